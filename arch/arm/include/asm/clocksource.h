@@ -3,6 +3,7 @@
 
 struct arch_clocksource_data {
 	bool vdso_direct;	/* Usable for direct VDSO access? */
+	bool vdso_gt;		/* Global timer, read through its page */
 };
 
 #endif
@@ -42,6 +42,7 @@
 #define L2X0_LOCKDOWN_WAY_D_BASE	0x900
 #define L2X0_LOCKDOWN_WAY_I_BASE	0x904
 #define L2X0_LOCKDOWN_STRIDE		0x08
+#define L310_LOCKDOWN_MASTERS		8
 #define L310_ADDR_FILTER_START		0xC00
 #define L310_ADDR_FILTER_END		0xC04
 #define L2X0_TEST_OPERATION		0xF00
@@ -154,6 +155,15 @@ static inline int l2x0_of_init(u32 aux_val, u32 aux_mask)
 }
 #endif
 
+#ifdef CONFIG_CACHE_L2X0
+extern int l2x0_pin_range(const void *start, size_t size);
+#else
+static inline int l2x0_pin_range(const void *start, size_t size)
+{
+	return -ENODEV;
+}
+#endif
+
 #ifdef CONFIG_CACHE_L2X0_PMU
 void l2x0_pmu_register(void __iomem *base, u32 part);
 void l2x0_pmu_suspend(void);
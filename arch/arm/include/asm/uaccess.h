@@ -512,11 +512,25 @@ do {									\
 extern unsigned long __must_check
 arm_copy_from_user(void *to, const void __user *from, unsigned long n);
 
+#ifdef CONFIG_ARM_NEON_UACCESS
+/* Copies of at least this many bytes use NEON (see uaccess_neon.c) */
+#define ARM_NEON_UACCESS_MIN	4096
+
+extern unsigned long __must_check
+arm_copy_from_user_neon(void *to, const void __user *from, unsigned long n);
+extern unsigned long __must_check
+arm_copy_to_user_neon(void __user *to, const void *from, unsigned long n);
+#endif
+
 static inline unsigned long __must_check
 raw_copy_from_user(void *to, const void __user *from, unsigned long n)
 {
 	unsigned int __ua_flags;
 
+#ifdef CONFIG_ARM_NEON_UACCESS
+	if (n >= ARM_NEON_UACCESS_MIN)
+		return arm_copy_from_user_neon(to, from, n);
+#endif
 	__ua_flags = uaccess_save_and_enable();
 	n = arm_copy_from_user(to, from, n);
 	uaccess_restore(__ua_flags);
@@ -531,6 +545,10 @@ __copy_to_user_std(void __user *to, const void *from, unsigned long n);
 static inline unsigned long __must_check
 raw_copy_to_user(void __user *to, const void *from, unsigned long n)
 {
+#ifdef CONFIG_ARM_NEON_UACCESS
+	if (n >= ARM_NEON_UACCESS_MIN)
+		return arm_copy_to_user_neon(to, from, n);
+#endif
 #ifndef CONFIG_UACCESS_WITH_MEMCPY
 	unsigned int __ua_flags;
 	__ua_flags = uaccess_save_and_enable();
@@ -35,6 +35,9 @@ struct vdso_data {
 	u64 xtime_clock_snsec;	/* CLOCK_REALTIME sub-ns base */
 	u32 tz_minuteswest;	/* timezone info for gettimeofday(2) */
 	u32 tz_dsttime;
+
+	u16 tk_is_gt;		/* global timer instead of CNTVCT */
+	u16 gt_offset;		/* counter in the page before this one */
 };
 
 union vdso_data_store {
@@ -12,6 +12,7 @@
 #include <linux/kernel.h>
 #include <linux/mm.h>
 #include <linux/of.h>
+#include <linux/of_address.h>
 #include <linux/printk.h>
 #include <linux/slab.h>
 #include <linux/timekeeper_internal.h>
@@ -33,6 +34,9 @@ extern char vdso_start[], vdso_end[];
 /* Total number of pages needed for the data and text portions of the VDSO. */
 unsigned int vdso_total_pages __ro_after_init;
 
+/* The data page, preceded by the global timer page if gt_ok */
+static unsigned int vvar_pages __ro_after_init = 1;
+
 /*
  * The VDSO data page.
  */
@@ -45,14 +49,39 @@ static const struct vm_special_mapping vdso_data_mapping = {
 	.pages = &vdso_data_page,
 };
 
+/* Physical address of the global timer registers (if gt_ok) */
+static phys_addr_t gt_phys __ro_after_init;
+
+static vm_fault_t vvar_gt_fault(const struct vm_special_mapping *sm,
+				struct vm_area_struct *vma,
+				struct vm_fault *vmf)
+{
+	switch (vmf->pgoff) {
+	case 0:
+		return vmf_insert_pfn_prot(vma, vmf->address,
+					   gt_phys >> PAGE_SHIFT,
+					   pgprot_device(vma->vm_page_prot));
+	case 1:
+		return vmf_insert_pfn(vma, vmf->address,
+				      page_to_pfn(vdso_data_page));
+	}
+
+	return VM_FAULT_SIGBUS;
+}
+
+static const struct vm_special_mapping vdso_data_gt_mapping = {
+	.name = "[vvar]",
+	.fault = vvar_gt_fault,
+};
+
 static int vdso_mremap(const struct vm_special_mapping *sm,
 		struct vm_area_struct *new_vma)
 {
 	unsigned long new_size = new_vma->vm_end - new_vma->vm_start;
 	unsigned long vdso_size;
 
-	/* without VVAR page */
-	vdso_size = (vdso_total_pages - 1) << PAGE_SHIFT;
+	/* without VVAR pages */
+	vdso_size = (vdso_total_pages - vvar_pages) << PAGE_SHIFT;
 
 	if (vdso_size != new_size)
 		return -EINVAL;
@@ -106,6 +135,33 @@ static bool __init cntvct_functional(void)
 	return ret;
 }
 
+/* Cached result of boot-time check for whether the global timer can be
+ * read from the VDSO instead (Cortex-A9).
+ */
+static bool gt_ok __ro_after_init;
+
+static bool __init gt_functional(void)
+{
+	struct device_node *np;
+	struct resource res;
+	bool ret = false;
+
+	if (!IS_ENABLED(CONFIG_ARM_GLOBAL_TIMER_VDSO))
+		return false;
+
+	np = of_find_compatible_node(NULL, NULL, "arm,cortex-a9-global-timer");
+	if (!np)
+		return false;
+
+	if (!of_address_to_resource(np, 0, &res)) {
+		gt_phys = res.start;
+		ret = true;
+	}
+
+	of_node_put(np);
+	return ret;
+}
+
 static void * __init find_section(Elf32_Ehdr *ehdr, const char *name,
 				  unsigned long *size)
 {
@@ -177,7 +233,7 @@ static void __init patch_vdso(void *ehdr)
 	 * want programs to incur the slight additional overhead of
 	 * dispatching through the VDSO only to fall back to syscalls.
 	 */
-	if (!cntvct_ok) {
+	if (!cntvct_ok && !gt_ok) {
 		vdso_nullpatch_one(&einfo, "__vdso_gettimeofday");
 		vdso_nullpatch_one(&einfo, "__vdso_clock_gettime");
 	}
@@ -214,10 +270,15 @@ static int __init vdso_init(void)
 
 	vdso_text_mapping.pages = vdso_text_pagelist;
 
-	vdso_total_pages = 1; /* for the data/vvar page */
-	vdso_total_pages += text_pages;
-
 	cntvct_ok = cntvct_functional();
+	gt_ok = !cntvct_ok && gt_functional();
+	if (gt_ok) {
+		vvar_pages = 2;
+		vdso_data->gt_offset = offset_in_page(gt_phys);
+	}
+
+	vdso_total_pages = vvar_pages; /* for the data/vvar pages */
+	vdso_total_pages += text_pages;
 
 	patch_vdso(vdso_start);
 
@@ -229,9 +290,15 @@ static int install_vvar(struct mm_struct *mm, unsigned long addr)
 {
 	struct vm_area_struct *vma;
 
-	vma = _install_special_mapping(mm, addr, PAGE_SIZE,
-				       VM_READ | VM_MAYREAD,
-				       &vdso_data_mapping);
+	if (gt_ok)
+		vma = _install_special_mapping(mm, addr, 2 * PAGE_SIZE,
+					       VM_READ | VM_MAYREAD | VM_IO |
+					       VM_PFNMAP | VM_DONTDUMP,
+					       &vdso_data_gt_mapping);
+	else
+		vma = _install_special_mapping(mm, addr, PAGE_SIZE,
+					       VM_READ | VM_MAYREAD,
+					       &vdso_data_mapping);
 
 	return PTR_ERR_OR_ZERO(vma);
 }
@@ -250,9 +317,9 @@ void arm_install_vdso(struct mm_struct *mm, unsigned long addr)
 	if (install_vvar(mm, addr))
 		return;
 
-	/* Account for vvar page. */
-	addr += PAGE_SIZE;
-	len = (vdso_total_pages - 1) << PAGE_SHIFT;
+	/* Account for vvar pages. */
+	addr += vvar_pages << PAGE_SHIFT;
+	len = (vdso_total_pages - vvar_pages) << PAGE_SHIFT;
 
 	vma = _install_special_mapping(mm, addr, len,
 		VM_READ | VM_EXEC | VM_MAYREAD | VM_MAYWRITE | VM_MAYEXEC,
@@ -285,13 +352,18 @@ static bool tk_is_cntvct(const struct timekeeper *tk)
 	return true;
 }
 
+static bool tk_is_gt(const struct timekeeper *tk)
+{
+	return gt_ok && tk->tkr_mono.clock->archdata.vdso_gt;
+}
+
 /**
  * update_vsyscall - update the vdso data page
  *
  * Increment the sequence counter, making it odd, indicating to
  * userspace that an update is in progress.  Update the fields used
- * for coarse clocks and, if the architected system timer is in use,
- * the fields used for high precision clocks.  Increment the sequence
+ * for coarse clocks and, if the architected system timer or the
+ * global timer is in use, the fields used for high precision clocks.  Increment the sequence
  * counter again, making it even, indicating to userspace that the
  * update is finished.
  *
@@ -307,7 +379,7 @@ void update_vsyscall(struct timekeeper *tk)
 {
 	struct timespec64 *wtm = &tk->wall_to_monotonic;
 
-	if (!cntvct_ok) {
+	if (!cntvct_ok && !gt_ok) {
 		/* The entry points have been zeroed, so there is no
 		 * point in updating the data page.
 		 */
@@ -317,13 +389,14 @@ void update_vsyscall(struct timekeeper *tk)
 	vdso_write_begin(vdso_data);
 
 	vdso_data->tk_is_cntvct			= tk_is_cntvct(tk);
+	vdso_data->tk_is_gt			= tk_is_gt(tk);
 	vdso_data->xtime_coarse_sec		= tk->xtime_sec;
 	vdso_data->xtime_coarse_nsec		= (u32)(tk->tkr_mono.xtime_nsec >>
 							tk->tkr_mono.shift);
 	vdso_data->wtm_clock_sec		= wtm->tv_sec;
 	vdso_data->wtm_clock_nsec		= wtm->tv_nsec;
 
-	if (vdso_data->tk_is_cntvct) {
+	if (vdso_data->tk_is_cntvct || vdso_data->tk_is_gt) {
 		vdso_data->cs_cycle_last	= tk->tkr_mono.cycle_last;
 		vdso_data->xtime_clock_sec	= tk->xtime_sec;
 		vdso_data->xtime_clock_snsec	= tk->tkr_mono.xtime_nsec;
@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ *  linux/arch/arm/lib/crc32-neon.c
+ *
+ *  crc32_le() and __crc32c_le() with NEON.
+ *
+ *  lib/crc32.c declares both weak, so these replace the table driven
+ *  versions for all users: UBIFS, JFFS2, the crc32 and crc32c shash
+ *  drivers of crypto/ and the network drivers.
+ */
+
+#include <linux/crc32.h>
+#include <linux/init.h>
+#include <linux/jump_label.h>
+#include <linux/kernel.h>
+#include <linux/sizes.h>
+#include <asm/neon.h>
+#include <asm/simd.h>
+
+/* Below this, the table lookup wins over kernel_neon_begin() */
+#define CRC32_NEON_MIN_LEN	256
+
+/*
+ * Bytes folded per kernel_neon_begin()/kernel_neon_end() pair, to bound
+ * the time with preemption disabled
+ */
+#define CRC32_NEON_CHUNK	SZ_16K
+
+asmlinkage u32 crc32_neon_le(const u8 buf[], u32 len, u32 init_crc);
+asmlinkage u32 crc32c_neon_le(const u8 buf[], u32 len, u32 init_crc);
+
+/* The generic versions in lib/crc32.c */
+u32 __pure crc32_le_base(u32 crc, unsigned char const *p, size_t len);
+u32 __pure __crc32c_le_base(u32 crc, unsigned char const *p, size_t len);
+
+static DEFINE_STATIC_KEY_FALSE(crc32_use_neon);
+
+static u32 crc32_neon_update(u32 crc, const u8 *p, size_t len,
+			     u32 (*neon)(const u8 [], u32, u32),
+			     u32 (*base)(u32, unsigned char const *, size_t))
+{
+	unsigned int l;
+
+	/* The folding loads 16 byte aligned blocks */
+	if ((uintptr_t)p % 16) {
+		l = 16 - (uintptr_t)p % 16;
+
+		crc = base(crc, p, l);
+		p += l;
+		len -= l;
+	}
+
+	while (len >= 64) {
+		l = min_t(size_t, round_down(len, 16), CRC32_NEON_CHUNK);
+
+		kernel_neon_begin();
+		crc = neon(p, l, crc);
+		kernel_neon_end();
+
+		p += l;
+		len -= l;
+	}
+
+	if (len)
+		crc = base(crc, p, len);
+
+	return crc;
+}
+
+u32 __pure crc32_le(u32 crc, unsigned char const *p, size_t len)
+{
+	if (!static_branch_likely(&crc32_use_neon) ||
+	    len < CRC32_NEON_MIN_LEN || !may_use_simd())
+		return crc32_le_base(crc, p, len);
+
+	return crc32_neon_update(crc, p, len, crc32_neon_le, crc32_le_base);
+}
+
+u32 __pure __crc32c_le(u32 crc, unsigned char const *p, size_t len)
+{
+	if (!static_branch_likely(&crc32_use_neon) ||
+	    len < CRC32_NEON_MIN_LEN || !may_use_simd())
+		return __crc32c_le_base(crc, p, len);
+
+	return crc32_neon_update(crc, p, len, crc32c_neon_le,
+				 __crc32c_le_base);
+}
+
+static int __init crc32_neon_init(void)
+{
+	if (cpu_has_neon())
+		static_branch_enable(&crc32_use_neon);
+	return 0;
+}
+core_initcall(crc32_neon_init);
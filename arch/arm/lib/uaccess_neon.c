@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ *  linux/arch/arm/lib/uaccess_neon.c
+ *
+ *  copy_{from,to}_user() of large blocks with NEON.
+ *
+ *  The integer loops of copy_template.S move 32 bytes per ldm/stm pair.
+ *  The NEON loop moves 64 bytes per iteration and keeps the load and
+ *  store units busier, which gets multi-megabyte copies closer to the
+ *  memory bandwidth on Cortex-A9.
+ */
+
+#include <linux/export.h>
+#include <linux/hardirq.h>
+#include <linux/kernel.h>
+#include <linux/sizes.h>
+#include <linux/uaccess.h>
+#include <asm/neon.h>
+
+/*
+ * Bytes copied per kernel_neon_begin()/kernel_neon_end() pair. Preemption
+ * is disabled in between, so this bounds the added latency (a few tens of
+ * microseconds).
+ */
+#define NEON_UACCESS_CHUNK	SZ_16K
+
+asmlinkage unsigned long __copy_from_user_neon(void *to,
+		const void __user *from, unsigned long n);
+asmlinkage unsigned long __copy_to_user_neon(void __user *to,
+		const void *from, unsigned long n);
+
+/*
+ * A fault in the NEON loop only reports the block. The integer copy then
+ * takes over for the rest of the chunk: it may sleep to fault the page in,
+ * and it stops at the exact byte if the address is bad.
+ */
+unsigned long arm_copy_from_user_neon(void *to, const void __user *from,
+				      unsigned long n)
+{
+	unsigned int ua_flags;
+	unsigned long chunk, left;
+
+	/* Like arm_copy_from_user() does it in assembly */
+	if (IS_ENABLED(CONFIG_CPU_SPECTRE))
+		from = uaccess_mask_range_ptr(from, n);
+
+	ua_flags = uaccess_save_and_enable();
+
+	if (in_interrupt())
+		goto out_std;
+
+	while (n >= 64) {
+		chunk = min_t(unsigned long, n, NEON_UACCESS_CHUNK) & ~63UL;
+
+		pagefault_disable();
+		kernel_neon_begin();
+		left = __copy_from_user_neon(to, from, chunk);
+		kernel_neon_end();
+		pagefault_enable();
+
+		if (left) {
+			left = arm_copy_from_user(to + chunk - left,
+						  from + chunk - left, left);
+			if (left) {
+				n -= chunk - left;
+				goto out;
+			}
+		}
+
+		to += chunk;
+		from += chunk;
+		n -= chunk;
+	}
+
+out_std:
+	if (n)
+		n = arm_copy_from_user(to, from, n);
+out:
+	uaccess_restore(ua_flags);
+	return n;
+}
+EXPORT_SYMBOL(arm_copy_from_user_neon);
+
+unsigned long arm_copy_to_user_neon(void __user *to, const void *from,
+				    unsigned long n)
+{
+	unsigned int ua_flags;
+	unsigned long chunk, left;
+
+	if (IS_ENABLED(CONFIG_CPU_SPECTRE))
+		to = uaccess_mask_range_ptr(to, n);
+
+	ua_flags = uaccess_save_and_enable();
+
+	if (in_interrupt())
+		goto out_std;
+
+	while (n >= 64) {
+		chunk = min_t(unsigned long, n, NEON_UACCESS_CHUNK) & ~63UL;
+
+		pagefault_disable();
+		kernel_neon_begin();
+		left = __copy_to_user_neon(to, from, chunk);
+		kernel_neon_end();
+		pagefault_enable();
+
+		if (left) {
+			left = __copy_to_user_std(to + chunk - left,
+						  from + chunk - left, left);
+			if (left) {
+				n -= chunk - left;
+				goto out;
+			}
+		}
+
+		to += chunk;
+		from += chunk;
+		n -= chunk;
+	}
+
+out_std:
+	if (n)
+		n = __copy_to_user_std(to, from, n);
+out:
+	uaccess_restore(ua_flags);
+	return n;
+}
+EXPORT_SYMBOL(arm_copy_to_user_neon);
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ *  linux/arch/arm/lib/uaccess_neon_bench.c
+ *
+ *  Times arm_copy_{from,to}_user_neon() against the integer copies.
+ *  Load the module to run it; the results go to the kernel log as
+ *  "<direction> <size>: neon <MB/s> std <MB/s>".
+ */
+
+#define pr_fmt(fmt) KBUILD_MODNAME ": " fmt
+
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/mman.h>
+#include <linux/module.h>
+#include <linux/sizes.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#define BENCH_MAX_SIZE		SZ_4M
+/* Bytes moved per measurement */
+#define BENCH_TOTAL		SZ_64M
+
+typedef unsigned long (*bench_copy_fn)(void *kbuf, void __user *ubuf,
+				       unsigned long n);
+
+static unsigned long bench_to_user_neon(void *kbuf, void __user *ubuf,
+					unsigned long n)
+{
+	return arm_copy_to_user_neon(ubuf, kbuf, n);
+}
+
+static unsigned long bench_to_user_std(void *kbuf, void __user *ubuf,
+				       unsigned long n)
+{
+	unsigned int ua_flags = uaccess_save_and_enable();
+
+	n = arm_copy_to_user(ubuf, kbuf, n);
+	uaccess_restore(ua_flags);
+	return n;
+}
+
+static unsigned long bench_from_user_neon(void *kbuf, void __user *ubuf,
+					  unsigned long n)
+{
+	return arm_copy_from_user_neon(kbuf, ubuf, n);
+}
+
+static unsigned long bench_from_user_std(void *kbuf, void __user *ubuf,
+					 unsigned long n)
+{
+	unsigned int ua_flags = uaccess_save_and_enable();
+
+	n = arm_copy_from_user(kbuf, ubuf, n);
+	uaccess_restore(ua_flags);
+	return n;
+}
+
+/* Returns MB/s, or 0 if a copy failed */
+static u64 bench_run(bench_copy_fn fn, void *kbuf, void __user *ubuf,
+		     unsigned long size)
+{
+	unsigned long i, loops = BENCH_TOTAL / size;
+	u64 t0, ns;
+
+	t0 = ktime_get_ns();
+	for (i = 0; i < loops; i++) {
+		if (fn(kbuf, ubuf, size))
+			return 0;
+		cond_resched();
+	}
+	ns = ktime_get_ns() - t0;
+
+	return div64_u64((u64)BENCH_TOTAL * 1000, max_t(u64, ns, 1));
+}
+
+static void bench_pair(const char *name, bench_copy_fn neon,
+		       bench_copy_fn std, void *kbuf, void __user *ubuf)
+{
+	unsigned long size;
+
+	for (size = SZ_4K; size <= BENCH_MAX_SIZE; size *= 4)
+		pr_info("%s %lu: neon %llu std %llu\n", name, size,
+			bench_run(neon, kbuf, ubuf, size),
+			bench_run(std, kbuf, ubuf, size));
+}
+
+static int __init uaccess_neon_bench_init(void)
+{
+	unsigned long uaddr;
+	void __user *ubuf;
+	void *kbuf;
+
+	kbuf = vmalloc(BENCH_MAX_SIZE);
+	if (!kbuf)
+		return -ENOMEM;
+	memset(kbuf, 0x5a, BENCH_MAX_SIZE);
+
+	uaddr = vm_mmap(NULL, 0, BENCH_MAX_SIZE, PROT_READ | PROT_WRITE,
+			MAP_ANONYMOUS | MAP_PRIVATE, 0);
+	if (IS_ERR_VALUE(uaddr)) {
+		vfree(kbuf);
+		return -ENOMEM;
+	}
+	ubuf = (void __user *)uaddr;
+
+	/* Fault the user pages in, so that page faults are not timed */
+	if (copy_to_user(ubuf, kbuf, BENCH_MAX_SIZE)) {
+		pr_err("failed to populate the user buffer\n");
+	} else {
+		bench_pair("to_user", bench_to_user_neon, bench_to_user_std,
+			   kbuf, ubuf);
+		bench_pair("from_user", bench_from_user_neon,
+			   bench_from_user_std, kbuf, ubuf);
+	}
+
+	vm_munmap(uaddr, BENCH_MAX_SIZE);
+	vfree(kbuf);
+
+	return -EAGAIN;
+}
+module_init(uaccess_neon_bench_init);
+
+MODULE_DESCRIPTION("Benchmark of the NEON copy_{from,to}_user()");
+MODULE_LICENSE("GPL");
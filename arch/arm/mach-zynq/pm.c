@@ -9,6 +9,10 @@
 
 #include <linux/clk/zynq.h>
 #include <linux/genalloc.h>
+#include <linux/ktime.h>
+#include <linux/platform_device.h>
+#include <linux/pm.h>
+#include <linux/string.h>
 #include <linux/suspend.h>
 #include <asm/cacheflush.h>
 #include <asm/fncpy.h>
@@ -32,6 +36,7 @@ static void __iomem *ddrc_base;
 
 #ifdef CONFIG_SUSPEND
 static int (*zynq_suspend_ptr)(void __iomem *, void __iomem *);
+static ktime_t zynq_pm_wake_time;
 
 static int zynq_pm_prepare_late(void)
 {
@@ -40,7 +45,82 @@ static int zynq_pm_prepare_late(void)
 
 static void zynq_pm_wake(void)
 {
+	zynq_pm_wake_time = ktime_get();
 	zynq_clk_resume_late();
+	pm_pr_dbg("zynq: clocks restored in %lld us\n",
+		  ktime_us_delta(ktime_get(), zynq_pm_wake_time));
+}
+
+/*
+ * Report the time from platform wake until the PM core has resumed all
+ * devices and thawed tasks. Per-device times come from pm_print_times.
+ */
+static int zynq_pm_notify(struct notifier_block *nb, unsigned long action,
+			  void *data)
+{
+	if (action == PM_POST_SUSPEND && zynq_pm_wake_time) {
+		pm_pr_dbg("zynq: wake to ready in %lld us\n",
+			  ktime_us_delta(ktime_get(), zynq_pm_wake_time));
+		zynq_pm_wake_time = 0;
+	}
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block zynq_pm_nb = {
+	.notifier_call = zynq_pm_notify,
+};
+
+/*
+ * Platform devices on Zynq hang off the AMBA simple-bus and resume
+ * independently of each other, so let the PM core resume them in
+ * parallel. Devices with regulator supplies stay synchronous: there are
+ * no device links to order them after a PMIC on another bus.
+ */
+static bool zynq_pm_async_ok(struct device *dev)
+{
+	static const char suffix[] = "-supply";
+	struct property *prop;
+	size_t len;
+
+	if (!dev->of_node)
+		return false;
+
+	for_each_property_of_node(dev->of_node, prop) {
+		len = strlen(prop->name);
+		if (len > sizeof(suffix) - 1 &&
+		    !strcmp(prop->name + len - (sizeof(suffix) - 1), suffix))
+			return false;
+	}
+
+	return true;
+}
+
+static int zynq_pm_enable_async(struct device *dev, void *data)
+{
+	if (zynq_pm_async_ok(dev))
+		device_enable_async_suspend(dev);
+
+	return 0;
+}
+
+static int zynq_pm_bus_notify(struct notifier_block *nb,
+			      unsigned long action, void *data)
+{
+	if (action == BUS_NOTIFY_ADD_DEVICE)
+		zynq_pm_enable_async(data, NULL);
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block zynq_pm_bus_nb = {
+	.notifier_call = zynq_pm_bus_notify,
+};
+
+static void zynq_pm_async_init(void)
+{
+	bus_register_notifier(&platform_bus_type, &zynq_pm_bus_nb);
+	bus_for_each_dev(&platform_bus_type, NULL, NULL, zynq_pm_enable_async);
 }
 
 static int zynq_pm_suspend(unsigned long arg)
@@ -183,6 +263,8 @@ static void zynq_pm_suspend_init(void)
 					 zynq_sys_suspend_sz);
 	}
 
+	zynq_pm_async_init();
+	register_pm_notifier(&zynq_pm_nb);
 	suspend_set_ops(&zynq_pm_ops);
 }
 #else	/* CONFIG_SUSPEND */
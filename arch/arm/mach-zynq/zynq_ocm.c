@@ -22,6 +22,9 @@
 #include <linux/of_irq.h>
 #include <linux/platform_device.h>
 #include <linux/genalloc.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/slab.h>
 
 #include "common.h"
 
@@ -44,6 +47,106 @@ struct zynq_ocm_dev {
 	int irq;
 	struct gen_pool *pool;
 	struct resource res[ZYNQ_OCM_BLOCKS];
+	struct miscdevice miscdev;
+};
+
+/**
+ * struct zynq_ocm_map - OCM chunk backing a userspace mapping
+ * @zynq_ocm:	OCM device the chunk was allocated from
+ * @vaddr:	kernel address of the chunk
+ * @size:	size of the chunk
+ * @users:	number of VMAs sharing the chunk, e.g. after fork
+ */
+struct zynq_ocm_map {
+	struct zynq_ocm_dev *zynq_ocm;
+	unsigned long vaddr;
+	size_t size;
+	atomic_t users;
+};
+
+static void zynq_ocm_vm_open(struct vm_area_struct *vma)
+{
+	struct zynq_ocm_map *map = vma->vm_private_data;
+
+	atomic_inc(&map->users);
+}
+
+static void zynq_ocm_vm_close(struct vm_area_struct *vma)
+{
+	struct zynq_ocm_map *map = vma->vm_private_data;
+
+	if (!atomic_dec_and_test(&map->users))
+		return;
+
+	gen_pool_free(map->zynq_ocm->pool, map->vaddr, map->size);
+	kfree(map);
+}
+
+static const struct vm_operations_struct zynq_ocm_vm_ops = {
+	.open = zynq_ocm_vm_open,
+	.close = zynq_ocm_vm_close,
+};
+
+/**
+ * zynq_ocm_mmap - Map a fresh OCM chunk into userspace
+ * @file:	Pointer to the file structure
+ * @vma:	Pointer to the VMA to fill
+ *
+ * Every mmap() of the device allocates a new, zeroed, page aligned chunk of
+ * the size of the mapping from the OCM pool. The chunk is mapped uncached
+ * and returns to the pool when the last mapping of it goes away.
+ *
+ * Return:	0 on success and error value on failure
+ */
+static int zynq_ocm_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	struct zynq_ocm_dev *zynq_ocm = container_of(file->private_data,
+						     struct zynq_ocm_dev,
+						     miscdev);
+	struct genpool_data_align align = { .align = PAGE_SIZE };
+	size_t size = vma->vm_end - vma->vm_start;
+	struct zynq_ocm_map *map;
+	phys_addr_t phys;
+	int ret;
+
+	if (vma->vm_pgoff)
+		return -EINVAL;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map)
+		return -ENOMEM;
+
+	map->vaddr = gen_pool_alloc_algo(zynq_ocm->pool, size,
+					 gen_pool_first_fit_align, &align);
+	if (!map->vaddr) {
+		kfree(map);
+		return -ENOMEM;
+	}
+	map->zynq_ocm = zynq_ocm;
+	map->size = size;
+	atomic_set(&map->users, 1);
+	memset_io((void __iomem *)map->vaddr, 0, size);
+
+	phys = gen_pool_virt_to_phys(zynq_ocm->pool, map->vaddr);
+	vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+	vma->vm_flags |= VM_IO | VM_DONTEXPAND | VM_DONTDUMP;
+	ret = remap_pfn_range(vma, vma->vm_start, PHYS_PFN(phys), size,
+			      vma->vm_page_prot);
+	if (ret) {
+		gen_pool_free(zynq_ocm->pool, map->vaddr, size);
+		kfree(map);
+		return ret;
+	}
+
+	vma->vm_private_data = map;
+	vma->vm_ops = &zynq_ocm_vm_ops;
+
+	return 0;
+}
+
+static const struct file_operations zynq_ocm_fops = {
+	.owner = THIS_MODULE,
+	.mmap = zynq_ocm_mmap,
 };
 
 /**
@@ -200,6 +303,19 @@ static int zynq_ocm_probe(struct platform_device *pdev)
 
 	platform_set_drvdata(pdev, zynq_ocm);
 
+	/*
+	 * Kernel users find the pool through a phandle to this node with
+	 * of_gen_pool_get(), userspace maps chunks of it through the misc
+	 * device.
+	 */
+	zynq_ocm->miscdev.minor = MISC_DYNAMIC_MINOR;
+	zynq_ocm->miscdev.name = "zynq-ocm";
+	zynq_ocm->miscdev.fops = &zynq_ocm_fops;
+	zynq_ocm->miscdev.parent = &pdev->dev;
+	ret = misc_register(&zynq_ocm->miscdev);
+	if (ret)
+		dev_warn(&pdev->dev, "Unable to register misc device\n");
+
 	return 0;
 }
 
@@ -217,6 +333,9 @@ static int zynq_ocm_remove(struct platform_device *pdev)
 {
 	struct zynq_ocm_dev *zynq_ocm = platform_get_drvdata(pdev);
 
+	if (!IS_ERR_OR_NULL(zynq_ocm->miscdev.this_device))
+		misc_deregister(&zynq_ocm->miscdev);
+
 	if (gen_pool_avail(zynq_ocm->pool) < gen_pool_size(zynq_ocm->pool))
 		dev_dbg(&pdev->dev, "removed while SRAM allocated\n");
 
@@ -8,6 +8,7 @@
 #include <linux/hrtimer.h>
 #include <linux/io.h>
 #include <linux/list.h>
+#include <linux/moduleparam.h>
 #include <linux/perf_event.h>
 #include <linux/printk.h>
 #include <linux/slab.h>
@@ -15,6 +16,9 @@
 
 #include <asm/hardware/cache-l2x0.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/l2x0.h>
+
 #define PMU_NR_COUNTERS 2
 
 static void __iomem *l2x0_base;
@@ -26,6 +30,26 @@ static const char *l2x0_name;
 static ktime_t l2x0_pmu_poll_period;
 static struct hrtimer l2x0_pmu_hrtimer;
 
+/*
+ * Poll period in microseconds while sampling. Every poll emits the
+ * l2x0_pmu_sample tracepoint with the events of each active counter since
+ * the previous poll. Together with the timestamps of other tracepoints
+ * (e.g. lockamp_drain_*), this shows how the L2 behaves around DMA bursts.
+ * The counters cannot tell the masters apart, so run e.g.
+ *
+ *   perf record -a -e l2c_310/co/ -e l2c_310/wa/ -e l2x0:l2x0_pmu_sample \
+ *               -e lockamp:lockamp_drain_end
+ *
+ * 0 keeps the default period of one second. A new value takes effect at the
+ * next poll.
+ */
+static unsigned int sample_us;
+module_param(sample_us, uint, 0644);
+MODULE_PARM_DESC(sample_us, "L2 counter sample period in microseconds (0 = 1 s)");
+
+/* Keep the CPU that owns the timer usable */
+#define L2X0_PMU_SAMPLE_MIN_US 50
+
 /*
  * The L220/PL310 PMU has two equivalent counters, Counter1 and Counter0.
  * Registers controlling these are laid out in pairs, in descending order, i.e.
@@ -148,6 +172,16 @@ static void l2x0_pmu_event_configure(struct perf_event *event)
 	l2x0_pmu_counter_write(hw->idx, 0);
 }
 
+static ktime_t l2x0_pmu_period(void)
+{
+	unsigned int us = READ_ONCE(sample_us);
+
+	if (!us)
+		return l2x0_pmu_poll_period;
+
+	return us_to_ktime(max_t(unsigned int, us, L2X0_PMU_SAMPLE_MIN_US));
+}
+
 static enum hrtimer_restart l2x0_pmu_poll(struct hrtimer *hrtimer)
 {
 	unsigned long flags;
@@ -158,18 +192,23 @@ static enum hrtimer_restart l2x0_pmu_poll(struct hrtimer *hrtimer)
 
 	for (i = 0; i < PMU_NR_COUNTERS; i++) {
 		struct perf_event *event = events[i];
+		u64 count;
 
 		if (!event)
 			continue;
 
+		count = local64_read(&event->count);
 		l2x0_pmu_event_read(event);
 		l2x0_pmu_event_configure(event);
+
+		trace_l2x0_pmu_sample(i, event->hw.config_base,
+				      local64_read(&event->count) - count);
 	}
 
 	__l2x0_pmu_enable();
 	local_irq_restore(flags);
 
-	hrtimer_forward_now(hrtimer, l2x0_pmu_poll_period);
+	hrtimer_forward_now(hrtimer, l2x0_pmu_period());
 	return HRTIMER_RESTART;
 }
 
@@ -240,7 +279,7 @@ static int l2x0_pmu_event_add(struct perf_event *event, int flags)
 	 * attribute).
 	 */
 	if (l2x0_pmu_num_active_counters() == 0)
-		hrtimer_start(&l2x0_pmu_hrtimer, l2x0_pmu_poll_period,
+		hrtimer_start(&l2x0_pmu_hrtimer, l2x0_pmu_period(),
 			      HRTIMER_MODE_REL_PINNED);
 
 	events[idx] = event;
@@ -7,6 +7,8 @@
 #include <linux/cpu.h>
 #include <linux/err.h>
 #include <linux/init.h>
+#include <linux/kobject.h>
+#include <linux/mutex.h>
 #include <linux/smp.h>
 #include <linux/spinlock.h>
 #include <linux/log2.h>
@@ -48,6 +50,17 @@ struct l2x0_regs l2x0_saved_regs;
 static bool l2x0_bresp_disable;
 static bool l2x0_flz_disable;
 
+/*
+ * Lockdown by master: the ways that master i (CPU i; see the TRM of the
+ * SoC for the ACP) must not allocate into. From "arm,lockdown-ways" and
+ * /sys/kernel/l2x0/. The ways of l2x0_pin_range() are locked for all
+ * masters on top. Only used on L2C-310 with non-secure lockdown access.
+ */
+static u32 l2x0_lockdown[L310_LOCKDOWN_MASTERS];
+static u32 l2x0_pinned_ways;
+static bool l2x0_lockdown_ok;
+static DEFINE_MUTEX(l2x0_pin_mutex);
+
 /*
  * Common code for all cache controllers.
  */
@@ -88,16 +101,28 @@ static void __l2c_op_way(void __iomem *reg)
 	l2c_wait_mask(reg, l2x0_way_mask);
 }
 
+static inline void l2c_write_lockdown(void __iomem *base, unsigned i, u32 val)
+{
+	writel_relaxed(val, base + L2X0_LOCKDOWN_WAY_D_BASE +
+		       i * L2X0_LOCKDOWN_STRIDE);
+	writel_relaxed(val, base + L2X0_LOCKDOWN_WAY_I_BASE +
+		       i * L2X0_LOCKDOWN_STRIDE);
+}
+
+static inline u32 l2c_lockdown_val(unsigned i)
+{
+	if (i >= ARRAY_SIZE(l2x0_lockdown))
+		return 0;
+	return (l2x0_lockdown[i] | l2x0_pinned_ways) & l2x0_way_mask;
+}
+
+/* Reset the lockdown to the configured one (none by default) */
 static inline void l2c_unlock(void __iomem *base, unsigned num)
 {
 	unsigned i;
 
-	for (i = 0; i < num; i++) {
-		writel_relaxed(0, base + L2X0_LOCKDOWN_WAY_D_BASE +
-			       i * L2X0_LOCKDOWN_STRIDE);
-		writel_relaxed(0, base + L2X0_LOCKDOWN_WAY_I_BASE +
-			       i * L2X0_LOCKDOWN_STRIDE);
-	}
+	for (i = 0; i < num; i++)
+		l2c_write_lockdown(base, i, l2c_lockdown_val(i));
 }
 
 static void l2c_configure(void __iomem *base)
@@ -881,6 +906,13 @@ static int __init __l2c_init(const struct l2c_init_data *data,
 	/* Re-read it in case some bits are reserved. */
 	aux = readl_relaxed(l2x0_base + L2X0_AUX_CTRL);
 
+	/* The controller may have been enabled before us (see above) */
+	if ((cache_id & L2X0_CACHE_ID_PART_MASK) == L2X0_CACHE_ID_PART_L310 &&
+	    (aux & L310_AUX_CTRL_NS_LOCKDOWN)) {
+		l2x0_lockdown_ok = true;
+		l2c_unlock(l2x0_base, data->num_lock);
+	}
+
 	pr_info("%s cache controller enabled, %d ways, %d kB\n",
 		data->type, ways, l2x0_size >> 10);
 	pr_info("%s: CACHE_ID 0x%08x, AUX_CTRL 0x%08x\n",
@@ -922,6 +954,164 @@ void __init l2x0_init(void __iomem *base, u32 aux_val, u32 aux_mask)
 	__l2c_init(data, aux_val, aux_mask, cache_id, false);
 }
 
+/**
+ * l2x0_pin_range() - keep a kernel region in the L2 cache
+ * @start: start of the region (in the linear mapping)
+ * @size: size of the region
+ *
+ * Load the region into ways of its own and lock these ways for all
+ * masters, so that the lines are never evicted. Each way holds one
+ * way size (64 KiB on Zynq) and at least one way is left for normal
+ * use. Call this before the region is in use: lines that another CPU
+ * pulls into an unlocked way in the meantime are not pinned. The pins
+ * do not survive a power down of the L2 cache.
+ */
+int l2x0_pin_range(const void *start, size_t size)
+{
+	unsigned way_size, len, cpu, way;
+	const void *p;
+	unsigned long flags;
+	u32 free_ways;
+	int ret = 0;
+
+	if (!l2x0_lockdown_ok)
+		return -ENODEV;
+	if (!size || !virt_addr_valid(start) ||
+	    !virt_addr_valid(start + size - 1))
+		return -EINVAL;
+
+	way_size = l2x0_size / hweight32(l2x0_way_mask);
+
+	mutex_lock(&l2x0_pin_mutex);
+	while (size) {
+		free_ways = l2x0_way_mask & ~l2x0_pinned_ways;
+		if (hweight32(free_ways) < 2) {
+			ret = -ENOSPC;
+			break;
+		}
+		way = fls(free_ways) - 1;
+		len = min_t(size_t, size, way_size);
+
+		local_irq_save(flags);
+		cpu = smp_processor_id();
+
+		/* Nobody else allocates into the way, this CPU only there */
+		raw_spin_lock(&l2x0_lock);
+		l2x0_pinned_ways |= BIT(way);
+		l2c_unlock(l2x0_base, l2x0_data->num_lock);
+		l2c_write_lockdown(l2x0_base, cpu, l2x0_way_mask & ~BIT(way));
+		raw_spin_unlock(&l2x0_lock);
+
+		/* Drop the lines from the other ways and load them again */
+		__cpuc_flush_dcache_area((void *)start, len);
+		outer_flush_range(__pa(start), __pa(start) + len);
+		for (p = start; p < start + len; p += CACHE_LINE_SIZE)
+			(void)READ_ONCE(*(const u32 *)p);
+		dsb();
+
+		raw_spin_lock(&l2x0_lock);
+		l2c_write_lockdown(l2x0_base, cpu, l2c_lockdown_val(cpu));
+		raw_spin_unlock(&l2x0_lock);
+		local_irq_restore(flags);
+
+		pr_info("L2C: pinned %u bytes at %pS in way %u\n", len, start,
+			way);
+		start += len;
+		size -= len;
+	}
+	mutex_unlock(&l2x0_pin_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(l2x0_pin_range);
+
+static ssize_t lockdown_show(struct kobject *kobj, struct kobj_attribute *attr,
+			     char *buf);
+static ssize_t lockdown_store(struct kobject *kobj,
+			      struct kobj_attribute *attr,
+			      const char *buf, size_t count);
+
+#define L2X0_LOCKDOWN_ATTR(_n)						\
+	__ATTR(lockdown_master##_n, 0644, lockdown_show, lockdown_store)
+
+static struct kobj_attribute l2x0_lockdown_attrs[L310_LOCKDOWN_MASTERS] = {
+	L2X0_LOCKDOWN_ATTR(0), L2X0_LOCKDOWN_ATTR(1),
+	L2X0_LOCKDOWN_ATTR(2), L2X0_LOCKDOWN_ATTR(3),
+	L2X0_LOCKDOWN_ATTR(4), L2X0_LOCKDOWN_ATTR(5),
+	L2X0_LOCKDOWN_ATTR(6), L2X0_LOCKDOWN_ATTR(7),
+};
+
+static ssize_t lockdown_show(struct kobject *kobj, struct kobj_attribute *attr,
+			     char *buf)
+{
+	unsigned i = attr - l2x0_lockdown_attrs;
+
+	return sprintf(buf, "0x%x\n", l2x0_lockdown[i]);
+}
+
+static ssize_t lockdown_store(struct kobject *kobj,
+			      struct kobj_attribute *attr,
+			      const char *buf, size_t count)
+{
+	unsigned i = attr - l2x0_lockdown_attrs;
+	unsigned long flags;
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 0, &val);
+	if (ret)
+		return ret;
+	if (val & ~l2x0_way_mask)
+		return -EINVAL;
+
+	raw_spin_lock_irqsave(&l2x0_lock, flags);
+	l2x0_lockdown[i] = val;
+	l2c_write_lockdown(l2x0_base, i, l2c_lockdown_val(i));
+	raw_spin_unlock_irqrestore(&l2x0_lock, flags);
+
+	return count;
+}
+
+static ssize_t pinned_ways_show(struct kobject *kobj,
+				struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "0x%x\n", l2x0_pinned_ways);
+}
+
+static struct kobj_attribute l2x0_pinned_ways_attr = __ATTR_RO(pinned_ways);
+
+static struct attribute *l2x0_lockdown_sysfs_attrs[] = {
+	&l2x0_lockdown_attrs[0].attr, &l2x0_lockdown_attrs[1].attr,
+	&l2x0_lockdown_attrs[2].attr, &l2x0_lockdown_attrs[3].attr,
+	&l2x0_lockdown_attrs[4].attr, &l2x0_lockdown_attrs[5].attr,
+	&l2x0_lockdown_attrs[6].attr, &l2x0_lockdown_attrs[7].attr,
+	&l2x0_pinned_ways_attr.attr,
+	NULL,
+};
+
+static const struct attribute_group l2x0_lockdown_group = {
+	.attrs = l2x0_lockdown_sysfs_attrs,
+};
+
+static int __init l2x0_lockdown_sysfs_init(void)
+{
+	struct kobject *kobj;
+	int ret;
+
+	if (!l2x0_lockdown_ok)
+		return 0;
+
+	kobj = kobject_create_and_add("l2x0", kernel_kobj);
+	if (!kobj)
+		return -ENOMEM;
+
+	ret = sysfs_create_group(kobj, &l2x0_lockdown_group);
+	if (ret)
+		kobject_put(kobj);
+	return ret;
+}
+late_initcall(l2x0_lockdown_sysfs_init);
+
 #ifdef CONFIG_OF
 static int l2_wt_override;
 
@@ -1159,6 +1349,11 @@ static void __init l2c310_of_parse(const struct device_node *np,
 					| L310_ADDR_FILTER_EN;
 	}
 
+	/* One mask of locked ways per master, starting with master 0 */
+	of_property_read_variable_u32_array(np, "arm,lockdown-ways",
+					    l2x0_lockdown, 1,
+					    ARRAY_SIZE(l2x0_lockdown));
+
 	ret = l2x0_cache_size_of_parse(np, aux_val, aux_mask, &assoc, SZ_512K);
 	if (!ret) {
 		switch (assoc) {
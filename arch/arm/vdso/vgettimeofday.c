@@ -103,7 +103,48 @@ static notrace int do_monotonic_coarse(struct timespec *ts,
 	return 0;
 }
 
+#if defined(CONFIG_ARM_ARCH_TIMER) || defined(CONFIG_ARM_GLOBAL_TIMER_VDSO)
+
+static notrace bool vdso_has_counter(const struct vdso_data *vdata)
+{
+	return vdata->tk_is_cntvct || vdata->tk_is_gt;
+}
+
+#ifdef CONFIG_ARM_GLOBAL_TIMER_VDSO
+/*
+ * The global timer page is mapped right before the data page. Like
+ * _gt_counter_read() in arm_global_timer.c.
+ */
+static notrace u64 gt_read(const struct vdso_data *vdata)
+{
+	const u32 *counter = (const void *)vdata - PAGE_SIZE +
+			     vdata->gt_offset;
+	u32 upper, old_upper, lower;
+
+	upper = READ_ONCE(counter[1]);
+	do {
+		old_upper = upper;
+		lower = READ_ONCE(counter[0]);
+		upper = READ_ONCE(counter[1]);
+	} while (upper != old_upper);
+
+	return ((u64)upper << 32) | lower;
+}
+#endif
+
+static notrace u64 read_cycles(const struct vdso_data *vdata)
+{
+#ifdef CONFIG_ARM_GLOBAL_TIMER_VDSO
+	if (vdata->tk_is_gt)
+		return gt_read(vdata);
+#endif
 #ifdef CONFIG_ARM_ARCH_TIMER
+	isb();
+	return read_sysreg(CNTVCT);
+#else
+	return 0;
+#endif
+}
 
 static notrace u64 get_ns(struct vdso_data *vdata)
 {
@@ -111,8 +152,7 @@ static notrace u64 get_ns(struct vdso_data *vdata)
 	u64 cycle_now;
 	u64 nsec;
 
-	isb();
-	cycle_now = read_sysreg(CNTVCT);
+	cycle_now = read_cycles(vdata);
 
 	cycle_delta = (cycle_now - vdata->cs_cycle_last) & vdata->cs_mask;
 
@@ -130,7 +170,7 @@ static notrace int do_realtime(struct timespec *ts, struct vdso_data *vdata)
 	do {
 		seq = vdso_read_begin(vdata);
 
-		if (!vdata->tk_is_cntvct)
+		if (!vdso_has_counter(vdata))
 			return -1;
 
 		ts->tv_sec = vdata->xtime_clock_sec;
@@ -153,7 +193,7 @@ static notrace int do_monotonic(struct timespec *ts, struct vdso_data *vdata)
 	do {
 		seq = vdso_read_begin(vdata);
 
-		if (!vdata->tk_is_cntvct)
+		if (!vdso_has_counter(vdata))
 			return -1;
 
 		ts->tv_sec = vdata->xtime_clock_sec;
@@ -171,7 +211,7 @@ static notrace int do_monotonic(struct timespec *ts, struct vdso_data *vdata)
 	return 0;
 }
 
-#else /* CONFIG_ARM_ARCH_TIMER */
+#else /* CONFIG_ARM_ARCH_TIMER || CONFIG_ARM_GLOBAL_TIMER_VDSO */
 
 static notrace int do_realtime(struct timespec *ts, struct vdso_data *vdata)
 {
@@ -183,7 +223,7 @@ static notrace int do_monotonic(struct timespec *ts, struct vdso_data *vdata)
 	return -1;
 }
 
-#endif /* CONFIG_ARM_ARCH_TIMER */
+#endif /* CONFIG_ARM_ARCH_TIMER || CONFIG_ARM_GLOBAL_TIMER_VDSO */
 
 notrace int __vdso_clock_gettime(clockid_t clkid, struct timespec *ts)
 {
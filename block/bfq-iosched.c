@@ -82,6 +82,13 @@
  * all low-latency heuristics for that device, by setting low_latency
  * to 0.
  *
+ * NOTE: on slow, high-latency flash (e.g., SD cards) that mixes long
+ * sequential writes with small sync reads, set read_idling to 0 and
+ * timeout_async to a few tens of ms. Then BFQ does not idle for
+ * queues that only read, and an async queue holds the device only for
+ * a short slice before the readers get it back. Use the bfq.weight
+ * file of each cgroup for the relative share of each group.
+ *
  * BFQ is described in [1], where also a reference to the initial,
  * more theoretical paper on BFQ can be found. The interested reader
  * can find in the latter paper full details on the main algorithm, as
@@ -158,6 +165,7 @@ BFQ_BFQQ_FNS(coop);
 BFQ_BFQQ_FNS(split_coop);
 BFQ_BFQQ_FNS(softrt_update);
 BFQ_BFQQ_FNS(has_waker);
+BFQ_BFQQ_FNS(has_writes);
 #undef BFQ_BFQQ_FNS						\
 
 /* Expiration time of sync (0) and async (1) requests, in ns. */
@@ -1869,6 +1877,9 @@ static void bfq_add_request(struct request *rq)
 	bfqq->queued[rq_is_sync(rq)]++;
 	bfqd->queued++;
 
+	if (bfq_bfqq_sync(bfqq) && rq_data_dir(rq) == WRITE)
+		bfq_mark_bfqq_has_writes(bfqq);
+
 	if (RB_EMPTY_ROOT(&bfqq->sort_list) && bfq_bfqq_sync(bfqq)) {
 		/*
 		 * Detect whether bfqq's I/O seems synchronized with
@@ -2871,7 +2882,10 @@ static bool bfq_allow_bio_merge(struct request_queue *q, struct request *rq,
 static void bfq_set_budget_timeout(struct bfq_data *bfqd,
 				   struct bfq_queue *bfqq)
 {
-	unsigned int timeout_coeff;
+	unsigned int timeout_coeff, timeout = bfqd->bfq_timeout;
+
+	if (!bfq_bfqq_sync(bfqq) && bfqd->bfq_timeout_async)
+		timeout = bfqd->bfq_timeout_async;
 
 	if (bfqq->wr_cur_max_time == bfqd->bfq_wr_rt_max_time)
 		timeout_coeff = 1;
@@ -2880,8 +2894,7 @@ static void bfq_set_budget_timeout(struct bfq_data *bfqd,
 
 	bfqd->last_budget_start = ktime_get();
 
-	bfqq->budget_timeout = jiffies +
-		bfqd->bfq_timeout * timeout_coeff;
+	bfqq->budget_timeout = jiffies + timeout * timeout_coeff;
 }
 
 static void __bfq_set_in_service_queue(struct bfq_data *bfqd,
@@ -4185,6 +4198,14 @@ static bool bfq_better_to_idle(struct bfq_queue *bfqq)
 	   bfq_class_idle(bfqq))
 		return false;
 
+	/*
+	 * Nor do we idle for queues that have issued only reads, if
+	 * read_idling is off. Then, service guarantees for such
+	 * queues rest on the budget timeouts of the other queues.
+	 */
+	if (!bfqd->read_idling && !bfq_bfqq_has_writes(bfqq))
+		return false;
+
 	idling_boosts_thr_with_no_issue =
 		idling_boosts_thr_without_issues(bfqd, bfqq);
 
@@ -6470,6 +6491,7 @@ static int bfq_init_queue(struct request_queue *q, struct elevator_type *e)
 	bfqd->bfq_back_penalty = bfq_back_penalty;
 	bfqd->bfq_slice_idle = bfq_slice_idle;
 	bfqd->bfq_timeout = bfq_timeout;
+	bfqd->bfq_timeout_async = 0;
 
 	bfqd->bfq_requests_within_timer = 120;
 
@@ -6477,6 +6499,7 @@ static int bfq_init_queue(struct request_queue *q, struct elevator_type *e)
 	bfqd->bfq_burst_interval = msecs_to_jiffies(180);
 
 	bfqd->low_latency = true;
+	bfqd->read_idling = true;
 
 	/*
 	 * Trade-off between responsiveness and fairness.
@@ -6581,8 +6604,10 @@ SHOW_FUNCTION(bfq_back_seek_penalty_show, bfqd->bfq_back_penalty, 0);
 SHOW_FUNCTION(bfq_slice_idle_show, bfqd->bfq_slice_idle, 2);
 SHOW_FUNCTION(bfq_max_budget_show, bfqd->bfq_user_max_budget, 0);
 SHOW_FUNCTION(bfq_timeout_sync_show, bfqd->bfq_timeout, 1);
+SHOW_FUNCTION(bfq_timeout_async_show, bfqd->bfq_timeout_async, 1);
 SHOW_FUNCTION(bfq_strict_guarantees_show, bfqd->strict_guarantees, 0);
 SHOW_FUNCTION(bfq_low_latency_show, bfqd->low_latency, 0);
+SHOW_FUNCTION(bfq_read_idling_show, bfqd->read_idling, 0);
 #undef SHOW_FUNCTION
 
 #define USEC_SHOW_FUNCTION(__FUNC, __VAR)				\
@@ -6627,6 +6652,9 @@ STORE_FUNCTION(bfq_back_seek_max_store, &bfqd->bfq_back_max, 0, INT_MAX, 0);
 STORE_FUNCTION(bfq_back_seek_penalty_store, &bfqd->bfq_back_penalty, 1,
 		INT_MAX, 0);
 STORE_FUNCTION(bfq_slice_idle_store, &bfqd->bfq_slice_idle, 0, INT_MAX, 2);
+STORE_FUNCTION(bfq_timeout_async_store, &bfqd->bfq_timeout_async, 0, INT_MAX,
+		1);
+STORE_FUNCTION(bfq_read_idling_store, &bfqd->read_idling, 0, 1, 0);
 #undef STORE_FUNCTION
 
 #define USEC_STORE_FUNCTION(__FUNC, __PTR, MIN, MAX)			\
@@ -6676,7 +6704,8 @@ static ssize_t bfq_max_budget_store(struct elevator_queue *e,
 
 /*
  * Leaving this name to preserve name compatibility with cfq
- * parameters, but this timeout is used for both sync and async.
+ * parameters, but this timeout is used for both sync and async
+ * (unless timeout_async is set).
  */
 static ssize_t bfq_timeout_sync_store(struct elevator_queue *e,
 				      const char *page, size_t count)
@@ -6755,8 +6784,10 @@ static struct elv_fs_entry bfq_attrs[] = {
 	BFQ_ATTR(slice_idle_us),
 	BFQ_ATTR(max_budget),
 	BFQ_ATTR(timeout_sync),
+	BFQ_ATTR(timeout_async),
 	BFQ_ATTR(strict_guarantees),
 	BFQ_ATTR(low_latency),
+	BFQ_ATTR(read_idling),
 	__ATTR_NULL
 };
 
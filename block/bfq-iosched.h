@@ -638,6 +638,11 @@ struct bfq_data {
 	 * without service-domain guarantees).
 	 */
 	unsigned int bfq_timeout;
+	/*
+	 * Timeout for async bfq_queues (jiffies). Zero means that
+	 * async queues use bfq_timeout too.
+	 */
+	unsigned int bfq_timeout_async;
 
 	/*
 	 * Number of consecutive requests that must be issued within
@@ -655,6 +660,13 @@ struct bfq_data {
 	 */
 	bool strict_guarantees;
 
+	/*
+	 * If false, never idle the device for sync queues that have
+	 * issued only reads. On slow flash, such idling costs more
+	 * throughput than it gains.
+	 */
+	bool read_idling;
+
 	/*
 	 * Last time at which a queue entered the current burst of
 	 * queues being activated shortly after each other; for more
@@ -768,7 +780,8 @@ enum bfqq_state_flags {
 				 */
 	BFQQF_coop,		/* bfqq is shared */
 	BFQQF_split_coop,	/* shared bfqq will be split */
-	BFQQF_has_waker		/* bfqq has a waker queue */
+	BFQQF_has_waker,	/* bfqq has a waker queue */
+	BFQQF_has_writes	/* sync bfqq has issued writes */
 };
 
 #define BFQ_BFQQ_FNS(name)						\
@@ -789,6 +802,7 @@ BFQ_BFQQ_FNS(coop);
 BFQ_BFQQ_FNS(split_coop);
 BFQ_BFQQ_FNS(softrt_update);
 BFQ_BFQQ_FNS(has_waker);
+BFQ_BFQQ_FNS(has_writes);
 #undef BFQ_BFQQ_FNS
 
 /* Expiration reasons. */
@@ -13,6 +13,7 @@
 #include <linux/device.h>
 #include <linux/regmap.h>
 #include <linux/fs.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/wait.h>
 
@@ -27,6 +28,29 @@ struct regmap_debugfs_off_cache {
 	unsigned int max_reg;
 };
 
+#ifdef CONFIG_REGMAP_STATS
+#define REGMAP_STATS_BUCKETS	16
+/* Registers beyond this index are not counted individually */
+#define REGMAP_STATS_MAX_REGS	4096
+
+struct regmap_reg_stats {
+	unsigned int reads;
+	unsigned int writes;
+};
+
+struct regmap_stats {
+	u64 reads;
+	u64 writes;
+	u64 cache_hits;
+	u64 bus_ns;
+	/* Bucket n counts the accesses of less than 2^n us, the last the rest */
+	u64 latency[REGMAP_STATS_BUCKETS];
+	/* Indexed by register / stride, NULL until debugfs is set up */
+	struct regmap_reg_stats *regs;
+	unsigned int num_regs;
+};
+#endif
+
 struct regmap_format {
 	size_t buf_size;
 	size_t reg_bytes;
@@ -64,6 +88,8 @@ struct regmap {
 	struct regmap_format format;  /* Buffer format */
 	const struct regmap_bus *bus;
 	void *bus_context;
+	/* if set, 32-bit LE MMIO registers regmap_read/write() may access directly */
+	void __iomem *fast_mmio;
 	const char *name;
 
 	bool async;
@@ -85,6 +111,9 @@ struct regmap {
 	struct list_head debugfs_off_cache;
 	struct mutex cache_lock;
 #endif
+#ifdef CONFIG_REGMAP_STATS
+	struct regmap_stats stats;
+#endif
 
 	unsigned int max_register;
 	bool (*writeable_reg)(struct device *dev, unsigned int reg);
@@ -157,6 +186,13 @@ struct regmap {
 	size_t max_raw_read;
 	size_t max_raw_write;
 
+	/* if set, single register writes are buffered until commit */
+	bool txn;
+	/* the buffered writes, in the order they were made */
+	struct reg_sequence *txn_regs;
+	unsigned int txn_num;
+	unsigned int txn_max;
+
 	struct rb_root range_tree;
 	void *selector_work_buf;	/* Scratch buffer used for selector */
 
@@ -232,6 +268,26 @@ static inline void regmap_debugfs_exit(struct regmap *map) { }
 static inline void regmap_debugfs_disable(struct regmap *map) { }
 #endif
 
+#ifdef CONFIG_REGMAP_STATS
+void regmap_stats_access(struct regmap *map, unsigned int reg, bool write,
+			 u64 start);
+
+static inline u64 regmap_stats_start(void)
+{
+	return ktime_get_ns();
+}
+
+static inline void regmap_stats_cache_hit(struct regmap *map)
+{
+	map->stats.cache_hits++;
+}
+#else
+static inline void regmap_stats_access(struct regmap *map, unsigned int reg,
+				       bool write, u64 start) { }
+static inline u64 regmap_stats_start(void) { return 0; }
+static inline void regmap_stats_cache_hit(struct regmap *map) { }
+#endif
+
 /* regcache core declarations */
 int regcache_init(struct regmap *map, const struct regmap_config *config);
 void regcache_exit(struct regmap *map);
@@ -12,6 +12,7 @@
 #include <linux/uaccess.h>
 #include <linux/device.h>
 #include <linux/list.h>
+#include <linux/math64.h>
 
 #include "internal.h"
 
@@ -532,6 +533,152 @@ static const struct file_operations regmap_cache_bypass_fops = {
 	.write = regmap_cache_bypass_write_file,
 };
 
+#ifdef CONFIG_REGMAP_STATS
+static unsigned int regmap_stats_index(struct regmap *map, unsigned int reg)
+{
+	if (map->reg_stride_order >= 0)
+		return reg >> map->reg_stride_order;
+
+	return reg / map->reg_stride;
+}
+
+/* Called under the map lock after a single register bus access */
+void regmap_stats_access(struct regmap *map, unsigned int reg, bool write,
+			 u64 start)
+{
+	struct regmap_stats *stats = &map->stats;
+	u64 ns = ktime_get_ns() - start;
+	unsigned int index = regmap_stats_index(map, reg);
+	unsigned int bucket;
+
+	if (write)
+		stats->writes++;
+	else
+		stats->reads++;
+	stats->bus_ns += ns;
+
+	bucket = fls64(div_u64(ns, NSEC_PER_USEC));
+	stats->latency[min_t(unsigned int, bucket, REGMAP_STATS_BUCKETS - 1)]++;
+
+	if (stats->regs && index < stats->num_regs) {
+		if (write)
+			stats->regs[index].writes++;
+		else
+			stats->regs[index].reads++;
+	}
+}
+
+static int regmap_stats_show(struct seq_file *s, void *ignored)
+{
+	struct regmap *map = s->private;
+	struct regmap_stats stats;
+	int i;
+
+	map->lock(map->lock_arg);
+	stats = map->stats;
+	map->unlock(map->lock_arg);
+
+	seq_printf(s, "reads: %llu\n", stats.reads);
+	seq_printf(s, "writes: %llu\n", stats.writes);
+	seq_printf(s, "cache hits: %llu\n", stats.cache_hits);
+	seq_printf(s, "bus time: %llu ns\n", stats.bus_ns);
+
+	for (i = 0; i < REGMAP_STATS_BUCKETS - 1; i++)
+		seq_printf(s, "<%uus: %llu\n", 1U << i, stats.latency[i]);
+	seq_printf(s, ">=%uus: %llu\n", 1U << (i - 1), stats.latency[i]);
+
+	return 0;
+}
+
+static int regmap_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, regmap_stats_show, inode->i_private);
+}
+
+static ssize_t regmap_stats_write_file(struct file *file,
+				       const char __user *user_buf,
+				       size_t count, loff_t *ppos)
+{
+	struct seq_file *s = file->private_data;
+	struct regmap *map = s->private;
+	struct regmap_stats *stats = &map->stats;
+
+	map->lock(map->lock_arg);
+
+	memset(stats, 0, offsetof(struct regmap_stats, regs));
+	if (stats->regs)
+		memset(stats->regs, 0, stats->num_regs * sizeof(*stats->regs));
+
+	map->unlock(map->lock_arg);
+
+	return count;
+}
+
+static const struct file_operations regmap_stats_fops = {
+	.open = regmap_stats_open,
+	.read = seq_read,
+	.write = regmap_stats_write_file,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int regmap_hot_registers_show(struct seq_file *s, void *ignored)
+{
+	struct regmap *map = s->private;
+	struct regmap_reg_stats *regs = map->stats.regs;
+	unsigned int i, reads, writes;
+	int reg_len;
+
+	reg_len = regmap_calc_reg_len(map->max_register);
+
+	for (i = 0; i < map->stats.num_regs; i++) {
+		reads = READ_ONCE(regs[i].reads);
+		writes = READ_ONCE(regs[i].writes);
+
+		/* Only list the registers that have been on the bus */
+		if (!reads && !writes)
+			continue;
+
+		seq_printf(s, "%.*x: %u %u\n", reg_len, i * map->reg_stride,
+			   reads, writes);
+	}
+
+	return 0;
+}
+
+DEFINE_SHOW_ATTRIBUTE(regmap_hot_registers);
+
+static void regmap_stats_debugfs_init(struct regmap *map)
+{
+	struct regmap_stats *stats = &map->stats;
+	unsigned int num_regs = regmap_stats_index(map, map->max_register) + 1;
+
+	debugfs_create_file("stats", 0600, map->debugfs, map,
+			    &regmap_stats_fops);
+
+	if (!map->max_register || num_regs > REGMAP_STATS_MAX_REGS)
+		return;
+
+	stats->regs = kcalloc(num_regs, sizeof(*stats->regs), GFP_KERNEL);
+	if (!stats->regs)
+		return;
+	stats->num_regs = num_regs;
+
+	debugfs_create_file("hot_registers", 0400, map->debugfs, map,
+			    &regmap_hot_registers_fops);
+}
+
+static void regmap_stats_debugfs_exit(struct regmap *map)
+{
+	kfree(map->stats.regs);
+	map->stats.regs = NULL;
+	map->stats.num_regs = 0;
+}
+#else
+static inline void regmap_stats_debugfs_init(struct regmap *map) { }
+static inline void regmap_stats_debugfs_exit(struct regmap *map) { }
+#endif
+
 void regmap_debugfs_init(struct regmap *map, const char *name)
 {
 	struct rb_node *next;
@@ -634,6 +781,8 @@ void regmap_debugfs_init(struct regmap *map, const char *name)
 
 	if (map->cache_ops && map->cache_ops->debugfs_init)
 		map->cache_ops->debugfs_init(map);
+
+	regmap_stats_debugfs_init(map);
 }
 
 void regmap_debugfs_exit(struct regmap *map)
@@ -643,6 +792,7 @@ void regmap_debugfs_exit(struct regmap *map)
 		mutex_lock(&map->cache_lock);
 		regmap_debugfs_free_dump_cache(map);
 		mutex_unlock(&map->cache_lock);
+		regmap_stats_debugfs_exit(map);
 		kfree(map->debugfs_name);
 	} else {
 		struct regmap_debugfs_node *node, *tmp;
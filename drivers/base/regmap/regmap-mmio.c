@@ -319,6 +319,29 @@ static struct regmap_mmio_context *regmap_mmio_gen_context(struct device *dev,
 	return ERR_PTR(ret);
 }
 
+/*
+ * Let regmap_read() and regmap_write() access the registers directly if the
+ * map is nothing but plain 32-bit little endian MMIO: no clock to enable, no
+ * ranges and a flat cache at most. The map lock is still taken, so maps with
+ * disable_locking get close to the cost of a bare readl()/writel().
+ */
+static struct regmap *regmap_mmio_init_fast(struct regmap *map)
+{
+	struct regmap_mmio_context *ctx;
+
+	if (IS_ERR(map))
+		return map;
+
+	ctx = map->bus_context;
+	if (ctx->reg_read == regmap_mmio_read32le && IS_ERR(ctx->clk) &&
+	    (map->cache_type == REGCACHE_NONE ||
+	     map->cache_type == REGCACHE_FLAT) &&
+	    RB_EMPTY_ROOT(&map->range_tree))
+		map->fast_mmio = ctx->regs;
+
+	return map;
+}
+
 struct regmap *__regmap_init_mmio_clk(struct device *dev, const char *clk_id,
 				      void __iomem *regs,
 				      const struct regmap_config *config,
@@ -331,8 +354,9 @@ struct regmap *__regmap_init_mmio_clk(struct device *dev, const char *clk_id,
 	if (IS_ERR(ctx))
 		return ERR_CAST(ctx);
 
-	return __regmap_init(dev, &regmap_mmio, ctx, config,
-			     lock_key, lock_name);
+	return regmap_mmio_init_fast(__regmap_init(dev, &regmap_mmio, ctx,
+						   config, lock_key,
+						   lock_name));
 }
 EXPORT_SYMBOL_GPL(__regmap_init_mmio_clk);
 
@@ -349,8 +373,9 @@ struct regmap *__devm_regmap_init_mmio_clk(struct device *dev,
 	if (IS_ERR(ctx))
 		return ERR_CAST(ctx);
 
-	return __devm_regmap_init(dev, &regmap_mmio, ctx, config,
-				  lock_key, lock_name);
+	return regmap_mmio_init_fast(__devm_regmap_init(dev, &regmap_mmio,
+							ctx, config, lock_key,
+							lock_name));
 }
 EXPORT_SYMBOL_GPL(__devm_regmap_init_mmio_clk);
 
@@ -358,6 +383,8 @@ int regmap_mmio_attach_clk(struct regmap *map, struct clk *clk)
 {
 	struct regmap_mmio_context *ctx = map->bus_context;
 
+	/* The fast path does not enable the clock */
+	map->fast_mmio = NULL;
 	ctx->clk = clk;
 	ctx->attached_clk = true;
 
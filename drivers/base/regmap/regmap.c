@@ -17,6 +17,7 @@
 #include <linux/delay.h>
 #include <linux/log2.h>
 #include <linux/hwspinlock.h>
+#include <linux/io.h>
 
 #define CREATE_TRACE_POINTS
 #include "trace.h"
@@ -1321,6 +1322,11 @@ int regmap_reinit_cache(struct regmap *map, const struct regmap_config *config)
 	map->readable_noinc_reg = config->readable_noinc_reg;
 	map->cache_type = config->cache_type;
 
+	/* The fast path only knows about the flat cache */
+	if (map->cache_type != REGCACHE_NONE &&
+	    map->cache_type != REGCACHE_FLAT)
+		map->fast_mmio = NULL;
+
 	regmap_debugfs_init(map, config->name);
 
 	map->cache_bypass = false;
@@ -1345,6 +1351,7 @@ void regmap_exit(struct regmap *map)
 	if (map->bus && map->bus->free_context)
 		map->bus->free_context(map->bus_context);
 	kfree(map->work_buf);
+	kfree(map->txn_regs);
 	while (!list_empty(&map->async_free)) {
 		async = list_first_entry_or_null(&map->async_free,
 						 struct regmap_async,
@@ -1757,11 +1764,117 @@ static inline void *_regmap_map_get_context(struct regmap *map)
 	return (map->bus) ? map : map->bus_context;
 }
 
+static int regmap_txn_add(struct regmap *map, unsigned int reg,
+			  unsigned int val)
+{
+	struct reg_sequence *regs;
+	unsigned int max;
+
+	if (map->txn_num == map->txn_max) {
+		max = max(2 * map->txn_max, 16U);
+		regs = krealloc(map->txn_regs, max * sizeof(*regs),
+				map->alloc_flags);
+		if (!regs)
+			return -ENOMEM;
+		map->txn_regs = regs;
+		map->txn_max = max;
+	}
+
+	regs = &map->txn_regs[map->txn_num++];
+	regs->reg = reg;
+	regs->def = val;
+	regs->delay_us = 0;
+
+	return 0;
+}
+
+/* The number of writes at @regs that go to consecutive registers */
+static unsigned int regmap_txn_run(struct regmap *map,
+				   const struct reg_sequence *regs,
+				   unsigned int num)
+{
+	unsigned int n;
+
+	if (!regmap_can_raw_write(map) || map->use_single_write)
+		return 1;
+
+	for (n = 1; n < num; n++)
+		if (regs[n].reg != regs[n - 1].reg + map->reg_stride)
+			break;
+
+	return n;
+}
+
+static int regmap_txn_write_run(struct regmap *map,
+				const struct reg_sequence *regs,
+				unsigned int num)
+{
+	size_t val_bytes = map->format.val_bytes;
+	void *buf;
+	int ret, i;
+
+	buf = kmalloc_array(num, val_bytes, map->alloc_flags);
+	if (!buf) {
+		for (i = 0, ret = 0; i < num && !ret; i++)
+			ret = _regmap_write(map, regs[i].reg, regs[i].def);
+		return ret;
+	}
+
+	for (i = 0; i < num; i++)
+		map->format.format_val(buf + i * val_bytes, regs[i].def, 0);
+
+	ret = _regmap_raw_write(map, regs[0].reg, buf, num * val_bytes);
+
+	kfree(buf);
+
+	return ret;
+}
+
+/*
+ * Send the writes buffered since regmap_transaction_begin(). Writes that
+ * are not sent because of an error are dropped. Their values are still in
+ * the cache, which is marked dirty so that regcache_sync() can restore them.
+ */
+static int __regmap_txn_flush(struct regmap *map)
+{
+	struct reg_sequence *regs = map->txn_regs;
+	unsigned int num = map->txn_num;
+	bool txn = map->txn;
+	unsigned int i, n;
+	int ret = 0;
+
+	/* Let the writes below through to the bus */
+	map->txn = false;
+	map->txn_num = 0;
+
+	for (i = 0; i < num; i += n) {
+		n = regmap_txn_run(map, regs + i, num - i);
+		if (n > 1)
+			ret = regmap_txn_write_run(map, regs + i, n);
+		else
+			ret = _regmap_write(map, regs[i].reg, regs[i].def);
+		if (ret) {
+			map->cache_dirty = true;
+			break;
+		}
+	}
+
+	map->txn = txn;
+
+	return ret;
+}
+
+static inline int regmap_txn_flush(struct regmap *map)
+{
+	return map->txn_num ? __regmap_txn_flush(map) : 0;
+}
+
 int _regmap_write(struct regmap *map, unsigned int reg,
 		  unsigned int val)
 {
 	int ret;
 	void *context = _regmap_map_get_context(map);
+	u64 start;
 
 	if (!regmap_writeable(map, reg))
 		return -EIO;
@@ -1776,12 +1889,91 @@ int _regmap_write(struct regmap *map, unsigned int reg,
 		}
 	}
 
+	if (map->txn) {
+		ret = regmap_txn_add(map, reg, val);
+		if (ret != -ENOMEM)
+			return ret;
+
+		/* Out of memory, send everything so far and this one now */
+		ret = regmap_txn_flush(map);
+		if (ret)
+			return ret;
+	}
+
+	if (regmap_should_log(map))
+		dev_info(map->dev, "%x <= %x\n", reg, val);
+
+	trace_regmap_reg_write(map, reg, val);
+
+	start = regmap_stats_start();
+	ret = map->reg_write(context, reg, val);
+	regmap_stats_access(map, reg, true, start);
+
+	return ret;
+}
+
+/*
+ * The fast path for maps set up by regmap_mmio_init_fast(). It does what
+ * _regmap_write() and _regmap_read() do for a flat or no cache, minus the
+ * indirect calls through the cache and bus ops.
+ */
+static inline bool regmap_use_fast_mmio(struct regmap *map)
+{
+	return map->fast_mmio && !map->cache_only && !map->cache_bypass &&
+	       !map->txn;
+}
+
+static int regmap_fast_mmio_write(struct regmap *map, unsigned int reg,
+				  unsigned int val)
+{
+	unsigned int *cache = map->cache;
+	u64 start;
+
+	if (!regmap_writeable(map, reg))
+		return -EIO;
+
+	if (map->cache_type == REGCACHE_FLAT && !regmap_volatile(map, reg))
+		cache[regcache_get_index_by_order(map, reg)] = val;
+
 	if (regmap_should_log(map))
 		dev_info(map->dev, "%x <= %x\n", reg, val);
 
 	trace_regmap_reg_write(map, reg, val);
 
-	return map->reg_write(context, reg, val);
+	start = regmap_stats_start();
+	writel(val, map->fast_mmio + reg);
+	regmap_stats_access(map, reg, true, start);
+
+	return 0;
+}
+
+static int regmap_fast_mmio_read(struct regmap *map, unsigned int reg,
+				 unsigned int *val)
+{
+	unsigned int *cache = map->cache;
+	u64 start;
+
+	if (map->cache_type == REGCACHE_FLAT && reg <= map->max_register &&
+	    !regmap_volatile(map, reg)) {
+		*val = cache[regcache_get_index_by_order(map, reg)];
+		trace_regmap_reg_read_cache(map, reg, *val);
+		regmap_stats_cache_hit(map);
+		return 0;
+	}
+
+	if (!regmap_readable(map, reg))
+		return -EIO;
+
+	start = regmap_stats_start();
+	*val = readl(map->fast_mmio + reg);
+	regmap_stats_access(map, reg, false, start);
+
+	if (regmap_should_log(map))
+		dev_info(map->dev, "%x => %x\n", reg, *val);
+
+	trace_regmap_reg_read(map, reg, *val);
+
+	return 0;
 }
 
 /**
@@ -1803,7 +1995,10 @@ int regmap_write(struct regmap *map, unsigned int reg, unsigned int val)
 
 	map->lock(map->lock_arg);
 
-	ret = _regmap_write(map, reg, val);
+	if (regmap_use_fast_mmio(map))
+		ret = regmap_fast_mmio_write(map, reg, val);
+	else
+		ret = _regmap_write(map, reg, val);
 
 	map->unlock(map->lock_arg);
 
@@ -1811,6 +2006,67 @@ int regmap_write(struct regmap *map, unsigned int reg, unsigned int val)
 }
 EXPORT_SYMBOL_GPL(regmap_write);
 
+/**
+ * regmap_transaction_begin() - Start buffering single register writes
+ *
+ * @map: Register map to write to
+ *
+ * Until regmap_transaction_commit(), regmap_write(), regmap_update_bits()
+ * and the other single register writes update the cache as usual but are
+ * only sent to the device at commit. There, each run of writes to
+ * consecutive registers becomes one raw write if the bus supports it. The
+ * writes are sent in the order they were made; a read from the device or
+ * a raw, bulk or noinc transfer sends the writes buffered so far first.
+ *
+ * Like cache only mode, the transaction applies to all users of the map.
+ *
+ * A value of zero will be returned on success, -EBUSY if a transaction
+ * is already open.
+ */
+int regmap_transaction_begin(struct regmap *map)
+{
+	int ret = 0;
+
+	map->lock(map->lock_arg);
+
+	if (map->txn)
+		ret = -EBUSY;
+	else
+		map->txn = true;
+
+	map->unlock(map->lock_arg);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(regmap_transaction_begin);
+
+/**
+ * regmap_transaction_commit() - Send the writes buffered in a transaction
+ *
+ * @map: Register map to write to
+ *
+ * Ends the transaction started with regmap_transaction_begin(). If a write
+ * fails, the writes after it are dropped and the cache is marked dirty, so
+ * regcache_sync() restores the cached registers.
+ *
+ * A value of zero will be returned on success, a negative errno will
+ * be returned in error cases.
+ */
+int regmap_transaction_commit(struct regmap *map)
+{
+	int ret;
+
+	map->lock(map->lock_arg);
+
+	ret = regmap_txn_flush(map);
+	map->txn = false;
+
+	map->unlock(map->lock_arg);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(regmap_transaction_commit);
+
 /**
  * regmap_write_async() - Write a value to a single register asynchronously
  *
@@ -1854,6 +2110,10 @@ int _regmap_raw_write(struct regmap *map, unsigned int reg,
 	if (!val_count)
 		return -EINVAL;
 
+	ret = regmap_txn_flush(map);
+	if (ret)
+		return ret;
+
 	if (map->use_single_write)
 		chunk_regs = 1;
 	else if (map->max_raw_write && val_len > map->max_raw_write)
@@ -2141,6 +2401,10 @@ static int _regmap_raw_multi_reg_write(struct regmap *map,
 	if (!len)
 		return -EINVAL;
 
+	ret = regmap_txn_flush(map);
+	if (ret)
+		return ret;
+
 	buf = kzalloc(len, GFP_KERNEL);
 	if (!buf)
 		return -ENOMEM;
@@ -2464,6 +2728,10 @@ static int _regmap_raw_read(struct regmap *map, unsigned int reg, void *val,
 	if (!map->bus || !map->bus->read)
 		return -EINVAL;
 
+	ret = regmap_txn_flush(map);
+	if (ret)
+		return ret;
+
 	range = _regmap_range_lookup(map, reg);
 	if (range) {
 		ret = _regmap_select_page(map, &reg, range,
@@ -2517,11 +2785,14 @@ static int _regmap_read(struct regmap *map, unsigned int reg,
 {
 	int ret;
 	void *context = _regmap_map_get_context(map);
+	u64 start;
 
 	if (!map->cache_bypass) {
 		ret = regcache_read(map, reg, val);
-		if (ret == 0)
+		if (ret == 0) {
+			regmap_stats_cache_hit(map);
 			return 0;
+		}
 	}
 
 	if (map->cache_only)
@@ -2530,7 +2801,14 @@ static int _regmap_read(struct regmap *map, unsigned int reg,
 	if (!regmap_readable(map, reg))
 		return -EIO;
 
+	/* The read may depend on what is still buffered */
+	ret = regmap_txn_flush(map);
+	if (ret)
+		return ret;
+
+	start = regmap_stats_start();
 	ret = map->reg_read(context, reg, val);
+	regmap_stats_access(map, reg, false, start);
 	if (ret == 0) {
 		if (regmap_should_log(map))
 			dev_info(map->dev, "%x => %x\n", reg, *val);
@@ -2563,7 +2841,10 @@ int regmap_read(struct regmap *map, unsigned int reg, unsigned int *val)
 
 	map->lock(map->lock_arg);
 
-	ret = _regmap_read(map, reg, val);
+	if (regmap_use_fast_mmio(map))
+		ret = regmap_fast_mmio_read(map, reg, val);
+	else
+		ret = _regmap_read(map, reg, val);
 
 	map->unlock(map->lock_arg);
 
@@ -0,0 +1,119 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/jiffies.h>
+#include <linux/string.h>
+#include <linux/timekeeping.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#include "adc.h"
+#include "hw.h"
+#include "pm.h"
+
+/*
+ * Asynchronous ADC snapshots
+ *
+ * A work item captures the ADC buffer into one of two snapshot buffers and
+ * then publishes it through the control page. See
+ * 'struct lockamp_adc_snapshot_ctrl'. This keeps the capture (16384 reads
+ * of the ADC data register) out of the reader's context. The capture runs
+ * once per 'adc_snapshot_period_ms' or on demand ('adc_snapshot_trigger').
+ */
+
+static s32 *snapshot_buffer(struct lockamp *lockamp, unsigned int index)
+{
+	char *base = (char *)lockamp->adc_snapshot;
+	return (s32 *)(base + LOCKAMP_ADC_SNAPSHOT_DATA_OFFSET + index * LOCKAMP_ADC_SAMPLES_SIZE);
+}
+
+static void snapshot_work(struct work_struct *work)
+{
+	struct lockamp *lockamp = container_of(to_delayed_work(work), struct lockamp,
+	                                       adc_snapshot_work);
+	struct lockamp_adc_snapshot_ctrl *ctrl = lockamp->adc_snapshot;
+	/* Write to the buffer that the readers don't look at */
+	unsigned int index = !ctrl->index;
+	unsigned int period_ms;
+	u64 time_ns;
+	int ret;
+	ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		goto out_reschedule;
+	}
+	mutex_lock(&lockamp->adc_buf_m);
+	time_ns = ktime_get_ns();
+	lockamp_get_adc_samples(lockamp, snapshot_buffer(lockamp, index));
+	mutex_unlock(&lockamp->adc_buf_m);
+	lockamp_pm_put(lockamp);
+	/* Publish the samples before the index */
+	smp_wmb();
+	WRITE_ONCE(ctrl->index, index);
+	WRITE_ONCE(ctrl->time_ns, time_ns);
+	smp_wmb();
+	WRITE_ONCE(ctrl->seq, ctrl->seq + 1);
+
+out_reschedule:
+	period_ms = READ_ONCE(lockamp->adc_snapshot_period_ms);
+	if (0 < period_ms) {
+		schedule_delayed_work(&lockamp->adc_snapshot_work, msecs_to_jiffies(period_ms));
+	}
+}
+
+int lockamp_adc_snapshot_init(struct lockamp *lockamp)
+{
+	lockamp->adc_snapshot = vmalloc_user(PAGE_ALIGN(LOCKAMP_ADC_SNAPSHOT_MAP_SIZE));
+	if (NULL == lockamp->adc_snapshot) {
+		return -ENOMEM;
+	}
+	lockamp->adc_snapshot_period_ms = 0;
+	INIT_DELAYED_WORK(&lockamp->adc_snapshot_work, snapshot_work);
+	return 0;
+}
+
+void lockamp_adc_snapshot_release(struct lockamp *lockamp)
+{
+	if (NULL == lockamp->adc_snapshot) {
+		return;
+	}
+	WRITE_ONCE(lockamp->adc_snapshot_period_ms, 0);
+	cancel_delayed_work_sync(&lockamp->adc_snapshot_work);
+	vfree(lockamp->adc_snapshot);
+	lockamp->adc_snapshot = NULL;
+}
+
+void lockamp_adc_snapshot_trigger(struct lockamp *lockamp)
+{
+	mod_delayed_work(system_wq, &lockamp->adc_snapshot_work, 0);
+}
+
+/* Zero to stop the periodic capture */
+void lockamp_adc_snapshot_set_period_ms(struct lockamp *lockamp, unsigned int period_ms)
+{
+	WRITE_ONCE(lockamp->adc_snapshot_period_ms, period_ms);
+	if (0 == period_ms) {
+		cancel_delayed_work_sync(&lockamp->adc_snapshot_work);
+		return;
+	}
+	lockamp_adc_snapshot_trigger(lockamp);
+}
+
+int lockamp_adc_snapshot_mmap(struct lockamp *lockamp, struct vm_area_struct *vma)
+{
+	/* Read-only for user space */
+	if (vma->vm_flags & VM_WRITE) {
+		return -EPERM;
+	}
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return remap_vmalloc_range(vma, lockamp->adc_snapshot, vma->vm_pgoff);
+}
+
+/* For read() on the snapshot attribute */
+ssize_t lockamp_adc_snapshot_copy(struct lockamp *lockamp, char *buf, loff_t offset, size_t count)
+{
+	return memory_read_from_buffer(buf, count, &offset, lockamp->adc_snapshot,
+	                               LOCKAMP_ADC_SNAPSHOT_MAP_SIZE);
+}
@@ -0,0 +1,24 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_ADC_H_
+#define _LOCKAMP_ADC_H_
+
+#include <linux/mm.h>
+
+#include "lockin_amplifier.h"
+
+/* Control page followed by the two snapshot buffers */
+#define LOCKAMP_ADC_SNAPSHOT_MAP_SIZE (LOCKAMP_ADC_SNAPSHOT_DATA_OFFSET + 2 * LOCKAMP_ADC_SAMPLES_SIZE)
+
+int lockamp_adc_snapshot_init(struct lockamp *lockamp);
+void lockamp_adc_snapshot_release(struct lockamp *lockamp);
+void lockamp_adc_snapshot_trigger(struct lockamp *lockamp);
+void lockamp_adc_snapshot_set_period_ms(struct lockamp *lockamp, unsigned int period_ms);
+int lockamp_adc_snapshot_mmap(struct lockamp *lockamp, struct vm_area_struct *vma);
+ssize_t lockamp_adc_snapshot_copy(struct lockamp *lockamp, char *buf, loff_t offset, size_t count);
+
+#endif /* _LOCKAMP_ADC_H_ */
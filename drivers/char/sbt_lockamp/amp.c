@@ -0,0 +1,310 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/of.h>
+#include <linux/rpmsg.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include "amp.h"
+#include "hw.h"
+#include "sbuf.h"
+#include "stats.h"
+
+/*
+ * AMP backend
+ *
+ * If the device tree node has an "sbt,amp-id", a bare-metal firmware on
+ * CPU1 (started through remoteproc) drains the FIFO instead of Linux. The
+ * firmware writes the samples directly into the signal buffer and tells us
+ * how far it got once per period (see amp.h for the protocol). The CPU0
+ * side only moves the head, much like the DMA backend. In turn, the drain
+ * timing depends on the firmware alone and not on the Linux scheduler.
+ *
+ * The signal buffer must come from the reserved "memory-region" so that the
+ * firmware can address it physically. See sbuf.c.
+ */
+
+struct lockamp_amp {
+	struct list_head node;
+	struct lockamp *lockamp;
+	u32 id;
+	/* The rpmsg channel of the firmware (NULL until it announces it).
+	 * Protected by 'lockamp_amps_m'. */
+	struct rpmsg_device *rpdev;
+	/* Protects the fields below */
+	spinlock_t lock;
+	bool running;
+	/* From the latest period message */
+	u32 count;
+	/* Accumulated since the last move to the signal buffer */
+	u32 lost_n;
+};
+
+/* Instances that have an "sbt,amp-id". Matched with the rpmsg channels. */
+static LIST_HEAD(lockamp_amps);
+static DEFINE_MUTEX(lockamp_amps_m);
+
+static struct lockamp_amp *lockamp_amp_find(u32 id)
+{
+	struct lockamp_amp *amp;
+	list_for_each_entry(amp, &lockamp_amps, node) {
+		if (amp->id == id) {
+			return amp;
+		}
+	}
+	return NULL;
+}
+
+static int lockamp_amp_send(struct lockamp_amp *amp, void *msg, int len)
+{
+	struct rpmsg_device *rpdev;
+	int ret;
+	mutex_lock(&lockamp_amps_m);
+	rpdev = amp->rpdev;
+	ret = (NULL != rpdev) ? rpmsg_send(rpdev->ept, msg, len) : -ENODEV;
+	mutex_unlock(&lockamp_amps_m);
+	return ret;
+}
+
+static int lockamp_amp_cb(struct rpmsg_device *rpdev, void *data, int len,
+                          void *priv, u32 src)
+{
+	struct lockamp_amp_msg_period *msg = data;
+	struct lockamp_amp *amp;
+	struct lockamp *lockamp;
+	bool running;
+	int cpu;
+	if (len < sizeof(*msg) ||
+	    LOCKAMP_AMP_MSG_PERIOD != le32_to_cpu(msg->type)) {
+		return 0;
+	}
+	/* Keeps the instance from going away (see 'lockamp_amp_release') */
+	mutex_lock(&lockamp_amps_m);
+	amp = dev_get_drvdata(&rpdev->dev);
+	if (NULL == amp) {
+		goto out_unlock;
+	}
+	lockamp = amp->lockamp;
+	spin_lock_irq(&amp->lock);
+	running = amp->running;
+	if (running) {
+		amp->count = le32_to_cpu(msg->count);
+		amp->lost_n += le32_to_cpu(msg->lost_n);
+	}
+	spin_unlock_irq(&amp->lock);
+	if (!running) {
+		goto out_unlock;
+	}
+	/* Like a DMA period. See 'lockamp_dma_period_done'. */
+	lockamp_stats_kick(lockamp);
+	cpu = READ_ONCE(lockamp->drain_cpu);
+	if (0 <= cpu) {
+		queue_work_on(cpu, system_highpri_wq, &lockamp->dma_work);
+	} else {
+		queue_work(system_highpri_wq, &lockamp->dma_work);
+	}
+out_unlock:
+	mutex_unlock(&lockamp_amps_m);
+	return 0;
+}
+
+static int lockamp_amp_probe(struct rpmsg_device *rpdev)
+{
+	struct lockamp_amp *amp;
+	int ret = 0;
+	mutex_lock(&lockamp_amps_m);
+	amp = lockamp_amp_find(rpdev->dst - LOCKAMP_AMP_ADDR_BASE);
+	if (NULL == amp || NULL != amp->rpdev) {
+		dev_err(&rpdev->dev, "No lock-in amplifier for address 0x%x\n",
+		        rpdev->dst);
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+	amp->rpdev = rpdev;
+	dev_set_drvdata(&rpdev->dev, amp);
+	dev_info(amp->lockamp->dev, "Drain firmware on channel 0x%x\n",
+	         rpdev->dst);
+out_unlock:
+	mutex_unlock(&lockamp_amps_m);
+	return ret;
+}
+
+static void lockamp_amp_remove(struct rpmsg_device *rpdev)
+{
+	struct lockamp_amp *amp;
+	mutex_lock(&lockamp_amps_m);
+	amp = dev_get_drvdata(&rpdev->dev);
+	if (NULL != amp) {
+		amp->rpdev = NULL;
+	}
+	mutex_unlock(&lockamp_amps_m);
+}
+
+static const struct rpmsg_device_id lockamp_amp_id_table[] = {
+	{ .name = LOCKAMP_AMP_CHANNEL },
+	{},
+};
+MODULE_DEVICE_TABLE(rpmsg, lockamp_amp_id_table);
+
+static struct rpmsg_driver lockamp_amp_driver = {
+	.drv.name = "sbt-lockamp-amp",
+	.id_table = lockamp_amp_id_table,
+	.probe = lockamp_amp_probe,
+	.callback = lockamp_amp_cb,
+	.remove = lockamp_amp_remove,
+};
+
+int lockamp_amp_register(void)
+{
+	return register_rpmsg_driver(&lockamp_amp_driver);
+}
+
+void lockamp_amp_unregister(void)
+{
+	unregister_rpmsg_driver(&lockamp_amp_driver);
+}
+
+int lockamp_amp_init(struct lockamp *lockamp, struct platform_device *pdev)
+{
+	struct lockamp_amp *amp;
+	u32 id;
+	lockamp->amp = NULL;
+	/* The firmware is optional */
+	if (of_property_read_u32(pdev->dev.of_node, "sbt,amp-id", &id) < 0) {
+		return 0;
+	}
+	amp = kzalloc(sizeof(*amp), GFP_KERNEL);
+	if (NULL == amp) {
+		return -ENOMEM;
+	}
+	amp->lockamp = lockamp;
+	amp->id = id;
+	spin_lock_init(&amp->lock);
+	mutex_lock(&lockamp_amps_m);
+	if (NULL != lockamp_amp_find(id)) {
+		mutex_unlock(&lockamp_amps_m);
+		kfree(amp);
+		return -EEXIST;
+	}
+	list_add_tail(&amp->node, &lockamp_amps);
+	mutex_unlock(&lockamp_amps_m);
+	lockamp->amp = amp;
+	return 0;
+}
+
+void lockamp_amp_release(struct lockamp *lockamp)
+{
+	struct lockamp_amp *amp = lockamp->amp;
+	if (NULL == amp) {
+		return;
+	}
+	mutex_lock(&lockamp_amps_m);
+	list_del(&amp->node);
+	if (NULL != amp->rpdev) {
+		dev_set_drvdata(&amp->rpdev->dev, NULL);
+	}
+	mutex_unlock(&lockamp_amps_m);
+	kfree(amp);
+	lockamp->amp = NULL;
+}
+
+int lockamp_amp_start(struct lockamp *lockamp)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct lockamp_amp *amp = lockamp->amp;
+	struct lockamp_amp_msg_start msg = {
+		.type = cpu_to_le32(LOCKAMP_AMP_MSG_START),
+		.ring_addr = cpu_to_le32(lockamp->signal_buf_dma),
+		.capacity_n = cpu_to_le32(sbuf->capacity_n),
+		.period_n = cpu_to_le32(LOCKAMP_AMP_PERIOD_N),
+		.reserve_n = cpu_to_le32(LOCKAMP_AMP_RESERVE_N),
+	};
+	int ret;
+	/* The firmware always starts from the beginning of the buffer */
+	sbuf->head = 0;
+	lockamp_sbuf_reserve(sbuf, LOCKAMP_AMP_RESERVE_N);
+	spin_lock_irq(&amp->lock);
+	amp->count = 0;
+	amp->lost_n = 0;
+	amp->running = true;
+	spin_unlock_irq(&amp->lock);
+	ret = lockamp_amp_send(amp, &msg, sizeof(msg));
+	if (ret < 0) {
+		spin_lock_irq(&amp->lock);
+		amp->running = false;
+		spin_unlock_irq(&amp->lock);
+	}
+	return ret;
+}
+
+void lockamp_amp_stop(struct lockamp *lockamp)
+{
+	struct lockamp_amp *amp = lockamp->amp;
+	struct lockamp_amp_msg msg = {
+		.type = cpu_to_le32(LOCKAMP_AMP_MSG_STOP),
+	};
+	int ret;
+	ret = lockamp_amp_send(amp, &msg, sizeof(msg));
+	if (ret < 0) {
+		dev_warn(lockamp->dev, "Failed to stop the drain firmware: %d\n", ret);
+	}
+	spin_lock_irq(&amp->lock);
+	amp->running = false;
+	spin_unlock_irq(&amp->lock);
+	cancel_work_sync(&lockamp->dma_work);
+}
+
+/*
+ * The number of samples that the firmware wrote past the head. Call with
+ * 'signal_buf_m' held.
+ */
+size_t lockamp_amp_pending_n(struct lockamp *lockamp)
+{
+	struct lockamp_amp *amp = lockamp->amp;
+	u32 count;
+	spin_lock_irq(&amp->lock);
+	count = amp->count;
+	spin_unlock_irq(&amp->lock);
+	return count - lockamp->signal_buf.head;
+}
+
+/*
+ * Move the head to the count of the latest period message. Counterpart of
+ * 'lockamp_dma_move_to_sbuf'.
+ */
+size_t lockamp_amp_move_to_sbuf(struct lockamp *lockamp)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct lockamp_amp *amp = lockamp->amp;
+	size_t size_n;
+	u32 head;
+	u32 lost_n;
+	spin_lock_irq(&amp->lock);
+	head = amp->count;
+	lost_n = amp->lost_n;
+	amp->lost_n = 0;
+	spin_unlock_irq(&amp->lock);
+	size_n = head - sbuf->head;
+	/* The error is the latency of the period message */
+	lockamp_latch_anchor(lockamp, head, lost_n);
+	if (0 < lost_n) {
+		atomic_inc(&lockamp->stats.fifo_overruns);
+		atomic64_add(lost_n, &lockamp->stats.fifo_lost_n);
+	}
+	/* The firmware writes past the head on its own. Keep the reserve
+	 * ahead of it so that the readers stay clear. */
+	lockamp_sbuf_reserve(sbuf, head + LOCKAMP_AMP_RESERVE_N);
+	lockamp_sbuf_apply_multipliers(lockamp, sbuf->head,
+	                               min(size_n, sbuf->capacity_n));
+	lockamp_sbuf_filter(lockamp, sbuf->head, min(size_n, sbuf->capacity_n));
+	lockamp->head_seq += lost_n + size_n;
+	smp_store_release(&sbuf->head, head);
+	return size_n;
+}
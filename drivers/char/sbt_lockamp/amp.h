@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_AMP_H_
+#define _LOCKAMP_AMP_H_
+
+#include <linux/platform_device.h>
+#include <linux/types.h>
+
+#include "lockin_amplifier.h"
+
+/*
+ * Ring protocol between the driver and the drain firmware on CPU1
+ *
+ * The firmware announces one rpmsg channel named LOCKAMP_AMP_CHANNEL per
+ * lock-in amplifier. The source address of the channel is
+ * LOCKAMP_AMP_ADDR_BASE plus the "sbt,amp-id" of the device tree node.
+ *
+ * The ring is the signal buffer itself. The driver sends the physical
+ * address and size of the ring with LOCKAMP_AMP_MSG_START. From then on,
+ * the firmware pops the FIFO into the ring (starting at index zero and
+ * wrapping at 'capacity_n'). After every 'period_n' samples, it sends
+ * LOCKAMP_AMP_MSG_PERIOD with the free-running count of samples written so
+ * far. The firmware never waits for the driver. It must not write more
+ * than 'reserve_n' samples past the count of the latest period message.
+ *
+ * The ring is mapped uncached on the Linux side. The firmware must either
+ * map it uncached too or write back its data cache before each period
+ * message.
+ *
+ * All fields are little endian.
+ */
+#define LOCKAMP_AMP_CHANNEL   "sbt-lockamp-ring"
+#define LOCKAMP_AMP_ADDR_BASE 0x400
+
+enum lockamp_amp_msg_type {
+	/* Linux to firmware: struct lockamp_amp_msg_start */
+	LOCKAMP_AMP_MSG_START = 1,
+	/* Linux to firmware: struct lockamp_amp_msg. Stop popping the FIFO. */
+	LOCKAMP_AMP_MSG_STOP = 2,
+	/* Firmware to Linux: struct lockamp_amp_msg_period */
+	LOCKAMP_AMP_MSG_PERIOD = 3,
+};
+
+struct lockamp_amp_msg {
+	__le32 type;
+} __packed;
+
+struct lockamp_amp_msg_start {
+	__le32 type;
+	__le32 ring_addr;
+	/* Ring size in samples (a power of 2) */
+	__le32 capacity_n;
+	__le32 period_n;
+	__le32 reserve_n;
+} __packed;
+
+struct lockamp_amp_msg_period {
+	__le32 type;
+	/* Samples written to the ring since LOCKAMP_AMP_MSG_START (wraps at
+	 * 2^32) */
+	__le32 count;
+	/* Samples that the PL dropped since the last period message */
+	__le32 lost_n;
+} __packed;
+
+/* Same period as the DMA backend */
+#define LOCKAMP_AMP_PERIOD_N  (LOCKAMP_FIFO_CAPACITY_N / 2)
+#define LOCKAMP_AMP_RESERVE_N (2 * LOCKAMP_AMP_PERIOD_N)
+
+#ifdef CONFIG_SBT_LOCKAMP_AMP
+static inline bool lockamp_has_amp(struct lockamp *lockamp)
+{
+	return NULL != lockamp->amp;
+}
+
+int lockamp_amp_register(void);
+void lockamp_amp_unregister(void);
+int lockamp_amp_init(struct lockamp *lockamp, struct platform_device *pdev);
+void lockamp_amp_release(struct lockamp *lockamp);
+int lockamp_amp_start(struct lockamp *lockamp);
+void lockamp_amp_stop(struct lockamp *lockamp);
+size_t lockamp_amp_pending_n(struct lockamp *lockamp);
+size_t lockamp_amp_move_to_sbuf(struct lockamp *lockamp);
+#else
+static inline bool lockamp_has_amp(struct lockamp *lockamp)
+{
+	return false;
+}
+static inline int lockamp_amp_register(void)
+{
+	return 0;
+}
+static inline void lockamp_amp_unregister(void)
+{
+}
+static inline int lockamp_amp_init(struct lockamp *lockamp,
+                                   struct platform_device *pdev)
+{
+	return 0;
+}
+static inline void lockamp_amp_release(struct lockamp *lockamp)
+{
+}
+static inline int lockamp_amp_start(struct lockamp *lockamp)
+{
+	return -ENODEV;
+}
+static inline void lockamp_amp_stop(struct lockamp *lockamp)
+{
+}
+static inline size_t lockamp_amp_pending_n(struct lockamp *lockamp)
+{
+	return 0;
+}
+static inline size_t lockamp_amp_move_to_sbuf(struct lockamp *lockamp)
+{
+	return 0;
+}
+#endif
+
+#endif /* _LOCKAMP_AMP_H_ */
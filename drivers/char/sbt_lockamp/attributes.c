@@ -4,11 +4,18 @@
  *
  * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
  */
+#include <linux/cpumask.h>
 #include <linux/device.h>
+#include <linux/math64.h>
 
 #include "lockin_amplifier.h"
+#include "adc.h"
+#include "config.h"
+#include "fir.h"
+#include "sweep.h"
 #include "hw.h"
 #include "pm.h"
+#include "sbuf.h"
 
 /* decimation_factor */
 static ssize_t decimation_factor_show(
@@ -47,6 +54,9 @@ static ssize_t decimation_factor_store(
 		return ret;
 	}
 	ret = lockamp_set_decimation(lockamp, value);
+	if (0 <= ret) {
+		ret = lockamp_update_timing(lockamp);
+	}
 	lockamp_pm_put(lockamp);
 	if (ret < 0) {
 		return ret;
@@ -62,20 +72,21 @@ static ssize_t time_step_ns_show(
 	char *buf)
 {
 	struct lockamp *lockamp = dev_get_drvdata(device);
-	unsigned int value;
-	int ret = lockamp_pm_get(lockamp);
-	if (ret < 0) {
-		return ret;
-	}
-	ret = lockamp_get_time_step_ns(lockamp, &value);
-	lockamp_pm_put(lockamp);
-	if (ret < 0) {
-		return ret;
-	}
-	return snprintf(buf, PAGE_SIZE, "%d\n", value);
+	return snprintf(buf, PAGE_SIZE, "%d\n", lockamp_time_step_ns(lockamp));
 }
 DEVICE_ATTR(time_step_ns, S_IRUGO, time_step_ns_show, NULL);
 
+/* time_step_fs (unrounded; follows the measured rate of the input clock) */
+static ssize_t time_step_fs_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%llu\n", lockamp_time_step_fs(lockamp));
+}
+DEVICE_ATTR(time_step_fs, S_IRUGO, time_step_fs_show, NULL);
+
 /* fir_cycles */
 static ssize_t fir_cycles_show(
 	struct device *device,
@@ -102,9 +113,20 @@ static int signal_max_amplitude_e1 = 1784331945;
 DEVICE_INT_ATTR(signal_max_amplitude_e1, S_IRUGO, signal_max_amplitude_e1);
 
 /* ma_time_step_ns */
-DEVICE_INT_ATTR(ma_time_step_ns, S_IRUGO, lockamp_ma_time_step_ns);
+static ssize_t ma_time_step_ns_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(lockamp->stats.ma_time_step_ns));
+}
+DEVICE_ATTR(ma_time_step_ns, S_IRUGO, ma_time_step_ns_show, NULL);
 
-/* signal_buf_capacity */
+/* signal_buf_capacity
+ *
+ * Size of the signal buffer in bytes. Must be a power of 2. Can only be
+ * changed while the device is closed. */
 static ssize_t signal_buf_capacity_show(
 	struct device *device,
 	struct device_attribute *attr,
@@ -114,7 +136,35 @@ static ssize_t signal_buf_capacity_show(
 	size_t capacity = sizeof(struct sample) * lockamp->signal_buf.capacity_n;
 	return snprintf(buf, PAGE_SIZE, "%d\n", capacity);
 }
-DEVICE_ATTR(signal_buf_capacity, S_IRUGO, signal_buf_capacity_show, NULL);
+static ssize_t signal_buf_capacity_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	u32 value;
+	int ret = kstrtou32(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	/* Resume first. Otherwise, we can't get the signal buffer mutex. */
+	ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = lockamp_sbuf_resize(lockamp, value);
+	lockamp_pm_put(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	return count;
+#else
+	return -EPERM;
+#endif
+}
+DEVICE_ATTR(signal_buf_capacity, S_IRUGO | S_IWUSR, signal_buf_capacity_show, signal_buf_capacity_store);
 
 /* gen_scale_min */
 static ssize_t gen_scale_min_show(
@@ -372,6 +422,10 @@ DEVICE_ATTR_GEN_LOCK_PHASE(gen2, LOCKAMP_GEN2_CONTROL);
 			return ret; \
 		} \
 		ret = lockamp_set_##_name##_length(lockamp, value); \
+		/* The CIC length affects the time step */ \
+		if (0 <= ret) { \
+			ret = lockamp_update_timing(lockamp); \
+		} \
 		lockamp_pm_put(lockamp); \
 		if (ret < 0) { \
 			return ret; \
@@ -380,8 +434,8 @@ DEVICE_ATTR_GEN_LOCK_PHASE(gen2, LOCKAMP_GEN2_CONTROL);
 	} \
 	DEVICE_ATTR(_name##_length, S_IRUGO | S_IWUSR, _name##_length_show, _name##_length_store);
 
-DEVICE_ATTR_FILTER_LENGTH(ma, 2, 255);
-DEVICE_ATTR_FILTER_LENGTH(cic, 2, 4095);
+DEVICE_ATTR_FILTER_LENGTH(ma, LOCKAMP_MA_LENGTH_MIN, LOCKAMP_MA_LENGTH_MAX);
+DEVICE_ATTR_FILTER_LENGTH(cic, LOCKAMP_CIC_LENGTH_MIN, LOCKAMP_CIC_LENGTH_MAX);
 
 /* filter scale */
 #define DEVICE_ATTR_FILTER_SCALE(_name, _val_min, _val_max) \
@@ -431,8 +485,8 @@ DEVICE_ATTR_FILTER_LENGTH(cic, 2, 4095);
 	} \
 	DEVICE_ATTR(_name##_scale, S_IRUGO | S_IWUSR, _name##_scale_show, _name##_scale_store);
 
-DEVICE_ATTR_FILTER_SCALE(ma, 1, 7);
-DEVICE_ATTR_FILTER_SCALE(cic, 1, 63);
+DEVICE_ATTR_FILTER_SCALE(ma, LOCKAMP_MA_SCALE_MIN, LOCKAMP_MA_SCALE_MAX);
+DEVICE_ATTR_FILTER_SCALE(cic, LOCKAMP_CIC_SCALE_MIN, LOCKAMP_CIC_SCALE_MAX);
 
 /* dac_data_bits */
 static ssize_t dac_data_bits_show(
@@ -599,7 +653,31 @@ static ssize_t reset_ma_filter_store(
 }
 DEVICE_ATTR(reset_ma_filter, S_IWUSR, NULL, reset_ma_filter_store);
 
-/* fir_filter */
+/* sweep_step
+ *
+ * Index of the current step of the frequency sweep. -1 if there is no
+ * sweep. See LOCKAMP_IOC_START_SWEEP. */
+static ssize_t sweep_step_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	int step;
+	/* Resume first. Otherwise, we can't get the signal buffer mutex. */
+	int ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	step = lockamp_sweep_step(lockamp);
+	lockamp_pm_put(lockamp);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", step);
+}
+DEVICE_ATTR(sweep_step, S_IRUGO, sweep_step_show, NULL);
+
+/* fir_filter
+ *
+ * Name of the active coefficient set. See fir.c. */
 enum fir_filter {
 	NONE,
 	GROENNING,
@@ -659,7 +737,7 @@ const s32 lockamp_fir_coefs[LOCKAMP_FIR_FILTER_COUNT][LOCKAMP_FIR_COEF_LEN] = {
 		16405,  20680,  16290,  13311,  10153,   6747,   5791,   7696,  11879,  12402,   5675,   1361,   3686,   4424,   4906,   5002,   6538,   7152,   5193,   2223,   1648,   2219,   4381,   4529,    453,   1655,   2505,   1762,   2396,   3357,   4999,   6249,   4191,   1749,   -209,  -3353,   1103,   2061,   4207,   4360,   3003,   2484,   3863,   2983,   1027,  -2044,  -2679,  -1421,   -486,    397,   3126,   2463,  -1478,  -9349, -13788, -11001,  -6834,  -1529,    630,   3620,    997,  -1184,   2219,  -1316,  -1370,  -5042,  -4435,   -757,   1859,    302,  -4623,  -8368,  -5960,  -3521,    787,   1849,    333,  -2098,  -2726,  -1129,    -17,   -732,  -2101,    588,   2430,   3675,   3604,    -13,  -5603, -10096,  -7131,     85,   5953,   3676,   2833,  -1151,   -531,   1955,   4924,   4394,   1152,  -3347,  -3065,  -4507,    120,   7432,  10735,   9303,   8269,  10461,   6216,  -4214,  -8575,  -8788,  -5420,   3219,  15260,  19048,  15834,  13201,  10508,   8835,   9793,   5402,  -1818,  -4093,  -4139,  -1264,   2296,   4869,   7825,   2912,  -1842,  -6996,  -7814,  -8543,  -4706,  -2703,    862,   1713,   2115,   3092,   2373,   2370,  -1616,  -4566,  -5543,  -2781,    552,    736,  -4747,  -6608, -12238, -14941, -13686, -13119, -12042, -13403, -22150, -24617, -20065,  -9829,  -3820,  -5022,  -8859, -12310, -13453, -13705, -17832, -22631, -25207, -24122, -22671, -22118, -23295, -21695, -27166, -36611, -42173, -42003, -41659, -39905, -36406, -39284, -48262, -55997, -60210, -59011, -58517, -55905, -55498, -57496, -57303, -62654, -65560, -67149, -64579, -63181, -62434, -64820, -70391, -73368, -76738, -83004, -88184, -94876, -97720, -96411, -98354,-101554,-111507,-120547,-125686,-121219,-109790,-103401,-102182,-105620,-107810,-102656, -96752, -87960, -84515, -82881, -88237, -96689,-109560,-121065,-135444,-151154,-164479,-172925,-177408,-180998,-194321,-210393,-222662,-222935,-206178,-165231,-111030, -59530, -13344,  23369,  49241,  48832,  14733, -61603,-167058,-255878,-238824,   6371, 602272,1592446,2873402,4147772,2873402,1592446, 602272,   6371,-238824,-255878,-167058, -61603,  14733,  48832,  49241,  23369, -13344, -59530,-111030,-165231,-206178,-222935,-222662,-210393,-194321,-180998,-177408,-172925,-164479,-151154,-135444,-121065,-109560, -96689, -88237, -82881, -84515, -87960, -96752,-102656,-107810,-105620,-102182,-103401,-109790,-121219,-125686,-120547,-111507,-101554, -98354, -96411, -97720, -94876, -88184, -83004, -76738, -73368, -70391, -64820, -62434, -63181, -64579, -67149, -65560, -62654, -57303, -57496, -55498, -55905, -58517, -59011, -60210, -55997, -48262, -39284, -36406, -39905, -41659, -42003, -42173, -36611, -27166, -21695, -23295, -22118, -22671, -24122, -25207, -22631, -17832, -13705, -13453, -12310,  -8859,  -5022,  -3820,  -9829, -20065, -24617, -22150, -13403, -12042, -13119, -13686, -14941, -12238,  -6608,  -4747,    736,    552,  -2781,  -5543,  -4566,  -1616,   2370,   2373,   3092,   2115,   1713,    862,  -2703,  -4706,  -8543,  -7814,  -6996,  -1842,   2912,   7825,   4869,   2296,  -1264,  -4139,  -4093,  -1818,   5402,   9793,   8835,  10508,  13201,  15834,  19048,  15260,   3219,  -5420,  -8788,  -8575,  -4214,   6216,  10461,   8269,   9303,  10735,   7432,    120,  -4507,  -3065,  -3347,   1152,   4394,   4924,   1955,   -531,  -1151,   2833,   3676,   5953,     85,  -7131, -10096,  -5603,    -13,   3604,   3675,   2430,    588,  -2101,   -732,    -17,  -1129,  -2726,  -2098,    333,   1849,    787,  -3521,  -5960,  -8368,  -4623,    302,   1859,   -757,  -4435,  -5042,  -1370,  -1316,   2219,  -1184,    997,   3620,    630,  -1529,  -6834, -11001, -13788,  -9349,  -1478,   2463,   3126,    397,   -486,  -1421,  -2679,  -2044,   1027,   2983,   3863,   2484,   3003,   4360,   4207,   2061,   1103,  -3353,   -209,   1749,   4191,   6249,   4999,   3357,   2396,   1762,   2505,   1655,    453,   4529,   4381,   2219,   1648,   2223,   5193,   7152,   6538,   5002,   4906,   4424,   3686,   1361,   5675,  12402,  11879,   7696,   5791,   6747,  10153,  13311,  16290,  20680,  16405
 	},
 };
-const char *fir_filter_strings[] = {
+const char *lockamp_fir_names[LOCKAMP_FIR_FILTER_COUNT] = {
 	"none",
 	"groenning",
 	"a1",
@@ -671,28 +749,13 @@ const char *fir_filter_strings[] = {
 	"zeus0",
 	"wiener0",
 };
-static const char *fir_filter_to_str( enum fir_filter fir_filter )
-{
-	return fir_filter_strings[fir_filter];
-}
-static int strn_to_fir_filter( const char *s, size_t n, enum fir_filter *firf )
-{
-	size_t i;
-	for (i = 0; ARRAY_SIZE(fir_filter_strings) > i; ++i)
-		if (0 == strncmp(s, fir_filter_strings[i], n)) {
-			*firf = i;
-			return 0;
-		}
-	return -EINVAL;
-}
-
-enum fir_filter fir_filter = A1;
 static ssize_t fir_filter_show(
 	struct device *device,
 	struct device_attribute *attr,
 	char *buf)
 {
-	return scnprintf(buf, PAGE_SIZE, "%s\n", fir_filter_to_str(fir_filter));
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return lockamp_fir_show_name(lockamp, buf);
 }
 static ssize_t fir_filter_store(
 	struct device *device,
@@ -702,27 +765,60 @@ static ssize_t fir_filter_store(
 {
 	struct lockamp *lockamp = dev_get_drvdata(device);
 	int ret;
-	int content_length = count;
-	/* Truncate the newline away */
-	if (0 < content_length && '\n' == buf[content_length - 1]) {
-		content_length -= 1;
+	ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		return ret;
 	}
-	ret = strn_to_fir_filter(buf, content_length, &fir_filter);
+	ret = lockamp_fir_select(lockamp, buf);
+	lockamp_pm_put(lockamp);
 	if (ret < 0) {
 		return ret;
 	}
+	return count;
+}
+DEVICE_ATTR(fir_filter, S_IRUGO | S_IWUSR, fir_filter_show, fir_filter_store);
+
+/* fir_filters_available */
+static ssize_t fir_filters_available_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return lockamp_fir_show_available(lockamp, buf);
+}
+DEVICE_ATTR(fir_filters_available, S_IRUGO, fir_filters_available_show, NULL);
+
+/* fir_filter_load
+ *
+ * Write a name to load the coefficient set from the "lockamp-fir-<name>.bin"
+ * firmware file. Select it afterwards through 'fir_filter'. */
+static ssize_t fir_filter_load_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	char name[LOCKAMP_FIR_NAME_MAX];
+	int ret;
+	if (sizeof(name) <= count) {
+		return -EINVAL;
+	}
+	strscpy(name, buf, sizeof(name));
+	/* The set may be active. In turn, we may write to the hardware. */
 	ret = lockamp_pm_get(lockamp);
 	if (ret < 0) {
 		return ret;
 	}
-	ret = lockamp_set_fir_coefs(lockamp, lockamp_fir_coefs[fir_filter]);
+	ret = lockamp_fir_load(lockamp, strim(name));
 	lockamp_pm_put(lockamp);
 	if (ret < 0) {
 		return ret;
 	}
 	return count;
 }
-DEVICE_ATTR(fir_filter, S_IRUGO | S_IWUSR, fir_filter_show, fir_filter_store);
+DEVICE_ATTR(fir_filter_load, S_IWUSR, NULL, fir_filter_load_store);
 
 static ssize_t sample_multipliers_show(
 	struct device *device,
@@ -804,13 +900,191 @@ static ssize_t latest_adc_samples_read(
 }
 BIN_ATTR_RO(latest_adc_samples, LOCKAMP_ADC_SAMPLES_SIZE);
 
+/* status
+ *
+ * Everything that a status poll needs in a single read. See
+ * 'struct lockamp_status'. Only reads the register cache, so we do not
+ * take a PM reference. */
+static ssize_t status_read(
+	struct file *file,
+	struct kobject *kobj,
+	struct bin_attribute *bin_attr,
+	char *buf,
+	loff_t offset,
+	size_t count)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct lockamp *lockamp = dev_get_drvdata(dev);
+	struct lockamp_stats *stats = &lockamp->stats;
+	struct lockamp_status status;
+	int ret;
+	memset(&status, 0, sizeof(status));
+	status.version = LOCKAMP_STATUS_VERSION;
+	status.size = sizeof(status);
+	ret = lockamp_config_get(lockamp, &status.config);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = lockamp_get_fir_cycles(lockamp, &status.fir_cycles);
+	if (ret < 0) {
+		return ret;
+	}
+	status.time_step_ns = lockamp_time_step_ns(lockamp);
+	status.time_step_fs = lockamp_time_step_fs(lockamp);
+	status.ma_time_step_ns = READ_ONCE(stats->ma_time_step_ns);
+	status.fifo_read_duration_us = div_u64(READ_ONCE(stats->drain_duration_ns), 1000);
+	status.fifo_read_delay_us = div_u64(READ_ONCE(stats->read_delay_ns), 1000);
+	status.fifo_high = atomic_read(&stats->fifo_high);
+	status.fifo_overruns = atomic_read(&stats->fifo_overruns);
+	status.overruns = atomic_read(&stats->overruns);
+	status.invalid_mmap_tails = atomic_read(&stats->invalid_mmap_tails);
+	status.dma_errors = atomic_read(&stats->dma_errors);
+	status.desyncs = atomic_read(&lockamp->desyncs);
+	status.fifo_lost_n = atomic64_read(&stats->fifo_lost_n);
+	status.lost_n = atomic64_read(&stats->lost_n);
+	status.wakeup_latency_ns = READ_ONCE(stats->wakeup_latency_ns);
+	status.wakeup_latency_max_ns = READ_ONCE(stats->wakeup_latency_max_ns);
+	return memory_read_from_buffer(buf, count, &offset, &status, sizeof(status));
+}
+BIN_ATTR_RO(status, sizeof(struct lockamp_status));
+
+/* adc_snapshot
+ *
+ * The asynchronous alternative to 'latest_adc_samples'. Map it (read-only)
+ * and see 'struct lockamp_adc_snapshot_ctrl' for the layout. */
+static ssize_t adc_snapshot_read(
+	struct file *file,
+	struct kobject *kobj,
+	struct bin_attribute *bin_attr,
+	char *buf,
+	loff_t offset,
+	size_t count)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct lockamp *lockamp = dev_get_drvdata(dev);
+	return lockamp_adc_snapshot_copy(lockamp, buf, offset, count);
+}
+static int adc_snapshot_mmap(
+	struct file *file,
+	struct kobject *kobj,
+	struct bin_attribute *bin_attr,
+	struct vm_area_struct *vma)
+{
+	struct device *dev = container_of(kobj, struct device, kobj);
+	struct lockamp *lockamp = dev_get_drvdata(dev);
+	return lockamp_adc_snapshot_mmap(lockamp, vma);
+}
+static struct bin_attribute bin_attr_adc_snapshot = {
+	.attr = { .name = "adc_snapshot", .mode = S_IRUGO },
+	.size = LOCKAMP_ADC_SNAPSHOT_MAP_SIZE,
+	.read = adc_snapshot_read,
+	.mmap = adc_snapshot_mmap,
+};
+
+/* adc_snapshot_period_ms
+ *
+ * Capture an ADC snapshot this often. Zero (the default) to stop. */
+static ssize_t adc_snapshot_period_ms_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(lockamp->adc_snapshot_period_ms));
+}
+static ssize_t adc_snapshot_period_ms_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	unsigned int value;
+	int ret = kstrtouint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	lockamp_adc_snapshot_set_period_ms(lockamp, value);
+	return count;
+}
+DEVICE_ATTR(adc_snapshot_period_ms, S_IRUGO | S_IWUSR, adc_snapshot_period_ms_show, adc_snapshot_period_ms_store);
+
+/* adc_snapshot_trigger
+ *
+ * Write anything to capture a single ADC snapshot. */
+static ssize_t adc_snapshot_trigger_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	lockamp_adc_snapshot_trigger(lockamp);
+	return count;
+}
+DEVICE_ATTR(adc_snapshot_trigger, S_IWUSR, NULL, adc_snapshot_trigger_store);
+
+/* autosuspend_delay_ms
+ *
+ * Stay powered this long after the last session ends. Negative to never
+ * power down. Same as "power/autosuspend_delay_ms" of the platform
+ * device. */
+static ssize_t autosuspend_delay_ms_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+	                 READ_ONCE(device->parent->power.autosuspend_delay));
+}
+static ssize_t autosuspend_delay_ms_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	int value;
+	int ret = kstrtoint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	pm_runtime_set_autosuspend_delay(device->parent, value);
+	return count;
+}
+DEVICE_ATTR(autosuspend_delay_ms, S_IRUGO | S_IWUSR, autosuspend_delay_ms_show, autosuspend_delay_ms_store);
+
+/* prewarm_ms
+ *
+ * Write a duration to power up right away and stay powered for at least
+ * that long. E.g., right before a client reconnects. */
+static ssize_t prewarm_ms_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	unsigned int value;
+	int ret = kstrtouint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = lockamp_pm_prewarm(lockamp, value);
+	if (ret < 0) {
+		return ret;
+	}
+	return count;
+}
+DEVICE_ATTR(prewarm_ms, S_IWUSR, NULL, prewarm_ms_store);
+
 /* fifo_read_duration_us */
 static ssize_t fifo_read_duration_us_show(
 	struct device *device,
 	struct device_attribute *attr,
 	char *buf)
 {
-	return scnprintf(buf, PAGE_SIZE, "%d\n", (u32)lockamp_fifo_read_duration / 1000);
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (u32)READ_ONCE(lockamp->stats.drain_duration_ns) / 1000);
 }
 DEVICE_ATTR(fifo_read_duration_us, S_IRUGO, fifo_read_duration_us_show, NULL);
 
@@ -820,10 +1094,374 @@ static ssize_t fifo_read_delay_us_show(
 	struct device_attribute *attr,
 	char *buf)
 {
-	return scnprintf(buf, PAGE_SIZE, "%d\n", (u32)lockamp_fifo_read_delay / 1000);
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", (u32)READ_ONCE(lockamp->stats.read_delay_ns) / 1000);
 }
 DEVICE_ATTR(fifo_read_delay_us, S_IRUGO, fifo_read_delay_us_show, NULL);
 
+/* fifo_watermark
+ *
+ * Number of samples in the FIFO that triggers the FIFO interrupt. Only
+ * available if the device has a FIFO interrupt. */
+static ssize_t fifo_watermark_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	u32 value;
+	int ret;
+	if (lockamp->irq <= 0) {
+		return -ENODEV;
+	}
+	ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = lockamp_get_fifo_threshold_n(lockamp, &value);
+	lockamp_pm_put(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	return scnprintf(buf, PAGE_SIZE, "%d\n", value);
+}
+static ssize_t fifo_watermark_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	u32 value;
+	int ret;
+	if (lockamp->irq <= 0) {
+		return -ENODEV;
+	}
+	ret = kstrtou32(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	/* Zero would disable the interrupt altogether */
+	if (1 > value || value >= LOCKAMP_FIFO_CAPACITY_N) {
+		return -ERANGE;
+	}
+	ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = lockamp_set_fifo_threshold_n(lockamp, value);
+	lockamp_pm_put(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	return count;
+}
+DEVICE_ATTR(fifo_watermark, S_IRUGO | S_IWUSR, fifo_watermark_show, fifo_watermark_store);
+
+#ifdef CONFIG_SBT_LOCKAMP_FIFO_BENCHMARK
+/* fifo_benchmark */
+static int fifo_benchmark_print(char *buf, size_t size, const char *name, u64 total_ns)
+{
+	/* ns per sample with three decimals */
+	u64 ps = div_u64(total_ns * 1000, LOCKAMP_FIFO_BENCHMARK_N);
+	u32 frac;
+	u64 whole = div_u64_rem(ps, 1000, &frac);
+	return scnprintf(buf, size, "%s: %llu.%03u ns/sample\n", name, whole, frac);
+}
+static ssize_t fifo_benchmark_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	struct lockamp_fifo_benchmark result;
+	ssize_t size = 0;
+	int ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	mutex_lock(&lockamp->signal_buf_m);
+	ret = lockamp_fifo_benchmark(lockamp, &result);
+	mutex_unlock(&lockamp->signal_buf_m);
+	lockamp_pm_put(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	size += scnprintf(buf + size, PAGE_SIZE - size, "relaxed: %d\n",
+	                  IS_ENABLED(CONFIG_SBT_LOCKAMP_FIFO_POP_RELAXED));
+	size += fifo_benchmark_print(buf + size, PAGE_SIZE - size,
+	                             "pop_sample", result.pop_sample_ns);
+	size += fifo_benchmark_print(buf + size, PAGE_SIZE - size,
+	                             "pop_rep", result.pop_rep_ns);
+	size += fifo_benchmark_print(buf + size, PAGE_SIZE - size,
+	                             "multiply_scalar", result.multiply_scalar_ns);
+	size += fifo_benchmark_print(buf + size, PAGE_SIZE - size,
+	                             "multiply_fast", result.multiply_fast_ns);
+	return size;
+}
+DEVICE_ATTR(fifo_benchmark, S_IRUSR, fifo_benchmark_show, NULL);
+#endif
+
+/* read_low_watermark
+ *
+ * Blocking reads wait until there are at least this many samples (or as many
+ * samples as the read buffer can hold). Likewise, poll reports the device as
+ * readable from this many samples. Zero (the default) disables the wait. */
+static ssize_t read_low_watermark_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(lockamp->read_low_watermark_n));
+}
+static ssize_t read_low_watermark_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	u32 value;
+	int ret = kstrtou32(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	/* Leave room for the reader to catch up before it is overrun */
+	if (value > lockamp->signal_buf.capacity_n / 2) {
+		return -ERANGE;
+	}
+	WRITE_ONCE(lockamp->read_low_watermark_n, value);
+	return count;
+}
+DEVICE_ATTR(read_low_watermark, S_IRUGO | S_IWUSR, read_low_watermark_show, read_low_watermark_store);
+
+/* timestamp_mode */
+static const char *timestamp_mode_strings[] = {
+	[LOCKAMP_TIMESTAMP_EXTRAPOLATED] = "extrapolated",
+	[LOCKAMP_TIMESTAMP_ANCHOR] = "anchor",
+};
+static ssize_t timestamp_mode_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%s\n",
+	                 timestamp_mode_strings[READ_ONCE(lockamp->timestamp_mode)]);
+}
+static ssize_t timestamp_mode_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	int ret = sysfs_match_string(timestamp_mode_strings, buf);
+	if (ret < 0) {
+		return ret;
+	}
+	WRITE_ONCE(lockamp->timestamp_mode, ret);
+	return count;
+}
+DEVICE_ATTR(timestamp_mode, S_IRUGO | S_IWUSR, timestamp_mode_show, timestamp_mode_store);
+
+/* chunk_header_version
+ *
+ * 1: The chunk header as is. 2: The chunk header is followed by a sequence
+ * header (sequence number and loss accounting). See fops.c. */
+static ssize_t chunk_header_version_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(lockamp->chunk_header_version));
+}
+static ssize_t chunk_header_version_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	unsigned int value;
+	int ret = kstrtouint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	if (1 > value || LOCKAMP_CHUNK_HEADER_VERSION_MAX < value) {
+		return -ERANGE;
+	}
+	WRITE_ONCE(lockamp->chunk_header_version, value);
+	return count;
+}
+DEVICE_ATTR(chunk_header_version, S_IRUGO | S_IWUSR, chunk_header_version_show, chunk_header_version_store);
+
+/* output_mask
+ *
+ * Entries of each sample that read() outputs. Bit i selects entry i of
+ * 'struct sample' (i.e., 'hf_re', 'hf_im', 'lf_re', 'lf_im' of site 0
+ * followed by those of site 1). Any mask but 0xff adds a format
+ * descriptor to the chunk header. */
+static ssize_t output_mask_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "0x%02x\n", READ_ONCE(lockamp->output_mask));
+}
+static ssize_t output_mask_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	unsigned int value;
+	int ret = kstrtouint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	if (0 == value || value & ~LOCKAMP_OUTPUT_MASK_ALL) {
+		return -EINVAL;
+	}
+	WRITE_ONCE(lockamp->output_mask, value);
+	return count;
+}
+DEVICE_ATTR(output_mask, S_IRUGO | S_IWUSR, output_mask_show, output_mask_store);
+
+/* output_entry
+ *
+ * Type of each entry that read() outputs. "s16" saturates the entries.
+ * Use the sample multipliers to scale the entries into the s16 range. */
+static const char *output_entry_strings[] = {
+	[LOCKAMP_OUTPUT_S32] = "s32",
+	[LOCKAMP_OUTPUT_S16] = "s16",
+};
+static ssize_t output_entry_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%s\n",
+	                 output_entry_strings[READ_ONCE(lockamp->output_entry)]);
+}
+static ssize_t output_entry_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	int ret = sysfs_match_string(output_entry_strings, buf);
+	if (ret < 0) {
+		return ret;
+	}
+	WRITE_ONCE(lockamp->output_entry, ret);
+	return count;
+}
+DEVICE_ATTR(output_entry, S_IRUGO | S_IWUSR, output_entry_show, output_entry_store);
+
+/* drain_cpu
+ *
+ * CPU that moves data into the signal buffer. -1 (the default) for any CPU.
+ * Takes effect when the first reader opens the device. */
+static ssize_t drain_cpu_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(lockamp->drain_cpu));
+}
+static ssize_t drain_cpu_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	int value;
+	int ret = kstrtoint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	if (0 <= value && (value >= nr_cpu_ids || !cpu_online(value))) {
+		return -EINVAL;
+	}
+	WRITE_ONCE(lockamp->drain_cpu, max(value, -1));
+	return count;
+}
+DEVICE_ATTR(drain_cpu, S_IRUGO | S_IWUSR, drain_cpu_show, drain_cpu_store);
+
+/* drain_min_freq_khz
+ *
+ * Minimum frequency of the drain CPU (or of all CPUs if 'drain_cpu' is -1)
+ * while the drain runs. Capped at the maximum of the cpufreq policy. 0 (the
+ * default) to leave the frequency to the governor. Takes effect when the
+ * first reader opens the device. */
+static ssize_t drain_min_freq_khz_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(lockamp->drain_min_freq_khz));
+}
+static ssize_t drain_min_freq_khz_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	unsigned int value;
+	int ret = kstrtouint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	/* The QoS values are signed */
+	WRITE_ONCE(lockamp->drain_min_freq_khz, min_t(unsigned int, value, S32_MAX));
+	return count;
+}
+DEVICE_ATTR(drain_min_freq_khz, S_IRUGO | S_IWUSR, drain_min_freq_khz_show, drain_min_freq_khz_store);
+
+/* drain_policy
+ *
+ * Scheduling policy of the thread that moves data into the signal buffer.
+ * Takes effect when the first reader opens the device. */
+static const char *drain_policy_strings[] = {
+	[LOCKAMP_DRAIN_FIFO] = "fifo",
+	[LOCKAMP_DRAIN_DEADLINE] = "deadline",
+};
+static ssize_t drain_policy_show(
+	struct device *device,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%s\n",
+	                 drain_policy_strings[READ_ONCE(lockamp->drain_policy)]);
+}
+static ssize_t drain_policy_store(
+	struct device *device,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct lockamp *lockamp = dev_get_drvdata(device);
+	int ret = sysfs_match_string(drain_policy_strings, buf);
+	if (ret < 0) {
+		return ret;
+	}
+	WRITE_ONCE(lockamp->drain_policy, ret);
+	return count;
+}
+DEVICE_ATTR(drain_policy, S_IRUGO | S_IWUSR, drain_policy_show, drain_policy_store);
+
 /* amp_supply_force_off */
 static ssize_t amp_supply_force_off_show(
 	struct device *device,
@@ -873,18 +1511,15 @@ DEVICE_ATTR(amp_supply_force_off,
             amp_supply_force_off_show,
             amp_supply_force_off_store);
 
-DEVICE_INT_ATTR(drv_debug1, S_IRUGO, lockamp_debug1);
-DEVICE_INT_ATTR(drv_debug2, S_IRUGO, lockamp_debug2);
-DEVICE_INT_ATTR(drv_debug3, S_IRUGO, lockamp_debug3);
-
 /* attribute group */
 static struct attribute *attrs[] = {
 	&dev_attr_decimation_factor.attr,
 	&dev_attr_time_step_ns.attr,
+	&dev_attr_time_step_fs.attr,
 	&dev_attr_fir_cycles.attr,
 	&dev_attr_signal_buf_capacity.attr,
 	&dev_attr_signal_max_amplitude_e1.attr.attr,
-	&dev_attr_ma_time_step_ns.attr.attr,
+	&dev_attr_ma_time_step_ns.attr,
 	&dev_attr_gen_scale_min.attr,
 	&dev_attr_gen_scale_max.attr,
 	&dev_attr_gen1_scale.attr,
@@ -903,18 +1538,36 @@ static struct attribute *attrs[] = {
 	&dev_attr_config.attr,
 	&dev_attr_debug_control.attr,
 	&dev_attr_reset_ma_filter.attr,
+	&dev_attr_sweep_step.attr,
 	&dev_attr_fir_filter.attr,
+	&dev_attr_fir_filters_available.attr,
+	&dev_attr_fir_filter_load.attr,
 	&dev_attr_sample_multipliers.attr,
 	&dev_attr_fifo_read_duration_us.attr,
 	&dev_attr_fifo_read_delay_us.attr,
+	&dev_attr_fifo_watermark.attr,
+	&dev_attr_read_low_watermark.attr,
+	&dev_attr_timestamp_mode.attr,
+	&dev_attr_chunk_header_version.attr,
+	&dev_attr_output_mask.attr,
+	&dev_attr_output_entry.attr,
+	&dev_attr_drain_cpu.attr,
+	&dev_attr_drain_min_freq_khz.attr,
+	&dev_attr_drain_policy.attr,
+#ifdef CONFIG_SBT_LOCKAMP_FIFO_BENCHMARK
+	&dev_attr_fifo_benchmark.attr,
+#endif
 	&dev_attr_amp_supply_force_off.attr,
-	&dev_attr_drv_debug1.attr.attr,
-	&dev_attr_drv_debug2.attr.attr,
-	&dev_attr_drv_debug3.attr.attr,
+	&dev_attr_adc_snapshot_period_ms.attr,
+	&dev_attr_adc_snapshot_trigger.attr,
+	&dev_attr_autosuspend_delay_ms.attr,
+	&dev_attr_prewarm_ms.attr,
 	NULL
 };
 static struct bin_attribute *bin_attrs[] = {
 	&bin_attr_latest_adc_samples,
+	&bin_attr_adc_snapshot,
+	&bin_attr_status,
 	NULL
 };
 static struct attribute_group attr_group = {
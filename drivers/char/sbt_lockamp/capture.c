@@ -0,0 +1,821 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/gpio/consumer.h>
+#include <linux/interrupt.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/vmalloc.h>
+
+#include "capture.h"
+#include "hw.h"
+
+/*
+ * Capture device (see 'struct lockamp_capture_header')
+ *
+ * The signal buffer already holds the recent history. Thus, the
+ * pre-trigger samples are simply the ones before the trigger sample. The
+ * drain path (see 'drain_fifo') calls 'lockamp_capture_push' each time it
+ * moved samples into the signal buffer. We look for a trigger in the new
+ * samples (or take the pending external trigger). Once the head passed the
+ * end of the window, we copy the window out of the signal buffer and into a
+ * slot of our own ring.
+ *
+ * Like the signal buffer, the ring has a single producer and any number of
+ * readers, and the producer never waits for the readers. The ring only
+ * exists while a capture file is open. Its slot size follows from "pre_n"
+ * and "post_n", so these only change while no file is open.
+ *
+ * External triggers (the GPIO interrupt and the "trigger" attribute) only
+ * latch the time. The producer converts it into a sample count with the
+ * anchor (see 'lockamp_latch_anchor').
+ *
+ * The producer state is protected by 'signal_buf_m'.
+ */
+#define LOCKAMP_CAPTURE_BUF_SIZE  4194304 /* 4 MiB */
+#define LOCKAMP_CAPTURE_MAX_SLOTS 64
+/* Such that the ring has at least four slots */
+#define LOCKAMP_CAPTURE_MAX_N     ((LOCKAMP_CAPTURE_BUF_SIZE / 4 - \
+                                    sizeof(struct lockamp_capture_header)) / \
+                                   sizeof(struct sample))
+#define LOCKAMP_CAPTURE_PRE_N     1024
+#define LOCKAMP_CAPTURE_POST_N    3072
+/* lf_re of the first site */
+#define LOCKAMP_CAPTURE_LEVEL_ENTRY 2
+
+enum lockamp_capture_edge {
+	LOCKAMP_CAPTURE_RISING,
+	LOCKAMP_CAPTURE_FALLING,
+	LOCKAMP_CAPTURE_BOTH,
+};
+
+struct lockamp_capture {
+	struct lockamp *lockamp;
+	struct device dev;
+	struct cdev cdev;
+	/* Serializes open, release, and changes of the window size */
+	struct mutex m;
+	u32 pre_n;
+	u32 post_n;
+	enum lockamp_capture_source source;
+	unsigned int level_entry;
+	s32 level;
+	enum lockamp_capture_edge level_edge;
+	/* The trigger GPIO (optional) and its interrupt */
+	struct gpio_desc *gpio;
+	int irq;
+	/* The latest external trigger (if 'ext_pending') */
+	spinlock_t ext_lock;
+	bool ext_pending;
+	u64 ext_mono_ns;
+	enum lockamp_capture_source ext_source;
+	u32 ext_missed;
+	/* Ring of 'slots_n' windows of 'slot_size' bytes each. Free-running
+	 * counts of windows like 'struct circ_sample_buf'. */
+	void *buf;
+	size_t slot_size;
+	u32 slots_n;
+	u32 head;
+	u32 reserve;
+	wait_queue_head_t wq;
+	/* Number of open files. The producer only runs if non-zero. */
+	unsigned int open_count;
+	/* A new trigger must be at this count or later (i.e., past the end of
+	 * the last window) */
+	u32 next_count;
+	/* Count of the next sample to compare with the level */
+	u32 scan;
+	s32 prev_value;
+	bool prev_valid;
+	u32 config_count;
+	/* The trigger of the window in progress (if 'triggered') */
+	bool triggered;
+	u32 trigger_count;
+	enum lockamp_capture_source trigger_source;
+	u32 missed;
+};
+
+/* Per open file */
+struct lockamp_capture_reader {
+	struct lockamp_capture *capture;
+	u32 tail;
+};
+
+static struct lockamp_capture_header *slot(struct lockamp_capture *capture,
+                                           u32 index)
+{
+	return capture->buf + (index & (capture->slots_n - 1)) * capture->slot_size;
+}
+
+/* The count of the sample that the PL produced at the given time
+ * (see 'ktime_get_mono_fast_ns') */
+static u32 mono_ns_to_count(struct lockamp *lockamp, u64 mono_ns)
+{
+	struct lockamp_anchor *anchor = &lockamp->anchor;
+	unsigned int time_step_ns = lockamp_time_step_ns(lockamp);
+	if (0 == time_step_ns) {
+		return anchor->count;
+	}
+	if (mono_ns < anchor->mono_ns) {
+		return anchor->count -
+		       (u32)div_u64(anchor->mono_ns - mono_ns, time_step_ns);
+	}
+	return anchor->count + (u32)div_u64(mono_ns - anchor->mono_ns, time_step_ns);
+}
+
+/* Safe to call from hard interrupt context */
+static void ext_trigger(struct lockamp_capture *capture,
+                        enum lockamp_capture_source source)
+{
+	u64 mono_ns = ktime_get_mono_fast_ns();
+	unsigned long flags;
+	if (0 == READ_ONCE(capture->open_count)) {
+		return;
+	}
+	spin_lock_irqsave(&capture->ext_lock, flags);
+	/* The producer did not take the previous trigger yet */
+	if (capture->ext_pending) {
+		++capture->ext_missed;
+	} else {
+		capture->ext_pending = true;
+		capture->ext_mono_ns = mono_ns;
+		capture->ext_source = source;
+	}
+	spin_unlock_irqrestore(&capture->ext_lock, flags);
+}
+
+static irqreturn_t capture_gpio_irq(int irq, void *data)
+{
+	struct lockamp_capture *capture = data;
+	if (LOCKAMP_CAPTURE_GPIO == READ_ONCE(capture->source)) {
+		ext_trigger(capture, LOCKAMP_CAPTURE_GPIO);
+	}
+	return IRQ_HANDLED;
+}
+
+static bool trigger(struct lockamp_capture *capture, u32 count,
+                    enum lockamp_capture_source source)
+{
+	/* Within the last window */
+	if ((s32)(count - capture->next_count) < 0) {
+		++capture->missed;
+		return false;
+	}
+	capture->triggered = true;
+	capture->trigger_count = count;
+	capture->trigger_source = source;
+	return true;
+}
+
+static bool take_ext_trigger(struct lockamp *lockamp,
+                             struct lockamp_capture *capture)
+{
+	enum lockamp_capture_source source;
+	bool pending;
+	u64 mono_ns;
+	spin_lock_irq(&capture->ext_lock);
+	pending = capture->ext_pending;
+	mono_ns = capture->ext_mono_ns;
+	source = capture->ext_source;
+	capture->missed += capture->ext_missed;
+	capture->ext_pending = false;
+	capture->ext_missed = 0;
+	spin_unlock_irq(&capture->ext_lock);
+	if (!pending) {
+		return false;
+	}
+	return trigger(capture, mono_ns_to_count(lockamp, mono_ns), source);
+}
+
+/* Compare the samples in [scan; head) with the level */
+static bool scan_level(struct lockamp *lockamp, struct lockamp_capture *capture,
+                       u32 head)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	unsigned int entry = READ_ONCE(capture->level_entry);
+	enum lockamp_capture_edge edge = READ_ONCE(capture->level_edge);
+	s32 level = READ_ONCE(capture->level);
+	bool rising, falling;
+	s32 value;
+	/* Skip the last window */
+	if ((s32)(capture->scan - capture->next_count) < 0) {
+		capture->scan = capture->next_count;
+		capture->prev_valid = false;
+	}
+	while (head != capture->scan) {
+		value = ((const s32 *)&sbuf->buf[lockamp_sbuf_index(sbuf, capture->scan)])[entry];
+		rising = capture->prev_valid && capture->prev_value < level && level <= value;
+		falling = capture->prev_valid && capture->prev_value >= level && level > value;
+		capture->prev_value = value;
+		capture->prev_valid = true;
+		if ((rising && LOCKAMP_CAPTURE_FALLING != edge) ||
+		    (falling && LOCKAMP_CAPTURE_RISING != edge)) {
+			return trigger(capture, capture->scan++, LOCKAMP_CAPTURE_LEVEL);
+		}
+		++capture->scan;
+	}
+	return false;
+}
+
+static bool find_trigger(struct lockamp *lockamp, struct lockamp_capture *capture,
+                         u32 head)
+{
+	enum lockamp_capture_source source = READ_ONCE(capture->source);
+	u32 config_count;
+	if (take_ext_trigger(lockamp, capture)) {
+		return true;
+	}
+	if (LOCKAMP_CAPTURE_LEVEL == source) {
+		return scan_level(lockamp, capture, head);
+	}
+	/* Don't compare old samples once the level source is selected */
+	capture->scan = head;
+	capture->prev_valid = false;
+	if (LOCKAMP_CAPTURE_CONFIG == source) {
+		config_count = READ_ONCE(lockamp->config_count);
+		if (config_count != capture->config_count) {
+			capture->config_count = config_count;
+			return trigger(capture, config_count, LOCKAMP_CAPTURE_CONFIG);
+		}
+	}
+	return false;
+}
+
+/* Copy the window of the current trigger into the next slot */
+static void emit_window(struct lockamp *lockamp, struct lockamp_capture *capture)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct lockamp_capture_header *header;
+	struct sample *samples;
+	u32 oldest = sbuf->reserve - sbuf->capacity_n;
+	u32 count = capture->trigger_count - capture->pre_n;
+	u32 head = capture->head;
+	size_t size_n;
+	size_t index;
+	size_t n;
+	capture->triggered = false;
+	capture->next_count = capture->trigger_count + capture->post_n;
+	/* The signal buffer no longer holds the trigger sample */
+	if ((s32)(capture->trigger_count - oldest) < 0) {
+		++capture->missed;
+		return;
+	}
+	/* Nor all of the pre-trigger samples */
+	if ((s32)(count - oldest) < 0) {
+		count = oldest;
+	}
+	size_n = capture->next_count - count;
+	WRITE_ONCE(capture->reserve, head + 1);
+	/* Readers must see the new reserve before the new window */
+	smp_wmb();
+	header = slot(capture, head);
+	header->time_ns = lockamp_count_real_ns(lockamp, capture->trigger_count);
+	header->seq = head;
+	header->trigger_count = capture->trigger_count;
+	header->count = count;
+	header->size_n = size_n;
+	header->pre_n = capture->trigger_count - count;
+	header->source = capture->trigger_source;
+	header->missed = capture->missed;
+	header->reserved = 0;
+	capture->missed = 0;
+	/* In contiguous parts of the signal buffer */
+	samples = (struct sample *)(header + 1);
+	while (0 < size_n) {
+		index = lockamp_sbuf_index(sbuf, count);
+		n = min_t(size_t, size_n, sbuf->capacity_n - index);
+		memcpy(samples, &sbuf->buf[index], n * sizeof(*samples));
+		samples += n;
+		count += n;
+		size_n -= n;
+	}
+	smp_store_release(&capture->head, head + 1);
+}
+
+/* Call with 'signal_buf_m' held */
+void lockamp_capture_push(struct lockamp *lockamp)
+{
+	struct lockamp_capture *capture = lockamp->capture;
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	u32 head = sbuf->head;
+	u32 old_head;
+	u32 oldest;
+	if (NULL == capture || 0 == capture->open_count) {
+		return;
+	}
+	/* We fell behind (e.g., at the first push). Start over. */
+	oldest = sbuf->reserve - sbuf->capacity_n;
+	if ((s32)(capture->scan - oldest) < 0) {
+		capture->scan = oldest;
+		capture->prev_valid = false;
+	}
+	old_head = capture->head;
+	for (;;) {
+		if (!capture->triggered && !find_trigger(lockamp, capture, head)) {
+			break;
+		}
+		/* Wait for the rest of the window */
+		if ((s32)(head - (capture->trigger_count + capture->post_n)) < 0) {
+			break;
+		}
+		emit_window(lockamp, capture);
+	}
+	if (old_head != capture->head) {
+		wake_up_interruptible(&capture->wq);
+	}
+}
+
+/* Skip the windows that the producer overwrote */
+static void reader_skip_overrun(struct lockamp_capture_reader *reader)
+{
+	struct lockamp_capture *capture = reader->capture;
+	u32 oldest;
+	/* Read the reserve after the windows */
+	smp_rmb();
+	oldest = READ_ONCE(capture->reserve) - capture->slots_n;
+	if ((s32)(reader->tail - oldest) < 0) {
+		reader->tail = oldest;
+	}
+}
+
+static bool reader_has_data(struct lockamp_capture_reader *reader)
+{
+	return smp_load_acquire(&reader->capture->head) != reader->tail;
+}
+
+/* Call with 'capture->m' held */
+static int alloc_ring(struct lockamp_capture *capture)
+{
+	size_t slot_size = sizeof(struct lockamp_capture_header) +
+	                   (size_t)(capture->pre_n + capture->post_n) * sizeof(struct sample);
+	u32 slots_n = rounddown_pow_of_two(LOCKAMP_CAPTURE_BUF_SIZE / slot_size);
+	slots_n = min_t(u32, slots_n, LOCKAMP_CAPTURE_MAX_SLOTS);
+	capture->buf = vmalloc(slots_n * slot_size);
+	if (NULL == capture->buf) {
+		return -ENOMEM;
+	}
+	capture->slot_size = slot_size;
+	capture->slots_n = slots_n;
+	capture->head = 0;
+	capture->reserve = 0;
+	return 0;
+}
+
+static int capture_open(struct inode *inode, struct file *filp)
+{
+	struct lockamp_capture *capture = container_of(inode->i_cdev,
+	                                               struct lockamp_capture, cdev);
+	struct lockamp *lockamp = capture->lockamp;
+	struct lockamp_capture_reader *reader;
+	int ret;
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (NULL == reader) {
+		return -ENOMEM;
+	}
+	reader->capture = capture;
+	/* Like any reader, we keep the producer running */
+	ret = lockamp_drain_get(lockamp);
+	if (ret < 0) {
+		goto out_free;
+	}
+	mutex_lock(&capture->m);
+	if (0 == capture->open_count) {
+		ret = alloc_ring(capture);
+		if (ret < 0) {
+			mutex_unlock(&capture->m);
+			goto out_put;
+		}
+		spin_lock_irq(&capture->ext_lock);
+		capture->ext_pending = false;
+		capture->ext_missed = 0;
+		spin_unlock_irq(&capture->ext_lock);
+	}
+	mutex_lock(&lockamp->signal_buf_m);
+	/* The first file looks for triggers from the newest sample on */
+	if (0 == capture->open_count++) {
+		capture->next_count = lockamp->signal_buf.head;
+		capture->scan = lockamp->signal_buf.head;
+		capture->prev_valid = false;
+		capture->config_count = READ_ONCE(lockamp->config_count);
+		capture->triggered = false;
+		capture->missed = 0;
+	}
+	reader->tail = capture->head;
+	mutex_unlock(&lockamp->signal_buf_m);
+	mutex_unlock(&capture->m);
+	filp->private_data = reader;
+	return stream_open(inode, filp);
+
+out_put:
+	lockamp_drain_put(lockamp);
+out_free:
+	kfree(reader);
+	return ret;
+}
+
+static int capture_release(struct inode *inode, struct file *filp)
+{
+	struct lockamp_capture_reader *reader = filp->private_data;
+	struct lockamp_capture *capture = reader->capture;
+	struct lockamp *lockamp = capture->lockamp;
+	void *buf = NULL;
+	mutex_lock(&capture->m);
+	mutex_lock(&lockamp->signal_buf_m);
+	if (0 == --capture->open_count) {
+		buf = capture->buf;
+		capture->buf = NULL;
+	}
+	mutex_unlock(&lockamp->signal_buf_m);
+	vfree(buf);
+	mutex_unlock(&capture->m);
+	lockamp_drain_put(lockamp);
+	kfree(reader);
+	return 0;
+}
+
+static ssize_t capture_read(struct file *filp, char __user *buf, size_t len,
+                            loff_t *off)
+{
+	struct lockamp_capture_reader *reader = filp->private_data;
+	struct lockamp_capture *capture = reader->capture;
+	struct lockamp_capture_header *header;
+	size_t copied = 0;
+	size_t size;
+	u32 head;
+	int ret;
+	if (len < capture->slot_size) {
+		return -EINVAL;
+	}
+	if (!reader_has_data(reader)) {
+		if (filp->f_flags & O_NONBLOCK) {
+			return -EAGAIN;
+		}
+		ret = wait_event_interruptible(capture->wq, reader_has_data(reader));
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	for (;;) {
+		head = smp_load_acquire(&capture->head);
+		reader_skip_overrun(reader);
+		if (head == reader->tail) {
+			break;
+		}
+		header = slot(capture, reader->tail);
+		size = sizeof(*header) + READ_ONCE(header->size_n) * sizeof(struct sample);
+		/* The producer may overwrite the window while we copy it. We
+		 * check for that below. */
+		size = min(size, capture->slot_size);
+		if (len - copied < size) {
+			break;
+		}
+		if (copy_to_user(buf + copied, header, size)) {
+			return (0 < copied) ? copied : -EFAULT;
+		}
+		smp_rmb();
+		if ((s32)(reader->tail - (READ_ONCE(capture->reserve) -
+		                          capture->slots_n)) < 0) {
+			continue;
+		}
+		copied += size;
+		++reader->tail;
+	}
+	return copied;
+}
+
+static __poll_t capture_poll(struct file *filp, poll_table *wait)
+{
+	struct lockamp_capture_reader *reader = filp->private_data;
+	poll_wait(filp, &reader->capture->wq, wait);
+	if (reader_has_data(reader)) {
+		return EPOLLIN | EPOLLRDNORM;
+	}
+	return 0;
+}
+
+static const struct file_operations lockamp_capture_fops = {
+	.owner = THIS_MODULE,
+	.open = capture_open,
+	.release = capture_release,
+	.read = capture_read,
+	.poll = capture_poll,
+	.llseek = no_llseek,
+};
+
+static int set_window(struct lockamp_capture *capture, u32 pre_n, u32 post_n)
+{
+	int ret = 0;
+	/* The trigger sample is the first of the post-trigger samples */
+	if (0 == post_n || LOCKAMP_CAPTURE_MAX_N < (u64)pre_n + post_n) {
+		return -EINVAL;
+	}
+	mutex_lock(&capture->m);
+	if (0 < capture->open_count) {
+		ret = -EBUSY;
+		goto out;
+	}
+	WRITE_ONCE(capture->pre_n, pre_n);
+	WRITE_ONCE(capture->post_n, post_n);
+out:
+	mutex_unlock(&capture->m);
+	return ret;
+}
+
+/* pre_n */
+static ssize_t pre_n_show(struct device *device, struct device_attribute *attr,
+                          char *buf)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(capture->pre_n));
+}
+static ssize_t pre_n_store(struct device *device, struct device_attribute *attr,
+                           const char *buf, size_t count)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	u32 value;
+	int ret = kstrtou32(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = set_window(capture, value, READ_ONCE(capture->post_n));
+	if (ret < 0) {
+		return ret;
+	}
+	return count;
+}
+static DEVICE_ATTR(pre_n, S_IRUGO | S_IWUSR, pre_n_show, pre_n_store);
+
+/* post_n */
+static ssize_t post_n_show(struct device *device, struct device_attribute *attr,
+                           char *buf)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(capture->post_n));
+}
+static ssize_t post_n_store(struct device *device, struct device_attribute *attr,
+                            const char *buf, size_t count)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	u32 value;
+	int ret = kstrtou32(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = set_window(capture, READ_ONCE(capture->pre_n), value);
+	if (ret < 0) {
+		return ret;
+	}
+	return count;
+}
+static DEVICE_ATTR(post_n, S_IRUGO | S_IWUSR, post_n_show, post_n_store);
+
+/* trigger_source */
+static const char *source_strings[] = {
+	[LOCKAMP_CAPTURE_SOFTWARE] = "software",
+	[LOCKAMP_CAPTURE_GPIO] = "gpio",
+	[LOCKAMP_CAPTURE_LEVEL] = "level",
+	[LOCKAMP_CAPTURE_CONFIG] = "config",
+};
+static ssize_t trigger_source_show(struct device *device,
+                                   struct device_attribute *attr, char *buf)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%s\n",
+	                 source_strings[READ_ONCE(capture->source)]);
+}
+static ssize_t trigger_source_store(struct device *device,
+                                    struct device_attribute *attr,
+                                    const char *buf, size_t count)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	int ret = sysfs_match_string(source_strings, buf);
+	if (ret < 0) {
+		return ret;
+	}
+	if (LOCKAMP_CAPTURE_GPIO == ret && NULL == capture->gpio) {
+		return -ENODEV;
+	}
+	WRITE_ONCE(capture->source, ret);
+	return count;
+}
+static DEVICE_ATTR(trigger_source, S_IRUGO | S_IWUSR, trigger_source_show,
+                   trigger_source_store);
+
+/* trigger
+ *
+ * Write anything to trigger a window now. */
+static ssize_t trigger_store(struct device *device, struct device_attribute *attr,
+                             const char *buf, size_t count)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	ext_trigger(capture, LOCKAMP_CAPTURE_SOFTWARE);
+	return count;
+}
+static DEVICE_ATTR(trigger, S_IWUSR, NULL, trigger_store);
+
+/* level_entry
+ *
+ * Index of the entry of 'struct sample' that the level source compares. */
+static ssize_t level_entry_show(struct device *device,
+                                struct device_attribute *attr, char *buf)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(capture->level_entry));
+}
+static ssize_t level_entry_store(struct device *device,
+                                 struct device_attribute *attr, const char *buf,
+                                 size_t count)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	unsigned int value;
+	int ret = kstrtouint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	if (LOCKAMP_ENTRIES_PER_SAMPLE <= value) {
+		return -EINVAL;
+	}
+	WRITE_ONCE(capture->level_entry, value);
+	return count;
+}
+static DEVICE_ATTR(level_entry, S_IRUGO | S_IWUSR, level_entry_show,
+                   level_entry_store);
+
+/* level */
+static ssize_t level_show(struct device *device, struct device_attribute *attr,
+                          char *buf)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(capture->level));
+}
+static ssize_t level_store(struct device *device, struct device_attribute *attr,
+                           const char *buf, size_t count)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	s32 value;
+	int ret = kstrtos32(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	WRITE_ONCE(capture->level, value);
+	return count;
+}
+static DEVICE_ATTR(level, S_IRUGO | S_IWUSR, level_show, level_store);
+
+/* level_edge */
+static const char *edge_strings[] = {
+	[LOCKAMP_CAPTURE_RISING] = "rising",
+	[LOCKAMP_CAPTURE_FALLING] = "falling",
+	[LOCKAMP_CAPTURE_BOTH] = "both",
+};
+static ssize_t level_edge_show(struct device *device,
+                               struct device_attribute *attr, char *buf)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%s\n",
+	                 edge_strings[READ_ONCE(capture->level_edge)]);
+}
+static ssize_t level_edge_store(struct device *device,
+                                struct device_attribute *attr, const char *buf,
+                                size_t count)
+{
+	struct lockamp_capture *capture = dev_get_drvdata(device);
+	int ret = sysfs_match_string(edge_strings, buf);
+	if (ret < 0) {
+		return ret;
+	}
+	WRITE_ONCE(capture->level_edge, ret);
+	return count;
+}
+static DEVICE_ATTR(level_edge, S_IRUGO | S_IWUSR, level_edge_show,
+                   level_edge_store);
+
+static struct attribute *lockamp_capture_attrs[] = {
+	&dev_attr_pre_n.attr,
+	&dev_attr_post_n.attr,
+	&dev_attr_trigger_source.attr,
+	&dev_attr_trigger.attr,
+	&dev_attr_level_entry.attr,
+	&dev_attr_level.attr,
+	&dev_attr_level_edge.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(lockamp_capture);
+
+static void lockamp_capture_dev_release(struct device *dev)
+{
+	struct lockamp_capture *capture = container_of(dev, struct lockamp_capture, dev);
+	kfree(capture);
+}
+
+static int request_gpio_irq(struct lockamp_capture *capture)
+{
+	unsigned long flags = IRQF_TRIGGER_RISING;
+	int ret;
+	if (NULL == capture->gpio) {
+		return 0;
+	}
+	ret = gpiod_to_irq(capture->gpio);
+	if (ret < 0) {
+		return ret;
+	}
+	capture->irq = ret;
+	/* The interrupt sees the raw line */
+	if (gpiod_is_active_low(capture->gpio)) {
+		flags = IRQF_TRIGGER_FALLING;
+	}
+	ret = request_irq(capture->irq, capture_gpio_irq, flags,
+	                  dev_name(&capture->dev), capture);
+	if (ret < 0) {
+		capture->irq = 0;
+		return ret;
+	}
+	return 0;
+}
+
+int lockamp_capture_init(struct lockamp *lockamp)
+{
+	struct lockamp_capture *capture;
+	struct gpio_desc *gpio;
+	int ret;
+	/* Trigger GPIO (optional) */
+	gpio = devm_gpiod_get_optional(lockamp->dev, "trigger", GPIOD_IN);
+	if (IS_ERR(gpio)) {
+		return PTR_ERR(gpio);
+	}
+	capture = kzalloc(sizeof(*capture), GFP_KERNEL);
+	if (NULL == capture) {
+		return -ENOMEM;
+	}
+	capture->lockamp = lockamp;
+	mutex_init(&capture->m);
+	capture->pre_n = LOCKAMP_CAPTURE_PRE_N;
+	capture->post_n = LOCKAMP_CAPTURE_POST_N;
+	capture->source = LOCKAMP_CAPTURE_SOFTWARE;
+	capture->level_entry = LOCKAMP_CAPTURE_LEVEL_ENTRY;
+	capture->level_edge = LOCKAMP_CAPTURE_RISING;
+	capture->gpio = gpio;
+	spin_lock_init(&capture->ext_lock);
+	init_waitqueue_head(&capture->wq);
+
+	/* From here on, the release callback frees the capture */
+	device_initialize(&capture->dev);
+	capture->dev.devt = MKDEV(MAJOR(lockamp->chrdev_no),
+	                          2 * LOCKAMP_MAX_DEVICES + lockamp->id);
+	capture->dev.parent = lockamp->dev;
+	capture->dev.groups = lockamp_capture_groups;
+	capture->dev.release = lockamp_capture_dev_release;
+	dev_set_drvdata(&capture->dev, capture);
+	ret = dev_set_name(&capture->dev, "%s_capture", dev_name(lockamp->dev));
+	if (ret < 0) {
+		goto out_put;
+	}
+	ret = request_gpio_irq(capture);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to request the trigger interrupt: %d\n", ret);
+		goto out_put;
+	}
+	cdev_init(&capture->cdev, &lockamp_capture_fops);
+	capture->cdev.owner = THIS_MODULE;
+	ret = cdev_device_add(&capture->cdev, &capture->dev);
+	if (ret < 0) {
+		goto out_irq;
+	}
+	lockamp->capture = capture;
+	return 0;
+
+out_irq:
+	if (0 < capture->irq) {
+		free_irq(capture->irq, capture);
+	}
+out_put:
+	put_device(&capture->dev);
+	return ret;
+}
+
+void lockamp_capture_remove(struct lockamp *lockamp)
+{
+	struct lockamp_capture *capture = lockamp->capture;
+	if (NULL == capture) {
+		return;
+	}
+	if (0 < capture->irq) {
+		free_irq(capture->irq, capture);
+	}
+	cdev_device_del(&capture->cdev, &capture->dev);
+	/* Wait for the push in progress (if any) */
+	mutex_lock(&lockamp->signal_buf_m);
+	lockamp->capture = NULL;
+	mutex_unlock(&lockamp->signal_buf_m);
+	put_device(&capture->dev);
+}
@@ -0,0 +1,29 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_CAPTURE_H_
+#define _LOCKAMP_CAPTURE_H_
+
+#include "lockin_amplifier.h"
+
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+extern int lockamp_capture_init(struct lockamp *lockamp);
+extern void lockamp_capture_remove(struct lockamp *lockamp);
+extern void lockamp_capture_push(struct lockamp *lockamp);
+#else
+static inline int lockamp_capture_init(struct lockamp *lockamp)
+{
+	return 0;
+}
+static inline void lockamp_capture_remove(struct lockamp *lockamp)
+{
+}
+static inline void lockamp_capture_push(struct lockamp *lockamp)
+{
+}
+#endif
+
+#endif /* _LOCKAMP_CAPTURE_H_ */
@@ -0,0 +1,298 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/device.h>
+#include <linux/math64.h>
+#include <linux/posix-clock.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/timex.h>
+
+#include "clock.h"
+#include "hw.h"
+
+/*
+ * Sample clock (a dynamic POSIX clock)
+ *
+ * Each lock-in amplifier has a "<name>_clock" character device. Open it
+ * and pass FD_TO_CLOCKID(fd) to clock_gettime. The time is the sequence
+ * number of the sample that the PL produces right now (see 'head_seq')
+ * times the time step. That is, the clock counts in sample time.
+ *
+ * We take the sequence number from the latest anchor and extrapolate it
+ * with the system clock. The anchor latches every drain, so this
+ * extrapolation covers one drain interval at most. Like any reader, an
+ * open clock keeps the drain running.
+ *
+ * On top of that, clock_settime and clock_adjtime (ADJ_SETOFFSET and
+ * ADJ_FREQUENCY) work like they do for a PTP hardware clock. The
+ * "measured_ppb" attribute gives the frequency error of the nominal time
+ * step, based on 'ma_time_step_ns'. Apply it with ADJ_FREQUENCY to make the
+ * sample clock follow the system clock.
+ */
+/* Like PTP clocks: the largest frequency correction that we accept */
+#define LOCKAMP_CLOCK_MAX_PPB 500000
+
+struct lockamp_clock {
+	struct posix_clock clock;
+	struct device *dev;
+	struct lockamp *lockamp;
+	/* Protects the fields below */
+	spinlock_t lock;
+	/* The time at the sample time 'raw_base_ns' */
+	u64 base_ns;
+	u64 raw_base_ns;
+	/* Frequency correction since 'raw_base_ns' */
+	s32 ppb;
+};
+
+/* The sample time (ns) of the sample that the PL produces right now */
+static u64 raw_time_ns(struct lockamp *lockamp)
+{
+	struct lockamp_anchor anchor;
+	u64 mono_ns = ktime_get_mono_fast_ns();
+	u64 step_q32;
+	unsigned int seq;
+	u64 raw_ns;
+	lockamp_get_anchor(lockamp, &anchor);
+	do {
+		seq = read_seqbegin(&lockamp->timing.lock);
+		step_q32 = lockamp->timing.time_step_q32;
+	} while (read_seqretry(&lockamp->timing.lock, seq));
+	raw_ns = mul_u64_u64_shr(anchor.seq, step_q32, 32);
+	/* The drain did not run yet (see 'start_drain') */
+	if (0 == anchor.mono_ns || mono_ns < anchor.mono_ns) {
+		return raw_ns;
+	}
+	return raw_ns + (mono_ns - anchor.mono_ns);
+}
+
+/* Call with 'clock->lock' held */
+static u64 clock_time_ns(struct lockamp_clock *clock, u64 raw_ns)
+{
+	u64 delta_ns = raw_ns - clock->raw_base_ns;
+	u64 adj_ns = mul_u64_u32_div(delta_ns, abs(clock->ppb), NSEC_PER_SEC);
+	if (clock->ppb < 0) {
+		return clock->base_ns + delta_ns - adj_ns;
+	}
+	return clock->base_ns + delta_ns + adj_ns;
+}
+
+/* Call with 'clock->lock' held. Start over from the current time. */
+static void rebase(struct lockamp_clock *clock, u64 raw_ns)
+{
+	clock->base_ns = clock_time_ns(clock, raw_ns);
+	clock->raw_base_ns = raw_ns;
+}
+
+static int lockamp_clock_gettime(struct posix_clock *pc, struct timespec64 *ts)
+{
+	struct lockamp_clock *clock = container_of(pc, struct lockamp_clock, clock);
+	u64 raw_ns = raw_time_ns(clock->lockamp);
+	unsigned long flags;
+	u64 ns;
+	spin_lock_irqsave(&clock->lock, flags);
+	ns = clock_time_ns(clock, raw_ns);
+	spin_unlock_irqrestore(&clock->lock, flags);
+	*ts = ns_to_timespec64(ns);
+	return 0;
+}
+
+static int lockamp_clock_getres(struct posix_clock *pc, struct timespec64 *ts)
+{
+	/* The extrapolation is at the resolution of the system clock */
+	ts->tv_sec = 0;
+	ts->tv_nsec = 1;
+	return 0;
+}
+
+static int lockamp_clock_settime(struct posix_clock *pc,
+                                 const struct timespec64 *ts)
+{
+	struct lockamp_clock *clock = container_of(pc, struct lockamp_clock, clock);
+	u64 raw_ns = raw_time_ns(clock->lockamp);
+	unsigned long flags;
+	if (ts->tv_sec < 0) {
+		return -EINVAL;
+	}
+	spin_lock_irqsave(&clock->lock, flags);
+	clock->base_ns = timespec64_to_ns(ts);
+	clock->raw_base_ns = raw_ns;
+	spin_unlock_irqrestore(&clock->lock, flags);
+	return 0;
+}
+
+static int lockamp_clock_adjtime(struct posix_clock *pc, struct __kernel_timex *tx)
+{
+	struct lockamp_clock *clock = container_of(pc, struct lockamp_clock, clock);
+	u64 raw_ns = raw_time_ns(clock->lockamp);
+	unsigned long flags;
+	s64 offset_ns = 0;
+	s64 ppb = 0;
+	if (tx->modes & ~(ADJ_SETOFFSET | ADJ_FREQUENCY | ADJ_NANO)) {
+		return -EOPNOTSUPP;
+	}
+	if (tx->modes & ADJ_SETOFFSET) {
+		/* 'tv_usec' holds ns with ADJ_NANO */
+		offset_ns = tx->time.tv_usec;
+		if (!(tx->modes & ADJ_NANO)) {
+			offset_ns *= NSEC_PER_USEC;
+		}
+		if (offset_ns < 0 || NSEC_PER_SEC <= offset_ns) {
+			return -EINVAL;
+		}
+		offset_ns += tx->time.tv_sec * NSEC_PER_SEC;
+	}
+	if (tx->modes & ADJ_FREQUENCY) {
+		/* 'freq' is in ppm with a 16 bit fractional part */
+		ppb = div_s64((s64)tx->freq * 1000, 1 << 16);
+		if (ppb < -LOCKAMP_CLOCK_MAX_PPB || LOCKAMP_CLOCK_MAX_PPB < ppb) {
+			return -ERANGE;
+		}
+	}
+	spin_lock_irqsave(&clock->lock, flags);
+	if (tx->modes & (ADJ_SETOFFSET | ADJ_FREQUENCY)) {
+		rebase(clock, raw_ns);
+	}
+	if (tx->modes & ADJ_SETOFFSET) {
+		clock->base_ns += offset_ns;
+	}
+	if (tx->modes & ADJ_FREQUENCY) {
+		clock->ppb = ppb;
+	}
+	tx->freq = div_s64((s64)clock->ppb * (1 << 16), 1000);
+	spin_unlock_irqrestore(&clock->lock, flags);
+	return 0;
+}
+
+/* Like any reader, an open clock keeps the producer (and thus the anchor)
+ * running */
+static int lockamp_clock_open(struct posix_clock *pc, fmode_t fmode)
+{
+	struct lockamp_clock *clock = container_of(pc, struct lockamp_clock, clock);
+	int ret = lockamp_drain_get(clock->lockamp);
+	return (ret < 0) ? ret : 0;
+}
+
+static int lockamp_clock_release(struct posix_clock *pc)
+{
+	struct lockamp_clock *clock = container_of(pc, struct lockamp_clock, clock);
+	lockamp_drain_put(clock->lockamp);
+	return 0;
+}
+
+static const struct posix_clock_operations lockamp_clock_ops = {
+	.owner = THIS_MODULE,
+	.clock_adjtime = lockamp_clock_adjtime,
+	.clock_gettime = lockamp_clock_gettime,
+	.clock_getres = lockamp_clock_getres,
+	.clock_settime = lockamp_clock_settime,
+	.open = lockamp_clock_open,
+	.release = lockamp_clock_release,
+};
+
+/* measured_ppb
+ *
+ * Frequency error of the nominal time step relative to the system clock.
+ * Only meaningful while the drain runs. */
+static ssize_t measured_ppb_show(struct device *device,
+                                 struct device_attribute *attr, char *buf)
+{
+	struct lockamp_clock *clock = dev_get_drvdata(device);
+	struct lockamp *lockamp = clock->lockamp;
+	u64 step_fs = lockamp_time_step_fs(lockamp);
+	s64 diff_fs;
+	s64 ppb = 0;
+	if (0 < step_fs) {
+		diff_fs = (s64)READ_ONCE(lockamp->stats.ma_time_step_ns) * 1000000 - step_fs;
+		/* Such that the product below does not overflow */
+		diff_fs = clamp_t(s64, diff_fs, -9000000000LL, 9000000000LL);
+		ppb = div64_s64(diff_fs * NSEC_PER_SEC, step_fs);
+	}
+	return scnprintf(buf, PAGE_SIZE, "%lld\n", ppb);
+}
+static DEVICE_ATTR_RO(measured_ppb);
+
+static struct attribute *lockamp_clock_attrs[] = {
+	&dev_attr_measured_ppb.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(lockamp_clock);
+
+static void lockamp_clock_free(struct posix_clock *pc)
+{
+	struct lockamp_clock *clock = container_of(pc, struct lockamp_clock, clock);
+	kfree(clock);
+}
+
+static void lockamp_clock_dev_release(struct device *dev)
+{
+	kfree(dev);
+}
+
+int lockamp_clock_init(struct lockamp *lockamp)
+{
+	struct lockamp_clock *clock;
+	struct device *dev;
+	int ret;
+	clock = kzalloc(sizeof(*clock), GFP_KERNEL);
+	if (NULL == clock) {
+		return -ENOMEM;
+	}
+	dev = kzalloc(sizeof(*dev), GFP_KERNEL);
+	if (NULL == dev) {
+		kfree(clock);
+		return -ENOMEM;
+	}
+	clock->lockamp = lockamp;
+	clock->dev = dev;
+	spin_lock_init(&clock->lock);
+	clock->clock.ops = lockamp_clock_ops;
+	clock->clock.release = lockamp_clock_free;
+
+	/* From here on, the release callback frees the device */
+	device_initialize(dev);
+	dev->devt = MKDEV(MAJOR(lockamp->chrdev_no),
+	                  3 * LOCKAMP_MAX_DEVICES + lockamp->id);
+	dev->parent = lockamp->dev;
+	dev->groups = lockamp_clock_groups;
+	dev->release = lockamp_clock_dev_release;
+	dev_set_drvdata(dev, clock);
+	ret = dev_set_name(dev, "%s_clock", dev_name(lockamp->dev));
+	if (ret < 0) {
+		goto out_put;
+	}
+	/* From here on, the clock release callback frees the clock */
+	ret = posix_clock_register(&clock->clock, dev->devt);
+	if (ret < 0) {
+		goto out_put;
+	}
+	ret = device_add(dev);
+	if (ret < 0) {
+		posix_clock_unregister(&clock->clock);
+		put_device(dev);
+		return ret;
+	}
+	lockamp->clock = clock;
+	return 0;
+
+out_put:
+	kfree(clock);
+	put_device(dev);
+	return ret;
+}
+
+void lockamp_clock_remove(struct lockamp *lockamp)
+{
+	struct lockamp_clock *clock = lockamp->clock;
+	if (NULL == clock) {
+		return;
+	}
+	lockamp->clock = NULL;
+	device_unregister(clock->dev);
+	/* The open files get -ENODEV from here on */
+	posix_clock_unregister(&clock->clock);
+}
@@ -0,0 +1,25 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_CLOCK_H_
+#define _LOCKAMP_CLOCK_H_
+
+#include "lockin_amplifier.h"
+
+#ifdef CONFIG_SBT_LOCKAMP_CLOCK
+extern int lockamp_clock_init(struct lockamp *lockamp);
+extern void lockamp_clock_remove(struct lockamp *lockamp);
+#else
+static inline int lockamp_clock_init(struct lockamp *lockamp)
+{
+	return 0;
+}
+static inline void lockamp_clock_remove(struct lockamp *lockamp)
+{
+}
+#endif
+
+#endif /* _LOCKAMP_CLOCK_H_ */
@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/delay.h>
+#include <linux/log2.h>
+
+#include "amp.h"
+#include "config.h"
+#include "dma.h"
+#include "hw.h"
+
+/*
+ * Atomic measurement configuration (LOCKAMP_IOC_SET_CONFIG)
+ *
+ * Where the sysfs attributes write one register at a time, we validate the
+ * complete configuration up front and write all registers in a single
+ * regmap transaction. Afterwards, we reset the moving average filter once.
+ * The samples that the PL produced in between are from a mix of the old and
+ * new configuration. Therefore, the new configuration starts with the first
+ * sample after the reset. We latch the count of said sample as
+ * 'config_count'.
+ */
+
+/* Number of registers written by 'lockamp_config_set' */
+#define LOCKAMP_CONFIG_REG_COUNT 14
+
+static struct lockamp_gen_control *gen_controls[2] = {
+	&LOCKAMP_GEN1_CONTROL,
+	&LOCKAMP_GEN2_CONTROL,
+};
+
+static int validate(struct lockamp_config *config)
+{
+	int ret;
+	int i;
+	for (i = 0; ARRAY_SIZE(config->gen) > i; ++i) {
+		ret = lockamp_adjust_gen_scale((s32 *)&config->gen[i].scale);
+		if (ret < 0) {
+			return ret;
+		}
+		if (U16_MAX < config->gen[i].step_frac) {
+			return -ERANGE;
+		}
+	}
+	if (LOCKAMP_MA_LENGTH_MIN > config->ma_length || config->ma_length > LOCKAMP_MA_LENGTH_MAX) {
+		return -ERANGE;
+	}
+	if (LOCKAMP_MA_SCALE_MIN > config->ma_scale || config->ma_scale > LOCKAMP_MA_SCALE_MAX) {
+		return -ERANGE;
+	}
+	if (LOCKAMP_CIC_LENGTH_MIN > config->cic_length || config->cic_length > LOCKAMP_CIC_LENGTH_MAX) {
+		return -ERANGE;
+	}
+	if (LOCKAMP_CIC_SCALE_MIN > config->cic_scale || config->cic_scale > LOCKAMP_CIC_SCALE_MAX) {
+		return -ERANGE;
+	}
+	if (!lockamp_valid_decimation(config->decimation)) {
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int write_registers(struct lockamp *lockamp,
+                           const struct lockamp_config *config)
+{
+	struct reg_sequence regs[LOCKAMP_CONFIG_REG_COUNT];
+	u32 hb_filters = ilog2(config->decimation);
+	int n = 0;
+	int i;
+	for (i = 0; ARRAY_SIZE(config->gen) > i; ++i) {
+		const struct lockamp_gen_config *gen = &config->gen[i];
+		/* Only 18 MSB are used. See 'lockamp_set_gen_scale'. */
+		regs[n++] = (struct reg_sequence){ gen_controls[i]->scale, gen->scale << 14 };
+		regs[n++] = (struct reg_sequence){ gen_controls[i]->step_int, gen->step_int };
+		regs[n++] = (struct reg_sequence){ gen_controls[i]->step_frac, gen->step_frac };
+		regs[n++] = (struct reg_sequence){ gen_controls[i]->lock_phase, gen->lock_phase };
+	}
+	regs[n++] = (struct reg_sequence){ LOCKAMP_REG_MA_LENGTH, config->ma_length };
+	regs[n++] = (struct reg_sequence){ LOCKAMP_REG_MA_SCALE, config->ma_scale };
+	regs[n++] = (struct reg_sequence){ LOCKAMP_REG_CIC_LENGTH, config->cic_length };
+	regs[n++] = (struct reg_sequence){ LOCKAMP_REG_CIC_SCALE, config->cic_scale };
+	/* See 'lockamp_set_decimation' */
+	regs[n++] = (struct reg_sequence){ LOCKAMP_REG_HB_FILTERS, hb_filters };
+	regs[n++] = (struct reg_sequence){ LOCKAMP_REG_FIR_CYCLES,
+	                                   lockamp_decimation_fir_cycles(hb_filters) & 0b111111111 };
+	BUILD_BUG_ON(LOCKAMP_CONFIG_REG_COUNT != 4 * ARRAY_SIZE(config->gen) + 6);
+	return regmap_multi_reg_write(lockamp->regmap, regs, n);
+}
+
+/*
+ * The count of the sample that the PL produces next. Call with
+ * 'signal_buf_m' held.
+ */
+int lockamp_produced_count(struct lockamp *lockamp, u32 *count)
+{
+	*count = lockamp->signal_buf.head + lockamp_fifo_size_n(lockamp);
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+	/* The DMA engine writes past the head. Note that the residue only
+	 * changes per period. */
+	if (lockamp_has_dma(lockamp)) {
+		ssize_t pending_n = lockamp_dma_pending_n(lockamp);
+		if (pending_n < 0) {
+			return pending_n;
+		}
+		*count += pending_n;
+	}
+	/* Likewise for the drain firmware */
+	if (lockamp_has_amp(lockamp)) {
+		*count += lockamp_amp_pending_n(lockamp);
+	}
+#endif
+	return 0;
+}
+
+/*
+ * Mark the start of a new configuration at the sample that the PL produces
+ * next. Call with 'signal_buf_m' held. Returns the count of said sample
+ * and the new sequence number.
+ */
+int lockamp_config_mark(struct lockamp *lockamp, u32 *count, u32 *seq)
+{
+	int ret = lockamp_produced_count(lockamp, count);
+	if (ret < 0) {
+		return ret;
+	}
+	*seq = lockamp->config_seq + 1;
+	WRITE_ONCE(lockamp->config_count, *count);
+	smp_store_release(&lockamp->config_seq, *seq);
+	return 0;
+}
+
+/*
+ * Like 'lockamp_reset_ma_filter' but also marks the first sample after the
+ * reset.
+ */
+static int reset_ma_filter(struct lockamp *lockamp, u32 *count, u32 *seq)
+{
+	int ret;
+	ret = regmap_update_bits(lockamp->regmap, LOCKAMP_REG_DEBUG_CONTROL,
+	                         LOCKAMP_MA_RESET_BIT, LOCKAMP_MA_RESET_BIT);
+	if (ret < 0) {
+		return ret;
+	}
+	/* Arbitrary delay */
+	msleep(1);
+	/* Hold the producer off until we marked the sample */
+	mutex_lock(&lockamp->signal_buf_m);
+	ret = regmap_update_bits(lockamp->regmap, LOCKAMP_REG_DEBUG_CONTROL,
+	                         LOCKAMP_MA_RESET_BIT, 0x0);
+	if (0 <= ret) {
+		ret = lockamp_config_mark(lockamp, count, seq);
+	}
+	mutex_unlock(&lockamp->signal_buf_m);
+	return ret;
+}
+
+/* The caller must hold a PM reference */
+int lockamp_config_set(struct lockamp *lockamp, struct lockamp_config *config)
+{
+	u32 count;
+	u32 seq;
+	int ret = validate(config);
+	if (ret < 0) {
+		return ret;
+	}
+	mutex_lock(&lockamp->config_m);
+	ret = write_registers(lockamp, config);
+	if (ret < 0) {
+		goto out;
+	}
+	ret = lockamp_update_timing(lockamp);
+	if (ret < 0) {
+		goto out;
+	}
+	ret = reset_ma_filter(lockamp, &count, &seq);
+	if (ret < 0) {
+		goto out;
+	}
+	config->start_count = count;
+	config->seq = seq;
+	config->reserved = 0;
+out:
+	mutex_unlock(&lockamp->config_m);
+	return ret;
+}
+
+/* Only reads the register cache (none of the registers are volatile). Thus,
+ * the device may be suspended. */
+int lockamp_config_get(struct lockamp *lockamp, struct lockamp_config *config)
+{
+	u16 step_frac;
+	int ret = 0;
+	int i;
+	memset(config, 0, sizeof(*config));
+	mutex_lock(&lockamp->config_m);
+	for (i = 0; ARRAY_SIZE(config->gen) > i && 0 <= ret; ++i) {
+		struct lockamp_gen_config *gen = &config->gen[i];
+		ret = lockamp_get_gen_scale(lockamp, gen_controls[i], &gen->scale);
+		if (0 <= ret) {
+			ret = lockamp_get_gen_step_int(lockamp, gen_controls[i], &gen->step_int);
+		}
+		if (0 <= ret) {
+			ret = lockamp_get_gen_step_frac(lockamp, gen_controls[i], &step_frac);
+			gen->step_frac = step_frac;
+		}
+		if (0 <= ret) {
+			ret = lockamp_get_gen_lock_phase(lockamp, gen_controls[i], &gen->lock_phase);
+		}
+	}
+	if (0 <= ret) {
+		ret = lockamp_get_ma_length(lockamp, &config->ma_length);
+	}
+	if (0 <= ret) {
+		ret = lockamp_get_ma_scale(lockamp, &config->ma_scale);
+	}
+	if (0 <= ret) {
+		ret = lockamp_get_cic_length(lockamp, &config->cic_length);
+	}
+	if (0 <= ret) {
+		ret = lockamp_get_cic_scale(lockamp, &config->cic_scale);
+	}
+	if (0 <= ret) {
+		ret = lockamp_get_decimation(lockamp, &config->decimation);
+	}
+	config->start_count = READ_ONCE(lockamp->config_count);
+	config->seq = lockamp->config_seq;
+	mutex_unlock(&lockamp->config_m);
+	return ret;
+}
@@ -0,0 +1,17 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_CONFIG_H_
+#define _LOCKAMP_CONFIG_H_
+
+#include "lockin_amplifier.h"
+
+int lockamp_produced_count(struct lockamp *lockamp, u32 *count);
+int lockamp_config_mark(struct lockamp *lockamp, u32 *count, u32 *seq);
+int lockamp_config_set(struct lockamp *lockamp, struct lockamp_config *config);
+int lockamp_config_get(struct lockamp *lockamp, struct lockamp_config *config);
+
+#endif /* _LOCKAMP_CONFIG_H_ */
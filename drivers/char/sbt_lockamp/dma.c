@@ -0,0 +1,161 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/circ_buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/mm.h>
+#include <linux/workqueue.h>
+
+#include "dma.h"
+#include "hw.h"
+#include "sbuf.h"
+#include "stats.h"
+
+/*
+ * DMA backend
+ *
+ * If the device tree node has a "fifo" DMA channel, the PL streams the FIFO
+ * content directly into the signal buffer through the AXI DMA (in cyclic
+ * mode). In turn, the CPU does not touch the FIFO data register at all.
+ *
+ * The signal buffer is then a coherent DMA buffer (instead of vmalloc
+ * memory). See sbuf.c.
+ */
+
+static void lockamp_dma_period_done(void *data)
+{
+	struct lockamp *lockamp = data;
+	/* We are in tasklet context here. Do the actual work (which needs the
+	 * signal buffer mutex) in process context. */
+	int cpu = READ_ONCE(lockamp->drain_cpu);
+	lockamp_stats_kick(lockamp);
+	if (0 <= cpu) {
+		queue_work_on(cpu, system_highpri_wq, &lockamp->dma_work);
+	} else {
+		queue_work(system_highpri_wq, &lockamp->dma_work);
+	}
+}
+
+int lockamp_dma_init(struct lockamp *lockamp, struct platform_device *pdev)
+{
+	struct dma_chan *chan;
+	chan = dma_request_chan(&pdev->dev, "fifo");
+	if (IS_ERR(chan)) {
+		/* The DMA channel is optional */
+		if (-ENODEV == PTR_ERR(chan)) {
+			lockamp->dma_chan = NULL;
+			return 0;
+		}
+		return PTR_ERR(chan);
+	}
+	lockamp->dma_chan = chan;
+	return 0;
+}
+
+void lockamp_dma_release(struct lockamp *lockamp)
+{
+	struct dma_chan *chan = lockamp->dma_chan;
+	if (NULL == chan) {
+		return;
+	}
+	dma_release_channel(chan);
+	lockamp->dma_chan = NULL;
+}
+
+int lockamp_dma_start(struct lockamp *lockamp)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct dma_async_tx_descriptor *desc;
+	struct dma_slave_config config = {
+		.direction = DMA_DEV_TO_MEM,
+		.src_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
+	};
+	dma_cookie_t cookie;
+	int ret;
+	ret = dmaengine_slave_config(lockamp->dma_chan, &config);
+	if (ret < 0) {
+		return ret;
+	}
+	/* The DMA engine always starts from the beginning of the buffer */
+	sbuf->head = 0;
+	lockamp_sbuf_reserve(sbuf, LOCKAMP_DMA_RESERVE_N);
+	desc = dmaengine_prep_dma_cyclic(lockamp->dma_chan,
+	                                 lockamp->signal_buf_dma,
+	                                 sbuf->capacity_n * sizeof(struct sample),
+	                                 LOCKAMP_DMA_PERIOD_SIZE,
+	                                 DMA_DEV_TO_MEM, DMA_PREP_INTERRUPT);
+	if (NULL == desc) {
+		return -ENOMEM;
+	}
+	desc->callback = lockamp_dma_period_done;
+	desc->callback_param = lockamp;
+	cookie = dmaengine_submit(desc);
+	ret = dma_submit_error(cookie);
+	if (ret < 0) {
+		return ret;
+	}
+	lockamp->dma_cookie = cookie;
+	dma_async_issue_pending(lockamp->dma_chan);
+	return 0;
+}
+
+void lockamp_dma_stop(struct lockamp *lockamp)
+{
+	dmaengine_terminate_sync(lockamp->dma_chan);
+	cancel_work_sync(&lockamp->dma_work);
+}
+
+/*
+ * The number of samples that the DMA engine wrote past the head. Call with
+ * 'signal_buf_m' held. Negative on error.
+ */
+ssize_t lockamp_dma_pending_n(struct lockamp *lockamp)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct dma_tx_state state;
+	enum dma_status status;
+	size_t index;
+	status = dmaengine_tx_status(lockamp->dma_chan, lockamp->dma_cookie,
+	                             &state);
+	if (DMA_ERROR == status) {
+		return -EIO;
+	}
+	/* The residue is in bytes. Only count complete samples. */
+	index = (sbuf->capacity_n * sizeof(struct sample) - state.residue) / sizeof(struct sample);
+	index = lockamp_sbuf_index(sbuf, index);
+	return CIRC_CNT(index, lockamp_sbuf_index(sbuf, sbuf->head), sbuf->capacity_n);
+}
+
+/*
+ * Move the head to where the DMA engine is now. Counterpart of
+ * 'lockamp_fifo_move_to_sbuf'.
+ */
+size_t lockamp_dma_move_to_sbuf(struct lockamp *lockamp)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	ssize_t pending_n;
+	size_t size_n;
+	u32 head;
+	pending_n = lockamp_dma_pending_n(lockamp);
+	if (pending_n < 0) {
+		atomic_inc(&lockamp->stats.dma_errors);
+		return 0;
+	}
+	size_n = pending_n;
+	head = sbuf->head + size_n;
+	/* The residue only changes per period, so this anchor is less precise
+	 * than that of the FIFO path. The error is the callback latency. */
+	lockamp_latch_anchor(lockamp, head, 0);
+	/* The DMA engine writes past the head on its own. Keep the reserve a
+	 * couple of periods ahead so that the readers stay clear of it. */
+	lockamp_sbuf_reserve(sbuf, head + LOCKAMP_DMA_RESERVE_N);
+	lockamp_sbuf_apply_multipliers(lockamp, sbuf->head, size_n);
+	lockamp_sbuf_filter(lockamp, sbuf->head, size_n);
+	lockamp->head_seq += size_n;
+	smp_store_release(&sbuf->head, head);
+	return size_n;
+}
@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_DMA_H_
+#define _LOCKAMP_DMA_H_
+
+#include <linux/platform_device.h>
+
+#include "lockin_amplifier.h"
+
+/* Same as half of the FIFO. I.e., what the polling kthread reads at a time. */
+#define LOCKAMP_DMA_PERIOD_SIZE (LOCKAMP_FIFO_CAPACITY / 2)
+/* How far the DMA engine may be ahead of the head (in samples) */
+#define LOCKAMP_DMA_RESERVE_N   (2 * LOCKAMP_DMA_PERIOD_SIZE / sizeof(struct sample))
+
+static inline bool lockamp_has_dma(struct lockamp *lockamp)
+{
+	return NULL != lockamp->dma_chan;
+}
+
+int lockamp_dma_init(struct lockamp *lockamp, struct platform_device *pdev);
+void lockamp_dma_release(struct lockamp *lockamp);
+int lockamp_dma_start(struct lockamp *lockamp);
+void lockamp_dma_stop(struct lockamp *lockamp);
+ssize_t lockamp_dma_pending_n(struct lockamp *lockamp);
+size_t lockamp_dma_move_to_sbuf(struct lockamp *lockamp);
+
+#endif /* _LOCKAMP_DMA_H_ */
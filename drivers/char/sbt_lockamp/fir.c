@@ -0,0 +1,201 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/ctype.h>
+#include <linux/firmware.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "fir.h"
+#include "hw.h"
+
+/*
+ * FIR filter coefficient sets
+ *
+ * There are the compiled-in sets ('lockamp_fir_coefs') and the sets loaded
+ * at runtime from "lockamp-fir-<name>.bin" through 'request_firmware'. A
+ * firmware file holds LOCKAMP_FIR_COEF_LEN little-endian s32 coefficients.
+ * Loaded sets stay cached in the kernel until the device goes away.
+ *
+ * The coefficient registers are not in the regmap cache (see
+ * 'lockamp_volatile_reg'). Instead, we keep a pointer to the active set and
+ * upload it again after a reset (see 'lockamp_fir_restore').
+ */
+
+/* Call with 'fir_m' held */
+static struct lockamp_fir_set *find_set(struct lockamp *lockamp, const char *name)
+{
+	struct lockamp_fir_set *set;
+	list_for_each_entry(set, &lockamp->fir_sets, list) {
+		if (sysfs_streq(name, set->name)) {
+			return set;
+		}
+	}
+	return NULL;
+}
+
+/* Call with 'fir_m' held */
+static int select_coefs(struct lockamp *lockamp, const char *name, const s32 *coefs)
+{
+	int ret = lockamp_set_fir_coefs(lockamp, coefs);
+	if (ret < 0) {
+		return ret;
+	}
+	lockamp->fir_name = name;
+	lockamp->fir_coefs = coefs;
+	return 0;
+}
+
+static bool valid_name(const char *name)
+{
+	size_t i;
+	size_t len = strlen(name);
+	if (0 == len || LOCKAMP_FIR_NAME_MAX <= len) {
+		return false;
+	}
+	for (i = 0; len > i; ++i) {
+		if (!isalnum(name[i]) && '_' != name[i] && '-' != name[i]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int lockamp_fir_init(struct lockamp *lockamp)
+{
+	int ret;
+	mutex_lock(&lockamp->fir_m);
+	ret = select_coefs(lockamp, lockamp_fir_names[0], lockamp_fir_coefs[0]);
+	mutex_unlock(&lockamp->fir_m);
+	return ret;
+}
+
+void lockamp_fir_release(struct lockamp *lockamp)
+{
+	struct lockamp_fir_set *set, *tmp;
+	list_for_each_entry_safe(set, tmp, &lockamp->fir_sets, list) {
+		list_del(&set->list);
+		kfree(set);
+	}
+	lockamp->fir_name = NULL;
+	lockamp->fir_coefs = NULL;
+}
+
+/*
+ * Load (or reload) the set with the given name. If the set is active, the
+ * new coefficients take effect right away.
+ */
+int lockamp_fir_load(struct lockamp *lockamp, const char *name)
+{
+	const struct firmware *fw;
+	struct lockamp_fir_set *set;
+	char fw_name[LOCKAMP_FIR_NAME_MAX + 16];
+	const __le32 *src;
+	int i;
+	int ret;
+	if (!valid_name(name)) {
+		return -EINVAL;
+	}
+	snprintf(fw_name, sizeof(fw_name), "lockamp-fir-%s.bin", name);
+	ret = request_firmware(&fw, fw_name, lockamp->dev);
+	if (ret < 0) {
+		return ret;
+	}
+	if (LOCKAMP_FIR_COEF_LEN * sizeof(s32) != fw->size) {
+		dev_err(lockamp->dev, "%s has %zu bytes (expected %zu)\n", fw_name,
+		        fw->size, LOCKAMP_FIR_COEF_LEN * sizeof(s32));
+		ret = -EINVAL;
+		goto out_fw;
+	}
+	mutex_lock(&lockamp->fir_m);
+	set = find_set(lockamp, name);
+	if (NULL == set) {
+		set = kzalloc(sizeof(*set), GFP_KERNEL);
+		if (NULL == set) {
+			ret = -ENOMEM;
+			goto out_unlock;
+		}
+		strscpy(set->name, name, sizeof(set->name));
+		list_add_tail(&set->list, &lockamp->fir_sets);
+	}
+	src = (const __le32 *)fw->data;
+	for (i = 0; LOCKAMP_FIR_COEF_LEN > i; ++i) {
+		set->coefs[i] = le32_to_cpu(src[i]);
+	}
+	if (lockamp->fir_coefs == set->coefs) {
+		ret = select_coefs(lockamp, set->name, set->coefs);
+	}
+
+out_unlock:
+	mutex_unlock(&lockamp->fir_m);
+out_fw:
+	release_firmware(fw);
+	return ret;
+}
+
+/* Activate a compiled-in or loaded set. The caller must hold a PM reference. */
+int lockamp_fir_select(struct lockamp *lockamp, const char *name)
+{
+	struct lockamp_fir_set *set;
+	int ret = -EINVAL;
+	int i;
+	mutex_lock(&lockamp->fir_m);
+	for (i = 0; LOCKAMP_FIR_FILTER_COUNT > i; ++i) {
+		if (sysfs_streq(name, lockamp_fir_names[i])) {
+			ret = select_coefs(lockamp, lockamp_fir_names[i], lockamp_fir_coefs[i]);
+			goto out_unlock;
+		}
+	}
+	set = find_set(lockamp, name);
+	if (NULL != set) {
+		ret = select_coefs(lockamp, set->name, set->coefs);
+	}
+
+out_unlock:
+	mutex_unlock(&lockamp->fir_m);
+	return ret;
+}
+
+/* Upload the active set again. E.g., after a reset. */
+int lockamp_fir_restore(struct lockamp *lockamp)
+{
+	int ret = 0;
+	mutex_lock(&lockamp->fir_m);
+	if (NULL != lockamp->fir_coefs) {
+		ret = lockamp_set_fir_coefs(lockamp, lockamp->fir_coefs);
+	}
+	mutex_unlock(&lockamp->fir_m);
+	return ret;
+}
+
+ssize_t lockamp_fir_show_name(struct lockamp *lockamp, char *buf)
+{
+	ssize_t ret;
+	mutex_lock(&lockamp->fir_m);
+	ret = scnprintf(buf, PAGE_SIZE, "%s\n", lockamp->fir_name);
+	mutex_unlock(&lockamp->fir_m);
+	return ret;
+}
+
+ssize_t lockamp_fir_show_available(struct lockamp *lockamp, char *buf)
+{
+	struct lockamp_fir_set *set;
+	ssize_t len = 0;
+	int i;
+	for (i = 0; LOCKAMP_FIR_FILTER_COUNT > i; ++i) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s ", lockamp_fir_names[i]);
+	}
+	mutex_lock(&lockamp->fir_m);
+	list_for_each_entry(set, &lockamp->fir_sets, list) {
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s ", set->name);
+	}
+	mutex_unlock(&lockamp->fir_m);
+	/* Replace the trailing space */
+	if (0 < len) {
+		buf[len - 1] = '\n';
+	}
+	return len;
+}
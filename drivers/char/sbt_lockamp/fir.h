@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_FIR_H_
+#define _LOCKAMP_FIR_H_
+
+#include "lockin_amplifier.h"
+
+#define LOCKAMP_FIR_NAME_MAX 32
+
+/* A coefficient set loaded with 'request_firmware' */
+struct lockamp_fir_set {
+	struct list_head list;
+	char name[LOCKAMP_FIR_NAME_MAX];
+	s32 coefs[LOCKAMP_FIR_COEF_LEN];
+};
+
+extern const char *lockamp_fir_names[LOCKAMP_FIR_FILTER_COUNT];
+
+int lockamp_fir_init(struct lockamp *lockamp);
+void lockamp_fir_release(struct lockamp *lockamp);
+int lockamp_fir_load(struct lockamp *lockamp, const char *name);
+int lockamp_fir_select(struct lockamp *lockamp, const char *name);
+int lockamp_fir_restore(struct lockamp *lockamp);
+ssize_t lockamp_fir_show_name(struct lockamp *lockamp, char *buf);
+ssize_t lockamp_fir_show_available(struct lockamp *lockamp, char *buf);
+
+#endif /* _LOCKAMP_FIR_H_ */
@@ -5,19 +5,41 @@
  * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
  */
 #include <asm/io.h>
+#include <linux/capability.h>
 #include <linux/circ_buf.h>
+#include <linux/compat.h>
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/fs.h>
+#include <linux/interrupt.h>
 #include <linux/kthread.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/sched/types.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include <linux/pm_runtime.h>
+#include <linux/pipe_fs_i.h>
+#include <linux/splice.h>
+#include <linux/uio.h>
 #include <uapi/linux/sched/types.h>
 
 #include "lockin_amplifier.h"
+#include "amp.h"
+#include "capture.h"
+#include "config.h"
+#include "dma.h"
 #include "hw.h"
+#include "iio.h"
+#include "monitor.h"
 #include "pm.h"
+#include "sbuf.h"
+#include "stats.h"
+#include "sweep.h"
+
+#include <trace/events/lockamp.h>
 
 struct chunk_header {
 	u64 last_start_time_ns;
@@ -25,31 +47,136 @@ struct chunk_header {
 } __attribute__((packed));
 _Static_assert (16 == sizeof(struct chunk_header), "struct 'chunk_header' is not packed on this platform");
 
+/*
+ * Used in the LOCKAMP_TIMESTAMP_ANCHOR mode. The sample with the count
+ * 'anchor_count' was produced at 'anchor_mono_ns' (CLOCK_MONOTONIC) and
+ * 'anchor_real_ns' (CLOCK_REALTIME). The first sample in the chunk has
+ * the count 'start_count'. Counts are free-running and wrap at 2^32.
+ */
+struct chunk_anchor_header {
+	struct chunk_header base;
+	u64 anchor_mono_ns;
+	u64 anchor_real_ns;
+	u32 start_count;
+	u32 anchor_count;
+} __attribute__((packed));
+_Static_assert (40 == sizeof(struct chunk_anchor_header), "struct 'chunk_anchor_header' is not packed on this platform");
+
+/*
+ * Follows the header if the output format is compact (i.e., not all entries
+ * as s32). Each sample then consists of the entries in 'entry_mask' (in
+ * the order of 'struct sample') of 'entry_size' bytes each.
+ */
+struct chunk_format {
+	u8 entry_mask;
+	u8 entry_size;
+	u16 sample_size;
+	u32 reserved;
+} __attribute__((packed));
+_Static_assert (8 == sizeof(struct chunk_format), "struct 'chunk_format' is not packed on this platform");
+
+/*
+ * Follows the (anchor) header in chunk header version 2:
+ *
+ *   seq:       Sequence number of the first sample in the chunk. Counts all
+ *              samples that the PL produced, including the dropped ones.
+ *   dropped_n: Total number of samples that this reader lost so far. The
+ *              sequence number skips over lost samples.
+ *   flags:     LOCKAMP_CHUNK_FIFO_OVERRUN and/or LOCKAMP_CHUNK_SBUF_OVERRUN
+ *              if samples were lost right before this chunk. A chunk never
+ *              spans a loss. LOCKAMP_CHUNK_FILTERED if a filter program
+ *              dropped samples right before this chunk (these are not
+ *              counted in 'dropped_n').
+ *   version:   The chunk header version (i.e., 2).
+ *
+ * A FIFO overrun means that the PL dropped samples because the FIFO was
+ * full (the number is estimated from the time since the last drain). A
+ * signal buffer overrun means that the reader was too slow and the samples
+ * were overwritten (the number is exact).
+ */
+struct chunk_seq_header {
+	u64 seq;
+	u64 dropped_n;
+	u32 flags;
+	u32 version;
+} __attribute__((packed));
+_Static_assert (24 == sizeof(struct chunk_seq_header), "struct 'chunk_seq_header' is not packed on this platform");
+
 struct chunk_info {
-	struct chunk_header header;
+	struct chunk_anchor_header header;
+	size_t header_size;
+	struct chunk_seq_header seq;
+	/* Zero for chunk header version 1 */
+	size_t seq_size;
+	/* Dropped by the PL right before this chunk */
+	u64 fifo_lost_n;
+	struct chunk_format format;
+	/* Zero for the default format */
+	size_t format_size;
 	size_t data_size_n;
 };
 
-unsigned int lockamp_ma_time_step_ns = 0;
-u64 lockamp_fifo_read_duration = 0;
-u64 lockamp_fifo_read_delay = 0;
-int lockamp_debug1 = 0;
-int lockamp_debug2 = 0;
-int lockamp_debug3 = 0;
+static void reset_start_time(struct lockamp_reader *reader)
+{
+	struct timespec ts;
+	getnstimeofday(&ts);
+	reader->last_start_time_ns = timespec_to_ns(&ts);
+}
 
-static unsigned int open_count = 0;
+static void synchronize(struct lockamp_reader *reader)
+{
+	struct lockamp *lockamp = reader->lockamp;
+	if (atomic_read(&lockamp->desyncs) != reader->last_desyncs) {
+		trace_lockamp_desync(lockamp->dev, atomic_read(&lockamp->desyncs));
+		reset_start_time(reader);
+	}
+	reader->last_desyncs = atomic_read(&lockamp->desyncs);
+}
 
 #ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
 
-struct task_struct *thread = NULL;
-static u64 last_ma_time_ns = 0;
-static unsigned int ma_factor = 20;
+/* Weight of the history in the 'ma_time_step_ns' moving average */
+#define LOCKAMP_MA_FACTOR 20
 
+/*
+ * Reserve a bandwidth of 'runtime' per 'read_delay_ns'. The latter is the
+ * time it takes the PL to fill half of the FIFO. The runtime is twice the
+ * measured drain duration (or a quarter of the period if we did not measure
+ * it yet) and at most half of the period.
+ *
+ * Note that the kernel refuses SCHED_DEADLINE for a task whose affinity
+ * does not span its root domain. Pin the thread with 'drain_cpu' only if
+ * the CPU is in a root domain of its own (e.g., an exclusive cpuset).
+ */
+static int set_deadline_policy(struct lockamp *lockamp, struct task_struct *t)
+{
+	u64 period_ns = lockamp_read_delay_ns(lockamp);
+	u64 runtime_ns = READ_ONCE(lockamp->stats.drain_duration_ns) * 2;
+	struct sched_attr attr = {
+		.size = sizeof(attr),
+		.sched_policy = SCHED_DEADLINE,
+	};
+	if (0 == period_ns) {
+		return -EINVAL;
+	}
+	if (0 == runtime_ns) {
+		runtime_ns = period_ns / 4;
+	}
+	/* The scheduler requires at least 2^DL_SCALE ns */
+	runtime_ns = clamp_t(u64, runtime_ns, 1 << 10, period_ns / 2);
+	attr.sched_runtime = runtime_ns;
+	attr.sched_deadline = period_ns;
+	attr.sched_period = period_ns;
+	return sched_setattr_nocheck(t, &attr);
+}
 
-static int increase_task_priority(struct task_struct *t)
+static int increase_task_priority(struct lockamp *lockamp, struct task_struct *t)
 {
 	int ret;
 	struct sched_param param = { .sched_priority = 99 };
+	if (LOCKAMP_DRAIN_DEADLINE == lockamp->drain_policy) {
+		return set_deadline_policy(lockamp, t);
+	}
 	ret = sched_setscheduler(t, SCHED_FIFO, &param);
 	if (ret < 0) {
 		return ret;
@@ -58,19 +185,20 @@ static int increase_task_priority(struct task_struct *t)
 	return ret;
 }
 
-static void update_ma_time_ns(size_t size_n_since_last)
+static void update_ma_time_ns(struct lockamp *lockamp, size_t size_n_since_last)
 {
+	struct lockamp_stats *stats = &lockamp->stats;
 	u64 ma_time_ns;
 	unsigned int ma_delta_ns;
 	unsigned int time_step_ns;
 	struct timespec ts;
 	getnstimeofday(&ts);
 	ma_time_ns = timespec_to_ns(&ts);
-	ma_delta_ns = ma_time_ns - last_ma_time_ns;
-	last_ma_time_ns = ma_time_ns;
+	ma_delta_ns = ma_time_ns - stats->last_ma_time_ns;
+	stats->last_ma_time_ns = ma_time_ns;
 	if (0 < size_n_since_last) {
 		time_step_ns = ma_delta_ns / size_n_since_last;
-		lockamp_ma_time_step_ns = (time_step_ns + (ma_factor - 1) * lockamp_ma_time_step_ns) / ma_factor;
+		WRITE_ONCE(stats->ma_time_step_ns, (time_step_ns + (LOCKAMP_MA_FACTOR - 1) * stats->ma_time_step_ns) / LOCKAMP_MA_FACTOR);
 	}
 }
 
@@ -79,7 +207,6 @@ static u64 sleep_until_fifo_half_full(struct lockamp *lockamp)
 	struct timespec ts;
 	u64 before_sleep_ns;
 	u64 after_sleep_ns;
-	u64 ret;
 	unsigned long target_sleep_ns;
 	unsigned long sleep_upper_us;
 	unsigned long sleep_lower_us;
@@ -87,16 +214,31 @@ static u64 sleep_until_fifo_half_full(struct lockamp *lockamp)
 	getnstimeofday(&ts);
 	before_sleep_ns = timespec_to_ns(&ts);
 	/* Target sleep duration. E.g., 178 ms */
-	ret = lockamp_get_read_delay_ns(lockamp, &target_sleep_ns);
-	if (ret < 0) {
-		return ret;
+	target_sleep_ns = lockamp_read_delay_ns(lockamp);
+	/* Wake up in time for the next sweep step */
+	if (0 < lockamp_sweep_delay_ns(lockamp)) {
+		target_sleep_ns = min(target_sleep_ns, lockamp_sweep_delay_ns(lockamp));
 	}
 	/* Sleep range. E.g., 168 ms to 178 ms */
-	sleep_upper_us = max(((long)target_sleep_ns - (long)lockamp_fifo_read_duration) / 1000, 3000L);
+	sleep_upper_us = max(((long)target_sleep_ns - (long)lockamp->stats.drain_duration_ns) / 1000, 3000L);
 	sleep_lower_us = max((long)sleep_upper_us - 10000, 2000L);
-	lockamp_debug2 = sleep_lower_us;
-	lockamp_debug3 = sleep_upper_us;
-	usleep_range(sleep_lower_us, sleep_upper_us);
+	trace_lockamp_drain_sleep(lockamp->dev, sleep_lower_us, sleep_upper_us);
+	/* Like 'usleep_range' but with a timer of our own, so that we know
+	 * when it expired (see 'drain_timer_expired') */
+	WRITE_ONCE(lockamp->drain_timer_fired, false);
+	hrtimer_start_range_ns(&lockamp->drain_timer,
+	                       ns_to_ktime(sleep_lower_us * NSEC_PER_USEC),
+	                       (sleep_upper_us - sleep_lower_us) * NSEC_PER_USEC,
+	                       HRTIMER_MODE_REL);
+	for (;;) {
+		set_current_state(TASK_UNINTERRUPTIBLE);
+		if (READ_ONCE(lockamp->drain_timer_fired) || kthread_should_stop()) {
+			break;
+		}
+		schedule();
+	}
+	__set_current_state(TASK_RUNNING);
+	hrtimer_cancel(&lockamp->drain_timer);
 	/* Profile end */
 	getnstimeofday(&ts);
 	after_sleep_ns = timespec_to_ns(&ts);
@@ -104,326 +246,1038 @@ static u64 sleep_until_fifo_half_full(struct lockamp *lockamp)
 	return after_sleep_ns - before_sleep_ns;
 }
 
-static int fifo_to_sbuf(void *data)
+/* Begin an update of the time fields in the mmap control page */
+static void mmap_ctrl_write_begin(struct lockamp_mmap_ctrl *ctrl)
+{
+	WRITE_ONCE(ctrl->seq, ctrl->seq + 1);
+	smp_wmb();
+}
+
+/* End an update of the time fields in the mmap control page */
+static void mmap_ctrl_write_end(struct lockamp_mmap_ctrl *ctrl)
+{
+	smp_wmb();
+	WRITE_ONCE(ctrl->seq, ctrl->seq + 1);
+}
+
+/*
+ * Skip the samples that the producer overwrote (or is about to overwrite).
+ *
+ * Since we know exactly how many samples were lost, we can move the start
+ * time forward accordingly. I.e., this is not a desync.
+ */
+static void reader_skip_overrun(struct lockamp_reader *reader)
+{
+	struct lockamp *lockamp = reader->lockamp;
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	u32 oldest = READ_ONCE(sbuf->reserve) - sbuf->capacity_n;
+	u32 lost_n;
+	/* Signed difference to handle the wrap-around */
+	if (0 <= (s32)(reader->tail - oldest)) {
+		return;
+	}
+	lost_n = oldest - reader->tail;
+	reader->tail = oldest;
+	reader->seq += lost_n;
+	reader->loss_flags |= LOCKAMP_CHUNK_SBUF_OVERRUN;
+	reader->last_start_time_ns += lockamp_duration_ns(lockamp, lost_n);
+	reader->overruns += 1;
+	reader->lost_n += lost_n;
+	atomic_inc(&lockamp->stats.overruns);
+	atomic64_add(lost_n, &lockamp->stats.lost_n);
+	trace_lockamp_reader_overrun(lockamp->dev, reader->tail, lost_n);
+}
+
+/*
+ * Take the samples consumed by the mmap reader into account.
+ *
+ * The mmap reader advances the tail in the control page. We move said tail
+ * into the reader and advance the start time accordingly. I.e., this is the
+ * mmap equivalent of 'chunk_commit_info'.
+ */
+static void mmap_consume(struct lockamp *lockamp)
+{
+	struct lockamp_reader *reader = lockamp->mmap_reader;
+	struct lockamp_mmap_ctrl *ctrl = lockamp->mmap_ctrl;
+	u32 tail = smp_load_acquire(&ctrl->tail);
+	u32 consumed_n = tail - reader->tail;
+	/* The reader is still behind the samples that we skipped */
+	if ((s32)consumed_n <= 0) {
+		return;
+	}
+	/* The reader can not consume more than what has been produced */
+	if (consumed_n > lockamp->signal_buf.head - reader->tail) {
+		atomic_inc(&lockamp->stats.invalid_mmap_tails);
+		return;
+	}
+	reader->seq += consumed_n;
+	reader->tail = tail;
+	reader->last_start_time_ns += lockamp_duration_ns(lockamp, consumed_n);
+	trace_lockamp_reader_pop(lockamp->dev, tail, consumed_n);
+}
+
+/* Publish the producer state to the mmap reader */
+static void mmap_publish(struct lockamp *lockamp)
+{
+	struct lockamp_reader *reader = lockamp->mmap_reader;
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct lockamp_mmap_ctrl *ctrl = lockamp->mmap_ctrl;
+	synchronize(reader);
+	reader_skip_overrun(reader);
+	mmap_ctrl_write_begin(ctrl);
+	ctrl->time_step_ns = lockamp_time_step_ns(lockamp);
+	ctrl->last_start_time_ns = reader->last_start_time_ns;
+	ctrl->start_tail = reader->tail;
+	ctrl->desyncs = atomic_read(&lockamp->desyncs);
+	mmap_ctrl_write_end(ctrl);
+	WRITE_ONCE(ctrl->config_count, READ_ONCE(lockamp->config_count));
+	smp_store_release(&ctrl->config_seq, smp_load_acquire(&lockamp->config_seq));
+	WRITE_ONCE(ctrl->write_end, READ_ONCE(sbuf->reserve));
+	smp_store_release(&ctrl->head, sbuf->head);
+}
+
+/* Move the FIFO content into the signal buffer (once) */
+static void drain_fifo(struct lockamp *lockamp)
 {
-	struct lockamp *lockamp = data;
 	size_t size_n;
 	struct timespec ts;
 	u64 start, end;
+	u64 latency_ns = lockamp_stats_wakeup(lockamp);
+	/* Profile begin */
+	trace_lockamp_drain_start(lockamp->dev);
+	if (0 < latency_ns) {
+		trace_lockamp_drain_wakeup(lockamp->dev, latency_ns);
+	}
+	getnstimeofday(&ts);
+	start = timespec_to_ns(&ts);
+	/* Actual work */
+	mutex_lock(&lockamp->signal_buf_m);
+	if (lockamp->mmap_reader) {
+		mmap_consume(lockamp);
+	}
+	if (lockamp_has_dma(lockamp)) {
+		size_n = lockamp_dma_move_to_sbuf(lockamp);
+	} else if (lockamp_has_amp(lockamp)) {
+		size_n = lockamp_amp_move_to_sbuf(lockamp);
+	} else {
+		size_n = lockamp_fifo_move_to_sbuf(lockamp);
+	}
+	update_ma_time_ns(lockamp, size_n);
+	lockamp_sweep_advance(lockamp);
+	trace_lockamp_sbuf_fill(lockamp->dev, lockamp->signal_buf.head, size_n);
+	if (lockamp->mmap_reader) {
+		mmap_publish(lockamp);
+	}
+	lockamp_iio_push(lockamp);
+	lockamp_monitor_push(lockamp);
+	lockamp_capture_push(lockamp);
+	mutex_unlock(&lockamp->signal_buf_m);
+	/* Let the readers know */
+	if (0 < size_n) {
+		wake_up_interruptible(&lockamp->read_wq);
+	}
+	/* Profile end */
+	getnstimeofday(&ts);
+	end = timespec_to_ns(&ts);
+	lockamp_stats_drain(lockamp, end - start);
+	trace_lockamp_drain_end(lockamp->dev, size_n, end - start);
+}
+
+static int fifo_to_sbuf(void *data)
+{
+	struct lockamp *lockamp = data;
 	/* Continuously poll the FIFO */
 	for (;;) {
 		if (kthread_should_stop()) {
 			break;
 		}
-		/* Profile begin */
-		getnstimeofday(&ts);
-		start = timespec_to_ns(&ts);
-		/* Actual work */
-		mutex_lock(&lockamp->signal_buf_m);
-		size_n = lockamp_fifo_move_to_sbuf(lockamp);
-		update_ma_time_ns(size_n);
-		mutex_unlock(&lockamp->signal_buf_m);
-		/* Profile end */
-		getnstimeofday(&ts);
-		end = timespec_to_ns(&ts);
-		lockamp_fifo_read_duration = end - start;
+		drain_fifo(lockamp);
 		/* Wait for data */
-		lockamp_fifo_read_delay = sleep_until_fifo_half_full(lockamp);
-		if (lockamp_fifo_read_delay < 0) {
-			dev_warn_ratelimited(lockamp->dev, "Could not determine FIFO read delay. Will sleep for 250 ms. Data loss may occur.\n");
-			msleep(250);
-		}
+		WRITE_ONCE(lockamp->stats.read_delay_ns, sleep_until_fifo_half_full(lockamp));
 	}
 	return 0;
 }
 
-#endif
+/* Runs after each DMA or AMP period. See dma.c and amp.c. */
+static void dma_to_sbuf(struct work_struct *work)
+{
+	struct lockamp *lockamp = container_of(work, struct lockamp, dma_work);
+	drain_fifo(lockamp);
+}
 
-static void reset_start_time(struct lockamp *lockamp)
+/* Wakes the polling kthread. See 'sleep_until_fifo_half_full'. */
+static enum hrtimer_restart drain_timer_expired(struct hrtimer *timer)
 {
-	struct timespec ts;
-	getnstimeofday(&ts);
-	lockamp->last_start_time_ns = timespec_to_ns(&ts);
+	struct lockamp *lockamp = container_of(timer, struct lockamp, drain_timer);
+	lockamp_stats_kick(lockamp);
+	WRITE_ONCE(lockamp->drain_timer_fired, true);
+	wake_up_process(lockamp->drain_thread);
+	return HRTIMER_NORESTART;
 }
 
+/* Hard handler of the FIFO threshold interrupt. Only notes the time for the
+ * wakeup latency of the threaded handler. */
+irqreturn_t lockamp_fifo_hardirq(int irq, void *data)
+{
+	struct lockamp *lockamp = data;
+	lockamp_stats_kick(lockamp);
+	return IRQ_WAKE_THREAD;
+}
 
 /*
- * Character Device Functions
+ * Threaded handler of the FIFO threshold interrupt
+ *
+ * The PL asserts the (level-triggered) interrupt while the FIFO holds at
+ * least 'fifo_watermark' samples. We drain the FIFO, which deasserts the
+ * interrupt again. This replaces the 'fifo_to_sbuf' kthread when the device
+ * has an interrupt.
  */
-static int device_open(struct inode *inode, struct file *file)
+irqreturn_t lockamp_fifo_irq(int irq, void *data)
+{
+	struct lockamp *lockamp = data;
+	u64 now_ns = ktime_get_ns();
+	if (0 != lockamp->last_irq_ns) {
+		WRITE_ONCE(lockamp->stats.read_delay_ns, now_ns - lockamp->last_irq_ns);
+	}
+	lockamp->last_irq_ns = now_ns;
+	drain_fifo(lockamp);
+	return IRQ_HANDLED;
+}
+
+/*
+ * Keep the drain CPUs from clocking down while the drain runs. A low clock
+ * stretches the drain burst past the time it takes the PL to fill the rest
+ * of the FIFO. Not fatal: the drain just runs at the governor's pace.
+ */
+static void raise_drain_freq(struct lockamp *lockamp)
 {
+	unsigned int khz = READ_ONCE(lockamp->drain_min_freq_khz);
+	int cpu = lockamp->drain_cpu;
 	int ret;
-	struct lockamp *lockamp;
-	lockamp = container_of(inode->i_cdev, struct lockamp, cdev);
-	file->private_data = lockamp;
-	/* Only a single reader at a time */
-	if (0 < open_count) {
-		return -EBUSY;
+	if (0 == khz) {
+		return;
+	}
+	ret = cpufreq_latency_req_add(&lockamp->drain_freq_req,
+	                              (0 <= cpu) ? cpumask_of(cpu) : cpu_online_mask,
+	                              khz);
+	if (ret < 0) {
+		dev_warn(lockamp->dev, "Failed to raise the CPU frequency: %d\n", ret);
 	}
-	++open_count;
+}
 
-#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+/* Start to move data into the signal buffer. Called for the first reader. */
+static int start_drain(struct lockamp *lockamp)
+{
+	int ret;
 	/* power */
 	ret = lockamp_pm_get(lockamp);
 	if (ret < 0) {
 		dev_err(lockamp->dev, "Failed to get pm runtime: %d\n", ret);
-		goto out_open_count;
+		return ret;
+	}
+	raise_drain_freq(lockamp);
+	/* Don't estimate FIFO overruns from the anchor of the last session.
+	 * See 'fifo_lost_n'. */
+	lockamp->anchor.mono_ns = 0;
+
+	/* Let the DMA engine move the data if there is a DMA channel */
+	if (lockamp_has_dma(lockamp)) {
+		INIT_WORK(&lockamp->dma_work, dma_to_sbuf);
+		ret = lockamp_dma_start(lockamp);
+		if (ret < 0) {
+			dev_err(lockamp->dev, "Failed to start DMA: %d\n", ret);
+			goto out_pm;
+		}
+		return 0;
+	}
+
+	/* Likewise if the firmware on CPU1 drains the FIFO */
+	if (lockamp_has_amp(lockamp)) {
+		INIT_WORK(&lockamp->dma_work, dma_to_sbuf);
+		ret = lockamp_amp_start(lockamp);
+		if (ret < 0) {
+			dev_err(lockamp->dev, "Failed to start the drain firmware: %d\n", ret);
+			goto out_pm;
+		}
+		return 0;
+	}
+
+	/* Use the FIFO threshold interrupt if there is one. The IRQ thread
+	 * follows the affinity of the interrupt. */
+	if (0 < lockamp->irq) {
+		if (0 <= lockamp->drain_cpu) {
+			ret = irq_set_affinity_hint(lockamp->irq, cpumask_of(lockamp->drain_cpu));
+			if (ret < 0) {
+				dev_warn(lockamp->dev, "Failed to set IRQ affinity: %d\n", ret);
+			}
+		}
+		lockamp->last_irq_ns = 0;
+		enable_irq(lockamp->irq);
+		return 0;
 	}
 
 	/* start buffering thread if there is a signal buffer */
-	thread = kthread_create(fifo_to_sbuf, lockamp, "lockamp0");
-	if (IS_ERR(thread)) {
+	hrtimer_init(&lockamp->drain_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	lockamp->drain_timer.function = drain_timer_expired;
+	lockamp->drain_thread = kthread_create(fifo_to_sbuf, lockamp, "lockamp%d", lockamp->id);
+	if (IS_ERR(lockamp->drain_thread)) {
 		dev_alert(lockamp->dev, "Failed to create kthread.\n");
-		ret = PTR_ERR(thread);
-		thread = NULL;
+		ret = PTR_ERR(lockamp->drain_thread);
+		lockamp->drain_thread = NULL;
 		goto out_pm;
 	}
-	ret = increase_task_priority(thread);
+	if (0 <= lockamp->drain_cpu) {
+		kthread_bind(lockamp->drain_thread, lockamp->drain_cpu);
+	}
+	ret = increase_task_priority(lockamp, lockamp->drain_thread);
 	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to set the scheduling policy: %d\n", ret);
 		goto out_thread;
 	}
-	wake_up_process(thread);
+	wake_up_process(lockamp->drain_thread);
+	return 0;
+
+out_thread:
+	kthread_stop(lockamp->drain_thread);
+	lockamp->drain_thread = NULL;
+out_pm:
+	cpufreq_latency_req_remove(&lockamp->drain_freq_req);
+	lockamp_pm_put(lockamp);
+	return ret;
+}
+
+/* Counterpart of 'start_drain'. Called for the last reader. */
+static void stop_drain(struct lockamp *lockamp)
+{
+	if (lockamp_has_dma(lockamp)) {
+		lockamp_dma_stop(lockamp);
+	} else if (lockamp_has_amp(lockamp)) {
+		lockamp_amp_stop(lockamp);
+	}
+	if (0 < lockamp->irq) {
+		/* Also waits for the threaded handler to finish */
+		disable_irq(lockamp->irq);
+		irq_set_affinity_hint(lockamp->irq, NULL);
+	}
+	if (lockamp->drain_thread) {
+		kthread_stop(lockamp->drain_thread);
+		lockamp->drain_thread = NULL;
+	}
+	cpufreq_latency_req_remove(&lockamp->drain_freq_req);
+	lockamp_pm_put(lockamp);
+}
+
+/*
+ * Register a reader that is not a file (e.g., the IIO frontend). Keeps the
+ * producer running until the matching 'lockamp_drain_put'.
+ */
+int lockamp_drain_get(struct lockamp *lockamp)
+{
+	int ret = 0;
+	mutex_lock(&lockamp->readers_m);
+	if (0 == lockamp->reader_count) {
+		ret = start_drain(lockamp);
+	}
+	if (0 <= ret) {
+		++lockamp->reader_count;
+	}
+	mutex_unlock(&lockamp->readers_m);
+	return ret;
+}
+
+void lockamp_drain_put(struct lockamp *lockamp)
+{
+	mutex_lock(&lockamp->readers_m);
+	--lockamp->reader_count;
+	if (0 == lockamp->reader_count) {
+		stop_drain(lockamp);
+	}
+	mutex_unlock(&lockamp->readers_m);
+}
+
 #endif
 
-	/* Synchronization */
-	lockamp->last_desyncs = atomic_read(&lockamp->desyncs);
-	reset_start_time(lockamp);
-	/* Out */
-	ret = 0;
-	goto out;
+/*
+ * Character Device Functions
+ */
+static int device_open(struct inode *inode, struct file *file)
+{
+	int ret;
+	struct lockamp *lockamp;
+	struct lockamp_reader *reader;
+	lockamp = container_of(inode->i_cdev, struct lockamp, cdev);
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (NULL == reader) {
+		return -ENOMEM;
+	}
+	reader->lockamp = lockamp;
 
+	mutex_lock(&lockamp->readers_m);
 #ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
-out_thread:
-	if (thread) {
-		kthread_stop(thread);
-		thread = NULL;
+	/* The first reader starts the producer */
+	if (0 == lockamp->reader_count) {
+		ret = start_drain(lockamp);
+		if (ret < 0) {
+			goto out_unlock;
+		}
+	}
+	/* Start with the newest sample */
+	mutex_lock(&lockamp->signal_buf_m);
+	reader->tail = lockamp->signal_buf.head;
+	reader->seq = lockamp->head_seq;
+	reader->fifo_lost_n = lockamp->anchor.fifo_lost_n;
+	mutex_unlock(&lockamp->signal_buf_m);
+#else
+	/* Without the signal buffer, readers would steal samples from each
+	 * other. Only a single reader at a time. */
+	if (0 < lockamp->reader_count) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+	/* Allocate up front and keep the power on while the device is open.
+	 * This way, read() itself doesn't do either. */
+	reader->bounce_buf = kmalloc(LOCKAMP_BOUNCE_BUF_SIZE, GFP_KERNEL);
+	if (NULL == reader->bounce_buf) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+	ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to get pm runtime: %d\n", ret);
+		pm_runtime_put_noidle(lockamp->dev->parent);
+		goto out_unlock;
 	}
-out_pm:
-	lockamp_pm_put(lockamp);
-out_open_count:
 #endif
+	++lockamp->reader_count;
+	mutex_unlock(&lockamp->readers_m);
 
-	--open_count;
-out:
+	/* Synchronization */
+	reader->last_desyncs = atomic_read(&lockamp->desyncs);
+	reset_start_time(reader);
+	file->private_data = reader;
+	return 0;
+
+out_unlock:
+	mutex_unlock(&lockamp->readers_m);
+	kfree(reader->bounce_buf);
+	kfree(reader);
 	return ret;
 }
 
 static int device_release(struct inode *inode, struct file *file)
 {
+	struct lockamp_reader *reader = file->private_data;
+	struct lockamp *lockamp = reader->lockamp;
 #ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
-	struct lockamp *lockamp;
-	lockamp = container_of(inode->i_cdev, struct lockamp, cdev);
-	if (thread) {
-		kthread_stop(thread);
-		thread = NULL;
+	lockamp_sweep_stop(lockamp, reader);
+	mutex_lock(&lockamp->signal_buf_m);
+	if (lockamp->mmap_reader == reader) {
+		lockamp->mmap_reader = NULL;
+	}
+	mutex_unlock(&lockamp->signal_buf_m);
+#endif
+	mutex_lock(&lockamp->readers_m);
+	--lockamp->reader_count;
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+	/* The last reader stops the producer */
+	if (0 == lockamp->reader_count) {
+		stop_drain(lockamp);
 	}
+#else
 	lockamp_pm_put(lockamp);
 #endif
-	--open_count;
+	mutex_unlock(&lockamp->readers_m);
+	kfree(reader->pack_buf);
+	kfree(reader->bounce_buf);
+	kfree(reader);
 	return 0;
 }
 
 #ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
 
-static ssize_t pop_chunk_to_user(struct circ_sample_buf *cbuf,
+/* Returns the size of the format descriptor in the chunk header */
+static size_t chunk_get_format(struct lockamp *lockamp, struct chunk_format *format)
+{
+	format->entry_mask = READ_ONCE(lockamp->output_mask);
+	format->entry_size = LOCKAMP_OUTPUT_S16 == READ_ONCE(lockamp->output_entry) ? sizeof(s16) : sizeof(s32);
+	format->sample_size = hweight8(format->entry_mask) * format->entry_size;
+	format->reserved = 0;
+	if (LOCKAMP_OUTPUT_MASK_ALL == format->entry_mask && sizeof(s32) == format->entry_size) {
+		return 0;
+	}
+	return sizeof(*format);
+}
+
+static size_t chunk_header_size(struct lockamp *lockamp)
+{
+	if (LOCKAMP_TIMESTAMP_ANCHOR == READ_ONCE(lockamp->timestamp_mode)) {
+		return sizeof(struct chunk_anchor_header);
+	}
+	return sizeof(struct chunk_header);
+}
+
+static size_t chunk_seq_size(struct lockamp *lockamp)
+{
+	if (2 <= READ_ONCE(lockamp->chunk_header_version)) {
+		return sizeof(struct chunk_seq_header);
+	}
+	return 0;
+}
+
+static ssize_t pop_chunk_to_iter(struct circ_sample_buf *cbuf,
                                  struct csbuf_snapshot *cbuf_snap,
-                                 char __user *buffer, size_t length)
+                                 struct iov_iter *to, size_t length)
 {
-	size_t cbuf_size_to_end_n = (size_t)CIRC_CNT_TO_END(cbuf_snap->head,
-	                                         cbuf_snap->tail, cbuf->capacity_n);
+	size_t tail_index = lockamp_sbuf_index(cbuf, cbuf_snap->tail);
+	size_t cbuf_size_to_end_n = min_t(size_t,
+	                                  cbuf_snap->head - cbuf_snap->tail,
+	                                  cbuf->capacity_n - tail_index);
 	size_t chunk_size = cbuf_size_to_end_n * sizeof(struct sample);
 	size_t copy_length = min(chunk_size, length);
 	size_t copy_length_n = copy_length / sizeof(struct sample);
-	ptrdiff_t new_tail;
-	if (copy_to_user(buffer, cbuf->buf + cbuf_snap->tail, copy_length)) {
+	if (copy_to_iter(cbuf->buf + tail_index, copy_length, to) != copy_length) {
 		return -EFAULT;
 	}
-	new_tail = (cbuf_snap->tail + copy_length_n) & (cbuf->capacity_n - 1);
-	smp_store_release(&cbuf->tail, new_tail);
-	cbuf_snap->tail = new_tail;
+	/* Note that the reader's tail is only moved in 'chunk_commit_info' */
+	cbuf_snap->tail += copy_length_n;
 	return copy_length;
 }
 
-static ssize_t pop_to_user(struct circ_sample_buf *cbuf,
+static ssize_t pop_to_iter(struct circ_sample_buf *cbuf,
                            struct csbuf_snapshot *cbuf_snap,
-                           char __user *buffer, size_t length)
+                           struct iov_iter *to, size_t length)
 {
 	ssize_t ret;
-	char *pos = buffer;
+	size_t copied = 0;
 	/* Read the first contiguous chunk of data */
-	ret = pop_chunk_to_user(cbuf, cbuf_snap, pos, length);
+	ret = pop_chunk_to_iter(cbuf, cbuf_snap, to, length);
 	if (ret < 0) {
 		return ret;
 	}
-	pos += ret;
+	copied += ret;
 	length -= ret;
 	/* Read the second contiguous chunk of data */
-	ret = pop_chunk_to_user(cbuf, cbuf_snap, pos, length);
+	ret = pop_chunk_to_iter(cbuf, cbuf_snap, to, length);
 	if (ret < 0) {
 		return ret;
 	}
-	pos += ret;
+	copied += ret;
 	length -= ret;
-	return pos - buffer;
+	return copied;
 }
 
-static int chunk_get_info(struct lockamp *lockamp, size_t usr_buf_length,
+/* Convert a single sample into the compact format */
+static char *pack_sample(const struct sample *sample,
+                         const struct chunk_format *format, char *dst)
+{
+	const s32 *entries = (const s32 *)sample;
+	int i;
+	for (i = 0; LOCKAMP_ENTRIES_PER_SAMPLE > i; ++i) {
+		if (!(format->entry_mask & BIT(i))) {
+			continue;
+		}
+		if (sizeof(s16) == format->entry_size) {
+			*(s16 *)dst = clamp_t(s32, entries[i], S16_MIN, S16_MAX);
+		} else {
+			*(s32 *)dst = entries[i];
+		}
+		dst += format->entry_size;
+	}
+	return dst;
+}
+
+/*
+ * Like 'pop_to_iter' but converts the samples into the compact format on
+ * the way. Goes through the reader's page-sized bounce buffer.
+ */
+static ssize_t pop_packed_to_iter(struct lockamp_reader *reader,
+                                  struct csbuf_snapshot *cbuf_snap,
+                                  const struct chunk_format *format,
+                                  struct iov_iter *to, size_t count_n)
+{
+	struct circ_sample_buf *cbuf = &reader->lockamp->signal_buf;
+	size_t batch_n = PAGE_SIZE / format->sample_size;
+	size_t copied = 0;
+	size_t packed_size;
+	char *dst;
+	size_t i, n;
+	if (NULL == reader->pack_buf) {
+		reader->pack_buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+		if (NULL == reader->pack_buf) {
+			return -ENOMEM;
+		}
+	}
+	while (0 < count_n) {
+		n = min(count_n, batch_n);
+		dst = reader->pack_buf;
+		for (i = 0; n > i; ++i) {
+			dst = pack_sample(&cbuf->buf[lockamp_sbuf_index(cbuf, cbuf_snap->tail + i)],
+			                  format, dst);
+		}
+		packed_size = dst - (char *)reader->pack_buf;
+		if (copy_to_iter(reader->pack_buf, packed_size, to) != packed_size) {
+			return -EFAULT;
+		}
+		copied += packed_size;
+		/* Note that the reader's tail is only moved in 'chunk_commit_info' */
+		cbuf_snap->tail += n;
+		count_n -= n;
+	}
+	return copied;
+}
+
+static int chunk_get_info(struct lockamp_reader *reader, size_t usr_buf_length,
                           struct csbuf_snapshot *sbuf_snap,
                           struct chunk_info *info)
 {
+	struct lockamp *lockamp = reader->lockamp;
+	struct lockamp_anchor anchor;
 	size_t data_size_n;
-	unsigned int time_step_ns;
-	int ret;
+	size_t total_header_size;
+	u32 config_n;
+	u32 gap_n;
+	info->header_size = chunk_header_size(lockamp);
+	info->seq_size = chunk_seq_size(lockamp);
+	info->format_size = chunk_get_format(lockamp, &info->format);
+	total_header_size = info->header_size + info->seq_size + info->format_size;
 	/* The user-provided buffer can not contain a chunk */
-	if (sizeof(struct chunk_header) > usr_buf_length) {
+	if (total_header_size > usr_buf_length) {
 		return -EINVAL;
 	}
-	ret = lockamp_get_time_step_ns(lockamp, &time_step_ns);
-	if (ret < 0) {
-		return ret;
-	}
-	data_size_n = (usr_buf_length - sizeof(struct chunk_header)) / sizeof(struct sample);
+	data_size_n = (usr_buf_length - total_header_size) / info->format.sample_size;
 	data_size_n = min(data_size_n, sbuf_snap->size_n);
-	info->header.last_start_time_ns = lockamp->last_start_time_ns;
-	info->header.time_step_ns = time_step_ns;
+	/* Don't mix samples from before and after a configuration change */
+	config_n = READ_ONCE(lockamp->config_count) - sbuf_snap->tail;
+	if (0 < (s32)config_n && config_n < data_size_n) {
+		data_size_n = config_n;
+	}
+	/* Don't span a FIFO overrun either. If the reader is past the latest
+	 * one, we account for all overruns since the last chunk at once. */
+	lockamp_get_anchor(lockamp, &anchor);
+	info->fifo_lost_n = 0;
+	if (anchor.fifo_lost_n != reader->fifo_lost_n) {
+		gap_n = anchor.gap_count - sbuf_snap->tail;
+		if (0 < (s32)gap_n) {
+			data_size_n = min_t(size_t, data_size_n, gap_n);
+		} else {
+			info->fifo_lost_n = anchor.fifo_lost_n - reader->fifo_lost_n;
+		}
+	}
+	info->header.base.last_start_time_ns = reader->last_start_time_ns +
+	                                       lockamp_duration_ns(lockamp, info->fifo_lost_n);
+	info->header.base.time_step_ns = lockamp_time_step_ns(lockamp);
+	if (sizeof(struct chunk_anchor_header) == info->header_size) {
+		info->header.anchor_mono_ns = anchor.mono_ns;
+		info->header.anchor_real_ns = anchor.real_ns;
+		info->header.start_count = sbuf_snap->tail;
+		info->header.anchor_count = anchor.count;
+	}
+	info->seq.seq = reader->seq + info->fifo_lost_n;
+	info->seq.dropped_n = reader->lost_n + reader->fifo_dropped_n + info->fifo_lost_n;
+	info->seq.flags = reader->loss_flags;
+	if (0 < info->fifo_lost_n) {
+		info->seq.flags |= LOCKAMP_CHUNK_FIFO_OVERRUN;
+	}
+	info->seq.version = 2;
 	info->data_size_n = data_size_n;
 	return 0;
 }
 
-static int chunk_commit_info(struct lockamp *lockamp, struct chunk_info *info)
+static int chunk_commit_info(struct lockamp_reader *reader,
+                             struct csbuf_snapshot *sbuf_snap,
+                             struct chunk_info *info)
 {
-	u64 duration_ns;
-	int ret = lockamp_get_duration_ns(lockamp, info->data_size_n, &duration_ns);
-	if (ret < 0) {
-		return ret;
-	}
-	lockamp->last_start_time_ns += duration_ns;
+	reader->tail = sbuf_snap->tail;
+	reader->seq += info->fifo_lost_n + info->data_size_n;
+	reader->fifo_lost_n += info->fifo_lost_n;
+	reader->fifo_dropped_n += info->fifo_lost_n;
+	reader->loss_flags = 0;
+	reader->last_start_time_ns += lockamp_duration_ns(reader->lockamp,
+	                                                  info->fifo_lost_n + info->data_size_n);
+	trace_lockamp_reader_pop(reader->lockamp->dev, reader->tail, info->data_size_n);
 	return 0;
 }
 
-static ssize_t write_header_to_user(struct lockamp *lockamp,
-                                    struct chunk_header *header,
-                                    char __user *buffer, size_t length)
+static ssize_t write_header_to_iter(struct lockamp *lockamp,
+                                    struct chunk_info *info,
+                                    struct iov_iter *to)
 {
-	if (copy_to_user(buffer, header, sizeof(struct chunk_header))) {
+	if (copy_to_iter(&info->header, info->header_size, to) != info->header_size) {
 		dev_alert(lockamp->dev, "Failed to copy chunk header to user space buffer.\n");
 		return -EFAULT;
 	}
-	return sizeof(struct chunk_header);
+	if (copy_to_iter(&info->seq, info->seq_size, to) != info->seq_size) {
+		dev_alert(lockamp->dev, "Failed to copy chunk sequence header to user space buffer.\n");
+		return -EFAULT;
+	}
+	if (copy_to_iter(&info->format, info->format_size, to) != info->format_size) {
+		dev_alert(lockamp->dev, "Failed to copy chunk format to user space buffer.\n");
+		return -EFAULT;
+	}
+	return info->header_size + info->seq_size + info->format_size;
+}
+
+/*
+ * Skip the samples that a filter program dropped (see 'lockamp_sbuf_filter')
+ * and end the snapshot before the next ones. Like an overrun, we know how
+ * many samples we skip. I.e., this is not a desync either.
+ */
+static void reader_skip_filtered(struct lockamp_reader *reader,
+                                 struct csbuf_snapshot *snap)
+{
+	struct lockamp *lockamp = reader->lockamp;
+	u32 skip_n;
+	u32 keep_n;
+	lockamp_sbuf_filtered(lockamp, snap->tail, snap->size_n, &skip_n, &keep_n);
+	if (0 < skip_n) {
+		reader->tail += skip_n;
+		reader->seq += skip_n;
+		reader->loss_flags |= LOCKAMP_CHUNK_FILTERED;
+		reader->last_start_time_ns += lockamp_duration_ns(lockamp, skip_n);
+	}
+	snap->tail = reader->tail;
+	snap->size_n = keep_n;
 }
 
-static void reader_get_sbuf_snapshot(struct lockamp *lockamp,
+static void reader_get_sbuf_snapshot(struct lockamp_reader *reader,
                                      struct csbuf_snapshot *snap)
 {
-	snap->head = smp_load_acquire(&lockamp->signal_buf.head);
-	snap->tail = lockamp->signal_buf.tail;
-	snap->size_n = (size_t)CIRC_CNT(snap->head, snap->tail, lockamp->signal_buf.capacity_n);
-	if (lockamp->signal_buf.capacity_n - 1 == snap->size_n) {
-		atomic_inc(&lockamp->desyncs);
-		dev_warn_ratelimited(lockamp->dev, "Data loss. Signal buffer was not popped in time and has reached its maximum capacity.\n");
+	snap->head = smp_load_acquire(&reader->lockamp->signal_buf.head);
+	reader_skip_overrun(reader);
+	snap->tail = reader->tail;
+	snap->size_n = snap->head - snap->tail;
+	reader_skip_filtered(reader, snap);
+}
+
+/* The mmap reader keeps its tail in the control page */
+static u32 reader_tail(struct lockamp_reader *reader)
+{
+	struct lockamp *lockamp = reader->lockamp;
+	if (READ_ONCE(lockamp->mmap_reader) == reader) {
+		return smp_load_acquire(&lockamp->mmap_ctrl->tail);
 	}
+	return reader->tail;
 }
 
-#endif
+/* Number of unread samples (including samples that may be overwritten) */
+static u32 reader_available_n(struct lockamp_reader *reader)
+{
+	struct lockamp *lockamp = reader->lockamp;
+	return smp_load_acquire(&lockamp->signal_buf.head) - reader_tail(reader);
+}
 
-static void synchronize(struct lockamp *lockamp)
+/*
+ * Wait until there are at least 'read_low_watermark' samples. Never waits
+ * for more samples than what fits into the user-provided buffer.
+ */
+static int reader_wait(struct lockamp_reader *reader, struct file *filp,
+                       size_t usr_buf_length)
 {
-	if (atomic_read(&lockamp->desyncs) != lockamp->last_desyncs) {
-		dev_warn(lockamp->dev, "Resetting start time due to desync.\n");
-		reset_start_time(lockamp);
+	struct lockamp *lockamp = reader->lockamp;
+	size_t wanted_n = READ_ONCE(lockamp->read_low_watermark_n);
+	struct chunk_format format;
+	size_t header_size = chunk_header_size(lockamp) + chunk_seq_size(lockamp) +
+	                     chunk_get_format(lockamp, &format);
+	/* 'chunk_get_info' reports the error */
+	if (header_size > usr_buf_length) {
+		return 0;
+	}
+	wanted_n = min(wanted_n, (usr_buf_length - header_size) / format.sample_size);
+	if (0 == wanted_n || reader_available_n(reader) >= wanted_n) {
+		return 0;
 	}
-	lockamp->last_desyncs = atomic_read(&lockamp->desyncs);
+	if (filp->f_flags & O_NONBLOCK) {
+		return -EAGAIN;
+	}
+	return wait_event_interruptible(lockamp->read_wq,
+	                                reader_available_n(reader) >= wanted_n);
 }
 
-static ssize_t device_read(
-	struct file *filp,
-	__user char *buffer,
-	size_t length,
-	loff_t *offset)
+/* Did the producer overwrite any of the samples from 'tail' and on? */
+static bool reader_was_overrun(struct lockamp_reader *reader, u32 tail)
 {
-	ssize_t ret;
-	struct lockamp *lockamp = filp->private_data;
+	struct circ_sample_buf *sbuf = &reader->lockamp->signal_buf;
+	/* Read the reserve after the samples */
+	smp_rmb();
+	return (s32)(tail - (READ_ONCE(sbuf->reserve) - sbuf->capacity_n)) < 0;
+}
+
+#endif
+
+/*
+ * Both read() and splice() end up here. For the latter, 'to' points into the
+ * pages of a pipe.
+ */
+static ssize_t device_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct file *filp = iocb->ki_filp;
+	struct lockamp_reader *reader = filp->private_data;
+	struct lockamp *lockamp = reader->lockamp;
+	size_t length = iov_iter_count(to);
 #ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
-	char *pos = buffer;
+	ssize_t ret;
+	size_t copied;
 	struct chunk_info info;
 	struct csbuf_snapshot sbuf_snap;
-	reader_get_sbuf_snapshot(lockamp, &sbuf_snap);
-	synchronize(lockamp);
-	ret = chunk_get_info(lockamp, length, &sbuf_snap, &info);
+	size_t usr_buf_length = length;
+	/* The mmap control page owns the tail */
+	if (READ_ONCE(lockamp->mmap_reader) == reader) {
+		return -EBUSY;
+	}
+	ret = reader_wait(reader, filp, usr_buf_length);
+	if (ret < 0) {
+		return ret;
+	}
+retry:
+	copied = 0;
+	length = usr_buf_length;
+	reader_get_sbuf_snapshot(reader, &sbuf_snap);
+	synchronize(reader);
+	ret = chunk_get_info(reader, length, &sbuf_snap, &info);
 	if (ret < 0) {
 		return ret;
 	}
 	/* Chunk header */
-	ret = write_header_to_user(lockamp, &info.header, pos, length);
+	ret = write_header_to_iter(lockamp, &info, to);
 	if (ret < 0) {
 		dev_alert(lockamp->dev, "Failed to copy header to user space buffer.\n");
-		return ret;
+		goto out_revert;
 	}
-	pos += ret;
+	copied += ret;
 	length = info.data_size_n * sizeof(struct sample);
 	/* Chunk data */
-	ret = pop_to_user(&lockamp->signal_buf, &sbuf_snap, pos, length);
+	if (0 < info.format_size) {
+		ret = pop_packed_to_iter(reader, &sbuf_snap, &info.format, to, info.data_size_n);
+	} else {
+		ret = pop_to_iter(&lockamp->signal_buf, &sbuf_snap, to, length);
+	}
 	if (ret < 0) {
 		dev_alert(lockamp->dev, "Failed to copy chunk data to user space buffer.\n");
-		return ret;
+		goto out_revert;
 	}
-	pos += ret;
+	copied += ret;
 	length -= ret;
+	/* The producer may have overwritten the samples while we copied them.
+	 * If so, skip the lost samples and try again. */
+	if (reader_was_overrun(reader, reader->tail)) {
+		reader_skip_overrun(reader);
+		iov_iter_revert(to, copied);
+		goto retry;
+	}
 	/* Effectuate the write */
-	ret = chunk_commit_info(lockamp, &info);
+	ret = chunk_commit_info(reader, &sbuf_snap, &info);
 	if (ret < 0) {
-		return ret;
+		goto out_revert;
 	}
-	return pos - buffer;
+	return copied;
+out_revert:
+	/* Leave nothing of a partial chunk behind (e.g., in the pipe) */
+	iov_iter_revert(to, copied);
+	return ret;
 #else
-	size_t fifo_size_n;
-	size_t buffer_size_n = length / sizeof(struct sample);
-	size_t bounded_size_n;
-	size_t bounded_size;
-	char *kbuf = NULL;
-	char *pos;
-	int i;
-	/* get power */
-	ret = lockamp_pm_get(lockamp);
-	if (ret < 0) {
-		dev_err(lockamp->dev, "Failed to get pm runtime: %d\n", ret);
-		ret = -EFAULT;
+	size_t remaining_n;
+	size_t block_n;
+	size_t block_size;
+	size_t copied = 0;
+	/* Bound to the FIFO content. The reader holds the power (see
+	 * 'device_open'). */
+	remaining_n = min_t(size_t, lockamp_fifo_size_n(lockamp),
+	                    length / sizeof(struct sample));
+	synchronize(reader);
+	/* Pop directly into user space, one page at a time */
+	while (0 < remaining_n) {
+		block_n = min_t(size_t, remaining_n, LOCKAMP_BOUNCE_BUF_N);
+		block_size = block_n * sizeof(struct sample);
+		lockamp_fifo_pop_bulk(lockamp, reader->bounce_buf, block_n);
+		if (copy_to_iter(reader->bounce_buf, block_size, to) != block_size) {
+			dev_err(lockamp->dev, "Failed to copy memory to user space.\n");
+			/* The samples are gone either way. Report what we have. */
+			return (0 < copied) ? copied : -EFAULT;
+		}
+		copied += block_size;
+		remaining_n -= block_n;
+	}
+	return copied;
+#endif
+}
+
+/*
+ * splice() from the device into a pipe
+ *
+ * Each call emits (at most) a single chunk, exactly as read() does. That is,
+ * the chunk header is interleaved with the sample data in the pipe. The
+ * consumer can e.g. splice the pipe onward to a socket or a file, without
+ * the samples passing through user space.
+ *
+ * The samples are copied into the pipe's own pages. We can't hand out the
+ * signal buffer pages themselves: The producer never waits for readers and
+ * would overwrite the samples while they are still in the pipe.
+ *
+ * A chunk must not be split. Therefore, we bound the chunk to the free
+ * space in the pipe. The caller holds the pipe lock. Note that
+ * SPLICE_F_NONBLOCK only concerns the pipe. Open the device with O_NONBLOCK
+ * to not wait for samples.
+ */
+static ssize_t device_splice_read(struct file *filp, loff_t *ppos,
+                                  struct pipe_inode_info *pipe, size_t len,
+                                  unsigned int flags)
+{
+	size_t space = (size_t)(pipe->buffers - pipe->nrbufs) << PAGE_SHIFT;
+	if (0 == space) {
+		return -EAGAIN;
+	}
+	return generic_file_splice_read(filp, ppos, pipe, min(len, space), flags);
+}
+
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+
+static int mmap_ctrl(struct lockamp_reader *reader, struct vm_area_struct *vma)
+{
+	struct lockamp *lockamp = reader->lockamp;
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct lockamp_mmap_ctrl *ctrl = lockamp->mmap_ctrl;
+	int ret;
+	if (vma->vm_end - vma->vm_start != PAGE_SIZE) {
+		return -EINVAL;
+	}
+	mutex_lock(&lockamp->signal_buf_m);
+	/* There is only a single control page */
+	if (NULL != lockamp->mmap_reader) {
+		ret = -EBUSY;
 		goto out;
 	}
-	/* bounds */
-	fifo_size_n = lockamp_fifo_size_n(lockamp);
-	bounded_size_n = min(fifo_size_n, buffer_size_n);
-	bounded_size = bounded_size_n * sizeof(struct sample);
-	/* allocate kernel memory */
-	kbuf = vmalloc(bounded_size);
-	if (NULL == kbuf) {
-		dev_err(lockamp->dev, "Failed to allocate kernel buffer.\n");
-		ret = -ENOMEM;
-		goto out_pm;
+	ret = remap_vmalloc_range(vma, ctrl, 0);
+	if (ret < 0) {
+		goto out;
 	}
-	/* copy from FIFO into kernel buffer */
-	synchronize(lockamp);
-	pos = kbuf;
-	for (i = 0; bounded_size_n != i; ++i) {
-		lockamp_fifo_pop_sample(lockamp, (struct sample*)pos);
-		pos += sizeof(struct sample);
-	}
-	/* copy from kernel space to user space */
-	if (copy_to_user(buffer, kbuf, bounded_size)) {
-		dev_err(lockamp->dev, "Failed to copy memory to user space.\n");
-		ret = -EFAULT;
-		goto out_kbuf;
-	}
-	ret = bounded_size;
-	goto out_pm;
-out_kbuf:
-	vfree(kbuf);
-out_pm:
-	lockamp_pm_put(lockamp);
+	/* Start out where the reader is */
+	ctrl->capacity_n = sbuf->capacity_n;
+	ctrl->sample_size = sizeof(struct sample);
+	WRITE_ONCE(ctrl->tail, reader->tail);
+	WRITE_ONCE(lockamp->mmap_reader, reader);
+	mmap_publish(lockamp);
 out:
+	mutex_unlock(&lockamp->signal_buf_m);
 	return ret;
+}
+
+static int mmap_data(struct lockamp *lockamp, struct vm_area_struct *vma)
+{
+	/* The signal buffer is read-only for the reader */
+	if (vma->vm_flags & VM_WRITE) {
+		return -EPERM;
+	}
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return lockamp_sbuf_mmap(lockamp, vma);
+}
+
+static __poll_t device_poll(struct file *filp, poll_table *wait)
+{
+	struct lockamp_reader *reader = filp->private_data;
+	struct lockamp *lockamp = reader->lockamp;
+	u32 wanted_n = max(1U, READ_ONCE(lockamp->read_low_watermark_n));
+	poll_wait(filp, &lockamp->read_wq, wait);
+	if (reader_available_n(reader) >= wanted_n) {
+		return EPOLLIN | EPOLLRDNORM;
+	}
+	return 0;
+}
+
+static int device_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct lockamp_reader *reader = filp->private_data;
+	if (LOCKAMP_MMAP_CTRL_PGOFF == vma->vm_pgoff) {
+		return mmap_ctrl(reader, vma);
+	}
+	return mmap_data(reader->lockamp, vma);
+}
+
 #endif
+
+/* Per-reader overrun accounting in /proc/<pid>/fdinfo/<fd> */
+static void device_show_fdinfo(struct seq_file *m, struct file *filp)
+{
+	struct lockamp_reader *reader = filp->private_data;
+	seq_printf(m, "overruns:\t%u\n", reader->overruns);
+	seq_printf(m, "lost_samples:\t%llu\n", reader->lost_n);
+}
+
+static long device_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	struct lockamp_reader *reader = filp->private_data;
+	struct lockamp *lockamp = reader->lockamp;
+	void __user *argp = (void __user *)arg;
+	struct lockamp_config config;
+	struct lockamp_sweep sweep;
+	int ret;
+	switch (cmd) {
+	case LOCKAMP_IOC_SET_CONFIG:
+		/* Same as for the sysfs attributes */
+		if (!capable(CAP_SYS_ADMIN)) {
+			return -EPERM;
+		}
+		if (copy_from_user(&config, argp, sizeof(config))) {
+			return -EFAULT;
+		}
+		break;
+	case LOCKAMP_IOC_GET_CONFIG:
+		break;
+	case LOCKAMP_IOC_START_SWEEP:
+		if (!capable(CAP_SYS_ADMIN)) {
+			return -EPERM;
+		}
+		if (copy_from_user(&sweep, argp, sizeof(sweep))) {
+			return -EFAULT;
+		}
+		ret = lockamp_pm_get(lockamp);
+		if (ret < 0) {
+			return ret;
+		}
+		ret = lockamp_sweep_start(lockamp, reader, &sweep);
+		lockamp_pm_put(lockamp);
+		if (ret < 0) {
+			return ret;
+		}
+		if (copy_to_user(argp, &sweep, sizeof(sweep))) {
+			return -EFAULT;
+		}
+		return 0;
+	case LOCKAMP_IOC_STOP_SWEEP:
+		if (!capable(CAP_SYS_ADMIN)) {
+			return -EPERM;
+		}
+		lockamp_sweep_stop(lockamp, NULL);
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+	ret = lockamp_pm_get(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	if (LOCKAMP_IOC_SET_CONFIG == cmd) {
+		ret = lockamp_config_set(lockamp, &config);
+	} else {
+		ret = lockamp_config_get(lockamp, &config);
+	}
+	lockamp_pm_put(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	if (copy_to_user(argp, &config, sizeof(config))) {
+		return -EFAULT;
+	}
+	return 0;
+}
+
+#ifdef CONFIG_COMPAT
+/* 'struct lockamp_config' has the same layout for 32-bit user space */
+static long device_compat_ioctl(struct file *filp, unsigned int cmd,
+                                unsigned long arg)
+{
+	return device_ioctl(filp, cmd, (unsigned long)compat_ptr(arg));
 }
+#endif
 
 static ssize_t device_write(struct file *filp, const char __user *buff,
                             size_t len, loff_t * off)
@@ -433,8 +1287,18 @@ static ssize_t device_write(struct file *filp, const char __user *buff,
 
 struct file_operations lockamp_fops = {
 	.owner = THIS_MODULE,
-	.read = device_read,
+	.read_iter = device_read_iter,
+	.splice_read = device_splice_read,
 	.write = device_write,
+	.unlocked_ioctl = device_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = device_compat_ioctl,
+#endif
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+	.poll = device_poll,
+	.mmap = device_mmap,
+#endif
 	.open = device_open,
-	.release = device_release
+	.release = device_release,
+	.show_fdinfo = device_show_fdinfo
 };
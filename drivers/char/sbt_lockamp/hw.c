@@ -6,12 +6,25 @@
  */
 #include <asm/io.h>
 #include <linux/circ_buf.h>
+#include <linux/clk.h>
 #include <linux/delay.h>
 #include <linux/gpio/consumer.h>
 #include <linux/ioport.h>
+#include <linux/ktime.h>
 #include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/slab.h>
+#include <linux/time64.h>
+#ifdef CONFIG_KERNEL_MODE_NEON
+#include <asm/neon.h>
+#include <asm/simd.h>
+#endif
 
 #include "hw.h"
+#include "sbuf.h"
+#include "stats.h"
+
+#include <trace/events/lockamp.h>
 
 struct lockamp_gen_control LOCKAMP_GEN1_CONTROL = {
 	.scale = LOCKAMP_REG_GEN1_SCALE,
@@ -32,6 +45,7 @@ void lockamp_reset(struct lockamp *lockamp)
 	gpiod_set_value(lockamp->reset, 1);
 	msleep(1); /* Arbitrary */
 	gpiod_set_value(lockamp->reset, 0);
+	lockamp_sim_reset(lockamp);
 }
 
 int lockamp_set_decimation(struct lockamp *lockamp, u32 value)
@@ -45,7 +59,7 @@ int lockamp_set_decimation(struct lockamp *lockamp, u32 value)
 	 * 8:  Sample rate  ~46 KHz (time step: 21824 ns)
 	 * 16: Sample rate  ~23 KHz (time step: 43648 ns)
 	 */
-	if (!(1 == value || 2 == value || 4 == value || 8 == value || 16 == value)) {
+	if (!lockamp_valid_decimation(value)) {
 		return -EINVAL;
 	}
 	/*
@@ -62,7 +76,7 @@ int lockamp_set_decimation(struct lockamp *lockamp, u32 value)
 		return ret;
 	}
 	/* Set FIR cycles accordingly */
-	fir_cycles = min(511, 341 * (1 << hb_filters) / 8 - 6);
+	fir_cycles = lockamp_decimation_fir_cycles(hb_filters);
 	ret = lockamp_set_fir_cycles(lockamp, fir_cycles);
 	if (ret < 0) {
 		return ret;
@@ -88,54 +102,335 @@ int lockamp_get_decimation(struct lockamp *lockamp, u32 *value)
 	return 0;
 }
 
+/* Recompute the time step from the cycles per sample and the clock period.
+ * Call with the timing lock held. */
+static void lockamp_apply_timing(struct lockamp *lockamp)
+{
+	struct lockamp_timing *timing = &lockamp->timing;
+	u64 step_fs = (u64)timing->base_time_step_fs * timing->cycles_n;
+	unsigned int time_step_ns = DIV_ROUND_CLOSEST_ULL(step_fs, LOCKAMP_FSEC_PER_NSEC);
+	u32 rem_fs;
+	u64 step_ns = div_u64_rem(step_fs, LOCKAMP_FSEC_PER_NSEC, &rem_fs);
+	timing->time_step_q32 = (step_ns << 32) |
+	                        div_u64((u64)rem_fs << 32, LOCKAMP_FSEC_PER_NSEC);
+	WRITE_ONCE(timing->time_step_ns, time_step_ns);
+	WRITE_ONCE(timing->read_delay_ns,
+	           LOCKAMP_FIFO_CAPACITY_N / 2 * time_step_ns);
+}
+
+static void lockamp_set_clk_rate(struct lockamp *lockamp, unsigned long rate)
+{
+	unsigned long flags;
+	if (0 == rate) {
+		return;
+	}
+	write_seqlock_irqsave(&lockamp->timing.lock, flags);
+	lockamp->timing.base_time_step_fs = DIV_ROUND_CLOSEST_ULL(FSEC_PER_SEC, rate);
+	lockamp_apply_timing(lockamp);
+	write_sequnlock_irqrestore(&lockamp->timing.lock, flags);
+}
+
+/* The rate of the input clock changed. E.g., because of a new measurement
+ * of the oscillator (see clk-sit9121). */
+static int lockamp_clk_notify(struct notifier_block *nb, unsigned long event,
+                              void *data)
+{
+	struct lockamp *lockamp = container_of(nb, struct lockamp, timing.clk_nb);
+	struct clk_notifier_data *ndata = data;
+	if (POST_RATE_CHANGE != event) {
+		return NOTIFY_DONE;
+	}
+	lockamp_set_clk_rate(lockamp, ndata->new_rate);
+	dev_dbg(lockamp->dev, "Input clock rate: %lu Hz\n", ndata->new_rate);
+	return NOTIFY_OK;
+}
+
+static void lockamp_timing_release(void *data)
+{
+	struct lockamp *lockamp = data;
+	clk_notifier_unregister(lockamp->timing.clk, &lockamp->timing.clk_nb);
+}
+
+/*
+ * The input clock is optional. Without it, we assume the nominal period
+ * (LOCKAMP_BASE_TIME_STEP).
+ */
+int lockamp_timing_init(struct lockamp *lockamp)
+{
+	struct lockamp_timing *timing = &lockamp->timing;
+	int ret;
+	seqlock_init(&timing->lock);
+	timing->base_time_step_fs = LOCKAMP_BASE_TIME_STEP * LOCKAMP_FSEC_PER_NSEC;
+	timing->clk = devm_clk_get_optional(lockamp->dev, NULL);
+	if (IS_ERR(timing->clk)) {
+		return PTR_ERR(timing->clk);
+	}
+	if (NULL == timing->clk) {
+		return 0;
+	}
+	timing->clk_nb.notifier_call = lockamp_clk_notify;
+	ret = clk_notifier_register(timing->clk, &timing->clk_nb);
+	if (ret < 0) {
+		return ret;
+	}
+	ret = devm_add_action_or_reset(lockamp->dev, lockamp_timing_release, lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	lockamp_set_clk_rate(lockamp, clk_get_rate(timing->clk));
+	return 0;
+}
+
+/*
+ * Recompute the derived timing from the registers.
+ *
+ * Call this whenever a register that affects the time step changes. I.e.,
+ * the CIC length or the decimation factor.
+ */
+int lockamp_update_timing(struct lockamp *lockamp)
+{
+	unsigned long flags;
+	u32 cycles_n;
+	int ret = lockamp_read_cycles_n(lockamp, &cycles_n);
+	if (ret < 0) {
+		return ret;
+	}
+	write_seqlock_irqsave(&lockamp->timing.lock, flags);
+	lockamp->timing.cycles_n = cycles_n;
+	lockamp_apply_timing(lockamp);
+	write_sequnlock_irqrestore(&lockamp->timing.lock, flags);
+	return 0;
+}
+
+/*
+ * Raw write (not through regmap)
+ *
+ * The coefficients are not in the regmap cache. Thus, we can skip the
+ * per-register overhead of regmap and write them in one burst of relaxed
+ * writes. Note that the filter is live while we write to it.
+ */
 int lockamp_set_fir_coefs(struct lockamp *lockamp, const s32 *coefs)
 {
-	return regmap_bulk_write(lockamp->regmap, LOCKAMP_REG_FIR_COEF_BASE,
-	                         coefs, LOCKAMP_FIR_COEF_LEN);
+	__iowrite32_copy(lockamp->control + LOCKAMP_REG_FIR_COEF_BASE, coefs,
+	                 LOCKAMP_FIR_COEF_LEN);
+	/* Complete the writes before later register accesses */
+	wmb();
+	return 0;
 }
 
 /* Raw read (not through regmap) */
 void lockamp_get_adc_samples(struct lockamp *lockamp, s32 *adc_samples)
 {
-	int i;
 	/* Reset ADC data acquisition */
 	iowrite32(0, lockamp->control + LOCKAMP_REG_ADC_BUFFER);
-	/* Read ADC data */
-	for (i = 0; LOCKAMP_ADC_SAMPLES_SIZE_S32 > i; ++i) {
-		adc_samples[i] = ioread32(lockamp->control + LOCKAMP_REG_ADC_BUFFER);
+	/* Read ADC data. Like the FIFO, the register pops an entry per read. */
+	ioread32_rep(lockamp->control + LOCKAMP_REG_ADC_BUFFER, adc_samples,
+	             LOCKAMP_ADC_SAMPLES_SIZE_S32);
+	/* Order the reads before later memory accesses */
+	rmb();
+}
+
+static void lockamp_apply_multipliers_scalar(const int *multipliers,
+                                             struct sample *s, size_t size_n)
+{
+	size_t i;
+	int j;
+	int multiplier;
+	for (i = 0; size_n != i; ++i) {
+		for (j = 0; LOCKAMP_SITES_PER_SAMPLE > j; ++j) {
+			multiplier = multipliers[j];
+			s[i].sites[j].hf_re *= multiplier;
+			s[i].sites[j].hf_im *= multiplier;
+			s[i].sites[j].lf_re *= multiplier;
+			s[i].sites[j].lf_im *= multiplier;
+		}
+	}
+}
+
+static void lockamp_apply_multipliers_fast(const int *multipliers,
+                                           struct sample *s, size_t size_n)
+{
+#ifdef CONFIG_KERNEL_MODE_NEON
+	BUILD_BUG_ON(2 != LOCKAMP_SITES_PER_SAMPLE);
+	if (cpu_has_neon() && may_use_simd()) {
+		kernel_neon_begin();
+		lockamp_apply_multipliers_neon((s32 *)s, size_n,
+		                               multipliers[0], multipliers[1]);
+		kernel_neon_end();
+		return;
+	}
+#endif
+	lockamp_apply_multipliers_scalar(multipliers, s, size_n);
+}
+
+void lockamp_apply_multipliers(struct lockamp *lockamp, struct sample *s,
+                               size_t size_n)
+{
+	int i;
+	/* Most of the time, the multipliers are all one. Skip the pass over the
+	 * data in that case. */
+	for (i = 0; LOCKAMP_SITES_PER_SAMPLE > i; ++i) {
+		if (1 != lockamp->sample_multipliers[i]) {
+			break;
+		}
+	}
+	if (LOCKAMP_SITES_PER_SAMPLE == i) {
+		return;
 	}
+	lockamp_apply_multipliers_fast(lockamp->sample_multipliers, s, size_n);
+}
+
+/* Raw read (not through regmap)
+ *
+ * Bulk version of 'lockamp_fifo_pop_sample'. First, we burst-read all the
+ * raw entries. Afterwards, we apply the multipliers to the whole block. */
+void lockamp_fifo_pop_bulk(struct lockamp *lockamp, struct sample *s,
+                           size_t size_n)
+{
+	lockamp_fifo_pop_rep(lockamp, (s32 *)s, size_n * LOCKAMP_ENTRIES_PER_SAMPLE);
+	lockamp_apply_multipliers(lockamp, s, size_n);
+}
+
+/*
+ * Record that the sample with the given count is produced right now. If
+ * the PL dropped 'lost_n' samples right before it, record that as well.
+ * Call before the head moves.
+ *
+ * Only the producer calls this (with the signal buffer mutex held), so
+ * there is a single writer.
+ */
+void lockamp_latch_anchor(struct lockamp *lockamp, u32 count, u32 lost_n)
+{
+	u64 mono_ns = ktime_get_mono_fast_ns();
+	u64 real_ns = ktime_get_real_fast_ns();
+	write_seqcount_begin(&lockamp->anchor_seq);
+	lockamp->anchor.count = count;
+	/* The producer moves the head (and 'head_seq') afterwards */
+	lockamp->anchor.seq = lockamp->head_seq + lost_n +
+	                      (count - lockamp->signal_buf.head);
+	lockamp->anchor.mono_ns = mono_ns;
+	lockamp->anchor.real_ns = real_ns;
+	if (0 < lost_n) {
+		lockamp->anchor.fifo_lost_n += lost_n;
+		lockamp->anchor.gap_count = count;
+	}
+	write_seqcount_end(&lockamp->anchor_seq);
+}
+
+/*
+ * The PL drops new samples while the FIFO is full. Estimate how many from
+ * the time since the last anchor. We only do so when the FIFO is full.
+ * Otherwise, the jitter of the anchor times would show up as losses.
+ */
+static u32 fifo_lost_n(struct lockamp *lockamp, size_t fifo_size_n)
+{
+	unsigned int time_step_ns = lockamp_time_step_ns(lockamp);
+	u64 produced_n;
+	if (LOCKAMP_FIFO_CAPACITY_N > fifo_size_n || 0 == time_step_ns ||
+	    0 == lockamp->anchor.mono_ns) {
+		return 0;
+	}
+	produced_n = div_u64(ktime_get_mono_fast_ns() - lockamp->anchor.mono_ns,
+	                     time_step_ns);
+	if (produced_n <= fifo_size_n) {
+		return 0;
+	}
+	return min_t(u64, produced_n - fifo_size_n, U32_MAX);
+}
+
+void lockamp_get_anchor(struct lockamp *lockamp, struct lockamp_anchor *anchor)
+{
+	unsigned int seq;
+	do {
+		seq = read_seqcount_begin(&lockamp->anchor_seq);
+		*anchor = lockamp->anchor;
+	} while (read_seqcount_retry(&lockamp->anchor_seq, seq));
 }
 
 size_t lockamp_fifo_move_to_sbuf(struct lockamp *lockamp)
 {
-	size_t i;
-	ptrdiff_t head, tail;
-	size_t bounded_size_n, signal_buf_space_n;
+	u32 head;
+	size_t index;
+	size_t bounded_size_n;
+	size_t remaining_n, chunk_n;
 	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
 	size_t fifo_size_n = lockamp_fifo_size_n(lockamp);
-	size_t sbuf_cap_minus_one = sbuf->capacity_n - 1;
+	u32 lost_n = fifo_lost_n(lockamp, fifo_size_n);
+	/* The PL produces the next sample (the one after the FIFO content)
+	 * right about now. The error is within a single time step. Any
+	 * dropped samples were dropped right before said sample. */
+	lockamp_latch_anchor(lockamp, sbuf->head + fifo_size_n, lost_n);
+	if (0 < lost_n) {
+		atomic_inc(&lockamp->stats.fifo_overruns);
+		atomic64_add(lost_n, &lockamp->stats.fifo_lost_n);
+	}
+	trace_lockamp_fifo_fill(lockamp->dev, fifo_size_n, LOCKAMP_FIFO_CAPACITY_N);
+	lockamp_stats_fifo_fill(lockamp, fifo_size_n);
+	/* Data loss may be imminent */
 	if (fifo_size_n > LOCKAMP_FIFO_CAPACITY_N * 3 / 4) {
-		/* Note that these 'print statements' are slow. May take 5-10 ms. */
-		dev_warn_ratelimited(lockamp->dev, "FIFO is over 3/4 filled (%d/%d). Data loss may be imminent.\n",
-									  fifo_size_n, LOCKAMP_FIFO_CAPACITY_N);
+		atomic_inc(&lockamp->stats.fifo_high);
 	}
 
+	/* We never wait for the readers. Slow readers detect that we overwrote
+	 * their samples on their own. */
+	bounded_size_n = min(fifo_size_n, sbuf->capacity_n);
 	head = sbuf->head;
-	tail = READ_ONCE(sbuf->tail);
-	signal_buf_space_n = CIRC_SPACE(head, tail, sbuf->capacity_n);
-
-	if (0 == signal_buf_space_n) {
-		atomic_inc(&lockamp->desyncs);
-		/* Note that these 'print statements' are slow. May take 5-10 ms. */
-		dev_warn_ratelimited(lockamp->dev, "Data loss. There is no more space in the signal buffer.\n");
-	}
+	lockamp_sbuf_reserve(sbuf, head + bounded_size_n);
 
-	bounded_size_n = min(signal_buf_space_n, fifo_size_n);
-	for (i = 0; bounded_size_n != i; ++i) {
-		lockamp_fifo_pop_sample(lockamp, &sbuf->buf[head]);
-		head = (head + 1) & sbuf_cap_minus_one;
+	/* At most two contiguous chunks: Until the end of the signal buffer and
+	 * from the start of the signal buffer. */
+	remaining_n = bounded_size_n;
+	while (0 < remaining_n) {
+		index = lockamp_sbuf_index(sbuf, head);
+		chunk_n = min_t(size_t, remaining_n, sbuf->capacity_n - index);
+		lockamp_fifo_pop_bulk(lockamp, &sbuf->buf[index], chunk_n);
+		head += chunk_n;
+		remaining_n -= chunk_n;
 	}
+	lockamp_sbuf_filter(lockamp, sbuf->head, bounded_size_n);
+	lockamp->head_seq += lost_n + bounded_size_n;
 	smp_store_release(&sbuf->head, head);
 
 	return bounded_size_n;
 }
+
+#ifdef CONFIG_SBT_LOCKAMP_FIFO_BENCHMARK
+/* Raw read (not through regmap)
+ *
+ * Time each of the FIFO pop and multiplication variants. The popped samples
+ * are discarded. */
+int lockamp_fifo_benchmark(struct lockamp *lockamp,
+                           struct lockamp_fifo_benchmark *result)
+{
+	static const int multipliers[LOCKAMP_SITES_PER_SAMPLE] = { -1, -1 };
+	struct sample *s;
+	size_t i;
+	u64 start;
+	s = kmalloc_array(LOCKAMP_FIFO_BENCHMARK_N, sizeof(struct sample), GFP_KERNEL);
+	if (NULL == s) {
+		return -ENOMEM;
+	}
+	/* One sample at a time */
+	start = ktime_get_ns();
+	for (i = 0; LOCKAMP_FIFO_BENCHMARK_N != i; ++i) {
+		lockamp_fifo_pop_sample(lockamp, &s[i]);
+	}
+	result->pop_sample_ns = ktime_get_ns() - start;
+	/* Burst reads only */
+	start = ktime_get_ns();
+	lockamp_fifo_pop_rep(lockamp, (s32 *)s,
+	                     LOCKAMP_FIFO_BENCHMARK_N * LOCKAMP_ENTRIES_PER_SAMPLE);
+	result->pop_rep_ns = ktime_get_ns() - start;
+	/* Multiplication */
+	start = ktime_get_ns();
+	lockamp_apply_multipliers_scalar(multipliers, s, LOCKAMP_FIFO_BENCHMARK_N);
+	result->multiply_scalar_ns = ktime_get_ns() - start;
+	start = ktime_get_ns();
+	lockamp_apply_multipliers_fast(multipliers, s, LOCKAMP_FIFO_BENCHMARK_N);
+	result->multiply_fast_ns = ktime_get_ns() - start;
+	kfree(s);
+	/* The FIFO content is gone. Let the reader know. */
+	atomic_inc(&lockamp->desyncs);
+	return 0;
+}
+#endif
@@ -8,15 +8,18 @@
 #define _LOCKAMP_HW_H_
 
 #include <asm/io.h>
+#include <linux/math64.h>
 #include <linux/platform_device.h>
 
 #include "lockin_amplifier.h"
+#include "sim.h"
 
 #define LOCKAMP_REG_VERSION         0x000
 #define LOCKAMP_REG_FIFO_SIZE       0x004
 #define LOCKAMP_REG_FIFO_DATA       0x008
 #define LOCKAMP_REG_GEN1_SCALE      0x00C
 #define LOCKAMP_REG_GEN2_SCALE      0x038 /* Note the jump in address */
+#define LOCKAMP_REG_FIFO_THRESHOLD  0x03C
 #define LOCKAMP_REG_ADC_BUFFER      0x010
 /* Registers 0x014 to 0x027 (both inclusive) are deprecated */
 #define LOCKAMP_REG_DAC_DATA_BITS   0x028
@@ -41,11 +44,21 @@
 
 #define LOCKAMP_REG_FIR_COEF_BASE   0x800
 
-/* Corresponding to 125 MHz */
+/* Corresponding to 125 MHz. The nominal period of the input clock. */
 #define LOCKAMP_BASE_TIME_STEP      8
+#define LOCKAMP_FSEC_PER_NSEC       1000000
 #define LOCKAMP_GEN_SCALE_MIN       0
 /* s18 max */
 #define LOCKAMP_GEN_SCALE_MAX       131071
+/* Valid filter settings */
+#define LOCKAMP_MA_LENGTH_MIN       2
+#define LOCKAMP_MA_LENGTH_MAX       255
+#define LOCKAMP_CIC_LENGTH_MIN      2
+#define LOCKAMP_CIC_LENGTH_MAX      4095
+#define LOCKAMP_MA_SCALE_MIN        1
+#define LOCKAMP_MA_SCALE_MAX        7
+#define LOCKAMP_CIC_SCALE_MIN       1
+#define LOCKAMP_CIC_SCALE_MAX       63
 
 struct lockamp_gen_control
 {
@@ -68,6 +81,11 @@ static inline int lockamp_version(struct lockamp *lockamp, u32 *value)
 /* Raw read (not through regmap) */
 static inline u32 lockamp_fifo_size_s32(struct lockamp *lockamp)
 {
+#ifdef CONFIG_SBT_LOCKAMP_SIM
+	if (unlikely(lockamp->sim)) {
+		return lockamp_sim_fifo_size_s32(lockamp);
+	}
+#endif
 	return ioread32(lockamp->control + LOCKAMP_REG_FIFO_SIZE);
 }
 
@@ -259,10 +277,41 @@ static inline int lockamp_set_fir_cycles(struct lockamp *lockamp, u32 value)
 	return regmap_write(lockamp->regmap, LOCKAMP_REG_FIR_CYCLES, value);
 }
 
+/* The FIFO threshold (watermark) is given in s32 entries. The PL asserts the
+ * FIFO interrupt while the FIFO size is at or above the threshold. A threshold
+ * of zero disables the interrupt. */
+static inline int lockamp_get_fifo_threshold_n(struct lockamp *lockamp, u32 *value)
+{
+	int ret = regmap_read(lockamp->regmap, LOCKAMP_REG_FIFO_THRESHOLD, value);
+	if (ret < 0) {
+		return ret;
+	}
+	*value /= LOCKAMP_ENTRIES_PER_SAMPLE;
+	return 0;
+}
+
+static inline int lockamp_set_fifo_threshold_n(struct lockamp *lockamp, u32 value)
+{
+	return regmap_write(lockamp->regmap, LOCKAMP_REG_FIFO_THRESHOLD,
+	                    value * LOCKAMP_ENTRIES_PER_SAMPLE);
+}
+
+static inline bool lockamp_valid_decimation(u32 value)
+{
+	return 1 == value || 2 == value || 4 == value || 8 == value || 16 == value;
+}
+
+/* The FIR filter must finish within the (decimated) sample period */
+static inline u32 lockamp_decimation_fir_cycles(u32 hb_filters)
+{
+	return min(511, 341 * (1 << hb_filters) / 8 - 6);
+}
+
 int lockamp_get_decimation(struct lockamp *lockamp, u32 *value);
 int lockamp_set_decimation(struct lockamp *lockamp, u32 value);
 
-static inline int lockamp_get_time_step_ns(struct lockamp *lockamp, unsigned int *value)
+/* Reads the registers. Use 'lockamp_time_step_ns' in the hot path. */
+static inline int lockamp_read_cycles_n(struct lockamp *lockamp, u32 *value)
 {
 	int ret;
 	u32 cic_length;
@@ -280,32 +329,65 @@ static inline int lockamp_get_time_step_ns(struct lockamp *lockamp, unsigned int
 	 *   2) The length of the CIC filter
 	 *   3) The number of half band filters (indirectly, the so-called
 	 *      decimation factor).
+	 * This is the product of the latter two. See 'lockamp_update_timing'
+	 * for the first.
 	 */
-	*value = LOCKAMP_BASE_TIME_STEP * cic_length * decimation;
+	*value = cic_length * decimation;
 	return 0;
 }
 
-static inline int lockamp_get_duration_ns(struct lockamp *lockamp, size_t size_n, u64 *value)
+extern int lockamp_timing_init(struct lockamp *lockamp);
+extern int lockamp_update_timing(struct lockamp *lockamp);
+
+/* The derived timing (see 'lockamp_update_timing') is read without any
+ * register access. */
+static inline unsigned int lockamp_time_step_ns(struct lockamp *lockamp)
 {
-	unsigned int time_step_ns;
-	int ret = lockamp_get_time_step_ns(lockamp, &time_step_ns);
-	if (ret < 0) {
-		return ret;
+	return READ_ONCE(lockamp->timing.time_step_ns);
+}
+
+/* The unrounded time step */
+static inline u64 lockamp_time_step_fs(struct lockamp *lockamp)
+{
+	unsigned int seq;
+	u64 step_fs;
+	do {
+		seq = read_seqbegin(&lockamp->timing.lock);
+		step_fs = (u64)lockamp->timing.base_time_step_fs *
+		          lockamp->timing.cycles_n;
+	} while (read_seqretry(&lockamp->timing.lock, seq));
+	return step_fs;
+}
+
+/* Exact (not based on the rounded 'time_step_ns'). Thus, it follows the
+ * measured rate of the input clock down to a fraction of a ppb. */
+static inline u64 lockamp_duration_ns(struct lockamp *lockamp, size_t size_n)
+{
+	unsigned int seq;
+	u64 step;
+	do {
+		seq = read_seqbegin(&lockamp->timing.lock);
+		step = lockamp->timing.time_step_q32;
+	} while (read_seqretry(&lockamp->timing.lock, seq));
+	return (u64)size_n * (step >> 32) + mul_u64_u32_shr(size_n, (u32)step, 32);
+}
+
+/* The time (ns since the epoch) of the sample with the given count. Based
+ * on the latest anchor. Call with 'signal_buf_m' held. */
+static inline u64 lockamp_count_real_ns(struct lockamp *lockamp, u32 count)
+{
+	struct lockamp_anchor *anchor = &lockamp->anchor;
+	s32 before_n = anchor->count - count;
+	if (0 <= before_n) {
+		return anchor->real_ns - lockamp_duration_ns(lockamp, before_n);
 	}
-	*value = time_step_ns * size_n;
-	return 0;
+	return anchor->real_ns + lockamp_duration_ns(lockamp, -before_n);
 }
 
 /* The time it takes to read half of the FIFO. */
-static inline int lockamp_get_read_delay_ns(struct lockamp *lockamp, unsigned long *value)
+static inline unsigned long lockamp_read_delay_ns(struct lockamp *lockamp)
 {
-	unsigned int time_step_ns;
-	int ret = lockamp_get_time_step_ns(lockamp, &time_step_ns);
-	if (ret < 0) {
-		return ret;
-	}
-	*value = LOCKAMP_FIFO_CAPACITY_N / 2 * time_step_ns;
-	return 0;
+	return READ_ONCE(lockamp->timing.read_delay_ns);
 }
 
 static inline int lockamp_reset_ma_filter(struct lockamp *lockamp)
@@ -328,6 +410,13 @@ static inline int lockamp_reset_ma_filter(struct lockamp *lockamp)
 /* Raw read (not through regmap) */
 static inline s32 lockamp_fifo_pop(struct lockamp *lockamp)
 {
+#ifdef CONFIG_SBT_LOCKAMP_SIM
+	s32 value;
+	if (unlikely(lockamp->sim)) {
+		lockamp_sim_fifo_pop_rep(lockamp, &value, 1);
+		return value;
+	}
+#endif
 #ifdef CONFIG_SBT_LOCKAMP_FIFO_POP_RELAXED
 	return readl_relaxed(lockamp->control + LOCKAMP_REG_FIFO_DATA);
 #else
@@ -340,6 +429,12 @@ static __maybe_unused inline s32 lockamp_fifo_pop_dbg(struct lockamp *lockamp)
 {
 	u32 raw;
 	s32 ret; /* signed, so that right-shifts will be arithmetic */
+#ifdef CONFIG_SBT_LOCKAMP_SIM
+	if (unlikely(lockamp->sim)) {
+		lockamp_sim_fifo_pop_rep(lockamp, &ret, 1);
+		return ret;
+	}
+#endif
 #ifdef CONFIG_SBT_LOCKAMP_FIFO_POP_RELAXED
 	raw = readl_relaxed(lockamp->control + LOCKAMP_REG_FIFO_DATA);
 #else
@@ -376,7 +471,55 @@ static inline void lockamp_fifo_pop_sample(struct lockamp *lockamp, struct sampl
 	}
 }
 
+/* Raw read (not through regmap)
+ *
+ * Pop 'count' s32 entries in one go. On ARM, ioread32_rep is an unrolled
+ * loop of 'ldr' (from the FIFO) and 'stmia' (to memory). Furthermore, it is
+ * relaxed so there is no barrier between the reads. */
+static inline void lockamp_fifo_pop_rep(struct lockamp *lockamp, s32 *dst,
+                                        size_t count)
+{
+#ifdef CONFIG_SBT_LOCKAMP_SIM
+	if (unlikely(lockamp->sim)) {
+		lockamp_sim_fifo_pop_rep(lockamp, dst, count);
+		return;
+	}
+#endif
+	ioread32_rep(lockamp->control + LOCKAMP_REG_FIFO_DATA, dst, count);
+#ifndef CONFIG_SBT_LOCKAMP_FIFO_POP_RELAXED
+	/* Order the FIFO reads before later memory accesses (like ioread32) */
+	rmb();
+#endif
+}
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+/* See neon.c */
+void lockamp_apply_multipliers_neon(int32_t *data, unsigned long size_n,
+                                    int32_t multiplier0, int32_t multiplier1);
+#endif
+
+extern void lockamp_apply_multipliers(struct lockamp *lockamp, struct sample *s,
+                                      size_t size_n);
+extern void lockamp_fifo_pop_bulk(struct lockamp *lockamp, struct sample *s,
+                                  size_t size_n);
+extern void lockamp_latch_anchor(struct lockamp *lockamp, u32 count, u32 lost_n);
+extern void lockamp_get_anchor(struct lockamp *lockamp, struct lockamp_anchor *anchor);
 extern size_t lockamp_fifo_move_to_sbuf(struct lockamp *lockamp);
+
+#ifdef CONFIG_SBT_LOCKAMP_FIFO_BENCHMARK
+#define LOCKAMP_FIFO_BENCHMARK_N 1024
+
+/* Durations in ns for LOCKAMP_FIFO_BENCHMARK_N samples */
+struct lockamp_fifo_benchmark {
+	u64 pop_sample_ns;
+	u64 pop_rep_ns;
+	u64 multiply_scalar_ns;
+	u64 multiply_fast_ns;
+};
+
+extern int lockamp_fifo_benchmark(struct lockamp *lockamp,
+                                  struct lockamp_fifo_benchmark *result);
+#endif
 extern int lockamp_set_fir_coefs(struct lockamp *lockamp, const s32 *coefs);
 extern void lockamp_get_adc_samples(struct lockamp *lockamp, s32 *adc_samples);
 
@@ -0,0 +1,333 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/iio/buffer.h>
+#include <linux/iio/buffer_impl.h>
+#include <linux/iio/buffer-dma.h>
+#include <linux/iio/iio.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+
+#include "hw.h"
+#include "iio.h"
+
+/*
+ * IIO frontend
+ *
+ * Exposes the signal buffer as an IIO device with a block-based DMA buffer
+ * (see industrialio-buffer-dma.c). The scan elements are the fields of
+ * 'struct site_sample' for each site. Thus, a scan is a 'struct sample'.
+ *
+ * The IIO buffer is yet another reader of the signal buffer. It has its own
+ * tail. Every time the producer drains the FIFO, we copy complete blocks
+ * from the signal buffer into the blocks that the IIO core submitted. We
+ * never copy partial blocks so that a block is either free or done.
+ */
+
+struct lockamp_iio_buffer {
+	struct iio_dma_buffer_queue queue;
+	struct lockamp *lockamp;
+	/* Submitted blocks. Protected by 'queue.list_lock'. */
+	struct list_head active;
+};
+
+struct lockamp_iio {
+	struct lockamp *lockamp;
+	struct iio_dev *indio_dev;
+	struct lockamp_iio_buffer *buffer;
+	/* Protected by the signal buffer mutex */
+	bool enabled;
+	u32 tail;
+};
+
+static struct lockamp_iio_buffer *to_lockamp_iio_buffer(struct iio_buffer *buffer)
+{
+	return container_of(buffer, struct lockamp_iio_buffer, queue.buffer);
+}
+
+/* The IIO core holds 'queue.lock' */
+static int lockamp_iio_submit_block(struct iio_dma_buffer_queue *queue,
+                                    struct iio_dma_buffer_block *block)
+{
+	struct lockamp_iio_buffer *buffer = to_lockamp_iio_buffer(&queue->buffer);
+	spin_lock_irq(&queue->list_lock);
+	list_add_tail(&block->head, &buffer->active);
+	spin_unlock_irq(&queue->list_lock);
+	return 0;
+}
+
+static void lockamp_iio_abort(struct iio_dma_buffer_queue *queue)
+{
+	struct lockamp_iio_buffer *buffer = to_lockamp_iio_buffer(&queue->buffer);
+	struct lockamp *lockamp = buffer->lockamp;
+	/* Wait for 'lockamp_iio_push' to finish the block it is working on */
+	mutex_lock(&lockamp->signal_buf_m);
+	iio_dma_buffer_block_list_abort(queue, &buffer->active);
+	mutex_unlock(&lockamp->signal_buf_m);
+}
+
+static void lockamp_iio_buffer_release(struct iio_buffer *iio_buffer)
+{
+	struct lockamp_iio_buffer *buffer = to_lockamp_iio_buffer(iio_buffer);
+	iio_dma_buffer_release(&buffer->queue);
+	kfree(buffer);
+}
+
+static const struct iio_buffer_access_funcs lockamp_iio_buffer_access = {
+	.read_first_n = iio_dma_buffer_read,
+	.set_bytes_per_datum = iio_dma_buffer_set_bytes_per_datum,
+	.set_length = iio_dma_buffer_set_length,
+	.request_update = iio_dma_buffer_request_update,
+	.enable = iio_dma_buffer_enable,
+	.disable = iio_dma_buffer_disable,
+	.data_available = iio_dma_buffer_data_available,
+	.release = lockamp_iio_buffer_release,
+	.alloc_blocks = iio_dma_buffer_alloc_blocks,
+	.free_blocks = iio_dma_buffer_free_blocks,
+	.query_block = iio_dma_buffer_query_block,
+	.enqueue_block = iio_dma_buffer_enqueue_block,
+	.dequeue_block = iio_dma_buffer_dequeue_block,
+	.mmap = iio_dma_buffer_mmap,
+
+	.modes = INDIO_BUFFER_HARDWARE,
+	.flags = INDIO_BUFFER_FLAG_FIXED_WATERMARK,
+};
+
+static const struct iio_dma_buffer_ops lockamp_iio_dma_buffer_ops = {
+	.submit = lockamp_iio_submit_block,
+	.abort = lockamp_iio_abort,
+};
+
+/* Copy 'count' samples from the signal buffer (starting at 'tail') */
+static void copy_from_sbuf(struct circ_sample_buf *sbuf, struct sample *dst,
+                           u32 tail, size_t count)
+{
+	size_t index;
+	size_t chunk_n;
+	while (0 < count) {
+		index = lockamp_sbuf_index(sbuf, tail);
+		chunk_n = min_t(size_t, count, sbuf->capacity_n - index);
+		memcpy(dst, &sbuf->buf[index], chunk_n * sizeof(struct sample));
+		dst += chunk_n;
+		tail += chunk_n;
+		count -= chunk_n;
+	}
+}
+
+/*
+ * Move complete blocks from the signal buffer to the IIO core
+ *
+ * Called by the producer with the signal buffer mutex held.
+ */
+void lockamp_iio_push(struct lockamp *lockamp)
+{
+	struct lockamp_iio *iio = lockamp->iio;
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct iio_dma_buffer_queue *queue;
+	struct iio_dma_buffer_block *block;
+	u32 oldest;
+	size_t block_n;
+	if (NULL == iio || !iio->enabled) {
+		return;
+	}
+	queue = &iio->buffer->queue;
+	/* Like the character device readers, we lose the overwritten samples */
+	oldest = sbuf->reserve - sbuf->capacity_n;
+	if ((s32)(iio->tail - oldest) < 0) {
+		atomic_inc(&lockamp->stats.overruns);
+		atomic64_add(oldest - iio->tail, &lockamp->stats.lost_n);
+		iio->tail = oldest;
+	}
+	for (;;) {
+		spin_lock_irq(&queue->list_lock);
+		block = list_first_entry_or_null(&iio->buffer->active,
+		                                 struct iio_dma_buffer_block, head);
+		if (NULL == block) {
+			spin_unlock_irq(&queue->list_lock);
+			return;
+		}
+		/* Leave room for the producer. Otherwise, the block may never
+		 * fill up. */
+		block_n = min_t(size_t, block->size / sizeof(struct sample),
+		                sbuf->capacity_n / 2);
+		if (sbuf->head - iio->tail < block_n) {
+			spin_unlock_irq(&queue->list_lock);
+			return;
+		}
+		list_del(&block->head);
+		spin_unlock_irq(&queue->list_lock);
+		copy_from_sbuf(sbuf, block->vaddr, iio->tail, block_n);
+		block->bytes_used = block_n * sizeof(struct sample);
+		iio->tail += block_n;
+		iio_dma_buffer_block_done(block);
+	}
+}
+
+static int lockamp_iio_postenable(struct iio_dev *indio_dev)
+{
+	struct lockamp_iio *iio = iio_priv(indio_dev);
+	struct lockamp *lockamp = iio->lockamp;
+	int ret = lockamp_drain_get(lockamp);
+	if (ret < 0) {
+		return ret;
+	}
+	/* Start with the newest sample */
+	mutex_lock(&lockamp->signal_buf_m);
+	iio->tail = lockamp->signal_buf.head;
+	iio->enabled = true;
+	mutex_unlock(&lockamp->signal_buf_m);
+	return 0;
+}
+
+static int lockamp_iio_predisable(struct iio_dev *indio_dev)
+{
+	struct lockamp_iio *iio = iio_priv(indio_dev);
+	struct lockamp *lockamp = iio->lockamp;
+	mutex_lock(&lockamp->signal_buf_m);
+	iio->enabled = false;
+	mutex_unlock(&lockamp->signal_buf_m);
+	return 0;
+}
+
+/* After the abort. The device may suspend when we stop the drain. */
+static int lockamp_iio_postdisable(struct iio_dev *indio_dev)
+{
+	struct lockamp_iio *iio = iio_priv(indio_dev);
+	lockamp_drain_put(iio->lockamp);
+	return 0;
+}
+
+static const struct iio_buffer_setup_ops lockamp_iio_setup_ops = {
+	.postenable = lockamp_iio_postenable,
+	.predisable = lockamp_iio_predisable,
+	.postdisable = lockamp_iio_postdisable,
+};
+
+static int lockamp_iio_read_raw(struct iio_dev *indio_dev,
+                                struct iio_chan_spec const *chan,
+                                int *val, int *val2, long mask)
+{
+	struct lockamp_iio *iio = iio_priv(indio_dev);
+	unsigned int time_step_ns;
+	switch (mask) {
+	case IIO_CHAN_INFO_SAMP_FREQ:
+		time_step_ns = lockamp_time_step_ns(iio->lockamp);
+		if (0 == time_step_ns) {
+			return -EINVAL;
+		}
+		*val = NSEC_PER_SEC;
+		*val2 = time_step_ns;
+		return IIO_VAL_FRACTIONAL;
+	default:
+		return -EINVAL;
+	}
+}
+
+static const struct iio_info lockamp_iio_info = {
+	.read_raw = lockamp_iio_read_raw,
+};
+
+#define LOCKAMP_IIO_CHAN(_site, _field, _index) {                      \
+	.type = IIO_VOLTAGE,                                             \
+	.indexed = 1,                                                    \
+	.channel = _site,                                                \
+	.extend_name = #_field,                                          \
+	.info_mask_shared_by_all = BIT(IIO_CHAN_INFO_SAMP_FREQ),         \
+	.scan_index = _index,                                            \
+	.scan_type = {                                                   \
+		.sign = 's',                                             \
+		.realbits = 32,                                          \
+		.storagebits = 32,                                       \
+		.endianness = IIO_CPU,                                   \
+	},                                                               \
+}
+
+/* In the order of 'struct sample' */
+static const struct iio_chan_spec lockamp_iio_channels[] = {
+	LOCKAMP_IIO_CHAN(0, hf_re, 0),
+	LOCKAMP_IIO_CHAN(0, hf_im, 1),
+	LOCKAMP_IIO_CHAN(0, lf_re, 2),
+	LOCKAMP_IIO_CHAN(0, lf_im, 3),
+	LOCKAMP_IIO_CHAN(1, hf_re, 4),
+	LOCKAMP_IIO_CHAN(1, hf_im, 5),
+	LOCKAMP_IIO_CHAN(1, lf_re, 6),
+	LOCKAMP_IIO_CHAN(1, lf_im, 7),
+};
+_Static_assert (LOCKAMP_ENTRIES_PER_SAMPLE == ARRAY_SIZE(lockamp_iio_channels), "IIO channels do not match 'struct sample'");
+
+/* We always move whole samples. Thus, the active scan always contains all
+ * channels. */
+static const unsigned long lockamp_iio_scan_masks[] = {
+	GENMASK(LOCKAMP_ENTRIES_PER_SAMPLE - 1, 0),
+	0,
+};
+
+int lockamp_iio_init(struct lockamp *lockamp, struct platform_device *pdev)
+{
+	int ret;
+	struct iio_dev *indio_dev;
+	struct lockamp_iio *iio;
+	struct lockamp_iio_buffer *buffer;
+	indio_dev = iio_device_alloc(sizeof(*iio));
+	if (NULL == indio_dev) {
+		return -ENOMEM;
+	}
+	iio = iio_priv(indio_dev);
+	iio->lockamp = lockamp;
+	iio->indio_dev = indio_dev;
+	indio_dev->dev.parent = &pdev->dev;
+	indio_dev->name = dev_name(lockamp->dev);
+	indio_dev->info = &lockamp_iio_info;
+	indio_dev->modes = INDIO_BUFFER_HARDWARE;
+	indio_dev->channels = lockamp_iio_channels;
+	indio_dev->num_channels = ARRAY_SIZE(lockamp_iio_channels);
+	indio_dev->available_scan_masks = lockamp_iio_scan_masks;
+	indio_dev->setup_ops = &lockamp_iio_setup_ops;
+
+	buffer = kzalloc(sizeof(*buffer), GFP_KERNEL);
+	if (NULL == buffer) {
+		ret = -ENOMEM;
+		goto out_device;
+	}
+	buffer->lockamp = lockamp;
+	INIT_LIST_HEAD(&buffer->active);
+	/* The blocks are filled by the CPU. Any device will do for the
+	 * allocation of the block memory. */
+	iio_dma_buffer_init(&buffer->queue, &pdev->dev, &lockamp_iio_dma_buffer_ops);
+	buffer->queue.buffer.access = &lockamp_iio_buffer_access;
+	iio->buffer = buffer;
+	iio_device_attach_buffer(indio_dev, &buffer->queue.buffer);
+
+	ret = iio_device_register(indio_dev);
+	if (ret < 0) {
+		goto out_buffer;
+	}
+	lockamp->iio = iio;
+	return 0;
+
+out_buffer:
+	iio_dma_buffer_exit(&buffer->queue);
+	iio_buffer_put(&buffer->queue.buffer);
+out_device:
+	iio_device_free(indio_dev);
+	return ret;
+}
+
+void lockamp_iio_remove(struct lockamp *lockamp)
+{
+	struct lockamp_iio *iio = lockamp->iio;
+	struct lockamp_iio_buffer *buffer;
+	if (NULL == iio) {
+		return;
+	}
+	buffer = iio->buffer;
+	lockamp->iio = NULL;
+	iio_device_unregister(iio->indio_dev);
+	iio_dma_buffer_exit(&buffer->queue);
+	iio_buffer_put(&buffer->queue.buffer);
+	/* Also drops the reference that the IIO device has to the buffer */
+	iio_device_free(iio->indio_dev);
+}
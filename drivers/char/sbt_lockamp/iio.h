@@ -0,0 +1,31 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_IIO_H_
+#define _LOCKAMP_IIO_H_
+
+#include <linux/platform_device.h>
+
+#include "lockin_amplifier.h"
+
+#ifdef CONFIG_SBT_LOCKAMP_IIO
+extern int lockamp_iio_init(struct lockamp *lockamp, struct platform_device *pdev);
+extern void lockamp_iio_remove(struct lockamp *lockamp);
+extern void lockamp_iio_push(struct lockamp *lockamp);
+#else
+static inline int lockamp_iio_init(struct lockamp *lockamp, struct platform_device *pdev)
+{
+	return 0;
+}
+static inline void lockamp_iio_remove(struct lockamp *lockamp)
+{
+}
+static inline void lockamp_iio_push(struct lockamp *lockamp)
+{
+}
+#endif
+
+#endif
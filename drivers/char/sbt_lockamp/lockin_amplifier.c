@@ -6,17 +6,34 @@
  */
 #include <linux/fs.h>
 #include <linux/gpio/consumer.h>
+#include <linux/idr.h>
 #include <linux/iio/consumer.h>
-#include <linux/log2.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
 #include <linux/module.h>
 #include <linux/mod_devicetable.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
 #include <linux/slab.h>
 
+#include "amp.h"
+#include "capture.h"
+#include "clock.h"
+#include "dma.h"
+#include "fir.h"
 #include "hw.h"
+#include "adc.h"
+#include "iio.h"
+#include "monitor.h"
+#include "pm.h"
+#include "sbuf.h"
+#include "sim.h"
+#include "stats.h"
 
 static struct class *lockamp_class;
+/* All instances share a single region. Each instance gets a minor. */
+static dev_t lockamp_devt;
+static DEFINE_IDA(lockamp_ida);
 
 static int lockamp_get_iio_chans(struct lockamp *lockamp,
                                  struct platform_device *pdev)
@@ -97,6 +114,49 @@ static int lockamp_get_io_resources(struct lockamp *lockamp,
 	return 0;
 }
 
+static int lockamp_get_fifo_irq(struct lockamp *lockamp,
+                                struct platform_device *pdev)
+{
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+	const char *irq_name;
+	int ret;
+	lockamp->irq = 0;
+	ret = platform_get_irq_optional(pdev, 0);
+	if (-EPROBE_DEFER == ret) {
+		return ret;
+	}
+	/* Without an interrupt, we fall back to polling in a kthread */
+	if (ret <= 0) {
+		dev_info(lockamp->dev, "No FIFO interrupt. Will poll the FIFO.\n");
+		return lockamp_set_fifo_threshold_n(lockamp, 0);
+	}
+	lockamp->irq = ret;
+	/* Default to half of the FIFO (like the polling kthread) */
+	ret = lockamp_set_fifo_threshold_n(lockamp, LOCKAMP_FIFO_CAPACITY_N / 2);
+	if (ret < 0) {
+		return ret;
+	}
+	/* One per instance in /proc/interrupts */
+	irq_name = devm_kasprintf(&pdev->dev, GFP_KERNEL, "lockamp%d-fifo", lockamp->id);
+	if (NULL == irq_name) {
+		return -ENOMEM;
+	}
+	/* The interrupt is enabled when the character device is opened */
+	irq_set_status_flags(lockamp->irq, IRQ_NOAUTOEN);
+	ret = devm_request_threaded_irq(&pdev->dev, lockamp->irq,
+	                                lockamp_fifo_hardirq,
+	                                lockamp_fifo_irq, IRQF_ONESHOT,
+	                                irq_name, lockamp);
+	if (ret < 0) {
+		lockamp->irq = 0;
+		return ret;
+	}
+#else
+	lockamp->irq = 0;
+#endif
+	return 0;
+}
+
 static bool lockamp_reg_gap(struct device *dev, unsigned int reg) {
 	if (LOCKAMP_REG_GEN2_LOCK_PHASE < reg && reg < LOCKAMP_REG_DEBUG0) {
 		return true;
@@ -133,6 +193,10 @@ static bool lockamp_volatile_reg(struct device *dev, unsigned int reg)
 	case LOCKAMP_REG_ADC_BUFFER:
 		return true;
 	}
+	/* Written in bulk without regmap. See 'lockamp_set_fir_coefs'. */
+	if (LOCKAMP_REG_FIR_COEF_BASE <= reg) {
+		return true;
+	}
 	return false;
 }
 
@@ -151,9 +215,19 @@ static struct regmap_config lockamp_regmap_config = {
 	.volatile_reg         = lockamp_volatile_reg,
 };
 
+static void lockamp_free_sbuf(struct lockamp *lockamp)
+{
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+	lockamp_sbuf_release(lockamp);
+#endif
+	lockamp_dma_release(lockamp);
+	lockamp_amp_release(lockamp);
+}
+
 static int lockamp_probe(struct platform_device *pdev)
 {
 	struct lockamp *lockamp;
+	bool sim = lockamp_is_sim(pdev);
 	u32 version;
 	int i;
 	int ret = 0;
@@ -165,8 +239,11 @@ static int lockamp_probe(struct platform_device *pdev)
 	lockamp->dev = &pdev->dev;
 	platform_set_drvdata(pdev, lockamp);
 
-	/* Reset GPIO */
-	lockamp->reset = devm_gpiod_get(&pdev->dev, "reset", GPIOD_OUT_LOW);
+	/* Reset GPIO (the simulated hardware has none) */
+	lockamp->reset = NULL;
+	if (!sim) {
+		lockamp->reset = devm_gpiod_get(&pdev->dev, "reset", GPIOD_OUT_LOW);
+	}
 	if (IS_ERR(lockamp->reset)) {
 		dev_err(&pdev->dev, "Failed to get reset GPIO: %ld.\n",
 		        PTR_ERR(lockamp->reset));
@@ -179,37 +256,66 @@ static int lockamp_probe(struct platform_device *pdev)
 	/* Init mutexes */
 	mutex_init(&lockamp->signal_buf_m);
 	mutex_init(&lockamp->adc_buf_m);
+	mutex_init(&lockamp->readers_m);
+	mutex_init(&lockamp->fir_m);
+	mutex_init(&lockamp->config_m);
+	lockamp_pm_prewarm_init(lockamp);
+	INIT_LIST_HEAD(&lockamp->fir_sets);
+	lockamp->reader_count = 0;
+	init_waitqueue_head(&lockamp->read_wq);
+	seqcount_init(&lockamp->anchor_seq);
+	seqcount_init(&lockamp->filter_seq);
+	lockamp->timestamp_mode = LOCKAMP_TIMESTAMP_EXTRAPOLATED;
+	lockamp->chunk_header_version = 1;
+	lockamp->output_mask = LOCKAMP_OUTPUT_MASK_ALL;
+	lockamp->output_entry = LOCKAMP_OUTPUT_S32;
+	lockamp->read_low_watermark_n = 0;
+	lockamp->drain_cpu = -1;
+	lockamp->drain_policy = LOCKAMP_DRAIN_FIFO;
+	lockamp->drain_min_freq_khz = 0;
+	cpufreq_latency_req_init(&lockamp->drain_freq_req);
+	lockamp_stats_init(lockamp);
 
 	/* Signal buffer */
 #ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
-	lockamp->signal_buf.buf = vmalloc(LOCKAMP_SIGNAL_BUF_CAPACITY);
-	lockamp->signal_buf.capacity_n = LOCKAMP_SIGNAL_BUF_CAPACITY / sizeof(struct sample);
-	lockamp->signal_buf.head = 0;
-	lockamp->signal_buf.tail = 0;
-	if (NULL == lockamp->signal_buf.buf) {
-		dev_err(lockamp->dev, "Failed to allocate signal buffer.\n");
-		return -ENOMEM;
+	/* The simulated hardware has no DMA */
+	lockamp->dma_chan = NULL;
+	ret = (sim) ? 0 : lockamp_dma_init(lockamp, pdev);
+	if (ret < 0) {
+		if (-EPROBE_DEFER != ret) {
+			dev_err(lockamp->dev, "Failed to initialize DMA: %d\n", ret);
+		}
+		return ret;
+	}
+	ret = (sim) ? 0 : lockamp_amp_init(lockamp, pdev);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to initialize the AMP drain: %d\n", ret);
+		goto out_sbuf;
 	}
-	/* Must be a power of 2 so that the CIRC_* macros work */
-	if (!is_power_of_2(lockamp->signal_buf.capacity_n)) {
-		dev_err(lockamp->dev, "Signal buffer capacity must be a power of 2 (tried with %d).\n",
-		        lockamp->signal_buf.capacity_n);
-		ret = -EINVAL;
+	ret = lockamp_sbuf_init(lockamp, pdev);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to allocate signal buffer: %d\n", ret);
 		goto out_sbuf;
 	}
 #else
+	lockamp->dma_chan = NULL;
+	lockamp->amp = NULL;
 	lockamp->signal_buf.buf = NULL;
 	lockamp->signal_buf.capacity_n = 0;
 	lockamp->signal_buf.head = 0;
-	lockamp->signal_buf.tail = 0;
+	lockamp->signal_buf.reserve = 0;
+	lockamp->mmap_ctrl = NULL;
+	lockamp->mmap_reader = NULL;
 #endif
 
 	/* Dev (device number) */
-	ret = alloc_chrdev_region(&lockamp->chrdev_no, 0, 1, pdev->name);
+	ret = ida_simple_get(&lockamp_ida, 0, LOCKAMP_MAX_DEVICES, GFP_KERNEL);
 	if (ret < 0) {
-		dev_err(lockamp->dev, "Failed to allocate character device region.\n");
+		dev_err(&pdev->dev, "Failed to allocate a minor number: %d\n", ret);
 		goto out_sbuf;
 	}
+	lockamp->id = ret;
+	lockamp->chrdev_no = MKDEV(MAJOR(lockamp_devt), lockamp->id);
 
 	/* Cdev (character device) */
 	cdev_init(&lockamp->cdev, &lockamp_fops);
@@ -232,7 +338,7 @@ static int lockamp_probe(struct platform_device *pdev)
 	dev_set_drvdata(lockamp->dev, lockamp);
 
 	/* I/O resources */
-	ret = lockamp_get_io_resources(lockamp, pdev);
+	ret = (sim) ? lockamp_sim_init(lockamp) : lockamp_get_io_resources(lockamp, pdev);
 	if (ret < 0) {
 		dev_err(lockamp->dev, "Failed to initialize lock-in amplifier.\n");
 		goto out_device;
@@ -241,8 +347,13 @@ static int lockamp_probe(struct platform_device *pdev)
 	/* Vs regulator for the injection amp
 	 *
 	 * We need exclusive ownership of the regulator so that we can enforce
-	 * the "amp_supply_force_off" logic. */
-	lockamp->amp_supply = devm_regulator_get_exclusive(&pdev->dev, "amp");
+	 * the "amp_supply_force_off" logic. The simulated hardware gets a
+	 * dummy regulator (which can't be exclusive). */
+	if (sim) {
+		lockamp->amp_supply = devm_regulator_get(&pdev->dev, "amp");
+	} else {
+		lockamp->amp_supply = devm_regulator_get_exclusive(&pdev->dev, "amp");
+	}
 	if (IS_ERR(lockamp->amp_supply)) {
 		dev_err(lockamp->dev, "Failed to get 'amp' regulator.\n");
 		ret = PTR_ERR(lockamp->amp_supply);
@@ -255,7 +366,7 @@ static int lockamp_probe(struct platform_device *pdev)
 	 * callback. The regmap will be allocated soon after the power is
 	 * turned on. */
 	lockamp->regmap = NULL;
-	pm_runtime_set_autosuspend_delay(&pdev->dev, 3000);
+	pm_runtime_set_autosuspend_delay(&pdev->dev, LOCKAMP_AUTOSUSPEND_DELAY_MS);
 	pm_runtime_use_autosuspend(&pdev->dev);
 	pm_runtime_enable(&pdev->dev);
 	ret = pm_runtime_get_sync(&pdev->dev);
@@ -272,6 +383,11 @@ static int lockamp_probe(struct platform_device *pdev)
 		ret = -ENOMEM;
 		goto out_pm_get;
 	}
+	ret = lockamp_adc_snapshot_init(lockamp);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to allocate adc snapshot buffers.\n");
+		goto out_pm_get;
+	}
 
 	/* Regmap */
 	lockamp->regmap = devm_regmap_init_mmio(lockamp->dev, lockamp->control,
@@ -290,47 +406,115 @@ static int lockamp_probe(struct platform_device *pdev)
 	atomic_set(&lockamp->desyncs, 0);
 
 	/* Set hardware defaults */
-	ret = lockamp_set_fir_coefs(lockamp, lockamp_fir_coefs[0]);
+	ret = lockamp_fir_init(lockamp);
 	if (ret < 0) {
 		dev_err(lockamp->dev, "Failed to set FIR filter coefficients: %d\n", ret);
 		goto out_pm_get;
 	}
 
+	/* Derived timing */
+	ret = lockamp_timing_init(lockamp);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to get the input clock: %d\n", ret);
+		goto out_pm_get;
+	}
+	ret = lockamp_update_timing(lockamp);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to get the timing configuration: %d\n", ret);
+		goto out_pm_get;
+	}
+
+	/* FIFO threshold interrupt */
+	ret = lockamp_get_fifo_irq(lockamp, pdev);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to get FIFO interrupt: %d\n", ret);
+		goto out_pm_get;
+	}
+
 	/* Welcome message */
 	ret = lockamp_version(lockamp, &version);
 	if (ret < 0) {
 		dev_err(lockamp->dev, "Failed to get hardware version: %d\n", ret);
 		goto out_pm_get;
 	}
+
+	/* Monitor device */
+	ret = lockamp_monitor_init(lockamp);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to add monitor device: %d\n", ret);
+		goto out_pm_get;
+	}
+
+	/* Capture device */
+	ret = lockamp_capture_init(lockamp);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to add capture device: %d\n", ret);
+		goto out_monitor;
+	}
+
+	/* Sample clock */
+	ret = lockamp_clock_init(lockamp);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to register sample clock: %d\n", ret);
+		goto out_capture;
+	}
+
+	/* IIO frontend */
+	ret = lockamp_iio_init(lockamp, pdev);
+	if (ret < 0) {
+		dev_err(lockamp->dev, "Failed to register IIO device: %d\n", ret);
+		goto out_clock;
+	}
 	dev_info(lockamp->dev, "Probe success (hw_version:%x)\n", version);
 
+	lockamp_debugfs_init(lockamp);
+
 	pm_runtime_put(&pdev->dev); /* ignore return value */
 
 	return ret;
 
+out_clock:
+	lockamp_clock_remove(lockamp);
+out_capture:
+	lockamp_capture_remove(lockamp);
+out_monitor:
+	lockamp_monitor_remove(lockamp);
 out_pm_get:
 	pm_runtime_put(&pdev->dev); /* ignore return value */
 out_pm_enable:
 	pm_runtime_disable(&pdev->dev);
 out_device:
+	lockamp_pm_prewarm_release(lockamp);
 	device_destroy(lockamp_class, lockamp->chrdev_no);
+	/* After the attributes are gone */
+	lockamp_adc_snapshot_release(lockamp);
+	lockamp_fir_release(lockamp);
 out_cdev:
 	cdev_del(&lockamp->cdev);
 out_chrdev:
-	unregister_chrdev_region(lockamp->chrdev_no, 1);
+	ida_simple_remove(&lockamp_ida, lockamp->id);
 out_sbuf:
-	vfree(lockamp->signal_buf.buf);
+	lockamp_free_sbuf(lockamp);
 	return ret;
 }
 
 static int lockamp_remove(struct platform_device *pdev)
 {
 	struct lockamp *lockamp = platform_get_drvdata(pdev);
+	lockamp_iio_remove(lockamp);
+	lockamp_clock_remove(lockamp);
+	lockamp_capture_remove(lockamp);
+	lockamp_monitor_remove(lockamp);
+	lockamp_debugfs_remove(lockamp);
+	lockamp_pm_prewarm_release(lockamp);
 	pm_runtime_disable(&pdev->dev);
 	device_destroy(lockamp_class, lockamp->chrdev_no);
+	/* After the attributes are gone */
+	lockamp_adc_snapshot_release(lockamp);
+	lockamp_fir_release(lockamp);
 	cdev_del(&lockamp->cdev);
-	unregister_chrdev_region(lockamp->chrdev_no, 1);
-	vfree(lockamp->signal_buf.buf);
+	ida_simple_remove(&lockamp_ida, lockamp->id);
+	lockamp_free_sbuf(lockamp);
 	return 0;
 }
 
@@ -340,12 +524,21 @@ static const struct of_device_id lockamp_of_match_table[] = {
 };
 MODULE_DEVICE_TABLE(of, lockamp_of_match_table);
 
+static const struct platform_device_id lockamp_id_table[] = {
+#ifdef CONFIG_SBT_LOCKAMP_SIM
+	/* See sim.c */
+	{ .name = LOCKAMP_SIM_NAME },
+#endif
+	{},
+};
+
 static struct platform_driver lockamp_driver = {
 	.driver = {
 		.name = "sbt-lockamp",
 		.of_match_table = of_match_ptr(lockamp_of_match_table),
 		.pm = &lockamp_pm_ops,
 	},
+	.id_table = lockamp_id_table,
 	.probe = lockamp_probe,
 	.remove = lockamp_remove,
 };
@@ -361,13 +554,37 @@ static int __init lockamp_module_init(void)
 		goto out;
 	}
 	lockamp_class->dev_groups = lockamp_attr_groups;
+	/* Dev (device numbers of all instances) */
+	ret = alloc_chrdev_region(&lockamp_devt, 0, LOCKAMP_MAX_MINORS, LOCKAMP_CLASS_NAME);
+	if (ret < 0) {
+		pr_err(LOCKAMP_CLASS_NAME ": Failed to allocate character device region.\n");
+		goto out_class;
+	}
 	/* Register platform driver */
 	ret = platform_driver_register(&lockamp_driver);
 	if (ret < 0) {
 		pr_err(LOCKAMP_CLASS_NAME ": Failed to register platform driver.\n");
-		goto out_class;
+		goto out_chrdev;
+	}
+	/* Drain firmware channels (if enabled) */
+	ret = lockamp_amp_register();
+	if (ret < 0) {
+		pr_err(LOCKAMP_CLASS_NAME ": Failed to register rpmsg driver.\n");
+		goto out_driver;
+	}
+	/* Simulated hardware (if enabled) */
+	ret = lockamp_sim_register();
+	if (ret < 0) {
+		pr_err(LOCKAMP_CLASS_NAME ": Failed to register simulated device.\n");
+		goto out_amp;
 	}
 	goto out;
+out_amp:
+	lockamp_amp_unregister();
+out_driver:
+	platform_driver_unregister(&lockamp_driver);
+out_chrdev:
+	unregister_chrdev_region(lockamp_devt, LOCKAMP_MAX_MINORS);
 out_class:
 	class_destroy(lockamp_class);
 out:
@@ -377,7 +594,10 @@ module_init(lockamp_module_init);
 
 static void __exit lockamp_module_exit(void)
 {
+	lockamp_sim_unregister();
+	lockamp_amp_unregister();
 	platform_driver_unregister(&lockamp_driver);
+	unregister_chrdev_region(lockamp_devt, LOCKAMP_MAX_MINORS);
 	class_destroy(lockamp_class);
 }
 module_exit(lockamp_module_exit);
@@ -8,15 +8,37 @@
 #define LOCKAMP_LOCKAMP_H
 #include <asm/atomic.h>
 #include <linux/cdev.h>
+#include <linux/cpufreq.h>
+#include <linux/dmaengine.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
+#include <linux/notifier.h>
 #include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
+#include <linux/seqlock.h>
 #include <linux/sysfs.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <uapi/linux/sbt_lockamp.h>
 
+struct lockamp_amp;
+struct lockamp_capture;
+struct lockamp_clock;
+struct lockamp_iio;
+struct lockamp_monitor;
+struct lockamp_sim;
+struct lockamp_sweep_state;
 struct sample;
 
 /* Class name as it appears in /sys/class  */
 #define LOCKAMP_CLASS_NAME  "lockin_amplifier"
+/* Number of character device minors (i.e., lock-in amplifier instances) */
+#define LOCKAMP_MAX_DEVICES 8
+/* Each instance also has a monitor device (at LOCKAMP_MAX_DEVICES + id),
+ * a capture device (at 2 * LOCKAMP_MAX_DEVICES + id), and a sample clock
+ * (at 3 * LOCKAMP_MAX_DEVICES + id) */
+#define LOCKAMP_MAX_MINORS  (4 * LOCKAMP_MAX_DEVICES)
 
 #define LOCKAMP_ADC_SAMPLES_SIZE_S32 16384
 #define LOCKAMP_ADC_SAMPLES_SIZE     (LOCKAMP_ADC_SAMPLES_SIZE_S32 * sizeof(s32))
@@ -27,41 +49,304 @@ struct sample;
 #define LOCKAMP_SITES_PER_SAMPLE     2
 #define LOCKAMP_ENTRIES_PER_SITE     4
 #define LOCKAMP_ENTRIES_PER_SAMPLE   (LOCKAMP_ENTRIES_PER_SITE * LOCKAMP_SITES_PER_SAMPLE)
-#define LOCKAMP_SIGNAL_BUF_CAPACITY  4194304 /* 4 MiB */
+#define LOCKAMP_SIGNAL_BUF_CAPACITY  4194304 /* 4 MiB (default) */
 
+/*
+ * Signal buffer with a single producer and any number of readers
+ *
+ * 'head' and 'reserve' are free-running sample counts (they wrap at 2^32).
+ * The buffer index is the count modulo 'capacity_n'. Each reader has its own
+ * tail (see 'struct lockamp_reader').
+ *
+ * The producer never waits for the readers. Instead, it overwrites the
+ * oldest samples. The producer moves 'reserve' forward before it writes to
+ * the buffer and moves 'head' forward after. I.e., only the samples in
+ * [reserve - capacity_n; head) are valid.
+ */
 struct circ_sample_buf {
 	struct sample *buf;
 	size_t capacity_n;
-	ptrdiff_t head;
-	ptrdiff_t tail;
+	u32 head;
+	u32 reserve;
 };
 
 struct csbuf_snapshot {
 	size_t size_n;
-	ptrdiff_t head;
-	ptrdiff_t tail;
+	u32 head;
+	u32 tail;
+};
+
+static inline void lockamp_sbuf_reserve(struct circ_sample_buf *sbuf, u32 reserve)
+{
+	WRITE_ONCE(sbuf->reserve, reserve);
+	/* Readers must see the new reserve before the new samples */
+	smp_wmb();
+}
+
+static inline size_t lockamp_sbuf_index(struct circ_sample_buf *sbuf, u32 count)
+{
+	return count & (sbuf->capacity_n - 1);
+}
+
+struct lockamp;
+
+/* Per open file */
+struct lockamp_reader {
+	struct lockamp *lockamp;
+	/* Sample count of the next sample to read */
+	u32 tail;
+	int last_desyncs;
+	u64 last_start_time_ns;
+	/* Number of times that the producer overwrote unread samples and
+	 * the total number of samples lost that way. */
+	unsigned int overruns;
+	u64 lost_n;
+	/* Sequence number of the sample at 'tail'. See 'lockamp->head_seq'. */
+	u64 seq;
+	/* The part of 'anchor.fifo_lost_n' that we accounted for and the
+	 * part of that since the reader opened the device */
+	u64 fifo_lost_n;
+	u64 fifo_dropped_n;
+	/* LOCKAMP_CHUNK_*_OVERRUN since the last chunk */
+	u32 loss_flags;
+	/* Holds the converted samples for compact output formats. Allocated
+	 * on first use. */
+	void *pack_buf;
+	/* Stages the FIFO content on its way to user space (without the
+	 * signal buffer). LOCKAMP_BOUNCE_BUF_SIZE bytes. */
+	void *bounce_buf;
+};
+
+#define LOCKAMP_BOUNCE_BUF_SIZE PAGE_SIZE
+#define LOCKAMP_BOUNCE_BUF_N    (LOCKAMP_BOUNCE_BUF_SIZE / sizeof(struct sample))
+
+/*
+ * The time at which a given sample was produced. Latched when the producer
+ * drains the FIFO. 'count' is a free-running sample count (like the head).
+ */
+struct lockamp_anchor {
+	u32 count;
+	/* Sequence number of the sample at 'count' (see 'head_seq') */
+	u64 seq;
+	u64 mono_ns;
+	u64 real_ns;
+	/* Total number of samples that the PL dropped because the FIFO was
+	 * full. The latest drop happened right before the sample at
+	 * 'gap_count'. */
+	u64 fifo_lost_n;
+	u32 gap_count;
+};
+
+/* Loss flags of the sequence header (chunk header version 2) */
+#define LOCKAMP_CHUNK_FIFO_OVERRUN BIT(0)
+#define LOCKAMP_CHUNK_SBUF_OVERRUN BIT(1)
+/* A filter program dropped samples (see 'lockamp_sbuf_filter') */
+#define LOCKAMP_CHUNK_FILTERED     BIT(2)
+#define LOCKAMP_CHUNK_HEADER_VERSION_MAX 2
+
+/* The latest ranges of samples that filter programs dropped. Adjacent
+ * drops share a range. See 'lockamp_sbuf_filter'. */
+#define LOCKAMP_FILTER_DROPS_N 64
+
+struct lockamp_filter_drop {
+	u32 count;
+	u32 size_n;
+};
+
+enum lockamp_timestamp_mode {
+	/* The start time is extrapolated from the time of open (or of the
+	 * last desync) */
+	LOCKAMP_TIMESTAMP_EXTRAPOLATED,
+	/* Additionally, each chunk carries the latest anchor */
+	LOCKAMP_TIMESTAMP_ANCHOR,
+};
+
+/* All entries of 'struct sample' */
+#define LOCKAMP_OUTPUT_MASK_ALL GENMASK(LOCKAMP_ENTRIES_PER_SAMPLE - 1, 0)
+
+enum lockamp_output_entry {
+	LOCKAMP_OUTPUT_S32,
+	/* Saturated to the s16 range */
+	LOCKAMP_OUTPUT_S16,
+};
+
+enum lockamp_drain_policy {
+	/* SCHED_FIFO at the highest priority */
+	LOCKAMP_DRAIN_FIFO,
+	/* SCHED_DEADLINE with a period of 'read_delay_ns' */
+	LOCKAMP_DRAIN_DEADLINE,
+};
+
+#define LOCKAMP_STATS_BINS 16
+
+/*
+ * Producer statistics. See stats.c.
+ *
+ * We count the unusual events instead of printing them. Print statements
+ * are slow (they may take 5-10 ms) and would cause the very overruns that
+ * they report.
+ */
+struct lockamp_stats {
+	/* Latest values. Written by the producer. */
+	u64 drain_duration_ns;
+	u64 read_delay_ns;
+	unsigned int ma_time_step_ns;
+	u64 last_ma_time_ns;
+	u64 wakeup_latency_ns;
+	u64 wakeup_latency_max_ns;
+	/* Histograms. Written by the producer. */
+	u32 drain_duration_hist[LOCKAMP_STATS_BINS];
+	u32 fifo_fill_hist[LOCKAMP_STATS_BINS];
+	u32 wakeup_latency_hist[LOCKAMP_STATS_BINS];
+	/* When the timer, interrupt, or DMA period that the next drain
+	 * responds to happened (zero if none is pending). See
+	 * 'lockamp_stats_kick'. */
+	atomic64_t kick_ns;
+	/* The FIFO was more than 3/4 full */
+	atomic_t fifo_high;
+	/* The PL dropped samples because the FIFO was full (estimated) */
+	atomic_t fifo_overruns;
+	atomic64_t fifo_lost_n;
+	/* Sum over all readers */
+	atomic_t overruns;
+	atomic64_t lost_n;
+	atomic_t invalid_mmap_tails;
+	atomic_t dma_errors;
+};
+
+/* Derived from the configuration registers and the rate of the input
+ * clock. See 'lockamp_update_timing'. */
+struct lockamp_timing {
+	/* Rounded to the nearest ns. See 'time_step_q32' for the exact value. */
+	unsigned int time_step_ns;
+	unsigned long read_delay_ns;
+	/* Protects the fields below (and the consistency of the fields
+	 * above with them) */
+	seqlock_t lock;
+	/* Input clock cycles per sample (CIC length times decimation) */
+	u32 cycles_n;
+	/* Period of the input clock. Follows the rate of the clock if the
+	 * device tree gives one (see 'lockamp_clk_notify'). */
+	u32 base_time_step_fs;
+	/* The time step in ns as a 32.32 fixed-point number */
+	u64 time_step_q32;
+	/* The input clock (optional) */
+	struct clk *clk;
+	struct notifier_block clk_nb;
 };
 
 struct lockamp {
 	struct cdev cdev;
 	struct device *dev;
 	dev_t chrdev_no;
+	/* Minor number. Also the index in the kthread name. */
+	int id;
 	struct gpio_desc *reset;
 	struct iio_channel *adc_site0, *adc_site1, *dac_site0, *dac_site1;
 	struct regmap *regmap;
+	struct lockamp_timing timing;
 	u8 __iomem *control;
+	/* FIFO threshold interrupt. Not used if less than or equal to zero. */
+	int irq;
+	u64 last_irq_ns;
+	/* The polling kthread (if neither the interrupt nor DMA is used) */
+	struct task_struct *drain_thread;
+	/* Wakes the polling kthread. See 'sleep_until_fifo_half_full'. */
+	struct hrtimer drain_timer;
+	bool drain_timer_fired;
+	/* FIFO DMA channel. Optional. See dma.c. */
+	struct dma_chan *dma_chan;
+	/* Drain firmware on CPU1. Optional. See amp.c. */
+	struct lockamp_amp *amp;
+	/* See sbuf.c */
+	struct device *signal_buf_dev;
+	bool signal_buf_reserved_mem;
+	dma_addr_t signal_buf_dma;
+	dma_cookie_t dma_cookie;
+	/* Runs the drain after each DMA or AMP period */
+	struct work_struct dma_work;
+	/* Where and how the producer runs. Takes effect on the next start of
+	 * the drain (i.e., when the first reader opens the device). The CPU is
+	 * negative to run on any CPU. */
+	int drain_cpu;
+	enum lockamp_drain_policy drain_policy;
+	/* Frequency floor (kHz) of the drain CPUs while the drain runs. Zero
+	 * (the default) to leave the frequency to the governor. */
+	unsigned int drain_min_freq_khz;
+	struct cpufreq_latency_req drain_freq_req;
 	struct regulator *amp_supply;
 	bool amp_supply_force_off;
+	/* See 'lockamp_pm_prewarm' */
+	struct mutex prewarm_m;
+	struct delayed_work prewarm_work;
+	bool prewarm_held;
+	bool prewarm_disabled;
 
 	struct circ_sample_buf signal_buf;
 	struct mutex signal_buf_m;
+	/* Shared with user space through mmap. See 'struct lockamp_mmap_ctrl'. */
+	struct lockamp_mmap_ctrl *mmap_ctrl;
+	/* The reader that owns the mmap control page (if any) */
+	struct lockamp_reader *mmap_reader;
+	struct mutex readers_m;
+	unsigned int reader_count;
+	/* Woken up when there are new samples in the signal buffer */
+	wait_queue_head_t read_wq;
+	/* Blocking reads wait for this many samples. Zero to not block. */
+	unsigned int read_low_watermark_n;
 	struct mutex adc_buf_m;
 	char *adc_buffer;
+	/* See adc.c */
+	struct lockamp_adc_snapshot_ctrl *adc_snapshot;
+	struct delayed_work adc_snapshot_work;
+	unsigned int adc_snapshot_period_ms;
 	int sample_multipliers[LOCKAMP_SITES_PER_SAMPLE];
+	/* The active FIR coefficient set and the loaded sets. See fir.c. */
+	struct mutex fir_m;
+	const char *fir_name;
+	const s32 *fir_coefs;
+	struct list_head fir_sets;
 
 	atomic_t desyncs;
-	int last_desyncs;
-	u64 last_start_time_ns;
+	/* Serializes LOCKAMP_IOC_SET_CONFIG. See config.c. */
+	struct mutex config_m;
+	/* Count of the first sample of the latest configuration. Written
+	 * before 'config_seq' (with release semantics). */
+	u32 config_count;
+	u32 config_seq;
+	/* The running frequency sweep (if any). See sweep.c. */
+	struct lockamp_sweep_state *sweep;
+	unsigned long sweep_delay_ns;
+
+	struct lockamp_anchor anchor;
+	seqcount_t anchor_seq;
+	/* Written by the producer */
+	struct lockamp_filter_drop filter_drops[LOCKAMP_FILTER_DROPS_N];
+	u32 filter_drops_head;
+	seqcount_t filter_seq;
+	enum lockamp_timestamp_mode timestamp_mode;
+	/* 1: The original chunk header. 2: Followed by the sequence header. */
+	unsigned int chunk_header_version;
+	/* Sequence number of the sample at the head. Counts all samples that
+	 * the PL produced, including the ones that it dropped. Protected by
+	 * 'signal_buf_m'. */
+	u64 head_seq;
+	/* Output format of read(). Bit i selects entry i of 'struct sample'. */
+	unsigned int output_mask;
+	enum lockamp_output_entry output_entry;
+
+	struct lockamp_stats stats;
+	struct dentry *debugfs;
+	/* IIO frontend. Optional. See iio.c. */
+	struct lockamp_iio *iio;
+	/* Low-rate monitor device. See monitor.c. */
+	struct lockamp_monitor *monitor;
+	/* Triggered capture device. See capture.c. */
+	struct lockamp_capture *capture;
+	/* Sample clock (a dynamic POSIX clock). See clock.c. */
+	struct lockamp_clock *clock;
+	/* Simulated hardware (NULL for the real thing). See sim.c. */
+	struct lockamp_sim *sim;
 };
 
 struct site_sample {
@@ -77,15 +362,13 @@ struct sample {
 } __attribute__((packed));
 _Static_assert (LOCKAMP_SITES_PER_SAMPLE * sizeof(struct site_sample) == sizeof(struct sample), "struct 'sample' is not packed on this platform");
 
-extern unsigned int lockamp_ma_time_step_ns;
-extern u64 lockamp_fifo_read_duration;
-extern u64 lockamp_fifo_read_delay;
-extern int lockamp_debug1;
-extern int lockamp_debug2;
-extern int lockamp_debug3;
 extern const s32 lockamp_fir_coefs[LOCKAMP_FIR_FILTER_COUNT][LOCKAMP_FIR_COEF_LEN];
 extern const struct attribute_group *lockamp_attr_groups[2];
 extern struct file_operations lockamp_fops;
+extern irqreturn_t lockamp_fifo_hardirq(int irq, void *data);
+extern irqreturn_t lockamp_fifo_irq(int irq, void *data);
+extern int lockamp_drain_get(struct lockamp *lockamp);
+extern void lockamp_drain_put(struct lockamp *lockamp);
 extern struct dev_pm_ops lockamp_pm_ops;
 
 #endif /* LOCKAMP_LOCKAMP_H */
@@ -0,0 +1,416 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/math64.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#ifdef CONFIG_KERNEL_MODE_NEON
+#include <asm/neon.h>
+#include <asm/simd.h>
+#endif
+
+#include "hw.h"
+#include "monitor.h"
+
+/*
+ * Monitor device (see 'struct lockamp_monitor_sample')
+ *
+ * Live displays only need about 100 S/s. Instead of the full-rate stream,
+ * they read the monitor device. The drain path (see 'drain_fifo') calls
+ * 'lockamp_monitor_push' each time it moved samples into the signal buffer.
+ * We then average the new samples in windows of 'window_n' samples (a
+ * boxcar) and append each mean to a ring of our own.
+ *
+ * Like the signal buffer, the ring has a single producer and any number of
+ * readers, and the producer never waits for the readers. The averaging
+ * only runs while a monitor file is open. The full-rate readers are not
+ * affected either way.
+ *
+ * The producer state is protected by 'signal_buf_m'.
+ */
+#define LOCKAMP_MONITOR_CAPACITY_N 1024
+#define LOCKAMP_MONITOR_RATE_HZ    100
+
+struct lockamp_monitor {
+	struct lockamp *lockamp;
+	struct device dev;
+	struct cdev cdev;
+	unsigned int rate_hz;
+	/* Free-running counts of means like 'struct circ_sample_buf' */
+	struct lockamp_monitor_sample *buf;
+	u32 head;
+	u32 reserve;
+	wait_queue_head_t wq;
+	/* Number of open files. The producer only averages if non-zero. */
+	unsigned int open_count;
+	/* Count of the next signal buffer sample to average */
+	u32 tail;
+	/* The current window */
+	s64 sums[LOCKAMP_ENTRIES_PER_SAMPLE];
+	u32 sum_n;
+	u32 window_n;
+	u32 window_count;
+	u64 window_time_ns;
+};
+
+/* Per open file */
+struct lockamp_monitor_reader {
+	struct lockamp_monitor *monitor;
+	u32 tail;
+};
+
+static void sum_samples_scalar(const struct sample *s, size_t size_n, s64 *sums)
+{
+	const s32 *entries;
+	size_t i;
+	int j;
+	for (i = 0; size_n != i; ++i) {
+		entries = (const s32 *)&s[i];
+		for (j = 0; LOCKAMP_ENTRIES_PER_SAMPLE > j; ++j) {
+			sums[j] += entries[j];
+		}
+	}
+}
+
+static void sum_samples(const struct sample *s, size_t size_n, s64 *sums)
+{
+#ifdef CONFIG_KERNEL_MODE_NEON
+	BUILD_BUG_ON(8 != LOCKAMP_ENTRIES_PER_SAMPLE);
+	if (cpu_has_neon() && may_use_simd()) {
+		kernel_neon_begin();
+		lockamp_sum_samples_neon((const s32 *)s, size_n, sums);
+		kernel_neon_end();
+		return;
+	}
+#endif
+	sum_samples_scalar(s, size_n, sums);
+}
+
+/* Number of samples per mean for the current time step */
+static u32 window_n(struct lockamp *lockamp, unsigned int rate_hz)
+{
+	unsigned int time_step_ns = lockamp_time_step_ns(lockamp);
+	u64 n;
+	if (0 == time_step_ns || 0 == rate_hz) {
+		return 1;
+	}
+	n = DIV_ROUND_CLOSEST_ULL(NSEC_PER_SEC, (u64)time_step_ns * rate_hz);
+	return clamp_t(u64, n, 1, U32_MAX);
+}
+
+static void start_window(struct lockamp *lockamp, struct lockamp_monitor *monitor)
+{
+	monitor->window_n = window_n(lockamp, READ_ONCE(monitor->rate_hz));
+	monitor->window_count = monitor->tail;
+	monitor->window_time_ns = lockamp_count_real_ns(lockamp, monitor->tail);
+}
+
+static void emit_window(struct lockamp_monitor *monitor)
+{
+	struct lockamp_monitor_sample *mean;
+	u32 head = monitor->head;
+	int i;
+	WRITE_ONCE(monitor->reserve, head + 1);
+	/* Readers must see the new reserve before the new mean */
+	smp_wmb();
+	mean = &monitor->buf[head & (LOCKAMP_MONITOR_CAPACITY_N - 1)];
+	mean->time_ns = monitor->window_time_ns;
+	mean->count = monitor->window_count;
+	mean->size_n = monitor->sum_n;
+	for (i = 0; LOCKAMP_ENTRIES_PER_SAMPLE > i; ++i) {
+		mean->entries[i] = div_s64(monitor->sums[i], monitor->sum_n);
+		monitor->sums[i] = 0;
+	}
+	monitor->sum_n = 0;
+	smp_store_release(&monitor->head, head + 1);
+}
+
+/* Call with 'signal_buf_m' held */
+void lockamp_monitor_push(struct lockamp *lockamp)
+{
+	struct lockamp_monitor *monitor = lockamp->monitor;
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	u32 head = sbuf->head;
+	u32 oldest;
+	u32 config_n;
+	size_t index;
+	size_t n;
+	bool emitted = false;
+	if (NULL == monitor || 0 == monitor->open_count) {
+		return;
+	}
+	/* We fell behind (e.g., at the first push). Start over. */
+	oldest = sbuf->reserve - sbuf->capacity_n;
+	if ((s32)(monitor->tail - oldest) < 0) {
+		monitor->tail = oldest;
+		memset(monitor->sums, 0, sizeof(monitor->sums));
+		monitor->sum_n = 0;
+	}
+	while (head != monitor->tail) {
+		if (0 == monitor->sum_n) {
+			start_window(lockamp, monitor);
+		}
+		/* Within the window and contiguous in the signal buffer */
+		index = lockamp_sbuf_index(sbuf, monitor->tail);
+		n = min_t(size_t, head - monitor->tail,
+		          monitor->window_n - monitor->sum_n);
+		n = min_t(size_t, n, sbuf->capacity_n - index);
+		/* Don't mix samples from before and after a configuration
+		 * change */
+		config_n = READ_ONCE(lockamp->config_count) - monitor->tail;
+		if (0 < (s32)config_n && config_n < n) {
+			n = config_n;
+		}
+		sum_samples(&sbuf->buf[index], n, monitor->sums);
+		monitor->tail += n;
+		monitor->sum_n += n;
+		if (monitor->sum_n == monitor->window_n ||
+		    monitor->tail == READ_ONCE(lockamp->config_count)) {
+			emit_window(monitor);
+			emitted = true;
+		}
+	}
+	if (emitted) {
+		wake_up_interruptible(&monitor->wq);
+	}
+}
+
+/* Skip the means that the producer overwrote */
+static void reader_skip_overrun(struct lockamp_monitor_reader *reader)
+{
+	struct lockamp_monitor *monitor = reader->monitor;
+	u32 oldest;
+	/* Read the reserve after the means */
+	smp_rmb();
+	oldest = READ_ONCE(monitor->reserve) - LOCKAMP_MONITOR_CAPACITY_N;
+	if ((s32)(reader->tail - oldest) < 0) {
+		reader->tail = oldest;
+	}
+}
+
+static bool reader_has_data(struct lockamp_monitor_reader *reader)
+{
+	return smp_load_acquire(&reader->monitor->head) != reader->tail;
+}
+
+static int monitor_open(struct inode *inode, struct file *filp)
+{
+	struct lockamp_monitor *monitor = container_of(inode->i_cdev,
+	                                               struct lockamp_monitor, cdev);
+	struct lockamp *lockamp = monitor->lockamp;
+	struct lockamp_monitor_reader *reader;
+	int ret;
+	reader = kzalloc(sizeof(*reader), GFP_KERNEL);
+	if (NULL == reader) {
+		return -ENOMEM;
+	}
+	reader->monitor = monitor;
+	/* Like any reader, we keep the producer running */
+	ret = lockamp_drain_get(lockamp);
+	if (ret < 0) {
+		kfree(reader);
+		return ret;
+	}
+	mutex_lock(&lockamp->signal_buf_m);
+	/* The first file starts averaging from the newest sample */
+	if (0 == monitor->open_count++) {
+		monitor->tail = lockamp->signal_buf.head;
+		memset(monitor->sums, 0, sizeof(monitor->sums));
+		monitor->sum_n = 0;
+	}
+	reader->tail = monitor->head;
+	mutex_unlock(&lockamp->signal_buf_m);
+	filp->private_data = reader;
+	return stream_open(inode, filp);
+}
+
+static int monitor_release(struct inode *inode, struct file *filp)
+{
+	struct lockamp_monitor_reader *reader = filp->private_data;
+	struct lockamp_monitor *monitor = reader->monitor;
+	struct lockamp *lockamp = monitor->lockamp;
+	mutex_lock(&lockamp->signal_buf_m);
+	--monitor->open_count;
+	mutex_unlock(&lockamp->signal_buf_m);
+	lockamp_drain_put(lockamp);
+	kfree(reader);
+	return 0;
+}
+
+#define LOCKAMP_MONITOR_BATCH_N 8
+
+static ssize_t monitor_read(struct file *filp, char __user *buf, size_t len,
+                            loff_t *off)
+{
+	struct lockamp_monitor_reader *reader = filp->private_data;
+	struct lockamp_monitor *monitor = reader->monitor;
+	struct lockamp_monitor_sample batch[LOCKAMP_MONITOR_BATCH_N];
+	size_t copied = 0;
+	size_t size;
+	u32 head;
+	u32 n, i;
+	int ret;
+	if (len < sizeof(batch[0])) {
+		return -EINVAL;
+	}
+	if (!reader_has_data(reader)) {
+		if (filp->f_flags & O_NONBLOCK) {
+			return -EAGAIN;
+		}
+		ret = wait_event_interruptible(monitor->wq, reader_has_data(reader));
+		if (ret < 0) {
+			return ret;
+		}
+	}
+	for (;;) {
+		head = smp_load_acquire(&monitor->head);
+		reader_skip_overrun(reader);
+		n = min_t(size_t, head - reader->tail,
+		          (len - copied) / sizeof(batch[0]));
+		n = min_t(u32, n, LOCKAMP_MONITOR_BATCH_N);
+		if (0 == n) {
+			break;
+		}
+		/* Copy out of the ring first. The producer may overwrite the
+		 * means in the meantime, but it never waits for a page fault. */
+		for (i = 0; n != i; ++i) {
+			batch[i] = monitor->buf[(reader->tail + i) &
+			                        (LOCKAMP_MONITOR_CAPACITY_N - 1)];
+		}
+		smp_rmb();
+		if ((s32)(reader->tail - (READ_ONCE(monitor->reserve) -
+		                          LOCKAMP_MONITOR_CAPACITY_N)) < 0) {
+			continue;
+		}
+		size = n * sizeof(batch[0]);
+		if (copy_to_user(buf + copied, batch, size)) {
+			return (0 < copied) ? copied : -EFAULT;
+		}
+		copied += size;
+		reader->tail += n;
+	}
+	return copied;
+}
+
+static __poll_t monitor_poll(struct file *filp, poll_table *wait)
+{
+	struct lockamp_monitor_reader *reader = filp->private_data;
+	poll_wait(filp, &reader->monitor->wq, wait);
+	if (reader_has_data(reader)) {
+		return EPOLLIN | EPOLLRDNORM;
+	}
+	return 0;
+}
+
+static const struct file_operations lockamp_monitor_fops = {
+	.owner = THIS_MODULE,
+	.open = monitor_open,
+	.release = monitor_release,
+	.read = monitor_read,
+	.poll = monitor_poll,
+	.llseek = no_llseek,
+};
+
+static ssize_t rate_hz_show(struct device *device,
+                            struct device_attribute *attr, char *buf)
+{
+	struct lockamp_monitor *monitor = dev_get_drvdata(device);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(monitor->rate_hz));
+}
+static ssize_t rate_hz_store(struct device *device,
+                             struct device_attribute *attr, const char *buf,
+                             size_t count)
+{
+	struct lockamp_monitor *monitor = dev_get_drvdata(device);
+	unsigned int value;
+	int ret = kstrtouint(buf, 0, &value);
+	if (ret < 0) {
+		return ret;
+	}
+	if (0 == value) {
+		return -EINVAL;
+	}
+	/* Takes effect with the next window */
+	WRITE_ONCE(monitor->rate_hz, value);
+	return count;
+}
+static DEVICE_ATTR(rate_hz, S_IRUGO | S_IWUSR, rate_hz_show, rate_hz_store);
+
+static struct attribute *lockamp_monitor_attrs[] = {
+	&dev_attr_rate_hz.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(lockamp_monitor);
+
+static void lockamp_monitor_dev_release(struct device *dev)
+{
+	struct lockamp_monitor *monitor = container_of(dev, struct lockamp_monitor, dev);
+	kvfree(monitor->buf);
+	kfree(monitor);
+}
+
+int lockamp_monitor_init(struct lockamp *lockamp)
+{
+	struct lockamp_monitor *monitor;
+	int ret;
+	monitor = kzalloc(sizeof(*monitor), GFP_KERNEL);
+	if (NULL == monitor) {
+		return -ENOMEM;
+	}
+	monitor->buf = kvcalloc(LOCKAMP_MONITOR_CAPACITY_N, sizeof(*monitor->buf),
+	                        GFP_KERNEL);
+	if (NULL == monitor->buf) {
+		kfree(monitor);
+		return -ENOMEM;
+	}
+	monitor->lockamp = lockamp;
+	monitor->rate_hz = LOCKAMP_MONITOR_RATE_HZ;
+	init_waitqueue_head(&monitor->wq);
+
+	/* From here on, the release callback frees the monitor */
+	device_initialize(&monitor->dev);
+	monitor->dev.devt = MKDEV(MAJOR(lockamp->chrdev_no),
+	                          LOCKAMP_MAX_DEVICES + lockamp->id);
+	monitor->dev.parent = lockamp->dev;
+	monitor->dev.groups = lockamp_monitor_groups;
+	monitor->dev.release = lockamp_monitor_dev_release;
+	dev_set_drvdata(&monitor->dev, monitor);
+	ret = dev_set_name(&monitor->dev, "%s_monitor", dev_name(lockamp->dev));
+	if (ret < 0) {
+		goto out_put;
+	}
+	cdev_init(&monitor->cdev, &lockamp_monitor_fops);
+	monitor->cdev.owner = THIS_MODULE;
+	ret = cdev_device_add(&monitor->cdev, &monitor->dev);
+	if (ret < 0) {
+		goto out_put;
+	}
+	lockamp->monitor = monitor;
+	return 0;
+
+out_put:
+	put_device(&monitor->dev);
+	return ret;
+}
+
+void lockamp_monitor_remove(struct lockamp *lockamp)
+{
+	struct lockamp_monitor *monitor = lockamp->monitor;
+	if (NULL == monitor) {
+		return;
+	}
+	cdev_device_del(&monitor->cdev, &monitor->dev);
+	/* Wait for the push in progress (if any) */
+	mutex_lock(&lockamp->signal_buf_m);
+	lockamp->monitor = NULL;
+	mutex_unlock(&lockamp->signal_buf_m);
+	put_device(&monitor->dev);
+}
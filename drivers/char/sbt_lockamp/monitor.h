@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_MONITOR_H_
+#define _LOCKAMP_MONITOR_H_
+
+#include "lockin_amplifier.h"
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+/* See neon.c */
+void lockamp_sum_samples_neon(const int32_t *data, unsigned long size_n,
+                              int64_t *sums);
+#endif
+
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+extern int lockamp_monitor_init(struct lockamp *lockamp);
+extern void lockamp_monitor_remove(struct lockamp *lockamp);
+extern void lockamp_monitor_push(struct lockamp *lockamp);
+#else
+static inline int lockamp_monitor_init(struct lockamp *lockamp)
+{
+	return 0;
+}
+static inline void lockamp_monitor_remove(struct lockamp *lockamp)
+{
+}
+static inline void lockamp_monitor_push(struct lockamp *lockamp)
+{
+}
+#endif
+
+#endif /* _LOCKAMP_MONITOR_H_ */
@@ -0,0 +1,60 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <arm_neon.h>
+
+/*
+ * Multiply each sample by the per-site multipliers.
+ *
+ * A sample is two sites of four s32 entries each. I.e., exactly two NEON
+ * quadword registers, so there is no need for lane shuffling.
+ *
+ * Must be called between kernel_neon_begin and kernel_neon_end. Note that
+ * this file is compiled with NEON enabled, so we can not include the usual
+ * kernel headers here.
+ */
+void lockamp_apply_multipliers_neon(int32_t *data, unsigned long size_n,
+                                    int32_t multiplier0, int32_t multiplier1)
+{
+	const int32x4_t m0 = vdupq_n_s32(multiplier0);
+	const int32x4_t m1 = vdupq_n_s32(multiplier1);
+	unsigned long i;
+	for (i = 0; size_n != i; ++i) {
+		vst1q_s32(data, vmulq_s32(vld1q_s32(data), m0));
+		vst1q_s32(data + 4, vmulq_s32(vld1q_s32(data + 4), m1));
+		data += 8;
+	}
+}
+
+/*
+ * Add each entry of 'size_n' samples to the corresponding entry of 'sums'.
+ *
+ * The entries are widened to s64 so that the sums of long windows don't
+ * overflow. Same constraints as above.
+ */
+void lockamp_sum_samples_neon(const int32_t *data, unsigned long size_n,
+                              int64_t *sums)
+{
+	int64x2_t s0 = vld1q_s64(sums);
+	int64x2_t s1 = vld1q_s64(sums + 2);
+	int64x2_t s2 = vld1q_s64(sums + 4);
+	int64x2_t s3 = vld1q_s64(sums + 6);
+	int32x4_t site0, site1;
+	unsigned long i;
+	for (i = 0; size_n != i; ++i) {
+		site0 = vld1q_s32(data);
+		site1 = vld1q_s32(data + 4);
+		s0 = vaddw_s32(s0, vget_low_s32(site0));
+		s1 = vaddw_s32(s1, vget_high_s32(site0));
+		s2 = vaddw_s32(s2, vget_low_s32(site1));
+		s3 = vaddw_s32(s3, vget_high_s32(site1));
+		data += 8;
+	}
+	vst1q_s64(sums, s0);
+	vst1q_s64(sums + 2, s1);
+	vst1q_s64(sums + 4, s2);
+	vst1q_s64(sums + 6, s3);
+}
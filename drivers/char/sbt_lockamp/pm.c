@@ -7,7 +7,9 @@
 #include <linux/delay.h>
 #include <linux/iio/consumer.h>
 
+#include "fir.h"
 #include "hw.h"
+#include "pm.h"
 
 static int lockamp_pm_suspend(struct device *dev)
 {
@@ -50,6 +52,10 @@ static int lockamp_enable_converters(struct device *dev, bool enabled)
 {
 	struct lockamp *lockamp = dev_get_drvdata(dev);
 	int ret;
+	/* The simulated hardware has no converters */
+	if (NULL == lockamp->adc_site0) {
+		return 0;
+	}
 	ret = lockamp_powerdown_iio_chan(lockamp->adc_site0, !enabled);
 	if (ret < 0) {
 		dev_err(dev, "Failed to power down the ADC\n");
@@ -118,6 +124,12 @@ static int lockamp_pm_runtime_resume(struct device *dev)
 			dev_err(dev, "Failed to sync regmap cache on resume: %d\n", ret);
 			return ret;
 		}
+		/* The FIR coefficients are not in the regmap cache */
+		ret = lockamp_fir_restore(lockamp);
+		if (ret < 0) {
+			dev_err(dev, "Failed to restore FIR coefficients on resume: %d\n", ret);
+			return ret;
+		}
 	}
 	/* We have exclusive ownership of the regulator, so the regulator is
 	 * enabled iff we enabled it in this driver.
@@ -135,6 +147,68 @@ static int lockamp_pm_runtime_resume(struct device *dev)
 	return 0;
 }
 
+/*
+ * Pre-warm
+ *
+ * Power up the device ahead of a session. E.g., when a client is about to
+ * reconnect. We hold a PM reference for 'hold_ms'. Afterwards, the usual
+ * autosuspend delay applies. Thus, the session doesn't have to wait for the
+ * converters and the amplifiers to power up and settle.
+ */
+static void prewarm_work(struct work_struct *work)
+{
+	struct lockamp *lockamp = container_of(to_delayed_work(work), struct lockamp,
+	                                       prewarm_work);
+	mutex_lock(&lockamp->prewarm_m);
+	if (lockamp->prewarm_held) {
+		lockamp->prewarm_held = false;
+		lockamp_pm_put(lockamp);
+	}
+	mutex_unlock(&lockamp->prewarm_m);
+}
+
+void lockamp_pm_prewarm_init(struct lockamp *lockamp)
+{
+	mutex_init(&lockamp->prewarm_m);
+	lockamp->prewarm_held = false;
+	lockamp->prewarm_disabled = false;
+	INIT_DELAYED_WORK(&lockamp->prewarm_work, prewarm_work);
+}
+
+void lockamp_pm_prewarm_release(struct lockamp *lockamp)
+{
+	mutex_lock(&lockamp->prewarm_m);
+	lockamp->prewarm_disabled = true;
+	mutex_unlock(&lockamp->prewarm_m);
+	cancel_delayed_work_sync(&lockamp->prewarm_work);
+	/* The work may not have run */
+	prewarm_work(&lockamp->prewarm_work.work);
+}
+
+/* Extends a pending pre-warm */
+int lockamp_pm_prewarm(struct lockamp *lockamp, unsigned int hold_ms)
+{
+	int ret = 0;
+	mutex_lock(&lockamp->prewarm_m);
+	if (lockamp->prewarm_disabled) {
+		ret = -ENODEV;
+		goto out;
+	}
+	if (!lockamp->prewarm_held) {
+		ret = lockamp_pm_get(lockamp);
+		if (ret < 0) {
+			pm_runtime_put_noidle(lockamp->dev->parent);
+			goto out;
+		}
+		lockamp->prewarm_held = true;
+	}
+	mod_delayed_work(system_wq, &lockamp->prewarm_work, msecs_to_jiffies(hold_ms));
+	ret = 0;
+out:
+	mutex_unlock(&lockamp->prewarm_m);
+	return ret;
+}
+
 struct dev_pm_ops lockamp_pm_ops = {
 	SET_SYSTEM_SLEEP_PM_OPS(lockamp_pm_suspend,
 	                        lockamp_pm_resume)
@@ -5,6 +5,9 @@
 
 #include "lockin_amplifier.h"
 
+/* Stay powered this long after the last use. E.g., between two sessions. */
+#define LOCKAMP_AUTOSUSPEND_DELAY_MS 3000
+
 static inline int lockamp_pm_get(struct lockamp *lockamp)
 {
 	return pm_runtime_get_sync(lockamp->dev->parent);
@@ -16,4 +19,8 @@ static inline void lockamp_pm_put(struct lockamp *lockamp)
 	pm_runtime_put_autosuspend(lockamp->dev->parent); /* Ignore return value */
 }
 
+void lockamp_pm_prewarm_init(struct lockamp *lockamp);
+void lockamp_pm_prewarm_release(struct lockamp *lockamp);
+int lockamp_pm_prewarm(struct lockamp *lockamp, unsigned int hold_ms);
+
 #endif
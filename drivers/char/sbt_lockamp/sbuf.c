@@ -0,0 +1,291 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/dma-mapping.h>
+#include <linux/log2.h>
+#include <linux/of_reserved_mem.h>
+#include <linux/vmalloc.h>
+#include <trace/events/lockamp.h>
+
+#include "amp.h"
+#include "dma.h"
+#include "hw.h"
+#include "sbuf.h"
+
+/*
+ * Signal buffer memory
+ *
+ * In order of preference, the signal buffer comes from:
+ *
+ *   1. The "memory-region" of the device tree node (a "shared-dma-pool").
+ *      Reserved at boot so the allocation never fails due to fragmentation.
+ *   2. The DMA API of the DMA channel (CMA if enabled). Physically
+ *      contiguous so that the DMA engine can write to it.
+ *   3. vmalloc_user. Only if there is no DMA channel.
+ *
+ * 'signal_buf_dev' is the device that we allocated (1) or (2) with. It is
+ * NULL for (3). On the Zynq, there is no IOMMU, so the DMA address of (1)
+ * is also valid for the DMA channel.
+ */
+
+static void *sbuf_alloc(struct lockamp *lockamp, size_t capacity,
+                        dma_addr_t *dma)
+{
+	if (NULL != lockamp->signal_buf_dev) {
+		return dma_alloc_coherent(lockamp->signal_buf_dev, capacity, dma,
+		                          GFP_KERNEL | __GFP_NOWARN);
+	}
+	/* Use vmalloc_user so that the buffer can be mapped into user space */
+	return vmalloc_user(capacity);
+}
+
+static void sbuf_free(struct lockamp *lockamp, void *buf, size_t capacity,
+                      dma_addr_t dma)
+{
+	if (NULL == buf) {
+		return;
+	}
+	if (NULL != lockamp->signal_buf_dev) {
+		dma_free_coherent(lockamp->signal_buf_dev, capacity, buf, dma);
+		return;
+	}
+	vfree(buf);
+}
+
+int lockamp_sbuf_init(struct lockamp *lockamp, struct platform_device *pdev)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	int ret;
+	/* The reserved memory region is optional */
+	ret = of_reserved_mem_device_init(&pdev->dev);
+	if (0 == ret) {
+		lockamp->signal_buf_reserved_mem = true;
+		lockamp->signal_buf_dev = &pdev->dev;
+	} else if (-ENODEV == ret) {
+		lockamp->signal_buf_reserved_mem = false;
+		lockamp->signal_buf_dev = lockamp_has_dma(lockamp) ? lockamp->dma_chan->device->dev : NULL;
+	} else {
+		return ret;
+	}
+	/* The drain firmware addresses the buffer physically */
+	if (lockamp_has_amp(lockamp) && !lockamp->signal_buf_reserved_mem) {
+		dev_err(&pdev->dev, "The AMP drain needs a memory-region\n");
+		return -EINVAL;
+	}
+	/* Control page (shared with user space through mmap) */
+	lockamp->mmap_ctrl = vmalloc_user(PAGE_SIZE);
+	lockamp->mmap_reader = NULL;
+	if (NULL == lockamp->mmap_ctrl) {
+		return -ENOMEM;
+	}
+	/* Must be a power of 2 so that the CIRC_* macros work */
+	if (!is_power_of_2(LOCKAMP_SIGNAL_BUF_CAPACITY / sizeof(struct sample))) {
+		return -EINVAL;
+	}
+	sbuf->buf = sbuf_alloc(lockamp, LOCKAMP_SIGNAL_BUF_CAPACITY,
+	                       &lockamp->signal_buf_dma);
+	if (NULL == sbuf->buf) {
+		return -ENOMEM;
+	}
+	sbuf->capacity_n = LOCKAMP_SIGNAL_BUF_CAPACITY / sizeof(struct sample);
+	sbuf->head = 0;
+	sbuf->reserve = 0;
+	return 0;
+}
+
+void lockamp_sbuf_release(struct lockamp *lockamp)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	vfree(lockamp->mmap_ctrl);
+	lockamp->mmap_ctrl = NULL;
+	sbuf_free(lockamp, sbuf->buf, sbuf->capacity_n * sizeof(struct sample),
+	          lockamp->signal_buf_dma);
+	sbuf->buf = NULL;
+	sbuf->capacity_n = 0;
+	if (lockamp->signal_buf_reserved_mem) {
+		of_reserved_mem_device_release(lockamp->signal_buf_dev);
+		lockamp->signal_buf_reserved_mem = false;
+	}
+	lockamp->signal_buf_dev = NULL;
+}
+
+/*
+ * Replace the signal buffer with one of the given capacity (in bytes)
+ *
+ * Only while there are no readers. Keeps the current buffer if we can't
+ * allocate the new one.
+ */
+int lockamp_sbuf_resize(struct lockamp *lockamp, size_t capacity)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	size_t old_capacity;
+	dma_addr_t old_dma;
+	dma_addr_t dma;
+	void *old_buf;
+	void *buf;
+	int ret = 0;
+	if (capacity < LOCKAMP_SIGNAL_BUF_MIN_CAPACITY ||
+	    !is_power_of_2(capacity / sizeof(struct sample)) ||
+	    0 != capacity % sizeof(struct sample)) {
+		return -EINVAL;
+	}
+	mutex_lock(&lockamp->readers_m);
+	if (0 < lockamp->reader_count) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+	buf = sbuf_alloc(lockamp, capacity, &dma);
+	if (NULL == buf) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+	mutex_lock(&lockamp->signal_buf_m);
+	old_buf = sbuf->buf;
+	old_capacity = sbuf->capacity_n * sizeof(struct sample);
+	old_dma = lockamp->signal_buf_dma;
+	sbuf->buf = buf;
+	sbuf->capacity_n = capacity / sizeof(struct sample);
+	sbuf->head = 0;
+	sbuf->reserve = 0;
+	lockamp->signal_buf_dma = dma;
+	/* The counts start over */
+	write_seqcount_begin(&lockamp->filter_seq);
+	lockamp->filter_drops_head = 0;
+	write_seqcount_end(&lockamp->filter_seq);
+	mutex_unlock(&lockamp->signal_buf_m);
+	sbuf_free(lockamp, old_buf, old_capacity, old_dma);
+
+out_unlock:
+	mutex_unlock(&lockamp->readers_m);
+	return ret;
+}
+
+/*
+ * Apply the per-site sample multipliers to 'size_n' samples from 'from'.
+ * For the backends that write to the signal buffer without the CPU.
+ */
+void lockamp_sbuf_apply_multipliers(struct lockamp *lockamp, u32 from,
+                                    size_t size_n)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	size_t index;
+	size_t chunk_n;
+	/* At most two contiguous chunks */
+	while (0 < size_n) {
+		index = lockamp_sbuf_index(sbuf, from);
+		chunk_n = min_t(size_t, size_n, sbuf->capacity_n - index);
+		lockamp_apply_multipliers(lockamp, &sbuf->buf[index], chunk_n);
+		from += chunk_n;
+		size_n -= chunk_n;
+	}
+}
+
+/* Call with 'signal_buf_m' held */
+static void add_filter_drop(struct lockamp *lockamp, u32 count, u32 size_n)
+{
+	u32 head = lockamp->filter_drops_head;
+	struct lockamp_filter_drop *last;
+	last = &lockamp->filter_drops[(head - 1) & (LOCKAMP_FILTER_DROPS_N - 1)];
+	write_seqcount_begin(&lockamp->filter_seq);
+	if (0 < head && last->count + last->size_n == count) {
+		last->size_n += size_n;
+	} else {
+		lockamp->filter_drops[head & (LOCKAMP_FILTER_DROPS_N - 1)] =
+			(struct lockamp_filter_drop){ count, size_n };
+		lockamp->filter_drops_head = head + 1;
+	}
+	write_seqcount_end(&lockamp->filter_seq);
+}
+
+/*
+ * Filter programs (see 'struct lockamp_filter_block')
+ *
+ * Hand 'size_n' new samples from 'from' to the "lockamp_filter_block"
+ * tracepoint, in blocks. The producer calls this before it moves the head.
+ * Thus, the readers never see a sample before its verdict.
+ */
+void lockamp_sbuf_filter(struct lockamp *lockamp, u32 from, size_t size_n)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	struct lockamp_filter_block block;
+	size_t index;
+	if (!trace_lockamp_filter_block_enabled()) {
+		return;
+	}
+	while (0 < size_n) {
+		index = lockamp_sbuf_index(sbuf, from);
+		block.samples = (uintptr_t)&sbuf->buf[index];
+		block.count = from;
+		block.size_n = min3(size_n, (size_t)LOCKAMP_FILTER_BLOCK_N,
+		                    sbuf->capacity_n - index);
+		block.id = lockamp->id;
+		block.flags = 0;
+		trace_lockamp_filter_block(&block, lockamp->dev);
+		if (block.flags & LOCKAMP_FILTER_DROP) {
+			add_filter_drop(lockamp, from, block.size_n);
+		}
+		from += block.size_n;
+		size_n -= block.size_n;
+	}
+}
+
+/*
+ * Of the 'size_n' samples from 'tail' on, a filter program dropped the first
+ * 'skip_n'. The following 'keep_n' samples are not dropped.
+ */
+void lockamp_sbuf_filtered(struct lockamp *lockamp, u32 tail, u32 size_n,
+                           u32 *skip_n, u32 *keep_n)
+{
+	struct lockamp_filter_drop drops[LOCKAMP_FILTER_DROPS_N];
+	unsigned int seq;
+	u32 drops_n;
+	u32 offset;
+	bool skipped;
+	u32 i;
+	*skip_n = 0;
+	*keep_n = size_n;
+	/* Nothing was ever dropped */
+	if (0 == READ_ONCE(lockamp->filter_drops_head)) {
+		return;
+	}
+	do {
+		seq = read_seqcount_begin(&lockamp->filter_seq);
+		drops_n = min_t(u32, lockamp->filter_drops_head, LOCKAMP_FILTER_DROPS_N);
+		memcpy(drops, lockamp->filter_drops, sizeof(drops));
+	} while (read_seqcount_retry(&lockamp->filter_seq, seq));
+	/* Skip the ranges that cover the tail (they may follow each other) */
+	do {
+		skipped = false;
+		for (i = 0; drops_n != i; ++i) {
+			offset = tail + *skip_n - drops[i].count;
+			if (offset < drops[i].size_n) {
+				*skip_n += drops[i].size_n - offset;
+				skipped = true;
+			}
+		}
+	} while (skipped && *skip_n < size_n);
+	*skip_n = min(*skip_n, size_n);
+	*keep_n = size_n - *skip_n;
+	/* Stop at the next range */
+	for (i = 0; drops_n != i; ++i) {
+		offset = drops[i].count - (tail + *skip_n);
+		*keep_n = min(*keep_n, offset);
+	}
+}
+
+int lockamp_sbuf_mmap(struct lockamp *lockamp, struct vm_area_struct *vma)
+{
+	struct circ_sample_buf *sbuf = &lockamp->signal_buf;
+	if (NULL == lockamp->signal_buf_dev) {
+		return remap_vmalloc_range(vma, sbuf->buf,
+		                           vma->vm_pgoff - LOCKAMP_MMAP_DATA_PGOFF);
+	}
+	/* dma_mmap_coherent uses the page offset as an offset into the buffer */
+	vma->vm_pgoff -= LOCKAMP_MMAP_DATA_PGOFF;
+	return dma_mmap_coherent(lockamp->signal_buf_dev, vma, sbuf->buf,
+	                         lockamp->signal_buf_dma,
+	                         sbuf->capacity_n * sizeof(struct sample));
+}
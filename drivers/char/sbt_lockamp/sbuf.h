@@ -0,0 +1,28 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_SBUF_H_
+#define _LOCKAMP_SBUF_H_
+
+#include <linux/mm.h>
+#include <linux/platform_device.h>
+
+#include "lockin_amplifier.h"
+
+/* Room for the DMA reserve and the FIFO content */
+#define LOCKAMP_SIGNAL_BUF_MIN_CAPACITY (2 * LOCKAMP_FIFO_CAPACITY)
+
+int lockamp_sbuf_init(struct lockamp *lockamp, struct platform_device *pdev);
+void lockamp_sbuf_release(struct lockamp *lockamp);
+int lockamp_sbuf_resize(struct lockamp *lockamp, size_t capacity);
+void lockamp_sbuf_apply_multipliers(struct lockamp *lockamp, u32 from,
+                                    size_t size_n);
+void lockamp_sbuf_filter(struct lockamp *lockamp, u32 from, size_t size_n);
+void lockamp_sbuf_filtered(struct lockamp *lockamp, u32 tail, u32 size_n,
+                           u32 *skip_n, u32 *keep_n);
+int lockamp_sbuf_mmap(struct lockamp *lockamp, struct vm_area_struct *vma);
+
+#endif /* _LOCKAMP_SBUF_H_ */
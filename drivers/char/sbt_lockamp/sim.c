@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#include "hw.h"
+#include "sim.h"
+
+/*
+ * Simulated hardware
+ *
+ * Lets us exercise (and benchmark) the drain path, the signal buffer, and
+ * the readers without the PL. Load the module with "sim=1" to register a
+ * platform device that the driver binds to as usual. The device has no
+ * converters, no reset GPIO, no DMA, and no FIFO interrupt (so the polling
+ * kthread drains the FIFO).
+ *
+ * The control registers are plain memory (so regmap works as usual). Only
+ * the FIFO is simulated: It fills at the rate given by the configuration
+ * (see 'lockamp_time_step_ns'). Like the PL, it drops new samples while it
+ * is full. All entries of a sample hold the count of said sample (including
+ * the dropped ones) modulo 2^31. Thus, a reader can verify the data and
+ * locate any loss.
+ *
+ * The zero-cost FIFO reads mean that the benchmark results are an upper
+ * bound of the hardware throughput.
+ */
+
+/* Up to and including the last register (LOCKAMP_REG_FIR_COEF_BASE plus
+ * the coefficients and the end of the regmap) */
+#define LOCKAMP_SIM_CONTROL_SIZE (0x1000 + sizeof(u32))
+#define LOCKAMP_SIM_VALUE_MASK   0x7fffffff
+
+struct lockamp_sim {
+	spinlock_t lock;
+	/* Time of the latest sample that the PL produced */
+	u64 last_ns;
+	/* The count of each sample in the FIFO */
+	u32 fifo[LOCKAMP_FIFO_CAPACITY_N];
+	u32 front;
+	u32 level_n;
+	/* Entries of the front sample that were already popped */
+	u32 front_entry;
+	/* Count of the next sample that the PL produces */
+	u32 next_count;
+};
+
+static bool lockamp_sim_enabled;
+module_param_named(sim, lockamp_sim_enabled, bool, 0444);
+MODULE_PARM_DESC(sim, "Register a simulated lock-in amplifier");
+
+static struct platform_device *lockamp_sim_pdev;
+
+int lockamp_sim_register(void)
+{
+	struct platform_device *pdev;
+	if (!lockamp_sim_enabled) {
+		return 0;
+	}
+	pdev = platform_device_register_simple(LOCKAMP_SIM_NAME,
+	                                       PLATFORM_DEVID_NONE, NULL, 0);
+	if (IS_ERR(pdev)) {
+		return PTR_ERR(pdev);
+	}
+	lockamp_sim_pdev = pdev;
+	return 0;
+}
+
+void lockamp_sim_unregister(void)
+{
+	if (NULL == lockamp_sim_pdev) {
+		return;
+	}
+	platform_device_unregister(lockamp_sim_pdev);
+	lockamp_sim_pdev = NULL;
+}
+
+bool lockamp_is_sim(struct platform_device *pdev)
+{
+	return 0 == strcmp(pdev->name, LOCKAMP_SIM_NAME);
+}
+
+/* Write the register defaults directly (before the regmap reads them) */
+static void lockamp_sim_init_registers(struct lockamp *lockamp)
+{
+	/* A time step of 2728 ns at decimation 1 (see 'lockamp_set_decimation') */
+	iowrite32(341, lockamp->control + LOCKAMP_REG_CIC_LENGTH);
+	iowrite32(1, lockamp->control + LOCKAMP_REG_CIC_SCALE);
+	iowrite32(LOCKAMP_MA_LENGTH_MIN, lockamp->control + LOCKAMP_REG_MA_LENGTH);
+	iowrite32(LOCKAMP_MA_SCALE_MIN, lockamp->control + LOCKAMP_REG_MA_SCALE);
+	iowrite32(0, lockamp->control + LOCKAMP_REG_HB_FILTERS);
+	iowrite32(lockamp_decimation_fir_cycles(0),
+	          lockamp->control + LOCKAMP_REG_FIR_CYCLES);
+}
+
+int lockamp_sim_init(struct lockamp *lockamp)
+{
+	struct lockamp_sim *sim;
+	void *control;
+	sim = devm_kzalloc(lockamp->dev, sizeof(*sim), GFP_KERNEL);
+	if (NULL == sim) {
+		return -ENOMEM;
+	}
+	control = devm_kzalloc(lockamp->dev, LOCKAMP_SIM_CONTROL_SIZE, GFP_KERNEL);
+	if (NULL == control) {
+		return -ENOMEM;
+	}
+	spin_lock_init(&sim->lock);
+	sim->last_ns = ktime_get_ns();
+	lockamp->control = (u8 __force __iomem *)control;
+	lockamp->sim = sim;
+	lockamp_sim_init_registers(lockamp);
+	dev_info(lockamp->dev, "Using the simulated FIFO\n");
+	return 0;
+}
+
+/* Like the PL reset: Clear the FIFO */
+void lockamp_sim_reset(struct lockamp *lockamp)
+{
+	struct lockamp_sim *sim = lockamp->sim;
+	if (NULL == sim) {
+		return;
+	}
+	spin_lock(&sim->lock);
+	sim->level_n = 0;
+	sim->front_entry = 0;
+	sim->last_ns = ktime_get_ns();
+	spin_unlock(&sim->lock);
+}
+
+/* Move the FIFO forward to the current time. Call with the lock held. */
+static void lockamp_sim_produce(struct lockamp *lockamp, struct lockamp_sim *sim)
+{
+	unsigned int time_step_ns = lockamp_time_step_ns(lockamp);
+	u64 now_ns = ktime_get_ns();
+	u64 produced_n;
+	u32 accepted_n;
+	u32 i;
+	if (0 == time_step_ns) {
+		sim->last_ns = now_ns;
+		return;
+	}
+	produced_n = div_u64(now_ns - sim->last_ns, time_step_ns);
+	sim->last_ns += produced_n * time_step_ns;
+	accepted_n = min_t(u64, produced_n, LOCKAMP_FIFO_CAPACITY_N - sim->level_n);
+	for (i = 0; accepted_n != i; ++i) {
+		sim->fifo[(sim->front + sim->level_n) % LOCKAMP_FIFO_CAPACITY_N] =
+			sim->next_count++;
+		++sim->level_n;
+	}
+	/* The PL drops the rest */
+	sim->next_count += (u32)(produced_n - accepted_n);
+}
+
+u32 lockamp_sim_fifo_size_s32(struct lockamp *lockamp)
+{
+	struct lockamp_sim *sim = lockamp->sim;
+	u32 size_s32;
+	spin_lock(&sim->lock);
+	lockamp_sim_produce(lockamp, sim);
+	size_s32 = sim->level_n * LOCKAMP_ENTRIES_PER_SAMPLE - sim->front_entry;
+	spin_unlock(&sim->lock);
+	return size_s32;
+}
+
+void lockamp_sim_fifo_pop_rep(struct lockamp *lockamp, s32 *dst, size_t count)
+{
+	struct lockamp_sim *sim = lockamp->sim;
+	s32 value;
+	size_t i = 0;
+	spin_lock(&sim->lock);
+	while (count != i && 0 != sim->level_n) {
+		value = sim->fifo[sim->front] & LOCKAMP_SIM_VALUE_MASK;
+		for (; count != i && LOCKAMP_ENTRIES_PER_SAMPLE != sim->front_entry;
+		     ++sim->front_entry) {
+			dst[i++] = value;
+		}
+		if (LOCKAMP_ENTRIES_PER_SAMPLE == sim->front_entry) {
+			sim->front = (sim->front + 1) % LOCKAMP_FIFO_CAPACITY_N;
+			sim->front_entry = 0;
+			--sim->level_n;
+		}
+	}
+	spin_unlock(&sim->lock);
+	/* Like an empty FIFO in the PL */
+	memset(dst + i, 0, (count - i) * sizeof(s32));
+}
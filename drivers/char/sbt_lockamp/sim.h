@@ -0,0 +1,47 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_SIM_H_
+#define _LOCKAMP_SIM_H_
+
+#include <linux/platform_device.h>
+
+#include "lockin_amplifier.h"
+
+/* Name of the simulated platform device (and its /dev entry) */
+#define LOCKAMP_SIM_NAME "sbt-lockamp-sim"
+
+#ifdef CONFIG_SBT_LOCKAMP_SIM
+extern int lockamp_sim_register(void);
+extern void lockamp_sim_unregister(void);
+extern bool lockamp_is_sim(struct platform_device *pdev);
+extern int lockamp_sim_init(struct lockamp *lockamp);
+extern void lockamp_sim_reset(struct lockamp *lockamp);
+extern u32 lockamp_sim_fifo_size_s32(struct lockamp *lockamp);
+extern void lockamp_sim_fifo_pop_rep(struct lockamp *lockamp, s32 *dst,
+                                     size_t count);
+#else
+static inline int lockamp_sim_register(void)
+{
+	return 0;
+}
+static inline void lockamp_sim_unregister(void)
+{
+}
+static inline bool lockamp_is_sim(struct platform_device *pdev)
+{
+	return false;
+}
+static inline int lockamp_sim_init(struct lockamp *lockamp)
+{
+	return -ENODEV;
+}
+static inline void lockamp_sim_reset(struct lockamp *lockamp)
+{
+}
+#endif
+
+#endif /* _LOCKAMP_SIM_H_ */
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+
+#include "stats.h"
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/lockamp.h>
+
+void lockamp_stats_init(struct lockamp *lockamp)
+{
+	memset(&lockamp->stats, 0, sizeof(lockamp->stats));
+}
+
+static void show_hist(struct seq_file *m, const char *name, const u32 *hist)
+{
+	int i;
+	seq_printf(m, "%s:", name);
+	for (i = 0; LOCKAMP_STATS_BINS > i; ++i) {
+		seq_printf(m, " %u", READ_ONCE(hist[i]));
+	}
+	seq_puts(m, "\n");
+}
+
+/*
+ * Everything in a single file so that tools can sample all of it at once.
+ * The histograms are written by the producer without locks. Thus, the bins
+ * may be slightly out of sync with each other.
+ */
+static int stats_show(struct seq_file *m, void *data)
+{
+	struct lockamp *lockamp = m->private;
+	struct lockamp_stats *stats = &lockamp->stats;
+	seq_printf(m, "drain_duration_ns:\t%llu\n", READ_ONCE(stats->drain_duration_ns));
+	seq_printf(m, "read_delay_ns:\t%llu\n", READ_ONCE(stats->read_delay_ns));
+	seq_printf(m, "ma_time_step_ns:\t%u\n", READ_ONCE(stats->ma_time_step_ns));
+	seq_printf(m, "wakeup_latency_ns:\t%llu\n", READ_ONCE(stats->wakeup_latency_ns));
+	seq_printf(m, "wakeup_latency_max_ns:\t%llu\n", READ_ONCE(stats->wakeup_latency_max_ns));
+	seq_printf(m, "fifo_high:\t%d\n", atomic_read(&stats->fifo_high));
+	seq_printf(m, "fifo_overruns:\t%d\n", atomic_read(&stats->fifo_overruns));
+	seq_printf(m, "fifo_lost_samples:\t%lld\n", atomic64_read(&stats->fifo_lost_n));
+	seq_printf(m, "overruns:\t%d\n", atomic_read(&stats->overruns));
+	seq_printf(m, "lost_samples:\t%lld\n", atomic64_read(&stats->lost_n));
+	seq_printf(m, "invalid_mmap_tails:\t%d\n", atomic_read(&stats->invalid_mmap_tails));
+	seq_printf(m, "dma_errors:\t%d\n", atomic_read(&stats->dma_errors));
+	show_hist(m, "drain_duration_log2_us", stats->drain_duration_hist);
+	show_hist(m, "fifo_fill_sixteenths", stats->fifo_fill_hist);
+	show_hist(m, "wakeup_latency_log2_us", stats->wakeup_latency_hist);
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(stats);
+
+void lockamp_debugfs_init(struct lockamp *lockamp)
+{
+	/* debugfs is optional. Don't check the return values. */
+	lockamp->debugfs = debugfs_create_dir(dev_name(lockamp->dev), NULL);
+	debugfs_create_file("stats", S_IRUGO, lockamp->debugfs, lockamp,
+	                    &stats_fops);
+}
+
+void lockamp_debugfs_remove(struct lockamp *lockamp)
+{
+	debugfs_remove_recursive(lockamp->debugfs);
+	lockamp->debugfs = NULL;
+}
@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_STATS_H_
+#define _LOCKAMP_STATS_H_
+
+#include <linux/atomic.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/types.h>
+
+#include "lockin_amplifier.h"
+
+extern void lockamp_stats_init(struct lockamp *lockamp);
+extern void lockamp_debugfs_init(struct lockamp *lockamp);
+extern void lockamp_debugfs_remove(struct lockamp *lockamp);
+
+/* Bin i holds durations in [2^i; 2^(i+1)) us. Bin 0 also holds the
+ * durations less than 1 us. */
+static inline unsigned int lockamp_stats_log2_us_bin(u64 duration_ns)
+{
+	u64 duration_us = div_u64(duration_ns, 1000);
+	unsigned int bin = 0 < duration_us ? ilog2(duration_us) : 0;
+	return min_t(unsigned int, bin, LOCKAMP_STATS_BINS - 1);
+}
+
+/* Only called by the producer */
+static inline void lockamp_stats_drain(struct lockamp *lockamp, u64 duration_ns)
+{
+	struct lockamp_stats *stats = &lockamp->stats;
+	unsigned int bin = lockamp_stats_log2_us_bin(duration_ns);
+	WRITE_ONCE(stats->drain_duration_ns, duration_ns);
+	WRITE_ONCE(stats->drain_duration_hist[bin], stats->drain_duration_hist[bin] + 1);
+}
+
+/*
+ * Note the time of the event that the next drain responds to: the expiry
+ * of the kthread's timer, the FIFO interrupt, or the end of a DMA (or AMP)
+ * period. If the drain did not run since the last event, we keep the time
+ * of that one. Safe to call from any context.
+ */
+static inline void lockamp_stats_kick(struct lockamp *lockamp)
+{
+	atomic64_cmpxchg(&lockamp->stats.kick_ns, 0, ktime_get_ns());
+}
+
+/*
+ * Only called by the producer, when the drain starts. Returns the wakeup
+ * latency (the time since 'lockamp_stats_kick') or zero if there was no
+ * kick.
+ */
+static inline u64 lockamp_stats_wakeup(struct lockamp *lockamp)
+{
+	struct lockamp_stats *stats = &lockamp->stats;
+	u64 kick_ns = atomic64_xchg(&stats->kick_ns, 0);
+	u64 now_ns = ktime_get_ns();
+	u64 latency_ns;
+	unsigned int bin;
+	if (0 == kick_ns || now_ns < kick_ns) {
+		return 0;
+	}
+	latency_ns = now_ns - kick_ns;
+	bin = lockamp_stats_log2_us_bin(latency_ns);
+	WRITE_ONCE(stats->wakeup_latency_ns, latency_ns);
+	if (stats->wakeup_latency_max_ns < latency_ns) {
+		WRITE_ONCE(stats->wakeup_latency_max_ns, latency_ns);
+	}
+	WRITE_ONCE(stats->wakeup_latency_hist[bin], stats->wakeup_latency_hist[bin] + 1);
+	return latency_ns;
+}
+
+/* Only called by the producer */
+static inline void lockamp_stats_fifo_fill(struct lockamp *lockamp, size_t fifo_n)
+{
+	struct lockamp_stats *stats = &lockamp->stats;
+	/* Bin i holds fill levels in [i/BINS; (i+1)/BINS) of the capacity */
+	unsigned int bin = fifo_n * LOCKAMP_STATS_BINS / LOCKAMP_FIFO_CAPACITY_N;
+	bin = min_t(unsigned int, bin, LOCKAMP_STATS_BINS - 1);
+	WRITE_ONCE(stats->fifo_fill_hist[bin], stats->fifo_fill_hist[bin] + 1);
+}
+
+#endif
@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#include <linux/mm.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "config.h"
+#include "hw.h"
+#include "sweep.h"
+
+/*
+ * Frequency sweep (LOCKAMP_IOC_START_SWEEP)
+ *
+ * The drain path (see 'drain_fifo') calls 'lockamp_sweep_advance' each time
+ * it moved samples into the signal buffer. Once the PL produced 'dwell_n'
+ * samples of the current step, we write the generator registers of the
+ * next step and mark the transition (see 'lockamp_config_mark').
+ *
+ * Thus, the transitions happen on sample counts. They are late by at most
+ * the drain interval. The polling kthread shortens its sleep to the next
+ * transition (see 'lockamp_sweep_delay_ns'). Either way, each step lasts
+ * for at least 'dwell_n' samples and the marker gives the exact count.
+ *
+ * The sweep state is protected by 'signal_buf_m'.
+ */
+struct lockamp_sweep_state {
+	struct lockamp_sweep_step *steps;
+	u32 step_count;
+	struct lockamp_gen_control *gen;
+	u32 flags;
+	u32 index;
+	/* Count of the first sample of the next step */
+	u32 next_count;
+	/* The file that started the sweep */
+	struct lockamp_reader *owner;
+};
+
+static void free_state(struct lockamp_sweep_state *state)
+{
+	kvfree(state->steps);
+	kfree(state);
+}
+
+/* Call with 'signal_buf_m' held */
+static int apply_step(struct lockamp *lockamp, struct lockamp_sweep_state *state,
+                      u32 *seq)
+{
+	const struct lockamp_sweep_step *step = &state->steps[state->index];
+	struct reg_sequence regs[] = {
+		{ state->gen->step_int, step->step_int },
+		{ state->gen->step_frac, step->step_frac },
+		/* Only 18 MSB are used. See 'lockamp_set_gen_scale'. */
+		{ state->gen->scale, step->scale << 14 },
+	};
+	u32 count;
+	int ret = regmap_multi_reg_write(lockamp->regmap, regs, ARRAY_SIZE(regs));
+	if (ret < 0) {
+		return ret;
+	}
+	ret = lockamp_config_mark(lockamp, &count, seq);
+	if (ret < 0) {
+		return ret;
+	}
+	state->next_count = count + step->dwell_n;
+	WRITE_ONCE(lockamp->sweep_delay_ns, lockamp_duration_ns(lockamp, step->dwell_n));
+	return 0;
+}
+
+/* Call with 'signal_buf_m' held */
+static void uninstall(struct lockamp *lockamp)
+{
+	free_state(lockamp->sweep);
+	lockamp->sweep = NULL;
+	WRITE_ONCE(lockamp->sweep_delay_ns, 0);
+}
+
+static int validate(struct lockamp_sweep *sweep, struct lockamp_sweep_step *steps)
+{
+	int ret;
+	u32 i;
+	for (i = 0; sweep->step_count > i; ++i) {
+		ret = lockamp_adjust_gen_scale((s32 *)&steps[i].scale);
+		if (ret < 0) {
+			return ret;
+		}
+		if (U16_MAX < steps[i].step_frac || 0 == steps[i].dwell_n) {
+			return -EINVAL;
+		}
+	}
+	return 0;
+}
+
+/* The caller must hold a PM reference */
+int lockamp_sweep_start(struct lockamp *lockamp, struct lockamp_reader *owner,
+                        struct lockamp_sweep *sweep)
+{
+	struct lockamp_sweep_state *state;
+	int ret;
+	if (0 == sweep->step_count || LOCKAMP_SWEEP_MAX_STEPS < sweep->step_count) {
+		return -EINVAL;
+	}
+	if (1 < sweep->gen || (sweep->flags & ~LOCKAMP_SWEEP_LOOP)) {
+		return -EINVAL;
+	}
+	state = kzalloc(sizeof(*state), GFP_KERNEL);
+	if (NULL == state) {
+		return -ENOMEM;
+	}
+	state->steps = vmemdup_user(u64_to_user_ptr(sweep->steps),
+	                            sweep->step_count * sizeof(*state->steps));
+	if (IS_ERR(state->steps)) {
+		ret = PTR_ERR(state->steps);
+		kfree(state);
+		return ret;
+	}
+	ret = validate(sweep, state->steps);
+	if (ret < 0) {
+		free_state(state);
+		return ret;
+	}
+	state->step_count = sweep->step_count;
+	state->gen = 0 == sweep->gen ? &LOCKAMP_GEN1_CONTROL : &LOCKAMP_GEN2_CONTROL;
+	state->flags = sweep->flags;
+	state->owner = owner;
+	mutex_lock(&lockamp->signal_buf_m);
+	/* Replaces the current sweep (if any) */
+	if (NULL != lockamp->sweep) {
+		uninstall(lockamp);
+	}
+	ret = apply_step(lockamp, state, &sweep->seq);
+	if (ret < 0) {
+		free_state(state);
+		goto out;
+	}
+	lockamp->sweep = state;
+out:
+	mutex_unlock(&lockamp->signal_buf_m);
+	return ret;
+}
+
+/* Stop the sweep. If 'owner' is given, only if said file started it. */
+void lockamp_sweep_stop(struct lockamp *lockamp, struct lockamp_reader *owner)
+{
+	mutex_lock(&lockamp->signal_buf_m);
+	if (NULL != lockamp->sweep && (NULL == owner || lockamp->sweep->owner == owner)) {
+		uninstall(lockamp);
+	}
+	mutex_unlock(&lockamp->signal_buf_m);
+}
+
+/* Call with 'signal_buf_m' held */
+void lockamp_sweep_advance(struct lockamp *lockamp)
+{
+	struct lockamp_sweep_state *state = lockamp->sweep;
+	u32 count;
+	u32 seq;
+	int ret;
+	if (NULL == state) {
+		return;
+	}
+	ret = lockamp_produced_count(lockamp, &count);
+	if (ret < 0) {
+		goto out_stop;
+	}
+	if ((s32)(count - state->next_count) < 0) {
+		WRITE_ONCE(lockamp->sweep_delay_ns,
+		           lockamp_duration_ns(lockamp, state->next_count - count));
+		return;
+	}
+	++state->index;
+	if (state->step_count == state->index) {
+		if (!(state->flags & LOCKAMP_SWEEP_LOOP)) {
+			uninstall(lockamp);
+			return;
+		}
+		state->index = 0;
+	}
+	ret = apply_step(lockamp, state, &seq);
+	if (ret < 0) {
+		goto out_stop;
+	}
+	return;
+
+out_stop:
+	dev_err(lockamp->dev, "Stopped the sweep at step %u: %d\n", state->index, ret);
+	uninstall(lockamp);
+}
+
+/* Index of the current step. Negative if there is no sweep. */
+int lockamp_sweep_step(struct lockamp *lockamp)
+{
+	int step = -1;
+	mutex_lock(&lockamp->signal_buf_m);
+	if (NULL != lockamp->sweep) {
+		step = lockamp->sweep->index;
+	}
+	mutex_unlock(&lockamp->signal_buf_m);
+	return step;
+}
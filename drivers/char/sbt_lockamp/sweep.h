@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LOCKAMP_SWEEP_H_
+#define _LOCKAMP_SWEEP_H_
+
+#include "lockin_amplifier.h"
+
+#ifdef CONFIG_SBT_LOCKAMP_USE_SBUF
+extern int lockamp_sweep_start(struct lockamp *lockamp,
+                               struct lockamp_reader *owner,
+                               struct lockamp_sweep *sweep);
+extern void lockamp_sweep_stop(struct lockamp *lockamp,
+                               struct lockamp_reader *owner);
+extern void lockamp_sweep_advance(struct lockamp *lockamp);
+extern int lockamp_sweep_step(struct lockamp *lockamp);
+#else
+static inline int lockamp_sweep_start(struct lockamp *lockamp,
+                                      struct lockamp_reader *owner,
+                                      struct lockamp_sweep *sweep)
+{
+	return -EOPNOTSUPP;
+}
+static inline void lockamp_sweep_stop(struct lockamp *lockamp,
+                                      struct lockamp_reader *owner)
+{
+}
+static inline void lockamp_sweep_advance(struct lockamp *lockamp)
+{
+}
+static inline int lockamp_sweep_step(struct lockamp *lockamp)
+{
+	return -1;
+}
+#endif
+
+/* Time until the next step (zero if there is no sweep). See fops.c. */
+static inline unsigned long lockamp_sweep_delay_ns(struct lockamp *lockamp)
+{
+	return READ_ONCE(lockamp->sweep_delay_ns);
+}
+
+#endif /* _LOCKAMP_SWEEP_H_ */
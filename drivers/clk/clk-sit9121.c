@@ -2,19 +2,29 @@
 /*
  * Copyright (C) 2019 Frederik Peter Aalund <fpa@sbtinstruments.com>
  */
+#include <linux/clk.h>
 #include <linux/clk-provider.h>
+#include <linux/math64.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
 #include <linux/pm.h>
 #include <linux/pm_runtime.h>
 #include <linux/regulator/consumer.h>
+#include <linux/time64.h>
+
+/* Measurements may deviate this much from 'clock-frequency' if the device
+ * tree does not give 'clock-accuracy' */
+#define SIT9121_DEFAULT_ACCURACY_PPB 100000
 
 struct sit9121 {
 	struct clk_hw hw;
 	struct regulator *vdd;
 	unsigned long fixed_rate;
 	unsigned long fixed_accuracy;
+	/* The measured rate (see 'measured_rate_store'). Zero if there is no
+	 * measurement. Then, we report 'fixed_rate'. */
+	unsigned long measured_rate;
 };
 
 #define to_sit9121(_hw) container_of(_hw, struct sit9121, hw)
@@ -38,7 +48,42 @@ static void sit9121_unprepare(struct clk_hw *hw)
 static unsigned long sit9121_recalc_rate(struct clk_hw *hw,
                                          unsigned long parent_rate)
 {
-	return to_sit9121(hw)->fixed_rate;
+	struct sit9121 *sit9121 = to_sit9121(hw);
+	if (0 != sit9121->measured_rate) {
+		return sit9121->measured_rate;
+	}
+	return sit9121->fixed_rate;
+}
+
+/* The oscillator has a single rate. A "rate change" is a measurement of
+ * said rate. We accept measurements within the accuracy of the oscillator
+ * (anything else is a bad measurement). */
+static void sit9121_rate_range(struct sit9121 *sit9121, unsigned long *min,
+                               unsigned long *max)
+{
+	unsigned long accuracy = sit9121->fixed_accuracy ?
+		sit9121->fixed_accuracy : SIT9121_DEFAULT_ACCURACY_PPB;
+	unsigned long deviation = div_u64((u64)sit9121->fixed_rate * accuracy,
+	                                  NSEC_PER_SEC);
+	*min = sit9121->fixed_rate - deviation;
+	*max = sit9121->fixed_rate + deviation;
+}
+
+static long sit9121_round_rate(struct clk_hw *hw, unsigned long rate,
+                               unsigned long *parent_rate)
+{
+	unsigned long min, max;
+	sit9121_rate_range(to_sit9121(hw), &min, &max);
+	return clamp(rate, min, max);
+}
+
+/* Consumers get the usual rate change notifications */
+static int sit9121_set_rate(struct clk_hw *hw, unsigned long rate,
+                            unsigned long parent_rate)
+{
+	struct sit9121 *sit9121 = to_sit9121(hw);
+	sit9121->measured_rate = rate == sit9121->fixed_rate ? 0 : rate;
+	return 0;
 }
 
 static unsigned long sit9121_recalc_accuracy(struct clk_hw *hw,
@@ -51,9 +96,71 @@ const struct clk_ops sit9121_ops = {
 	.prepare = sit9121_prepare,
 	.unprepare = sit9121_unprepare,
 	.recalc_rate = sit9121_recalc_rate,
+	.round_rate = sit9121_round_rate,
+	.set_rate = sit9121_set_rate,
 	.recalc_accuracy = sit9121_recalc_accuracy,
 };
 
+/* measured_rate
+ *
+ * Read: The current rate in Hz (measured or nominal).
+ *
+ * Write: "<cycles> <interval_ns>" where <cycles> is the count of clock
+ * cycles over a reference interval of <interval_ns>. E.g., from a counter
+ * gated by a PTP- or GPS-disciplined PPS. Or "0" to go back to the nominal
+ * rate ('clock-frequency').
+ */
+static ssize_t measured_rate_show(struct device *dev,
+                                  struct device_attribute *attr, char *buf)
+{
+	struct sit9121 *sit9121 = dev_get_drvdata(dev);
+	return scnprintf(buf, PAGE_SIZE, "%lu\n", clk_get_rate(sit9121->hw.clk));
+}
+
+static ssize_t measured_rate_store(struct device *dev,
+                                   struct device_attribute *attr,
+                                   const char *buf, size_t count)
+{
+	struct sit9121 *sit9121 = dev_get_drvdata(dev);
+	unsigned long min, max;
+	u64 cycles, interval_ns;
+	u64 rate;
+	int error;
+	int n = sscanf(buf, "%llu %llu", &cycles, &interval_ns);
+	if (1 == n && 0 == cycles) {
+		rate = sit9121->fixed_rate;
+	} else if (2 == n && 0 != interval_ns) {
+		/* cycles * 10^9 must fit in 64 bits (~147 s at 125 MHz) */
+		if (cycles > div_u64(U64_MAX, NSEC_PER_SEC)) {
+			return -ERANGE;
+		}
+		rate = DIV64_U64_ROUND_CLOSEST(cycles * NSEC_PER_SEC, interval_ns);
+		sit9121_rate_range(sit9121, &min, &max);
+		if (rate < min || max < rate) {
+			dev_warn(dev, "Measured rate %llu Hz is out of range [%lu; %lu]\n",
+			         rate, min, max);
+			return -ERANGE;
+		}
+	} else {
+		return -EINVAL;
+	}
+	error = clk_set_rate(sit9121->hw.clk, rate);
+	if (error) {
+		return error;
+	}
+	return count;
+}
+static DEVICE_ATTR_RW(measured_rate);
+
+static struct attribute *sit9121_attrs[] = {
+	&dev_attr_measured_rate.attr,
+	NULL,
+};
+
+static const struct attribute_group sit9121_group = {
+	.attrs = sit9121_attrs,
+};
+
 static int sit9121_probe(struct platform_device *pdev)
 {
 	struct sit9121 *sit9121;
@@ -104,6 +211,10 @@ static int sit9121_probe(struct platform_device *pdev)
 	if (error) {
 		return error;
 	}
+	error = devm_device_add_group(&pdev->dev, &sit9121_group);
+	if (error) {
+		return error;
+	}
 
 	return 0;
 }
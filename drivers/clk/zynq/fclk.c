@@ -0,0 +1,263 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Zynq FCLK divider driver
+ *
+ * Each PL clock (FCLK) has two cascaded 6 bit dividers in its
+ * FPGAx_CLK_CTRL register. This driver treats them as a single divider.
+ * A rate change then writes both divisors at once instead of one after
+ * the other. In turn, the PL never runs at the rate in between. It also
+ * never touches the parent (the mux and the PLL). Thus, the PL clock keeps
+ * running while the rate changes.
+ *
+ * The products of the two divisors are in a table that is built (in
+ * ascending order) once at boot. A rate lookup is then a binary search.
+ */
+#include <linux/clk/zynq.h>
+#include <linux/clk-provider.h>
+#include <linux/io.h>
+#include <linux/slab.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/clk_zynq.h>
+
+/**
+ * struct zynq_fclk_div
+ * @hw:		Handle between common and hardware-specific interfaces
+ * @clk_ctrl:	FPGAx_CLK_CTRL register
+ * @lock:	Register lock (shared with the mux in the same register)
+ */
+struct zynq_fclk_div {
+	struct clk_hw	hw;
+	void __iomem	*clk_ctrl;
+	spinlock_t	*lock;
+};
+#define to_zynq_fclk_div(_hw)	container_of(_hw, struct zynq_fclk_div, hw)
+
+/* Register bitfield defines */
+#define FCLK_DIV0_MASK		0x3f00
+#define FCLK_DIV0_SHIFT		8
+#define FCLK_DIV1_MASK		0x3f00000
+#define FCLK_DIV1_SHIFT		20
+
+#define FCLK_DIV_MAX		63
+
+/**
+ * struct zynq_fclk_div_entry
+ * @div:	Total divisor (@div0 * @div1)
+ * @div0:	Divisor of the first divider
+ * @div1:	Divisor of the second divider
+ */
+struct zynq_fclk_div_entry {
+	u16	div;
+	u8	div0;
+	u8	div1;
+};
+
+/* All total divisors that the two dividers can do, in ascending order */
+static struct zynq_fclk_div_entry *zynq_fclk_div_table;
+static unsigned int zynq_fclk_div_table_n;
+
+/**
+ * zynq_fclk_div_table_init() - Build the divisor table (once)
+ * Returns 0 on success or negative errno.
+ */
+static int __init zynq_fclk_div_table_init(void)
+{
+	struct zynq_fclk_div_entry *table;
+	unsigned int div0, div1, div, n = 0;
+	u16 *pairs;
+
+	if (zynq_fclk_div_table)
+		return 0;
+
+	/* For each total divisor, the first pair that gives it (if any) */
+	pairs = kcalloc(FCLK_DIV_MAX * FCLK_DIV_MAX + 1, sizeof(*pairs),
+			GFP_KERNEL);
+	if (!pairs)
+		return -ENOMEM;
+
+	for (div0 = 1; div0 <= FCLK_DIV_MAX; div0++) {
+		for (div1 = 1; div1 <= FCLK_DIV_MAX; div1++) {
+			div = div0 * div1;
+			if (!pairs[div]) {
+				pairs[div] = (div0 << 8) | div1;
+				n++;
+			}
+		}
+	}
+
+	table = kcalloc(n, sizeof(*table), GFP_KERNEL);
+	if (!table) {
+		kfree(pairs);
+		return -ENOMEM;
+	}
+
+	n = 0;
+	for (div = 1; div <= FCLK_DIV_MAX * FCLK_DIV_MAX; div++) {
+		if (!pairs[div])
+			continue;
+		table[n].div = div;
+		table[n].div0 = pairs[div] >> 8;
+		table[n].div1 = pairs[div] & 0xff;
+		n++;
+	}
+	kfree(pairs);
+
+	zynq_fclk_div_table = table;
+	zynq_fclk_div_table_n = n;
+
+	return 0;
+}
+
+/**
+ * zynq_fclk_div_lookup() - Find the divisors for a rate
+ * @rate:	Desired clock frequency
+ * @prate:	Clock frequency of the parent clock
+ * Returns the entry with the smallest total divisor at which the rate does
+ * not exceed @rate (or the largest total divisor if there is none).
+ */
+static const struct zynq_fclk_div_entry *
+zynq_fclk_div_lookup(unsigned long rate, unsigned long prate)
+{
+	unsigned int lo = 0, hi = zynq_fclk_div_table_n - 1, mid;
+	unsigned long div;
+
+	if (!rate)
+		return &zynq_fclk_div_table[hi];
+
+	div = DIV_ROUND_UP(prate, rate);
+	if (div > zynq_fclk_div_table[hi].div)
+		return &zynq_fclk_div_table[hi];
+
+	/* The first total divisor that is at least @div */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (zynq_fclk_div_table[mid].div < div)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return &zynq_fclk_div_table[lo];
+}
+
+/**
+ * zynq_fclk_div_round_rate() - Round a clock frequency
+ * @hw:		Handle between common and hardware-specific interfaces
+ * @rate:	Desired clock frequency
+ * @prate:	Clock frequency of parent clock
+ * Returns frequency closest to @rate (but not above) the dividers can
+ * generate.
+ */
+static long zynq_fclk_div_round_rate(struct clk_hw *hw, unsigned long rate,
+		unsigned long *prate)
+{
+	return DIV_ROUND_UP(*prate, zynq_fclk_div_lookup(rate, *prate)->div);
+}
+
+/**
+ * zynq_fclk_div_recalc_rate() - Recalculate clock frequency
+ * @hw:			Handle between common and hardware-specific interfaces
+ * @parent_rate:	Clock frequency of parent clock
+ * Returns current clock frequency.
+ */
+static unsigned long zynq_fclk_div_recalc_rate(struct clk_hw *hw,
+		unsigned long parent_rate)
+{
+	struct zynq_fclk_div *clk = to_zynq_fclk_div(hw);
+	u32 reg = readl(clk->clk_ctrl);
+	u32 div0 = (reg & FCLK_DIV0_MASK) >> FCLK_DIV0_SHIFT;
+	u32 div1 = (reg & FCLK_DIV1_MASK) >> FCLK_DIV1_SHIFT;
+
+	/* Zero divides by one (like CLK_DIVIDER_ALLOW_ZERO) */
+	return DIV_ROUND_UP(parent_rate, max(div0, 1U) * max(div1, 1U));
+}
+
+/**
+ * zynq_fclk_div_set_rate() - Change the clock frequency
+ * @hw:			Handle between common and hardware-specific interfaces
+ * @rate:		Rounded clock frequency
+ * @parent_rate:	Clock frequency of parent clock
+ * Returns 0 on success
+ */
+static int zynq_fclk_div_set_rate(struct clk_hw *hw, unsigned long rate,
+		unsigned long parent_rate)
+{
+	struct zynq_fclk_div *clk = to_zynq_fclk_div(hw);
+	const struct zynq_fclk_div_entry *entry;
+	unsigned long flags = 0;
+	u32 reg;
+
+	entry = zynq_fclk_div_lookup(rate, parent_rate);
+
+	spin_lock_irqsave(clk->lock, flags);
+
+	/* Both divisors in a single write */
+	reg = readl(clk->clk_ctrl);
+	reg &= ~(FCLK_DIV0_MASK | FCLK_DIV1_MASK);
+	reg |= entry->div0 << FCLK_DIV0_SHIFT;
+	reg |= entry->div1 << FCLK_DIV1_SHIFT;
+	writel(reg, clk->clk_ctrl);
+
+	spin_unlock_irqrestore(clk->lock, flags);
+
+	trace_zynq_fclk_set_rate(clk_hw_get_name(hw), parent_rate, entry->div0,
+				 entry->div1);
+
+	return 0;
+}
+
+static const struct clk_ops zynq_fclk_div_ops = {
+	.round_rate = zynq_fclk_div_round_rate,
+	.recalc_rate = zynq_fclk_div_recalc_rate,
+	.set_rate = zynq_fclk_div_set_rate
+};
+
+/**
+ * clk_register_zynq_fclk_div() - Register FCLK dividers with the clock
+ *				  framework
+ * @name	Divider name
+ * @parent	Parent clock name
+ * @clk_ctrl	Pointer to FPGAx_CLK_CTRL register
+ * @lock	Register lock
+ * Returns handle to the registered clock.
+ */
+struct clk *__init clk_register_zynq_fclk_div(const char *name,
+		const char *parent, void __iomem *clk_ctrl, spinlock_t *lock)
+{
+	struct zynq_fclk_div *div;
+	struct clk *clk;
+	const char *parent_arr[1] = {parent};
+	struct clk_init_data initd = {
+		.name = name,
+		.parent_names = parent_arr,
+		.ops = &zynq_fclk_div_ops,
+		.num_parents = 1,
+		.flags = 0
+	};
+	int ret;
+
+	ret = zynq_fclk_div_table_init();
+	if (ret)
+		return ERR_PTR(ret);
+
+	div = kmalloc(sizeof(*div), GFP_KERNEL);
+	if (!div)
+		return ERR_PTR(-ENOMEM);
+
+	/* Populate the struct */
+	div->hw.init = &initd;
+	div->clk_ctrl = clk_ctrl;
+	div->lock = lock;
+
+	clk = clk_register(NULL, &div->hw);
+	if (WARN_ON(IS_ERR(clk)))
+		goto free_div;
+
+	return clk;
+
+free_div:
+	kfree(div);
+
+	return clk;
+}
@@ -23,6 +23,9 @@
 
 #include <asm/cputype.h>
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/arm_global_timer.h>
+
 #define GT_COUNTER0	0x00
 #define GT_COUNTER1	0x04
 
@@ -50,6 +53,18 @@ static unsigned long gt_clk_rate;
 static int gt_ppi;
 static struct clock_event_device __percpu *gt_evt;
 
+/*
+ * The last value written to the (banked) comparator of each CPU. Only
+ * valid while 'armed', i.e. in one-shot mode between two shutdowns.
+ */
+struct gt_comp_cache {
+	u64 comp;
+	bool armed;
+	unsigned long reprograms;
+	unsigned long skips;
+};
+static DEFINE_PER_CPU(struct gt_comp_cache, gt_comp_cache);
+
 /*
  * To get the value from the Global Timer Counter register proceed as follows:
  * 1. Read the upper 32-bit timer counter register
@@ -92,14 +107,27 @@ static u64 gt_counter_read(void)
  */
 static void gt_compare_set(unsigned long delta, int periodic)
 {
+	struct gt_comp_cache *cache = this_cpu_ptr(&gt_comp_cache);
 	u64 counter = gt_counter_read();
 	unsigned long ctrl;
 
 	counter += delta;
+
+	/* Already armed for the same cycle. The pending event still fires. */
+	if (!periodic && cache->armed && cache->comp == counter) {
+		cache->skips++;
+		trace_gt_compare_set(counter, true, cache->reprograms,
+				     cache->skips);
+		return;
+	}
+
 	ctrl = GT_CONTROL_TIMER_ENABLE;
 	writel_relaxed(ctrl, gt_base + GT_CONTROL);
 	writel_relaxed(lower_32_bits(counter), gt_base + GT_COMP0);
-	writel_relaxed(upper_32_bits(counter), gt_base + GT_COMP1);
+	/* The upper half changes every 2^32 cycles only (~13 s at 333 MHz) */
+	if (!cache->armed ||
+	    upper_32_bits(cache->comp) != upper_32_bits(counter))
+		writel_relaxed(upper_32_bits(counter), gt_base + GT_COMP1);
 
 	if (periodic) {
 		writel_relaxed(delta, gt_base + GT_AUTO_INC);
@@ -108,6 +136,12 @@ static void gt_compare_set(unsigned long delta, int periodic)
 
 	ctrl |= GT_CONTROL_COMP_ENABLE | GT_CONTROL_IRQ_ENABLE;
 	writel_relaxed(ctrl, gt_base + GT_CONTROL);
+
+	/* The auto-increment moves the comparator on its own */
+	cache->comp = counter;
+	cache->armed = !periodic;
+	cache->reprograms++;
+	trace_gt_compare_set(counter, false, cache->reprograms, cache->skips);
 }
 
 static int gt_clockevent_shutdown(struct clock_event_device *evt)
@@ -118,6 +152,8 @@ static int gt_clockevent_shutdown(struct clock_event_device *evt)
 	ctrl &= ~(GT_CONTROL_COMP_ENABLE | GT_CONTROL_IRQ_ENABLE |
 		  GT_CONTROL_AUTO_INC);
 	writel(ctrl, gt_base + GT_CONTROL);
+	/* The comparator may lose its value if the CPU powers down */
+	this_cpu_ptr(&gt_comp_cache)->armed = false;
 	return 0;
 }
 
@@ -248,6 +284,10 @@ static int __init gt_clocksource_init(void)
 
 #ifdef CONFIG_CLKSRC_ARM_GLOBAL_TIMER_SCHED_CLOCK
 	sched_clock_register(gt_sched_clock_read, 64, gt_clk_rate);
+#endif
+#ifdef CONFIG_ARM_GLOBAL_TIMER_VDSO
+	/* The VDSO maps the registers itself (see arch/arm/kernel/vdso.c) */
+	gt_clocksource.archdata.vdso_gt = true;
 #endif
 	return clocksource_register_hz(&gt_clocksource, gt_clk_rate);
 }
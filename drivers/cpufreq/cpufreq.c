@@ -2494,6 +2494,98 @@ void cpufreq_update_limits(unsigned int cpu)
 }
 EXPORT_SYMBOL_GPL(cpufreq_update_limits);
 
+/*********************************************************************
+ *               LATENCY REQUESTS                                    *
+ *********************************************************************/
+
+struct cpufreq_latency_entry {
+	struct list_head node;
+	struct cpufreq_policy *policy;
+	struct freq_qos_request qos;
+};
+
+/**
+ * cpufreq_latency_req_add - Raise the minimum frequency of some CPUs.
+ * @req: Request to add. Must be empty (see cpufreq_latency_req_init()).
+ * @cpus: The CPUs that run the latency-critical work.
+ * @min_freq: Frequency floor in kHz. Capped at the policy maximum.
+ *
+ * Adds a FREQ_QOS_MIN request to the policy of each CPU in @cpus, so that
+ * e.g. schedutil cannot lower the clock below @min_freq while a driver
+ * streams. Unlike the performance governor, this only lasts until
+ * cpufreq_latency_req_remove() and leaves the other policies alone. CPUs
+ * without a policy are skipped.
+ *
+ * Return: 0 or a negative error code. On error, nothing is added.
+ */
+int cpufreq_latency_req_add(struct cpufreq_latency_req *req,
+			    const struct cpumask *cpus, unsigned int min_freq)
+{
+	struct cpufreq_latency_entry *entry;
+	struct cpufreq_policy *policy;
+	unsigned int cpu;
+	int ret;
+
+	for_each_cpu(cpu, cpus) {
+		policy = cpufreq_cpu_get(cpu);
+		if (!policy)
+			continue;
+
+		/* Only one request per policy */
+		list_for_each_entry(entry, &req->entries, node) {
+			if (entry->policy == policy)
+				break;
+		}
+		if (&entry->node != &req->entries) {
+			cpufreq_cpu_put(policy);
+			continue;
+		}
+
+		entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+		if (!entry) {
+			cpufreq_cpu_put(policy);
+			ret = -ENOMEM;
+			goto err;
+		}
+
+		ret = freq_qos_add_request(&policy->constraints, &entry->qos,
+					   FREQ_QOS_MIN, min_freq);
+		if (ret < 0) {
+			kfree(entry);
+			cpufreq_cpu_put(policy);
+			goto err;
+		}
+
+		/* The reference is dropped in cpufreq_latency_req_remove() */
+		entry->policy = policy;
+		list_add_tail(&entry->node, &req->entries);
+	}
+
+	return 0;
+
+err:
+	cpufreq_latency_req_remove(req);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(cpufreq_latency_req_add);
+
+/**
+ * cpufreq_latency_req_remove - Drop the floors of cpufreq_latency_req_add().
+ * @req: Request to remove. May be empty.
+ */
+void cpufreq_latency_req_remove(struct cpufreq_latency_req *req)
+{
+	struct cpufreq_latency_entry *entry, *tmp;
+
+	list_for_each_entry_safe(entry, tmp, &req->entries, node) {
+		freq_qos_remove_request(&entry->qos);
+		cpufreq_cpu_put(entry->policy);
+		list_del(&entry->node);
+		kfree(entry);
+	}
+}
+EXPORT_SYMBOL_GPL(cpufreq_latency_req_remove);
+
 /*********************************************************************
  *               BOOST						     *
  *********************************************************************/
@@ -6,27 +6,58 @@
  *
  * based on arch/arm/mach-at91/cpuidle.c
  *
- * The cpu idle uses wait-for-interrupt and RAM self refresh in order
+ * The cpu idle uses wait-for-interrupt and core clock gating in order
  * to implement two idle states -
  * #1 wait-for-interrupt
- * #2 wait-for-interrupt and RAM self refresh
+ * #2 wait-for-interrupt with Cortex-A9 dynamic clock gating
+ *
+ * DDR self refresh is not usable as an idle state: the DDRC only leaves
+ * self refresh under software control, which breaks the other CPU and
+ * any PL master still using DDR. The private and global timers run from
+ * PERIPHCLK, which stays on while the core clock is gated, so neither
+ * state needs a broadcast timer. Per-state usage and residency are
+ * reported by the cpuidle core under
+ * /sys/devices/system/cpu/cpuN/cpuidle/stateM/.
  *
  * Maintainer: Michal Simek <michal.simek@xilinx.com>
  */
 
+#include <linux/bits.h>
 #include <linux/init.h>
 #include <linux/cpuidle.h>
 #include <linux/platform_device.h>
+#include <asm/barrier.h>
 #include <asm/cpuidle.h>
 
 #define ZYNQ_MAX_STATES		2
 
+/* Cortex-A9 CP15 Power Control Register */
+#define A9_PCR_DYN_CLK_GATING	BIT(0)
+
+static inline u32 zynq_a9_pcr_read(void)
+{
+	u32 val;
+
+	asm volatile("mrc p15, 0, %0, c15, c0, 0" : "=r" (val));
+	return val;
+}
+
+static inline void zynq_a9_pcr_write(u32 val)
+{
+	asm volatile("mcr p15, 0, %0, c15, c0, 0" : : "r" (val));
+	isb();
+}
+
 /* Actual code that puts the SoC in different idle states */
 static int zynq_enter_idle(struct cpuidle_device *dev,
 			   struct cpuidle_driver *drv, int index)
 {
-	/* Add code for DDR self refresh start */
+	u32 pcr = zynq_a9_pcr_read();
+
+	/* Stop the core clock while in WFI, restart it on the wakeup IRQ */
+	zynq_a9_pcr_write(pcr | A9_PCR_DYN_CLK_GATING);
 	cpu_do_idle();
+	zynq_a9_pcr_write(pcr);
 
 	return index;
 }
@@ -39,9 +70,9 @@ static struct cpuidle_driver zynq_idle_driver = {
 		{
 			.enter			= zynq_enter_idle,
 			.exit_latency		= 10,
-			.target_residency	= 10000,
-			.name			= "RAM_SR",
-			.desc			= "WFI and RAM Self Refresh",
+			.target_residency	= 100,
+			.name			= "WFI_CG",
+			.desc			= "WFI and core clock gating",
 		},
 	},
 	.safe_state_index = 0,
@@ -10,15 +10,20 @@
  * it under the terms of the GNU General Public License version 2 as
  * published by the Free Software Foundation.
  */
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/dmaengine.h>
 #include <linux/init.h>
+#include <linux/kernel_stat.h>
 #include <linux/kthread.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/of_dma.h>
 #include <linux/platform_device.h>
 #include <linux/random.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/wait.h>
 #include <linux/sched/task.h>
 #include <linux/dma/xilinx_dma.h>
@@ -32,6 +37,37 @@ module_param(iterations, uint, 0444);
 MODULE_PARM_DESC(iterations,
 		 "Iterations before stopping test (default: infinite)");
 
+static bool verify = true;
+module_param(verify, bool, 0444);
+MODULE_PARM_DESC(verify,
+		 "Check the copied data, disable to measure the raw rate (default: on)");
+
+static bool bench;
+module_param(bench, bool, 0444);
+MODULE_PARM_DESC(bench,
+		 "Run the benchmark sweep instead of the test (default: off)");
+
+static unsigned int bench_min_size = 64;
+module_param(bench_min_size, uint, 0444);
+MODULE_PARM_DESC(bench_min_size, "Smallest benchmark transfer size");
+
+static unsigned int bench_max_size = 65536;
+module_param(bench_max_size, uint, 0444);
+MODULE_PARM_DESC(bench_max_size, "Largest benchmark transfer size");
+
+static unsigned int bench_max_segs = 8;
+module_param(bench_max_segs, uint, 0444);
+MODULE_PARM_DESC(bench_max_segs, "Largest number of SG segments per transfer");
+
+static unsigned int bench_max_depth = 16;
+module_param(bench_max_depth, uint, 0444);
+MODULE_PARM_DESC(bench_max_depth, "Largest number of transfers in flight");
+
+static unsigned int bench_iterations = 1000;
+module_param(bench_iterations, uint, 0444);
+MODULE_PARM_DESC(bench_iterations,
+		 "Transfers per benchmark point (default: 1000)");
+
 /*
  * Initialization patterns. All bytes in the source buffer has bit 7
  * set, all bytes in the destination buffer has bit 7 cleared.
@@ -51,6 +87,9 @@ MODULE_PARM_DESC(iterations,
 
 #define XILINX_DMATEST_BD_CNT	11
 
+#define DMATEST_BENCH_MAX_SEGS	16U
+#define DMATEST_BENCH_MAX_DEPTH	64U
+
 struct dmatest_slave_thread {
 	struct list_head node;
 	struct task_struct *task;
@@ -327,11 +366,13 @@ static int dmatest_slave_func(void *data)
 		src_off = (src_off >> align) << align;
 		dst_off = (dst_off >> align) << align;
 
-		start = ktime_get();
-		dmatest_init_srcs(thread->srcs, src_off, len);
-		dmatest_init_dsts(thread->dsts, dst_off, len);
-		diff = ktime_sub(ktime_get(), start);
-		filltime = ktime_add(filltime, diff);
+		if (verify) {
+			start = ktime_get();
+			dmatest_init_srcs(thread->srcs, src_off, len);
+			dmatest_init_dsts(thread->dsts, dst_off, len);
+			diff = ktime_sub(ktime_get(), start);
+			filltime = ktime_add(filltime, diff);
+		}
 
 		for (i = 0; i < src_cnt; i++) {
 			u8 *buf = thread->srcs[i] + src_off;
@@ -449,6 +490,9 @@ static int dmatest_slave_func(void *data)
 			dma_unmap_single(rx_dev->dev, dma_dsts[i],
 					 test_buf_size, DMA_BIDIRECTIONAL);
 
+		if (!verify)
+			continue;
+
 		error_count = 0;
 		start = ktime_get();
 		pr_debug("%s: verifying source buffer...\n", thread_name);
@@ -515,6 +559,338 @@ static int dmatest_slave_func(void *data)
 	return ret;
 }
 
+/*
+ * Benchmark mode. Sweeps the transfer size, the number of SG segments per
+ * transfer and the number of transfers kept in flight, all in powers of
+ * two. Data is not verified, the buffers are mapped once per run.
+ */
+struct dmatest_bench_slot {
+	struct completion cmp;
+	ktime_t submitted;
+	ktime_t completed;
+	u8 *src;
+	u8 *dst;
+	dma_addr_t src_dma;
+	dma_addr_t dst_dma;
+	struct scatterlist tx_sg[DMATEST_BENCH_MAX_SEGS];
+	struct scatterlist rx_sg[DMATEST_BENCH_MAX_SEGS];
+};
+
+struct dmatest_bench_result {
+	struct list_head node;
+	unsigned int size;
+	unsigned int segs;
+	unsigned int depth;
+	unsigned int transfers;
+	unsigned int errors;
+	u64 runtime_ns;
+	unsigned long long kbps;
+	u32 lat_min;
+	u32 lat_p50;
+	u32 lat_p90;
+	u32 lat_p99;
+	u32 lat_max;
+	u32 cpu_util;
+	u64 cpu_ns;
+};
+
+static LIST_HEAD(dmatest_bench_results);
+static DEFINE_MUTEX(dmatest_bench_lock);
+static struct dentry *dmatest_debugfs;
+
+static void dmatest_bench_callback(void *data)
+{
+	struct dmatest_bench_slot *slot = data;
+
+	slot->completed = ktime_get();
+	complete(&slot->cmp);
+}
+
+/* CPU time spent outside idle on all online CPUs, at tick resolution */
+static u64 dmatest_cpu_busy_ns(void)
+{
+	u64 busy = 0;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		u64 *cpustat = kcpustat_cpu(cpu).cpustat;
+
+		busy += cpustat[CPUTIME_USER] + cpustat[CPUTIME_NICE] +
+			cpustat[CPUTIME_SYSTEM] + cpustat[CPUTIME_SOFTIRQ] +
+			cpustat[CPUTIME_IRQ];
+	}
+
+	return busy;
+}
+
+static int dmatest_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a;
+	u32 y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static int dmatest_bench_submit(struct dmatest_slave_thread *thread,
+				struct dmatest_bench_slot *slot,
+				unsigned int seg_len, unsigned int segs)
+{
+	struct dma_chan *tx_chan = thread->tx_chan;
+	struct dma_chan *rx_chan = thread->rx_chan;
+	enum dma_ctrl_flags flags = DMA_CTRL_ACK | DMA_PREP_INTERRUPT;
+	struct dma_async_tx_descriptor *txd, *rxd;
+	dma_cookie_t tx_cookie, rx_cookie;
+	unsigned int i;
+
+	sg_init_table(slot->tx_sg, segs);
+	sg_init_table(slot->rx_sg, segs);
+
+	for (i = 0; i < segs; i++) {
+		sg_dma_address(&slot->tx_sg[i]) = slot->src_dma + i * seg_len;
+		sg_dma_address(&slot->rx_sg[i]) = slot->dst_dma + i * seg_len;
+		sg_dma_len(&slot->tx_sg[i]) = seg_len;
+		sg_dma_len(&slot->rx_sg[i]) = seg_len;
+	}
+
+	rxd = rx_chan->device->device_prep_slave_sg(rx_chan, slot->rx_sg, segs,
+						    DMA_DEV_TO_MEM, flags,
+						    NULL);
+	txd = tx_chan->device->device_prep_slave_sg(tx_chan, slot->tx_sg, segs,
+						    DMA_MEM_TO_DEV, flags,
+						    NULL);
+	if (!rxd || !txd)
+		return -ENOMEM;
+
+	reinit_completion(&slot->cmp);
+	rxd->callback = dmatest_bench_callback;
+	rxd->callback_param = slot;
+
+	slot->submitted = ktime_get();
+	rx_cookie = rxd->tx_submit(rxd);
+	tx_cookie = txd->tx_submit(txd);
+	if (dma_submit_error(rx_cookie) || dma_submit_error(tx_cookie))
+		return -EIO;
+
+	dma_async_issue_pending(rx_chan);
+	dma_async_issue_pending(tx_chan);
+
+	return 0;
+}
+
+/* Run one point of the sweep, returns -ETIMEDOUT if the channels hung */
+static int dmatest_bench_point(struct dmatest_slave_thread *thread,
+			       struct dmatest_bench_slot *slots, u32 *lat,
+			       unsigned int size, unsigned int segs,
+			       unsigned int depth, unsigned int align)
+{
+	struct dmatest_bench_result *res;
+	unsigned int seg_len, submitted = 0, done = 0;
+	u64 busy, nr_cpus = num_online_cpus();
+	ktime_t start;
+	int ret = 0;
+
+	seg_len = ((size / segs) >> align) << align;
+	if (!seg_len)
+		return 0;
+
+	res = kzalloc(sizeof(*res), GFP_KERNEL);
+	if (!res)
+		return -ENOMEM;
+
+	res->size = seg_len * segs;
+	res->segs = segs;
+	res->depth = depth;
+
+	busy = dmatest_cpu_busy_ns();
+	start = ktime_get();
+
+	while (submitted < depth && submitted < bench_iterations) {
+		if (dmatest_bench_submit(thread, &slots[submitted], seg_len,
+					 segs)) {
+			res->errors++;
+			break;
+		}
+		submitted++;
+	}
+
+	while (done < submitted) {
+		struct dmatest_bench_slot *slot = &slots[done % depth];
+
+		if (!wait_for_completion_timeout(&slot->cmp,
+						 msecs_to_jiffies(3000))) {
+			pr_warn("%s: size %u segs %u depth %u timed out\n",
+				current->comm, res->size, segs, depth);
+			res->errors++;
+			ret = -ETIMEDOUT;
+			break;
+		}
+
+		lat[done++] = ktime_to_ns(ktime_sub(slot->completed,
+						    slot->submitted));
+
+		if (submitted < bench_iterations && !res->errors) {
+			if (dmatest_bench_submit(thread, slot, seg_len, segs))
+				res->errors++;
+			else
+				submitted++;
+		}
+	}
+
+	res->runtime_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	busy = dmatest_cpu_busy_ns() - busy;
+
+	if (ret) {
+		dmaengine_terminate_all(thread->tx_chan);
+		dmaengine_terminate_all(thread->rx_chan);
+	}
+
+	res->transfers = done;
+	res->kbps = dmatest_KBs(div_u64(res->runtime_ns, NSEC_PER_USEC),
+				(unsigned long long)done * res->size);
+	if (done) {
+		sort(lat, done, sizeof(*lat), dmatest_cmp_u32, NULL);
+		res->lat_min = lat[0];
+		res->lat_p50 = lat[done * 50 / 100];
+		res->lat_p90 = lat[done * 90 / 100];
+		res->lat_p99 = lat[done * 99 / 100];
+		res->lat_max = lat[done - 1];
+		res->cpu_ns = div_u64(busy, done);
+	}
+	if (res->runtime_ns)
+		res->cpu_util = div64_u64(busy * 10000,
+					  res->runtime_ns * nr_cpus);
+
+	pr_info("%s: size %u segs %u depth %u: %llu KB/s, latency p50 %u ns p99 %u ns, cpu %u.%02u%%\n",
+		current->comm, res->size, segs, depth, res->kbps,
+		res->lat_p50, res->lat_p99, res->cpu_util / 100,
+		res->cpu_util % 100);
+
+	mutex_lock(&dmatest_bench_lock);
+	list_add_tail(&res->node, &dmatest_bench_results);
+	mutex_unlock(&dmatest_bench_lock);
+
+	return ret;
+}
+
+static void dmatest_bench_clear(void)
+{
+	struct dmatest_bench_result *res, *_res;
+
+	mutex_lock(&dmatest_bench_lock);
+	list_for_each_entry_safe(res, _res, &dmatest_bench_results, node) {
+		list_del(&res->node);
+		kfree(res);
+	}
+	mutex_unlock(&dmatest_bench_lock);
+}
+
+static int dmatest_bench_func(void *data)
+{
+	struct dmatest_slave_thread *thread = data;
+	struct device *tx_dev = thread->tx_chan->device->dev;
+	struct device *rx_dev = thread->rx_chan->device->dev;
+	unsigned int max_segs = min(bench_max_segs, DMATEST_BENCH_MAX_SEGS);
+	unsigned int max_depth = min(bench_max_depth, DMATEST_BENCH_MAX_DEPTH);
+	struct dmatest_bench_slot *slots;
+	unsigned int size, segs, depth, align, i;
+	u32 *lat = NULL;
+	int ret = -ENOMEM;
+
+	/* Ensure that all previous reads are complete */
+	smp_rmb();
+
+	align = max(thread->tx_chan->device->copy_align,
+		    thread->rx_chan->device->copy_align);
+
+	dmatest_bench_clear();
+
+	slots = kcalloc(max_depth, sizeof(*slots), GFP_KERNEL);
+	if (!slots)
+		goto out;
+
+	for (i = 0; i < max_depth; i++) {
+		init_completion(&slots[i].cmp);
+		slots[i].src = kmalloc(bench_max_size, GFP_KERNEL);
+		slots[i].dst = kmalloc(bench_max_size, GFP_KERNEL);
+		if (!slots[i].src || !slots[i].dst)
+			goto free_bufs;
+	}
+
+	lat = kvmalloc_array(bench_iterations, sizeof(*lat), GFP_KERNEL);
+	if (!lat)
+		goto free_bufs;
+
+	for (i = 0; i < max_depth; i++) {
+		slots[i].src_dma = dma_map_single(tx_dev, slots[i].src,
+						  bench_max_size,
+						  DMA_TO_DEVICE);
+		slots[i].dst_dma = dma_map_single(rx_dev, slots[i].dst,
+						  bench_max_size,
+						  DMA_FROM_DEVICE);
+	}
+
+	set_user_nice(current, 10);
+
+	ret = 0;
+	for (size = bench_min_size; size && size <= bench_max_size;
+	     size <<= 1) {
+		for (segs = 1; segs <= max_segs; segs <<= 1) {
+			for (depth = 1; depth <= max_depth; depth <<= 1) {
+				if (kthread_should_stop())
+					goto unmap;
+
+				ret = dmatest_bench_point(thread, slots, lat,
+							  size, segs, depth,
+							  align);
+				if (ret)
+					goto unmap;
+			}
+		}
+	}
+
+unmap:
+	for (i = 0; i < max_depth; i++) {
+		dma_unmap_single(tx_dev, slots[i].src_dma, bench_max_size,
+				 DMA_TO_DEVICE);
+		dma_unmap_single(rx_dev, slots[i].dst_dma, bench_max_size,
+				 DMA_FROM_DEVICE);
+	}
+	kvfree(lat);
+free_bufs:
+	for (i = 0; i < max_depth; i++) {
+		kfree(slots[i].src);
+		kfree(slots[i].dst);
+	}
+	kfree(slots);
+out:
+	pr_notice("%s: benchmark finished (status %d)\n", current->comm, ret);
+
+	thread->done = true;
+	wake_up(&thread_wait);
+
+	return ret;
+}
+
+static int dmatest_bench_show(struct seq_file *s, void *unused)
+{
+	struct dmatest_bench_result *res;
+
+	seq_puts(s, "size,segs,depth,transfers,errors,runtime_ns,kbps,lat_min_ns,lat_p50_ns,lat_p90_ns,lat_p99_ns,lat_max_ns,cpu_util_x100,cpu_ns_per_transfer\n");
+
+	mutex_lock(&dmatest_bench_lock);
+	list_for_each_entry(res, &dmatest_bench_results, node)
+		seq_printf(s, "%u,%u,%u,%u,%u,%llu,%llu,%u,%u,%u,%u,%u,%u,%llu\n",
+			   res->size, res->segs, res->depth, res->transfers,
+			   res->errors, res->runtime_ns, res->kbps,
+			   res->lat_min, res->lat_p50, res->lat_p90,
+			   res->lat_p99, res->lat_max, res->cpu_util,
+			   res->cpu_ns);
+	mutex_unlock(&dmatest_bench_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(dmatest_bench);
+
 static void dmatest_cleanup_channel(struct dmatest_chan *dtc)
 {
 	struct dmatest_slave_thread *thread;
@@ -552,7 +928,8 @@ static int dmatest_add_slave_threads(struct dmatest_chan *tx_dtc,
 
 	/* Ensure that all previous writes are complete */
 	smp_wmb();
-	thread->task = kthread_run(dmatest_slave_func, thread, "%s-%s",
+	thread->task = kthread_run(bench ? dmatest_bench_func :
+				   dmatest_slave_func, thread, "%s-%s",
 				   dma_chan_name(tx_chan),
 				   dma_chan_name(rx_chan));
 	ret = PTR_ERR(thread->task);
@@ -607,7 +984,7 @@ static int dmatest_add_slave_channels(struct dma_chan *tx_chan,
 	list_add_tail(&rx_dtc->node, &dmatest_channels);
 	nr_channels += 2;
 
-	if (iterations)
+	if (iterations || bench)
 		wait_event(thread_wait, !is_threaded_test_run(tx_dtc, rx_dtc));
 
 	return 0;
@@ -683,6 +1060,10 @@ static struct platform_driver xilinx_axidmatest_driver = {
 
 static int __init axidma_init(void)
 {
+	dmatest_debugfs = debugfs_create_dir("axidmatest", NULL);
+	debugfs_create_file("results", 0444, dmatest_debugfs, NULL,
+			    &dmatest_bench_fops);
+
 	return platform_driver_register(&xilinx_axidmatest_driver);
 }
 late_initcall(axidma_init);
@@ -690,6 +1071,8 @@ late_initcall(axidma_init);
 static void __exit axidma_exit(void)
 {
 	platform_driver_unregister(&xilinx_axidmatest_driver);
+	debugfs_remove_recursive(dmatest_debugfs);
+	dmatest_bench_clear();
 }
 module_exit(axidma_exit)
 
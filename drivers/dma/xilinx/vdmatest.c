@@ -21,13 +21,16 @@
 #include <linux/dma/xilinx_dma.h>
 #include <linux/delay.h>
 #include <linux/init.h>
+#include <linux/dma-mapping.h>
 #include <linux/kthread.h>
+#include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/of_dma.h>
 #include <linux/platform_device.h>
 #include <linux/random.h>
 #include <linux/slab.h>
 #include <linux/sched/task.h>
+#include <linux/sort.h>
 #include <linux/wait.h>
 
 static unsigned int test_buf_size = 64;
@@ -47,6 +50,37 @@ static unsigned int vsize = 32;
 module_param(vsize, uint, 0444);
 MODULE_PARM_DESC(vsize, "Vertical size in bytes");
 
+static bool bench;
+module_param(bench, bool, 0444);
+MODULE_PARM_DESC(bench, "Run the frame rate benchmark instead of the test");
+
+static unsigned int bench_duration_ms = 5000;
+module_param(bench_duration_ms, uint, 0444);
+MODULE_PARM_DESC(bench_duration_ms, "Streaming time per benchmark point");
+
+static unsigned int bench_width[8];
+static unsigned int bench_nr_width;
+module_param_array(bench_width, uint, &bench_nr_width, 0444);
+MODULE_PARM_DESC(bench_width, "Frame widths in pixels (default: hsize)");
+
+static unsigned int bench_height[8];
+static unsigned int bench_nr_height;
+module_param_array(bench_height, uint, &bench_nr_height, 0444);
+MODULE_PARM_DESC(bench_height, "Frame heights in lines (default: vsize)");
+
+static unsigned int bench_bpp[8];
+static unsigned int bench_nr_bpp;
+module_param_array(bench_bpp, uint, &bench_nr_bpp, 0444);
+MODULE_PARM_DESC(bench_bpp, "Bytes per pixel of each pixel format (default: 1)");
+
+static bool bench_park;
+module_param(bench_park, bool, 0444);
+MODULE_PARM_DESC(bench_park, "Run the MM2S channel in park mode");
+
+static unsigned int bench_max_frames = 65536;
+module_param(bench_max_frames, uint, 0444);
+MODULE_PARM_DESC(bench_max_frames, "Frame intervals kept for the statistics");
+
 /*
  * Initialization patterns. All bytes in the source buffer has bit 7
  * set, all bytes in the destination buffer has bit 7 cleared.
@@ -494,6 +528,277 @@ static int xilinx_vdmatest_slave_func(void *data)
 	return ret;
 }
 
+/*
+ * Benchmark mode. Streams frames continuously through the loopback for
+ * bench_duration_ms per resolution and pixel size, timestamping every
+ * received frame. Frame buffers are recycled as soon as they complete.
+ */
+struct xilinx_vdmatest_bench_frame {
+	struct completion cmp;
+	ktime_t stamp;
+	void *src;
+	void *dst;
+	dma_addr_t src_dma;
+	dma_addr_t dst_dma;
+};
+
+static void xilinx_vdmatest_bench_callback(void *data)
+{
+	struct xilinx_vdmatest_bench_frame *frame = data;
+
+	frame->stamp = ktime_get();
+	complete(&frame->cmp);
+}
+
+static int
+xilinx_vdmatest_bench_submit(struct xilinx_vdmatest_slave_thread *thread,
+			     struct xilinx_vdmatest_bench_frame *frame,
+			     struct dma_interleaved_template *tmpl,
+			     unsigned int line, unsigned int lines)
+{
+	enum dma_ctrl_flags flags = DMA_CTRL_ACK | DMA_PREP_INTERRUPT;
+	struct dma_chan *tx_chan = thread->tx_chan;
+	struct dma_chan *rx_chan = thread->rx_chan;
+	struct dma_async_tx_descriptor *txd, *rxd;
+
+	tmpl->numf = lines;
+	tmpl->frame_size = 1;
+	tmpl->sgl[0].size = line;
+	tmpl->sgl[0].icg = 0;
+
+	tmpl->dir = DMA_DEV_TO_MEM;
+	tmpl->dst_start = frame->dst_dma;
+	rxd = rx_chan->device->device_prep_interleaved_dma(rx_chan, tmpl,
+							   flags);
+	tmpl->dir = DMA_MEM_TO_DEV;
+	tmpl->src_start = frame->src_dma;
+	txd = tx_chan->device->device_prep_interleaved_dma(tx_chan, tmpl,
+							   flags);
+	if (!rxd || !txd)
+		return -ENOMEM;
+
+	reinit_completion(&frame->cmp);
+	rxd->callback = xilinx_vdmatest_bench_callback;
+	rxd->callback_param = frame;
+
+	if (dma_submit_error(rxd->tx_submit(rxd)) ||
+	    dma_submit_error(txd->tx_submit(txd)))
+		return -EIO;
+
+	return 0;
+}
+
+static int xilinx_vdmatest_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a;
+	u32 y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Summarise the intervals between consecutive received frames */
+static void xilinx_vdmatest_bench_report(unsigned int width,
+					 unsigned int height, unsigned int bpp,
+					 u32 *gaps, unsigned int nr_gaps,
+					 unsigned int frames, u64 runtime_ns,
+					 unsigned int errors)
+{
+	u64 mean = 0, var = 0, fps;
+	unsigned int dropped = 0, i;
+	u32 median, fps_frac;
+
+	fps = runtime_ns ? div64_u64((u64)frames * NSEC_PER_SEC * 100,
+				     runtime_ns) : 0;
+
+	if (!nr_gaps) {
+		pr_info("%s: %ux%u %u Bpp: %u frames, no intervals (%u errors)\n",
+			current->comm, width, height, bpp, frames, errors);
+		return;
+	}
+
+	for (i = 0; i < nr_gaps; i++)
+		mean += gaps[i];
+	mean = div_u64(mean, nr_gaps);
+
+	for (i = 0; i < nr_gaps; i++) {
+		s64 dev = (s64)gaps[i] - (s64)mean;
+
+		var += div_u64(dev * dev, nr_gaps);
+	}
+
+	sort(gaps, nr_gaps, sizeof(*gaps), xilinx_vdmatest_cmp_u32, NULL);
+	median = gaps[nr_gaps / 2];
+
+	/* A gap well above the typical one means frames went missing */
+	for (i = 0; i < nr_gaps && median; i++)
+		if (gaps[i] > median + median / 2)
+			dropped += (gaps[i] + median / 2) / median - 1;
+
+	fps = div_u64_rem(fps, 100, &fps_frac);
+	pr_info("%s: %ux%u %u Bpp: %llu.%02u fps over %u frames, interval mean %llu ns min %u ns max %u ns, jitter %u ns rms %u ns p99, %u dropped, %u errors\n",
+		current->comm, width, height, bpp, fps, fps_frac, frames,
+		mean, gaps[0], gaps[nr_gaps - 1], int_sqrt64(var),
+		gaps[nr_gaps * 99 / 100] - median, dropped, errors);
+}
+
+static int
+xilinx_vdmatest_bench_point(struct xilinx_vdmatest_slave_thread *thread,
+			    struct xilinx_vdmatest_bench_frame *frames,
+			    struct dma_interleaved_template *tmpl, u32 *gaps,
+			    unsigned int width, unsigned int height,
+			    unsigned int bpp)
+{
+	struct device *tx_dev = thread->tx_chan->device->dev;
+	struct device *rx_dev = thread->rx_chan->device->dev;
+	unsigned int line = width * bpp, size = line * height;
+	unsigned int count = 0, nr_gaps = 0, errors = 0, i;
+	struct xilinx_vdma_config config;
+	ktime_t start, end, last = 0;
+	int ret = 0;
+
+	for (i = 0; i < frm_cnt; i++) {
+		frames[i].src = dma_alloc_coherent(tx_dev, size,
+						   &frames[i].src_dma,
+						   GFP_KERNEL);
+		frames[i].dst = dma_alloc_coherent(rx_dev, size,
+						   &frames[i].dst_dma,
+						   GFP_KERNEL);
+		if (!frames[i].src || !frames[i].dst) {
+			ret = -ENOMEM;
+			goto free;
+		}
+		memset(frames[i].src, PATTERN_SRC, size);
+		init_completion(&frames[i].cmp);
+	}
+
+	/* Interrupt on every frame so each one gets its own timestamp */
+	memset(&config, 0, sizeof(config));
+	config.frm_cnt_en = 1;
+	config.coalesc = 1;
+	xilinx_vdma_channel_set_config(thread->rx_chan, &config);
+	config.park = bench_park;
+	xilinx_vdma_channel_set_config(thread->tx_chan, &config);
+
+	for (i = 0; i < frm_cnt; i++) {
+		ret = xilinx_vdmatest_bench_submit(thread, &frames[i], tmpl,
+						   line, height);
+		if (ret)
+			goto stop;
+	}
+
+	start = ktime_get();
+	end = ktime_add_ms(start, bench_duration_ms);
+	dma_async_issue_pending(thread->tx_chan);
+	dma_async_issue_pending(thread->rx_chan);
+
+	for (i = 0; !kthread_should_stop(); i = (i + 1) % frm_cnt) {
+		struct xilinx_vdmatest_bench_frame *frame = &frames[i];
+
+		if (!wait_for_completion_timeout(&frame->cmp,
+						 msecs_to_jiffies(1000))) {
+			pr_warn("%s: %ux%u %u Bpp: stalled after %u frames\n",
+				current->comm, width, height, bpp, count);
+			ret = -ETIMEDOUT;
+			break;
+		}
+
+		if (count && nr_gaps < bench_max_frames)
+			gaps[nr_gaps++] = ktime_to_ns(ktime_sub(frame->stamp,
+								last));
+		last = frame->stamp;
+		count++;
+
+		if (ktime_after(last, end))
+			break;
+
+		if (xilinx_vdmatest_bench_submit(thread, frame, tmpl, line,
+						 height)) {
+			errors++;
+			continue;
+		}
+		dma_async_issue_pending(thread->tx_chan);
+		dma_async_issue_pending(thread->rx_chan);
+	}
+
+	xilinx_vdmatest_bench_report(width, height, bpp, gaps, nr_gaps, count,
+				     ktime_to_ns(ktime_sub(last, start)),
+				     errors);
+stop:
+	dmaengine_terminate_all(thread->tx_chan);
+	dmaengine_terminate_all(thread->rx_chan);
+free:
+	for (i = 0; i < frm_cnt; i++) {
+		if (frames[i].src)
+			dma_free_coherent(tx_dev, size, frames[i].src,
+					  frames[i].src_dma);
+		if (frames[i].dst)
+			dma_free_coherent(rx_dev, size, frames[i].dst,
+					  frames[i].dst_dma);
+		frames[i].src = NULL;
+		frames[i].dst = NULL;
+	}
+
+	return ret;
+}
+
+static int xilinx_vdmatest_bench_func(void *data)
+{
+	struct xilinx_vdmatest_slave_thread *thread = data;
+	struct xilinx_vdmatest_bench_frame *frames;
+	struct dma_interleaved_template *tmpl;
+	unsigned int nr_res, nr_bpp, r, b;
+	u32 *gaps = NULL;
+	int ret = -ENOMEM;
+
+	/* This barrier ensures 'thread' is initialized and
+	 * we get valid DMA channels
+	 */
+	smp_rmb();
+
+	frames = kcalloc(frm_cnt, sizeof(*frames), GFP_KERNEL);
+	tmpl = kzalloc(sizeof(*tmpl) + sizeof(struct data_chunk), GFP_KERNEL);
+	gaps = kvmalloc_array(bench_max_frames, sizeof(*gaps), GFP_KERNEL);
+	if (!frames || !tmpl || !gaps)
+		goto out;
+
+	/* Without a list, benchmark the hsize x vsize test frame */
+	nr_res = min(bench_nr_width, bench_nr_height);
+	if (!nr_res) {
+		bench_width[0] = hsize;
+		bench_height[0] = vsize;
+		nr_res = 1;
+	}
+	nr_bpp = bench_nr_bpp;
+	if (!nr_bpp) {
+		bench_bpp[0] = 1;
+		nr_bpp = 1;
+	}
+
+	ret = 0;
+	for (r = 0; r < nr_res && !ret; r++) {
+		for (b = 0; b < nr_bpp && !ret; b++) {
+			if (kthread_should_stop())
+				goto out;
+
+			ret = xilinx_vdmatest_bench_point(thread, frames, tmpl,
+							  gaps, bench_width[r],
+							  bench_height[r],
+							  bench_bpp[b]);
+		}
+	}
+
+out:
+	kvfree(gaps);
+	kfree(tmpl);
+	kfree(frames);
+	pr_notice("%s: benchmark finished (status %d)\n", current->comm, ret);
+
+	thread->done = true;
+	wake_up(&thread_wait);
+
+	return ret;
+}
+
 static void xilinx_vdmatest_cleanup_channel(struct xilinx_vdmatest_chan *dtc)
 {
 	struct xilinx_vdmatest_slave_thread *thread, *_thread;
@@ -533,7 +838,8 @@ xilinx_vdmatest_add_slave_threads(struct xilinx_vdmatest_chan *tx_dtc,
 	 * are initialized
 	 */
 	smp_wmb();
-	thread->task = kthread_run(xilinx_vdmatest_slave_func, thread, "%s-%s",
+	thread->task = kthread_run(bench ? xilinx_vdmatest_bench_func :
+		xilinx_vdmatest_slave_func, thread, "%s-%s",
 		dma_chan_name(tx_chan), dma_chan_name(rx_chan));
 	if (IS_ERR(thread->task)) {
 		pr_warn("xilinx_vdmatest: Failed to run thread %s-%s\n",
@@ -578,7 +884,7 @@ static int xilinx_vdmatest_add_slave_channels(struct dma_chan *tx_chan,
 	list_add_tail(&rx_dtc->node, &xilinx_vdmatest_channels);
 	nr_channels += 2;
 
-	if (iterations)
+	if (iterations || bench)
 		wait_event(thread_wait, !is_threaded_test_run(tx_dtc, rx_dtc));
 
 	return 0;
@@ -34,12 +34,16 @@
  */
 
 #include <linux/bitops.h>
+#include <linux/dim.h>
 #include <linux/dmapool.h>
 #include <linux/dma/xilinx_dma.h>
+#include <linux/genalloc.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/iopoll.h>
+#include <linux/kthread.h>
+#include <linux/llist.h>
 #include <linux/module.h>
 #include <linux/of_address.h>
 #include <linux/of_dma.h>
@@ -177,10 +181,19 @@
 #define XILINX_DMA_CR_COALESCE_SHIFT	16
 #define XILINX_DMA_BD_SOP		BIT(27)
 #define XILINX_DMA_BD_EOP		BIT(26)
+#define XILINX_DMA_BD_COMP_MASK		BIT(31)
 #define XILINX_DMA_COALESCE_MAX		255
 #define XILINX_DMA_NUM_DESCS		255
 #define XILINX_DMA_NUM_APP_WORDS	5
 
+/* Threaded completion */
+#define XILINX_DMA_POLL_SCHED		0
+#define XILINX_DMA_CLEANUP_BATCH	16
+
+/* Adaptive coalescing, the delay timer ticks every 125 SG clock cycles */
+#define XILINX_DMA_DIM_DEF_PROFILE	1
+#define XILINX_DMA_DELAY_TICK_CYCLES	125
+
 /* AXI CDMA Specific Registers/Offsets */
 #define XILINX_CDMA_REG_SRCADDR		0x18
 #define XILINX_CDMA_REG_DSTADDR		0x20
@@ -196,6 +209,8 @@
 #define XILINX_MCDMA_S2MM_CTRL_OFFSET		0x0500
 #define XILINX_MCDMA_CHEN_OFFSET		0x0008
 #define XILINX_MCDMA_CH_ERR_OFFSET		0x0010
+#define XILINX_MCDMA_SCHD_TYPE_OFFSET		0x0014
+#define XILINX_MCDMA_WRR_OFFSET(x)		(0x0018 + ((x) / 8) * 4)
 #define XILINX_MCDMA_RXINT_SER_OFFSET		0x0020
 #define XILINX_MCDMA_TXINT_SER_OFFSET		0x0028
 #define XILINX_MCDMA_CHAN_CR_OFFSET(x)		(0x40 + (x) * 0x40)
@@ -208,12 +223,20 @@
 #define XILINX_MCDMA_COALESCE_MAX		24
 #define XILINX_MCDMA_IRQ_ALL_MASK		GENMASK(7, 5)
 #define XILINX_MCDMA_COALESCE_MASK		GENMASK(23, 16)
+#define XILINX_MCDMA_DELAY_SHIFT		24
+#define XILINX_MCDMA_DELAY_MASK			GENMASK(31, 24)
 #define XILINX_MCDMA_CR_RUNSTOP_MASK		BIT(0)
 #define XILINX_MCDMA_IRQ_IOC_MASK		BIT(5)
 #define XILINX_MCDMA_IRQ_DELAY_MASK		BIT(6)
 #define XILINX_MCDMA_IRQ_ERR_MASK		BIT(7)
 #define XILINX_MCDMA_BD_EOP			BIT(30)
 #define XILINX_MCDMA_BD_SOP			BIT(31)
+#define XILINX_MCDMA_SCHD_TYPE_MASK		GENMASK(1, 0)
+#define XILINX_MCDMA_SCHD_WRR			2
+#define XILINX_MCDMA_WRR_SHIFT(x)		(((x) % 8) * 4)
+#define XILINX_MCDMA_WRR_MASK(x)		(GENMASK(3, 0) << \
+						 XILINX_MCDMA_WRR_SHIFT(x))
+#define XILINX_MCDMA_WRR_WEIGHT_MAX		15
 
 /**
  * struct xilinx_vdma_desc_hw - Hardware Descriptor
@@ -310,11 +333,13 @@ struct xilinx_cdma_desc_hw {
  * struct xilinx_vdma_tx_segment - Descriptor segment
  * @hw: Hardware descriptor
  * @node: Node in the descriptor segments list
+ * @llnode: Node in the channel segment cache
  * @phys: Physical address of segment
  */
 struct xilinx_vdma_tx_segment {
 	struct xilinx_vdma_desc_hw hw;
 	struct list_head node;
+	struct llist_node llnode;
 	dma_addr_t phys;
 } __aligned(64);
 
@@ -346,11 +371,13 @@ struct xilinx_aximcdma_tx_segment {
  * struct xilinx_cdma_tx_segment - Descriptor segment
  * @hw: Hardware descriptor
  * @node: Node in the descriptor segments list
+ * @llnode: Node in the channel segment cache
  * @phys: Physical address of segment
  */
 struct xilinx_cdma_tx_segment {
 	struct xilinx_cdma_desc_hw hw;
 	struct list_head node;
+	struct llist_node llnode;
 	dma_addr_t phys;
 } __aligned(64);
 
@@ -359,6 +386,7 @@ struct xilinx_cdma_tx_segment {
  * @async_tx: Async transaction descriptor
  * @segments: TX segments list
  * @node: Node in the channel descriptors list
+ * @llnode: Node in the channel descriptor cache
  * @cyclic: Check for cyclic transfers.
  * @err: Whether the descriptor has an error.
  * @residue: Residue of the completed descriptor
@@ -367,6 +395,7 @@ struct xilinx_dma_tx_descriptor {
 	struct dma_async_tx_descriptor async_tx;
 	struct list_head segments;
 	struct list_head node;
+	struct llist_node llnode;
 	bool cyclic;
 	bool err;
 	u32 residue;
@@ -409,6 +438,26 @@ struct xilinx_dma_tx_descriptor {
  * @stop_transfer: Differentiate b/w DMA IP's quiesce
  * @tdest: TDEST value for mcdma
  * @has_vflip: S2MM vertical flip
+ * @poll_task: Completion thread, NULL when cleanup runs in the tasklet
+ * @poll_budget: Maximum descriptors completed per completion thread pass
+ * @poll_pending: Bit XILINX_DMA_POLL_SCHED is set when the thread has work
+ * @irq_masked: Completion interrupts are masked while the thread polls
+ * @dim: Adaptive coalescing state
+ * @dim_enabled: Adaptive coalescing is enabled
+ * @dim_events: Completion interrupts seen, for the coalescing samples
+ * @dim_pkts: Descriptors completed, for the coalescing samples
+ * @dim_bytes: Bytes transferred, for the coalescing samples
+ * @coal_count: Coalesce count of the current profile
+ * @coal_usec: Delay timeout of the current profile in microseconds
+ * @coal_delay: Delay timeout of the current profile in timer ticks
+ * @coal_partial: The running batch interrupts before all of it is done
+ * @delay_tick_ps: Delay timer tick in picoseconds
+ * @busy_poll: Completions are polled from tx_status instead of the irq
+ * @num_descs: Size of the AXI DMA/MCDMA BD ring and of the CDMA segment cache
+ * @free_desc_cache: Recycled transaction descriptors
+ * @free_seg_cache: Recycled CDMA and VDMA segments
+ * @hot_append: Extend the running SG chain instead of waiting for idle
+ * @weight: MCDMA MM2S weighted round-robin weight
  */
 struct xilinx_dma_chan {
 	struct xilinx_dma_device *xdev;
@@ -446,6 +495,26 @@ struct xilinx_dma_chan {
 	int (*stop_transfer)(struct xilinx_dma_chan *chan);
 	u16 tdest;
 	bool has_vflip;
+	struct task_struct *poll_task;
+	u32 poll_budget;
+	unsigned long poll_pending;
+	bool irq_masked;
+	struct dim dim;
+	bool dim_enabled;
+	u16 dim_events;
+	u64 dim_pkts;
+	u64 dim_bytes;
+	u32 coal_count;
+	u32 coal_usec;
+	u32 coal_delay;
+	bool coal_partial;
+	u32 delay_tick_ps;
+	bool busy_poll;
+	u32 num_descs;
+	struct llist_head free_desc_cache;
+	struct llist_head free_seg_cache;
+	bool hot_append;
+	u32 weight;
 };
 
 /**
@@ -491,6 +560,9 @@ struct xilinx_dma_config {
  * @s2mm_chan_id: DMA s2mm channel identifier
  * @mm2s_chan_id: DMA mm2s channel identifier
  * @max_buffer_len: Max buffer length
+ * @mcdma_sched: MCDMA MM2S scheduler type, or -1 to keep the reset value
+ * @sched_lock: Serialises updates of the shared MCDMA scheduler registers
+ * @bd_pool: Optional on-chip SRAM pool for the AXI DMA and MCDMA BD rings
  */
 struct xilinx_dma_device {
 	void __iomem *regs;
@@ -509,6 +581,9 @@ struct xilinx_dma_device {
 	u32 s2mm_chan_id;
 	u32 mm2s_chan_id;
 	u32 max_buffer_len;
+	int mcdma_sched;
+	spinlock_t sched_lock;
+	struct gen_pool *bd_pool;
 };
 
 /* Macros */
@@ -625,6 +700,33 @@ static inline void xilinx_aximcdma_buf(struct xilinx_dma_chan *chan,
  * Descriptors and segments alloc and free
  */
 
+/**
+ * xilinx_dma_cache_get - Take an entry from a channel cache
+ * @chan: Driver specific DMA channel
+ * @cache: Cache to take from
+ *
+ * Entries are returned with llist_add() from any context without locking.
+ * llist_del_first() allows only one consumer at a time, so consumers are
+ * serialised on the channel lock.
+ *
+ * Return: The cached node, or NULL if the cache is empty.
+ */
+static struct llist_node *xilinx_dma_cache_get(struct xilinx_dma_chan *chan,
+					       struct llist_head *cache)
+{
+	struct llist_node *node;
+	unsigned long flags;
+
+	if (llist_empty(cache))
+		return NULL;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	node = llist_del_first(cache);
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return node;
+}
+
 /**
  * xilinx_vdma_alloc_tx_segment - Allocate transaction segment
  * @chan: Driver specific DMA channel
@@ -635,8 +737,13 @@ static struct xilinx_vdma_tx_segment *
 xilinx_vdma_alloc_tx_segment(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_vdma_tx_segment *segment;
+	struct llist_node *node;
 	dma_addr_t phys;
 
+	node = xilinx_dma_cache_get(chan, &chan->free_seg_cache);
+	if (node)
+		return llist_entry(node, struct xilinx_vdma_tx_segment, llnode);
+
 	segment = dma_pool_zalloc(chan->desc_pool, GFP_ATOMIC, &phys);
 	if (!segment)
 		return NULL;
@@ -656,8 +763,13 @@ static struct xilinx_cdma_tx_segment *
 xilinx_cdma_alloc_tx_segment(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_cdma_tx_segment *segment;
+	struct llist_node *node;
 	dma_addr_t phys;
 
+	node = xilinx_dma_cache_get(chan, &chan->free_seg_cache);
+	if (node)
+		return llist_entry(node, struct xilinx_cdma_tx_segment, llnode);
+
 	segment = dma_pool_zalloc(chan->desc_pool, GFP_ATOMIC, &phys);
 	if (!segment)
 		return NULL;
@@ -775,7 +887,8 @@ static void xilinx_mcdma_free_tx_segment(struct xilinx_dma_chan *chan,
 static void xilinx_cdma_free_tx_segment(struct xilinx_dma_chan *chan,
 				struct xilinx_cdma_tx_segment *segment)
 {
-	dma_pool_free(chan->desc_pool, segment, segment->phys);
+	memset(&segment->hw, 0, sizeof(segment->hw));
+	llist_add(&segment->llnode, &chan->free_seg_cache);
 }
 
 /**
@@ -786,7 +899,8 @@ static void xilinx_cdma_free_tx_segment(struct xilinx_dma_chan *chan,
 static void xilinx_vdma_free_tx_segment(struct xilinx_dma_chan *chan,
 					struct xilinx_vdma_tx_segment *segment)
 {
-	dma_pool_free(chan->desc_pool, segment, segment->phys);
+	memset(&segment->hw, 0, sizeof(segment->hw));
+	llist_add(&segment->llnode, &chan->free_seg_cache);
 }
 
 /**
@@ -799,10 +913,18 @@ static struct xilinx_dma_tx_descriptor *
 xilinx_dma_alloc_tx_descriptor(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_dma_tx_descriptor *desc;
+	struct llist_node *node;
 
-	desc = kzalloc(sizeof(*desc), GFP_KERNEL);
-	if (!desc)
-		return NULL;
+	node = xilinx_dma_cache_get(chan, &chan->free_desc_cache);
+	if (node) {
+		desc = llist_entry(node, struct xilinx_dma_tx_descriptor,
+				   llnode);
+		memset(desc, 0, sizeof(*desc));
+	} else {
+		desc = kzalloc(sizeof(*desc), GFP_KERNEL);
+		if (!desc)
+			return NULL;
+	}
 
 	INIT_LIST_HEAD(&desc->segments);
 
@@ -851,7 +973,7 @@ xilinx_dma_free_tx_descriptor(struct xilinx_dma_chan *chan,
 		}
 	}
 
-	kfree(desc);
+	llist_add(&desc->llnode, &chan->free_desc_cache);
 }
 
 /* Required functions */
@@ -889,6 +1011,94 @@ static void xilinx_dma_free_descriptors(struct xilinx_dma_chan *chan)
 	spin_unlock_irqrestore(&chan->lock, flags);
 }
 
+/**
+ * xilinx_dma_fill_seg_cache - Preallocate CDMA and VDMA segments
+ * @chan: Driver specific DMA channel
+ *
+ * The AXI DMA and MCDMA channels carve their segments out of a coherent
+ * BD ring instead. Running out here is not fatal, the dma_pool stays the
+ * overflow path for the prep functions.
+ */
+static void xilinx_dma_fill_seg_cache(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_cdma_tx_segment *cdma_segment;
+	struct xilinx_vdma_tx_segment *segment;
+	dma_addr_t phys;
+	u32 i;
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_CDMA) {
+		for (i = 0; i < chan->num_descs; i++) {
+			cdma_segment = dma_pool_zalloc(chan->desc_pool,
+						       GFP_KERNEL, &phys);
+			if (!cdma_segment)
+				return;
+			cdma_segment->phys = phys;
+			llist_add(&cdma_segment->llnode, &chan->free_seg_cache);
+		}
+	} else {
+		for (i = 0; i < chan->num_frms; i++) {
+			segment = dma_pool_zalloc(chan->desc_pool, GFP_KERNEL,
+						  &phys);
+			if (!segment)
+				return;
+			segment->phys = phys;
+			llist_add(&segment->llnode, &chan->free_seg_cache);
+		}
+	}
+}
+
+/**
+ * xilinx_dma_drain_seg_cache - Return cached segments to the dma_pool
+ * @chan: Driver specific DMA channel
+ */
+static void xilinx_dma_drain_seg_cache(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_cdma_tx_segment *cdma_segment, *cdma_next;
+	struct xilinx_vdma_tx_segment *segment, *next;
+	struct llist_node *list = llist_del_all(&chan->free_seg_cache);
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_CDMA) {
+		llist_for_each_entry_safe(cdma_segment, cdma_next, list, llnode)
+			dma_pool_free(chan->desc_pool, cdma_segment,
+				      cdma_segment->phys);
+	} else {
+		llist_for_each_entry_safe(segment, next, list, llnode)
+			dma_pool_free(chan->desc_pool, segment, segment->phys);
+	}
+}
+
+/*
+ * BD rings come from the on-chip SRAM pool named by "xlnx,bd-sram" when
+ * there is one and it has room, so descriptor fetches do not compete with
+ * DDR traffic. Otherwise they are ordinary coherent DMA memory.
+ */
+static void *xilinx_dma_bd_alloc(struct xilinx_dma_chan *chan, size_t size,
+				 dma_addr_t *dma)
+{
+	struct gen_pool *pool = chan->xdev->bd_pool;
+	void *vaddr;
+
+	if (pool) {
+		vaddr = gen_pool_dma_zalloc_align(pool, size, dma, 64);
+		if (vaddr)
+			return vaddr;
+		dev_dbg(chan->dev, "BD SRAM full, using DDR\n");
+	}
+
+	return dma_alloc_coherent(chan->dev, size, dma, GFP_KERNEL);
+}
+
+static void xilinx_dma_bd_free(struct xilinx_dma_chan *chan, size_t size,
+			       void *vaddr, dma_addr_t dma)
+{
+	struct gen_pool *pool = chan->xdev->bd_pool;
+
+	if (pool && addr_in_gen_pool(pool, (unsigned long)vaddr, size))
+		gen_pool_free(pool, (unsigned long)vaddr, size);
+	else
+		dma_free_coherent(chan->dev, size, vaddr, dma);
+}
+
 /**
  * xilinx_dma_free_chan_resources - Free channel resources
  * @dchan: DMA channel
@@ -896,6 +1106,7 @@ static void xilinx_dma_free_descriptors(struct xilinx_dma_chan *chan)
 static void xilinx_dma_free_chan_resources(struct dma_chan *dchan)
 {
 	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	struct xilinx_dma_tx_descriptor *desc, *next;
 	unsigned long flags;
 
 	dev_dbg(chan->dev, "Free all channel resources.\n");
@@ -908,13 +1119,13 @@ static void xilinx_dma_free_chan_resources(struct dma_chan *dchan)
 		spin_unlock_irqrestore(&chan->lock, flags);
 
 		/* Free memory that is allocated for BD */
-		dma_free_coherent(chan->dev, sizeof(*chan->seg_v) *
-				  XILINX_DMA_NUM_DESCS, chan->seg_v,
-				  chan->seg_p);
+		xilinx_dma_bd_free(chan, sizeof(*chan->seg_v) *
+				   chan->num_descs, chan->seg_v,
+				   chan->seg_p);
 
 		/* Free Memory that is allocated for cyclic DMA Mode */
-		dma_free_coherent(chan->dev, sizeof(*chan->cyclic_seg_v),
-				  chan->cyclic_seg_v, chan->cyclic_seg_p);
+		xilinx_dma_bd_free(chan, sizeof(*chan->cyclic_seg_v),
+				   chan->cyclic_seg_v, chan->cyclic_seg_p);
 	}
 
 	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA) {
@@ -923,17 +1134,21 @@ static void xilinx_dma_free_chan_resources(struct dma_chan *dchan)
 		spin_unlock_irqrestore(&chan->lock, flags);
 
 		/* Free memory that is allocated for BD */
-		dma_free_coherent(chan->dev, sizeof(*chan->seg_mv) *
-				  XILINX_DMA_NUM_DESCS, chan->seg_mv,
-				  chan->seg_p);
+		xilinx_dma_bd_free(chan, sizeof(*chan->seg_mv) *
+				   chan->num_descs, chan->seg_mv,
+				   chan->seg_p);
 	}
 
 	if (chan->xdev->dma_config->dmatype != XDMA_TYPE_AXIDMA &&
 	    chan->xdev->dma_config->dmatype != XDMA_TYPE_AXIMCDMA) {
+		xilinx_dma_drain_seg_cache(chan);
 		dma_pool_destroy(chan->desc_pool);
 		chan->desc_pool = NULL;
 	}
 
+	llist_for_each_entry_safe(desc, next,
+				  llist_del_all(&chan->free_desc_cache), llnode)
+		kfree(desc);
 }
 
 /**
@@ -986,6 +1201,217 @@ static u32 xilinx_dma_get_residue(struct xilinx_dma_chan *chan,
 	return residue;
 }
 
+/**
+ * xilinx_axidma_get_hw_residue - Compute residue from the engine position
+ * @chan: Driver specific dma channel
+ * @desc: dma transaction descriptor
+ *
+ * The BD status is only written back once a segment completes, and in
+ * cyclic mode it is never cleared, so it cannot tell how far the engine
+ * has got into the buffer. Use the current descriptor register instead:
+ * every segment from the one the engine is working on onwards is still
+ * outstanding.
+ *
+ * Return: The number of residue bytes for the descriptor.
+ */
+static u32 xilinx_axidma_get_hw_residue(struct xilinx_dma_chan *chan,
+					struct xilinx_dma_tx_descriptor *desc)
+{
+	struct xilinx_axidma_tx_segment *segment;
+	bool found = false;
+	u32 residue = 0;
+	u32 cur;
+
+	cur = dma_ctrl_read(chan, XILINX_DMA_REG_CURDESC);
+
+	list_for_each_entry(segment, &desc->segments, node) {
+		if (!found && lower_32_bits(segment->phys) == cur)
+			found = true;
+		if (!found)
+			continue;
+
+		if (!desc->cyclic &&
+		    (segment->hw.status & XILINX_DMA_BD_COMP_MASK))
+			residue += (segment->hw.control - segment->hw.status) &
+				   chan->xdev->max_buffer_len;
+		else
+			residue += segment->hw.control &
+				   chan->xdev->max_buffer_len;
+	}
+
+	/* The engine is not inside this descriptor, trust the BD status */
+	if (!found)
+		return xilinx_dma_get_residue(chan, desc);
+
+	return residue;
+}
+
+/*
+ * Coalescing profiles, in order of increasing moderation. net_dim() steps
+ * through NET_DIM_PARAMS_NUM_PROFILES of them, so the table has five.
+ */
+static const struct dim_cq_moder xilinx_dma_dim_profiles[] = {
+	{ .usec = 0,   .pkts = 1 },
+	{ .usec = 8,   .pkts = 4 },
+	{ .usec = 16,  .pkts = 16 },
+	{ .usec = 32,  .pkts = 64 },
+	{ .usec = 64,  .pkts = 255 },
+};
+
+/**
+ * xilinx_dma_desc_done - Check the hardware status of a descriptor
+ * @chan: Driver specific dma channel
+ * @desc: dma transaction descriptor
+ *
+ * Return: true once the hardware has written back the last segment
+ */
+static bool xilinx_dma_desc_done(struct xilinx_dma_chan *chan,
+				 struct xilinx_dma_tx_descriptor *desc)
+{
+	struct xilinx_axidma_tx_segment *axidma_seg;
+	struct xilinx_aximcdma_tx_segment *aximcdma_seg;
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA) {
+		aximcdma_seg = list_last_entry(&desc->segments,
+					       struct xilinx_aximcdma_tx_segment,
+					       node);
+		return aximcdma_seg->hw.status & XILINX_DMA_BD_COMP_MASK;
+	}
+
+	axidma_seg = list_last_entry(&desc->segments,
+				     struct xilinx_axidma_tx_segment, node);
+	return axidma_seg->hw.status & XILINX_DMA_BD_COMP_MASK;
+}
+
+/**
+ * xilinx_dma_get_transferred - Count the bytes moved by a descriptor
+ * @chan: Driver specific dma channel
+ * @desc: dma transaction descriptor
+ *
+ * Return: The number of bytes the hardware reported as transferred.
+ */
+static u32 xilinx_dma_get_transferred(struct xilinx_dma_chan *chan,
+				      struct xilinx_dma_tx_descriptor *desc)
+{
+	struct xilinx_axidma_tx_segment *axidma_seg;
+	struct xilinx_aximcdma_tx_segment *aximcdma_seg;
+	u32 len = 0;
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA) {
+		list_for_each_entry(aximcdma_seg, &desc->segments, node)
+			len += aximcdma_seg->hw.status &
+			       chan->xdev->max_buffer_len;
+	} else {
+		list_for_each_entry(axidma_seg, &desc->segments, node)
+			len += axidma_seg->hw.status &
+			       chan->xdev->max_buffer_len;
+	}
+
+	return len;
+}
+
+/**
+ * xilinx_dma_dim_apply - Switch to a coalescing profile
+ * @chan: Driver specific dma channel
+ * @ix: Index into xilinx_dma_dim_profiles
+ *
+ * The new values are programmed by the next start_transfer.
+ *
+ * CONTEXT: chan->lock held
+ */
+static void xilinx_dma_dim_apply(struct xilinx_dma_chan *chan, int ix)
+{
+	const struct dim_cq_moder *moder = &xilinx_dma_dim_profiles[ix];
+	u32 max;
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA)
+		max = XILINX_MCDMA_COALESCE_MAX;
+	else
+		max = XILINX_DMA_COALESCE_MAX;
+
+	chan->coal_count = min_t(u32, moder->pkts, max);
+	chan->coal_usec = moder->usec;
+	chan->coal_delay = min_t(u32, DIV_ROUND_UP(moder->usec * 1000000,
+						   chan->delay_tick_ps),
+				 XILINX_DMA_DMACR_DELAY_MAX);
+}
+
+/**
+ * xilinx_dma_dim_work - Apply the profile chosen by net_dim()
+ * @work: Work embedded in the channel dim state
+ */
+static void xilinx_dma_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct xilinx_dma_chan *chan = container_of(dim, struct xilinx_dma_chan,
+						    dim);
+	unsigned long flags;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	xilinx_dma_dim_apply(chan, dim->profile_ix);
+	dim->state = DIM_START_MEASURE;
+	spin_unlock_irqrestore(&chan->lock, flags);
+}
+
+/**
+ * xilinx_dma_dim_update - Feed a completion interrupt to net_dim()
+ * @chan: Driver specific dma channel
+ *
+ * CONTEXT: hardirq, chan->lock held
+ */
+static void xilinx_dma_dim_update(struct xilinx_dma_chan *chan)
+{
+	struct dim_sample sample;
+
+	if (!IS_ENABLED(CONFIG_DIMLIB) || !chan->dim_enabled)
+		return;
+
+	chan->dim_events++;
+	dim_update_sample(chan->dim_events, chan->dim_pkts, chan->dim_bytes,
+			  &sample);
+	net_dim(&chan->dim, sample);
+}
+
+/**
+ * xilinx_dma_coalesce_count - Interrupt threshold for the pending batch
+ * @chan: Driver specific dma channel
+ * @delay: Returns the delay timeout in timer ticks
+ *
+ * Without adaptive coalescing the channel interrupts once, when the whole
+ * batch is done. With it, the batch may interrupt every coal_count
+ * descriptors. The delay timer then completes the tail of the batch, and
+ * likewise completes descriptors hot-appended to a running chain.
+ *
+ * CONTEXT: chan->lock held
+ *
+ * Return: The coalesce count to program
+ */
+static u32 xilinx_dma_coalesce_count(struct xilinx_dma_chan *chan,
+				     u32 *delay)
+{
+	u32 count = chan->desc_pendingcount;
+
+	chan->coal_partial = false;
+	*delay = 0;
+
+	if (chan->cyclic)
+		return count;
+
+	if (chan->dim_enabled && chan->coal_count < count) {
+		count = chan->coal_count;
+		chan->coal_partial = true;
+	}
+
+	/* Descriptors hot-appended later do not line up with the threshold */
+	if (chan->hot_append)
+		chan->coal_partial = true;
+
+	if (chan->coal_partial)
+		*delay = max_t(u32, chan->coal_delay, 1);
+
+	return count;
+}
+
 /**
  * xilinx_dma_chan_handle_cyclic - Cyclic dma callback
  * @chan: Driver specific dma channel
@@ -1011,47 +1437,86 @@ static void xilinx_dma_chan_handle_cyclic(struct xilinx_dma_chan *chan,
 /**
  * xilinx_dma_chan_desc_cleanup - Clean channel descriptors
  * @chan: Driver specific DMA channel
+ * @budget: Maximum number of descriptors to complete
+ *
+ * Descriptors are taken off the done list in batches of up to
+ * XILINX_DMA_CLEANUP_BATCH. Each batch is freed under a single hold of the
+ * channel lock and its callbacks then run back to back without it, so the
+ * descriptors are already available to clients that resubmit from their
+ * callback.
+ *
+ * Return: Number of descriptors completed
  */
-static void xilinx_dma_chan_desc_cleanup(struct xilinx_dma_chan *chan)
+static int xilinx_dma_chan_desc_cleanup(struct xilinx_dma_chan *chan,
+					int budget)
 {
+	struct dmaengine_desc_callback cb[XILINX_DMA_CLEANUP_BATCH];
+	struct dmaengine_result result[XILINX_DMA_CLEANUP_BATCH];
 	struct xilinx_dma_tx_descriptor *desc, *next;
 	unsigned long flags;
+	bool cyclic = false;
+	int done = 0, i, n;
 
 	spin_lock_irqsave(&chan->lock, flags);
 
-	list_for_each_entry_safe(desc, next, &chan->done_list, node) {
-		struct dmaengine_result result;
+	while (done < budget) {
+		n = 0;
+		list_for_each_entry_safe(desc, next, &chan->done_list, node) {
+			if (desc->cyclic) {
+				cyclic = true;
+				break;
+			}
 
-		if (desc->cyclic) {
-			xilinx_dma_chan_handle_cyclic(chan, desc, &flags);
-			break;
-		}
+			if (n == XILINX_DMA_CLEANUP_BATCH || done + n == budget)
+				break;
 
-		/* Remove from the list of running transactions */
-		list_del(&desc->node);
+			/* Remove from the list of running transactions */
+			list_del(&desc->node);
 
-		if (unlikely(desc->err)) {
-			if (chan->direction == DMA_DEV_TO_MEM)
-				result.result = DMA_TRANS_READ_FAILED;
-			else
-				result.result = DMA_TRANS_WRITE_FAILED;
-		} else {
-			result.result = DMA_TRANS_NOERROR;
+			if (unlikely(desc->err)) {
+				if (chan->direction == DMA_DEV_TO_MEM)
+					result[n].result = DMA_TRANS_READ_FAILED;
+				else
+					result[n].result = DMA_TRANS_WRITE_FAILED;
+			} else {
+				result[n].result = DMA_TRANS_NOERROR;
+			}
+
+			result[n].residue = desc->residue;
+			dmaengine_desc_get_callback(&desc->async_tx, &cb[n]);
+
+			/* Run any dependencies, then free the descriptor */
+			dma_run_dependencies(&desc->async_tx);
+			xilinx_dma_free_tx_descriptor(chan, desc);
+			n++;
 		}
 
-		result.residue = desc->residue;
+		if (!n)
+			break;
 
-		/* Run the link descriptor callback function */
+		/* Run the link descriptor callback functions */
 		spin_unlock_irqrestore(&chan->lock, flags);
-		dmaengine_desc_get_callback_invoke(&desc->async_tx, &result);
+		for (i = 0; i < n; i++)
+			dmaengine_desc_callback_invoke(&cb[i], &result[i]);
 		spin_lock_irqsave(&chan->lock, flags);
 
-		/* Run any dependencies, then free the descriptor */
-		dma_run_dependencies(&desc->async_tx);
-		xilinx_dma_free_tx_descriptor(chan, desc);
+		done += n;
+		if (cyclic)
+			break;
+	}
+
+	/* A callback may have terminated the channel, so look again */
+	if (cyclic) {
+		desc = list_first_entry_or_null(&chan->done_list,
+						struct xilinx_dma_tx_descriptor,
+						node);
+		if (desc && desc->cyclic)
+			xilinx_dma_chan_handle_cyclic(chan, desc, &flags);
 	}
 
 	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return done;
 }
 
 /**
@@ -1062,7 +1527,155 @@ static void xilinx_dma_do_tasklet(unsigned long data)
 {
 	struct xilinx_dma_chan *chan = (struct xilinx_dma_chan *)data;
 
-	xilinx_dma_chan_desc_cleanup(chan);
+	xilinx_dma_chan_desc_cleanup(chan, INT_MAX);
+}
+
+/**
+ * xilinx_dma_irq_mask - Mask the channel completion interrupts
+ * @chan: Driver specific DMA channel
+ *
+ * Error interrupts stay enabled. The hardware keeps latching completions
+ * in the status register, so unmasking raises any that were missed.
+ *
+ * CONTEXT: chan->lock held
+ */
+static void xilinx_dma_irq_mask(struct xilinx_dma_chan *chan)
+{
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA)
+		dma_ctrl_clr(chan, XILINX_MCDMA_CHAN_CR_OFFSET(chan->tdest),
+			     XILINX_MCDMA_IRQ_IOC_MASK |
+			     XILINX_MCDMA_IRQ_DELAY_MASK);
+	else
+		dma_ctrl_clr(chan, XILINX_DMA_REG_DMACR,
+			     XILINX_DMA_DMACR_FRM_CNT_IRQ |
+			     XILINX_DMA_DMACR_DLY_CNT_IRQ);
+
+	chan->irq_masked = true;
+}
+
+/**
+ * xilinx_dma_irq_unmask - Unmask the channel completion interrupts
+ * @chan: Driver specific DMA channel
+ *
+ * CONTEXT: chan->lock held
+ */
+static void xilinx_dma_irq_unmask(struct xilinx_dma_chan *chan)
+{
+	if (!chan->irq_masked || chan->busy_poll)
+		return;
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA)
+		dma_ctrl_set(chan, XILINX_MCDMA_CHAN_CR_OFFSET(chan->tdest),
+			     XILINX_MCDMA_IRQ_IOC_MASK |
+			     XILINX_MCDMA_IRQ_DELAY_MASK);
+	else
+		dma_ctrl_set(chan, XILINX_DMA_REG_DMACR,
+			     XILINX_DMA_DMACR_FRM_CNT_IRQ |
+			     XILINX_DMA_DMACR_DLY_CNT_IRQ);
+
+	chan->irq_masked = false;
+}
+
+/**
+ * xilinx_dma_poll_thread - Completion thread
+ * @data: Pointer to the Xilinx DMA channel structure
+ *
+ * Runs descriptor cleanup in process context, NAPI style. The irq handler
+ * masks the channel completion interrupts and wakes the thread, which
+ * completes at most @poll_budget descriptors per pass. The interrupts are
+ * unmasked once a pass finishes under budget. Otherwise the thread yields
+ * and polls again.
+ *
+ * Return: '0' when the thread is stopped
+ */
+static int xilinx_dma_poll_thread(void *data)
+{
+	struct xilinx_dma_chan *chan = data;
+	unsigned long flags;
+	int done;
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop())
+			break;
+
+		if (!test_and_clear_bit(XILINX_DMA_POLL_SCHED,
+					&chan->poll_pending)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		done = xilinx_dma_chan_desc_cleanup(chan, chan->poll_budget);
+		if (done < chan->poll_budget) {
+			spin_lock_irqsave(&chan->lock, flags);
+			xilinx_dma_irq_unmask(chan);
+			spin_unlock_irqrestore(&chan->lock, flags);
+		} else {
+			set_bit(XILINX_DMA_POLL_SCHED, &chan->poll_pending);
+			cond_resched();
+		}
+	}
+	__set_current_state(TASK_RUNNING);
+
+	return 0;
+}
+
+/**
+ * xilinx_dma_sched_cleanup - Defer descriptor cleanup from the irq handler
+ * @chan: Driver specific DMA channel
+ *
+ * CONTEXT: hardirq
+ */
+static void xilinx_dma_sched_cleanup(struct xilinx_dma_chan *chan)
+{
+	if (!chan->poll_task) {
+		tasklet_schedule(&chan->tasklet);
+		return;
+	}
+
+	spin_lock(&chan->lock);
+	xilinx_dma_irq_mask(chan);
+	spin_unlock(&chan->lock);
+
+	set_bit(XILINX_DMA_POLL_SCHED, &chan->poll_pending);
+	wake_up_process(chan->poll_task);
+}
+
+/**
+ * xilinx_dma_poll_init - Start the channel completion thread
+ * @chan: Driver specific DMA channel
+ * @node: Device node
+ *
+ * The thread is bound to the CPU given by "xlnx,completion-cpu" if present.
+ * Its affinity can be changed later from userspace like any other thread.
+ *
+ * Return: '0' on success and failure value on error
+ */
+static int xilinx_dma_poll_init(struct xilinx_dma_chan *chan,
+				struct device_node *node)
+{
+	struct task_struct *task;
+	u32 cpu;
+
+	task = kthread_create(xilinx_dma_poll_thread, chan, "xdma/%d-%d",
+			      chan->irq, chan->id);
+	if (IS_ERR(task)) {
+		dev_err(chan->dev, "unable to create completion thread\n");
+		return PTR_ERR(task);
+	}
+
+	if (!of_property_read_u32(node, "xlnx,completion-cpu", &cpu)) {
+		if (cpu >= nr_cpu_ids ||
+		    set_cpus_allowed_ptr(task, cpumask_of(cpu)))
+			dev_warn(chan->dev, "ch %d: invalid completion cpu %u\n",
+				 chan->id, cpu);
+	}
+
+	chan->poll_task = task;
+	wake_up_process(task);
+
+	return 0;
 }
 
 /**
@@ -1086,9 +1699,9 @@ static int xilinx_dma_alloc_chan_resources(struct dma_chan *dchan)
 	 */
 	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIDMA) {
 		/* Allocate the buffer descriptors. */
-		chan->seg_v = dma_alloc_coherent(chan->dev,
-						 sizeof(*chan->seg_v) * XILINX_DMA_NUM_DESCS,
-						 &chan->seg_p, GFP_KERNEL);
+		chan->seg_v = xilinx_dma_bd_alloc(chan,
+						  sizeof(*chan->seg_v) * chan->num_descs,
+						  &chan->seg_p);
 		if (!chan->seg_v) {
 			dev_err(chan->dev,
 				"unable to allocate channel %d descriptors\n",
@@ -1101,27 +1714,26 @@ static int xilinx_dma_alloc_chan_resources(struct dma_chan *dchan)
 		 * so allocating a desc segment during channel allocation for
 		 * programming tail descriptor.
 		 */
-		chan->cyclic_seg_v = dma_alloc_coherent(chan->dev,
-							sizeof(*chan->cyclic_seg_v),
-							&chan->cyclic_seg_p,
-							GFP_KERNEL);
+		chan->cyclic_seg_v = xilinx_dma_bd_alloc(chan,
+							 sizeof(*chan->cyclic_seg_v),
+							 &chan->cyclic_seg_p);
 		if (!chan->cyclic_seg_v) {
 			dev_err(chan->dev,
 				"unable to allocate desc segment for cyclic DMA\n");
-			dma_free_coherent(chan->dev, sizeof(*chan->seg_v) *
-				XILINX_DMA_NUM_DESCS, chan->seg_v,
+			xilinx_dma_bd_free(chan, sizeof(*chan->seg_v) *
+				chan->num_descs, chan->seg_v,
 				chan->seg_p);
 			return -ENOMEM;
 		}
 		chan->cyclic_seg_v->phys = chan->cyclic_seg_p;
 
-		for (i = 0; i < XILINX_DMA_NUM_DESCS; i++) {
+		for (i = 0; i < chan->num_descs; i++) {
 			chan->seg_v[i].hw.next_desc =
 			lower_32_bits(chan->seg_p + sizeof(*chan->seg_v) *
-				((i + 1) % XILINX_DMA_NUM_DESCS));
+				((i + 1) % chan->num_descs));
 			chan->seg_v[i].hw.next_desc_msb =
 			upper_32_bits(chan->seg_p + sizeof(*chan->seg_v) *
-				((i + 1) % XILINX_DMA_NUM_DESCS));
+				((i + 1) % chan->num_descs));
 			chan->seg_v[i].phys = chan->seg_p +
 				sizeof(*chan->seg_v) * i;
 			list_add_tail(&chan->seg_v[i].node,
@@ -1129,23 +1741,23 @@ static int xilinx_dma_alloc_chan_resources(struct dma_chan *dchan)
 		}
 	} else if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA) {
 		/* Allocate the buffer descriptors. */
-		chan->seg_mv = dma_alloc_coherent(chan->dev,
-						  sizeof(*chan->seg_mv) *
-						  XILINX_DMA_NUM_DESCS,
-						  &chan->seg_p, GFP_KERNEL);
+		chan->seg_mv = xilinx_dma_bd_alloc(chan,
+						   sizeof(*chan->seg_mv) *
+						   chan->num_descs,
+						   &chan->seg_p);
 		if (!chan->seg_mv) {
 			dev_err(chan->dev,
 				"unable to allocate channel %d descriptors\n",
 				chan->id);
 			return -ENOMEM;
 		}
-		for (i = 0; i < XILINX_DMA_NUM_DESCS; i++) {
+		for (i = 0; i < chan->num_descs; i++) {
 			chan->seg_mv[i].hw.next_desc =
 			lower_32_bits(chan->seg_p + sizeof(*chan->seg_mv) *
-				((i + 1) % XILINX_DMA_NUM_DESCS));
+				((i + 1) % chan->num_descs));
 			chan->seg_mv[i].hw.next_desc_msb =
 			upper_32_bits(chan->seg_p + sizeof(*chan->seg_mv) *
-				((i + 1) % XILINX_DMA_NUM_DESCS));
+				((i + 1) % chan->num_descs));
 			chan->seg_mv[i].phys = chan->seg_p +
 				sizeof(*chan->seg_mv) * i;
 			list_add_tail(&chan->seg_mv[i].node,
@@ -1174,6 +1786,9 @@ static int xilinx_dma_alloc_chan_resources(struct dma_chan *dchan)
 		return -ENOMEM;
 	}
 
+	if (chan->desc_pool)
+		xilinx_dma_fill_seg_cache(chan);
+
 	dma_cookie_init(dchan);
 
 	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIDMA) {
@@ -1182,6 +1797,8 @@ static int xilinx_dma_alloc_chan_resources(struct dma_chan *dchan)
 		 */
 		dma_ctrl_set(chan, XILINX_DMA_REG_DMACR,
 			      XILINX_DMA_DMAXR_ALL_IRQ_MASK);
+		if (chan->busy_poll)
+			xilinx_dma_irq_mask(chan);
 	}
 
 	if ((chan->xdev->dma_config->dmatype == XDMA_TYPE_CDMA) && chan->has_sg)
@@ -1200,63 +1817,23 @@ static int xilinx_dma_alloc_chan_resources(struct dma_chan *dchan)
  * Return: Amount of data that has to be copied
  */
 static int xilinx_dma_calc_copysize(struct xilinx_dma_chan *chan,
-				    int size, int done)
-{
-	size_t copy;
-
-	copy = min_t(size_t, size - done,
-		     chan->xdev->max_buffer_len);
-
-	if ((copy + done < size) &&
-	    chan->xdev->common.copy_align) {
-		/*
-		 * If this is not the last descriptor, make sure
-		 * the next one will be properly aligned
-		 */
-		copy = rounddown(copy,
-				 (1 << chan->xdev->common.copy_align));
-	}
-	return copy;
-}
-
-/**
- * xilinx_dma_tx_status - Get DMA transaction status
- * @dchan: DMA channel
- * @cookie: Transaction identifier
- * @txstate: Transaction state
- *
- * Return: DMA transaction status
- */
-static enum dma_status xilinx_dma_tx_status(struct dma_chan *dchan,
-					dma_cookie_t cookie,
-					struct dma_tx_state *txstate)
-{
-	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
-	struct xilinx_dma_tx_descriptor *desc;
-	enum dma_status ret;
-	unsigned long flags;
-	u32 residue = 0;
+				    int size, int done)
+{
+	size_t copy;
 
-	ret = dma_cookie_status(dchan, cookie, txstate);
-	if (ret == DMA_COMPLETE || !txstate)
-		return ret;
+	copy = min_t(size_t, size - done,
+		     chan->xdev->max_buffer_len);
 
-	spin_lock_irqsave(&chan->lock, flags);
-	if (!list_empty(&chan->active_list)) {
-		desc = list_last_entry(&chan->active_list,
-				       struct xilinx_dma_tx_descriptor, node);
+	if ((copy + done < size) &&
+	    chan->xdev->common.copy_align) {
 		/*
-		 * VDMA and simple mode do not support residue reporting, so the
-		 * residue field will always be 0.
+		 * If this is not the last descriptor, make sure
+		 * the next one will be properly aligned
 		 */
-		if (chan->has_sg && chan->xdev->dma_config->dmatype != XDMA_TYPE_VDMA)
-			residue = xilinx_dma_get_residue(chan, desc);
+		copy = rounddown(copy,
+				 (1 << chan->xdev->common.copy_align));
 	}
-	spin_unlock_irqrestore(&chan->lock, flags);
-
-	dma_set_residue(txstate, residue);
-
-	return ret;
+	return copy;
 }
 
 /**
@@ -1491,6 +2068,81 @@ static void xilinx_cdma_start_transfer(struct xilinx_dma_chan *chan)
 	chan->idle = false;
 }
 
+/**
+ * xilinx_dma_hot_append - Extend a running SG chain with the pending list
+ * @chan: Driver specific DMA channel
+ *
+ * Only the tail pointer is moved. No BD the engine might already have
+ * fetched is rewritten, so the pending chain is appended only when the
+ * next pointer of the running tail already points at the pending head.
+ * That holds while segments come off the BD ring in order. Otherwise the
+ * pending descriptors wait for the channel to go idle as before. If the
+ * engine has already gone idle at the old tail, the tail pointer write
+ * restarts it from that next pointer.
+ *
+ * CONTEXT: chan->lock held
+ */
+static void xilinx_dma_hot_append(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_tx_descriptor *active_desc, *head_desc, *tail_desc;
+	struct xilinx_aximcdma_tx_segment *aximcdma_seg;
+	struct xilinx_axidma_tx_segment *axidma_seg;
+	u32 next, next_msb, reg;
+	dma_addr_t tail_phys;
+	u64 tail_next;
+
+	if (!chan->hot_append || !chan->has_sg || chan->cyclic ||
+	    list_empty(&chan->pending_list) ||
+	    list_empty(&chan->active_list))
+		return;
+
+	active_desc = list_last_entry(&chan->active_list,
+				      struct xilinx_dma_tx_descriptor, node);
+	head_desc = list_first_entry(&chan->pending_list,
+				     struct xilinx_dma_tx_descriptor, node);
+	tail_desc = list_last_entry(&chan->pending_list,
+				    struct xilinx_dma_tx_descriptor, node);
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA) {
+		aximcdma_seg = list_last_entry(&active_desc->segments,
+					       struct xilinx_aximcdma_tx_segment,
+					       node);
+		next = aximcdma_seg->hw.next_desc;
+		next_msb = aximcdma_seg->hw.next_desc_msb;
+		aximcdma_seg = list_last_entry(&tail_desc->segments,
+					       struct xilinx_aximcdma_tx_segment,
+					       node);
+		tail_phys = aximcdma_seg->phys;
+		reg = XILINX_MCDMA_CHAN_TDESC_OFFSET(chan->tdest);
+	} else {
+		axidma_seg = list_last_entry(&active_desc->segments,
+					     struct xilinx_axidma_tx_segment,
+					     node);
+		next = axidma_seg->hw.next_desc;
+		next_msb = axidma_seg->hw.next_desc_msb;
+		axidma_seg = list_last_entry(&tail_desc->segments,
+					     struct xilinx_axidma_tx_segment,
+					     node);
+		tail_phys = axidma_seg->phys;
+		reg = XILINX_DMA_REG_TAILDESC;
+	}
+
+	tail_next = next;
+	if (chan->ext_addr)
+		tail_next |= (u64)next_msb << 32;
+
+	if (tail_next != head_desc->async_tx.phys)
+		return;
+
+	/* The appended descriptors complete on BD status, not on IOC count */
+	chan->coal_partial = true;
+
+	xilinx_write(chan, reg, tail_phys);
+
+	list_splice_tail_init(&chan->pending_list, &chan->active_list);
+	chan->desc_pendingcount = 0;
+}
+
 /**
  * xilinx_dma_start_transfer - Starts DMA transfer
  * @chan: Driver specific channel struct pointer
@@ -1499,7 +2151,7 @@ static void xilinx_dma_start_transfer(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_dma_tx_descriptor *head_desc, *tail_desc;
 	struct xilinx_axidma_tx_segment *tail_segment;
-	u32 reg;
+	u32 reg, count, delay;
 
 	if (chan->err)
 		return;
@@ -1507,8 +2159,10 @@ static void xilinx_dma_start_transfer(struct xilinx_dma_chan *chan)
 	if (list_empty(&chan->pending_list))
 		return;
 
-	if (!chan->idle)
+	if (!chan->idle) {
+		xilinx_dma_hot_append(chan);
 		return;
+	}
 
 	head_desc = list_first_entry(&chan->pending_list,
 				     struct xilinx_dma_tx_descriptor, node);
@@ -1519,10 +2173,12 @@ static void xilinx_dma_start_transfer(struct xilinx_dma_chan *chan)
 
 	reg = dma_ctrl_read(chan, XILINX_DMA_REG_DMACR);
 
-	if (chan->desc_pendingcount <= XILINX_DMA_COALESCE_MAX) {
-		reg &= ~XILINX_DMA_CR_COALESCE_MAX;
-		reg |= chan->desc_pendingcount <<
-				  XILINX_DMA_CR_COALESCE_SHIFT;
+	count = xilinx_dma_coalesce_count(chan, &delay);
+	if (count <= XILINX_DMA_COALESCE_MAX) {
+		reg &= ~(XILINX_DMA_CR_COALESCE_MAX |
+			 XILINX_DMA_DMACR_DELAY_MASK);
+		reg |= count << XILINX_DMA_CR_COALESCE_SHIFT;
+		reg |= delay << XILINX_DMA_DMACR_DELAY_SHIFT;
 		dma_ctrl_write(chan, XILINX_DMA_REG_DMACR, reg);
 	}
 
@@ -1565,6 +2221,41 @@ static void xilinx_dma_start_transfer(struct xilinx_dma_chan *chan)
 	chan->idle = false;
 }
 
+/**
+ * xilinx_mcdma_program_sched - Program the MM2S scheduler for a channel
+ * @chan: Driver specific channel struct pointer
+ *
+ * The scheduler type and the weights of all MM2S channels live in shared
+ * registers, which a reset returns to their defaults.
+ */
+static void xilinx_mcdma_program_sched(struct xilinx_dma_chan *chan)
+{
+	struct xilinx_dma_device *xdev = chan->xdev;
+	unsigned long flags;
+	u32 reg;
+
+	if (chan->direction != DMA_MEM_TO_DEV)
+		return;
+
+	spin_lock_irqsave(&xdev->sched_lock, flags);
+
+	if (xdev->mcdma_sched >= 0) {
+		reg = dma_ctrl_read(chan, XILINX_MCDMA_SCHD_TYPE_OFFSET);
+		reg &= ~XILINX_MCDMA_SCHD_TYPE_MASK;
+		reg |= xdev->mcdma_sched;
+		dma_ctrl_write(chan, XILINX_MCDMA_SCHD_TYPE_OFFSET, reg);
+	}
+
+	if (chan->weight) {
+		reg = dma_ctrl_read(chan, XILINX_MCDMA_WRR_OFFSET(chan->tdest));
+		reg &= ~XILINX_MCDMA_WRR_MASK(chan->tdest);
+		reg |= chan->weight << XILINX_MCDMA_WRR_SHIFT(chan->tdest);
+		dma_ctrl_write(chan, XILINX_MCDMA_WRR_OFFSET(chan->tdest), reg);
+	}
+
+	spin_unlock_irqrestore(&xdev->sched_lock, flags);
+}
+
 /**
  * xilinx_mcdma_start_transfer - Starts MCDMA transfer
  * @chan: Driver specific channel struct pointer
@@ -1573,7 +2264,7 @@ static void xilinx_mcdma_start_transfer(struct xilinx_dma_chan *chan)
 {
 	struct xilinx_dma_tx_descriptor *head_desc, *tail_desc;
 	struct xilinx_aximcdma_tx_segment *tail_segment;
-	u32 reg;
+	u32 reg, count, delay;
 
 	/*
 	 * lock has been held by calling functions, so we don't need it
@@ -1583,8 +2274,10 @@ static void xilinx_mcdma_start_transfer(struct xilinx_dma_chan *chan)
 	if (chan->err)
 		return;
 
-	if (!chan->idle)
+	if (!chan->idle) {
+		xilinx_dma_hot_append(chan);
 		return;
+	}
 
 	if (list_empty(&chan->pending_list))
 		return;
@@ -1598,15 +2291,21 @@ static void xilinx_mcdma_start_transfer(struct xilinx_dma_chan *chan)
 
 	reg = dma_ctrl_read(chan, XILINX_MCDMA_CHAN_CR_OFFSET(chan->tdest));
 
-	if (chan->desc_pendingcount <= XILINX_MCDMA_COALESCE_MAX) {
-		reg &= ~XILINX_MCDMA_COALESCE_MASK;
-		reg |= chan->desc_pendingcount <<
-			XILINX_MCDMA_COALESCE_SHIFT;
+	count = xilinx_dma_coalesce_count(chan, &delay);
+	if (count <= XILINX_MCDMA_COALESCE_MAX) {
+		reg &= ~(XILINX_MCDMA_COALESCE_MASK | XILINX_MCDMA_DELAY_MASK);
+		reg |= count << XILINX_MCDMA_COALESCE_SHIFT;
+		reg |= delay << XILINX_MCDMA_DELAY_SHIFT;
 	}
 
-	reg |= XILINX_MCDMA_IRQ_ALL_MASK;
+	if (chan->irq_masked)
+		reg |= XILINX_MCDMA_IRQ_ERR_MASK;
+	else
+		reg |= XILINX_MCDMA_IRQ_ALL_MASK;
 	dma_ctrl_write(chan, XILINX_MCDMA_CHAN_CR_OFFSET(chan->tdest), reg);
 
+	xilinx_mcdma_program_sched(chan);
+
 	/* Program current descriptor */
 	xilinx_write(chan, XILINX_MCDMA_CHAN_CDESC_OFFSET(chan->tdest),
 		     head_desc->async_tx.phys);
@@ -1653,7 +2352,7 @@ static void xilinx_dma_issue_pending(struct dma_chan *dchan)
  * xilinx_dma_complete_descriptor - Mark the active descriptor as complete
  * @chan : xilinx DMA channel
  *
- * CONTEXT: hardirq
+ * CONTEXT: hardirq, or chan->lock held when busy polling
  */
 static void xilinx_dma_complete_descriptor(struct xilinx_dma_chan *chan)
 {
@@ -1664,6 +2363,11 @@ static void xilinx_dma_complete_descriptor(struct xilinx_dma_chan *chan)
 		return;
 
 	list_for_each_entry_safe(desc, next, &chan->active_list, node) {
+		/* A partially coalesced batch may still be running */
+		if (chan->coal_partial && !chan->err &&
+		    !xilinx_dma_desc_done(chan, desc))
+			break;
+
 		if (chan->has_sg && chan->xdev->dma_config->dmatype !=
 		    XDMA_TYPE_VDMA)
 			desc->residue = xilinx_dma_get_residue(chan, desc);
@@ -1671,6 +2375,12 @@ static void xilinx_dma_complete_descriptor(struct xilinx_dma_chan *chan)
 			desc->residue = 0;
 		desc->err = chan->err;
 
+		if (chan->dim_enabled) {
+			chan->dim_pkts++;
+			chan->dim_bytes += xilinx_dma_get_transferred(chan,
+								      desc);
+		}
+
 		list_del(&desc->node);
 		if (!desc->cyclic)
 			dma_cookie_complete(&desc->async_tx);
@@ -1678,6 +2388,99 @@ static void xilinx_dma_complete_descriptor(struct xilinx_dma_chan *chan)
 	}
 }
 
+/**
+ * xilinx_dma_poll_complete - Complete descriptors without the irq
+ * @chan: Driver specific DMA channel
+ *
+ * Checks the completion bit in the channel status register, acks it and
+ * completes the finished descriptors, running their callbacks in the
+ * caller's context. Errors are still reported by the irq handler.
+ */
+static void xilinx_dma_poll_complete(struct xilinx_dma_chan *chan)
+{
+	unsigned long flags;
+	u32 reg, ioc;
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA) {
+		reg = XILINX_MCDMA_CHAN_SR_OFFSET(chan->tdest);
+		ioc = XILINX_MCDMA_IRQ_IOC_MASK;
+	} else {
+		reg = XILINX_DMA_REG_DMASR;
+		ioc = XILINX_DMA_DMASR_FRM_CNT_IRQ;
+	}
+
+	spin_lock_irqsave(&chan->lock, flags);
+	if (dma_ctrl_read(chan, reg) & ioc) {
+		dma_ctrl_write(chan, reg, ioc);
+		xilinx_dma_complete_descriptor(chan);
+		if (list_empty(&chan->active_list))
+			chan->idle = true;
+		chan->start_transfer(chan);
+	}
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	xilinx_dma_chan_desc_cleanup(chan, INT_MAX);
+}
+
+/**
+ * xilinx_dma_tx_status - Get DMA transaction status
+ * @dchan: DMA channel
+ * @cookie: Transaction identifier
+ * @txstate: Transaction state
+ *
+ * Return: DMA transaction status
+ */
+static enum dma_status xilinx_dma_tx_status(struct dma_chan *dchan,
+					dma_cookie_t cookie,
+					struct dma_tx_state *txstate)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	struct xilinx_dma_tx_descriptor *desc;
+	enum dma_status ret;
+	unsigned long flags;
+	u32 residue = 0;
+
+	ret = dma_cookie_status(dchan, cookie, txstate);
+	if (ret != DMA_COMPLETE && chan->busy_poll) {
+		xilinx_dma_poll_complete(chan);
+		ret = dma_cookie_status(dchan, cookie, txstate);
+	}
+
+	if (ret == DMA_COMPLETE || !txstate)
+		return ret;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	/*
+	 * VDMA and simple mode do not support residue reporting, so the
+	 * residue field will always be 0.
+	 */
+	if (chan->has_sg && chan->xdev->dma_config->dmatype != XDMA_TYPE_VDMA) {
+		list_for_each_entry(desc, &chan->active_list, node) {
+			if (desc->async_tx.cookie != cookie)
+				continue;
+
+			if (chan->xdev->dma_config->dmatype == XDMA_TYPE_AXIDMA)
+				residue = xilinx_axidma_get_hw_residue(chan,
+								       desc);
+			else
+				residue = xilinx_dma_get_residue(chan, desc);
+			break;
+		}
+
+		list_for_each_entry(desc, &chan->pending_list, node) {
+			if (desc->async_tx.cookie == cookie) {
+				residue = xilinx_dma_get_residue(chan, desc);
+				break;
+			}
+		}
+	}
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	dma_set_residue(txstate, residue);
+
+	return ret;
+}
+
 /**
  * xilinx_dma_reset - Reset DMA channel
  * @chan: Driver specific DMA channel
@@ -1729,6 +2532,8 @@ static int xilinx_dma_chan_reset(struct xilinx_dma_chan *chan)
 	/* Enable interrupts */
 	dma_ctrl_set(chan, XILINX_DMA_REG_DMACR,
 		      XILINX_DMA_DMAXR_ALL_IRQ_MASK);
+	if (chan->busy_poll)
+		xilinx_dma_irq_mask(chan);
 
 	return 0;
 }
@@ -1789,15 +2594,18 @@ static irqreturn_t xilinx_mcdma_irq_handler(int irq, void *data)
 		dev_dbg(chan->dev, "Inter-packet latency too long\n");
 	}
 
-	if (status & XILINX_MCDMA_IRQ_IOC_MASK) {
+	if (status & XILINX_MCDMA_IRQ_IOC_MASK ||
+	    (chan->coal_partial && status & XILINX_MCDMA_IRQ_DELAY_MASK)) {
 		spin_lock(&chan->lock);
 		xilinx_dma_complete_descriptor(chan);
-		chan->idle = true;
+		xilinx_dma_dim_update(chan);
+		if (list_empty(&chan->active_list))
+			chan->idle = true;
 		chan->start_transfer(chan);
 		spin_unlock(&chan->lock);
 	}
 
-	tasklet_schedule(&chan->tasklet);
+	xilinx_dma_sched_cleanup(chan);
 	return IRQ_HANDLED;
 }
 
@@ -1853,15 +2661,18 @@ static irqreturn_t xilinx_dma_irq_handler(int irq, void *data)
 		dev_dbg(chan->dev, "Inter-packet latency too long\n");
 	}
 
-	if (status & XILINX_DMA_DMASR_FRM_CNT_IRQ) {
+	if (status & XILINX_DMA_DMASR_FRM_CNT_IRQ ||
+	    (chan->coal_partial && status & XILINX_DMA_DMASR_DLY_CNT_IRQ)) {
 		spin_lock(&chan->lock);
 		xilinx_dma_complete_descriptor(chan);
-		chan->idle = true;
+		xilinx_dma_dim_update(chan);
+		if (list_empty(&chan->active_list))
+			chan->idle = true;
 		chan->start_transfer(chan);
 		spin_unlock(&chan->lock);
 	}
 
-	tasklet_schedule(&chan->tasklet);
+	xilinx_dma_sched_cleanup(chan);
 	return IRQ_HANDLED;
 }
 
@@ -2524,10 +3335,172 @@ int xilinx_vdma_channel_set_config(struct dma_chan *dchan,
 }
 EXPORT_SYMBOL(xilinx_vdma_channel_set_config);
 
+/**
+ * xilinx_dma_channel_set_poll - Select busy-poll completion
+ * @dchan: DMA channel
+ * @enable: Poll for completions instead of taking interrupts
+ *
+ * With polling enabled the channel completion interrupts stay masked and
+ * dmaengine_tx_status() checks the hardware and completes finished
+ * descriptors itself. Their callbacks then run in the polling context.
+ * Error interrupts stay enabled. Supported on AXI DMA, MCDMA and CDMA.
+ *
+ * Return: '0' on success and failure value on error
+ */
+int xilinx_dma_channel_set_poll(struct dma_chan *dchan, bool enable)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	unsigned long flags;
+
+	if (chan->xdev->dma_config->dmatype == XDMA_TYPE_VDMA)
+		return -EINVAL;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->busy_poll = enable;
+	if (enable)
+		xilinx_dma_irq_mask(chan);
+	else
+		xilinx_dma_irq_unmask(chan);
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(xilinx_dma_channel_set_poll);
+
+/**
+ * xilinx_mcdma_channel_set_weight - Set the MCDMA scheduler weight
+ * @dchan: DMA channel
+ * @weight: Weighted round-robin weight, 1 to 15
+ *
+ * Only MM2S channels of an MCDMA are scheduled by the core, S2MM traffic
+ * is steered by the stream TDEST. The weight takes effect immediately and
+ * is restored whenever the channel is started after a reset. It only has
+ * an effect when the MM2S scheduler is in weighted round-robin mode.
+ *
+ * Return: '0' on success and failure value on error
+ */
+int xilinx_mcdma_channel_set_weight(struct dma_chan *dchan, u32 weight)
+{
+	struct xilinx_dma_chan *chan = to_xilinx_chan(dchan);
+	unsigned long flags;
+
+	if (chan->xdev->dma_config->dmatype != XDMA_TYPE_AXIMCDMA ||
+	    chan->direction != DMA_MEM_TO_DEV)
+		return -EINVAL;
+
+	if (!weight || weight > XILINX_MCDMA_WRR_WEIGHT_MAX)
+		return -EINVAL;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	chan->weight = weight;
+	xilinx_mcdma_program_sched(chan);
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(xilinx_mcdma_channel_set_weight);
+
 /* -----------------------------------------------------------------------------
  * Probe and remove
  */
 
+/**
+ * xilinx_dma_delay_tick_ps - Period of the delay timer
+ * @xdev: Driver specific device structure
+ *
+ * Return: The delay timer tick in picoseconds
+ */
+static u32 xilinx_dma_delay_tick_ps(struct xilinx_dma_device *xdev)
+{
+	/* axidma_clk_init hands m_axi_sg_aclk back through rx_clk */
+	unsigned long rate = clk_get_rate(xdev->rx_clk);
+
+	if (!rate)
+		rate = clk_get_rate(xdev->axi_clk);
+	if (!rate)
+		rate = 100000000;
+
+	return DIV_ROUND_UP_ULL(XILINX_DMA_DELAY_TICK_CYCLES * NSEC_PER_SEC *
+				1000ULL, rate);
+}
+
+static struct xilinx_dma_chan *dev_to_xilinx_chan(struct device *dev)
+{
+	return to_xilinx_chan(container_of(dev, struct dma_chan_dev,
+					   device)->chan);
+}
+
+static ssize_t adaptive_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct xilinx_dma_chan *chan = dev_to_xilinx_chan(dev);
+
+	return sprintf(buf, "%d\n", chan->dim_enabled);
+}
+
+static ssize_t adaptive_store(struct device *dev,
+			      struct device_attribute *attr,
+			      const char *buf, size_t count)
+{
+	struct xilinx_dma_chan *chan = dev_to_xilinx_chan(dev);
+	unsigned long flags;
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+
+	if (!IS_ENABLED(CONFIG_DIMLIB))
+		return -EOPNOTSUPP;
+
+	spin_lock_irqsave(&chan->lock, flags);
+	if (enable && !chan->dim_enabled) {
+		chan->dim.state = DIM_START_MEASURE;
+		chan->dim.tune_state = DIM_GOING_RIGHT;
+		chan->dim.profile_ix = XILINX_DMA_DIM_DEF_PROFILE;
+		xilinx_dma_dim_apply(chan, XILINX_DMA_DIM_DEF_PROFILE);
+	}
+	chan->dim_enabled = enable;
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	if (!enable)
+		cancel_work_sync(&chan->dim.work);
+
+	return count;
+}
+static DEVICE_ATTR_RW(adaptive);
+
+static ssize_t count_show(struct device *dev,
+			  struct device_attribute *attr, char *buf)
+{
+	struct xilinx_dma_chan *chan = dev_to_xilinx_chan(dev);
+
+	return sprintf(buf, "%u\n", chan->coal_count);
+}
+static DEVICE_ATTR_RO(count);
+
+static ssize_t delay_us_show(struct device *dev,
+			     struct device_attribute *attr, char *buf)
+{
+	struct xilinx_dma_chan *chan = dev_to_xilinx_chan(dev);
+
+	return sprintf(buf, "%u\n", chan->coal_usec);
+}
+static DEVICE_ATTR_RO(delay_us);
+
+static struct attribute *xilinx_dma_coalesce_attrs[] = {
+	&dev_attr_adaptive.attr,
+	&dev_attr_count.attr,
+	&dev_attr_delay_us.attr,
+	NULL,
+};
+
+static const struct attribute_group xilinx_dma_coalesce_group = {
+	.name = "coalesce",
+	.attrs = xilinx_dma_coalesce_attrs,
+};
+
 /**
  * xilinx_dma_chan_remove - Per Channel remove function
  * @chan: Driver specific DMA channel
@@ -2543,6 +3516,11 @@ static void xilinx_dma_chan_remove(struct xilinx_dma_chan *chan)
 
 	tasklet_kill(&chan->tasklet);
 
+	if (chan->poll_task)
+		kthread_stop(chan->poll_task);
+
+	cancel_work_sync(&chan->dim.work);
+
 	list_del(&chan->common.device_node);
 }
 
@@ -2787,8 +3765,14 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	/* Retrieve the channel properties from the device tree */
 	has_dre = of_property_read_bool(node, "xlnx,include-dre");
 
+	chan->num_descs = XILINX_DMA_NUM_DESCS;
+	if (!of_property_read_u32(node, "xlnx,num-descs", &value) && value)
+		chan->num_descs = value;
+
 	chan->genlock = of_property_read_bool(node, "xlnx,genlock-mode");
 
+	chan->hot_append = of_property_read_bool(node, "xlnx,hot-append");
+
 	err = of_property_read_u32(node, "xlnx,datawidth", &value);
 	if (err) {
 		dev_err(xdev->dev, "missing xlnx,datawidth property\n");
@@ -2810,6 +3794,17 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 		chan->id = xdev->mm2s_chan_id++;
 		chan->tdest = chan->id;
 
+		if (xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA &&
+		    !of_property_read_u32_index(node, "xlnx,channel-weights",
+						chan->tdest, &value)) {
+			if (value && value <= XILINX_MCDMA_WRR_WEIGHT_MAX)
+				chan->weight = value;
+			else
+				dev_warn(xdev->dev,
+					 "invalid weight %u for channel %d\n",
+					 value, chan->id);
+		}
+
 		chan->ctrl_offset = XILINX_DMA_MM2S_CTRL_OFFSET;
 		if (xdev->dma_config->dmatype == XDMA_TYPE_VDMA) {
 			chan->desc_offset = XILINX_VDMA_MM2S_DESC_OFFSET;
@@ -2889,6 +3884,11 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	tasklet_init(&chan->tasklet, xilinx_dma_do_tasklet,
 			(unsigned long)chan);
 
+	/* Adaptive coalescing stays off until enabled through sysfs */
+	INIT_WORK(&chan->dim.work, xilinx_dma_dim_work);
+	chan->dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+	chan->delay_tick_ps = xilinx_dma_delay_tick_ps(xdev);
+
 	/*
 	 * Initialize the DMA channel and add it to the DMA engine channels
 	 * list.
@@ -2898,6 +3898,15 @@ static int xilinx_dma_chan_probe(struct xilinx_dma_device *xdev,
 	list_add_tail(&chan->common.device_node, &xdev->common.channels);
 	xdev->chan[chan->id] = chan;
 
+	/* Optionally run completions in a thread instead of the tasklet */
+	if (!of_property_read_u32(node, "xlnx,completion-budget", &value) &&
+	    value) {
+		chan->poll_budget = min_t(u32, value, INT_MAX);
+		err = xilinx_dma_poll_init(chan, node);
+		if (err)
+			return err;
+	}
+
 	/* Reset the channel */
 	err = xilinx_dma_chan_reset(chan);
 	if (err < 0) {
@@ -3002,7 +4011,7 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 	struct device_node *node = pdev->dev.of_node;
 	struct xilinx_dma_device *xdev;
 	struct device_node *child, *np = pdev->dev.of_node;
-	u32 num_frames, addr_width, len_width;
+	u32 num_frames, addr_width, len_width, sched;
 	int i, err;
 
 	/* Allocate and initialize the DMA engine structure */
@@ -3034,9 +4043,26 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 	/* Retrieve the DMA engine properties from the device tree */
 	xdev->max_buffer_len = GENMASK(XILINX_DMA_MAX_TRANS_LEN_MAX - 1, 0);
 	xdev->s2mm_chan_id = xdev->dma_config->max_channels / 2;
+	xdev->mcdma_sched = -1;
+	spin_lock_init(&xdev->sched_lock);
+
+	if (xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA &&
+	    !of_property_read_u32(node, "xlnx,mm2s-scheduler", &sched)) {
+		if (sched <= XILINX_MCDMA_SCHD_WRR)
+			xdev->mcdma_sched = sched;
+		else
+			dev_warn(xdev->dev,
+				 "invalid xlnx,mm2s-scheduler %u\n", sched);
+	}
 
 	if (xdev->dma_config->dmatype == XDMA_TYPE_AXIDMA ||
 	    xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA) {
+		if (of_find_property(node, "xlnx,bd-sram", NULL)) {
+			xdev->bd_pool = of_gen_pool_get(node, "xlnx,bd-sram", 0);
+			if (!xdev->bd_pool)
+				return -EPROBE_DEFER;
+		}
+
 		if (!of_property_read_u32(node, "xlnx,sg-length-width",
 					  &len_width)) {
 			if (len_width < XILINX_DMA_MAX_TRANS_LEN_MIN ||
@@ -3101,9 +4127,12 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 		xdev->common.device_prep_slave_sg = xilinx_dma_prep_slave_sg;
 		xdev->common.device_prep_dma_cyclic =
 					  xilinx_dma_prep_dma_cyclic;
-		/* Residue calculation is supported by only AXI DMA and CDMA */
+		/*
+		 * Residue calculation is supported by only AXI DMA and CDMA.
+		 * AXI DMA follows the engine position through CURDESC.
+		 */
 		xdev->common.residue_granularity =
-					  DMA_RESIDUE_GRANULARITY_SEGMENT;
+					  DMA_RESIDUE_GRANULARITY_BURST;
 	} else if (xdev->dma_config->dmatype == XDMA_TYPE_CDMA) {
 		dma_cap_set(DMA_MEMCPY, xdev->common.cap_mask);
 		xdev->common.device_prep_dma_memcpy = xilinx_cdma_prep_memcpy;
@@ -3135,6 +4164,23 @@ static int xilinx_dma_probe(struct platform_device *pdev)
 	/* Register the DMA engine with the core */
 	dma_async_device_register(&xdev->common);
 
+	/* Adaptive coalescing relies on SG descriptor status writeback */
+	if (xdev->dma_config->dmatype == XDMA_TYPE_AXIDMA ||
+	    xdev->dma_config->dmatype == XDMA_TYPE_AXIMCDMA) {
+		for (i = 0; i < xdev->dma_config->max_channels; i++) {
+			struct xilinx_dma_chan *chan = xdev->chan[i];
+
+			if (!chan || !chan->has_sg)
+				continue;
+
+			if (device_add_group(&chan->common.dev->device,
+					     &xilinx_dma_coalesce_group))
+				dev_warn(xdev->dev,
+					 "ch %d: no coalescing attributes\n",
+					 chan->id);
+		}
+	}
+
 	err = of_dma_controller_register(node, of_dma_xilinx_xlate,
 					 xdev);
 	if (err < 0) {
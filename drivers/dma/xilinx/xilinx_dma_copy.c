@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Memory copy offload through a DMA_MEMCPY capable channel
+ *
+ * Copies of kernel buffers of at least copy_threshold bytes are handed
+ * to a memcpy channel, such as the ZynqMP DMA or the AXI CDMA. Smaller
+ * copies, and copies when no channel is available, use memcpy().
+ */
+
+#include <linux/atomic.h>
+#include <linux/completion.h>
+#include <linux/dma-mapping.h>
+#include <linux/dma/xilinx_dma_copy.h>
+#include <linux/dmaengine.h>
+#include <linux/mm.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/sizes.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+/* bytes per descriptor, below the transfer limit of the CDMA */
+#define XILINX_DMA_COPY_CHUNK	SZ_4M
+
+static unsigned int copy_threshold = SZ_64K;
+module_param(copy_threshold, uint, 0644);
+MODULE_PARM_DESC(copy_threshold,
+		 "Smallest copy in bytes that is offloaded to DMA (default: 64 KiB)");
+
+static DEFINE_MUTEX(xilinx_dma_copy_lock);
+static struct dma_chan *xilinx_dma_copy_chan;
+static bool xilinx_dma_copy_probed;
+
+/**
+ * struct xilinx_dma_copy_req - An offloaded copy
+ * @dev: Device the buffers are mapped for
+ * @dst: DMA address of the destination
+ * @src: DMA address of the source
+ * @len: Length of the copy in bytes
+ * @pending: Submitted chunks plus one reference held by the submitter
+ * @err: First error of the copy
+ * @done: Completion callback of the caller
+ * @param: Parameter of @done
+ */
+struct xilinx_dma_copy_req {
+	struct device *dev;
+	dma_addr_t dst;
+	dma_addr_t src;
+	size_t len;
+	atomic_t pending;
+	int err;
+	xilinx_dma_copy_callback done;
+	void *param;
+};
+
+static struct dma_chan *xilinx_dma_copy_get_chan(void)
+{
+	dma_cap_mask_t mask;
+
+	mutex_lock(&xilinx_dma_copy_lock);
+	if (!xilinx_dma_copy_probed) {
+		dma_cap_zero(mask);
+		dma_cap_set(DMA_MEMCPY, mask);
+		xilinx_dma_copy_chan = dma_request_channel(mask, NULL, NULL);
+		/* retry on later copies while no channel has probed yet */
+		xilinx_dma_copy_probed = !!xilinx_dma_copy_chan;
+	}
+	mutex_unlock(&xilinx_dma_copy_lock);
+
+	return xilinx_dma_copy_chan;
+}
+
+static void xilinx_dma_copy_put(struct xilinx_dma_copy_req *req)
+{
+	if (!atomic_dec_and_test(&req->pending))
+		return;
+
+	dma_unmap_single(req->dev, req->src, req->len, DMA_TO_DEVICE);
+	dma_unmap_single(req->dev, req->dst, req->len, DMA_FROM_DEVICE);
+
+	req->done(req->param, req->err);
+	kfree(req);
+}
+
+static void xilinx_dma_copy_complete(void *param,
+				     const struct dmaengine_result *result)
+{
+	struct xilinx_dma_copy_req *req = param;
+
+	if (result && result->result != DMA_TRANS_NOERROR)
+		req->err = -EIO;
+
+	xilinx_dma_copy_put(req);
+}
+
+/*
+ * Submits the copy in chunks. A chunk that can't be queued fails the
+ * request, which then completes once the chunks already queued are done.
+ */
+static void xilinx_dma_copy_submit(struct dma_chan *chan,
+				   struct xilinx_dma_copy_req *req)
+{
+	struct dma_async_tx_descriptor *tx;
+	size_t off, chunk;
+	dma_cookie_t cookie;
+
+	atomic_set(&req->pending, 1);
+
+	for (off = 0; off < req->len; off += chunk) {
+		chunk = min_t(size_t, req->len - off, XILINX_DMA_COPY_CHUNK);
+		tx = dmaengine_prep_dma_memcpy(chan, req->dst + off,
+					       req->src + off, chunk,
+					       DMA_CTRL_ACK |
+					       DMA_PREP_INTERRUPT);
+		if (!tx) {
+			req->err = -ENOMEM;
+			break;
+		}
+
+		tx->callback_result = xilinx_dma_copy_complete;
+		tx->callback_param = req;
+
+		atomic_inc(&req->pending);
+		cookie = dmaengine_submit(tx);
+		if (dma_submit_error(cookie)) {
+			atomic_dec(&req->pending);
+			req->err = -EIO;
+			break;
+		}
+	}
+
+	dma_async_issue_pending(chan);
+	xilinx_dma_copy_put(req);
+}
+
+/**
+ * xilinx_dma_copy_async - Copy a kernel buffer, offloaded when worthwhile
+ * @dst: Destination, in the kernel linear mapping when offloaded
+ * @src: Source, in the kernel linear mapping when offloaded
+ * @len: Length of the copy in bytes
+ * @done: Called with @param and 0 or an error code once the copy is done
+ * @param: Parameter of @done
+ *
+ * Copies shorter than the copy_threshold module parameter, copies of
+ * buffers outside the linear mapping, and copies when no DMA_MEMCPY
+ * channel is available are done with memcpy() before returning. Otherwise
+ * @done is called from the completion context of the DMA channel. The
+ * buffers must not be touched by the CPU until then.
+ *
+ * Return: 0 when @done has been or will be called, a negative error code
+ * when the copy could not be started. A copy that fails after it has been
+ * started reports the error through @done.
+ */
+int xilinx_dma_copy_async(void *dst, const void *src, size_t len,
+			  xilinx_dma_copy_callback done, void *param)
+{
+	struct xilinx_dma_copy_req *req;
+	struct dma_chan *chan;
+	struct device *dev;
+	int ret;
+
+	if (!len || len < copy_threshold || !virt_addr_valid(dst) ||
+	    !virt_addr_valid(src) || !virt_addr_valid(dst + len - 1) ||
+	    !virt_addr_valid(src + len - 1))
+		goto fallback;
+
+	chan = xilinx_dma_copy_get_chan();
+	if (!chan)
+		goto fallback;
+
+	req = kzalloc(sizeof(*req), GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+
+	dev = chan->device->dev;
+	req->dev = dev;
+	req->len = len;
+	req->done = done;
+	req->param = param;
+
+	req->src = dma_map_single(dev, (void *)src, len, DMA_TO_DEVICE);
+	if (dma_mapping_error(dev, req->src)) {
+		ret = -ENOMEM;
+		goto err_free;
+	}
+
+	req->dst = dma_map_single(dev, dst, len, DMA_FROM_DEVICE);
+	if (dma_mapping_error(dev, req->dst)) {
+		ret = -ENOMEM;
+		goto err_unmap_src;
+	}
+
+	xilinx_dma_copy_submit(chan, req);
+
+	return 0;
+
+err_unmap_src:
+	dma_unmap_single(dev, req->src, len, DMA_TO_DEVICE);
+err_free:
+	kfree(req);
+	return ret;
+
+fallback:
+	memcpy(dst, src, len);
+	done(param, 0);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(xilinx_dma_copy_async);
+
+struct xilinx_dma_copy_wait {
+	struct completion done;
+	int err;
+};
+
+static void xilinx_dma_copy_wait_done(void *param, int err)
+{
+	struct xilinx_dma_copy_wait *wait = param;
+
+	wait->err = err;
+	complete(&wait->done);
+}
+
+/**
+ * xilinx_dma_copy - Copy a kernel buffer and wait for the copy
+ * @dst: Destination
+ * @src: Source
+ * @len: Length of the copy in bytes
+ *
+ * Like xilinx_dma_copy_async(), but sleeps until the copy is done. Falls
+ * back to memcpy() when the DMA copy fails.
+ *
+ * Return: 0.
+ */
+int xilinx_dma_copy(void *dst, const void *src, size_t len)
+{
+	struct xilinx_dma_copy_wait wait;
+	int err;
+
+	might_sleep();
+
+	if (len < copy_threshold) {
+		memcpy(dst, src, len);
+		return 0;
+	}
+
+	init_completion(&wait.done);
+	err = xilinx_dma_copy_async(dst, src, len,
+				    xilinx_dma_copy_wait_done, &wait);
+	if (!err) {
+		wait_for_completion(&wait.done);
+		err = wait.err;
+	}
+
+	if (err) {
+		memcpy(dst, src, len);
+		err = 0;
+	}
+
+	return err;
+}
+EXPORT_SYMBOL_GPL(xilinx_dma_copy);
+
+static void __exit xilinx_dma_copy_exit(void)
+{
+	if (xilinx_dma_copy_chan)
+		dma_release_channel(xilinx_dma_copy_chan);
+}
+module_exit(xilinx_dma_copy_exit);
+
+MODULE_DESCRIPTION("Xilinx DMA memory copy offload");
+MODULE_LICENSE("GPL v2");
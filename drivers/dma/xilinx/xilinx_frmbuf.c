@@ -24,6 +24,8 @@
 #include <linux/clk.h>
 #include <linux/delay.h>
 #include <linux/dma/xilinx_frmbuf.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-fence-array.h>
 #include <linux/dmapool.h>
 #include <linux/gpio/consumer.h>
 #include <linux/init.h>
@@ -141,6 +143,10 @@ struct xilinx_frmbuf_desc_hw {
  * @node: Node in the channel descriptors list
  * @fid: Field ID of buffer
  * @earlycb: Whether the callback should be called when in staged state
+ * @in_fence: Fence the buffer has to wait for before the frame starts
+ * @in_cb: Callback on @in_fence
+ * @fence_wait: The frame is held back until @in_fence signals
+ * @out_fence: Fence signalled when the frame is done
  */
 struct xilinx_frmbuf_tx_descriptor {
 	struct dma_async_tx_descriptor async_tx;
@@ -148,6 +154,10 @@ struct xilinx_frmbuf_tx_descriptor {
 	struct list_head node;
 	u32 fid;
 	u32 earlycb;
+	struct dma_fence *in_fence;
+	struct dma_fence_cb in_cb;
+	bool fence_wait;
+	struct dma_fence *out_fence;
 };
 
 /**
@@ -169,6 +179,9 @@ struct xilinx_frmbuf_tx_descriptor {
  * @vid_fmt: Reference to currently assigned video format description
  * @hw_fid: FID enabled in hardware flag
  * @mode: Select operation mode
+ * @fence_lock: Lock of the frame done fences
+ * @fence_context: Fence context of the frame done fences
+ * @fence_seqno: Sequence number of the last frame done fence
  */
 struct xilinx_frmbuf_chan {
 	struct xilinx_frmbuf_device *xdev;
@@ -190,6 +203,10 @@ struct xilinx_frmbuf_chan {
 	const struct xilinx_frmbuf_format_desc *vid_fmt;
 	bool hw_fid;
 	enum operation_mode mode;
+	/* Frame done fence lock */
+	spinlock_t fence_lock;
+	u64 fence_context;
+	unsigned int fence_seqno;
 };
 
 /**
@@ -866,6 +883,165 @@ int xilinx_xdma_set_earlycb(struct dma_chan *chan,
 }
 EXPORT_SYMBOL(xilinx_xdma_set_earlycb);
 
+static const char *xilinx_frmbuf_fence_get_name(struct dma_fence *fence)
+{
+	return "xilinx-frmbuf";
+}
+
+static const struct dma_fence_ops xilinx_frmbuf_fence_ops = {
+	.get_driver_name = xilinx_frmbuf_fence_get_name,
+	.get_timeline_name = xilinx_frmbuf_fence_get_name,
+};
+
+static void xilinx_frmbuf_fence_cb(struct dma_fence *fence,
+				   struct dma_fence_cb *cb)
+{
+	struct xilinx_frmbuf_tx_descriptor *desc =
+		container_of(cb, struct xilinx_frmbuf_tx_descriptor, in_cb);
+	struct xilinx_frmbuf_chan *chan = to_xilinx_chan(desc->async_tx.chan);
+
+	/* Called with the fence lock held, leave the start to the tasklet */
+	WRITE_ONCE(desc->fence_wait, false);
+	tasklet_schedule(&chan->tasklet);
+}
+
+/*
+ * Collect the fences a frame has to wait for: the last writer when the
+ * engine reads the buffer, the writer and all readers when it writes it.
+ */
+static int xilinx_frmbuf_get_in_fence(struct xilinx_frmbuf_chan *chan,
+				      struct dma_resv *resv,
+				      struct dma_fence **in_fence)
+{
+	struct dma_fence **fences, *excl;
+	struct dma_fence_array *array;
+	unsigned int count;
+	int ret;
+
+	*in_fence = NULL;
+
+	if (chan->direction == DMA_MEM_TO_DEV) {
+		*in_fence = dma_fence_get(dma_resv_get_excl(resv));
+		return 0;
+	}
+
+	ret = dma_resv_get_fences_rcu(resv, &excl, &count, &fences);
+	if (ret)
+		return ret;
+
+	if (excl) {
+		struct dma_fence **all;
+
+		all = krealloc(fences, (count + 1) * sizeof(*fences),
+			       GFP_KERNEL);
+		if (!all) {
+			while (count--)
+				dma_fence_put(fences[count]);
+			kfree(fences);
+			dma_fence_put(excl);
+			return -ENOMEM;
+		}
+		fences = all;
+		fences[count++] = excl;
+	}
+
+	if (count <= 1) {
+		if (count)
+			*in_fence = fences[0];
+		kfree(fences);
+		return 0;
+	}
+
+	array = dma_fence_array_create(count, fences,
+				       dma_fence_context_alloc(1), 1, false);
+	if (!array) {
+		while (count--)
+			dma_fence_put(fences[count]);
+		kfree(fences);
+		return -ENOMEM;
+	}
+
+	*in_fence = &array->base;
+	return 0;
+}
+
+int xilinx_xdma_set_dmabuf(struct dma_chan *chan,
+			   struct dma_async_tx_descriptor *async_tx,
+			   struct dma_buf *dmabuf)
+{
+	struct xilinx_frmbuf_device *xdev;
+	struct xilinx_frmbuf_tx_descriptor *desc;
+	struct xilinx_frmbuf_chan *xchan;
+	struct dma_fence *fence, *in_fence;
+	struct dma_resv *resv;
+	unsigned long flags;
+	int ret;
+
+	if (!async_tx || !dmabuf)
+		return -EINVAL;
+
+	xdev = frmbuf_find_dev(chan);
+	if (IS_ERR(xdev))
+		return PTR_ERR(xdev);
+
+	desc = to_dma_tx_descriptor(async_tx);
+	if (!desc)
+		return -EINVAL;
+
+	if (desc->out_fence)
+		return -EBUSY;
+
+	xchan = to_xilinx_chan(chan);
+	resv = dmabuf->resv;
+
+	fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+	if (!fence)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&xchan->lock, flags);
+	dma_fence_init(fence, &xilinx_frmbuf_fence_ops, &xchan->fence_lock,
+		       xchan->fence_context, ++xchan->fence_seqno);
+	spin_unlock_irqrestore(&xchan->lock, flags);
+
+	ret = dma_resv_lock_interruptible(resv, NULL);
+	if (ret)
+		goto err_put;
+
+	ret = xilinx_frmbuf_get_in_fence(xchan, resv, &in_fence);
+	if (ret)
+		goto err_unlock;
+
+	if (xchan->direction == DMA_DEV_TO_MEM) {
+		dma_resv_add_excl_fence(resv, fence);
+	} else {
+		ret = dma_resv_reserve_shared(resv, 1);
+		if (ret) {
+			dma_fence_put(in_fence);
+			goto err_unlock;
+		}
+		dma_resv_add_shared_fence(resv, fence);
+	}
+	dma_resv_unlock(resv);
+
+	desc->out_fence = fence;
+	desc->in_fence = in_fence;
+	if (in_fence) {
+		desc->fence_wait = true;
+		if (dma_fence_add_callback(in_fence, &desc->in_cb,
+					   xilinx_frmbuf_fence_cb))
+			desc->fence_wait = false;
+	}
+
+	return 0;
+
+err_unlock:
+	dma_resv_unlock(resv);
+err_put:
+	dma_fence_put(fence);
+	return ret;
+}
+EXPORT_SYMBOL(xilinx_xdma_set_dmabuf);
+
 /**
  * of_dma_xilinx_xlate - Translation function
  * @dma_spec: Pointer to DMA specifier as found in the device tree
@@ -903,6 +1079,35 @@ xilinx_frmbuf_alloc_tx_descriptor(struct xilinx_frmbuf_chan *chan)
 	return desc;
 }
 
+/**
+ * xilinx_frmbuf_free_tx_descriptor - Free transaction descriptor
+ * @desc: Transaction descriptor
+ *
+ * A frame that never completed cancels its done fence so that nobody
+ * waits on it forever.
+ */
+static void
+xilinx_frmbuf_free_tx_descriptor(struct xilinx_frmbuf_tx_descriptor *desc)
+{
+	if (!desc)
+		return;
+
+	if (desc->in_fence) {
+		dma_fence_remove_callback(desc->in_fence, &desc->in_cb);
+		dma_fence_put(desc->in_fence);
+	}
+
+	if (desc->out_fence) {
+		if (!dma_fence_is_signaled(desc->out_fence)) {
+			dma_fence_set_error(desc->out_fence, -ECANCELED);
+			dma_fence_signal(desc->out_fence);
+		}
+		dma_fence_put(desc->out_fence);
+	}
+
+	kfree(desc);
+}
+
 /**
  * xilinx_frmbuf_free_desc_list - Free descriptors list
  * @chan: Driver specific dma channel
@@ -915,7 +1120,7 @@ static void xilinx_frmbuf_free_desc_list(struct xilinx_frmbuf_chan *chan,
 
 	list_for_each_entry_safe(desc, next, list, node) {
 		list_del(&desc->node);
-		kfree(desc);
+		xilinx_frmbuf_free_tx_descriptor(desc);
 	}
 }
 
@@ -931,8 +1136,8 @@ static void xilinx_frmbuf_free_descriptors(struct xilinx_frmbuf_chan *chan)
 
 	xilinx_frmbuf_free_desc_list(chan, &chan->pending_list);
 	xilinx_frmbuf_free_desc_list(chan, &chan->done_list);
-	kfree(chan->active_desc);
-	kfree(chan->staged_desc);
+	xilinx_frmbuf_free_tx_descriptor(chan->active_desc);
+	xilinx_frmbuf_free_tx_descriptor(chan->staged_desc);
 
 	chan->staged_desc = NULL;
 	chan->active_desc = NULL;
@@ -981,23 +1186,12 @@ static void xilinx_frmbuf_chan_desc_cleanup(struct xilinx_frmbuf_chan *chan)
 
 		/* Run any dependencies, then free the descriptor */
 		dma_run_dependencies(&desc->async_tx);
-		kfree(desc);
+		xilinx_frmbuf_free_tx_descriptor(desc);
 	}
 
 	spin_unlock_irqrestore(&chan->lock, flags);
 }
 
-/**
- * xilinx_frmbuf_do_tasklet - Schedule completion tasklet
- * @data: Pointer to the Xilinx frmbuf channel structure
- */
-static void xilinx_frmbuf_do_tasklet(unsigned long data)
-{
-	struct xilinx_frmbuf_chan *chan = (struct xilinx_frmbuf_chan *)data;
-
-	xilinx_frmbuf_chan_desc_cleanup(chan);
-}
-
 /**
  * xilinx_frmbuf_alloc_chan_resources - Allocate channel resources
  * @dchan: DMA channel
@@ -1070,6 +1264,8 @@ static void xilinx_frmbuf_complete_descriptor(struct xilinx_frmbuf_chan *chan)
 			    XILINX_FRMBUF_FID_MASK;
 
 	dma_cookie_complete(&desc->async_tx);
+	if (desc->out_fence)
+		dma_fence_signal(desc->out_fence);
 	list_add_tail(&desc->node, &chan->done_list);
 }
 
@@ -1096,6 +1292,10 @@ static void xilinx_frmbuf_start_transfer(struct xilinx_frmbuf_chan *chan)
 				struct xilinx_frmbuf_tx_descriptor,
 				node);
 
+	/* Frames go out in order, hold the queue until the buffer is free */
+	if (READ_ONCE(desc->fence_wait))
+		return;
+
 	if (desc->earlycb == EARLY_CALLBACK_START_DESC) {
 		dma_async_tx_callback callback;
 		void *callback_param;
@@ -1150,6 +1350,23 @@ static void xilinx_frmbuf_issue_pending(struct dma_chan *dchan)
 	spin_unlock_irqrestore(&chan->lock, flags);
 }
 
+/**
+ * xilinx_frmbuf_do_tasklet - Schedule completion tasklet
+ * @data: Pointer to the Xilinx frmbuf channel structure
+ */
+static void xilinx_frmbuf_do_tasklet(unsigned long data)
+{
+	struct xilinx_frmbuf_chan *chan = (struct xilinx_frmbuf_chan *)data;
+	unsigned long flags;
+
+	xilinx_frmbuf_chan_desc_cleanup(chan);
+
+	/* Start a frame whose buffer fences have signalled in the meantime */
+	spin_lock_irqsave(&chan->lock, flags);
+	xilinx_frmbuf_start_transfer(chan);
+	spin_unlock_irqrestore(&chan->lock, flags);
+}
+
 /**
  * xilinx_frmbuf_reset - Reset frmbuf channel
  * @chan: Driver specific dma channel
@@ -1444,6 +1661,9 @@ static int xilinx_frmbuf_chan_probe(struct xilinx_frmbuf_device *xdev,
 	INIT_LIST_HEAD(&chan->pending_list);
 	INIT_LIST_HEAD(&chan->done_list);
 
+	spin_lock_init(&chan->fence_lock);
+	chan->fence_context = dma_fence_context_alloc(1);
+
 	chan->irq = irq_of_parse_and_map(node, 0);
 	err = devm_request_irq(xdev->dev, chan->irq, xilinx_frmbuf_irq_handler,
 			       IRQF_SHARED, "xilinx_framebuffer", chan);
@@ -19,10 +19,39 @@
 #include <linux/slab.h>
 #include <linux/scatterlist.h>
 #include <linux/highmem.h>
+#include <linux/fs.h>
+#include <linux/security.h>
+#include <linux/sizes.h>
+#include <linux/xz.h>
+#include <linux/zstd.h>
+#include <linux/ktime.h>
+
+#define CREATE_TRACE_POINTS
+#include <trace/events/fpga.h>
+
+EXPORT_TRACEPOINT_SYMBOL_GPL(fpga_mgr_step);
+#include <generated/utsrelease.h>
 
 static DEFINE_IDA(fpga_mgr_ida);
 static struct class *fpga_mgr_class;
 
+static unsigned int image_cache_kb = 16384;
+module_param(image_cache_kb, uint, 0644);
+MODULE_PARM_DESC(image_cache_kb,
+		 "Memory budget for preloaded images per manager in KiB (default 16384)");
+
+/*
+ * An image kept resident by fpga_mgr_cache_preload(). The firmware buffer is
+ * held for the lifetime of the entry and sgt describes its pages, so a load
+ * from the cache goes straight to the low level driver.
+ */
+struct fpga_mgr_image {
+	struct list_head node;
+	char *name;
+	const struct firmware *fw;
+	struct sg_table sgt;
+};
+
 /**
  * fpga_image_info_alloc - Allocate a FPGA image info struct
  * @dev: owning device
@@ -67,6 +96,57 @@ void fpga_image_info_free(struct fpga_image_info *info)
 }
 EXPORT_SYMBOL_GPL(fpga_image_info_free);
 
+static const char * const fpga_mgr_phase_str[] = {
+	[FPGA_MGR_PHASE_READ] =			"read",
+	[FPGA_MGR_PHASE_DECOMPRESS] =		"decompress",
+	[FPGA_MGR_PHASE_WRITE_INIT] =		"write_init",
+	[FPGA_MGR_PHASE_WRITE] =		"write",
+	[FPGA_MGR_PHASE_WRITE_COMPLETE] =	"write_complete",
+};
+
+/*
+ * Account the time since start to a phase of the current load. Phases that
+ * are entered repeatedly, such as reads and writes of a streamed image, add
+ * up. bytes is the amount of image data written to the FPGA in this call.
+ */
+static void fpga_mgr_phase_end(struct fpga_manager *mgr,
+			       enum fpga_mgr_phase phase, u64 start,
+			       size_t bytes)
+{
+	u64 delta = ktime_get_ns() - start;
+
+	mgr->timing.phase_ns[phase] += delta;
+	mgr->timing.bytes += bytes;
+	trace_fpga_mgr_phase(mgr, fpga_mgr_phase_str[phase], delta, bytes);
+}
+
+static void fpga_mgr_timing_start(struct fpga_manager *mgr)
+{
+	memset(&mgr->timing, 0, sizeof(mgr->timing));
+	mgr->timing.start_ns = ktime_get_ns();
+}
+
+static void fpga_mgr_timing_stop(struct fpga_manager *mgr, int result)
+{
+	mgr->timing.total_ns = ktime_get_ns() - mgr->timing.start_ns;
+	mgr->timing.result = result;
+	trace_fpga_mgr_load(mgr, mgr->timing.bytes, mgr->timing.total_ns,
+			    result);
+}
+
+/* Call the low level driver's write function and account for it. */
+static int fpga_mgr_write(struct fpga_manager *mgr, const char *buf,
+			  size_t count)
+{
+	u64 start = ktime_get_ns();
+	int ret;
+
+	ret = mgr->mops->write(mgr, buf, count);
+	fpga_mgr_phase_end(mgr, FPGA_MGR_PHASE_WRITE, start, ret ? 0 : count);
+
+	return ret;
+}
+
 /*
  * Call the low level driver's write_init function.  This will do the
  * device-specific things to get the FPGA into the state where it is ready to
@@ -77,6 +157,7 @@ static int fpga_mgr_write_init_buf(struct fpga_manager *mgr,
 				   struct fpga_image_info *info,
 				   const char *buf, size_t count)
 {
+	u64 start = ktime_get_ns();
 	int ret;
 
 	mgr->state = FPGA_MGR_STATE_WRITE_INIT;
@@ -85,6 +166,7 @@ static int fpga_mgr_write_init_buf(struct fpga_manager *mgr,
 	else
 		ret = mgr->mops->write_init(
 		    mgr, info, buf, min(mgr->mops->initial_header_size, count));
+	fpga_mgr_phase_end(mgr, FPGA_MGR_PHASE_WRITE_INIT, start, 0);
 
 	if (ret) {
 		dev_err(&mgr->dev, "Error preparing FPGA for writing\n");
@@ -142,10 +224,12 @@ static int fpga_mgr_write_init_sg(struct fpga_manager *mgr,
 static int fpga_mgr_write_complete(struct fpga_manager *mgr,
 				   struct fpga_image_info *info)
 {
+	u64 start = ktime_get_ns();
 	int ret;
 
 	mgr->state = FPGA_MGR_STATE_WRITE_COMPLETE;
 	ret = mgr->mops->write_complete(mgr, info);
+	fpga_mgr_phase_end(mgr, FPGA_MGR_PHASE_WRITE_COMPLETE, start, 0);
 	if (ret) {
 		dev_err(&mgr->dev, "Error after writing image data to FPGA\n");
 		mgr->state = FPGA_MGR_STATE_WRITE_COMPLETE_ERR;
@@ -156,6 +240,18 @@ static int fpga_mgr_write_complete(struct fpga_manager *mgr,
 	return 0;
 }
 
+static size_t fpga_mgr_sgt_len(struct sg_table *sgt)
+{
+	struct scatterlist *sg;
+	size_t len = 0;
+	int i;
+
+	for_each_sg(sgt->sgl, sg, sgt->orig_nents, i)
+		len += sg->length;
+
+	return len;
+}
+
 /**
  * fpga_mgr_buf_load_sg - load fpga from image in buffer from a scatter list
  * @mgr:	fpga manager
@@ -177,6 +273,7 @@ static int fpga_mgr_buf_load_sg(struct fpga_manager *mgr,
 				struct fpga_image_info *info,
 				struct sg_table *sgt)
 {
+	u64 start;
 	int ret;
 
 	if (info->flags & FPGA_MGR_USERKEY_ENCRYPTED_BITSTREAM)
@@ -189,13 +286,16 @@ static int fpga_mgr_buf_load_sg(struct fpga_manager *mgr,
 	/* Write the FPGA image to the FPGA. */
 	mgr->state = FPGA_MGR_STATE_WRITE;
 	if (mgr->mops->write_sg) {
+		start = ktime_get_ns();
 		ret = mgr->mops->write_sg(mgr, sgt);
+		fpga_mgr_phase_end(mgr, FPGA_MGR_PHASE_WRITE, start,
+				   ret ? 0 : fpga_mgr_sgt_len(sgt));
 	} else {
 		struct sg_mapping_iter miter;
 
 		sg_miter_start(&miter, sgt->sgl, sgt->nents, SG_MITER_FROM_SG);
 		while (sg_miter_next(&miter)) {
-			ret = mgr->mops->write(mgr, miter.addr, miter.length);
+			ret = fpga_mgr_write(mgr, miter.addr, miter.length);
 			if (ret)
 				break;
 		}
@@ -225,7 +325,7 @@ static int fpga_mgr_buf_load_mapped(struct fpga_manager *mgr,
 	 * Write the FPGA image to the FPGA.
 	 */
 	mgr->state = FPGA_MGR_STATE_WRITE;
-	ret = mgr->mops->write(mgr, buf, count);
+	ret = fpga_mgr_write(mgr, buf, count);
 	if (ret) {
 		dev_err(&mgr->dev, "Error while writing image data to FPGA\n");
 		mgr->state = FPGA_MGR_STATE_WRITE_ERR;
@@ -249,29 +349,283 @@ static int fpga_mgr_buf_load_mapped(struct fpga_manager *mgr,
  *
  * Return: 0 on success, negative error code otherwise.
  */
-static int fpga_mgr_buf_load(struct fpga_manager *mgr,
-			     struct fpga_image_info *info,
-			     const char *buf, size_t count)
+#ifdef CONFIG_FPGA_MGR_DECOMPRESS
+/* Largest xz dictionary or zstd window accepted for compressed images */
+#define FPGA_MGR_DECOMP_WINDOW_MAX	SZ_8M
+
+enum fpga_mgr_decomp_format {
+	FPGA_MGR_DECOMP_NONE,
+	FPGA_MGR_DECOMP_XZ,
+	FPGA_MGR_DECOMP_ZSTD,
+};
+
+/*
+ * State for decompressing an image on the fly. Decompressed data is collected
+ * in out and handed to the low level driver's write op one stream_chunk_size
+ * chunk at a time, the first chunk also goes to write_init as the header.
+ */
+struct fpga_mgr_decomp {
+	struct fpga_manager *mgr;
+	struct fpga_image_info *info;
+	enum fpga_mgr_decomp_format format;
+	struct xz_dec *xz;
+	ZSTD_DStream *zstd;
+	void *wksp;
+	char *out;
+	size_t out_pos;
+	size_t out_size;
+	bool started;
+	bool done;
+};
+
+static enum fpga_mgr_decomp_format fpga_mgr_decomp_detect(const char *buf,
+							   size_t count)
+{
+	static const u8 xz_magic[] = { 0xfd, '7', 'z', 'X', 'Z', 0x00 };
+	static const u8 zstd_magic[] = { 0x28, 0xb5, 0x2f, 0xfd };
+
+	if (count >= sizeof(xz_magic) &&
+	    !memcmp(buf, xz_magic, sizeof(xz_magic)))
+		return FPGA_MGR_DECOMP_XZ;
+	if (count >= sizeof(zstd_magic) &&
+	    !memcmp(buf, zstd_magic, sizeof(zstd_magic)))
+		return FPGA_MGR_DECOMP_ZSTD;
+
+	return FPGA_MGR_DECOMP_NONE;
+}
+
+static void fpga_mgr_decomp_free(struct fpga_mgr_decomp *d)
+{
+	if (d->xz)
+		xz_dec_end(d->xz);
+	kvfree(d->wksp);
+	kvfree(d->out);
+}
+
+/*
+ * Set up a decompressor for an image starting with buf. The whole zstd frame
+ * header has to be in buf, which holds for the first chunk of any sane image.
+ */
+static int fpga_mgr_decomp_init(struct fpga_mgr_decomp *d,
+				struct fpga_manager *mgr,
+				struct fpga_image_info *info,
+				const char *buf, size_t count)
+{
+	ZSTD_frameParams params;
+	size_t wksp_size;
+
+	memset(d, 0, sizeof(*d));
+	d->mgr = mgr;
+	d->info = info;
+	d->format = fpga_mgr_decomp_detect(buf, count);
+
+	if (!mgr->mops->stream_chunk_size) {
+		dev_err(&mgr->dev, "Compressed images not supported by %s\n",
+			mgr->name);
+		return -EOPNOTSUPP;
+	}
+
+	d->out_size = max(mgr->mops->stream_chunk_size,
+			  mgr->mops->initial_header_size);
+	d->out = kvmalloc(d->out_size, GFP_KERNEL);
+	if (!d->out)
+		return -ENOMEM;
+
+	switch (d->format) {
+	case FPGA_MGR_DECOMP_XZ:
+		d->xz = xz_dec_init(XZ_DYNALLOC, FPGA_MGR_DECOMP_WINDOW_MAX);
+		if (!d->xz)
+			goto err_nomem;
+		break;
+	case FPGA_MGR_DECOMP_ZSTD:
+		if (ZSTD_getFrameParams(&params, buf, count) ||
+		    params.windowSize > FPGA_MGR_DECOMP_WINDOW_MAX) {
+			dev_err(&mgr->dev, "Unsupported zstd frame header\n");
+			fpga_mgr_decomp_free(d);
+			return -EINVAL;
+		}
+
+		wksp_size = ZSTD_DStreamWorkspaceBound(params.windowSize);
+		d->wksp = kvmalloc(wksp_size, GFP_KERNEL);
+		if (!d->wksp)
+			goto err_nomem;
+
+		d->zstd = ZSTD_initDStream(params.windowSize, d->wksp,
+					   wksp_size);
+		if (!d->zstd)
+			goto err_nomem;
+		break;
+	default:
+		fpga_mgr_decomp_free(d);
+		return -EINVAL;
+	}
+
+	return 0;
+
+err_nomem:
+	fpga_mgr_decomp_free(d);
+
+	return -ENOMEM;
+}
+
+/* Pass the decompressed data collected so far on to the driver. */
+static int fpga_mgr_decomp_flush(struct fpga_mgr_decomp *d)
+{
+	struct fpga_manager *mgr = d->mgr;
+	int ret;
+
+	if (!d->out_pos)
+		return 0;
+
+	if (!d->started) {
+		ret = fpga_mgr_write_init_buf(mgr, d->info, d->out, d->out_pos);
+		if (ret)
+			return ret;
+		mgr->state = FPGA_MGR_STATE_WRITE;
+		d->started = true;
+	}
+
+	ret = fpga_mgr_write(mgr, d->out, d->out_pos);
+	if (ret) {
+		dev_err(&mgr->dev, "Error while writing image data to FPGA\n");
+		mgr->state = FPGA_MGR_STATE_WRITE_ERR;
+		return ret;
+	}
+	d->out_pos = 0;
+
+	return 0;
+}
+
+/* Run one step of the decoder, returns the number of input bytes consumed. */
+static ssize_t fpga_mgr_decomp_run(struct fpga_mgr_decomp *d,
+				   const char *buf, size_t count)
+{
+	if (d->format == FPGA_MGR_DECOMP_XZ) {
+		struct xz_buf b = {
+			.in = buf,
+			.in_size = count,
+			.out = d->out,
+			.out_pos = d->out_pos,
+			.out_size = d->out_size,
+		};
+		enum xz_ret xz_ret;
+
+		xz_ret = xz_dec_run(d->xz, &b);
+		d->out_pos = b.out_pos;
+		if (xz_ret == XZ_STREAM_END)
+			d->done = true;
+		else if (xz_ret == XZ_MEM_ERROR)
+			return -ENOMEM;
+		else if (xz_ret != XZ_OK)
+			return -EINVAL;
+
+		return b.in_pos;
+	} else {
+		ZSTD_inBuffer in = { .src = buf, .size = count };
+		ZSTD_outBuffer out = {
+			.dst = d->out,
+			.size = d->out_size,
+			.pos = d->out_pos,
+		};
+		size_t zret;
+
+		zret = ZSTD_decompressStream(d->zstd, &out, &in);
+		d->out_pos = out.pos;
+		if (ZSTD_isError(zret))
+			return -EINVAL;
+		if (!zret)
+			d->done = true;
+
+		return in.pos;
+	}
+}
+
+/* Feed the next piece of compressed input through the decoder. */
+static int fpga_mgr_decomp_feed(struct fpga_mgr_decomp *d, const char *buf,
+				size_t count)
+{
+	bool full;
+	ssize_t len;
+	u64 start;
+	int ret;
+
+	do {
+		start = ktime_get_ns();
+		len = fpga_mgr_decomp_run(d, buf, count);
+		fpga_mgr_phase_end(d->mgr, FPGA_MGR_PHASE_DECOMPRESS, start, 0);
+		if (len < 0) {
+			dev_err(&d->mgr->dev, "Corrupt compressed image\n");
+			return len;
+		}
+		buf += len;
+		count -= len;
+
+		/* a full buffer may leave more output pending in the decoder */
+		full = d->out_pos == d->out_size;
+		if (full) {
+			ret = fpga_mgr_decomp_flush(d);
+			if (ret)
+				return ret;
+		}
+	} while (!d->done && (count || full));
+
+	return 0;
+}
+
+/* Push out the tail of the image and finish programming. */
+static int fpga_mgr_decomp_finish(struct fpga_mgr_decomp *d)
+{
+	int ret;
+
+	if (!d->done) {
+		dev_err(&d->mgr->dev, "Truncated compressed image\n");
+		return -EINVAL;
+	}
+
+	ret = fpga_mgr_decomp_flush(d);
+	if (ret)
+		return ret;
+
+	if (!d->started)
+		return -EINVAL;
+
+	return fpga_mgr_write_complete(d->mgr, d->info);
+}
+
+static int fpga_mgr_decomp_buf_load(struct fpga_manager *mgr,
+				    struct fpga_image_info *info,
+				    const char *buf, size_t count)
+{
+	struct fpga_mgr_decomp d;
+	int ret;
+
+	ret = fpga_mgr_decomp_init(&d, mgr, info, buf, count);
+	if (ret)
+		return ret;
+
+	ret = fpga_mgr_decomp_feed(&d, buf, count);
+	if (!ret)
+		ret = fpga_mgr_decomp_finish(&d);
+
+	fpga_mgr_decomp_free(&d);
+
+	return ret;
+}
+#endif /* CONFIG_FPGA_MGR_DECOMPRESS */
+
+/*
+ * Convert the linear kernel pointer into a sg_table of pages for use by the
+ * driver.
+ */
+static int fpga_mgr_buf_to_sgt(struct sg_table *sgt, const char *buf,
+			       size_t count)
 {
 	struct page **pages;
-	struct sg_table sgt;
 	const void *p;
 	int nr_pages;
 	int index;
 	int rc;
 
-	/*
-	 * This is just a fast path if the caller has already created a
-	 * contiguous kernel buffer and the driver doesn't require SG, non-SG
-	 * drivers will still work on the slow path.
-	 */
-	if (mgr->mops->write)
-		return fpga_mgr_buf_load_mapped(mgr, info, buf, count);
-
-	/*
-	 * Convert the linear kernel pointer into a sg_table of pages for use
-	 * by the driver.
-	 */
 	nr_pages = DIV_ROUND_UP((unsigned long)buf + count, PAGE_SIZE) -
 		   (unsigned long)buf / PAGE_SIZE;
 	pages = kmalloc_array(nr_pages, sizeof(struct page *), GFP_KERNEL);
@@ -295,9 +649,34 @@ static int fpga_mgr_buf_load(struct fpga_manager *mgr,
 	 * The temporary pages list is used to code share the merging algorithm
 	 * in sg_alloc_table_from_pages
 	 */
-	rc = sg_alloc_table_from_pages(&sgt, pages, index, offset_in_page(buf),
+	rc = sg_alloc_table_from_pages(sgt, pages, index, offset_in_page(buf),
 				       count, GFP_KERNEL);
 	kfree(pages);
+
+	return rc;
+}
+
+static int fpga_mgr_buf_load(struct fpga_manager *mgr,
+			     struct fpga_image_info *info,
+			     const char *buf, size_t count)
+{
+	struct sg_table sgt;
+	int rc;
+
+#ifdef CONFIG_FPGA_MGR_DECOMPRESS
+	if (fpga_mgr_decomp_detect(buf, count))
+		return fpga_mgr_decomp_buf_load(mgr, info, buf, count);
+#endif
+
+	/*
+	 * This is just a fast path if the caller has already created a
+	 * contiguous kernel buffer and the driver doesn't require SG, non-SG
+	 * drivers will still work on the slow path.
+	 */
+	if (mgr->mops->write)
+		return fpga_mgr_buf_load_mapped(mgr, info, buf, count);
+
+	rc = fpga_mgr_buf_to_sgt(&sgt, buf, count);
 	if (rc)
 		return rc;
 
@@ -340,6 +719,309 @@ static int fpga_dmabuf_load(struct fpga_manager *mgr,
 	return ret;
 }
 
+/*
+ * Directories searched for images that can be streamed, in the same order as
+ * the firmware loader searches them.
+ */
+static const char * const fpga_mgr_fw_path[] = {
+	"/lib/firmware/updates/" UTS_RELEASE,
+	"/lib/firmware/updates",
+	"/lib/firmware/" UTS_RELEASE,
+	"/lib/firmware"
+};
+
+static struct file *fpga_mgr_firmware_open(const char *image_name)
+{
+	struct file *file = ERR_PTR(-ENOENT);
+	char *path;
+	int i;
+
+	path = __getname();
+	if (!path)
+		return ERR_PTR(-ENOMEM);
+
+	for (i = 0; i < ARRAY_SIZE(fpga_mgr_fw_path); i++) {
+		if (snprintf(path, PATH_MAX, "%s/%s", fpga_mgr_fw_path[i],
+			     image_name) >= PATH_MAX)
+			continue;
+
+		file = filp_open(path, O_RDONLY, 0);
+		if (IS_ERR(file))
+			continue;
+
+		if (S_ISREG(file_inode(file)->i_mode))
+			break;
+
+		fput(file);
+		file = ERR_PTR(-ENOENT);
+	}
+
+	__putname(path);
+
+	return file;
+}
+
+/* Fill buf from file, only returning short at the end of the file. */
+static ssize_t fpga_mgr_firmware_read(struct fpga_manager *mgr,
+				      struct file *file, char *buf,
+				      size_t count, loff_t *pos)
+{
+	u64 start = ktime_get_ns();
+	size_t done = 0;
+	ssize_t len = 0;
+
+	while (done < count) {
+		len = kernel_read(file, buf + done, count - done, pos);
+		if (len <= 0)
+			break;
+		done += len;
+	}
+	fpga_mgr_phase_end(mgr, FPGA_MGR_PHASE_READ, start, 0);
+
+	return len < 0 ? len : done;
+}
+
+#ifdef CONFIG_FPGA_MGR_DECOMPRESS
+/*
+ * Decompress an image file while it is read, the first chunk has already
+ * been read into buf.
+ */
+static int fpga_mgr_decomp_stream(struct fpga_manager *mgr,
+				  struct fpga_image_info *info,
+				  struct file *file, char *buf, ssize_t len,
+				  size_t chunk, loff_t *pos)
+{
+	struct fpga_mgr_decomp d;
+	int ret;
+
+	ret = fpga_mgr_decomp_init(&d, mgr, info, buf, len);
+	if (ret)
+		return ret;
+
+	while (len > 0 && !d.done) {
+		ret = fpga_mgr_decomp_feed(&d, buf, len);
+		if (ret)
+			goto out_free;
+
+		len = fpga_mgr_firmware_read(mgr, file, buf, chunk, pos);
+	}
+
+	if (len < 0) {
+		dev_err(&mgr->dev, "Error reading compressed image\n");
+		mgr->state = FPGA_MGR_STATE_WRITE_ERR;
+		ret = len;
+		goto out_free;
+	}
+
+	ret = fpga_mgr_decomp_finish(&d);
+
+out_free:
+	fpga_mgr_decomp_free(&d);
+
+	return ret;
+}
+#endif
+
+/**
+ * fpga_mgr_firmware_stream - load fpga from an image file in chunks
+ * @mgr:	fpga manager
+ * @info:	fpga image specific information
+ * @file:	opened image file
+ *
+ * Read the image stream_chunk_size bytes at a time and hand each chunk to the
+ * low level driver's write op as soon as it has been read, so the driver can
+ * program one chunk while the next one is being read from storage.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+static int fpga_mgr_firmware_stream(struct fpga_manager *mgr,
+				    struct fpga_image_info *info,
+				    struct file *file)
+{
+	size_t chunk;
+	loff_t pos = 0;
+	ssize_t len;
+	char *buf;
+	int ret;
+
+	ret = security_kernel_read_file(file, READING_FIRMWARE);
+	if (ret)
+		return ret;
+
+	chunk = max(mgr->mops->stream_chunk_size,
+		    mgr->mops->initial_header_size);
+	buf = kvmalloc(chunk, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	len = fpga_mgr_firmware_read(mgr, file, buf, chunk, &pos);
+	if (len <= 0) {
+		mgr->state = FPGA_MGR_STATE_FIRMWARE_REQ_ERR;
+		ret = len ? len : -EINVAL;
+		goto out_free;
+	}
+
+#ifdef CONFIG_FPGA_MGR_DECOMPRESS
+	if (fpga_mgr_decomp_detect(buf, len)) {
+		ret = fpga_mgr_decomp_stream(mgr, info, file, buf, len, chunk,
+					     &pos);
+		goto out_free;
+	}
+#endif
+
+	ret = fpga_mgr_write_init_buf(mgr, info, buf, len);
+	if (ret)
+		goto out_free;
+
+	mgr->state = FPGA_MGR_STATE_WRITE;
+	while (len > 0) {
+		ret = fpga_mgr_write(mgr, buf, len);
+		if (ret)
+			break;
+
+		len = fpga_mgr_firmware_read(mgr, file, buf, chunk, &pos);
+	}
+	if (len < 0)
+		ret = len;
+
+	if (ret) {
+		dev_err(&mgr->dev, "Error while writing image data to FPGA\n");
+		mgr->state = FPGA_MGR_STATE_WRITE_ERR;
+		goto out_free;
+	}
+
+	ret = fpga_mgr_write_complete(mgr, info);
+
+out_free:
+	kvfree(buf);
+
+	return ret;
+}
+
+static void fpga_mgr_image_free(struct fpga_manager *mgr,
+				struct fpga_mgr_image *img)
+{
+	list_del(&img->node);
+	mgr->cache_size -= img->fw->size;
+	sg_free_table(&img->sgt);
+	release_firmware(img->fw);
+	kfree(img->name);
+	kfree(img);
+}
+
+/* Must be called with cache_mutex held, moves a hit to the front. */
+static struct fpga_mgr_image *fpga_mgr_cache_find(struct fpga_manager *mgr,
+						  const char *image_name)
+{
+	struct fpga_mgr_image *img;
+
+	list_for_each_entry(img, &mgr->image_cache, node) {
+		if (!strcmp(img->name, image_name)) {
+			list_move(&img->node, &mgr->image_cache);
+			return img;
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * fpga_mgr_cache_preload - keep an image resident for fast loading
+ * @mgr:	fpga manager
+ * @image_name:	name of image file on the firmware search path
+ *
+ * Request the image and keep it in memory, so that later loads of the same
+ * firmware name skip the storage read and the conversion to a sg_table.
+ * Each manager holds at most image_cache_kb of images, the least recently
+ * used ones are dropped to make room.
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fpga_mgr_cache_preload(struct fpga_manager *mgr, const char *image_name)
+{
+	size_t budget = (size_t)image_cache_kb * SZ_1K;
+	struct fpga_mgr_image *img;
+	const struct firmware *fw;
+	int ret;
+
+	mutex_lock(&mgr->cache_mutex);
+	if (fpga_mgr_cache_find(mgr, image_name)) {
+		ret = 0;
+		goto out_unlock;
+	}
+
+	ret = request_firmware(&fw, image_name, &mgr->dev);
+	if (ret) {
+		dev_err(&mgr->dev, "Error requesting firmware %s\n",
+			image_name);
+		goto out_unlock;
+	}
+
+	if (fw->size > budget) {
+		dev_err(&mgr->dev, "%s does not fit in the image cache\n",
+			image_name);
+		ret = -ENOSPC;
+		goto out_release;
+	}
+
+	img = kzalloc(sizeof(*img), GFP_KERNEL);
+	if (!img) {
+		ret = -ENOMEM;
+		goto out_release;
+	}
+
+	img->name = kstrdup(image_name, GFP_KERNEL);
+	if (!img->name) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	ret = fpga_mgr_buf_to_sgt(&img->sgt, fw->data, fw->size);
+	if (ret)
+		goto out_free_name;
+
+	while (mgr->cache_size + fw->size > budget)
+		fpga_mgr_image_free(mgr, list_last_entry(&mgr->image_cache,
+							 struct fpga_mgr_image,
+							 node));
+
+	img->fw = fw;
+	list_add(&img->node, &mgr->image_cache);
+	mgr->cache_size += fw->size;
+	mutex_unlock(&mgr->cache_mutex);
+
+	return 0;
+
+out_free_name:
+	kfree(img->name);
+out_free:
+	kfree(img);
+out_release:
+	release_firmware(fw);
+out_unlock:
+	mutex_unlock(&mgr->cache_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(fpga_mgr_cache_preload);
+
+/**
+ * fpga_mgr_cache_drop - drop preloaded images
+ * @mgr:	fpga manager
+ * @image_name:	name of the image to drop, or NULL to drop all of them
+ */
+void fpga_mgr_cache_drop(struct fpga_manager *mgr, const char *image_name)
+{
+	struct fpga_mgr_image *img, *tmp;
+
+	mutex_lock(&mgr->cache_mutex);
+	list_for_each_entry_safe(img, tmp, &mgr->image_cache, node)
+		if (!image_name || !strcmp(img->name, image_name))
+			fpga_mgr_image_free(mgr, img);
+	mutex_unlock(&mgr->cache_mutex);
+}
+EXPORT_SYMBOL_GPL(fpga_mgr_cache_drop);
+
 /**
  * fpga_mgr_firmware_load - request firmware and load to fpga
  * @mgr:	fpga manager
@@ -359,7 +1041,9 @@ static int fpga_mgr_firmware_load(struct fpga_manager *mgr,
 				  const char *image_name)
 {
 	struct device *dev = &mgr->dev;
+	struct fpga_mgr_image *img;
 	const struct firmware *fw;
+	u64 start;
 	int ret;
 
 	dev_info(dev, "writing %s to %s\n", image_name, mgr->name);
@@ -370,7 +1054,41 @@ static int fpga_mgr_firmware_load(struct fpga_manager *mgr,
 	info->flags = mgr->flags;
 	memcpy(info->key, mgr->key, ENCRYPTED_KEY_LEN);
 
+	mutex_lock(&mgr->cache_mutex);
+	img = fpga_mgr_cache_find(mgr, image_name);
+	if (img) {
+#ifdef CONFIG_FPGA_MGR_DECOMPRESS
+		if (fpga_mgr_decomp_detect(img->fw->data, img->fw->size))
+			ret = fpga_mgr_decomp_buf_load(mgr, info, img->fw->data,
+						       img->fw->size);
+		else
+#endif
+			ret = fpga_mgr_buf_load_sg(mgr, info, &img->sgt);
+		mutex_unlock(&mgr->cache_mutex);
+		return ret;
+	}
+	mutex_unlock(&mgr->cache_mutex);
+
+	/*
+	 * Stream the image straight from the filesystem if the driver can
+	 * take it in chunks. Images that are not found there (built-in or
+	 * user helper firmware) take the request_firmware path below. The
+	 * post-read appraisal hook needs the whole image, so skip streaming
+	 * when it may be in use.
+	 */
+	if (mgr->mops->stream_chunk_size && !IS_ENABLED(CONFIG_IMA_APPRAISE)) {
+		struct file *file = fpga_mgr_firmware_open(image_name);
+
+		if (!IS_ERR(file)) {
+			ret = fpga_mgr_firmware_stream(mgr, info, file);
+			fput(file);
+			return ret;
+		}
+	}
+
+	start = ktime_get_ns();
 	ret = request_firmware(&fw, image_name, dev);
+	fpga_mgr_phase_end(mgr, FPGA_MGR_PHASE_READ, start, 0);
 	if (ret) {
 		mgr->state = FPGA_MGR_STATE_FIRMWARE_REQ_ERR;
 		dev_err(dev, "Error requesting firmware %s\n", image_name);
@@ -396,15 +1114,24 @@ static int fpga_mgr_firmware_load(struct fpga_manager *mgr,
  */
 int fpga_mgr_load(struct fpga_manager *mgr, struct fpga_image_info *info)
 {
+	int ret;
+
+	fpga_mgr_timing_start(mgr);
+
 	if (info->flags & FPGA_MGR_CONFIG_DMA_BUF)
-		return fpga_dmabuf_load(mgr, info);
-	if (info->sgt)
-		return fpga_mgr_buf_load_sg(mgr, info, info->sgt);
-	if (info->buf && info->count)
-		return fpga_mgr_buf_load(mgr, info, info->buf, info->count);
-	if (info->firmware_name)
-		return fpga_mgr_firmware_load(mgr, info, info->firmware_name);
-	return -EINVAL;
+		ret = fpga_dmabuf_load(mgr, info);
+	else if (info->sgt)
+		ret = fpga_mgr_buf_load_sg(mgr, info, info->sgt);
+	else if (info->buf && info->count)
+		ret = fpga_mgr_buf_load(mgr, info, info->buf, info->count);
+	else if (info->firmware_name)
+		ret = fpga_mgr_firmware_load(mgr, info, info->firmware_name);
+	else
+		ret = -EINVAL;
+
+	fpga_mgr_timing_stop(mgr, ret);
+
+	return ret;
 }
 EXPORT_SYMBOL_GPL(fpga_mgr_load);
 
@@ -509,13 +1236,58 @@ static ssize_t firmware_store(struct device *dev,
 	if (image_name[len - 1] == '\n')
 		image_name[len - 1] = 0;
 
+	fpga_mgr_timing_start(mgr);
 	ret = fpga_mgr_firmware_load(mgr, &info, image_name);
+	fpga_mgr_timing_stop(mgr, ret);
 	if (ret)
 		return ret;
 
 	return count;
 }
 
+static ssize_t image_cache_show(struct device *dev,
+				struct device_attribute *attr, char *buf)
+{
+	struct fpga_manager *mgr = to_fpga_manager(dev);
+	struct fpga_mgr_image *img;
+	ssize_t len = 0;
+
+	mutex_lock(&mgr->cache_mutex);
+	list_for_each_entry(img, &mgr->image_cache, node)
+		len += scnprintf(buf + len, PAGE_SIZE - len, "%s %zu\n",
+				 img->name, img->fw->size);
+	mutex_unlock(&mgr->cache_mutex);
+
+	return len;
+}
+
+static ssize_t image_cache_store(struct device *dev,
+				 struct device_attribute *attr,
+				 const char *buf, size_t count)
+{
+	struct fpga_manager *mgr = to_fpga_manager(dev);
+	char *image_name;
+	int ret;
+
+	image_name = kstrndup(buf, count, GFP_KERNEL);
+	if (!image_name)
+		return -ENOMEM;
+
+	/* "name" preloads an image, "-name" drops it and "-" drops them all */
+	strim(image_name);
+	if (image_name[0] == '-') {
+		fpga_mgr_cache_drop(mgr, image_name[1] ? image_name + 1 : NULL);
+		ret = 0;
+	} else if (image_name[0]) {
+		ret = fpga_mgr_cache_preload(mgr, image_name);
+	} else {
+		ret = -EINVAL;
+	}
+	kfree(image_name);
+
+	return ret ? ret : count;
+}
+
 static ssize_t key_show(struct device *dev,
 			struct device_attribute *attr, char *buf)
 {
@@ -563,6 +1335,7 @@ static DEVICE_ATTR_RO(status);
 static DEVICE_ATTR_WO(firmware);
 static DEVICE_ATTR_RW(flags);
 static DEVICE_ATTR_RW(key);
+static DEVICE_ATTR_RW(image_cache);
 
 static struct attribute *fpga_mgr_attrs[] = {
 	&dev_attr_name.attr,
@@ -571,6 +1344,7 @@ static struct attribute *fpga_mgr_attrs[] = {
 	&dev_attr_firmware.attr,
 	&dev_attr_flags.attr,
 	&dev_attr_key.attr,
+	&dev_attr_image_cache.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(fpga_mgr);
@@ -683,6 +1457,30 @@ static const struct file_operations fpga_mgr_ops_image = {
 	.open = fpga_mgr_read_open,
 	.read = seq_read,
 };
+
+static int fpga_mgr_timing_show(struct seq_file *s, void *data)
+{
+	struct fpga_manager *mgr = s->private;
+	struct fpga_mgr_timing *t = &mgr->timing;
+	u64 write_ns = t->phase_ns[FPGA_MGR_PHASE_WRITE];
+	int i;
+
+	seq_printf(s, "result: %d\n", t->result);
+	seq_printf(s, "bytes: %zu\n", t->bytes);
+	seq_printf(s, "total_us: %llu\n", div_u64(t->total_ns, NSEC_PER_USEC));
+	for (i = 0; i < FPGA_MGR_PHASE_MAX; i++)
+		seq_printf(s, "%s_us: %llu\n", fpga_mgr_phase_str[i],
+			   div_u64(t->phase_ns[i], NSEC_PER_USEC));
+	seq_printf(s, "write_kbps: %llu\n", write_ns ?
+		   div64_u64((u64)t->bytes * NSEC_PER_SEC, write_ns * SZ_1K) :
+		   0);
+	seq_printf(s, "overall_kbps: %llu\n", t->total_ns ?
+		   div64_u64((u64)t->bytes * NSEC_PER_SEC, t->total_ns * SZ_1K) :
+		   0);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(fpga_mgr_timing);
 #endif
 
 static int fpga_dmabuf_fd_get(struct file *file, char __user *argp)
@@ -794,7 +1592,8 @@ struct fpga_manager *fpga_mgr_create(struct device *dev, const char *name,
 	int id, ret;
 
 	if (!mops || !mops->write_complete || !mops->state ||
-	    !mops->write_init || (!mops->write && !mops->write_sg)) {
+	    !mops->write_init || (!mops->write && !mops->write_sg) ||
+	    (mops->stream_chunk_size && !mops->write)) {
 		dev_err(dev, "Attempt to register without fpga_manager_ops\n");
 		return NULL;
 	}
@@ -815,6 +1614,8 @@ struct fpga_manager *fpga_mgr_create(struct device *dev, const char *name,
 	}
 
 	mutex_init(&mgr->ref_mutex);
+	mutex_init(&mgr->cache_mutex);
+	INIT_LIST_HEAD(&mgr->image_cache);
 
 	mgr->name = name;
 	mgr->mops = mops;
@@ -960,6 +1761,8 @@ int fpga_mgr_register(struct fpga_manager *mgr)
 		debugfs_remove_recursive(mgr->dir);
 		goto error_device;
 	}
+
+	debugfs_create_file("timing", 0444, parent, mgr, &fpga_mgr_timing_fops);
 #endif
 	dev_info(&mgr->dev, "%s registered\n", mgr->name);
 
@@ -993,6 +1796,8 @@ void fpga_mgr_unregister(struct fpga_manager *mgr)
 	if (mgr->mops->fpga_remove)
 		mgr->mops->fpga_remove(mgr);
 
+	fpga_mgr_cache_drop(mgr, NULL);
+
 	device_unregister(&mgr->dev);
 }
 EXPORT_SYMBOL_GPL(fpga_mgr_unregister);
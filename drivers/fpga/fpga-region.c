@@ -158,6 +158,35 @@ int fpga_region_program_fpga(struct fpga_region *region)
 }
 EXPORT_SYMBOL_GPL(fpga_region_program_fpga);
 
+/**
+ * fpga_region_cache_preload - preload an image for this region
+ * @region: FPGA region
+ * @image_name: name of image file on the firmware search path
+ *
+ * Keep the image resident in the region's FPGA manager, so that programming
+ * it later with fpga_region_program_fpga() does not have to read it from
+ * storage again. Useful for regions that switch between a few partial
+ * bitstreams.
+ *
+ * Return 0 for success or negative error code.
+ */
+int fpga_region_cache_preload(struct fpga_region *region,
+			      const char *image_name)
+{
+	int ret;
+
+	region = fpga_region_get(region);
+	if (IS_ERR(region))
+		return PTR_ERR(region);
+
+	ret = fpga_mgr_cache_preload(region->mgr, image_name);
+
+	fpga_region_put(region);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(fpga_region_cache_preload);
+
 static ssize_t compat_id_show(struct device *dev,
 			      struct device_attribute *attr, char *buf)
 {
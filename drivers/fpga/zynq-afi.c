@@ -9,10 +9,16 @@
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
+#include <linux/spinlock.h>
+#include <linux/sysfs.h>
 
 /* Registers and special values for doing register-based operations */
 #define AFI_RDCHAN_CTRL_OFFSET	0x00
+#define AFI_RDCHAN_ISSUE_OFFSET	0x04
+#define AFI_RDQOS_OFFSET	0x08
 #define AFI_WRCHAN_CTRL_OFFSET	0x14
+#define AFI_WRCHAN_ISSUE_OFFSET	0x18
+#define AFI_WRQOS_OFFSET	0x1c
 
 #define AFI_BUSWIDTH_MASK	0x01
 
@@ -20,12 +26,161 @@
  * struct afi_fpga - AFI register description
  * @membase:	pointer to register struct
  * @afi_width:	AFI bus width to be written
+ * @lock:	serialises read-modify-write of the registers
  */
 struct zynq_afi_fpga {
 	void __iomem	*membase;
 	u32		afi_width;
+	spinlock_t	lock;
 };
 
+/**
+ * struct zynq_afi_field - a tunable AFI register field
+ * @prop:	DT property holding the initial value
+ * @offset:	register offset
+ * @shift:	position of the field in the register
+ * @mask:	mask of the field, unshifted
+ * @bias:	difference between the user value and the register value
+ * @min:	smallest user value
+ *
+ * User values run from @min to @mask + @bias.
+ */
+struct zynq_afi_field {
+	const char	*prop;
+	u32		offset;
+	u8		shift;
+	u32		mask;
+	u32		bias;
+	u32		min;
+};
+
+struct zynq_afi_attr {
+	struct device_attribute		attr;
+	const struct zynq_afi_field	field;
+};
+
+#define to_zynq_afi_attr(a) container_of(a, struct zynq_afi_attr, attr)
+
+static ssize_t zynq_afi_field_show(struct device *dev,
+				   struct device_attribute *attr, char *buf)
+{
+	struct zynq_afi_fpga *afi_fpga = dev_get_drvdata(dev);
+	const struct zynq_afi_field *f = &to_zynq_afi_attr(attr)->field;
+	u32 val;
+
+	val = readl(afi_fpga->membase + f->offset);
+
+	return sprintf(buf, "%u\n", ((val >> f->shift) & f->mask) + f->bias);
+}
+
+static int zynq_afi_field_set(struct zynq_afi_fpga *afi_fpga,
+			      const struct zynq_afi_field *f, u32 val)
+{
+	unsigned long flags;
+	u32 reg_val;
+
+	if (val < f->min || val > f->mask + f->bias)
+		return -EINVAL;
+
+	spin_lock_irqsave(&afi_fpga->lock, flags);
+	reg_val = readl(afi_fpga->membase + f->offset);
+	reg_val &= ~(f->mask << f->shift);
+	reg_val |= (val - f->bias) << f->shift;
+	writel(reg_val, afi_fpga->membase + f->offset);
+	spin_unlock_irqrestore(&afi_fpga->lock, flags);
+
+	return 0;
+}
+
+static ssize_t zynq_afi_field_store(struct device *dev,
+				    struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct zynq_afi_fpga *afi_fpga = dev_get_drvdata(dev);
+	u32 val;
+	int ret;
+
+	ret = kstrtou32(buf, 0, &val);
+	if (ret)
+		return ret;
+
+	ret = zynq_afi_field_set(afi_fpga, &to_zynq_afi_attr(attr)->field,
+				 val);
+
+	return ret ? ret : count;
+}
+
+#define ZYNQ_AFI_ATTR(_name, _prop, _offset, _shift, _mask, _bias, _min) \
+	struct zynq_afi_attr zynq_afi_attr_##_name = {			\
+		.attr = __ATTR(_name, 0644, zynq_afi_field_show,	\
+			       zynq_afi_field_store),			\
+		.field = {						\
+			.prop = _prop,					\
+			.offset = _offset,				\
+			.shift = _shift,				\
+			.mask = _mask,					\
+			.bias = _bias,					\
+			.min = _min,					\
+		},							\
+	}
+
+/*
+ * Issuing capability is the number of outstanding commands (1-8). The QoS
+ * values (0-15) are used while the fabric QoS enable bit is clear, setting
+ * it hands QoS to the AxQOS signals of the PL master instead. The write
+ * data threshold is the number of data beats in the FIFO before a write
+ * command is released to DDR.
+ */
+static ZYNQ_AFI_ATTR(rd_issuing, "xlnx,rd-issuing",
+		     AFI_RDCHAN_ISSUE_OFFSET, 0, 0x7, 1, 1);
+static ZYNQ_AFI_ATTR(wr_issuing, "xlnx,wr-issuing",
+		     AFI_WRCHAN_ISSUE_OFFSET, 0, 0x7, 1, 1);
+static ZYNQ_AFI_ATTR(rd_qos, "xlnx,rd-qos", AFI_RDQOS_OFFSET, 0, 0xf, 0, 0);
+static ZYNQ_AFI_ATTR(wr_qos, "xlnx,wr-qos", AFI_WRQOS_OFFSET, 0, 0xf, 0, 0);
+static ZYNQ_AFI_ATTR(rd_fabric_qos, "xlnx,rd-fabric-qos",
+		     AFI_RDCHAN_CTRL_OFFSET, 1, 0x1, 0, 0);
+static ZYNQ_AFI_ATTR(wr_fabric_qos, "xlnx,wr-fabric-qos",
+		     AFI_WRCHAN_CTRL_OFFSET, 1, 0x1, 0, 0);
+static ZYNQ_AFI_ATTR(wr_data_threshold, "xlnx,wr-data-threshold",
+		     AFI_WRCHAN_CTRL_OFFSET, 8, 0xf, 0, 0);
+
+static struct attribute *zynq_afi_attrs[] = {
+	&zynq_afi_attr_rd_issuing.attr.attr,
+	&zynq_afi_attr_wr_issuing.attr.attr,
+	&zynq_afi_attr_rd_qos.attr.attr,
+	&zynq_afi_attr_wr_qos.attr.attr,
+	&zynq_afi_attr_rd_fabric_qos.attr.attr,
+	&zynq_afi_attr_wr_fabric_qos.attr.attr,
+	&zynq_afi_attr_wr_data_threshold.attr.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(zynq_afi);
+
+/* Apply the optional DT properties, leaving unset fields at reset values. */
+static int zynq_afi_fpga_init_fields(struct device *dev,
+				     struct zynq_afi_fpga *afi_fpga)
+{
+	const struct zynq_afi_field *f;
+	struct attribute **attr;
+	u32 val;
+	int ret;
+
+	for (attr = zynq_afi_attrs; *attr; attr++) {
+		f = &container_of(*attr, struct zynq_afi_attr,
+				  attr.attr)->field;
+		if (device_property_read_u32(dev, f->prop, &val))
+			continue;
+
+		ret = zynq_afi_field_set(afi_fpga, f, val);
+		if (ret) {
+			dev_err(dev, "Invalid %s: %u\n", f->prop, val);
+			return ret;
+		}
+	}
+
+	return 0;
+}
+
 static int zynq_afi_fpga_probe(struct platform_device *pdev)
 {
 	struct zynq_afi_fpga *afi_fpga;
@@ -36,6 +191,8 @@ static int zynq_afi_fpga_probe(struct platform_device *pdev)
 	afi_fpga = devm_kzalloc(&pdev->dev, sizeof(*afi_fpga), GFP_KERNEL);
 	if (!afi_fpga)
 		return -ENOMEM;
+	spin_lock_init(&afi_fpga->lock);
+	platform_set_drvdata(pdev, afi_fpga);
 
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	afi_fpga->membase = devm_ioremap_resource(&pdev->dev, res);
@@ -58,7 +215,7 @@ static int zynq_afi_fpga_probe(struct platform_device *pdev)
 	writel(reg_val | afi_fpga->afi_width,
 	       afi_fpga->membase + AFI_WRCHAN_CTRL_OFFSET);
 
-	return 0;
+	return zynq_afi_fpga_init_fields(&pdev->dev, afi_fpga);
 }
 
 static const struct of_device_id zynq_afi_fpga_ids[] = {
@@ -71,6 +228,7 @@ static struct platform_driver zynq_afi_fpga_driver = {
 	.driver = {
 		.name = "zynq-afi-fpga",
 		.of_match_table = zynq_afi_fpga_ids,
+		.dev_groups = zynq_afi_groups,
 	},
 	.probe = zynq_afi_fpga_probe,
 };
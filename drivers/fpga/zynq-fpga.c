@@ -15,6 +15,7 @@
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/iopoll.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/mfd/syscon.h>
 #include <linux/of_address.h>
@@ -23,6 +24,9 @@
 #include <linux/regmap.h>
 #include <linux/string.h>
 #include <linux/scatterlist.h>
+#include <linux/sizes.h>
+#include <linux/wait.h>
+#include <trace/events/fpga.h>
 
 /* Offsets into SLCR regmap */
 
@@ -106,6 +110,9 @@
 #define DMA_SRC_LAST_TRANSFER		1
 /* Timeout for DMA completion */
 #define DMA_TIMEOUT_MS			5000
+/* Bounce ring used to stream images handed to the write op */
+#define STREAM_SLOTS			4
+#define STREAM_SLOT_SIZE		SZ_64K
 
 /* Masks for controlling stuff in SLCR */
 /* Disable all Level shifters */
@@ -132,6 +139,19 @@ struct zynq_fpga_priv {
 	struct scatterlist *cur_sg;
 
 	struct completion dma_done;
+
+	/* Streaming state, protected by dma_lock */
+	void *stream_buf;
+	dma_addr_t stream_dma;
+	size_t stream_len[STREAM_SLOTS];
+	unsigned int stream_head;
+	unsigned int stream_tail;
+	unsigned int stream_fill;
+	bool stream_active;
+	bool stream_busy;
+	bool stream_last;
+	int stream_err;
+	wait_queue_head_t stream_wait;
 };
 
 static inline void zynq_fpga_write(struct zynq_fpga_priv *priv, u32 offset,
@@ -209,6 +229,65 @@ static void zynq_step_dma(struct zynq_fpga_priv *priv)
 	}
 }
 
+/* Must be called with dma_lock held. Only one transfer is in flight at a
+ * time so every DMA done interrupt retires exactly one slot. The newest slot
+ * is held back until more data arrives or the write completes, so that the
+ * final transfer can be flagged as the last one.
+ */
+static void zynq_stream_kick(struct zynq_fpga_priv *priv)
+{
+	bool last;
+	u32 addr;
+
+	if (priv->stream_busy || priv->stream_err || !priv->stream_fill)
+		return;
+
+	last = priv->stream_fill == 1;
+	if (last && !priv->stream_last)
+		return;
+
+	addr = priv->stream_dma + priv->stream_tail * STREAM_SLOT_SIZE;
+	if (last)
+		addr |= DMA_SRC_LAST_TRANSFER;
+
+	zynq_fpga_write(priv, DMA_SRC_ADDR_OFFSET, addr);
+	zynq_fpga_write(priv, DMA_DST_ADDR_OFFSET, DMA_INVALID_ADDRESS);
+	zynq_fpga_write(priv, DMA_SRC_LEN_OFFSET,
+			priv->stream_len[priv->stream_tail] / 4);
+	zynq_fpga_write(priv, DMA_DEST_LEN_OFFSET, 0);
+	priv->stream_busy = true;
+
+	zynq_fpga_set_irq(priv, (last ? IXR_D_P_DONE_MASK : IXR_DMA_DONE_MASK) |
+			  IXR_ERROR_FLAGS_MASK);
+}
+
+/* Must be called with dma_lock held */
+static void zynq_stream_isr(struct zynq_fpga_priv *priv, u32 intr_status)
+{
+	u32 done;
+
+	if (intr_status & IXR_ERROR_FLAGS_MASK) {
+		priv->stream_err = -EIO;
+		priv->stream_busy = false;
+		zynq_fpga_set_irq(priv, 0);
+		wake_up(&priv->stream_wait);
+		return;
+	}
+
+	done = priv->stream_last && priv->stream_fill == 1 ?
+	       IXR_D_P_DONE_MASK : IXR_DMA_DONE_MASK;
+	if (!priv->stream_busy || !(intr_status & done))
+		return;
+
+	zynq_fpga_write(priv, INT_STS_OFFSET, IXR_DMA_DONE_MASK);
+	priv->stream_busy = false;
+	priv->stream_tail = (priv->stream_tail + 1) % STREAM_SLOTS;
+	priv->stream_fill--;
+	zynq_fpga_set_irq(priv, 0);
+	zynq_stream_kick(priv);
+	wake_up(&priv->stream_wait);
+}
+
 static irqreturn_t zynq_fpga_isr(int irq, void *data)
 {
 	struct zynq_fpga_priv *priv = data;
@@ -220,6 +299,11 @@ static irqreturn_t zynq_fpga_isr(int irq, void *data)
 	 */
 	spin_lock(&priv->dma_lock);
 	intr_status = zynq_fpga_read(priv, INT_STS_OFFSET);
+	if (priv->stream_active) {
+		zynq_stream_isr(priv, intr_status);
+		spin_unlock(&priv->dma_lock);
+		return IRQ_HANDLED;
+	}
 	if (!(intr_status & IXR_ERROR_FLAGS_MASK) &&
 	    (intr_status & IXR_DMA_DONE_MASK) && priv->cur_sg) {
 		zynq_fpga_write(priv, INT_STS_OFFSET, IXR_DMA_DONE_MASK);
@@ -235,6 +319,54 @@ static irqreturn_t zynq_fpga_isr(int irq, void *data)
 	return IRQ_HANDLED;
 }
 
+/* Tear down a stream started by zynq_fpga_ops_write_stream. If flush is set
+ * the queued data is pushed out and waited for, otherwise only the transfer
+ * already in flight is waited for and the rest is dropped.
+ */
+static int zynq_stream_stop(struct fpga_manager *mgr, bool flush)
+{
+	struct zynq_fpga_priv *priv = mgr->priv;
+	unsigned long flags;
+	u32 intr_status;
+	long timeout;
+	u64 start;
+	int err;
+
+	spin_lock_irqsave(&priv->dma_lock, flags);
+	if (flush) {
+		priv->stream_last = true;
+		zynq_stream_kick(priv);
+	} else {
+		priv->stream_fill = priv->stream_busy;
+	}
+	spin_unlock_irqrestore(&priv->dma_lock, flags);
+
+	start = ktime_get_ns();
+	timeout = wait_event_timeout(priv->stream_wait,
+				     !priv->stream_fill || priv->stream_err,
+				     msecs_to_jiffies(DMA_TIMEOUT_MS));
+	if (flush)
+		trace_fpga_mgr_step(mgr, "dma_drain", ktime_get_ns() - start);
+
+	spin_lock_irqsave(&priv->dma_lock, flags);
+	zynq_fpga_set_irq(priv, 0);
+	priv->stream_active = false;
+	err = priv->stream_err;
+	spin_unlock_irqrestore(&priv->dma_lock, flags);
+
+	intr_status = zynq_fpga_read(priv, INT_STS_OFFSET);
+	zynq_fpga_write(priv, INT_STS_OFFSET, IXR_ALL_MASK);
+	clk_disable(priv->clk);
+
+	if (!err && flush && !timeout)
+		err = -ETIMEDOUT;
+	if (err && flush)
+		dev_err(&mgr->dev, "Streaming DMA failed: %d INT_STS:0x%x\n",
+			err, intr_status);
+
+	return err;
+}
+
 /* Sanity check the proposed bitstream. It must start with the sync word in
  * the correct byte order, and be dword aligned. The input is a Xilinx .bin
  * file with every 32 bit quantity swapped.
@@ -254,10 +386,15 @@ static int zynq_fpga_ops_write_init(struct fpga_manager *mgr,
 {
 	struct zynq_fpga_priv *priv;
 	u32 ctrl, status;
+	u64 start;
 	int err;
 
 	priv = mgr->priv;
 
+	/* a previous streamed load may have been abandoned half way */
+	if (priv->stream_active)
+		zynq_stream_stop(mgr, false);
+
 	err = clk_enable(priv->clk);
 	if (err)
 		return err;
@@ -282,6 +419,8 @@ static int zynq_fpga_ops_write_init(struct fpga_manager *mgr,
 			goto out_err;
 		}
 
+		start = ktime_get_ns();
+
 		/* assert AXI interface resets */
 		regmap_write(priv->slcr, SLCR_FPGA_RST_CTRL_OFFSET,
 			     FPGA_RST_ALL_MASK);
@@ -340,6 +479,8 @@ static int zynq_fpga_ops_write_init(struct fpga_manager *mgr,
 			dev_err(&mgr->dev, "Timeout waiting for PCFG_INIT\n");
 			goto out_err;
 		}
+
+		trace_fpga_mgr_step(mgr, "pl_reset", ktime_get_ns() - start);
 	}
 
 	/* set configuration register with following options:
@@ -390,6 +531,7 @@ static int zynq_fpga_ops_write(struct fpga_manager *mgr, struct sg_table *sgt)
 	unsigned long timeout;
 	unsigned long flags;
 	struct scatterlist *sg;
+	u64 start;
 	int i;
 
 	priv = mgr->priv;
@@ -420,6 +562,8 @@ static int zynq_fpga_ops_write(struct fpga_manager *mgr, struct sg_table *sgt)
 	zynq_fpga_write(priv, INT_STS_OFFSET, IXR_ALL_MASK);
 	reinit_completion(&priv->dma_done);
 
+	start = ktime_get_ns();
+
 	/* zynq_step_dma will turn on interrupts */
 	spin_lock_irqsave(&priv->dma_lock, flags);
 	priv->dma_elm = 0;
@@ -429,6 +573,7 @@ static int zynq_fpga_ops_write(struct fpga_manager *mgr, struct sg_table *sgt)
 
 	timeout = wait_for_completion_timeout(&priv->dma_done,
 					      msecs_to_jiffies(DMA_TIMEOUT_MS));
+	trace_fpga_mgr_step(mgr, "dma", ktime_get_ns() - start);
 
 	spin_lock_irqsave(&priv->dma_lock, flags);
 	zynq_fpga_set_irq(priv, 0);
@@ -482,12 +627,96 @@ static int zynq_fpga_ops_write(struct fpga_manager *mgr, struct sg_table *sgt)
 	return err;
 }
 
+/* Streaming counterpart of zynq_fpga_ops_write: copy the data into the
+ * bounce ring and return as soon as it is queued, so the caller can fetch
+ * the next chunk while the DevC DMA drains the ring. The clock stays enabled
+ * until zynq_fpga_ops_write_complete flushes the ring.
+ */
+static int zynq_fpga_ops_write_stream(struct fpga_manager *mgr,
+				      const char *buf, size_t count)
+{
+	struct zynq_fpga_priv *priv = mgr->priv;
+	unsigned long flags;
+	size_t len;
+	void *slot;
+	int err;
+
+	if (count % 4) {
+		dev_err(&mgr->dev, "Invalid bitstream, chunks must be aligned\n");
+		return -EINVAL;
+	}
+
+	if (!priv->stream_active) {
+		err = clk_enable(priv->clk);
+		if (err)
+			return err;
+
+		zynq_fpga_write(priv, INT_STS_OFFSET, IXR_ALL_MASK);
+
+		spin_lock_irqsave(&priv->dma_lock, flags);
+		priv->stream_head = 0;
+		priv->stream_tail = 0;
+		priv->stream_fill = 0;
+		priv->stream_busy = false;
+		priv->stream_last = false;
+		priv->stream_err = 0;
+		priv->stream_active = true;
+		spin_unlock_irqrestore(&priv->dma_lock, flags);
+	}
+
+	while (count) {
+		if (!wait_event_timeout(priv->stream_wait,
+					priv->stream_fill < STREAM_SLOTS ||
+					priv->stream_err,
+					msecs_to_jiffies(DMA_TIMEOUT_MS))) {
+			err = -ETIMEDOUT;
+			goto out_stop;
+		}
+		if (priv->stream_err) {
+			err = priv->stream_err;
+			goto out_stop;
+		}
+
+		/* Only this function advances stream_head, and the slot it
+		 * points at is free until stream_fill is bumped below.
+		 */
+		len = min_t(size_t, count, STREAM_SLOT_SIZE);
+		slot = priv->stream_buf + priv->stream_head * STREAM_SLOT_SIZE;
+		memcpy(slot, buf, len);
+
+		spin_lock_irqsave(&priv->dma_lock, flags);
+		priv->stream_len[priv->stream_head] = len;
+		priv->stream_head = (priv->stream_head + 1) % STREAM_SLOTS;
+		priv->stream_fill++;
+		zynq_stream_kick(priv);
+		spin_unlock_irqrestore(&priv->dma_lock, flags);
+
+		buf += len;
+		count -= len;
+	}
+
+	return 0;
+
+out_stop:
+	zynq_stream_stop(mgr, false);
+	dev_err(&mgr->dev, "Streaming DMA failed: %d\n", err);
+
+	return err;
+}
+
 static int zynq_fpga_ops_write_complete(struct fpga_manager *mgr,
 					struct fpga_image_info *info)
 {
 	struct zynq_fpga_priv *priv = mgr->priv;
 	int err;
 	u32 intr_status;
+	u64 start;
+
+	if (priv->stream_active) {
+		err = zynq_stream_stop(mgr, true);
+		if (err)
+			return err;
+	}
 
 	err = clk_enable(priv->clk);
 	if (err)
@@ -497,10 +726,12 @@ static int zynq_fpga_ops_write_complete(struct fpga_manager *mgr,
 	zynq_fpga_write(priv, CTRL_OFFSET,
 		zynq_fpga_read(priv, CTRL_OFFSET) & ~CTRL_PCAP_PR_MASK);
 
+	start = ktime_get_ns();
 	err = zynq_fpga_poll_timeout(priv, INT_STS_OFFSET, intr_status,
 				     intr_status & IXR_PCFG_DONE_MASK,
 				     INIT_POLL_DELAY,
 				     INIT_POLL_TIMEOUT);
+	trace_fpga_mgr_step(mgr, "done_poll", ktime_get_ns() - start);
 
 	clk_disable(priv->clk);
 
@@ -544,8 +775,10 @@ static enum fpga_mgr_states zynq_fpga_ops_state(struct fpga_manager *mgr)
 
 static const struct fpga_manager_ops zynq_fpga_ops = {
 	.initial_header_size = 128,
+	.stream_chunk_size = STREAM_SLOT_SIZE,
 	.state = zynq_fpga_ops_state,
 	.write_init = zynq_fpga_ops_write_init,
+	.write = zynq_fpga_ops_write_stream,
 	.write_sg = zynq_fpga_ops_write,
 	.write_complete = zynq_fpga_ops_write_complete,
 };
@@ -576,6 +809,13 @@ static int zynq_fpga_probe(struct platform_device *pdev)
 	}
 
 	init_completion(&priv->dma_done);
+	init_waitqueue_head(&priv->stream_wait);
+
+	priv->stream_buf = dmam_alloc_coherent(dev,
+					       STREAM_SLOTS * STREAM_SLOT_SIZE,
+					       &priv->stream_dma, GFP_KERNEL);
+	if (!priv->stream_buf)
+		return -ENOMEM;
 
 	priv->irq = platform_get_irq(pdev, 0);
 	if (priv->irq < 0) {
@@ -0,0 +1,1225 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * DRM driver for Ilitek ILI9488 panels
+ *
+ * Copyright 2019 Frederik Peter Aalund <fpa@sbtinstruments.com
+ */
+
+#include <linux/backlight.h>
+#include <linux/completion.h>
+#include <linux/delay.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/gpio/consumer.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/of_device.h>
+#include <linux/platform_device.h>
+#include <linux/sched/clock.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+
+#include <drm/drm_atomic_helper.h>
+#include <drm/drm_damage_helper.h>
+#include <drm/drm_debugfs.h>
+#include <drm/drm_drv.h>
+#include <drm/drm_fb_helper.h>
+#include <drm/drm_format_helper.h>
+#include <drm/drm_fourcc.h>
+#include <drm/drm_gem_cma_helper.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_mipi_dbi.h>
+#include <drm/drm_modeset_helper.h>
+#include <drm/drm_vblank.h>
+#include <video/mipi_display.h>
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+#include <asm/neon.h>
+#endif
+
+#define MIPI_DBI_B_REG_VERSION      0x0
+#define MIPI_DBI_B_REG_CONTROL      0x4
+#define MIPI_DBI_B_REG_COMMAND      0x10
+#define MIPI_DBI_B_REG_DATA         0x20
+
+#define MIPI_DBI_B_CONTROL_RESET    BIT(0)
+#define MIPI_DBI_B_CONTROL_CS       BIT(1)
+
+#define ILI9488_CMD_DISPLAY_INVERSION_CONTROL   0xb4
+#define ILI9488_CMD_FRAME_RATE_CONTROL          0xb1
+
+#define ILI9488_DINV_2_DOT_INVERSION            0x02
+#define ILI9488_DPI_16_BPP                      0x5
+#define ILI9488_DBI_16_BPP                      0x5
+
+#define ILI9488_MADCTL_BGR          BIT(3)
+#define ILI9488_MADCTL_MV           BIT(5)
+#define ILI9488_MADCTL_MX           BIT(6)
+#define ILI9488_MADCTL_MY           BIT(7)
+
+/* Shorter memory writes are faster with the CPU loop */
+#define MIPI_DBI_B_DMA_MIN_LEN      1024
+#define MIPI_DBI_B_DMA_TIMEOUT_MS   500
+
+/* Cost model of the damage clips: Each clip costs the address window
+ * commands and the setup of a memory write on top of its pixels. We
+ * express said overhead in pixels (that could be sent in the same time).
+ * Two clips are merged into their bounding box if the box costs less
+ * than the two clips on their own. */
+#define ILI9488_CLIP_OVERHEAD_PX    512
+#define ILI9488_MAX_CLIPS           16
+
+/* The panel needs this long after sleep out before it accepts sleep in */
+#define ILI9488_SLEEP_OUT_MS        120
+
+/* What we know about the panel */
+enum ili9488_panel {
+	/* Unknown (e.g., after probe or suspend). Needs the full setup. */
+	ILI9488_PANEL_UNKNOWN = 0,
+	/* Set up and in sleep mode. Keeps its settings. */
+	ILI9488_PANEL_ASLEEP,
+	/* Set up and on */
+	ILI9488_PANEL_ON,
+};
+
+struct type_b {
+	void __iomem *base;
+	bool skip_initial_reset;
+	/* Optional DMA channel for memory writes. NULL if there is none. */
+	struct dma_chan *tx;
+	/* The transfer buffer that is not in use by mipi_dbi (see
+	 * mipi_dbi_type_b_write_memory_dma) */
+	u16 *tx_spare;
+	size_t tx_spare_len;
+	/* State of the current DMA transfer. Protected by the command lock
+	 * of mipi_dbi. */
+	bool tx_busy;
+	dma_addr_t tx_dma;
+	size_t tx_len;
+	struct completion tx_done;
+};
+
+struct ili9488 {
+	/* Must be first since mipi_dbi_release frees it */
+	struct mipi_dbi_dev dbidev;
+	/* Optional tearing effect (TE) input. NULL if there is none. With
+	 * TE, the flush worker writes the pending damage on each TE edge
+	 * and sends the vblank events afterwards. */
+	struct gpio_desc *te;
+	int te_irq;
+	struct work_struct flush_work;
+	/* Pending flush. Protected by 'flush_lock'. */
+	spinlock_t flush_lock;
+	bool flush_pending;
+	struct drm_framebuffer *flush_fb;
+	struct drm_rect flush_clips[ILI9488_MAX_CLIPS];
+	unsigned int flush_num;
+	struct drm_pending_vblank_event *flush_event;
+	/* Protected by the modeset locks (i.e., the pipe callbacks) */
+	enum ili9488_panel panel;
+	ktime_t sleep_out_time;
+	/* Optional idle mode (8 colors) after 'idle_timeout_ms' without
+	 * flushes. Zero disables it. */
+	unsigned int idle_timeout_ms;
+	struct delayed_work idle_work;
+	/* Protects 'idle' */
+	struct mutex idle_lock;
+	bool idle;
+};
+
+static struct ili9488 *drm_to_ili9488(struct drm_device *drm)
+{
+	return container_of(drm_to_mipi_dbi_dev(drm), struct ili9488, dbidev);
+}
+
+struct type_b *type_b_from_mipi_dbi(struct mipi_dbi *dbi)
+{
+	return (struct type_b *)dbi->spi;
+}
+
+/* Copied from drm_mipi_dbi.c */
+#define MIPI_DBI_DEBUG_COMMAND(cmd, data, len) \
+({ \
+	if (!len) \
+		DRM_DEBUG_DRIVER("cmd=%02x\n", cmd); \
+	else if (len <= 32) \
+		DRM_DEBUG_DRIVER("cmd=%02x, par=%*ph\n", cmd, (int)len, data);\
+	else \
+		DRM_DEBUG_DRIVER("cmd=%02x, len=%zu\n", cmd, len); \
+})
+
+/* Copied from drm_mipi_dbi.c since it is not exported from there. */
+static const u8 mipi_dbi_dcs_read_commands[] = {
+	MIPI_DCS_GET_DISPLAY_ID,
+	MIPI_DCS_GET_RED_CHANNEL,
+	MIPI_DCS_GET_GREEN_CHANNEL,
+	MIPI_DCS_GET_BLUE_CHANNEL,
+	MIPI_DCS_GET_DISPLAY_STATUS,
+	MIPI_DCS_GET_POWER_MODE,
+	MIPI_DCS_GET_ADDRESS_MODE,
+	MIPI_DCS_GET_PIXEL_FORMAT,
+	MIPI_DCS_GET_DISPLAY_MODE,
+	MIPI_DCS_GET_SIGNAL_MODE,
+	MIPI_DCS_GET_DIAGNOSTIC_RESULT,
+	MIPI_DCS_READ_MEMORY_START,
+	MIPI_DCS_READ_MEMORY_CONTINUE,
+	MIPI_DCS_GET_SCANLINE,
+	MIPI_DCS_GET_DISPLAY_BRIGHTNESS,
+	MIPI_DCS_GET_CONTROL_DISPLAY,
+	MIPI_DCS_GET_POWER_SAVE,
+	MIPI_DCS_GET_CABC_MIN_BRIGHTNESS,
+	MIPI_DCS_READ_DDB_START,
+	MIPI_DCS_READ_DDB_CONTINUE,
+	0, /* sentinel */
+};
+
+static void mipi_dbi_type_b_dma_callback(void *data)
+{
+	struct type_b *type_b = data;
+	/* Deassert CS */
+	iowrite32(0, type_b->base + MIPI_DBI_B_REG_CONTROL);
+	complete(&type_b->tx_done);
+}
+
+/* Wait for the current DMA transfer (if any). Call with the command lock
+ * held. */
+static int mipi_dbi_type_b_dma_wait(struct type_b *type_b)
+{
+	unsigned long timeout = msecs_to_jiffies(MIPI_DBI_B_DMA_TIMEOUT_MS);
+	int ret = 0;
+	if (!type_b->tx_busy) {
+		return 0;
+	}
+	if (!wait_for_completion_timeout(&type_b->tx_done, timeout)) {
+		DRM_ERROR("Type B DMA transfer timed out\n");
+		dmaengine_terminate_sync(type_b->tx);
+		iowrite32(0, type_b->base + MIPI_DBI_B_REG_CONTROL);
+		ret = -ETIMEDOUT;
+	}
+	dma_unmap_single(type_b->tx->device->dev, type_b->tx_dma,
+	                 type_b->tx_len, DMA_TO_DEVICE);
+	type_b->tx_busy = false;
+	return ret;
+}
+
+/* Stream a memory write to the bus with DMA. Returns before the transfer
+ * completes. The bus stays busy (CS asserted) until then.
+ *
+ * mipi_dbi fills its transfer buffer ('tx_buf') just before it sends
+ * the memory write. To not overwrite the buffer mid-transfer, we hand
+ * mipi_dbi our spare buffer and keep the one in flight. */
+static int mipi_dbi_type_b_write_memory_dma(struct mipi_dbi *dbi, u8 *param,
+                                            size_t num)
+{
+	struct type_b *type_b = type_b_from_mipi_dbi(dbi);
+	struct mipi_dbi_dev *dbidev = container_of(dbi, struct mipi_dbi_dev, dbi);
+	struct device *dma_dev = type_b->tx->device->dev;
+	struct dma_async_tx_descriptor *desc;
+	dma_cookie_t cookie;
+	u16 *spare;
+
+	if ((u8 *)dbidev->tx_buf != param || type_b->tx_spare_len < num) {
+		return -EINVAL;
+	}
+	type_b->tx_dma = dma_map_single(dma_dev, param, num, DMA_TO_DEVICE);
+	if (dma_mapping_error(dma_dev, type_b->tx_dma)) {
+		return -ENOMEM;
+	}
+	type_b->tx_len = num;
+	desc = dmaengine_prep_slave_single(type_b->tx, type_b->tx_dma, num,
+	                                   DMA_MEM_TO_DEV, DMA_PREP_INTERRUPT);
+	if (NULL == desc) {
+		goto err_unmap;
+	}
+	desc->callback = mipi_dbi_type_b_dma_callback;
+	desc->callback_param = type_b;
+	reinit_completion(&type_b->tx_done);
+	cookie = dmaengine_submit(desc);
+	if (dma_submit_error(cookie)) {
+		goto err_unmap;
+	}
+	type_b->tx_busy = true;
+	dma_async_issue_pending(type_b->tx);
+	/* Swap the transfer buffers */
+	spare = type_b->tx_spare;
+	type_b->tx_spare = dbidev->tx_buf;
+	dbidev->tx_buf = spare;
+	return 0;
+
+err_unmap:
+	dma_unmap_single(dma_dev, type_b->tx_dma, num, DMA_TO_DEVICE);
+	return -EIO;
+}
+
+static int mipi_dbi_type_b_command(struct mipi_dbi *dbi, u8 *cmd, u8 *param, size_t num)
+{
+	struct type_b *type_b = type_b_from_mipi_dbi(dbi);
+	int ret;
+	MIPI_DBI_DEBUG_COMMAND(*cmd, param, num);
+	/* The bus is busy until the current DMA transfer is done */
+	ret = mipi_dbi_type_b_dma_wait(type_b);
+	if (ret) {
+		return ret;
+	}
+	/* Assert CS */
+	iowrite32(MIPI_DBI_B_CONTROL_CS, type_b->base + MIPI_DBI_B_REG_CONTROL);
+	/* Write command */
+	iowrite8(*cmd, type_b->base + MIPI_DBI_B_REG_COMMAND);
+	/* Some special commands may send the parameters in an optimized way */
+	switch (*cmd) {
+	/* 8 bits at a time is the default */
+	default:
+		while (0 < num) {
+			iowrite8(*param, type_b->base + MIPI_DBI_B_REG_DATA);
+			++param;
+			--num;
+		}
+		break;
+	/* Memory writes are optimized in hardware */
+	case MIPI_DCS_WRITE_MEMORY_START:
+		/* The DMA callback deasserts CS */
+		if (NULL != type_b->tx && MIPI_DBI_B_DMA_MIN_LEN <= num &&
+		    0 == mipi_dbi_type_b_write_memory_dma(dbi, param, num)) {
+			return 0;
+		}
+		/* Fall back on the CPU */
+		while (0 < num) {
+			iowrite32(*(u32*)param, type_b->base + MIPI_DBI_B_REG_DATA);
+			param += 4;
+			num -= 4;
+		}
+		break;
+	}
+	/* Deassert CS */
+	iowrite32(0, type_b->base + MIPI_DBI_B_REG_CONTROL);
+	return 0;
+}
+
+int mipi_dbi_type_b_init(struct type_b *type_b, struct mipi_dbi *dbi)
+{
+	/* HACK: Use the spi field to store the type_b struct. */
+	dbi->spi = (void *)type_b;
+
+	dbi->read_commands = mipi_dbi_dcs_read_commands;
+	dbi->command = mipi_dbi_type_b_command;
+	dbi->swap_bytes = false;
+
+	DRM_DEBUG_DRIVER("Using MIPI DBI Type B (Intel 8080 type parallel bus)\n");
+
+	return 0;
+}
+
+static void mipi_dbi_type_b_dma_release(void *data)
+{
+	struct type_b *type_b = data;
+	dmaengine_terminate_sync(type_b->tx);
+	if (type_b->tx_busy) {
+		dma_unmap_single(type_b->tx->device->dev, type_b->tx_dma,
+		                 type_b->tx_len, DMA_TO_DEVICE);
+		type_b->tx_busy = false;
+	}
+	dma_release_channel(type_b->tx);
+}
+
+/* Optional. Only if the device tree gives a "tx" DMA channel that streams
+ * to the data register. Call after mipi_dbi_dev_init (which allocates
+ * the transfer buffer). */
+static int mipi_dbi_type_b_dma_init(struct device *dev, struct type_b *type_b,
+                                    struct mipi_dbi_dev *dbidev,
+                                    const struct drm_display_mode *mode,
+                                    resource_size_t phys)
+{
+	struct dma_slave_config config = {
+		.direction = DMA_MEM_TO_DEV,
+		.dst_addr = phys + MIPI_DBI_B_REG_DATA,
+		.dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES,
+	};
+	int ret;
+	init_completion(&type_b->tx_done);
+	type_b->tx = dma_request_chan(dev, "tx");
+	if (IS_ERR(type_b->tx)) {
+		ret = PTR_ERR(type_b->tx);
+		type_b->tx = NULL;
+		if (-ENODEV == ret) {
+			DRM_DEBUG_DRIVER("No DMA channel. Using the CPU for memory writes.\n");
+			return 0;
+		}
+		if (-EPROBE_DEFER != ret) {
+			DRM_DEV_ERROR(dev, "Failed to get DMA channel: %d\n", ret);
+		}
+		return ret;
+	}
+	ret = dmaengine_slave_config(type_b->tx, &config);
+	if (ret) {
+		DRM_DEV_ERROR(dev, "Failed to configure DMA channel: %d\n", ret);
+		dma_release_channel(type_b->tx);
+		type_b->tx = NULL;
+		return ret;
+	}
+	/* Same size as the transfer buffer of mipi_dbi. Allocated before the
+	 * release action so that it outlives any transfer. */
+	type_b->tx_spare_len = mode->vdisplay * mode->hdisplay * sizeof(u16);
+	type_b->tx_spare = devm_kmalloc(dev, type_b->tx_spare_len, GFP_KERNEL);
+	if (!type_b->tx_spare) {
+		dma_release_channel(type_b->tx);
+		type_b->tx = NULL;
+		return -ENOMEM;
+	}
+	ret = devm_add_action_or_reset(dev, mipi_dbi_type_b_dma_release, type_b);
+	if (ret) {
+		type_b->tx = NULL;
+		return ret;
+	}
+	DRM_DEBUG_DRIVER("Using DMA for memory writes\n");
+	return 0;
+}
+
+static void mipi_dbi_type_b_hw_reset(struct mipi_dbi *dbi)
+{
+	struct type_b *type_b = type_b_from_mipi_dbi(dbi);
+	iowrite32(MIPI_DBI_B_CONTROL_RESET, type_b->base + MIPI_DBI_B_REG_CONTROL);
+	msleep(10);
+	iowrite32(0, type_b->base + MIPI_DBI_B_REG_CONTROL);
+	msleep(120);
+}
+
+static unsigned int ili9488_rect_area(const struct drm_rect *rect)
+{
+	return drm_rect_width(rect) * drm_rect_height(rect);
+}
+
+static void ili9488_rect_union(struct drm_rect *a, const struct drm_rect *b)
+{
+	a->x1 = min(a->x1, b->x1);
+	a->y1 = min(a->y1, b->y1);
+	a->x2 = max(a->x2, b->x2);
+	a->y2 = max(a->y2, b->y2);
+}
+
+/* Merge clips as long as it pays off (see ILI9488_CLIP_OVERHEAD_PX).
+ * Returns the new number of clips. */
+static unsigned int ili9488_coalesce_clips(struct drm_rect *clips,
+                                           unsigned int num)
+{
+	struct drm_rect box;
+	unsigned int i, j;
+	bool merged;
+	do {
+		merged = false;
+		for (i = 0; i < num; ++i) {
+			for (j = i + 1; j < num; ++j) {
+				box = clips[i];
+				ili9488_rect_union(&box, &clips[j]);
+				if (ili9488_rect_area(&box) >
+				    ili9488_rect_area(&clips[i]) +
+				    ili9488_rect_area(&clips[j]) +
+				    ILI9488_CLIP_OVERHEAD_PX) {
+					continue;
+				}
+				clips[i] = box;
+				clips[j] = clips[--num];
+				merged = true;
+				/* Start over with the grown clip */
+				j = i;
+			}
+		}
+	} while (merged);
+	return num;
+}
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+/* See ili9488_neon.c */
+void ili9488_neon_xrgb8888_to_rgb565(u16 *dst, const u32 *src,
+                                     unsigned int pixels, int swab);
+
+static bool ili9488_has_neon(void)
+{
+	return cpu_has_neon();
+}
+
+/* Like drm_fb_xrgb8888_to_rgb565. We only hold the NEON unit for a line
+ * at a time to keep the preemption latency down. */
+static void ili9488_xrgb8888_to_rgb565_neon(u16 *dst, void *vaddr,
+                                            struct drm_framebuffer *fb,
+                                            struct drm_rect *clip, bool swab)
+{
+	unsigned int pixels = drm_rect_width(clip);
+	void *src = vaddr + clip->y1 * fb->pitches[0] + clip->x1 * sizeof(u32);
+	unsigned int y;
+	for (y = clip->y1; y < clip->y2; ++y) {
+		kernel_neon_begin();
+		ili9488_neon_xrgb8888_to_rgb565(dst, src, pixels, swab);
+		kernel_neon_end();
+		src += fb->pitches[0];
+		dst += pixels;
+	}
+}
+#else
+static bool ili9488_has_neon(void)
+{
+	return false;
+}
+
+static void ili9488_xrgb8888_to_rgb565_neon(u16 *dst, void *vaddr,
+                                            struct drm_framebuffer *fb,
+                                            struct drm_rect *clip, bool swab)
+{
+}
+#endif
+
+/* Like mipi_dbi_buf_copy but with the NEON conversion of XRGB8888 (if
+ * available). RGB565 framebuffers are copied as is by mipi_dbi_buf_copy. */
+static int ili9488_buf_copy(void *dst, struct drm_framebuffer *fb,
+                            struct drm_rect *clip, bool swap)
+{
+	struct drm_gem_object *gem = drm_gem_fb_get_obj(fb, 0);
+	struct drm_gem_cma_object *cma_obj = to_drm_gem_cma_obj(gem);
+	struct dma_buf_attachment *import_attach = gem->import_attach;
+	int ret;
+
+	if (DRM_FORMAT_XRGB8888 != fb->format->format || !ili9488_has_neon()) {
+		return mipi_dbi_buf_copy(dst, fb, clip, swap);
+	}
+
+	if (import_attach) {
+		ret = dma_buf_begin_cpu_access(import_attach->dmabuf,
+		                               DMA_FROM_DEVICE);
+		if (ret) {
+			return ret;
+		}
+	}
+	ili9488_xrgb8888_to_rgb565_neon(dst, cma_obj->vaddr, fb, clip, swap);
+	if (import_attach) {
+		return dma_buf_end_cpu_access(import_attach->dmabuf,
+		                              DMA_FROM_DEVICE);
+	}
+	return 0;
+}
+
+/* Like mipi_dbi_fb_dirty but only for the clip. The address mode
+ * (MADCTL) takes care of the rotation. */
+static void ili9488_fb_dirty(struct drm_framebuffer *fb, struct drm_rect *rect)
+{
+	struct mipi_dbi_dev *dbidev = drm_to_mipi_dbi_dev(fb->dev);
+	unsigned int height = rect->y2 - rect->y1;
+	unsigned int width = rect->x2 - rect->x1;
+	struct mipi_dbi *dbi = &dbidev->dbi;
+	u16 x1 = rect->x1, x2 = rect->x2 - 1;
+	u16 y1 = rect->y1, y2 = rect->y2 - 1;
+	int ret;
+
+	DRM_DEBUG_KMS("Flushing [FB:%d] " DRM_RECT_FMT "\n", fb->base.id, DRM_RECT_ARG(rect));
+
+	ret = ili9488_buf_copy(dbidev->tx_buf, fb, rect, dbi->swap_bytes);
+	if (ret) {
+		goto err_msg;
+	}
+
+	mipi_dbi_command(dbi, MIPI_DCS_SET_COLUMN_ADDRESS,
+	                 (x1 >> 8) & 0xff, x1 & 0xff, (x2 >> 8) & 0xff, x2 & 0xff);
+	mipi_dbi_command(dbi, MIPI_DCS_SET_PAGE_ADDRESS,
+	                 (y1 >> 8) & 0xff, y1 & 0xff, (y2 >> 8) & 0xff, y2 & 0xff);
+
+	ret = mipi_dbi_command_buf(dbi, MIPI_DCS_WRITE_MEMORY_START,
+	                           (u8 *)dbidev->tx_buf, width * height * 2);
+err_msg:
+	if (ret) {
+		dev_err_once(fb->dev->dev, "Failed to update display %d\n", ret);
+	}
+}
+
+/* Leave idle mode (if we are in it) and restart the idle timeout */
+static void ili9488_idle_exit(struct ili9488 *ili9488)
+{
+	if (0 == ili9488->idle_timeout_ms) {
+		return;
+	}
+	mutex_lock(&ili9488->idle_lock);
+	if (ili9488->idle) {
+		mipi_dbi_command(&ili9488->dbidev.dbi, MIPI_DCS_EXIT_IDLE_MODE);
+		ili9488->idle = false;
+	}
+	mod_delayed_work(system_wq, &ili9488->idle_work,
+	                 msecs_to_jiffies(ili9488->idle_timeout_ms));
+	mutex_unlock(&ili9488->idle_lock);
+}
+
+/* No flushes for a while. Idle mode cuts the colors to 8 (and the power
+ * of the panel with it). The next flush leaves it again. */
+static void ili9488_idle_work(struct work_struct *work)
+{
+	struct ili9488 *ili9488 = container_of(to_delayed_work(work),
+	                                       struct ili9488, idle_work);
+	struct drm_device *drm = &ili9488->dbidev.drm;
+	int idx;
+
+	if (!ili9488->dbidev.enabled || !drm_dev_enter(drm, &idx)) {
+		return;
+	}
+	mutex_lock(&ili9488->idle_lock);
+	if (!ili9488->idle) {
+		mipi_dbi_command(&ili9488->dbidev.dbi, MIPI_DCS_ENTER_IDLE_MODE);
+		ili9488->idle = true;
+	}
+	mutex_unlock(&ili9488->idle_lock);
+	drm_dev_exit(idx);
+}
+
+static void ili9488_flush_clips(struct drm_framebuffer *fb,
+                                struct drm_rect *clips, unsigned int num)
+{
+	struct mipi_dbi_dev *dbidev = drm_to_mipi_dbi_dev(fb->dev);
+	unsigned int i;
+	int idx;
+
+	if (!dbidev->enabled) {
+		return;
+	}
+	if (!drm_dev_enter(fb->dev, &idx)) {
+		return;
+	}
+	ili9488_idle_exit(drm_to_ili9488(fb->dev));
+	for (i = 0; i < num; ++i) {
+		ili9488_fb_dirty(fb, &clips[i]);
+	}
+	drm_dev_exit(idx);
+}
+
+static void ili9488_send_event(struct drm_crtc *crtc,
+                               struct drm_pending_vblank_event *event)
+{
+	spin_lock_irq(&crtc->dev->event_lock);
+	drm_crtc_send_vblank_event(crtc, event);
+	spin_unlock_irq(&crtc->dev->event_lock);
+}
+
+/* Add damage (and the event, if any) to the pending flush. The flush
+ * worker picks it up on the next TE edge. */
+static void ili9488_te_queue(struct ili9488 *ili9488, struct drm_crtc *crtc,
+                             struct drm_framebuffer *fb,
+                             const struct drm_rect *clips, unsigned int num)
+{
+	struct drm_pending_vblank_event *event = crtc->state->event;
+	struct drm_pending_vblank_event *stale_event = NULL;
+	struct drm_framebuffer *old_fb;
+	unsigned int i;
+
+	crtc->state->event = NULL;
+	if (num) {
+		drm_framebuffer_get(fb);
+	}
+	spin_lock_irq(&ili9488->flush_lock);
+	for (i = 0; i < num; ++i) {
+		if (ILI9488_MAX_CLIPS == ili9488->flush_num) {
+			ili9488_rect_union(&ili9488->flush_clips[ILI9488_MAX_CLIPS - 1],
+			                   &clips[i]);
+			continue;
+		}
+		ili9488->flush_clips[ili9488->flush_num++] = clips[i];
+	}
+	old_fb = NULL;
+	if (num) {
+		old_fb = ili9488->flush_fb;
+		ili9488->flush_fb = fb;
+	}
+	if (event) {
+		/* The commit waits for the previous event, so this should not
+		 * happen. Send the old one right away if it does. */
+		stale_event = ili9488->flush_event;
+		ili9488->flush_event = event;
+	}
+	ili9488->flush_pending = ili9488->flush_num || ili9488->flush_event;
+	spin_unlock_irq(&ili9488->flush_lock);
+
+	if (old_fb) {
+		drm_framebuffer_put(old_fb);
+	}
+	if (stale_event) {
+		ili9488_send_event(crtc, stale_event);
+	}
+}
+
+/* Flush the pending damage (if 'flush' is true) and send the pending
+ * event */
+static void ili9488_te_flush(struct ili9488 *ili9488, bool flush)
+{
+	struct drm_crtc *crtc = &ili9488->dbidev.pipe.crtc;
+	struct drm_rect clips[ILI9488_MAX_CLIPS];
+	struct drm_pending_vblank_event *event;
+	struct drm_framebuffer *fb;
+	unsigned int num;
+
+	spin_lock_irq(&ili9488->flush_lock);
+	fb = ili9488->flush_fb;
+	num = ili9488->flush_num;
+	memcpy(clips, ili9488->flush_clips, num * sizeof(*clips));
+	event = ili9488->flush_event;
+	ili9488->flush_fb = NULL;
+	ili9488->flush_num = 0;
+	ili9488->flush_event = NULL;
+	ili9488->flush_pending = false;
+	spin_unlock_irq(&ili9488->flush_lock);
+
+	if (fb) {
+		if (flush && num) {
+			num = ili9488_coalesce_clips(clips, num);
+			ili9488_flush_clips(fb, clips, num);
+		}
+		drm_framebuffer_put(fb);
+	}
+	if (event) {
+		ili9488_send_event(crtc, event);
+	}
+}
+
+static void ili9488_flush_work(struct work_struct *work)
+{
+	struct ili9488 *ili9488 = container_of(work, struct ili9488, flush_work);
+	ili9488_te_flush(ili9488, true);
+}
+
+/* The panel starts to scan out a new frame. Writes that start now do not
+ * tear (as long as they keep ahead of the scan). */
+static irqreturn_t ili9488_te_handler(int irq, void *data)
+{
+	struct ili9488 *ili9488 = data;
+	drm_crtc_handle_vblank(&ili9488->dbidev.pipe.crtc);
+	if (READ_ONCE(ili9488->flush_pending)) {
+		queue_work(system_highpri_wq, &ili9488->flush_work);
+	}
+	return IRQ_HANDLED;
+}
+
+/* The TE interrupt stays on. drm_crtc_handle_vblank ignores it while
+ * vblank is disabled. */
+static int ili9488_enable_vblank(struct drm_simple_display_pipe *pipe)
+{
+	return 0;
+}
+
+static void ili9488_disable_vblank(struct drm_simple_display_pipe *pipe)
+{
+}
+
+/* Optional. Only if the device tree gives a "te" GPIO. */
+static int ili9488_te_init(struct device *dev, struct ili9488 *ili9488)
+{
+	struct drm_device *drm = &ili9488->dbidev.drm;
+	int ret;
+	spin_lock_init(&ili9488->flush_lock);
+	INIT_WORK(&ili9488->flush_work, ili9488_flush_work);
+	ili9488->te = devm_gpiod_get_optional(dev, "te", GPIOD_IN);
+	if (IS_ERR(ili9488->te)) {
+		ret = PTR_ERR(ili9488->te);
+		if (-EPROBE_DEFER != ret) {
+			DRM_DEV_ERROR(dev, "Failed to get TE GPIO: %d\n", ret);
+		}
+		return ret;
+	}
+	if (NULL == ili9488->te) {
+		DRM_DEBUG_DRIVER("No TE GPIO. Flushing synchronously.\n");
+		return 0;
+	}
+	ret = drm_vblank_init(drm, 1);
+	if (ret) {
+		return ret;
+	}
+	ili9488->te_irq = gpiod_to_irq(ili9488->te);
+	if (ili9488->te_irq < 0) {
+		DRM_DEV_ERROR(dev, "Failed to get TE IRQ: %d\n", ili9488->te_irq);
+		return ili9488->te_irq;
+	}
+	ret = devm_request_irq(dev, ili9488->te_irq, ili9488_te_handler,
+	                       IRQF_TRIGGER_RISING, "ili9488-te", ili9488);
+	if (ret) {
+		DRM_DEV_ERROR(dev, "Failed to request TE IRQ: %d\n", ret);
+		return ret;
+	}
+	DRM_DEBUG_DRIVER("Flushing on TE\n");
+	return 0;
+}
+
+/* Flush each damage clip on its own. Unlike mipi_dbi_pipe_update (which
+ * flushes the bounding box of all clips), we only merge clips when the
+ * cost model says so. */
+static void ili9488_pipe_update(struct drm_simple_display_pipe *pipe,
+				struct drm_plane_state *old_state)
+{
+	struct ili9488 *ili9488 = drm_to_ili9488(pipe->crtc.dev);
+	struct drm_plane_state *state = pipe->plane.state;
+	struct drm_crtc *crtc = &pipe->crtc;
+	struct drm_atomic_helper_damage_iter iter;
+	struct drm_rect clips[ILI9488_MAX_CLIPS];
+	struct drm_rect clip;
+	unsigned int num = 0;
+
+	drm_atomic_helper_damage_iter_init(&iter, old_state, state);
+	drm_atomic_for_each_plane_damage(&iter, &clip) {
+		/* Out of room. Grow the last clip instead. */
+		if (ILI9488_MAX_CLIPS == num) {
+			ili9488_rect_union(&clips[num - 1], &clip);
+			continue;
+		}
+		clips[num++] = clip;
+	}
+	/* With TE, the flush worker takes it from here */
+	if (ili9488->te) {
+		ili9488_te_queue(ili9488, crtc, state->fb, clips, num);
+		return;
+	}
+	if (num) {
+		num = ili9488_coalesce_clips(clips, num);
+		ili9488_flush_clips(state->fb, clips, num);
+	}
+
+	if (crtc->state->event) {
+		ili9488_send_event(crtc, crtc->state->event);
+		crtc->state->event = NULL;
+	}
+}
+
+/* Like mipi_dbi_enable_flush but with our flush */
+static void ili9488_enable_flush(struct mipi_dbi_dev *dbidev,
+                                 struct drm_plane_state *plane_state)
+{
+	struct drm_framebuffer *fb = plane_state->fb;
+	struct drm_rect rect = {
+		.x1 = 0,
+		.x2 = fb->width,
+		.y1 = 0,
+		.y2 = fb->height,
+	};
+
+	dbidev->enabled = true;
+	ili9488_flush_clips(fb, &rect, 1);
+	backlight_enable(dbidev->backlight);
+}
+
+/* Put the panel to sleep. It keeps its settings, so that
+ * ili9488_pipe_enable only has to wake it up again. */
+static void ili9488_panel_sleep(struct ili9488 *ili9488)
+{
+	struct mipi_dbi *dbi = &ili9488->dbidev.dbi;
+	s64 awake_ms;
+
+	if (ILI9488_PANEL_ON != ili9488->panel) {
+		return;
+	}
+	/* Sleep mode keeps idle mode. Leave it so that we wake up without. */
+	mutex_lock(&ili9488->idle_lock);
+	if (ili9488->idle) {
+		mipi_dbi_command(dbi, MIPI_DCS_EXIT_IDLE_MODE);
+		ili9488->idle = false;
+	}
+	mutex_unlock(&ili9488->idle_lock);
+	awake_ms = ktime_ms_delta(ktime_get(), ili9488->sleep_out_time);
+	if (awake_ms < ILI9488_SLEEP_OUT_MS) {
+		msleep(ILI9488_SLEEP_OUT_MS - awake_ms);
+	}
+	mipi_dbi_command(dbi, MIPI_DCS_SET_DISPLAY_OFF);
+	mipi_dbi_command(dbi, MIPI_DCS_ENTER_SLEEP_MODE);
+	/* The panel ignores commands for 5 ms after sleep in */
+	msleep(5);
+	ili9488->panel = ILI9488_PANEL_ASLEEP;
+}
+
+static void ili9488_pipe_enable(struct drm_simple_display_pipe *pipe,
+				struct drm_crtc_state *crtc_state,
+				struct drm_plane_state *plane_state)
+{
+	struct ili9488 *ili9488 = drm_to_ili9488(pipe->crtc.dev);
+	struct mipi_dbi_dev *dbidev = &ili9488->dbidev;
+	struct mipi_dbi *dbi = &dbidev->dbi;
+	struct type_b *type_b = type_b_from_mipi_dbi(dbi);
+	u32 version;
+	u8 addr_mode;
+
+	version = ioread32(type_b->base + MIPI_DBI_B_REG_VERSION);
+	DRM_DEBUG_DRIVER("MIPI DBI Type B HW version: %d\n", version);
+
+	/* Sometimes, the boot loader does the initial reset. E.g., to show
+	 * a splash screen before Linux boots. To avoid resetting twice
+	 * (and potentially undo the work of the boot loader) we do a
+	 * simple check here. */
+	if (type_b->skip_initial_reset) {
+		type_b->skip_initial_reset = false;
+		goto out_panel_on;
+	}
+
+	/* The panel kept its settings in sleep mode. Just wake it up. */
+	if (ILI9488_PANEL_ASLEEP == ili9488->panel) {
+		mipi_dbi_command(dbi, MIPI_DCS_EXIT_SLEEP_MODE);
+		ili9488->sleep_out_time = ktime_get();
+		/* The panel ignores commands for 5 ms after sleep out */
+		msleep(5);
+		mipi_dbi_command(dbi, MIPI_DCS_SET_DISPLAY_ON);
+		goto out_panel_on;
+	}
+
+	if (mipi_dbi_display_is_on(dbi)) {
+		goto out_panel_on;
+	}
+
+	/* Hardware reset */
+	mipi_dbi_type_b_hw_reset(dbi);
+	mipi_dbi_command(dbi, MIPI_DCS_SOFT_RESET);
+	msleep(120);
+
+	/*** Apply settings ***/
+	/* Display off */
+	mipi_dbi_command(dbi, MIPI_DCS_SET_DISPLAY_OFF);
+	/* Positive gamma control */
+	mipi_dbi_command(dbi, 0xE0, 0x00, 0x03, 0x09, 0x08, 0x16, \
+			0x0A, 0x3F, 0x78, 0x4C, 0x09, 0x0A, \
+			0x08, 0x16, 0x1A, 0x0F);
+	/* Negative gamma control */
+	mipi_dbi_command(dbi, 0xE1, 0x00, 0x16, 0x19, 0x03, 0x0F, \
+			0x05, 0x32, 0x45, 0x46, 0x04, 0x0E, \
+			0x0D, 0x35, 0x37, 0x0F);
+	/* Power control 1 */
+	mipi_dbi_command(dbi, 0xC0, 0x17, 0x15);
+	/* Power control 2 */
+	mipi_dbi_command(dbi, 0xC1, 0x41);
+	/* VCOM control 1 */
+	mipi_dbi_command(dbi, 0xC5, 0x00, 0x12, 0x80);
+	/* Pixel interchange format: RGB565 over MIPI 16 bit */
+	mipi_dbi_command(dbi, MIPI_DCS_SET_PIXEL_FORMAT,
+	                 ILI9488_DBI_16_BPP | (ILI9488_DPI_16_BPP << 4));
+	/* Interface mode control */
+	mipi_dbi_command(dbi, 0xB0, 0x00);
+	/* Frame rate control (0x01 is 30.38 Hz; 0xA0 is 60.76 Hz) */
+	mipi_dbi_command(dbi, ILI9488_CMD_FRAME_RATE_CONTROL, 0xA0);
+	/* Display inversion ON */
+	mipi_dbi_command(dbi, 0x21);
+	/* Display inversion control */
+	mipi_dbi_command(dbi, ILI9488_CMD_DISPLAY_INVERSION_CONTROL,
+                     ILI9488_DINV_2_DOT_INVERSION);
+	/* Write CTRL display value (brightness, dimming, backlight) */
+	mipi_dbi_command(dbi, MIPI_DCS_WRITE_CONTROL_DISPLAY, 0x28);
+	/* Write display brightness value */
+	mipi_dbi_command(dbi, MIPI_DCS_SET_DISPLAY_BRIGHTNESS, 0x7F);
+	/* Exit sleep */
+	mipi_dbi_command(dbi, MIPI_DCS_EXIT_SLEEP_MODE);
+	msleep(120);
+	/* Display on */
+	mipi_dbi_command(dbi, MIPI_DCS_SET_DISPLAY_ON);
+	msleep(50);
+
+out_panel_on:
+	/* Otherwise, the panel left sleep mode long ago (the full setup waits
+	 * for it and the boot loader ran before us) */
+	if (ILI9488_PANEL_ASLEEP != ili9488->panel) {
+		ili9488->sleep_out_time = ktime_sub_ms(ktime_get(),
+		                                       ILI9488_SLEEP_OUT_MS);
+	}
+	ili9488->panel = ILI9488_PANEL_ON;
+
+	/* Memory access control: MX and BGR */
+	switch (dbidev->rotation) {
+	default:
+		addr_mode = ILI9488_MADCTL_MX;
+		break;
+	case 90:
+		addr_mode = ILI9488_MADCTL_MV;
+		break;
+	case 180:
+		addr_mode = ILI9488_MADCTL_MY;
+		break;
+	case 270:
+		addr_mode = ILI9488_MADCTL_MV | ILI9488_MADCTL_MY |
+			    ILI9488_MADCTL_MX;
+		break;
+	}
+	addr_mode |= ILI9488_MADCTL_BGR;
+	mipi_dbi_command(dbi, MIPI_DCS_SET_ADDRESS_MODE, addr_mode);
+	ili9488_enable_flush(dbidev, plane_state);
+	if (ili9488->te) {
+		drm_crtc_vblank_on(&pipe->crtc);
+	}
+}
+
+static void ili9488_pipe_disable(struct drm_simple_display_pipe *pipe)
+{
+	struct ili9488 *ili9488 = drm_to_ili9488(pipe->crtc.dev);
+	if (ili9488->te) {
+		/* Drop the pending damage but deliver the pending event */
+		cancel_work_sync(&ili9488->flush_work);
+		ili9488_te_flush(ili9488, false);
+		drm_crtc_vblank_off(&pipe->crtc);
+	}
+	cancel_delayed_work_sync(&ili9488->idle_work);
+	mipi_dbi_pipe_disable(pipe);
+	ili9488_panel_sleep(ili9488);
+}
+
+static const struct drm_simple_display_pipe_funcs ili9488_pipe_funcs = {
+	.enable = ili9488_pipe_enable,
+	.disable = ili9488_pipe_disable,
+	.update = ili9488_pipe_update,
+	.prepare_fb = drm_gem_fb_simple_display_pipe_prepare_fb,
+	.enable_vblank = ili9488_enable_vblank,
+	.disable_vblank = ili9488_disable_vblank,
+};
+
+/* convert_bench
+ *
+ * Reading runs the XRGB8888 to RGB565 conversion of a full frame with
+ * the generic helper and with NEON (if available). Reports the time per
+ * frame and whether the results match. */
+#define ILI9488_BENCH_FRAMES 16
+
+static int ili9488_convert_bench_show(struct seq_file *m, void *arg)
+{
+	struct drm_info_node *node = m->private;
+	struct mipi_dbi_dev *dbidev = drm_to_mipi_dbi_dev(node->minor->dev);
+	unsigned int width = dbidev->mode.hdisplay;
+	unsigned int height = dbidev->mode.vdisplay;
+	struct drm_rect clip = {
+		.x1 = 0,
+		.x2 = width,
+		.y1 = 0,
+		.y2 = height,
+	};
+	struct drm_framebuffer *fb;
+	u32 *src = NULL;
+	u16 *dst = NULL, *dst_neon = NULL;
+	u64 start_ns, generic_ns, neon_ns;
+	unsigned int i;
+	int ret = -ENOMEM;
+
+	/* The helpers only look at the pitch */
+	fb = kzalloc(sizeof(*fb), GFP_KERNEL);
+	src = vmalloc(width * height * sizeof(u32));
+	dst = vmalloc(width * height * sizeof(u16));
+	dst_neon = vmalloc(width * height * sizeof(u16));
+	if (!fb || !src || !dst || !dst_neon) {
+		goto out_free;
+	}
+	fb->pitches[0] = width * sizeof(u32);
+	for (i = 0; i < width * height; ++i) {
+		src[i] = i * 0x01020304;
+	}
+
+	start_ns = ktime_get_ns();
+	for (i = 0; i < ILI9488_BENCH_FRAMES; ++i) {
+		drm_fb_xrgb8888_to_rgb565(dst, src, fb, &clip, false);
+	}
+	generic_ns = div_u64(ktime_get_ns() - start_ns, ILI9488_BENCH_FRAMES);
+	seq_printf(m, "generic: %llu ns/frame\n", generic_ns);
+
+	if (ili9488_has_neon()) {
+		start_ns = ktime_get_ns();
+		for (i = 0; i < ILI9488_BENCH_FRAMES; ++i) {
+			ili9488_xrgb8888_to_rgb565_neon(dst_neon, src, fb, &clip, false);
+		}
+		neon_ns = div_u64(ktime_get_ns() - start_ns, ILI9488_BENCH_FRAMES);
+		seq_printf(m, "neon: %llu ns/frame (%s)\n", neon_ns,
+		           memcmp(dst, dst_neon, width * height * sizeof(u16)) ?
+		           "mismatch" : "match");
+	} else {
+		seq_puts(m, "neon: unavailable\n");
+	}
+	ret = 0;
+
+out_free:
+	vfree(dst_neon);
+	vfree(dst);
+	vfree(src);
+	kfree(fb);
+	return ret;
+}
+
+static const struct drm_info_list ili9488_debugfs_list[] = {
+	{ "convert_bench", ili9488_convert_bench_show, 0 },
+};
+
+static int ili9488_debugfs_init(struct drm_minor *minor)
+{
+	return drm_debugfs_create_files(ili9488_debugfs_list,
+	                                ARRAY_SIZE(ili9488_debugfs_list),
+	                                minor->debugfs_root, minor);
+}
+
+DEFINE_DRM_GEM_CMA_FOPS(ili9488_fops);
+
+static struct drm_driver ili9488_driver = {
+	.driver_features	= DRIVER_GEM | DRIVER_MODESET | DRIVER_ATOMIC,
+	.fops			= &ili9488_fops,
+	.release		= mipi_dbi_release,
+	DRM_GEM_CMA_VMAP_DRIVER_OPS,
+	.debugfs_init		= ili9488_debugfs_init,
+	.name			= "ili9488",
+	.desc			= "Ilitek ILI9488",
+	.date			= "20190716",
+	.major			= 1,
+	.minor			= 0,
+};
+
+static const struct of_device_id ili9488_of_match[] = {
+	{ .compatible = "urt,p220md-t" },
+	{},
+};
+MODULE_DEVICE_TABLE(of, ili9488_of_match);
+
+static int ili9488_probe(struct platform_device *pdev)
+{
+	const struct drm_display_mode mode = {
+		DRM_SIMPLE_MODE(320, 480, 49, 73)
+	};
+	struct device *dev = &pdev->dev;
+	struct ili9488 *ili9488;
+	struct mipi_dbi_dev *dbidev;
+	struct drm_device *drm;
+	struct mipi_dbi *dbi;
+	struct type_b *type_b;
+	struct resource *resource;
+	int rotation = 0;
+	int ret;
+
+	ili9488 = devm_kzalloc(dev, sizeof(*ili9488), GFP_KERNEL);
+	if (!ili9488) {
+		return -ENOMEM;
+	}
+	dbidev = &ili9488->dbidev;
+
+	dbi = &dbidev->dbi;
+	drm = &dbidev->drm;
+	ret = devm_drm_dev_init(dev, drm, &ili9488_driver);
+	if (ret) {
+		return ret;
+	}
+
+	drm_mode_config_init(drm);
+
+	type_b = devm_kzalloc(dev, sizeof(*type_b), GFP_KERNEL);
+	if (!type_b) {
+		return -ENOMEM;
+	}
+
+	/* MIPI DBI interface */
+	resource = platform_get_resource_byname(pdev, IORESOURCE_MEM,
+	                                        "mipi-dbi-type-b");
+	if (NULL == resource) {
+		DRM_DEV_ERROR(dev, "Failed to get resource 'mipi-dbi-type-b'\n");
+		return -ENOMEM;
+	}
+	type_b->base = devm_ioremap_resource(dev, resource);
+	if (IS_ERR(type_b->base)) {
+		DRM_DEV_ERROR(dev, "Failed to ioremap 'mipi-dbi-type-b'\n");
+		return PTR_ERR(type_b->base);
+	}
+	type_b->skip_initial_reset = of_property_read_bool(dev->of_node, "linux,skip-reset");
+
+	/* Idle mode */
+	of_property_read_u32(dev->of_node, "idle-timeout-ms",
+	                     &ili9488->idle_timeout_ms);
+	INIT_DELAYED_WORK(&ili9488->idle_work, ili9488_idle_work);
+	mutex_init(&ili9488->idle_lock);
+
+	ret = mipi_dbi_type_b_init(type_b, dbi);
+	if (ret) {
+		return ret;
+	}
+
+	/* Backlight */
+	dbidev->backlight = devm_of_find_backlight(dev);
+	if (IS_ERR(dbidev->backlight)) {
+		DRM_DEV_ERROR(dev, "Failed to find backlight\n");
+		return PTR_ERR(dbidev->backlight);
+	}
+
+	/* Rotation */
+	device_property_read_u32(dev, "rotation", &rotation);
+
+	ret = mipi_dbi_dev_init(dbidev, &ili9488_pipe_funcs, &mode, rotation);
+	if (ret) {
+		return ret;
+	}
+
+	ret = mipi_dbi_type_b_dma_init(dev, type_b, dbidev, &mode, resource->start);
+	if (ret) {
+		return ret;
+	}
+
+	/* Tearing effect */
+	ret = ili9488_te_init(dev, ili9488);
+	if (ret) {
+		return ret;
+	}
+
+	drm_mode_config_reset(drm);
+
+	ret = drm_dev_register(drm, 0);
+	if (ret) {
+		return ret;
+	}
+
+	platform_set_drvdata(pdev, drm);
+
+	drm_fbdev_generic_setup(drm, 0);
+
+	return 0;
+}
+
+static int ili9488_remove(struct platform_device *pdev)
+{
+	struct drm_device *drm = platform_get_drvdata(pdev);
+	struct ili9488 *ili9488 = drm_to_ili9488(drm);
+
+	drm_dev_unplug(drm);
+	drm_atomic_helper_shutdown(drm);
+	if (ili9488->te) {
+		disable_irq(ili9488->te_irq);
+		cancel_work_sync(&ili9488->flush_work);
+	}
+	cancel_delayed_work_sync(&ili9488->idle_work);
+
+	return 0;
+}
+
+static int ili9488_pm_suspend(struct device *dev)
+{
+	struct drm_device *drm = dev_get_drvdata(dev);
+	int ret = drm_mode_config_helper_suspend(drm);
+	/* The panel may lose power. Set it up from scratch on resume. */
+	if (!ret) {
+		drm_to_ili9488(drm)->panel = ILI9488_PANEL_UNKNOWN;
+	}
+	return ret;
+}
+
+static int ili9488_pm_resume(struct device *dev)
+{
+	return drm_mode_config_helper_resume(dev_get_drvdata(dev));
+}
+
+static const struct dev_pm_ops ili9488_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(ili9488_pm_suspend, ili9488_pm_resume)
+};
+
+static void ili9488_shutdown(struct platform_device *pdev)
+{
+	drm_atomic_helper_shutdown(platform_get_drvdata(pdev));
+}
+
+static struct platform_driver ili9488_platform_driver = {
+	.driver = {
+		.name = "ili9488",
+		.owner = THIS_MODULE,
+		.of_match_table = ili9488_of_match,
+		.pm = &ili9488_pm_ops,
+	},
+	.probe = ili9488_probe,
+	.remove = ili9488_remove,
+	.shutdown = ili9488_shutdown,
+};
+module_platform_driver(ili9488_platform_driver);
+
+MODULE_DESCRIPTION("Ilitek ILI9488 DRM driver");
+MODULE_AUTHOR("Frederik Aalund");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * NEON pixel conversion for the ILI9488 DRM driver
+ *
+ * Built with the NEON compiler flags (see the Makefile). Call between
+ * kernel_neon_begin() and kernel_neon_end() only.
+ *
+ * Copyright 2019 Frederik Peter Aalund <fpa@sbtinstruments.com
+ */
+
+#include <arm_neon.h>
+
+/* Same conversion as drm_fb_xrgb8888_to_rgb565 (truncate each channel) */
+static uint16_t ili9488_xrgb8888_to_rgb565_pixel(uint32_t pix, int swab)
+{
+	uint16_t val = ((pix & 0x00f80000) >> 8) |
+	               ((pix & 0x0000fc00) >> 5) |
+	               ((pix & 0x000000f8) >> 3);
+	if (swab) {
+		val = (val << 8) | (val >> 8);
+	}
+	return val;
+}
+
+/* Convert a line of 'pixels' XRGB8888 pixels. 8 pixels at a time. */
+void ili9488_neon_xrgb8888_to_rgb565(uint16_t *dst, const uint32_t *src,
+                                     unsigned int pixels, int swab)
+{
+	uint8x8x4_t bgrx;
+	uint16x8_t val;
+	unsigned int i;
+	for (i = 0; i + 8 <= pixels; i += 8) {
+		/* Little endian XRGB8888 is B, G, R, X in memory */
+		bgrx = vld4_u8((const uint8_t *)(src + i));
+		/* R in bits 15-11, G in bits 10-5, B in bits 4-0 */
+		val = vshll_n_u8(bgrx.val[2], 8);
+		val = vsriq_n_u16(val, vshll_n_u8(bgrx.val[1], 8), 5);
+		val = vsriq_n_u16(val, vshll_n_u8(bgrx.val[0], 8), 11);
+		if (swab) {
+			val = vreinterpretq_u16_u8(vrev16q_u8(vreinterpretq_u8_u16(val)));
+		}
+		vst1q_u16(dst + i, val);
+	}
+	for (; i < pixels; ++i) {
+		dst[i] = ili9488_xrgb8888_to_rgb565_pixel(src[i], swab);
+	}
+}
@@ -0,0 +1,734 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * DRM driver for Solomon SSD2119 panels
+ *
+ * Replaces the staging fbtft driver (fb_ssd2119). Same init sequence but
+ * with damage-clip updates, a cached init state, and an asynchronous flush
+ * worker (optionally paced by the tearing effect signal). Modelled after
+ * ili9488.
+ *
+ * Copyright (C) 2019 Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+
+#include <linux/backlight.h>
+#include <linux/delay.h>
+#include <linux/dma-buf.h>
+#include <linux/gpio/consumer.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/property.h>
+#include <linux/slab.h>
+#include <linux/spi/spi.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
+
+#include <drm/drm_atomic_helper.h>
+#include <drm/drm_damage_helper.h>
+#include <drm/drm_drv.h>
+#include <drm/drm_fb_helper.h>
+#include <drm/drm_gem_cma_helper.h>
+#include <drm/drm_gem_framebuffer_helper.h>
+#include <drm/drm_mipi_dbi.h>
+#include <drm/drm_modeset_helper.h>
+#include <drm/drm_rect.h>
+#include <drm/drm_vblank.h>
+
+#define SSD2119_REG_OSCILLATION_START   0x00
+#define SSD2119_REG_OUTPUT_CONTROL      0x01
+#define SSD2119_REG_DISPLAY_CONTROL     0x07
+#define SSD2119_REG_SLEEP_MODE_1        0x10
+#define SSD2119_REG_ENTRY_MODE          0x11
+#define SSD2119_REG_RAM_DATA_WRITE      0x22
+#define SSD2119_REG_VCOM_OTP_1          0x28
+#define SSD2119_REG_V_RAM_POS           0x44
+#define SSD2119_REG_H_RAM_START         0x45
+#define SSD2119_REG_H_RAM_END           0x46
+#define SSD2119_REG_X_RAM_ADDR          0x4e
+#define SSD2119_REG_Y_RAM_ADDR          0x4f
+
+#define SSD2119_DISPLAY_CONTROL_ON      0x0033
+#define SSD2119_DISPLAY_CONTROL_OFF     0x0000
+#define SSD2119_SLEEP_MODE_1_SLEEP      0x0001
+#define SSD2119_SLEEP_MODE_1_WAKE       0x0000
+
+#define SSD2119_ENTRY_MODE_UPPER_BITS   0x6E40
+#define SSD2119_ROT_0                   0x30
+#define SSD2119_ROT_90                  0x18
+#define SSD2119_ROT_180                 0x00
+#define SSD2119_ROT_270                 0x28
+
+/* Cost model of the damage clips: Each clip costs the window and address
+ * counter writes on top of its pixels. We express said overhead in pixels
+ * (that could be sent in the same time). Two clips are merged into their
+ * bounding box if the box costs less than the two clips on their own. */
+#define SSD2119_CLIP_OVERHEAD_PX        256
+#define SSD2119_MAX_CLIPS               16
+
+struct ssd2119 {
+	/* Must be first since mipi_dbi_release frees it */
+	struct mipi_dbi_dev dbidev;
+	/* The controller kept its configuration since the last init. E.g.,
+	 * because the pipe was only disabled (sleep mode). */
+	bool initialized;
+	/* The register index is sent as 16 bits. SPI needs a DMA-safe
+	 * buffer. Protected by the command lock of mipi_dbi. */
+	u8 index[2] ____cacheline_aligned;
+	/* Optional tearing effect (TE) input. NULL if there is none. */
+	struct gpio_desc *te;
+	int te_irq;
+	/* Serializes the flushes (worker and enable) */
+	struct mutex flush_mutex;
+	struct work_struct flush_work;
+	/* Pending flush. Protected by 'flush_lock'. */
+	spinlock_t flush_lock;
+	bool flush_pending;
+	struct drm_framebuffer *flush_fb;
+	struct drm_rect flush_clips[SSD2119_MAX_CLIPS];
+	unsigned int flush_num;
+	struct drm_pending_vblank_event *flush_event;
+};
+
+static struct ssd2119 *drm_to_ssd2119(struct drm_device *drm)
+{
+	return container_of(drm_to_mipi_dbi_dev(drm), struct ssd2119, dbidev);
+}
+
+static int ssd2119_command(struct mipi_dbi *dbi, u8 reg, u16 value)
+{
+	u8 par[2] = { value >> 8, value & 0xff };
+
+	return mipi_dbi_command_stackbuf(dbi, reg, par, 2);
+}
+
+/* Like mipi_dbi_typec3_command but with a 16-bit register index (as with
+ * regwidth 16 in fbtft) */
+static int ssd2119_dbi_command(struct mipi_dbi *dbi, u8 *cmd, u8 *par,
+			       size_t num)
+{
+	struct mipi_dbi_dev *dbidev = container_of(dbi, struct mipi_dbi_dev, dbi);
+	struct ssd2119 *ssd2119 = container_of(dbidev, struct ssd2119, dbidev);
+	struct spi_device *spi = dbi->spi;
+	unsigned int bpw = 8;
+	u32 speed_hz;
+	int ret;
+
+	ssd2119->index[0] = 0x00;
+	ssd2119->index[1] = *cmd;
+	gpiod_set_value_cansleep(dbi->dc, 0);
+	speed_hz = mipi_dbi_spi_cmd_max_speed(spi, 2);
+	ret = mipi_dbi_spi_transfer(spi, speed_hz, 8, ssd2119->index, 2);
+	if (ret || !num)
+		return ret;
+
+	if (*cmd == SSD2119_REG_RAM_DATA_WRITE && !dbi->swap_bytes)
+		bpw = 16;
+
+	gpiod_set_value_cansleep(dbi->dc, 1);
+	speed_hz = mipi_dbi_spi_cmd_max_speed(spi, num);
+
+	return mipi_dbi_spi_transfer(spi, speed_hz, bpw, par, num);
+}
+
+/* Same sequence as fb_ssd2119 */
+static void ssd2119_init_display(struct mipi_dbi *dbi)
+{
+	mipi_dbi_hw_reset(dbi);
+	ssd2119_command(dbi, SSD2119_REG_VCOM_OTP_1, 0x0006);
+	ssd2119_command(dbi, SSD2119_REG_OSCILLATION_START, 0x0001);
+	ssd2119_command(dbi, SSD2119_REG_SLEEP_MODE_1, SSD2119_SLEEP_MODE_1_WAKE);
+	ssd2119_command(dbi, SSD2119_REG_OUTPUT_CONTROL, 0x30EF);
+	ssd2119_command(dbi, 0x02, 0x0600);
+	ssd2119_command(dbi, 0x03, 0x6A38);
+	ssd2119_command(dbi, SSD2119_REG_ENTRY_MODE,
+			SSD2119_ENTRY_MODE_UPPER_BITS | SSD2119_ROT_0);
+	ssd2119_command(dbi, 0x0F, 0x0000);
+	ssd2119_command(dbi, 0x0B, 0x5308);
+	ssd2119_command(dbi, 0x0C, 0x0003);
+	ssd2119_command(dbi, 0x0D, 0x000A);
+	ssd2119_command(dbi, 0x0E, 0x2E00);
+	ssd2119_command(dbi, 0x1E, 0x00BE);
+	ssd2119_command(dbi, 0x25, 0xA000);
+	ssd2119_command(dbi, 0x26, 0x7800);
+	ssd2119_command(dbi, SSD2119_REG_X_RAM_ADDR, 0x0000);
+	ssd2119_command(dbi, SSD2119_REG_Y_RAM_ADDR, 0x0000);
+	ssd2119_command(dbi, 0x12, 0x08D9);
+	ssd2119_command(dbi, 0x30, 0x0000);
+	ssd2119_command(dbi, 0x31, 0x0104);
+	ssd2119_command(dbi, 0x32, 0x0100);
+	ssd2119_command(dbi, 0x33, 0x0305);
+	ssd2119_command(dbi, 0x34, 0x0505);
+	ssd2119_command(dbi, 0x35, 0x0305);
+	ssd2119_command(dbi, 0x36, 0x0707);
+	ssd2119_command(dbi, 0x37, 0x0300);
+	ssd2119_command(dbi, 0x3A, 0x1200);
+	ssd2119_command(dbi, 0x3B, 0x0800);
+	ssd2119_command(dbi, SSD2119_REG_DISPLAY_CONTROL,
+			SSD2119_DISPLAY_CONTROL_ON);
+}
+
+/* Set the GDDRAM window and address counter to the clip. The address
+ * counter wraps within the window. Same mapping as in fb_ssd2119. */
+static void ssd2119_set_addr_win(struct mipi_dbi_dev *dbidev,
+				 struct drm_framebuffer *fb,
+				 const struct drm_rect *rect)
+{
+	struct mipi_dbi *dbi = &dbidev->dbi;
+	int xres = fb->width, yres = fb->height;
+	int xs = rect->x1, xe = rect->x2 - 1;
+	int ys = rect->y1, ye = rect->y2 - 1;
+	int hs, he, vs, ve, x, y;
+
+	switch (dbidev->rotation) {
+	default:
+		hs = xs;
+		he = xe;
+		vs = ys;
+		ve = ye;
+		x = xs;
+		y = ys;
+		break;
+	case 180:
+		hs = xres - 1 - xe;
+		he = xres - 1 - xs;
+		vs = yres - 1 - ye;
+		ve = yres - 1 - ys;
+		x = xres - 1 - xs;
+		y = yres - 1 - ys;
+		break;
+	case 270:
+		hs = yres - 1 - ye;
+		he = yres - 1 - ys;
+		vs = xs;
+		ve = xe;
+		x = yres - 1 - ys;
+		y = xs;
+		break;
+	case 90:
+		hs = ys;
+		he = ye;
+		vs = xres - 1 - xe;
+		ve = xres - 1 - xs;
+		x = ys;
+		y = xres - 1 - xs;
+		break;
+	}
+
+	ssd2119_command(dbi, SSD2119_REG_V_RAM_POS, (ve << 8) | vs);
+	ssd2119_command(dbi, SSD2119_REG_H_RAM_START, hs);
+	ssd2119_command(dbi, SSD2119_REG_H_RAM_END, he);
+	ssd2119_command(dbi, SSD2119_REG_X_RAM_ADDR, x);
+	ssd2119_command(dbi, SSD2119_REG_Y_RAM_ADDR, y);
+}
+
+static unsigned int ssd2119_rect_area(const struct drm_rect *rect)
+{
+	return drm_rect_width(rect) * drm_rect_height(rect);
+}
+
+static void ssd2119_rect_union(struct drm_rect *a, const struct drm_rect *b)
+{
+	a->x1 = min(a->x1, b->x1);
+	a->y1 = min(a->y1, b->y1);
+	a->x2 = max(a->x2, b->x2);
+	a->y2 = max(a->y2, b->y2);
+}
+
+/* Merge clips as long as it pays off (see SSD2119_CLIP_OVERHEAD_PX).
+ * Returns the new number of clips. */
+static unsigned int ssd2119_coalesce_clips(struct drm_rect *clips,
+					   unsigned int num)
+{
+	struct drm_rect box;
+	unsigned int i, j;
+	bool merged;
+
+	do {
+		merged = false;
+		for (i = 0; i < num; ++i) {
+			for (j = i + 1; j < num; ++j) {
+				box = clips[i];
+				ssd2119_rect_union(&box, &clips[j]);
+				if (ssd2119_rect_area(&box) >
+				    ssd2119_rect_area(&clips[i]) +
+				    ssd2119_rect_area(&clips[j]) +
+				    SSD2119_CLIP_OVERHEAD_PX)
+					continue;
+				clips[i] = box;
+				clips[j] = clips[--num];
+				merged = true;
+				/* Start over with the grown clip */
+				j = i;
+			}
+		}
+	} while (merged);
+
+	return num;
+}
+
+static void ssd2119_fb_dirty(struct drm_framebuffer *fb, struct drm_rect *rect)
+{
+	struct mipi_dbi_dev *dbidev = drm_to_mipi_dbi_dev(fb->dev);
+	unsigned int height = rect->y2 - rect->y1;
+	unsigned int width = rect->x2 - rect->x1;
+	struct mipi_dbi *dbi = &dbidev->dbi;
+	int ret;
+
+	DRM_DEBUG_KMS("Flushing [FB:%d] " DRM_RECT_FMT "\n", fb->base.id, DRM_RECT_ARG(rect));
+
+	ret = mipi_dbi_buf_copy(dbidev->tx_buf, fb, rect, dbi->swap_bytes);
+	if (ret)
+		goto err_msg;
+
+	ssd2119_set_addr_win(dbidev, fb, rect);
+	ret = mipi_dbi_command_buf(dbi, SSD2119_REG_RAM_DATA_WRITE,
+				   (u8 *)dbidev->tx_buf, width * height * 2);
+err_msg:
+	if (ret)
+		dev_err_once(fb->dev->dev, "Failed to update display %d\n", ret);
+}
+
+static void ssd2119_flush_clips(struct ssd2119 *ssd2119,
+				struct drm_framebuffer *fb,
+				struct drm_rect *clips, unsigned int num)
+{
+	struct mipi_dbi_dev *dbidev = &ssd2119->dbidev;
+	unsigned int i;
+	int idx;
+
+	if (!drm_dev_enter(fb->dev, &idx))
+		return;
+
+	mutex_lock(&ssd2119->flush_mutex);
+	if (dbidev->enabled) {
+		num = ssd2119_coalesce_clips(clips, num);
+		for (i = 0; i < num; ++i)
+			ssd2119_fb_dirty(fb, &clips[i]);
+	}
+	mutex_unlock(&ssd2119->flush_mutex);
+
+	drm_dev_exit(idx);
+}
+
+static void ssd2119_send_event(struct drm_crtc *crtc,
+			       struct drm_pending_vblank_event *event)
+{
+	spin_lock_irq(&crtc->dev->event_lock);
+	drm_crtc_send_vblank_event(crtc, event);
+	spin_unlock_irq(&crtc->dev->event_lock);
+}
+
+/* Flush the pending damage (if 'flush' is true) and send the pending
+ * event */
+static void ssd2119_flush_pending(struct ssd2119 *ssd2119, bool flush)
+{
+	struct drm_crtc *crtc = &ssd2119->dbidev.pipe.crtc;
+	struct drm_rect clips[SSD2119_MAX_CLIPS];
+	struct drm_pending_vblank_event *event;
+	struct drm_framebuffer *fb;
+	unsigned int num;
+
+	spin_lock_irq(&ssd2119->flush_lock);
+	fb = ssd2119->flush_fb;
+	num = ssd2119->flush_num;
+	memcpy(clips, ssd2119->flush_clips, num * sizeof(*clips));
+	event = ssd2119->flush_event;
+	ssd2119->flush_fb = NULL;
+	ssd2119->flush_num = 0;
+	ssd2119->flush_event = NULL;
+	ssd2119->flush_pending = false;
+	spin_unlock_irq(&ssd2119->flush_lock);
+
+	if (fb) {
+		if (flush && num)
+			ssd2119_flush_clips(ssd2119, fb, clips, num);
+		drm_framebuffer_put(fb);
+	}
+	if (event)
+		ssd2119_send_event(crtc, event);
+}
+
+static void ssd2119_flush_work(struct work_struct *work)
+{
+	struct ssd2119 *ssd2119 = container_of(work, struct ssd2119, flush_work);
+
+	ssd2119_flush_pending(ssd2119, true);
+}
+
+/* The panel starts to scan out a new frame. Writes that start now do not
+ * tear (as long as they keep ahead of the scan). */
+static irqreturn_t ssd2119_te_handler(int irq, void *data)
+{
+	struct ssd2119 *ssd2119 = data;
+
+	drm_crtc_handle_vblank(&ssd2119->dbidev.pipe.crtc);
+	if (READ_ONCE(ssd2119->flush_pending))
+		queue_work(system_highpri_wq, &ssd2119->flush_work);
+
+	return IRQ_HANDLED;
+}
+
+/* Hand the damage (and the commit's event) to the flush worker. It runs
+ * right away without TE and on the next TE edge with TE. */
+static void ssd2119_pipe_update(struct drm_simple_display_pipe *pipe,
+				struct drm_plane_state *old_state)
+{
+	struct ssd2119 *ssd2119 = drm_to_ssd2119(pipe->crtc.dev);
+	struct drm_plane_state *state = pipe->plane.state;
+	struct drm_pending_vblank_event *stale_event = NULL;
+	struct drm_crtc *crtc = &pipe->crtc;
+	struct drm_pending_vblank_event *event = crtc->state->event;
+	struct drm_atomic_helper_damage_iter iter;
+	struct drm_framebuffer *old_fb = NULL;
+	struct drm_rect clip;
+	bool damaged = false;
+
+	crtc->state->event = NULL;
+	if (state->fb)
+		drm_framebuffer_get(state->fb);
+
+	spin_lock_irq(&ssd2119->flush_lock);
+	drm_atomic_helper_damage_iter_init(&iter, old_state, state);
+	drm_atomic_for_each_plane_damage(&iter, &clip) {
+		damaged = true;
+		/* Out of room. Grow the last clip instead. */
+		if (ssd2119->flush_num == SSD2119_MAX_CLIPS) {
+			ssd2119_rect_union(&ssd2119->flush_clips[SSD2119_MAX_CLIPS - 1],
+					   &clip);
+			continue;
+		}
+		ssd2119->flush_clips[ssd2119->flush_num++] = clip;
+	}
+	if (damaged) {
+		old_fb = ssd2119->flush_fb;
+		ssd2119->flush_fb = state->fb;
+	} else {
+		old_fb = state->fb;
+	}
+	if (event) {
+		/* The commit waits for the previous event, so this should not
+		 * happen. Send the old one right away if it does. */
+		stale_event = ssd2119->flush_event;
+		ssd2119->flush_event = event;
+	}
+	ssd2119->flush_pending = ssd2119->flush_num || ssd2119->flush_event;
+	spin_unlock_irq(&ssd2119->flush_lock);
+
+	if (old_fb)
+		drm_framebuffer_put(old_fb);
+	if (stale_event)
+		ssd2119_send_event(crtc, stale_event);
+
+	if (!ssd2119->te && READ_ONCE(ssd2119->flush_pending))
+		queue_work(system_highpri_wq, &ssd2119->flush_work);
+}
+
+static void ssd2119_pipe_enable(struct drm_simple_display_pipe *pipe,
+				struct drm_crtc_state *crtc_state,
+				struct drm_plane_state *plane_state)
+{
+	struct ssd2119 *ssd2119 = drm_to_ssd2119(pipe->crtc.dev);
+	struct mipi_dbi_dev *dbidev = &ssd2119->dbidev;
+	struct drm_framebuffer *fb = plane_state->fb;
+	struct mipi_dbi *dbi = &dbidev->dbi;
+	struct drm_rect rect = {
+		.x1 = 0,
+		.x2 = fb->width,
+		.y1 = 0,
+		.y2 = fb->height,
+	};
+	u16 entry_mode = SSD2119_ENTRY_MODE_UPPER_BITS;
+	int idx;
+
+	if (!drm_dev_enter(pipe->crtc.dev, &idx))
+		return;
+
+	DRM_DEBUG_KMS("\n");
+
+	if (ssd2119->initialized) {
+		/* The controller kept its configuration. Just wake it up. */
+		ssd2119_command(dbi, SSD2119_REG_SLEEP_MODE_1,
+				SSD2119_SLEEP_MODE_1_WAKE);
+		msleep(30);
+		ssd2119_command(dbi, SSD2119_REG_DISPLAY_CONTROL,
+				SSD2119_DISPLAY_CONTROL_ON);
+	} else {
+		ssd2119_init_display(dbi);
+		ssd2119->initialized = true;
+	}
+
+	switch (dbidev->rotation) {
+	default:
+		entry_mode |= SSD2119_ROT_0;
+		break;
+	case 90:
+		entry_mode |= SSD2119_ROT_90;
+		break;
+	case 180:
+		entry_mode |= SSD2119_ROT_180;
+		break;
+	case 270:
+		entry_mode |= SSD2119_ROT_270;
+		break;
+	}
+	ssd2119_command(dbi, SSD2119_REG_ENTRY_MODE, entry_mode);
+
+	dbidev->enabled = true;
+	ssd2119_flush_clips(ssd2119, fb, &rect, 1);
+	backlight_enable(dbidev->backlight);
+	if (ssd2119->te)
+		drm_crtc_vblank_on(&pipe->crtc);
+
+	drm_dev_exit(idx);
+}
+
+static void ssd2119_pipe_disable(struct drm_simple_display_pipe *pipe)
+{
+	struct ssd2119 *ssd2119 = drm_to_ssd2119(pipe->crtc.dev);
+	struct mipi_dbi_dev *dbidev = &ssd2119->dbidev;
+	struct mipi_dbi *dbi = &dbidev->dbi;
+
+	DRM_DEBUG_KMS("\n");
+
+	/* Drop the pending damage but deliver the pending event */
+	cancel_work_sync(&ssd2119->flush_work);
+	ssd2119_flush_pending(ssd2119, false);
+	if (ssd2119->te)
+		drm_crtc_vblank_off(&pipe->crtc);
+
+	if (!dbidev->enabled)
+		return;
+
+	mutex_lock(&ssd2119->flush_mutex);
+	dbidev->enabled = false;
+	mutex_unlock(&ssd2119->flush_mutex);
+
+	backlight_disable(dbidev->backlight);
+	/* Sleep mode keeps the configuration (see 'initialized') */
+	ssd2119_command(dbi, SSD2119_REG_DISPLAY_CONTROL,
+			SSD2119_DISPLAY_CONTROL_OFF);
+	ssd2119_command(dbi, SSD2119_REG_SLEEP_MODE_1,
+			SSD2119_SLEEP_MODE_1_SLEEP);
+}
+
+/* The TE interrupt stays on. drm_crtc_handle_vblank ignores it while
+ * vblank is disabled. */
+static int ssd2119_enable_vblank(struct drm_simple_display_pipe *pipe)
+{
+	return 0;
+}
+
+static void ssd2119_disable_vblank(struct drm_simple_display_pipe *pipe)
+{
+}
+
+static const struct drm_simple_display_pipe_funcs ssd2119_pipe_funcs = {
+	.enable		= ssd2119_pipe_enable,
+	.disable	= ssd2119_pipe_disable,
+	.update		= ssd2119_pipe_update,
+	.prepare_fb	= drm_gem_fb_simple_display_pipe_prepare_fb,
+	.enable_vblank	= ssd2119_enable_vblank,
+	.disable_vblank	= ssd2119_disable_vblank,
+};
+
+static const struct drm_display_mode ssd2119_mode = {
+	DRM_SIMPLE_MODE(320, 240, 70, 53),
+};
+
+DEFINE_DRM_GEM_CMA_FOPS(ssd2119_fops);
+
+static struct drm_driver ssd2119_driver = {
+	.driver_features	= DRIVER_GEM | DRIVER_MODESET | DRIVER_ATOMIC,
+	.fops			= &ssd2119_fops,
+	.release		= mipi_dbi_release,
+	DRM_GEM_CMA_VMAP_DRIVER_OPS,
+	.debugfs_init		= mipi_dbi_debugfs_init,
+	.name			= "ssd2119",
+	.desc			= "Solomon SSD2119",
+	.date			= "20191104",
+	.major			= 1,
+	.minor			= 0,
+};
+
+static const struct of_device_id ssd2119_of_match[] = {
+	{ .compatible = "solomon,ssd2119" },
+	{},
+};
+MODULE_DEVICE_TABLE(of, ssd2119_of_match);
+
+static const struct spi_device_id ssd2119_id[] = {
+	{ "ssd2119", 0 },
+	{ },
+};
+MODULE_DEVICE_TABLE(spi, ssd2119_id);
+
+/* Optional. Only if the device tree gives a "te" GPIO. */
+static int ssd2119_te_init(struct device *dev, struct ssd2119 *ssd2119)
+{
+	int ret;
+
+	ssd2119->te = devm_gpiod_get_optional(dev, "te", GPIOD_IN);
+	if (IS_ERR(ssd2119->te)) {
+		ret = PTR_ERR(ssd2119->te);
+		if (ret != -EPROBE_DEFER)
+			DRM_DEV_ERROR(dev, "Failed to get gpio 'te'\n");
+		return ret;
+	}
+	if (!ssd2119->te)
+		return 0;
+
+	ret = drm_vblank_init(&ssd2119->dbidev.drm, 1);
+	if (ret)
+		return ret;
+
+	ssd2119->te_irq = gpiod_to_irq(ssd2119->te);
+	if (ssd2119->te_irq < 0) {
+		DRM_DEV_ERROR(dev, "Failed to get TE IRQ\n");
+		return ssd2119->te_irq;
+	}
+
+	ret = devm_request_irq(dev, ssd2119->te_irq, ssd2119_te_handler,
+			       IRQF_TRIGGER_RISING, "ssd2119-te", ssd2119);
+	if (ret)
+		DRM_DEV_ERROR(dev, "Failed to request TE IRQ\n");
+
+	return ret;
+}
+
+static int ssd2119_probe(struct spi_device *spi)
+{
+	struct device *dev = &spi->dev;
+	struct ssd2119 *ssd2119;
+	struct mipi_dbi_dev *dbidev;
+	struct drm_device *drm;
+	struct mipi_dbi *dbi;
+	struct gpio_desc *dc;
+	u32 rotation = 0;
+	int ret;
+
+	ssd2119 = kzalloc(sizeof(*ssd2119), GFP_KERNEL);
+	if (!ssd2119)
+		return -ENOMEM;
+
+	dbidev = &ssd2119->dbidev;
+	dbi = &dbidev->dbi;
+	drm = &dbidev->drm;
+	ret = devm_drm_dev_init(dev, drm, &ssd2119_driver);
+	if (ret) {
+		kfree(ssd2119);
+		return ret;
+	}
+
+	drm_mode_config_init(drm);
+
+	mutex_init(&ssd2119->flush_mutex);
+	spin_lock_init(&ssd2119->flush_lock);
+	INIT_WORK(&ssd2119->flush_work, ssd2119_flush_work);
+
+	/* Sometimes, the boot loader initializes the display. E.g., to show
+	 * a splash screen before Linux boots. */
+	ssd2119->initialized = device_property_read_bool(dev, "linux,skip-reset");
+
+	dbi->reset = devm_gpiod_get_optional(dev, "reset", GPIOD_OUT_HIGH);
+	if (IS_ERR(dbi->reset)) {
+		DRM_DEV_ERROR(dev, "Failed to get gpio 'reset'\n");
+		return PTR_ERR(dbi->reset);
+	}
+
+	dc = devm_gpiod_get(dev, "dc", GPIOD_OUT_LOW);
+	if (IS_ERR(dc)) {
+		DRM_DEV_ERROR(dev, "Failed to get gpio 'dc'\n");
+		return PTR_ERR(dc);
+	}
+
+	dbidev->backlight = devm_of_find_backlight(dev);
+	if (IS_ERR(dbidev->backlight))
+		return PTR_ERR(dbidev->backlight);
+
+	device_property_read_u32(dev, "rotation", &rotation);
+
+	ret = mipi_dbi_spi_init(spi, dbi, dc);
+	if (ret)
+		return ret;
+
+	/* override the command function set in mipi_dbi_spi_init() */
+	dbi->command = ssd2119_dbi_command;
+	/* There is no read-back of the DCS kind */
+	dbi->read_commands = NULL;
+
+	ret = mipi_dbi_dev_init(dbidev, &ssd2119_pipe_funcs, &ssd2119_mode,
+				rotation);
+	if (ret)
+		return ret;
+
+	ret = ssd2119_te_init(dev, ssd2119);
+	if (ret)
+		return ret;
+
+	drm_mode_config_reset(drm);
+
+	ret = drm_dev_register(drm, 0);
+	if (ret)
+		return ret;
+
+	spi_set_drvdata(spi, drm);
+
+	drm_fbdev_generic_setup(drm, 0);
+
+	return 0;
+}
+
+static int ssd2119_remove(struct spi_device *spi)
+{
+	struct drm_device *drm = spi_get_drvdata(spi);
+	struct ssd2119 *ssd2119 = drm_to_ssd2119(drm);
+
+	drm_dev_unplug(drm);
+	drm_atomic_helper_shutdown(drm);
+	if (ssd2119->te)
+		disable_irq(ssd2119->te_irq);
+	cancel_work_sync(&ssd2119->flush_work);
+
+	return 0;
+}
+
+static void ssd2119_shutdown(struct spi_device *spi)
+{
+	drm_atomic_helper_shutdown(spi_get_drvdata(spi));
+}
+
+static int __maybe_unused ssd2119_pm_suspend(struct device *dev)
+{
+	return drm_mode_config_helper_suspend(dev_get_drvdata(dev));
+}
+
+static int __maybe_unused ssd2119_pm_resume(struct device *dev)
+{
+	struct drm_device *drm = dev_get_drvdata(dev);
+
+	/* The controller may have lost power */
+	drm_to_ssd2119(drm)->initialized = false;
+
+	return drm_mode_config_helper_resume(drm);
+}
+
+static const struct dev_pm_ops ssd2119_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(ssd2119_pm_suspend, ssd2119_pm_resume)
+};
+
+static struct spi_driver ssd2119_spi_driver = {
+	.driver = {
+		.name = "ssd2119",
+		.owner = THIS_MODULE,
+		.of_match_table = ssd2119_of_match,
+		.pm = &ssd2119_pm_ops,
+	},
+	.id_table = ssd2119_id,
+	.probe = ssd2119_probe,
+	.remove = ssd2119_remove,
+	.shutdown = ssd2119_shutdown,
+};
+module_spi_driver(ssd2119_spi_driver);
+
+MODULE_DESCRIPTION("Solomon SSD2119 DRM driver");
+MODULE_AUTHOR("Frederik Aalund");
+MODULE_LICENSE("GPL");
@@ -122,6 +122,28 @@ static const struct drm_mode_config_funcs xlnx_mode_config_funcs = {
 	.atomic_commit		= drm_atomic_helper_commit,
 };
 
+/*
+ * Same as drm_atomic_helper_commit_tail(), but waits for the flip done events
+ * only. All CRTCs send the event when the new frame is being scanned out, so
+ * an extra vblank wait would only delay the next non-blocking commit.
+ */
+static void xlnx_atomic_commit_tail(struct drm_atomic_state *old_state)
+{
+	struct drm_device *drm = old_state->dev;
+
+	drm_atomic_helper_commit_modeset_disables(drm, old_state);
+	drm_atomic_helper_commit_modeset_enables(drm, old_state);
+	drm_atomic_helper_commit_planes(drm, old_state, 0);
+	drm_atomic_helper_fake_vblank(old_state);
+	drm_atomic_helper_commit_hw_done(old_state);
+	drm_atomic_helper_wait_for_flip_done(drm, old_state);
+	drm_atomic_helper_cleanup_planes(drm, old_state);
+}
+
+static const struct drm_mode_config_helper_funcs xlnx_mode_config_helpers = {
+	.atomic_commit_tail	= xlnx_atomic_commit_tail,
+};
+
 static void xlnx_mode_config_init(struct drm_device *drm)
 {
 	struct xlnx_drm *xlnx_drm = drm->dev_private;
@@ -239,6 +261,7 @@ static int xlnx_bind(struct device *dev)
 
 	drm_mode_config_init(drm);
 	drm->mode_config.funcs = &xlnx_mode_config_funcs;
+	drm->mode_config.helper_private = &xlnx_mode_config_helpers;
 
 	ret = drm_vblank_init(drm, 1);
 	if (ret) {
@@ -17,6 +17,7 @@
 #include <drm/drm_fourcc.h>
 #include <drm/drm_gem_cma_helper.h>
 #include <drm/drm_modeset_helper_vtables.h>
+#include <linux/bitmap.h>
 #include <linux/clk.h>
 #include <linux/component.h>
 #include <linux/dma/xilinx_frmbuf.h>
@@ -127,6 +128,10 @@
 #define	XVMIX_SCALE_FACTOR_4X		2
 #define	XVMIX_SCALE_FACTOR_INVALID	3
 #define	XVMIX_BASE_ALIGN		8
+/* Registers below this offset are sampled by the core at frame start */
+#define XVMIX_SHADOW_SIZE		(XVMIX_LOGOCLRKEYMAX_B_DATA + \
+					 XVMIX_LOGO_OFFSET + 4)
+#define XVMIX_SHADOW_REGS		(XVMIX_SHADOW_SIZE / 4)
 #define XVMIX_CSC_MAX_ROWS		(3)
 #define XVMIX_CSC_MAX_COLS		(3)
 #define XVMIX_CSC_MATRIX_SIZE	(XVMIX_CSC_MAX_ROWS * XVMIX_CSC_MAX_COLS)
@@ -375,6 +380,11 @@ struct xlnx_mix_layer_data {
  * @reset_gpio: GPIO line used to reset IP between modesetting operations
  * @intrpt_handler_fn: Interrupt handler function called when frame is completed
  * @intrpt_data: Data pointer passed to interrupt handler
+ * @shadow: Last value written to each frame-sampled register
+ * @shadow_valid: Registers for which @shadow matches the hardware
+ * @shadow_dirty: Registers written while latched, flushed at frame done
+ * @shadow_lock: Protects the shadow state against the interrupt handler
+ * @latch: Defer register writes to the next frame done interrupt
  *
  * Used as the primary data structure for many L2 driver functions. Logo layer
  * data, if enabled within the IP, is described in this structure.  All other
@@ -406,6 +416,11 @@ struct xlnx_mix_hw {
 	struct gpio_desc *reset_gpio;
 	void (*intrpt_handler_fn)(void *);
 	void *intrpt_data;
+	u32 *shadow;
+	unsigned long *shadow_valid;
+	unsigned long *shadow_dirty;
+	spinlock_t shadow_lock;
+	bool latch;
 };
 
 /**
@@ -430,6 +445,7 @@ struct xlnx_mix_hw {
  * @pixel_clock_enabled: pixel clock status
  * @dpms: mixer drm state
  * @event: vblank pending event
+ * @event_latched: Register writes of @event have been flushed to the core
  * @vtc_bridge: vtc_bridge structure
  *
  * Contains pointers to logical constructions such as the DRM plane manager as
@@ -459,6 +475,7 @@ struct xlnx_mix {
 	bool pixel_clock_enabled;
 	int dpms;
 	struct drm_pending_vblank_event *event;
+	bool event_latched;
 	struct xlnx_bridge *vtc_bridge;
 };
 
@@ -514,6 +531,131 @@ static inline u32 reg_readl(void __iomem *base, int offset)
 	return readl(base + offset);
 }
 
+static inline bool xlnx_mix_is_shadowed(int offset)
+{
+	return offset >= XVMIX_WIDTH_DATA && offset < XVMIX_SHADOW_SIZE;
+}
+
+/**
+ * xlnx_mix_write - Write a mixer register
+ * @mixer: instance of mixer IP core
+ * @offset: register offset
+ * @val: value to write
+ *
+ * The core samples its configuration registers when it starts a frame, so
+ * a write while it is running may tear with the writes that follow it. While
+ * latched, writes only update the shadow and the whole batch is flushed from
+ * the frame done interrupt. Writes that don't change a register are dropped.
+ */
+static void xlnx_mix_write(struct xlnx_mix_hw *mixer, int offset, u32 val)
+{
+	unsigned int i = offset / 4;
+	unsigned long flags;
+
+	if (!xlnx_mix_is_shadowed(offset)) {
+		reg_writel(mixer->base, offset, val);
+		return;
+	}
+
+	spin_lock_irqsave(&mixer->shadow_lock, flags);
+	if (!test_bit(i, mixer->shadow_valid) || mixer->shadow[i] != val) {
+		mixer->shadow[i] = val;
+		__set_bit(i, mixer->shadow_valid);
+		if (mixer->latch)
+			__set_bit(i, mixer->shadow_dirty);
+		else
+			reg_writel(mixer->base, offset, val);
+	}
+	spin_unlock_irqrestore(&mixer->shadow_lock, flags);
+}
+
+static void xlnx_mix_writeq(struct xlnx_mix_hw *mixer, int offset, u64 val)
+{
+	xlnx_mix_write(mixer, offset, lower_32_bits(val));
+	xlnx_mix_write(mixer, offset + 4, upper_32_bits(val));
+}
+
+/**
+ * xlnx_mix_read - Read a mixer register
+ * @mixer: instance of mixer IP core
+ * @offset: register offset
+ *
+ * Return: the value last written to a frame-sampled register, which may not
+ * have reached the core yet, or the hardware value of any other register.
+ */
+static u32 xlnx_mix_read(struct xlnx_mix_hw *mixer, int offset)
+{
+	unsigned int i = offset / 4;
+	unsigned long flags;
+	u32 val;
+
+	if (!xlnx_mix_is_shadowed(offset))
+		return reg_readl(mixer->base, offset);
+
+	spin_lock_irqsave(&mixer->shadow_lock, flags);
+	if (test_bit(i, mixer->shadow_valid))
+		val = mixer->shadow[i];
+	else
+		val = reg_readl(mixer->base, offset);
+	spin_unlock_irqrestore(&mixer->shadow_lock, flags);
+
+	return val;
+}
+
+/**
+ * xlnx_mix_flush - Write the latched registers to the core
+ * @mixer: instance of mixer IP core
+ *
+ * Return: true if any register was written
+ */
+static bool xlnx_mix_flush(struct xlnx_mix_hw *mixer)
+{
+	unsigned long flags;
+	unsigned int i;
+	bool flushed;
+
+	spin_lock_irqsave(&mixer->shadow_lock, flags);
+	flushed = !bitmap_empty(mixer->shadow_dirty, XVMIX_SHADOW_REGS);
+	for_each_set_bit(i, mixer->shadow_dirty, XVMIX_SHADOW_REGS)
+		reg_writel(mixer->base, i * 4, mixer->shadow[i]);
+	bitmap_zero(mixer->shadow_dirty, XVMIX_SHADOW_REGS);
+	spin_unlock_irqrestore(&mixer->shadow_lock, flags);
+
+	return flushed;
+}
+
+static bool xlnx_mix_flush_pending(struct xlnx_mix_hw *mixer)
+{
+	unsigned long flags;
+	bool pending;
+
+	spin_lock_irqsave(&mixer->shadow_lock, flags);
+	pending = !bitmap_empty(mixer->shadow_dirty, XVMIX_SHADOW_REGS);
+	spin_unlock_irqrestore(&mixer->shadow_lock, flags);
+
+	return pending;
+}
+
+/* The core lost its configuration, make the next writes go to the hardware */
+static void xlnx_mix_shadow_invalidate(struct xlnx_mix_hw *mixer)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&mixer->shadow_lock, flags);
+	bitmap_zero(mixer->shadow_valid, XVMIX_SHADOW_REGS);
+	bitmap_zero(mixer->shadow_dirty, XVMIX_SHADOW_REGS);
+	spin_unlock_irqrestore(&mixer->shadow_lock, flags);
+}
+
+static void xlnx_mix_set_latch(struct xlnx_mix_hw *mixer, bool latch)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&mixer->shadow_lock, flags);
+	mixer->latch = latch;
+	spin_unlock_irqrestore(&mixer->shadow_lock, flags);
+}
+
 /**
  * xlnx_mix_intrpt_enable_done - Enables interrupts
  * @mixer: instance of mixer IP core
@@ -547,14 +689,17 @@ static void xlnx_mix_intrpt_disable(struct xlnx_mix_hw *mixer)
  * xlnx_mix_start - Start the mixer core video generator
  * @mixer: Mixer core instance for which to start video output
  *
- * Starts the core to generate a video frame.
+ * Starts the core to generate a video frame. From then on register updates
+ * are latched to frame boundaries if the done interrupt is available.
  */
 static void xlnx_mix_start(struct xlnx_mix_hw *mixer)
 {
 	u32 val;
 
+	xlnx_mix_flush(mixer);
 	val = XVMIX_AP_RST_MASK | XVMIX_AP_EN_MASK;
 	reg_writel(mixer->base, XVMIX_AP_CTRL, val);
+	xlnx_mix_set_latch(mixer, mixer->irq > 0);
 }
 
 /**
@@ -565,6 +710,8 @@ static void xlnx_mix_start(struct xlnx_mix_hw *mixer)
  */
 static void xlnx_mix_stop(struct xlnx_mix_hw *mixer)
 {
+	xlnx_mix_set_latch(mixer, false);
+	xlnx_mix_flush(mixer);
 	reg_writel(mixer->base, XVMIX_AP_CTRL, 0);
 }
 
@@ -596,14 +743,14 @@ static void xlnx_mix_set_yuv2_rgb_coeff(struct xlnx_mix_plane *plane,
 	u32 bpc_scale = 1 << (mixer->mixer_hw.bg_layer_bpc - 8);
 
 	for (i = 0; i < XVMIX_CSC_MATRIX_SIZE; i++)
-		reg_writel(mixer->mixer_hw.base, XVMIX_K00_1 + i * 8,
-			   xlnx_mix_yuv2rgb_coeffs[enc][range][i] *
-			   XVMIX_CSC_SCALE_FACTOR / XVMIX_CSC_DIVISOR);
+		xlnx_mix_write(&mixer->mixer_hw, XVMIX_K00_1 + i * 8,
+			       xlnx_mix_yuv2rgb_coeffs[enc][range][i] *
+			       XVMIX_CSC_SCALE_FACTOR / XVMIX_CSC_DIVISOR);
 
 	for (i = XVMIX_CSC_MATRIX_SIZE; i < XVMIX_CSC_COEFF_SIZE; i++)
-		reg_writel(mixer->mixer_hw.base, XVMIX_K00_1 + i * 8,
-			   (xlnx_mix_yuv2rgb_coeffs[enc][range][i] *
-			    bpc_scale));
+		xlnx_mix_write(&mixer->mixer_hw, XVMIX_K00_1 + i * 8,
+			       (xlnx_mix_yuv2rgb_coeffs[enc][range][i] *
+			       bpc_scale));
 }
 
 /**
@@ -623,14 +770,14 @@ static void xlnx_mix_set_rgb2_yuv_coeff(struct xlnx_mix_plane *plane,
 	u32 bpc_scale = 1 << (mixer->mixer_hw.bg_layer_bpc - 8);
 
 	for (i = 0; i < XVMIX_CSC_MATRIX_SIZE; i++)
-		reg_writel(mixer->mixer_hw.base, XVMIX_K00_2 + i * 8,
-			   xlnx_mix_rgb2yuv_coeffs[enc][range][i] *
-			   XVMIX_CSC_SCALE_FACTOR / XVMIX_CSC_DIVISOR);
+		xlnx_mix_write(&mixer->mixer_hw, XVMIX_K00_2 + i * 8,
+			       xlnx_mix_rgb2yuv_coeffs[enc][range][i] *
+			       XVMIX_CSC_SCALE_FACTOR / XVMIX_CSC_DIVISOR);
 
 	for (i = XVMIX_CSC_MATRIX_SIZE; i < XVMIX_CSC_COEFF_SIZE; i++)
-		reg_writel(mixer->mixer_hw.base, XVMIX_K00_2 + i * 8,
-			   (xlnx_mix_rgb2yuv_coeffs[enc][range][i] *
-			    bpc_scale));
+		xlnx_mix_write(&mixer->mixer_hw, XVMIX_K00_2 + i * 8,
+			       (xlnx_mix_rgb2yuv_coeffs[enc][range][i] *
+			       bpc_scale));
 }
 
 /**
@@ -681,8 +828,8 @@ static int xlnx_mix_set_active_area(struct xlnx_mix_hw *mixer,
 		return -EINVAL;
 	}
 	/* set resolution */
-	reg_writel(mixer->base, XVMIX_HEIGHT_DATA, vactive);
-	reg_writel(mixer->base, XVMIX_WIDTH_DATA, hactive);
+	xlnx_mix_write(mixer, XVMIX_HEIGHT_DATA, vactive);
+	xlnx_mix_write(mixer, XVMIX_WIDTH_DATA, hactive);
 	ld->layer_regs.width  = hactive;
 	ld->layer_regs.height = vactive;
 
@@ -757,17 +904,17 @@ static void xlnx_mix_layer_enable(struct xlnx_mix_hw *mixer,
 
 	/* Check if request is to enable all layers or single layer */
 	if (id == mixer->max_layers) {
-		reg_writel(mixer->base, XVMIX_LAYERENABLE_DATA,
-			   mixer->enable_all_mask);
+		xlnx_mix_write(mixer, XVMIX_LAYERENABLE_DATA,
+			       mixer->enable_all_mask);
 
 	} else if ((id < mixer->layer_cnt) || ((id == mixer->logo_layer_id) &&
 		   mixer->logo_layer_en)) {
-		curr_state = reg_readl(mixer->base, XVMIX_LAYERENABLE_DATA);
+		curr_state = xlnx_mix_read(mixer, XVMIX_LAYERENABLE_DATA);
 		if (id == mixer->logo_layer_id)
 			curr_state |= mixer->logo_en_mask;
 		else
 			curr_state |= BIT(id);
-		reg_writel(mixer->base, XVMIX_LAYERENABLE_DATA, curr_state);
+		xlnx_mix_write(mixer, XVMIX_LAYERENABLE_DATA, curr_state);
 	} else {
 		DRM_ERROR("Can't enable requested layer %d\n", id);
 	}
@@ -818,16 +965,16 @@ static void xlnx_mix_layer_disable(struct xlnx_mix_hw *mixer,
 	num_layers = mixer->layer_cnt;
 
 	if (id == mixer->max_layers) {
-		reg_writel(mixer->base, XVMIX_LAYERENABLE_DATA,
-			   XVMIX_MASK_DISABLE_ALL_LAYERS);
+		xlnx_mix_write(mixer, XVMIX_LAYERENABLE_DATA,
+			       XVMIX_MASK_DISABLE_ALL_LAYERS);
 	} else if ((id < num_layers) ||
 		   ((id == mixer->logo_layer_id) && (mixer->logo_layer_en))) {
-		curr_state = reg_readl(mixer->base, XVMIX_LAYERENABLE_DATA);
+		curr_state = xlnx_mix_read(mixer, XVMIX_LAYERENABLE_DATA);
 		if (id == mixer->logo_layer_id)
 			curr_state &= ~(mixer->logo_en_mask);
 		else
 			curr_state &= ~(BIT(id));
-		reg_writel(mixer->base, XVMIX_LAYERENABLE_DATA, curr_state);
+		xlnx_mix_write(mixer, XVMIX_LAYERENABLE_DATA, curr_state);
 	} else {
 		DRM_ERROR("Can't disable requested layer %d\n", id);
 	}
@@ -1055,14 +1202,14 @@ static int xlnx_mix_get_layer_scaling(struct xlnx_mix_hw *mixer,
 					XVMIX_LOGO_OFFSET;
 			else
 				reg = XVMIX_LOGOSCALEFACTOR_DATA;
-			scale_factor = reg_readl(mixer->base, reg);
+			scale_factor = xlnx_mix_read(mixer, reg);
 			l_data->layer_regs.scale_fact = scale_factor;
 		}
 	} else {
 		/*Layer0-Layer15*/
 		if (id < mixer->logo_layer_id && l_data->hw_config.can_scale) {
 			reg = XVMIX_LAYERSCALE_0_DATA + (id * XVMIX_REG_OFFSET);
-			scale_factor = reg_readl(mixer->base, reg);
+			scale_factor = xlnx_mix_read(mixer, reg);
 			l_data->layer_regs.scale_fact = scale_factor;
 		}
 	}
@@ -1123,10 +1270,10 @@ static int xlnx_mix_set_layer_window(struct xlnx_mix_hw *mixer,
 			w_reg = XVMIX_LOGOWIDTH_DATA;
 			h_reg = XVMIX_LOGOHEIGHT_DATA;
 		}
-		reg_writel(mixer->base, x_reg, x_pos);
-		reg_writel(mixer->base, y_reg, y_pos);
-		reg_writel(mixer->base, w_reg, width);
-		reg_writel(mixer->base, h_reg, height);
+		xlnx_mix_write(mixer, x_reg, x_pos);
+		xlnx_mix_write(mixer, y_reg, y_pos);
+		xlnx_mix_write(mixer, w_reg, width);
+		xlnx_mix_write(mixer, h_reg, height);
 		l_data->layer_regs.x_pos = x_pos;
 		l_data->layer_regs.y_pos = y_pos;
 		l_data->layer_regs.width = width;
@@ -1146,17 +1293,17 @@ static int xlnx_mix_set_layer_window(struct xlnx_mix_hw *mixer,
 		s_reg = XVMIX_LAYERSTRIDE_0_DATA;
 
 		off = id * XVMIX_REG_OFFSET;
-		reg_writel(mixer->base, (x_reg + off), x_pos);
-		reg_writel(mixer->base, (y_reg + off), y_pos);
-		reg_writel(mixer->base, (w_reg + off), width);
-		reg_writel(mixer->base, (h_reg + off), height);
+		xlnx_mix_write(mixer, (x_reg + off), x_pos);
+		xlnx_mix_write(mixer, (y_reg + off), y_pos);
+		xlnx_mix_write(mixer, (w_reg + off), width);
+		xlnx_mix_write(mixer, (h_reg + off), height);
 		l_data->layer_regs.x_pos = x_pos;
 		l_data->layer_regs.y_pos = y_pos;
 		l_data->layer_regs.width = width;
 		l_data->layer_regs.height = height;
 
 		if (!l_data->hw_config.is_streaming)
-			reg_writel(mixer->base, (s_reg + off), stride);
+			xlnx_mix_write(mixer, (s_reg + off), stride);
 		status = 0;
 	}
 	return status;
@@ -1233,10 +1380,9 @@ static int xlnx_mix_set_layer_dimensions(struct xlnx_mix_plane *plane,
 static int xlnx_mix_set_layer_scaling(struct xlnx_mix_hw *mixer,
 				      enum xlnx_mix_layer_id id, u32 scale)
 {
-	void __iomem *reg = mixer->base;
 	struct xlnx_mix_layer_data *l_data;
 	int status = 0;
-	u32 x_pos, y_pos, width, height, offset;
+	u32 x_pos, y_pos, width, height, offset, reg;
 
 	l_data = xlnx_mix_get_layer_data(mixer, id);
 	x_pos = l_data->layer_regs.x_pos;
@@ -1249,12 +1395,10 @@ static int xlnx_mix_set_layer_scaling(struct xlnx_mix_hw *mixer,
 
 	if (id == mixer->logo_layer_id) {
 		if (mixer->logo_layer_en) {
+			reg = XVMIX_LOGOSCALEFACTOR_DATA;
 			if (mixer->max_layers > XVMIX_MAX_OVERLAY_LAYERS)
-				reg_writel(reg, XVMIX_LOGOSCALEFACTOR_DATA +
-					   XVMIX_LOGO_OFFSET, scale);
-			else
-				reg_writel(reg, XVMIX_LOGOSCALEFACTOR_DATA,
-					   scale);
+				reg += XVMIX_LOGO_OFFSET;
+			xlnx_mix_write(mixer, reg, scale);
 			l_data->layer_regs.scale_fact = scale;
 			status = 0;
 		}
@@ -1263,8 +1407,8 @@ static int xlnx_mix_set_layer_scaling(struct xlnx_mix_hw *mixer,
 		if (id < mixer->layer_cnt && l_data->hw_config.can_scale) {
 			offset = id * XVMIX_REG_OFFSET;
 
-			reg_writel(reg, (XVMIX_LAYERSCALE_0_DATA + offset),
-				   scale);
+			xlnx_mix_write(mixer, (XVMIX_LAYERSCALE_0_DATA + offset),
+				       scale);
 			l_data->layer_regs.scale_fact = scale;
 			status = 0;
 		}
@@ -1334,7 +1478,7 @@ static int xlnx_mix_set_layer_alpha(struct xlnx_mix_hw *mixer,
 				reg = XVMIX_LOGOALPHA_DATA + XVMIX_LOGO_OFFSET;
 			else
 				reg = XVMIX_LOGOALPHA_DATA;
-			reg_writel(mixer->base, reg, alpha);
+			xlnx_mix_write(mixer, reg, alpha);
 			layer_data->layer_regs.alpha = alpha;
 			status = 0;
 		}
@@ -1345,7 +1489,7 @@ static int xlnx_mix_set_layer_alpha(struct xlnx_mix_hw *mixer,
 			u32 offset =  layer_id * XVMIX_REG_OFFSET;
 
 			reg = XVMIX_LAYERALPHA_0_DATA;
-			reg_writel(mixer->base, (reg + offset), alpha);
+			xlnx_mix_write(mixer, (reg + offset), alpha);
 			layer_data->layer_regs.alpha = alpha;
 			status = 0;
 		}
@@ -1410,11 +1554,11 @@ static int xlnx_mix_set_layer_buff_addr(struct xlnx_mix_hw *mixer,
 	reg2 = XVMIX_LAYER1_BUF2_V_DATA + offset;
 	layer_data = &mixer->layer_data[id];
 	if (mixer->dma_addr_size == 64 && sizeof(dma_addr_t) == 8) {
-		reg_writeq(mixer->base, reg1, luma_addr);
-		reg_writeq(mixer->base, reg2, chroma_addr);
+		xlnx_mix_writeq(mixer, reg1, luma_addr);
+		xlnx_mix_writeq(mixer, reg2, chroma_addr);
 	} else {
-		reg_writel(mixer->base, reg1, (u32)luma_addr);
-		reg_writel(mixer->base, reg2, (u32)chroma_addr);
+		xlnx_mix_write(mixer, reg1, (u32)luma_addr);
+		xlnx_mix_write(mixer, reg2, (u32)chroma_addr);
 	}
 	layer_data->layer_regs.buff_addr1 = luma_addr;
 	layer_data->layer_regs.buff_addr2 = chroma_addr;
@@ -2268,6 +2412,18 @@ static int xlnx_mix_dt_parse(struct device *dev, struct xlnx_mix *mixer)
 		dev_err(dev, "Failed to map io mem space for mixer\n");
 		return PTR_ERR(mixer_hw->base);
 	}
+	mixer_hw->shadow = devm_kcalloc(dev, XVMIX_SHADOW_REGS,
+					sizeof(*mixer_hw->shadow), GFP_KERNEL);
+	mixer_hw->shadow_valid = devm_kcalloc(dev,
+					      BITS_TO_LONGS(XVMIX_SHADOW_REGS),
+					      sizeof(long), GFP_KERNEL);
+	mixer_hw->shadow_dirty = devm_kcalloc(dev,
+					      BITS_TO_LONGS(XVMIX_SHADOW_REGS),
+					      sizeof(long), GFP_KERNEL);
+	if (!mixer_hw->shadow || !mixer_hw->shadow_valid ||
+	    !mixer_hw->shadow_dirty)
+		return -ENOMEM;
+	spin_lock_init(&mixer_hw->shadow_lock);
 	if (of_device_is_compatible(dev->of_node, "xlnx,mixer-4.0") ||
 	    of_device_is_compatible(dev->of_node, "xlnx,mixer-5.0")) {
 		mixer_hw->max_layers = 18;
@@ -2436,6 +2592,8 @@ static irqreturn_t xlnx_mix_intr_handler(int irq, void *data)
 		return IRQ_NONE;
 	if (mixer->intrpt_handler_fn)
 		mixer->intrpt_handler_fn(mixer->intrpt_data);
+	/* The core is about to sample the registers for the next frame */
+	xlnx_mix_flush(mixer);
 	xlnx_mix_clear_intr_status(mixer, intr);
 
 	return IRQ_HANDLED;
@@ -2572,9 +2730,9 @@ static void xlnx_mix_set_bkg_col(struct xlnx_mix_hw *mixer, u64 rgb_value)
 	u16 r_val = (rgb_value >> 0) &  val_mask;
 
 	/* Set Background Color */
-	reg_writel(mixer->base, XVMIX_BACKGROUND_Y_R_DATA, r_val);
-	reg_writel(mixer->base, XVMIX_BACKGROUND_U_G_DATA, g_val);
-	reg_writel(mixer->base, XVMIX_BACKGROUND_V_B_DATA, b_val);
+	xlnx_mix_write(mixer, XVMIX_BACKGROUND_Y_R_DATA, r_val);
+	xlnx_mix_write(mixer, XVMIX_BACKGROUND_U_G_DATA, g_val);
+	xlnx_mix_write(mixer, XVMIX_BACKGROUND_V_B_DATA, b_val);
 	mixer->bg_color = rgb_value;
 }
 
@@ -2590,6 +2748,7 @@ static void xlnx_mix_reset(struct xlnx_mix *mixer)
 
 	gpiod_set_raw_value(mixer_hw->reset_gpio, 0);
 	gpiod_set_raw_value(mixer_hw->reset_gpio, 1);
+	xlnx_mix_shadow_invalidate(mixer_hw);
 	/* restore layer properties and bg color after reset */
 	xlnx_mix_set_bkg_col(mixer_hw, mixer_hw->bg_color);
 	xlnx_mix_plane_restore(mixer);
@@ -2673,11 +2832,18 @@ static void xlnx_mix_crtc_vblank_handler(void *data)
 	unsigned long flags;
 
 	drm_crtc_handle_vblank(base_crtc);
-	/* Finish page flip */
+	/*
+	 * Finish page flip. Writes of the flip are flushed after this handler
+	 * returns, so the new frame only starts at the done interrupt after.
+	 */
 	spin_lock_irqsave(&drm->event_lock, flags);
 	event = mixer->event;
-	mixer->event = NULL;
+	if (event && !mixer->event_latched) {
+		mixer->event_latched = true;
+		event = NULL;
+	}
 	if (event) {
+		mixer->event = NULL;
 		drm_crtc_send_vblank_event(base_crtc, event);
 		drm_crtc_vblank_put(base_crtc);
 	}
@@ -2804,15 +2970,27 @@ xlnx_mix_crtc_atomic_begin(struct drm_crtc *crtc,
 			   struct drm_crtc_state *old_crtc_state)
 {
 	drm_crtc_vblank_on(crtc);
+}
+
+static void
+xlnx_mix_crtc_atomic_flush(struct drm_crtc *crtc,
+			   struct drm_crtc_state *old_crtc_state)
+{
+	struct xlnx_crtc *xcrtc = to_xlnx_crtc(crtc);
+	struct xlnx_mix *mixer = to_xlnx_mixer(xcrtc);
+	struct drm_device *drm = crtc->dev;
+	unsigned long flags;
+
 	/* Don't rely on vblank when disabling crtc */
 	if (crtc->state->event) {
-		struct xlnx_crtc *xcrtc = to_xlnx_crtc(crtc);
-		struct xlnx_mix *mixer = to_xlnx_mixer(xcrtc);
-
 		/* Consume the flip_done event from atomic helper */
 		crtc->state->event->pipe = drm_crtc_index(crtc);
 		WARN_ON(drm_crtc_vblank_get(crtc) != 0);
+		spin_lock_irqsave(&drm->event_lock, flags);
 		mixer->event = crtc->state->event;
+		mixer->event_latched =
+			!xlnx_mix_flush_pending(&mixer->mixer_hw);
+		spin_unlock_irqrestore(&drm->event_lock, flags);
 		crtc->state->event = NULL;
 	}
 }
@@ -2823,6 +3001,7 @@ static struct drm_crtc_helper_funcs xlnx_mix_crtc_helper_funcs = {
 	.mode_set_nofb	= xlnx_mix_crtc_mode_set_nofb,
 	.atomic_check	= xlnx_mix_crtc_atomic_check,
 	.atomic_begin	= xlnx_mix_crtc_atomic_begin,
+	.atomic_flush	= xlnx_mix_crtc_atomic_flush,
 };
 
 /**
@@ -16,6 +16,7 @@
 #include <drm/drm_fb_cma_helper.h>
 #include <drm/drm_fourcc.h>
 #include <drm/drm_gem_cma_helper.h>
+#include <drm/drm_gem_framebuffer_helper.h>
 #include <linux/component.h>
 #include <linux/device.h>
 #include <linux/dmaengine.h>
@@ -338,6 +339,7 @@ xlnx_pl_disp_plane_atomic_check(struct drm_plane *plane,
 }
 
 static const struct drm_plane_helper_funcs xlnx_pl_disp_plane_helper_funcs = {
+	.prepare_fb = drm_gem_fb_prepare_fb,
 	.atomic_update = xlnx_pl_disp_plane_atomic_update,
 	.atomic_disable = xlnx_pl_disp_plane_atomic_disable,
 	.atomic_check = xlnx_pl_disp_plane_atomic_check,
@@ -363,6 +365,16 @@ static void xlnx_pl_disp_crtc_atomic_begin(struct drm_crtc *crtc,
 					   struct drm_crtc_state *old_state)
 {
 	drm_crtc_vblank_on(crtc);
+}
+
+/*
+ * The event is armed only after the plane update queued the new frame, so
+ * that it is sent by the DMA callback of the new frame and the client can't
+ * reuse a buffer that is still scanned out.
+ */
+static void xlnx_pl_disp_crtc_atomic_flush(struct drm_crtc *crtc,
+					   struct drm_crtc_state *old_state)
+{
 	spin_lock_irq(&crtc->dev->event_lock);
 	if (crtc->state->event) {
 		/* Consume the flip_done event from atomic helper */
@@ -432,6 +444,7 @@ static struct drm_crtc_helper_funcs xlnx_pl_disp_crtc_helper_funcs = {
 	.atomic_disable = xlnx_pl_disp_crtc_atomic_disable,
 	.atomic_check = xlnx_pl_disp_crtc_atomic_check,
 	.atomic_begin = xlnx_pl_disp_crtc_atomic_begin,
+	.atomic_flush = xlnx_pl_disp_crtc_atomic_flush,
 };
 
 static void xlnx_pl_disp_crtc_destroy(struct drm_crtc *crtc)
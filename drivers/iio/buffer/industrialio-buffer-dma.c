@@ -17,6 +17,7 @@
 #include <linux/iio/buffer-dma.h>
 #include <linux/dma-mapping.h>
 #include <linux/sizes.h>
+#include <linux/mm.h>
 
 /*
  * For DMA buffers the storage is sub-divided into so called blocks. Each block
@@ -297,6 +298,10 @@ int iio_dma_buffer_request_update(struct iio_buffer *buffer)
 
 	mutex_lock(&queue->lock);
 
+	/* The application manages the blocks itself */
+	if (queue->num_blocks)
+		goto out_unlock;
+
 	/* Allocations are page aligned */
 	if (PAGE_ALIGN(queue->fileio.block_size) == PAGE_ALIGN(size))
 		try_reuse = true;
@@ -491,6 +496,11 @@ int iio_dma_buffer_read(struct iio_buffer *buffer, size_t n,
 
 	mutex_lock(&queue->lock);
 
+	if (queue->num_blocks) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
 	if (!queue->fileio.active_block) {
 		block = iio_dma_buffer_dequeue(queue);
 		if (block == NULL) {
@@ -598,6 +608,347 @@ int iio_dma_buffer_set_length(struct iio_buffer *buffer, unsigned int length)
 }
 EXPORT_SYMBOL_GPL(iio_dma_buffer_set_length);
 
+/*
+ * Blocks that are still owned by the DMA controller are freed once it hands
+ * them back. Call with queue->lock held.
+ */
+static void iio_dma_buffer_free_fileio_blocks(struct iio_dma_buffer_queue *queue)
+{
+	unsigned int i;
+
+	spin_lock_irq(&queue->list_lock);
+	for (i = 0; i < ARRAY_SIZE(queue->fileio.blocks); i++) {
+		if (!queue->fileio.blocks[i])
+			continue;
+		queue->fileio.blocks[i]->state = IIO_BLOCK_STATE_DEAD;
+	}
+	INIT_LIST_HEAD(&queue->outgoing);
+	spin_unlock_irq(&queue->list_lock);
+
+	INIT_LIST_HEAD(&queue->incoming);
+
+	for (i = 0; i < ARRAY_SIZE(queue->fileio.blocks); i++) {
+		if (!queue->fileio.blocks[i])
+			continue;
+		iio_buffer_block_put(queue->fileio.blocks[i]);
+		queue->fileio.blocks[i] = NULL;
+	}
+	queue->fileio.active_block = NULL;
+}
+
+/*
+ * Same as iio_dma_buffer_free_fileio_blocks() for the mmap blocks. Blocks that
+ * are still mapped are freed once the last mapping goes away.
+ */
+static void iio_dma_buffer_free_mmap_blocks(struct iio_dma_buffer_queue *queue)
+{
+	unsigned int i;
+
+	spin_lock_irq(&queue->list_lock);
+	for (i = 0; i < queue->num_blocks; i++)
+		queue->blocks[i]->state = IIO_BLOCK_STATE_DEAD;
+	INIT_LIST_HEAD(&queue->outgoing);
+	spin_unlock_irq(&queue->list_lock);
+
+	INIT_LIST_HEAD(&queue->incoming);
+
+	for (i = 0; i < queue->num_blocks; i++)
+		iio_buffer_block_put(queue->blocks[i]);
+
+	kfree(queue->blocks);
+	queue->blocks = NULL;
+	queue->num_blocks = 0;
+}
+
+/*
+ * The mmap() offsets of the blocks are 32 bit. These limits keep them well in
+ * range.
+ */
+#define IIO_DMA_BUFFER_MAX_BLOCKS	64
+#define IIO_DMA_BUFFER_MAX_BLOCK_SIZE	SZ_16M
+
+/**
+ * iio_dma_buffer_alloc_blocks() - DMA buffer alloc_blocks callback
+ * @buffer: Buffer to allocate the blocks for
+ * @req: The allocation request
+ *
+ * Replaces the fileio blocks with @req->count blocks that the application
+ * maps with mmap() and exchanges with the queue through
+ * iio_dma_buffer_enqueue_block() and iio_dma_buffer_dequeue_block(). Fewer
+ * blocks than requested may be allocated, @req->count is updated accordingly.
+ *
+ * Should be used as the alloc_blocks callback for iio_buffer_access_ops
+ * struct for DMA buffers.
+ */
+int iio_dma_buffer_alloc_blocks(struct iio_buffer *buffer,
+	struct iio_buffer_block_alloc_req *req)
+{
+	struct iio_dma_buffer_queue *queue = iio_buffer_to_queue(buffer);
+	struct iio_dma_buffer_block **blocks;
+	struct iio_dma_buffer_block *block;
+	unsigned int count;
+	unsigned int i;
+	int ret = 0;
+
+	if (req->type || req->id)
+		return -EINVAL;
+
+	if (!req->size || req->size > IIO_DMA_BUFFER_MAX_BLOCK_SIZE ||
+	    !req->count)
+		return -EINVAL;
+
+	count = min_t(unsigned int, req->count, IIO_DMA_BUFFER_MAX_BLOCKS);
+
+	mutex_lock(&queue->lock);
+
+	if (queue->active || queue->num_blocks) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	blocks = kcalloc(count, sizeof(*blocks), GFP_KERNEL);
+	if (!blocks) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	for (i = 0; i < count; i++) {
+		block = iio_dma_buffer_alloc_block(queue, req->size);
+		if (!block)
+			break;
+		block->id = i;
+		block->offset = i * PAGE_ALIGN(req->size);
+		blocks[i] = block;
+	}
+
+	if (i == 0) {
+		kfree(blocks);
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	iio_dma_buffer_free_fileio_blocks(queue);
+	queue->blocks = blocks;
+	queue->num_blocks = i;
+	req->count = i;
+
+out_unlock:
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(iio_dma_buffer_alloc_blocks);
+
+/**
+ * iio_dma_buffer_free_blocks() - DMA buffer free_blocks callback
+ * @buffer: Buffer to free the blocks for
+ *
+ * Frees the blocks allocated with iio_dma_buffer_alloc_blocks(). The fileio
+ * blocks are allocated again the next time the buffer is enabled.
+ *
+ * Should be used as the free_blocks callback for iio_buffer_access_ops
+ * struct for DMA buffers.
+ */
+int iio_dma_buffer_free_blocks(struct iio_buffer *buffer)
+{
+	struct iio_dma_buffer_queue *queue = iio_buffer_to_queue(buffer);
+	int ret = 0;
+
+	mutex_lock(&queue->lock);
+	if (queue->active)
+		ret = -EBUSY;
+	else
+		iio_dma_buffer_free_mmap_blocks(queue);
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(iio_dma_buffer_free_blocks);
+
+static struct iio_dma_buffer_block *iio_dma_buffer_lookup_block(
+	struct iio_dma_buffer_queue *queue, u32 id)
+{
+	if (id >= queue->num_blocks)
+		return NULL;
+
+	return queue->blocks[id];
+}
+
+static void iio_dma_buffer_fill_block(struct iio_dma_buffer_block *block,
+	struct iio_buffer_block *desc)
+{
+	memset(desc, 0, sizeof(*desc));
+	desc->id = block->id;
+	desc->size = block->size;
+	desc->bytes_used = block->bytes_used;
+	desc->data.offset = block->offset;
+}
+
+/**
+ * iio_dma_buffer_query_block() - DMA buffer query_block callback
+ * @buffer: Buffer the block belongs to
+ * @block: Descriptor of the block. Only the id is used on entry.
+ *
+ * Should be used as the query_block callback for iio_buffer_access_ops
+ * struct for DMA buffers.
+ */
+int iio_dma_buffer_query_block(struct iio_buffer *buffer,
+	struct iio_buffer_block *block)
+{
+	struct iio_dma_buffer_queue *queue = iio_buffer_to_queue(buffer);
+	struct iio_dma_buffer_block *dma_block;
+	int ret = 0;
+
+	mutex_lock(&queue->lock);
+	dma_block = iio_dma_buffer_lookup_block(queue, block->id);
+	if (dma_block)
+		iio_dma_buffer_fill_block(dma_block, block);
+	else
+		ret = -EINVAL;
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(iio_dma_buffer_query_block);
+
+/**
+ * iio_dma_buffer_enqueue_block() - DMA buffer enqueue_block callback
+ * @buffer: Buffer the block belongs to
+ * @block: Descriptor of the block. Only the id is used on entry.
+ *
+ * Hands a block that has been dequeued by the application back to the queue.
+ * If the buffer is enabled the block is submitted to the DMA controller right
+ * away.
+ *
+ * Should be used as the enqueue_block callback for iio_buffer_access_ops
+ * struct for DMA buffers.
+ */
+int iio_dma_buffer_enqueue_block(struct iio_buffer *buffer,
+	struct iio_buffer_block *block)
+{
+	struct iio_dma_buffer_queue *queue = iio_buffer_to_queue(buffer);
+	struct iio_dma_buffer_block *dma_block;
+	int ret = 0;
+
+	mutex_lock(&queue->lock);
+	dma_block = iio_dma_buffer_lookup_block(queue, block->id);
+	if (!dma_block || dma_block->state != IIO_BLOCK_STATE_DEQUEUED) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	iio_dma_buffer_fill_block(dma_block, block);
+	iio_dma_buffer_enqueue(queue, dma_block);
+
+out_unlock:
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(iio_dma_buffer_enqueue_block);
+
+/**
+ * iio_dma_buffer_dequeue_block() - DMA buffer dequeue_block callback
+ * @buffer: Buffer to dequeue the block from
+ * @block: Set to the descriptor of the dequeued block
+ *
+ * Returns -EAGAIN if no block has been completed yet.
+ *
+ * Should be used as the dequeue_block callback for iio_buffer_access_ops
+ * struct for DMA buffers.
+ */
+int iio_dma_buffer_dequeue_block(struct iio_buffer *buffer,
+	struct iio_buffer_block *block)
+{
+	struct iio_dma_buffer_queue *queue = iio_buffer_to_queue(buffer);
+	struct iio_dma_buffer_block *dma_block;
+	int ret = 0;
+
+	mutex_lock(&queue->lock);
+	if (!queue->num_blocks) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	dma_block = iio_dma_buffer_dequeue(queue);
+	if (dma_block)
+		iio_dma_buffer_fill_block(dma_block, block);
+	else
+		ret = -EAGAIN;
+
+out_unlock:
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(iio_dma_buffer_dequeue_block);
+
+/* Each mapping holds a reference to its block */
+static void iio_dma_buffer_vm_open(struct vm_area_struct *vma)
+{
+	iio_buffer_block_get(vma->vm_private_data);
+}
+
+static void iio_dma_buffer_vm_close(struct vm_area_struct *vma)
+{
+	iio_buffer_block_put(vma->vm_private_data);
+}
+
+static const struct vm_operations_struct iio_dma_buffer_vm_ops = {
+	.open = iio_dma_buffer_vm_open,
+	.close = iio_dma_buffer_vm_close,
+};
+
+/**
+ * iio_dma_buffer_mmap() - DMA buffer mmap callback
+ * @buffer: Buffer the block belongs to
+ * @vma: The mapping. The offset must be the one of a block.
+ *
+ * Should be used as the mmap callback for iio_buffer_access_ops struct for
+ * DMA buffers.
+ */
+int iio_dma_buffer_mmap(struct iio_buffer *buffer,
+	struct vm_area_struct *vma)
+{
+	struct iio_dma_buffer_queue *queue = iio_buffer_to_queue(buffer);
+	struct iio_dma_buffer_block *block = NULL;
+	unsigned long offset = vma->vm_pgoff << PAGE_SHIFT;
+	unsigned long size = vma->vm_end - vma->vm_start;
+	unsigned int i;
+	int ret;
+
+	mutex_lock(&queue->lock);
+
+	for (i = 0; i < queue->num_blocks; i++) {
+		if (queue->blocks[i]->offset == offset) {
+			block = queue->blocks[i];
+			break;
+		}
+	}
+
+	if (!block || size > PAGE_ALIGN(block->size)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+
+	/* The offset selects the block, the mapping starts at its beginning */
+	vma->vm_pgoff = 0;
+	vma->vm_flags |= VM_DONTEXPAND | VM_DONTDUMP;
+	vma->vm_private_data = block;
+	vma->vm_ops = &iio_dma_buffer_vm_ops;
+
+	ret = dma_mmap_coherent(queue->dev, vma, block->vaddr,
+		block->phys_addr, size);
+	if (!ret)
+		iio_buffer_block_get(block);
+
+out_unlock:
+	mutex_unlock(&queue->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(iio_dma_buffer_mmap);
+
 /**
  * iio_dma_buffer_init() - Initialize DMA buffer queue
  * @queue: Buffer to initialize
@@ -636,28 +987,10 @@ EXPORT_SYMBOL_GPL(iio_dma_buffer_init);
  */
 void iio_dma_buffer_exit(struct iio_dma_buffer_queue *queue)
 {
-	unsigned int i;
-
 	mutex_lock(&queue->lock);
 
-	spin_lock_irq(&queue->list_lock);
-	for (i = 0; i < ARRAY_SIZE(queue->fileio.blocks); i++) {
-		if (!queue->fileio.blocks[i])
-			continue;
-		queue->fileio.blocks[i]->state = IIO_BLOCK_STATE_DEAD;
-	}
-	INIT_LIST_HEAD(&queue->outgoing);
-	spin_unlock_irq(&queue->list_lock);
-
-	INIT_LIST_HEAD(&queue->incoming);
-
-	for (i = 0; i < ARRAY_SIZE(queue->fileio.blocks); i++) {
-		if (!queue->fileio.blocks[i])
-			continue;
-		iio_buffer_block_put(queue->fileio.blocks[i]);
-		queue->fileio.blocks[i] = NULL;
-	}
-	queue->fileio.active_block = NULL;
+	iio_dma_buffer_free_fileio_blocks(queue);
+	iio_dma_buffer_free_mmap_blocks(queue);
 	queue->ops = NULL;
 
 	mutex_unlock(&queue->lock);
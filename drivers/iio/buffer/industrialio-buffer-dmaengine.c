@@ -12,6 +12,7 @@
 #include <linux/err.h>
 
 #include <linux/iio/iio.h>
+#include <linux/iio/sysfs.h>
 #include <linux/iio/buffer.h>
 #include <linux/iio/buffer_impl.h>
 #include <linux/iio/buffer-dma.h>
@@ -25,8 +26,18 @@
  * this results in a device independent fully functional DMA buffer
  * implementation that can be used by device drivers for peripherals which are
  * connected to a DMA controller which has a DMAengine driver implementation.
+ *
+ * By default each block is a transfer of its own, so the DMA stops whenever
+ * the application is late to hand back a block. If the channel supports it,
+ * the buffer can instead run in cyclic mode (the "cyclic" buffer attribute).
+ * The DMA then fills a private ring of IIO_DMAENGINE_CYCLIC_PERIODS periods
+ * without ever stopping and each completed period is copied into the next
+ * block on the active list. If there is no block at the time, the period is
+ * dropped and counted in "cyclic_overruns".
  */
 
+#define IIO_DMAENGINE_CYCLIC_PERIODS 4
+
 struct dmaengine_buffer {
 	struct iio_dma_buffer_queue queue;
 
@@ -35,6 +46,20 @@ struct dmaengine_buffer {
 
 	size_t align;
 	size_t max_size;
+
+	bool cyclic;
+	bool cyclic_capable;
+	bool cyclic_residue;
+
+	/* Cyclic state, only used while the queue is active */
+	void *ring;
+	dma_addr_t ring_phys;
+	size_t ring_size;
+	size_t period;
+	unsigned int pos;
+	dma_cookie_t cookie;
+	/* Protected by queue.list_lock */
+	unsigned int overruns;
 };
 
 static struct dmaengine_buffer *iio_buffer_to_dmaengine_buffer(
@@ -62,6 +87,14 @@ static int iio_dmaengine_buffer_submit_block(struct iio_dma_buffer_queue *queue,
 	struct dma_async_tx_descriptor *desc;
 	dma_cookie_t cookie;
 
+	/* The block waits for the ring, see iio_dmaengine_buffer_period_done() */
+	if (dmaengine_buffer->cyclic) {
+		spin_lock_irq(&dmaengine_buffer->queue.list_lock);
+		list_add_tail(&block->head, &dmaengine_buffer->active);
+		spin_unlock_irq(&dmaengine_buffer->queue.list_lock);
+		return 0;
+	}
+
 	block->bytes_used = min(block->size, dmaengine_buffer->max_size);
 	block->bytes_used = rounddown(block->bytes_used,
 			dmaengine_buffer->align);
@@ -97,6 +130,197 @@ static void iio_dmaengine_buffer_abort(struct iio_dma_buffer_queue *queue)
 	iio_dma_buffer_block_list_abort(queue, &dmaengine_buffer->active);
 }
 
+static void iio_dmaengine_buffer_fill_block(
+	struct dmaengine_buffer *dmaengine_buffer, unsigned int period)
+{
+	struct iio_dma_buffer_queue *queue = &dmaengine_buffer->queue;
+	struct iio_dma_buffer_block *block;
+	unsigned long flags;
+
+	spin_lock_irqsave(&queue->list_lock, flags);
+	block = list_first_entry_or_null(&dmaengine_buffer->active,
+		struct iio_dma_buffer_block, head);
+	if (block)
+		list_del(&block->head);
+	else
+		dmaengine_buffer->overruns++;
+	spin_unlock_irqrestore(&queue->list_lock, flags);
+
+	if (!block)
+		return;
+
+	block->bytes_used = min(block->size, dmaengine_buffer->period);
+	memcpy(block->vaddr, dmaengine_buffer->ring +
+		period * dmaengine_buffer->period, block->bytes_used);
+	iio_dma_buffer_block_done(block);
+}
+
+static void iio_dmaengine_buffer_period_done(void *data)
+{
+	struct dmaengine_buffer *dmaengine_buffer = data;
+	struct dma_tx_state state;
+	unsigned int cur, n;
+
+	/*
+	 * The callbacks of several periods may be coalesced into one. If the
+	 * channel can tell, take the number of periods from the position of the
+	 * DMA in the ring.
+	 */
+	if (dmaengine_buffer->cyclic_residue) {
+		dmaengine_tx_status(dmaengine_buffer->chan,
+			dmaengine_buffer->cookie, &state);
+		cur = (dmaengine_buffer->ring_size - state.residue) /
+			dmaengine_buffer->period;
+		cur %= IIO_DMAENGINE_CYCLIC_PERIODS;
+		n = (cur + IIO_DMAENGINE_CYCLIC_PERIODS - dmaengine_buffer->pos) %
+			IIO_DMAENGINE_CYCLIC_PERIODS;
+	} else {
+		n = 1;
+	}
+
+	while (n--) {
+		iio_dmaengine_buffer_fill_block(dmaengine_buffer,
+			dmaengine_buffer->pos);
+		dmaengine_buffer->pos = (dmaengine_buffer->pos + 1) %
+			IIO_DMAENGINE_CYCLIC_PERIODS;
+	}
+}
+
+static int iio_dmaengine_buffer_start_cyclic(
+	struct dmaengine_buffer *dmaengine_buffer)
+{
+	struct iio_dma_buffer_queue *queue = &dmaengine_buffer->queue;
+	struct device *dev = dmaengine_buffer->chan->device->dev;
+	struct dma_async_tx_descriptor *desc;
+	size_t period, ring_size;
+	dma_cookie_t cookie;
+
+	/* One period per block */
+	mutex_lock(&queue->lock);
+	if (queue->num_blocks)
+		period = queue->blocks[0]->size;
+	else
+		period = queue->fileio.block_size;
+	mutex_unlock(&queue->lock);
+
+	period = min(period, dmaengine_buffer->max_size);
+	period = rounddown(period, dmaengine_buffer->align);
+	if (!period)
+		return -EINVAL;
+
+	ring_size = period * IIO_DMAENGINE_CYCLIC_PERIODS;
+	if (dmaengine_buffer->ring &&
+	    PAGE_ALIGN(dmaengine_buffer->ring_size) != PAGE_ALIGN(ring_size)) {
+		dma_free_coherent(dev, PAGE_ALIGN(dmaengine_buffer->ring_size),
+			dmaengine_buffer->ring, dmaengine_buffer->ring_phys);
+		dmaengine_buffer->ring = NULL;
+	}
+	if (!dmaengine_buffer->ring) {
+		dmaengine_buffer->ring = dma_alloc_coherent(dev,
+			PAGE_ALIGN(ring_size), &dmaengine_buffer->ring_phys,
+			GFP_KERNEL);
+		if (!dmaengine_buffer->ring)
+			return -ENOMEM;
+	}
+	dmaengine_buffer->ring_size = ring_size;
+	dmaengine_buffer->period = period;
+	dmaengine_buffer->pos = 0;
+
+	desc = dmaengine_prep_dma_cyclic(dmaengine_buffer->chan,
+		dmaengine_buffer->ring_phys, ring_size, period, DMA_DEV_TO_MEM,
+		DMA_PREP_INTERRUPT);
+	if (!desc)
+		return -ENOMEM;
+
+	desc->callback = iio_dmaengine_buffer_period_done;
+	desc->callback_param = dmaengine_buffer;
+
+	cookie = dmaengine_submit(desc);
+	if (dma_submit_error(cookie))
+		return dma_submit_error(cookie);
+	dmaengine_buffer->cookie = cookie;
+
+	dma_async_issue_pending(dmaengine_buffer->chan);
+
+	return 0;
+}
+
+static int iio_dmaengine_buffer_enable(struct iio_buffer *buf,
+	struct iio_dev *indio_dev)
+{
+	struct dmaengine_buffer *dmaengine_buffer =
+		iio_buffer_to_dmaengine_buffer(buf);
+	int ret;
+
+	ret = iio_dma_buffer_enable(buf, indio_dev);
+	if (ret || !dmaengine_buffer->cyclic)
+		return ret;
+
+	ret = iio_dmaengine_buffer_start_cyclic(dmaengine_buffer);
+	if (ret)
+		iio_dma_buffer_disable(buf, indio_dev);
+
+	return ret;
+}
+
+static ssize_t iio_dmaengine_buffer_get_cyclic(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct dmaengine_buffer *dmaengine_buffer =
+		iio_buffer_to_dmaengine_buffer(indio_dev->buffer);
+
+	return sprintf(buf, "%d\n", dmaengine_buffer->cyclic);
+}
+
+static ssize_t iio_dmaengine_buffer_set_cyclic(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t len)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct dmaengine_buffer *dmaengine_buffer =
+		iio_buffer_to_dmaengine_buffer(indio_dev->buffer);
+	struct iio_dma_buffer_queue *queue = &dmaengine_buffer->queue;
+	bool cyclic;
+	int ret;
+
+	ret = strtobool(buf, &cyclic);
+	if (ret < 0)
+		return ret;
+
+	if (cyclic && !dmaengine_buffer->cyclic_capable)
+		return -EOPNOTSUPP;
+
+	mutex_lock(&queue->lock);
+	if (queue->active)
+		ret = -EBUSY;
+	else
+		dmaengine_buffer->cyclic = cyclic;
+	mutex_unlock(&queue->lock);
+
+	return ret ? ret : len;
+}
+
+static ssize_t iio_dmaengine_buffer_get_cyclic_overruns(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct iio_dev *indio_dev = dev_to_iio_dev(dev);
+	struct dmaengine_buffer *dmaengine_buffer =
+		iio_buffer_to_dmaengine_buffer(indio_dev->buffer);
+
+	return sprintf(buf, "%u\n", READ_ONCE(dmaengine_buffer->overruns));
+}
+
+static IIO_DEVICE_ATTR(cyclic, 0644, iio_dmaengine_buffer_get_cyclic,
+	iio_dmaengine_buffer_set_cyclic, 0);
+static IIO_DEVICE_ATTR(cyclic_overruns, 0444,
+	iio_dmaengine_buffer_get_cyclic_overruns, NULL, 0);
+
+static const struct attribute *iio_dmaengine_buffer_attrs[] = {
+	&iio_dev_attr_cyclic.dev_attr.attr,
+	&iio_dev_attr_cyclic_overruns.dev_attr.attr,
+	NULL,
+};
+
 static void iio_dmaengine_buffer_release(struct iio_buffer *buf)
 {
 	struct dmaengine_buffer *dmaengine_buffer =
@@ -111,10 +335,16 @@ static const struct iio_buffer_access_funcs iio_dmaengine_buffer_ops = {
 	.set_bytes_per_datum = iio_dma_buffer_set_bytes_per_datum,
 	.set_length = iio_dma_buffer_set_length,
 	.request_update = iio_dma_buffer_request_update,
-	.enable = iio_dma_buffer_enable,
+	.enable = iio_dmaengine_buffer_enable,
 	.disable = iio_dma_buffer_disable,
 	.data_available = iio_dma_buffer_data_available,
 	.release = iio_dmaengine_buffer_release,
+	.alloc_blocks = iio_dma_buffer_alloc_blocks,
+	.free_blocks = iio_dma_buffer_free_blocks,
+	.query_block = iio_dma_buffer_query_block,
+	.enqueue_block = iio_dma_buffer_enqueue_block,
+	.dequeue_block = iio_dma_buffer_dequeue_block,
+	.mmap = iio_dma_buffer_mmap,
 
 	.modes = INDIO_BUFFER_HARDWARE,
 	.flags = INDIO_BUFFER_FLAG_FIXED_WATERMARK,
@@ -175,11 +405,17 @@ struct iio_buffer *iio_dmaengine_buffer_alloc(struct device *dev,
 	dmaengine_buffer->chan = chan;
 	dmaengine_buffer->align = width;
 	dmaengine_buffer->max_size = dma_get_max_seg_size(chan->device->dev);
+	dmaengine_buffer->cyclic_capable = dma_has_cap(DMA_CYCLIC,
+		chan->device->cap_mask);
+	dmaengine_buffer->cyclic_residue = caps.residue_granularity !=
+		DMA_RESIDUE_GRANULARITY_DESCRIPTOR;
 
 	iio_dma_buffer_init(&dmaengine_buffer->queue, chan->device->dev,
 		&iio_dmaengine_default_ops);
 
 	dmaengine_buffer->queue.buffer.access = &iio_dmaengine_buffer_ops;
+	iio_buffer_set_attrs(&dmaengine_buffer->queue.buffer,
+		iio_dmaengine_buffer_attrs);
 
 	return &dmaengine_buffer->queue.buffer;
 
@@ -201,6 +437,10 @@ void iio_dmaengine_buffer_free(struct iio_buffer *buffer)
 		iio_buffer_to_dmaengine_buffer(buffer);
 
 	iio_dma_buffer_exit(&dmaengine_buffer->queue);
+	if (dmaengine_buffer->ring)
+		dma_free_coherent(dmaengine_buffer->chan->device->dev,
+			PAGE_ALIGN(dmaengine_buffer->ring_size),
+			dmaengine_buffer->ring, dmaengine_buffer->ring_phys);
 	dma_release_channel(dmaengine_buffer->chan);
 
 	iio_buffer_put(buffer);
@@ -98,6 +98,14 @@ static int iio_store_to_kfifo(struct iio_buffer *r,
 	return 0;
 }
 
+static int iio_store_n_to_kfifo(struct iio_buffer *r,
+				const void *data, unsigned int n)
+{
+	struct iio_kfifo *kf = iio_to_kfifo(r);
+
+	return kfifo_in(&kf->kf, data, n);
+}
+
 static int iio_read_first_n_kfifo(struct iio_buffer *r,
 			   size_t n, char __user *buf)
 {
@@ -141,6 +149,7 @@ static void iio_kfifo_buffer_release(struct iio_buffer *buffer)
 
 static const struct iio_buffer_access_funcs kfifo_access_funcs = {
 	.store_to = &iio_store_to_kfifo,
+	.store_n_to = &iio_store_n_to_kfifo,
 	.read_first_n = &iio_read_first_n_kfifo,
 	.data_available = iio_kfifo_buf_data_available,
 	.request_update = &iio_request_update_kfifo,
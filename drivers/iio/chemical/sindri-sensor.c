@@ -35,7 +35,27 @@
 #define SINDRI_REG_COND_CAL_OFFSET 0x04
 #define SINDRI_REG_COND_CAL_GAIN 0x06
 #define SINDRI_REG_COND 0x0a
-
+/* Burst-capable firmware only (see SINDRI_FW_VERSION_FIFO) */
+#define SINDRI_REG_FIFO_WATERMARK 0x0c
+#define SINDRI_REG_FIFO_LEVEL 0x0d
+#define SINDRI_REG_FIFO_DATA 0x0e
+
+/* First firmware version that buffers readings on the sensor */
+#define SINDRI_FW_VERSION_FIFO 2
+/* Readings that the sensor can buffer */
+#define SINDRI_FIFO_LENGTH 32
+
+/* Calibration: processed = (raw - offset) * gain / SINDRI_CAL_GAIN_ONE */
+#define SINDRI_CAL_GAIN_SHIFT 15
+#define SINDRI_CAL_GAIN_ONE (1 << SINDRI_CAL_GAIN_SHIFT)
+
+
+// Elements need to be aligned to their own length.
+struct sindri_scan {
+	__be16 cond;
+	s32 processed;
+	s64 timestamp;
+};
 
 struct sindri_data {
 	struct i2c_client *client;
@@ -50,9 +70,25 @@ struct sindri_data {
 	int calibration_offset;
 	int calibration_gain;
 
+	// Direct mode: The buffer is enabled without a trigger. The IRQ
+	// thread reads and pushes each sample itself.
+	bool direct;
+	// Time of the latest interrupt (captured in the hard IRQ handler)
+	s64 timestamp;
+
+	// Burst mode (direct mode with fifo_batch > 1)
+	bool fifo_supported;
+	unsigned int watermark;
+	unsigned int fifo_batch;
+	s64 fifo_timestamp;
+	s64 fifo_period;
+	// The level followed by up to SINDRI_FIFO_LENGTH readings
+	u8 fifo[1 + SINDRI_FIFO_LENGTH * sizeof(__be16)];
+
 	// A single datapoint
-	// Elements need to be aligned to their own length.
-	__be16 buffer[8]; /* 2 bytes conductivity + 6 bytes pad + 8 bytes timestamp */
+	struct sindri_scan scan;
+	// Burst mode: The scans of a batch, indio_dev->scan_bytes apart
+	struct sindri_scan batch[SINDRI_FIFO_LENGTH];
 };
 
 static const struct regmap_config sindri_regmap_config = {
@@ -98,9 +134,28 @@ static const struct iio_chan_spec sindri_channels[] = {
 			.endianness = IIO_BE,
 		},
 	},
-	IIO_CHAN_SOFT_TIMESTAMP(1),
+	// Calibrated in the kernel (see sindri_calibrate)
+	{
+		.type = IIO_ELECTRICALCONDUCTIVITY,
+		.address = SINDRI_REG_COND,
+		.extend_name = "processed",
+		.info_mask_separate =
+			BIT(IIO_CHAN_INFO_PROCESSED),
+		.scan_index = 1,
+		.scan_type = {
+			.sign = 's',
+			.realbits = 32,
+			.storagebits = 32,
+			.endianness = IIO_CPU,
+		},
+	},
+	IIO_CHAN_SOFT_TIMESTAMP(2),
 };
 
+// The scan always holds both channels. The IIO core picks out the
+// enabled ones.
+static const unsigned long sindri_scan_masks[] = { 0x3, 0 };
+
 
 struct sindri_device {
 	const struct iio_chan_spec *channels;
@@ -118,11 +173,63 @@ static struct sindri_device sindri_devices[] = {
 	},
 };
 
+// Let the sensor buffer 'batch' readings before it interrupts.
+// Zero (or one) gives an interrupt per reading.
+static int sindri_fifo_set_batch(struct sindri_data *data, unsigned int batch)
+{
+	u8 val = batch;
+	int ret;
+
+	if (!data->fifo_supported)
+		return 0;
+
+	if (batch <= 1)
+		val = batch = 0;
+
+	ret = regmap_bulk_write(data->regmap, SINDRI_REG_FIFO_WATERMARK,
+			       &val, sindri_reg_size(SINDRI_REG_FIFO_WATERMARK));
+	if (ret)
+		return ret;
+
+	data->fifo_batch = batch;
+	data->fifo_timestamp = 0;
+	data->fifo_period = 0;
+	return 0;
+}
+
+// Fixed-point calibration of a raw reading. Without a valid
+// calibration, the processed value equals the raw value.
+static s32 sindri_calibrate(struct sindri_data *data, u16 raw)
+{
+	s64 val;
+
+	if (!data->calibration_valid)
+		return raw;
+
+	val = ((s64)raw - data->calibration_offset) * data->calibration_gain;
+	return (s32)div_s64(val, SINDRI_CAL_GAIN_ONE);
+}
+
+static void sindri_fill_scan(struct sindri_data *data)
+{
+	data->scan.processed = sindri_calibrate(data,
+						be16_to_cpu(data->scan.cond));
+}
+
 static int sindri_buffer_postenable(struct iio_dev *indio_dev)
 {
 	struct sindri_data *data = iio_priv(indio_dev);
 	int ret;
 
+	// No trigger assigned: Skip the trigger and push from the IRQ thread
+	if (indio_dev->currentmode == INDIO_BUFFER_SOFTWARE) {
+		ret = sindri_fifo_set_batch(data, data->watermark);
+		if (ret)
+			return ret;
+		WRITE_ONCE(data->direct, true);
+		return 0;
+	}
+
 	ret = iio_triggered_buffer_postenable(indio_dev);
 	return ret;
 }
@@ -132,6 +239,14 @@ static int sindri_buffer_predisable(struct iio_dev *indio_dev)
 	struct sindri_data *data = iio_priv(indio_dev);
 	int ret;
 
+	if (data->direct) {
+		WRITE_ONCE(data->direct, false);
+		// Wait for a running IRQ thread to finish its push
+		if (data->interrupt_enabled)
+			synchronize_irq(data->client->irq);
+		return sindri_fifo_set_batch(data, 0);
+	}
+
 	ret = iio_triggered_buffer_predisable(indio_dev);
 	return ret;
 }
@@ -161,12 +276,14 @@ static irqreturn_t sindri_trigger_handler(int irq, void *private)
 	int ret;
 	
 	ret = regmap_bulk_read(data->regmap, data->chip->data_reg,
-			      &data->buffer, sindri_reg_size(data->chip->data_reg));
+			      &data->scan.cond, sindri_reg_size(data->chip->data_reg));
 
 	
-	if (!ret)
-		iio_push_to_buffers_with_timestamp(indio_dev, data->buffer,
+	if (!ret) {
+		sindri_fill_scan(data);
+		iio_push_to_buffers_with_timestamp(indio_dev, &data->scan,
 				pf->timestamp);
+	}
 
 	iio_trigger_notify_done(indio_dev->trig);
 
@@ -179,11 +296,84 @@ static irqreturn_t sindri_interrupt_handler(int irq, void *private)
 	struct iio_dev *indio_dev = private;
 	struct sindri_data *data = iio_priv(indio_dev);
 
+	data->timestamp = iio_get_time_ns(indio_dev);
+
+	if (READ_ONCE(data->direct))
+		return IRQ_WAKE_THREAD;
+
 	irq_work_queue(&data->work);
 
 	return IRQ_HANDLED;
 }
 
+// Burst mode: Read the level and a batch of readings in a single block
+// transfer. The interrupt timestamp belongs to the last reading. The
+// timestamps of the others are interpolated from the previous batch.
+static void sindri_fifo_push(struct iio_dev *indio_dev)
+{
+	struct sindri_data *data = iio_priv(indio_dev);
+	unsigned int count;
+	unsigned int i;
+	s64 timestamp = data->timestamp;
+	int ret;
+
+	ret = regmap_bulk_read(data->regmap, SINDRI_REG_FIFO_LEVEL, data->fifo,
+			      1 + data->fifo_batch * sizeof(__be16));
+	if (ret)
+		return;
+
+	count = min_t(unsigned int, data->fifo[0], data->fifo_batch);
+	if (!count)
+		return;
+
+	// The first batch has nothing to interpolate from. Reuse the
+	// period of the previous buffer session (zero at first).
+	if (data->fifo_timestamp)
+		data->fifo_period = div_s64(timestamp - data->fifo_timestamp,
+					    count);
+	data->fifo_timestamp = timestamp;
+
+	// Push the whole batch at once, so that readers wake up only once
+	for (i = 0; i < count; i++) {
+		memcpy(&data->scan.cond, &data->fifo[1 + i * sizeof(__be16)],
+		       sizeof(__be16));
+		sindri_fill_scan(data);
+		iio_scan_set_timestamp(indio_dev, &data->scan,
+				timestamp - (count - 1 - i) * data->fifo_period);
+		memcpy((u8 *)data->batch + i * indio_dev->scan_bytes,
+		       &data->scan, indio_dev->scan_bytes);
+	}
+	iio_push_to_buffers_n(indio_dev, data->batch, count);
+}
+
+// Direct mode: A single block read of the measurement, pushed straight to
+// the buffer with the timestamp of the hard IRQ.
+static irqreturn_t sindri_interrupt_thread(int irq, void *private)
+{
+	struct iio_dev *indio_dev = private;
+	struct sindri_data *data = iio_priv(indio_dev);
+	int ret;
+
+	if (!READ_ONCE(data->direct))
+		return IRQ_HANDLED;
+
+	if (data->fifo_batch) {
+		sindri_fifo_push(indio_dev);
+		return IRQ_HANDLED;
+	}
+
+	ret = regmap_bulk_read(data->regmap, data->chip->data_reg,
+			      &data->scan.cond, sindri_reg_size(data->chip->data_reg));
+
+	if (!ret) {
+		sindri_fill_scan(data);
+		iio_push_to_buffers_with_timestamp(indio_dev, &data->scan,
+				data->timestamp);
+	}
+
+	return IRQ_HANDLED;
+}
+
 static int sindri_read_measurement(struct sindri_data *data, int reg, __be32 *val)
 {
 	struct device *dev = &data->client->dev;
@@ -221,6 +411,19 @@ static int sindri_read_raw(struct iio_dev *indio_dev,
 		}
 		return -EINVAL;
 	}
+	case IIO_CHAN_INFO_PROCESSED: {
+		int ret;
+		__be16 long_reg;
+
+		ret = regmap_bulk_read(data->regmap, chan->address,
+				       &long_reg, sindri_reg_size(chan->address));
+		if (ret)
+			return ret;
+		*val = sindri_calibrate(data, be16_to_cpu(long_reg));
+		return IIO_VAL_INT;
+	}
+	default:
+		return -EINVAL;
 	}
 }
 
@@ -329,6 +532,33 @@ static ssize_t sindri_calibration_valid_show(struct device *dev,
 	return sprintf(buf, "%d\n", val);
 }
 
+// Cache the calibration for sindri_calibrate
+static int sindri_calibration_acquire(struct sindri_data *data)
+{
+	char valid;
+	__be16 val;
+	int ret;
+
+	ret = regmap_bulk_read(data->regmap, SINDRI_REG_COND_CAL_VALID,
+					       &valid, sindri_reg_size(SINDRI_REG_COND_CAL_VALID));
+	if (ret)
+		return ret;
+	data->calibration_valid = valid;
+
+	ret = regmap_bulk_read(data->regmap, SINDRI_REG_COND_CAL_OFFSET,
+					       &val, sindri_reg_size(SINDRI_REG_COND_CAL_OFFSET));
+	if (ret)
+		return ret;
+	data->calibration_offset = (s16)be16_to_cpu(val);
+
+	ret = regmap_bulk_read(data->regmap, SINDRI_REG_COND_CAL_GAIN,
+					       &val, sindri_reg_size(SINDRI_REG_COND_CAL_GAIN));
+	if (ret)
+		return ret;
+	data->calibration_gain = be16_to_cpu(val);
+	return 0;
+}
+
 static IIO_DEVICE_ATTR(calibration_valid, S_IRUGO,
 	sindri_calibration_valid_show, NULL, SINDRI_REG_COND_CAL_VALID);
 
@@ -371,7 +601,9 @@ static ssize_t sindri_calibration_offset_store(struct device *dev,
 	__be16 nval = cpu_to_be16(val);
 	ret = regmap_bulk_write(data->regmap, SINDRI_REG_COND_CAL_OFFSET,
 					       &nval, sindri_reg_size(SINDRI_REG_COND_CAL_OFFSET));
-	
+	if (ret)
+		return ret;
+	data->calibration_offset = (s16)be16_to_cpu(nval);
 
 	return len;
 }
@@ -410,7 +642,9 @@ static ssize_t sindri_calibration_gain_store(struct device *dev,
 	__be16 nval = cpu_to_be16(val);
 	ret = regmap_bulk_write(data->regmap, SINDRI_REG_COND_CAL_GAIN,
 					       &nval, sindri_reg_size(SINDRI_REG_COND_CAL_GAIN));
-	
+	if (ret)
+		return ret;
+	data->calibration_gain = be16_to_cpu(nval);
 
 	return len;
 }
@@ -438,6 +672,55 @@ static const struct iio_info sindri_info = {
 	.read_raw = &sindri_read_raw,
 };
 
+// HW FIFO (burst mode)
+// Modelled after accel/bmc150-accel-core.c
+static ssize_t sindri_hwfifo_watermark_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct sindri_data *data = iio_priv(dev_to_iio_dev(dev));
+	return sprintf(buf, "%u\n", data->watermark);
+}
+
+static ssize_t sindri_hwfifo_enabled_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct sindri_data *data = iio_priv(dev_to_iio_dev(dev));
+	return sprintf(buf, "%d\n", data->fifo_batch ? 1 : 0);
+}
+
+static IIO_CONST_ATTR(hwfifo_watermark_min, "1");
+static IIO_CONST_ATTR(hwfifo_watermark_max, __stringify(SINDRI_FIFO_LENGTH));
+static IIO_DEVICE_ATTR(hwfifo_enabled, S_IRUGO,
+	sindri_hwfifo_enabled_show, NULL, 0);
+static IIO_DEVICE_ATTR(hwfifo_watermark, S_IRUGO,
+	sindri_hwfifo_watermark_show, NULL, 0);
+
+static const struct attribute *sindri_fifo_attributes[] = {
+	&iio_const_attr_hwfifo_watermark_min.dev_attr.attr,
+	&iio_const_attr_hwfifo_watermark_max.dev_attr.attr,
+	&iio_dev_attr_hwfifo_watermark.dev_attr.attr,
+	&iio_dev_attr_hwfifo_enabled.dev_attr.attr,
+	NULL,
+};
+
+// Called by the IIO core (with the buffer watermark) just before
+// postenable.
+static int sindri_set_watermark(struct iio_dev *indio_dev, unsigned val)
+{
+	struct sindri_data *data = iio_priv(indio_dev);
+
+	data->watermark = clamp_t(unsigned int, val, 1, SINDRI_FIFO_LENGTH);
+	return 0;
+}
+
+static const struct iio_info sindri_info_fifo = {
+	.attrs = &sindri_attribute_group,
+	.read_raw = &sindri_read_raw,
+	.hwfifo_set_watermark = sindri_set_watermark,
+};
+
 static const struct i2c_device_id sindri_id[] = {
 	{ "sindri", 0},
 	{}
@@ -474,6 +757,7 @@ static int sindri_probe(struct i2c_client *client,
 	indio_dev->name = SINDRI_DRV_NAME;
 	indio_dev->channels = chip->channels;
 	indio_dev->num_channels = chip->num_channels;
+	indio_dev->available_scan_masks = sindri_scan_masks;
 	indio_dev->modes = INDIO_BUFFER_SOFTWARE;
 
 	trig = devm_iio_trigger_alloc(&client->dev, "%s",
@@ -513,13 +797,33 @@ static int sindri_probe(struct i2c_client *client,
 
 	init_irq_work(&data->work, sindri_work_handler);
 
+	// Acquire constant values
+	data->hw_version = sindri_hw_version_acquire(data);
+	data->fw_version = sindri_fw_version_acquire(data);
+	ret = sindri_calibration_acquire(data);
+	if (ret)
+		dev_warn(&client->dev, "cannot read calibration\n");
+
+	// Burst mode
+	data->watermark = 1;
+	if (data->fw_version >= SINDRI_FW_VERSION_FIFO) {
+		data->fifo_supported = true;
+		indio_dev->info = &sindri_info_fifo;
+		iio_buffer_set_attrs(indio_dev->buffer, sindri_fifo_attributes);
+		ret = sindri_fifo_set_batch(data, 0);
+		if (ret) {
+			dev_err(&client->dev, "cannot disable burst mode\n");
+			goto unregister_buffer;
+		}
+	}
+
 	if (client->irq <= 0) {
 		dev_err(&client->dev, "no valid irq defined\n");
 		goto unregister_trigger;
 	}
 	/* interrupt pin rises when new measurement is ready */
 	ret = devm_request_threaded_irq(&client->dev, client->irq,
-			NULL, sindri_interrupt_handler,
+			sindri_interrupt_handler, sindri_interrupt_thread,
 			IRQF_TRIGGER_RISING | IRQF_ONESHOT,
 			"sindri-interrupt",
 			indio_dev);
@@ -536,13 +840,6 @@ static int sindri_probe(struct i2c_client *client,
 		goto unregister_buffer;
 	}
 
-	// Acquire constant values
-	data->hw_version = sindri_hw_version_acquire(data);
-	data->fw_version = sindri_fw_version_acquire(data);
-	//data->calibration_valid = sindri_calibration_valid_acquire(data);
-	//data->calibration_offset = sindri_calibration_offset_acquire(data);
-	//data->calibration_gain = sindri_calibration_gain_acquire(data);
-
 	// Testing interface
 	//uint8_t reg;
 	//int retval;
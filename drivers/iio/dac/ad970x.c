@@ -3,8 +3,11 @@
  * Copyright (C) 2019 Frederik Peter Aalund <fpa@sbtinstruments.com>
  */
 #include <linux/clk.h>
+#include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/iio/iio.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/spi/spi.h>
 #include <linux/of.h>
 #include <linux/pm.h>
@@ -40,6 +43,11 @@
 #define AD970X_CALCLK_TARGET_RATE 10000000 /* 10 MHz */
 #define AD970X_CALCLK_CAL_CYCLES  4500 /* as per the data sheet */
 
+/* Waveform constants */
+#define AD970X_WAVE_MAX_SIZE (256 * 1024)
+/* One sample (16 bit) of each channel */
+#define AD970X_WAVE_ALIGN    4
+
 /* Utility */
 #define AD970X_TO_VALUE(enabled) ((enabled) ? 0xFF : 0x0)
 
@@ -61,10 +69,25 @@ enum ad970x_calmem {
 	AD970X_USER_INPUT       = 0x3,
 };
 
-struct ad970x {
-	struct regmap *regmap;
-	struct clk *clk;
-	struct regulator *vdd;
+/*
+ * Waveform output
+ *
+ * If the device tree gives a "tx" DMA channel (e.g., a Xilinx AXI DMA
+ * that feeds the DAC data path in the PL), we can play a waveform at the
+ * full DAC rate. Write the raw samples (as the PL expects them) to the
+ * "waveform" attribute of the SPI device. A write at offset zero starts a
+ * new waveform. Then write 1 to "waveform_enable". The DMA channel loops
+ * over the waveform (cyclic transfer) until "waveform_enable" is set to 0.
+ * The DAC stays powered up while the waveform plays.
+ */
+struct ad970x_wave {
+	struct dma_chan *tx;
+	void *buf;
+	dma_addr_t buf_dma;
+	/* Protects the members below */
+	struct mutex lock;
+	size_t size;
+	bool running;
 };
 
 struct ad970x_state {
@@ -75,6 +98,18 @@ struct ad970x_state {
 	bool twos_complement;
 };
 
+struct ad970x {
+	struct device *dev;
+	struct regmap *regmap;
+	struct clk *clk;
+	struct regulator *vdd;
+	struct ad970x_wave wave;
+	/* The applied state (restored on resume) */
+	struct ad970x_state state;
+	/* Clock rate of the latest calibration. Zero if not calibrated. */
+	unsigned long cal_clk_rate;
+};
+
 static struct ad970x_state ad970x_default_state = {
 	.calibrate_on_init = false,
 	.clkdiff = false,
@@ -317,20 +352,41 @@ static int ad970x_calibrate(struct device *dev)
 		return -EFAULT;
 	}
 
+	ad970x->cal_clk_rate = clk_rate;
 	dev_dbg(dev, "Calibration completed successfully.\n");
 	return 0;
 }
 
-static int ad970x_apply_state(struct device *dev, struct ad970x_state *state)
+/*
+ * Is the calibration in the device still good? The calibration memory
+ * must hold a self calibration and the clock must be the same as during
+ * said calibration.
+ */
+static bool ad970x_calibration_valid(struct device *dev)
 {
 	struct ad970x *ad970x = dev_get_drvdata(dev);
-	struct spi_device *spi = container_of(dev, struct spi_device, dev);
+	enum ad970x_calmem calmem;
 	int error;
-	error = ad970x_reset(ad970x);
+	if (0 == ad970x->cal_clk_rate) {
+		return false;
+	}
+	if (clk_get_rate(ad970x->clk) != ad970x->cal_clk_rate) {
+		dev_dbg(dev, "Clock rate changed since the calibration.\n");
+		return false;
+	}
+	error = ad970x_get_calmem(ad970x, &calmem);
 	if (error) {
-		dev_err(dev, "Failed to reset: %d\n", error);
-		return error;
+		return false;
 	}
+	return AD970X_SELF_CALIBRATION == calmem;
+}
+
+static int ad970x_write_state(struct device *dev, struct ad970x_state *state,
+                              bool reuse_cal)
+{
+	struct ad970x *ad970x = dev_get_drvdata(dev);
+	struct spi_device *spi = container_of(dev, struct spi_device, dev);
+	int error;
 	if (spi->mode & SPI_3WIRE) {
 		dev_dbg(dev, "Using 3-wire SPI mode.\n");
 	} else {
@@ -361,7 +417,8 @@ static int ad970x_apply_state(struct device *dev, struct ad970x_state *state)
 		dev_err(dev, "Failed to enable two's complement mode: %d.\n", error);
 		return error;
 	}
-	if (state->calibrate_on_init) {
+	/* Reuse the calibration if we can (see 'ad970x_restore_state') */
+	if (state->calibrate_on_init && !(reuse_cal && ad970x_calibration_valid(dev))) {
 		error = ad970x_calibrate(dev);
 		if (error) {
 			dev_err(dev, "Failed to calibrate: %d\n", error);
@@ -375,10 +432,40 @@ static int ad970x_apply_state(struct device *dev, struct ad970x_state *state)
 			return error;
 		}
 	}
+	ad970x->state = *state;
+	return 0;
+}
+
+static int ad970x_apply_state(struct device *dev, struct ad970x_state *state)
+{
+	struct ad970x *ad970x = dev_get_drvdata(dev);
+	int error;
+	error = ad970x_reset(ad970x);
+	if (error) {
+		dev_err(dev, "Failed to reset: %d\n", error);
+		return error;
+	}
+	/* The reset clears the calibration memory */
+	ad970x->cal_clk_rate = 0;
+	error = ad970x_write_state(dev, state, false);
+	if (error) {
+		return error;
+	}
 	dev_dbg(dev, "Init completed successfully.\n");
 	return 0;
 }
 
+/*
+ * Minimal restore on resume: Write the configuration registers again and
+ * only calibrate if the calibration memory no longer holds a valid
+ * calibration (e.g., if the supply was cut) or the clock changed. No reset.
+ */
+static int ad970x_restore_state(struct device *dev)
+{
+	struct ad970x *ad970x = dev_get_drvdata(dev);
+	return ad970x_write_state(dev, &ad970x->state, true);
+}
+
 static int ad970x_of_get_state(struct device *dev, struct ad970x_state *state)
 {
 	int error = 0;
@@ -455,6 +542,38 @@ static ssize_t ad970x_write_powerdown(struct iio_dev *indio_dev,
 	return len;
 }
 
+static ssize_t ad970x_write_recalibrate(struct iio_dev *indio_dev,
+                                        uintptr_t private,
+                                        const struct iio_chan_spec *chan,
+                                        const char *buf, size_t len)
+{
+	struct device *dev = indio_dev->dev.parent;
+	struct ad970x *ad970x = dev_get_drvdata(dev);
+	bool recalibrate;
+	int error;
+	error = strtobool(buf, &recalibrate);
+	if (error) {
+		return error;
+	}
+	if (!recalibrate) {
+		return len;
+	}
+	error = pm_runtime_get_sync(dev);
+	if (error < 0) {
+		pm_runtime_put_noidle(dev);
+		return error;
+	}
+	error = ad970x_calibrate(dev);
+	pm_runtime_put(dev);
+	if (error) {
+		dev_err(dev, "Failed to calibrate: %d\n", error);
+		return error;
+	}
+	/* Keep using the calibration from now on (also after resume) */
+	ad970x->state.calibrate_on_init = true;
+	return len;
+}
+
 /* Inspired by the powerdown channel of:
  * drivers/iio/dac/ad5758.c
  */
@@ -464,6 +583,13 @@ static const struct iio_chan_spec_ext_info ad970x_ext_info[] = {
 		.write = ad970x_write_powerdown,
 		.shared = IIO_SHARED_BY_ALL,
 	},
+	/* Calibrate again (e.g., after a change of temperature). Otherwise,
+	 * we reuse the calibration across runtime suspend/resume. */
+	{
+		.name = "recalibrate",
+		.write = ad970x_write_recalibrate,
+		.shared = IIO_SHARED_BY_ALL,
+	},
 	{ },
 };
 
@@ -490,6 +616,178 @@ static const struct iio_info ad970x_info = {
 	.read_raw = ad970x_read_raw,
 };
 
+static int ad970x_wave_start(struct ad970x *ad970x)
+{
+	struct ad970x_wave *wave = &ad970x->wave;
+	struct dma_async_tx_descriptor *desc;
+	dma_cookie_t cookie;
+	int error;
+	if (wave->running) {
+		return 0;
+	}
+	if (0 == wave->size) {
+		return -EINVAL;
+	}
+	error = pm_runtime_get_sync(ad970x->dev);
+	if (error < 0) {
+		pm_runtime_put_noidle(ad970x->dev);
+		return error;
+	}
+	desc = dmaengine_prep_dma_cyclic(wave->tx, wave->buf_dma, wave->size,
+	                                 wave->size, DMA_MEM_TO_DEV, 0);
+	if (NULL == desc) {
+		error = -ENOMEM;
+		goto out_pm;
+	}
+	cookie = dmaengine_submit(desc);
+	error = dma_submit_error(cookie);
+	if (error) {
+		goto out_pm;
+	}
+	dma_async_issue_pending(wave->tx);
+	wave->running = true;
+	return 0;
+
+out_pm:
+	pm_runtime_put(ad970x->dev);
+	return error;
+}
+
+static void ad970x_wave_stop(struct ad970x *ad970x)
+{
+	struct ad970x_wave *wave = &ad970x->wave;
+	if (!wave->running) {
+		return;
+	}
+	dmaengine_terminate_sync(wave->tx);
+	wave->running = false;
+	pm_runtime_put(ad970x->dev);
+}
+
+static ssize_t waveform_write(struct file *filp, struct kobject *kobj,
+                              struct bin_attribute *attr, char *buf,
+                              loff_t off, size_t count)
+{
+	struct device *dev = kobj_to_dev(kobj);
+	struct ad970x *ad970x = dev_get_drvdata(dev);
+	struct ad970x_wave *wave = &ad970x->wave;
+	ssize_t ret = count;
+	if (!IS_ALIGNED(off, AD970X_WAVE_ALIGN) ||
+	    !IS_ALIGNED(count, AD970X_WAVE_ALIGN)) {
+		return -EINVAL;
+	}
+	mutex_lock(&wave->lock);
+	if (wave->running) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+	memcpy(wave->buf + off, buf, count);
+	if (0 == off) {
+		wave->size = 0;
+	}
+	wave->size = max_t(size_t, wave->size, off + count);
+out_unlock:
+	mutex_unlock(&wave->lock);
+	return ret;
+}
+static BIN_ATTR_WO(waveform, AD970X_WAVE_MAX_SIZE);
+
+/* waveform_enable
+ *
+ * Write 1 to play the waveform (in a loop). Write 0 to stop it. */
+static ssize_t waveform_enable_show(struct device *dev,
+                                    struct device_attribute *attr, char *buf)
+{
+	struct ad970x *ad970x = dev_get_drvdata(dev);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(ad970x->wave.running));
+}
+static ssize_t waveform_enable_store(struct device *dev,
+                                     struct device_attribute *attr,
+                                     const char *buf, size_t len)
+{
+	struct ad970x *ad970x = dev_get_drvdata(dev);
+	struct ad970x_wave *wave = &ad970x->wave;
+	bool enable;
+	int error;
+	error = strtobool(buf, &enable);
+	if (error) {
+		return error;
+	}
+	mutex_lock(&wave->lock);
+	if (enable) {
+		error = ad970x_wave_start(ad970x);
+	} else {
+		ad970x_wave_stop(ad970x);
+	}
+	mutex_unlock(&wave->lock);
+	return error ? error : len;
+}
+static DEVICE_ATTR_RW(waveform_enable);
+
+static struct attribute *ad970x_wave_attrs[] = {
+	&dev_attr_waveform_enable.attr,
+	NULL,
+};
+
+static struct bin_attribute *ad970x_wave_bin_attrs[] = {
+	&bin_attr_waveform,
+	NULL,
+};
+
+static const struct attribute_group ad970x_wave_group = {
+	.attrs = ad970x_wave_attrs,
+	.bin_attrs = ad970x_wave_bin_attrs,
+};
+
+static void ad970x_wave_release(void *data)
+{
+	struct ad970x *ad970x = data;
+	struct ad970x_wave *wave = &ad970x->wave;
+	mutex_lock(&wave->lock);
+	ad970x_wave_stop(ad970x);
+	mutex_unlock(&wave->lock);
+	dma_free_coherent(wave->tx->device->dev, AD970X_WAVE_MAX_SIZE, wave->buf,
+	                  wave->buf_dma);
+	dma_release_channel(wave->tx);
+}
+
+/* Optional. Only if the device tree gives a "tx" DMA channel. */
+static int ad970x_wave_init(struct device *dev, struct ad970x *ad970x)
+{
+	struct ad970x_wave *wave = &ad970x->wave;
+	int error;
+	mutex_init(&wave->lock);
+	wave->tx = dma_request_chan(dev, "tx");
+	if (IS_ERR(wave->tx)) {
+		error = PTR_ERR(wave->tx);
+		wave->tx = NULL;
+		if (-ENODEV == error) {
+			dev_dbg(dev, "No DMA channel. Waveform output is disabled.\n");
+			return 0;
+		}
+		if (-EPROBE_DEFER != error) {
+			dev_err(dev, "Failed to get DMA channel: %d\n", error);
+		}
+		return error;
+	}
+	wave->buf = dma_alloc_coherent(wave->tx->device->dev, AD970X_WAVE_MAX_SIZE,
+	                               &wave->buf_dma, GFP_KERNEL);
+	if (NULL == wave->buf) {
+		dma_release_channel(wave->tx);
+		return -ENOMEM;
+	}
+	error = devm_add_action_or_reset(dev, ad970x_wave_release, ad970x);
+	if (error) {
+		return error;
+	}
+	error = devm_device_add_group(dev, &ad970x_wave_group);
+	if (error) {
+		dev_err(dev, "Failed to add sysfs group: %d\n", error);
+		return error;
+	}
+	return 0;
+}
+
 static int ad970x_probe(struct device *dev, struct regmap *regmap)
 {
 	int error;
@@ -510,6 +808,7 @@ static int ad970x_probe(struct device *dev, struct regmap *regmap)
 	indio_dev->channels = ad970x_channels;
 	indio_dev->num_channels = ARRAY_SIZE(ad970x_channels);
 	ad970x = iio_priv(indio_dev);
+	ad970x->dev = dev;
 	ad970x->regmap = regmap;
 	dev_set_drvdata(dev, ad970x);
 
@@ -528,6 +827,12 @@ static int ad970x_probe(struct device *dev, struct regmap *regmap)
 		return PTR_ERR(ad970x->clk);
 	}
 
+	/* waveform output (optional) */
+	error = ad970x_wave_init(dev, ad970x);
+	if (error) {
+		return error;
+	}
+
 	/* power */
 	pm_runtime_enable(dev);
 	error = pm_runtime_get_sync(dev);
@@ -623,12 +928,11 @@ static int ad970x_pm_runtime_resume(struct device *dev)
 		dev_err(dev, "Failed to enable device on resume: %d\n", error);
 		return error;
 	}
-	/* restore hw context (note that calibration information is saved
-	 * in persistent storage, so it will be automatically preserved) */
-	regcache_mark_dirty(ad970x->regmap);
-	error = regcache_sync(ad970x->regmap);
+	/* restore hw context. All registers are volatile so the regmap cache
+	 * can't do this for us. */
+	error = ad970x_restore_state(dev);
 	if (error) {
-		dev_err(dev, "Failed to sync regmap cache on resume: %d\n", error);
+		dev_err(dev, "Failed to restore state on resume: %d\n", error);
 		return error;
 	}
 	return 0;
@@ -34,6 +34,38 @@ void iio_free_chan_devattr_list(struct list_head *attr_list);
 
 ssize_t iio_format_value(char *buf, unsigned int type, int size, int *vals);
 
+/*
+ * Protects the callbacks of iio_info against iio_device_unregister() for
+ * consumers that do not take info_exist_lock.
+ */
+extern struct srcu_struct iio_info_srcu;
+
+struct iio_phc;
+
+#ifdef CONFIG_IIO_PHC_TIMESTAMP
+struct iio_phc *iio_phc_get(int index);
+void iio_phc_put(struct iio_phc *phc);
+int iio_phc_index(const struct iio_phc *phc);
+s64 iio_phc_time_ns(struct iio_phc *phc);
+#else
+static inline struct iio_phc *iio_phc_get(int index)
+{
+	return ERR_PTR(-ENODEV);
+}
+
+static inline void iio_phc_put(struct iio_phc *phc) {}
+
+static inline int iio_phc_index(const struct iio_phc *phc)
+{
+	return -1;
+}
+
+static inline s64 iio_phc_time_ns(struct iio_phc *phc)
+{
+	return 0;
+}
+#endif
+
 /* Event interface flags */
 #define IIO_BUSY_BIT_POS 1
 
@@ -44,12 +76,16 @@ __poll_t iio_buffer_poll(struct file *filp,
 			     struct poll_table_struct *wait);
 ssize_t iio_buffer_read_first_n_outer(struct file *filp, char __user *buf,
 				      size_t n, loff_t *f_ps);
+long iio_buffer_ioctl(struct iio_dev *indio_dev, struct file *filp,
+		      unsigned int cmd, unsigned long arg);
+int iio_buffer_mmap(struct file *filp, struct vm_area_struct *vma);
 
 int iio_buffer_alloc_sysfs_and_mask(struct iio_dev *indio_dev);
 void iio_buffer_free_sysfs_and_mask(struct iio_dev *indio_dev);
 
 #define iio_buffer_poll_addr (&iio_buffer_poll)
 #define iio_buffer_read_first_n_outer_addr (&iio_buffer_read_first_n_outer)
+#define iio_buffer_mmap_addr (&iio_buffer_mmap)
 
 void iio_disable_all_buffers(struct iio_dev *indio_dev);
 void iio_buffer_wakeup_poll(struct iio_dev *indio_dev);
@@ -58,6 +94,14 @@ void iio_buffer_wakeup_poll(struct iio_dev *indio_dev);
 
 #define iio_buffer_poll_addr NULL
 #define iio_buffer_read_first_n_outer_addr NULL
+#define iio_buffer_mmap_addr NULL
+
+static inline long iio_buffer_ioctl(struct iio_dev *indio_dev,
+				    struct file *filp, unsigned int cmd,
+				    unsigned long arg)
+{
+	return -EINVAL;
+}
 
 static inline int iio_buffer_alloc_sysfs_and_mask(struct iio_dev *indio_dev)
 {
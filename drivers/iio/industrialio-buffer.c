@@ -16,6 +16,7 @@
 #include <linux/cdev.h>
 #include <linux/slab.h>
 #include <linux/poll.h>
+#include <linux/mm.h>
 #include <linux/sched/signal.h>
 
 #include <linux/iio/iio.h>
@@ -195,6 +196,135 @@ void iio_buffer_wakeup_poll(struct iio_dev *indio_dev)
 	wake_up(&indio_dev->buffer->pollq);
 }
 
+static int iio_buffer_dequeue_block(struct file *filp, struct iio_buffer *rb,
+				    struct iio_buffer_block *block)
+{
+	struct iio_dev *indio_dev = filp->private_data;
+	DEFINE_WAIT_FUNC(wait, woken_wake_function);
+	int ret;
+
+	add_wait_queue(&rb->pollq, &wait);
+	do {
+		if (!indio_dev->info) {
+			ret = -ENODEV;
+			break;
+		}
+
+		ret = rb->access->dequeue_block(rb, block);
+		if (ret != -EAGAIN || (filp->f_flags & O_NONBLOCK))
+			break;
+
+		/* drain the buffer if it was disabled */
+		if (!iio_buffer_is_active(rb))
+			break;
+
+		if (signal_pending(current)) {
+			ret = -ERESTARTSYS;
+			break;
+		}
+
+		wait_woken(&wait, TASK_INTERRUPTIBLE, MAX_SCHEDULE_TIMEOUT);
+	} while (1);
+	remove_wait_queue(&rb->pollq, &wait);
+
+	return ret;
+}
+
+/**
+ * iio_buffer_ioctl() - chrdev ioctl for block based buffer access
+ * @indio_dev:	The IIO device
+ * @filp:	File structure pointer for the char device
+ * @cmd:	One of the IIO_BUFFER_BLOCK_*_IOCTL commands
+ * @arg:	Userspace pointer to the argument of @cmd
+ *
+ * A dequeue blocks until a block contains data, unless the file has been
+ * opened with O_NONBLOCK.
+ *
+ * Return: 0 on success or a negative error code
+ */
+long iio_buffer_ioctl(struct iio_dev *indio_dev, struct file *filp,
+		      unsigned int cmd, unsigned long arg)
+{
+	struct iio_buffer *rb = indio_dev->buffer;
+	void __user *argp = (void __user *)arg;
+	struct iio_buffer_block_alloc_req req;
+	struct iio_buffer_block block;
+	int ret;
+
+	if (!rb || !rb->access)
+		return -ENODEV;
+
+	switch (cmd) {
+	case IIO_BUFFER_BLOCK_ALLOC_IOCTL:
+		if (!rb->access->alloc_blocks)
+			return -ENODEV;
+		if (copy_from_user(&req, argp, sizeof(req)))
+			return -EFAULT;
+		ret = rb->access->alloc_blocks(rb, &req);
+		if (ret)
+			return ret;
+		if (copy_to_user(argp, &req, sizeof(req)))
+			return -EFAULT;
+		return 0;
+	case IIO_BUFFER_BLOCK_FREE_IOCTL:
+		if (!rb->access->free_blocks)
+			return -ENODEV;
+		return rb->access->free_blocks(rb);
+	case IIO_BUFFER_BLOCK_QUERY_IOCTL:
+	case IIO_BUFFER_BLOCK_ENQUEUE_IOCTL:
+	case IIO_BUFFER_BLOCK_DEQUEUE_IOCTL:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (!rb->access->query_block || !rb->access->enqueue_block ||
+	    !rb->access->dequeue_block)
+		return -ENODEV;
+
+	if (copy_from_user(&block, argp, sizeof(block)))
+		return -EFAULT;
+
+	if (cmd == IIO_BUFFER_BLOCK_QUERY_IOCTL)
+		ret = rb->access->query_block(rb, &block);
+	else if (cmd == IIO_BUFFER_BLOCK_ENQUEUE_IOCTL)
+		ret = rb->access->enqueue_block(rb, &block);
+	else
+		ret = iio_buffer_dequeue_block(filp, rb, &block);
+	if (ret)
+		return ret;
+
+	if (copy_to_user(argp, &block, sizeof(block)))
+		return -EFAULT;
+
+	return 0;
+}
+
+/**
+ * iio_buffer_mmap() - chrdev mmap for block based buffer access
+ * @filp:	File structure pointer for the char device
+ * @vma:	The mapping. The offset selects the block (see
+ *		struct iio_buffer_block).
+ *
+ * Return: 0 on success or a negative error code
+ */
+int iio_buffer_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct iio_dev *indio_dev = filp->private_data;
+	struct iio_buffer *rb = indio_dev->buffer;
+
+	if (!indio_dev->info)
+		return -ENODEV;
+
+	if (!rb || !rb->access->mmap)
+		return -ENODEV;
+
+	if (!(vma->vm_flags & VM_SHARED))
+		return -EINVAL;
+
+	return rb->access->mmap(rb, vma);
+}
+
 void iio_buffer_init(struct iio_buffer *buffer)
 {
 	INIT_LIST_HEAD(&buffer->demux_list);
@@ -1413,6 +1543,61 @@ int iio_push_to_buffers(struct iio_dev *indio_dev, const void *data)
 }
 EXPORT_SYMBOL_GPL(iio_push_to_buffers);
 
+static int iio_push_n_to_buffer(struct iio_buffer *buffer, const void *data,
+				unsigned int n, size_t scan_bytes)
+{
+	unsigned int i;
+	int ret = 0;
+
+	/* Without a demux the scans can go into the buffer as they are */
+	if (list_empty(&buffer->demux_list) && buffer->access->store_n_to) {
+		ret = buffer->access->store_n_to(buffer, data, n);
+		if (ret >= 0)
+			ret = ret < n ? -EBUSY : 0;
+	} else {
+		for (i = 0; i < n; i++) {
+			ret = buffer->access->store_to(buffer,
+					iio_demux(buffer, data + i * scan_bytes));
+			if (ret)
+				break;
+		}
+	}
+
+	/* One wakeup for the whole batch */
+	wake_up_interruptible_poll(&buffer->pollq, EPOLLIN | EPOLLRDNORM);
+	return ret;
+}
+
+/**
+ * iio_push_to_buffers_n() - push several scans to the registered buffers
+ * @indio_dev:		iio_dev structure for device.
+ * @data:		@n consecutive full scans, indio_dev->scan_bytes each.
+ * @n:			Number of scans.
+ *
+ * Same as calling iio_push_to_buffers() for each scan, but the readers are
+ * only woken up once. Buffers that need no demux and implement store_n_to
+ * take the whole batch in one go.
+ *
+ * Returns 0 on success, -EBUSY if a buffer ran full or another negative error
+ * code.
+ */
+int iio_push_to_buffers_n(struct iio_dev *indio_dev, const void *data,
+			  unsigned int n)
+{
+	int ret;
+	struct iio_buffer *buf;
+
+	list_for_each_entry(buf, &indio_dev->buffer_list, buffer_list) {
+		ret = iio_push_n_to_buffer(buf, data, n,
+					   indio_dev->scan_bytes);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(iio_push_to_buffers_n);
+
 /**
  * iio_buffer_release() - Free a buffer's resources
  * @ref: Pointer to the kref embedded in the iio_buffer struct
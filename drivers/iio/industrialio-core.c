@@ -24,6 +24,8 @@
 #include <linux/anon_inodes.h>
 #include <linux/debugfs.h>
 #include <linux/mutex.h>
+#include <linux/rcupdate.h>
+#include <linux/srcu.h>
 #include <linux/iio/iio.h>
 #include "iio_core.h"
 #include "iio_core_trigger.h"
@@ -35,6 +37,8 @@
 /* IDA to assign each registered device a unique id */
 static DEFINE_IDA(iio_ida);
 
+DEFINE_SRCU(iio_info_srcu);
+
 static dev_t iio_devt;
 
 #define IIO_DEV_MAX 256
@@ -190,25 +194,63 @@ ssize_t iio_read_const_attr(struct device *dev,
 }
 EXPORT_SYMBOL(iio_read_const_attr);
 
-static int iio_device_set_clock(struct iio_dev *indio_dev, clockid_t clock_id)
+/*
+ * @phc is only used with IIO_CLOCK_PHC. It is handed over to the device on
+ * success and released on failure.
+ */
+static int iio_device_set_clock(struct iio_dev *indio_dev, clockid_t clock_id,
+				struct iio_phc *phc)
 {
 	int ret;
 	const struct iio_event_interface *ev_int = indio_dev->event_interface;
+	struct iio_phc *old_phc;
 
 	ret = mutex_lock_interruptible(&indio_dev->mlock);
-	if (ret)
+	if (ret) {
+		iio_phc_put(phc);
 		return ret;
+	}
 	if ((ev_int && iio_event_enabled(ev_int)) ||
 	    iio_buffer_enabled(indio_dev)) {
 		mutex_unlock(&indio_dev->mlock);
+		iio_phc_put(phc);
 		return -EBUSY;
 	}
-	indio_dev->clock_id = clock_id;
+
+	/*
+	 * Drivers may take timestamps at any time, e.g. in their interrupt
+	 * handler. iio_get_time_ns() reads the PHC under RCU and falls back to
+	 * CLOCK_MONOTONIC while the pointer is NULL.
+	 */
+	old_phc = rcu_dereference_protected(indio_dev->phc,
+					    lockdep_is_held(&indio_dev->mlock));
+	if (clock_id == IIO_CLOCK_PHC) {
+		rcu_assign_pointer(indio_dev->phc, phc);
+		WRITE_ONCE(indio_dev->clock_id, clock_id);
+	} else {
+		WRITE_ONCE(indio_dev->clock_id, clock_id);
+		RCU_INIT_POINTER(indio_dev->phc, NULL);
+	}
 	mutex_unlock(&indio_dev->mlock);
 
+	iio_phc_put(old_phc);
+
 	return 0;
 }
 
+static s64 iio_get_phc_time_ns(const struct iio_dev *indio_dev)
+{
+	struct iio_phc *phc;
+	s64 ns;
+
+	rcu_read_lock();
+	phc = rcu_dereference(indio_dev->phc);
+	ns = phc ? iio_phc_time_ns(phc) : ktime_get_ns();
+	rcu_read_unlock();
+
+	return ns;
+}
+
 /**
  * iio_get_time_ns() - utility function to get a time stamp for events etc
  * @indio_dev: device
@@ -233,6 +275,8 @@ s64 iio_get_time_ns(const struct iio_dev *indio_dev)
 		return ktime_get_boottime_ns();
 	case CLOCK_TAI:
 		return ktime_get_clocktai_ns();
+	case IIO_CLOCK_PHC:
+		return iio_get_phc_time_ns(indio_dev);
 	default:
 		BUG();
 	}
@@ -252,6 +296,7 @@ unsigned int iio_get_time_res(const struct iio_dev *indio_dev)
 	case CLOCK_MONOTONIC_RAW:
 	case CLOCK_BOOTTIME:
 	case CLOCK_TAI:
+	case IIO_CLOCK_PHC:
 		return hrtimer_resolution;
 	case CLOCK_REALTIME_COARSE:
 	case CLOCK_MONOTONIC_COARSE:
@@ -1260,6 +1305,7 @@ static ssize_t iio_show_timestamp_clock(struct device *dev,
 {
 	const struct iio_dev *indio_dev = dev_to_iio_dev(dev);
 	const clockid_t clk = iio_device_get_clock(indio_dev);
+	struct iio_phc *phc;
 	const char *name;
 	ssize_t sz;
 
@@ -1292,6 +1338,12 @@ static ssize_t iio_show_timestamp_clock(struct device *dev,
 		name = "tai\n";
 		sz = sizeof("tai\n");
 		break;
+	case IIO_CLOCK_PHC:
+		rcu_read_lock();
+		phc = rcu_dereference(indio_dev->phc);
+		sz = sprintf(buf, "ptp%d\n", phc ? iio_phc_index(phc) : -1);
+		rcu_read_unlock();
+		return sz;
 	default:
 		BUG();
 	}
@@ -1304,10 +1356,17 @@ static ssize_t iio_store_timestamp_clock(struct device *dev,
 					 struct device_attribute *attr,
 					 const char *buf, size_t len)
 {
+	struct iio_phc *phc = NULL;
+	unsigned int index;
 	clockid_t clk;
 	int ret;
 
-	if (sysfs_streq(buf, "realtime"))
+	if (sscanf(buf, "ptp%u", &index) == 1) {
+		phc = iio_phc_get(index);
+		if (IS_ERR(phc))
+			return PTR_ERR(phc);
+		clk = IIO_CLOCK_PHC;
+	} else if (sysfs_streq(buf, "realtime"))
 		clk = CLOCK_REALTIME;
 	else if (sysfs_streq(buf, "monotonic"))
 		clk = CLOCK_MONOTONIC;
@@ -1324,7 +1383,7 @@ static ssize_t iio_store_timestamp_clock(struct device *dev,
 	else
 		return -EINVAL;
 
-	ret = iio_device_set_clock(dev_to_iio_dev(dev), clk);
+	ret = iio_device_set_clock(dev_to_iio_dev(dev), clk, phc);
 	if (ret)
 		return ret;
 
@@ -1427,6 +1486,7 @@ static void iio_dev_release(struct device *device)
 	iio_device_unregister_sysfs(indio_dev);
 
 	iio_buffer_put(indio_dev->buffer);
+	iio_phc_put(rcu_dereference_protected(indio_dev->phc, 1));
 
 	ida_simple_remove(&iio_ida, indio_dev->id);
 	kfree(indio_dev);
@@ -1601,7 +1661,7 @@ static int iio_chrdev_release(struct inode *inode, struct file *filp)
 }
 
 /* Somewhat of a cross file organization violation - ioctls here are actually
- * event related */
+ * event and buffer related */
 static long iio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 {
 	struct iio_dev *indio_dev = filp->private_data;
@@ -1619,7 +1679,7 @@ static long iio_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 			return -EFAULT;
 		return 0;
 	}
-	return -EINVAL;
+	return iio_buffer_ioctl(indio_dev, filp, cmd, arg);
 }
 
 static const struct file_operations iio_buffer_fileops = {
@@ -1627,6 +1687,7 @@ static const struct file_operations iio_buffer_fileops = {
 	.release = iio_chrdev_release,
 	.open = iio_chrdev_open,
 	.poll = iio_buffer_poll_addr,
+	.mmap = iio_buffer_mmap_addr,
 	.owner = THIS_MODULE,
 	.llseek = noop_llseek,
 	.unlocked_ioctl = iio_ioctl,
@@ -1751,6 +1812,9 @@ void iio_device_unregister(struct iio_dev *indio_dev)
 
 	mutex_unlock(&indio_dev->info_exist_lock);
 
+	/* Wait for the consumers that run without info_exist_lock */
+	synchronize_srcu(&iio_info_srcu);
+
 	iio_buffer_free_sysfs_and_mask(indio_dev);
 }
 EXPORT_SYMBOL(iio_device_unregister);
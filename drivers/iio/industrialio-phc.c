@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/* The industrial I/O core - PTP hardware clock timestamps
+ *
+ * Reading a PHC means register accesses that may sleep, which is no good for
+ * timestamps taken in interrupt context. Instead, a worker samples the PHC
+ * against CLOCK_MONOTONIC_RAW once per IIO_PHC_PERIOD and iio_phc_time_ns()
+ * extrapolates from the latest sample with the rate measured between the last
+ * two. The samples are published through a seqcount latch so that readers
+ * never wait for the worker, not even if they interrupt it.
+ */
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/ptp_clock_kernel.h>
+#include <linux/rcupdate.h>
+#include <linux/seqlock.h>
+#include <linux/slab.h>
+#include <linux/workqueue.h>
+
+#include "iio_core.h"
+
+#define IIO_PHC_PERIOD HZ
+/* Far beyond the tolerance of any oscillator. Anything above is a step. */
+#define IIO_PHC_MAX_PPB 1000000
+
+struct iio_phc_sample {
+	s64 sys;
+	s64 phc;
+	s32 ppb;
+};
+
+struct iio_phc {
+	struct ptp_clock *ptp;
+	int index;
+	struct delayed_work work;
+	struct rcu_head rcu;
+
+	seqcount_t seq;
+	struct iio_phc_sample sample[2];
+
+	/* Only accessed by the worker */
+	struct iio_phc_sample last;
+	bool lost;
+};
+
+static int iio_phc_read(struct iio_phc *phc, struct iio_phc_sample *s)
+{
+	struct timespec64 ts;
+	s64 t0, t1;
+	int ret;
+
+	t0 = ktime_get_raw_ns();
+	ret = ptp_clock_read(phc->ptp, &ts);
+	t1 = ktime_get_raw_ns();
+	if (ret)
+		return ret;
+
+	s->sys = t0 + (t1 - t0) / 2;
+	s->phc = timespec64_to_ns(&ts);
+	s->ppb = 0;
+
+	return 0;
+}
+
+static void iio_phc_publish(struct iio_phc *phc, const struct iio_phc_sample *s)
+{
+	raw_write_seqcount_latch(&phc->seq);
+	phc->sample[0] = *s;
+	raw_write_seqcount_latch(&phc->seq);
+	phc->sample[1] = *s;
+}
+
+static void iio_phc_work(struct work_struct *work)
+{
+	struct iio_phc *phc = container_of(to_delayed_work(work),
+					   struct iio_phc, work);
+	struct iio_phc_sample s;
+	s64 dsys, dphc;
+
+	if (iio_phc_read(phc, &s)) {
+		/* The clock is gone, keep extrapolating from the last sample */
+		if (!phc->lost)
+			pr_warn("iio: ptp%d went away\n", phc->index);
+		phc->lost = true;
+		return;
+	}
+
+	dsys = s.sys - phc->last.sys;
+	dphc = s.phc - phc->last.phc;
+	if (dsys > 0) {
+		s.ppb = clamp_t(s64, div64_s64((dphc - dsys) * NSEC_PER_SEC,
+					       dsys),
+				-IIO_PHC_MAX_PPB, IIO_PHC_MAX_PPB);
+		/* The PHC has been stepped, the old rate is the better guess */
+		if (abs(s.ppb) == IIO_PHC_MAX_PPB)
+			s.ppb = phc->last.ppb;
+	}
+
+	phc->last = s;
+	iio_phc_publish(phc, &s);
+
+	schedule_delayed_work(&phc->work, IIO_PHC_PERIOD);
+}
+
+/**
+ * iio_phc_get() - start converting timestamps to a PHC
+ * @index: Index of the PTP clock (as in /dev/ptp<index>)
+ */
+struct iio_phc *iio_phc_get(int index)
+{
+	struct iio_phc *phc;
+	struct ptp_clock *ptp;
+	struct iio_phc_sample s;
+	int ret;
+
+	ptp = ptp_clock_get_by_index(index);
+	if (IS_ERR(ptp))
+		return ERR_CAST(ptp);
+
+	phc = kzalloc(sizeof(*phc), GFP_KERNEL);
+	if (!phc) {
+		ptp_clock_put(ptp);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	phc->ptp = ptp;
+	phc->index = index;
+	seqcount_init(&phc->seq);
+	INIT_DELAYED_WORK(&phc->work, iio_phc_work);
+
+	ret = iio_phc_read(phc, &s);
+	if (ret) {
+		ptp_clock_put(ptp);
+		kfree(phc);
+		return ERR_PTR(ret);
+	}
+
+	phc->last = s;
+	iio_phc_publish(phc, &s);
+	schedule_delayed_work(&phc->work, IIO_PHC_PERIOD);
+
+	return phc;
+}
+
+/**
+ * iio_phc_put() - stop converting timestamps to a PHC
+ * @phc: As returned by iio_phc_get(), may be NULL
+ *
+ * Readers that still hold @phc must be inside an RCU read side section.
+ */
+void iio_phc_put(struct iio_phc *phc)
+{
+	if (!phc)
+		return;
+
+	cancel_delayed_work_sync(&phc->work);
+	ptp_clock_put(phc->ptp);
+	kfree_rcu(phc, rcu);
+}
+
+/**
+ * iio_phc_index() - index of the PTP clock of @phc
+ * @phc: As returned by iio_phc_get()
+ */
+int iio_phc_index(const struct iio_phc *phc)
+{
+	return phc->index;
+}
+
+/**
+ * iio_phc_time_ns() - the current time of the PHC
+ * @phc: As returned by iio_phc_get()
+ *
+ * Safe to call from any context but NMI. Call inside an RCU read side
+ * section.
+ */
+s64 iio_phc_time_ns(struct iio_phc *phc)
+{
+	const struct iio_phc_sample *s;
+	unsigned int seq;
+	s64 now, delta, ns;
+
+	now = ktime_get_raw_ns();
+	do {
+		seq = raw_read_seqcount_latch(&phc->seq);
+		s = &phc->sample[seq & 1];
+		delta = now - s->sys;
+		ns = s->phc + delta + div_s64(delta * s->ppb, NSEC_PER_SEC);
+	} while (read_seqcount_retry(&phc->seq, seq));
+
+	return ns;
+}
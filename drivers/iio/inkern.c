@@ -8,6 +8,7 @@
 #include <linux/slab.h>
 #include <linux/mutex.h>
 #include <linux/of.h>
+#include <linux/srcu.h>
 
 #include <linux/iio/iio.h>
 #include "iio_core.h"
@@ -884,6 +885,90 @@ int iio_write_channel_raw(struct iio_channel *chan, int val)
 }
 EXPORT_SYMBOL_GPL(iio_write_channel_raw);
 
+/*
+ * The batched accessors below skip info_exist_lock. They run inside an
+ * iio_info_srcu read side section instead, which iio_device_unregister()
+ * waits for once it has cleared the info pointer. SRCU, because the
+ * callbacks of most drivers sleep.
+ */
+int iio_read_channels_raw(struct iio_channel *chans, unsigned int num,
+			  int *vals)
+{
+	int vals_multi[INDIO_MAX_RAW_ELEMENTS];
+	const struct iio_info *info;
+	struct iio_channel *chan;
+	int val_len, unused;
+	unsigned int i;
+	int ret = 0;
+	int idx;
+
+	idx = srcu_read_lock(&iio_info_srcu);
+	for (i = 0; i < num; i++) {
+		chan = &chans[i];
+		info = READ_ONCE(chan->indio_dev->info);
+		if (!info) {
+			ret = -ENODEV;
+			break;
+		}
+
+		if (!iio_channel_has_info(chan->channel, IIO_CHAN_INFO_RAW)) {
+			ret = -EINVAL;
+			break;
+		}
+
+		if (info->read_raw_multi) {
+			ret = info->read_raw_multi(chan->indio_dev,
+					chan->channel, INDIO_MAX_RAW_ELEMENTS,
+					vals_multi, &val_len,
+					IIO_CHAN_INFO_RAW);
+			vals[i] = vals_multi[0];
+		} else {
+			ret = info->read_raw(chan->indio_dev, chan->channel,
+					&vals[i], &unused, IIO_CHAN_INFO_RAW);
+		}
+		if (ret < 0)
+			break;
+	}
+	srcu_read_unlock(&iio_info_srcu, idx);
+
+	return ret < 0 ? ret : 0;
+}
+EXPORT_SYMBOL_GPL(iio_read_channels_raw);
+
+int iio_write_channels_raw(struct iio_channel *chans, unsigned int num,
+			   const int *vals)
+{
+	const struct iio_info *info;
+	struct iio_channel *chan;
+	unsigned int i;
+	int ret = 0;
+	int idx;
+
+	idx = srcu_read_lock(&iio_info_srcu);
+	for (i = 0; i < num; i++) {
+		chan = &chans[i];
+		info = READ_ONCE(chan->indio_dev->info);
+		if (!info) {
+			ret = -ENODEV;
+			break;
+		}
+
+		if (!info->write_raw) {
+			ret = -EINVAL;
+			break;
+		}
+
+		ret = info->write_raw(chan->indio_dev, chan->channel, vals[i],
+				      0, IIO_CHAN_INFO_RAW);
+		if (ret < 0)
+			break;
+	}
+	srcu_read_unlock(&iio_info_srcu, idx);
+
+	return ret < 0 ? ret : 0;
+}
+EXPORT_SYMBOL_GPL(iio_write_channels_raw);
+
 unsigned int iio_get_channel_ext_info_count(struct iio_channel *chan)
 {
 	const struct iio_chan_spec_ext_info *ext_info;
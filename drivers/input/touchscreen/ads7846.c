@@ -58,6 +58,7 @@
 
 #define TS_POLL_DELAY	1	/* ms delay before the first sample */
 #define TS_POLL_PERIOD	5	/* ms delay between samples */
+#define TS_MAX_FILTER_SHIFT	8
 
 /* this driver doesn't aim at the peak continuous sample rate */
 #define	SAMPLE_BITS	(8 /*cmd*/ + 16 /*sample*/ + 2 /* before, after */)
@@ -130,6 +131,13 @@ struct ads7846 {
 
 	u16			penirq_recheck_delay_usecs;
 
+	/* for the filter_shift mode, x and y scaled by 2^filter_shift */
+	u16			filter_shift;
+	unsigned int		avg_x;
+	unsigned int		avg_y;
+
+	ktime_t			poll_period;
+
 	struct touchscreen_properties core_prop;
 
 	struct mutex		lock;
@@ -746,11 +754,53 @@ static void ads7846_read_state(struct ads7846 *ts)
 	}
 }
 
+static inline u16 ads7846_conv(u16 *rx)
+{
+	/* see ads7846_get_value() */
+	return (be16_to_cpup((__be16 *)rx) >> 3) & 0xfff;
+}
+
+/*
+ * With filter_shift, a sample is a single SPI message. Instead of repeating
+ * readings until they are consistent, x and y go through a fixed-point
+ * exponential average that restarts with every pen down.
+ */
+static void ads7846_read_sample(struct ads7846 *ts)
+{
+	struct ads7846_packet *packet = ts->packet;
+	unsigned int shift = ts->filter_shift;
+	int error;
+
+	ts->wait_for_sync();
+
+	error = spi_sync(ts->spi, &ts->msg[0]);
+	if (error) {
+		dev_err(&ts->spi->dev, "spi_sync --> %d\n", error);
+		packet->tc.ignore = true;
+		return;
+	}
+
+	packet->tc.x = ads7846_conv(&packet->tc.x);
+	packet->tc.y = ads7846_conv(&packet->tc.y);
+	packet->tc.z1 = ads7846_conv(&packet->tc.z1);
+	packet->tc.z2 = ads7846_conv(&packet->tc.z2);
+	packet->tc.ignore = false;
+
+	if (!ts->pendown) {
+		ts->avg_x = packet->tc.x << shift;
+		ts->avg_y = packet->tc.y << shift;
+	} else {
+		ts->avg_x += packet->tc.x - (ts->avg_x >> shift);
+		ts->avg_y += packet->tc.y - (ts->avg_y >> shift);
+	}
+}
+
 static void ads7846_report_state(struct ads7846 *ts)
 {
 	struct ads7846_packet *packet = ts->packet;
 	unsigned int Rt;
 	u16 x, y, z1, z2;
+	u16 fx, fy;
 
 	/*
 	 * ads7846_get_value() does in-place conversion (including byte swap)
@@ -769,6 +819,15 @@ static void ads7846_report_state(struct ads7846 *ts)
 		z2 = packet->tc.z2;
 	}
 
+	/* the pressure is computed from the raw x */
+	if (ts->filter_shift && ts->pendown) {
+		fx = ts->avg_x >> ts->filter_shift;
+		fy = ts->avg_y >> ts->filter_shift;
+	} else {
+		fx = x;
+		fy = y;
+	}
+
 	/* range filtering */
 	if (x == MAX_12BIT)
 		x = 0;
@@ -832,7 +891,7 @@ static void ads7846_report_state(struct ads7846 *ts)
 			dev_vdbg(&ts->spi->dev, "DOWN\n");
 		}
 
-		touchscreen_report_pos(input, &ts->core_prop, x, y, false);
+		touchscreen_report_pos(input, &ts->core_prop, fx, fy, false);
 		input_report_abs(input, ABS_PRESSURE, ts->pressure_max - Rt);
 
 		input_sync(input);
@@ -858,13 +917,16 @@ static irqreturn_t ads7846_irq(int irq, void *handle)
 	while (!ts->stopped && get_pendown_state(ts)) {
 
 		/* pen is down, continue with the measurement */
-		ads7846_read_state(ts);
+		if (ts->filter_shift)
+			ads7846_read_sample(ts);
+		else
+			ads7846_read_state(ts);
 
 		if (!ts->stopped)
 			ads7846_report_state(ts);
 
-		wait_event_timeout(ts->wait, ts->stopped,
-				   msecs_to_jiffies(TS_POLL_PERIOD));
+		/* a jiffy based timeout would round the period up to a tick */
+		wait_event_hrtimeout(ts->wait, ts->stopped, ts->poll_period);
 	}
 
 	if (ts->pendown && !ts->stopped) {
@@ -965,6 +1027,21 @@ static int ads7846_setup_pendown(struct spi_device *spi,
 	return 0;
 }
 
+/* With filter_shift, all transfers of a sample go into the first message */
+static struct spi_message *ads7846_next_msg(struct ads7846 *ts,
+					    struct spi_message *m)
+{
+	if (ts->filter_shift)
+		return m;
+
+	ts->msg_count++;
+	m++;
+	spi_message_init(m);
+	m->context = ts;
+
+	return m;
+}
+
 /*
  * Set up the transfers to read touchscreen state; this assumes we
  * use formula #2 for pressure, not #3.
@@ -1031,10 +1108,7 @@ static void ads7846_setup_spi_msg(struct ads7846 *ts,
 		spi_message_add_tail(x, m);
 	}
 
-	ts->msg_count++;
-	m++;
-	spi_message_init(m);
-	m->context = ts;
+	m = ads7846_next_msg(ts, m);
 
 	if (ts->model == 7845) {
 		x++;
@@ -1076,10 +1150,7 @@ static void ads7846_setup_spi_msg(struct ads7846 *ts,
 
 	/* turn y+ off, x- on; we'll use formula #2 */
 	if (ts->model == 7846) {
-		ts->msg_count++;
-		m++;
-		spi_message_init(m);
-		m->context = ts;
+		m = ads7846_next_msg(ts, m);
 
 		x++;
 		packet->read_z1 = READ_Z1(vref);
@@ -1107,10 +1178,7 @@ static void ads7846_setup_spi_msg(struct ads7846 *ts,
 			spi_message_add_tail(x, m);
 		}
 
-		ts->msg_count++;
-		m++;
-		spi_message_init(m);
-		m->context = ts;
+		m = ads7846_next_msg(ts, m);
 
 		x++;
 		packet->read_z2 = READ_Z2(vref);
@@ -1140,10 +1208,7 @@ static void ads7846_setup_spi_msg(struct ads7846 *ts,
 	}
 
 	/* power down */
-	ts->msg_count++;
-	m++;
-	spi_message_init(m);
-	m->context = ts;
+	m = ads7846_next_msg(ts, m);
 
 	if (ts->model == 7845) {
 		x++;
@@ -1237,6 +1302,9 @@ static const struct ads7846_platform_data *ads7846_probe_dt(struct device *dev)
 		pdata->debounce_max = (u16) value;
 	of_property_read_u16(node, "ti,debounce-tol", &pdata->debounce_tol);
 	of_property_read_u16(node, "ti,debounce-rep", &pdata->debounce_rep);
+	of_property_read_u16(node, "ti,filter-shift", &pdata->filter_shift);
+	of_property_read_u32(node, "ti,poll-period-usecs",
+			     &pdata->poll_period_usecs);
 
 	of_property_read_u32(node, "ti,pendown-gpio-debounce",
 			     &pdata->gpio_pendown_debounce);
@@ -1327,6 +1395,9 @@ static int ads7846_probe(struct spi_device *spi)
 		}
 		ts->filter = pdata->filter;
 		ts->filter_cleanup = pdata->filter_cleanup;
+	} else if (pdata->filter_shift && ts->model != 7845) {
+		ts->filter_shift = min_t(u16, pdata->filter_shift,
+					 TS_MAX_FILTER_SHIFT);
 	} else if (pdata->debounce_max) {
 		ts->debounce_max = pdata->debounce_max;
 		if (ts->debounce_max < 2)
@@ -1348,6 +1419,11 @@ static int ads7846_probe(struct spi_device *spi)
 				pdata->penirq_recheck_delay_usecs;
 
 	ts->wait_for_sync = pdata->wait_for_sync ? : null_wait_for_sync;
+	if (pdata->poll_period_usecs)
+		ts->poll_period = ns_to_ktime((u64)pdata->poll_period_usecs *
+					      NSEC_PER_USEC);
+	else
+		ts->poll_period = ms_to_ktime(TS_POLL_PERIOD);
 
 	snprintf(ts->phys, sizeof(ts->phys), "%s/input0", dev_name(&spi->dev));
 	snprintf(ts->name, sizeof(ts->name), "ADS%d Touchscreen", ts->model);
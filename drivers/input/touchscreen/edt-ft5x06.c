@@ -62,6 +62,7 @@
 #define EDT_SWITCH_MODE_DELAY		5 /* msec */
 #define EDT_RAW_DATA_RETRIES		100
 #define EDT_RAW_DATA_DELAY		1000 /* usec */
+#define EDT_MAX_REPORT_INTERVAL		100 /* msec */
 
 enum edt_ver {
 	EDT_M06,
@@ -106,6 +107,7 @@ struct edt_ft5x06_ts_data {
 	int offset_x;
 	int offset_y;
 	int report_rate;
+	int report_interval_ms;
 	int max_support_points;
 
 	char name[EDT_NAME_LEN];
@@ -169,6 +171,43 @@ static bool edt_ft5x06_ts_check_crc(struct edt_ft5x06_ts_data *tsdata,
 	return true;
 }
 
+/*
+ * All but the M06 report the number of active points in the header. Read
+ * the header and the first point in one go, and the other points only if
+ * there are any. If the number is bogus, fall back to reading all points.
+ */
+static int edt_ft5x06_ts_read_points(struct edt_ft5x06_ts_data *tsdata,
+				     u8 *rdbuf, int offset, int tplen,
+				     int *num_points)
+{
+	u8 cmd = 0x0;
+	int count;
+	int error;
+
+	error = edt_ft5x06_ts_readwrite(tsdata->client, sizeof(cmd), &cmd,
+					offset + tplen, rdbuf);
+	if (error)
+		return error;
+
+	count = rdbuf[offset - 1] & 0x0f;
+	if (count > tsdata->max_support_points) {
+		*num_points = tsdata->max_support_points;
+		return edt_ft5x06_ts_readwrite(tsdata->client,
+					       sizeof(cmd), &cmd,
+					       offset + tplen * *num_points,
+					       rdbuf);
+	}
+
+	*num_points = count;
+	if (count <= 1)
+		return 0;
+
+	cmd = offset + tplen;
+	return edt_ft5x06_ts_readwrite(tsdata->client, sizeof(cmd), &cmd,
+				       tplen * (count - 1),
+				       rdbuf + offset + tplen);
+}
+
 static irqreturn_t edt_ft5x06_ts_isr(int irq, void *dev_id)
 {
 	struct edt_ft5x06_ts_data *tsdata = dev_id;
@@ -177,6 +216,8 @@ static irqreturn_t edt_ft5x06_ts_isr(int irq, void *dev_id)
 	u8 rdbuf[63];
 	int i, type, x, y, id;
 	int offset, tplen, datalen, crclen;
+	int num_points;
+	bool touched = false;
 	int error;
 
 	switch (tsdata->version) {
@@ -203,10 +244,16 @@ static irqreturn_t edt_ft5x06_ts_isr(int irq, void *dev_id)
 
 	memset(rdbuf, 0, sizeof(rdbuf));
 	datalen = tplen * tsdata->max_support_points + offset + crclen;
+	num_points = tsdata->max_support_points;
 
-	error = edt_ft5x06_ts_readwrite(tsdata->client,
-					sizeof(cmd), &cmd,
-					datalen, rdbuf);
+	if (tsdata->version == EDT_M06) {
+		error = edt_ft5x06_ts_readwrite(tsdata->client,
+						sizeof(cmd), &cmd,
+						datalen, rdbuf);
+	} else {
+		error = edt_ft5x06_ts_read_points(tsdata, rdbuf, offset, tplen,
+						  &num_points);
+	}
 	if (error) {
 		dev_err_ratelimited(dev, "Unable to fetch data, error: %d\n",
 				    error);
@@ -227,7 +274,7 @@ static irqreturn_t edt_ft5x06_ts_isr(int irq, void *dev_id)
 			goto out;
 	}
 
-	for (i = 0; i < tsdata->max_support_points; i++) {
+	for (i = 0; i < num_points; i++) {
 		u8 *buf = &rdbuf[i * tplen + offset];
 
 		type = buf[0] >> 6;
@@ -249,14 +296,27 @@ static irqreturn_t edt_ft5x06_ts_isr(int irq, void *dev_id)
 
 		input_mt_slot(tsdata->input, id);
 		if (input_mt_report_slot_state(tsdata->input, MT_TOOL_FINGER,
-					       type != TOUCH_EVENT_UP))
+					       type != TOUCH_EVENT_UP)) {
 			touchscreen_report_pos(tsdata->input, &tsdata->prop,
 					       x, y, true);
+			touched = true;
+		}
 	}
 
+	/* Only the active points were read, release all others */
+	if (num_points < tsdata->max_support_points)
+		input_mt_drop_unused(tsdata->input);
+
 	input_mt_report_pointer_emulation(tsdata->input, true);
 	input_sync(tsdata->input);
 
+	/*
+	 * Keep the interrupt masked for a while so that the moves in between
+	 * coalesce in the controller into the next report.
+	 */
+	if (tsdata->report_interval_ms && touched)
+		msleep(tsdata->report_interval_ms);
+
 out:
 	return IRQ_HANDLED;
 }
@@ -509,6 +569,9 @@ static EDT_ATTR(threshold, S_IWUSR | S_IRUGO, WORK_REGISTER_THRESHOLD,
 /* m06: range 3 to 14, m12: (0x64: 100Hz) */
 static EDT_ATTR(report_rate, S_IWUSR | S_IRUGO, WORK_REGISTER_REPORT_RATE,
 		NO_REGISTER, NO_REGISTER, 0, 255);
+/* all: minimum time between reports while touched, 0 to disable */
+static EDT_ATTR(report_interval_ms, S_IWUSR | S_IRUGO, NO_REGISTER, NO_REGISTER,
+		NO_REGISTER, 0, EDT_MAX_REPORT_INTERVAL);
 
 static struct attribute *edt_ft5x06_attrs[] = {
 	&edt_ft5x06_attr_gain.dattr.attr,
@@ -517,6 +580,7 @@ static struct attribute *edt_ft5x06_attrs[] = {
 	&edt_ft5x06_attr_offset_y.dattr.attr,
 	&edt_ft5x06_attr_threshold.dattr.attr,
 	&edt_ft5x06_attr_report_rate.dattr.attr,
+	&edt_ft5x06_attr_report_interval_ms.dattr.attr,
 	NULL
 };
 
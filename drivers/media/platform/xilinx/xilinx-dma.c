@@ -365,6 +365,21 @@ static int xvip_dma_buffer_prepare(struct vb2_buffer *vb)
 	struct vb2_v4l2_buffer *vbuf = to_vb2_v4l2_buffer(vb);
 	struct xvip_dma *dma = vb2_get_drv_priv(vb->vb2_queue);
 	struct xvip_dma_buffer *buf = to_xvip_dma_buffer(vbuf);
+	unsigned int i;
+
+	/*
+	 * USERPTR and DMABUF buffers come from elsewhere, make sure the DMA
+	 * engine can actually write to them before queueing a descriptor.
+	 */
+	for (i = 0; i < vb->num_planes; i++) {
+		if (!IS_ALIGNED(vb2_dma_contig_plane_dma_addr(vb, i),
+				dma->align)) {
+			dev_dbg(dma->xdev->dev,
+				"buffer plane %u not aligned to %u bytes\n",
+				i, dma->align);
+			return -EINVAL;
+		}
+	}
 
 	buf->dma = dma;
 
@@ -1401,6 +1416,17 @@ int xvip_dma_init(struct xvip_composite_device *xdev, struct xvip_dma *dma,
 	dma->queue.buf_struct_size = sizeof(struct xvip_dma_buffer);
 	dma->queue.ops = &xvip_dma_queue_qops;
 	dma->queue.mem_ops = &vb2_dma_contig_memops;
+	/*
+	 * Exported buffers are imported by engines that may not sit behind
+	 * the same IOMMU (or any), so keep MMAP buffers physically contiguous.
+	 */
+	dma->queue.dma_attrs = DMA_ATTR_FORCE_CONTIGUOUS;
+	/*
+	 * Prime the frame buffer DMA with a second descriptor before the
+	 * pipeline starts, so that it never repeats a frame into a buffer
+	 * that is about to be returned to userspace.
+	 */
+	dma->queue.min_buffers_needed = 2;
 	dma->queue.timestamp_flags = V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC
 				   | V4L2_BUF_FLAG_TSTAMP_SRC_EOF;
 	dma->queue.dev = dma->xdev->dev;
@@ -379,8 +379,7 @@ struct xm2msc_chan_ctx {
  * @cap_streamed_chan: bitmap for all capture streamed channel
  * @running_chan: currently running channels
  * @device_busy: HW device is busy or not
- * @isr_wait: flag to follow the ISR complete or not
- * @isr_finished: Wait queue used to wait for IP to complete processing
+ * @isr_finished: Wait queue used to wait for the device to go idle
  * @v4l2_dev: main struct to for V4L2 device drivers
  * @dev_mutex: lock for V4L2 device
  * @mutex: lock for channel ctx
@@ -408,7 +407,6 @@ struct xm2m_msc_dev {
 	u32 cap_streamed_chan;
 	u32 running_chan;
 	bool device_busy;
-	bool isr_wait;
 	wait_queue_head_t isr_finished;
 
 	struct v4l2_device v4l2_dev;
@@ -995,6 +993,7 @@ static void xm2msc_set_chan(struct xm2msc_chan_ctx *ctx, bool state)
 static void
 xm2msc_set_chan_stream(struct xm2msc_chan_ctx *ctx, bool state, int type)
 {
+	unsigned long flags;
 	u32 *ptr;
 
 	if (type == XM2MSC_CHAN_OUT)
@@ -1002,13 +1001,13 @@ xm2msc_set_chan_stream(struct xm2msc_chan_ctx *ctx, bool state, int type)
 	else
 		ptr = &ctx->xm2msc_dev->cap_streamed_chan;
 
-	spin_lock(&ctx->xm2msc_dev->lock);
+	spin_lock_irqsave(&ctx->xm2msc_dev->lock, flags);
 	if (state)
 		xm2msc_setbit(ctx->num, ptr);
 	else
 		xm2msc_clrbit(ctx->num, ptr);
 
-	spin_unlock(&ctx->xm2msc_dev->lock);
+	spin_unlock_irqrestore(&ctx->xm2msc_dev->lock, flags);
 }
 
 static int
@@ -1045,6 +1044,21 @@ static void xm2msc_reset(struct xm2m_msc_dev *xm2msc)
 	gpiod_set_value_cansleep(xm2msc->rst_gpio, XM2MSC_RESET_DEASSERT);
 }
 
+static void xm2msc_set_idle(struct xm2m_msc_dev *xm2msc)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&xm2msc->lock, flags);
+	xm2msc->device_busy = false;
+	spin_unlock_irqrestore(&xm2msc->lock, flags);
+	wake_up(&xm2msc->isr_finished);
+}
+
+static void xm2msc_wait_idle(struct xm2m_msc_dev *xm2msc)
+{
+	wait_event(xm2msc->isr_finished, !READ_ONCE(xm2msc->device_busy));
+}
+
 /*
  * mem2mem callbacks
  */
@@ -1080,8 +1094,9 @@ static void xm2msc_chan_abort_bufs(struct xm2msc_chan_ctx *chan_ctx)
 {
 	struct xm2m_msc_dev *xm2msc = chan_ctx->xm2msc_dev;
 	struct vb2_v4l2_buffer *dst_vb, *src_vb;
+	unsigned long flags;
 
-	spin_lock(&xm2msc->lock);
+	spin_lock_irqsave(&xm2msc->lock, flags);
 	dev_dbg(xm2msc->dev, "aborting all buffers\n");
 
 	while (v4l2_m2m_num_src_bufs_ready(chan_ctx->m2m_ctx) > 0) {
@@ -1097,21 +1112,24 @@ static void xm2msc_chan_abort_bufs(struct xm2msc_chan_ctx *chan_ctx)
 	}
 
 	v4l2_m2m_job_finish(chan_ctx->m2m_dev, chan_ctx->m2m_ctx);
-	spin_unlock(&xm2msc->lock);
+	spin_unlock_irqrestore(&xm2msc->lock, flags);
 }
 
 static void xm2msc_job_abort(void *priv)
 {
 	struct xm2msc_chan_ctx *chan_ctx = priv;
 
-	xm2msc_chan_abort_bufs(chan_ctx);
-
 	/*
 	 * Stream off the channel as job_abort may not always
-	 * be called after streamoff
+	 * be called after streamoff. This also keeps the interrupt handler
+	 * from chaining another batch, so the one in flight is the last to
+	 * touch the buffers.
 	 */
 	xm2msc_set_chan_stream(chan_ctx, false, XM2MSC_CHAN_OUT);
 	xm2msc_set_chan_stream(chan_ctx, false, XM2MSC_CHAN_CAP);
+	xm2msc_wait_idle(chan_ctx->xm2msc_dev);
+
+	xm2msc_chan_abort_bufs(chan_ctx);
 }
 
 static int xm2msc_set_bufaddr(struct xm2m_msc_dev *xm2msc)
@@ -1250,10 +1268,12 @@ static void xm2msc_device_run(void *priv)
 
 	spin_lock_irqsave(&xm2msc->lock, flags);
 	if (xm2msc->device_busy) {
+		/* Picked up by the batch after the one in flight */
 		spin_unlock_irqrestore(&xm2msc->lock, flags);
 		return;
 	}
 	xm2msc->device_busy = true;
+	spin_unlock_irqrestore(&xm2msc->lock, flags);
 
 	if (xm2msc->running_chan != NUM_STREAM(xm2msc)) {
 		dev_dbg(xm2msc->dev, "Running chan was %d\n",
@@ -1265,16 +1285,14 @@ static void xm2msc_device_run(void *priv)
 		xm2msc_writereg(base + XM2MSC_NUM_OUTS, xm2msc->running_chan);
 		ret = xm2msc_program_allchan(xm2msc);
 		if (ret) {
-			spin_unlock_irqrestore(&xm2msc->lock, flags);
-			xm2msc->device_busy = false;
+			xm2msc_set_idle(xm2msc);
 			return;
 		}
 	}
-	spin_unlock_irqrestore(&xm2msc->lock, flags);
 
 	dev_dbg(xm2msc->dev, "Running chan = %d\n", xm2msc->running_chan);
 	if (!xm2msc->running_chan) {
-		xm2msc->device_busy = false;
+		xm2msc_set_idle(xm2msc);
 		return;
 	}
 
@@ -1286,11 +1304,11 @@ static void xm2msc_device_run(void *priv)
 		 * channel while streaming is going on
 		 */
 		if (xm2msc->out_streamed_chan || xm2msc->cap_streamed_chan)
-			dev_err(xm2msc->dev,
+			dev_dbg(xm2msc->dev,
 				"Buffer not available, streaming chan 0x%x\n",
 				xm2msc->cap_streamed_chan);
 
-		xm2msc->device_busy = false;
+		xm2msc_set_idle(xm2msc);
 		return;
 	}
 
@@ -1301,25 +1319,15 @@ static void xm2msc_device_run(void *priv)
 	xm2msc_pr_screg(xm2msc->dev, base);
 	xm2msc_pr_allchanreg(xm2msc);
 
+	/* Completion, and the next batch, are handled by xm2msc_isr() */
 	xm2msc_start(xm2msc);
-
-	xm2msc->isr_wait = true;
-	wait_event(xm2msc->isr_finished, !xm2msc->isr_wait);
-
-	xm2msc_job_done(xm2msc);
-
-	xm2msc->device_busy = false;
-
-	if (xm2msc_alljob_ready(xm2msc))
-		xm2msc_device_run(xm2msc->xm2msc_chan);
-
-	xm2msc_job_finish(xm2msc);
 }
 
 static irqreturn_t xm2msc_isr(int irq, void *data)
 {
 	struct xm2m_msc_dev *xm2msc = (struct xm2m_msc_dev *)data;
 	void __iomem *base = xm2msc->regs;
+	bool chained;
 	u32 status;
 
 	status = xm2msc_readreg(base + XM2MSC_ISR);
@@ -1330,8 +1338,27 @@ static irqreturn_t xm2msc_isr(int irq, void *data)
 
 	xm2msc_stop(xm2msc);
 
-	xm2msc->isr_wait = false;
-	wake_up(&xm2msc->isr_finished);
+	xm2msc_job_done(xm2msc);
+	xm2msc_job_finish(xm2msc);
+
+	/*
+	 * If every channel of the batch has another job queued, program
+	 * their buffers and launch the next batch right away instead of
+	 * waiting for the m2m framework to schedule device_run again. A
+	 * change in the number of streaming channels needs a reset of the
+	 * IP, which sleeps, so leave that to device_run.
+	 */
+	spin_lock(&xm2msc->lock);
+	chained = xm2msc->running_chan == NUM_STREAM(xm2msc) &&
+		  !xm2msc_set_bufaddr(xm2msc);
+	if (chained)
+		xm2msc_start(xm2msc);
+	else
+		xm2msc->device_busy = false;
+	spin_unlock(&xm2msc->lock);
+
+	if (!chained)
+		wake_up(&xm2msc->isr_finished);
 
 	return IRQ_HANDLED;
 }
@@ -1896,12 +1923,14 @@ static void xm2msc_stop_streaming(struct vb2_queue *q)
 {
 	struct xm2msc_chan_ctx *chan_ctx = vb2_get_drv_priv(q);
 
-	xm2msc_return_all_buffers(chan_ctx, q, VB2_BUF_STATE_ERROR);
-
 	if (V4L2_TYPE_IS_OUTPUT(q->type))
 		xm2msc_set_chan_stream(chan_ctx, false, XM2MSC_CHAN_OUT);
 	else
 		xm2msc_set_chan_stream(chan_ctx, false, XM2MSC_CHAN_CAP);
+
+	/* Don't hand back buffers the IP may still be writing to */
+	xm2msc_wait_idle(chan_ctx->xm2msc_dev);
+	xm2msc_return_all_buffers(chan_ctx, q, VB2_BUF_STATE_ERROR);
 }
 
 static const struct vb2_ops xm2msc_qops = {
@@ -10,6 +10,8 @@
 
 #include <linux/gpio/consumer.h>
 #include <linux/of.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
 #include <linux/xilinx-v4l2-events.h>
 
 #include <media/v4l2-async.h>
@@ -262,6 +264,65 @@ static int xscd_unsubscribe_event(struct v4l2_subdev *sd,
 	return ret;
 }
 
+static int xscd_get_results(struct xscd_chan *chan,
+			    struct xscd_results *req)
+{
+	struct xscd_result *results;
+	unsigned long flags;
+	u32 first, count, i;
+	int ret = 0;
+
+	if (req->reserved)
+		return -EINVAL;
+
+	count = min_t(u32, req->count, XSCD_RESULT_RING_SIZE);
+	results = kmalloc_array(max_t(u32, count, 1), sizeof(*results),
+				GFP_KERNEL);
+	if (!results)
+		return -ENOMEM;
+
+	spin_lock_irqsave(&chan->result_lock, flags);
+	first = req->sequence;
+	req->lost = 0;
+	if ((s32)(chan->result_seq - first) < 0) {
+		/* Nothing that recent yet */
+		count = 0;
+	} else {
+		if (chan->result_seq - first > XSCD_RESULT_RING_SIZE) {
+			req->lost = chan->result_seq - XSCD_RESULT_RING_SIZE -
+				    first;
+			first += req->lost;
+		}
+		count = min(count, chan->result_seq - first);
+	}
+	for (i = 0; i < count; i++)
+		results[i] = chan->results[(first + i) %
+					   XSCD_RESULT_RING_SIZE];
+	spin_unlock_irqrestore(&chan->result_lock, flags);
+
+	if (copy_to_user(u64_to_user_ptr(req->results), results,
+			 count * sizeof(*results)))
+		ret = -EFAULT;
+
+	req->sequence = first;
+	req->count = count;
+	kfree(results);
+
+	return ret;
+}
+
+static long xscd_ioctl(struct v4l2_subdev *sd, unsigned int cmd, void *arg)
+{
+	struct xscd_chan *chan = to_xscd_chan(sd);
+
+	switch (cmd) {
+	case XSCD_IOCTL_GET_RESULTS:
+		return xscd_get_results(chan, arg);
+	}
+
+	return -ENOTTY;
+}
+
 static int xscd_open(struct v4l2_subdev *subdev, struct v4l2_subdev_fh *fh)
 {
 	return 0;
@@ -290,6 +351,7 @@ static const struct v4l2_ctrl_config xscd_ctrls[] = {
 };
 
 static const struct v4l2_subdev_core_ops xscd_core_ops = {
+	.ioctl = xscd_ioctl,
 	.subscribe_event = xscd_subscribe_event,
 	.unsubscribe_event = xscd_unsubscribe_event
 };
@@ -326,6 +388,7 @@ static const struct media_entity_operations xscd_media_ops = {
 
 void xscd_chan_event_notify(struct xscd_chan *chan)
 {
+	struct xscd_result *result;
 	u32 *eventdata;
 	u32 sad;
 
@@ -339,6 +402,15 @@ void xscd_chan_event_notify(struct xscd_chan *chan)
 	else
 		eventdata[0] = XSCD_NO_SCENE_CHANGE;
 
+	spin_lock(&chan->result_lock);
+	result = &chan->results[chan->result_seq % XSCD_RESULT_RING_SIZE];
+	result->timestamp = ktime_get_ns();
+	result->sequence = chan->result_seq++;
+	result->sad = sad;
+	result->scene_change = eventdata[0];
+	result->reserved = 0;
+	spin_unlock(&chan->result_lock);
+
 	chan->event.type = V4L2_EVENT_XLNXSCD;
 	v4l2_subdev_notify_event(&chan->subdev, &chan->event);
 }
@@ -361,6 +433,7 @@ int xscd_chan_init(struct xscd_device *xscd, unsigned int chan_id,
 	unsigned int i;
 
 	mutex_init(&chan->lock);
+	spin_lock_init(&chan->result_lock);
 	chan->xscd = xscd;
 	chan->id = chan_id;
 	chan->iomem = chan->xscd->iomem + chan->id * XSCD_CHAN_OFFSET;
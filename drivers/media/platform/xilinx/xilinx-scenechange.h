@@ -19,6 +19,7 @@
 #include <linux/spinlock.h>
 #include <linux/wait.h>
 #include <linux/xilinx-v4l2-controls.h>
+#include <linux/xilinx-scd.h>
 
 #include <media/v4l2-ctrls.h>
 #include <media/v4l2-subdev.h>
@@ -62,6 +63,7 @@ struct gpio_desc;
 #define XSCD_CHAN_EN_OFFSET		0x780
 
 #define XSCD_MAX_CHANNELS		8
+#define XSCD_RESULT_RING_SIZE		64
 
 #define XSCD_RESET_DEASSERT		(0)
 #define XSCD_RESET_ASSERT		(1)
@@ -152,6 +154,9 @@ static inline struct xscd_dma_chan *to_xscd_dma_chan(struct dma_chan *chan)
  * @event: scene change event
  * @dmachan: dma channel part of the scenechange stream
  * @lock: lock to protect active stream count variable
+ * @result_lock: Protects @results and @result_seq
+ * @results: Ring of the most recent detection results
+ * @result_seq: Sequence number of the next result
  */
 struct xscd_chan {
 	int id;
@@ -167,6 +172,10 @@ struct xscd_chan {
 
 	/* Lock to protect active stream count */
 	struct mutex lock;
+
+	spinlock_t result_lock;
+	struct xscd_result results[XSCD_RESULT_RING_SIZE];
+	u32 result_seq;
 };
 
 static inline struct xscd_chan *to_xscd_chan(struct v4l2_subdev *subdev)
@@ -9,6 +9,7 @@
  *           Laurent Pinchart <laurent.pinchart@ideasonboard.com>
  */
 
+#include <linux/dma-mapping.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/of.h>
@@ -20,6 +21,7 @@
 #include <media/v4l2-common.h>
 #include <media/v4l2-device.h>
 #include <media/v4l2-fwnode.h>
+#include <media/videobuf2-dma-contig.h>
 
 #include "xilinx-dma.h"
 #include "xilinx-vipp.h"
@@ -819,6 +821,14 @@ static int xvip_composite_probe(struct platform_device *pdev)
 	if (ret < 0)
 		return ret;
 
+	/*
+	 * Imported DMABUFs only need to be contiguous in the DMA address
+	 * space, let vb2 accept buffers that the IOMMU maps in one segment.
+	 */
+	ret = vb2_dma_contig_set_max_seg_size(xdev->dev, DMA_BIT_MASK(32));
+	if (ret < 0)
+		goto error;
+
 	ret = xvip_graph_init(xdev);
 	if (ret < 0)
 		goto error;
@@ -830,6 +840,7 @@ static int xvip_composite_probe(struct platform_device *pdev)
 	return 0;
 
 error:
+	vb2_dma_contig_clear_max_seg_size(xdev->dev);
 	xvip_composite_v4l2_cleanup(xdev);
 	return ret;
 }
@@ -840,6 +851,7 @@ static int xvip_composite_remove(struct platform_device *pdev)
 
 	mutex_destroy(&xdev->lock);
 	xvip_graph_cleanup(xdev);
+	vb2_dma_contig_clear_max_seg_size(xdev->dev);
 	xvip_composite_v4l2_cleanup(xdev);
 
 	return 0;
@@ -55,6 +55,17 @@
 #define PL353_SMC_SET_CYCLES_T5_SHIFT	17
 #define PL353_SMC_SET_CYCLES_T6_MASK	0xF
 #define PL353_SMC_SET_CYCLES_T6_SHIFT	20
+#define PL353_SMC_SET_CYCLES_SRAM_T6_MASK	0x1	/* we_time */
+
+/* Set opmode register specific constants (SRAM interface) */
+#define PL353_SMC_SET_OPMODE_MW_MASK	0x3
+#define PL353_SMC_SET_OPMODE_MW_SHIFT	0
+#define PL353_SMC_SET_OPMODE_RD_BL_SHIFT	3
+#define PL353_SMC_SET_OPMODE_WR_BL_SHIFT	7
+
+/* SRAM interface chip selects */
+#define PL353_SMC_SRAM_CS_COUNT		2
+#define PL353_SMC_SRAM_CYCLES_COUNT	7
 
 /* ECC status register specific constants */
 #define PL353_SMC_ECC_STATUS_BUSY	BIT(6)
@@ -68,6 +79,9 @@
 #define PL353_SMC_DC_UPT_NAND_REGS	((4 << 23) |	/* CS: NAND chip */ \
 				 (2 << 21))	/* UpdateRegs operation */
 
+#define PL353_SMC_DC_UPT_SRAM_REGS(cs)	(((cs) << 23) |	/* CS: SRAM chip */ \
+				 (2 << 21))	/* UpdateRegs operation */
+
 #define PL353_NAND_ECC_CMD1	((0x80)       |	/* Write command */ \
 				 (0 << 8)     |	/* Read command */ \
 				 (0x30 << 16) |	/* Read End command */ \
@@ -335,6 +349,111 @@ static void pl353_smc_init_nand_interface(struct amba_device *adev,
 	       pl353_smc_base + PL353_SMC_ECC_MEMCMD2_OFFS);
 }
 
+/**
+ * pl353_smc_burst_len - Encode a burst length for the set opmode register
+ * @beats: Burst length in beats (1 | 4 | 8 | 16 | 32)
+ * Return: the encoded burst length or negative errno.
+ */
+static int pl353_smc_burst_len(u32 beats)
+{
+	switch (beats) {
+	case 1:
+		return 0;
+	case 4:
+		return 1;
+	case 8:
+		return 2;
+	case 16:
+		return 3;
+	case 32:
+		return 4;
+	default:
+		return -EINVAL;
+	}
+}
+
+/**
+ * pl353_smc_init_sram_interface - Initialize an SRAM interface chip select
+ * @adev: Pointer to the amba_device struct
+ * @sram_node: Pointer to the device_node struct of the attached device
+ *
+ * Sets the timing and the operating mode of the chip select given by
+ * "arm,sram-cs" from the device tree:
+ *
+ * - "arm,sram-cycles": t_rc, t_wc, t_ceoe, t_wp, t_pc, t_tr and we_time in
+ *   memory clock cycles. t_pc is the page cycle time of page mode reads.
+ * - "arm,sram-bus-width": 8 (default) or 16
+ * - "arm,sram-read-burst-length" and "arm,sram-write-burst-length": 1
+ *   (default), 4, 8, 16 or 32 beats. With a read burst length above 1,
+ *   the SMC turns each AXI burst into a page mode read.
+ *
+ * The SMC then splits AXI bursts (e.g., from a dmaengine memcpy by the AXI
+ * CDMA to the region of the chip select) according to these settings
+ * instead of doing single beats.
+ */
+static void pl353_smc_init_sram_interface(struct amba_device *adev,
+					  struct device_node *sram_node)
+{
+	u32 timings[PL353_SMC_SRAM_CYCLES_COUNT];
+	u32 cs, bw = 8, rd_beats = 1, wr_beats = 1, opmode, cycles;
+	int rd_bl, wr_bl, err;
+
+	err = of_property_read_u32(sram_node, "arm,sram-cs", &cs);
+	if (err || cs >= PL353_SMC_SRAM_CS_COUNT) {
+		dev_err(&adev->dev, "invalid arm,sram-cs\n");
+		return;
+	}
+
+	of_property_read_u32(sram_node, "arm,sram-bus-width", &bw);
+	of_property_read_u32(sram_node, "arm,sram-read-burst-length",
+			     &rd_beats);
+	of_property_read_u32(sram_node, "arm,sram-write-burst-length",
+			     &wr_beats);
+
+	rd_bl = pl353_smc_burst_len(rd_beats);
+	wr_bl = pl353_smc_burst_len(wr_beats);
+	if (rd_bl < 0 || wr_bl < 0 || (bw != 8 && bw != 16)) {
+		dev_err(&adev->dev, "invalid SRAM mode for CS%u\n", cs);
+		return;
+	}
+
+	opmode = ((bw == 16 ? PL353_SMC_MEM_WIDTH_16 : PL353_SMC_MEM_WIDTH_8) &
+		  PL353_SMC_SET_OPMODE_MW_MASK) << PL353_SMC_SET_OPMODE_MW_SHIFT;
+	opmode |= rd_bl << PL353_SMC_SET_OPMODE_RD_BL_SHIFT;
+	opmode |= wr_bl << PL353_SMC_SET_OPMODE_WR_BL_SHIFT;
+	writel(opmode, pl353_smc_base + PL353_SMC_SET_OPMODE_OFFS);
+
+	/*
+	 * Keep the reset timing if the device tree does not give one. Unlike
+	 * pl353_smc_set_cycles(), this must not update the NAND chip.
+	 */
+	if (!of_property_read_u32_array(sram_node, "arm,sram-cycles", timings,
+					ARRAY_SIZE(timings))) {
+		cycles = (timings[0] & PL353_SMC_SET_CYCLES_T0_MASK) <<
+				PL353_SMC_SET_CYCLES_T0_SHIFT;
+		cycles |= (timings[1] & PL353_SMC_SET_CYCLES_T1_MASK) <<
+				PL353_SMC_SET_CYCLES_T1_SHIFT;
+		cycles |= (timings[2] & PL353_SMC_SET_CYCLES_T2_MASK) <<
+				PL353_SMC_SET_CYCLES_T2_SHIFT;
+		cycles |= (timings[3] & PL353_SMC_SET_CYCLES_T3_MASK) <<
+				PL353_SMC_SET_CYCLES_T3_SHIFT;
+		cycles |= (timings[4] & PL353_SMC_SET_CYCLES_T4_MASK) <<
+				PL353_SMC_SET_CYCLES_T4_SHIFT;
+		cycles |= (timings[5] & PL353_SMC_SET_CYCLES_T5_MASK) <<
+				PL353_SMC_SET_CYCLES_T5_SHIFT;
+		cycles |= (timings[6] & PL353_SMC_SET_CYCLES_SRAM_T6_MASK) <<
+				PL353_SMC_SET_CYCLES_T6_SHIFT;
+		writel(cycles, pl353_smc_base + PL353_SMC_SET_CYCLES_OFFS);
+	}
+
+	/* Latch the set cycles and set opmode registers for the chip select */
+	writel(PL353_SMC_DC_UPT_SRAM_REGS(cs), pl353_smc_base +
+	       PL353_SMC_DIRECT_CMD_OFFS);
+
+	dev_dbg(&adev->dev, "SRAM CS%u: %u bit, read burst %u, write burst %u\n",
+		cs, bw, rd_beats, wr_beats);
+}
+
 static const struct of_device_id pl353_smc_supported_children[] = {
 	{
 		.compatible = "cfi-flash"
@@ -400,21 +519,24 @@ static int pl353_smc_probe(struct amba_device *adev, const struct amba_id *id)
 	/* Find compatible children. Only a single child is supported */
 	for_each_available_child_of_node(of_node, child) {
 		match = of_match_node(pl353_smc_supported_children, child);
-		if (!match) {
+		if (!match && !of_find_property(child, "arm,sram-cs", NULL)) {
 			dev_warn(&adev->dev, "unsupported child node\n");
 			continue;
 		}
 		break;
 	}
-	if (!match) {
+	if (!child) {
 		dev_err(&adev->dev, "no matching children\n");
 		goto out_clk_disable;
 	}
 
-	init = (void (*)(struct amba_device *,
-			 struct device_node *))match->data;
+	init = match ? (void (*)(struct amba_device *,
+				 struct device_node *))match->data : NULL;
 	if (init)
 		init(adev, child);
+	/* Any device on the SRAM interface (e.g., a flash or a FIFO) */
+	if (of_find_property(child, "arm,sram-cs", NULL))
+		pl353_smc_init_sram_interface(adev, child);
 	of_platform_device_create(child, NULL, &adev->dev);
 
 	return 0;
@@ -249,6 +249,10 @@ static int da9063_clear_fault_log(struct da9063 *da9063)
 				"Fault log entry detected: DA9063_WAIT_SHUT\n");
 	}
 
+	/* Nothing to clear. Save the bus transaction. */
+	if (!fault_log)
+		return 0;
+
 	ret = regmap_write(da9063->regmap,
 			   DA9063_REG_FAULT_LOG,
 			   fault_log);
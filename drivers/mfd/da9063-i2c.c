@@ -41,7 +41,7 @@ static const struct regmap_range da9063_ad_writeable_ranges[] = {
 };
 
 static const struct regmap_range da9063_ad_volatile_ranges[] = {
-	regmap_reg_range(DA9063_REG_PAGE_CON, DA9063_REG_EVENT_D),
+	regmap_reg_range(DA9063_REG_STATUS_A, DA9063_REG_EVENT_D),
 	regmap_reg_range(DA9063_REG_CONTROL_A, DA9063_REG_CONTROL_B),
 	regmap_reg_range(DA9063_REG_CONTROL_E, DA9063_REG_CONTROL_F),
 	regmap_reg_range(DA9063_REG_BCORE2_CONT, DA9063_REG_LDO11_CONT),
@@ -86,7 +86,7 @@ static const struct regmap_range da9063_bb_writeable_ranges[] = {
 };
 
 static const struct regmap_range da9063_bb_volatile_ranges[] = {
-	regmap_reg_range(DA9063_REG_PAGE_CON, DA9063_REG_EVENT_D),
+	regmap_reg_range(DA9063_REG_STATUS_A, DA9063_REG_EVENT_D),
 	regmap_reg_range(DA9063_REG_CONTROL_A, DA9063_REG_CONTROL_B),
 	regmap_reg_range(DA9063_REG_CONTROL_E, DA9063_REG_CONTROL_F),
 	regmap_reg_range(DA9063_REG_BCORE2_CONT, DA9063_REG_LDO11_CONT),
@@ -130,7 +130,7 @@ static const struct regmap_range da9063l_bb_writeable_ranges[] = {
 };
 
 static const struct regmap_range da9063l_bb_volatile_ranges[] = {
-	regmap_reg_range(DA9063_REG_PAGE_CON, DA9063_REG_EVENT_D),
+	regmap_reg_range(DA9063_REG_STATUS_A, DA9063_REG_EVENT_D),
 	regmap_reg_range(DA9063_REG_CONTROL_A, DA9063_REG_CONTROL_B),
 	regmap_reg_range(DA9063_REG_CONTROL_E, DA9063_REG_CONTROL_F),
 	regmap_reg_range(DA9063_REG_BCORE2_CONT, DA9063_REG_LDO11_CONT),
@@ -168,6 +168,12 @@ static const struct regmap_range_cfg da9063_range_cfg[] = {
 	}
 };
 
+/*
+ * The page register (PAGE_CON) is not volatile. Only the driver changes the
+ * page (REVERT is never set) so the cached value is always current. This
+ * way, regmap only writes PAGE_CON when the page actually changes. If it was
+ * volatile, each access would first read PAGE_CON over the bus.
+ */
 static struct regmap_config da9063_regmap_config = {
 	.reg_bits = 8,
 	.val_bits = 8,
@@ -184,6 +190,54 @@ static const struct of_device_id da9063_dt_ids[] = {
 	{ }
 };
 MODULE_DEVICE_TABLE(of, da9063_dt_ids);
+
+/*
+ * The PMIC keeps its registers during suspend. We only have to make sure
+ * that nothing accesses the bus while the I2C controller is suspended.
+ * Writes in between go to the cache and regcache_sync() writes them (in
+ * bulk) on resume. If there were none, resume does not touch the bus.
+ */
+static int __maybe_unused da9063_i2c_suspend_noirq(struct device *dev)
+{
+	struct da9063 *da9063 = dev_get_drvdata(dev);
+
+	regcache_cache_only(da9063->regmap, true);
+
+	return 0;
+}
+
+/*
+ * Leave cache-only mode as early as possible. The wake-up IRQ runs as soon
+ * as the IRQs are enabled again (before the resume callbacks) and must read
+ * the (volatile) event registers.
+ */
+static int __maybe_unused da9063_i2c_resume_noirq(struct device *dev)
+{
+	struct da9063 *da9063 = dev_get_drvdata(dev);
+
+	regcache_cache_only(da9063->regmap, false);
+
+	return 0;
+}
+
+static int __maybe_unused da9063_i2c_resume(struct device *dev)
+{
+	struct da9063 *da9063 = dev_get_drvdata(dev);
+	int ret;
+
+	ret = regcache_sync(da9063->regmap);
+	if (ret)
+		dev_err(dev, "Failed to restore registers: %d\n", ret);
+
+	return ret;
+}
+
+static const struct dev_pm_ops da9063_i2c_pm_ops = {
+	SET_NOIRQ_SYSTEM_SLEEP_PM_OPS(da9063_i2c_suspend_noirq,
+				      da9063_i2c_resume_noirq)
+	SET_SYSTEM_SLEEP_PM_OPS(NULL, da9063_i2c_resume)
+};
+
 static int da9063_i2c_probe(struct i2c_client *i2c,
 			    const struct i2c_device_id *id)
 {
@@ -235,6 +289,7 @@ static struct i2c_driver da9063_i2c_driver = {
 	.driver = {
 		.name = "da9063",
 		.of_match_table = of_match_ptr(da9063_dt_ids),
+		.pm = &da9063_i2c_pm_ops,
 	},
 	.probe    = da9063_i2c_probe,
 	.id_table = da9063_i2c_id,
@@ -11,6 +11,9 @@
  */
 
 #include <linux/miscdevice.h>
+#include <linux/dma-buf.h>
+#include <linux/dmaengine.h>
+#include <linux/eventfd.h>
 #include <linux/io.h>
 #include <linux/interrupt.h>
 #include <linux/kernel.h>
@@ -21,6 +24,7 @@
 #include <linux/clk.h>
 #include <linux/compat.h>
 #include <linux/highmem.h>
+#include <linux/scatterlist.h>
 
 #include <uapi/misc/xilinx_sdfec.h>
 
@@ -164,6 +168,10 @@ static DEFINE_IDA(dev_nrs);
 /* The maximum number of pinned pages */
 #define MAX_NUM_PAGES ((XSDFEC_QC_TABLE_DEPTH / PAGE_SIZE) + 1)
 
+/* Batches not yet retrieved with XSDFEC_GET_BATCH */
+#define XSDFEC_MAX_BATCHES (32)
+#define XSDFEC_MAX_BATCH_BLOCKS (256)
+
 /**
  * struct xsdfec_clks - For managing SD-FEC clocks
  * @core_clk: Main processing clock for core
@@ -186,6 +194,42 @@ struct xsdfec_clks {
 	struct clk *status_clk;
 };
 
+/**
+ * struct xsdfec_buf - dma-buf mapped for one stream of a batch
+ * @dbuf: The dma-buf
+ * @attach: Attachment to the DMA device
+ * @map: Mapping of the whole dma-buf
+ * @sgt: The blocks of the batch, split at block boundaries
+ * @dir: Direction of the mapping
+ */
+struct xsdfec_buf {
+	struct dma_buf *dbuf;
+	struct dma_buf_attachment *attach;
+	struct sg_table *map;
+	struct sg_table sgt;
+	enum dma_data_direction dir;
+};
+
+/**
+ * struct xsdfec_batch_req - Batch of blocks queued on the DMA channels
+ * @node: Entry in the pending or done list
+ * @xsdfec: The SDFEC processing the batch
+ * @din: Input blocks
+ * @dout: Output blocks
+ * @eventfd: Signalled on completion, may be NULL
+ * @id: User supplied id
+ * @status: Completion status
+ */
+struct xsdfec_batch_req {
+	struct list_head node;
+	struct xsdfec_dev *xsdfec;
+	struct xsdfec_buf din;
+	struct xsdfec_buf dout;
+	struct eventfd_ctx *eventfd;
+	u64 id;
+	int status;
+};
+
 /**
  * struct xsdfec_dev - Driver data for SDFEC
  * @miscdev: Misc device handle
@@ -206,6 +250,13 @@ struct xsdfec_clks {
  * @state_updated: indicates State updated by interrupt handler
  * @stats_updated: indicates Stats updated by interrupt handler
  * @intr_enabled: indicates IRQ enabled
+ * @din_chan: DMA channel feeding DIN, NULL if there is none
+ * @dout_chan: DMA channel draining DOUT, NULL if there is none
+ * @batch_mutex: Keeps the blocks of a batch together on both channels
+ * @batch_lock: Protects the batch lists and count
+ * @batch_pending: Batches queued on the DMA channels
+ * @batch_done: Completed batches
+ * @batch_count: Number of batches on both lists
  *
  * This structure contains necessary state for SDFEC driver to operate
  */
@@ -229,6 +280,15 @@ struct xsdfec_dev {
 	bool state_updated;
 	bool stats_updated;
 	bool intr_enabled;
+	struct dma_chan *din_chan;
+	struct dma_chan *dout_chan;
+	/* Mutex to serialize batch submission */
+	struct mutex batch_mutex;
+	/* Spinlock to protect the batch lists */
+	spinlock_t batch_lock;
+	struct list_head batch_pending;
+	struct list_head batch_done;
+	unsigned int batch_count;
 };
 
 static inline void xsdfec_regwrite(struct xsdfec_dev *xsdfec, u32 addr,
@@ -941,6 +1001,364 @@ static int xsdfec_set_default_config(struct xsdfec_dev *xsdfec)
 	return 0;
 }
 
+static unsigned int xsdfec_buf_split(struct xsdfec_buf *buf, size_t offset,
+				     size_t block_size, size_t end,
+				     struct scatterlist *out)
+{
+	struct scatterlist *sg;
+	size_t start = 0, seg_end, pos, next;
+	unsigned int nents = 0;
+	int i;
+
+	for_each_sg(buf->map->sgl, sg, buf->map->nents, i) {
+		seg_end = start + sg_dma_len(sg);
+		for (pos = max(start, offset); pos < min(seg_end, end);
+		     pos = next) {
+			next = offset + ((pos - offset) / block_size + 1) *
+			       block_size;
+			next = min3(next, seg_end, end);
+			if (out) {
+				sg_dma_address(out) = sg_dma_address(sg) +
+						      pos - start;
+				sg_dma_len(out) = next - pos;
+				out = sg_next(out);
+			}
+			nents++;
+		}
+		start = seg_end;
+	}
+
+	return start < end ? 0 : nents;
+}
+
+static void xsdfec_buf_put(struct xsdfec_buf *buf)
+{
+	if (!buf->dbuf)
+		return;
+
+	sg_free_table(&buf->sgt);
+	dma_buf_unmap_attachment(buf->attach, buf->map, buf->dir);
+	dma_buf_detach(buf->dbuf, buf->attach);
+	dma_buf_put(buf->dbuf);
+	buf->dbuf = NULL;
+}
+
+static int xsdfec_buf_get(struct xsdfec_buf *buf, struct dma_chan *chan,
+			  int fd, u32 offset, u32 block_size, u32 num_blocks,
+			  enum dma_data_direction dir)
+{
+	u64 end = offset + (u64)block_size * num_blocks;
+	unsigned int nents;
+	int err;
+
+	buf->dbuf = dma_buf_get(fd);
+	if (IS_ERR(buf->dbuf)) {
+		err = PTR_ERR(buf->dbuf);
+		buf->dbuf = NULL;
+		return err;
+	}
+
+	if (end > buf->dbuf->size) {
+		err = -EINVAL;
+		goto err_put;
+	}
+
+	buf->attach = dma_buf_attach(buf->dbuf, chan->device->dev);
+	if (IS_ERR(buf->attach)) {
+		err = PTR_ERR(buf->attach);
+		goto err_put;
+	}
+
+	buf->dir = dir;
+	buf->map = dma_buf_map_attachment(buf->attach, dir);
+	if (IS_ERR(buf->map)) {
+		err = PTR_ERR(buf->map);
+		goto err_detach;
+	}
+
+	nents = xsdfec_buf_split(buf, offset, block_size, end, NULL);
+	if (!nents) {
+		err = -EINVAL;
+		goto err_unmap;
+	}
+
+	err = sg_alloc_table(&buf->sgt, nents, GFP_KERNEL);
+	if (err)
+		goto err_unmap;
+	xsdfec_buf_split(buf, offset, block_size, end, buf->sgt.sgl);
+
+	return 0;
+
+err_unmap:
+	dma_buf_unmap_attachment(buf->attach, buf->map, dir);
+err_detach:
+	dma_buf_detach(buf->dbuf, buf->attach);
+err_put:
+	dma_buf_put(buf->dbuf);
+	buf->dbuf = NULL;
+	return err;
+}
+
+/*
+ * Each block is a DMA transfer of its own, so that TLAST ends every block.
+ * All but the last transfer are submitted here, the last one is returned for
+ * the caller to set a callback.
+ */
+static struct dma_async_tx_descriptor *
+xsdfec_buf_prep(struct xsdfec_buf *buf, struct dma_chan *chan,
+		u32 block_size, u32 num_blocks,
+		enum dma_transfer_direction dir)
+{
+	struct dma_async_tx_descriptor *tx = NULL;
+	struct scatterlist *sg = buf->sgt.sgl, *first;
+	unsigned int nents;
+	u32 i, len;
+
+	for (i = 0; i < num_blocks; i++) {
+		if (tx && dma_submit_error(dmaengine_submit(tx)))
+			return NULL;
+
+		first = sg;
+		for (nents = 0, len = 0; len < block_size; nents++) {
+			len += sg_dma_len(sg);
+			sg = sg_next(sg);
+		}
+
+		tx = dmaengine_prep_slave_sg(chan, first, nents, dir,
+					     i == num_blocks - 1 ?
+					     DMA_PREP_INTERRUPT : 0);
+		if (!tx)
+			return NULL;
+	}
+
+	return tx;
+}
+
+static void xsdfec_batch_free(struct xsdfec_batch_req *req)
+{
+	xsdfec_buf_put(&req->dout);
+	xsdfec_buf_put(&req->din);
+	if (req->eventfd)
+		eventfd_ctx_put(req->eventfd);
+	kfree(req);
+}
+
+static void xsdfec_batch_done(void *param,
+			      const struct dmaengine_result *result)
+{
+	struct xsdfec_batch_req *req = param;
+	struct xsdfec_dev *xsdfec = req->xsdfec;
+	unsigned long flags;
+
+	spin_lock_irqsave(&xsdfec->batch_lock, flags);
+	req->status = result->result == DMA_TRANS_NOERROR ? 0 : -EIO;
+	list_move_tail(&req->node, &xsdfec->batch_done);
+	spin_unlock_irqrestore(&xsdfec->batch_lock, flags);
+
+	if (req->eventfd)
+		eventfd_signal(req->eventfd, 1);
+	wake_up_interruptible(&xsdfec->waitq);
+}
+
+/* Stops both channels and completes all pending batches as canceled */
+static void xsdfec_batch_abort(struct xsdfec_dev *xsdfec)
+{
+	struct xsdfec_batch_req *req;
+
+	dmaengine_terminate_sync(xsdfec->din_chan);
+	dmaengine_terminate_sync(xsdfec->dout_chan);
+
+	spin_lock_irq(&xsdfec->batch_lock);
+	list_for_each_entry(req, &xsdfec->batch_pending, node) {
+		req->status = -ECANCELED;
+		if (req->eventfd)
+			eventfd_signal(req->eventfd, 1);
+	}
+	list_splice_tail_init(&xsdfec->batch_pending, &xsdfec->batch_done);
+	spin_unlock_irq(&xsdfec->batch_lock);
+
+	wake_up_interruptible(&xsdfec->waitq);
+}
+
+static int xsdfec_submit_batch(struct xsdfec_dev *xsdfec, void __user *arg)
+{
+	struct dma_async_tx_descriptor *tx;
+	struct xsdfec_batch_req *req;
+	struct xsdfec_batch batch;
+	int err;
+
+	if (!xsdfec->din_chan)
+		return -EOPNOTSUPP;
+
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+
+	if (xsdfec->state != XSDFEC_STARTED) {
+		dev_dbg(xsdfec->dev, "Device not started");
+		return -EINVAL;
+	}
+
+	if (!batch.num_blocks || batch.num_blocks > XSDFEC_MAX_BATCH_BLOCKS ||
+	    !batch.din_block_size || !batch.dout_block_size)
+		return -EINVAL;
+
+	req = kzalloc(sizeof(*req), GFP_KERNEL);
+	if (!req)
+		return -ENOMEM;
+
+	req->xsdfec = xsdfec;
+	req->id = batch.id;
+	INIT_LIST_HEAD(&req->node);
+
+	if (batch.eventfd >= 0) {
+		req->eventfd = eventfd_ctx_fdget(batch.eventfd);
+		if (IS_ERR(req->eventfd)) {
+			err = PTR_ERR(req->eventfd);
+			req->eventfd = NULL;
+			goto err_free;
+		}
+	}
+
+	err = xsdfec_buf_get(&req->din, xsdfec->din_chan, batch.din_fd,
+			     batch.din_offset, batch.din_block_size,
+			     batch.num_blocks, DMA_TO_DEVICE);
+	if (err)
+		goto err_free;
+
+	err = xsdfec_buf_get(&req->dout, xsdfec->dout_chan, batch.dout_fd,
+			     batch.dout_offset, batch.dout_block_size,
+			     batch.num_blocks, DMA_FROM_DEVICE);
+	if (err)
+		goto err_free;
+
+	mutex_lock(&xsdfec->batch_mutex);
+
+	spin_lock_irq(&xsdfec->batch_lock);
+	if (xsdfec->batch_count < XSDFEC_MAX_BATCHES) {
+		xsdfec->batch_count++;
+		list_add_tail(&req->node, &xsdfec->batch_pending);
+	} else {
+		err = -EBUSY;
+	}
+	spin_unlock_irq(&xsdfec->batch_lock);
+	if (err)
+		goto err_unlock;
+
+	/* Queue the output first so that it can take the first block */
+	tx = xsdfec_buf_prep(&req->dout, xsdfec->dout_chan,
+			     batch.dout_block_size, batch.num_blocks,
+			     DMA_DEV_TO_MEM);
+	if (tx) {
+		tx->callback_result = xsdfec_batch_done;
+		tx->callback_param = req;
+		if (dma_submit_error(dmaengine_submit(tx)))
+			tx = NULL;
+	}
+	if (tx)
+		tx = xsdfec_buf_prep(&req->din, xsdfec->din_chan,
+				     batch.din_block_size, batch.num_blocks,
+				     DMA_MEM_TO_DEV);
+	if (tx && dma_submit_error(dmaengine_submit(tx)))
+		tx = NULL;
+
+	if (!tx) {
+		/* The streams are out of step, drop everything queued */
+		dev_err(xsdfec->dev, "Unable to queue batch, aborting all");
+		xsdfec_batch_abort(xsdfec);
+		spin_lock_irq(&xsdfec->batch_lock);
+		list_del(&req->node);
+		xsdfec->batch_count--;
+		spin_unlock_irq(&xsdfec->batch_lock);
+		err = -ENOMEM;
+		goto err_unlock;
+	}
+
+	dma_async_issue_pending(xsdfec->dout_chan);
+	dma_async_issue_pending(xsdfec->din_chan);
+
+	mutex_unlock(&xsdfec->batch_mutex);
+
+	return 0;
+
+err_unlock:
+	mutex_unlock(&xsdfec->batch_mutex);
+err_free:
+	xsdfec_batch_free(req);
+	return err;
+}
+
+static int xsdfec_get_batch(struct xsdfec_dev *xsdfec, void __user *arg)
+{
+	struct xsdfec_batch_status status = { 0 };
+	struct xsdfec_batch_req *req;
+
+	spin_lock_irq(&xsdfec->batch_lock);
+	req = list_first_entry_or_null(&xsdfec->batch_done,
+				       struct xsdfec_batch_req, node);
+	if (req) {
+		list_del(&req->node);
+		xsdfec->batch_count--;
+	}
+	spin_unlock_irq(&xsdfec->batch_lock);
+
+	if (!req)
+		return -EAGAIN;
+
+	status.id = req->id;
+	status.status = req->status;
+	xsdfec_batch_free(req);
+
+	if (copy_to_user(arg, &status, sizeof(status)))
+		return -EFAULT;
+
+	return 0;
+}
+
+static int xsdfec_dma_init(struct xsdfec_dev *xsdfec)
+{
+	struct device *dev = xsdfec->dev;
+	int err;
+
+	xsdfec->din_chan = dma_request_chan(dev, "din");
+	if (IS_ERR(xsdfec->din_chan)) {
+		err = PTR_ERR(xsdfec->din_chan);
+		xsdfec->din_chan = NULL;
+		goto no_dma;
+	}
+
+	xsdfec->dout_chan = dma_request_chan(dev, "dout");
+	if (IS_ERR(xsdfec->dout_chan)) {
+		err = PTR_ERR(xsdfec->dout_chan);
+		xsdfec->dout_chan = NULL;
+		dma_release_channel(xsdfec->din_chan);
+		xsdfec->din_chan = NULL;
+		goto no_dma;
+	}
+
+	return 0;
+
+no_dma:
+	if (err == -EPROBE_DEFER)
+		return err;
+	dev_dbg(dev, "No DMA channels, batch submission disabled");
+	return 0;
+}
+
+static void xsdfec_dma_exit(struct xsdfec_dev *xsdfec)
+{
+	struct xsdfec_batch_req *req, *tmp;
+
+	if (!xsdfec->din_chan)
+		return;
+
+	xsdfec_batch_abort(xsdfec);
+	list_for_each_entry_safe(req, tmp, &xsdfec->batch_done, node)
+		xsdfec_batch_free(req);
+
+	dma_release_channel(xsdfec->dout_chan);
+	dma_release_channel(xsdfec->din_chan);
+}
+
 static long xsdfec_dev_ioctl(struct file *fptr, unsigned int cmd,
 			     unsigned long data)
 {
@@ -953,7 +1371,8 @@ static long xsdfec_dev_ioctl(struct file *fptr, unsigned int cmd,
 	/* In failed state allow only reset and get status IOCTLs */
 	if (xsdfec->state == XSDFEC_NEEDS_RESET &&
 	    (cmd != XSDFEC_SET_DEFAULT_CONFIG && cmd != XSDFEC_GET_STATUS &&
-	     cmd != XSDFEC_GET_STATS && cmd != XSDFEC_CLEAR_STATS)) {
+	     cmd != XSDFEC_GET_STATS && cmd != XSDFEC_CLEAR_STATS &&
+	     cmd != XSDFEC_GET_BATCH)) {
 		return -EPERM;
 	}
 
@@ -1010,6 +1429,12 @@ static long xsdfec_dev_ioctl(struct file *fptr, unsigned int cmd,
 	case XSDFEC_IS_ACTIVE:
 		rval = xsdfec_is_active(xsdfec, (bool __user *)arg);
 		break;
+	case XSDFEC_SUBMIT_BATCH:
+		rval = xsdfec_submit_batch(xsdfec, arg);
+		break;
+	case XSDFEC_GET_BATCH:
+		rval = xsdfec_get_batch(xsdfec, arg);
+		break;
 	default:
 		/* Should not get here */
 		break;
@@ -1046,6 +1471,12 @@ static unsigned int xsdfec_poll(struct file *file, poll_table *wait)
 		mask |= POLLIN | POLLRDNORM;
 	spin_unlock_irqrestore(&xsdfec->error_data_lock, xsdfec->flags);
 
+	/* A batch completed */
+	spin_lock_irq(&xsdfec->batch_lock);
+	if (!list_empty(&xsdfec->batch_done))
+		mask |= POLLIN | POLLRDBAND;
+	spin_unlock_irq(&xsdfec->batch_lock);
+
 	return mask;
 }
 
@@ -1392,6 +1823,11 @@ static int xsdfec_probe(struct platform_device *pdev)
 
 	xsdfec->dev = &pdev->dev;
 	spin_lock_init(&xsdfec->error_data_lock);
+	init_waitqueue_head(&xsdfec->waitq);
+	mutex_init(&xsdfec->batch_mutex);
+	spin_lock_init(&xsdfec->batch_lock);
+	INIT_LIST_HEAD(&xsdfec->batch_pending);
+	INIT_LIST_HEAD(&xsdfec->batch_done);
 
 	err = xsdfec_clk_init(pdev, &xsdfec->clks);
 	if (err)
@@ -1421,7 +1857,6 @@ static int xsdfec_probe(struct platform_device *pdev)
 	platform_set_drvdata(pdev, xsdfec);
 
 	if (irq_enabled) {
-		init_waitqueue_head(&xsdfec->waitq);
 		/* Register IRQ thread */
 		err = devm_request_threaded_irq(dev, xsdfec->irq, NULL,
 						xsdfec_irq_thread, IRQF_ONESHOT,
@@ -1432,9 +1867,13 @@ static int xsdfec_probe(struct platform_device *pdev)
 		}
 	}
 
-	err = ida_alloc(&dev_nrs, GFP_KERNEL);
+	err = xsdfec_dma_init(xsdfec);
 	if (err < 0)
 		goto err_xsdfec_dev;
+
+	err = ida_alloc(&dev_nrs, GFP_KERNEL);
+	if (err < 0)
+		goto err_xsdfec_dma;
 	xsdfec->dev_id = err;
 
 	snprintf(xsdfec->dev_name, DEV_NAME_LEN, "xsdfec%d", xsdfec->dev_id);
@@ -1451,6 +1890,8 @@ static int xsdfec_probe(struct platform_device *pdev)
 
 err_xsdfec_ida:
 	ida_free(&dev_nrs, xsdfec->dev_id);
+err_xsdfec_dma:
+	xsdfec_dma_exit(xsdfec);
 err_xsdfec_dev:
 	xsdfec_disable_all_clks(&xsdfec->clks);
 	return err;
@@ -1463,6 +1904,7 @@ static int xsdfec_remove(struct platform_device *pdev)
 	xsdfec = platform_get_drvdata(pdev);
 	misc_deregister(&xsdfec->miscdev);
 	ida_free(&dev_nrs, xsdfec->dev_id);
+	xsdfec_dma_exit(xsdfec);
 	xsdfec_disable_all_clks(&xsdfec->clks);
 	return 0;
 }
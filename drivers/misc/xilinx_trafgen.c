@@ -14,11 +14,17 @@
  */
 
 #include <linux/clk.h>
+#include <linux/completion.h>
 #include <linux/dma-mapping.h>
+#include <linux/firmware.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
+#include <linux/iopoll.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of_platform.h>
 #include <linux/of_address.h>
 #include <linux/of_irq.h>
@@ -196,6 +202,13 @@
 #define CMD_WDS	0x4	/* No of words in command ram per command */
 #define EXT_WDS	0x1	/* No of words in extended ram per command */
 #define MSB_INDEX	0x4
+
+/* Benchmark profiles */
+#define XTG_BENCH_MAGIC		0x42475458	/* "XTGB" */
+#define XTG_BENCH_VERSION	1
+#define XTG_BENCH_MAX_CMDS	(MAX_NUM_ENTRIES - 1) /* per block */
+#define XTG_BENCH_MAX_MS	60000		/* Longest session */
+#define XTG_BENCH_PASS_TIMEOUT_US 1000000	/* Longest pass */
 /**
  * struct xtg_cram - Command RAM structure
  * @addr: Address Driven to a*_addr line
@@ -276,6 +289,70 @@ struct xtg_pram {
 	u32 is_valid_req;
 };
 
+/**
+ * struct xtg_bench_hdr - Header of a benchmark profile firmware file
+ * @magic: XTG_BENCH_MAGIC
+ * @version: XTG_BENCH_VERSION
+ * @num_cmds: Number of struct xtg_bench_cmd following the header
+ */
+struct xtg_bench_hdr {
+	__le32 magic;
+	__le16 version;
+	__le16 num_cmds;
+} __packed;
+
+/**
+ * struct xtg_bench_cmd - Benchmark profile command
+ * @addr: Address Driven to a*_addr line
+ * @repeat: Number of repetitions after the first transaction
+ * @my_dpnd: My Depend command number
+ * @other_dpnd: Other depend command number
+ * @write: Write command if non-zero, read command otherwise
+ * @length: Driven to a*_len line
+ * @size: Driven to a*_size line
+ * @burst: Driven to a*_burst line
+ * @id: Driven to a*_id line
+ * @addr_mode: Address mode of the repetitions
+ * @cache: Driven to a*_cache line
+ * @qos: Driven to a*_qos line
+ *
+ * The commands of a profile are placed in the read and write blocks of the
+ * command RAM in file order. The dependencies limit the number of
+ * outstanding transactions the same way as in the command RAM.
+ */
+struct xtg_bench_cmd {
+	__le64 addr;
+	__le32 repeat;
+	__le16 my_dpnd;
+	__le16 other_dpnd;
+	u8 write;
+	u8 length;
+	u8 size;
+	u8 burst;
+	u8 id;
+	u8 addr_mode;
+	u8 cache;
+	u8 qos;
+} __packed;
+
+/**
+ * struct xtg_bench_result - Result of a benchmark session
+ * @passes: Number of complete passes through the loaded profile
+ * @bytes: Bytes transferred
+ * @time_ns: Time the master was busy
+ * @pass_min_ns: Shortest pass
+ * @pass_max_ns: Longest pass
+ * @errors: Error status that ended the session
+ */
+struct xtg_bench_result {
+	u32 passes;
+	u64 bytes;
+	u64 time_ns;
+	u64 pass_min_ns;
+	u64 pass_max_ns;
+	u32 errors;
+};
+
 /**
  * struct xtg_dev_info - Global Driver structure
  * @regs: Iomapped base address
@@ -286,6 +363,12 @@ struct xtg_pram {
  * @id: Device instance id
  * @xtg_mram_offset: MasterRam offset
  * @clk: Input clock
+ * @bench_lock: Serializes benchmark profile loads and sessions
+ * @bench_done: Completed by the master complete interrupt
+ * @bench_end: Time of the last master complete interrupt
+ * @bench_irq: Master complete interrupt is available
+ * @bench_pass_bytes: Bytes per pass of the loaded profile, 0 if none
+ * @bench_result: Result of the last benchmark session
  */
 struct xtg_dev_info {
 	void __iomem *regs;
@@ -296,6 +379,12 @@ struct xtg_dev_info {
 	u32 id;
 	u32 xtg_mram_offset;
 	struct clk *clk;
+	struct mutex bench_lock;
+	struct completion bench_done;
+	ktime_t bench_end;
+	bool bench_irq;
+	u64 bench_pass_bytes;
+	struct xtg_bench_result bench_result;
 };
 
 /**
@@ -708,12 +797,14 @@ static ssize_t xtg_sysfs_ioctl(struct device *dev, const char *buf,
 		break;
 
 	case XTG_CLEAR_CRAM:
+		tg->bench_pass_bytes = 0;
 		xtg_access_rams(tg, XTG_COMMAND_RAM_OFFSET,
 				XTG_COMMAND_RAM_SIZE,
 				XTG_WRITE_RAM_ZERO, NULL);
 		break;
 
 	case XTG_CLEAR_PRAM:
+		tg->bench_pass_bytes = 0;
 		xtg_access_rams(tg, XTG_PARAM_RAM_OFFSET,
 				XTG_PARAM_RAM_SIZE,
 				XTG_WRITE_RAM_ZERO, NULL);
@@ -795,6 +886,200 @@ static ssize_t xtg_sysfs_ioctl(struct device *dev, const char *buf,
 	return rdval;
 }
 
+/**
+ * xtg_bench_load - Programs a benchmark profile into the Command/Parameter RAM
+ * @tg: Pointer to xtg_dev_info structure
+ * @fw: Profile firmware file
+ *
+ * Return: 0 on success and failure value on error
+ */
+static int xtg_bench_load(struct xtg_dev_info *tg, const struct firmware *fw)
+{
+	const struct xtg_bench_hdr *hdr = (const void *)fw->data;
+	const struct xtg_bench_cmd *cmd;
+	struct xtg_cram cram = { .valid_cmd = 1 };
+	struct xtg_pram pram = { };
+	u32 cmd_words[CMD_WDS + EXT_WDS];
+	u32 param_word, repeat;
+	u16 index[2] = { 0, 0 };
+	u64 bytes = 0;
+	int i, num, off;
+	bool write;
+
+	if (fw->size < sizeof(*hdr) ||
+	    le32_to_cpu(hdr->magic) != XTG_BENCH_MAGIC ||
+	    le16_to_cpu(hdr->version) != XTG_BENCH_VERSION)
+		return -EINVAL;
+
+	num = le16_to_cpu(hdr->num_cmds);
+	if (!num || fw->size != sizeof(*hdr) + num * sizeof(*cmd))
+		return -EINVAL;
+
+	xtg_access_rams(tg, XTG_COMMAND_RAM_OFFSET, XTG_COMMAND_RAM_SIZE,
+			XTG_WRITE_RAM_ZERO, NULL);
+	xtg_access_rams(tg, XTG_PARAM_RAM_OFFSET, XTG_PARAM_RAM_SIZE,
+			XTG_WRITE_RAM_ZERO, NULL);
+	tg->last_wr_valid_idx = -1;
+	tg->last_rd_valid_idx = -1;
+
+	cmd = (const void *)(hdr + 1);
+	for (i = 0; i < num; i++, cmd++) {
+		write = cmd->write;
+		repeat = le32_to_cpu(cmd->repeat);
+
+		/* Keep an invalid command behind the last one of each block */
+		if (index[write] >= XTG_BENCH_MAX_CMDS ||
+		    repeat > XTG_PARAM_COUNT_MASK)
+			return -EINVAL;
+
+		cram.addr = le64_to_cpu(cmd->addr);
+		cram.length = cmd->length;
+		cram.size = cmd->size;
+		cram.burst = cmd->burst;
+		cram.id = cmd->id;
+		cram.my_dpnd = le16_to_cpu(cmd->my_dpnd);
+		cram.other_dpnd = le16_to_cpu(cmd->other_dpnd);
+		cram.cache = cmd->cache;
+		cram.qos = cmd->qos;
+		xtg_prepare_cmd_words(tg, &cram, cmd_words);
+
+		off = index[write] * XTG_CRAM_BYTES_PER_ENTRY;
+		if (write)
+			off += XTG_CMD_RAM_BLOCK_SIZE;
+		xtg_access_rams(tg, XTG_COMMAND_RAM_OFFSET + off,
+				XTG_CRAM_BYTES_PER_ENTRY, XTG_WRITE_RAM,
+				cmd_words);
+
+		pram.opcode = repeat ? XTG_PARAM_OP_RPT : XTG_PARAM_OP_NOP;
+		pram.op_cntl0 = repeat;
+		pram.addr_mode = cmd->addr_mode;
+		xtg_prepare_param_word(tg, &pram, &param_word);
+
+		off = index[write] * XTG_PRAM_BYTES_PER_ENTRY;
+		if (write)
+			off += XTG_PRM_RAM_BLOCK_SIZE;
+		xtg_access_rams(tg, XTG_PARAM_RAM_OFFSET + off,
+				XTG_PRAM_BYTES_PER_ENTRY, XTG_WRITE_RAM,
+				&param_word);
+
+		if (write)
+			tg->last_wr_valid_idx = index[write];
+		else
+			tg->last_rd_valid_idx = index[write];
+		index[write]++;
+
+		bytes += ((u64)repeat + 1) * (cram.length + 1) <<
+				(cram.size & XTG_SIZE_MASK);
+	}
+
+	tg->bench_pass_bytes = bytes;
+
+	return 0;
+}
+
+/**
+ * xtg_bench_pass - Runs the Command RAM once
+ * @tg: Pointer to xtg_dev_info structure
+ * @ns: Time the pass took
+ *
+ * Return: 0 on success and failure value on error
+ */
+static int xtg_bench_pass(struct xtg_dev_info *tg, u64 *ns)
+{
+	ktime_t start, end;
+	u32 val;
+	int ret = 0;
+
+	reinit_completion(&tg->bench_done);
+
+	start = ktime_get();
+	writel(readl(tg->regs + XTG_MCNTL_OFFSET) | XTG_MCNTL_MSTEN_MASK,
+	       tg->regs + XTG_MCNTL_OFFSET);
+
+	if (tg->bench_irq) {
+		if (!wait_for_completion_timeout(&tg->bench_done,
+				usecs_to_jiffies(XTG_BENCH_PASS_TIMEOUT_US)))
+			ret = -ETIMEDOUT;
+		end = tg->bench_end;
+	} else {
+		ret = readl_poll_timeout(tg->regs + XTG_MCNTL_OFFSET, val,
+					 !(val & XTG_MCNTL_MSTEN_MASK), 10,
+					 XTG_BENCH_PASS_TIMEOUT_US);
+		end = ktime_get();
+		writel(readl(tg->regs + XTG_ERR_STS_OFFSET) |
+		       XTG_ERR_STS_MSTDONE_MASK, tg->regs + XTG_ERR_STS_OFFSET);
+	}
+
+	*ns = ktime_to_ns(ktime_sub(end, start));
+
+	return ret;
+}
+
+/**
+ * xtg_bench_run - Runs a benchmark session
+ * @tg: Pointer to xtg_dev_info structure
+ * @ms: Duration of the session
+ *
+ * Restarts the master on the loaded profile until @ms have passed. The
+ * time between two passes is not accounted to the session.
+ *
+ * Return: 0 on success and failure value on error
+ */
+static int xtg_bench_run(struct xtg_dev_info *tg, unsigned int ms)
+{
+	struct xtg_bench_result *res = &tg->bench_result;
+	u64 deadline, ns;
+	u32 err_en, errs;
+	int ret = 0;
+
+	memset(res, 0, sizeof(*res));
+
+	if (!tg->bench_pass_bytes)
+		return -ENODATA;
+
+	if (readl(tg->regs + XTG_MCNTL_OFFSET) & XTG_MCNTL_MSTEN_MASK)
+		return -EBUSY;
+
+	writel(readl(tg->regs + XTG_MCNTL_OFFSET) & ~XTG_MCNTL_LOOPEN_MASK,
+	       tg->regs + XTG_MCNTL_OFFSET);
+	writel(readl(tg->regs + XTG_ERR_STS_OFFSET) | XTG_ERR_ALL_ERRS_MASK,
+	       tg->regs + XTG_ERR_STS_OFFSET);
+
+	err_en = readl(tg->regs + XTG_ERR_EN_OFFSET);
+	if (tg->bench_irq)
+		writel(err_en | XTG_ERR_EN_MSTIRQEN_MASK,
+		       tg->regs + XTG_ERR_EN_OFFSET);
+
+	res->pass_min_ns = U64_MAX;
+	deadline = ktime_get_ns() + (u64)ms * NSEC_PER_MSEC;
+	do {
+		ret = xtg_bench_pass(tg, &ns);
+		if (ret)
+			break;
+
+		errs = readl(tg->regs + XTG_ERR_STS_OFFSET) &
+			XTG_ERR_ALL_ERRS_MASK & ~XTG_ERR_STS_MSTDONE_MASK;
+		if (errs) {
+			res->errors = errs;
+			ret = -EIO;
+			break;
+		}
+
+		res->passes++;
+		res->bytes += tg->bench_pass_bytes;
+		res->time_ns += ns;
+		res->pass_min_ns = min(res->pass_min_ns, ns);
+		res->pass_max_ns = max(res->pass_max_ns, ns);
+	} while (ktime_get_ns() < deadline);
+
+	writel(err_en, tg->regs + XTG_ERR_EN_OFFSET);
+
+	if (!res->passes)
+		res->pass_min_ns = 0;
+
+	return ret;
+}
+
 /* Sysfs functions */
 
 static ssize_t id_show(struct device *dev,
@@ -1171,6 +1456,86 @@ static ssize_t loop_enable_store(struct device *dev,
 }
 static DEVICE_ATTR_RW(loop_enable);
 
+static ssize_t bench_profile_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t size)
+{
+	struct xtg_dev_info *tg = to_xtg_dev_info(dev);
+	const struct firmware *fw;
+	char *name;
+	int err;
+
+	name = kstrndup(buf, size, GFP_KERNEL);
+	if (!name)
+		return -ENOMEM;
+
+	err = request_firmware(&fw, strim(name), dev);
+	kfree(name);
+	if (err)
+		return err;
+
+	mutex_lock(&tg->bench_lock);
+	if (readl(tg->regs + XTG_MCNTL_OFFSET) & XTG_MCNTL_MSTEN_MASK)
+		err = -EBUSY;
+	else
+		err = xtg_bench_load(tg, fw);
+	mutex_unlock(&tg->bench_lock);
+
+	release_firmware(fw);
+
+	return err ? err : size;
+}
+static DEVICE_ATTR_WO(bench_profile);
+
+static ssize_t bench_run_store(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t size)
+{
+	struct xtg_dev_info *tg = to_xtg_dev_info(dev);
+	unsigned int ms;
+	int err;
+
+	err = kstrtouint(buf, 0, &ms);
+	if (err)
+		return err;
+
+	if (!ms || ms > XTG_BENCH_MAX_MS)
+		return -EINVAL;
+
+	mutex_lock(&tg->bench_lock);
+	err = xtg_bench_run(tg, ms);
+	mutex_unlock(&tg->bench_lock);
+
+	return err ? err : size;
+}
+static DEVICE_ATTR_WO(bench_run);
+
+static ssize_t bench_result_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct xtg_dev_info *tg = to_xtg_dev_info(dev);
+	struct xtg_bench_result res;
+	u64 mbps = 0, avg_ns = 0;
+
+	mutex_lock(&tg->bench_lock);
+	res = tg->bench_result;
+	mutex_unlock(&tg->bench_lock);
+
+	if (res.time_ns)
+		mbps = div64_u64(res.bytes * 1000, res.time_ns);
+	if (res.passes)
+		avg_ns = div_u64(res.time_ns, res.passes);
+
+	return snprintf(buf, PAGE_SIZE,
+			"passes: %u\nbytes: %llu\ntime_ns: %llu\n"
+			"bandwidth_mbps: %llu\npass_min_ns: %llu\n"
+			"pass_avg_ns: %llu\npass_max_ns: %llu\n"
+			"errors: 0x%08x\n",
+			res.passes, res.bytes, res.time_ns, mbps,
+			res.pass_min_ns, avg_ns, res.pass_max_ns, res.errors);
+}
+static DEVICE_ATTR_RO(bench_result);
+
 static ssize_t xtg_pram_read(struct file *filp, struct kobject *kobj,
 			     struct bin_attribute *bin_attr,
 			     char *buf, loff_t off, size_t count)
@@ -1224,6 +1589,7 @@ static ssize_t xtg_pram_write(struct file *filp, struct kobject *kobj,
 		}
 	}
 
+	tg->bench_pass_bytes = 0;
 	off += XTG_PARAM_RAM_OFFSET;
 	xtg_access_rams(tg, off, count, XTG_WRITE_RAM, data);
 
@@ -1321,6 +1687,7 @@ static ssize_t xtg_cram_write(struct file *filp, struct kobject *kobj,
 		}
 	}
 
+	tg->bench_pass_bytes = 0;
 	off += XTG_COMMAND_RAM_OFFSET;
 	xtg_access_rams(tg, off, count, XTG_WRITE_RAM, data);
 
@@ -1449,6 +1816,9 @@ static const struct attribute *xtg_attrs[] = {
 	&dev_attr_stream_enable.attr,
 	&dev_attr_reset_static_transferdone.attr,
 	&dev_attr_loop_enable.attr,
+	&dev_attr_bench_profile.attr,
+	&dev_attr_bench_run.attr,
+	&dev_attr_bench_result.attr,
 	NULL,
 };
 
@@ -1468,9 +1838,13 @@ static irqreturn_t xtg_cmp_intr_handler(int irq, void *data)
 {
 	struct xtg_dev_info *tg = (struct xtg_dev_info *)data;
 
+	tg->bench_end = ktime_get();
+
 	writel(readl(tg->regs + XTG_ERR_STS_OFFSET) |
 	       XTG_ERR_STS_MSTDONE_MASK, tg->regs + XTG_ERR_STS_OFFSET);
 
+	complete(&tg->bench_done);
+
 	return IRQ_HANDLED;
 }
 
@@ -1522,6 +1896,8 @@ static int xtg_probe(struct platform_device *pdev)
 	tg->dev = &pdev->dev;
 	dev = tg->dev;
 	node = pdev->dev.of_node;
+	mutex_init(&tg->bench_lock);
+	init_completion(&tg->bench_done);
 
 	/* Map the registers */
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
@@ -1563,6 +1939,7 @@ static int xtg_probe(struct platform_device *pdev)
 			dev_err(&pdev->dev, "unable to request irq %d", irq);
 			return err;
 		}
+		tg->bench_irq = true;
 	}
 
 	tg->clk = devm_clk_get(&pdev->dev, NULL);
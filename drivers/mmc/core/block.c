@@ -1233,7 +1233,10 @@ static void mmc_blk_issue_flush(struct mmc_queue *mq, struct request *req)
 	struct mmc_card *card = md->queue.card;
 	int ret = 0;
 
-	ret = mmc_flush_cache(card);
+	if (mmc_card_sd(card))
+		ret = mmc_sd_flush_cache(card);
+	else
+		ret = mmc_flush_cache(card);
 	blk_mq_end_request(req, ret ? BLK_STS_IOERR : BLK_STS_OK);
 }
 
@@ -2392,6 +2395,14 @@ static struct mmc_blk_data *mmc_blk_alloc_req(struct mmc_card *card,
 		blk_queue_write_cache(md->queue.queue, true, true);
 	}
 
+	/*
+	 * The SD cache can be turned on through sysfs at any time, so ask for
+	 * flushes whenever it exists. FUA is emulated by the block layer.
+	 */
+	if (mmc_card_sd(card) &&
+	    card->ext_perf.feature_support & SD_EXT_PERF_CACHE)
+		blk_queue_write_cache(md->queue.queue, true, false);
+
 	return md;
 
  err_putdisk:
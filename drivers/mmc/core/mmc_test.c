@@ -12,6 +12,7 @@
 #include <linux/scatterlist.h>
 #include <linux/swap.h>		/* For nr_free_buffer_pages() */
 #include <linux/list.h>
+#include <linux/sort.h>
 
 #include <linux/debugfs.h>
 #include <linux/uaccess.h>
@@ -40,6 +41,30 @@
  */
 #define TEST_AREA_MAX_SIZE (128 * 1024 * 1024)
 
+/*
+ * Parameters of the mixed workload test: sequential writes of
+ * 'mixed_write_kb' interleaved with 'mixed_reads' random reads of
+ * 'mixed_read_kb' each, with up to 'mixed_qdepth' requests queued.
+ */
+#define MIXED_MAX_QDEPTH	8
+#define MIXED_WRITE_CNT		256
+
+static unsigned int mixed_qdepth = 2;
+module_param(mixed_qdepth, uint, 0644);
+MODULE_PARM_DESC(mixed_qdepth, "Queue depth of the mixed workload test (1-8)");
+
+static unsigned int mixed_write_kb = 512;
+module_param(mixed_write_kb, uint, 0644);
+MODULE_PARM_DESC(mixed_write_kb, "Write size of the mixed workload test in KiB");
+
+static unsigned int mixed_read_kb = 4;
+module_param(mixed_read_kb, uint, 0644);
+MODULE_PARM_DESC(mixed_read_kb, "Read size of the mixed workload test in KiB");
+
+static unsigned int mixed_reads = 4;
+module_param(mixed_reads, uint, 0644);
+MODULE_PARM_DESC(mixed_reads, "Reads per write in the mixed workload test");
+
 /**
  * struct mmc_test_pages - pages allocated by 'alloc_pages()'.
  * @page: first page in the allocation
@@ -2309,6 +2334,237 @@ static int mmc_test_profile_sglen_r_nonblock_perf(struct mmc_test_card *test)
 /*
  * eMMC hardware reset.
  */
+/*
+ * A request of the mixed workload test. Each one has its own scatterlist,
+ * because the host maps the scatterlist of queued requests in advance.
+ */
+struct mmc_test_mixed_slot {
+	struct mmc_test_req rq;
+	struct scatterlist *sg;
+	ktime_t queued;
+	bool write;
+};
+
+static int mmc_test_cmp_u32(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+ * Print the latency percentiles of cnt requests (in microseconds).
+ */
+static void mmc_test_print_latency(struct mmc_test_card *test,
+				   const char *type, u32 *lat,
+				   unsigned int cnt)
+{
+	if (!cnt)
+		return;
+
+	sort(lat, cnt, sizeof(*lat), mmc_test_cmp_u32, NULL);
+
+	pr_info("%s: %u %s requests: latency p50 %u us, p90 %u us, p99 %u us, max %u us\n",
+		mmc_hostname(test->card->host), cnt, type,
+		lat[cnt * 50 / 100], lat[cnt * 90 / 100],
+		lat[cnt * 99 / 100], lat[cnt - 1]);
+}
+
+/*
+ * Map a request and hand it to the host for preparation, like the block
+ * driver does for requests that wait behind the one in flight.
+ */
+static int mmc_test_mixed_queue(struct mmc_test_card *test,
+				struct mmc_test_mixed_slot *slot,
+				unsigned int dev_addr, unsigned long sz,
+				bool write)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_request *mrq = &slot->rq.mrq;
+	unsigned int sg_len;
+	int ret;
+
+	ret = mmc_test_map_sg(t->mem, sz, slot->sg, 1, t->max_segs,
+			      t->max_seg_sz, &sg_len, 0);
+	if (ret)
+		return ret;
+
+	mmc_test_req_reset(&slot->rq);
+	mrq->sbc = &slot->rq.sbc;
+	mmc_test_prepare_mrq(test, mrq, slot->sg, sg_len, dev_addr, sz >> 9,
+			     512, write);
+
+	init_completion(&mrq->completion);
+	mrq->done = mmc_test_wait_done;
+	slot->write = write;
+	slot->queued = ktime_get();
+	mmc_pre_req(test->card->host, mrq);
+
+	return 0;
+}
+
+static int mmc_test_mixed_start(struct mmc_test_card *test,
+				struct mmc_test_mixed_slot *slot)
+{
+	struct mmc_host *host = test->card->host;
+	int err;
+
+	err = mmc_start_request(host, &slot->rq.mrq);
+	if (err)
+		mmc_retune_release(host);
+
+	return err;
+}
+
+/*
+ * Sequential writes with small random reads in between, as seen by the block
+ * driver while logging. Up to mixed_qdepth requests are prepared ahead of the
+ * one on the bus. The latency of a request runs from its preparation to the
+ * end of its busy state.
+ */
+static int mmc_test_mixed_perf(struct mmc_test_card *test)
+{
+	struct mmc_test_area *t = &test->area;
+	struct mmc_host *host = test->card->host;
+	struct mmc_test_mixed_slot *slots;
+	unsigned int qdepth = clamp_t(unsigned int, mixed_qdepth, 1,
+				      MIXED_MAX_QDEPTH);
+	unsigned int reads = mixed_reads;
+	unsigned long wsz, rsz;
+	unsigned int total, issued = 0, done = 0, head = 0, queued = 0;
+	unsigned int wcnt = 0, rcnt = 0, waddr = 0, area_sects;
+	struct timespec64 ts1, ts2, ts;
+	u32 *wlat, *rlat;
+	unsigned int rate, iops;
+	int i, ret = 0;
+
+	wsz = min_t(unsigned long, (unsigned long)mixed_write_kb << 10,
+		    t->max_tfr) & ~511UL;
+	rsz = min_t(unsigned long, (unsigned long)mixed_read_kb << 10,
+		    t->max_tfr) & ~511UL;
+	if (!wsz || !rsz)
+		return -EINVAL;
+
+	area_sects = t->max_sz >> 9;
+	total = MIXED_WRITE_CNT * (1 + reads);
+
+	slots = kcalloc(qdepth, sizeof(*slots), GFP_KERNEL);
+	wlat = kcalloc(MIXED_WRITE_CNT, sizeof(*wlat), GFP_KERNEL);
+	rlat = kcalloc(MIXED_WRITE_CNT * reads + 1, sizeof(*rlat), GFP_KERNEL);
+	if (!slots || !wlat || !rlat) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	for (i = 0; i < qdepth; i++) {
+		slots[i].sg = kmalloc_array(t->max_segs, sizeof(*slots[i].sg),
+					    GFP_KERNEL);
+		if (!slots[i].sg) {
+			ret = -ENOMEM;
+			goto out_free;
+		}
+	}
+
+	ktime_get_ts64(&ts1);
+
+	while (done < total) {
+		struct mmc_test_mixed_slot *slot;
+		u32 lat;
+
+		/* Keep the queue full */
+		while (queued < qdepth && issued < total) {
+			bool write = !(issued % (1 + reads));
+			unsigned int dev_addr;
+			unsigned long sz;
+
+			if (write) {
+				sz = wsz;
+				if (waddr + (sz >> 9) > area_sects)
+					waddr = 0;
+				dev_addr = t->dev_addr + waddr;
+				waddr += sz >> 9;
+			} else {
+				sz = rsz;
+				dev_addr = t->dev_addr +
+					   mmc_test_rnd_num(area_sects /
+							    (sz >> 9)) *
+					   (sz >> 9);
+			}
+
+			slot = &slots[(head + queued) % qdepth];
+			ret = mmc_test_mixed_queue(test, slot, dev_addr, sz,
+						   write);
+			if (ret)
+				goto out_unprepare;
+
+			queued++;
+			issued++;
+
+			/* Nothing is on the bus when the queue was empty */
+			if (queued == 1) {
+				ret = mmc_test_mixed_start(test, slot);
+				if (ret)
+					goto out_unprepare;
+			}
+		}
+
+		slot = &slots[head];
+		wait_for_completion(&slot->rq.mrq.completion);
+		ret = mmc_test_wait_busy(test);
+		if (!ret)
+			ret = mmc_test_check_result(test, &slot->rq.mrq);
+		lat = ktime_us_delta(ktime_get(), slot->queued);
+		if (ret)
+			goto out_unprepare;
+
+		/* Start the next one before cleaning up, as blk-mq does */
+		if (queued > 1) {
+			ret = mmc_test_mixed_start(test,
+						   &slots[(head + 1) % qdepth]);
+			if (ret)
+				goto out_unprepare;
+		}
+
+		mmc_post_req(host, &slot->rq.mrq, 0);
+		if (slot->write)
+			wlat[wcnt++] = lat;
+		else
+			rlat[rcnt++] = lat;
+
+		head = (head + 1) % qdepth;
+		queued--;
+		done++;
+	}
+
+	ktime_get_ts64(&ts2);
+	ts = timespec64_sub(ts2, ts1);
+
+	rate = mmc_test_rate((uint64_t)wcnt * wsz + (uint64_t)rcnt * rsz, &ts);
+	iops = mmc_test_rate(done * 100, &ts);
+	pr_info("%s: Mixed workload of %u x %lu KiB writes and %u x %lu KiB reads at queue depth %u took %llu.%09u seconds (%u kB/s, %u.%02u IOPS)\n",
+		mmc_hostname(host), wcnt, wsz >> 10, rcnt, rsz >> 10, qdepth,
+		(u64)ts.tv_sec, (u32)ts.tv_nsec, rate / 1000,
+		iops / 100, iops % 100);
+	mmc_test_save_transfer_result(test, done, wsz >> 9, ts, rate, iops);
+
+	mmc_test_print_latency(test, "write", wlat, wcnt);
+	mmc_test_print_latency(test, "read", rlat, rcnt);
+	goto out_free;
+
+out_unprepare:
+	/* Nothing is in flight any more, only prepared requests remain */
+	for (i = 0; i < queued; i++)
+		mmc_post_req(host, &slots[(head + i) % qdepth].rq.mrq, ret);
+out_free:
+	if (slots)
+		for (i = 0; i < qdepth; i++)
+			kfree(slots[i].sg);
+	kfree(slots);
+	kfree(wlat);
+	kfree(rlat);
+	return ret;
+}
+
 static int mmc_test_reset(struct mmc_test_card *test)
 {
 	struct mmc_card *card = test->card;
@@ -2914,6 +3170,13 @@ static const struct mmc_test_case mmc_test_cases[] = {
 		.run = mmc_test_cmds_during_write_cmd23_nonblock,
 		.cleanup = mmc_test_area_cleanup,
 	},
+
+	{
+		.name = "Mixed sequential write and random read performance",
+		.prepare = mmc_test_area_prepare,
+		.run = mmc_test_mixed_perf,
+		.cleanup = mmc_test_area_cleanup,
+	},
 };
 
 static DEFINE_MUTEX(mmc_test_lock);
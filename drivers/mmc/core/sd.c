@@ -12,6 +12,7 @@
 #include <linux/slab.h>
 #include <linux/stat.h>
 #include <linux/pm_runtime.h>
+#include <asm/unaligned.h>
 
 #include <linux/mmc/host.h>
 #include <linux/mmc/card.h>
@@ -216,7 +217,9 @@ static int mmc_decode_scr(struct mmc_card *card)
 	else
 		card->erased_byte = 0x0;
 
-	if (scr->sda_spec3)
+	if (scr->sda_spec4)
+		scr->cmds = UNSTUFF_BITS(resp, 32, 4);
+	else if (scr->sda_spec3)
 		scr->cmds = UNSTUFF_BITS(resp, 32, 2);
 
 	/* SD Spec says: any SD Card shall set at least bits 0 and 2 */
@@ -707,6 +710,45 @@ static ssize_t mmc_dsr_show(struct device *dev,
 
 static DEVICE_ATTR(dsr, S_IRUGO, mmc_dsr_show, NULL);
 
+static ssize_t mmc_cache_show(struct device *dev,
+			      struct device_attribute *attr, char *buf)
+{
+	struct mmc_card *card = mmc_dev_to_card(dev);
+
+	return sprintf(buf, "%d\n",
+		       !!(card->ext_perf.feature_enabled & SD_EXT_PERF_CACHE));
+}
+
+static ssize_t mmc_cache_store(struct device *dev,
+			       struct device_attribute *attr,
+			       const char *buf, size_t count)
+{
+	struct mmc_card *card = mmc_dev_to_card(dev);
+	bool enable;
+	int err;
+
+	err = kstrtobool(buf, &enable);
+	if (err)
+		return err;
+
+	if (!(card->ext_perf.feature_support & SD_EXT_PERF_CACHE))
+		return -EOPNOTSUPP;
+
+	mmc_get_card(card, NULL);
+	err = mmc_sd_set_cache(card, enable);
+	if (!err) {
+		if (enable)
+			card->ext_perf.feature_off &= ~SD_EXT_PERF_CACHE;
+		else
+			card->ext_perf.feature_off |= SD_EXT_PERF_CACHE;
+	}
+	mmc_put_card(card, NULL);
+
+	return err ? err : count;
+}
+
+static DEVICE_ATTR(cache, S_IRUGO | S_IWUSR, mmc_cache_show, mmc_cache_store);
+
 static struct attribute *sd_std_attrs[] = {
 	&dev_attr_cid.attr,
 	&dev_attr_csd.attr,
@@ -724,6 +766,7 @@ static struct attribute *sd_std_attrs[] = {
 	&dev_attr_ocr.attr,
 	&dev_attr_rca.attr,
 	&dev_attr_dsr.attr,
+	&dev_attr_cache.attr,
 	NULL,
 };
 ATTRIBUTE_GROUPS(sd_std);
@@ -908,6 +951,120 @@ int mmc_sd_setup_card(struct mmc_host *host, struct mmc_card *card,
 	return 0;
 }
 
+/*
+ * Parse one extension of the general information. Only the performance
+ * enhancement function, which holds the cache control, is used so far.
+ */
+static int sd_parse_ext_reg(struct mmc_card *card, u8 *gen_info_buf,
+	u16 *next_ext_addr)
+{
+	u8 num_regs, fno, page;
+	u16 sfc, offset, ext = *next_ext_addr;
+	u32 reg_addr;
+	u8 *reg_buf;
+	int err;
+
+	/* Each extension descriptor is at least 48 bytes long */
+	if (ext > 512 - 48)
+		return -EFAULT;
+
+	/* Standard function code */
+	sfc = get_unaligned_le16(&gen_info_buf[ext]);
+	*next_ext_addr = get_unaligned_le16(&gen_info_buf[ext + 40]);
+	num_regs = gen_info_buf[ext + 42];
+
+	/* Only a single register per extension is supported */
+	if (num_regs != 1)
+		return 0;
+
+	/* [8:0] offset, [16:9] page, [21:18] function number */
+	reg_addr = get_unaligned_le32(&gen_info_buf[ext + 44]);
+	offset = reg_addr & 0x1ff;
+	page = reg_addr >> 9 & 0xff;
+	fno = reg_addr >> 18 & 0xf;
+
+	/* Performance enhancement function */
+	if (sfc != 0x2)
+		return 0;
+
+	reg_buf = kzalloc(512, GFP_KERNEL);
+	if (!reg_buf)
+		return -ENOMEM;
+
+	err = mmc_sd_read_ext_reg(card, fno, page, offset, 512, reg_buf);
+	if (err) {
+		pr_warn("%s: error %d reading PERF func of ext reg\n",
+			mmc_hostname(card->host), err);
+		goto out;
+	}
+
+	card->ext_perf.rev = reg_buf[0];
+	if (reg_buf[4] & BIT(0))
+		card->ext_perf.feature_support |= SD_EXT_PERF_CACHE;
+
+	card->ext_perf.fno = fno;
+	card->ext_perf.page = page;
+	card->ext_perf.offset = offset;
+out:
+	kfree(reg_buf);
+	return err;
+}
+
+/*
+ * Read the general information of the function extension registers (SD 4.0
+ * and later, CMD48) and parse the extensions that we know about.
+ */
+static int sd_read_ext_regs(struct mmc_card *card)
+{
+	int err, i;
+	u8 num_ext, *gen_info_buf;
+	u16 rev, len, next_ext_addr;
+
+	if (mmc_host_is_spi(card->host))
+		return 0;
+
+	if (!(card->scr.cmds & SD_SCR_CMD48_SUPPORT))
+		return 0;
+
+	gen_info_buf = kzalloc(512, GFP_KERNEL);
+	if (!gen_info_buf)
+		return -ENOMEM;
+
+	/* The general information is at function 0, page 0, offset 0 */
+	err = mmc_sd_read_ext_reg(card, 0, 0, 0, 512, gen_info_buf);
+	if (err) {
+		pr_warn("%s: error %d reading general info of SD ext reg\n",
+			mmc_hostname(card->host), err);
+		goto out;
+	}
+
+	rev = get_unaligned_le16(&gen_info_buf[0]);
+	len = get_unaligned_le16(&gen_info_buf[2]);
+	num_ext = gen_info_buf[4];
+
+	/* Only revision 0 is supported, and only up to 512 bytes of it */
+	if (rev != 0 || len > 512) {
+		pr_warn("%s: non-supported SD ext reg layout\n",
+			mmc_hostname(card->host));
+		goto out;
+	}
+
+	/* The first extension follows the 16 byte header */
+	next_ext_addr = 16;
+	for (i = 0; i < num_ext; i++) {
+		err = sd_parse_ext_reg(card, gen_info_buf, &next_ext_addr);
+		if (err) {
+			pr_warn("%s: error %d parsing SD ext reg\n",
+				mmc_hostname(card->host), err);
+			break;
+		}
+	}
+
+out:
+	kfree(gen_info_buf);
+	return err;
+}
+
 unsigned mmc_sd_get_max_clock(struct mmc_card *card)
 {
 	unsigned max_dtr = (unsigned int)-1;
@@ -1090,6 +1247,18 @@ static int mmc_sd_init_card(struct mmc_host *host, u32 ocr,
 		goto free_card;
 	}
 done:
+	/*
+	 * The extension registers are optional. A card that fails to report
+	 * them is used without its cache.
+	 */
+	if (!oldcard)
+		sd_read_ext_regs(card);
+
+	/* Turn the cache on unless it was turned off through sysfs */
+	if (card->ext_perf.feature_support & SD_EXT_PERF_CACHE &&
+	    !(card->ext_perf.feature_off & SD_EXT_PERF_CACHE))
+		mmc_sd_set_cache(card, true);
+
 	host->card = card;
 	return 0;
 
@@ -1152,6 +1321,11 @@ static int _mmc_sd_suspend(struct mmc_host *host)
 	if (mmc_card_suspended(host->card))
 		goto out;
 
+	/* The cache is lost with the power */
+	err = mmc_sd_flush_cache(host->card);
+	if (err)
+		goto out;
+
 	if (!mmc_host_is_spi(host))
 		err = mmc_deselect_cards(host);
 
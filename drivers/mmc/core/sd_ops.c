@@ -16,8 +16,16 @@
 #include <linux/mmc/sd.h>
 
 #include "core.h"
+#include "mmc_ops.h"
 #include "sd_ops.h"
 
+/* The card may signal busy for up to 1 s after CMD49 */
+#define SD_WRITE_EXTR_SINGLE_TIMEOUT_MS	1000
+
+/* Offsets of the cache control bytes in the performance register */
+#define SD_EXT_PERF_CACHE_ENABLE	260
+#define SD_EXT_PERF_CACHE_FLUSH		261
+
 int mmc_app_cmd(struct mmc_host *host, struct mmc_card *card)
 {
 	int err;
@@ -343,3 +351,181 @@ int mmc_app_sd_status(struct mmc_card *card, void *ssr)
 
 	return 0;
 }
+
+/*
+ * Read @len bytes (at most 512) of an extension register with CMD48.
+ * @reg_buf must be a heap-allocated buffer of 512 bytes.
+ */
+int mmc_sd_read_ext_reg(struct mmc_card *card, u8 fno, u8 page, u16 offset,
+	u16 len, u8 *reg_buf)
+{
+	struct mmc_request mrq = {};
+	struct mmc_command cmd = {};
+	struct mmc_data data = {};
+	struct scatterlist sg;
+
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+
+	/*
+	 * [31] MIO (0 = memory), [30:27] function number, [25:18] page,
+	 * [17:9] offset, [8:0] length minus one.
+	 */
+	cmd.opcode = SD_READ_EXTR_SINGLE;
+	cmd.arg = fno << 27 | page << 18 | offset << 9 | (len - 1);
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	data.blksz = 512;
+	data.blocks = 1;
+	data.flags = MMC_DATA_READ;
+	data.sg = &sg;
+	data.sg_len = 1;
+
+	sg_init_one(&sg, reg_buf, 512);
+
+	mmc_set_data_timeout(&data, card);
+
+	mmc_wait_for_req(card->host, &mrq);
+
+	if (cmd.error)
+		return cmd.error;
+	if (data.error)
+		return data.error;
+
+	return 0;
+}
+
+/*
+ * Write one byte of an extension register with CMD49. The caller has to wait
+ * for the card to leave the busy state.
+ */
+int mmc_sd_write_ext_reg(struct mmc_card *card, u8 fno, u8 page, u16 offset,
+	u8 reg_data)
+{
+	struct mmc_request mrq = {};
+	struct mmc_command cmd = {};
+	struct mmc_data data = {};
+	struct scatterlist sg;
+	u8 *reg_buf;
+
+	reg_buf = kzalloc(512, GFP_KERNEL);
+	if (!reg_buf)
+		return -ENOMEM;
+
+	mrq.cmd = &cmd;
+	mrq.data = &data;
+
+	/*
+	 * [31] MIO (0 = memory), [30:27] function number, [26] MW (0 = no
+	 * mask), [25:18] page, [17:9] offset, [8:0] length minus one.
+	 */
+	cmd.opcode = SD_WRITE_EXTR_SINGLE;
+	cmd.arg = fno << 27 | page << 18 | offset << 9;
+	cmd.flags = MMC_RSP_R1 | MMC_CMD_ADTC;
+
+	/* The data to write is the first byte of the block */
+	reg_buf[0] = reg_data;
+
+	data.blksz = 512;
+	data.blocks = 1;
+	data.flags = MMC_DATA_WRITE;
+	data.sg = &sg;
+	data.sg_len = 1;
+
+	sg_init_one(&sg, reg_buf, 512);
+
+	mmc_set_data_timeout(&data, card);
+
+	mmc_wait_for_req(card->host, &mrq);
+
+	kfree(reg_buf);
+
+	if (cmd.error)
+		return cmd.error;
+	if (data.error)
+		return data.error;
+
+	return 0;
+}
+
+/*
+ * Turn the cache of the performance enhancement function on or off. The
+ * cache is flushed before it is turned off.
+ */
+int mmc_sd_set_cache(struct mmc_card *card, bool enable)
+{
+	struct sd_ext_reg *ext = &card->ext_perf;
+	int err;
+
+	if (!(ext->feature_support & SD_EXT_PERF_CACHE))
+		return -EOPNOTSUPP;
+
+	if (!enable) {
+		err = mmc_sd_flush_cache(card);
+		if (err)
+			return err;
+	}
+
+	ext->feature_enabled &= ~SD_EXT_PERF_CACHE;
+	err = mmc_sd_write_ext_reg(card, ext->fno, ext->page,
+				   ext->offset + SD_EXT_PERF_CACHE_ENABLE,
+				   enable ? BIT(0) : 0);
+	if (err) {
+		pr_warn("%s: error %d writing Cache Enable bit\n",
+			mmc_hostname(card->host), err);
+		return err;
+	}
+
+	err = mmc_poll_for_busy(card, SD_WRITE_EXTR_SINGLE_TIMEOUT_MS, true,
+				false);
+	if (!err && enable)
+		ext->feature_enabled |= SD_EXT_PERF_CACHE;
+
+	return err;
+}
+
+/*
+ * Write the cache of the card back to the flash. Does nothing unless the
+ * cache is enabled.
+ */
+int mmc_sd_flush_cache(struct mmc_card *card)
+{
+	struct sd_ext_reg *ext = &card->ext_perf;
+	u16 offset = ext->offset + SD_EXT_PERF_CACHE_FLUSH;
+	u8 *reg_buf;
+	int err;
+
+	if (!(ext->feature_enabled & SD_EXT_PERF_CACHE))
+		return 0;
+
+	reg_buf = kzalloc(512, GFP_KERNEL);
+	if (!reg_buf)
+		return -ENOMEM;
+
+	err = mmc_sd_write_ext_reg(card, ext->fno, ext->page, offset, BIT(0));
+	if (err) {
+		pr_warn("%s: error %d writing Cache Flush bit\n",
+			mmc_hostname(card->host), err);
+		goto out;
+	}
+
+	err = mmc_poll_for_busy(card, SD_WRITE_EXTR_SINGLE_TIMEOUT_MS, true,
+				false);
+	if (err)
+		goto out;
+
+	/* The Cache Flush bit clears itself once the flush is complete */
+	err = mmc_sd_read_ext_reg(card, ext->fno, ext->page, offset, 1,
+				  reg_buf);
+	if (err) {
+		pr_warn("%s: error %d reading Cache Flush bit\n",
+			mmc_hostname(card->host), err);
+		goto out;
+	}
+
+	if (reg_buf[0] & BIT(0))
+		err = -ETIMEDOUT;
+out:
+	kfree(reg_buf);
+	return err;
+}
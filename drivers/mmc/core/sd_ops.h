@@ -22,6 +22,12 @@ int mmc_sd_switch(struct mmc_card *card, int mode, int group,
 	u8 value, u8 *resp);
 int mmc_app_sd_status(struct mmc_card *card, void *ssr);
 int mmc_app_cmd(struct mmc_host *host, struct mmc_card *card);
+int mmc_sd_read_ext_reg(struct mmc_card *card, u8 fno, u8 page, u16 offset,
+	u16 len, u8 *reg_buf);
+int mmc_sd_write_ext_reg(struct mmc_card *card, u8 fno, u8 page, u16 offset,
+	u8 reg_data);
+int mmc_sd_set_cache(struct mmc_card *card, bool enable);
+int mmc_sd_flush_cache(struct mmc_card *card);
 
 #endif
 
@@ -22,6 +22,8 @@
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/partitions.h>
 #include <linux/mtd/map.h>
+#include <linux/highmem.h>
+#include <linux/vmalloc.h>
 
 #include <linux/uaccess.h>
 
@@ -631,6 +633,113 @@ static int mtdchar_write_ioctl(struct mtd_info *mtd,
 	return ret;
 }
 
+/* Pages pinned and mapped at a time by MEMREADBULK and MEMWRITEBULK */
+#define MTDCHAR_BULK_PAGES	256
+
+static int mtdchar_bulk_chunk(struct mtd_info *mtd, loff_t from,
+		unsigned long uaddr, size_t len, size_t *retlen, bool write,
+		struct page **pages)
+{
+	unsigned int offs = offset_in_page(uaddr);
+	int nr_pages = DIV_ROUND_UP(offs + len, PAGE_SIZE);
+	void *vaddr;
+	int pinned, i;
+	int ret;
+
+	pinned = get_user_pages_fast(uaddr & PAGE_MASK, nr_pages,
+				     write ? 0 : FOLL_WRITE, pages);
+	if (pinned < nr_pages) {
+		ret = pinned < 0 ? pinned : -EFAULT;
+		goto out_put;
+	}
+
+	vaddr = vm_map_ram(pages, nr_pages, NUMA_NO_NODE, PAGE_KERNEL);
+	if (!vaddr) {
+		ret = -ENOMEM;
+		goto out_put;
+	}
+
+	if (write) {
+		ret = mtd_write(mtd, from, len, retlen, vaddr + offs);
+	} else {
+		ret = mtd_read(mtd, from, len, retlen, vaddr + offs);
+		/* Like mtdchar_read(), hand out data with ECC errors too */
+		if (mtd_is_bitflip_or_eccerr(ret))
+			ret = 0;
+		flush_kernel_vmap_range(vaddr + offs, *retlen);
+	}
+
+	vm_unmap_ram(vaddr, nr_pages);
+
+out_put:
+	for (i = 0; i < pinned; i++) {
+		if (!write)
+			set_page_dirty_lock(pages[i]);
+		put_page(pages[i]);
+	}
+
+	return ret;
+}
+
+/*
+ * MEMREADBULK and MEMWRITEBULK: no bounce buffer, and requests of up to
+ * MTDCHAR_BULK_PAGES pages for the driver. spi-nor turns that into a few
+ * long transfers instead of one per mtd_kmalloc_up_to() buffer.
+ */
+static int mtdchar_bulk_ioctl(struct file *file, struct mtd_info *mtd,
+		struct mtd_bulk_req __user *argp, bool write)
+{
+	struct mtd_file_info *mfi = file->private_data;
+	struct mtd_bulk_req req;
+	struct page **pages;
+	unsigned long uaddr;
+	u64 total = 0;
+	int ret = 0;
+
+	if (copy_from_user(&req, argp, sizeof(req)))
+		return -EFAULT;
+
+	/* OTP and raw accesses keep using read() and write() */
+	if (mfi->mode != MTD_FILE_MODE_NORMAL)
+		return -EOPNOTSUPP;
+
+	if (write && !(file->f_mode & FMODE_WRITE))
+		return -EPERM;
+
+	if (req.start >= mtd->size || req.len > mtd->size - req.start)
+		return -EINVAL;
+
+	uaddr = (unsigned long)req.usr_data;
+	if (!access_ok((void __user *)uaddr, req.len))
+		return -EFAULT;
+
+	pages = kmalloc_array(MTDCHAR_BULK_PAGES, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	while (total < req.len) {
+		size_t len, retlen = 0;
+
+		len = min_t(u64, req.len - total,
+			    MTDCHAR_BULK_PAGES * PAGE_SIZE -
+			    offset_in_page(uaddr));
+
+		ret = mtdchar_bulk_chunk(mtd, req.start + total, uaddr, len,
+					 &retlen, write, pages);
+		total += retlen;
+		uaddr += retlen;
+		if (ret || retlen < len)
+			break;
+	}
+
+	kfree(pages);
+
+	if (put_user(total, &argp->retlen))
+		return -EFAULT;
+
+	return ret;
+}
+
 static int mtdchar_ioctl(struct file *file, u_int cmd, u_long arg)
 {
 	struct mtd_file_info *mfi = file->private_data;
@@ -786,6 +895,14 @@ static int mtdchar_ioctl(struct file *file, u_int cmd, u_long arg)
 		break;
 	}
 
+	case MEMREADBULK:
+	case MEMWRITEBULK:
+	{
+		ret = mtdchar_bulk_ioctl(file, mtd,
+		      (struct mtd_bulk_req __user *)arg, cmd == MEMWRITEBULK);
+		break;
+	}
+
 	case MEMLOCK:
 	{
 		struct erase_info_user einfo;
@@ -1135,6 +1252,38 @@ static int mtdchar_mmap(struct file *file, struct vm_area_struct *vma)
 	struct mtd_info *mtd = mfi->mtd;
 	struct map_info *map = mtd->priv;
 
+	/*
+	 * Read-only mapping of the image that a driver keeps in vmalloc_user()
+	 * memory and hands out with mtd_point() (e.g. at25sf041 with
+	 * CONFIG_SPI_AT25SF041_CACHE).
+	 */
+	if (mtd->_point) {
+		size_t len = vma->vm_end - vma->vm_start;
+		loff_t from = (loff_t)vma->vm_pgoff << PAGE_SHIFT;
+		size_t retlen;
+		void *virt;
+		int ret;
+
+		if (vma->vm_flags & VM_WRITE)
+			return -EACCES;
+
+		ret = mtd_point(mtd, from, len, &retlen, &virt, NULL);
+		if (ret)
+			return ret;
+
+		if (retlen == len && is_vmalloc_addr(virt) &&
+		    PAGE_ALIGNED(virt)) {
+			vma->vm_flags &= ~VM_MAYWRITE;
+			/* Fails unless the area is VM_USERMAP */
+			ret = remap_vmalloc_range_partial(vma, vma->vm_start,
+							  virt, len);
+		} else {
+			ret = -ENODEV;
+		}
+		mtd_unpoint(mtd, from, len);
+		return ret;
+	}
+
         /* This is broken because it assumes the MTD device is map-based
 	   and that mtd->priv is a valid struct map_info.  It should be
 	   replaced with something that uses the mtd_get_unmapped_area()
@@ -2,20 +2,76 @@
 /*
  * Copyright (C) 2019 Frederik Peter Aalund, SBT Instruments
  */
+#include <linux/delay.h>
+#include <linux/jiffies.h>
 #include <linux/module.h>
 #include <linux/mtd/spi-nor.h>
+#include <linux/mutex.h>
 #include <linux/platform_device.h>
+#include <linux/sizes.h>
 #include <linux/spi/spi.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 
 #define AT25SF041_MAN_ID 0x1F
 #define AT25SF041_DEV_ID1 0x84
 #define AT25SF041_DEV_ID2 0x01
 #define AT25SF041_PAGE_SIZE 256
+/* Worst case duration (with some margin) of the self-timed operations
+ * (tWRSR, tPP, tBE, and tCHPE in the datasheet) */
+#define AT25SF041_WRSR_TIMEOUT_MS 100
+#define AT25SF041_PP_TIMEOUT_MS 10
+#define AT25SF041_BE_4K_TIMEOUT_MS 400
+#define AT25SF041_BE_32K_TIMEOUT_MS 1600
+#define AT25SF041_BE_64K_TIMEOUT_MS 3000
+#define AT25SF041_CHIP_ERASE_TIMEOUT_MS 12000
+/* Buffered writes are programmed after this delay at the latest */
+#define AT25SF041_WB_DELAY_MS 20
+/* The cache is loaded in blocks of this size */
+#define AT25SF041_CACHE_BLOCK SZ_4K
 
 
 struct at25sf041 {
 	struct spi_nor nor;
+	/* Fast Read (1-1-1), Dual Output (1-1-2), or Quad Output (1-1-4).
+	 * Selected from 'spi-rx-bus-width' at probe. */
+	u8 read_opcode;
+	/* Bus width of the data phase of the read */
+	u8 read_nbits;
+	/* The read operation of spi-nor (see 'at25sf041_mtd_read') */
+	int (*nor_read)(struct mtd_info *mtd, loff_t from, size_t len,
+	                size_t *retlen, u_char *buf);
+	/* Write-back buffer of a single page. Successive writes to the same
+	 * page are merged and programmed with a single page program.
+	 * Protected by 'wb_lock'. */
+	struct mutex wb_lock;
+	struct delayed_work wb_work;
+	bool wb_valid;
+	loff_t wb_page;
+	/* Buffered range within the page */
+	size_t wb_start;
+	size_t wb_end;
+	u8 wb_buf[AT25SF041_PAGE_SIZE] ____cacheline_aligned;
+	/* DMA-safe buffers of the queued messages. Protected by 'nor.lock'. */
+	u8 op_wren;
+	u8 op_cmd[4];
+	u8 op_rdsr;
+	u8 status ____cacheline_aligned;
+#ifdef CONFIG_SPI_AT25SF041_TEST_CON
+	/* Periodic connection test (if 'test_con_interval_ms' is set) */
+	struct delayed_work con_work;
+	/* Result of the latest periodic connection test */
+	int con_result;
+#endif
+#ifdef CONFIG_SPI_AT25SF041_CACHE
+	/* Image of the whole chip (see 'at25sf041_cache_load'). Allocated
+	 * with vmalloc_user so that it can be mapped to user space.
+	 * Protected by 'wb_lock'. */
+	u8 *cache;
+	/* The blocks of 'cache' that have been read from the chip */
+	unsigned long *cache_valid;
+#endif
 };
 
 struct at25sf041_page {
@@ -25,6 +81,37 @@ struct at25sf041_page {
 };
 
 
+#ifdef CONFIG_SPI_AT25SF041_CACHE
+/* Forget the loaded blocks. Also called without 'wb_lock' (after a failed
+ * connection test), hence the atomic bit operations. */
+static void at25sf041_cache_drop(struct at25sf041 *at25, loff_t from,
+                                 size_t len)
+{
+	unsigned long block;
+	if (NULL == at25->cache) {
+		return;
+	}
+	for (block = from / AT25SF041_CACHE_BLOCK;
+	     block * AT25SF041_CACHE_BLOCK < from + len; ++block) {
+		clear_bit(block, at25->cache_valid);
+	}
+}
+
+static void at25sf041_cache_drop_all(struct at25sf041 *at25)
+{
+	at25sf041_cache_drop(at25, 0, at25->nor.mtd.size);
+}
+#else
+static void at25sf041_cache_drop(struct at25sf041 *at25, loff_t from,
+                                 size_t len)
+{
+}
+
+static void at25sf041_cache_drop_all(struct at25sf041 *at25)
+{
+}
+#endif
+
 #ifdef CONFIG_SPI_AT25SF041_TEST_CON
 /* Tests if the chip is connected by probing the status and ID registers.
  *
@@ -96,6 +183,101 @@ static int at25sf041_test_con(struct spi_device *spi)
 	}
 	return 0;
 }
+
+static unsigned int test_con_interval_ms =
+	CONFIG_SPI_AT25SF041_TEST_CON_INTERVAL_MS;
+module_param(test_con_interval_ms, uint, 0444);
+MODULE_PARM_DESC(test_con_interval_ms,
+                 "Interval of the connection test (0 to test before each operation)");
+
+/* With an interval, the operations only see the result of the latest
+ * periodic test. Without, each operation tests the connection first. */
+static int at25sf041_check_con(struct spi_nor *nor)
+{
+	struct at25sf041 *at25 = container_of(nor, struct at25sf041, nor);
+	int result;
+	if (0 != test_con_interval_ms) {
+		return READ_ONCE(at25->con_result);
+	}
+	result = at25sf041_test_con(nor->spi);
+	if (0 != result) {
+		dev_dbg(nor->dev, "Connection test failed: %d\n", result);
+		/* A different chip may show up */
+		at25sf041_cache_drop_all(at25);
+	}
+	return result;
+}
+
+/* Test the connection right away after an SPI error (instead of at the
+ * end of the interval) */
+static void at25sf041_con_error(struct spi_nor *nor)
+{
+	struct at25sf041 *at25 = container_of(nor, struct at25sf041, nor);
+	if (0 != test_con_interval_ms) {
+		mod_delayed_work(system_wq, &at25->con_work, 0);
+	}
+}
+
+static void at25sf041_con_work(struct work_struct *work)
+{
+	struct at25sf041 *at25 = container_of(to_delayed_work(work),
+	                                      struct at25sf041, con_work);
+	struct spi_nor *nor = &at25->nor;
+	int result;
+	mutex_lock(&nor->lock);
+	result = at25sf041_test_con(nor->spi);
+	mutex_unlock(&nor->lock);
+	if (result != at25->con_result) {
+		if (0 != result) {
+			dev_warn(nor->dev, "Connection test failed: %d\n", result);
+			at25sf041_cache_drop_all(at25);
+		} else {
+			dev_info(nor->dev, "Connection restored\n");
+		}
+	}
+	WRITE_ONCE(at25->con_result, result);
+	queue_delayed_work(system_wq, &at25->con_work,
+	                   msecs_to_jiffies(test_con_interval_ms));
+}
+
+static void at25sf041_con_init(struct at25sf041 *at25)
+{
+	INIT_DELAYED_WORK(&at25->con_work, at25sf041_con_work);
+}
+
+static void at25sf041_con_start(struct at25sf041 *at25)
+{
+	if (0 != test_con_interval_ms) {
+		queue_delayed_work(system_wq, &at25->con_work,
+		                   msecs_to_jiffies(test_con_interval_ms));
+	}
+}
+
+static void at25sf041_con_stop(struct at25sf041 *at25)
+{
+	cancel_delayed_work_sync(&at25->con_work);
+}
+#else
+static int at25sf041_check_con(struct spi_nor *nor)
+{
+	return 0;
+}
+
+static void at25sf041_con_error(struct spi_nor *nor)
+{
+}
+
+static void at25sf041_con_init(struct at25sf041 *at25)
+{
+}
+
+static void at25sf041_con_start(struct at25sf041 *at25)
+{
+}
+
+static void at25sf041_con_stop(struct at25sf041 *at25)
+{
+}
 #endif
 
 static int at25sf041_read_reg(struct spi_nor *nor, u8 opcode, u8 *buf, int len)
@@ -111,13 +293,10 @@ static int at25sf041_read_reg(struct spi_nor *nor, u8 opcode, u8 *buf, int len)
 	};
 	struct spi_message m;
 	int result;
-#ifdef CONFIG_SPI_AT25SF041_TEST_CON
-	result = at25sf041_test_con(spi);
+	result = at25sf041_check_con(nor);
 	if (0 != result) {
-		dev_dbg(nor->dev, "Connection test failed: %d\n", result);
 		return result;
 	}
-#endif
 	spi_message_init(&m);
 	spi_message_add_tail(&command_t, &m);
 	if (0 < len) {
@@ -125,6 +304,7 @@ static int at25sf041_read_reg(struct spi_nor *nor, u8 opcode, u8 *buf, int len)
 	}
 	result = spi_sync(spi, &m);
 	if (0 != result) {
+		at25sf041_con_error(nor);
 		return result;
 	}
 	return 0;
@@ -143,13 +323,10 @@ static int at25sf041_write_reg(struct spi_nor *nor, u8 opcode, u8 *buf, int len)
 	};
 	struct spi_message m;
 	int result;
-#ifdef CONFIG_SPI_AT25SF041_TEST_CON
-	result = at25sf041_test_con(spi);
+	result = at25sf041_check_con(nor);
 	if (0 != result) {
-		dev_dbg(nor->dev, "Connection test failed: %d\n", result);
 		return result;
 	}
-#endif
 	spi_message_init(&m);
 	spi_message_add_tail(&command_t, &m);
 	if (0 < len) {
@@ -157,6 +334,7 @@ static int at25sf041_write_reg(struct spi_nor *nor, u8 opcode, u8 *buf, int len)
 	}
 	result = spi_sync(spi, &m);
 	if (0 != result) {
+		at25sf041_con_error(nor);
 		return result;
 	}
 	return 0;
@@ -166,14 +344,15 @@ static ssize_t at25sf041_read(struct spi_nor *nor, loff_t from,
                                   size_t len, u_char *read_buf)
 {
 	struct spi_device *spi = container_of(nor->dev, struct spi_device, dev);
+	struct at25sf041 *at25 = container_of(nor, struct at25sf041, nor);
 	u8 command_buf[] = {
 		/* read array opcode */
-		0x0b,
+		at25->read_opcode,
 		/* address */
 		(from >> 16) & 0xFF,
 		(from >> 8) & 0xFF,
 		from & 0xFF,
-		/* dummy byte */
+		/* dummy byte (8 dummy clocks for all of the read modes) */
 		0,
 	};
 	struct spi_transfer command_t = {
@@ -186,21 +365,20 @@ static ssize_t at25sf041_read(struct spi_nor *nor, loff_t from,
 	struct spi_transfer data_t = {
 		.rx_buf = read_buf,
 		.len = read_len,
+		.rx_nbits = at25->read_nbits,
 	};
 	struct spi_message m;
 	int result;
-#ifdef CONFIG_SPI_AT25SF041_TEST_CON
-	result = at25sf041_test_con(spi);
+	result = at25sf041_check_con(nor);
 	if (0 != result) {
-		dev_dbg(nor->dev, "Connection test failed: %d\n", result);
 		return result;
 	}
-#endif
 	spi_message_init(&m);
 	spi_message_add_tail(&command_t, &m);
 	spi_message_add_tail(&data_t, &m);
 	result = spi_sync(spi, &m);
 	if (0 != result) {
+		at25sf041_con_error(nor);
 		return result;
 	}
 	return read_len;
@@ -228,18 +406,16 @@ static ssize_t at25sf041_write_page(struct spi_nor *nor,
 	};
 	struct spi_message m;
 	ssize_t result;
-#ifdef CONFIG_SPI_AT25SF041_TEST_CON
-	result = at25sf041_test_con(spi);
+	result = at25sf041_check_con(nor);
 	if (0 != result) {
-		dev_dbg(nor->dev, "Connection test failed: %d\n", result);
 		return result;
 	}
-#endif
 	spi_message_init(&m);
 	spi_message_add_tail(&command_t, &m);
 	spi_message_add_tail(&data_t, &m);
 	result = spi_sync(spi, &m);
 	if (0 != result) {
+		at25sf041_con_error(nor);
 		return result;
 	}
 	return page->len;
@@ -276,6 +452,538 @@ static ssize_t at25sf041_write(struct spi_nor *nor, loff_t to,
 	return write_len;
 }
 
+/* Wait for the end of a self-timed operation (write, program, or erase).
+ * Polls the status register every 'poll_us' (or a bit longer). */
+static int at25sf041_wait_ready(struct spi_nor *nor, unsigned int timeout_ms,
+                                unsigned int poll_us)
+{
+	unsigned long deadline = jiffies + msecs_to_jiffies(timeout_ms);
+	u8 status;
+	int result;
+	for (;;) {
+		result = at25sf041_read_reg(nor, SPINOR_OP_RDSR, &status, 1);
+		if (0 != result) {
+			return result;
+		}
+		if (!(status & SR_WIP)) {
+			return 0;
+		}
+		if (time_after(jiffies, deadline)) {
+			return -ETIMEDOUT;
+		}
+		usleep_range(poll_us, 2 * poll_us);
+	}
+}
+
+/* Set the Quad Enable (QE) bit of status register byte 2. It is
+ * non-volatile so we only write it if it is not already set. */
+static int at25sf041_quad_enable(struct spi_nor *nor)
+{
+	u8 status[2];
+	int result;
+	result = at25sf041_read_reg(nor, SPINOR_OP_RDSR, &status[0], 1);
+	if (0 != result) {
+		return result;
+	}
+	result = at25sf041_read_reg(nor, SPINOR_OP_RDCR, &status[1], 1);
+	if (0 != result) {
+		return result;
+	}
+	if (status[1] & CR_QUAD_EN_SPAN) {
+		return 0;
+	}
+	status[1] |= CR_QUAD_EN_SPAN;
+	result = at25sf041_write_reg(nor, SPINOR_OP_WREN, NULL, 0);
+	if (0 != result) {
+		return result;
+	}
+	/* The write status register command takes both bytes */
+	result = at25sf041_write_reg(nor, SPINOR_OP_WRSR, status, 2);
+	if (0 != result) {
+		return result;
+	}
+	result = at25sf041_wait_ready(nor, AT25SF041_WRSR_TIMEOUT_MS, 1000);
+	if (0 != result) {
+		return result;
+	}
+	result = at25sf041_read_reg(nor, SPINOR_OP_RDCR, &status[1], 1);
+	if (0 != result) {
+		return result;
+	}
+	if (!(status[1] & CR_QUAD_EN_SPAN)) {
+		return -EIO;
+	}
+	return 0;
+}
+
+/* Execute a self-timed operation as a single queued message: Write enable,
+ * the operation itself, and the first status read. Only polls the status
+ * register again (with separate messages) if the operation is still in
+ * progress by then. Call with 'nor.lock' held. */
+static int at25sf041_exec_timed(struct at25sf041 *at25, u8 opcode,
+                                bool has_addr, loff_t addr,
+                                const u8 *data, size_t len,
+                                unsigned int timeout_ms, unsigned int poll_us)
+{
+	struct spi_nor *nor = &at25->nor;
+	struct spi_device *spi = nor->spi;
+	struct spi_transfer wren_t = {
+		.tx_buf = &at25->op_wren,
+		.len = 1,
+		/* pull chip select up between the commands */
+		.cs_change = 1,
+	};
+	struct spi_transfer command_t = {
+		.tx_buf = at25->op_cmd,
+		.len = has_addr ? ARRAY_SIZE(at25->op_cmd) : 1,
+		.cs_change = 0 == len,
+	};
+	struct spi_transfer data_t = {
+		.tx_buf = data,
+		.len = len,
+		.cs_change = 1,
+	};
+	struct spi_transfer sr_req = {
+		.tx_buf = &at25->op_rdsr,
+		.len = 1,
+	};
+	struct spi_transfer sr_res = {
+		.rx_buf = &at25->status,
+		.len = 1,
+	};
+	struct spi_message m;
+	int result;
+	result = at25sf041_check_con(nor);
+	if (0 != result) {
+		return result;
+	}
+	at25->op_wren = SPINOR_OP_WREN;
+	at25->op_cmd[0] = opcode;
+	at25->op_cmd[1] = (addr >> 16) & 0xFF;
+	at25->op_cmd[2] = (addr >> 8) & 0xFF;
+	at25->op_cmd[3] = addr & 0xFF;
+	at25->op_rdsr = SPINOR_OP_RDSR;
+	spi_message_init(&m);
+	spi_message_add_tail(&wren_t, &m);
+	spi_message_add_tail(&command_t, &m);
+	if (0 < len) {
+		spi_message_add_tail(&data_t, &m);
+	}
+	spi_message_add_tail(&sr_req, &m);
+	spi_message_add_tail(&sr_res, &m);
+	result = spi_sync(spi, &m);
+	if (0 != result) {
+		at25sf041_con_error(nor);
+		return result;
+	}
+	if (!(at25->status & SR_WIP)) {
+		return 0;
+	}
+	return at25sf041_wait_ready(nor, timeout_ms, poll_us);
+}
+
+/* Program the buffered range of the write-back buffer (if any). Call with
+ * 'wb_lock' held. */
+static int at25sf041_wb_flush(struct at25sf041 *at25)
+{
+	struct spi_nor *nor = &at25->nor;
+	int result;
+	if (!at25->wb_valid) {
+		return 0;
+	}
+	at25->wb_valid = false;
+	mutex_lock(&nor->lock);
+	result = at25sf041_exec_timed(at25, SPINOR_OP_PP, true,
+	                              at25->wb_page + at25->wb_start,
+	                              at25->wb_buf + at25->wb_start,
+	                              at25->wb_end - at25->wb_start,
+	                              AT25SF041_PP_TIMEOUT_MS, 100);
+	mutex_unlock(&nor->lock);
+	if (0 != result) {
+		dev_err(nor->dev, "Failed to program page 0x%llx: %d\n",
+		        (long long)at25->wb_page, result);
+		/* The cache has the data that we failed to program */
+		at25sf041_cache_drop(at25, at25->wb_page, AT25SF041_PAGE_SIZE);
+	}
+	return result;
+}
+
+static void at25sf041_wb_work(struct work_struct *work)
+{
+	struct at25sf041 *at25 = container_of(to_delayed_work(work),
+	                                      struct at25sf041, wb_work);
+	mutex_lock(&at25->wb_lock);
+	at25sf041_wb_flush(at25);
+	mutex_unlock(&at25->wb_lock);
+}
+
+/* Whether the range [start, end) of 'page' can join the buffered range.
+ * I.e., it is in the same page and overlaps or adjoins the buffered range
+ * (so that the result is still a single range). */
+static bool at25sf041_wb_mergeable(struct at25sf041 *at25, loff_t page,
+                                   size_t start, size_t end)
+{
+	return at25->wb_valid && page == at25->wb_page &&
+	       start <= at25->wb_end && at25->wb_start <= end;
+}
+
+/* Add data to the write-back buffer. The bytes that overlap previously
+ * buffered bytes are AND'ed like the flash cells would be if we programmed
+ * them twice. */
+static void at25sf041_wb_merge(struct at25sf041 *at25, loff_t page,
+                               size_t start, size_t end, const u_char *buf)
+{
+	size_t i;
+	if (!at25->wb_valid) {
+		at25->wb_valid = true;
+		at25->wb_page = page;
+		at25->wb_start = start;
+		at25->wb_end = end;
+		memcpy(at25->wb_buf + start, buf, end - start);
+		return;
+	}
+	for (i = start; end != i; ++i) {
+		if (at25->wb_start <= i && i < at25->wb_end) {
+			at25->wb_buf[i] &= buf[i - start];
+		} else {
+			at25->wb_buf[i] = buf[i - start];
+		}
+	}
+	at25->wb_start = min(at25->wb_start, start);
+	at25->wb_end = max(at25->wb_end, end);
+}
+
+#ifdef CONFIG_SPI_AT25SF041_CACHE
+static bool at25sf041_cache_enabled(struct at25sf041 *at25)
+{
+	return NULL != at25->cache;
+}
+
+/* Read the blocks of [from, from + len) that are not in the cache yet. Call
+ * with 'wb_lock' held. */
+static int at25sf041_cache_load(struct at25sf041 *at25, loff_t from,
+                                size_t len)
+{
+	struct mtd_info *mtd = &at25->nor.mtd;
+	unsigned long block;
+	loff_t addr;
+	size_t retlen;
+	int result;
+	for (block = from / AT25SF041_CACHE_BLOCK;
+	     block * AT25SF041_CACHE_BLOCK < from + len; ++block) {
+		if (test_bit(block, at25->cache_valid)) {
+			continue;
+		}
+		addr = (loff_t)block * AT25SF041_CACHE_BLOCK;
+		/* The chip must have the buffered data first */
+		if (at25->wb_valid && addr <= at25->wb_page &&
+		    at25->wb_page < addr + AT25SF041_CACHE_BLOCK) {
+			result = at25sf041_wb_flush(at25);
+			if (0 != result) {
+				return result;
+			}
+		}
+		retlen = 0;
+		result = at25->nor_read(mtd, addr, AT25SF041_CACHE_BLOCK, &retlen,
+		                        at25->cache + addr);
+		if (0 != result) {
+			return result;
+		}
+		if (AT25SF041_CACHE_BLOCK != retlen) {
+			return -EIO;
+		}
+		set_bit(block, at25->cache_valid);
+	}
+	return 0;
+}
+
+static int at25sf041_cache_read(struct at25sf041 *at25, loff_t from,
+                                size_t len, size_t *retlen, u_char *buf)
+{
+	int result;
+	result = at25sf041_cache_load(at25, from, len);
+	if (0 != result) {
+		return result;
+	}
+	memcpy(buf, at25->cache + from, len);
+	*retlen = len;
+	return 0;
+}
+
+/* Update the cached parts of [addr, addr + len) after programming 'buf' or,
+ * if 'buf' is NULL, after an erase */
+static void at25sf041_cache_update(struct at25sf041 *at25, loff_t addr,
+                                   size_t len, const u_char *buf)
+{
+	size_t n, i;
+	if (NULL == at25->cache) {
+		return;
+	}
+	while (0 < len) {
+		n = min_t(size_t, len, AT25SF041_CACHE_BLOCK -
+		          (addr & (AT25SF041_CACHE_BLOCK - 1)));
+		if (test_bit(addr / AT25SF041_CACHE_BLOCK, at25->cache_valid)) {
+			if (NULL != buf) {
+				/* Programming only clears bits */
+				for (i = 0; n != i; ++i) {
+					at25->cache[addr + i] &= buf[i];
+				}
+			} else {
+				memset(at25->cache + addr, 0xFF, n);
+			}
+		}
+		addr += n;
+		if (NULL != buf) {
+			buf += n;
+		}
+		len -= n;
+	}
+}
+
+static int at25sf041_mtd_point(struct mtd_info *mtd, loff_t from, size_t len,
+                               size_t *retlen, void **virt,
+                               resource_size_t *phys)
+{
+	struct at25sf041 *at25 = container_of(mtd, struct at25sf041, nor.mtd);
+	int result;
+	mutex_lock(&at25->wb_lock);
+	result = at25sf041_cache_load(at25, from, len);
+	mutex_unlock(&at25->wb_lock);
+	if (0 != result) {
+		return result;
+	}
+	*virt = at25->cache + from;
+	*retlen = len;
+	return 0;
+}
+
+/* The cache stays until the driver goes away */
+static int at25sf041_mtd_unpoint(struct mtd_info *mtd, loff_t from, size_t len)
+{
+	return 0;
+}
+
+static int at25sf041_cache_init(struct at25sf041 *at25)
+{
+	struct mtd_info *mtd = &at25->nor.mtd;
+	at25->cache = vmalloc_user(mtd->size);
+	if (NULL == at25->cache) {
+		return -ENOMEM;
+	}
+	at25->cache_valid = bitmap_zalloc(mtd->size / AT25SF041_CACHE_BLOCK,
+	                                  GFP_KERNEL);
+	if (NULL == at25->cache_valid) {
+		vfree(at25->cache);
+		at25->cache = NULL;
+		return -ENOMEM;
+	}
+	mtd->_point = at25sf041_mtd_point;
+	mtd->_unpoint = at25sf041_mtd_unpoint;
+	return 0;
+}
+
+static void at25sf041_cache_release(struct at25sf041 *at25)
+{
+	bitmap_free(at25->cache_valid);
+	vfree(at25->cache);
+	at25->cache = NULL;
+}
+#else
+static bool at25sf041_cache_enabled(struct at25sf041 *at25)
+{
+	return false;
+}
+
+static int at25sf041_cache_read(struct at25sf041 *at25, loff_t from,
+                                size_t len, size_t *retlen, u_char *buf)
+{
+	return -EOPNOTSUPP;
+}
+
+static void at25sf041_cache_update(struct at25sf041 *at25, loff_t addr,
+                                   size_t len, const u_char *buf)
+{
+}
+
+static int at25sf041_cache_init(struct at25sf041 *at25)
+{
+	return 0;
+}
+
+static void at25sf041_cache_release(struct at25sf041 *at25)
+{
+}
+#endif
+
+/* Writes go through the write-back buffer. Full pages are programmed right
+ * away. Partial pages wait for more data for a short while (see
+ * AT25SF041_WB_DELAY_MS). A later error of said program is only logged. */
+static int at25sf041_mtd_write(struct mtd_info *mtd, loff_t to, size_t len,
+                               size_t *retlen, const u_char *buf)
+{
+	struct at25sf041 *at25 = container_of(mtd, struct at25sf041, nor.mtd);
+	int result = 0;
+	mutex_lock(&at25->wb_lock);
+	while (0 < len) {
+		loff_t page = to & ~(loff_t)(AT25SF041_PAGE_SIZE - 1);
+		size_t start = to - page;
+		size_t end = min_t(size_t, AT25SF041_PAGE_SIZE, start + len);
+		if (at25->wb_valid &&
+		    !at25sf041_wb_mergeable(at25, page, start, end)) {
+			result = at25sf041_wb_flush(at25);
+			if (0 != result) {
+				break;
+			}
+		}
+		at25sf041_wb_merge(at25, page, start, end, buf);
+		at25sf041_cache_update(at25, to, end - start, buf);
+		if (0 == at25->wb_start && AT25SF041_PAGE_SIZE == at25->wb_end) {
+			result = at25sf041_wb_flush(at25);
+			if (0 != result) {
+				break;
+			}
+		}
+		*retlen += end - start;
+		to += end - start;
+		buf += end - start;
+		len -= end - start;
+	}
+	if (at25->wb_valid) {
+		mod_delayed_work(system_wq, &at25->wb_work,
+		                 msecs_to_jiffies(AT25SF041_WB_DELAY_MS));
+	}
+	mutex_unlock(&at25->wb_lock);
+	return result;
+}
+
+/* Reads of the buffered page must see the buffered data (the cache has
+ * it already) */
+static int at25sf041_mtd_read(struct mtd_info *mtd, loff_t from, size_t len,
+                              size_t *retlen, u_char *buf)
+{
+	struct at25sf041 *at25 = container_of(mtd, struct at25sf041, nor.mtd);
+	int result = 0;
+	mutex_lock(&at25->wb_lock);
+	if (at25sf041_cache_enabled(at25)) {
+		result = at25sf041_cache_read(at25, from, len, retlen, buf);
+		mutex_unlock(&at25->wb_lock);
+		return result;
+	}
+	if (at25->wb_valid &&
+	    at25->wb_page + at25->wb_start < from + len &&
+	    from < at25->wb_page + at25->wb_end) {
+		result = at25sf041_wb_flush(at25);
+	}
+	if (0 == result) {
+		result = at25->nor_read(mtd, from, len, retlen, buf);
+	}
+	mutex_unlock(&at25->wb_lock);
+	return result;
+}
+
+/* Use the largest erase that fits the alignment and the remaining length.
+ * Returns the erase size and sets 'opcode' and 'timeout_ms'. */
+static u32 at25sf041_erase_op(struct mtd_info *mtd, u32 addr, u32 len,
+                              u8 *opcode, unsigned int *timeout_ms)
+{
+	if (0 == addr && mtd->size == len) {
+		*opcode = SPINOR_OP_CHIP_ERASE;
+		*timeout_ms = AT25SF041_CHIP_ERASE_TIMEOUT_MS;
+		return len;
+	}
+	if (IS_ALIGNED(addr, SZ_64K) && SZ_64K <= len) {
+		*opcode = SPINOR_OP_SE;
+		*timeout_ms = AT25SF041_BE_64K_TIMEOUT_MS;
+		return SZ_64K;
+	}
+	if (IS_ALIGNED(addr, SZ_32K) && SZ_32K <= len) {
+		*opcode = SPINOR_OP_BE_32K;
+		*timeout_ms = AT25SF041_BE_32K_TIMEOUT_MS;
+		return SZ_32K;
+	}
+	*opcode = SPINOR_OP_BE_4K;
+	*timeout_ms = AT25SF041_BE_4K_TIMEOUT_MS;
+	return SZ_4K;
+}
+
+static int at25sf041_mtd_erase(struct mtd_info *mtd, struct erase_info *instr)
+{
+	struct at25sf041 *at25 = container_of(mtd, struct at25sf041, nor.mtd);
+	struct spi_nor *nor = &at25->nor;
+	u32 addr = instr->addr;
+	u32 len = instr->len;
+	unsigned int timeout_ms;
+	u32 erase_len;
+	u8 opcode;
+	int result = 0;
+	if (!IS_ALIGNED(addr, SZ_4K) || !IS_ALIGNED(len, SZ_4K)) {
+		return -EINVAL;
+	}
+	mutex_lock(&at25->wb_lock);
+	/* Drop the buffered data if the erase covers it anyway */
+	if (at25->wb_valid) {
+		if (addr <= at25->wb_page &&
+		    at25->wb_page + AT25SF041_PAGE_SIZE <= (loff_t)addr + len) {
+			at25->wb_valid = false;
+		} else {
+			result = at25sf041_wb_flush(at25);
+		}
+	}
+	mutex_lock(&nor->lock);
+	while (0 == result && 0 < len) {
+		erase_len = at25sf041_erase_op(mtd, addr, len, &opcode, &timeout_ms);
+		result = at25sf041_exec_timed(at25, opcode,
+		                              SPINOR_OP_CHIP_ERASE != opcode, addr,
+		                              NULL, 0, timeout_ms, 1000);
+		if (0 != result) {
+			instr->fail_addr = addr;
+			at25sf041_cache_drop(at25, addr, len);
+			break;
+		}
+		at25sf041_cache_update(at25, addr, erase_len, NULL);
+		addr += erase_len;
+		len -= erase_len;
+	}
+	mutex_unlock(&nor->lock);
+	mutex_unlock(&at25->wb_lock);
+	return result;
+}
+
+static void at25sf041_mtd_sync(struct mtd_info *mtd)
+{
+	struct at25sf041 *at25 = container_of(mtd, struct at25sf041, nor.mtd);
+	cancel_delayed_work_sync(&at25->wb_work);
+	mutex_lock(&at25->wb_lock);
+	at25sf041_wb_flush(at25);
+	mutex_unlock(&at25->wb_lock);
+}
+
+/* Select the read mode from the bus width of the data lines. The SPI
+ * core sets SPI_RX_DUAL/SPI_RX_QUAD from 'spi-rx-bus-width'. */
+static void at25sf041_select_read_mode(struct at25sf041 *at25)
+{
+	struct spi_device *spi = at25->nor.spi;
+	int result;
+	if (spi->mode & SPI_RX_QUAD) {
+		result = at25sf041_quad_enable(&at25->nor);
+		if (0 == result) {
+			at25->read_opcode = SPINOR_OP_READ_1_1_4;
+			at25->read_nbits = SPI_NBITS_QUAD;
+			dev_dbg(&spi->dev, "Using Quad Output reads\n");
+			return;
+		}
+		dev_warn(&spi->dev, "Failed to enable quad mode: %d\n", result);
+	}
+	if (spi->mode & (SPI_RX_DUAL | SPI_RX_QUAD)) {
+		at25->read_opcode = SPINOR_OP_READ_1_1_2;
+		at25->read_nbits = SPI_NBITS_DUAL;
+		dev_dbg(&spi->dev, "Using Dual Output reads\n");
+		return;
+	}
+	at25->read_opcode = SPINOR_OP_READ_FAST;
+	at25->read_nbits = SPI_NBITS_SINGLE;
+}
+
 static int at25sf041_probe(struct spi_device *spi)
 {
 	struct at25sf041 *at25;
@@ -304,10 +1012,32 @@ static int at25sf041_probe(struct spi_device *spi)
 	at25->nor.read = at25sf041_read;
 	at25->nor.write = at25sf041_write;
 
+	/* an SPI error may trigger a connection test already during the scan */
+	at25sf041_con_init(at25);
+
 	/* scan for flash chip */
 	result = spi_nor_scan(&at25->nor, "at25sf041", &hwcaps);
 	if (0 != result) {
 		dev_err(dev, "Failed to find flash memory chip: %d\n", result);
+		at25sf041_con_stop(at25);
+		return result;
+	}
+
+	at25sf041_select_read_mode(at25);
+
+	/* replace the MTD operations of spi-nor with our own (that queue the
+	 * write enable and status reads with the operation itself) */
+	mutex_init(&at25->wb_lock);
+	INIT_DELAYED_WORK(&at25->wb_work, at25sf041_wb_work);
+	at25->nor_read = at25->nor.mtd._read;
+	at25->nor.mtd._read = at25sf041_mtd_read;
+	at25->nor.mtd._write = at25sf041_mtd_write;
+	at25->nor.mtd._erase = at25sf041_mtd_erase;
+	at25->nor.mtd._sync = at25sf041_mtd_sync;
+
+	result = at25sf041_cache_init(at25);
+	if (0 != result) {
+		at25sf041_con_stop(at25);
 		return result;
 	}
 
@@ -315,9 +1045,13 @@ static int at25sf041_probe(struct spi_device *spi)
 	result = mtd_device_register(&at25->nor.mtd, NULL, 0);
 	if (0 != result) {
 		dev_err(dev, "Failed to register MTD device: %d\n", result);
+		at25sf041_cache_release(at25);
+		at25sf041_con_stop(at25);
 		return result;
 	}
 
+	at25sf041_con_start(at25);
+
 	dev_dbg(dev, "Success\n");
 	return 0;
 }
@@ -327,9 +1061,18 @@ static int at25sf041_remove(struct spi_device *spi)
 	struct at25sf041 *at25 = spi_get_drvdata(spi);
 	struct spi_nor *nor = &at25->nor;
 	mtd_device_unregister(&nor->mtd);
+	at25sf041_mtd_sync(&nor->mtd);
+	at25sf041_con_stop(at25);
+	at25sf041_cache_release(at25);
 	return 0;
 }
 
+static void at25sf041_shutdown(struct spi_device *spi)
+{
+	struct at25sf041 *at25 = spi_get_drvdata(spi);
+	at25sf041_mtd_sync(&at25->nor.mtd);
+}
+
 
 static const struct of_device_id at25sf041_of_match[] = {
 	{.compatible = "at25sf041"},
@@ -345,6 +1088,7 @@ static struct spi_driver at25sf041_driver = {
 	},
 	.probe = at25sf041_probe,
 	.remove = at25sf041_remove,
+	.shutdown = at25sf041_shutdown,
 };
 module_spi_driver(at25sf041_driver)
 
@@ -72,10 +72,14 @@
 #include <linux/err.h>
 #include <linux/slab.h>
 #include <linux/crc32.h>
+#include <linux/ktime.h>
 #include <linux/math64.h>
 #include <linux/random.h>
 #include "ubi.h"
 
+#define CREATE_TRACE_POINTS
+#include <trace/events/ubi.h>
+
 static int self_check_ai(struct ubi_device *ubi, struct ubi_attach_info *ai);
 
 #define AV_FIND		BIT(0)
@@ -1394,6 +1398,7 @@ static int scan_all(struct ubi_device *ubi, struct ubi_attach_info *ai,
 
 		dbg_gen("process PEB %d", pnum);
 		err = scan_peb(ubi, ai, pnum, false);
+		trace_ubi_scan_peb(ubi->ubi_num, pnum, err);
 		if (err < 0)
 			goto out_vidh;
 	}
@@ -1508,6 +1513,7 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 
 		dbg_gen("process PEB %d", pnum);
 		err = scan_peb(ubi, scan_ai, pnum, true);
+		trace_ubi_scan_peb(ubi->ubi_num, pnum, err);
 		if (err < 0)
 			goto out_vidh;
 	}
@@ -1544,6 +1550,26 @@ static int scan_fast(struct ubi_device *ubi, struct ubi_attach_info **ai)
 
 #endif
 
+/**
+ * attach_phase - account for one phase of attaching.
+ * @ubi: UBI device descriptor
+ * @phase: name of the phase
+ * @t: start time of the phase, set to the current time on return
+ *
+ * This function emits the phase duration as a trace event and returns it in
+ * milliseconds.
+ */
+static s64 attach_phase(struct ubi_device *ubi, const char *phase, ktime_t *t)
+{
+	ktime_t now = ktime_get();
+	s64 ms = ktime_ms_delta(now, *t);
+
+	trace_ubi_attach_phase(ubi->ubi_num, phase,
+			       ktime_to_ns(ktime_sub(now, *t)));
+	*t = now;
+	return ms;
+}
+
 /**
  * ubi_attach - attach an MTD device.
  * @ubi: UBI device descriptor
@@ -1556,11 +1582,15 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 {
 	int err;
 	struct ubi_attach_info *ai;
+	ktime_t start, t;
+	s64 fm_ms = 0, scan_ms = 0, vtbl_ms, wl_ms, eba_ms;
 
 	ai = alloc_ai();
 	if (!ai)
 		return -ENOMEM;
 
+	start = t = ktime_get();
+
 #ifdef CONFIG_MTD_UBI_FASTMAP
 	/* On small flash devices we disable fastmap in any case. */
 	if ((int)mtd_div_by_eb(ubi->mtd->size, ubi->mtd) <= UBI_FM_MAX_START) {
@@ -1568,10 +1598,12 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 		force_scan = 1;
 	}
 
-	if (force_scan)
+	if (force_scan) {
 		err = scan_all(ubi, ai, 0);
-	else {
+		scan_ms = attach_phase(ubi, "scan", &t);
+	} else {
 		err = scan_fast(ubi, &ai);
+		fm_ms = attach_phase(ubi, "fastmap", &t);
 		if (err > 0 || mtd_is_eccerr(err)) {
 			if (err != UBI_NO_FASTMAP) {
 				destroy_ai(ai);
@@ -1583,10 +1615,12 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 			} else {
 				err = scan_all(ubi, ai, UBI_FM_MAX_START);
 			}
+			scan_ms = attach_phase(ubi, "scan", &t);
 		}
 	}
 #else
 	err = scan_all(ubi, ai, 0);
+	scan_ms = attach_phase(ubi, "scan", &t);
 #endif
 	if (err)
 		goto out_ai;
@@ -1601,14 +1635,17 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 	err = ubi_read_volume_table(ubi, ai);
 	if (err)
 		goto out_ai;
+	vtbl_ms = attach_phase(ubi, "vtbl", &t);
 
 	err = ubi_wl_init(ubi, ai);
 	if (err)
 		goto out_vtbl;
+	wl_ms = attach_phase(ubi, "wl", &t);
 
 	err = ubi_eba_init(ubi, ai);
 	if (err)
 		goto out_wl;
+	eba_ms = attach_phase(ubi, "eba", &t);
 
 #ifdef CONFIG_MTD_UBI_FASTMAP
 	if (ubi->fm && ubi_dbg_chk_fastmap(ubi)) {
@@ -1634,6 +1671,10 @@ int ubi_attach(struct ubi_device *ubi, int force_scan)
 	}
 #endif
 
+	ubi_msg(ubi, "attached in %lld ms: fastmap %lld, scan %lld, volume table %lld, WL %lld, EBA %lld",
+		ktime_ms_delta(ktime_get(), start), fm_ms, scan_ms, vtbl_ms,
+		wl_ms, eba_ms);
+
 	destroy_ai(ai);
 	return 0;
 
@@ -55,6 +55,9 @@
 /* Maximum number of comma-separated items in the 'block=' parameter */
 #define UBIBLOCK_PARAM_COUNT 2
 
+/* Default number of reads in flight per device */
+#define UBIBLOCK_DEFAULT_WORKERS 4
+
 struct ubiblock_param {
 	int ubi_num;
 	int vol_id;
@@ -171,6 +174,12 @@ MODULE_PARM_DESC(block, "Attach block devices to UBI volumes. Parameter format:
 			"Using both UBI device number and UBI volume number:\n"
 			"ubi.block=0,0\n");
 
+static unsigned int ubiblock_workers = UBIBLOCK_DEFAULT_WORKERS;
+module_param_named(block_workers, ubiblock_workers, uint, 0444);
+MODULE_PARM_DESC(block_workers, "Maximum number of concurrent reads per UBI block device (default: "
+			__stringify(UBIBLOCK_DEFAULT_WORKERS) ").\n"
+			"Example: ubi.block_workers=8");
+
 static struct ubiblock *find_dev_nolock(int ubi_num, int vol_id)
 {
 	struct ubiblock *dev;
@@ -437,6 +446,13 @@ int ubiblock_create(struct ubi_volume_info *vi)
 		goto out_free_tags;
 	}
 	blk_queue_max_segments(dev->rq, UBI_MAX_SG_COUNT);
+	/*
+	 * Let the block layer merge requests up to what a single pdu can
+	 * hold, and let readahead ask for as much. This way, squashfs
+	 * readahead turns into few large reads.
+	 */
+	blk_queue_max_hw_sectors(dev->rq, (UBI_MAX_SG_COUNT * PAGE_SIZE) >> 9);
+	dev->rq->backing_dev_info->ra_pages = UBI_MAX_SG_COUNT;
 
 	dev->rq->queuedata = dev;
 	dev->gd->queue = dev->rq;
@@ -444,8 +460,13 @@ int ubiblock_create(struct ubi_volume_info *vi)
 	/*
 	 * Create one workqueue per volume (per registered block device).
 	 * Rembember workqueues are cheap, they're not threads.
+	 *
+	 * The workqueue is unbound so that up to 'block_workers' reads run
+	 * at the same time, on any CPU, instead of behind each other on the
+	 * CPU that queued them.
 	 */
-	dev->wq = alloc_workqueue("%s", 0, 0, gd->disk_name);
+	dev->wq = alloc_workqueue("%s", WQ_UNBOUND, ubiblock_workers,
+				  gd->disk_name);
 	if (!dev->wq) {
 		ret = -ENOMEM;
 		goto out_free_queue;
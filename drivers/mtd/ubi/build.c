@@ -29,6 +29,7 @@
 #include <linux/kernel.h>
 #include <linux/slab.h>
 #include <linux/major.h>
+#include <linux/reboot.h>
 #include "ubi.h"
 
 /* Maximum length of the 'mtd=' parameter */
@@ -1168,6 +1169,41 @@ static struct mtd_info * __init open_mtd_device(const char *mtd_dev)
 	return mtd;
 }
 
+/**
+ * ubi_reboot_notify - write a fresh fastmap before the system goes down.
+ * @nb: the notifier block
+ * @event: the reboot event
+ * @unused: unused
+ *
+ * A UBI device compiled into the kernel is never detached, so without this
+ * the fastmap on flash is the one written at the last pool refill and the
+ * next attach has to scan all PEBs that were used since then.
+ */
+static int ubi_reboot_notify(struct notifier_block *nb, unsigned long event,
+			     void *unused)
+{
+	struct ubi_device *ubi;
+	int i, err;
+
+	for (i = 0; i < UBI_MAX_DEVICES; i++) {
+		ubi = ubi_get_device(i);
+		if (!ubi)
+			continue;
+
+		err = ubi_update_fastmap(ubi);
+		if (err)
+			ubi_err(ubi, "cannot write fastmap at reboot, error %d",
+				err);
+		ubi_put_device(ubi);
+	}
+
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block ubi_reboot_nb = {
+	.notifier_call = ubi_reboot_notify,
+};
+
 static int __init ubi_init(void)
 {
 	int err, i, k;
@@ -1205,6 +1241,9 @@ static int __init ubi_init(void)
 	if (err)
 		goto out_slab;
 
+	err = register_reboot_notifier(&ubi_reboot_nb);
+	if (err)
+		goto out_debugfs;
 
 	/* Attach MTD devices */
 	for (i = 0; i < mtd_devs; i++) {
@@ -1269,6 +1308,8 @@ static int __init ubi_init(void)
 			ubi_detach_mtd_dev(ubi_devices[k]->ubi_num, 1);
 			mutex_unlock(&ubi_devices_mutex);
 		}
+	unregister_reboot_notifier(&ubi_reboot_nb);
+out_debugfs:
 	ubi_debugfs_exit();
 out_slab:
 	kmem_cache_destroy(ubi_wl_entry_slab);
@@ -1286,6 +1327,7 @@ static void __exit ubi_exit(void)
 	int i;
 
 	ubiblock_exit();
+	unregister_reboot_notifier(&ubi_reboot_nb);
 
 	for (i = 0; i < UBI_MAX_DEVICES; i++)
 		if (ubi_devices[i]) {
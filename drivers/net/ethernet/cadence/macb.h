@@ -11,6 +11,8 @@
 #include <linux/ptp_clock_kernel.h>
 #include <linux/net_tstamp.h>
 #include <linux/interrupt.h>
+#include <linux/dim.h>
+#include <net/xdp.h>
 
 #if defined(CONFIG_ARCH_DMA_ADDR_T_64BIT) || defined(CONFIG_MACB_USE_HWSTAMP)
 #define MACB_EXT_DESC
@@ -81,6 +83,7 @@
 #define GEM_DMACFG		0x0010 /* DMA Configuration */
 #define GEM_PBUFRXCUT		0x0044 /* RX Partial Store and Forward */
 #define GEM_JML			0x0048 /* Jumbo Max Length */
+#define GEM_IMOD		0x005c /* Interrupt Moderation */
 #define GEM_HRB			0x0080 /* Hash Bottom */
 #define GEM_HRT			0x0084 /* Hash Top */
 #define GEM_SA1B		0x0088 /* Specific1 Bottom */
@@ -94,6 +97,9 @@
 #define GEM_WOL			0x00B8 /* Wake on LAN */
 #define GEM_RXPTPUNI		0x00D4 /* PTP RX Unicast address */
 #define GEM_TXPTPUNI		0x00D8 /* PTP TX Unicast address */
+#define GEM_NSC			0x00DC /* 1588 Timer Nanosecond Comparison */
+#define GEM_SCL			0x00E0 /* 1588 Timer Second Comparison Low */
+#define GEM_SCH			0x00E4 /* 1588 Timer Second Comparison High */
 #define GEM_EFTSH		0x00e8 /* PTP Event Frame Transmitted Seconds Register 47:32 */
 #define GEM_EFRSH		0x00ec /* PTP Event Frame Received Seconds Register 47:32 */
 #define GEM_PEFTSH		0x00f0 /* PTP Peer Event Frame Transmitted Seconds Register 47:32 */
@@ -327,6 +333,12 @@
 #define GEM_ENCUTTHRU_OFFSET	31 /* Enable RX partial store and forward */
 #define GEM_ENCUTTHRU_SIZE	1
 
+/* Bitfields in IMOD. The delays are in units of 800 ns. */
+#define GEM_RXIMOD_OFFSET	0 /* RX interrupt moderation delay */
+#define GEM_RXIMOD_SIZE		8
+#define GEM_TXIMOD_OFFSET	16 /* TX interrupt moderation delay */
+#define GEM_TXIMOD_SIZE		8
+
 /* Bitfields in NSR */
 #define MACB_NSR_LINK_OFFSET	0 /* pcs_link_state */
 #define MACB_NSR_LINK_SIZE	1
@@ -408,6 +420,8 @@
 #define MACB_PDRSFT_SIZE	1
 #define MACB_SRI_OFFSET		26 /* TSU Seconds Register Increment */
 #define MACB_SRI_SIZE		1
+#define MACB_TCI_OFFSET		29 /* TSU timer comparison interrupt */
+#define MACB_TCI_SIZE		1
 
 /* Timer increment fields */
 #define MACB_TI_CNS_OFFSET	0
@@ -534,6 +548,10 @@
 #define GEM_TN_OFFSET				0 /* TSU timer value (ns) */
 #define GEM_TN_SIZE					30
 
+/* Bitfields in NSC */
+#define GEM_NSC_OFFSET				0 /* Comparison value of TN[29:8] */
+#define GEM_NSC_SIZE				22
+
 /* Bitfields in TXBDCTRL */
 #define GEM_TXTSMODE_OFFSET			4 /* TX Descriptor Timestamp Insertion mode */
 #define GEM_TXTSMODE_SIZE			2
@@ -875,6 +893,8 @@ struct gem_tx_ts {
  */
 struct macb_tx_skb {
 	struct sk_buff		*skb;
+	/* Set instead of skb for (single-buffer) XDP frames */
+	struct xdp_frame	*xdpf;
 	dma_addr_t		mapping;
 	size_t			size;
 	bool			mapped_as_page;
@@ -1129,6 +1149,14 @@ struct tsu_incr {
 	u32 ns;
 };
 
+/* A GEM RX buffer: a fragment of a page from the queue's page_pool */
+struct macb_rx_buf {
+	struct page		*page;
+	unsigned int		offset;
+};
+
+struct page_pool;
+
 struct macb_queue {
 	struct macb		*bp;
 	int			irq;
@@ -1146,6 +1174,9 @@ struct macb_queue {
 	unsigned int		tx_head, tx_tail;
 	struct macb_dma_desc	*tx_ring;
 	struct macb_tx_skb	*tx_skb;
+	/* Sent XDP frames, returned from NAPI context by gem_xdp_tx_reclaim */
+	struct xdp_frame	**tx_xdp_done;
+	unsigned int		tx_xdp_done_head, tx_xdp_done_tail;
 	dma_addr_t		tx_ring_dma;
 	struct work_struct	tx_error_task;
 
@@ -1154,7 +1185,9 @@ struct macb_queue {
 	unsigned int		rx_tail;
 	unsigned int		rx_prepared_head;
 	struct macb_dma_desc	*rx_ring;
-	struct sk_buff		**rx_skbuff;
+	struct macb_rx_buf	*rx_buf;
+	struct page_pool	*page_pool;
+	struct xdp_rxq_info	xdp_rxq;
 	void			*rx_buffers;
 	struct napi_struct	napi;
 	struct queue_stats stats;
@@ -1186,6 +1219,22 @@ struct macb {
 
 	struct macb_dma_desc	*rx_ring_tieoff;
 	size_t			rx_buffer_size;
+	/* GEM: bytes per RX fragment (headroom, buffer and skb_shared_info)
+	 * and the order of the pages that hold them
+	 */
+	unsigned int		rx_frag_size;
+	unsigned int		rx_page_order;
+	unsigned int		rx_headroom;
+	struct bpf_prog		*xdp_prog;
+
+	/* Interrupt moderation (GEM only). The RX delay follows rx_dim if
+	 * adaptive RX coalescing is on.
+	 */
+	u32			rx_coalesce_usecs;
+	u32			tx_coalesce_usecs;
+	bool			rx_dim_enabled;
+	struct dim		rx_dim;
+	u16			rx_dim_events;
 
 	unsigned int		rx_ring_size;
 	unsigned int		tx_ring_size;
@@ -1248,6 +1297,13 @@ struct macb {
 	struct ptp_clock_info ptp_clock_info;
 	struct tsu_incr tsu_incr;
 	struct hwtstamp_config tstamp_config;
+	/* The TSU comparator drives either the PPS or the periodic output.
+	 * Protected by tsu_clk_lock. The period is 0 while it is off.
+	 */
+	u64 tsu_cmp_start;
+	u64 tsu_cmp_next;
+	u64 tsu_cmp_period;
+	bool tsu_cmp_pps;
 
 	/* RX queue filer rule set*/
 	struct ethtool_rx_fs_list rx_fs_list;
@@ -1280,6 +1336,7 @@ void gem_ptp_init(struct net_device *ndev);
 void gem_ptp_remove(struct net_device *ndev);
 int gem_ptp_txstamp(struct macb_queue *queue, struct sk_buff *skb, struct macb_dma_desc *des);
 void gem_ptp_rxstamp(struct macb *bp, struct sk_buff *skb, struct macb_dma_desc *desc);
+void gem_ptp_tsu_cmp_irq(struct macb *bp);
 static inline int gem_ptp_do_txstamp(struct macb_queue *queue, struct sk_buff *skb, struct macb_dma_desc *desc)
 {
 	if (queue->bp->tstamp_config.tx_type == TSTAMP_DISABLED)
@@ -1300,6 +1357,7 @@ int gem_set_hwtst(struct net_device *dev, struct ifreq *ifr, int cmd);
 #else
 static inline void gem_ptp_init(struct net_device *ndev) { }
 static inline void gem_ptp_remove(struct net_device *ndev) { }
+static inline void gem_ptp_tsu_cmp_irq(struct macb *bp) { }
 
 static inline int gem_ptp_do_txstamp(struct macb_queue *queue, struct sk_buff *skb, struct macb_dma_desc *desc)
 {
@@ -38,6 +38,11 @@
 #include <linux/pm_runtime.h>
 #include <linux/crc32.h>
 #include <linux/inetdevice.h>
+#include <linux/bpf.h>
+#include <linux/bpf_trace.h>
+#include <net/page_pool.h>
+#include <net/xdp.h>
+#include <asm/unaligned.h>
 #include "macb.h"
 
 /* This structure is only used for MACB on SiFive FU540 devices */
@@ -62,6 +67,15 @@ struct sifive_fu540_macb_mgmt {
 #define TX_RING_BYTES(bp)	(macb_dma_desc_get_size(bp)	\
 				 * (bp)->tx_ring_size)
 
+/* GEM RX frames up to this size are copied instead of passing the page up */
+static unsigned int rx_copybreak = 256;
+module_param(rx_copybreak, uint, 0644);
+MODULE_PARM_DESC(rx_copybreak, "GEM RX frames up to this size are copied");
+
+/* GEM interrupt moderation: 8-bit delays in units of 800 ns */
+#define GEM_IMOD_NS		800
+#define GEM_MAX_COALESCE_USECS	(255 * GEM_IMOD_NS / NSEC_PER_USEC)
+
 /* level of occupied TX descriptors under which we wake up TX process */
 #define MACB_TX_WAKEUP_THRESH(bp)	(3 * (bp)->tx_ring_size / 4)
 
@@ -670,8 +684,38 @@ static int macb_halt_tx(struct macb *bp)
 	return -ETIMEDOUT;
 }
 
-static void macb_tx_unmap(struct macb *bp, struct macb_tx_skb *tx_skb)
+/* Queue a sent XDP frame for gem_xdp_tx_reclaim(). Call with bp->lock held. */
+static void gem_xdp_tx_done(struct macb_queue *queue, struct xdp_frame *xdpf)
+{
+	unsigned int head = queue->tx_xdp_done_head;
+
+	queue->tx_xdp_done[head & (queue->bp->tx_ring_size - 1)] = xdpf;
+	smp_store_release(&queue->tx_xdp_done_head, head + 1);
+}
+
+/* Return the sent XDP frames to their owners. The frames may belong to a
+ * page_pool (ours or that of the redirecting device), which must not be fed
+ * from hard IRQ context. Hence, this runs from NAPI and not from
+ * macb_tx_interrupt().
+ */
+static void gem_xdp_tx_reclaim(struct macb_queue *queue)
 {
+	unsigned int mask = queue->bp->tx_ring_size - 1;
+	unsigned int head, tail;
+
+	if (!queue->tx_xdp_done)
+		return;
+
+	head = smp_load_acquire(&queue->tx_xdp_done_head);
+	for (tail = queue->tx_xdp_done_tail; tail != head; tail++)
+		xdp_return_frame(queue->tx_xdp_done[tail & mask]);
+	smp_store_release(&queue->tx_xdp_done_tail, tail);
+}
+
+static void macb_tx_unmap(struct macb_queue *queue, struct macb_tx_skb *tx_skb)
+{
+	struct macb *bp = queue->bp;
+
 	if (tx_skb->mapping) {
 		if (tx_skb->mapped_as_page)
 			dma_unmap_page(&bp->pdev->dev, tx_skb->mapping,
@@ -686,6 +730,11 @@ static void macb_tx_unmap(struct macb *bp, struct macb_tx_skb *tx_skb)
 		dev_kfree_skb_any(tx_skb->skb);
 		tx_skb->skb = NULL;
 	}
+
+	if (tx_skb->xdpf) {
+		gem_xdp_tx_done(queue, tx_skb->xdpf);
+		tx_skb->xdpf = NULL;
+	}
 }
 
 static void macb_set_addr(struct macb *bp, struct macb_dma_desc *desc, dma_addr_t addr)
@@ -732,6 +781,7 @@ static void macb_tx_error_task(struct work_struct *work)
 	unsigned int		tail;
 	unsigned long		flags;
 	bool			halt_timeout = false;
+	bool			xdp_done = false;
 
 	netdev_vdbg(bp->dev, "macb_tx_error_task: q = %u, t = %u, h = %u\n",
 		    (unsigned int)(queue - bp->queues),
@@ -770,9 +820,11 @@ static void macb_tx_error_task(struct work_struct *work)
 		skb = tx_skb->skb;
 
 		if (ctrl & MACB_BIT(TX_USED)) {
-			/* skb is set for the last buffer of the frame */
-			while (!skb) {
-				macb_tx_unmap(bp, tx_skb);
+			/* skb (or xdpf) is set for the last buffer of the
+			 * frame
+			 */
+			while (!skb && !tx_skb->xdpf) {
+				macb_tx_unmap(queue, tx_skb);
 				tail++;
 				tx_skb = macb_tx_skb(queue, tail);
 				skb = tx_skb->skb;
@@ -782,13 +834,15 @@ static void macb_tx_error_task(struct work_struct *work)
 			 * since it's the only one written back by the hardware
 			 */
 			if (!(ctrl & MACB_BIT(TX_BUF_EXHAUSTED))) {
-				netdev_vdbg(bp->dev, "txerr skb %u (data %p) TX complete\n",
-					    macb_tx_ring_wrap(bp, tail),
-					    skb->data);
+				unsigned int len = skb ? skb->len :
+						   tx_skb->xdpf->len;
+
+				netdev_vdbg(bp->dev, "txerr frame %u TX complete\n",
+					    macb_tx_ring_wrap(bp, tail));
 				bp->dev->stats.tx_packets++;
 				queue->stats.tx_packets++;
-				bp->dev->stats.tx_bytes += skb->len;
-				queue->stats.tx_bytes += skb->len;
+				bp->dev->stats.tx_bytes += len;
+				queue->stats.tx_bytes += len;
 			}
 		} else {
 			/* "Buffers exhausted mid-frame" errors may only happen
@@ -802,7 +856,9 @@ static void macb_tx_error_task(struct work_struct *work)
 			desc->ctrl = ctrl | MACB_BIT(TX_USED);
 		}
 
-		macb_tx_unmap(bp, tx_skb);
+		if (tx_skb->xdpf)
+			xdp_done = true;
+		macb_tx_unmap(queue, tx_skb);
 	}
 
 	/* Set end of TX queue */
@@ -835,6 +891,9 @@ static void macb_tx_error_task(struct work_struct *work)
 	macb_writel(bp, NCR, macb_readl(bp, NCR) | MACB_BIT(TSTART));
 
 	spin_unlock_irqrestore(&bp->lock, flags);
+
+	if (xdp_done)
+		napi_schedule(&queue->napi);
 }
 
 static void macb_tx_interrupt(struct macb_queue *queue)
@@ -844,6 +903,7 @@ static void macb_tx_interrupt(struct macb_queue *queue)
 	u32 status;
 	struct macb *bp = queue->bp;
 	u16 queue_index = queue - bp->queues;
+	bool xdp_done = false;
 
 	status = macb_readl(bp, TSR);
 	macb_writel(bp, TSR, status);
@@ -896,10 +956,19 @@ static void macb_tx_interrupt(struct macb_queue *queue)
 				queue->stats.tx_packets++;
 				bp->dev->stats.tx_bytes += skb->len;
 				queue->stats.tx_bytes += skb->len;
+			} else if (tx_skb->xdpf) {
+				/* An XDP frame always fits one buffer */
+				bp->dev->stats.tx_packets++;
+				queue->stats.tx_packets++;
+				bp->dev->stats.tx_bytes += tx_skb->xdpf->len;
+				queue->stats.tx_bytes += tx_skb->xdpf->len;
+				xdp_done = true;
+				macb_tx_unmap(queue, tx_skb);
+				break;
 			}
 
 			/* Now we can safely release resources */
-			macb_tx_unmap(bp, tx_skb);
+			macb_tx_unmap(queue, tx_skb);
 
 			/* skb is set only for the last buffer of the frame.
 			 * WARNING: at this point skb has been freed by
@@ -911,16 +980,44 @@ static void macb_tx_interrupt(struct macb_queue *queue)
 	}
 
 	queue->tx_tail = tail;
+
+	/* The frames are returned from NAPI, like the RX path does it */
+	if (xdp_done) {
+		queue_writel(queue, IDR, bp->rx_intr_mask);
+		if (napi_schedule_prep(&queue->napi))
+			__napi_schedule(&queue->napi);
+	}
+
 	if (__netif_subqueue_stopped(bp->dev, queue_index) &&
 	    CIRC_CNT(queue->tx_head, queue->tx_tail,
 		     bp->tx_ring_size) <= MACB_TX_WAKEUP_THRESH(bp))
 		netif_wake_subqueue(bp->dev, queue_index);
 }
 
+static inline dma_addr_t gem_rx_buf_dma(struct macb *bp,
+					struct macb_rx_buf *buf)
+{
+	return buf->page->dma_addr + buf->offset + bp->rx_headroom;
+}
+
+static inline void *gem_rx_buf_va(struct macb_rx_buf *buf)
+{
+	return page_address(buf->page) + buf->offset;
+}
+
+/* Give the page back to the stack's refcounting; it leaves the pool */
+static void gem_rx_buf_release(struct macb_queue *queue,
+			       struct macb_rx_buf *buf)
+{
+	page_pool_release_page(queue->page_pool, buf->page);
+	put_page(buf->page);
+	buf->page = NULL;
+}
+
 static void gem_rx_refill(struct macb_queue *queue)
 {
 	unsigned int		entry;
-	struct sk_buff		*skb;
+	struct macb_rx_buf	*buf;
 	dma_addr_t		paddr;
 	struct macb *bp = queue->bp;
 	struct macb_dma_desc *desc;
@@ -933,43 +1030,38 @@ static void gem_rx_refill(struct macb_queue *queue)
 		rmb();
 
 		desc = macb_rx_desc(queue, entry);
+		buf = &queue->rx_buf[entry];
 
-		if (!queue->rx_skbuff[entry]) {
-			/* allocate sk_buff for this free entry in ring */
-			skb = netdev_alloc_skb(bp->dev, bp->rx_buffer_size);
-			if (unlikely(!skb)) {
+		if (!buf->page) {
+			/* allocate a page for this free entry in ring */
+			buf->page = page_pool_dev_alloc_pages(queue->page_pool);
+			if (unlikely(!buf->page)) {
 				netdev_err(bp->dev,
-					   "Unable to allocate sk_buff\n");
-				break;
-			}
-
-			/* now fill corresponding descriptor entry */
-			paddr = dma_map_single(&bp->pdev->dev, skb->data,
-					       bp->rx_buffer_size,
-					       DMA_FROM_DEVICE);
-			if (dma_mapping_error(&bp->pdev->dev, paddr)) {
-				dev_kfree_skb(skb);
+					   "Unable to allocate RX page\n");
 				break;
 			}
-
-			queue->rx_skbuff[entry] = skb;
-
-			if (entry == bp->rx_ring_size - 1)
-				paddr |= MACB_BIT(RX_WRAP);
-			desc->ctrl = 0;
-			/* Setting addr clears RX_USED and allows reception,
-			 * make sure ctrl is cleared first to avoid a race.
-			 */
-			dma_wmb();
-			macb_set_addr(bp, desc, paddr);
-
-			/* properly align Ethernet header */
-			skb_reserve(skb, NET_IP_ALIGN);
-		} else {
-			desc->ctrl = 0;
-			dma_wmb();
-			desc->addr &= ~MACB_BIT(RX_USED);
+			buf->offset = 0;
 		}
+
+		/* The page stays mapped while it is recycled, so only the
+		 * cache lines of the buffer need maintenance.
+		 */
+		dma_sync_single_range_for_device(&bp->pdev->dev,
+						 buf->page->dma_addr,
+						 buf->offset + bp->rx_headroom,
+						 bp->rx_buffer_size,
+						 DMA_FROM_DEVICE);
+
+		/* now fill corresponding descriptor entry */
+		paddr = gem_rx_buf_dma(bp, buf);
+		if (entry == bp->rx_ring_size - 1)
+			paddr |= MACB_BIT(RX_WRAP);
+		desc->ctrl = 0;
+		/* Setting addr clears RX_USED and allows reception,
+		 * make sure ctrl is cleared first to avoid a race.
+		 */
+		dma_wmb();
+		macb_set_addr(bp, desc, paddr);
 		queue->rx_prepared_head++;
 	}
 
@@ -980,6 +1072,50 @@ static void gem_rx_refill(struct macb_queue *queue)
 			queue, queue->rx_prepared_head, queue->rx_tail);
 }
 
+/*
+ * Turn a received buffer into an skb. The frame starts 'off' bytes into the
+ * buffer (after the headroom, or wherever an XDP program moved it to).
+ *
+ * Frames up to rx_copybreak bytes are copied, and the buffer goes straight
+ * back to the ring. Otherwise the skb is built around the fragment. If the
+ * page holds two fragments and the stack is done with the other one, the
+ * ring gets the other half of the same (still mapped) page. Otherwise the
+ * page leaves the pool and the ring gets a fresh one.
+ */
+static struct sk_buff *gem_rx_build_skb(struct macb_queue *queue,
+					struct napi_struct *napi,
+					struct macb_rx_buf *buf,
+					unsigned int off, unsigned int len)
+{
+	struct macb *bp = queue->bp;
+	struct sk_buff *skb;
+	void *va = gem_rx_buf_va(buf);
+
+	if (len <= rx_copybreak) {
+		skb = napi_alloc_skb(napi, len);
+		if (unlikely(!skb))
+			return NULL;
+		skb_put_data(skb, va + off, len);
+		return skb;
+	}
+
+	skb = build_skb(va, bp->rx_frag_size);
+	if (unlikely(!skb))
+		return NULL;
+	skb_reserve(skb, off);
+	skb_put(skb, len);
+
+	/* One reference for the skb, one for the ring */
+	page_ref_inc(buf->page);
+	if ((PAGE_SIZE << bp->rx_page_order) == 2 * bp->rx_frag_size &&
+	    page_ref_count(buf->page) == 2)
+		buf->offset ^= bp->rx_frag_size;
+	else
+		gem_rx_buf_release(queue, buf);
+
+	return skb;
+}
+
 /* Mark DMA descriptors from begin up to and not including end as unused */
 static void discard_partial_frame(struct macb_queue *queue, unsigned int begin,
 				  unsigned int end)
@@ -1010,19 +1146,168 @@ static int macb_validate_hw_csum(struct sk_buff *skb)
 	return (pkt_csum != csum);
 }
 
+/* Same as macb_validate_hw_csum() but before there is an skb */
+static bool gem_rx_fcs_ok(const void *data, unsigned int len)
+{
+	if (len <= ETH_FCS_LEN)
+		return false;
+
+	return get_unaligned((u32 *)(data + len - ETH_FCS_LEN)) ==
+	       ~crc32_le(~0, data, len - ETH_FCS_LEN);
+}
+
+/* Put an XDP frame on the TX ring. The frame always fits one buffer.
+ * Call with bp->lock held and write TSTART afterwards.
+ */
+static int macb_xdp_submit(struct macb_queue *queue, struct xdp_frame *xdpf)
+{
+	struct macb *bp = queue->bp;
+	struct macb_tx_skb *tx_skb;
+	struct macb_dma_desc *desc;
+	unsigned int entry, done;
+	dma_addr_t mapping;
+	u32 ctrl;
+
+	/* Keep room for the end of queue descriptor. Also, every frame on
+	 * the ring must fit in tx_xdp_done once it is sent.
+	 */
+	done = queue->tx_xdp_done_head - READ_ONCE(queue->tx_xdp_done_tail);
+	if (CIRC_CNT(queue->tx_head, queue->tx_tail, bp->tx_ring_size) + done >=
+	    bp->tx_ring_size - 1)
+		return -ENOSPC;
+
+	mapping = dma_map_single(&bp->pdev->dev, xdpf->data, xdpf->len,
+				 DMA_TO_DEVICE);
+	if (dma_mapping_error(&bp->pdev->dev, mapping))
+		return -ENOMEM;
+
+	entry = macb_tx_ring_wrap(bp, queue->tx_head);
+	tx_skb = &queue->tx_skb[entry];
+	tx_skb->skb = NULL;
+	tx_skb->xdpf = xdpf;
+	tx_skb->mapping = mapping;
+	tx_skb->size = xdpf->len;
+	tx_skb->mapped_as_page = false;
+
+	/* Set 'TX_USED' bit in the next descriptor to set the end of TX
+	 * queue
+	 */
+	desc = macb_tx_desc(queue, queue->tx_head + 1);
+	desc->ctrl = MACB_BIT(TX_USED);
+
+	ctrl = (u32)xdpf->len | MACB_BIT(TX_LAST);
+	if (unlikely(entry == (bp->tx_ring_size - 1)))
+		ctrl |= MACB_BIT(TX_WRAP);
+
+	desc = macb_tx_desc(queue, entry);
+	macb_set_addr(bp, desc, mapping);
+	/* desc->addr must be visible to hardware before clearing
+	 * 'TX_USED' bit in desc->ctrl.
+	 */
+	wmb();
+	desc->ctrl = ctrl;
+
+	queue->tx_head++;
+
+	return 0;
+}
+
+/*
+ * Run the XDP program on a received buffer. Returns true if the program
+ * consumed the frame. Otherwise, the frame goes up the stack with the
+ * (possibly adjusted) offset and length.
+ *
+ * The buffer stays on the ring for dropped frames. Transmitted and redirected
+ * frames take the page along, and gem_rx_refill() allocates a new one.
+ */
+static bool gem_rx_xdp(struct macb_queue *queue, struct bpf_prog *prog,
+		       struct macb_rx_buf *buf, unsigned int *off,
+		       unsigned int *len, bool *xdp_redirect)
+{
+	struct macb *bp = queue->bp;
+	struct xdp_frame *xdpf;
+	struct xdp_buff xdp;
+	unsigned long flags;
+	u32 act;
+	int err;
+
+	xdp.data_hard_start = gem_rx_buf_va(buf);
+	xdp.data = xdp.data_hard_start + *off;
+	xdp_set_data_meta_invalid(&xdp);
+	xdp.data_end = xdp.data + *len;
+	xdp.rxq = &queue->xdp_rxq;
+
+	act = bpf_prog_run_xdp(prog, &xdp);
+	switch (act) {
+	case XDP_PASS:
+		*off = xdp.data - xdp.data_hard_start;
+		*len = xdp.data_end - xdp.data;
+		return false;
+	case XDP_TX:
+		xdpf = convert_to_xdp_frame(&xdp);
+		if (unlikely(!xdpf))
+			goto err;
+
+		spin_lock_irqsave(&bp->lock, flags);
+		err = macb_xdp_submit(queue, xdpf);
+		if (!err) {
+			/* Make newly initialized descriptor visible to
+			 * hardware
+			 */
+			wmb();
+			macb_writel(bp, NCR, macb_readl(bp, NCR) |
+				    MACB_BIT(TSTART));
+		}
+		spin_unlock_irqrestore(&bp->lock, flags);
+		if (unlikely(err))
+			goto err;
+		break;
+	case XDP_REDIRECT:
+		err = xdp_do_redirect(bp->dev, &xdp, prog);
+		if (unlikely(err))
+			goto err;
+		*xdp_redirect = true;
+		break;
+	default:
+		bpf_warn_invalid_xdp_action(act);
+		/* fall through */
+	case XDP_ABORTED:
+err:
+		trace_xdp_exception(bp->dev, prog, act);
+		/* fall through */
+	case XDP_DROP:
+		bp->dev->stats.rx_dropped++;
+		queue->stats.rx_dropped++;
+		return true;
+	}
+
+	buf->page = NULL;
+	bp->dev->stats.rx_packets++;
+	queue->stats.rx_packets++;
+	bp->dev->stats.rx_bytes += *len;
+	queue->stats.rx_bytes += *len;
+	return true;
+}
+
 static int gem_rx(struct macb_queue *queue, struct napi_struct *napi,
 		  int budget)
 {
 	struct macb *bp = queue->bp;
 	unsigned int		len;
+	unsigned int		off;
 	unsigned int		entry;
 	struct sk_buff		*skb;
 	struct macb_dma_desc	*desc;
+	struct macb_rx_buf	*buf;
+	struct bpf_prog		*xdp_prog;
+	bool			xdp_redirect = false;
 	int			count = 0;
 
+	rcu_read_lock();
+	xdp_prog = READ_ONCE(bp->xdp_prog);
+
 	while (count < budget) {
 		u32 ctrl;
-		dma_addr_t addr;
 		bool rxused;
 
 		entry = macb_rx_ring_wrap(bp, queue->rx_tail);
@@ -1032,7 +1317,6 @@ static int gem_rx(struct macb_queue *queue, struct napi_struct *napi,
 		rmb();
 
 		rxused = (desc->addr & MACB_BIT(RX_USED)) ? true : false;
-		addr = macb_get_addr(bp, desc);
 
 		if (!rxused)
 			break;
@@ -1052,8 +1336,8 @@ static int gem_rx(struct macb_queue *queue, struct napi_struct *napi,
 			queue->stats.rx_dropped++;
 			break;
 		}
-		skb = queue->rx_skbuff[entry];
-		if (unlikely(!skb)) {
+		buf = &queue->rx_buf[entry];
+		if (unlikely(!buf->page)) {
 			netdev_err(bp->dev,
 				   "inconsistent Rx descriptor chain\n");
 			bp->dev->stats.rx_dropped++;
@@ -1061,22 +1345,52 @@ static int gem_rx(struct macb_queue *queue, struct napi_struct *napi,
 			break;
 		}
 		/* now everything is ready for receiving packet */
-		queue->rx_skbuff[entry] = NULL;
 		len = ctrl & bp->rx_frm_len_mask;
 
 		netdev_vdbg(bp->dev, "gem_rx %u (len %u)\n", entry, len);
 
-		skb_put(skb, len);
-		dma_unmap_single(&bp->pdev->dev, addr,
-				 bp->rx_buffer_size, DMA_FROM_DEVICE);
+		off = bp->rx_headroom + NET_IP_ALIGN;
+		dma_sync_single_range_for_cpu(&bp->pdev->dev,
+					      buf->page->dma_addr,
+					      buf->offset + bp->rx_headroom,
+					      len + NET_IP_ALIGN,
+					      DMA_FROM_DEVICE);
+
+		if (xdp_prog) {
+			/* The program must not see the FCS, so validate and
+			 * strip it here instead of on the skb.
+			 */
+			if (!(bp->dev->features & NETIF_F_RXCSUM)) {
+				if (!gem_rx_fcs_ok(gem_rx_buf_va(buf) + off,
+						   len)) {
+					netdev_err(bp->dev, "incorrect FCS\n");
+					bp->dev->stats.rx_dropped++;
+					queue->stats.rx_dropped++;
+					continue;
+				}
+				len -= ETH_FCS_LEN;
+			}
+
+			if (gem_rx_xdp(queue, xdp_prog, buf, &off, &len,
+				       &xdp_redirect))
+				continue;
+		}
+
+		skb = gem_rx_build_skb(queue, napi, buf, off, len);
+		if (unlikely(!skb)) {
+			bp->dev->stats.rx_dropped++;
+			queue->stats.rx_dropped++;
+			continue;
+		}
 
 		skb->protocol = eth_type_trans(skb, bp->dev);
 
 		/* Validate MAC fcs if RX checsum offload disabled */
-		if (!(bp->dev->features & NETIF_F_RXCSUM)) {
+		if (!xdp_prog && !(bp->dev->features & NETIF_F_RXCSUM)) {
 			if (macb_validate_hw_csum(skb)) {
 				netdev_err(bp->dev, "incorrect FCS\n");
 				bp->dev->stats.rx_dropped++;
+				dev_kfree_skb_any(skb);
 				break;
 			}
 		}
@@ -1106,6 +1420,10 @@ static int gem_rx(struct macb_queue *queue, struct napi_struct *napi,
 		napi_gro_receive(napi, skb);
 	}
 
+	if (xdp_redirect)
+		xdp_do_flush_map();
+	rcu_read_unlock();
+
 	gem_rx_refill(queue);
 
 	return count;
@@ -1303,6 +1621,41 @@ static int macb_rx(struct macb_queue *queue, struct napi_struct *napi,
 	return received;
 }
 
+static void gem_set_imod(struct macb *bp)
+{
+	gem_writel(bp, IMOD,
+		   GEM_BF(RXIMOD, DIV_ROUND_UP(bp->rx_coalesce_usecs *
+					       NSEC_PER_USEC, GEM_IMOD_NS)) |
+		   GEM_BF(TXIMOD, DIV_ROUND_UP(bp->tx_coalesce_usecs *
+					       NSEC_PER_USEC, GEM_IMOD_NS)));
+}
+
+static void gem_rx_dim_work(struct work_struct *work)
+{
+	struct dim *dim = container_of(work, struct dim, work);
+	struct macb *bp = container_of(dim, struct macb, rx_dim);
+	struct dim_cq_moder moder;
+
+	moder = net_dim_get_rx_moderation(dim->mode, dim->profile_ix);
+	bp->rx_coalesce_usecs = min_t(u32, moder.usec, GEM_MAX_COALESCE_USECS);
+	gem_set_imod(bp);
+
+	dim->state = DIM_START_MEASURE;
+}
+
+/* The moderation register is shared by all queues, so queue 0 alone
+ * drives the adaptive RX coalescing.
+ */
+static void gem_rx_dim_update(struct macb_queue *queue)
+{
+	struct macb *bp = queue->bp;
+	struct dim_sample sample = {};
+
+	dim_update_sample(++bp->rx_dim_events, queue->stats.rx_packets,
+			  queue->stats.rx_bytes, &sample);
+	net_dim(&bp->rx_dim, sample);
+}
+
 static int macb_poll(struct napi_struct *napi, int budget)
 {
 	struct macb_queue *queue = container_of(napi, struct macb_queue, napi);
@@ -1316,10 +1669,15 @@ static int macb_poll(struct napi_struct *napi, int budget)
 	netdev_vdbg(bp->dev, "poll: status = %08lx, budget = %d\n",
 		    (unsigned long)status, budget);
 
+	gem_xdp_tx_reclaim(queue);
+
 	work_done = bp->macbgem_ops.mog_rx(queue, napi, budget);
 	if (work_done < budget) {
 		napi_complete_done(napi, work_done);
 
+		if (bp->rx_dim_enabled && queue == bp->queues)
+			gem_rx_dim_update(queue);
+
 		/* Packets received while interrupts were disabled */
 		status = macb_readl(bp, RSR);
 		if (status) {
@@ -1435,6 +1793,15 @@ static irqreturn_t macb_interrupt(int irq, void *dev_id)
 			    (unsigned int)(queue - bp->queues),
 			    (unsigned long)status);
 
+		/* Handle it before anything can break out of the loop: the
+		 * comparator must be armed for the next edge.
+		 */
+		if (status & MACB_BIT(TCI)) {
+			if (bp->caps & MACB_CAPS_ISR_CLEAR_ON_WRITE)
+				queue_writel(queue, ISR, MACB_BIT(TCI));
+			gem_ptp_tsu_cmp_irq(bp);
+		}
+
 		if (status & bp->rx_intr_mask) {
 			/* There's no point taking any more interrupts
 			 * until we have processed the buffers. The
@@ -1701,7 +2068,7 @@ static unsigned int macb_tx_map(struct macb *bp,
 	for (i = queue->tx_head; i != tx_head; i++) {
 		tx_skb = macb_tx_skb(queue, i);
 
-		macb_tx_unmap(bp, tx_skb);
+		macb_tx_unmap(queue, tx_skb);
 	}
 
 	return 0;
@@ -1716,6 +2083,11 @@ static netdev_features_t macb_features_check(struct sk_buff *skb,
 
 	/* Validate LSO compatibility */
 
+	/* macb_start_xmit() needs the TCP headers in the linear part */
+	if (skb_is_gso(skb) && ip_hdr(skb)->protocol == IPPROTO_TCP &&
+	    skb_headlen(skb) < skb_transport_offset(skb) + tcp_hdrlen(skb))
+		return features & ~MACB_NETIF_LSO;
+
 	/* there is only one buffer */
 	if (!skb_is_nonlinear(skb) || (ip_hdr(skb)->protocol != IPPROTO_UDP))
 		return features;
@@ -1891,6 +2263,8 @@ static netdev_tx_t macb_start_xmit(struct sk_buff *skb, struct net_device *dev)
 	if (CIRC_SPACE(queue->tx_head, queue->tx_tail,
 		       bp->tx_ring_size) < desc_cnt) {
 		netif_stop_subqueue(dev, queue_index);
+		/* Frames of the batch so far may still wait for TSTART */
+		macb_writel(bp, NCR, macb_readl(bp, NCR) | MACB_BIT(TSTART));
 		spin_unlock_irqrestore(&bp->lock, flags);
 		netdev_dbg(bp->dev, "tx_head = %u, tx_tail = %u\n",
 			   queue->tx_head, queue->tx_tail);
@@ -1900,19 +2274,23 @@ static netdev_tx_t macb_start_xmit(struct sk_buff *skb, struct net_device *dev)
 	/* Map socket buffer for DMA transfer */
 	if (!macb_tx_map(bp, queue, skb, hdrlen)) {
 		dev_kfree_skb_any(skb);
-		goto unlock;
+		goto kick;
 	}
 
 	/* Make newly initialized descriptor visible to hardware */
 	wmb();
 	skb_tx_timestamp(skb);
 
-	macb_writel(bp, NCR, macb_readl(bp, NCR) | MACB_BIT(TSTART));
-
 	if (CIRC_SPACE(queue->tx_head, queue->tx_tail, bp->tx_ring_size) < 1)
 		netif_stop_subqueue(dev, queue_index);
 
-unlock:
+kick:
+	/* Only start the transmission for the last frame of a batch. The
+	 * batch ends early if the queue is stopped.
+	 */
+	if (!netdev_xmit_more() || __netif_subqueue_stopped(dev, queue_index))
+		macb_writel(bp, NCR, macb_readl(bp, NCR) | MACB_BIT(TSTART));
+
 	spin_unlock_irqrestore(&bp->lock, flags);
 
 	return ret;
@@ -1932,6 +2310,20 @@ static void macb_init_rx_buffer_size(struct macb *bp, size_t size)
 			bp->rx_buffer_size =
 				roundup(bp->rx_buffer_size, RX_BUFFER_MULTIPLE);
 		}
+
+		/* XDP needs more headroom, and the frames it transmits or
+		 * redirects take the whole page along.
+		 */
+		bp->rx_headroom = bp->xdp_prog ? XDP_PACKET_HEADROOM :
+						 NET_SKB_PAD;
+
+		/* Two fragments per page for the standard MTU */
+		bp->rx_frag_size = roundup_pow_of_two(SKB_DATA_ALIGN(bp->rx_headroom +
+								     bp->rx_buffer_size) +
+						      SKB_DATA_ALIGN(sizeof(struct skb_shared_info)));
+		bp->rx_page_order = get_order(bp->rx_frag_size);
+		if (bp->xdp_prog)
+			bp->rx_frag_size = PAGE_SIZE << bp->rx_page_order;
 	}
 
 	netdev_dbg(bp->dev, "mtu [%u] rx_buffer_size [%zu]\n",
@@ -1940,34 +2332,29 @@ static void macb_init_rx_buffer_size(struct macb *bp, size_t size)
 
 static void gem_free_rx_buffers(struct macb *bp)
 {
-	struct sk_buff		*skb;
-	struct macb_dma_desc	*desc;
 	struct macb_queue *queue;
-	dma_addr_t		addr;
 	unsigned int q;
 	int i;
 
 	for (q = 0, queue = bp->queues; q < bp->num_queues; ++q, ++queue) {
-		if (!queue->rx_skbuff)
-			continue;
-
-		for (i = 0; i < bp->rx_ring_size; i++) {
-			skb = queue->rx_skbuff[i];
+		if (queue->rx_buf) {
+			for (i = 0; i < bp->rx_ring_size; i++) {
+				if (queue->rx_buf[i].page)
+					gem_rx_buf_release(queue,
+							   &queue->rx_buf[i]);
+			}
 
-			if (!skb)
-				continue;
+			kfree(queue->rx_buf);
+			queue->rx_buf = NULL;
+		}
 
-			desc = macb_rx_desc(queue, i);
-			addr = macb_get_addr(bp, desc);
+		if (xdp_rxq_info_is_reg(&queue->xdp_rxq))
+			xdp_rxq_info_unreg(&queue->xdp_rxq);
 
-			dma_unmap_single(&bp->pdev->dev, addr, bp->rx_buffer_size,
-					DMA_FROM_DEVICE);
-			dev_kfree_skb_any(skb);
-			skb = NULL;
+		if (queue->page_pool) {
+			page_pool_destroy(queue->page_pool);
+			queue->page_pool = NULL;
 		}
-
-		kfree(queue->rx_skbuff);
-		queue->rx_skbuff = NULL;
 	}
 }
 
@@ -1987,8 +2374,22 @@ static void macb_free_consistent(struct macb *bp)
 {
 	struct macb_queue *queue;
 	unsigned int q;
+	unsigned int i;
 	int size;
 
+	/* XDP frames in flight may hold pages of the RX page pools */
+	for (q = 0, queue = bp->queues; q < bp->num_queues; ++q, ++queue) {
+		if (!queue->tx_skb)
+			continue;
+		for (i = queue->tx_tail; i != queue->tx_head; i++) {
+			struct macb_tx_skb *tx_skb = macb_tx_skb(queue, i);
+
+			if (tx_skb->xdpf)
+				macb_tx_unmap(queue, tx_skb);
+		}
+		gem_xdp_tx_reclaim(queue);
+	}
+
 	bp->macbgem_ops.mog_free_rx_buffers(bp);
 
 	if (bp->rx_ring_tieoff) {
@@ -2000,6 +2401,8 @@ static void macb_free_consistent(struct macb *bp)
 	for (q = 0, queue = bp->queues; q < bp->num_queues; ++q, ++queue) {
 		kfree(queue->tx_skb);
 		queue->tx_skb = NULL;
+		kfree(queue->tx_xdp_done);
+		queue->tx_xdp_done = NULL;
 		if (queue->tx_ring) {
 			size = TX_RING_BYTES(bp) + bp->tx_bd_rd_prefetch;
 			dma_free_coherent(&bp->pdev->dev, size,
@@ -2021,15 +2424,37 @@ static int gem_alloc_rx_buffers(struct macb *bp)
 	unsigned int q;
 	int size;
 
+	struct page_pool_params pp_params = {
+		.flags		= PP_FLAG_DMA_MAP,
+		.order		= bp->rx_page_order,
+		.pool_size	= bp->rx_ring_size,
+		.nid		= NUMA_NO_NODE,
+		.dev		= &bp->pdev->dev,
+		.dma_dir	= DMA_FROM_DEVICE,
+	};
+
 	for (q = 0, queue = bp->queues; q < bp->num_queues; ++q, ++queue) {
-		size = bp->rx_ring_size * sizeof(struct sk_buff *);
-		queue->rx_skbuff = kzalloc(size, GFP_KERNEL);
-		if (!queue->rx_skbuff)
+		queue->page_pool = page_pool_create(&pp_params);
+		if (IS_ERR(queue->page_pool)) {
+			queue->page_pool = NULL;
+			return -ENOMEM;
+		}
+
+		if (xdp_rxq_info_reg(&queue->xdp_rxq, bp->dev, q) < 0)
+			return -ENOMEM;
+		if (xdp_rxq_info_reg_mem_model(&queue->xdp_rxq,
+					       MEM_TYPE_PAGE_POOL,
+					       queue->page_pool) < 0)
+			return -ENOMEM;
+
+		size = bp->rx_ring_size * sizeof(struct macb_rx_buf);
+		queue->rx_buf = kzalloc(size, GFP_KERNEL);
+		if (!queue->rx_buf)
 			return -ENOMEM;
 		else
 			netdev_dbg(bp->dev,
-				   "Allocated %d RX struct sk_buff entries at %p\n",
-				   bp->rx_ring_size, queue->rx_skbuff);
+				   "Allocated %d RX buffer entries at %p\n",
+				   bp->rx_ring_size, queue->rx_buf);
 	}
 	return 0;
 }
@@ -2070,10 +2495,18 @@ static int macb_alloc_consistent(struct macb *bp)
 			   queue->tx_ring);
 
 		size = bp->tx_ring_size * sizeof(struct macb_tx_skb);
-		queue->tx_skb = kmalloc(size, GFP_KERNEL);
+		queue->tx_skb = kzalloc(size, GFP_KERNEL);
 		if (!queue->tx_skb)
 			goto out_err;
 
+		queue->tx_xdp_done = kcalloc(bp->tx_ring_size,
+					     sizeof(*queue->tx_xdp_done),
+					     GFP_KERNEL);
+		if (!queue->tx_xdp_done)
+			goto out_err;
+		queue->tx_xdp_done_head = 0;
+		queue->tx_xdp_done_tail = 0;
+
 		size = RX_RING_BYTES(bp) + bp->rx_bd_rd_prefetch;
 		queue->rx_ring = dma_alloc_coherent(&bp->pdev->dev, size,
 						 &queue->rx_ring_dma, GFP_KERNEL);
@@ -2345,6 +2778,8 @@ static void macb_init_hw(struct macb *bp)
 	macb_writel(bp, NCFGR, config);
 	if ((bp->caps & MACB_CAPS_JUMBO) && bp->jumbo_max_len)
 		gem_writel(bp, JML, bp->jumbo_max_len);
+	if (macb_is_gem(bp))
+		gem_set_imod(bp);
 	bp->speed = SPEED_10;
 	if (bp->caps & MACB_CAPS_PARTIAL_STORE_FORWARD)
 		bp->duplex = DUPLEX_FULL;
@@ -2585,6 +3020,7 @@ static int macb_close(struct net_device *dev)
 
 	for (q = 0, queue = bp->queues; q < bp->num_queues; ++q, ++queue)
 		napi_disable(&queue->napi);
+	cancel_work_sync(&bp->rx_dim.work);
 
 	if (dev->phydev)
 		phy_stop(dev->phydev);
@@ -2604,16 +3040,123 @@ static int macb_close(struct net_device *dev)
 	return 0;
 }
 
+/* With XDP, a frame and its headroom must fit in a single page */
+static bool macb_xdp_mtu_ok(int mtu)
+{
+	size_t bufsz = roundup(mtu + ETH_HLEN + ETH_FCS_LEN + NET_IP_ALIGN,
+			       RX_BUFFER_MULTIPLE);
+
+	return SKB_DATA_ALIGN(XDP_PACKET_HEADROOM + bufsz) +
+	       SKB_DATA_ALIGN(sizeof(struct skb_shared_info)) <= PAGE_SIZE;
+}
+
 static int macb_change_mtu(struct net_device *dev, int new_mtu)
 {
+	struct macb *bp = netdev_priv(dev);
+
 	if (netif_running(dev))
 		return -EBUSY;
 
+	if (bp->xdp_prog && !macb_xdp_mtu_ok(new_mtu)) {
+		netdev_err(dev, "MTU %d too large for XDP\n", new_mtu);
+		return -EINVAL;
+	}
+
 	dev->mtu = new_mtu;
 
 	return 0;
 }
 
+static int gem_xdp_setup(struct net_device *dev, struct bpf_prog *prog,
+			 struct netlink_ext_ack *extack)
+{
+	struct macb *bp = netdev_priv(dev);
+	struct bpf_prog *old_prog;
+	bool reopen;
+	int err;
+
+	if (prog && !macb_xdp_mtu_ok(dev->mtu)) {
+		NL_SET_ERR_MSG_MOD(extack, "MTU too large for XDP");
+		return -EOPNOTSUPP;
+	}
+
+	/* The RX buffer layout depends on whether there is a program */
+	reopen = netif_running(dev) && !prog != !bp->xdp_prog;
+	if (reopen)
+		macb_close(dev);
+
+	old_prog = xchg(&bp->xdp_prog, prog);
+
+	if (reopen) {
+		err = macb_open(dev);
+		if (err) {
+			/* The caller releases the new program */
+			xchg(&bp->xdp_prog, old_prog);
+			return err;
+		}
+	}
+
+	if (old_prog)
+		bpf_prog_put(old_prog);
+
+	return 0;
+}
+
+static int gem_xdp(struct net_device *dev, struct netdev_bpf *xdp)
+{
+	struct macb *bp = netdev_priv(dev);
+
+	if (!macb_is_gem(bp)) {
+		NL_SET_ERR_MSG_MOD(xdp->extack, "XDP requires GEM");
+		return -EOPNOTSUPP;
+	}
+
+	switch (xdp->command) {
+	case XDP_SETUP_PROG:
+		return gem_xdp_setup(dev, xdp->prog, xdp->extack);
+	case XDP_QUERY_PROG:
+		xdp->prog_id = bp->xdp_prog ? bp->xdp_prog->aux->id : 0;
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+/* Frames redirected to us by XDP programs (ours or of other devices) */
+static int gem_xdp_xmit(struct net_device *dev, int n,
+			struct xdp_frame **frames, u32 flags)
+{
+	struct macb *bp = netdev_priv(dev);
+	struct macb_queue *queue;
+	unsigned long irq_flags;
+	int drops = 0;
+	int i;
+
+	if (unlikely(flags & ~XDP_XMIT_FLAGS_MASK))
+		return -EINVAL;
+
+	if (unlikely(!netif_running(dev) || !netif_carrier_ok(dev)))
+		return -ENETDOWN;
+
+	queue = &bp->queues[smp_processor_id() % bp->num_queues];
+
+	spin_lock_irqsave(&bp->lock, irq_flags);
+	for (i = 0; i < n; i++) {
+		if (macb_xdp_submit(queue, frames[i]))
+			frames[drops++] = frames[i];
+	}
+
+	/* Make newly initialized descriptors visible to hardware */
+	wmb();
+	macb_writel(bp, NCR, macb_readl(bp, NCR) | MACB_BIT(TSTART));
+	spin_unlock_irqrestore(&bp->lock, irq_flags);
+
+	for (i = 0; i < drops; i++)
+		xdp_return_frame_rx_napi(frames[i]);
+
+	return n - drops;
+}
+
 static void gem_update_stats(struct macb *bp)
 {
 	struct macb_queue *queue;
@@ -2865,6 +3408,48 @@ static int macb_set_ringparam(struct net_device *netdev,
 	return 0;
 }
 
+static int gem_get_coalesce(struct net_device *netdev,
+			    struct ethtool_coalesce *ec)
+{
+	struct macb *bp = netdev_priv(netdev);
+
+	ec->rx_coalesce_usecs = bp->rx_coalesce_usecs;
+	ec->tx_coalesce_usecs = bp->tx_coalesce_usecs;
+	ec->use_adaptive_rx_coalesce = bp->rx_dim_enabled;
+
+	return 0;
+}
+
+static int gem_set_coalesce(struct net_device *netdev,
+			    struct ethtool_coalesce *ec)
+{
+	struct macb *bp = netdev_priv(netdev);
+
+	/* The hardware only delays the interrupts; it does not count frames.
+	 * A frame limit of 1 is the same as no limit.
+	 */
+	if (ec->rx_max_coalesced_frames > 1 ||
+	    ec->tx_max_coalesced_frames > 1 ||
+	    ec->use_adaptive_tx_coalesce)
+		return -EOPNOTSUPP;
+
+	if (ec->rx_coalesce_usecs > GEM_MAX_COALESCE_USECS ||
+	    ec->tx_coalesce_usecs > GEM_MAX_COALESCE_USECS)
+		return -EINVAL;
+
+	if (!ec->use_adaptive_rx_coalesce && bp->rx_dim_enabled)
+		cancel_work_sync(&bp->rx_dim.work);
+
+	bp->rx_dim_enabled = ec->use_adaptive_rx_coalesce;
+	bp->rx_coalesce_usecs = ec->rx_coalesce_usecs;
+	bp->tx_coalesce_usecs = ec->tx_coalesce_usecs;
+
+	if (netif_running(netdev))
+		gem_set_imod(bp);
+
+	return 0;
+}
+
 #ifdef CONFIG_MACB_USE_HWSTAMP
 static unsigned int gem_get_tsu_rate(struct macb *bp)
 {
@@ -3267,6 +3852,8 @@ static const struct ethtool_ops gem_ethtool_ops = {
 	.set_link_ksettings     = phy_ethtool_set_link_ksettings,
 	.get_ringparam		= macb_get_ringparam,
 	.set_ringparam		= macb_set_ringparam,
+	.get_coalesce		= gem_get_coalesce,
+	.set_coalesce		= gem_set_coalesce,
 	.get_rxnfc			= gem_get_rxnfc,
 	.set_rxnfc			= gem_set_rxnfc,
 };
@@ -3390,6 +3977,8 @@ static const struct net_device_ops macb_netdev_ops = {
 #endif
 	.ndo_set_features	= macb_set_features,
 	.ndo_features_check	= macb_features_check,
+	.ndo_bpf		= gem_xdp,
+	.ndo_xdp_xmit		= gem_xdp_xmit,
 };
 
 /* Configure peripheral capabilities according to device tree
@@ -3568,6 +4157,38 @@ static int macb_clk_init(struct platform_device *pdev, struct clk **pclk,
 	return err;
 }
 
+/* Give every queue a CPU of its own, for its IRQ (and thus NAPI) and for
+ * XPS. A flow that gem_add_flow_filter() steers to a queue other than 0 is
+ * then handled apart from the bulk traffic of queue 0. Userspace may still
+ * move the IRQs around.
+ */
+static void macb_set_queue_cpus(struct macb *bp)
+{
+	struct macb_queue *queue;
+	const struct cpumask *mask;
+	unsigned int q;
+	int err;
+
+	if (bp->num_queues < 2)
+		return;
+
+	for (q = 0, queue = bp->queues; q < bp->num_queues; ++q, ++queue) {
+		mask = cpumask_of(cpumask_local_spread(q, NUMA_NO_NODE));
+
+		err = irq_set_affinity_hint(queue->irq, mask);
+		if (err)
+			netdev_warn(bp->dev,
+				    "Unable to set affinity of IRQ %d (error %d)\n",
+				    queue->irq, err);
+
+		err = netif_set_xps_queue(bp->dev, mask, q);
+		if (err)
+			netdev_warn(bp->dev,
+				    "Unable to set XPS of queue %u (error %d)\n",
+				    q, err);
+	}
+}
+
 static int macb_init(struct platform_device *pdev)
 {
 	struct net_device *dev = platform_get_drvdata(pdev);
@@ -3580,6 +4201,9 @@ static int macb_init(struct platform_device *pdev)
 	bp->tx_ring_size = DEFAULT_TX_RING_SIZE;
 	bp->rx_ring_size = DEFAULT_RX_RING_SIZE;
 
+	INIT_WORK(&bp->rx_dim.work, gem_rx_dim_work);
+	bp->rx_dim.mode = DIM_CQ_PERIOD_MODE_START_FROM_EQE;
+
 	/* set the queue register mapping once for all: queue0 has a special
 	 * register mapping but we don't want to test the queue index then
 	 * compute the corresponding register offset at run time.
@@ -3640,6 +4264,8 @@ static int macb_init(struct platform_device *pdev)
 		q++;
 	}
 
+	macb_set_queue_cpus(bp);
+
 	dev->netdev_ops = &macb_netdev_ops;
 
 	/* setup appropriated routines according to adapter type */
@@ -4492,6 +5118,8 @@ static int macb_remove(struct platform_device *pdev)
 {
 	struct net_device *dev;
 	struct macb *bp;
+	struct macb_queue *queue;
+	unsigned int q;
 	struct device_node *np = pdev->dev.of_node;
 
 	dev = platform_get_drvdata(pdev);
@@ -4507,6 +5135,9 @@ static int macb_remove(struct platform_device *pdev)
 		mdiobus_free(bp->mii_bus);
 
 		unregister_netdev(dev);
+		for (q = 0, queue = bp->queues; q < bp->num_queues;
+		     ++q, ++queue)
+			irq_set_affinity_hint(queue->irq, NULL);
 		pm_runtime_disable(&pdev->dev);
 		pm_runtime_dont_use_autosuspend(&pdev->dev);
 		if (!pm_runtime_suspended(&pdev->dev)) {
@@ -25,6 +25,13 @@
 
 #define  GEM_PTP_TIMER_NAME "gem-ptp-timer"
 
+/* The comparator only looks at TN[29:8] */
+#define GEM_NSC_SHIFT		8
+/* The comparator is re-armed from the interrupt at every edge */
+#define GEM_PEROUT_MIN_PERIOD	NSEC_PER_MSEC
+/* Time allowed for arming the comparator ahead of the first edge */
+#define GEM_CMP_ARM_MARGIN	NSEC_PER_MSEC
+
 static struct macb_dma_desc_ptp *macb_ptp_desc(struct macb *bp,
 					       struct macb_dma_desc *desc)
 {
@@ -172,13 +179,163 @@ static int gem_ptp_adjtime(struct ptp_clock_info *ptp, s64 delta)
 		gem_writel(bp, TA, adj);
 	}
 
+	gem_tsu_rearm_cmp(bp);
+	return 0;
+}
+
+static void gem_tsu_set_cmp(struct macb *bp, u64 ns)
+{
+	struct timespec64 ts = ns_to_timespec64(ns);
+
+	gem_writel(bp, SCH, (ts.tv_sec >> GEM_TSL_SIZE) &
+		   ((1 << GEM_TSH_SIZE) - 1));
+	gem_writel(bp, SCL, (u32)ts.tv_sec);
+	gem_writel(bp, NSC, GEM_BF(NSC, ts.tv_nsec >> GEM_NSC_SHIFT));
+}
+
+/* Arm the comparator for the first edge after 'now'. Call with
+ * tsu_clk_lock held.
+ */
+static void gem_tsu_arm_cmp(struct macb *bp, u64 now)
+{
+	u64 next = bp->tsu_cmp_start;
+
+	now += GEM_CMP_ARM_MARGIN;
+	if (next < now)
+		next += (div64_u64(now - next, bp->tsu_cmp_period) + 1) *
+			bp->tsu_cmp_period;
+
+	bp->tsu_cmp_next = next;
+	gem_tsu_set_cmp(bp, next);
+}
+
+static u64 gem_tsu_get_ns(struct macb *bp)
+{
+	struct timespec64 ts;
+
+	gem_tsu_get_time(&bp->ptp_clock_info, &ts);
+	return timespec64_to_ns(&ts);
+}
+
+/* A step of the timer would leave the comparator behind (or far ahead) */
+static void gem_tsu_rearm_cmp(struct macb *bp)
+{
+	unsigned long flags;
+	u64 now = gem_tsu_get_ns(bp);
+
+	spin_lock_irqsave(&bp->tsu_clk_lock, flags);
+	if (bp->tsu_cmp_period)
+		gem_tsu_arm_cmp(bp, now);
+	spin_unlock_irqrestore(&bp->tsu_clk_lock, flags);
+}
+
+static int gem_tsu_start_cmp(struct macb *bp, u64 start, u64 period, bool pps)
+{
+	unsigned long flags;
+	u64 now = gem_tsu_get_ns(bp);
+
+	spin_lock_irqsave(&bp->tsu_clk_lock, flags);
+	/* There is a single comparator */
+	if (bp->tsu_cmp_period && bp->tsu_cmp_pps != pps) {
+		spin_unlock_irqrestore(&bp->tsu_clk_lock, flags);
+		return -EBUSY;
+	}
+
+	bp->tsu_cmp_start = start;
+	bp->tsu_cmp_period = period;
+	bp->tsu_cmp_pps = pps;
+	gem_tsu_arm_cmp(bp, now);
+	queue_writel(bp->queues, IER, MACB_BIT(TCI));
+	spin_unlock_irqrestore(&bp->tsu_clk_lock, flags);
+
+	return 0;
+}
+
+static void gem_tsu_stop_cmp(struct macb *bp, bool pps)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&bp->tsu_clk_lock, flags);
+	if (bp->tsu_cmp_period && bp->tsu_cmp_pps == pps) {
+		queue_writel(bp->queues, IDR, MACB_BIT(TCI));
+		bp->tsu_cmp_period = 0;
+	}
+	spin_unlock_irqrestore(&bp->tsu_clk_lock, flags);
+}
+
+/* The comparator matched. The match itself is the output edge (the
+ * gem_tsu_timer_cmp_val signal to the PL). Here, we only arm the next one.
+ */
+void gem_ptp_tsu_cmp_irq(struct macb *bp)
+{
+	struct ptp_clock_event event;
+	bool pps;
+
+	spin_lock(&bp->tsu_clk_lock);
+	if (!bp->tsu_cmp_period) {
+		spin_unlock(&bp->tsu_clk_lock);
+		return;
+	}
+	bp->tsu_cmp_next += bp->tsu_cmp_period;
+	gem_tsu_set_cmp(bp, bp->tsu_cmp_next);
+	pps = bp->tsu_cmp_pps;
+	spin_unlock(&bp->tsu_clk_lock);
+
+	if (pps && bp->ptp_clock) {
+		event.type = PTP_CLOCK_PPS;
+		ptp_clock_event(bp->ptp_clock, &event);
+	}
+}
+
+static int gem_ptp_settime(struct ptp_clock_info *ptp,
+			   const struct timespec64 *ts)
+{
+	struct macb *bp = container_of(ptp, struct macb, ptp_clock_info);
+
+	gem_tsu_set_time(ptp, ts);
+	gem_tsu_rearm_cmp(bp);
 	return 0;
 }
 
 static int gem_ptp_enable(struct ptp_clock_info *ptp,
 			  struct ptp_clock_request *rq, int on)
 {
-	return -EOPNOTSUPP;
+	struct macb *bp = container_of(ptp, struct macb, ptp_clock_info);
+	u64 start, period;
+
+	switch (rq->type) {
+	case PTP_CLK_REQ_PEROUT:
+		if (rq->perout.index != 0 || rq->perout.flags)
+			return -EOPNOTSUPP;
+
+		if (!on) {
+			gem_tsu_stop_cmp(bp, false);
+			return 0;
+		}
+
+		/* The comparator resolution is 256 ns */
+		start = rq->perout.start.sec * NSEC_PER_SEC +
+			rq->perout.start.nsec;
+		period = rq->perout.period.sec * NSEC_PER_SEC +
+			 rq->perout.period.nsec;
+		start = round_down(start, 1 << GEM_NSC_SHIFT);
+		period = round_down(period, 1 << GEM_NSC_SHIFT);
+		if (period < GEM_PEROUT_MIN_PERIOD)
+			return -EINVAL;
+
+		return gem_tsu_start_cmp(bp, start, period, false);
+	case PTP_CLK_REQ_PPS:
+		if (!on) {
+			gem_tsu_stop_cmp(bp, true);
+			return 0;
+		}
+
+		/* Edges on the full seconds */
+		return gem_tsu_start_cmp(bp, 0, NSEC_PER_SEC, true);
+	default:
+		/* The GEM has no capture input for EXTTS */
+		return -EOPNOTSUPP;
+	}
 }
 
 static const struct ptp_clock_info gem_ptp_caps_template = {
@@ -187,13 +344,13 @@ static const struct ptp_clock_info gem_ptp_caps_template = {
 	.max_adj	= 0,
 	.n_alarm	= 0,
 	.n_ext_ts	= 0,
-	.n_per_out	= 0,
+	.n_per_out	= 1,
 	.n_pins		= 0,
 	.pps		= 1,
 	.adjfine	= gem_ptp_adjfine,
 	.adjtime	= gem_ptp_adjtime,
 	.gettime64	= gem_tsu_get_time,
-	.settime64	= gem_tsu_set_time,
+	.settime64	= gem_ptp_settime,
 	.enable		= gem_ptp_enable,
 };
 
@@ -366,6 +523,7 @@ void gem_ptp_init(struct net_device *dev)
 	unsigned int q;
 
 	bp->ptp_clock_info = gem_ptp_caps_template;
+	bp->tsu_cmp_period = 0;
 
 	/* nominal frequency and maximum adjustment in ppb */
 	bp->tsu_rate = bp->ptp_info->get_tsu_rate(bp);
@@ -400,6 +558,8 @@ void gem_ptp_remove(struct net_device *ndev)
 	struct macb *bp = netdev_priv(ndev);
 	unsigned long flags;
 
+	gem_tsu_stop_cmp(bp, bp->tsu_cmp_pps);
+
 	if (bp->ptp_clock)
 		ptp_clock_unregister(bp->ptp_clock);
 
@@ -707,7 +707,6 @@ enum axienet_tsn_ioctl {
  * @ptp_rx_hw_pointer: ptp rx hw pointer
  * @ptp_rx_sw_pointer: ptp rx sw pointer
  * @ptp_txq:	PTP tx queue header
- * @tx_tstamp_work: PTP timestamping work queue
  * @ptp_tx_lock: PTP tx lock
  * @dma_err_tasklet: Tasklet structure to process Axi DMA errors
  * @eth_irq:	Axi Ethernet IRQ number
@@ -796,7 +795,6 @@ struct axienet_local {
 	u8  ptp_rx_hw_pointer;
 	u8  ptp_rx_sw_pointer;
 	struct sk_buff_head ptp_txq;
-	struct work_struct tx_tstamp_work;
 #endif
 #endif
 	spinlock_t ptp_tx_lock;		/* PTP tx lock*/
@@ -879,6 +877,9 @@ struct axienet_local {
  *		completed.
  * @rx_bd_ci:	Stores the index of the Rx buffer descriptor in the ring being
  *		accessed currently.
+ * @tx_tail_p:	Tail descriptor that the DMA does not know about yet.
+ * @tx_tail_pending: Whether @tx_tail_p is valid (see axienet_tx_kick).
+ * @txq_id:	Netdev TX queue of this dma queue (for BQL).
  * @chan_id:    MCDMA channel to operate on.
  * @rx_offset:	MCDMA S2MM channel starting offset.
  * @txq_bd_v:	Virtual address of the MCDMA TX buffer descriptor ring
@@ -913,6 +914,10 @@ struct axienet_dma_q {
 	u32 rx_bd_ci;
 	u32 tx_bd_tail;
 
+	dma_addr_t tx_tail_p;
+	bool tx_tail_pending;
+	u16 txq_id;
+
 	/* MCDMA fields */
 	u16 chan_id;
 	u32 rx_offset;
@@ -925,6 +930,20 @@ struct axienet_dma_q {
 	unsigned long rx_bytes;
 };
 
+/* BQL needs the DMA queues and netdev TX queues to map one to one. With
+ * TSN they do not (see tsn_queue_mapping).
+ */
+static inline bool axienet_has_bql(struct axienet_local *lp)
+{
+	return !lp->is_tsn;
+}
+
+/* Call when the Tx BDs of @q are dropped (e.g., on a DMA reset) */
+static inline void axienet_tx_reset_bql(struct axienet_dma_q *q)
+{
+	netdev_tx_reset_queue(netdev_get_tx_queue(q->lp->ndev, q->txq_id));
+}
+
 #define AXIENET_TX_SSTATS_LEN(lp) ((lp)->num_tx_queues * 2)
 #define AXIENET_RX_SSTATS_LEN(lp) ((lp)->num_rx_queues * 2)
 
@@ -1120,14 +1139,26 @@ int axienet_mdio_enable(struct axienet_local *lp);
 void axienet_mdio_disable(struct axienet_local *lp);
 int axienet_mdio_setup(struct axienet_local *lp);
 void axienet_mdio_teardown(struct axienet_local *lp);
-#ifdef CONFIG_XILINX_TSN_PTP
-void axienet_tx_tstamp(struct work_struct *work);
-#endif
 #ifdef CONFIG_XILINX_TSN_QBV
+/* Qbv scheduler instances */
+enum hw_port {
+	PORT_EP = 0,
+	PORT_TEMAC_1,
+	PORT_TEMAC_2,
+};
+
 int axienet_qbv_init(struct net_device *ndev);
 void axienet_qbv_remove(struct net_device *ndev);
 int axienet_set_schedule(struct net_device *ndev, void __user *useraddr);
 int axienet_get_schedule(struct net_device *ndev, void __user *useraddr);
+struct tc_taprio_qopt_offload;
+int axienet_setup_taprio(struct net_device *ndev, u8 port,
+			 struct tc_taprio_qopt_offload *qopt);
+#endif
+
+#ifdef CONFIG_XILINX_TSN_QCI
+struct flow_cls_offload;
+int axienet_qci_setup_flower(u8 in_pid, struct flow_cls_offload *f);
 #endif
 
 #ifdef CONFIG_XILINX_TSN_QBR
@@ -1168,6 +1199,11 @@ void __maybe_unused axienet_mcdma_rx_bd_free(struct net_device *ndev,
 irqreturn_t __maybe_unused axienet_mcdma_tx_irq(int irq, void *_ndev);
 irqreturn_t __maybe_unused axienet_mcdma_rx_irq(int irq, void *_ndev);
 void __maybe_unused axienet_mcdma_err_handler(unsigned long data);
+void axienet_mcdma_set_affinity(struct axienet_local *lp, bool spread);
+void axienet_mcdma_get_channels(struct net_device *ndev,
+				struct ethtool_channels *ch);
+int axienet_mcdma_get_rxnfc(struct net_device *ndev, struct ethtool_rxnfc *cmd,
+			    u32 *rule_locs);
 void axienet_strings(struct net_device *ndev, u32 sset, u8 *data);
 int axienet_sset_count(struct net_device *ndev, int sset);
 void axienet_get_stats(struct net_device *ndev,
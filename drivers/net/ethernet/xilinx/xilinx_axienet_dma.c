@@ -73,6 +73,7 @@ static int __dma_txq_init(struct net_device *ndev, struct axienet_dma_q *q)
 
 	q->tx_bd_ci = 0;
 	q->tx_bd_tail = 0;
+	q->tx_tail_pending = false;
 
 	q->tx_bd_v = dma_alloc_coherent(ndev->dev.parent,
 					sizeof(*q->tx_bd_v) * lp->tx_bd_num,
@@ -434,7 +435,10 @@ void __maybe_unused axienet_dma_err_handler(unsigned long data)
 
 	q->tx_bd_ci = 0;
 	q->tx_bd_tail = 0;
+	q->tx_tail_pending = false;
 	q->rx_bd_ci = 0;
+	if (axienet_has_bql(lp))
+		axienet_tx_reset_bql(q);
 
 	/* Start updating the Rx channel control register */
 	cr = axienet_dma_in32(q, XAXIDMA_RX_CR_OFFSET);
@@ -42,6 +42,7 @@
 #include <linux/ptp_classify.h>
 #include <linux/net_tstamp.h>
 #include <linux/random.h>
+#include <net/pkt_cls.h>
 #include <net/sock.h>
 #include <linux/xilinx_phy.h>
 #include <linux/clk.h>
@@ -70,6 +71,11 @@
 
 #define MRMAC_RESET_DELAY	1 /* Delay in msecs*/
 
+/* Rx frames up to this size are copied, and their buffer stays on the ring */
+static unsigned int rx_copybreak = 256;
+module_param(rx_copybreak, uint, 0644);
+MODULE_PARM_DESC(rx_copybreak, "Rx frames up to this size are copied");
+
 #ifdef CONFIG_XILINX_TSN_PTP
 int axienet_phc_index = -1;
 EXPORT_SYMBOL(axienet_phc_index);
@@ -891,6 +897,7 @@ void axienet_start_xmit_done(struct net_device *ndev,
 {
 	u32 size = 0;
 	u32 packets = 0;
+	unsigned int bql_bytes = 0;
 	struct axienet_local *lp = netdev_priv(ndev);
 
 #ifdef CONFIG_AXIENET_HAS_MCDMA
@@ -922,8 +929,11 @@ void axienet_start_xmit_done(struct net_device *ndev,
 					 cur_p->cntrl &
 					 XAXIDMA_BD_CTRL_LENGTH_MASK,
 					 DMA_TO_DEVICE);
-		if (cur_p->tx_skb)
+		if (cur_p->tx_skb) {
+			/* The same length as in axienet_queue_xmit */
+			bql_bytes += ((struct sk_buff *)cur_p->tx_skb)->len;
 			dev_kfree_skb_irq((struct sk_buff *)cur_p->tx_skb);
+		}
 		/*cur_p->phys = 0;*/
 		cur_p->app0 = 0;
 		cur_p->app1 = 0;
@@ -954,6 +964,10 @@ void axienet_start_xmit_done(struct net_device *ndev,
 	q->tx_packets += packets;
 	q->tx_bytes += size;
 
+	if (axienet_has_bql(lp))
+		netdev_tx_completed_queue(netdev_get_tx_queue(ndev, q->txq_id),
+					  packets, bql_bytes);
+
 	/* Matches barrier in axienet_start_xmit */
 	smp_mb();
 
@@ -1215,6 +1229,29 @@ static int axienet_skb_tstsmp(struct sk_buff **__skb, struct axienet_dma_q *q,
 }
 #endif
 
+/**
+ * axienet_tx_kick - Hands the pending Tx BDs over to the DMA.
+ * @q:		Pointer to DMA queue structure
+ *
+ * axienet_queue_xmit defers the tail descriptor write while the stack has
+ * more packets for us (see netdev_xmit_more). This writes it. Call with
+ * the tx_lock held.
+ */
+static void axienet_tx_kick(struct axienet_dma_q *q)
+{
+	if (!q->tx_tail_pending)
+		return;
+
+	/* Start the transfer */
+#ifdef CONFIG_AXIENET_HAS_MCDMA
+	axienet_dma_bdout(q, XMCDMA_CHAN_TAILDESC_OFFSET(q->chan_id),
+			  q->tx_tail_p);
+#else
+	axienet_dma_bdout(q, XAXIDMA_TX_TDESC_OFFSET, q->tx_tail_p);
+#endif
+	q->tx_tail_pending = false;
+}
+
 static int axienet_queue_xmit(struct sk_buff *skb,
 			      struct net_device *ndev, u16 map)
 {
@@ -1231,6 +1268,7 @@ static int axienet_queue_xmit(struct sk_buff *skb,
 #endif
 	unsigned long flags;
 	struct axienet_dma_q *q;
+	bool kick = true;
 
 	if (lp->axienet_config->mactype == XAXIENET_10G_25G ||
 	    lp->axienet_config->mactype == XAXIENET_MRMAC) {
@@ -1242,6 +1280,13 @@ static int axienet_queue_xmit(struct sk_buff *skb,
 		 */
 		if (eth_skb_pad(skb)) {
 			ndev->stats.tx_dropped++;
+			/* The end of a batch. Start what came before. */
+			if (!netdev_xmit_more()) {
+				q = lp->dq[map];
+				spin_lock_irqsave(&q->tx_lock, flags);
+				axienet_tx_kick(q);
+				spin_unlock_irqrestore(&q->tx_lock, flags);
+			}
 			return NETDEV_TX_OK;
 		}
 	}
@@ -1275,6 +1320,8 @@ static int axienet_queue_xmit(struct sk_buff *skb,
 
 	spin_lock_irqsave(&q->tx_lock, flags);
 	if (axienet_check_tx_bd_space(q, num_frag)) {
+		/* The ring is full of BDs. Make sure the DMA knows them all. */
+		axienet_tx_kick(q);
 		if (netif_queue_stopped(ndev)) {
 			spin_unlock_irqrestore(&q->tx_lock, flags);
 			return NETDEV_TX_BUSY;
@@ -1296,6 +1343,7 @@ static int axienet_queue_xmit(struct sk_buff *skb,
 
 #ifdef CONFIG_XILINX_AXI_EMAC_HWTSTAMP
 	if (axienet_skb_tstsmp(&skb, q, ndev)) {
+		axienet_tx_kick(q);
 		spin_unlock_irqrestore(&q->tx_lock, flags);
 		return NETDEV_TX_BUSY;
 	}
@@ -1379,13 +1427,17 @@ static int axienet_queue_xmit(struct sk_buff *skb,
 	/* Ensure BD write before starting transfer */
 	wmb();
 
-	/* Start the transfer */
-#ifdef CONFIG_AXIENET_HAS_MCDMA
-	axienet_dma_bdout(q, XMCDMA_CHAN_TAILDESC_OFFSET(q->chan_id),
-			  tail_p);
-#else
-	axienet_dma_bdout(q, XAXIDMA_TX_TDESC_OFFSET, tail_p);
-#endif
+	q->tx_tail_p = tail_p;
+	q->tx_tail_pending = true;
+	/* Only the last packet of a batch rings the doorbell. Without BQL,
+	 * the TSN paths above may kick other queues in between, so we start
+	 * each packet right away.
+	 */
+	if (axienet_has_bql(lp))
+		kick = __netdev_tx_sent_queue(netdev_get_tx_queue(ndev, map),
+					      skb->len, netdev_xmit_more());
+	if (kick)
+		axienet_tx_kick(q);
 	if (++q->tx_bd_tail >= lp->tx_bd_num)
 		q->tx_bd_tail = 0;
 
@@ -1453,30 +1505,51 @@ static int axienet_recv(struct net_device *ndev, int budget,
 
 	while ((numbdfree < budget) &&
 	       (cur_p->status & XAXIDMA_BD_STS_COMPLETE_MASK)) {
-		new_skb = netdev_alloc_skb(ndev, lp->max_frm_size);
-		if (!new_skb) {
-			dev_err(lp->dev, "No memory for new_skb\n");
-			break;
-		}
-#ifdef CONFIG_AXIENET_HAS_MCDMA
-		tail_p = q->rx_bd_p + sizeof(*q->rxq_bd_v) * q->rx_bd_ci;
-#else
-		tail_p = q->rx_bd_p + sizeof(*q->rx_bd_v) * q->rx_bd_ci;
-#endif
-
-		dma_unmap_single(ndev->dev.parent, cur_p->phys,
-				 lp->max_frm_size,
-				 DMA_FROM_DEVICE);
-
-		skb = (struct sk_buff *)(cur_p->sw_id_offset);
-
 		if (lp->eth_hasnobuf ||
 		    (lp->axienet_config->mactype != XAXIENET_1G))
 			length = cur_p->status & XAXIDMA_BD_STS_ACTUAL_LEN_MASK;
 		else
 			length = cur_p->app4 & 0x0000FFFF;
 
-		skb_put(skb, length);
+		skb = (struct sk_buff *)(cur_p->sw_id_offset);
+
+		if (length <= rx_copybreak) {
+			/* Copy the frame. The buffer stays mapped and goes
+			 * straight back to the ring.
+			 */
+			new_skb = NULL;
+			dma_sync_single_for_cpu(ndev->dev.parent, cur_p->phys,
+						length, DMA_FROM_DEVICE);
+			skb = netdev_alloc_skb_ip_align(ndev, length);
+			if (skb)
+				skb_put_data(skb, ((struct sk_buff *)
+						   cur_p->sw_id_offset)->data,
+					     length);
+			dma_sync_single_for_device(ndev->dev.parent,
+						   cur_p->phys, length,
+						   DMA_FROM_DEVICE);
+			if (!skb) {
+				dev_err(lp->dev, "No memory for rx skb\n");
+				break;
+			}
+		} else {
+			new_skb = netdev_alloc_skb(ndev, lp->max_frm_size);
+			if (!new_skb) {
+				dev_err(lp->dev, "No memory for new_skb\n");
+				break;
+			}
+
+			dma_unmap_single(ndev->dev.parent, cur_p->phys,
+					 lp->max_frm_size,
+					 DMA_FROM_DEVICE);
+
+			skb_put(skb, length);
+		}
+#ifdef CONFIG_AXIENET_HAS_MCDMA
+		tail_p = q->rx_bd_p + sizeof(*q->rxq_bd_v) * q->rx_bd_ci;
+#else
+		tail_p = q->rx_bd_p + sizeof(*q->rx_bd_v) * q->rx_bd_ci;
+#endif
 #ifdef CONFIG_XILINX_AXI_EMAC_HWTSTAMP
 	if (!lp->is_tsn) {
 		if ((lp->tstamp_config.rx_filter == HWTSTAMP_FILTER_ALL ||
@@ -1544,12 +1617,15 @@ static int axienet_recv(struct net_device *ndev, int budget,
 		 */
 		wmb();
 
-		cur_p->phys = dma_map_single(ndev->dev.parent, new_skb->data,
-					     lp->max_frm_size,
-					     DMA_FROM_DEVICE);
+		if (new_skb) {
+			cur_p->phys = dma_map_single(ndev->dev.parent,
+						     new_skb->data,
+						     lp->max_frm_size,
+						     DMA_FROM_DEVICE);
+			cur_p->sw_id_offset = (phys_addr_t)new_skb;
+		}
 		cur_p->cntrl = lp->max_frm_size;
 		cur_p->status = 0;
-		cur_p->sw_id_offset = (phys_addr_t)new_skb;
 
 		if (++q->rx_bd_ci >= lp->rx_bd_num)
 			q->rx_bd_ci = 0;
@@ -1813,7 +1889,6 @@ static int axienet_open(struct net_device *ndev)
 	}
 #ifdef CONFIG_XILINX_TSN_PTP
 	if (lp->is_tsn) {
-		INIT_WORK(&lp->tx_tstamp_work, axienet_tx_tstamp);
 		skb_queue_head_init(&lp->ptp_txq);
 
 		lp->ptp_rx_hw_pointer = 0;
@@ -1938,6 +2013,14 @@ static int axienet_open(struct net_device *ndev)
 			goto err_eth_irq;
 	}
 
+#ifdef CONFIG_AXIENET_HAS_MCDMA
+	if (!lp->is_tsn || lp->temac_no == XAE_TEMAC1)
+		axienet_mcdma_set_affinity(lp, true);
+#endif
+	if (axienet_has_bql(lp)) {
+		for_each_tx_dma_queue(lp, i)
+			axienet_tx_reset_bql(lp->dq[i]);
+	}
 	netif_tx_start_all_queues(ndev);
 	return 0;
 
@@ -1991,6 +2074,9 @@ static int axienet_stop(struct net_device *ndev)
 			   ~(XAE_OPTION_TXEN | XAE_OPTION_RXEN));
 
 	if (!lp->is_tsn || lp->temac_no == XAE_TEMAC1) {
+#ifdef CONFIG_AXIENET_HAS_MCDMA
+		axienet_mcdma_set_affinity(lp, false);
+#endif
 		for_each_tx_dma_queue(lp, i) {
 			q = lp->dq[i];
 			cr = axienet_dma_in32(q, XAXIDMA_RX_CR_OFFSET);
@@ -2306,6 +2392,56 @@ static int axienet_ioctl(struct net_device *dev, struct ifreq *rq, int cmd)
 	}
 }
 
+#ifdef CONFIG_XILINX_TSN_QCI
+static int axienet_setup_tc_block_cb(enum tc_setup_type type, void *type_data,
+				     void *cb_priv)
+{
+	struct net_device *ndev = cb_priv;
+	struct axienet_local *lp = netdev_priv(ndev);
+	/* Switch port ids: 0 is the endpoint, 1 and 2 the MACs */
+	u8 in_pid = (lp->temac_no == XAE_TEMAC1) ? 1 : 2;
+
+	if (!tc_cls_can_offload_and_chain0(ndev, type_data))
+		return -EOPNOTSUPP;
+
+	if (type != TC_SETUP_CLSFLOWER)
+		return -EOPNOTSUPP;
+
+	return axienet_qci_setup_flower(in_pid, type_data);
+}
+
+static LIST_HEAD(axienet_block_cb_list);
+#endif
+
+#if defined(CONFIG_XILINX_TSN_QBV) || defined(CONFIG_XILINX_TSN_QCI)
+static int axienet_setup_tc(struct net_device *ndev, enum tc_setup_type type,
+			    void *type_data)
+{
+	struct axienet_local *lp = netdev_priv(ndev);
+
+	if (!lp->is_tsn)
+		return -EOPNOTSUPP;
+
+	switch (type) {
+#ifdef CONFIG_XILINX_TSN_QBV
+	case TC_SETUP_QDISC_TAPRIO:
+		return axienet_setup_taprio(ndev, (lp->temac_no == XAE_TEMAC1) ?
+					    PORT_TEMAC_1 : PORT_TEMAC_2,
+					    type_data);
+#endif
+#ifdef CONFIG_XILINX_TSN_QCI
+	case TC_SETUP_BLOCK:
+		return flow_block_cb_setup_simple(type_data,
+						  &axienet_block_cb_list,
+						  axienet_setup_tc_block_cb,
+						  ndev, ndev, true);
+#endif
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+#endif
+
 static const struct net_device_ops axienet_netdev_ops = {
 	.ndo_open = axienet_open,
 	.ndo_stop = axienet_stop,
@@ -2315,6 +2451,9 @@ static const struct net_device_ops axienet_netdev_ops = {
 	.ndo_validate_addr = eth_validate_addr,
 	.ndo_set_rx_mode = axienet_set_multicast_list,
 	.ndo_do_ioctl = axienet_ioctl,
+#if defined(CONFIG_XILINX_TSN_QBV) || defined(CONFIG_XILINX_TSN_QCI)
+	.ndo_setup_tc = axienet_setup_tc,
+#endif
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller = axienet_poll_controller,
 #endif
@@ -2645,6 +2784,8 @@ static const struct ethtool_ops axienet_ethtool_ops = {
 	.get_sset_count	 = axienet_sset_count,
 	.get_ethtool_stats = axienet_get_stats,
 	.get_strings = axienet_strings,
+	.get_channels = axienet_mcdma_get_channels,
+	.get_rxnfc = axienet_mcdma_get_rxnfc,
 #endif
 };
 
@@ -2668,6 +2809,7 @@ static int __maybe_unused axienet_mcdma_probe(struct platform_device *pdev,
 
 		/* parent */
 		q->lp = lp;
+		q->txq_id = i;
 		lp->dq[i] = q;
 		ret = of_property_read_string_index(pdev->dev.of_node,
 						    "xlnx,channel-ids", i,
@@ -2728,6 +2870,7 @@ static int __maybe_unused axienet_dma_probe(struct platform_device *pdev,
 
 		/* parent */
 		q->lp = lp;
+		q->txq_id = i;
 
 		lp->dq[i] = q;
 	}
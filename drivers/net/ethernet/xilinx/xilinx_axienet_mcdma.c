@@ -13,6 +13,7 @@
  * This file contains helper functions for AXI MCDMA TX and RX programming.
  */
 
+#include <linux/interrupt.h>
 #include <linux/module.h>
 #include <linux/of_mdio.h>
 #include <linux/of_platform.h>
@@ -171,6 +172,7 @@ int __maybe_unused axienet_mcdma_tx_q_init(struct net_device *ndev,
 
 	q->tx_bd_ci = 0;
 	q->tx_bd_tail = 0;
+	q->tx_tail_pending = false;
 
 	q->txq_bd_v = dma_alloc_coherent(ndev->dev.parent,
 					 sizeof(*q->txq_bd_v) * lp->tx_bd_num,
@@ -425,6 +427,15 @@ static inline int map_dma_q_rxirq(int irq, struct axienet_local *lp)
 	chan_sermask = axienet_dma_in32(q, XMCDMA_RXINT_SER_OFFSET +
 					q->rx_offset);
 
+	/* Prefer the channel that owns this IRQ line so that its NAPI
+	 * context is scheduled on the CPU the line is routed to.
+	 */
+	for_each_rx_dma_queue(lp, i) {
+		q = lp->dq[i];
+		if (q->rx_irq == irq && (chan_sermask & BIT(q->chan_id - 1)))
+			return q->chan_id;
+	}
+
 	for (i = 1, chan_id = 1; i != 0 && i <= chan_sermask;
 		i <<= 1, chan_id++) {
 		if (chan_sermask & i)
@@ -490,6 +501,87 @@ irqreturn_t __maybe_unused axienet_mcdma_rx_irq(int irq, void *_ndev)
 	return IRQ_HANDLED;
 }
 
+/**
+ * axienet_mcdma_set_affinity - Spread the channel IRQs over the CPUs
+ * @lp:		Pointer to axienet local structure
+ * @spread:	Set the affinity hints if true, clear them if false
+ *
+ * Channel i of the Rx and Tx paths gets the i-th CPU (wrapping around), and
+ * the Tx queue of that channel is steered to the same CPU through XPS. The
+ * hints must be cleared before the IRQs are freed.
+ */
+void axienet_mcdma_set_affinity(struct axienet_local *lp, bool spread)
+{
+	const struct cpumask *mask = NULL;
+	struct axienet_dma_q *q;
+	int i;
+
+	if (lp->num_rx_queues < 2 && lp->num_tx_queues < 2)
+		return;
+
+	for_each_rx_dma_queue(lp, i) {
+		q = lp->dq[i];
+		if (spread)
+			mask = cpumask_of(cpumask_local_spread(i, NUMA_NO_NODE));
+		irq_set_affinity_hint(q->rx_irq, mask);
+	}
+
+	for_each_tx_dma_queue(lp, i) {
+		q = lp->dq[i];
+		if (spread) {
+			mask = cpumask_of(cpumask_local_spread(i, NUMA_NO_NODE));
+			netif_set_xps_queue(lp->ndev, mask, i);
+		}
+		irq_set_affinity_hint(q->tx_irq, spread ? mask : NULL);
+	}
+}
+
+/**
+ * axienet_mcdma_get_channels - Get the number of MCDMA channels.
+ * @ndev:	Pointer to net_device structure
+ * @ch:		Pointer to ethtool_channels structure
+ *
+ * The channels are fixed by the hardware design ("xlnx,channel-ids"). Issue
+ * "ethtool -l ethX" under linux prompt to execute this function.
+ */
+void axienet_mcdma_get_channels(struct net_device *ndev,
+				struct ethtool_channels *ch)
+{
+	struct axienet_local *lp = netdev_priv(ndev);
+
+	ch->max_rx = lp->num_rx_queues;
+	ch->max_tx = lp->num_tx_queues;
+	ch->rx_count = lp->num_rx_queues;
+	ch->tx_count = lp->num_tx_queues;
+}
+
+/**
+ * axienet_mcdma_get_rxnfc - Get Rx flow classification information.
+ * @ndev:	Pointer to net_device structure
+ * @cmd:	Pointer to ethtool_rxnfc structure
+ * @rule_locs:	Unused
+ *
+ * Only the number of Rx rings is reported. The S2MM channel of a frame is
+ * selected by the TDEST of the AXI stream that feeds the MCDMA, that is, by
+ * the logic in front of it (e.g. the TSN traffic classes), and not by the
+ * driver.
+ *
+ * Return: 0, on success, Non-zero error value on failure.
+ */
+int axienet_mcdma_get_rxnfc(struct net_device *ndev, struct ethtool_rxnfc *cmd,
+			    u32 *rule_locs)
+{
+	struct axienet_local *lp = netdev_priv(ndev);
+
+	switch (cmd->cmd) {
+	case ETHTOOL_GRXRINGS:
+		cmd->data = lp->num_rx_queues;
+		return 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
 void axienet_strings(struct net_device *ndev, u32 sset, u8 *data)
 {
 	struct axienet_local *lp = netdev_priv(ndev);
@@ -645,7 +737,10 @@ void __maybe_unused axienet_mcdma_err_handler(unsigned long data)
 
 	q->tx_bd_ci = 0;
 	q->tx_bd_tail = 0;
+	q->tx_tail_pending = false;
 	q->rx_bd_ci = 0;
+	if (axienet_has_bql(lp))
+		axienet_tx_reset_bql(q);
 
 	/* Start updating the Rx channel control register */
 	cr = axienet_dma_in32(q, XMCDMA_CHAN_CR_OFFSET(q->chan_id) +
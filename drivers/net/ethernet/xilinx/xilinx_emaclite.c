@@ -119,6 +119,7 @@
  * @phy_node:		pointer to the PHY device node
  * @mii_bus:		pointer to the MII bus
  * @last_link:		last link status
+ * @napi:		NAPI context for draining the Rx buffers
  */
 struct net_local {
 	struct net_device *ndev;
@@ -138,6 +139,8 @@ struct net_local {
 	struct mii_bus *mii_bus;
 
 	int last_link;
+
+	struct napi_struct napi;
 };
 
 /*************************/
@@ -249,49 +252,6 @@ static void xemaclite_aligned_write(void *src_ptr, u32 *dest_ptr,
 	}
 }
 
-/**
- * xemaclite_aligned_read - Read from 32-bit aligned to 16-bit aligned buffer
- * @src_ptr:	Pointer to the 32-bit aligned source address
- * @dest_ptr:	Pointer to the 16-bit aligned destination address
- * @length:	Number bytes to read from source to destination
- *
- * This function reads data from a 32-bit aligned address in the EmacLite device
- * to a 16-bit aligned buffer.
- */
-static void xemaclite_aligned_read(u32 *src_ptr, u8 *dest_ptr,
-				   unsigned int length)
-{
-	u16 *to_u16_ptr, *from_u16_ptr;
-	u32 *from_u32_ptr;
-	u32 align_buffer;
-
-	from_u32_ptr = src_ptr;
-	to_u16_ptr = (u16 *)dest_ptr;
-
-	for (; length > 3; length -= 4) {
-		/* Copy each word into the temporary buffer */
-		align_buffer = *from_u32_ptr++;
-		from_u16_ptr = (u16 *)&align_buffer;
-
-		/* Read data from source */
-		*to_u16_ptr++ = *from_u16_ptr++;
-		*to_u16_ptr++ = *from_u16_ptr++;
-	}
-
-	if (length) {
-		u8 *to_u8_ptr, *from_u8_ptr;
-
-		/* Set up to read the remaining data */
-		to_u8_ptr = (u8 *)to_u16_ptr;
-		align_buffer = *from_u32_ptr++;
-		from_u8_ptr = (u8 *)&align_buffer;
-
-		/* Read the remaining data */
-		for (; length > 0; length--)
-			*to_u8_ptr = *from_u8_ptr;
-	}
-}
-
 /**
  * xemaclite_send_data - Send an Ethernet frame
  * @drvdata:	Pointer to the Emaclite device private data
@@ -367,8 +327,8 @@ static int xemaclite_send_data(struct net_local *drvdata, u8 *data,
  * @data:	Address where the data is to be received
  * @maxlen:    Maximum supported ethernet packet length
  *
- * This function is intended to be called from the interrupt context or
- * with a wrapper which waits for the receive frame to be available.
+ * This function is intended to be called from the NAPI poll, or with a
+ * wrapper which waits for the receive frame to be available.
  *
  * Return:	Total number of bytes received
  */
@@ -441,9 +401,10 @@ static u16 xemaclite_recv_data(struct net_local *drvdata, u8 *data, int maxlen)
 	if (WARN_ON(length > maxlen))
 		length = maxlen;
 
-	/* Read from the EmacLite device */
-	xemaclite_aligned_read((u32 __force *)(addr + XEL_RXBUFF_OFFSET),
-			       data, length);
+	/* Read from the EmacLite device. The buffer is plain memory, so copy
+	 * it in bulk rather than word by word.
+	 */
+	memcpy_fromio(data, addr + XEL_RXBUFF_OFFSET, length);
 
 	/* Acknowledge the frame */
 	reg_data = xemaclite_readl(addr + XEL_RSR_OFFSET);
@@ -453,6 +414,41 @@ static u16 xemaclite_recv_data(struct net_local *drvdata, u8 *data, int maxlen)
 	return length;
 }
 
+/**
+ * xemaclite_rx_pending - Check for received frames
+ * @drvdata:	Pointer to the Emaclite device private data
+ *
+ * Return:	true if the ping or the pong Rx buffer holds a frame
+ */
+static bool xemaclite_rx_pending(struct net_local *drvdata)
+{
+	void __iomem *base_addr = drvdata->base_addr;
+
+	return (xemaclite_readl(base_addr + XEL_RSR_OFFSET) &
+		XEL_RSR_RECV_DONE_MASK) ||
+	       (xemaclite_readl(base_addr + XEL_BUFFER_OFFSET + XEL_RSR_OFFSET) &
+		XEL_RSR_RECV_DONE_MASK);
+}
+
+/**
+ * xemaclite_rx_irq - Enable or disable the Rx interrupt
+ * @drvdata:	Pointer to the Emaclite device private data
+ * @enable:	Whether to enable the interrupt
+ *
+ * The Rx interrupt enable bit of the first buffer covers both buffers.
+ */
+static void xemaclite_rx_irq(struct net_local *drvdata, bool enable)
+{
+	u32 reg_data;
+
+	reg_data = xemaclite_readl(drvdata->base_addr + XEL_RSR_OFFSET);
+	if (enable)
+		reg_data |= XEL_RSR_RECV_IE_MASK;
+	else
+		reg_data &= ~XEL_RSR_RECV_IE_MASK;
+	xemaclite_writel(reg_data, drvdata->base_addr + XEL_RSR_OFFSET);
+}
+
 /**
  * xemaclite_update_address - Update the MAC address in the device
  * @drvdata:	Pointer to the Emaclite device private data
@@ -582,13 +578,15 @@ static void xemaclite_tx_handler(struct net_device *dev)
 }
 
 /**
- * xemaclite_rx_handler- Interrupt handler for frames received
+ * xemaclite_rx_handler - Receive one frame
  * @dev:	Pointer to the network device
  *
  * This function allocates memory for a socket buffer, fills it with data
  * received and hands it over to the TCP/IP stack.
+ *
+ * Return:	true if a frame was taken from the Rx buffers
  */
-static void xemaclite_rx_handler(struct net_device *dev)
+static bool xemaclite_rx_handler(struct net_device *dev)
 {
 	struct net_local *lp = netdev_priv(dev);
 	struct sk_buff *skb;
@@ -596,12 +594,12 @@ static void xemaclite_rx_handler(struct net_device *dev)
 	u32 len;
 
 	len = ETH_FRAME_LEN + ETH_FCS_LEN;
-	skb = netdev_alloc_skb(dev, len + ALIGNMENT);
+	skb = napi_alloc_skb(&lp->napi, len + ALIGNMENT);
 	if (!skb) {
 		/* Couldn't get memory. */
 		dev->stats.rx_dropped++;
 		dev_err(&lp->ndev->dev, "Could not allocate receive buffer\n");
-		return;
+		return false;
 	}
 
 	/* A new skb should have the data halfword aligned, but this code is
@@ -619,8 +617,8 @@ static void xemaclite_rx_handler(struct net_device *dev)
 
 	if (!len) {
 		dev->stats.rx_errors++;
-		dev_kfree_skb_irq(skb);
-		return;
+		dev_kfree_skb(skb);
+		return false;
 	}
 
 	skb_put(skb, len);	/* Tell the skb how much data we got */
@@ -632,7 +630,43 @@ static void xemaclite_rx_handler(struct net_device *dev)
 	dev->stats.rx_bytes += len;
 
 	if (!skb_defer_rx_timestamp(skb))
-		netif_rx(skb);	/* Send the packet upstream */
+		napi_gro_receive(&lp->napi, skb); /* Send the packet upstream */
+
+	return true;
+}
+
+/**
+ * xemaclite_poll - NAPI poll routine
+ * @napi:	Pointer to the NAPI context
+ * @budget:	Maximum number of frames to receive
+ *
+ * This function drains the ping and pong Rx buffers. The Rx interrupt stays
+ * disabled until both are empty.
+ *
+ * Return:	Number of frames received
+ */
+static int xemaclite_poll(struct napi_struct *napi, int budget)
+{
+	struct net_local *lp = container_of(napi, struct net_local, napi);
+	int work_done = 0;
+
+	while (work_done < budget && xemaclite_rx_pending(lp)) {
+		if (!xemaclite_rx_handler(lp->ndev))
+			break;
+		work_done++;
+	}
+
+	if (work_done < budget && napi_complete_done(napi, work_done)) {
+		xemaclite_rx_irq(lp, true);
+
+		/* Frames that arrived while the interrupt was disabled do not
+		 * raise one now
+		 */
+		if (xemaclite_rx_pending(lp) && napi_reschedule(napi))
+			xemaclite_rx_irq(lp, false);
+	}
+
+	return work_done;
 }
 
 /**
@@ -654,12 +688,10 @@ static irqreturn_t xemaclite_interrupt(int irq, void *dev_id)
 	u32 tx_status;
 
 	/* Check if there is Rx Data available */
-	if ((xemaclite_readl(base_addr + XEL_RSR_OFFSET) &
-			 XEL_RSR_RECV_DONE_MASK) ||
-	    (xemaclite_readl(base_addr + XEL_BUFFER_OFFSET + XEL_RSR_OFFSET)
-			 & XEL_RSR_RECV_DONE_MASK))
-
-		xemaclite_rx_handler(dev);
+	if (xemaclite_rx_pending(lp) && napi_schedule_prep(&lp->napi)) {
+		xemaclite_rx_irq(lp, false);
+		__napi_schedule(&lp->napi);
+	}
 
 	/* Check if the Transmission for the first buffer is completed */
 	tx_status = xemaclite_readl(base_addr + XEL_TSR_OFFSET);
@@ -974,6 +1006,8 @@ static int xemaclite_open(struct net_device *dev)
 		return retval;
 	}
 
+	napi_enable(&lp->napi);
+
 	/* Enable Interrupts */
 	xemaclite_enable_interrupts(lp);
 
@@ -1000,6 +1034,7 @@ static int xemaclite_close(struct net_device *dev)
 	netif_stop_queue(dev);
 	xemaclite_disable_interrupts(lp);
 	free_irq(dev->irq, dev);
+	napi_disable(&lp->napi);
 
 	if (lp->phy_dev)
 		phy_disconnect(lp->phy_dev);
@@ -1187,6 +1222,7 @@ static int xemaclite_of_probe(struct platform_device *ofdev)
 
 	ndev->netdev_ops = &xemaclite_netdev_ops;
 	ndev->ethtool_ops = &xemaclite_ethtool_ops;
+	netif_napi_add(ndev, &lp->napi, xemaclite_poll, NAPI_POLL_WEIGHT);
 	ndev->flags &= ~IFF_MULTICAST;
 	ndev->watchdog_timeo = TX_TIMEOUT;
 
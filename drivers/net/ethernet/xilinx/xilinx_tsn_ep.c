@@ -65,8 +65,32 @@ static int tsn_ep_xmit(struct sk_buff *skb, struct net_device *dev)
 	return NETDEV_TX_OK;
 }
 
+#ifdef CONFIG_XILINX_TSN_QBV
+/**
+ * tsn_ep_setup_tc - TSN endpoint tc offload.
+ * @dev: Pointer to the net_device structure
+ * @type: Offload type
+ * @type_data: Offload data
+ *
+ * Return: 0 on success, Non-zero error value on failure.
+ *
+ * Only taprio schedules are offloaded, onto the endpoint gate control list.
+ */
+static int tsn_ep_setup_tc(struct net_device *dev, enum tc_setup_type type,
+			   void *type_data)
+{
+	if (type != TC_SETUP_QDISC_TAPRIO)
+		return -EOPNOTSUPP;
+
+	return axienet_setup_taprio(dev, PORT_EP, type_data);
+}
+#endif
+
 static const struct net_device_ops ep_netdev_ops = {
 	.ndo_do_ioctl = tsn_ep_ioctl,
+#ifdef CONFIG_XILINX_TSN_QBV
+	.ndo_setup_tc = tsn_ep_setup_tc,
+#endif
 	.ndo_start_xmit = tsn_ep_xmit,
 };
 
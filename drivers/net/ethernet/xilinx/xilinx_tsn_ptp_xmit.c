@@ -289,14 +289,14 @@ irqreturn_t axienet_ptp_rx_irq(int irq, void *_ndev)
 
 /**
  * axienet_tx_tstamp - timestamp skb on trasmit path
- * @work:	Pointer to work_struct structure
+ * @lp:		Pointer to axienet local structure
  *
- * This adds TX timestamp to skb
+ * This adds TX timestamp to the sent skbs of the PTP tx queue and frees
+ * them. It is called straight from the PTP TX ISR so that the timestamps
+ * reach the socket without the delay of a work queue.
  */
-void axienet_tx_tstamp(struct work_struct *work)
+static void axienet_tx_tstamp(struct axienet_local *lp)
 {
-	struct axienet_local *lp = container_of(work, struct axienet_local,
-			tx_tstamp_work);
 	struct net_device *ndev = lp->ndev;
 	struct skb_shared_hwtstamps hwtstamps;
 	struct sk_buff *skb;
@@ -361,7 +361,7 @@ irqreturn_t axienet_ptp_tx_irq(int irq, void *_ndev)
 	/* read ctrl register to clear the interrupt */
 	axienet_ior(lp, PTP_TX_CONTROL_OFFSET);
 
-	schedule_work(&lp->tx_tstamp_work);
+	axienet_tx_tstamp(lp);
 
 	netif_wake_queue(ndev);
 
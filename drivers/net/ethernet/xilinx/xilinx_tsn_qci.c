@@ -15,6 +15,13 @@
  * GNU General Public License for more details.
  */
 
+#include <linux/bitmap.h>
+#include <linux/etherdevice.h>
+#include <linux/mutex.h>
+#include <net/flow_offload.h>
+#include <net/pkt_cls.h>
+#include <net/pkt_sched.h>
+
 #include "xilinx_tsn_switch.h"
 
 #define SMC_MODE_SHIFT				28
@@ -34,6 +41,25 @@
 #define OP_TYPE_SHIFT				1
 #define PSFP_EN_CONTROL_MASK			0x1
 
+#define PSFP_WR_OP_FILTER			0x0
+#define PSFP_WR_OP_METER			0x1
+#define PSFP_OP_WRITE				1
+
+#define QCI_MAX_STREAMS				256
+#define QCI_FWD_TO_EP				BIT(0)
+
+/* Streams offloaded through tc flower. The index is used both as the stream
+ * handle (gate id) and as the meter id.
+ */
+struct qci_stream {
+	unsigned long cookie;
+	struct cam_struct cam;
+};
+
+static struct qci_stream qci_streams[QCI_MAX_STREAMS];
+static DECLARE_BITMAP(qci_stream_map, QCI_MAX_STREAMS);
+static DEFINE_MUTEX(qci_stream_lock);
+
 /**
  * psfp_control - Configure thr control for PSFP
  * @data:	Value to be programmed
@@ -149,3 +175,164 @@ void get_psfp_static_counter(struct psfp_static_counter *data)
 	data->err_meter.lsb = axienet_ior(&lp, METER_ERR_OFFSET + offset);
 	data->err_meter.msb = axienet_ior(&lp, METER_ERR_OFFSET + offset + 0x4);
 }
+
+static int qci_find_stream(unsigned long cookie)
+{
+	int id;
+
+	for_each_set_bit(id, qci_stream_map, QCI_MAX_STREAMS) {
+		if (qci_streams[id].cookie == cookie)
+			return id;
+	}
+
+	return -ENOENT;
+}
+
+static void qci_del_stream(int id)
+{
+	struct psfp_config psfp = {
+		.gate_id = id,
+		.wr_op_type = PSFP_WR_OP_FILTER,
+		.op_type = PSFP_OP_WRITE,
+	};
+
+	add_delete_cam_entry(qci_streams[id].cam, 0);
+	psfp_control(psfp);
+	clear_bit(id, qci_stream_map);
+}
+
+static int qci_flower_replace(u8 in_pid, struct flow_cls_offload *f)
+{
+	struct flow_rule *rule = flow_cls_offload_flow_rule(f);
+	struct netlink_ext_ack *extack = f->common.extack;
+	struct flow_dissector *dissector = rule->match.dissector;
+	struct psfp_config psfp = { .op_type = PSFP_OP_WRITE };
+	struct stream_filter filter = {
+		.in_pid = in_pid,
+		.max_fr_size = MAX_FR_SIZE_MASK,
+	};
+	struct meter_config meter = { 0 };
+	struct flow_match_eth_addrs eth;
+	struct flow_match_vlan vlan;
+	const struct flow_action_entry *act;
+	bool police = false, allow = true;
+	struct qci_stream *stream;
+	int i, id;
+
+	if (dissector->used_keys &
+	    ~(BIT(FLOW_DISSECTOR_KEY_CONTROL) |
+	      BIT(FLOW_DISSECTOR_KEY_BASIC) |
+	      BIT(FLOW_DISSECTOR_KEY_ETH_ADDRS) |
+	      BIT(FLOW_DISSECTOR_KEY_VLAN))) {
+		NL_SET_ERR_MSG_MOD(extack, "Unsupported keys used");
+		return -EOPNOTSUPP;
+	}
+
+	/* The stream identification CAM is keyed by destination MAC and
+	 * VLAN ID, both exact.
+	 */
+	if (!flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_ETH_ADDRS) ||
+	    !flow_rule_match_key(rule, FLOW_DISSECTOR_KEY_VLAN)) {
+		NL_SET_ERR_MSG_MOD(extack, "Match on dst_mac and vlan_id");
+		return -EOPNOTSUPP;
+	}
+
+	flow_rule_match_eth_addrs(rule, &eth);
+	flow_rule_match_vlan(rule, &vlan);
+	if (!is_broadcast_ether_addr(eth.mask->dst) ||
+	    !is_zero_ether_addr(eth.mask->src) ||
+	    vlan.mask->vlan_id != VLAN_VID_MASK || vlan.mask->vlan_priority) {
+		NL_SET_ERR_MSG_MOD(extack, "Only exact dst_mac and vlan_id");
+		return -EOPNOTSUPP;
+	}
+
+	flow_action_for_each(i, act, &rule->action) {
+		switch (act->id) {
+		case FLOW_ACTION_POLICE:
+			meter.cir = min_t(u64, act->police.rate_bytes_ps,
+					  U32_MAX);
+			meter.cbr = div_u64(act->police.rate_bytes_ps *
+					    PSCHED_NS2TICKS(act->police.burst),
+					    PSCHED_TICKS_PER_SEC);
+			police = true;
+			break;
+		case FLOW_ACTION_DROP:
+			allow = false;
+			break;
+		default:
+			NL_SET_ERR_MSG_MOD(extack, "Only police and drop");
+			return -EOPNOTSUPP;
+		}
+	}
+
+	mutex_lock(&qci_stream_lock);
+	id = qci_find_stream(f->cookie);
+	if (id >= 0)
+		qci_del_stream(id);
+	id = find_first_zero_bit(qci_stream_map, QCI_MAX_STREAMS);
+	if (id >= QCI_MAX_STREAMS) {
+		mutex_unlock(&qci_stream_lock);
+		NL_SET_ERR_MSG_MOD(extack, "No free stream handle");
+		return -ENOSPC;
+	}
+
+	if (police) {
+		program_meter_reg(meter);
+		psfp.meter_id = id;
+		psfp.wr_op_type = PSFP_WR_OP_METER;
+		psfp_control(psfp);
+	}
+
+	config_stream_filter(filter);
+	psfp.gate_id = id;
+	psfp.meter_id = id;
+	psfp.en_meter = police;
+	psfp.allow_stream = allow;
+	psfp.en_psfp = true;
+	psfp.wr_op_type = PSFP_WR_OP_FILTER;
+	psfp_control(psfp);
+
+	stream = &qci_streams[id];
+	memset(stream, 0, sizeof(*stream));
+	stream->cookie = f->cookie;
+	ether_addr_copy(stream->cam.dest_addr, eth.key->dst);
+	stream->cam.vlanid = vlan.key->vlan_id;
+	stream->cam.fwd_port = QCI_FWD_TO_EP;
+	stream->cam.gate_id = id;
+	add_delete_cam_entry(stream->cam, 1);
+	set_bit(id, qci_stream_map);
+	mutex_unlock(&qci_stream_lock);
+
+	return 0;
+}
+
+/**
+ * axienet_qci_setup_flower - Offload a tc flower rule to the Qci tables
+ * @in_pid:	Switch port the rule applies to
+ * @f:		Flower classifier offload request
+ *
+ * A rule matches the frames to the endpoint by destination MAC and VLAN ID,
+ * and may police them (police) or block them (drop). Each rule takes one
+ * CAM entry, one stream filter and one meter.
+ *
+ * Return: 0, on success, Non-zero error value on failure.
+ */
+int axienet_qci_setup_flower(u8 in_pid, struct flow_cls_offload *f)
+{
+	int id;
+
+	switch (f->command) {
+	case FLOW_CLS_REPLACE:
+		return qci_flower_replace(in_pid, f);
+	case FLOW_CLS_DESTROY:
+		mutex_lock(&qci_stream_lock);
+		id = qci_find_stream(f->cookie);
+		if (id >= 0)
+			qci_del_stream(id);
+		mutex_unlock(&qci_stream_lock);
+		return id < 0 ? id : 0;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+EXPORT_SYMBOL_GPL(axienet_qci_setup_flower);
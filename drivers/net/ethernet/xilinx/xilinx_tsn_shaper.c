@@ -15,6 +15,8 @@
  * GNU General Public License for more details.
  */
 
+#include <net/pkt_sched.h>
+
 #include "xilinx_axienet.h"
 #include "xilinx_tsn_shaper.h"
 
@@ -132,6 +134,86 @@ int axienet_set_schedule(struct net_device *ndev, void __user *useraddr)
 	return ret;
 }
 
+/* Map a taprio gate mask (one bit per traffic class) to the GS_* states.
+ * Traffic class 0 is best effort and the highest one is scheduled.
+ */
+static inline u32 axienet_map_tc_to_gs(struct axienet_local *lp, u32 mask)
+{
+	u32 gs = 0;
+
+	if (mask & BIT(0))
+		gs |= GS_BE_OPEN;
+	if (lp->num_tc == 3 && (mask & BIT(1)))
+		gs |= GS_RE_OPEN;
+	if (mask & BIT(lp->num_tc - 1))
+		gs |= GS_ST_OPEN;
+
+	return gs;
+}
+
+/**
+ * axienet_setup_taprio - Offload a taprio schedule to the Qbv scheduler.
+ * @ndev:	Pointer to net_device structure
+ * @port:	Scheduler instance (see enum hw_port)
+ * @qopt:	Schedule from the taprio qdisc
+ *
+ * The gate intervals are converted from ns to the tick granularity of the
+ * scheduler. A schedule that is already running is replaced.
+ *
+ * Return: 0, on success, Non-zero error value on failure.
+ */
+int axienet_setup_taprio(struct net_device *ndev, u8 port,
+			 struct tc_taprio_qopt_offload *qopt)
+{
+	struct axienet_local *lp = netdev_priv(ndev);
+	struct qbv_info *qbv;
+	u32 tick, sec_ns;
+	size_t i;
+	int ret;
+
+	if (qopt->enable && (qopt->num_entries > QBV_MAX_ENTRIES ||
+			     qopt->cycle_time > CYCLE_TIME_DENOMINATOR_MASK ||
+			     qopt->cycle_time_extension ||
+			     qopt->base_time < 0))
+		return -EOPNOTSUPP;
+
+	tick = (axienet_ior(lp, GATE_STATE(port)) >>
+		GS_TICK_GRANULARITY_SHIFT) & GS_TICK_GRANULARITY_MASK;
+	if (!tick)
+		tick = 1;
+
+	qbv = kzalloc(sizeof(*qbv), GFP_KERNEL);
+	if (!qbv)
+		return -ENOMEM;
+
+	qbv->port = port;
+	qbv->force = 1;
+	if (qopt->enable) {
+		qbv->cycle_time = qopt->cycle_time;
+		qbv->ptp_time_sec = div_u64_rem(qopt->base_time, NSEC_PER_SEC,
+						&sec_ns);
+		qbv->ptp_time_ns = sec_ns;
+		qbv->list_length = qopt->num_entries;
+	}
+
+	for (i = 0; i < qbv->list_length; i++) {
+		struct tc_taprio_sched_entry *e = &qopt->entries[i];
+
+		if (e->command != TC_TAPRIO_CMD_SET_GATES ||
+		    e->interval / tick > CTRL_LIST_TIME_INTERVAL_MASK) {
+			ret = -EOPNOTSUPP;
+			goto out;
+		}
+		qbv->acl_gate_state[i] = axienet_map_tc_to_gs(lp, e->gate_mask);
+		qbv->acl_gate_time[i] = e->interval / tick;
+	}
+
+	ret = __axienet_set_schedule(ndev, qbv);
+out:
+	kfree(qbv);
+	return ret;
+}
+
 static int __axienet_get_schedule(struct net_device *ndev, struct qbv_info *qbv)
 {
 	struct axienet_local *lp = netdev_priv(ndev);
@@ -42,12 +42,6 @@
  * 0x7c		ST_XMIT_OVRRUN_CNT
  */
 
-enum hw_port {
-	PORT_EP = 0,
-	PORT_TEMAC_1,
-	PORT_TEMAC_2,
-};
-
 			     /* EP */ /* TEMAC1 */ /* TEMAC2*/
 static u32 qbv_reg_map[3] = { 0x0,   0x14000,     0x14000 };
 
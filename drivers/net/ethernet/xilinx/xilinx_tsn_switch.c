@@ -401,7 +401,7 @@ static void get_memory_static_counter(struct switch_data *data)
 					XAS_MEM_STCNTR_ERR_BE_MAC1_MAC2 + 0x4);
 }
 
-static void add_delete_cam_entry(struct cam_struct data, u8 add)
+void add_delete_cam_entry(struct cam_struct data, u8 add)
 {
 	u32 port_action = 0;
 	u32 tv2 = 0;
@@ -346,6 +346,8 @@ struct switch_data {
 
 extern struct axienet_local lp;
 
+void add_delete_cam_entry(struct cam_struct data, u8 add);
+
 /********* qci function declararions ********/
 void psfp_control(struct psfp_config data);
 void config_stream_filter(struct stream_filter data);
@@ -16,8 +16,10 @@
 
 #define pr_fmt(fmt)	"OF: " fmt
 
+#include <linux/cpumask.h>
 #include <linux/device.h>
 #include <linux/errno.h>
+#include <linux/interrupt.h>
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/of.h>
@@ -33,14 +35,89 @@
  * This function is a wrapper that chains of_irq_parse_one() and
  * irq_create_of_mapping() to make things easier to callers
  */
+#ifdef CONFIG_SMP
+/* Add the CPUs of the phandle list @propname of @np to @mask */
+static void of_irq_add_cpus(struct device_node *np, const char *propname,
+			    int index, int count, struct cpumask *mask)
+{
+	struct device_node *cpu_np;
+	int i, cpu;
+
+	for (i = index; i < index + count; i++) {
+		cpu_np = of_parse_phandle(np, propname, i);
+		if (!cpu_np)
+			break;
+		cpu = of_cpu_node_to_id(cpu_np);
+		of_node_put(cpu_np);
+		if (cpu >= 0)
+			cpumask_set_cpu(cpu, mask);
+	}
+}
+
+/*
+ * Set the affinity that interrupt @index of @dev gets when it is requested:
+ *
+ *  - "interrupt-affinity" of @dev: one CPU phandle per interrupt (as in the
+ *    ARM PMU binding).
+ *  - Otherwise "linux,interrupt-cpus" of @dev or of its closest ancestor
+ *    that has it: the CPUs for all interrupts below that node. On a bus of
+ *    FPGA fabric devices, this keeps their interrupts off the housekeeping
+ *    CPUs.
+ *
+ * The mapping is created again when a device is added again (e.g. after an
+ * overlay is applied), so the affinity survives that, unlike a setting in
+ * /proc/irq.
+ */
+static void of_irq_set_affinity(struct device_node *dev, int index,
+				unsigned int virq)
+{
+	struct device_node *np;
+	cpumask_var_t mask;
+	int count;
+
+	if (!virq || !zalloc_cpumask_var(&mask, GFP_KERNEL))
+		return;
+
+	if (of_count_phandle_with_args(dev, "interrupt-affinity", NULL) > index) {
+		of_irq_add_cpus(dev, "interrupt-affinity", index, 1, mask);
+	} else {
+		for (np = of_node_get(dev); np; np = of_get_next_parent(np)) {
+			count = of_count_phandle_with_args(np,
+					"linux,interrupt-cpus", NULL);
+			if (count > 0) {
+				of_irq_add_cpus(np, "linux,interrupt-cpus", 0,
+						count, mask);
+				of_node_put(np);
+				break;
+			}
+		}
+	}
+
+	/* -EBUSY for a mapping that exists already. Keep what it has. */
+	if (!cpumask_empty(mask) && irq_set_initial_affinity(virq, mask))
+		pr_debug("%pOF: affinity of interrupt %d left as is\n",
+			 dev, index);
+
+	free_cpumask_var(mask);
+}
+#else
+static inline void of_irq_set_affinity(struct device_node *dev, int index,
+				       unsigned int virq)
+{
+}
+#endif
+
 unsigned int irq_of_parse_and_map(struct device_node *dev, int index)
 {
 	struct of_phandle_args oirq;
+	unsigned int virq;
 
 	if (of_irq_parse_one(dev, index, &oirq))
 		return 0;
 
-	return irq_create_of_mapping(&oirq);
+	virq = irq_create_of_mapping(&oirq);
+	of_irq_set_affinity(dev, index, virq);
+	return virq;
 }
 EXPORT_SYMBOL_GPL(irq_of_parse_and_map);
 
@@ -398,7 +475,9 @@ int of_irq_get(struct device_node *dev, int index)
 	if (!domain)
 		return -EPROBE_DEFER;
 
-	return irq_create_of_mapping(&oirq);
+	rc = irq_create_of_mapping(&oirq);
+	of_irq_set_affinity(dev, index, rc);
+	return rc;
 }
 EXPORT_SYMBOL_GPL(of_irq_get);
 
@@ -0,0 +1,614 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Xilinx AXI Performance Monitor PMU
+ *
+ * Exposes the metric counters of an APM in advanced mode as an uncore PMU.
+ * Each event counts one metric on one of the monitored AXI interfaces
+ * (slots), e.g. the Zynq HP, ACP and GP ports. The 32-bit metric counters
+ * are free-running; the sample interval timer of the APM raises an interrupt
+ * often enough to fold them into the 64-bit perf counts before they wrap.
+ */
+
+#include <linux/clk.h>
+#include <linux/cpuhotplug.h>
+#include <linux/idr.h>
+#include <linux/interrupt.h>
+#include <linux/io.h>
+#include <linux/module.h>
+#include <linux/of.h>
+#include <linux/perf_event.h>
+#include <linux/platform_device.h>
+#include <linux/slab.h>
+
+#define XAPM_GCC_HIGH		0x0000	/* Global clock counter */
+#define XAPM_GCC_LOW		0x0004
+#define XAPM_SI_LOW		0x0024	/* Sample interval */
+#define XAPM_SICR		0x0028	/* Sample interval control */
+#define XAPM_GIE		0x0030	/* Global interrupt enable */
+#define XAPM_IE			0x0034	/* Interrupt enable */
+#define XAPM_IS			0x0038	/* Interrupt status */
+#define XAPM_MSR(n)		(0x0044 + ((n) / 4) * 4) /* Metric selector */
+#define XAPM_MC(n)		(0x0100 + (n) * 0x10)	/* Metric counter */
+#define XAPM_CTL		0x0300
+
+#define XAPM_SICR_ENABLE	BIT(0)
+#define XAPM_SICR_LOAD		BIT(1)
+#define XAPM_IXR_SIC_OVERFLOW	BIT(1)
+#define XAPM_CTL_MCNTR_ENABLE	BIT(0)
+#define XAPM_CTL_GCC_ENABLE	BIT(16)
+#define XAPM_CTL_GCC_RESET	BIT(17)
+
+#define XAPM_MSR_SLOT_SHIFT	5
+
+#define XAPM_MAX_COUNTERS	10
+#define XAPM_MAX_SLOTS		8
+
+/*
+ * At most 16 bytes per clock and slot, so a 32-bit byte counter takes at
+ * least 2^28 clocks to wrap. Sample four times as often.
+ */
+#define XAPM_SAMPLE_CYCLES	(1U << 26)
+
+/* The highest metric that accumulates, the ones above are min/max values */
+#define XAPM_METRIC_MAX		0x0b
+#define XAPM_EVENT_CYCLES	0xff
+
+#define XAPM_EVENT(config)	((config) & 0xff)
+#define XAPM_SLOT(config)	(((config) >> 8) & 0x7)
+
+#define to_xapm_pmu(p)		container_of(p, struct xapm_pmu, pmu)
+
+#define XAPM_PMU_DEV_NAME	"xilinx_apm"
+#define XAPM_CPUHP_CB_NAME	XAPM_PMU_DEV_NAME "_perf_pmu"
+
+static DEFINE_IDA(xapm_ida);
+
+struct xapm_pmu {
+	struct pmu pmu;
+	void __iomem *base;
+	struct clk *clk;
+	unsigned int cpu;
+	struct hlist_node node;
+	struct device *dev;
+	struct perf_event *events[XAPM_MAX_COUNTERS];
+	struct perf_event *cycles;
+	int active_events;
+	enum cpuhp_state cpuhp_state;
+	u32 num_counters;
+	u32 num_slots;
+	u32 gcc_width;
+	int irq;
+	int id;
+};
+
+static ssize_t xapm_pmu_cpumask_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct xapm_pmu *pmu = dev_get_drvdata(dev);
+
+	return cpumap_print_to_pagebuf(true, buf, cpumask_of(pmu->cpu));
+}
+
+static struct device_attribute xapm_pmu_cpumask_attr =
+	__ATTR(cpumask, 0444, xapm_pmu_cpumask_show, NULL);
+
+static struct attribute *xapm_pmu_cpumask_attrs[] = {
+	&xapm_pmu_cpumask_attr.attr,
+	NULL,
+};
+
+static struct attribute_group xapm_pmu_cpumask_attr_group = {
+	.attrs = xapm_pmu_cpumask_attrs,
+};
+
+static ssize_t
+xapm_pmu_event_show(struct device *dev, struct device_attribute *attr,
+		    char *page)
+{
+	struct perf_pmu_events_attr *pmu_attr;
+
+	pmu_attr = container_of(attr, struct perf_pmu_events_attr, attr);
+	return sprintf(page, "event=0x%02llx\n", pmu_attr->id);
+}
+
+#define XAPM_PMU_EVENT_ATTR(_name, _id)					\
+	(&((struct perf_pmu_events_attr[]) {				\
+		{ .attr = __ATTR(_name, 0444, xapm_pmu_event_show, NULL),\
+		  .id = _id, }						\
+	})[0].attr.attr)
+
+static struct attribute *xapm_pmu_events_attrs[] = {
+	XAPM_PMU_EVENT_ATTR(write-transactions, 0x00),
+	XAPM_PMU_EVENT_ATTR(read-transactions, 0x01),
+	XAPM_PMU_EVENT_ATTR(write-bytes, 0x02),
+	XAPM_PMU_EVENT_ATTR(read-bytes, 0x03),
+	XAPM_PMU_EVENT_ATTR(write-beats, 0x04),
+	XAPM_PMU_EVENT_ATTR(read-latency, 0x05),
+	XAPM_PMU_EVENT_ATTR(write-latency, 0x06),
+	XAPM_PMU_EVENT_ATTR(slave-write-idle, 0x07),
+	XAPM_PMU_EVENT_ATTR(master-read-idle, 0x08),
+	XAPM_PMU_EVENT_ATTR(write-responses, 0x09),
+	XAPM_PMU_EVENT_ATTR(write-lasts, 0x0a),
+	XAPM_PMU_EVENT_ATTR(read-lasts, 0x0b),
+	XAPM_PMU_EVENT_ATTR(cycles, XAPM_EVENT_CYCLES),
+	NULL,
+};
+
+static struct attribute_group xapm_pmu_events_attr_group = {
+	.name = "events",
+	.attrs = xapm_pmu_events_attrs,
+};
+
+PMU_FORMAT_ATTR(event, "config:0-7");
+PMU_FORMAT_ATTR(slot, "config:8-10");
+
+static struct attribute *xapm_pmu_format_attrs[] = {
+	&format_attr_event.attr,
+	&format_attr_slot.attr,
+	NULL,
+};
+
+static struct attribute_group xapm_pmu_format_attr_group = {
+	.name = "format",
+	.attrs = xapm_pmu_format_attrs,
+};
+
+static const struct attribute_group *attr_groups[] = {
+	&xapm_pmu_events_attr_group,
+	&xapm_pmu_format_attr_group,
+	&xapm_pmu_cpumask_attr_group,
+	NULL,
+};
+
+static bool xapm_pmu_is_cycles(struct perf_event *event)
+{
+	return XAPM_EVENT(event->attr.config) == XAPM_EVENT_CYCLES;
+}
+
+static u64 xapm_pmu_read_gcc(struct xapm_pmu *pmu)
+{
+	u32 high, low;
+
+	if (pmu->gcc_width < 64)
+		return readl_relaxed(pmu->base + XAPM_GCC_LOW);
+
+	do {
+		high = readl_relaxed(pmu->base + XAPM_GCC_HIGH);
+		low = readl_relaxed(pmu->base + XAPM_GCC_LOW);
+	} while (readl_relaxed(pmu->base + XAPM_GCC_HIGH) != high);
+
+	return ((u64)high << 32) | low;
+}
+
+static u64 xapm_pmu_read_counter(struct xapm_pmu *pmu, struct perf_event *event)
+{
+	if (xapm_pmu_is_cycles(event))
+		return xapm_pmu_read_gcc(pmu);
+
+	return readl_relaxed(pmu->base + XAPM_MC(event->hw.idx));
+}
+
+static u64 xapm_pmu_counter_mask(struct xapm_pmu *pmu, struct perf_event *event)
+{
+	if (xapm_pmu_is_cycles(event) && pmu->gcc_width == 64)
+		return U64_MAX;
+
+	return U32_MAX;
+}
+
+static int xapm_pmu_event_init(struct perf_event *event)
+{
+	struct xapm_pmu *pmu = to_xapm_pmu(event->pmu);
+	struct hw_perf_event *hwc = &event->hw;
+	struct perf_event *sibling;
+	u32 metric = XAPM_EVENT(event->attr.config);
+
+	if (event->attr.type != event->pmu->type)
+		return -ENOENT;
+
+	if (is_sampling_event(event) || event->attach_state & PERF_ATTACH_TASK)
+		return -EOPNOTSUPP;
+
+	if (event->cpu < 0) {
+		dev_warn(pmu->dev, "Can't provide per-task data!\n");
+		return -EOPNOTSUPP;
+	}
+
+	if (metric != XAPM_EVENT_CYCLES &&
+	    (metric > XAPM_METRIC_MAX ||
+	     XAPM_SLOT(event->attr.config) >= pmu->num_slots))
+		return -EINVAL;
+
+	/*
+	 * We must NOT create groups containing mixed PMUs, although software
+	 * events are acceptable.
+	 */
+	if (event->group_leader->pmu != event->pmu &&
+			!is_software_event(event->group_leader))
+		return -EINVAL;
+
+	for_each_sibling_event(sibling, event->group_leader) {
+		if (sibling->pmu != event->pmu &&
+				!is_software_event(sibling))
+			return -EINVAL;
+	}
+
+	event->cpu = pmu->cpu;
+	hwc->idx = -1;
+
+	return 0;
+}
+
+static void xapm_pmu_event_update(struct perf_event *event)
+{
+	struct xapm_pmu *pmu = to_xapm_pmu(event->pmu);
+	struct hw_perf_event *hwc = &event->hw;
+	u64 delta, prev_raw_count, new_raw_count;
+
+	do {
+		prev_raw_count = local64_read(&hwc->prev_count);
+		new_raw_count = xapm_pmu_read_counter(pmu, event);
+	} while (local64_cmpxchg(&hwc->prev_count, prev_raw_count,
+			new_raw_count) != prev_raw_count);
+
+	delta = (new_raw_count - prev_raw_count) &
+		xapm_pmu_counter_mask(pmu, event);
+
+	local64_add(delta, &event->count);
+}
+
+static void xapm_pmu_select_metric(struct xapm_pmu *pmu, int counter,
+				   u32 metric, u32 slot)
+{
+	unsigned int shift = (counter % 4) * 8;
+	u32 val;
+
+	val = readl(pmu->base + XAPM_MSR(counter));
+	val &= ~(0xff << shift);
+	val |= (metric | slot << XAPM_MSR_SLOT_SHIFT) << shift;
+	writel(val, pmu->base + XAPM_MSR(counter));
+}
+
+/*
+ * The metric and global clock counters cannot be enabled one by one. They
+ * run while any event is added and the events take deltas of them.
+ */
+static void xapm_pmu_enable_hw(struct xapm_pmu *pmu, bool enable)
+{
+	if (!enable) {
+		writel(0, pmu->base + XAPM_GIE);
+		writel(0, pmu->base + XAPM_SICR);
+		writel(0, pmu->base + XAPM_CTL);
+		return;
+	}
+
+	writel(XAPM_SAMPLE_CYCLES, pmu->base + XAPM_SI_LOW);
+	writel(XAPM_SICR_LOAD, pmu->base + XAPM_SICR);
+	writel(XAPM_SICR_ENABLE, pmu->base + XAPM_SICR);
+
+	writel(XAPM_IXR_SIC_OVERFLOW, pmu->base + XAPM_IS);
+	writel(XAPM_IXR_SIC_OVERFLOW, pmu->base + XAPM_IE);
+	writel(1, pmu->base + XAPM_GIE);
+
+	writel(XAPM_CTL_MCNTR_ENABLE | XAPM_CTL_GCC_ENABLE,
+	       pmu->base + XAPM_CTL);
+}
+
+static void xapm_pmu_event_start(struct perf_event *event, int flags)
+{
+	struct xapm_pmu *pmu = to_xapm_pmu(event->pmu);
+	struct hw_perf_event *hwc = &event->hw;
+
+	local64_set(&hwc->prev_count, xapm_pmu_read_counter(pmu, event));
+
+	hwc->state = 0;
+}
+
+static int xapm_pmu_event_add(struct perf_event *event, int flags)
+{
+	struct xapm_pmu *pmu = to_xapm_pmu(event->pmu);
+	struct hw_perf_event *hwc = &event->hw;
+	u64 config = event->attr.config;
+	int counter;
+
+	if (xapm_pmu_is_cycles(event)) {
+		if (pmu->cycles)
+			return -EOPNOTSUPP;
+		pmu->cycles = event;
+		counter = XAPM_MAX_COUNTERS;
+	} else {
+		for (counter = 0; counter < pmu->num_counters; counter++)
+			if (!pmu->events[counter])
+				break;
+
+		if (counter == pmu->num_counters) {
+			dev_dbg(pmu->dev, "There are not enough counters\n");
+			return -EOPNOTSUPP;
+		}
+
+		pmu->events[counter] = event;
+		xapm_pmu_select_metric(pmu, counter, XAPM_EVENT(config),
+				       XAPM_SLOT(config));
+	}
+
+	if (!pmu->active_events++)
+		xapm_pmu_enable_hw(pmu, true);
+	hwc->idx = counter;
+
+	hwc->state |= PERF_HES_STOPPED;
+
+	if (flags & PERF_EF_START)
+		xapm_pmu_event_start(event, flags);
+
+	return 0;
+}
+
+static void xapm_pmu_event_stop(struct perf_event *event, int flags)
+{
+	struct hw_perf_event *hwc = &event->hw;
+
+	if (hwc->state & PERF_HES_STOPPED)
+		return;
+
+	xapm_pmu_event_update(event);
+
+	hwc->state |= PERF_HES_STOPPED | PERF_HES_UPTODATE;
+}
+
+static void xapm_pmu_event_del(struct perf_event *event, int flags)
+{
+	struct xapm_pmu *pmu = to_xapm_pmu(event->pmu);
+	struct hw_perf_event *hwc = &event->hw;
+
+	xapm_pmu_event_stop(event, PERF_EF_UPDATE);
+
+	if (xapm_pmu_is_cycles(event))
+		pmu->cycles = NULL;
+	else
+		pmu->events[hwc->idx] = NULL;
+
+	if (!--pmu->active_events)
+		xapm_pmu_enable_hw(pmu, false);
+	hwc->idx = -1;
+}
+
+static void xapm_pmu_init(struct xapm_pmu *pmu, void __iomem *base,
+			  struct device *dev)
+{
+	pmu->pmu = (struct pmu) {
+		.module	     = THIS_MODULE,
+		.capabilities = PERF_PMU_CAP_NO_EXCLUDE,
+		.task_ctx_nr = perf_invalid_context,
+		.attr_groups = attr_groups,
+		.event_init  = xapm_pmu_event_init,
+		.add	     = xapm_pmu_event_add,
+		.del	     = xapm_pmu_event_del,
+		.start	     = xapm_pmu_event_start,
+		.stop	     = xapm_pmu_event_stop,
+		.read	     = xapm_pmu_event_update,
+	};
+	pmu->base = base;
+	pmu->dev = dev;
+}
+
+static irqreturn_t xapm_pmu_irq_handler(int irq, void *p)
+{
+	struct xapm_pmu *pmu = p;
+	struct perf_event *event;
+	u32 status;
+	int i;
+
+	status = readl(pmu->base + XAPM_IS);
+	if (!(status & XAPM_IXR_SIC_OVERFLOW))
+		return IRQ_NONE;
+	writel(status, pmu->base + XAPM_IS);
+
+	for (i = 0; i < pmu->num_counters; i++) {
+		event = pmu->events[i];
+		if (event && !(event->hw.state & PERF_HES_STOPPED))
+			xapm_pmu_event_update(event);
+	}
+
+	event = pmu->cycles;
+	if (event && !(event->hw.state & PERF_HES_STOPPED))
+		xapm_pmu_event_update(event);
+
+	return IRQ_HANDLED;
+}
+
+static int xapm_pmu_offline_cpu(unsigned int cpu, struct hlist_node *node)
+{
+	struct xapm_pmu *pmu = hlist_entry_safe(node, struct xapm_pmu, node);
+	int target;
+
+	if (cpu != pmu->cpu)
+		return 0;
+
+	target = cpumask_any_but(cpu_online_mask, cpu);
+	if (target >= nr_cpu_ids)
+		return 0;
+
+	perf_pmu_migrate_context(&pmu->pmu, cpu, target);
+	pmu->cpu = target;
+
+	WARN_ON(irq_set_affinity_hint(pmu->irq, cpumask_of(pmu->cpu)));
+
+	return 0;
+}
+
+static int xapm_pmu_getprop(struct xapm_pmu *pmu, struct device_node *node)
+{
+	u32 val = 0;
+	int ret;
+
+	/* Profile and trace mode have no metric counters */
+	of_property_read_u32(node, "xlnx,enable-profile", &val);
+	if (val)
+		return -ENODEV;
+	of_property_read_u32(node, "xlnx,enable-trace", &val);
+	if (val)
+		return -ENODEV;
+
+	ret = of_property_read_u32(node, "xlnx,num-monitor-slots",
+				   &pmu->num_slots);
+	if (ret < 0)
+		return ret;
+
+	ret = of_property_read_u32(node, "xlnx,num-of-counters",
+				   &pmu->num_counters);
+	if (ret < 0)
+		return ret;
+
+	pmu->gcc_width = 32;
+	of_property_read_u32(node, "xlnx,global-count-width", &pmu->gcc_width);
+
+	pmu->num_slots = min_t(u32, pmu->num_slots, XAPM_MAX_SLOTS);
+	pmu->num_counters = min_t(u32, pmu->num_counters, XAPM_MAX_COUNTERS);
+
+	return 0;
+}
+
+static int xapm_pmu_probe(struct platform_device *pdev)
+{
+	struct xapm_pmu *pmu;
+	void __iomem *base;
+	char *name;
+	int ret;
+	int irq;
+
+	base = devm_platform_ioremap_resource(pdev, 0);
+	if (IS_ERR(base))
+		return PTR_ERR(base);
+
+	pmu = devm_kzalloc(&pdev->dev, sizeof(*pmu), GFP_KERNEL);
+	if (!pmu)
+		return -ENOMEM;
+
+	xapm_pmu_init(pmu, base, &pdev->dev);
+	platform_set_drvdata(pdev, pmu);
+
+	ret = xapm_pmu_getprop(pmu, pdev->dev.of_node);
+	if (ret) {
+		dev_err(&pdev->dev, "Unsupported or incomplete APM description\n");
+		return ret;
+	}
+
+	pmu->clk = devm_clk_get(&pdev->dev, NULL);
+	if (IS_ERR(pmu->clk)) {
+		if (PTR_ERR(pmu->clk) != -EPROBE_DEFER)
+			dev_err(&pdev->dev, "axi clock error\n");
+		return PTR_ERR(pmu->clk);
+	}
+
+	irq = platform_get_irq(pdev, 0);
+	if (irq < 0)
+		return irq;
+
+	ret = clk_prepare_enable(pmu->clk);
+	if (ret) {
+		dev_err(&pdev->dev, "Unable to enable clock.\n");
+		return ret;
+	}
+
+	xapm_pmu_enable_hw(pmu, false);
+	writel(XAPM_CTL_GCC_RESET, pmu->base + XAPM_CTL);
+	writel(0, pmu->base + XAPM_CTL);
+
+	pmu->id = ida_simple_get(&xapm_ida, 0, 0, GFP_KERNEL);
+	if (pmu->id < 0) {
+		ret = pmu->id;
+		goto err_clk;
+	}
+
+	name = devm_kasprintf(&pdev->dev, GFP_KERNEL, XAPM_PMU_DEV_NAME "%d",
+			      pmu->id);
+	if (!name) {
+		ret = -ENOMEM;
+		goto err_ida;
+	}
+
+	pmu->cpu = raw_smp_processor_id();
+	ret = cpuhp_setup_state_multi(CPUHP_AP_ONLINE_DYN,
+				      XAPM_CPUHP_CB_NAME,
+				      NULL,
+				      xapm_pmu_offline_cpu);
+	if (ret < 0) {
+		dev_err(&pdev->dev, "cpuhp_setup_state_multi failed\n");
+		goto err_ida;
+	}
+
+	pmu->cpuhp_state = ret;
+
+	/* Register the pmu instance for cpu hotplug */
+	cpuhp_state_add_instance_nocalls(pmu->cpuhp_state, &pmu->node);
+
+	ret = devm_request_irq(&pdev->dev, irq, xapm_pmu_irq_handler,
+			       IRQF_NOBALANCING | IRQF_NO_THREAD,
+			       XAPM_CPUHP_CB_NAME, pmu);
+	if (ret < 0) {
+		dev_err(&pdev->dev, "Request irq failed: %d", ret);
+		goto err_cpuhp;
+	}
+
+	pmu->irq = irq;
+	ret = irq_set_affinity_hint(pmu->irq, cpumask_of(pmu->cpu));
+	if (ret) {
+		dev_err(pmu->dev, "Failed to set interrupt affinity!\n");
+		goto err_cpuhp;
+	}
+
+	ret = perf_pmu_register(&pmu->pmu, name, -1);
+	if (ret)
+		goto err_affinity;
+
+	dev_info(&pdev->dev, "%u counters on %u slots\n", pmu->num_counters,
+		 pmu->num_slots);
+
+	return 0;
+
+err_affinity:
+	irq_set_affinity_hint(pmu->irq, NULL);
+err_cpuhp:
+	cpuhp_state_remove_instance_nocalls(pmu->cpuhp_state, &pmu->node);
+err_ida:
+	ida_simple_remove(&xapm_ida, pmu->id);
+err_clk:
+	clk_disable_unprepare(pmu->clk);
+	return ret;
+}
+
+static int xapm_pmu_remove(struct platform_device *pdev)
+{
+	struct xapm_pmu *pmu = platform_get_drvdata(pdev);
+
+	cpuhp_state_remove_instance_nocalls(pmu->cpuhp_state, &pmu->node);
+	irq_set_affinity_hint(pmu->irq, NULL);
+
+	perf_pmu_unregister(&pmu->pmu);
+
+	ida_simple_remove(&xapm_ida, pmu->id);
+	clk_disable_unprepare(pmu->clk);
+
+	return 0;
+}
+
+static const struct of_device_id xapm_pmu_of_match[] = {
+	{ .compatible = "xlnx,axi-perf-monitor", },
+	{ /* end of table */ }
+};
+MODULE_DEVICE_TABLE(of, xapm_pmu_of_match);
+
+static struct platform_driver xapm_pmu_driver = {
+	.driver = {
+		.name = "xilinx-apm-pmu",
+		.of_match_table = xapm_pmu_of_match,
+		.suppress_bind_attrs = true,
+	},
+	.probe = xapm_pmu_probe,
+	.remove = xapm_pmu_remove,
+};
+
+module_platform_driver(xapm_pmu_driver);
+
+MODULE_DESCRIPTION("Xilinx AXI Performance Monitor PMU driver");
+MODULE_LICENSE("GPL v2");
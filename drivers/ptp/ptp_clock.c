@@ -312,6 +312,55 @@ int ptp_clock_unregister(struct ptp_clock *ptp)
 }
 EXPORT_SYMBOL(ptp_clock_unregister);
 
+static int ptp_clock_match_index(struct device *dev, const void *data)
+{
+	struct ptp_clock *ptp = dev_get_drvdata(dev);
+
+	if (!ptp || ptp->index != *(const int *)data)
+		return 0;
+
+	/* Still in the class, so the posix clock has not been released */
+	posix_clock_get(&ptp->clock);
+	return 1;
+}
+
+struct ptp_clock *ptp_clock_get_by_index(int index)
+{
+	struct device *dev;
+	struct ptp_clock *ptp;
+
+	dev = class_find_device(ptp_class, NULL, &index, ptp_clock_match_index);
+	if (!dev)
+		return ERR_PTR(-ENODEV);
+
+	ptp = dev_get_drvdata(dev);
+	put_device(dev);
+
+	return ptp;
+}
+EXPORT_SYMBOL(ptp_clock_get_by_index);
+
+void ptp_clock_put(struct ptp_clock *ptp)
+{
+	posix_clock_put(&ptp->clock);
+}
+EXPORT_SYMBOL(ptp_clock_put);
+
+int ptp_clock_read(struct ptp_clock *ptp, struct timespec64 *ts)
+{
+	int err;
+
+	down_read(&ptp->clock.rwsem);
+	if (ptp->clock.zombie)
+		err = -ENODEV;
+	else
+		err = ptp_clock_gettime(&ptp->clock, ts);
+	up_read(&ptp->clock.rwsem);
+
+	return err;
+}
+EXPORT_SYMBOL(ptp_clock_read);
+
 void ptp_clock_event(struct ptp_clock *ptp, struct ptp_clock_event *event)
 {
 	struct pps_event_time evt;
@@ -445,12 +445,8 @@ void pwm_free(struct pwm_device *pwm)
 }
 EXPORT_SYMBOL_GPL(pwm_free);
 
-/**
- * pwm_apply_state() - atomically apply a new state to a PWM device
- * @pwm: PWM device
- * @state: new state to apply
- */
-int pwm_apply_state(struct pwm_device *pwm, const struct pwm_state *state)
+static int __pwm_apply_state(struct pwm_device *pwm,
+			     const struct pwm_state *state)
 {
 	struct pwm_chip *chip;
 	int err;
@@ -526,8 +522,49 @@ int pwm_apply_state(struct pwm_device *pwm, const struct pwm_state *state)
 
 	return 0;
 }
+
+/**
+ * pwm_apply_state() - atomically apply a new state to a PWM device
+ * @pwm: PWM device
+ * @state: new state to apply
+ *
+ * This function may sleep, depending on the driver. See
+ * pwm_apply_state_atomic() for a variant that can be used in atomic context.
+ */
+int pwm_apply_state(struct pwm_device *pwm, const struct pwm_state *state)
+{
+	return __pwm_apply_state(pwm, state);
+}
 EXPORT_SYMBOL_GPL(pwm_apply_state);
 
+/**
+ * pwm_apply_state_atomic() - apply a new state to a PWM device without
+ *                            sleeping
+ * @pwm: PWM device
+ * @state: new state to apply
+ *
+ * Like pwm_apply_state() but can be called in atomic context (e.g., from an
+ * hrtimer or an interrupt handler). Only chips that set ->atomic support
+ * this. Use pwm_might_sleep() to check up front.
+ *
+ * Returns: 0 on success, -EPERM if the chip may sleep, or another negative
+ * error code.
+ */
+int pwm_apply_state_atomic(struct pwm_device *pwm,
+			   const struct pwm_state *state)
+{
+	if (!pwm)
+		return -EINVAL;
+
+	if (WARN_ONCE(!pwm->chip->atomic,
+		      "%s: sleeping PWM chip used in atomic context\n",
+		      dev_name(pwm->chip->dev)))
+		return -EPERM;
+
+	return __pwm_apply_state(pwm, state);
+}
+EXPORT_SYMBOL_GPL(pwm_apply_state_atomic);
+
 /**
  * pwm_capture() - capture and report a PWM signal
  * @pwm: PWM device
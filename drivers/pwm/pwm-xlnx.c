@@ -14,11 +14,19 @@
 
 #include <linux/clk.h>
 #include <linux/err.h>
+#include <linux/hrtimer.h>
+#include <linux/interrupt.h>
 #include <linux/io.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
 #include <linux/pwm.h>
+#include <linux/pwm_xlnx.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
 
 /* mmio regiser mapping */
 
@@ -30,17 +38,101 @@
 #define PERIOD		TLR0
 #define DUTY		TLR1
 
+#define MDT_BIT		BIT(0)	/* Timer Mode (capture) */
 #define UDT_BIT		BIT(1)	/* Up/Down Count Timer */
 #define GENT_BIT	BIT(2)	/* Enable External Generate Signal Timer */
+#define CAPT_BIT	BIT(3)	/* Enable External Capture Trigger Timer */
+#define ARHT_BIT	BIT(4)	/* Auto Reload/Hold Timer */
+#define LOAD_BIT	BIT(5)	/* Load Timer */
+#define ENIT_BIT	BIT(6)	/* Enable Interrupt for Timer */
 #define ENT_BIT		BIT(7)	/* Enable Timer */
+#define TINT_BIT	BIT(8)	/* Timer Interrupt */
 #define PWMA_BIT	BIT(9)	/* Enable Pulse Width Modulation for Timer */
-#define PWM_CONF	(UDT_BIT | GENT_BIT | ENT_BIT | PWMA_BIT)
+#define ENALL_BIT	BIT(10)	/* Enable All Timers */
+#define PWM_CONF	(UDT_BIT | GENT_BIT | ARHT_BIT | ENT_BIT | PWMA_BIT)
+/* Count up and overwrite the load register on each capture */
+#define CAPTURE_CONF	(MDT_BIT | CAPT_BIT | ARHT_BIT | ENIT_BIT)
+
+/* Weight (as a power of 2) of the running capture estimate */
+#define CAPTURE_EWMA_SHIFT	3
+/* The running estimate reads zero if there was no edge for this long */
+#define CAPTURE_STALE_MS	1000
+
+/*
+ * Capture
+ *
+ * Timer 0 captures the counter on each rising edge of the capture input.
+ * The difference between two captures is the period. If the board wires
+ * the inverted input to the capture trigger of timer 1
+ * ("xlnx,capture-duty"), timer 1 captures the falling edges. Both timers
+ * start together (ENALL) so their counters match. The difference between
+ * a rising and the following falling edge is then the duty cycle.
+ *
+ * Captures are interrupt driven. Thus, capture needs the interrupt of the
+ * timer. The capture input shares the timers with the PWM output. I.e.,
+ * only one of them can be active at a time.
+ */
+struct xlnx_pwm_capture {
+	/* Protects the members below */
+	spinlock_t lock;
+	wait_queue_head_t wait;
+	bool active;
+	bool continuous;
+	u32 rise;
+	u32 fall;
+	bool has_rise;
+	bool has_fall;
+	/* Number of periods measured since the start */
+	unsigned int sample_n;
+	/* The latest measurement (in clock cycles) */
+	u32 period;
+	u32 duty;
+	/* The running estimate (in clock cycles) */
+	u32 period_avg;
+	u32 duty_avg;
+	ktime_t last_time;
+};
+
+/*
+ * Streaming
+ *
+ * Plays a waveform: A sequence of duty cycles, one per 'period' (the
+ * update period, not the PWM period). Write the duty cycles (in ns, as
+ * u32s) to the "stream_data" binary attribute. A write at offset zero
+ * starts a new waveform. Then set "stream_period_ns" and write 1 to
+ * "stream_enable". The PWM output must be enabled (with the PWM period
+ * that the waveform is meant for).
+ *
+ * An hrtimer writes the precomputed duty load register values one by one.
+ * The timers pick up each value at the end of the PWM cycle (see
+ * 'xlnx_pwm_write').
+ */
+#define STREAM_MAX_N		4096
+#define STREAM_MIN_PERIOD_NS	10000
+
+struct xlnx_pwm_stream {
+	/* Protects the members below */
+	spinlock_t lock;
+	struct hrtimer timer;
+	/* In ns. Converted to TLR values (in place) on start. */
+	u32 *data;
+	u32 *tlr;
+	unsigned int data_n;
+	unsigned int index;
+	u64 period_ns;
+	bool loop;
+	bool running;
+};
 
 struct xlnx_pwm_chip {
 	struct pwm_chip chip;
 	struct device *dev;
 	int clk_period;
 	void __iomem *mmio_base;
+	int irq;
+	bool capture_duty;
+	struct xlnx_pwm_capture capture;
+	struct xlnx_pwm_stream stream;
 };
 
 static inline struct xlnx_pwm_chip *to_xlnx_pwm_chip(struct pwm_chip *chip)
@@ -48,10 +140,9 @@ static inline struct xlnx_pwm_chip *to_xlnx_pwm_chip(struct pwm_chip *chip)
 	return container_of(chip, struct xlnx_pwm_chip, chip);
 }
 
-static int xlnx_pwm_config(struct pwm_chip *chip, struct pwm_device *pwm,
-                           int duty_ns, int period_ns)
+static void __xlnx_pwm_ns_to_tlr(struct xlnx_pwm_chip *pc, int duty_ns,
+                                 int period_ns, struct xlnx_pwm_tlr *tlr)
 {
-	struct xlnx_pwm_chip *pc = container_of(chip, struct xlnx_pwm_chip, chip);
 	int tlrx_duty = max(2, duty_ns / pc->clk_period) - 2;
 	int tlrx_period = max(2, period_ns / pc->clk_period) - 2;
 	/* When duty_cycle==period, the output is zero. The output should have
@@ -59,58 +150,621 @@ static int xlnx_pwm_config(struct pwm_chip *chip, struct pwm_device *pwm,
 	 * duty_cycle<=period. In practice, this means that the output will never
 	 * reach full saturation (100% duty cycle) but only close to it (~99.9%
 	 * duty cycle). */
-	tlrx_duty = min(tlrx_period - 1, tlrx_duty);
-	dev_dbg(chip->dev, "duty cycle [ns]: %d\n", duty_ns);
-	dev_dbg(chip->dev, "period     [ns]: %d\n", period_ns);
-	dev_dbg(chip->dev, "clk_period  [1]: %d\n", pc->clk_period);
-	dev_dbg(chip->dev, "tlrx_duty   [1]: %d\n", tlrx_duty);
-	dev_dbg(chip->dev, "tlrx_period [1]: %d\n", tlrx_period);
-	iowrite32(tlrx_duty, pc->mmio_base + DUTY);
-	iowrite32(tlrx_period, pc->mmio_base + PERIOD);
-	return 0;
+	tlrx_duty = max(0, min(tlrx_period - 1, tlrx_duty));
+	tlr->duty = tlrx_duty;
+	tlr->period = tlrx_period;
 }
 
-static int xlnx_pwm_enable(struct pwm_chip *chip, struct pwm_device *pwm)
+static bool xlnx_pwm_is_enabled(struct xlnx_pwm_chip *pc)
 {
-	struct xlnx_pwm_chip *pc = container_of(chip, struct xlnx_pwm_chip, chip);
-	iowrite32(PWM_CONF, pc->mmio_base + TCSR0);
-	iowrite32(PWM_CONF, pc->mmio_base + TCSR1);
-	return 0;
+	unsigned int tcsr0 = ioread32(pc->mmio_base + TCSR0);
+	unsigned int tcsr1 = ioread32(pc->mmio_base + TCSR1);
+	bool timer0_enabled = (PWM_CONF & tcsr0) == PWM_CONF;
+	bool timer1_enabled = (PWM_CONF & tcsr1) == PWM_CONF;
+	return timer0_enabled && timer1_enabled;
 }
 
-static void xlnx_pwm_disable(struct pwm_chip *chip, struct pwm_device *pwm)
+/*
+ * Write the load registers and enable/disable the timers
+ *
+ * With ARHT set, the running counters reload from the load registers at
+ * the end of each cycle. Thus, a new period and duty cycle take effect on
+ * a cycle boundary and never cut a cycle short. The two load registers
+ * can't be written at once. Instead, we order the writes so that
+ * duty < period holds even if a reload happens in between. The cycle in
+ * between (if any) is a valid cycle with the new period and the old duty
+ * cycle (or vice versa).
+ *
+ * When we enable the timers, we first load the counters (LOAD) and then
+ * start both timers at once (ENALL). This way, the first cycle is
+ * complete as well.
+ */
+static void xlnx_pwm_write(struct xlnx_pwm_chip *pc,
+                           const struct xlnx_pwm_tlr *tlr,
+                           bool enabled, bool was_enabled)
+{
+	u32 old_period;
+	if (!enabled) {
+		if (was_enabled) {
+			iowrite32(0, pc->mmio_base + TCSR0);
+			iowrite32(0, pc->mmio_base + TCSR1);
+		}
+		return;
+	}
+	if (NULL != tlr) {
+		old_period = ioread32(pc->mmio_base + PERIOD);
+		if (tlr->period >= old_period) {
+			iowrite32(tlr->period, pc->mmio_base + PERIOD);
+			iowrite32(tlr->duty, pc->mmio_base + DUTY);
+		} else {
+			iowrite32(tlr->duty, pc->mmio_base + DUTY);
+			iowrite32(tlr->period, pc->mmio_base + PERIOD);
+		}
+	}
+	if (was_enabled) {
+		return;
+	}
+	iowrite32(LOAD_BIT, pc->mmio_base + TCSR0);
+	iowrite32(LOAD_BIT, pc->mmio_base + TCSR1);
+	iowrite32(PWM_CONF & ~ENT_BIT, pc->mmio_base + TCSR0);
+	iowrite32(PWM_CONF | ENALL_BIT, pc->mmio_base + TCSR1);
+}
+
+static int xlnx_pwm_apply(struct pwm_chip *chip, struct pwm_device *pwm,
+                          const struct pwm_state *state)
 {
 	struct xlnx_pwm_chip *pc = to_xlnx_pwm_chip(chip);
-	iowrite32(0, pc->mmio_base + TCSR0);
-	iowrite32(0, pc->mmio_base + TCSR1);
+	struct xlnx_pwm_tlr tlr;
+	if (state->enabled && READ_ONCE(pc->capture.active)) {
+		return -EBUSY;
+	}
+	/* The stream owns the duty cycle */
+	if (READ_ONCE(pc->stream.running)) {
+		return -EBUSY;
+	}
+	if (PWM_POLARITY_NORMAL != state->polarity) {
+		return -EINVAL;
+	}
+	if (INT_MAX < state->period) {
+		return -EINVAL;
+	}
+	__xlnx_pwm_ns_to_tlr(pc, state->duty_cycle, state->period, &tlr);
+	dev_dbg(chip->dev, "duty cycle [ns]: %u\n", state->duty_cycle);
+	dev_dbg(chip->dev, "period     [ns]: %u\n", state->period);
+	dev_dbg(chip->dev, "tlrx_duty   [1]: %u\n", tlr.duty);
+	dev_dbg(chip->dev, "tlrx_period [1]: %u\n", tlr.period);
+	xlnx_pwm_write(pc, &tlr, state->enabled, xlnx_pwm_is_enabled(pc));
+	return 0;
 }
 
 static void xlnx_pwm_get_state(struct pwm_chip *chip, struct pwm_device *pwm,
                                struct pwm_state *state)
 {
-	struct xlnx_pwm_chip *pc = container_of(chip, struct xlnx_pwm_chip, chip);
-	unsigned int tcsr0 = ioread32(pc->mmio_base + TCSR0);
-	unsigned int tcsr1 = ioread32(pc->mmio_base + TCSR1);
-	bool timer0_enabled = (PWM_CONF & tcsr0) == PWM_CONF;
-	bool timer1_enabled = (PWM_CONF & tcsr1) == PWM_CONF;
-	state->enabled = timer0_enabled && timer1_enabled;
+	struct xlnx_pwm_chip *pc = to_xlnx_pwm_chip(chip);
+	state->enabled = xlnx_pwm_is_enabled(pc);
+	state->period = (ioread32(pc->mmio_base + PERIOD) + 2) * pc->clk_period;
+	state->duty_cycle = (ioread32(pc->mmio_base + DUTY) + 2) * pc->clk_period;
+	state->polarity = PWM_POLARITY_NORMAL;
+}
+
+static void xlnx_pwm_capture_update(u32 *avg, u32 sample, bool first)
+{
+	if (first) {
+		*avg = sample;
+		return;
+	}
+	*avg += ((s32)(sample - *avg)) >> CAPTURE_EWMA_SHIFT;
+}
+
+static irqreturn_t xlnx_pwm_irq(int irq, void *data)
+{
+	struct xlnx_pwm_chip *pc = data;
+	struct xlnx_pwm_capture *cap = &pc->capture;
+	u32 tcsr0 = ioread32(pc->mmio_base + TCSR0);
+	u32 tcsr1 = ioread32(pc->mmio_base + TCSR1);
+	u32 rise, duty;
+	bool first;
+	if (!(tcsr0 & TINT_BIT) && !(tcsr1 & TINT_BIT)) {
+		return IRQ_NONE;
+	}
+	spin_lock(&cap->lock);
+	/* The falling edge belongs to the previous rising edge. Process it
+	 * first. */
+	if (tcsr1 & TINT_BIT) {
+		cap->fall = ioread32(pc->mmio_base + TLR1);
+		/* Write 1 to clear */
+		iowrite32(tcsr1, pc->mmio_base + TCSR1);
+		cap->has_fall = cap->has_rise && pc->capture_duty;
+	}
+	if (tcsr0 & TINT_BIT) {
+		rise = ioread32(pc->mmio_base + TLR0);
+		iowrite32(tcsr0, pc->mmio_base + TCSR0);
+		if (cap->has_rise) {
+			first = 0 == cap->sample_n;
+			/* Unsigned arithmetic handles the wrap-around */
+			cap->period = rise - cap->rise;
+			xlnx_pwm_capture_update(&cap->period_avg, cap->period, first);
+			duty = cap->fall - cap->rise;
+			if (!cap->has_fall || duty >= cap->period) {
+				duty = 0;
+			}
+			cap->duty = duty;
+			xlnx_pwm_capture_update(&cap->duty_avg, cap->duty, first);
+			++cap->sample_n;
+			cap->last_time = ktime_get();
+			wake_up(&cap->wait);
+		}
+		cap->rise = rise;
+		cap->has_rise = true;
+		cap->has_fall = false;
+	}
+	spin_unlock(&cap->lock);
+	return IRQ_HANDLED;
+}
+
+/* Call with 'cap->lock' held */
+static void xlnx_pwm_capture_start(struct xlnx_pwm_chip *pc)
+{
+	struct xlnx_pwm_capture *cap = &pc->capture;
+	cap->active = true;
+	cap->has_rise = false;
+	cap->has_fall = false;
+	cap->sample_n = 0;
+	cap->period = 0;
+	cap->duty = 0;
+	/* Start both counters from zero at the same time */
+	iowrite32(0, pc->mmio_base + TLR0);
+	iowrite32(0, pc->mmio_base + TLR1);
+	iowrite32(LOAD_BIT, pc->mmio_base + TCSR0);
+	iowrite32(LOAD_BIT, pc->mmio_base + TCSR1);
+	iowrite32(CAPTURE_CONF | TINT_BIT, pc->mmio_base + TCSR0);
+	iowrite32(CAPTURE_CONF | TINT_BIT | ENALL_BIT, pc->mmio_base + TCSR1);
+}
+
+/* Call with 'cap->lock' held */
+static void xlnx_pwm_capture_stop(struct xlnx_pwm_chip *pc)
+{
+	struct xlnx_pwm_capture *cap = &pc->capture;
+	iowrite32(TINT_BIT, pc->mmio_base + TCSR0);
+	iowrite32(TINT_BIT, pc->mmio_base + TCSR1);
+	cap->active = false;
+	cap->continuous = false;
 }
 
-static int xlnx_pwm_set_polarity(struct pwm_chip *chip, struct pwm_device *pwm,
-                                 enum pwm_polarity polarity)
+static unsigned int xlnx_pwm_capture_samples(struct xlnx_pwm_capture *cap)
 {
-	return -ENOTSUPP;
+	unsigned long flags;
+	unsigned int sample_n;
+	spin_lock_irqsave(&cap->lock, flags);
+	sample_n = cap->sample_n;
+	spin_unlock_irqrestore(&cap->lock, flags);
+	return sample_n;
+}
+
+/*
+ * Measure a single period (and duty cycle). In continuous mode, waits for
+ * the next measurement. Otherwise, starts the capture and stops it again
+ * afterwards. 'timeout' is in ms.
+ */
+static int xlnx_pwm_capture(struct pwm_chip *chip, struct pwm_device *pwm,
+                            struct pwm_capture *result, unsigned long timeout)
+{
+	struct xlnx_pwm_chip *pc = to_xlnx_pwm_chip(chip);
+	struct xlnx_pwm_capture *cap = &pc->capture;
+	unsigned long flags;
+	unsigned int target_n;
+	long left;
+	int ret = 0;
+	if (0 >= pc->irq) {
+		return -EOPNOTSUPP;
+	}
+	spin_lock_irqsave(&cap->lock, flags);
+	if (!cap->active) {
+		if (xlnx_pwm_is_enabled(pc)) {
+			spin_unlock_irqrestore(&cap->lock, flags);
+			return -EBUSY;
+		}
+		xlnx_pwm_capture_start(pc);
+	}
+	/* Skip the measurement in progress. It may have started before the
+	 * capture did. */
+	target_n = cap->sample_n + 2;
+	spin_unlock_irqrestore(&cap->lock, flags);
+	left = wait_event_interruptible_timeout(cap->wait,
+		(int)(xlnx_pwm_capture_samples(cap) - target_n) >= 0,
+		msecs_to_jiffies(timeout));
+	spin_lock_irqsave(&cap->lock, flags);
+	if (0 > left) {
+		ret = left;
+	} else if (0 == left) {
+		ret = -ETIMEDOUT;
+	} else {
+		result->period = cap->period * pc->clk_period;
+		result->duty_cycle = cap->duty * pc->clk_period;
+	}
+	if (!cap->continuous) {
+		xlnx_pwm_capture_stop(pc);
+	}
+	spin_unlock_irqrestore(&cap->lock, flags);
+	return ret;
 }
 
 static const struct pwm_ops xlnx_pwm_ops = {
-	.config = xlnx_pwm_config,
-	.enable = xlnx_pwm_enable,
-	.disable = xlnx_pwm_disable,
+	.capture = xlnx_pwm_capture,
+	.apply = xlnx_pwm_apply,
 	.get_state = xlnx_pwm_get_state,
-	.set_polarity = xlnx_pwm_set_polarity,
 	.owner = THIS_MODULE,
 };
 
+bool xlnx_pwm_is_xlnx(struct pwm_device *pwm)
+{
+	return &xlnx_pwm_ops == pwm->chip->ops;
+}
+EXPORT_SYMBOL_GPL(xlnx_pwm_is_xlnx);
+
+void xlnx_pwm_ns_to_tlr(struct pwm_device *pwm, unsigned int duty_ns,
+                        unsigned int period_ns, struct xlnx_pwm_tlr *tlr)
+{
+	struct xlnx_pwm_chip *pc = to_xlnx_pwm_chip(pwm->chip);
+	__xlnx_pwm_ns_to_tlr(pc, duty_ns, period_ns, tlr);
+}
+EXPORT_SYMBOL_GPL(xlnx_pwm_ns_to_tlr);
+
+/* The actual period (the inverse of 'xlnx_pwm_ns_to_tlr') */
+unsigned int xlnx_pwm_tlr_to_period_ns(struct pwm_device *pwm,
+                                       const struct xlnx_pwm_tlr *tlr)
+{
+	struct xlnx_pwm_chip *pc = to_xlnx_pwm_chip(pwm->chip);
+	return (tlr->period + 2) * pc->clk_period;
+}
+EXPORT_SYMBOL_GPL(xlnx_pwm_tlr_to_period_ns);
+
+/*
+ * Write 'tlr' (unless NULL) and enable/disable the timers. Doesn't sleep.
+ * Same cycle-boundary semantics as 'xlnx_pwm_apply'.
+ *
+ * Keeps 'pwm->state' up to date so that the PWM core (and a later
+ * 'pwm_apply_state') sees the actual state.
+ */
+void xlnx_pwm_write_tlr(struct pwm_device *pwm, const struct xlnx_pwm_tlr *tlr,
+                        bool enabled)
+{
+	struct xlnx_pwm_chip *pc = to_xlnx_pwm_chip(pwm->chip);
+	xlnx_pwm_write(pc, tlr, enabled, pwm->state.enabled);
+	if (NULL != tlr) {
+		pwm->state.period = (tlr->period + 2) * pc->clk_period;
+		pwm->state.duty_cycle = (tlr->duty + 2) * pc->clk_period;
+	}
+	pwm->state.enabled = enabled;
+}
+EXPORT_SYMBOL_GPL(xlnx_pwm_write_tlr);
+
+/* capture_continuous
+ *
+ * Keep the capture running and maintain a running estimate of the period
+ * and duty cycle. Needs the interrupt. */
+static ssize_t capture_continuous_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(pc->capture.continuous));
+}
+static ssize_t capture_continuous_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	struct xlnx_pwm_capture *cap = &pc->capture;
+	unsigned long flags;
+	bool continuous;
+	int ret = kstrtobool(buf, &continuous);
+	if (ret) {
+		return ret;
+	}
+	if (0 >= pc->irq) {
+		return -EOPNOTSUPP;
+	}
+	spin_lock_irqsave(&cap->lock, flags);
+	if (continuous && !cap->active) {
+		if (xlnx_pwm_is_enabled(pc)) {
+			ret = -EBUSY;
+			goto out_unlock;
+		}
+		xlnx_pwm_capture_start(pc);
+	} else if (!continuous && cap->active) {
+		xlnx_pwm_capture_stop(pc);
+	}
+	cap->continuous = continuous;
+out_unlock:
+	spin_unlock_irqrestore(&cap->lock, flags);
+	return ret ? ret : count;
+}
+static DEVICE_ATTR(capture_continuous, S_IRUGO | S_IWUSR,
+                   capture_continuous_show, capture_continuous_store);
+
+/* Reads the running estimate. Zero if stale. */
+static void xlnx_pwm_capture_estimate(struct xlnx_pwm_chip *pc, u32 *period_ns,
+                                      u32 *duty_ns)
+{
+	struct xlnx_pwm_capture *cap = &pc->capture;
+	unsigned long flags;
+	bool fresh;
+	spin_lock_irqsave(&cap->lock, flags);
+	fresh = cap->active && 0 != cap->sample_n &&
+	        ktime_ms_delta(ktime_get(), cap->last_time) < CAPTURE_STALE_MS;
+	*period_ns = fresh ? cap->period_avg * pc->clk_period : 0;
+	*duty_ns = fresh ? cap->duty_avg * pc->clk_period : 0;
+	spin_unlock_irqrestore(&cap->lock, flags);
+}
+
+/* capture_period_ns
+ *
+ * The running estimate of the period. Zero if there is no signal. */
+static ssize_t capture_period_ns_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	u32 period_ns, duty_ns;
+	xlnx_pwm_capture_estimate(pc, &period_ns, &duty_ns);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", period_ns);
+}
+static DEVICE_ATTR(capture_period_ns, S_IRUGO, capture_period_ns_show, NULL);
+
+/* capture_duty_ns
+ *
+ * The running estimate of the duty cycle. Zero if there is no signal (or
+ * no "xlnx,capture-duty"). */
+static ssize_t capture_duty_ns_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	u32 period_ns, duty_ns;
+	xlnx_pwm_capture_estimate(pc, &period_ns, &duty_ns);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", duty_ns);
+}
+static DEVICE_ATTR(capture_duty_ns, S_IRUGO, capture_duty_ns_show, NULL);
+
+static struct attribute *xlnx_pwm_capture_attrs[] = {
+	&dev_attr_capture_continuous.attr,
+	&dev_attr_capture_period_ns.attr,
+	&dev_attr_capture_duty_ns.attr,
+	NULL,
+};
+
+static const struct attribute_group xlnx_pwm_capture_group = {
+	.attrs = xlnx_pwm_capture_attrs,
+};
+
+static enum hrtimer_restart xlnx_pwm_stream_tick(struct hrtimer *timer)
+{
+	struct xlnx_pwm_chip *pc = container_of(timer, struct xlnx_pwm_chip,
+	                                        stream.timer);
+	struct xlnx_pwm_stream *st = &pc->stream;
+	enum hrtimer_restart restart = HRTIMER_RESTART;
+	spin_lock(&st->lock);
+	if (!st->running) {
+		restart = HRTIMER_NORESTART;
+		goto out_unlock;
+	}
+	iowrite32(st->tlr[st->index++], pc->mmio_base + DUTY);
+	if (st->data_n == st->index) {
+		if (!st->loop) {
+			st->running = false;
+			restart = HRTIMER_NORESTART;
+			goto out_unlock;
+		}
+		st->index = 0;
+	}
+	hrtimer_forward_now(timer, ns_to_ktime(st->period_ns));
+out_unlock:
+	spin_unlock(&st->lock);
+	return restart;
+}
+
+/* Convert the waveform to TLR values and start the timer */
+static int xlnx_pwm_stream_start(struct xlnx_pwm_chip *pc)
+{
+	struct xlnx_pwm_stream *st = &pc->stream;
+	struct pwm_device *pwm = &pc->chip.pwms[0];
+	struct xlnx_pwm_tlr tlr;
+	unsigned long flags;
+	unsigned int i;
+	int ret = 0;
+	spin_lock_irqsave(&st->lock, flags);
+	if (st->running) {
+		goto out_unlock;
+	}
+	if (0 == st->data_n || 0 == st->period_ns) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+	if (!xlnx_pwm_is_enabled(pc)) {
+		ret = -EINVAL;
+		goto out_unlock;
+	}
+	for (i = 0; st->data_n != i; ++i) {
+		__xlnx_pwm_ns_to_tlr(pc, st->data[i], pwm->state.period, &tlr);
+		st->tlr[i] = tlr.duty;
+	}
+	st->index = 0;
+	st->running = true;
+	hrtimer_start(&st->timer, 0, HRTIMER_MODE_REL);
+out_unlock:
+	spin_unlock_irqrestore(&st->lock, flags);
+	return ret;
+}
+
+static void xlnx_pwm_stream_stop(struct xlnx_pwm_chip *pc)
+{
+	struct xlnx_pwm_stream *st = &pc->stream;
+	unsigned long flags;
+	spin_lock_irqsave(&st->lock, flags);
+	st->running = false;
+	spin_unlock_irqrestore(&st->lock, flags);
+	hrtimer_cancel(&st->timer);
+}
+
+static void xlnx_pwm_stream_release(void *data)
+{
+	xlnx_pwm_stream_stop(data);
+}
+
+static ssize_t stream_data_write(struct file *filp, struct kobject *kobj,
+                                 struct bin_attribute *attr, char *buf,
+                                 loff_t off, size_t count)
+{
+	struct device *dev = kobj_to_dev(kobj);
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	struct xlnx_pwm_stream *st = &pc->stream;
+	unsigned long flags;
+	ssize_t ret = count;
+	if (!IS_ALIGNED(off, sizeof(u32)) || !IS_ALIGNED(count, sizeof(u32))) {
+		return -EINVAL;
+	}
+	spin_lock_irqsave(&st->lock, flags);
+	if (st->running) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+	memcpy((u8 *)st->data + off, buf, count);
+	if (0 == off) {
+		st->data_n = 0;
+	}
+	st->data_n = max_t(unsigned int, st->data_n, (off + count) / sizeof(u32));
+out_unlock:
+	spin_unlock_irqrestore(&st->lock, flags);
+	return ret;
+}
+static BIN_ATTR_WO(stream_data, STREAM_MAX_N * sizeof(u32));
+
+/* stream_period_ns
+ *
+ * The time between two duty cycles of the waveform. */
+static ssize_t stream_period_ns_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	return scnprintf(buf, PAGE_SIZE, "%llu\n", READ_ONCE(pc->stream.period_ns));
+}
+static ssize_t stream_period_ns_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	struct xlnx_pwm_stream *st = &pc->stream;
+	unsigned long flags;
+	u64 period_ns;
+	int ret = kstrtou64(buf, 0, &period_ns);
+	if (ret) {
+		return ret;
+	}
+	if (STREAM_MIN_PERIOD_NS > period_ns) {
+		return -EINVAL;
+	}
+	spin_lock_irqsave(&st->lock, flags);
+	/* Takes effect on the next update */
+	st->period_ns = period_ns;
+	spin_unlock_irqrestore(&st->lock, flags);
+	return count;
+}
+static DEVICE_ATTR(stream_period_ns, S_IRUGO | S_IWUSR,
+                   stream_period_ns_show, stream_period_ns_store);
+
+/* stream_loop
+ *
+ * Start over after the last duty cycle (instead of stopping). */
+static ssize_t stream_loop_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(pc->stream.loop));
+}
+static ssize_t stream_loop_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	struct xlnx_pwm_stream *st = &pc->stream;
+	unsigned long flags;
+	bool loop;
+	int ret = kstrtobool(buf, &loop);
+	if (ret) {
+		return ret;
+	}
+	spin_lock_irqsave(&st->lock, flags);
+	st->loop = loop;
+	spin_unlock_irqrestore(&st->lock, flags);
+	return count;
+}
+static DEVICE_ATTR(stream_loop, S_IRUGO | S_IWUSR, stream_loop_show,
+                   stream_loop_store);
+
+/* stream_enable
+ *
+ * Write 1 to play the waveform. Reads 0 once it is done. */
+static ssize_t stream_enable_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(pc->stream.running));
+}
+static ssize_t stream_enable_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct xlnx_pwm_chip *pc = dev_get_drvdata(dev);
+	bool enable;
+	int ret = kstrtobool(buf, &enable);
+	if (ret) {
+		return ret;
+	}
+	if (enable) {
+		ret = xlnx_pwm_stream_start(pc);
+	} else {
+		xlnx_pwm_stream_stop(pc);
+	}
+	return ret ? ret : count;
+}
+static DEVICE_ATTR(stream_enable, S_IRUGO | S_IWUSR, stream_enable_show,
+                   stream_enable_store);
+
+static struct attribute *xlnx_pwm_stream_attrs[] = {
+	&dev_attr_stream_period_ns.attr,
+	&dev_attr_stream_loop.attr,
+	&dev_attr_stream_enable.attr,
+	NULL,
+};
+
+static struct bin_attribute *xlnx_pwm_stream_bin_attrs[] = {
+	&bin_attr_stream_data,
+	NULL,
+};
+
+static const struct attribute_group xlnx_pwm_stream_group = {
+	.attrs = xlnx_pwm_stream_attrs,
+	.bin_attrs = xlnx_pwm_stream_bin_attrs,
+};
+
 static int xlnx_pwm_probe(struct platform_device *pdev)
 {
 	int ret;
@@ -144,10 +798,54 @@ static int xlnx_pwm_probe(struct platform_device *pdev)
 	start = r->start;
 	end = r->end;
 
+	platform_set_drvdata(pdev, pwm);
+
+	/* capture (optional) */
+	spin_lock_init(&pwm->capture.lock);
+	init_waitqueue_head(&pwm->capture.wait);
+	pwm->capture_duty = of_property_read_bool(pdev->dev.of_node,
+	                                          "xlnx,capture-duty");
+	pwm->irq = platform_get_irq_optional(pdev, 0);
+	if (-EPROBE_DEFER == pwm->irq) {
+		return pwm->irq;
+	}
+	if (0 < pwm->irq) {
+		ret = devm_request_irq(&pdev->dev, pwm->irq, xlnx_pwm_irq, 0,
+		                       dev_name(&pdev->dev), pwm);
+		if (ret < 0) {
+			dev_err(&pdev->dev, "could not request irq: %d\n", ret);
+			return ret;
+		}
+		ret = devm_device_add_group(&pdev->dev, &xlnx_pwm_capture_group);
+		if (ret < 0) {
+			dev_err(&pdev->dev, "could not add sysfs group: %d\n", ret);
+			return ret;
+		}
+	}
+
+	/* streaming */
+	spin_lock_init(&pwm->stream.lock);
+	hrtimer_init(&pwm->stream.timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	pwm->stream.timer.function = xlnx_pwm_stream_tick;
+	pwm->stream.data = devm_kcalloc(&pdev->dev, STREAM_MAX_N, sizeof(u32),
+	                                GFP_KERNEL);
+	pwm->stream.tlr = devm_kcalloc(&pdev->dev, STREAM_MAX_N, sizeof(u32),
+	                               GFP_KERNEL);
+	if (!pwm->stream.data || !pwm->stream.tlr) {
+		return -ENOMEM;
+	}
+	/* Runs after the removal of the sysfs group (added below) */
+	ret = devm_add_action_or_reset(&pdev->dev, xlnx_pwm_stream_release, pwm);
+	if (ret < 0) {
+		return ret;
+	}
+
 	pwm->chip.dev = &pdev->dev;
 	pwm->chip.ops = &xlnx_pwm_ops;
 	pwm->chip.base = (int)&pdev->id;
 	pwm->chip.npwm = 1;
+	/* Only MMIO in 'xlnx_pwm_apply' */
+	pwm->chip.atomic = true;
 
 	ret = pwmchip_add(&pwm->chip);
 	if (ret < 0) {
@@ -155,7 +853,12 @@ static int xlnx_pwm_probe(struct platform_device *pdev)
 		return -1;
 	}
 
-	platform_set_drvdata(pdev, pwm);
+	ret = devm_device_add_group(&pdev->dev, &xlnx_pwm_stream_group);
+	if (ret < 0) {
+		dev_err(&pdev->dev, "could not add sysfs group: %d\n", ret);
+		pwmchip_remove(&pwm->chip);
+		return ret;
+	}
 
 	return 0;
 }
@@ -163,8 +866,13 @@ static int xlnx_pwm_probe(struct platform_device *pdev)
 static int xlnx_pwm_remove(struct platform_device *pdev)
 {
 	struct xlnx_pwm_chip *pc = platform_get_drvdata(pdev);
+	unsigned long flags;
 	if (WARN_ON(!pc))
 		return -ENODEV;
+	spin_lock_irqsave(&pc->capture.lock, flags);
+	if (pc->capture.active)
+		xlnx_pwm_capture_stop(pc);
+	spin_unlock_irqrestore(&pc->capture.lock, flags);
 	return pwmchip_remove(&pc->chip);
 }
 
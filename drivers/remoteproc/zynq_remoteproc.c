@@ -27,6 +27,10 @@
 #include <linux/slab.h>
 #include <linux/cpu.h>
 #include <linux/genalloc.h>
+#include <linux/hrtimer.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <uapi/linux/sched/types.h>
 #include <../../arch/arm/mach-zynq/common.h>
 
 #include "remoteproc_internal.h"
@@ -35,6 +39,8 @@
 #define NOTIFYID_ANY (-1)
 /* Maximum on chip memories used by the driver*/
 #define MAX_ON_CHIP_MEMS        32
+/* Passes over the vrings per firmware kick */
+#define VRING_BUDGET		8
 
 /* Structure for storing IRQs */
 struct irq_list {
@@ -65,40 +71,67 @@ struct zynq_mem_res {
  * @rproc: pointer to remoteproc instance
  * @ipis: interrupt processor interrupts statistics
  * @fw_mems: list of firmware memories
+ * @worker: real-time worker that processes the vrings on a firmware kick
+ * @work: the vring processing work
+ * @kick_timer: delays and batches the kicks to the firmware
+ * @kick_lock: protects the pending flags of @ipis
  */
 struct zynq_rproc_pdata {
 	struct irq_list irqs;
 	struct rproc *rproc;
 	struct ipi_info ipis[MAX_NUM_VRINGS];
 	struct list_head fw_mems;
+	struct kthread_worker *worker;
+	struct kthread_work work;
+	struct hrtimer kick_timer;
+	spinlock_t kick_lock;
 };
 
 static bool autoboot __read_mostly;
+static unsigned int kick_delay_us;
 
 /* Store rproc for IPI handler */
 static struct rproc *rproc;
-static struct work_struct workqueue;
 
-static void handle_event(struct work_struct *work)
+/*
+ * Process both vrings until they are empty (or the budget runs out).
+ * Messages that the firmware adds while we run are picked up without
+ * another IPI.
+ */
+static void handle_event(struct kthread_work *work)
 {
 	struct zynq_rproc_pdata *local = rproc->priv;
+	irqreturn_t ret;
+	int budget, i;
+
+	for (budget = 0; budget < VRING_BUDGET; budget++) {
+		ret = IRQ_NONE;
+		for (i = 0; i < MAX_NUM_VRINGS; i++)
+			ret |= rproc_vq_interrupt(local->rproc,
+						  local->ipis[i].notifyid);
+		if (ret == IRQ_NONE)
+			break;
+	}
 
-	if (rproc_vq_interrupt(local->rproc, local->ipis[0].notifyid) ==
-				IRQ_NONE)
-		dev_dbg(rproc->dev.parent, "no message found in vqid 0\n");
+	if (!budget)
+		dev_dbg(rproc->dev.parent, "no message found in vrings\n");
 }
 
 static void ipi_kick(void)
 {
+	struct zynq_rproc_pdata *local = rproc->priv;
+
 	dev_dbg(rproc->dev.parent, "KICK Linux because of pending message\n");
-	schedule_work(&workqueue);
+	kthread_queue_work(local->worker, &local->work);
 }
 
 static void kick_pending_ipi(struct rproc *rproc)
 {
 	struct zynq_rproc_pdata *local = rproc->priv;
+	unsigned long flags;
 	int i;
 
+	spin_lock_irqsave(&local->kick_lock, flags);
 	for (i = 0; i < MAX_NUM_VRINGS; i++) {
 		/* Send swirq to firmware */
 		if (local->ipis[i].pending) {
@@ -107,6 +140,18 @@ static void kick_pending_ipi(struct rproc *rproc)
 			local->ipis[i].pending = false;
 		}
 	}
+	spin_unlock_irqrestore(&local->kick_lock, flags);
+}
+
+/* One IPI for all the messages queued within kick_delay_us */
+static enum hrtimer_restart zynq_rproc_kick_timer(struct hrtimer *timer)
+{
+	struct zynq_rproc_pdata *local = container_of(timer,
+						      struct zynq_rproc_pdata,
+						      kick_timer);
+
+	kick_pending_ipi(local->rproc);
+	return HRTIMER_NORESTART;
 }
 
 static int zynq_rproc_start(struct rproc *rproc)
@@ -115,7 +160,6 @@ static int zynq_rproc_start(struct rproc *rproc)
 	int ret;
 
 	dev_dbg(dev, "%s\n", __func__);
-	INIT_WORK(&workqueue, handle_event);
 
 	ret = cpu_down(1);
 	/* EBUSY means CPU is already released */
@@ -137,28 +181,38 @@ static void zynq_rproc_kick(struct rproc *rproc, int vqid)
 	struct device *dev = rproc->dev.parent;
 	struct zynq_rproc_pdata *local = rproc->priv;
 	struct rproc_vdev *rvdev, *rvtmp;
+	unsigned long flags;
+	bool kick = false;
 	int i;
 
 	dev_dbg(dev, "KICK Firmware to start send messages vqid %d\n", vqid);
 
+	spin_lock_irqsave(&local->kick_lock, flags);
 	list_for_each_entry_safe(rvdev, rvtmp, &rproc->rvdevs, node) {
 		for (i = 0; i < MAX_NUM_VRINGS; i++) {
 			struct rproc_vring *rvring = &rvdev->vring[i];
 
-			/* Send swirq to firmware */
 			if (rvring->notifyid == vqid) {
 				local->ipis[i].notifyid = vqid;
 				/* As we do not turn off CPU1 until start,
 				 * we delay firmware kick
 				 */
-				if (rproc->state == RPROC_RUNNING)
-					gic_raise_softirq(cpumask_of(1),
-							  local->ipis[i].irq);
-				else
-					local->ipis[i].pending = true;
+				local->ipis[i].pending = true;
+				kick = true;
 			}
 		}
 	}
+	spin_unlock_irqrestore(&local->kick_lock, flags);
+
+	if (!kick || rproc->state != RPROC_RUNNING)
+		return;
+
+	/* Send swirq to firmware, now or with the next batch */
+	if (!kick_delay_us)
+		kick_pending_ipi(rproc);
+	else if (!hrtimer_is_queued(&local->kick_timer))
+		hrtimer_start(&local->kick_timer, us_to_ktime(kick_delay_us),
+			      HRTIMER_MODE_REL);
 }
 
 /* power off the remote processor */
@@ -166,9 +220,13 @@ static int zynq_rproc_stop(struct rproc *rproc)
 {
 	int ret;
 	struct device *dev = rproc->dev.parent;
+	struct zynq_rproc_pdata *local = rproc->priv;
 
 	dev_dbg(rproc->dev.parent, "%s\n", __func__);
 
+	hrtimer_cancel(&local->kick_timer);
+	kthread_flush_worker(local->worker);
+
 	/* Cpu can't be power on - for example in nosmp mode */
 	ret = cpu_up(1);
 	if (ret)
@@ -311,6 +369,7 @@ static int zynq_remoteproc_probe(struct platform_device *pdev)
 	struct irq_list *tmp;
 	int count = 0;
 	struct zynq_rproc_pdata *local;
+	struct sched_param param = { .sched_priority = MAX_RT_PRIO / 2 };
 
 	rproc = rproc_alloc(&pdev->dev, dev_name(&pdev->dev),
 			    &zynq_rproc_ops, NULL,
@@ -334,6 +393,24 @@ static int zynq_remoteproc_probe(struct platform_device *pdev)
 	/* Init list for IRQs - it can be long list */
 	INIT_LIST_HEAD(&local->irqs.list);
 
+	spin_lock_init(&local->kick_lock);
+	hrtimer_init(&local->kick_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	local->kick_timer.function = zynq_rproc_kick_timer;
+
+	/*
+	 * The vrings are processed on a dedicated real-time worker instead of
+	 * a system workqueue, so that a kick does not wait behind unrelated
+	 * work.
+	 */
+	kthread_init_work(&local->work, handle_event);
+	local->worker = kthread_create_worker(0, "%s", dev_name(&pdev->dev));
+	if (IS_ERR(local->worker)) {
+		ret = PTR_ERR(local->worker);
+		dev_err(&pdev->dev, "unable to create worker: %d\n", ret);
+		goto dma_mask_fault;
+	}
+	sched_setscheduler(local->worker->task, SCHED_FIFO, &param);
+
 	/* Alloc IRQ based on DTS to be sure that no other driver will use it */
 	while (1) {
 		int irq;
@@ -381,6 +458,7 @@ static int zynq_remoteproc_probe(struct platform_device *pdev)
 		dev_err(&pdev->dev, "unable to read property");
 		goto irq_fault;
 	}
+	local->ipis[0].notifyid = 0;
 
 	ret = set_ipi_handler(local->ipis[0].irq, ipi_kick,
 			      "Firmware kick");
@@ -396,6 +474,7 @@ static int zynq_remoteproc_probe(struct platform_device *pdev)
 		dev_err(&pdev->dev, "unable to read property");
 		goto ipi_fault;
 	}
+	local->ipis[1].notifyid = 1;
 
 	rproc->auto_boot = autoboot;
 
@@ -412,6 +491,7 @@ static int zynq_remoteproc_probe(struct platform_device *pdev)
 
 irq_fault:
 	clear_irq(rproc);
+	kthread_destroy_worker(local->worker);
 
 dma_mask_fault:
 	rproc_free(rproc);
@@ -430,6 +510,8 @@ static int zynq_remoteproc_remove(struct platform_device *pdev)
 
 	clear_ipi_handler(local->ipis[0].irq);
 	clear_irq(rproc);
+	hrtimer_cancel(&local->kick_timer);
+	kthread_destroy_worker(local->worker);
 
 	of_reserved_mem_device_release(&pdev->dev);
 	rproc_free(rproc);
@@ -457,6 +539,9 @@ module_platform_driver(zynq_remoteproc_driver);
 module_param_named(autoboot,  autoboot, bool, 0444);
 MODULE_PARM_DESC(autoboot,
 		 "enable | disable autoboot. (default: false)");
+module_param(kick_delay_us, uint, 0644);
+MODULE_PARM_DESC(kick_delay_us,
+		 "batch firmware kicks within this many us (default: 0, off)");
 
 MODULE_AUTHOR("Michal Simek <monstr@monstr.eu");
 MODULE_LICENSE("GPL v2");
@@ -35,6 +35,7 @@
 #include <asm/cacheflush.h>
 #include <linux/sched.h>
 #include <linux/dma-buf.h>
+#include <linux/eventfd.h>
 
 #include <linux/of.h>
 #include <linux/irq.h>
@@ -225,6 +226,9 @@ static void xilinx_chan_desc_cleanup(struct xdma_chan *chan)
 				cmp->done = 1;
 			else
 				complete(cmp);
+
+			if (dmahead->trigger)
+				eventfd_signal(dmahead->trigger, 1);
 		}
 		xdma_clean_bd(desc);
 		chan->bd_used--;
@@ -765,6 +769,96 @@ static void xdma_release(struct device *dev)
 {
 }
 
+/*
+ * maps a physically contiguous buffer, or pins and maps user pages, and
+ * builds the merged sg list the BDs are set up from
+ */
+static int xdma_map_user_buf(struct xdma_chan *chan,
+			     xlnk_intptr_type userbuf,
+			     unsigned int size,
+			     unsigned int user_flags,
+			     unsigned long attrs,
+			     struct scatterlist **sglistp,
+			     unsigned int *sgcntp,
+			     struct scatterlist **pagelistp,
+			     unsigned int *pagecntp)
+{
+	struct scatterlist *pagelist = NULL;
+	struct scatterlist *sglist = NULL;
+	unsigned int pagecnt = 0;
+	unsigned int sgcnt = 0;
+	enum dma_data_direction dmadir = chan->direction;
+	int status;
+
+	if (user_flags & CF_FLAG_PHYSICALLY_CONTIGUOUS) {
+		size_t elem_cnt;
+
+		elem_cnt = DIV_ROUND_UP(size, XDMA_MAX_TRANS_LEN);
+		sglist = kmalloc_array(elem_cnt, sizeof(*sglist), GFP_KERNEL);
+		if (!sglist)
+			return -ENOMEM;
+		sgcnt = phy_buf_to_sgl(userbuf, size, sglist);
+		if (!sgcnt) {
+			kfree(sglist);
+			return -ENOMEM;
+		}
+
+		status = get_dma_ops(chan->dev)->map_sg(chan->dev,
+							sglist,
+							sgcnt,
+							dmadir,
+							attrs);
+
+		if (!status) {
+			pr_err("sg contiguous mapping failed\n");
+			kfree(sglist);
+			return -ENOMEM;
+		}
+	} else {
+		status = pin_user_pages(userbuf,
+					size,
+					dmadir != DMA_TO_DEVICE,
+					&pagelist,
+					&pagecnt,
+					user_flags);
+		if (status < 0) {
+			pr_err("pin_user_pages failed\n");
+			return status;
+		}
+
+		status = get_dma_ops(chan->dev)->map_sg(chan->dev,
+							pagelist,
+							pagecnt,
+							dmadir,
+							attrs);
+		if (!status) {
+			pr_err("dma_map_sg failed\n");
+			unpin_user_pages(pagelist, pagecnt);
+			return -ENOMEM;
+		}
+
+		sglist = kmalloc_array(pagecnt, sizeof(*sglist), GFP_KERNEL);
+		if (sglist)
+			sgcnt = sgl_merge(pagelist, pagecnt, sglist);
+		if (!sgcnt) {
+			get_dma_ops(chan->dev)->unmap_sg(chan->dev,
+							 pagelist,
+							 pagecnt,
+							 dmadir,
+							 attrs);
+			unpin_user_pages(pagelist, pagecnt);
+			kfree(sglist);
+			return -ENOMEM;
+		}
+	}
+
+	*sglistp = sglist;
+	*sgcntp = sgcnt;
+	*pagelistp = pagelist;
+	*pagecntp = pagecnt;
+	return 0;
+}
+
 int xdma_submit(struct xdma_chan *chan,
 		xlnk_intptr_type userbuf,
 		void *kaddr,
@@ -846,63 +940,12 @@ int xdma_submit(struct xdma_chan *chan,
 		dmahead->userbuf = (xlnk_intptr_type)sglist->dma_address;
 		pagelist = NULL;
 		pagecnt = 0;
-	} else if (user_flags & CF_FLAG_PHYSICALLY_CONTIGUOUS) {
-		size_t elem_cnt;
-
-		elem_cnt = DIV_ROUND_UP(size, XDMA_MAX_TRANS_LEN);
-		sglist = kmalloc_array(elem_cnt, sizeof(*sglist), GFP_KERNEL);
-		sgcnt = phy_buf_to_sgl(userbuf, size, sglist);
-		if (!sgcnt)
-			return -ENOMEM;
-
-		status = get_dma_ops(chan->dev)->map_sg(chan->dev,
-							sglist,
-							sgcnt,
-							dmadir,
-							attrs);
-
-		if (!status) {
-			pr_err("sg contiguous mapping failed\n");
-			return -ENOMEM;
-		}
-		pagelist = NULL;
-		pagecnt = 0;
 	} else {
-		status = pin_user_pages(userbuf,
-					size,
-					dmadir != DMA_TO_DEVICE,
-					&pagelist,
-					&pagecnt,
-					user_flags);
-		if (status < 0) {
-			pr_err("pin_user_pages failed\n");
+		status = xdma_map_user_buf(chan, userbuf, size, user_flags,
+					   attrs, &sglist, &sgcnt,
+					   &pagelist, &pagecnt);
+		if (status)
 			return status;
-		}
-
-		status = get_dma_ops(chan->dev)->map_sg(chan->dev,
-							pagelist,
-							pagecnt,
-							dmadir,
-							attrs);
-		if (!status) {
-			pr_err("dma_map_sg failed\n");
-			unpin_user_pages(pagelist, pagecnt);
-			return -ENOMEM;
-		}
-
-		sglist = kmalloc_array(pagecnt, sizeof(*sglist), GFP_KERNEL);
-		if (sglist)
-			sgcnt = sgl_merge(pagelist, pagecnt, sglist);
-		if (!sgcnt) {
-			get_dma_ops(chan->dev)->unmap_sg(chan->dev,
-							 pagelist,
-							 pagecnt,
-							 dmadir,
-							 attrs);
-			unpin_user_pages(pagelist, pagecnt);
-			kfree(sglist);
-			return -ENOMEM;
-		}
 	}
 	dmahead->sglist = sglist;
 	dmahead->sgcnt = sgcnt;
@@ -968,6 +1011,22 @@ int xdma_wait(struct xdma_head *dmahead,
 		}
 	}
 
+	if (dmahead->trigger) {
+		eventfd_ctx_put(dmahead->trigger);
+		dmahead->trigger = NULL;
+	}
+
+	if (dmahead->tpl) {
+		struct xdma_template *tpl = dmahead->tpl;
+
+		/* the template stays mapped, only hand the data to the cpu */
+		if (tpl->user_flags & CF_FLAG_CACHE_FLUSH_INVALIDATE)
+			dma_sync_sg_for_cpu(chan->dev, tpl->map_list,
+					    tpl->map_cnt, tpl->dmadir);
+		atomic_dec(&tpl->inflight);
+		return 0;
+	}
+
 	if (!dmahead->dmabuf) {
 		if (!(user_flags & CF_FLAG_CACHE_FLUSH_INVALIDATE))
 			attrs |= DMA_ATTR_SKIP_CPU_SYNC;
@@ -993,6 +1052,181 @@ int xdma_wait(struct xdma_head *dmahead,
 }
 EXPORT_SYMBOL(xdma_wait);
 
+/**
+ * xdma_template_create - pins and maps a buffer for repeated transfers
+ * @chan: channel the transfers go through
+ * @userbuf: user or physical address of the buffer
+ * @size: length of the buffer in bytes
+ * @user_flags: CF_FLAG_* flags, as for xdma_submit
+ * @tplp: returns the template
+ *
+ * The buffer stays pinned and mapped until xdma_template_destroy(), so
+ * xdma_template_submit() only has to fill the BDs and move the tail.
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int xdma_template_create(struct xdma_chan *chan,
+			 xlnk_intptr_type userbuf,
+			 unsigned int size,
+			 unsigned int user_flags,
+			 struct xdma_template **tplp)
+{
+	struct xdma_template *tpl;
+	int status;
+
+	if (!chan || !size)
+		return -EINVAL;
+
+	tpl = kzalloc(sizeof(*tpl), GFP_KERNEL);
+	if (!tpl)
+		return -ENOMEM;
+
+	tpl->chan = chan;
+	tpl->userbuf = userbuf;
+	tpl->size = size;
+	tpl->user_flags = user_flags;
+	tpl->dmadir = chan->direction;
+	atomic_set(&tpl->inflight, 0);
+
+	/* cache maintenance is done per submit */
+	status = xdma_map_user_buf(chan, userbuf, size, user_flags,
+				   DMA_ATTR_SKIP_CPU_SYNC,
+				   &tpl->sglist, &tpl->sgcnt,
+				   &tpl->pagelist, &tpl->pagecnt);
+	if (status) {
+		kfree(tpl);
+		return status;
+	}
+
+	if (tpl->pagelist) {
+		tpl->map_list = tpl->pagelist;
+		tpl->map_cnt = tpl->pagecnt;
+	} else {
+		tpl->map_list = tpl->sglist;
+		tpl->map_cnt = tpl->sgcnt;
+	}
+
+	*tplp = tpl;
+	return 0;
+}
+EXPORT_SYMBOL(xdma_template_create);
+
+/**
+ * xdma_template_destroy - unmaps and unpins the buffer of a template
+ * @tpl: template to destroy
+ *
+ * Return: 0 on success, -EBUSY while transfers of the template are in
+ * flight.
+ */
+int xdma_template_destroy(struct xdma_template *tpl)
+{
+	struct xdma_chan *chan = tpl->chan;
+
+	if (atomic_read(&tpl->inflight))
+		return -EBUSY;
+
+	get_dma_ops(chan->dev)->unmap_sg(chan->dev,
+					 tpl->map_list,
+					 tpl->map_cnt,
+					 tpl->dmadir,
+					 DMA_ATTR_SKIP_CPU_SYNC);
+	if (tpl->pagelist)
+		unpin_user_pages(tpl->pagelist, tpl->pagecnt);
+	kfree(tpl->sglist);
+	kfree(tpl);
+	return 0;
+}
+EXPORT_SYMBOL(xdma_template_destroy);
+
+/**
+ * xdma_template_submit - queues a transfer of a template's buffer
+ * @tpl: template to transfer
+ * @nappwords_i: number of application words to pass to the first BD
+ * @appwords_i: application words to pass to the first BD
+ * @nappwords_o: number of application words to return from the last BD
+ * @dmaheadpp: returns the head to pass to xdma_wait()
+ *
+ * Return: 0 on success, a negative error code otherwise.
+ */
+int xdma_template_submit(struct xdma_template *tpl,
+			 unsigned int nappwords_i,
+			 u32 *appwords_i,
+			 unsigned int nappwords_o,
+			 struct xdma_head **dmaheadpp)
+{
+	struct xdma_chan *chan = tpl->chan;
+	struct xdma_head *dmahead;
+	int status;
+
+	dmahead = kzalloc(sizeof(*dmahead), GFP_KERNEL);
+	if (!dmahead)
+		return -ENOMEM;
+
+	dmahead->chan = chan;
+	dmahead->userbuf = tpl->userbuf;
+	dmahead->size = tpl->size;
+	dmahead->dmadir = tpl->dmadir;
+	dmahead->userflag = tpl->user_flags;
+	dmahead->tpl = tpl;
+	init_completion(&dmahead->cmp);
+
+	if (nappwords_i > XDMA_MAX_APPWORDS)
+		nappwords_i = XDMA_MAX_APPWORDS;
+
+	if (nappwords_o > XDMA_MAX_APPWORDS)
+		nappwords_o = XDMA_MAX_APPWORDS;
+
+	dmahead->nappwords_o = nappwords_o;
+
+	if (tpl->user_flags & CF_FLAG_CACHE_FLUSH_INVALIDATE)
+		dma_sync_sg_for_device(chan->dev, tpl->map_list, tpl->map_cnt,
+				       tpl->dmadir);
+
+	atomic_inc(&tpl->inflight);
+	status = xdma_setup_hw_desc(chan, dmahead, tpl->sglist, tpl->sgcnt,
+				    tpl->dmadir, nappwords_i, appwords_i);
+	if (status) {
+		pr_err("setup hw desc failed\n");
+		atomic_dec(&tpl->inflight);
+		kfree(dmahead);
+		return status;
+	}
+
+	*dmaheadpp = dmahead;
+	return 0;
+}
+EXPORT_SYMBOL(xdma_template_submit);
+
+/**
+ * xdma_set_eventfd - signals an eventfd when a transfer completes
+ * @dmahead: transfer returned by a submit
+ * @trigger: eventfd context, its reference is dropped by xdma_wait()
+ *
+ * The eventfd is signalled at once when the transfer has already
+ * completed. xdma_wait() still has to be called to finish the transfer.
+ *
+ * Return: 0 on success, -EINVAL on channels in poll mode, where the
+ * completion is only found by xdma_wait().
+ */
+int xdma_set_eventfd(struct xdma_head *dmahead, struct eventfd_ctx *trigger)
+{
+	struct xdma_chan *chan = dmahead->chan;
+	unsigned long flags;
+
+	if (chan->poll_mode || dmahead->trigger)
+		return -EINVAL;
+
+	/* completions are signalled by the cleanup under the lock */
+	spin_lock_irqsave(&chan->lock, flags);
+	dmahead->trigger = trigger;
+	if (completion_done(&dmahead->cmp))
+		eventfd_signal(trigger, 1);
+	spin_unlock_irqrestore(&chan->lock, flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(xdma_set_eventfd);
+
 int xdma_getconfig(struct xdma_chan *chan,
 		   unsigned char *irq_thresh,
 		   unsigned char *irq_delay)
@@ -189,6 +189,22 @@ struct xdma_device {
 	u8 channel_count;
 };
 
+/* a buffer kept pinned and mapped for repeated transfers */
+struct xdma_template {
+	struct xdma_chan *chan;
+	xlnk_intptr_type userbuf;
+	unsigned int size;
+	unsigned int user_flags;
+	enum dma_data_direction dmadir;
+	struct scatterlist *sglist;	/* merged list the BDs are built from */
+	unsigned int sgcnt;
+	struct scatterlist *pagelist;	/* pinned pages, if any */
+	unsigned int pagecnt;
+	struct scatterlist *map_list;	/* list passed to map_sg */
+	unsigned int map_cnt;
+	atomic_t inflight;		/* submits not yet waited for */
+};
+
 struct xdma_head {
 	xlnk_intptr_type userbuf;
 	unsigned int size;
@@ -205,6 +221,8 @@ struct xdma_head {
 	unsigned int userflag;
 	u32 last_bd_index;
 	struct xlnk_dmabuf_reg *dmabuf;
+	struct xdma_template *tpl;
+	struct eventfd_ctx *trigger;	/* optional, signalled on completion */
 };
 
 struct xdma_chan *xdma_request_channel(char *name);
@@ -223,6 +241,18 @@ int xdma_submit(struct xdma_chan *chan,
 int xdma_wait(struct xdma_head *dmahead,
 	      unsigned int user_flags,
 	      unsigned int *operating_flags);
+int xdma_template_create(struct xdma_chan *chan,
+			 xlnk_intptr_type userbuf,
+			 unsigned int size,
+			 unsigned int user_flags,
+			 struct xdma_template **tplp);
+int xdma_template_destroy(struct xdma_template *tpl);
+int xdma_template_submit(struct xdma_template *tpl,
+			 unsigned int nappwords_i,
+			 u32 *appwords_i,
+			 unsigned int nappwords_o,
+			 struct xdma_head **dmaheadpp);
+int xdma_set_eventfd(struct xdma_head *dmahead, struct eventfd_ctx *trigger);
 int xdma_getconfig(struct xdma_chan *chan,
 		   unsigned char *irq_thresh,
 		   unsigned char *irq_delay);
@@ -11,13 +11,19 @@
 #define XLNK_IOCFREEBUF		_IOWR(XLNK_IOC_MAGIC, 3, unsigned long)
 #define XLNK_IOCADDDMABUF	_IOWR(XLNK_IOC_MAGIC, 4, unsigned long)
 #define XLNK_IOCCLEARDMABUF	_IOWR(XLNK_IOC_MAGIC, 5, unsigned long)
+#define XLNK_IOCEXPORTDMABUF	_IOWR(XLNK_IOC_MAGIC, 6, unsigned long)
 
 #define XLNK_IOCDMAREQUEST	_IOWR(XLNK_IOC_MAGIC, 7, unsigned long)
 #define XLNK_IOCDMASUBMIT	_IOWR(XLNK_IOC_MAGIC, 8, unsigned long)
 #define XLNK_IOCDMAWAIT		_IOWR(XLNK_IOC_MAGIC, 9, unsigned long)
 #define XLNK_IOCDMARELEASE	_IOWR(XLNK_IOC_MAGIC, 10, unsigned long)
+#define XLNK_IOCDMATEMPLATE	_IOWR(XLNK_IOC_MAGIC, 11, unsigned long)
+#define XLNK_IOCDMATEMPLATEFREE	_IOWR(XLNK_IOC_MAGIC, 12, unsigned long)
+#define XLNK_IOCDMATEMPLATESUBMIT	_IOWR(XLNK_IOC_MAGIC, 13, unsigned long)
+#define XLNK_IOCDMAEVENTFD	_IOWR(XLNK_IOC_MAGIC, 14, unsigned long)
 
 #define XLNK_IOCMEMOP		_IOWR(XLNK_IOC_MAGIC, 25, unsigned long)
+#define XLNK_IOCCACHECTRLV	_IOWR(XLNK_IOC_MAGIC, 26, unsigned long)
 #define XLNK_IOCDEVREGISTER	_IOWR(XLNK_IOC_MAGIC, 16, unsigned long)
 #define XLNK_IOCDMAREGISTER	_IOWR(XLNK_IOC_MAGIC, 17, unsigned long)
 #define XLNK_IOCDEVUNREGISTER	_IOWR(XLNK_IOC_MAGIC, 18, unsigned long)
@@ -29,6 +35,7 @@
 #define XLNK_IOCIRQREGISTER	_IOWR(XLNK_IOC_MAGIC, 35, unsigned long)
 #define XLNK_IOCIRQUNREGISTER	_IOWR(XLNK_IOC_MAGIC, 36, unsigned long)
 #define XLNK_IOCIRQWAIT		_IOWR(XLNK_IOC_MAGIC, 37, unsigned long)
+#define XLNK_IOCIRQEVENTFD	_IOWR(XLNK_IOC_MAGIC, 38, unsigned long)
 
 #define XLNK_IOCSHUTDOWN	_IOWR(XLNK_IOC_MAGIC, 100, unsigned long)
 #define XLNK_IOCRECRES		_IOWR(XLNK_IOC_MAGIC, 101, unsigned long)
@@ -20,23 +20,30 @@
 
 #include <linux/cdev.h>
 #include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/dma-buf.h>
 #include <linux/dma-mapping.h>
 #include <linux/errno.h>
+#include <linux/eventfd.h>
 #include <linux/fs.h>
 #include <linux/gfp.h>
+#include <linux/idr.h>
+#include <linux/interval_tree.h>
 #include <linux/io.h>
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/pagemap.h>
 #include <linux/platform_device.h>
 #include <linux/pm.h>
 #include <linux/sched.h>
 #include <linux/semaphore.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
 #include <linux/wait.h>
@@ -72,14 +79,50 @@ static dma_addr_t xlnk_phyaddr[XLNK_BUF_POOL_SIZE];
 static size_t xlnk_buflen[XLNK_BUF_POOL_SIZE];
 static unsigned int xlnk_bufcacheable[XLNK_BUF_POOL_SIZE];
 static struct file *xlnk_buf_filp[XLNK_BUF_POOL_SIZE];
+static struct xlnk_dmabuf_export *xlnk_buf_export[XLNK_BUF_POOL_SIZE];
 static spinlock_t xlnk_buf_lock;
 
+/*
+ * Buffer ids come from an IDR and the address ranges of the buffers are
+ * kept in interval trees, so lookups don't scan the whole pool. All of
+ * them are protected by xlnk_buf_lock.
+ */
+static DEFINE_IDR(xlnk_buf_idr);
+static struct rb_root_cached xlnk_phys_tree = RB_ROOT_CACHED;
+static struct rb_root_cached xlnk_user_tree = RB_ROOT_CACHED;
+static struct interval_tree_node xlnk_phys_node[XLNK_BUF_POOL_SIZE];
+static struct interval_tree_node xlnk_user_node[XLNK_BUF_POOL_SIZE];
+
+static struct {
+	u64 phys_lookups;
+	u64 phys_misses;
+	u64 user_lookups;
+	u64 user_misses;
+	u64 user_visits; /* ranges checked for the owning process */
+	unsigned int allocated;
+	unsigned int peak;
+} xlnk_buf_stats;
+
+static struct dentry *xlnk_debugfs;
+
 #define XLNK_IRQ_POOL_SIZE 256
 static struct xlnk_irq_control *xlnk_irq_set[XLNK_IRQ_POOL_SIZE];
 static spinlock_t xlnk_irq_lock;
 
 LIST_HEAD(xlnk_dmabuf_list);
 
+#ifdef CONFIG_XILINX_DMA_APF
+/* transfer templates, their address is the handle given to userspace */
+struct xlnk_dma_template_reg {
+	struct xdma_template *tpl;
+	struct file *filp;
+	struct list_head list;
+};
+
+static LIST_HEAD(xlnk_template_list);
+static DEFINE_MUTEX(xlnk_template_mutex);
+#endif
+
 #define MAX_XLNK_DMAS 128
 
 struct xlnk_device_pack {
@@ -182,47 +225,65 @@ static void xlnk_devpacks_free_all(void)
 	}
 }
 
-static int xlnk_buf_findnull(void)
+/* called with xlnk_buf_lock held, after idr_preload() */
+static int xlnk_buf_findnull(void *kaddr)
 {
-	int i;
+	int id;
 
-	for (i = 1; i < XLNK_BUF_POOL_SIZE; i++) {
-		if (!xlnk_bufpool[i])
-			return i;
-	}
+	id = idr_alloc(&xlnk_buf_idr, kaddr, 1, XLNK_BUF_POOL_SIZE,
+		       GFP_NOWAIT);
 
-	return 0;
+	return id < 0 ? 0 : id;
 }
 
 static int xlnk_buf_find_by_phys_addr(xlnk_intptr_type addr)
 {
-	int i;
+	struct interval_tree_node *node;
 
-	for (i = 1; i < XLNK_BUF_POOL_SIZE; i++) {
-		if (xlnk_bufpool[i] &&
-		    xlnk_phyaddr[i] <= addr &&
-		    xlnk_phyaddr[i] + xlnk_buflen[i] > addr)
-			return i;
+	xlnk_buf_stats.phys_lookups++;
+	node = interval_tree_iter_first(&xlnk_phys_tree, addr, addr);
+	if (!node) {
+		xlnk_buf_stats.phys_misses++;
+		return 0;
 	}
 
-	return 0;
+	return node - xlnk_phys_node;
 }
 
 static int xlnk_buf_find_by_user_addr(xlnk_intptr_type addr, int pid)
 {
-	int i;
+	struct interval_tree_node *node;
+	int id;
 
-	for (i = 1; i < XLNK_BUF_POOL_SIZE; i++) {
-		if (xlnk_bufpool[i] &&
-		    xlnk_buf_process[i] == pid &&
-		    xlnk_userbuf[i] <= addr &&
-		    xlnk_userbuf[i] + xlnk_buflen[i] > addr)
-			return i;
+	/* several processes may map buffers at the same address */
+	xlnk_buf_stats.user_lookups++;
+	for (node = interval_tree_iter_first(&xlnk_user_tree, addr, addr);
+	     node; node = interval_tree_iter_next(node, addr, addr)) {
+		xlnk_buf_stats.user_visits++;
+		id = node - xlnk_user_node;
+		if (xlnk_buf_process[id] == pid)
+			return id;
 	}
 
+	xlnk_buf_stats.user_misses++;
 	return 0;
 }
 
+/* called with xlnk_buf_lock held */
+static void xlnk_buf_set_user_addr(int id, xlnk_intptr_type addr, int pid)
+{
+	if (xlnk_userbuf[id])
+		interval_tree_remove(&xlnk_user_node[id], &xlnk_user_tree);
+
+	xlnk_userbuf[id] = addr;
+	xlnk_buf_process[id] = pid;
+	if (addr && xlnk_buflen[id]) {
+		xlnk_user_node[id].start = addr;
+		xlnk_user_node[id].last = addr + xlnk_buflen[id] - 1;
+		interval_tree_insert(&xlnk_user_node[id], &xlnk_user_tree);
+	}
+}
+
 /*
  * allocate and return an id
  * id must be a positve number
@@ -245,8 +306,9 @@ static int xlnk_allocbuf(struct file *filp, unsigned int len,
 	if (!kaddr)
 		return -ENOMEM;
 
+	idr_preload(GFP_KERNEL);
 	spin_lock(&xlnk_buf_lock);
-	id = xlnk_buf_findnull();
+	id = xlnk_buf_findnull(kaddr);
 	if (id > 0 && id < XLNK_BUF_POOL_SIZE) {
 		xlnk_bufpool_alloc_point[id] = kaddr;
 		xlnk_bufpool[id] = kaddr;
@@ -254,11 +316,19 @@ static int xlnk_allocbuf(struct file *filp, unsigned int len,
 		xlnk_bufcacheable[id] = cacheable;
 		xlnk_phyaddr[id] = phys_addr_anchor;
 		xlnk_buf_filp[id] = filp;
+		xlnk_phys_node[id].start = phys_addr_anchor;
+		xlnk_phys_node[id].last = phys_addr_anchor + len - 1;
+		interval_tree_insert(&xlnk_phys_node[id], &xlnk_phys_tree);
+		if (++xlnk_buf_stats.allocated > xlnk_buf_stats.peak)
+			xlnk_buf_stats.peak = xlnk_buf_stats.allocated;
 	}
 	spin_unlock(&xlnk_buf_lock);
+	idr_preload_end();
 
-	if (id <= 0 || id >= XLNK_BUF_POOL_SIZE)
+	if (id <= 0 || id >= XLNK_BUF_POOL_SIZE) {
+		dma_free_attrs(xlnk_dev, len, kaddr, phys_addr_anchor, attrs);
 		return -ENOMEM;
+	}
 
 	return id;
 }
@@ -472,6 +542,7 @@ static int xlnk_freebuf(int id)
 	size_t buf_len;
 	int cacheable;
 	unsigned long attrs;
+	struct xlnk_dmabuf_export *exp;
 
 	if (id <= 0 || id >= XLNK_BUF_POOL_SIZE)
 		return -ENOMEM;
@@ -480,6 +551,14 @@ static int xlnk_freebuf(int id)
 		return -ENOMEM;
 
 	spin_lock(&xlnk_buf_lock);
+	if (!xlnk_bufpool[id]) {
+		spin_unlock(&xlnk_buf_lock);
+		return -ENOMEM;
+	}
+	interval_tree_remove(&xlnk_phys_node[id], &xlnk_phys_tree);
+	xlnk_buf_set_user_addr(id, 0, 0);
+	idr_remove(&xlnk_buf_idr, id);
+	xlnk_buf_stats.allocated--;
 	alloc_point = xlnk_bufpool_alloc_point[id];
 	p_addr = xlnk_phyaddr[id];
 	buf_len = xlnk_buflen[id];
@@ -489,8 +568,16 @@ static int xlnk_freebuf(int id)
 	xlnk_buf_filp[id] = NULL;
 	cacheable = xlnk_bufcacheable[id];
 	xlnk_bufcacheable[id] = 0;
+	exp = xlnk_buf_export[id];
+	xlnk_buf_export[id] = NULL;
+	if (exp)
+		exp->id = 0;
 	spin_unlock(&xlnk_buf_lock);
 
+	/* an exported buffer is freed when its dma-buf is released */
+	if (exp)
+		return 0;
+
 	attrs = cacheable ? DMA_ATTR_NON_CONSISTENT : 0;
 
 	dma_free_attrs(xlnk_dev,
@@ -528,6 +615,213 @@ static int xlnk_freebuf_ioctl(struct file *filp,
 	return xlnk_freebuf(id);
 }
 
+static struct sg_table *xlnk_dmabuf_map(struct dma_buf_attachment *attach,
+					enum dma_data_direction dir)
+{
+	struct xlnk_dmabuf_export *exp = attach->dmabuf->priv;
+	struct sg_table *sgt;
+	unsigned long attrs = 0;
+	int status;
+
+	sgt = kzalloc(sizeof(*sgt), GFP_KERNEL);
+	if (!sgt)
+		return ERR_PTR(-ENOMEM);
+
+	status = sg_alloc_table(sgt, 1, GFP_KERNEL);
+	if (status) {
+		kfree(sgt);
+		return ERR_PTR(status);
+	}
+
+	sg_set_page(sgt->sgl, pfn_to_page(exp->phys_addr >> PAGE_SHIFT),
+		    exp->len, offset_in_page(exp->phys_addr));
+
+	/* uncached buffers need no cache maintenance, as in memop */
+	if (!exp->cacheable)
+		attrs |= DMA_ATTR_SKIP_CPU_SYNC;
+
+	if (!dma_map_sg_attrs(attach->dev, sgt->sgl, 1, dir, attrs)) {
+		sg_free_table(sgt);
+		kfree(sgt);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	return sgt;
+}
+
+static void xlnk_dmabuf_unmap(struct dma_buf_attachment *attach,
+			      struct sg_table *sgt,
+			      enum dma_data_direction dir)
+{
+	struct xlnk_dmabuf_export *exp = attach->dmabuf->priv;
+	unsigned long attrs = 0;
+
+	if (!exp->cacheable)
+		attrs |= DMA_ATTR_SKIP_CPU_SYNC;
+
+	dma_unmap_sg_attrs(attach->dev, sgt->sgl, 1, dir, attrs);
+	sg_free_table(sgt);
+	kfree(sgt);
+}
+
+static void xlnk_dmabuf_put_export(struct xlnk_dmabuf_export *exp)
+{
+	unsigned long attrs;
+	bool orphaned;
+
+	spin_lock(&xlnk_buf_lock);
+	orphaned = !exp->id;
+	if (!orphaned)
+		xlnk_buf_export[exp->id] = NULL;
+	spin_unlock(&xlnk_buf_lock);
+
+	/* the buffer was freed while exported, release its memory now */
+	if (orphaned) {
+		attrs = exp->cacheable ? DMA_ATTR_NON_CONSISTENT : 0;
+		dma_free_attrs(xlnk_dev, exp->len, exp->kaddr, exp->phys_addr,
+			       attrs);
+	}
+
+	kfree(exp);
+}
+
+static void xlnk_dmabuf_release(struct dma_buf *dbuf)
+{
+	xlnk_dmabuf_put_export(dbuf->priv);
+}
+
+static int xlnk_dmabuf_begin_cpu_access(struct dma_buf *dbuf,
+					enum dma_data_direction dir)
+{
+	struct xlnk_dmabuf_export *exp = dbuf->priv;
+
+	if (exp->cacheable)
+		dma_sync_single_for_cpu(xlnk_dev, exp->phys_addr, exp->len,
+					dir);
+
+	return 0;
+}
+
+static int xlnk_dmabuf_end_cpu_access(struct dma_buf *dbuf,
+				      enum dma_data_direction dir)
+{
+	struct xlnk_dmabuf_export *exp = dbuf->priv;
+
+	if (exp->cacheable)
+		dma_sync_single_for_device(xlnk_dev, exp->phys_addr, exp->len,
+					   dir);
+
+	return 0;
+}
+
+static int xlnk_dmabuf_mmap(struct dma_buf *dbuf, struct vm_area_struct *vma)
+{
+	struct xlnk_dmabuf_export *exp = dbuf->priv;
+	unsigned long size = vma->vm_end - vma->vm_start;
+
+	if ((vma->vm_pgoff << PAGE_SHIFT) + size > PAGE_ALIGN(exp->len))
+		return -EINVAL;
+
+	/* same cacheability as a mapping of the buffer through xlnk_mmap */
+	if (!exp->cacheable)
+		vma->vm_page_prot = pgprot_noncached(vma->vm_page_prot);
+
+	return remap_pfn_range(vma, vma->vm_start,
+			       (exp->phys_addr >> PAGE_SHIFT) + vma->vm_pgoff,
+			       size, vma->vm_page_prot);
+}
+
+static void *xlnk_dmabuf_kmap(struct dma_buf *dbuf, unsigned long page_num)
+{
+	struct xlnk_dmabuf_export *exp = dbuf->priv;
+
+	return exp->kaddr + page_num * PAGE_SIZE;
+}
+
+static void *xlnk_dmabuf_vmap(struct dma_buf *dbuf)
+{
+	struct xlnk_dmabuf_export *exp = dbuf->priv;
+
+	return exp->kaddr;
+}
+
+static const struct dma_buf_ops xlnk_dmabuf_ops = {
+	.map_dma_buf = xlnk_dmabuf_map,
+	.unmap_dma_buf = xlnk_dmabuf_unmap,
+	.release = xlnk_dmabuf_release,
+	.begin_cpu_access = xlnk_dmabuf_begin_cpu_access,
+	.end_cpu_access = xlnk_dmabuf_end_cpu_access,
+	.mmap = xlnk_dmabuf_mmap,
+	.map = xlnk_dmabuf_kmap,
+	.vmap = xlnk_dmabuf_vmap,
+};
+
+static int xlnk_exportdmabuf_ioctl(struct file *filp,
+				   unsigned int code,
+				   unsigned long args)
+{
+	DEFINE_DMA_BUF_EXPORT_INFO(exp_info);
+	union xlnk_args temp_args;
+	struct xlnk_dmabuf_export *exp;
+	struct dma_buf *dbuf;
+	int status;
+	int id;
+	int fd;
+
+	status = copy_from_user(&temp_args, (void __user *)args,
+				sizeof(union xlnk_args));
+
+	if (status)
+		return -ENOMEM;
+
+	id = temp_args.exportdmabuf.id;
+	if (id <= 0 || id >= XLNK_BUF_POOL_SIZE)
+		return -EINVAL;
+
+	exp = kzalloc(sizeof(*exp), GFP_KERNEL);
+	if (!exp)
+		return -ENOMEM;
+
+	spin_lock(&xlnk_buf_lock);
+	if (!xlnk_bufpool[id] || xlnk_buf_export[id]) {
+		spin_unlock(&xlnk_buf_lock);
+		kfree(exp);
+		return -EINVAL;
+	}
+	exp->kaddr = xlnk_bufpool_alloc_point[id];
+	exp->phys_addr = xlnk_phyaddr[id];
+	exp->len = xlnk_buflen[id];
+	exp->cacheable = xlnk_bufcacheable[id];
+	exp->id = id;
+	xlnk_buf_export[id] = exp;
+	spin_unlock(&xlnk_buf_lock);
+
+	exp_info.ops = &xlnk_dmabuf_ops;
+	exp_info.size = exp->len;
+	exp_info.flags = O_RDWR;
+	exp_info.priv = exp;
+
+	dbuf = dma_buf_export(&exp_info);
+	if (IS_ERR(dbuf)) {
+		xlnk_dmabuf_put_export(exp);
+		return PTR_ERR(dbuf);
+	}
+
+	fd = dma_buf_fd(dbuf, O_CLOEXEC);
+	if (fd < 0) {
+		/* releases exp */
+		dma_buf_put(dbuf);
+		return fd;
+	}
+
+	temp_args.exportdmabuf.dmabuf_fd = fd;
+	status = copy_to_user((void __user *)args,
+			      &temp_args,
+			      sizeof(union xlnk_args));
+
+	return status ? -EFAULT : 0;
+}
+
 static int xlnk_adddmabuf_ioctl(struct file *filp,
 				unsigned int code,
 				unsigned long args)
@@ -560,9 +854,16 @@ static int xlnk_adddmabuf_ioctl(struct file *filp,
 	db->dmabuf_fd = temp_args.dmabuf.dmabuf_fd;
 	db->user_vaddr = temp_args.dmabuf.user_addr;
 	db->dbuf = dma_buf_get(db->dmabuf_fd);
+	if (IS_ERR(db->dbuf)) {
+		pr_err("Failed DMA-BUF get\n");
+		kfree(db);
+		return -EINVAL;
+	}
+
 	db->dbuf_attach = dma_buf_attach(db->dbuf, xlnk_dev);
 	if (IS_ERR(db->dbuf_attach)) {
 		dma_buf_put(db->dbuf);
+		kfree(db);
 		pr_err("Failed DMA-BUF attach\n");
 		return -EINVAL;
 	}
@@ -570,10 +871,11 @@ static int xlnk_adddmabuf_ioctl(struct file *filp,
 	db->dbuf_sg_table = dma_buf_map_attachment(db->dbuf_attach,
 						   DMA_BIDIRECTIONAL);
 
-	if (!db->dbuf_sg_table) {
+	if (IS_ERR_OR_NULL(db->dbuf_sg_table)) {
 		pr_err("Failed DMA-BUF map_attachment\n");
 		dma_buf_detach(db->dbuf, db->dbuf_attach);
 		dma_buf_put(db->dbuf);
+		kfree(db);
 		return -EINVAL;
 	}
 
@@ -722,6 +1024,151 @@ static int xlnk_dmasubmit_ioctl(struct file *filp, unsigned int code,
 #endif
 }
 
+#ifdef CONFIG_XILINX_DMA_APF
+/* called with xlnk_template_mutex held */
+static struct xlnk_dma_template_reg *xlnk_template_find(xlnk_intptr_type h)
+{
+	struct xlnk_dma_template_reg *reg;
+
+	list_for_each_entry(reg, &xlnk_template_list, list) {
+		if ((xlnk_intptr_type)reg == h)
+			return reg;
+	}
+
+	return NULL;
+}
+#endif
+
+static int xlnk_dmatemplate_ioctl(struct file *filp, unsigned int code,
+				  unsigned long args)
+{
+#ifdef CONFIG_XILINX_DMA_APF
+	union xlnk_args temp_args;
+	struct xlnk_dma_template_reg *reg;
+	int status;
+
+	status = copy_from_user(&temp_args, (void __user *)args,
+				sizeof(union xlnk_args));
+
+	if (status)
+		return -ENOMEM;
+
+	if (!temp_args.dmatemplate.dmachan)
+		return -ENODEV;
+
+	reg = kzalloc(sizeof(*reg), GFP_KERNEL);
+	if (!reg)
+		return -ENOMEM;
+
+	status = xdma_template_create((struct xdma_chan *)
+				      (temp_args.dmatemplate.dmachan),
+				      temp_args.dmatemplate.buf,
+				      temp_args.dmatemplate.len,
+				      temp_args.dmatemplate.flag,
+				      &reg->tpl);
+	if (status) {
+		kfree(reg);
+		return status;
+	}
+	reg->filp = filp;
+
+	mutex_lock(&xlnk_template_mutex);
+	list_add_tail(&reg->list, &xlnk_template_list);
+	mutex_unlock(&xlnk_template_mutex);
+
+	temp_args.dmatemplate.handle = (xlnk_intptr_type)reg;
+	if (copy_to_user((void __user *)args,
+			 &temp_args,
+			 sizeof(union xlnk_args)))
+		return -EFAULT;
+
+	return 0;
+#else
+	return -ENOMEM;
+#endif
+}
+
+static int xlnk_dmatemplatefree_ioctl(struct file *filp, unsigned int code,
+				      unsigned long args)
+{
+#ifdef CONFIG_XILINX_DMA_APF
+	union xlnk_args temp_args;
+	struct xlnk_dma_template_reg *reg;
+	int status;
+
+	status = copy_from_user(&temp_args, (void __user *)args,
+				sizeof(union xlnk_args));
+
+	if (status)
+		return -ENOMEM;
+
+	mutex_lock(&xlnk_template_mutex);
+	reg = xlnk_template_find(temp_args.dmatemplate.handle);
+	if (!reg) {
+		mutex_unlock(&xlnk_template_mutex);
+		return -EINVAL;
+	}
+	status = xdma_template_destroy(reg->tpl);
+	if (!status)
+		list_del(&reg->list);
+	mutex_unlock(&xlnk_template_mutex);
+
+	if (!status)
+		kfree(reg);
+
+	return status;
+#else
+	return -ENOMEM;
+#endif
+}
+
+/* like dmasubmit, with dmasubmit.buf holding the template handle */
+static int xlnk_dmatemplatesubmit_ioctl(struct file *filp, unsigned int code,
+					unsigned long args)
+{
+#ifdef CONFIG_XILINX_DMA_APF
+	union xlnk_args temp_args;
+	struct xlnk_dma_template_reg *reg;
+	struct xdma_head *dmahead;
+	int status;
+
+	status = copy_from_user(&temp_args, (void __user *)args,
+				sizeof(union xlnk_args));
+
+	if (status)
+		return -ENOMEM;
+
+	mutex_lock(&xlnk_template_mutex);
+	reg = xlnk_template_find(temp_args.dmasubmit.buf);
+	if (!reg) {
+		mutex_unlock(&xlnk_template_mutex);
+		return -EINVAL;
+	}
+	status = xdma_template_submit(reg->tpl,
+				      temp_args.dmasubmit.nappwords_i,
+				      temp_args.dmasubmit.appwords_i,
+				      temp_args.dmasubmit.nappwords_o,
+				      &dmahead);
+	mutex_unlock(&xlnk_template_mutex);
+
+	if (status)
+		return status;
+
+	temp_args.dmasubmit.dmahandle = (xlnk_intptr_type)dmahead;
+	temp_args.dmasubmit.last_bd_index =
+		(xlnk_intptr_type)dmahead->last_bd_index;
+
+	if (copy_to_user((void __user *)args,
+			 &temp_args,
+			 sizeof(union xlnk_args)))
+		return -EFAULT;
+
+	return 0;
+#else
+	return -ENOMEM;
+#endif
+}
+
 static int xlnk_dmawait_ioctl(struct file *filp,
 			      unsigned int code,
 			      unsigned long args)
@@ -758,6 +1205,40 @@ static int xlnk_dmawait_ioctl(struct file *filp,
 	return status;
 }
 
+/* signals an eventfd when a submitted transfer completes */
+static int xlnk_dmaeventfd_ioctl(struct file *filp, unsigned int code,
+				 unsigned long args)
+{
+#ifdef CONFIG_XILINX_DMA_APF
+	union xlnk_args temp_args;
+	struct eventfd_ctx *trigger;
+	struct xdma_head *dmahead;
+	int status;
+
+	status = copy_from_user(&temp_args, (void __user *)args,
+				sizeof(union xlnk_args));
+
+	if (status)
+		return -ENOMEM;
+
+	dmahead = (struct xdma_head *)temp_args.dmaeventfd.dmahandle;
+	if (!dmahead)
+		return -EINVAL;
+
+	trigger = eventfd_ctx_fdget(temp_args.dmaeventfd.fd);
+	if (IS_ERR(trigger))
+		return PTR_ERR(trigger);
+
+	status = xdma_set_eventfd(dmahead, trigger);
+	if (status)
+		eventfd_ctx_put(trigger);
+
+	return status;
+#else
+	return -ENOMEM;
+#endif
+}
+
 static int xlnk_dmarelease_ioctl(struct file *filp, unsigned int code,
 				 unsigned long args)
 {
@@ -859,6 +1340,8 @@ static irqreturn_t xlnk_accel_isr(int irq, void *arg)
 
 	disable_irq_nosync(irq);
 	complete(&irq_control->cmp);
+	if (irq_control->trigger)
+		eventfd_signal(irq_control->trigger, 1);
 
 	return IRQ_HANDLED;
 }
@@ -968,11 +1451,60 @@ static int xlnk_irq_unregister_ioctl(struct file *filp, unsigned int code,
 		complete(&ctrl->cmp);
 	}
 	free_irq(ctrl->irq, ctrl);
+	if (ctrl->trigger)
+		eventfd_ctx_put(ctrl->trigger);
 	kfree(ctrl);
 
 	return 0;
 }
 
+/*
+ * Signals an eventfd on every interrupt, so an event loop can wait for
+ * many accelerators. The interrupt is still armed and acknowledged with
+ * a polling irqwait.
+ */
+static int xlnk_irq_eventfd_ioctl(struct file *filp, unsigned int code,
+				  unsigned long args)
+{
+	union xlnk_args temp_args;
+	struct eventfd_ctx *trigger = NULL;
+	struct eventfd_ctx *old;
+	struct xlnk_irq_control *ctrl;
+	int status;
+	int irq_id;
+
+	status = copy_from_user(&temp_args,
+				(void __user *)args,
+				sizeof(temp_args.irqeventfd));
+	if (status)
+		return -ENOMEM;
+
+	irq_id = temp_args.irqeventfd.irq_id;
+	if (irq_id < 0 || irq_id >= XLNK_IRQ_POOL_SIZE)
+		return -EINVAL;
+
+	ctrl = xlnk_irq_set[irq_id];
+	if (!ctrl)
+		return -EINVAL;
+
+	if (temp_args.irqeventfd.fd >= 0) {
+		trigger = eventfd_ctx_fdget(temp_args.irqeventfd.fd);
+		if (IS_ERR(trigger))
+			return PTR_ERR(trigger);
+	}
+
+	/* keep the isr from using the old context while it is swapped */
+	disable_irq(ctrl->irq);
+	old = ctrl->trigger;
+	ctrl->trigger = trigger;
+	enable_irq(ctrl->irq);
+
+	if (old)
+		eventfd_ctx_put(old);
+
+	return 0;
+}
+
 static int xlnk_irq_wait_ioctl(struct file *filp, unsigned int code,
 			       unsigned long args)
 {
@@ -1075,6 +1607,130 @@ static int xlnk_cachecontrol_ioctl(struct file *filp, unsigned int code,
 	return 0;
 }
 
+struct xlnk_cache_op {
+	void *kaddr;
+	xlnk_intptr_type start;
+	xlnk_intptr_type end; /* exclusive */
+	int action;
+};
+
+static int xlnk_cache_op_cmp(const void *a, const void *b)
+{
+	const struct xlnk_cache_op *x = a, *y = b;
+
+	if (x->start < y->start)
+		return -1;
+	return x->start > y->start;
+}
+
+/*
+ * Maintains the caches for several buffer ranges in one call. The inner
+ * cache is cleaned by line for every range. The outer cache gets a single
+ * operation spanning all ranges when most of that span belongs to them,
+ * so it is synced once. The PL310 driver turns a span larger than the
+ * cache into a full clean and invalidate. Otherwise, the merged ranges are
+ * flushed one by one.
+ */
+static int xlnk_cachecontrolv_ioctl(struct file *filp, unsigned int code,
+				    unsigned long args)
+{
+	union xlnk_args temp_args;
+	struct xlnk_cache_range *ranges;
+	struct xlnk_cache_op *ops;
+	unsigned int count, i;
+	int status = 0;
+
+	if (copy_from_user(&temp_args, (void __user *)args,
+			   sizeof(union xlnk_args)))
+		return -ENOMEM;
+
+	count = temp_args.cachecontrolv.count;
+	if (!count)
+		return 0;
+	if (count > XLNK_MAX_CACHE_RANGES)
+		return -EINVAL;
+
+	ranges = memdup_user((void __user *)temp_args.cachecontrolv.ranges,
+			     count * sizeof(*ranges));
+	if (IS_ERR(ranges))
+		return PTR_ERR(ranges);
+
+	ops = kmalloc_array(count, sizeof(*ops), GFP_KERNEL);
+	if (!ops) {
+		kfree(ranges);
+		return -ENOMEM;
+	}
+
+	spin_lock(&xlnk_buf_lock);
+	for (i = 0; i < count; i++) {
+		int id = ranges[i].id;
+
+		if (id <= 0 || id >= XLNK_BUF_POOL_SIZE || !xlnk_bufpool[id] ||
+		    ranges[i].offset > xlnk_buflen[id] ||
+		    ranges[i].len > xlnk_buflen[id] - ranges[i].offset ||
+		    !(ranges[i].action == 0 || ranges[i].action == 1)) {
+			status = -EINVAL;
+			break;
+		}
+		ops[i].kaddr = xlnk_bufpool[id] + ranges[i].offset;
+		ops[i].start = xlnk_phyaddr[id] + ranges[i].offset;
+		ops[i].end = ops[i].start + ranges[i].len;
+		ops[i].action = ranges[i].action;
+	}
+	spin_unlock(&xlnk_buf_lock);
+
+	if (status) {
+		pr_err("Illegal range %u in cachecontrolv_ioctl\n", i);
+		goto out;
+	}
+
+#if XLNK_SYS_BIT_WIDTH == 32
+	{
+		xlnk_intptr_type span_start, span_end, total = 0;
+		unsigned int merged = 0;
+
+		for (i = 0; i < count; i++)
+			__cpuc_flush_dcache_area(ops[i].kaddr,
+						 ops[i].end - ops[i].start);
+
+		/* merge overlapping and adjacent ranges */
+		sort(ops, count, sizeof(*ops), xlnk_cache_op_cmp, NULL);
+		for (i = 1; i < count; i++) {
+			if (ops[i].start <= ops[merged].end) {
+				ops[merged].end = max(ops[merged].end,
+						      ops[i].end);
+				continue;
+			}
+			ops[++merged] = ops[i];
+		}
+		count = merged + 1;
+
+		span_start = ops[0].start;
+		span_end = ops[count - 1].end;
+		for (i = 0; i < count; i++)
+			total += ops[i].end - ops[i].start;
+
+		/* a clean and invalidate also covers action 1 */
+		if (span_end - span_start <= 2 * total) {
+			outer_flush_range(span_start, span_end);
+		} else {
+			for (i = 0; i < count; i++)
+				outer_flush_range(ops[i].start, ops[i].end);
+		}
+	}
+#else
+	for (i = 0; i < count; i++)
+		__dma_map_area(ops[i].kaddr, ops[i].end - ops[i].start,
+			       ops[i].action == 1 ? DMA_FROM_DEVICE :
+						    DMA_TO_DEVICE);
+#endif
+
+out:
+	kfree(ops);
+	kfree(ranges);
+	return status;
+}
+
 static int xlnk_memop_ioctl(struct file *filp, unsigned long arg_addr)
 {
 	union xlnk_args args;
@@ -1234,12 +1890,22 @@ static long xlnk_ioctl(struct file *filp,
 		return xlnk_adddmabuf_ioctl(filp, code, args);
 	case XLNK_IOCCLEARDMABUF:
 		return xlnk_cleardmabuf_ioctl(filp, code, args);
+	case XLNK_IOCEXPORTDMABUF:
+		return xlnk_exportdmabuf_ioctl(filp, code, args);
 	case XLNK_IOCDMAREQUEST:
 		return xlnk_dmarequest_ioctl(filp, code, args);
 	case XLNK_IOCDMASUBMIT:
 		return xlnk_dmasubmit_ioctl(filp, code, args);
 	case XLNK_IOCDMAWAIT:
 		return xlnk_dmawait_ioctl(filp, code, args);
+	case XLNK_IOCDMATEMPLATE:
+		return xlnk_dmatemplate_ioctl(filp, code, args);
+	case XLNK_IOCDMATEMPLATEFREE:
+		return xlnk_dmatemplatefree_ioctl(filp, code, args);
+	case XLNK_IOCDMATEMPLATESUBMIT:
+		return xlnk_dmatemplatesubmit_ioctl(filp, code, args);
+	case XLNK_IOCDMAEVENTFD:
+		return xlnk_dmaeventfd_ioctl(filp, code, args);
 	case XLNK_IOCDMARELEASE:
 		return xlnk_dmarelease_ioctl(filp, code, args);
 	case XLNK_IOCDEVREGISTER:
@@ -1254,12 +1920,16 @@ static long xlnk_ioctl(struct file *filp,
 		return xlnk_irq_register_ioctl(filp, code, args);
 	case XLNK_IOCIRQUNREGISTER:
 		return xlnk_irq_unregister_ioctl(filp, code, args);
+	case XLNK_IOCIRQEVENTFD:
+		return xlnk_irq_eventfd_ioctl(filp, code, args);
 	case XLNK_IOCIRQWAIT:
 		return xlnk_irq_wait_ioctl(filp, code, args);
 	case XLNK_IOCSHUTDOWN:
 		return xlnk_shutdown(args);
 	case XLNK_IOCRECRES:
 		return xlnk_recover_resource(args);
+	case XLNK_IOCCACHECTRLV:
+		return xlnk_cachecontrolv_ioctl(filp, code, args);
 	case XLNK_IOCMEMOP:
 		return xlnk_memop_ioctl(filp, args);
 	default:
@@ -1292,8 +1962,11 @@ static int xlnk_mmap(struct file *filp, struct vm_area_struct *vma)
 					 >> PAGE_SHIFT,
 					 vma->vm_end - vma->vm_start,
 					 vma->vm_page_prot);
-		xlnk_userbuf[bufid] = vma->vm_start;
-		xlnk_buf_process[bufid] = current->pid;
+		spin_lock(&xlnk_buf_lock);
+		if (xlnk_bufpool[bufid])
+			xlnk_buf_set_user_addr(bufid, vma->vm_start,
+					       current->pid);
+		spin_unlock(&xlnk_buf_lock);
 	}
 	if (status) {
 		pr_err("%s failed with code %d\n", __func__, status);
@@ -1355,6 +2028,22 @@ static ssize_t xlnk_read(struct file *filp,
 static int xlnk_release(struct inode *ip, struct file *filp)
 {
 	unsigned int i;
+#ifdef CONFIG_XILINX_DMA_APF
+	struct xlnk_dma_template_reg *reg, *tmp;
+
+	mutex_lock(&xlnk_template_mutex);
+	list_for_each_entry_safe(reg, tmp, &xlnk_template_list, list) {
+		if (reg->filp != filp)
+			continue;
+		if (xdma_template_destroy(reg->tpl)) {
+			pr_err("DMA template still in use at release, leaking it\n");
+			continue;
+		}
+		list_del(&reg->list);
+		kfree(reg);
+	}
+	mutex_unlock(&xlnk_template_mutex);
+#endif
 
 	for (i = 1; i < XLNK_BUF_POOL_SIZE; i++) {
 		if (xlnk_buf_filp[i] == filp)
@@ -1385,10 +2074,30 @@ static const struct file_operations xlnk_fops = {
 	.mmap = xlnk_mmap,
 };
 
+static int xlnk_lookup_stats_show(struct seq_file *s, void *data)
+{
+	spin_lock(&xlnk_buf_lock);
+	seq_printf(s, "buffers: %u\n", xlnk_buf_stats.allocated);
+	seq_printf(s, "peak buffers: %u\n", xlnk_buf_stats.peak);
+	seq_printf(s, "phys lookups: %llu\n", xlnk_buf_stats.phys_lookups);
+	seq_printf(s, "phys misses: %llu\n", xlnk_buf_stats.phys_misses);
+	seq_printf(s, "user lookups: %llu\n", xlnk_buf_stats.user_lookups);
+	seq_printf(s, "user misses: %llu\n", xlnk_buf_stats.user_misses);
+	seq_printf(s, "user ranges visited: %llu\n",
+		   xlnk_buf_stats.user_visits);
+	spin_unlock(&xlnk_buf_lock);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(xlnk_lookup_stats);
+
 static int xlnk_remove(struct platform_device *pdev)
 {
 	dev_t devno;
 
+	debugfs_remove_recursive(xlnk_debugfs);
+	xlnk_debugfs = NULL;
+
 	kfree(xlnk_dev_buf);
 	xlnk_dev_buf = NULL;
 
@@ -1486,6 +2195,10 @@ static int xlnk_probe(struct platform_device *pdev)
 
 	xlnk_init_irqpool();
 
+	xlnk_debugfs = debugfs_create_dir(DRIVER_NAME, NULL);
+	debugfs_create_file("lookup_stats", 0444, xlnk_debugfs, NULL,
+			    &xlnk_lookup_stats_fops);
+
 	dev_info(&pdev->dev, "%s driver loaded\n", DRIVER_NAME);
 
 	xlnk_pdev = pdev;
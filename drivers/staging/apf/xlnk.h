@@ -55,12 +55,32 @@ struct xlnk_dmabuf_reg {
 	struct list_head list;
 };
 
+/* an xlnk buffer exported as a dma-buf */
+struct xlnk_dmabuf_export {
+	void *kaddr;
+	dma_addr_t phys_addr;
+	size_t len;
+	unsigned int cacheable;
+	int id; /* buffer pool id, 0 once the buffer has been freed */
+};
+
 struct xlnk_irq_control {
 	int irq;
 	int enabled;
 	struct completion cmp;
+	struct eventfd_ctx *trigger; /* optional, signalled on interrupt */
 };
 
+/* CROSSES KERNEL-USER BOUNDARY */
+struct __attribute__ ((__packed__)) xlnk_cache_range {
+	xlnk_int_type id; /* buffer id returned by allocbuf */
+	xlnk_uint_type offset;
+	xlnk_uint_type len;
+	xlnk_int_type action; /* as in cachecontrol */
+};
+
+#define XLNK_MAX_CACHE_RANGES 64
+
 /* CROSSES KERNEL-USER BOUNDARY */
 union xlnk_args {
 	struct __attribute__ ((__packed__)) {
@@ -77,6 +97,10 @@ union xlnk_args {
 		xlnk_int_type dmabuf_fd;
 		xlnk_intptr_type user_addr;
 	} dmabuf;
+	struct __attribute__ ((__packed__)) {
+		xlnk_int_type id;
+		xlnk_int_type dmabuf_fd; /* return value */
+	} exportdmabuf;
 	struct __attribute__ ((__packed__)) {
 		xlnk_char_type name[64];
 		xlnk_intptr_type dmachan;
@@ -101,6 +125,13 @@ union xlnk_args {
 		xlnk_intptr_type dmahandle; /* return value */
 		xlnk_uint_type last_bd_index;
 	} dmasubmit;
+	struct __attribute__ ((__packed__)) {
+		xlnk_intptr_type dmachan;
+		xlnk_intptr_type buf;
+		xlnk_uint_type len;
+		xlnk_uint_type flag;
+		xlnk_intptr_type handle; /* return value of create */
+	} dmatemplate;
 	struct __attribute__ ((__packed__)) {
 		xlnk_intptr_type dmahandle;
 		xlnk_uint_type nappwords;
@@ -143,6 +174,10 @@ union xlnk_args {
 		xlnk_uint_type size;
 		xlnk_int_type action;
 	} cachecontrol;
+	struct __attribute__ ((__packed__)) {
+		xlnk_intptr_type ranges; /* struct xlnk_cache_range array */
+		xlnk_uint_type count;
+	} cachecontrolv;
 	struct __attribute__ ((__packed__)) {
 		xlnk_intptr_type virt_addr;
 		xlnk_int_type size;
@@ -165,6 +200,14 @@ union xlnk_args {
 	struct __attribute__ ((__packed__)) {
 		xlnk_int_type irq_id;
 	} irqunregister;
+	struct __attribute__ ((__packed__)) {
+		xlnk_int_type irq_id;
+		xlnk_int_type fd; /* eventfd, -1 to remove */
+	} irqeventfd;
+	struct __attribute__ ((__packed__)) {
+		xlnk_intptr_type dmahandle;
+		xlnk_int_type fd; /* eventfd */
+	} dmaeventfd;
 	struct __attribute__ ((__packed__)) {
 		xlnk_int_type irq_id;
 		xlnk_int_type polling;
@@ -16,6 +16,11 @@
 
 #include <linux/kernel.h>
 #include <linux/wait.h>
+#include <linux/completion.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/mm.h>
+#include <linux/scatterlist.h>
 #include <linux/spinlock_types.h>
 #include <linux/device.h>
 #include <linux/cdev.h>
@@ -27,9 +32,14 @@
 #include <linux/interrupt.h>
 #include <linux/param.h>
 #include <linux/fs.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <linux/vmalloc.h>
 #include <linux/types.h>
 #include <linux/uaccess.h>
 #include <linux/jiffies.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
 
 #include <linux/of_address.h>
 #include <linux/of_device.h>
@@ -45,6 +55,11 @@
 #define READ_BUF_SIZE 128U /* read buffer length in words */
 #define WRITE_BUF_SIZE 128U /* write buffer length in words */
 
+#define DMA_TIMEOUT_MS 1000 /* ms to wait for a dma transfer of a packet */
+#define DMA_MAXBURST 16U /* dma burst length in words */
+
+#define RX_COALESCE_USECS 100U /* default max delay of a coalesced wakeup */
+
 /* ----------------------------
  *     IP register offsets
  * ----------------------------
@@ -66,6 +81,10 @@
 #define XLLF_TDR_OFFSET  0x0000002C  /* Transmit Destination */
 #define XLLF_RDR_OFFSET  0x00000030  /* Receive Destination */
 
+/* data ports of the AXI4 (full) data interface, relative to its base */
+#define XLLF_AXI4_TDFD_OFFSET 0x00000000  /* Transmit Data */
+#define XLLF_AXI4_RDFD_OFFSET 0x00001000  /* Receive Data */
+
 /* ----------------------------
  *     reset register masks
  * ----------------------------
@@ -107,6 +126,9 @@ static struct class *axis_fifo_driver_class; /* char device class */
 
 static int read_timeout = 1000; /* ms to wait before read() times out */
 static int write_timeout = 1000; /* ms to wait before write() times out */
+static int dma_threshold = 1024; /* packets of this many bytes use dma */
+static unsigned int rx_ring_slots; /* slots of the mmap rx ring, 0 = none */
+static unsigned int rx_ring_slot_size = 2048; /* bytes per rx ring slot */
 
 /* ----------------------------
  * module command-line arguments
@@ -114,19 +136,64 @@ static int write_timeout = 1000; /* ms to wait before write() times out */
  */
 
 module_param(read_timeout, int, 0444);
-MODULE_PARM_DESC(read_timeout, "ms to wait before blocking read() timing out; set to -1 for no timeout");
+MODULE_PARM_DESC(read_timeout, "default ms to wait before blocking read() timing out; set to -1 for no timeout");
 module_param(write_timeout, int, 0444);
-MODULE_PARM_DESC(write_timeout, "ms to wait before blocking write() timing out; set to -1 for no timeout");
+MODULE_PARM_DESC(write_timeout, "default ms to wait before blocking write() timing out; set to -1 for no timeout");
+module_param(dma_threshold, int, 0644);
+MODULE_PARM_DESC(dma_threshold, "smallest packet in bytes moved by dma when dma channels are present; set to -1 to never use dma");
+module_param(rx_ring_slots, uint, 0444);
+MODULE_PARM_DESC(rx_ring_slots, "number of packet slots in the mmap()-able receive ring; 0 disables the ring");
+module_param(rx_ring_slot_size, uint, 0444);
+MODULE_PARM_DESC(rx_ring_slot_size, "bytes per receive ring slot including the 4 byte length prefix");
 
 /* ----------------------------
  *            types
  * ----------------------------
  */
 
+/* control page at the start of the mmap()-able receive ring. The slots
+ * follow on the next page, each holding a u32 packet length in bytes and
+ * the packet data. head and tail are free running slot counters: the
+ * driver fills slot head % nr_slots and then advances head, userspace
+ * consumes slot tail % nr_slots and then advances tail. The ring is full
+ * when head - tail == nr_slots, further packets then wait in the fifo.
+ */
+struct axis_fifo_ring_ctrl {
+	u32 head; /* written by the driver */
+	u32 tail; /* written by userspace */
+	u32 nr_slots;
+	u32 slot_size;
+	u32 dropped; /* packets too long for a slot */
+};
+
 struct axis_fifo {
 	int irq; /* interrupt */
 	struct resource *mem; /* physical memory */
 	void __iomem *base_addr; /* kernel space memory */
+	void __iomem *tx_data; /* transmit data port */
+	void __iomem *rx_data; /* receive data port */
+	phys_addr_t tx_data_phys; /* bus address of the transmit data port */
+	phys_addr_t rx_data_phys; /* bus address of the receive data port */
+
+	struct dma_chan *tx_chan; /* optional dma channel for writes */
+	struct dma_chan *rx_chan; /* optional dma channel for reads */
+
+	struct axis_fifo_ring_ctrl *ring; /* optional mmap()-able rx ring */
+	void *ring_slots; /* first slot of the rx ring */
+	size_t ring_size; /* size of the rx ring mapping in bytes */
+	spinlock_t ring_lock; /* lock for filling the rx ring */
+	unsigned int ring_users; /* vmas mapping the rx ring */
+	u32 ring_head; /* driver copy of ring->head */
+	bool ring_active; /* the rx ring receives the packets */
+
+	int read_timeout; /* ms to wait before read() times out */
+	int write_timeout; /* ms to wait before write() times out */
+
+	unsigned int rx_coalesce_packets; /* packets per reader wakeup */
+	unsigned int rx_coalesce_usecs; /* max delay of a coalesced wakeup */
+	unsigned int rx_coalesced; /* packets received since the last wakeup */
+	spinlock_t rx_coalesce_lock; /* lock for the coalescing state */
+	struct hrtimer rx_coalesce_timer; /* wakes the reader after a delay */
 
 	unsigned int rx_fifo_depth; /* max words in the receive fifo */
 	unsigned int tx_fifo_depth; /* max words in the transmit fifo */
@@ -137,8 +204,6 @@ struct axis_fifo {
 	spinlock_t read_queue_lock; /* lock for reading waitqueue */
 	wait_queue_head_t write_queue; /* wait queue for asynchronos write */
 	spinlock_t write_queue_lock; /* lock for writing waitqueue */
-	unsigned int write_flags; /* write file flags */
-	unsigned int read_flags; /* read file flags */
 
 	struct device *dt_device; /* device created from the device tree */
 	struct device *device; /* device associated with char_device */
@@ -320,6 +385,131 @@ static const struct attribute_group axis_fifo_attrs_group = {
 	.attrs = axis_fifo_attrs,
 };
 
+static ssize_t read_timeout_store(struct device *dev,
+				  struct device_attribute *attr,
+				  const char *buf, size_t count)
+{
+	struct axis_fifo *fifo = dev_get_drvdata(dev);
+	int tmp;
+	int rc;
+
+	rc = kstrtoint(buf, 0, &tmp);
+	if (rc < 0)
+		return rc;
+
+	WRITE_ONCE(fifo->read_timeout, tmp);
+
+	return count;
+}
+
+static ssize_t read_timeout_show(struct device *dev,
+				 struct device_attribute *attr, char *buf)
+{
+	struct axis_fifo *fifo = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%i\n", READ_ONCE(fifo->read_timeout));
+}
+
+static DEVICE_ATTR_RW(read_timeout);
+
+static ssize_t write_timeout_store(struct device *dev,
+				   struct device_attribute *attr,
+				   const char *buf, size_t count)
+{
+	struct axis_fifo *fifo = dev_get_drvdata(dev);
+	int tmp;
+	int rc;
+
+	rc = kstrtoint(buf, 0, &tmp);
+	if (rc < 0)
+		return rc;
+
+	WRITE_ONCE(fifo->write_timeout, tmp);
+
+	return count;
+}
+
+static ssize_t write_timeout_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct axis_fifo *fifo = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%i\n", READ_ONCE(fifo->write_timeout));
+}
+
+static DEVICE_ATTR_RW(write_timeout);
+
+static ssize_t rx_coalesce_packets_store(struct device *dev,
+					 struct device_attribute *attr,
+					 const char *buf, size_t count)
+{
+	struct axis_fifo *fifo = dev_get_drvdata(dev);
+	unsigned int tmp;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &tmp);
+	if (rc < 0)
+		return rc;
+
+	WRITE_ONCE(fifo->rx_coalesce_packets, tmp);
+
+	return count;
+}
+
+static ssize_t rx_coalesce_packets_show(struct device *dev,
+					struct device_attribute *attr,
+					char *buf)
+{
+	struct axis_fifo *fifo = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(fifo->rx_coalesce_packets));
+}
+
+static DEVICE_ATTR_RW(rx_coalesce_packets);
+
+static ssize_t rx_coalesce_usecs_store(struct device *dev,
+				       struct device_attribute *attr,
+				       const char *buf, size_t count)
+{
+	struct axis_fifo *fifo = dev_get_drvdata(dev);
+	unsigned int tmp;
+	int rc;
+
+	rc = kstrtouint(buf, 0, &tmp);
+	if (rc < 0)
+		return rc;
+
+	/* a coalesced wakeup must not be deferred until the next packet */
+	if (!tmp)
+		return -EINVAL;
+
+	WRITE_ONCE(fifo->rx_coalesce_usecs, tmp);
+
+	return count;
+}
+
+static ssize_t rx_coalesce_usecs_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct axis_fifo *fifo = dev_get_drvdata(dev);
+
+	return sprintf(buf, "%u\n", READ_ONCE(fifo->rx_coalesce_usecs));
+}
+
+static DEVICE_ATTR_RW(rx_coalesce_usecs);
+
+static struct attribute *axis_fifo_config_attrs[] = {
+	&dev_attr_read_timeout.attr,
+	&dev_attr_write_timeout.attr,
+	&dev_attr_rx_coalesce_packets.attr,
+	&dev_attr_rx_coalesce_usecs.attr,
+	NULL,
+};
+
+static const struct attribute_group axis_fifo_config_group = {
+	.attrs = axis_fifo_config_attrs,
+};
+
 /* ----------------------------
  *        implementation
  * ----------------------------
@@ -337,53 +527,295 @@ static void reset_ip_core(struct axis_fifo *fifo)
 	iowrite32(XLLF_INT_ALL_MASK, fifo->base_addr + XLLF_ISR_OFFSET);
 }
 
-/* reads a single packet from the fifo as dictated by the tlast signal */
-static ssize_t axis_fifo_read(struct file *f, char __user *buf,
-			      size_t len, loff_t *off)
+static void axis_fifo_dma_callback(void *param)
+{
+	complete(param);
+}
+
+/* moves a packet between a data port and pinned user pages with dma */
+static int axis_fifo_dma_user(struct axis_fifo *fifo, struct dma_chan *chan,
+			      enum dma_transfer_direction dir,
+			      unsigned long uaddr, size_t len)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct device *dma_dev = chan->device->dev;
+	enum dma_data_direction map_dir;
+	struct dma_async_tx_descriptor *desc;
+	struct dma_slave_config cfg = {};
+	unsigned int offset = offset_in_page(uaddr);
+	unsigned int nr_pages;
+	struct page **pages;
+	struct sg_table sgt;
+	int pinned;
+	int nents;
+	int rc;
+	int i;
+
+	map_dir = (dir == DMA_DEV_TO_MEM) ? DMA_FROM_DEVICE : DMA_TO_DEVICE;
+	nr_pages = DIV_ROUND_UP(offset + len, PAGE_SIZE);
+
+	pages = kmalloc_array(nr_pages, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+
+	pinned = get_user_pages_fast(uaddr & PAGE_MASK, nr_pages,
+				     (dir == DMA_DEV_TO_MEM) ? FOLL_WRITE : 0,
+				     pages);
+	if (pinned < 0) {
+		rc = pinned;
+		pinned = 0;
+		goto err_pages;
+	}
+	if (pinned != nr_pages) {
+		rc = -EFAULT;
+		goto err_pages;
+	}
+
+	rc = sg_alloc_table_from_pages(&sgt, pages, nr_pages, offset, len,
+				       GFP_KERNEL);
+	if (rc)
+		goto err_pages;
+
+	nents = dma_map_sg(dma_dev, sgt.sgl, sgt.orig_nents, map_dir);
+	if (!nents) {
+		rc = -EIO;
+		goto err_sgt;
+	}
+
+	cfg.direction = dir;
+	if (dir == DMA_DEV_TO_MEM) {
+		cfg.src_addr = fifo->rx_data_phys;
+		cfg.src_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES;
+		cfg.src_maxburst = DMA_MAXBURST;
+	} else {
+		cfg.dst_addr = fifo->tx_data_phys;
+		cfg.dst_addr_width = DMA_SLAVE_BUSWIDTH_4_BYTES;
+		cfg.dst_maxburst = DMA_MAXBURST;
+	}
+
+	rc = dmaengine_slave_config(chan, &cfg);
+	if (rc)
+		goto err_unmap;
+
+	desc = dmaengine_prep_slave_sg(chan, sgt.sgl, nents, dir,
+				       DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!desc) {
+		rc = -EIO;
+		goto err_unmap;
+	}
+
+	desc->callback = axis_fifo_dma_callback;
+	desc->callback_param = &done;
+
+	if (dma_submit_error(dmaengine_submit(desc))) {
+		rc = -EIO;
+		goto err_unmap;
+	}
+	dma_async_issue_pending(chan);
+
+	if (!wait_for_completion_timeout(&done,
+					 msecs_to_jiffies(DMA_TIMEOUT_MS))) {
+		dev_err(fifo->dt_device, "dma transfer timed out\n");
+		dmaengine_terminate_sync(chan);
+		rc = -ETIMEDOUT;
+	}
+
+err_unmap:
+	dma_unmap_sg(dma_dev, sgt.sgl, sgt.orig_nents, map_dir);
+err_sgt:
+	sg_free_table(&sgt);
+err_pages:
+	for (i = 0; i < pinned; i++) {
+		if (dir == DMA_DEV_TO_MEM && !rc)
+			set_page_dirty_lock(pages[i]);
+		put_page(pages[i]);
+	}
+	kfree(pages);
+	return rc;
+}
+
+/* whether a packet should be moved by dma rather than by the cpu */
+static bool axis_fifo_use_dma(struct dma_chan *chan, const void __user *buf,
+			      size_t len)
+{
+	return chan && dma_threshold >= 0 && len >= dma_threshold &&
+	       IS_ALIGNED((unsigned long)buf, sizeof(u32));
+}
+
+/* moves complete packets from the receive fifo into free ring slots,
+ * called with ring_lock held
+ */
+static void axis_fifo_ring_drain(struct axis_fifo *fifo)
+{
+	struct axis_fifo_ring_ctrl *ctrl = fifo->ring;
+	u32 head = fifo->ring_head;
+	u32 slot_size = ctrl->slot_size;
+	u32 nr_slots = ctrl->nr_slots;
+	u32 len;
+	u32 *slot;
+
+	while (ioread32(fifo->base_addr + XLLF_RDFO_OFFSET)) {
+		if (head - READ_ONCE(ctrl->tail) >= nr_slots)
+			break;
+
+		len = ioread32(fifo->base_addr + XLLF_RLR_OFFSET);
+		if (!len || len % sizeof(u32)) {
+			dev_err(fifo->dt_device, "received a packet of length %u - fifo core will be reset\n",
+				len);
+			reset_ip_core(fifo);
+			break;
+		}
+
+		if (len > slot_size - sizeof(u32)) {
+			/* too long for a slot, discard it */
+			for (len /= sizeof(u32); len; len--)
+				ioread32(fifo->rx_data);
+			ctrl->dropped++;
+			continue;
+		}
+
+		slot = fifo->ring_slots + (head % nr_slots) * slot_size;
+		ioread32_rep(fifo->rx_data, slot + 1, len / sizeof(u32));
+		slot[0] = len;
+
+		/* publish the slot contents before the new head */
+		head++;
+		smp_store_release(&ctrl->head, head);
+	}
+
+	fifo->ring_head = head;
+}
+
+static void axis_fifo_vm_open(struct vm_area_struct *vma)
+{
+	struct axis_fifo *fifo = vma->vm_private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&fifo->ring_lock, flags);
+	fifo->ring_users++;
+	spin_unlock_irqrestore(&fifo->ring_lock, flags);
+}
+
+static void axis_fifo_vm_close(struct vm_area_struct *vma)
+{
+	struct axis_fifo *fifo = vma->vm_private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&fifo->ring_lock, flags);
+	if (!--fifo->ring_users)
+		fifo->ring_active = false;
+	spin_unlock_irqrestore(&fifo->ring_lock, flags);
+}
+
+static const struct vm_operations_struct axis_fifo_vm_ops = {
+	.open = axis_fifo_vm_open,
+	.close = axis_fifo_vm_close,
+};
+
+/* maps the receive ring. While it is mapped, received packets go to the
+ * ring instead of read()
+ */
+static int axis_fifo_mmap(struct file *f, struct vm_area_struct *vma)
 {
 	struct axis_fifo *fifo = (struct axis_fifo *)f->private_data;
+	struct axis_fifo_ring_ctrl *ctrl = fifo->ring;
+	unsigned long flags;
+	int rc;
+
+	if (!ctrl)
+		return -ENODEV;
+
+	if (!(f->f_mode & FMODE_READ))
+		return -EACCES;
+
+	if (vma->vm_pgoff || vma->vm_end - vma->vm_start != fifo->ring_size)
+		return -EINVAL;
+
+	spin_lock_irqsave(&fifo->ring_lock, flags);
+	if (fifo->ring_users) {
+		spin_unlock_irqrestore(&fifo->ring_lock, flags);
+		return -EBUSY;
+	}
+	ctrl->head = 0;
+	ctrl->tail = 0;
+	ctrl->dropped = 0;
+	fifo->ring_head = 0;
+	fifo->ring_users = 1;
+	spin_unlock_irqrestore(&fifo->ring_lock, flags);
+
+	rc = remap_vmalloc_range(vma, fifo->ring, 0);
+	if (rc) {
+		spin_lock_irqsave(&fifo->ring_lock, flags);
+		fifo->ring_users = 0;
+		spin_unlock_irqrestore(&fifo->ring_lock, flags);
+		return rc;
+	}
+
+	vma->vm_flags |= VM_DONTCOPY;
+	vma->vm_ops = &axis_fifo_vm_ops;
+	vma->vm_private_data = fifo;
+
+	/* take over the packets that are already waiting */
+	spin_lock_irqsave(&fifo->ring_lock, flags);
+	fifo->ring_active = true;
+	axis_fifo_ring_drain(fifo);
+	spin_unlock_irqrestore(&fifo->ring_lock, flags);
+
+	return 0;
+}
+
+/* waits until the receive fifo holds a packet, unless nonblock is set */
+static int axis_fifo_wait_rx(struct axis_fifo *fifo, bool nonblock)
+{
+	int timeout = READ_ONCE(fifo->read_timeout);
+	int ret;
+
+	if (nonblock) {
+		/* return if there are no packets available */
+		if (!ioread32(fifo->base_addr + XLLF_RDFO_OFFSET))
+			return -EAGAIN;
+		return 0;
+	}
+
+	/* wait for a packet available interrupt (or timeout)
+	 * if nothing is currently available
+	 */
+	spin_lock_irq(&fifo->read_queue_lock);
+	ret = wait_event_interruptible_lock_irq_timeout
+		(fifo->read_queue,
+		 ioread32(fifo->base_addr + XLLF_RDFO_OFFSET),
+		 fifo->read_queue_lock,
+		 (timeout >= 0) ? msecs_to_jiffies(timeout) :
+			MAX_SCHEDULE_TIMEOUT);
+	spin_unlock_irq(&fifo->read_queue_lock);
+
+	if (ret == 0) {
+		/* timeout occurred */
+		dev_dbg(fifo->dt_device, "read timeout");
+		return -EAGAIN;
+	} else if (ret == -ERESTARTSYS) {
+		/* signal received */
+		return -ERESTARTSYS;
+	} else if (ret < 0) {
+		dev_err(fifo->dt_device, "wait_event_interruptible_timeout() error in read (ret=%i)\n",
+			ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+/* reads the packet at the head of the receive fifo into buf */
+static ssize_t axis_fifo_read_packet(struct axis_fifo *fifo, char __user *buf,
+				     size_t len)
+{
 	size_t bytes_available;
 	unsigned int words_available;
 	unsigned int copied;
 	unsigned int copy;
-	unsigned int i;
 	int ret;
 	u32 tmp_buf[READ_BUF_SIZE];
 
-	if (fifo->read_flags & O_NONBLOCK) {
-		/* opened in non-blocking mode
-		 * return if there are no packets available
-		 */
-		if (!ioread32(fifo->base_addr + XLLF_RDFO_OFFSET))
-			return -EAGAIN;
-	} else {
-		/* opened in blocking mode
-		 * wait for a packet available interrupt (or timeout)
-		 * if nothing is currently available
-		 */
-		spin_lock_irq(&fifo->read_queue_lock);
-		ret = wait_event_interruptible_lock_irq_timeout
-			(fifo->read_queue,
-			 ioread32(fifo->base_addr + XLLF_RDFO_OFFSET),
-			 fifo->read_queue_lock,
-			 (read_timeout >= 0) ? msecs_to_jiffies(read_timeout) :
-				MAX_SCHEDULE_TIMEOUT);
-		spin_unlock_irq(&fifo->read_queue_lock);
-
-		if (ret == 0) {
-			/* timeout occurred */
-			dev_dbg(fifo->dt_device, "read timeout");
-			return -EAGAIN;
-		} else if (ret == -ERESTARTSYS) {
-			/* signal received */
-			return -ERESTARTSYS;
-		} else if (ret < 0) {
-			dev_err(fifo->dt_device, "wait_event_interruptible_timeout() error in read (ret=%i)\n",
-				ret);
-			return ret;
-		}
-	}
-
 	bytes_available = ioread32(fifo->base_addr + XLLF_RLR_OFFSET);
 	if (!bytes_available) {
 		dev_err(fifo->dt_device, "received a packet of length 0 - fifo core will be reset\n");
@@ -407,6 +839,16 @@ static ssize_t axis_fifo_read(struct file *f, char __user *buf,
 		return -EIO;
 	}
 
+	if (axis_fifo_use_dma(fifo->rx_chan, buf, bytes_available)) {
+		ret = axis_fifo_dma_user(fifo, fifo->rx_chan, DMA_DEV_TO_MEM,
+					 (unsigned long)buf, bytes_available);
+		if (ret) {
+			reset_ip_core(fifo);
+			return ret;
+		}
+		return bytes_available;
+	}
+
 	words_available = bytes_available / sizeof(u32);
 
 	/* read data into an intermediate buffer, copying the contents
@@ -416,10 +858,7 @@ static ssize_t axis_fifo_read(struct file *f, char __user *buf,
 	while (words_available > 0) {
 		copy = min(words_available, READ_BUF_SIZE);
 
-		for (i = 0; i < copy; i++) {
-			tmp_buf[i] = ioread32(fifo->base_addr +
-					      XLLF_RDFD_OFFSET);
-		}
+		ioread32_rep(fifo->rx_data, tmp_buf, copy);
 
 		if (copy_to_user(buf + copied * sizeof(u32), tmp_buf,
 				 copy * sizeof(u32))) {
@@ -434,16 +873,70 @@ static ssize_t axis_fifo_read(struct file *f, char __user *buf,
 	return bytes_available;
 }
 
-static ssize_t axis_fifo_write(struct file *f, const char __user *buf,
-			       size_t len, loff_t *off)
+/* reads a single packet from the fifo as dictated by the tlast signal */
+static ssize_t axis_fifo_read(struct file *f, char __user *buf,
+			      size_t len, loff_t *off)
 {
 	struct axis_fifo *fifo = (struct axis_fifo *)f->private_data;
-	unsigned int words_to_write;
-	unsigned int copied;
-	unsigned int copy;
-	unsigned int i;
 	int ret;
-	u32 tmp_buf[WRITE_BUF_SIZE];
+
+	/* packets go to the mmap()-ed ring */
+	if (READ_ONCE(fifo->ring_active))
+		return -EBUSY;
+
+	ret = axis_fifo_wait_rx(fifo, f->f_flags & O_NONBLOCK);
+	if (ret)
+		return ret;
+
+	return axis_fifo_read_packet(fifo, buf, len);
+}
+
+/* reads one packet per iovec. Only the first packet is waited for, the
+ * call then drains what is already in the fifo. Every packet but the
+ * last one has to fill its iovec, so a packet shorter than its iovec
+ * ends the batch and the total length tells where the packets end.
+ */
+static ssize_t axis_fifo_read_iter(struct kiocb *iocb, struct iov_iter *to)
+{
+	struct axis_fifo *fifo = (struct axis_fifo *)iocb->ki_filp->private_data;
+	bool nonblock = (iocb->ki_filp->f_flags & O_NONBLOCK) ||
+			(iocb->ki_flags & IOCB_NOWAIT);
+	ssize_t total = 0;
+	ssize_t ret = 0;
+	unsigned long seg;
+
+	if (!iter_is_iovec(to))
+		return -EINVAL;
+
+	if (READ_ONCE(fifo->ring_active))
+		return -EBUSY;
+
+	for (seg = 0; seg < to->nr_segs; seg++) {
+		const struct iovec *iov = &to->iov[seg];
+
+		if (!iov->iov_len)
+			continue;
+
+		ret = axis_fifo_wait_rx(fifo, nonblock || total);
+		if (ret)
+			break;
+
+		ret = axis_fifo_read_packet(fifo, iov->iov_base, iov->iov_len);
+		if (ret < 0)
+			break;
+
+		total += ret;
+		if (ret < iov->iov_len)
+			break;
+	}
+
+	return total ? total : ret;
+}
+
+/* checks that a packet of len bytes can be sent, returns its word count */
+static int axis_fifo_check_packet(struct axis_fifo *fifo, size_t len)
+{
+	unsigned int words_to_write;
 
 	if (len % sizeof(u32)) {
 		dev_err(fifo->dt_device,
@@ -465,45 +958,77 @@ static ssize_t axis_fifo_write(struct file *f, const char __user *buf,
 		return -EINVAL;
 	}
 
-	if (fifo->write_flags & O_NONBLOCK) {
-		/* opened in non-blocking mode
-		 * return if there is not enough room available in the fifo
-		 */
-		if (words_to_write > ioread32(fifo->base_addr +
-					      XLLF_TDFV_OFFSET)) {
-			return -EAGAIN;
-		}
-	} else {
-		/* opened in blocking mode */
+	return words_to_write;
+}
 
-		/* wait for an interrupt (or timeout) if there isn't
-		 * currently enough room in the fifo
-		 */
-		spin_lock_irq(&fifo->write_queue_lock);
-		ret = wait_event_interruptible_lock_irq_timeout
-			(fifo->write_queue,
-			 ioread32(fifo->base_addr + XLLF_TDFV_OFFSET)
-				>= words_to_write,
-			 fifo->write_queue_lock,
-			 (write_timeout >= 0) ?
-				msecs_to_jiffies(write_timeout) :
-				MAX_SCHEDULE_TIMEOUT);
-		spin_unlock_irq(&fifo->write_queue_lock);
-
-		if (ret == 0) {
-			/* timeout occurred */
-			dev_dbg(fifo->dt_device, "write timeout\n");
+/* waits until the transmit fifo has room for words, unless nonblock is
+ * set
+ */
+static int axis_fifo_wait_tx(struct axis_fifo *fifo, bool nonblock,
+			     unsigned int words)
+{
+	int timeout = READ_ONCE(fifo->write_timeout);
+	int ret;
+
+	if (nonblock) {
+		/* return if there is not enough room available in the fifo */
+		if (words > ioread32(fifo->base_addr + XLLF_TDFV_OFFSET))
 			return -EAGAIN;
-		} else if (ret == -ERESTARTSYS) {
-			/* signal received */
-			return -ERESTARTSYS;
-		} else if (ret < 0) {
-			/* unknown error */
-			dev_err(fifo->dt_device,
-				"wait_event_interruptible_timeout() error in write (ret=%i)\n",
-				ret);
+		return 0;
+	}
+
+	/* wait for an interrupt (or timeout) if there isn't
+	 * currently enough room in the fifo
+	 */
+	spin_lock_irq(&fifo->write_queue_lock);
+	ret = wait_event_interruptible_lock_irq_timeout
+		(fifo->write_queue,
+		 ioread32(fifo->base_addr + XLLF_TDFV_OFFSET)
+			>= words,
+		 fifo->write_queue_lock,
+		 (timeout >= 0) ?
+			msecs_to_jiffies(timeout) :
+			MAX_SCHEDULE_TIMEOUT);
+	spin_unlock_irq(&fifo->write_queue_lock);
+
+	if (ret == 0) {
+		/* timeout occurred */
+		dev_dbg(fifo->dt_device, "write timeout\n");
+		return -EAGAIN;
+	} else if (ret == -ERESTARTSYS) {
+		/* signal received */
+		return -ERESTARTSYS;
+	} else if (ret < 0) {
+		/* unknown error */
+		dev_err(fifo->dt_device,
+			"wait_event_interruptible_timeout() error in write (ret=%i)\n",
+			ret);
+		return ret;
+	}
+
+	return 0;
+}
+
+/* writes buf as one packet, the fifo must have room for it */
+static ssize_t axis_fifo_write_packet(struct axis_fifo *fifo,
+				      const char __user *buf,
+				      unsigned int words_to_write)
+{
+	unsigned int copied;
+	unsigned int copy;
+	size_t len = words_to_write * sizeof(u32);
+	int ret;
+	u32 tmp_buf[WRITE_BUF_SIZE];
+
+	if (axis_fifo_use_dma(fifo->tx_chan, buf, len)) {
+		ret = axis_fifo_dma_user(fifo, fifo->tx_chan, DMA_MEM_TO_DEV,
+					 (unsigned long)buf, len);
+		if (ret) {
+			reset_ip_core(fifo);
 			return ret;
 		}
+		iowrite32(len, fifo->base_addr + XLLF_TLR_OFFSET);
+		return len;
 	}
 
 	/* write data from an intermediate buffer into the fifo IP, refilling
@@ -519,9 +1044,7 @@ static ssize_t axis_fifo_write(struct file *f, const char __user *buf,
 			return -EFAULT;
 		}
 
-		for (i = 0; i < copy; i++)
-			iowrite32(tmp_buf[i], fifo->base_addr +
-				  XLLF_TDFD_OFFSET);
+		iowrite32_rep(fifo->tx_data, tmp_buf, copy);
 
 		copied += copy;
 		words_to_write -= copy;
@@ -533,6 +1056,145 @@ static ssize_t axis_fifo_write(struct file *f, const char __user *buf,
 	return (ssize_t)copied * sizeof(u32);
 }
 
+static ssize_t axis_fifo_write(struct file *f, const char __user *buf,
+			       size_t len, loff_t *off)
+{
+	struct axis_fifo *fifo = (struct axis_fifo *)f->private_data;
+	int words_to_write;
+	int ret;
+
+	words_to_write = axis_fifo_check_packet(fifo, len);
+	if (words_to_write < 0)
+		return words_to_write;
+
+	ret = axis_fifo_wait_tx(fifo, f->f_flags & O_NONBLOCK, words_to_write);
+	if (ret)
+		return ret;
+
+	return axis_fifo_write_packet(fifo, buf, words_to_write);
+}
+
+/* writes one packet per iovec. Only the first packet is waited for, the
+ * batch ends early once the fifo runs out of room.
+ */
+static ssize_t axis_fifo_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+	struct axis_fifo *fifo = (struct axis_fifo *)iocb->ki_filp->private_data;
+	bool nonblock = (iocb->ki_filp->f_flags & O_NONBLOCK) ||
+			(iocb->ki_flags & IOCB_NOWAIT);
+	ssize_t total = 0;
+	ssize_t ret = 0;
+	unsigned long seg;
+
+	if (!iter_is_iovec(from))
+		return -EINVAL;
+
+	for (seg = 0; seg < from->nr_segs; seg++) {
+		const struct iovec *iov = &from->iov[seg];
+		int words_to_write;
+
+		if (!iov->iov_len)
+			continue;
+
+		words_to_write = axis_fifo_check_packet(fifo, iov->iov_len);
+		if (words_to_write < 0) {
+			ret = words_to_write;
+			break;
+		}
+
+		ret = axis_fifo_wait_tx(fifo, nonblock || total,
+					words_to_write);
+		if (ret)
+			break;
+
+		ret = axis_fifo_write_packet(fifo, iov->iov_base,
+					     words_to_write);
+		if (ret < 0)
+			break;
+
+		total += ret;
+	}
+
+	return total ? total : ret;
+}
+
+static __poll_t axis_fifo_poll(struct file *f, poll_table *wait)
+{
+	struct axis_fifo *fifo = (struct axis_fifo *)f->private_data;
+	__poll_t mask = 0;
+
+	if (fifo->has_rx_fifo && (f->f_mode & FMODE_READ)) {
+		poll_wait(f, &fifo->read_queue, wait);
+		if (READ_ONCE(fifo->ring_active)) {
+			unsigned long flags;
+
+			/* refill slots userspace has freed since the irq */
+			spin_lock_irqsave(&fifo->ring_lock, flags);
+			if (fifo->ring_active) {
+				axis_fifo_ring_drain(fifo);
+				if (fifo->ring_head != READ_ONCE(fifo->ring->tail))
+					mask |= EPOLLIN | EPOLLRDNORM;
+			}
+			spin_unlock_irqrestore(&fifo->ring_lock, flags);
+		} else if (ioread32(fifo->base_addr + XLLF_RDFO_OFFSET)) {
+			mask |= EPOLLIN | EPOLLRDNORM;
+		}
+	}
+
+	if (fifo->has_tx_fifo && (f->f_mode & FMODE_WRITE)) {
+		poll_wait(f, &fifo->write_queue, wait);
+		if (ioread32(fifo->base_addr + XLLF_TDFV_OFFSET))
+			mask |= EPOLLOUT | EPOLLWRNORM;
+	}
+
+	return mask;
+}
+
+static enum hrtimer_restart axis_fifo_coalesce_timer(struct hrtimer *timer)
+{
+	struct axis_fifo *fifo = container_of(timer, struct axis_fifo,
+					      rx_coalesce_timer);
+	unsigned long flags;
+
+	spin_lock_irqsave(&fifo->rx_coalesce_lock, flags);
+	fifo->rx_coalesced = 0;
+	spin_unlock_irqrestore(&fifo->rx_coalesce_lock, flags);
+
+	wake_up(&fifo->read_queue);
+
+	return HRTIMER_NORESTART;
+}
+
+/* wakes the reader on every rx_coalesce_packets-th packet, or once
+ * rx_coalesce_usecs have passed since the first packet it wasn't woken for
+ */
+static void axis_fifo_rx_wakeup(struct axis_fifo *fifo)
+{
+	unsigned int packets = READ_ONCE(fifo->rx_coalesce_packets);
+	bool wake = false;
+
+	if (packets <= 1) {
+		wake_up(&fifo->read_queue);
+		return;
+	}
+
+	spin_lock(&fifo->rx_coalesce_lock);
+	if (++fifo->rx_coalesced >= packets) {
+		fifo->rx_coalesced = 0;
+		wake = true;
+	} else if (fifo->rx_coalesced == 1) {
+		hrtimer_start(&fifo->rx_coalesce_timer,
+			      us_to_ktime(READ_ONCE(fifo->rx_coalesce_usecs)),
+			      HRTIMER_MODE_REL);
+	}
+	spin_unlock(&fifo->rx_coalesce_lock);
+
+	if (wake) {
+		hrtimer_try_to_cancel(&fifo->rx_coalesce_timer);
+		wake_up(&fifo->read_queue);
+	}
+}
+
 static irqreturn_t axis_fifo_irq(int irq, void *dw)
 {
 	struct axis_fifo *fifo = (struct axis_fifo *)dw;
@@ -546,12 +1208,20 @@ static irqreturn_t axis_fifo_irq(int irq, void *dw)
 		if (pending_interrupts & XLLF_INT_RC_MASK) {
 			/* packet received */
 
-			/* wake the reader process if it is waiting */
-			wake_up(&fifo->read_queue);
-
 			/* clear interrupt */
 			iowrite32(XLLF_INT_RC_MASK & XLLF_INT_ALL_MASK,
 				  fifo->base_addr + XLLF_ISR_OFFSET);
+
+			/* fill the rx ring if it is mapped */
+			if (READ_ONCE(fifo->ring_active)) {
+				spin_lock(&fifo->ring_lock);
+				if (fifo->ring_active)
+					axis_fifo_ring_drain(fifo);
+				spin_unlock(&fifo->ring_lock);
+			}
+
+			/* wake the reader process if it is waiting */
+			axis_fifo_rx_wakeup(fifo);
 		} else if (pending_interrupts & XLLF_INT_TC_MASK) {
 			/* packet sent */
 
@@ -647,9 +1317,7 @@ static int axis_fifo_open(struct inode *inod, struct file *f)
 
 	if (((f->f_flags & O_ACCMODE) == O_WRONLY) ||
 	    ((f->f_flags & O_ACCMODE) == O_RDWR)) {
-		if (fifo->has_tx_fifo) {
-			fifo->write_flags = f->f_flags;
-		} else {
+		if (!fifo->has_tx_fifo) {
 			dev_err(fifo->dt_device, "tried to open device for write but the transmit fifo is disabled\n");
 			return -EPERM;
 		}
@@ -657,9 +1325,7 @@ static int axis_fifo_open(struct inode *inod, struct file *f)
 
 	if (((f->f_flags & O_ACCMODE) == O_RDONLY) ||
 	    ((f->f_flags & O_ACCMODE) == O_RDWR)) {
-		if (fifo->has_rx_fifo) {
-			fifo->read_flags = f->f_flags;
-		} else {
+		if (!fifo->has_rx_fifo) {
 			dev_err(fifo->dt_device, "tried to open device for read but the receive fifo is disabled\n");
 			return -EPERM;
 		}
@@ -680,7 +1346,11 @@ static const struct file_operations fops = {
 	.open = axis_fifo_open,
 	.release = axis_fifo_close,
 	.read = axis_fifo_read,
-	.write = axis_fifo_write
+	.write = axis_fifo_write,
+	.read_iter = axis_fifo_read_iter,
+	.write_iter = axis_fifo_write_iter,
+	.poll = axis_fifo_poll,
+	.mmap = axis_fifo_mmap,
 };
 
 /* read named property from the device tree */
@@ -758,6 +1428,17 @@ static int axis_fifo_probe(struct platform_device *pdev)
 
 	spin_lock_init(&fifo->read_queue_lock);
 	spin_lock_init(&fifo->write_queue_lock);
+	spin_lock_init(&fifo->ring_lock);
+	spin_lock_init(&fifo->rx_coalesce_lock);
+
+	fifo->read_timeout = read_timeout;
+	fifo->write_timeout = write_timeout;
+	fifo->rx_coalesce_packets = 1;
+	fifo->rx_coalesce_usecs = RX_COALESCE_USECS;
+	fifo->rx_coalesced = 0;
+	hrtimer_init(&fifo->rx_coalesce_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	fifo->rx_coalesce_timer.function = axis_fifo_coalesce_timer;
 
 	/* ----------------------------
 	 *   init device memory space
@@ -953,11 +1634,48 @@ static int axis_fifo_probe(struct platform_device *pdev)
 	}
 
 	/* TODO
-	 * these exist in the device tree but it's unclear what they do
+	 * this exists in the device tree but it's unclear what it does
 	 * - select-xpm
-	 * - data-interface-type
 	 */
 
+	/* the data ports sit in the AXI4-Lite register space unless the IP
+	 * has the AXI4 (full) data interface, which has its own address
+	 * range and accepts bursts
+	 */
+	fifo->tx_data = fifo->base_addr + XLLF_TDFD_OFFSET;
+	fifo->rx_data = fifo->base_addr + XLLF_RDFD_OFFSET;
+	fifo->tx_data_phys = fifo->mem->start + XLLF_TDFD_OFFSET;
+	fifo->rx_data_phys = fifo->mem->start + XLLF_RDFD_OFFSET;
+
+	if (data_interface_type == 1) {
+		struct resource *r_axi4;
+		void __iomem *axi4_base;
+
+		r_axi4 = platform_get_resource(pdev, IORESOURCE_MEM, 1);
+		if (!r_axi4) {
+			dev_err(fifo->dt_device, "AXI4 data interface needs a second reg entry\n");
+			rc = -ENODEV;
+			goto err_unmap;
+		}
+
+		axi4_base = devm_ioremap_resource(dev, r_axi4);
+		if (IS_ERR(axi4_base)) {
+			rc = PTR_ERR(axi4_base);
+			goto err_unmap;
+		}
+
+		fifo->tx_data = axi4_base + XLLF_AXI4_TDFD_OFFSET;
+		fifo->rx_data = axi4_base + XLLF_AXI4_RDFD_OFFSET;
+		fifo->tx_data_phys = r_axi4->start + XLLF_AXI4_TDFD_OFFSET;
+		fifo->rx_data_phys = r_axi4->start + XLLF_AXI4_RDFD_OFFSET;
+	} else if (data_interface_type != 0) {
+		dev_err(fifo->dt_device,
+			"data interface type [%u] unsupported\n",
+			data_interface_type);
+		rc = -EIO;
+		goto err_unmap;
+	}
+
 	/* set device wrapper properties based on IP config */
 	fifo->rx_fifo_depth = rx_fifo_depth;
 	/* IP sets TDFV to fifo depth - 4 so we will do the same */
@@ -967,6 +1685,68 @@ static int axis_fifo_probe(struct platform_device *pdev)
 
 	reset_ip_core(fifo);
 
+	/* ----------------------------
+	 *   init optional dma channels
+	 * ----------------------------
+	 */
+
+	fifo->tx_chan = NULL;
+	fifo->rx_chan = NULL;
+	if (of_property_read_bool(dev->of_node, "dmas")) {
+		if (fifo->has_tx_fifo) {
+			fifo->tx_chan = dma_request_chan(dev, "tx");
+			if (IS_ERR(fifo->tx_chan)) {
+				rc = PTR_ERR(fifo->tx_chan);
+				fifo->tx_chan = NULL;
+				if (rc == -EPROBE_DEFER)
+					goto err_unmap;
+				dev_warn(fifo->dt_device, "no tx dma channel (%i), using pio\n",
+					 rc);
+			}
+		}
+		if (fifo->has_rx_fifo) {
+			fifo->rx_chan = dma_request_chan(dev, "rx");
+			if (IS_ERR(fifo->rx_chan)) {
+				rc = PTR_ERR(fifo->rx_chan);
+				fifo->rx_chan = NULL;
+				if (rc == -EPROBE_DEFER)
+					goto err_dma;
+				dev_warn(fifo->dt_device, "no rx dma channel (%i), using pio\n",
+					 rc);
+			}
+		}
+		rc = 0;
+	}
+
+	/* ----------------------------
+	 *    init optional rx ring
+	 * ----------------------------
+	 */
+
+	fifo->ring = NULL;
+	fifo->ring_users = 0;
+	fifo->ring_active = false;
+	if (rx_ring_slots && fifo->has_rx_fifo) {
+		if (rx_ring_slot_size < 2 * sizeof(u32) ||
+		    rx_ring_slot_size % sizeof(u32)) {
+			dev_err(fifo->dt_device, "rx ring slot size [%u] must be a multiple of 4 of at least 8\n",
+				rx_ring_slot_size);
+			rc = -EINVAL;
+			goto err_dma;
+		}
+
+		fifo->ring_size = PAGE_ALIGN(PAGE_SIZE + (size_t)rx_ring_slots *
+					     rx_ring_slot_size);
+		fifo->ring = vmalloc_user(fifo->ring_size);
+		if (!fifo->ring) {
+			rc = -ENOMEM;
+			goto err_dma;
+		}
+		fifo->ring_slots = (void *)fifo->ring + PAGE_SIZE;
+		fifo->ring->nr_slots = rx_ring_slots;
+		fifo->ring->slot_size = rx_ring_slot_size;
+	}
+
 	/* ----------------------------
 	 *    init device interrupts
 	 * ----------------------------
@@ -978,7 +1758,7 @@ static int axis_fifo_probe(struct platform_device *pdev)
 		dev_err(fifo->dt_device, "no IRQ found for 0x%pa\n",
 			&fifo->mem->start);
 		rc = -EIO;
-		goto err_unmap;
+		goto err_ring;
 	}
 
 	/* request IRQ */
@@ -987,7 +1767,7 @@ static int axis_fifo_probe(struct platform_device *pdev)
 	if (rc) {
 		dev_err(fifo->dt_device, "couldn't allocate interrupt %i\n",
 			fifo->irq);
-		goto err_unmap;
+		goto err_ring;
 	}
 
 	/* ----------------------------
@@ -1028,12 +1808,20 @@ static int axis_fifo_probe(struct platform_device *pdev)
 		goto err_cdev;
 	}
 
+	rc = sysfs_create_group(&fifo->device->kobj, &axis_fifo_config_group);
+	if (rc < 0) {
+		dev_err(fifo->dt_device, "couldn't register sysfs group\n");
+		goto err_sysfs;
+	}
+
 	dev_info(fifo->dt_device, "axis-fifo created at %pa mapped to 0x%pa, irq=%i, major=%i, minor=%i\n",
 		 &fifo->mem->start, &fifo->base_addr, fifo->irq,
 		 MAJOR(fifo->devt), MINOR(fifo->devt));
 
 	return 0;
 
+err_sysfs:
+	sysfs_remove_group(&fifo->device->kobj, &axis_fifo_attrs_group);
 err_cdev:
 	cdev_del(&fifo->char_device);
 err_dev:
@@ -1042,6 +1830,14 @@ static int axis_fifo_probe(struct platform_device *pdev)
 	unregister_chrdev_region(fifo->devt, 1);
 err_irq:
 	free_irq(fifo->irq, fifo);
+	hrtimer_cancel(&fifo->rx_coalesce_timer);
+err_ring:
+	vfree(fifo->ring);
+err_dma:
+	if (fifo->rx_chan)
+		dma_release_channel(fifo->rx_chan);
+	if (fifo->tx_chan)
+		dma_release_channel(fifo->tx_chan);
 err_unmap:
 	iounmap(fifo->base_addr);
 err_mem:
@@ -1056,12 +1852,19 @@ static int axis_fifo_remove(struct platform_device *pdev)
 	struct device *dev = &pdev->dev;
 	struct axis_fifo *fifo = dev_get_drvdata(dev);
 
+	sysfs_remove_group(&fifo->device->kobj, &axis_fifo_config_group);
 	sysfs_remove_group(&fifo->device->kobj, &axis_fifo_attrs_group);
 	cdev_del(&fifo->char_device);
 	dev_set_drvdata(fifo->device, NULL);
 	device_destroy(axis_fifo_driver_class, fifo->devt);
 	unregister_chrdev_region(fifo->devt, 1);
 	free_irq(fifo->irq, fifo);
+	hrtimer_cancel(&fifo->rx_coalesce_timer);
+	vfree(fifo->ring);
+	if (fifo->rx_chan)
+		dma_release_channel(fifo->rx_chan);
+	if (fifo->tx_chan)
+		dma_release_channel(fifo->tx_chan);
 	iounmap(fifo->base_addr);
 	release_mem_region(fifo->mem->start, resource_size(fifo->mem));
 	dev_set_drvdata(dev, NULL);
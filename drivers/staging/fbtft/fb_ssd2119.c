@@ -60,26 +60,45 @@ static int init_display(struct fbtft_par *par)
 	return 0;
 }
 
+/* Set the GDDRAM window. The address counter wraps within it. */
+static void set_window(struct fbtft_par *par, int hs, int he, int vs, int ve)
+{
+	/* R44h - Vertical RAM address position (end, start) */
+	write_reg(par, 0x44, (ve << 8) | vs);
+	/* R45h - Horizontal RAM address start position */
+	write_reg(par, 0x45, hs);
+	/* R46h - Horizontal RAM address end position */
+	write_reg(par, 0x46, he);
+}
+
 static void set_addr_win(struct fbtft_par *par, int xs, int ys, int xe, int ye)
 {
+	int xres = par->info->var.xres;
+	int yres = par->info->var.yres;
+
 	switch (par->info->var.rotate) {
 	/* R4Eh - Set GDDRAM X address counter */
 	/* R4Fh - Set GDDRAM Y address counter */
 	case 0:
+		set_window(par, xs, xe, ys, ye);
 		write_reg(par, 0x4e, xs);
 		write_reg(par, 0x4f, ys);
 		break;
 	case 180:
-		write_reg(par, 0x4e, par->info->var.xres - 1 - xs);
-		write_reg(par, 0x4f, par->info->var.yres - 1 - ys);
+		set_window(par, xres - 1 - xe, xres - 1 - xs,
+			   yres - 1 - ye, yres - 1 - ys);
+		write_reg(par, 0x4e, xres - 1 - xs);
+		write_reg(par, 0x4f, yres - 1 - ys);
 		break;
 	case 270:
-		write_reg(par, 0x4e, par->info->var.yres - 1 - ys);
+		set_window(par, yres - 1 - ye, yres - 1 - ys, xs, xe);
+		write_reg(par, 0x4e, yres - 1 - ys);
 		write_reg(par, 0x4f, xs);
 		break;
 	case 90:
+		set_window(par, ys, ye, xres - 1 - xe, xres - 1 - xs);
 		write_reg(par, 0x4e, ys);
-		write_reg(par, 0x4f, par->info->var.xres - 1 - xs);
+		write_reg(par, 0x4f, xres - 1 - xs);
 		break;
 	}
 
@@ -125,6 +144,7 @@ static struct fbtft_display display = {
 	.regwidth = 16,
 	.width = 320,
 	.height = 240,
+	.addr_win_cols = true,
 	.fbtftops = {
 		.init_display = init_display,
 		.set_addr_win = set_addr_win,
@@ -3,6 +3,9 @@
 #include <linux/errno.h>
 #include <linux/gpio/consumer.h>
 #include <linux/spi/spi.h>
+#ifdef CONFIG_KERNEL_MODE_NEON
+#include <asm/neon.h>
+#endif
 #include "fbtft.h"
 
 /*****************************************************************************
@@ -117,6 +120,59 @@ EXPORT_SYMBOL(fbtft_write_reg8_bus9);
  *
  *****************************************************************************/
 
+#if defined(CONFIG_KERNEL_MODE_NEON) && defined(__LITTLE_ENDIAN)
+/* Pixels per kernel_neon_begin(). Keeps the preemption latency down. */
+#define FBTFT_NEON_CHUNK 2048
+
+/* See fbtft-neon.c */
+void fbtft_neon_swab16(u16 *dst, const u16 *src, unsigned int n);
+
+static void fbtft_copy_be16(__be16 *dst, const u16 *src, size_t n)
+{
+	size_t chunk;
+	size_t i;
+
+	if (!cpu_has_neon()) {
+		for (i = 0; i < n; i++)
+			dst[i] = cpu_to_be16(src[i]);
+		return;
+	}
+
+	while (n) {
+		chunk = min_t(size_t, n, FBTFT_NEON_CHUNK);
+		kernel_neon_begin();
+		fbtft_neon_swab16((u16 *)dst, src, chunk);
+		kernel_neon_end();
+		dst += chunk;
+		src += chunk;
+		n -= chunk;
+	}
+}
+#else
+static void fbtft_copy_be16(__be16 *dst, const u16 *src, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		dst[i] = cpu_to_be16(src[i]);
+}
+#endif
+
+/*
+ * Largest chunk (in bytes) that fits in a single transfer. The chunks are
+ * as large as the transmit buffer allows (see the "txbuflen" module
+ * parameter) unless the SPI controller has a lower limit.
+ */
+static size_t fbtft_vmem_chunk_len(struct fbtft_par *par)
+{
+	size_t len = par->txbuf.len;
+
+	if (par->spi)
+		len = min(len, spi_max_transfer_size(par->spi));
+
+	return len;
+}
+
 /* 16 bit pixel over 8-bit databus */
 int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 {
@@ -125,7 +181,6 @@ int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 	size_t remain;
 	size_t to_copy;
 	size_t tx_array_size;
-	int i;
 	int ret = 0;
 	size_t startbyte_size = 0;
 
@@ -143,7 +198,7 @@ int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 		return par->fbtftops.write(par, vmem16, len);
 
 	/* buffered write */
-	tx_array_size = par->txbuf.len / 2;
+	tx_array_size = fbtft_vmem_chunk_len(par) / 2;
 
 	if (par->startbyte) {
 		txbuf16 = par->txbuf.buf + 1;
@@ -157,8 +212,7 @@ int fbtft_write_vmem16_bus8(struct fbtft_par *par, size_t offset, size_t len)
 		dev_dbg(par->info->device, "to_copy=%zu, remain=%zu\n",
 			to_copy, remain - to_copy);
 
-		for (i = 0; i < to_copy; i++)
-			txbuf16[i] = cpu_to_be16(vmem16[i]);
+		fbtft_copy_be16(txbuf16, vmem16, to_copy);
 
 		vmem16 = vmem16 + to_copy;
 		ret = par->fbtftops.write(par, par->txbuf.buf,
@@ -194,7 +248,7 @@ int fbtft_write_vmem16_bus9(struct fbtft_par *par, size_t offset, size_t len)
 	remain = len;
 	vmem8 = par->info->screen_buffer + offset;
 
-	tx_array_size = par->txbuf.len / 2;
+	tx_array_size = fbtft_vmem_chunk_len(par) / 2;
 
 	while (remain) {
 		to_copy = min(tx_array_size, remain);
@@ -33,14 +33,23 @@ static unsigned long debug;
 module_param(debug, ulong, 0000);
 MODULE_PARM_DESC(debug, "override device debug level");
 
+static int default_txbuflen;
+module_param_named(txbuflen, default_txbuflen, int, 0000);
+MODULE_PARM_DESC(txbuflen,
+		 "default transmit buffer length (-1 for the whole video memory)");
+
 int fbtft_write_buf_dc(struct fbtft_par *par, void *buf, size_t len, int dc)
 {
 	int ret;
 
 	if (par->gpio.dc)
 		gpiod_set_value(par->gpio.dc, dc);
+	/* The bus bridge drives DC itself (see fbtft_write_bus8()) */
+	par->bus_dc = dc;
 
 	ret = par->fbtftops.write(par, buf, len);
+	/* Those that set the DC GPIO themselves only ever write data */
+	par->bus_dc = 1;
 	if (ret < 0)
 		dev_err(par->info->device,
 			"write() failed and returned %d\n", ret);
@@ -92,6 +101,40 @@ static int fbtft_request_one_gpio(struct fbtft_par *par,
 	return ret;
 }
 
+/*
+ * Request the data bus as one array. This way, fbtft_write_gpio8_wr() and
+ * fbtft_write_gpio16_wr() set all data lines with a single
+ * gpiod_set_array_value() call. If the lines are on the same chip, in order,
+ * that is a single register write.
+ */
+static int fbtft_request_db_gpios(struct fbtft_par *par)
+{
+	struct device *dev = par->info->device;
+	struct gpio_descs *db;
+	int ret;
+	int i;
+
+	db = devm_gpiod_get_array_optional(dev, "db", GPIOD_OUT_HIGH);
+	if (IS_ERR(db)) {
+		ret = PTR_ERR(db);
+		dev_err(dev, "Failed to request db GPIOs: %d\n", ret);
+		return ret;
+	}
+	if (!db)
+		return 0;
+	if (db->ndescs > ARRAY_SIZE(par->gpio.db)) {
+		dev_err(dev, "Too many db GPIOs: %u\n", db->ndescs);
+		return -EINVAL;
+	}
+	for (i = 0; i < db->ndescs; i++)
+		par->gpio.db[i] = db->desc[i];
+	par->gpio.db_array = db;
+	fbtft_par_dbg(DEBUG_REQUEST_GPIOS, par, "%s: %u 'db' GPIOs\n",
+		      __func__, db->ndescs);
+
+	return 0;
+}
+
 static int fbtft_request_gpios_dt(struct fbtft_par *par)
 {
 	int i;
@@ -116,13 +159,12 @@ static int fbtft_request_gpios_dt(struct fbtft_par *par)
 	if (ret)
 		return ret;
 	ret = fbtft_request_one_gpio(par, "latch", 0, &par->gpio.latch);
+	if (ret)
+		return ret;
+	ret = fbtft_request_db_gpios(par);
 	if (ret)
 		return ret;
 	for (i = 0; i < 16; i++) {
-		ret = fbtft_request_one_gpio(par, "db", i,
-					     &par->gpio.db[i]);
-		if (ret)
-			return ret;
 		ret = fbtft_request_one_gpio(par, "led", i,
 					     &par->gpio.led[i]);
 		if (ret)
@@ -228,8 +270,11 @@ static void fbtft_set_addr_win(struct fbtft_par *par, int xs, int ys, int xe,
 
 static void fbtft_reset(struct fbtft_par *par)
 {
-	if (!par->gpio.reset)
+	if (!par->gpio.reset) {
+		if (par->bus_base)
+			fbtft_bus_reset(par);
 		return;
+	}
 	fbtft_par_dbg(DEBUG_RESET, par, "%s()\n", __func__);
 	gpiod_set_value_cansleep(par->gpio.reset, 1);
 	usleep_range(20, 40);
@@ -237,10 +282,18 @@ static void fbtft_reset(struct fbtft_par *par)
 	msleep(120);
 }
 
-static void fbtft_update_display(struct fbtft_par *par, unsigned int start_line,
-				 unsigned int end_line)
+/*
+ * Update the rectangle from (xs, start_line) to (xe, end_line) (both
+ * inclusive). Without par->addr_win_cols, xs and xe must span the full
+ * display width.
+ */
+static void fbtft_update_rect(struct fbtft_par *par, unsigned int xs,
+			      unsigned int start_line, unsigned int xe,
+			      unsigned int end_line)
 {
-	size_t offset, len;
+	size_t offset, len, row_len;
+	unsigned int bytes_per_pixel = par->info->var.bits_per_pixel / 8;
+	unsigned int y;
 	ktime_t ts_start, ts_end;
 	long fps, throughput;
 	bool timeit = false;
@@ -273,17 +326,34 @@ static void fbtft_update_display(struct fbtft_par *par, unsigned int start_line,
 		start_line = 0;
 		end_line = par->info->var.yres - 1;
 	}
+	if (xs > xe || xe > par->info->var.xres - 1) {
+		xs = 0;
+		xe = par->info->var.xres - 1;
+	}
 
-	fbtft_par_dbg(DEBUG_UPDATE_DISPLAY, par, "%s(start_line=%u, end_line=%u)\n",
-		      __func__, start_line, end_line);
+	fbtft_par_dbg(DEBUG_UPDATE_DISPLAY, par,
+		      "%s(xs=%u, start_line=%u, xe=%u, end_line=%u)\n",
+		      __func__, xs, start_line, xe, end_line);
 
 	if (par->fbtftops.set_addr_win)
-		par->fbtftops.set_addr_win(par, 0, start_line,
-				par->info->var.xres - 1, end_line);
-
-	offset = start_line * par->info->fix.line_length;
-	len = (end_line - start_line + 1) * par->info->fix.line_length;
-	ret = par->fbtftops.write_vmem(par, offset, len);
+		par->fbtftops.set_addr_win(par, xs, start_line, xe, end_line);
+
+	if (xs == 0 && xe == par->info->var.xres - 1) {
+		/* Full lines are contiguous in video memory */
+		offset = start_line * par->info->fix.line_length;
+		len = (end_line - start_line + 1) * par->info->fix.line_length;
+		ret = par->fbtftops.write_vmem(par, offset, len);
+	} else {
+		/* The controller wraps at the end of the column window */
+		row_len = (xe - xs + 1) * bytes_per_pixel;
+		len = 0;
+		for (y = start_line; y <= end_line && ret >= 0; y++) {
+			offset = y * par->info->fix.line_length +
+				 xs * bytes_per_pixel;
+			ret = par->fbtftops.write_vmem(par, offset, row_len);
+			len += row_len;
+		}
+	}
 	if (ret < 0)
 		dev_err(par->info->device,
 			"%s: write_vmem failed to update display buffer\n",
@@ -309,7 +379,15 @@ static void fbtft_update_display(struct fbtft_par *par, unsigned int start_line,
 	}
 }
 
-static void fbtft_mkdirty(struct fb_info *info, int y, int height)
+static void fbtft_update_display(struct fbtft_par *par, unsigned int start_line,
+				 unsigned int end_line)
+{
+	fbtft_update_rect(par, 0, start_line, par->info->var.xres - 1,
+			  end_line);
+}
+
+static void fbtft_mkdirty_rect(struct fb_info *info, int x, int y, int width,
+			       int height)
 {
 	struct fbtft_par *par = info->par;
 	struct fb_deferred_io *fbdefio = info->fbdefio;
@@ -318,24 +396,55 @@ static void fbtft_mkdirty(struct fb_info *info, int y, int height)
 	if (y == -1) {
 		y = 0;
 		height = info->var.yres - 1;
+		x = 0;
+		width = info->var.xres;
+	}
+
+	/* Without a column window, update full lines */
+	if (!par->addr_win_cols) {
+		x = 0;
+		width = info->var.xres;
 	}
 
-	/* Mark display lines/area as dirty */
+	/* Mark display area as dirty */
 	spin_lock(&par->dirty_lock);
 	if (y < par->dirty_lines_start)
 		par->dirty_lines_start = y;
 	if (y + height - 1 > par->dirty_lines_end)
 		par->dirty_lines_end = y + height - 1;
+	if (x < par->dirty_cols_start)
+		par->dirty_cols_start = x;
+	if (x + width - 1 > par->dirty_cols_end)
+		par->dirty_cols_end = x + width - 1;
 	spin_unlock(&par->dirty_lock);
 
 	/* Schedule deferred_io to update display (no-op if already on queue)*/
 	schedule_delayed_work(&info->deferred_work, fbdefio->delay);
 }
 
+static void fbtft_mkdirty(struct fb_info *info, int y, int height)
+{
+	fbtft_mkdirty_rect(info, 0, y, info->var.xres, height);
+}
+
+/* Mark a rectangle as dirty. Only full lines if the driver has its own
+ * mkdirty. */
+static void fbtft_fb_mkdirty(struct fb_info *info, int x, int y, int width,
+			     int height)
+{
+	struct fbtft_par *par = info->par;
+
+	if (par->fbtftops.mkdirty == fbtft_mkdirty)
+		fbtft_mkdirty_rect(info, x, y, width, height);
+	else
+		par->fbtftops.mkdirty(info, y, height);
+}
+
 static void fbtft_deferred_io(struct fb_info *info, struct list_head *pagelist)
 {
 	struct fbtft_par *par = info->par;
 	unsigned int dirty_lines_start, dirty_lines_end;
+	unsigned int dirty_cols_start, dirty_cols_end;
 	struct page *page;
 	unsigned long index;
 	unsigned int y_low = 0, y_high = 0;
@@ -347,6 +456,10 @@ static void fbtft_deferred_io(struct fb_info *info, struct list_head *pagelist)
 	/* set display line markers as clean */
 	par->dirty_lines_start = par->info->var.yres - 1;
 	par->dirty_lines_end = 0;
+	dirty_cols_start = par->dirty_cols_start;
+	dirty_cols_end = par->dirty_cols_end;
+	par->dirty_cols_start = par->info->var.xres - 1;
+	par->dirty_cols_end = 0;
 	spin_unlock(&par->dirty_lock);
 
 	/* Mark display lines as dirty */
@@ -364,49 +477,51 @@ static void fbtft_deferred_io(struct fb_info *info, struct list_head *pagelist)
 			dirty_lines_start = y_low;
 		if (y_high > dirty_lines_end)
 			dirty_lines_end = y_high;
+		/* Pages span full lines */
+		dirty_cols_start = 0;
+		dirty_cols_end = info->var.xres - 1;
 	}
 
-	par->fbtftops.update_display(info->par,
+	if (par->fbtftops.update_display == fbtft_update_display)
+		fbtft_update_rect(par, dirty_cols_start, dirty_lines_start,
+				  dirty_cols_end, dirty_lines_end);
+	else
+		par->fbtftops.update_display(info->par,
 					dirty_lines_start, dirty_lines_end);
 }
 
 static void fbtft_fb_fillrect(struct fb_info *info,
 			      const struct fb_fillrect *rect)
 {
-	struct fbtft_par *par = info->par;
-
 	dev_dbg(info->dev,
 		"%s: dx=%d, dy=%d, width=%d, height=%d\n",
 		__func__, rect->dx, rect->dy, rect->width, rect->height);
 	sys_fillrect(info, rect);
 
-	par->fbtftops.mkdirty(info, rect->dy, rect->height);
+	fbtft_fb_mkdirty(info, rect->dx, rect->dy, rect->width, rect->height);
 }
 
 static void fbtft_fb_copyarea(struct fb_info *info,
 			      const struct fb_copyarea *area)
 {
-	struct fbtft_par *par = info->par;
-
 	dev_dbg(info->dev,
 		"%s: dx=%d, dy=%d, width=%d, height=%d\n",
 		__func__,  area->dx, area->dy, area->width, area->height);
 	sys_copyarea(info, area);
 
-	par->fbtftops.mkdirty(info, area->dy, area->height);
+	fbtft_fb_mkdirty(info, area->dx, area->dy, area->width, area->height);
 }
 
 static void fbtft_fb_imageblit(struct fb_info *info,
 			       const struct fb_image *image)
 {
-	struct fbtft_par *par = info->par;
-
 	dev_dbg(info->dev,
 		"%s: dx=%d, dy=%d, width=%d, height=%d\n",
 		__func__,  image->dx, image->dy, image->width, image->height);
 	sys_imageblit(info, image);
 
-	par->fbtftops.mkdirty(info, image->dy, image->height);
+	fbtft_fb_mkdirty(info, image->dx, image->dy, image->width,
+			 image->height);
 }
 
 static ssize_t fbtft_fb_write(struct fb_info *info, const char __user *buf,
@@ -555,7 +670,7 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	void *buf = NULL;
 	unsigned int width;
 	unsigned int height;
-	int txbuflen = display->txbuflen;
+	int txbuflen = display->txbuflen ? display->txbuflen : default_txbuflen;
 	unsigned int bpp = display->bpp;
 	unsigned int fps = display->fps;
 	int vmem_size;
@@ -702,6 +817,13 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	par->debug = display->debug;
 	par->buf = buf;
 	spin_lock_init(&par->dirty_lock);
+	par->dirty_cols_start = width - 1;
+	par->dirty_cols_end = 0;
+	/* The default set_addr_win and write_vmem handle column windows */
+	par->addr_win_cols = !(bpp % 8) &&
+			     (display->addr_win_cols ||
+			      (!display->fbtftops.set_addr_win &&
+			       !display->fbtftops.write_vmem));
 	par->bgr = pdata->bgr;
 	par->startbyte = pdata->startbyte;
 	par->init_sequence = init_sequence;
@@ -720,8 +842,16 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 	/* Transmit buffer */
 	if (txbuflen == -1)
 		txbuflen = vmem_size + 2; /* add in case startbyte is used */
-	if (txbuflen >= vmem_size + 2)
+	if (txbuflen >= vmem_size + 2) {
+#ifdef __LITTLE_ENDIAN
+		/* need buffer for byteswapping. Large enough for a flush of
+		 * the whole display in one transfer.
+		 */
+		txbuflen = bpp > 8 ? vmem_size + 2 : 0;
+#else
 		txbuflen = 0;
+#endif
+	}
 
 #ifdef __LITTLE_ENDIAN
 	if ((!txbuflen) && (bpp > 8))
@@ -729,7 +859,16 @@ struct fb_info *fbtft_framebuffer_alloc(struct fbtft_display *display,
 #endif
 
 	if (txbuflen > 0) {
-		txbuf = devm_kzalloc(par->info->device, txbuflen, GFP_KERNEL);
+		txbuf = devm_kzalloc(par->info->device, txbuflen,
+				     GFP_KERNEL | __GFP_NOWARN);
+		/* a large buffer is only an optimization */
+		if (!txbuf && txbuflen > PAGE_SIZE) {
+			dev_warn(dev, "txbuf of %d bytes unavailable, using %lu\n",
+				 txbuflen, PAGE_SIZE);
+			txbuflen = PAGE_SIZE;
+			txbuf = devm_kzalloc(par->info->device, txbuflen,
+					     GFP_KERNEL);
+		}
 		if (!txbuf)
 			goto release_framebuf;
 		par->txbuf.buf = txbuf;
@@ -1117,13 +1256,14 @@ static int fbtft_verify_gpios(struct fbtft_par *par)
 	fbtft_par_dbg(DEBUG_VERIFY_GPIOS, par, "%s()\n", __func__);
 
 	if (pdata->display.buswidth != 9 &&  par->startbyte == 0 &&
-	    !par->gpio.dc) {
+	    !par->gpio.dc && !par->bus_base) {
 		dev_err(par->info->device,
 			"Missing info about 'dc' gpio. Aborting.\n");
 		return -EINVAL;
 	}
 
-	if (!par->pdev)
+	/* The bus bridge drives /WR and the data bus */
+	if (!par->pdev || par->bus_base)
 		return 0;
 
 	if (!par->gpio.wr) {
@@ -1221,6 +1361,7 @@ int fbtft_probe_common(struct fbtft_display *display,
 	struct fb_info *info;
 	struct fbtft_par *par;
 	struct fbtft_platform_data *pdata;
+	struct resource *res;
 	int ret;
 
 	if (sdev)
@@ -1281,6 +1422,28 @@ int fbtft_probe_common(struct fbtft_display *display,
 			par->fbtftops.write = fbtft_write_gpio16_wr;
 	}
 
+	/* MIPI DBI Type B bus bridge (optional) */
+	res = par->pdev ? platform_get_resource_byname(par->pdev, IORESOURCE_MEM,
+						       "mipi-dbi-type-b") : NULL;
+	if (res) {
+		if (display->buswidth != 8 && display->buswidth != 16) {
+			dev_err(dev, "bus bridge needs buswidth 8 or 16\n");
+			ret = -EINVAL;
+			goto out_release;
+		}
+		par->bus_base = devm_ioremap_resource(dev, res);
+		if (IS_ERR(par->bus_base)) {
+			ret = PTR_ERR(par->bus_base);
+			par->bus_base = NULL;
+			goto out_release;
+		}
+		par->bus_dc = 1;
+		if (display->buswidth == 8)
+			par->fbtftops.write = fbtft_write_bus8;
+		else
+			par->fbtftops.write = fbtft_write_bus16;
+	}
+
 	/* 9-bit SPI setup */
 	if (par->spi && display->buswidth == 9) {
 		if (par->spi->master->bits_per_word_mask & SPI_BPW_MASK(9)) {
@@ -1,7 +1,9 @@
 // SPDX-License-Identifier: GPL-2.0
+#include <linux/delay.h>
 #include <linux/export.h>
 #include <linux/errno.h>
 #include <linux/gpio/consumer.h>
+#include <linux/io.h>
 #include <linux/spi/spi.h>
 #include "fbtft.h"
 
@@ -123,6 +125,43 @@ int fbtft_read_spi(struct fbtft_par *par, void *buf, size_t len)
 }
 EXPORT_SYMBOL(fbtft_read_spi);
 
+/*
+ * Set all data lines at once with gpiod_set_array_value(). The array info
+ * lets gpiolib use its fast path: if the lines are on a single chip, in order,
+ * this is a single register write per bus cycle.
+ */
+static int fbtft_write_gpio_array(struct fbtft_par *par, void *buf, size_t len,
+				  unsigned int width)
+{
+	struct gpio_descs *db = par->gpio.db_array;
+	size_t step = width / 8;
+	unsigned long data;
+	unsigned long prev_data = ~0UL;
+
+	while (len >= step) {
+		data = width == 8 ? *(u8 *)buf : *(u16 *)buf;
+
+		/* Start writing by pulling down /WR */
+		gpiod_set_value(par->gpio.wr, 0);
+
+		/* Set data */
+		if (data == prev_data) {
+			gpiod_set_value(par->gpio.wr, 0); /* used as delay */
+		} else {
+			gpiod_set_array_value(width, db->desc, db->info, &data);
+			prev_data = data;
+		}
+
+		/* Pullup /WR */
+		gpiod_set_value(par->gpio.wr, 1);
+
+		buf += step;
+		len -= step;
+	}
+
+	return 0;
+}
+
 /*
  * Optimized use of gpiolib is twice as fast as no optimization
  * only one driver can use the optimized version at a time
@@ -138,6 +177,9 @@ int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len)
 	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
 			  "%s(len=%zu): ", __func__, len);
 
+	if (par->gpio.db_array && par->gpio.db_array->ndescs >= 8)
+		return fbtft_write_gpio_array(par, buf, len, 8);
+
 	while (len--) {
 		data = *(u8 *)buf;
 
@@ -188,6 +230,9 @@ int fbtft_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len)
 	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
 			  "%s(len=%zu): ", __func__, len);
 
+	if (par->gpio.db_array && par->gpio.db_array->ndescs >= 16)
+		return fbtft_write_gpio_array(par, buf, len, 16);
+
 	while (len) {
 		data = *(u16 *)buf;
 
@@ -234,3 +279,80 @@ int fbtft_write_gpio16_wr_latched(struct fbtft_par *par, void *buf, size_t len)
 	return -1;
 }
 EXPORT_SYMBOL(fbtft_write_gpio16_wr_latched);
+
+/*
+ * MIPI DBI Type B (8080) bus bridge
+ *
+ * The PL IP that the ili9488 DRM driver also uses. It drives CS, DC, /WR
+ * and the data bus. A write to the command register is a bus cycle with
+ * DC low. A write to the data register is a bus cycle with DC high. A
+ * 32-bit write to the data register is two 16-bit cycles (low half first).
+ * The IP holds off the write until the bus is ready.
+ *
+ * fbtft_probe_common() selects these for platform devices with a
+ * "mipi-dbi-type-b" memory resource. The DC GPIO is not needed: we take DC
+ * from par->bus_dc (see fbtft_write_buf_dc()).
+ */
+#define FBTFT_TYPE_B_REG_CONTROL	0x4
+#define FBTFT_TYPE_B_REG_COMMAND	0x10
+#define FBTFT_TYPE_B_REG_DATA		0x20
+
+#define FBTFT_TYPE_B_CONTROL_RESET	BIT(0)
+#define FBTFT_TYPE_B_CONTROL_CS		BIT(1)
+
+static void __iomem *fbtft_bus_reg(struct fbtft_par *par)
+{
+	return par->bus_base + (par->bus_dc ? FBTFT_TYPE_B_REG_DATA :
+					      FBTFT_TYPE_B_REG_COMMAND);
+}
+
+void fbtft_bus_reset(struct fbtft_par *par)
+{
+	iowrite32(FBTFT_TYPE_B_CONTROL_RESET,
+		  par->bus_base + FBTFT_TYPE_B_REG_CONTROL);
+	usleep_range(20, 40);
+	iowrite32(0, par->bus_base + FBTFT_TYPE_B_REG_CONTROL);
+	msleep(120);
+}
+EXPORT_SYMBOL(fbtft_bus_reset);
+
+int fbtft_write_bus8(struct fbtft_par *par, void *buf, size_t len)
+{
+	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
+			  "%s(len=%zu): ", __func__, len);
+
+	iowrite32(FBTFT_TYPE_B_CONTROL_CS,
+		  par->bus_base + FBTFT_TYPE_B_REG_CONTROL);
+	iowrite8_rep(fbtft_bus_reg(par), buf, len);
+	iowrite32(0, par->bus_base + FBTFT_TYPE_B_REG_CONTROL);
+
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_write_bus8);
+
+int fbtft_write_bus16(struct fbtft_par *par, void *buf, size_t len)
+{
+	void __iomem *reg = fbtft_bus_reg(par);
+	u16 *data = buf;
+	size_t n = len / 2;
+
+	fbtft_par_dbg_hex(DEBUG_WRITE, par, par->info->device, u8, buf, len,
+			  "%s(len=%zu): ", __func__, len);
+
+	iowrite32(FBTFT_TYPE_B_CONTROL_CS,
+		  par->bus_base + FBTFT_TYPE_B_REG_CONTROL);
+	/* Two data cycles per write. The buffer may be 2-byte aligned only. */
+	if (par->bus_dc) {
+		while (n >= 2) {
+			iowrite32(data[0] | (u32)data[1] << 16, reg);
+			data += 2;
+			n -= 2;
+		}
+	}
+	while (n--)
+		iowrite16(*data++, reg);
+	iowrite32(0, par->bus_base + FBTFT_TYPE_B_REG_CONTROL);
+
+	return 0;
+}
+EXPORT_SYMBOL(fbtft_write_bus16);
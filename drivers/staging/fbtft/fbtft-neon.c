@@ -0,0 +1,25 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * NEON byte swapping for the fbtft bus functions
+ *
+ * Built with the NEON compiler flags (see the Makefile). Call between
+ * kernel_neon_begin() and kernel_neon_end() only.
+ */
+
+#include <arm_neon.h>
+
+/* Copy 'n' 16-bit words from 'src' to 'dst' and swap the bytes of each */
+void fbtft_neon_swab16(uint16_t *dst, const uint16_t *src, unsigned int n)
+{
+	uint8x16_t a, b;
+	unsigned int i;
+
+	for (i = 0; i + 16 <= n; i += 16) {
+		a = vld1q_u8((const uint8_t *)(src + i));
+		b = vld1q_u8((const uint8_t *)(src + i + 8));
+		vst1q_u8((uint8_t *)(dst + i), vrev16q_u8(a));
+		vst1q_u8((uint8_t *)(dst + i + 8), vrev16q_u8(b));
+	}
+	for (; i < n; i++)
+		dst[i] = (src[i] << 8) | (src[i] >> 8);
+}
@@ -100,6 +100,8 @@ struct fbtft_ops {
  * @gamma_num: Number of Gamma curves
  * @gamma_len: Number of values per Gamma curve
  * @debug: Initial debug value
+ * @addr_win_cols: The driver's set_addr_win() honours the column range, so
+ *                 updates may cover part of a line
  *
  * This structure is not stored by FBTFT except for init_sequence.
  */
@@ -118,6 +120,7 @@ struct fbtft_display {
 	int gamma_num;
 	int gamma_len;
 	unsigned long debug;
+	bool addr_win_cols;
 };
 
 /**
@@ -166,9 +169,13 @@ struct fbtft_platform_data {
  * @startbyte: Used by some controllers when in SPI mode.
  *             Format: 6 bit Device id + RS bit + RW bit
  * @fbtftops: FBTFT operations provided by driver or device (platform_data)
- * @dirty_lock: Protects dirty_lines_start and dirty_lines_end
+ * @dirty_lock: Protects dirty_lines_start, dirty_lines_end, dirty_cols_start
+ *              and dirty_cols_end
  * @dirty_lines_start: Where to begin updating display
  * @dirty_lines_end: Where to end updating display
+ * @dirty_cols_start: First column to update (with @addr_win_cols)
+ * @dirty_cols_end: Last column to update (with @addr_win_cols)
+ * @addr_win_cols: Updates may cover part of a line (see fbtft_display)
  * @gpio.reset: GPIO used to reset display
  * @gpio.dc: Data/Command signal, also known as RS
  * @gpio.rd: Read latching signal
@@ -176,8 +183,11 @@ struct fbtft_platform_data {
  * @gpio.latch: Bus latch signal, eg. 16->8 bit bus latch
  * @gpio.cs: LCD Chip Select with parallel interface bus
  * @gpio.db[16]: Parallel databus
+ * @gpio.db_array: Parallel databus as one array (for bulk updates)
  * @gpio.led[16]: Led control signals
  * @gpio.aux[16]: Auxiliary signals, not used by core
+ * @bus_base: MIPI DBI Type B bus bridge registers (optional)
+ * @bus_dc: DC of the next bus bridge write
  * @init_sequence: Pointer to LCD initialization array
  * @gamma.lock: Mutex for Gamma curve locking
  * @gamma.curves: Pointer to Gamma curve array
@@ -207,6 +217,9 @@ struct fbtft_par {
 	spinlock_t dirty_lock;
 	unsigned int dirty_lines_start;
 	unsigned int dirty_lines_end;
+	unsigned int dirty_cols_start;
+	unsigned int dirty_cols_end;
+	bool addr_win_cols;
 	struct {
 		struct gpio_desc *reset;
 		struct gpio_desc *dc;
@@ -215,9 +228,12 @@ struct fbtft_par {
 		struct gpio_desc *latch;
 		struct gpio_desc *cs;
 		struct gpio_desc *db[16];
+		struct gpio_descs *db_array;
 		struct gpio_desc *led[16];
 		struct gpio_desc *aux[16];
 	} gpio;
+	void __iomem *bus_base;
+	int bus_dc;
 	const s16 *init_sequence;
 	struct {
 		struct mutex lock;
@@ -263,6 +279,9 @@ int fbtft_read_spi(struct fbtft_par *par, void *buf, size_t len);
 int fbtft_write_gpio8_wr(struct fbtft_par *par, void *buf, size_t len);
 int fbtft_write_gpio16_wr(struct fbtft_par *par, void *buf, size_t len);
 int fbtft_write_gpio16_wr_latched(struct fbtft_par *par, void *buf, size_t len);
+void fbtft_bus_reset(struct fbtft_par *par);
+int fbtft_write_bus8(struct fbtft_par *par, void *buf, size_t len);
+int fbtft_write_bus16(struct fbtft_par *par, void *buf, size_t len);
 
 /* fbtft-bus.c */
 int fbtft_write_vmem8_bus8(struct fbtft_par *par, size_t offset, size_t len);
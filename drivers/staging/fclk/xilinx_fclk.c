@@ -6,17 +6,259 @@
 
 #include <linux/clk.h>
 #include <linux/clk-provider.h>
+#include <linux/clk/xilinx-fclk.h>
+#include <linux/devfreq.h>
 #include <linux/errno.h>
 #include <linux/io.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of_device.h>
+#include <linux/of_platform.h>
 #include <linux/platform_device.h>
+#include <linux/pm_opp.h>
+
+#ifdef CONFIG_XILINX_FCLK_DEVFREQ
+#include "../../devfreq/governor.h"
+#endif
+
+#define FCLK_GOV_HINT	"fclk_hint"
 
 struct fclk_state {
 	struct device	*dev;
 	struct clk	*pl;
+#ifdef CONFIG_XILINX_FCLK_DEVFREQ
+	struct devfreq	*devfreq;
+	struct devfreq_dev_profile profile;
+	struct mutex	req_lock;	/* protects req_list */
+	struct list_head req_list;
+#endif
+};
+
+#ifdef CONFIG_XILINX_FCLK_DEVFREQ
+/**
+ * struct fclk_request - a consumer's rate requirement
+ * @node: entry in fclk_state.req_list
+ * @st: fclk the request applies to
+ * @rate: lowest rate the consumer needs right now, 0 when idle
+ */
+struct fclk_request {
+	struct list_head node;
+	struct fclk_state *st;
+	unsigned long rate;
 };
 
+static int fclk_devfreq_target(struct device *dev, unsigned long *freq,
+			       u32 flags)
+{
+	struct fclk_state *st = dev_get_drvdata(dev);
+	struct dev_pm_opp *opp;
+	unsigned long rate;
+
+	opp = devfreq_recommended_opp(dev, freq, flags);
+	if (IS_ERR(opp))
+		return PTR_ERR(opp);
+	rate = dev_pm_opp_get_freq(opp);
+	dev_pm_opp_put(opp);
+
+	if (rate == clk_get_rate(st->pl))
+		return 0;
+
+	return clk_set_rate(st->pl, clk_round_rate(st->pl, rate));
+}
+
+static int fclk_devfreq_get_cur_freq(struct device *dev, unsigned long *freq)
+{
+	struct fclk_state *st = dev_get_drvdata(dev);
+
+	*freq = clk_get_rate(st->pl);
+
+	return 0;
+}
+
+/*
+ * The hint governor runs the clock at the highest rate any consumer asked
+ * for, and at the lowest OPP when nobody needs it.
+ */
+static int fclk_gov_get_target_freq(struct devfreq *df, unsigned long *freq)
+{
+	struct fclk_state *st = dev_get_drvdata(df->dev.parent);
+	struct fclk_request *req;
+	unsigned long rate = DEVFREQ_MIN_FREQ;
+
+	mutex_lock(&st->req_lock);
+	list_for_each_entry(req, &st->req_list, node)
+		rate = max(rate, req->rate);
+	mutex_unlock(&st->req_lock);
+
+	*freq = rate;
+
+	return 0;
+}
+
+static int fclk_gov_event_handler(struct devfreq *df, unsigned int event,
+				  void *data)
+{
+	int ret = 0;
+
+	if (event == DEVFREQ_GOV_START || event == DEVFREQ_GOV_RESUME) {
+		mutex_lock(&df->lock);
+		ret = update_devfreq(df);
+		mutex_unlock(&df->lock);
+	}
+
+	return ret;
+}
+
+static struct devfreq_governor fclk_gov_hint = {
+	.name = FCLK_GOV_HINT,
+	.get_target_freq = fclk_gov_get_target_freq,
+	.event_handler = fclk_gov_event_handler,
+};
+
+static void fclk_request_release(struct device *dev, void *res)
+{
+	struct fclk_request *req = *(struct fclk_request **)res;
+	struct fclk_state *st = req->st;
+
+	mutex_lock(&st->req_lock);
+	list_del(&req->node);
+	mutex_unlock(&st->req_lock);
+
+	fclk_request_update(req, 0);
+	put_device(st->dev);
+	kfree(req);
+}
+
+/**
+ * devm_fclk_request_get - get a load hint handle for a consumer
+ * @dev: consumer device, its node points at the fclk with "xlnx,fclk"
+ *
+ * Return: a request that starts out idle, NULL if the consumer has no fclk
+ * or the fclk has no OPP table, or an ERR_PTR on failure.
+ */
+struct fclk_request *devm_fclk_request_get(struct device *dev)
+{
+	struct fclk_request **ptr, *req;
+	struct platform_device *pdev;
+	struct device_node *np;
+	struct fclk_state *st;
+
+	np = of_parse_phandle(dev->of_node, "xlnx,fclk", 0);
+	if (!np)
+		return NULL;
+
+	pdev = of_find_device_by_node(np);
+	of_node_put(np);
+	if (!pdev)
+		return ERR_PTR(-EPROBE_DEFER);
+
+	st = platform_get_drvdata(pdev);
+	if (!st) {
+		put_device(&pdev->dev);
+		return ERR_PTR(-EPROBE_DEFER);
+	}
+	if (!st->devfreq) {
+		put_device(&pdev->dev);
+		return NULL;
+	}
+
+	ptr = devres_alloc(fclk_request_release, sizeof(*ptr), GFP_KERNEL);
+	req = kzalloc(sizeof(*req), GFP_KERNEL);
+	if (!ptr || !req) {
+		devres_free(ptr);
+		kfree(req);
+		put_device(&pdev->dev);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	req->st = st;
+	mutex_lock(&st->req_lock);
+	list_add(&req->node, &st->req_list);
+	mutex_unlock(&st->req_lock);
+
+	*ptr = req;
+	devres_add(dev, ptr);
+
+	return req;
+}
+EXPORT_SYMBOL_GPL(devm_fclk_request_get);
+
+/**
+ * fclk_request_update - update a consumer's rate requirement
+ * @req: request from devm_fclk_request_get(), NULL is ignored
+ * @rate: lowest rate in Hz the consumer needs, 0 when it is idle
+ *
+ * Return: 0 on success, negative error code otherwise.
+ */
+int fclk_request_update(struct fclk_request *req, unsigned long rate)
+{
+	struct devfreq *df;
+	int ret;
+
+	if (IS_ERR_OR_NULL(req))
+		return 0;
+
+	mutex_lock(&req->st->req_lock);
+	req->rate = rate;
+	mutex_unlock(&req->st->req_lock);
+
+	df = req->st->devfreq;
+	mutex_lock(&df->lock);
+	ret = update_devfreq(df);
+	mutex_unlock(&df->lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(fclk_request_update);
+
+static void fclk_opp_remove(void *data)
+{
+	dev_pm_opp_of_remove_table(data);
+}
+
+/* The devfreq device is optional, it needs an OPP table in DT. */
+static int fclk_devfreq_init(struct fclk_state *st)
+{
+	struct device *dev = st->dev;
+	int ret;
+
+	mutex_init(&st->req_lock);
+	INIT_LIST_HEAD(&st->req_list);
+
+	if (!of_find_property(dev->of_node, "operating-points-v2", NULL))
+		return 0;
+
+	ret = dev_pm_opp_of_add_table(dev);
+	if (ret) {
+		dev_err(dev, "Invalid OPP table: %d\n", ret);
+		return ret;
+	}
+
+	ret = devm_add_action_or_reset(dev, fclk_opp_remove, dev);
+	if (ret)
+		return ret;
+
+	st->profile.initial_freq = clk_get_rate(st->pl);
+	st->profile.target = fclk_devfreq_target;
+	st->profile.get_cur_freq = fclk_devfreq_get_cur_freq;
+	st->devfreq = devm_devfreq_add_device(dev, &st->profile,
+					      FCLK_GOV_HINT, NULL);
+	if (IS_ERR(st->devfreq)) {
+		ret = PTR_ERR(st->devfreq);
+		st->devfreq = NULL;
+		dev_err(dev, "Unable to add devfreq device: %d\n", ret);
+		return ret;
+	}
+
+	return 0;
+}
+#else
+static inline int fclk_devfreq_init(struct fclk_state *st)
+{
+	return 0;
+}
+#endif /* CONFIG_XILINX_FCLK_DEVFREQ */
+
 /* Match table for of_platform binding */
 static const struct of_device_id fclk_of_match[] = {
 	{ .compatible = "xlnx,fclk",},
@@ -84,6 +326,12 @@ static int fclk_probe(struct platform_device *pdev)
 		return ret;
 	}
 
+	ret = fclk_devfreq_init(st);
+	if (ret) {
+		clk_disable_unprepare(st->pl);
+		return ret;
+	}
+
 	ret = sysfs_create_group(&dev->kobj, &fclk_ctrl_attr_grp);
 	if (ret)
 		return ret;
@@ -108,7 +356,32 @@ static struct platform_driver fclk_driver = {
 	.remove		= fclk_remove,
 };
 
+#ifdef CONFIG_XILINX_FCLK_DEVFREQ
+static int __init fclk_init(void)
+{
+	int ret;
+
+	ret = devfreq_add_governor(&fclk_gov_hint);
+	if (ret)
+		return ret;
+
+	ret = platform_driver_register(&fclk_driver);
+	if (ret)
+		devfreq_remove_governor(&fclk_gov_hint);
+
+	return ret;
+}
+module_init(fclk_init);
+
+static void __exit fclk_exit(void)
+{
+	platform_driver_unregister(&fclk_driver);
+	devfreq_remove_governor(&fclk_gov_hint);
+}
+module_exit(fclk_exit);
+#else
 module_platform_driver(fclk_driver);
+#endif
 
 MODULE_AUTHOR("Shubhrajyoti Datta <shubhrajyoti.datta@xilinx.com>");
 MODULE_DESCRIPTION("fclk enable");
@@ -730,6 +730,8 @@ static int xlnx_tsmux_enqueue_stream_context(struct xlnx_tsmux *mpgmuxts,
 		if (i == XTSMUX_MAXIN_STRM) {
 			dev_err(mpgmuxts->dev, "No DMA buffer with %d",
 				stream_data->srcbuf_id);
+			dma_pool_free(mpgmuxts->strm_ctx_pool, new_strm_node,
+				      strm_phy_addr);
 			return -ENOMEM;
 		}
 	}
@@ -799,6 +801,51 @@ static int xlnx_tsmux_ioctl_set_stream_context(struct xlnx_tsmux *mpgmuxts,
 	return 0;
 }
 
+/*
+ * Batched submission of stream contexts. Each write() takes an array of
+ * struct stream_context_in (at most XTSMUX_MAXIN_TLSTRM of them) and
+ * queues them all, just like MPG2MUX_SETSTRM would one by one. Returns
+ * the number of bytes of the stream contexts that were queued.
+ */
+static ssize_t xlnx_tsmux_write(struct file *fptr, const char __user *buf,
+				size_t count, loff_t *ppos)
+{
+	struct xlnx_tsmux *mpgmuxts = fptr->private_data;
+	struct stream_context_in *stream_data;
+	size_t num_strms, i;
+	int ret = 0;
+
+	if (!mpgmuxts)
+		return -ENODEV;
+
+	num_strms = count / sizeof(*stream_data);
+	if (!num_strms || count % sizeof(*stream_data))
+		return -EINVAL;
+	num_strms = min_t(size_t, num_strms, XTSMUX_MAXIN_TLSTRM);
+
+	stream_data = memdup_user(buf, num_strms * sizeof(*stream_data));
+	if (IS_ERR(stream_data)) {
+		dev_err(mpgmuxts->dev, "Failed to copy stream data from user");
+		return PTR_ERR(stream_data);
+	}
+
+	for (i = 0; i < num_strms; i++) {
+		ret = xlnx_tsmux_enqueue_stream_context(mpgmuxts,
+							&stream_data[i]);
+		if (ret < 0) {
+			dev_err(mpgmuxts->dev,
+				"Setting stream descripter %zu failed", i);
+			break;
+		}
+	}
+	kfree(stream_data);
+
+	if (!i)
+		return ret;
+
+	return i * sizeof(*stream_data);
+}
+
 static enum xlnx_tsmux_status xlnx_tsmux_get_device_status(struct xlnx_tsmux *
 							   mpgmuxts)
 {
@@ -1275,6 +1322,7 @@ static const struct file_operations mpg2mux_fops = {
 	.open = xlnx_tsmux_open,
 	.release = xlnx_tsmux_release,
 	.unlocked_ioctl = xlnx_tsmux_ioctl,
+	.write = xlnx_tsmux_write,
 	.mmap = xlnx_tsmux_mmap,
 	.poll = xlnx_tsmux_poll,
 };
@@ -16,6 +16,8 @@
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/dma-buf.h>
+#include <linux/dma-fence.h>
+#include <linux/dma-resv.h>
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/ioctl.h>
@@ -24,6 +26,7 @@
 #include <linux/of_irq.h>
 #include <linux/platform_device.h>
 #include <linux/poll.h>
+#include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/xlnxsync.h>
 
@@ -128,6 +131,13 @@
 
 #define XLNXSYNC_DEV_MAX		256
 
+/* Planes that a buffer fence waits for */
+#define XLNXSYNC_FENCE_LUMA		BIT(0)
+#define XLNXSYNC_FENCE_CHROMA		BIT(1)
+
+/* Maximum time to wait for the fences of a buffer before reuse */
+#define XLNXSYNC_FENCE_TIMEOUT_MS	100
+
 /* Module Parameters */
 static struct class *xlnxsync_class;
 static dev_t xlnxsync_devt;
@@ -184,6 +194,11 @@ struct xlnxsync_device {
  * @wq_error: Wait queue for error events
  * @l_done: Luma done result array
  * @c_done: Chroma done result array
+ * @fence_ctx: Fence context of the producer and consumer timelines
+ * @fence_seqno: Last fence sequence number per timeline
+ * @fence: Pending fence per buffer (signalled when the buffer is done)
+ * @fence_dbuf: dma-buf that each pending fence is attached to
+ * @fence_planes: Planes that each pending fence still waits for
  * @prod_sync_err: Capture synchronization error per channel
  * @prod_wdg_err: Capture watchdog error per channel
  * @cons_sync_err: Consumer synchronization error per channel
@@ -205,6 +220,11 @@ struct xlnxsync_channel {
 	wait_queue_head_t wq_error;
 	u8 l_done[XLNXSYNC_BUF_PER_CHAN][XLNXSYNC_IO];
 	u8 c_done[XLNXSYNC_BUF_PER_CHAN][XLNXSYNC_IO];
+	u64 fence_ctx;
+	u32 fence_seqno[XLNXSYNC_IO];
+	struct dma_fence *fence[XLNXSYNC_BUF_PER_CHAN][XLNXSYNC_IO];
+	struct dma_buf *fence_dbuf[XLNXSYNC_BUF_PER_CHAN][XLNXSYNC_IO];
+	u8 fence_planes[XLNXSYNC_BUF_PER_CHAN][XLNXSYNC_IO];
 	u8 prod_sync_err : 1;
 	u8 prod_wdg_err : 1;
 	u8 cons_sync_err : 1;
@@ -290,23 +310,16 @@ static void xlnxsync_reset(struct xlnxsync_device *dev)
 }
 
 static dma_addr_t xlnxsync_get_phy_addr(struct xlnxsync_device *dev,
-					u32 fd)
+					struct dma_buf *dbuf)
 {
-	struct dma_buf *dbuf;
 	struct dma_buf_attachment *attach;
 	struct sg_table *sgt;
 	dma_addr_t phy_addr = 0;
 
-	dbuf = dma_buf_get(fd);
-	if (IS_ERR(dbuf)) {
-		dev_err(dev->dev, "%s : Failed to get dma buf\n", __func__);
-		goto get_phy_addr_err;
-	}
-
 	attach = dma_buf_attach(dbuf, dev->dev);
 	if (IS_ERR(attach)) {
 		dev_err(dev->dev, "%s : Failed to attach buf\n", __func__);
-		goto fail_attach;
+		goto get_phy_addr_err;
 	}
 
 	sgt = dma_buf_map_attachment(attach, DMA_BIDIRECTIONAL);
@@ -320,17 +333,146 @@ static dma_addr_t xlnxsync_get_phy_addr(struct xlnxsync_device *dev,
 
 fail_map:
 	dma_buf_detach(dbuf, attach);
-fail_attach:
-	dma_buf_put(dbuf);
 get_phy_addr_err:
 	return phy_addr;
 }
 
+static const char *xlnxsync_fence_get_driver_name(struct dma_fence *fence)
+{
+	return XLNXSYNC_DRIVER_NAME;
+}
+
+static const char *xlnxsync_fence_get_timeline_name(struct dma_fence *fence)
+{
+	return "xlnxsync";
+}
+
+static const struct dma_fence_ops xlnxsync_fence_ops = {
+	.get_driver_name = xlnxsync_fence_get_driver_name,
+	.get_timeline_name = xlnxsync_fence_get_timeline_name,
+};
+
+static struct dma_fence *xlnxsync_fence_create(struct xlnxsync_channel *channel,
+					       u32 io)
+{
+	struct dma_fence *fence;
+
+	fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+	if (!fence)
+		return NULL;
+
+	dma_fence_init(fence, &xlnxsync_fence_ops, &channel->dev->irq_lock,
+		       channel->fence_ctx + io, ++channel->fence_seqno[io]);
+
+	return fence;
+}
+
+/* Signal and drop the fence of a buffer. Call with irq_lock held. */
+static void xlnxsync_fence_done(struct xlnxsync_channel *channel,
+				u32 buf, u32 io, int error)
+{
+	struct dma_fence *fence = channel->fence[buf][io];
+
+	if (!fence)
+		return;
+
+	if (error)
+		dma_fence_set_error(fence, error);
+	dma_fence_signal_locked(fence);
+	dma_fence_put(fence);
+	dma_buf_put(channel->fence_dbuf[buf][io]);
+
+	channel->fence[buf][io] = NULL;
+	channel->fence_dbuf[buf][io] = NULL;
+	channel->fence_planes[buf][io] = 0;
+}
+
+/* A plane of a buffer is done. Call with irq_lock held. */
+static void xlnxsync_fence_plane_done(struct xlnxsync_channel *channel,
+				      u32 buf, u32 io, u8 plane)
+{
+	channel->fence_planes[buf][io] &= ~plane;
+	if (!channel->fence_planes[buf][io])
+		xlnxsync_fence_done(channel, buf, io, 0);
+}
+
+static void xlnxsync_fence_cancel_all(struct xlnxsync_channel *channel)
+{
+	unsigned long flags;
+	u32 i, j;
+
+	spin_lock_irqsave(&channel->dev->irq_lock, flags);
+	for (i = 0; i < XLNXSYNC_BUF_PER_CHAN; i++)
+		for (j = 0; j < XLNXSYNC_IO; j++)
+			xlnxsync_fence_done(channel, i, j, -ECANCELED);
+	spin_unlock_irqrestore(&channel->dev->irq_lock, flags);
+}
+
+/*
+ * Attach a producer (exclusive) and a consumer (shared) fence to the
+ * reservation object of @dbuf. They signal when the IP is done with the
+ * buffers @fb. Other drivers (e.g., the display) can then wait for them
+ * in the kernel instead of waiting for userspace.
+ */
+static int xlnxsync_fence_attach(struct xlnxsync_channel *channel,
+				 struct dma_buf *dbuf, const u32 *fb,
+				 const u8 *planes)
+{
+	struct dma_fence *fence[XLNXSYNC_IO];
+	unsigned long flags;
+	int ret, j;
+
+	for (j = 0; j < XLNXSYNC_IO; j++) {
+		fence[j] = xlnxsync_fence_create(channel, j);
+		if (!fence[j]) {
+			ret = -ENOMEM;
+			goto err_put;
+		}
+	}
+
+	ret = dma_resv_lock_interruptible(dbuf->resv, NULL);
+	if (ret)
+		goto err_put;
+
+	ret = dma_resv_reserve_shared(dbuf->resv, 1);
+	if (ret) {
+		dma_resv_unlock(dbuf->resv);
+		goto err_put;
+	}
+
+	dma_resv_add_excl_fence(dbuf->resv, fence[XLNXSYNC_PROD]);
+	dma_resv_add_shared_fence(dbuf->resv, fence[XLNXSYNC_CONS]);
+	dma_resv_unlock(dbuf->resv);
+
+	spin_lock_irqsave(&channel->dev->irq_lock, flags);
+	for (j = 0; j < XLNXSYNC_IO; j++) {
+		/* The IP is done with the buffer, so is its old fence */
+		xlnxsync_fence_done(channel, fb[j], j, 0);
+		channel->fence[fb[j]][j] = fence[j];
+		channel->fence_dbuf[fb[j]][j] = dbuf;
+		channel->fence_planes[fb[j]][j] = planes[j];
+		get_dma_buf(dbuf);
+	}
+	spin_unlock_irqrestore(&channel->dev->irq_lock, flags);
+
+	return 0;
+
+err_put:
+	while (j--)
+		dma_fence_put(fence[j]);
+
+	return ret;
+}
+
 static int xlnxsync_chan_config(struct xlnxsync_channel *channel,
 				void __user *arg)
 {
 	struct xlnxsync_chan_config cfg;
-	int ret, i = 0, j;
+	int ret, i, j;
+	long timeout;
+	u32 fb[XLNXSYNC_IO];
+	u8 planes[XLNXSYNC_IO];
+	struct dma_buf *dbuf;
 	dma_addr_t phy_start_address;
 	u64 luma_start_address[XLNXSYNC_IO];
 	u64 chroma_start_address[XLNXSYNC_IO];
@@ -352,12 +494,19 @@ static int xlnxsync_chan_config(struct xlnxsync_channel *channel,
 		return -EINVAL;
 	}
 
+	dbuf = dma_buf_get(cfg.dma_fd);
+	if (IS_ERR(dbuf)) {
+		dev_err(dev->dev, "%s : Failed to get dma buf\n", __func__);
+		return -EINVAL;
+	}
+
 	/* Calculate luma/chroma physical addresses */
-	phy_start_address = xlnxsync_get_phy_addr(dev, cfg.dma_fd);
+	phy_start_address = xlnxsync_get_phy_addr(dev, dbuf);
 	if (!phy_start_address) {
 		dev_err(dev->dev, "%s : Failed to obtain physical address\n",
 			__func__);
-		return -EINVAL;
+		ret = -EINVAL;
+		goto put_dbuf;
 	}
 
 	luma_start_address[XLNXSYNC_PROD] =
@@ -398,8 +547,6 @@ static int xlnxsync_chan_config(struct xlnxsync_channel *channel,
 		cfg.fb_id[XLNXSYNC_CONS], cfg.ismono[XLNXSYNC_CONS]);
 
 	for (j = 0; j < XLNXSYNC_IO; j++) {
-		u32 l_start_reg, l_end_reg, c_start_reg, c_end_reg;
-
 		if (cfg.fb_id[j] == XLNXSYNC_AUTO_SEARCH) {
 			/*
 			 * When fb_id is 0xFF auto search for free fb
@@ -415,19 +562,22 @@ static int xlnxsync_chan_config(struct xlnxsync_channel *channel,
 					channel->id, j ? "prod" : "cons", i);
 			}
 
-			if (i == XLNXSYNC_BUF_PER_CHAN)
-				return -EBUSY;
+			if (i == XLNXSYNC_BUF_PER_CHAN) {
+				ret = -EBUSY;
+				goto put_dbuf;
+			}
 
 		} else if (cfg.fb_id[j] >= 0 &&
 			   cfg.fb_id[j] < XLNXSYNC_BUF_PER_CHAN) {
 			/* If fb_id is specified, check its availability */
-			if (!(xlnxsync_is_buf_done(dev, channel->id,
-						   cfg.fb_id[j], j))) {
+			i = cfg.fb_id[j];
+			if (!(xlnxsync_is_buf_done(dev, channel->id, i, j))) {
 				dev_dbg(dev->dev,
 					"%s : %s FB %d in channel %d is busy!\n",
 					__func__, j ? "prod" : "cons",
 					i, channel->id);
-				return -EBUSY;
+				ret = -EBUSY;
+				goto put_dbuf;
 			}
 			dev_dbg(dev->dev, "%s : Configure fb %d\n",
 				__func__, i);
@@ -435,9 +585,37 @@ static int xlnxsync_chan_config(struct xlnxsync_channel *channel,
 			/* Invalid fb_id passed */
 			dev_err(dev->dev, "Invalid FB id %d for configuration!\n",
 				cfg.fb_id[j]);
-			return -EINVAL;
+			ret = -EINVAL;
+			goto put_dbuf;
 		}
 
+		fb[j] = i;
+		planes[j] = XLNXSYNC_FENCE_LUMA;
+		if (!cfg.ismono[j])
+			planes[j] |= XLNXSYNC_FENCE_CHROMA;
+	}
+
+	/* Do not overwrite the buffer while others still use it */
+	timeout = dma_resv_wait_timeout_rcu(dbuf->resv, true, true,
+				msecs_to_jiffies(XLNXSYNC_FENCE_TIMEOUT_MS));
+	if (timeout <= 0) {
+		dev_dbg(dev->dev, "%s : Buffer fences did not signal\n",
+			__func__);
+		ret = timeout ? timeout : -EBUSY;
+		goto put_dbuf;
+	}
+
+	ret = xlnxsync_fence_attach(channel, dbuf, fb, planes);
+	if (ret) {
+		dev_err(dev->dev, "%s : Failed to attach fences\n", __func__);
+		goto put_dbuf;
+	}
+
+	for (j = 0; j < XLNXSYNC_IO; j++) {
+		u32 l_start_reg, l_end_reg, c_start_reg, c_end_reg;
+
+		i = fb[j];
+
 		if (j == XLNXSYNC_PROD) {
 			l_start_reg = XLNXSYNC_PL_START_LO_REG;
 			l_end_reg = XLNXSYNC_PL_END_LO_REG;
@@ -519,7 +697,12 @@ static int xlnxsync_chan_config(struct xlnxsync_channel *channel,
 			  (i * XLNXSYNC_COREOFF_NEXT));
 	}
 
-	return 0;
+	ret = 0;
+
+put_dbuf:
+	dma_buf_put(dbuf);
+
+	return ret;
 }
 
 static int xlnxsync_chan_get_status(struct xlnxsync_channel *channel,
@@ -602,6 +785,7 @@ static int xlnxsync_chan_enable(struct xlnxsync_channel *channel, bool enable)
 		xlnxsync_clr(dev, channel->id, XLNXSYNC_CTRL_REG,
 			     XLNXSYNC_CTRL_ENABLE_MASK |
 			     XLNXSYNC_CTRL_INTR_EN_MASK);
+		xlnxsync_fence_cancel_all(channel);
 		channel->prod_sync_err = false;
 		channel->prod_wdg_err = false;
 		channel->cons_sync_err = false;
@@ -976,6 +1160,7 @@ static int xlnxsync_open(struct inode *iptr, struct file *fptr)
 	dev_dbg(dev->dev, "Reserving channel %d\n", i);
 	set_bit(i, &dev->reserved);
 	chan->id = i;
+	chan->fence_ctx = dma_fence_context_alloc(XLNXSYNC_IO);
 	list_add_tail(&chan->channel, &dev->channels);
 	chan->dev = dev;
 	fptr->private_data = chan;
@@ -1021,6 +1206,7 @@ static int xlnxsync_release(struct inode *iptr, struct file *fptr)
 	dev->chan_count--;
 	list_del(&channel->channel);
 	mutex_unlock(&dev->sync_mutex);
+	xlnxsync_fence_cancel_all(channel);
 	devm_kfree(dev->dev, channel);
 
 	if (atomic_dec_and_test(&dev->user_count)) {
@@ -1091,6 +1277,8 @@ static irqreturn_t xlnxsync_irq_handler(int irq, void *data)
 				XLNXSYNC_ISR_PLDONE_SHIFT;
 
 			chan->l_done[i][XLNXSYNC_PROD] = true;
+			xlnxsync_fence_plane_done(chan, i, XLNXSYNC_PROD,
+						  XLNXSYNC_FENCE_LUMA);
 		}
 
 		if (val & XLNXSYNC_ISR_PCVALID_MASK) {
@@ -1098,6 +1286,8 @@ static irqreturn_t xlnxsync_irq_handler(int irq, void *data)
 				XLNXSYNC_ISR_PCDONE_SHIFT;
 
 			chan->c_done[i][XLNXSYNC_PROD] = true;
+			xlnxsync_fence_plane_done(chan, i, XLNXSYNC_PROD,
+						  XLNXSYNC_FENCE_CHROMA);
 		}
 
 		if (val & XLNXSYNC_ISR_CLVALID_MASK) {
@@ -1105,6 +1295,8 @@ static irqreturn_t xlnxsync_irq_handler(int irq, void *data)
 				XLNXSYNC_ISR_CLDONE_SHIFT;
 
 			chan->l_done[i][XLNXSYNC_CONS] = true;
+			xlnxsync_fence_plane_done(chan, i, XLNXSYNC_CONS,
+						  XLNXSYNC_FENCE_LUMA);
 		}
 
 		if (val & XLNXSYNC_ISR_CCVALID_MASK) {
@@ -1112,6 +1304,8 @@ static irqreturn_t xlnxsync_irq_handler(int irq, void *data)
 				XLNXSYNC_ISR_CCDONE_SHIFT;
 
 			chan->c_done[i][XLNXSYNC_CONS] = true;
+			xlnxsync_fence_plane_done(chan, i, XLNXSYNC_CONS,
+						  XLNXSYNC_FENCE_CHROMA);
 		}
 
 		for (i = 0; i < XLNXSYNC_BUF_PER_CHAN; i++) {
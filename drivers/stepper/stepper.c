@@ -1,47 +1,384 @@
 /* SPDX-License-Identifier: GPL-2.0-or-later */
+#include <linux/cdev.h>
+#include <linux/compat.h>
 #include <linux/device.h>
+#include <linux/fs.h>
+#include <linux/hrtimer.h>
+#include <linux/idr.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/module.h>
-#include <linux/mutex.h>
+#include <linux/overflow.h>
+#include <linux/property.h>
+#include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/spinlock.h>
 #include <linux/stepper.h>
+#include <linux/uaccess.h>
+
+/*
+ * Ramp engine
+ *
+ * An hrtimer moves the current velocity toward the target velocity at
+ * 'update_rate_hz'. Each tick applies a small increment (in
+ * 1/STEPPER_VELOCITY_SCALE units) and calls the driver directly from the
+ * timer. 'velocity_lock' protects the velocity state. It is taken from the
+ * timer (hard IRQ context), so use the irqsave variants elsewhere.
+ *
+ * The velocity of each tick comes from a profile table. We compute the
+ * table when the target changes (see 'stepper_profile_compute') and the
+ * timer replays it. A long ramp may need more than a table's worth of
+ * ticks. In that case, the timer computes the next part of the ramp when
+ * it reaches the end of the table.
+ */
+#define STEPPER_PROFILE_MAX_TICKS 2048
+/* ns * mHz = 1e-12 steps. Divide by this to get 1/STEPPER_POSITION_SCALE
+ * steps. */
+#define STEPPER_POSITION_DIV (1000000000000ULL / STEPPER_POSITION_SCALE)
+/* Fixed-point fraction bits of the profile computation */
+#define STEPPER_PROFILE_Q 16
+
+/* Number of minors of the character devices */
+#define STEPPER_MAX_DEVICES 32
+
+static dev_t stepper_devt;
+static DEFINE_IDA(stepper_ida);
+
+static const char *const stepper_profile_names[STEPPER_PROFILE_SIZE] = {
+	"trapezoid",
+	"s-curve",
+};
 
 struct stepper_device {
 	struct device dev;
-	struct delayed_work velocity_dwork;
-	struct mutex velocity_mutex;
+	struct hrtimer velocity_timer;
+	spinlock_t velocity_lock;
+	/* In 1/STEPPER_VELOCITY_SCALE units */
 	int velocity_current;
 	int velocity_target;
+	/* The velocity of the previous tick. Gives the current acceleration. */
+	int velocity_previous;
+	/* The latest value given to 'set_velocity' (see 'stepper_apply') */
+	int velocity_applied;
 	bool velocity_shifting;
 	bool force_off;
+	unsigned int update_rate_hz;
+	/* STEPPER_PROFILE_MAX_TICKS velocities. Entries from 'profile_index'
+	 * to 'profile_len' are yet to be replayed. */
+	int *profile;
+	unsigned int profile_index;
+	unsigned int profile_len;
+	/* Position in 1/STEPPER_POSITION_SCALE steps (see 'stepper_position_update') */
+	s64 position;
+	ktime_t position_time;
+	/* The step rate since 'position_time'. Negative in reverse. */
+	s64 position_rate_mhz;
+	/* Move-to-position mode (see 'stepper_position_tick') */
+	bool position_mode;
+	s64 position_target;
+	/* In 1/STEPPER_VELOCITY_SCALE units */
+	int position_velocity;
+	/* Synchronized start (see 'group_commit_store'). Zero for no group. */
+	u32 group;
+	bool armed;
+	int velocity_armed;
 	struct stepper_ops ops;
 	struct stepper_vel_cfg cfg;
+	/* Command queue (see 'include/uapi/linux/stepper.h'). 'queue_lock'
+	 * protects the 'queue_*' members. */
+	struct cdev cdev;
+	struct task_struct *queue_thread;
+	spinlock_t queue_lock;
+	struct stepper_cmd *queue_cmds;
+	u32 queue_count;
+	u32 queue_index;
+	int queue_error;
+	ktime_t queue_start;
+	struct file *queue_owner;
 };
 
 #define to_stepper_device(d) container_of(d, struct stepper_device, dev)
 
-static struct workqueue_struct *stepper_workqueue;
+/*
+ * Position tracking
+ *
+ * If the driver has a step counter ('get_steps'), we simply read it.
+ * Otherwise, we integrate the step rate (see 'step_rate_mhz') over the time
+ * between velocity changes. The driver applies a new velocity right away
+ * so the estimate is off by (at most) a fraction of a step per change.
+ */
+static bool stepper_has_position(struct stepper_device *stepdev)
+{
+	return NULL != stepdev->ops.get_steps || NULL != stepdev->ops.step_rate_mhz;
+}
 
-static void stepper_reach_target_velocity(struct work_struct *work)
+static void stepper_position_update(struct stepper_device *stepdev)
 {
-	struct delayed_work *dwork = to_delayed_work(work);
-	struct stepper_device *stepdev = container_of(dwork,
-	                                     struct stepper_device, velocity_dwork);
 	struct stepper_ops *ops = &stepdev->ops;
+	ktime_t now = ktime_get();
+	s64 elapsed_ns = ktime_to_ns(ktime_sub(now, stepdev->position_time));
+	s64 steps;
+	u64 delta;
+
+	lockdep_assert_held(&stepdev->velocity_lock);
+
+	stepdev->position_time = now;
+	if (NULL != ops->get_steps) {
+		if (0 == ops->get_steps(&stepdev->dev, &steps)) {
+			stepdev->position = steps * STEPPER_POSITION_SCALE;
+		}
+		return;
+	}
+	if (0 >= elapsed_ns || 0 == stepdev->position_rate_mhz) {
+		return;
+	}
+	delta = mul_u64_u32_div(elapsed_ns, abs(stepdev->position_rate_mhz),
+	                        STEPPER_POSITION_DIV);
+	if (0 < stepdev->position_rate_mhz) {
+		stepdev->position += delta;
+	} else {
+		stepdev->position -= delta;
+	}
+}
+
+static s64 stepper_step_rate_mhz(struct stepper_device *stepdev, int velocity_fine)
+{
+	struct stepper_ops *ops = &stepdev->ops;
+	s64 rate;
+	if (NULL == ops->step_rate_mhz) {
+		return 0;
+	}
+	rate = ops->step_rate_mhz(&stepdev->dev, velocity_fine);
+	return (0 > velocity_fine) ? -rate : rate;
+}
+
+static void stepper_apply(struct stepper_device *stepdev)
+{
+	struct stepper_ops *ops = &stepdev->ops;
+	int velocity;
+
+	lockdep_assert_held(&stepdev->velocity_lock);
+
+	stepper_position_update(stepdev);
+	if (NULL != ops->set_velocity_fine) {
+		stepdev->position_rate_mhz =
+			stepper_step_rate_mhz(stepdev, stepdev->velocity_current);
+		ops->set_velocity_fine(&stepdev->dev, stepdev->velocity_current);
+		return;
+	}
+	/* Only call the driver when the (coarse) velocity changes */
+	velocity = DIV_ROUND_CLOSEST(stepdev->velocity_current, STEPPER_VELOCITY_SCALE);
+	if (velocity == stepdev->velocity_applied) {
+		return;
+	}
+	stepdev->velocity_applied = velocity;
+	stepdev->position_rate_mhz =
+		stepper_step_rate_mhz(stepdev, velocity * STEPPER_VELOCITY_SCALE);
+	ops->set_velocity(&stepdev->dev, velocity);
+}
+
+/* The maximum velocity increment of a single tick (fixed-point) */
+static u64 stepper_tick_accel(struct stepper_device *stepdev)
+{
 	struct stepper_vel_cfg *cfg = &stepdev->cfg;
-	int delta;
-	mutex_lock(&stepdev->velocity_mutex);
-	delta = stepdev->velocity_target - stepdev->velocity_current;
-	delta = clamp(delta, -cfg->rate_of_change, cfg->rate_of_change);
-	stepdev->velocity_current += delta;
-	ops->set_velocity(&stepdev->dev, stepdev->velocity_current);
-	if (stepdev->velocity_current == stepdev->velocity_target) {
+	u64 per_second, per_tick;
+	u32 rem;
+	/* Velocity (in fine units) per second */
+	per_second = (u64)max(0, cfg->rate_of_change) * STEPPER_VELOCITY_SCALE * MSEC_PER_SEC;
+	per_second = div_u64(per_second, max(1, cfg->shift_delay_ms));
+	/* Split up the division so that the shift doesn't overflow */
+	per_tick = div_u64_rem(per_second, stepdev->update_rate_hz, &rem);
+	per_tick = (per_tick << STEPPER_PROFILE_Q) +
+	           div_u64((u64)rem << STEPPER_PROFILE_Q, stepdev->update_rate_hz);
+	return max_t(u64, 1ULL << STEPPER_PROFILE_Q, per_tick);
+}
+
+/* The maximum acceleration increment of a single tick (fixed-point). Zero
+ * for no limit. */
+static u64 stepper_tick_jerk(struct stepper_device *stepdev)
+{
+	struct stepper_vel_cfg *cfg = &stepdev->cfg;
+	u64 rate = stepdev->update_rate_hz;
+	if (STEPPER_PROFILE_SCURVE != cfg->profile || 0 == cfg->jerk) {
+		return 0;
+	}
+	return max_t(u64, 1, div64_u64(((u64)cfg->jerk * STEPPER_VELOCITY_SCALE)
+	                               << STEPPER_PROFILE_Q, rate * rate));
+}
+
+/*
+ * Fill the profile table with the velocities from the current velocity
+ * toward the target. We start from the current acceleration (so that a
+ * change of target mid-ramp in the same direction is also jerk-limited).
+ * Toward the end of the
+ * ramp, the acceleration ramps down so that it reaches zero along with
+ * the target velocity.
+ */
+static void stepper_profile_compute(struct stepper_device *stepdev)
+{
+	int start = stepdev->velocity_current;
+	int target = stepdev->velocity_target;
+	int sign = (target > start) ? 1 : -1;
+	u64 remaining = (u64)abs((s64)target - start) << STEPPER_PROFILE_Q;
+	u64 max_accel = min(stepper_tick_accel(stepdev), remaining);
+	u64 jerk = stepper_tick_jerk(stepdev);
+	s64 prev_accel = sign * ((s64)start - stepdev->velocity_previous);
+	u64 accel = (0 < prev_accel) ? min_t(u64, (u64)prev_accel << STEPPER_PROFILE_Q, max_accel) : 0;
+	u64 gained = 0;
+	u64 brake;
+	unsigned int i;
+
+	lockdep_assert_held(&stepdev->velocity_lock);
+
+	for (i = 0; STEPPER_PROFILE_MAX_TICKS > i; ++i) {
+		if (0 == jerk) {
+			accel = max_accel;
+		} else {
+			/* The velocity that we still gain if we start to ramp the
+			 * acceleration down now: a * (a / j + 1) / 2 */
+			if (check_mul_overflow(accel, div64_u64(accel, jerk) + 1, &brake)) {
+				brake = U64_MAX;
+			}
+			brake /= 2;
+			if (remaining - gained <= brake) {
+				accel = (accel > 2 * jerk) ? accel - jerk : jerk;
+			} else {
+				accel = min(accel + jerk, max_accel);
+			}
+		}
+		gained = min(gained + accel, remaining);
+		stepdev->profile[i] = start + sign * (int)(gained >> STEPPER_PROFILE_Q);
+		if (gained == remaining) {
+			stepdev->profile[i] = target;
+			++i;
+			break;
+		}
+	}
+	stepdev->profile_index = 0;
+	stepdev->profile_len = i;
+}
+
+static ktime_t stepper_tick_period(struct stepper_device *stepdev)
+{
+	return ns_to_ktime(NSEC_PER_SEC / stepdev->update_rate_hz);
+}
+
+/* The acceleration limit in 1/STEPPER_VELOCITY_SCALE units per second */
+static u64 stepper_accel_per_s(struct stepper_device *stepdev)
+{
+	struct stepper_vel_cfg *cfg = &stepdev->cfg;
+	u64 per_second = (u64)max(0, cfg->rate_of_change) * STEPPER_VELOCITY_SCALE * MSEC_PER_SEC;
+	return max_t(u64, 1, div_u64(per_second, max(1, cfg->shift_delay_ms)));
+}
+
+/*
+ * The distance (in 1/STEPPER_POSITION_SCALE steps) that it takes to slow
+ * down from 'velocity' to STEPPER_POSITION_CREEP_VELOCITY. Assumes that the
+ * step rate is (roughly) linear in the velocity.
+ */
+static u64 stepper_stop_distance(struct stepper_device *stepdev, int velocity)
+{
+	u64 accel = stepper_accel_per_s(stepdev);
+	unsigned int speed = abs(velocity);
+	u64 mean_mhz;
+	u64 time_ns;
+	if (STEPPER_POSITION_CREEP_VELOCITY >= speed) {
+		return 0;
+	}
+	time_ns = div64_u64((u64)(speed - STEPPER_POSITION_CREEP_VELOCITY) * NSEC_PER_SEC, accel);
+	/* The S-curve needs more time to ramp the acceleration up and down */
+	if (STEPPER_PROFILE_SCURVE == stepdev->cfg.profile && 0 != stepdev->cfg.jerk) {
+		time_ns += div64_u64(accel * NSEC_PER_SEC,
+		                     (u64)stepdev->cfg.jerk * STEPPER_VELOCITY_SCALE);
+	}
+	mean_mhz = abs(stepper_step_rate_mhz(stepdev, speed)) +
+	           abs(stepper_step_rate_mhz(stepdev, STEPPER_POSITION_CREEP_VELOCITY));
+	mean_mhz /= 2;
+	return mul_u64_u32_div(time_ns, min_t(u64, mean_mhz, U32_MAX),
+	                       STEPPER_POSITION_DIV);
+}
+
+/*
+ * Move-to-position mode
+ *
+ * Called on each tick. Cruises at 'position_velocity' toward the target.
+ * Once within the stopping distance, slows down
+ * to STEPPER_POSITION_CREEP_VELOCITY. Stops right away when the target is
+ * less than a tick away.
+ */
+static void stepper_position_tick(struct stepper_device *stepdev)
+{
+	s64 remaining = stepdev->position_target - stepdev->position;
+	int direction = (0 <= remaining) ? 1 : -1;
+	u64 distance = abs(remaining);
+	u64 tick_distance;
+	int desired;
+
+	lockdep_assert_held(&stepdev->velocity_lock);
+
+	tick_distance = div_u64(abs(stepdev->position_rate_mhz) *
+	                        (STEPPER_POSITION_SCALE / 1000), stepdev->update_rate_hz);
+	if (distance <= max_t(u64, tick_distance, STEPPER_POSITION_SCALE / 2)) {
+		stepdev->position_mode = false;
+		stepdev->velocity_target = 0;
+		stepdev->velocity_current = 0;
+		stepdev->velocity_previous = 0;
+		stepdev->profile_len = 0;
+		stepper_apply(stepdev);
+		return;
+	}
+	desired = direction * stepdev->position_velocity;
+	/* Slow down unless we move the wrong way (then we have to turn around) */
+	if (0 <= direction * stepdev->velocity_current &&
+	    distance <= stepper_stop_distance(stepdev, stepdev->velocity_current)) {
+		desired = direction * min(stepdev->position_velocity,
+		                          STEPPER_POSITION_CREEP_VELOCITY);
+	}
+	if (desired != stepdev->velocity_target) {
+		stepdev->velocity_target = desired;
+		stepper_profile_compute(stepdev);
+	}
+}
+
+static enum hrtimer_restart stepper_reach_target_velocity(struct hrtimer *timer)
+{
+	struct stepper_device *stepdev = container_of(timer,
+	                                     struct stepper_device, velocity_timer);
+	enum hrtimer_restart restart = HRTIMER_RESTART;
+	spin_lock(&stepdev->velocity_lock);
+	if (!stepdev->velocity_shifting) {
+		restart = HRTIMER_NORESTART;
+		goto out_lock;
+	}
+	if (stepdev->position_mode) {
+		stepper_position_update(stepdev);
+		stepper_position_tick(stepdev);
+		if (!stepdev->position_mode) {
+			/* Reached the target */
+			stepdev->velocity_shifting = false;
+			restart = HRTIMER_NORESTART;
+			goto out_lock;
+		}
+	}
+	if (stepdev->profile_len <= stepdev->profile_index) {
+		stepper_profile_compute(stepdev);
+	}
+	stepdev->velocity_previous = stepdev->velocity_current;
+	stepdev->velocity_current = stepdev->profile[stepdev->profile_index++];
+	stepper_apply(stepdev);
+	if (stepdev->velocity_current == stepdev->velocity_target &&
+	    !stepdev->position_mode) {
 		stepdev->velocity_shifting = false;
-		goto out_mutex;
+		/* The next ramp starts without any acceleration */
+		stepdev->velocity_previous = stepdev->velocity_current;
+		restart = HRTIMER_NORESTART;
+	} else {
+		hrtimer_forward_now(timer, stepper_tick_period(stepdev));
 	}
-	queue_delayed_work(stepper_workqueue, dwork,
-	                   msecs_to_jiffies(cfg->shift_delay_ms));
-out_mutex:
-	mutex_unlock(&stepdev->velocity_mutex);
+out_lock:
+	spin_unlock(&stepdev->velocity_lock);
+	return restart;
 }
 
 static int stepper_validate_velocity(struct stepper_device *stepdev, int vel)
@@ -51,63 +388,105 @@ static int stepper_validate_velocity(struct stepper_device *stepdev, int vel)
 	return (min_vel <= vel && vel <= max_vel) ? 0 : -EINVAL;
 }
 
-static int stepper_set_target_velocity(struct stepper_device *stepdev, int vel)
+/* Start the ramp toward 'vel'. The first tick is at 'first_tick'. */
+static void _stepper_set_target_velocity(struct stepper_device *stepdev, int vel,
+                                         ktime_t first_tick)
 {
-	int result = stepper_validate_velocity(stepdev, vel);
-	if (0 != result) {
-		goto out;
-	}
+	lockdep_assert_held(&stepdev->velocity_lock);
+
 	if (stepdev->force_off) {
-		goto out;
+		return;
 	}
-	mutex_lock(&stepdev->velocity_mutex);
-	stepdev->velocity_target = vel;
+	/* A velocity overrides the move (if any) */
+	stepdev->position_mode = false;
+	stepdev->velocity_target = vel * STEPPER_VELOCITY_SCALE;
 	if (stepdev->velocity_current == stepdev->velocity_target) {
-		goto out_mutex;
+		return;
 	}
+	/* A running ramp continues with the new profile */
+	stepper_profile_compute(stepdev);
 	if (stepdev->velocity_shifting) {
-		goto out_mutex;
+		return;
 	}
 	stepdev->velocity_shifting = true;
-	queue_delayed_work(stepper_workqueue, &stepdev->velocity_dwork,
-	                   msecs_to_jiffies(stepdev->cfg.shift_delay_ms));
-out_mutex:
-	mutex_unlock(&stepdev->velocity_mutex);
-out:
-	return result;
+	hrtimer_start(&stepdev->velocity_timer, first_tick, HRTIMER_MODE_ABS);
 }
 
-static void _stepper_set_target_velocity_instant(struct stepper_device *stepdev, int vel)
+static int stepper_set_target_velocity(struct stepper_device *stepdev, int vel)
 {
-	struct stepper_ops *ops = &stepdev->ops;
+	unsigned long flags;
+	int result = stepper_validate_velocity(stepdev, vel);
+	if (0 != result) {
+		return result;
+	}
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	_stepper_set_target_velocity(stepdev, vel,
+	                             ktime_add(ktime_get(), stepper_tick_period(stepdev)));
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return 0;
+}
 
-	lockdep_assert_held(stepdev->velocity_mutex);
+static void _stepper_set_target_velocity_instant(struct stepper_device *stepdev, int vel)
+{
+	lockdep_assert_held(&stepdev->velocity_lock);
 
-	stepdev->velocity_target = vel;
+	stepdev->position_mode = false;
+	stepdev->velocity_target = vel * STEPPER_VELOCITY_SCALE;
 	if (stepdev->velocity_current == stepdev->velocity_target) {
 		return;
 	}
-	cancel_delayed_work_sync(&stepdev->velocity_dwork);
+	/* A pending tick finds that there is nothing to do and stops */
 	stepdev->velocity_shifting = false;
-	stepdev->velocity_current = vel;
-	ops->set_velocity(&stepdev->dev, stepdev->velocity_current);
+	stepdev->velocity_current = stepdev->velocity_target;
+	stepdev->velocity_previous = stepdev->velocity_current;
+	stepdev->profile_len = 0;
+	stepper_apply(stepdev);
 }
 
 static int stepper_set_target_velocity_instant(struct stepper_device *stepdev, int vel)
 {
+	unsigned long flags;
 	int result = stepper_validate_velocity(stepdev, vel);
 	if (0 != result) {
 		return result;
 	}
-	if (stepdev->force_off) {
-		return 0;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	if (!stepdev->force_off) {
+		_stepper_set_target_velocity_instant(stepdev, vel);
 	}
-	mutex_lock(&stepdev->velocity_mutex);
-	_stepper_set_target_velocity_instant(stepdev, vel);
-	mutex_unlock(&stepdev->velocity_mutex);
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
 	return 0;
 }
 
+static int stepper_move_to_position(struct stepper_device *stepdev, s64 steps)
+{
+	unsigned long flags;
+	int result = 0;
+	if (!stepper_has_position(stepdev)) {
+		return -EOPNOTSUPP;
+	}
+	if (S64_MAX / STEPPER_POSITION_SCALE < abs(steps)) {
+		return -ERANGE;
+	}
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	if (stepdev->force_off) {
+		result = -EPERM;
+		goto out_lock;
+	}
+	stepdev->position_target = steps * STEPPER_POSITION_SCALE;
+	stepdev->position_mode = true;
+	if (stepdev->velocity_shifting) {
+		/* The next tick takes over */
+		goto out_lock;
+	}
+	stepdev->velocity_shifting = true;
+	hrtimer_start(&stepdev->velocity_timer, stepper_tick_period(stepdev),
+	              HRTIMER_MODE_REL);
+out_lock:
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return result;
+}
+
 static int stepper_validate_abs_torque(struct stepper_device *stepdev, unsigned abs_torque)
 {
 	return (abs_torque <= 100) ? 0 : -EINVAL;
@@ -130,18 +509,262 @@ static int stepper_set_abs_torque(struct stepper_device *stepdev, unsigned abs_t
 	return ops->set_abs_torque(&stepdev->dev, abs_torque);
 }
 
+/*
+ * Command queue
+ *
+ * A kernel thread (per device) sleeps until the next command is due and
+ * executes it. We can't do this from an hrtimer since 'set_abs_torque'
+ * may sleep.
+ */
+
+static void stepper_queue_execute(struct stepper_device *stepdev,
+                                  const struct stepper_cmd *cmd)
+{
+	int ret = 0;
+	if (cmd->flags & STEPPER_CMD_VELOCITY_INSTANT) {
+		ret = stepper_set_target_velocity_instant(stepdev, cmd->velocity);
+	} else if (cmd->flags & STEPPER_CMD_VELOCITY) {
+		ret = stepper_set_target_velocity(stepdev, cmd->velocity);
+	}
+	if (0 == ret && (cmd->flags & STEPPER_CMD_TORQUE)) {
+		ret = stepper_set_abs_torque(stepdev, cmd->abs_torque);
+	}
+	if (0 != ret) {
+		spin_lock(&stepdev->queue_lock);
+		if (0 == stepdev->queue_error) {
+			stepdev->queue_error = ret;
+		}
+		spin_unlock(&stepdev->queue_lock);
+	}
+}
+
+static int stepper_queue_thread(void *data)
+{
+	struct stepper_device *stepdev = data;
+	struct stepper_cmd cmd;
+	ktime_t when;
+	for (;;) {
+		/* Set the state before we check the queue so that we don't miss
+		 * a wake-up */
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (kthread_should_stop()) {
+			break;
+		}
+		spin_lock(&stepdev->queue_lock);
+		if (stepdev->queue_count == stepdev->queue_index) {
+			spin_unlock(&stepdev->queue_lock);
+			schedule();
+			continue;
+		}
+		cmd = stepdev->queue_cmds[stepdev->queue_index];
+		when = ktime_add_ns(stepdev->queue_start, cmd.offset_ns);
+		if (ktime_after(when, ktime_get())) {
+			spin_unlock(&stepdev->queue_lock);
+			schedule_hrtimeout(&when, HRTIMER_MODE_ABS);
+			continue;
+		}
+		++stepdev->queue_index;
+		spin_unlock(&stepdev->queue_lock);
+		__set_current_state(TASK_RUNNING);
+		stepper_queue_execute(stepdev, &cmd);
+	}
+	__set_current_state(TASK_RUNNING);
+	return 0;
+}
+
+static int stepper_queue_validate(struct stepper_device *stepdev,
+                                  const struct stepper_cmd *cmds, u32 count)
+{
+	const u32 known = STEPPER_CMD_VELOCITY | STEPPER_CMD_VELOCITY_INSTANT |
+	                  STEPPER_CMD_TORQUE;
+	u32 i;
+	int ret;
+	for (i = 0; count != i; ++i) {
+		if ((cmds[i].flags & ~known) || 0 != cmds[i].reserved) {
+			return -EINVAL;
+		}
+		if (0 != i && cmds[i].offset_ns < cmds[i - 1].offset_ns) {
+			return -EINVAL;
+		}
+		if (cmds[i].flags & (STEPPER_CMD_VELOCITY | STEPPER_CMD_VELOCITY_INSTANT)) {
+			ret = stepper_validate_velocity(stepdev, cmds[i].velocity);
+			if (0 != ret) {
+				return ret;
+			}
+		}
+		if (cmds[i].flags & STEPPER_CMD_TORQUE) {
+			ret = stepper_validate_abs_torque(stepdev, cmds[i].abs_torque);
+			if (0 != ret) {
+				return ret;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Replace the current batch with 'cmds' (that we take ownership of) */
+static int stepper_queue_install(struct stepper_device *stepdev,
+                                 struct file *owner, struct stepper_cmd *cmds,
+                                 u32 count, ktime_t start)
+{
+	struct stepper_cmd *old;
+	spin_lock(&stepdev->queue_lock);
+	if (NULL == stepdev->queue_thread) {
+		/* The device is gone */
+		spin_unlock(&stepdev->queue_lock);
+		kvfree(cmds);
+		return -ENODEV;
+	}
+	old = stepdev->queue_cmds;
+	stepdev->queue_cmds = cmds;
+	stepdev->queue_count = count;
+	stepdev->queue_index = 0;
+	stepdev->queue_error = 0;
+	stepdev->queue_start = start;
+	stepdev->queue_owner = owner;
+	wake_up_process(stepdev->queue_thread);
+	spin_unlock(&stepdev->queue_lock);
+	/* The thread copies each command under the lock. I.e., it no longer
+	 * uses the old batch. */
+	kvfree(old);
+	return 0;
+}
+
+static int stepper_queue_start(struct stepper_device *stepdev,
+                               struct file *owner, struct stepper_batch *batch)
+{
+	struct stepper_cmd *cmds;
+	ktime_t now = ktime_get();
+	int ret;
+	if (0 == batch->count || STEPPER_QUEUE_MAX_CMDS < batch->count) {
+		return -EINVAL;
+	}
+	if (0 != batch->flags) {
+		return -EINVAL;
+	}
+	cmds = vmemdup_user(u64_to_user_ptr(batch->cmds),
+	                    batch->count * sizeof(*cmds));
+	if (IS_ERR(cmds)) {
+		return PTR_ERR(cmds);
+	}
+	ret = stepper_queue_validate(stepdev, cmds, batch->count);
+	if (0 != ret) {
+		kvfree(cmds);
+		return ret;
+	}
+	if (0 == batch->start_ns) {
+		batch->start_ns = ktime_to_ns(now);
+	}
+	return stepper_queue_install(stepdev, owner, cmds, batch->count,
+	                             ns_to_ktime(batch->start_ns));
+}
+
+/* Stop the current batch. Only if it belongs to 'owner' (unless NULL). */
+static void stepper_queue_cancel(struct stepper_device *stepdev,
+                                 struct file *owner)
+{
+	spin_lock(&stepdev->queue_lock);
+	if (NULL == owner || stepdev->queue_owner == owner) {
+		stepdev->queue_count = stepdev->queue_index;
+		stepdev->queue_owner = NULL;
+	}
+	spin_unlock(&stepdev->queue_lock);
+	/* The thread finds that there is nothing to do and goes back to
+	 * sleep. No need to wake it. */
+}
+
+static void stepper_queue_status(struct stepper_device *stepdev,
+                                 struct stepper_queue_status *status)
+{
+	memset(status, 0, sizeof(*status));
+	spin_lock(&stepdev->queue_lock);
+	status->pending = stepdev->queue_count - stepdev->queue_index;
+	status->executed = stepdev->queue_index;
+	status->error = stepdev->queue_error;
+	spin_unlock(&stepdev->queue_lock);
+}
+
+static int stepper_open(struct inode *inode, struct file *filp)
+{
+	filp->private_data = container_of(inode->i_cdev, struct stepper_device, cdev);
+	return nonseekable_open(inode, filp);
+}
+
+static int stepper_release(struct inode *inode, struct file *filp)
+{
+	stepper_queue_cancel(filp->private_data, filp);
+	return 0;
+}
+
+static long stepper_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+	struct stepper_device *stepdev = filp->private_data;
+	void __user *argp = (void __user *)arg;
+	struct stepper_batch batch;
+	struct stepper_queue_status status;
+	int ret;
+	switch (cmd) {
+	case STEPPER_IOC_QUEUE:
+		/* Same as for the sysfs attributes */
+		if (!capable(CAP_SYS_ADMIN)) {
+			return -EPERM;
+		}
+		if (copy_from_user(&batch, argp, sizeof(batch))) {
+			return -EFAULT;
+		}
+		ret = stepper_queue_start(stepdev, filp, &batch);
+		if (0 != ret) {
+			return ret;
+		}
+		if (copy_to_user(argp, &batch, sizeof(batch))) {
+			return -EFAULT;
+		}
+		return 0;
+	case STEPPER_IOC_CANCEL:
+		if (!capable(CAP_SYS_ADMIN)) {
+			return -EPERM;
+		}
+		stepper_queue_cancel(stepdev, NULL);
+		return 0;
+	case STEPPER_IOC_STATUS:
+		stepper_queue_status(stepdev, &status);
+		if (copy_to_user(argp, &status, sizeof(status))) {
+			return -EFAULT;
+		}
+		return 0;
+	default:
+		return -ENOTTY;
+	}
+}
+
+#ifdef CONFIG_COMPAT
+/* The structs have the same layout for 32-bit user space */
+static long stepper_compat_ioctl(struct file *filp, unsigned int cmd,
+                                 unsigned long arg)
+{
+	return stepper_ioctl(filp, cmd, (unsigned long)compat_ptr(arg));
+}
+#endif
+
+static const struct file_operations stepper_fops = {
+	.owner = THIS_MODULE,
+	.open = stepper_open,
+	.release = stepper_release,
+	.unlocked_ioctl = stepper_ioctl,
+#ifdef CONFIG_COMPAT
+	.compat_ioctl = stepper_compat_ioctl,
+#endif
+	.llseek = no_llseek,
+};
+
 /* force_off */
 static ssize_t force_off_show(
 	struct device *dev,
 	struct device_attribute *attr,
 	char *buf)
 {
-	int result;
 	struct stepper_device *stepdev = to_stepper_device(dev);
-	mutex_lock(&stepdev->velocity_mutex);
-	result = scnprintf(buf, PAGE_SIZE, "%d\n", stepdev->force_off);
-	mutex_unlock(&stepdev->velocity_mutex);
-	return result;
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(stepdev->force_off));
 }
 static ssize_t force_off_store(
 	struct device *dev,
@@ -150,20 +773,20 @@ static ssize_t force_off_store(
 	size_t count)
 {
 	struct stepper_device *stepdev = to_stepper_device(dev);
-	int result;
-	mutex_lock(&stepdev->velocity_mutex);
-	result = kstrtobool(buf, &stepdev->force_off);
+	unsigned long flags;
+	bool force_off;
+	int result = kstrtobool(buf, &force_off);
 	if (0 != result) {
-		goto out_mutex;
+		return result;
 	}
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepdev->force_off = force_off;
 	if (stepdev->force_off) {
 		/* Turn off the stepper motor immediately */
 		_stepper_set_target_velocity_instant(stepdev, 0);
 	}
-	result = count;
-out_mutex:
-	mutex_unlock(&stepdev->velocity_mutex);
-	return result;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return count;
 }
 DEVICE_ATTR(force_off, S_IRUGO | S_IWUSR, force_off_show, force_off_store);
 
@@ -173,12 +796,10 @@ static ssize_t velocity_current_show(
 	struct device_attribute *attr,
 	char *buf)
 {
-	int result;
 	struct stepper_device *stepdev = to_stepper_device(dev);
-	mutex_lock(&stepdev->velocity_mutex);
-	result = scnprintf(buf, PAGE_SIZE, "%d\n", stepdev->velocity_current);
-	mutex_unlock(&stepdev->velocity_mutex);
-	return result;
+	int velocity = READ_ONCE(stepdev->velocity_current);
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+	                 DIV_ROUND_CLOSEST(velocity, STEPPER_VELOCITY_SCALE));
 }
 DEVICE_ATTR(velocity_current, S_IRUGO, velocity_current_show, NULL);
 
@@ -188,12 +809,10 @@ static ssize_t velocity_target_show(
 	struct device_attribute *attr,
 	char *buf)
 {
-	int result;
 	struct stepper_device *stepdev = to_stepper_device(dev);
-	mutex_lock(&stepdev->velocity_mutex);
-	result = scnprintf(buf, PAGE_SIZE, "%d\n", stepdev->velocity_target);
-	mutex_unlock(&stepdev->velocity_mutex);
-	return result;
+	int velocity = READ_ONCE(stepdev->velocity_target);
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+	                 DIV_ROUND_CLOSEST(velocity, STEPPER_VELOCITY_SCALE));
 }
 static ssize_t velocity_target_store(
 	struct device *dev,
@@ -254,6 +873,352 @@ static ssize_t velocity_max_show(
 }
 DEVICE_ATTR(velocity_max, S_IRUGO, velocity_max_show, NULL);
 
+/* update_rate_hz
+ *
+ * Update rate of the ramp engine. Takes effect on the next tick. */
+static ssize_t update_rate_hz_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(stepdev->update_rate_hz));
+}
+static ssize_t update_rate_hz_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	unsigned value;
+	int result = kstrtouint(buf, 0, &value);
+	if (0 != result)
+		return result;
+	if (0 == value || STEPPER_MAX_UPDATE_RATE_HZ < value)
+		return -EINVAL;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepdev->update_rate_hz = value;
+	/* The profile is in ticks. Compute it again for the new rate. */
+	stepdev->profile_len = 0;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return count;
+}
+DEVICE_ATTR(update_rate_hz, S_IRUGO | S_IWUSR, update_rate_hz_show, update_rate_hz_store);
+
+/* profile
+ *
+ * Shape of the velocity ramp. Either "trapezoid" or "s-curve". Takes
+ * effect on the next change of the target velocity. */
+static ssize_t profile_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	return scnprintf(buf, PAGE_SIZE, "%s\n",
+	                 stepper_profile_names[READ_ONCE(stepdev->cfg.profile)]);
+}
+static ssize_t profile_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	int result = sysfs_match_string(stepper_profile_names, buf);
+	if (0 > result)
+		return result;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepdev->cfg.profile = result;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return count;
+}
+DEVICE_ATTR(profile, S_IRUGO | S_IWUSR, profile_show, profile_store);
+
+/* acceleration
+ *
+ * The (maximum) acceleration in velocity units per second. Takes effect on
+ * the next change of the target velocity. */
+static ssize_t acceleration_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	int value;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	value = stepdev->cfg.rate_of_change * MSEC_PER_SEC /
+	        max(1, stepdev->cfg.shift_delay_ms);
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", value);
+}
+static ssize_t acceleration_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	int value;
+	int result = kstrtoint(buf, 0, &value);
+	if (0 != result)
+		return result;
+	if (0 >= value)
+		return -EINVAL;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepdev->cfg.rate_of_change = value;
+	stepdev->cfg.shift_delay_ms = MSEC_PER_SEC;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return count;
+}
+DEVICE_ATTR(acceleration, S_IRUGO | S_IWUSR, acceleration_show, acceleration_store);
+
+/* jerk
+ *
+ * The maximum jerk of the "s-curve" profile in velocity units per second
+ * squared. Zero for no limit. Takes effect on the next change of the
+ * target velocity. */
+static ssize_t jerk_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(stepdev->cfg.jerk));
+}
+static ssize_t jerk_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	unsigned value;
+	int result = kstrtouint(buf, 0, &value);
+	if (0 != result)
+		return result;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepdev->cfg.jerk = value;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return count;
+}
+DEVICE_ATTR(jerk, S_IRUGO | S_IWUSR, jerk_show, jerk_store);
+
+/* position
+ *
+ * The position in steps. Write to set the current position (e.g., after
+ * homing). Not available if the driver can't count steps. */
+static ssize_t position_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	s64 position;
+	if (!stepper_has_position(stepdev))
+		return -EOPNOTSUPP;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepper_position_update(stepdev);
+	position = stepdev->position;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return scnprintf(buf, PAGE_SIZE, "%lld\n",
+	                 div_s64(position, STEPPER_POSITION_SCALE));
+}
+static ssize_t position_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	s64 value;
+	int result = kstrtos64(buf, 0, &value);
+	if (0 != result)
+		return result;
+	if (!stepper_has_position(stepdev) || NULL != stepdev->ops.get_steps)
+		return -EOPNOTSUPP;
+	if (S64_MAX / STEPPER_POSITION_SCALE < abs(value))
+		return -ERANGE;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepper_position_update(stepdev);
+	/* Keep an ongoing move relative to the old position */
+	stepdev->position_target += value * STEPPER_POSITION_SCALE - stepdev->position;
+	stepdev->position = value * STEPPER_POSITION_SCALE;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return count;
+}
+DEVICE_ATTR(position, S_IRUGO | S_IWUSR, position_show, position_store);
+
+/* position_target
+ *
+ * Write to move to the given position (in steps). Moves at
+ * 'position_velocity' and stops on its own at the target. A write to
+ * 'velocity_target' (or similar) aborts the move. */
+static ssize_t position_target_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	s64 target;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	target = stepdev->position_target;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return scnprintf(buf, PAGE_SIZE, "%lld\n",
+	                 div_s64(target, STEPPER_POSITION_SCALE));
+}
+static ssize_t position_target_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	s64 value;
+	int result = kstrtos64(buf, 0, &value);
+	if (0 != result)
+		return result;
+	result = stepper_move_to_position(stepdev, value);
+	if (0 != result)
+		return result;
+	return count;
+}
+DEVICE_ATTR(position_target, S_IRUGO | S_IWUSR, position_target_show, position_target_store);
+
+/* position_moving
+ *
+ * 1 while in move-to-position mode. */
+static ssize_t position_moving_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	return scnprintf(buf, PAGE_SIZE, "%d\n", READ_ONCE(stepdev->position_mode));
+}
+DEVICE_ATTR(position_moving, S_IRUGO, position_moving_show, NULL);
+
+/* position_velocity
+ *
+ * The (unsigned) cruise velocity of the move-to-position mode. */
+static ssize_t position_velocity_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	int velocity = READ_ONCE(stepdev->position_velocity);
+	return scnprintf(buf, PAGE_SIZE, "%d\n",
+	                 DIV_ROUND_CLOSEST(velocity, STEPPER_VELOCITY_SCALE));
+}
+static ssize_t position_velocity_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	int value;
+	int result = kstrtoint(buf, 0, &value);
+	if (0 != result)
+		return result;
+	if (0 >= value || value > stepdev->cfg.max || -value < stepdev->cfg.min)
+		return -EINVAL;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepdev->position_velocity = value * STEPPER_VELOCITY_SCALE;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return count;
+}
+DEVICE_ATTR(position_velocity, S_IRUGO | S_IWUSR, position_velocity_show, position_velocity_store);
+
+/* group
+ *
+ * The group that this device belongs to. Zero for none. */
+static ssize_t group_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	return scnprintf(buf, PAGE_SIZE, "%u\n", READ_ONCE(stepdev->group));
+}
+static ssize_t group_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned value;
+	int result = kstrtouint(buf, 0, &value);
+	if (0 != result)
+		return result;
+	WRITE_ONCE(stepdev->group, value);
+	return count;
+}
+DEVICE_ATTR(group, S_IRUGO | S_IWUSR, group_show, group_store);
+
+/* velocity_armed
+ *
+ * Like 'velocity_target' but only takes effect on the next commit of the
+ * group (see 'group_commit'). Reads "none" if not armed. */
+static ssize_t velocity_armed_show(
+	struct device *dev,
+	struct device_attribute *attr,
+	char *buf)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	bool armed;
+	int velocity;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	armed = stepdev->armed;
+	velocity = stepdev->velocity_armed;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	if (!armed)
+		return scnprintf(buf, PAGE_SIZE, "none\n");
+	return scnprintf(buf, PAGE_SIZE, "%d\n", velocity);
+}
+static ssize_t velocity_armed_store(
+	struct device *dev,
+	struct device_attribute *attr,
+	const char *buf,
+	size_t count)
+{
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	unsigned long flags;
+	int value;
+	int result;
+	if (sysfs_streq(buf, "none")) {
+		spin_lock_irqsave(&stepdev->velocity_lock, flags);
+		stepdev->armed = false;
+		spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+		return count;
+	}
+	result = kstrtoint(buf, 0, &value);
+	if (0 != result)
+		return result;
+	result = stepper_validate_velocity(stepdev, value);
+	if (0 != result)
+		return result;
+	spin_lock_irqsave(&stepdev->velocity_lock, flags);
+	stepdev->velocity_armed = value;
+	stepdev->armed = true;
+	spin_unlock_irqrestore(&stepdev->velocity_lock, flags);
+	return count;
+}
+DEVICE_ATTR(velocity_armed, S_IRUGO | S_IWUSR, velocity_armed_show, velocity_armed_store);
+
 /* abs_torque */
 static ssize_t abs_torque_show(
 	struct device *dev,
@@ -297,6 +1262,16 @@ static struct attribute *attrs[] = {
 	&dev_attr_velocity_target_instant.attr,
 	&dev_attr_velocity_min.attr,
 	&dev_attr_velocity_max.attr,
+	&dev_attr_update_rate_hz.attr,
+	&dev_attr_profile.attr,
+	&dev_attr_acceleration.attr,
+	&dev_attr_jerk.attr,
+	&dev_attr_position.attr,
+	&dev_attr_position_target.attr,
+	&dev_attr_position_moving.attr,
+	&dev_attr_position_velocity.attr,
+	&dev_attr_group.attr,
+	&dev_attr_velocity_armed.attr,
 	&dev_attr_abs_torque.attr,
 	NULL,
 };
@@ -310,14 +1285,106 @@ static const struct attribute_group *stepper_dev_attr_groups[] = {
 	NULL
 };
 
+/*
+ * Group commit
+ *
+ * Write a group number to /sys/class/stepper/group_commit to start the
+ * armed velocities of all devices in said group at once. We apply them
+ * with interrupts disabled and schedule the first tick of each (idle)
+ * device at the same time. Thus, the ramps start within the same tick.
+ * Devices that are already ramping pick up the new target on their next
+ * tick.
+ */
+struct stepper_group_commit {
+	u32 group;
+	unsigned int count;
+	struct stepper_device *devices[STEPPER_MAX_DEVICES];
+};
+
+static int stepper_group_collect(struct device *dev, void *data)
+{
+	struct stepper_group_commit *commit = data;
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	if (READ_ONCE(stepdev->group) != commit->group) {
+		return 0;
+	}
+	/* There are no more than STEPPER_MAX_DEVICES devices (minors) */
+	if (WARN_ON(ARRAY_SIZE(commit->devices) == commit->count)) {
+		return -E2BIG;
+	}
+	get_device(dev);
+	commit->devices[commit->count++] = stepdev;
+	return 0;
+}
+
+static ssize_t group_commit_store(struct class *class,
+                                  struct class_attribute *attr,
+                                  const char *buf, size_t count)
+{
+	struct stepper_group_commit *commit;
+	struct stepper_device *stepdev;
+	unsigned long flags;
+	ktime_t first_tick;
+	unsigned int i;
+	int result;
+	commit = kzalloc(sizeof(*commit), GFP_KERNEL);
+	if (NULL == commit) {
+		return -ENOMEM;
+	}
+	result = kstrtouint(buf, 0, &commit->group);
+	if (0 != result) {
+		goto out;
+	}
+	if (0 == commit->group) {
+		result = -EINVAL;
+		goto out;
+	}
+	result = class_for_each_device(class, NULL, commit, stepper_group_collect);
+	if (0 != result) {
+		goto out_put;
+	}
+	first_tick = ktime_add_ns(ktime_get(), NSEC_PER_SEC / STEPPER_MAX_UPDATE_RATE_HZ);
+	local_irq_save(flags);
+	for (i = 0; commit->count != i; ++i) {
+		stepdev = commit->devices[i];
+		spin_lock(&stepdev->velocity_lock);
+		if (stepdev->armed) {
+			stepdev->armed = false;
+			_stepper_set_target_velocity(stepdev, stepdev->velocity_armed,
+			                             first_tick);
+		}
+		spin_unlock(&stepdev->velocity_lock);
+	}
+	local_irq_restore(flags);
+out_put:
+	for (i = 0; commit->count != i; ++i) {
+		put_device(&commit->devices[i]->dev);
+	}
+out:
+	kfree(commit);
+	return (0 != result) ? result : count;
+}
+static CLASS_ATTR_WO(group_commit);
+
+static struct attribute *stepper_class_attrs[] = {
+	&class_attr_group_commit.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(stepper_class);
+
 static void stepper_dev_release(struct device *dev)
 {
-	kfree(to_stepper_device(dev));
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	ida_simple_remove(&stepper_ida, MINOR(stepdev->dev.devt));
+	kvfree(stepdev->queue_cmds);
+	kfree(stepdev->profile);
+	kfree(stepdev);
 }
 
 static struct class stepper_class = {
 	.name = "stepper",
 	.owner = THIS_MODULE,
+	.class_groups = stepper_class_groups,
 	.dev_groups = stepper_dev_attr_groups,
 	.dev_release = stepper_dev_release,
 };
@@ -327,37 +1394,82 @@ __stepper_device_register(struct device *dev, const char *name, void *drvdata,
 	                      struct stepper_ops *ops, struct stepper_vel_cfg *cfg)
 {
 	int err;
+	int minor;
 	struct stepper_device *stepdev;
 	struct device *hdev;
+	struct task_struct *thread;
 	stepdev = kzalloc(sizeof(*stepdev), GFP_KERNEL);
 	if (stepdev == NULL) {
 		err = -ENOMEM;
 		goto error;
 	}
-
-	hdev = &stepdev->dev;
-	hdev->class = &stepper_class;
-	hdev->parent = dev;
-	hdev->of_node = dev ? dev->of_node : NULL;
-	dev_set_drvdata(hdev, drvdata);
-	dev_set_name(hdev, name);
-	err = device_register(hdev);
-	if (err) {
+	stepdev->profile = kcalloc(STEPPER_PROFILE_MAX_TICKS,
+	                           sizeof(*stepdev->profile), GFP_KERNEL);
+	if (NULL == stepdev->profile) {
+		err = -ENOMEM;
 		goto free_stepdev;
 	}
 
-	INIT_DELAYED_WORK(&stepdev->velocity_dwork, stepper_reach_target_velocity);
-	mutex_init(&stepdev->velocity_mutex);
+	hrtimer_init(&stepdev->velocity_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	stepdev->velocity_timer.function = stepper_reach_target_velocity;
+	spin_lock_init(&stepdev->velocity_lock);
 	stepdev->velocity_current = 0;
 	stepdev->velocity_target = 0;
+	stepdev->velocity_previous = 0;
+	stepdev->velocity_applied = 0;
 	stepdev->velocity_shifting = false;
 	stepdev->force_off = false;
 	stepdev->ops = *ops;
 	stepdev->cfg = *cfg;
+	stepdev->update_rate_hz = cfg->update_rate_hz;
+	if (0 == stepdev->update_rate_hz) {
+		stepdev->update_rate_hz = STEPPER_DEFAULT_UPDATE_RATE_HZ;
+	}
+	spin_lock_init(&stepdev->queue_lock);
+	stepdev->position_time = ktime_get();
+	stepdev->position_velocity = min(cfg->max, -cfg->min) * STEPPER_VELOCITY_SCALE;
 
+	minor = ida_simple_get(&stepper_ida, 0, STEPPER_MAX_DEVICES, GFP_KERNEL);
+	if (minor < 0) {
+		err = minor;
+		goto free_stepdev;
+	}
+
+	hdev = &stepdev->dev;
+	device_initialize(hdev);
+	/* From now on, 'stepper_dev_release' frees 'stepdev' */
+	hdev->class = &stepper_class;
+	hdev->parent = dev;
+	hdev->of_node = dev ? dev->of_node : NULL;
+	hdev->devt = MKDEV(MAJOR(stepper_devt), minor);
+	dev_set_drvdata(hdev, drvdata);
+	err = dev_set_name(hdev, name);
+	if (err) {
+		goto put_hdev;
+	}
+
+	thread = kthread_run(stepper_queue_thread, stepdev, "stepper/%s", name);
+	if (IS_ERR(thread)) {
+		err = PTR_ERR(thread);
+		goto put_hdev;
+	}
+	stepdev->queue_thread = thread;
+
+	cdev_init(&stepdev->cdev, &stepper_fops);
+	stepdev->cdev.owner = THIS_MODULE;
+	err = cdev_device_add(&stepdev->cdev, hdev);
+	if (err) {
+		goto stop_thread;
+	}
 	return hdev;
 
+stop_thread:
+	kthread_stop(thread);
+put_hdev:
+	put_device(hdev);
+	goto error;
 free_stepdev:
+	kfree(stepdev->profile);
 	kfree(stepdev);
 error:
 	return ERR_PTR(err);
@@ -376,13 +1488,66 @@ struct device *stepper_device_register(struct device *dev, const char *name,
 	if (NULL == cfg) {
 		return ERR_PTR(-EINVAL);
 	}
+	if (STEPPER_PROFILE_SIZE <= cfg->profile) {
+		return ERR_PTR(-EINVAL);
+	}
 	return __stepper_device_register(dev, name, drvdata, ops, cfg);
 }
 EXPORT_SYMBOL(stepper_device_register);
 
+/*
+ * Override the ramp parameters of 'cfg' with the (optional) device tree
+ * properties of 'dev':
+ *
+ *   profile:      "trapezoid" or "s-curve"
+ *   acceleration: Velocity units per second
+ *   jerk:         Velocity units per second squared
+ */
+int stepper_of_get_vel_cfg(struct device *dev, struct stepper_vel_cfg *cfg)
+{
+	const char *profile;
+	u32 value;
+	int result;
+	if (0 == device_property_read_string(dev, "profile", &profile)) {
+		result = match_string(stepper_profile_names, STEPPER_PROFILE_SIZE, profile);
+		if (0 > result) {
+			dev_err(dev, "Invalid profile: %s\n", profile);
+			return result;
+		}
+		cfg->profile = result;
+	}
+	if (0 == device_property_read_u32(dev, "acceleration", &value)) {
+		if (0 == value || INT_MAX < value) {
+			dev_err(dev, "Invalid acceleration: %u\n", value);
+			return -EINVAL;
+		}
+		cfg->rate_of_change = value;
+		cfg->shift_delay_ms = MSEC_PER_SEC;
+	}
+	if (0 == device_property_read_u32(dev, "jerk", &value)) {
+		cfg->jerk = value;
+	}
+	return 0;
+}
+EXPORT_SYMBOL(stepper_of_get_vel_cfg);
+
 void stepper_device_unregister(struct device *dev)
 {
-	device_unregister(dev);
+	struct stepper_device *stepdev = to_stepper_device(dev);
+	struct task_struct *thread;
+	/* Remove the attributes and the character device first (so that no
+	 * one can restart the queue or the timer). Open files keep 'stepdev'
+	 * around. */
+	cdev_device_del(&stepdev->cdev, dev);
+	spin_lock(&stepdev->queue_lock);
+	thread = stepdev->queue_thread;
+	stepdev->queue_thread = NULL;
+	stepdev->queue_count = stepdev->queue_index;
+	spin_unlock(&stepdev->queue_lock);
+	/* The thread may still restart the timer. Stop it first. */
+	kthread_stop(thread);
+	hrtimer_cancel(&stepdev->velocity_timer);
+	put_device(dev);
 }
 EXPORT_SYMBOL(stepper_device_unregister);
 
@@ -443,16 +1608,15 @@ static int __init stepper_init(void)
 		pr_err("stepper: Failed to register sysfs class.\n");
 		goto out;
 	}
-	/* workqueue */
-	stepper_workqueue = alloc_workqueue("stepper", 0, 0);
-	if (NULL == stepper_workqueue) {
-		pr_err("stepper: Failed to allocate workqueue.\n");
-		err = -ENOMEM;
-		goto out_class;
+	/* chrdev */
+	err = alloc_chrdev_region(&stepper_devt, 0, STEPPER_MAX_DEVICES, "stepper");
+	if (0 != err) {
+		pr_err("stepper: Failed to allocate chrdev region.\n");
+		goto unregister_class;
 	}
 	return 0;
 
-out_class:
+unregister_class:
 	class_unregister(&stepper_class);
 out:
 	return err;
@@ -460,9 +1624,9 @@ static int __init stepper_init(void)
 
 static void __exit stepper_exit(void)
 {
-	flush_workqueue(stepper_workqueue);
-	destroy_workqueue(stepper_workqueue);
+	unregister_chrdev_region(stepper_devt, STEPPER_MAX_DEVICES);
 	class_unregister(&stepper_class);
+	ida_destroy(&stepper_ida);
 }
 
 subsys_initcall(stepper_init);
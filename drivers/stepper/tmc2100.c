@@ -2,18 +2,28 @@
 /*
  * Copyright (C) 2019 Frederik Peter Aalund <fpa@sbtinstruments.com>
  */
+#include <linux/bitmap.h>
 #include <linux/gpio/consumer.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/of.h>
 #include <linux/string.h>
 #include <linux/platform_device.h>
 #include <linux/pwm.h>
+#include <linux/pwm_xlnx.h>
 #include <linux/regulator/consumer.h>
 #include <linux/stepper.h>
 
 #define TMC2100_REF_VOLTAGE_LOGICAL_MIN  500
 #define TMC2100_REF_VOLTAGE_LOGICAL_MAX 2500
 #define TMC2100_CFG_SIZE 6 /* Doesn't include cfg6_enn */
+/* Velocity resolution of the LUT in 1/STEPPER_VELOCITY_SCALE units */
+#define TMC2100_LUT_STEP 50
+/* Bit indices into 'tmc2100.ctl' */
+#define TMC2100_CTL_DIR 0
+#define TMC2100_CTL_ENN 1
+#define TMC2100_CTL_SIZE 2
 
 enum tmc2100_cfg_state {
 	TMC2100_GND = 0,
@@ -52,12 +62,33 @@ struct tmc2100_state {
 	unsigned int ref_voltage; /* mV */
 };
 
+/* The step PWM settings of a single velocity (see 'tmc2100_init_lut') */
+struct tmc2100_lut_entry {
+	unsigned int period_ns;
+	u32 rate_mhz;
+	/* Only if 'tmc2100.fast' */
+	struct xlnx_pwm_tlr tlr;
+};
+
 struct tmc2100 {
-	struct gpio_desc *cfg[TMC2100_CFG_SIZE];
+	struct gpio_descs *cfg;
+	/* The CFG pin states that the HW has right now */
+	enum tmc2100_cfg_state hw_cfg[TMC2100_CFG_SIZE];
+	/* Serializes CFG updates */
+	struct mutex cfg_lock;
 	struct gpio_desc *cfg6_enn, *dir, *index, *error;
+	/* dir and cfg6_enn (in that order) so that we can set both at once */
+	struct gpio_desc *ctl[TMC2100_CTL_SIZE];
+	/* The dir and cfg6_enn values that the HW has right now */
+	unsigned long ctl_values;
 	struct pwm_device *step;
 	struct regulator *ref;
 	struct tmc2100_state state;
+	/* Indexed by the absolute velocity in TMC2100_LUT_STEP units */
+	struct tmc2100_lut_entry *lut;
+	unsigned int lut_size;
+	/* Write the pwm-xlnx registers directly (see 'linux/pwm_xlnx.h') */
+	bool fast;
 };
 
 static struct stepper_vel_cfg tmc2100_cfg = {
@@ -65,6 +96,9 @@ static struct stepper_vel_cfg tmc2100_cfg = {
 	.shift_delay_ms = 10,
 	.min = -100,
 	.max = 100,
+	.update_rate_hz = STEPPER_DEFAULT_UPDATE_RATE_HZ,
+	.profile = STEPPER_PROFILE_TRAPEZOID,
+	.jerk = 0,
 };
 
 static struct tmc2100_state tmc2100_default_state = {
@@ -106,38 +140,84 @@ static struct tmc2100_state tmc2100_default_state = {
 	.ref_voltage = 2500,
 };
 
-static int tmc2100_set_cfg(struct tmc2100 *tmc, int idx, enum tmc2100_cfg_state value)
+/*
+ * Set the CFG pins to 'cfg'. Only touches the pins that change.
+ *
+ * The CFG GPIOs are tri-state so they can be set to input and detected as
+ * open. Levels of pins that stay outputs change in a single array call (one
+ * bus transaction per GPIO chip). Only pins that go to or from open need a
+ * direction change of their own.
+ */
+static int tmc2100_apply_cfg(struct tmc2100 *tmc,
+                             const enum tmc2100_cfg_state *cfg)
 {
-	struct gpio_desc *desc;
-	if (TMC2100_CFG_SIZE <= idx) {
-		return -EINVAL;
+	struct gpio_desc *descs[TMC2100_CFG_SIZE];
+	DECLARE_BITMAP(values, TMC2100_CFG_SIZE);
+	unsigned int n = 0;
+	int ret;
+	int i;
+	for (i = 0; TMC2100_CFG_SIZE > i; ++i) {
+		if (TMC_CFG_STATE_SIZE <= cfg[i]) {
+			return -EINVAL;
+		}
 	}
-	desc = tmc->cfg[idx];
-	/* The CFG GPIOs are tri-state so they can be set to input and detected
-	 * as open. */
-	switch (value) {
-	case TMC2100_GND:
-		return gpiod_direction_output(desc, 0);
-	case TMC2100_VCC_IO:
-		return gpiod_direction_output(desc, 1);
-	case TMC2100_OPEN:
-		return gpiod_direction_input(desc);
-	default:
-		return -EINVAL;
-	};
+	/* Release the pins that become open */
+	for (i = 0; TMC2100_CFG_SIZE > i; ++i) {
+		if (TMC2100_OPEN != cfg[i] || TMC2100_OPEN == tmc->hw_cfg[i]) {
+			continue;
+		}
+		ret = gpiod_direction_input(tmc->cfg->desc[i]);
+		if (0 != ret) {
+			return ret;
+		}
+		tmc->hw_cfg[i] = TMC2100_OPEN;
+	}
+	/* Change the levels of the pins that stay outputs */
+	bitmap_zero(values, TMC2100_CFG_SIZE);
+	for (i = 0; TMC2100_CFG_SIZE > i; ++i) {
+		if (TMC2100_OPEN == cfg[i] || TMC2100_OPEN == tmc->hw_cfg[i] ||
+		    cfg[i] == tmc->hw_cfg[i]) {
+			continue;
+		}
+		if (TMC2100_VCC_IO == cfg[i]) {
+			__set_bit(n, values);
+		}
+		descs[n++] = tmc->cfg->desc[i];
+	}
+	if (0 < n) {
+		ret = gpiod_set_array_value_cansleep(n, descs, NULL, values);
+		if (0 != ret) {
+			return ret;
+		}
+		for (i = 0; TMC2100_CFG_SIZE > i; ++i) {
+			if (TMC2100_OPEN != tmc->hw_cfg[i]) {
+				tmc->hw_cfg[i] = cfg[i];
+			}
+		}
+	}
+	/* Drive the pins that were open */
+	for (i = 0; TMC2100_CFG_SIZE > i; ++i) {
+		if (TMC2100_OPEN == cfg[i] || TMC2100_OPEN != tmc->hw_cfg[i]) {
+			continue;
+		}
+		ret = gpiod_direction_output(tmc->cfg->desc[i],
+		                             TMC2100_VCC_IO == cfg[i]);
+		if (0 != ret) {
+			return ret;
+		}
+		tmc->hw_cfg[i] = cfg[i];
+	}
+	return 0;
 }
 
 static int tmc2100_apply_state_to_hw(struct tmc2100 *tmc)
 {
 	int ret;
-	int i;
 	int voltage_uv;
 	struct tmc2100_state *state = &tmc->state;
-	for (i = 0; TMC2100_CFG_SIZE > i; ++i) {
-		ret = tmc2100_set_cfg(tmc, i, state->cfg[i]);
-		if (0 != ret) {
-			return ret;
-		}
+	ret = tmc2100_apply_cfg(tmc, state->cfg);
+	if (0 != ret) {
+		return ret;
 	}
 	voltage_uv = state->ref_voltage * 1000; /* mV to uV */
 	ret = regulator_set_voltage(tmc->ref, voltage_uv, voltage_uv);
@@ -148,47 +228,129 @@ static int tmc2100_apply_state_to_hw(struct tmc2100 *tmc)
 }
 
 /**
- * @velocity unitless value between -100 and 100
+ * @velocity_fine non-zero value between -100 and 100 in
+ * 1/STEPPER_VELOCITY_SCALE units
  */
-static void tmc2100_get_pwm_state(struct tmc2100 *tmc, int velocity,
-                                  struct pwm_state *state)
+static unsigned int tmc2100_get_period_ns(int velocity_fine)
 {
 	/* Linear increase in frequency from hz_min (at speed 1)
-	 * to hz_max (at speed 100).
+	 * to hz_max (at speed 100). Speeds between 0 and 1 use hz_min.
 	 */
 	int hz_min = 200;
 	int hz_max = 25000;
 	int hz_range = hz_max - hz_min;
-	int freq;
-	state->polarity = PWM_POLARITY_NORMAL;
-	if (0 != velocity) {
-		freq = (abs(velocity) - 1) * hz_range / (tmc2100_cfg.max - 1) + hz_min;
-		/* Convert frequency to corresponding period (Hz to ns) */
-		state->period = 1000000000 / freq;
-		state->duty_cycle = state->period / 2; /* 50 % */
-		state->enabled = true;
-	} else {
-		state->period = 0;
-		state->duty_cycle = 0;
-		state->enabled = false;
+	int above_min = max(0, abs(velocity_fine) - STEPPER_VELOCITY_SCALE);
+	int freq = div_u64((u64)above_min * hz_range,
+	                   (tmc2100_cfg.max - 1) * STEPPER_VELOCITY_SCALE) + hz_min;
+	/* Convert frequency to corresponding period (Hz to ns) */
+	return 1000000000 / freq;
+}
+
+/*
+ * Precompute the step PWM settings of all velocities (in TMC2100_LUT_STEP
+ * increments). This way, the ramp engine doesn't divide on each tick.
+ */
+static int tmc2100_init_lut(struct tmc2100 *tmc, struct device *dev)
+{
+	struct tmc2100_lut_entry *entry;
+	unsigned int i;
+	tmc->fast = xlnx_pwm_is_xlnx(tmc->step);
+	tmc->lut_size = tmc2100_cfg.max * STEPPER_VELOCITY_SCALE / TMC2100_LUT_STEP + 1;
+	tmc->lut = devm_kcalloc(dev, tmc->lut_size, sizeof(*tmc->lut), GFP_KERNEL);
+	if (NULL == tmc->lut) {
+		return -ENOMEM;
+	}
+	/* Entry 0 (zero velocity) is unused */
+	for (i = 1; tmc->lut_size > i; ++i) {
+		entry = &tmc->lut[i];
+		entry->period_ns = tmc2100_get_period_ns(i * TMC2100_LUT_STEP);
+		if (tmc->fast) {
+			xlnx_pwm_ns_to_tlr(tmc->step, entry->period_ns / 2, /* 50 % */
+			                   entry->period_ns, &entry->tlr);
+			/* The actual period (after rounding to clock cycles) */
+			entry->period_ns = xlnx_pwm_tlr_to_period_ns(tmc->step, &entry->tlr);
+		}
+		entry->rate_mhz = div_u64(1000000000000ULL, entry->period_ns);
 	}
+	return 0;
 }
 
 /**
- * @velocity unitless value between -100 and 100
+ * @velocity_fine non-zero value between -100 and 100 in
+ * 1/STEPPER_VELOCITY_SCALE units
  */
-static int tmc2100_set_velocity(struct device *dev, int velocity)
+static const struct tmc2100_lut_entry *tmc2100_lut_lookup(struct tmc2100 *tmc,
+                                                          int velocity_fine)
 {
-	int forward = 0 <= velocity;
+	unsigned int i = DIV_ROUND_CLOSEST(abs(velocity_fine), TMC2100_LUT_STEP);
+	/* Even the slowest velocity moves the motor */
+	return &tmc->lut[clamp(i, 1u, tmc->lut_size - 1)];
+}
+
+/**
+ * @velocity_fine value between -100 and 100 in 1/STEPPER_VELOCITY_SCALE units
+ *
+ * Called from the ramp engine's hrtimer. See 'tmc2100_probe' for why this
+ * doesn't sleep.
+ */
+static int tmc2100_set_velocity_fine(struct device *dev, int velocity_fine)
+{
+	int forward = 0 <= velocity_fine;
+	bool enabled = 0 != velocity_fine;
 	struct tmc2100 *tmc = dev_get_drvdata(dev);
+	const struct tmc2100_lut_entry *entry = NULL;
 	struct pwm_state state;
-	tmc2100_get_pwm_state(tmc, velocity, &state);
-	pwm_apply_state(tmc->step, &state);
-	gpiod_set_value(tmc->dir, forward);
-	gpiod_set_value(tmc->cfg6_enn, state.enabled);
+	unsigned long ctl_values = 0;
+	if (enabled) {
+		entry = tmc2100_lut_lookup(tmc, velocity_fine);
+	}
+	if (tmc->fast) {
+		xlnx_pwm_write_tlr(tmc->step, enabled ? &entry->tlr : NULL, enabled);
+	} else {
+		state.polarity = PWM_POLARITY_NORMAL;
+		state.period = enabled ? entry->period_ns : 0;
+		state.duty_cycle = state.period / 2; /* 50 % */
+		state.enabled = enabled;
+		pwm_apply_state_atomic(tmc->step, &state);
+	}
+	/* Most ticks only change the step rate. Skip the GPIOs then. Otherwise,
+	 * set dir and cfg6_enn together. */
+	if (forward) {
+		ctl_values |= BIT(TMC2100_CTL_DIR);
+	}
+	if (enabled) {
+		ctl_values |= BIT(TMC2100_CTL_ENN);
+	}
+	if (ctl_values != tmc->ctl_values) {
+		gpiod_set_array_value(TMC2100_CTL_SIZE, tmc->ctl, NULL, &ctl_values);
+		tmc->ctl_values = ctl_values;
+	}
 	return 0;
 }
 
+/**
+ * @velocity_fine value between -100 and 100 in 1/STEPPER_VELOCITY_SCALE units
+ *
+ * One step per PWM period. Uses the actual (rounded) period so that the
+ * position tracking matches the pulses.
+ */
+static u32 tmc2100_step_rate_mhz(struct device *dev, int velocity_fine)
+{
+	struct tmc2100 *tmc = dev_get_drvdata(dev);
+	if (0 == velocity_fine) {
+		return 0;
+	}
+	return tmc2100_lut_lookup(tmc, velocity_fine)->rate_mhz;
+}
+
+/**
+ * @velocity unitless value between -100 and 100
+ */
+static int tmc2100_set_velocity(struct device *dev, int velocity)
+{
+	return tmc2100_set_velocity_fine(dev, velocity * STEPPER_VELOCITY_SCALE);
+}
+
 /**
  * @abs_torque unitless value between 0 and 100
  */
@@ -218,22 +380,30 @@ static int tmc2100_set_abs_torque(struct device *dev, unsigned abs_torque)
 
 static struct stepper_ops tmc2100_ops = {
 	.set_velocity = tmc2100_set_velocity,
+	.set_velocity_fine = tmc2100_set_velocity_fine,
 	.get_abs_torque = tmc2100_get_abs_torque,
 	.set_abs_torque = tmc2100_set_abs_torque,
+	.step_rate_mhz = tmc2100_step_rate_mhz,
 };
 
 static int tmc2100_get_gpios(struct tmc2100 *tmc, struct platform_device *pdev)
 {
 	int i;
 	/* cfg0-5 */
-	for (i = 0; ARRAY_SIZE(tmc->cfg) > i; ++i) {
-		tmc->cfg[i] = devm_gpiod_get_index(&pdev->dev, "cfg", i,
-		                                   GPIOD_OUT_HIGH);
-		if (IS_ERR(tmc->cfg[i])) {
-			dev_err(&pdev->dev, "Failed to get cfg%d GPIO: %ld.\n", i,
-			        PTR_ERR(tmc->cfg[i]));
-			return PTR_ERR(tmc->cfg[i]);
-		}
+	tmc->cfg = devm_gpiod_get_array(&pdev->dev, "cfg", GPIOD_OUT_HIGH);
+	if (IS_ERR(tmc->cfg)) {
+		dev_err(&pdev->dev, "Failed to get cfg GPIOs: %ld.\n",
+		        PTR_ERR(tmc->cfg));
+		return PTR_ERR(tmc->cfg);
+	}
+	if (TMC2100_CFG_SIZE != tmc->cfg->ndescs) {
+		dev_err(&pdev->dev, "Expected %d cfg GPIOs but got %u.\n",
+		        TMC2100_CFG_SIZE, tmc->cfg->ndescs);
+		return -EINVAL;
+	}
+	/* GPIOD_OUT_HIGH */
+	for (i = 0; TMC2100_CFG_SIZE > i; ++i) {
+		tmc->hw_cfg[i] = TMC2100_VCC_IO;
 	}
 	/* cfg6-enn */
 	tmc->cfg6_enn = devm_gpiod_get(&pdev->dev, "cfg6-enn", GPIOD_OUT_LOW);
@@ -249,6 +419,9 @@ static int tmc2100_get_gpios(struct tmc2100 *tmc, struct platform_device *pdev)
 		        PTR_ERR(tmc->dir));
 		return PTR_ERR(tmc->dir);
 	}
+	/* Both start out low (see 'ctl_values') */
+	tmc->ctl[TMC2100_CTL_DIR] = tmc->dir;
+	tmc->ctl[TMC2100_CTL_ENN] = tmc->cfg6_enn;
 	/* index */
 	tmc->index = devm_gpiod_get(&pdev->dev, "index", GPIOD_IN);
 	if (IS_ERR(tmc->index)) {
@@ -318,6 +491,11 @@ static int tmc2100_init_handles(struct tmc2100 *tmc, struct platform_device *pde
 		dev_err(&pdev->dev, "Failed to initialize pwms: %d\n", ret);
 		return ret;
 	}
+	ret = tmc2100_init_lut(tmc, &pdev->dev);
+	if (ret) {
+		dev_err(&pdev->dev, "Failed to initialize LUT: %d\n", ret);
+		return ret;
+	}
 	ret = regulator_enable(tmc->ref);
 	if (ret) {
 		dev_err(&pdev->dev, "Failed to enable regulator 'ref': %d\n", ret);
@@ -389,20 +567,18 @@ static int tmc2100_get_resolution(struct tmc2100 *tmc, enum tmc2100_resolution *
 static int tmc2100_set_resolution(struct tmc2100 *tmc, enum tmc2100_resolution res)
 {
 	int ret;
-	enum tmc2100_cfg_state cfg1, cfg2;
+	enum tmc2100_cfg_state cfg[TMC2100_CFG_SIZE];
+	mutex_lock(&tmc->cfg_lock);
+	memcpy(cfg, tmc->state.cfg, sizeof(cfg));
 	/* Inverse 2D table look-up */
-	cfg2 = res / TMC_CFG_STATE_SIZE;
-	cfg1 = res % TMC_CFG_STATE_SIZE;
-	/* Apply state */
-	ret = tmc2100_set_cfg(tmc, 1, cfg1);
-	if (ret != 0)
-		return ret;
-	tmc->state.cfg[1] = cfg1;
-	ret = tmc2100_set_cfg(tmc, 2, cfg2);
-	if (ret != 0)
-		return ret;
-	tmc->state.cfg[2] = cfg2;
-	return 0;
+	cfg[2] = res / TMC_CFG_STATE_SIZE;
+	cfg[1] = res % TMC_CFG_STATE_SIZE;
+	/* Apply state (cfg1 and cfg2 at once) */
+	ret = tmc2100_apply_cfg(tmc, cfg);
+	if (0 == ret)
+		memcpy(tmc->state.cfg, cfg, sizeof(cfg));
+	mutex_unlock(&tmc->cfg_lock);
+	return ret;
 }
 
 /* resolution */
@@ -460,6 +636,7 @@ static int tmc2100_probe(struct platform_device *pdev)
 	int ret;
 	struct tmc2100 *tmc;
 	struct device *classdev;
+	struct stepper_vel_cfg vel_cfg = tmc2100_cfg;
 
 	tmc = devm_kzalloc(&pdev->dev, sizeof(*tmc), GFP_KERNEL);
 	if (NULL == tmc) {
@@ -467,6 +644,8 @@ static int tmc2100_probe(struct platform_device *pdev)
 		return -ENOMEM;
 	}
 
+	mutex_init(&tmc->cfg_lock);
+
 	/* So that we can access the tmc2100 struct from, e.g., sysfs attributes */
 	dev_set_drvdata(&pdev->dev, tmc);
 
@@ -496,14 +675,33 @@ static int tmc2100_probe(struct platform_device *pdev)
 		return ret;
 	}
 
+	/* The ramp engine sets the velocity from an hrtimer. I.e., we can't
+	 * sleep in 'tmc2100_set_velocity_fine'. */
+	if (gpiod_cansleep(tmc->dir) || gpiod_cansleep(tmc->cfg6_enn)) {
+		dev_err(&pdev->dev, "The dir and cfg6-enn GPIOs must not sleep.\n");
+		return -EINVAL;
+	}
+	if (pwm_might_sleep(tmc->step)) {
+		dev_err(&pdev->dev, "The step PWM must not sleep.\n");
+		return -EINVAL;
+	}
+
 	ret = devm_device_add_group(&pdev->dev, &tmc2100_attr_group);
 	if (0 != ret) {
 		dev_err(&pdev->dev, "Failed to add sysfs group: %d.\n", ret);
 		return ret;
 	}
 
+	/* Get the ramp parameters (profile, acceleration, jerk) from the
+	 * device tree */
+	ret = stepper_of_get_vel_cfg(&pdev->dev, &vel_cfg);
+	if (0 != ret) {
+		dev_err(&pdev->dev, "Failed to get OF velocity config.\n");
+		return ret;
+	}
+
 	classdev = devm_stepper_device_register(&pdev->dev, pdev->name, tmc,
-	                                        &tmc2100_ops, &tmc2100_cfg);
+	                                        &tmc2100_ops, &vel_cfg);
 
 	/* Welcome message */
 	dev_info(&pdev->dev, "Registered %s.\n", pdev->name);
@@ -686,6 +686,11 @@ static long uio_ioctl(struct file *filep, unsigned int cmd, unsigned long arg)
 				       &listener->dbufs_lock,
 				       (void __user *)arg);
 		break;
+	case UIO_IOC_SYNC_DMABUF:
+		ret = uio_dmabuf_sync(idev, &listener->dbufs,
+				      &listener->dbufs_lock,
+				      (void __user *)arg);
+		break;
 	default:
 		ret = -EINVAL;
 		break;
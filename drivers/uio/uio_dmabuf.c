@@ -9,7 +9,9 @@
  */
 
 #include <linux/dma-buf.h>
+#include <linux/dma-mapping.h>
 #include <linux/list.h>
+#include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/uaccess.h>
 #include <linux/uio_driver.h>
@@ -19,15 +21,72 @@
 
 #include "uio_dmabuf.h"
 
+/* idle mappings kept per listener for reuse by a later map */
+static unsigned int dmabuf_cache_size = 16;
+module_param(dmabuf_cache_size, uint, 0644);
+MODULE_PARM_DESC(dmabuf_cache_size,
+		 "Number of unmapped dma-buf attachments cached per open file");
+
+/*
+ * An attachment and its mapping. Unmapping only marks the entry idle, so
+ * mapping the same dma-buf again costs just the cache maintenance. The
+ * list is kept in most recently used order and the least recently used
+ * idle entries are torn down beyond dmabuf_cache_size.
+ */
 struct uio_dmabuf_mem {
 	int dbuf_fd;
 	struct dma_buf *dbuf;
 	struct dma_buf_attachment *dbuf_attach;
 	struct sg_table *sgt;
 	enum dma_data_direction dir;
+	unsigned int users;
 	struct list_head list;
 };
 
+static void uio_dmabuf_mem_free(struct uio_dmabuf_mem *dbuf_mem)
+{
+	dma_buf_unmap_attachment(dbuf_mem->dbuf_attach, dbuf_mem->sgt,
+				 dbuf_mem->dir);
+	dma_buf_detach(dbuf_mem->dbuf, dbuf_mem->dbuf_attach);
+	dma_buf_put(dbuf_mem->dbuf);
+	kfree(dbuf_mem);
+}
+
+/* called with the dbufs lock held */
+static void uio_dmabuf_evict(struct list_head *dbufs)
+{
+	struct uio_dmabuf_mem *dbuf_mem, *prev;
+	unsigned int idle = 0;
+
+	list_for_each_entry(dbuf_mem, dbufs, list)
+		if (!dbuf_mem->users)
+			idle++;
+
+	list_for_each_entry_safe_reverse(dbuf_mem, prev, dbufs, list) {
+		if (idle <= dmabuf_cache_size)
+			break;
+		if (dbuf_mem->users)
+			continue;
+		list_del(&dbuf_mem->list);
+		uio_dmabuf_mem_free(dbuf_mem);
+		idle--;
+	}
+}
+
+/* called with the dbufs lock held */
+static struct uio_dmabuf_mem *uio_dmabuf_find_fd(struct list_head *dbufs,
+						 int dbuf_fd)
+{
+	struct uio_dmabuf_mem *dbuf_mem;
+
+	list_for_each_entry(dbuf_mem, dbufs, list) {
+		if (dbuf_mem->users && dbuf_mem->dbuf_fd == dbuf_fd)
+			return dbuf_mem;
+	}
+
+	return NULL;
+}
+
 long uio_dmabuf_map(struct uio_device *dev, struct list_head *dbufs,
 		    struct mutex *dbufs_lock, void __user *user_args)
 {
@@ -45,19 +104,6 @@ long uio_dmabuf_map(struct uio_device *dev, struct list_head *dbufs,
 		goto err;
 	}
 
-	dbuf = dma_buf_get(args.dbuf_fd);
-	if (IS_ERR(dbuf)) {
-		dev_err(dev->dev.parent, "failed to get dmabuf\n");
-		return PTR_ERR(dbuf);
-	}
-
-	dbuf_attach = dma_buf_attach(dbuf, dev->dev.parent);
-	if (IS_ERR(dbuf_attach)) {
-		dev_err(dev->dev.parent, "failed to attach dmabuf\n");
-		ret = PTR_ERR(dbuf_attach);
-		goto err_put;
-	}
-
 	switch (args.dir) {
 	case UIO_DMABUF_DIR_BIDIR:
 		dir = DMA_BIDIRECTIONAL;
@@ -69,10 +115,55 @@ long uio_dmabuf_map(struct uio_device *dev, struct list_head *dbufs,
 		dir = DMA_FROM_DEVICE;
 		break;
 	default:
-		/* Not needed with check. Just here for any future change  */
 		dev_err(dev->dev.parent, "invalid direction\n");
 		ret = -EINVAL;
-		goto err_detach;
+		goto err;
+	}
+
+	dbuf = dma_buf_get(args.dbuf_fd);
+	if (IS_ERR(dbuf)) {
+		dev_err(dev->dev.parent, "failed to get dmabuf\n");
+		return PTR_ERR(dbuf);
+	}
+
+	/* reuse a cached mapping of the same dmabuf */
+	mutex_lock(dbufs_lock);
+	list_for_each_entry(dbuf_mem, dbufs, list) {
+		if (dbuf_mem->dbuf != dbuf || dbuf_mem->dir != dir ||
+		    dbuf_mem->users)
+			continue;
+
+		dbuf_mem->users++;
+		dbuf_mem->dbuf_fd = args.dbuf_fd;
+		list_move(&dbuf_mem->list, dbufs);
+		mutex_unlock(dbufs_lock);
+
+		/* the entry holds its own reference */
+		dma_buf_put(dbuf);
+
+		sgt = dbuf_mem->sgt;
+		dma_sync_sg_for_device(dev->dev.parent, sgt->sgl,
+				       sgt->orig_nents, dir);
+
+		args.dma_addr = sg_dma_address(sgt->sgl);
+		args.size = dbuf_mem->dbuf->size;
+		if (copy_to_user(user_args, &args, sizeof(args))) {
+			dev_err(dev->dev.parent, "failed to copy to user\n");
+			mutex_lock(dbufs_lock);
+			dbuf_mem->users--;
+			mutex_unlock(dbufs_lock);
+			return -EFAULT;
+		}
+
+		return 0;
+	}
+	mutex_unlock(dbufs_lock);
+
+	dbuf_attach = dma_buf_attach(dbuf, dev->dev.parent);
+	if (IS_ERR(dbuf_attach)) {
+		dev_err(dev->dev.parent, "failed to attach dmabuf\n");
+		ret = PTR_ERR(dbuf_attach);
+		goto err_put;
 	}
 
 	sgt = dma_buf_map_attachment(dbuf_attach, dir);
@@ -114,6 +205,7 @@ long uio_dmabuf_map(struct uio_device *dev, struct list_head *dbufs,
 	dbuf_mem->dbuf_attach = dbuf_attach;
 	dbuf_mem->sgt = sgt;
 	dbuf_mem->dir = dir;
+	dbuf_mem->users = 1;
 	args.dma_addr = sg_dma_address(sgt->sgl);
 	args.size = dbuf->size;
 
@@ -147,6 +239,7 @@ long uio_dmabuf_unmap(struct uio_device *dev, struct list_head *dbufs,
 {
 	struct uio_dmabuf_args args;
 	struct uio_dmabuf_mem *dbuf_mem;
+	struct sg_table *sgt;
 	long ret;
 
 	if (copy_from_user(&args, user_args, sizeof(args))) {
@@ -155,25 +248,21 @@ long uio_dmabuf_unmap(struct uio_device *dev, struct list_head *dbufs,
 	}
 
 	mutex_lock(dbufs_lock);
-	list_for_each_entry(dbuf_mem, dbufs, list) {
-		if (dbuf_mem->dbuf_fd == args.dbuf_fd)
-			break;
-	}
-
-	if (dbuf_mem->dbuf_fd != args.dbuf_fd) {
+	dbuf_mem = uio_dmabuf_find_fd(dbufs, args.dbuf_fd);
+	if (!dbuf_mem) {
 		dev_err(dev->dev.parent, "failed to find the dmabuf (%d)\n",
 			args.dbuf_fd);
 		ret = -EINVAL;
 		goto err_unlock;
 	}
-	list_del(&dbuf_mem->list);
-	mutex_unlock(dbufs_lock);
 
-	dma_buf_unmap_attachment(dbuf_mem->dbuf_attach, dbuf_mem->sgt,
-				 dbuf_mem->dir);
-	dma_buf_detach(dbuf_mem->dbuf, dbuf_mem->dbuf_attach);
-	dma_buf_put(dbuf_mem->dbuf);
-	kfree(dbuf_mem);
+	/* hand the buffer back to the cpu, but keep the mapping cached */
+	sgt = dbuf_mem->sgt;
+	dma_sync_sg_for_cpu(dev->dev.parent, sgt->sgl, sgt->orig_nents,
+			    dbuf_mem->dir);
+	dbuf_mem->users--;
+	uio_dmabuf_evict(dbufs);
+	mutex_unlock(dbufs_lock);
 
 	memset(&args, 0x0, sizeof(args));
 
@@ -190,6 +279,42 @@ long uio_dmabuf_unmap(struct uio_device *dev, struct list_head *dbufs,
 	return ret;
 }
 
+long uio_dmabuf_sync(struct uio_device *dev, struct list_head *dbufs,
+		     struct mutex *dbufs_lock, void __user *user_args)
+{
+	struct uio_dmabuf_sync_args args;
+	struct uio_dmabuf_mem *dbuf_mem;
+	struct sg_table *sgt;
+	long ret = 0;
+
+	if (copy_from_user(&args, user_args, sizeof(args)))
+		return -EFAULT;
+
+	if (!args.flags || args.flags & ~UIO_DMABUF_SYNC_VALID_FLAGS)
+		return -EINVAL;
+
+	mutex_lock(dbufs_lock);
+	dbuf_mem = uio_dmabuf_find_fd(dbufs, args.dbuf_fd);
+	if (!dbuf_mem) {
+		dev_err(dev->dev.parent, "failed to find the dmabuf (%d)\n",
+			args.dbuf_fd);
+		ret = -EINVAL;
+		goto out;
+	}
+
+	sgt = dbuf_mem->sgt;
+	if (args.flags & UIO_DMABUF_SYNC_FOR_CPU)
+		dma_sync_sg_for_cpu(dev->dev.parent, sgt->sgl,
+				    sgt->orig_nents, dbuf_mem->dir);
+	if (args.flags & UIO_DMABUF_SYNC_FOR_DEV)
+		dma_sync_sg_for_device(dev->dev.parent, sgt->sgl,
+				       sgt->orig_nents, dbuf_mem->dir);
+
+out:
+	mutex_unlock(dbufs_lock);
+	return ret;
+}
+
 int uio_dmabuf_cleanup(struct uio_device *dev, struct list_head *dbufs,
 		       struct mutex *dbufs_lock)
 {
@@ -198,11 +323,7 @@ int uio_dmabuf_cleanup(struct uio_device *dev, struct list_head *dbufs,
 	mutex_lock(dbufs_lock);
 	list_for_each_entry_safe(dbuf_mem, next, dbufs, list) {
 		list_del(&dbuf_mem->list);
-		dma_buf_unmap_attachment(dbuf_mem->dbuf_attach, dbuf_mem->sgt,
-					 dbuf_mem->dir);
-		dma_buf_detach(dbuf_mem->dbuf, dbuf_mem->dbuf_attach);
-		dma_buf_put(dbuf_mem->dbuf);
-		kfree(dbuf_mem);
+		uio_dmabuf_mem_free(dbuf_mem);
 	}
 	mutex_unlock(dbufs_lock);
 
@@ -19,6 +19,8 @@ long uio_dmabuf_map(struct uio_device *dev, struct list_head *dbufs,
 		    struct mutex *dbufs_lock, void __user *user_args);
 long uio_dmabuf_unmap(struct uio_device *dev, struct list_head *dbufs,
 		      struct mutex *dbufs_lock, void __user *user_args);
+long uio_dmabuf_sync(struct uio_device *dev, struct list_head *dbufs,
+		     struct mutex *dbufs_lock, void __user *user_args);
 
 int uio_dmabuf_cleanup(struct uio_device *dev, struct list_head *dbufs,
 		       struct mutex *dbufs_lock);
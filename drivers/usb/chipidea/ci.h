@@ -82,6 +82,9 @@ enum ci_hw_regs {
  * @ci: pointer to the controller
  * @lock: pointer to controller's spinlock
  * @td_pool: pointer to controller's TD pool
+ * @td_cache: TDs set aside for this endpoint
+ * @td_cache_len: number of TDs in @td_cache
+ * @td_cache_max: maximum number of TDs in @td_cache
  */
 struct ci_hw_ep {
 	struct usb_ep				ep;
@@ -101,6 +104,9 @@ struct ci_hw_ep {
 	spinlock_t				*lock;
 	struct dma_pool				*td_pool;
 	struct td_node				*pending_td;
+	struct list_head			td_cache;
+	unsigned				td_cache_len;
+	unsigned				td_cache_max;
 };
 
 enum ci_role {
@@ -193,6 +193,15 @@ static int hw_ep_prime(struct ci_hdrc *ci, int num, int dir, int is_ctrl)
 
 	hw_write(ci, OP_ENDPTPRIME, ~0, BIT(n));
 
+	/*
+	 * Only the setup check below needs the prime to finish. Requests
+	 * queued while ENDPTPRIME is still set are linked to the list that
+	 * is being primed (see _hardware_enqueue), so one prime covers them
+	 * all.
+	 */
+	if (!is_ctrl)
+		return 0;
+
 	while (hw_read(ci, OP_ENDPTPRIME, BIT(n)))
 		cpu_relax();
 	if (is_ctrl && dir == RX && hw_read(ci, OP_ENDPTSETUPSTAT, BIT(num)))
@@ -337,22 +346,106 @@ static int hw_usb_reset(struct ci_hdrc *ci)
  * UTIL block
  *****************************************************************************/
 
-static int add_td_to_list(struct ci_hw_ep *hwep, struct ci_hw_req *hwreq,
-			  unsigned length)
+/*
+ * td_alloc: gets a zeroed TD, from the endpoint's cache if possible
+ * @hwep: endpoint
+ */
+static struct td_node *td_alloc(struct ci_hw_ep *hwep)
 {
-	int i;
-	u32 temp;
-	struct td_node *lastnode, *node = kzalloc(sizeof(struct td_node),
-						  GFP_ATOMIC);
+	struct td_node *node;
+
+	if (!list_empty(&hwep->td_cache)) {
+		node = list_first_entry(&hwep->td_cache, struct td_node, td);
+		list_del(&node->td);
+		hwep->td_cache_len--;
+		memset(node->ptr, 0, sizeof(*node->ptr));
+		return node;
+	}
 
+	node = kzalloc(sizeof(struct td_node), GFP_ATOMIC);
 	if (node == NULL)
-		return -ENOMEM;
+		return NULL;
 
 	node->ptr = dma_pool_zalloc(hwep->td_pool, GFP_ATOMIC, &node->dma);
 	if (node->ptr == NULL) {
 		kfree(node);
-		return -ENOMEM;
+		return NULL;
+	}
+
+	return node;
+}
+
+/*
+ * td_free: puts a TD, that is no longer on any list, back in the
+ *          endpoint's cache or frees it if the cache is full
+ * @hwep: endpoint
+ * @node: TD
+ */
+static void td_free(struct ci_hw_ep *hwep, struct td_node *node)
+{
+	if (hwep->td_cache_len < hwep->td_cache_max) {
+		list_add(&node->td, &hwep->td_cache);
+		hwep->td_cache_len++;
+		return;
+	}
+
+	dma_pool_free(hwep->td_pool, node->ptr, node->dma);
+	kfree(node);
+}
+
+/*
+ * td_cache_fill: allocates TDs until the endpoint's cache is full
+ * @hwep: endpoint
+ *
+ * The cache is only an optimization, so this gives up quietly when the
+ * allocation fails.
+ */
+static void td_cache_fill(struct ci_hw_ep *hwep)
+{
+	struct td_node *node;
+
+	while (hwep->td_cache_len < hwep->td_cache_max) {
+		node = kzalloc(sizeof(struct td_node), GFP_ATOMIC);
+		if (node == NULL)
+			return;
+
+		node->ptr = dma_pool_zalloc(hwep->td_pool, GFP_ATOMIC,
+					    &node->dma);
+		if (node->ptr == NULL) {
+			kfree(node);
+			return;
+		}
+
+		list_add(&node->td, &hwep->td_cache);
+		hwep->td_cache_len++;
 	}
+}
+
+/*
+ * td_cache_drain: frees all TDs in the endpoint's cache
+ * @hwep: endpoint
+ */
+static void td_cache_drain(struct ci_hw_ep *hwep)
+{
+	struct td_node *node, *tmpnode;
+
+	list_for_each_entry_safe(node, tmpnode, &hwep->td_cache, td) {
+		list_del(&node->td);
+		dma_pool_free(hwep->td_pool, node->ptr, node->dma);
+		kfree(node);
+	}
+	hwep->td_cache_len = 0;
+}
+
+static int add_td_to_list(struct ci_hw_ep *hwep, struct ci_hw_req *hwreq,
+			  unsigned length, dma_addr_t dma)
+{
+	int i;
+	u32 temp;
+	struct td_node *lastnode, *node = td_alloc(hwep);
+
+	if (node == NULL)
+		return -ENOMEM;
 
 	node->ptr->token = cpu_to_le32(length << __ffs(TD_TOTAL_BYTES));
 	node->ptr->token &= cpu_to_le32(TD_TOTAL_BYTES);
@@ -366,7 +459,7 @@ static int add_td_to_list(struct ci_hw_ep *hwep, struct ci_hw_req *hwreq,
 		node->ptr->token |= cpu_to_le32(mul << __ffs(TD_MULTO));
 	}
 
-	temp = (u32) (hwreq->req.dma + hwreq->req.actual);
+	temp = (u32) dma;
 	if (length) {
 		node->ptr->page[0] = cpu_to_le32(temp);
 		for (i = 1; i < TD_PAGE_COUNT; i++) {
@@ -391,6 +484,73 @@ static int add_td_to_list(struct ci_hw_ep *hwep, struct ci_hw_req *hwreq,
 	return 0;
 }
 
+/*
+ * add_tds_for_buf: adds the TDs for a DMA contiguous buffer
+ * @hwep:   endpoint
+ * @hwreq:  request
+ * @dma:    DMA address of the buffer
+ * @length: length of the buffer, non zero
+ */
+static int add_tds_for_buf(struct ci_hw_ep *hwep, struct ci_hw_req *hwreq,
+			   dma_addr_t dma, unsigned length)
+{
+	int pages = TD_PAGE_COUNT;
+	int ret;
+
+	/*
+	 * The first buffer could be not page aligned.
+	 * In that case we have to span into one extra td.
+	 */
+	if (dma % PAGE_SIZE)
+		pages--;
+
+	while (length > 0) {
+		unsigned count = min(length,
+				     (unsigned)(pages * CI_HDRC_PAGE_SIZE));
+
+		ret = add_td_to_list(hwep, hwreq, count, dma);
+		if (ret < 0)
+			return ret;
+
+		dma += count;
+		length -= count;
+	}
+
+	return 0;
+}
+
+/*
+ * add_tds_for_sg: adds the TDs for a scatter-gather request
+ * @hwep:  endpoint
+ * @hwreq: request
+ *
+ * Every TD ends a packet, so all entries but the last one must hold whole
+ * packets.
+ */
+static int add_tds_for_sg(struct ci_hw_ep *hwep, struct ci_hw_req *hwreq)
+{
+	unsigned rest = hwreq->req.length;
+	struct scatterlist *s;
+	unsigned length;
+	int i, ret;
+
+	for_each_sg(hwreq->req.sg, s, hwreq->req.num_mapped_sgs, i) {
+		length = min(sg_dma_len(s), rest);
+		if (length < rest && length % hwep->ep.maxpacket)
+			return -EINVAL;
+
+		ret = add_tds_for_buf(hwep, hwreq, sg_dma_address(s), length);
+		if (ret < 0)
+			return ret;
+
+		rest -= length;
+		if (!rest)
+			return 0;
+	}
+
+	return -EINVAL;
+}
+
 /**
  * _usb_addr: calculates endpoint address from direction & number
  * @ep:  endpoint
@@ -412,7 +572,6 @@ static int _hardware_enqueue(struct ci_hw_ep *hwep, struct ci_hw_req *hwreq)
 	struct ci_hdrc *ci = hwep->ci;
 	int ret = 0;
 	unsigned rest = hwreq->req.length;
-	int pages = TD_PAGE_COUNT;
 	struct td_node *firstnode, *lastnode;
 
 	/* don't queue twice */
@@ -426,32 +585,18 @@ static int _hardware_enqueue(struct ci_hw_ep *hwep, struct ci_hw_req *hwreq)
 	if (ret)
 		return ret;
 
-	/*
-	 * The first buffer could be not page aligned.
-	 * In that case we have to span into one extra td.
-	 */
-	if (hwreq->req.dma % PAGE_SIZE)
-		pages--;
-
-	if (rest == 0) {
-		ret = add_td_to_list(hwep, hwreq, 0);
-		if (ret < 0)
-			goto done;
-	}
-
-	while (rest > 0) {
-		unsigned count = min(hwreq->req.length - hwreq->req.actual,
-					(unsigned)(pages * CI_HDRC_PAGE_SIZE));
-		ret = add_td_to_list(hwep, hwreq, count);
-		if (ret < 0)
-			goto done;
-
-		rest -= count;
-	}
+	if (rest == 0)
+		ret = add_td_to_list(hwep, hwreq, 0, 0);
+	else if (hwreq->req.num_mapped_sgs)
+		ret = add_tds_for_sg(hwep, hwreq);
+	else
+		ret = add_tds_for_buf(hwep, hwreq, hwreq->req.dma, rest);
+	if (ret < 0)
+		goto done;
 
 	if (hwreq->req.zero && hwreq->req.length && hwep->dir == TX
 	    && (hwreq->req.length % hwep->ep.maxpacket == 0)) {
-		ret = add_td_to_list(hwep, hwreq, 0);
+		ret = add_td_to_list(hwep, hwreq, 0, 0);
 		if (ret < 0)
 			goto done;
 	}
@@ -520,9 +665,8 @@ static void free_pending_td(struct ci_hw_ep *hwep)
 {
 	struct td_node *pending = hwep->pending_td;
 
-	dma_pool_free(hwep->td_pool, pending->ptr, pending->dma);
 	hwep->pending_td = NULL;
-	kfree(pending);
+	td_free(hwep, pending);
 }
 
 static int reprime_dtd(struct ci_hdrc *ci, struct ci_hw_ep *hwep,
@@ -637,10 +781,8 @@ __acquires(hwep->lock)
 						     struct ci_hw_req, queue);
 
 		list_for_each_entry_safe(node, tmpnode, &hwreq->tds, td) {
-			dma_pool_free(hwep->td_pool, node->ptr, node->dma);
 			list_del_init(&node->td);
-			node->ptr = NULL;
-			kfree(node);
+			td_free(hwep, node);
 		}
 
 		list_del_init(&hwreq->queue);
@@ -1269,6 +1411,15 @@ static int ep_enable(struct usb_ep *ep,
 
 	hwep->qh.ptr->td.next |= cpu_to_le32(TD_TERMINATE);   /* needed? */
 
+	/*
+	 * Set TDs aside so that streaming endpoints do not have to allocate
+	 * them for every request
+	 */
+	if (hwep->type != USB_ENDPOINT_XFER_CONTROL) {
+		hwep->td_cache_max = TD_CACHE_SIZE;
+		td_cache_fill(hwep);
+	}
+
 	if (hwep->num != 0 && hwep->type == USB_ENDPOINT_XFER_CONTROL) {
 		dev_err(hwep->ci->dev, "Set control xfer at non-ep0\n");
 		retval = -EINVAL;
@@ -1320,6 +1471,9 @@ static int ep_disable(struct usb_ep *ep)
 
 	} while (hwep->dir != direction);
 
+	hwep->td_cache_max = 0;
+	td_cache_drain(hwep);
+
 	hwep->ep.desc = NULL;
 
 	spin_unlock_irqrestore(hwep->lock, flags);
@@ -1369,10 +1523,8 @@ static void ep_free_request(struct usb_ep *ep, struct usb_request *req)
 	spin_lock_irqsave(hwep->lock, flags);
 
 	list_for_each_entry_safe(node, tmpnode, &hwreq->tds, td) {
-		dma_pool_free(hwep->td_pool, node->ptr, node->dma);
 		list_del_init(&node->td);
-		node->ptr = NULL;
-		kfree(node);
+		td_free(hwep, node);
 	}
 
 	kfree(hwreq);
@@ -1427,9 +1579,8 @@ static int ep_dequeue(struct usb_ep *ep, struct usb_request *req)
 		hw_ep_flush(hwep->ci, hwep->num, hwep->dir);
 
 	list_for_each_entry_safe(node, tmpnode, &hwreq->tds, td) {
-		dma_pool_free(hwep->td_pool, node->ptr, node->dma);
 		list_del(&node->td);
-		kfree(node);
+		td_free(hwep, node);
 	}
 
 	/* pop request */
@@ -1713,6 +1864,7 @@ static int init_eps(struct ci_hdrc *ci)
 			usb_ep_set_maxpacket_limit(&hwep->ep, (unsigned short)~0);
 
 			INIT_LIST_HEAD(&hwep->qh.queue);
+			INIT_LIST_HEAD(&hwep->td_cache);
 			hwep->qh.ptr = dma_pool_zalloc(ci->qh_pool, GFP_KERNEL,
 						       &hwep->qh.dma);
 			if (hwep->qh.ptr == NULL)
@@ -1745,8 +1897,10 @@ static void destroy_eps(struct ci_hdrc *ci)
 	for (i = 0; i < ci->hw_ep_max; i++) {
 		struct ci_hw_ep *hwep = &ci->ci_hw_ep[i];
 
+		hwep->td_cache_max = 0;
 		if (hwep->pending_td)
 			free_pending_td(hwep);
+		td_cache_drain(hwep);
 		dma_pool_free(ci->qh_pool, hwep->qh.ptr, hwep->qh.dma);
 	}
 }
@@ -1930,6 +2084,7 @@ static int udc_start(struct ci_hdrc *ci)
 	ci->gadget.ops          = &usb_gadget_ops;
 	ci->gadget.speed        = USB_SPEED_UNKNOWN;
 	ci->gadget.max_speed    = USB_SPEED_HIGH;
+	ci->gadget.sg_supported = 1;
 	ci->gadget.name         = ci->platdata->name;
 	ci->gadget.otg_caps	= otg_caps;
 
@@ -13,6 +13,7 @@
 #include <linux/list.h>
 
 #define CTRL_PAYLOAD_MAX   64
+#define TD_CACHE_SIZE      32  /* preallocated TDs per non-control endpoint */
 #define RX        0  /* similar to USB_DIR_OUT but can be used as an index */
 #define TX        1  /* similar to USB_DIR_IN  but can be used as an index */
 
@@ -16,6 +16,9 @@
 
 #include <linux/blkdev.h>
 #include <linux/pagemap.h>
+#include <linux/dma-buf.h>
+#include <linux/dma-fence.h>
+#include <linux/dma-resv.h>
 #include <linux/export.h>
 #include <linux/fs_parser.h>
 #include <linux/hid.h>
@@ -193,6 +196,10 @@ struct ffs_epfile {
 	struct ffs_buffer		*read_buffer;
 #define READ_BUFFER_DROP ((struct ffs_buffer *)ERR_PTR(-ESHUTDOWN))
 
+	/* DMABUFs attached with FUNCTIONFS_DMABUF_ATTACH */
+	struct mutex			dmabufs_mutex;
+	struct list_head		dmabufs;	/* P: dmabufs_mutex */
+
 	char				name[5];
 
 	unsigned char			in;	/* P: ffs->eps_lock */
@@ -229,6 +236,23 @@ struct ffs_io_data {
 	struct ffs_data *ffs;
 };
 
+struct ffs_dmabuf_priv {
+	struct list_head entry;
+	struct kref ref;
+	struct dma_buf_attachment *attach;
+	struct sg_table *sgt;
+	spinlock_t lock;
+	u64 context;
+	u64 seqno;			/* P: lock */
+};
+
+struct ffs_dma_fence {
+	struct dma_fence base;
+	struct ffs_dmabuf_priv *priv;
+	struct sg_table sgt;
+	struct work_struct work;
+};
+
 struct ffs_desc_helper {
 	struct ffs_data *ffs;
 	unsigned interfaces_count;
@@ -1262,6 +1286,424 @@ static ssize_t ffs_epfile_read_iter(struct kiocb *kiocb, struct iov_iter *to)
 	return res;
 }
 
+/* DMABUF attached endpoint I/O ********************************************/
+
+static void ffs_dmabuf_release(struct kref *ref)
+{
+	struct ffs_dmabuf_priv *priv = container_of(ref, struct ffs_dmabuf_priv,
+						    ref);
+	struct dma_buf_attachment *attach = priv->attach;
+	struct dma_buf *dmabuf = attach->dmabuf;
+
+	dma_buf_unmap_attachment(attach, priv->sgt, DMA_BIDIRECTIONAL);
+	dma_buf_detach(dmabuf, attach);
+	dma_buf_put(dmabuf);
+	kfree(priv);
+}
+
+static void ffs_dmabuf_put(struct ffs_dmabuf_priv *priv)
+{
+	kref_put(&priv->ref, ffs_dmabuf_release);
+}
+
+static struct ffs_dmabuf_priv *
+ffs_dmabuf_find(struct ffs_epfile *epfile, struct dma_buf *dmabuf)
+{
+	struct ffs_dmabuf_priv *priv;
+
+	lockdep_assert_held(&epfile->dmabufs_mutex);
+
+	list_for_each_entry(priv, &epfile->dmabufs, entry)
+		if (priv->attach->dmabuf == dmabuf)
+			return priv;
+
+	return NULL;
+}
+
+static const char *ffs_dmabuf_get_driver_name(struct dma_fence *fence)
+{
+	return "functionfs";
+}
+
+static const char *ffs_dmabuf_get_timeline_name(struct dma_fence *fence)
+{
+	return "ffs-dmabuf";
+}
+
+static const struct dma_fence_ops ffs_dmabuf_fence_ops = {
+	.get_driver_name	= ffs_dmabuf_get_driver_name,
+	.get_timeline_name	= ffs_dmabuf_get_timeline_name,
+};
+
+/* Drops what the transfer held, which may sleep */
+static void ffs_dmabuf_cleanup(struct work_struct *work)
+{
+	struct ffs_dma_fence *fence = container_of(work, struct ffs_dma_fence,
+						   work);
+
+	sg_free_table(&fence->sgt);
+	ffs_dmabuf_put(fence->priv);
+	dma_fence_put(&fence->base);
+}
+
+static void ffs_dmabuf_signal_done(struct ffs_dma_fence *fence, int status)
+{
+	if (status < 0)
+		dma_fence_set_error(&fence->base, status);
+	dma_fence_signal(&fence->base);
+	schedule_work(&fence->work);
+}
+
+static void ffs_dmabuf_io_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	pr_vdebug("FFS: DMABUF transfer done, status=%d actual=%u\n",
+		  req->status, req->actual);
+
+	ffs_dmabuf_signal_done(req->context, req->status);
+	usb_ep_free_request(ep, req);
+}
+
+/*
+ * Builds the scatterlist of bytes [offset, offset + length) of the DMABUF.
+ * The controller maps it for each request, like any other sg request.
+ */
+static int ffs_dmabuf_slice(struct sg_table *src, struct sg_table *dst,
+			    u64 offset, u64 length)
+{
+	struct scatterlist *sg, *d;
+	unsigned int i, n = 0;
+	u64 pos, start, end;
+	int ret;
+
+	pos = 0;
+	for_each_sg(src->sgl, sg, src->orig_nents, i) {
+		if (pos + sg->length > offset && pos < offset + length)
+			n++;
+		pos += sg->length;
+	}
+
+	ret = sg_alloc_table(dst, n, GFP_KERNEL);
+	if (ret)
+		return ret;
+
+	d = dst->sgl;
+	pos = 0;
+	for_each_sg(src->sgl, sg, src->orig_nents, i) {
+		start = max(pos, offset);
+		end = min(pos + sg->length, offset + length);
+		if (start < end) {
+			sg_set_page(d, sg_page(sg), end - start,
+				    sg->offset + start - pos);
+			d = sg_next(d);
+		}
+		pos += sg->length;
+	}
+
+	return 0;
+}
+
+static int ffs_dmabuf_attach(struct file *file, int fd)
+{
+	struct ffs_epfile *epfile = file->private_data;
+	struct usb_gadget *gadget = epfile->ffs->gadget;
+	struct dma_buf_attachment *attach;
+	struct ffs_dmabuf_priv *priv;
+	struct scatterlist *sg;
+	struct dma_buf *dmabuf;
+	unsigned int i;
+	int ret;
+
+	if (!gadget)
+		return -ENODEV;
+	if (!gadget->sg_supported)
+		return -EOPNOTSUPP;
+
+	dmabuf = dma_buf_get(fd);
+	if (IS_ERR(dmabuf))
+		return PTR_ERR(dmabuf);
+
+	attach = dma_buf_attach(dmabuf, gadget->dev.parent);
+	if (IS_ERR(attach)) {
+		ret = PTR_ERR(attach);
+		goto err_dmabuf_put;
+	}
+
+	priv = kzalloc(sizeof(*priv), GFP_KERNEL);
+	if (!priv) {
+		ret = -ENOMEM;
+		goto err_dmabuf_detach;
+	}
+
+	/* The direction of the endpoint isn't known before it is enabled */
+	priv->sgt = dma_buf_map_attachment(attach, DMA_BIDIRECTIONAL);
+	if (IS_ERR(priv->sgt)) {
+		ret = PTR_ERR(priv->sgt);
+		goto err_free_priv;
+	}
+
+	for_each_sg(priv->sgt->sgl, sg, priv->sgt->orig_nents, i) {
+		if (!sg_page(sg)) {
+			ret = -EINVAL;
+			goto err_unmap;
+		}
+	}
+
+	priv->attach = attach;
+	kref_init(&priv->ref);
+	spin_lock_init(&priv->lock);
+	priv->context = dma_fence_context_alloc(1);
+
+	mutex_lock(&epfile->dmabufs_mutex);
+	if (ffs_dmabuf_find(epfile, dmabuf)) {
+		mutex_unlock(&epfile->dmabufs_mutex);
+		ret = -EEXIST;
+		goto err_unmap;
+	}
+	list_add(&priv->entry, &epfile->dmabufs);
+	mutex_unlock(&epfile->dmabufs_mutex);
+
+	/* The reference to dmabuf is now owned by priv */
+	return 0;
+
+err_unmap:
+	dma_buf_unmap_attachment(attach, priv->sgt, DMA_BIDIRECTIONAL);
+err_free_priv:
+	kfree(priv);
+err_dmabuf_detach:
+	dma_buf_detach(dmabuf, attach);
+err_dmabuf_put:
+	dma_buf_put(dmabuf);
+
+	return ret;
+}
+
+static int ffs_dmabuf_detach(struct file *file, int fd)
+{
+	struct ffs_epfile *epfile = file->private_data;
+	struct ffs_dmabuf_priv *priv;
+	struct dma_buf *dmabuf;
+	int ret = 0;
+
+	dmabuf = dma_buf_get(fd);
+	if (IS_ERR(dmabuf))
+		return PTR_ERR(dmabuf);
+
+	mutex_lock(&epfile->dmabufs_mutex);
+	priv = ffs_dmabuf_find(epfile, dmabuf);
+	if (priv) {
+		list_del(&priv->entry);
+		/* Transfers still in flight keep the attachment alive */
+		ffs_dmabuf_put(priv);
+	} else {
+		ret = -EPERM;
+	}
+	mutex_unlock(&epfile->dmabufs_mutex);
+
+	dma_buf_put(dmabuf);
+
+	return ret;
+}
+
+static void ffs_dmabuf_detach_all(struct ffs_epfile *epfile)
+{
+	struct ffs_dmabuf_priv *priv, *tmp;
+
+	mutex_lock(&epfile->dmabufs_mutex);
+	list_for_each_entry_safe(priv, tmp, &epfile->dmabufs, entry) {
+		list_del(&priv->entry);
+		ffs_dmabuf_put(priv);
+	}
+	mutex_unlock(&epfile->dmabufs_mutex);
+}
+
+static struct ffs_ep *ffs_epfile_wait_ep(struct file *file)
+{
+	struct ffs_epfile *epfile = file->private_data;
+	struct ffs_ep *ep;
+	int ret;
+
+	/* Wait for endpoint to be enabled */
+	ep = epfile->ep;
+	if (!ep) {
+		if (file->f_flags & O_NONBLOCK)
+			return ERR_PTR(-EAGAIN);
+
+		ret = wait_event_interruptible(
+				epfile->ffs->wait, (ep = epfile->ep));
+		if (ret)
+			return ERR_PTR(-EINTR);
+	}
+
+	return ep;
+}
+
+static int ffs_dmabuf_transfer(struct file *file,
+			       const struct usb_ffs_dmabuf_transfer_req *req)
+{
+	bool nonblock = file->f_flags & O_NONBLOCK;
+	struct ffs_epfile *epfile = file->private_data;
+	struct ffs_dmabuf_priv *priv;
+	struct ffs_dma_fence *fence;
+	struct usb_request *usb_req;
+	struct dma_buf *dmabuf;
+	struct ffs_ep *ep;
+	unsigned long flags;
+	u64 seqno;
+	long timeout;
+	int ret;
+
+	if (req->flags)
+		return -EINVAL;
+
+	dmabuf = dma_buf_get(req->fd);
+	if (IS_ERR(dmabuf))
+		return PTR_ERR(dmabuf);
+
+	if (!req->length || req->length > UINT_MAX ||
+	    req->offset > dmabuf->size ||
+	    req->length > dmabuf->size - req->offset) {
+		ret = -EINVAL;
+		goto err_dmabuf_put;
+	}
+
+	mutex_lock(&epfile->dmabufs_mutex);
+	priv = ffs_dmabuf_find(epfile, dmabuf);
+	if (priv)
+		kref_get(&priv->ref);
+	mutex_unlock(&epfile->dmabufs_mutex);
+	if (!priv) {
+		ret = -EPERM;
+		goto err_dmabuf_put;
+	}
+
+	ep = ffs_epfile_wait_ep(file);
+	if (IS_ERR(ep)) {
+		ret = PTR_ERR(ep);
+		goto err_priv_put;
+	}
+
+	/*
+	 * The host writing into the buffer (OUT) has to wait for everyone,
+	 * the host reading from it (IN) only for the last writer.
+	 */
+	if (!dma_resv_test_signaled_rcu(dmabuf->resv, !epfile->in)) {
+		if (nonblock) {
+			ret = -EBUSY;
+			goto err_priv_put;
+		}
+
+		timeout = dma_resv_wait_timeout_rcu(dmabuf->resv, !epfile->in,
+						    true,
+						    MAX_SCHEDULE_TIMEOUT);
+		if (timeout < 0) {
+			ret = timeout;
+			goto err_priv_put;
+		}
+	}
+
+	fence = kzalloc(sizeof(*fence), GFP_KERNEL);
+	if (!fence) {
+		ret = -ENOMEM;
+		goto err_priv_put;
+	}
+
+	ret = ffs_dmabuf_slice(priv->sgt, &fence->sgt, req->offset,
+			       req->length);
+	if (ret)
+		goto err_fence_free;
+
+	fence->priv = priv;
+	INIT_WORK(&fence->work, ffs_dmabuf_cleanup);
+
+	spin_lock_irqsave(&priv->lock, flags);
+	seqno = ++priv->seqno;
+	spin_unlock_irqrestore(&priv->lock, flags);
+	dma_fence_init(&fence->base, &ffs_dmabuf_fence_ops, &priv->lock,
+		       priv->context, seqno);
+
+	dma_resv_lock(dmabuf->resv, NULL);
+	if (epfile->in) {
+		ret = dma_resv_reserve_shared(dmabuf->resv, 1);
+		if (ret) {
+			dma_resv_unlock(dmabuf->resv);
+			sg_free_table(&fence->sgt);
+			dma_fence_put(&fence->base);
+			goto err_priv_put;
+		}
+		dma_resv_add_shared_fence(dmabuf->resv, &fence->base);
+	} else {
+		dma_resv_add_excl_fence(dmabuf->resv, &fence->base);
+	}
+	dma_resv_unlock(dmabuf->resv);
+
+	/* From here on, failures are reported through the fence as well */
+	spin_lock_irq(&epfile->ffs->eps_lock);
+	if (epfile->ep != ep) {
+		/* In the meantime, endpoint got disabled or changed. */
+		ret = -ESHUTDOWN;
+		goto out_unlock;
+	}
+
+	usb_req = usb_ep_alloc_request(ep->ep, GFP_ATOMIC);
+	if (!usb_req) {
+		ret = -ENOMEM;
+		goto out_unlock;
+	}
+
+	usb_req->buf = NULL;
+	usb_req->sg = fence->sgt.sgl;
+	usb_req->num_sgs = fence->sgt.nents;
+	usb_req->length = req->length;
+	usb_req->context = fence;
+	usb_req->complete = ffs_dmabuf_io_complete;
+
+	ret = usb_ep_queue(ep->ep, usb_req, GFP_ATOMIC);
+	if (ret)
+		usb_ep_free_request(ep->ep, usb_req);
+out_unlock:
+	spin_unlock_irq(&epfile->ffs->eps_lock);
+
+	if (ret)
+		ffs_dmabuf_signal_done(fence, ret);
+
+	dma_buf_put(dmabuf);
+
+	return ret;
+
+err_fence_free:
+	kfree(fence);
+err_priv_put:
+	ffs_dmabuf_put(priv);
+err_dmabuf_put:
+	dma_buf_put(dmabuf);
+
+	return ret;
+}
+
+static long ffs_epfile_dmabuf_ioctl(struct file *file, unsigned code,
+				    unsigned long value)
+{
+	struct usb_ffs_dmabuf_transfer_req req;
+	int fd;
+
+	switch (code) {
+	case FUNCTIONFS_DMABUF_ATTACH:
+		if (get_user(fd, (int __user *)value))
+			return -EFAULT;
+		return ffs_dmabuf_attach(file, fd);
+	case FUNCTIONFS_DMABUF_DETACH:
+		if (get_user(fd, (int __user *)value))
+			return -EFAULT;
+		return ffs_dmabuf_detach(file, fd);
+	case FUNCTIONFS_DMABUF_TRANSFER:
+		if (copy_from_user(&req, (void __user *)value, sizeof(req)))
+			return -EFAULT;
+		return ffs_dmabuf_transfer(file, &req);
+	}
+
+	return -ENOTTY;
+}
+
 static int
 ffs_epfile_release(struct inode *inode, struct file *file)
 {
@@ -1269,6 +1711,7 @@ ffs_epfile_release(struct inode *inode, struct file *file)
 
 	ENTER();
 
+	ffs_dmabuf_detach_all(epfile);
 	__ffs_epfile_read_buffer_free(epfile);
 	ffs_data_closed(epfile->ffs);
 
@@ -1287,18 +1730,17 @@ static long ffs_epfile_ioctl(struct file *file, unsigned code,
 	if (WARN_ON(epfile->ffs->state != FFS_ACTIVE))
 		return -ENODEV;
 
-	/* Wait for endpoint to be enabled */
-	ep = epfile->ep;
-	if (!ep) {
-		if (file->f_flags & O_NONBLOCK)
-			return -EAGAIN;
-
-		ret = wait_event_interruptible(
-				epfile->ffs->wait, (ep = epfile->ep));
-		if (ret)
-			return -EINTR;
+	switch (code) {
+	case FUNCTIONFS_DMABUF_ATTACH:
+	case FUNCTIONFS_DMABUF_DETACH:
+	case FUNCTIONFS_DMABUF_TRANSFER:
+		return ffs_epfile_dmabuf_ioctl(file, code, value);
 	}
 
+	ep = ffs_epfile_wait_ep(file);
+	if (IS_ERR(ep))
+		return PTR_ERR(ep);
+
 	spin_lock_irq(&epfile->ffs->eps_lock);
 
 	/* In the meantime, endpoint got disabled or changed. */
@@ -1892,6 +2334,8 @@ static int ffs_epfiles_create(struct ffs_data *ffs)
 	for (i = 1; i <= count; ++i, ++epfile) {
 		epfile->ffs = ffs;
 		mutex_init(&epfile->mutex);
+		mutex_init(&epfile->dmabufs_mutex);
+		INIT_LIST_HEAD(&epfile->dmabufs);
 		if (ffs->user_flags & FUNCTIONFS_VIRTUAL_ADDR)
 			sprintf(epfile->name, "ep%02x", ffs->eps_addrmap[i]);
 		else
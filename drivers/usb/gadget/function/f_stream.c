@@ -0,0 +1,778 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * f_stream.c - USB peripheral bulk streaming function
+ */
+
+/* #define VERBOSE_DEBUG */
+
+#include <linux/err.h>
+#include <linux/highmem.h>
+#include <linux/kernel.h>
+#include <linux/kref.h>
+#include <linux/module.h>
+#include <linux/scatterlist.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/usb/composite.h>
+#include <linux/usb/g_stream.h>
+
+#include "u_stream.h"
+
+/*
+ * STREAM FUNCTION ... streams data from in-kernel producers to the host
+ *
+ * The function has a single bulk IN endpoint, fed from a ring of 'qlen'
+ * chunks of 'buflen' bytes each. Producers copy into the chunk at the head
+ * of the ring with usb_stream_write(). As soon as a chunk is full, its
+ * request is queued. Each request describes the pages of its chunk with a
+ * scatterlist, so the controller reads straight out of the ring, and with
+ * all of the ring queued the endpoint never waits for the CPU. A chunk is
+ * free again once its request completes.
+ *
+ * Producers find a stream by the name of its function instance (as in
+ * functions/stream.<name>). Data written while the host hasn't enabled the
+ * interface, or while the whole ring is queued, is dropped.
+ */
+struct usb_stream {
+	struct kref		ref;
+	struct list_head	entry;		/* P: usb_stream_list_lock */
+	const char		*name;
+
+	spinlock_t		lock;
+	struct f_stream		*f;		/* P: lock */
+};
+
+struct f_stream {
+	struct usb_function	function;
+	struct usb_stream	*stream;
+
+	struct usb_ep		*in_ep;
+	unsigned		qlen;
+	unsigned		buflen;
+
+	void			*buf;
+	struct sg_table		*sgts;
+	struct usb_request	**reqs;
+
+	/* P: stream->lock */
+	bool			enabled;
+	unsigned		head;		/* chunk being filled */
+	unsigned		fill;		/* bytes in the head chunk */
+	unsigned		inflight;	/* queued chunks before head */
+};
+
+static LIST_HEAD(usb_stream_list);
+static DEFINE_MUTEX(usb_stream_list_lock);
+
+static inline struct f_stream *func_to_stream(struct usb_function *f)
+{
+	return container_of(f, struct f_stream, function);
+}
+
+/*-------------------------------------------------------------------------*/
+
+static struct usb_interface_descriptor stream_intf = {
+	.bLength =		sizeof(stream_intf),
+	.bDescriptorType =	USB_DT_INTERFACE,
+
+	.bNumEndpoints =	1,
+	.bInterfaceClass =	USB_CLASS_VENDOR_SPEC,
+	/* .iInterface = DYNAMIC */
+};
+
+/* full speed support: */
+
+static struct usb_endpoint_descriptor fs_stream_in_desc = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bEndpointAddress =	USB_DIR_IN,
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+};
+
+static struct usb_descriptor_header *fs_stream_descs[] = {
+	(struct usb_descriptor_header *) &stream_intf,
+	(struct usb_descriptor_header *) &fs_stream_in_desc,
+	NULL,
+};
+
+/* high speed support: */
+
+static struct usb_endpoint_descriptor hs_stream_in_desc = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize =	cpu_to_le16(512),
+};
+
+static struct usb_descriptor_header *hs_stream_descs[] = {
+	(struct usb_descriptor_header *) &stream_intf,
+	(struct usb_descriptor_header *) &hs_stream_in_desc,
+	NULL,
+};
+
+/* super speed support: */
+
+static struct usb_endpoint_descriptor ss_stream_in_desc = {
+	.bLength =		USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType =	USB_DT_ENDPOINT,
+
+	.bmAttributes =		USB_ENDPOINT_XFER_BULK,
+	.wMaxPacketSize =	cpu_to_le16(1024),
+};
+
+static struct usb_ss_ep_comp_descriptor ss_stream_in_comp_desc = {
+	.bLength =		USB_DT_SS_EP_COMP_SIZE,
+	.bDescriptorType =	USB_DT_SS_ENDPOINT_COMP,
+	.bMaxBurst =		0,
+	.bmAttributes =		0,
+	.wBytesPerInterval =	0,
+};
+
+static struct usb_descriptor_header *ss_stream_descs[] = {
+	(struct usb_descriptor_header *) &stream_intf,
+	(struct usb_descriptor_header *) &ss_stream_in_desc,
+	(struct usb_descriptor_header *) &ss_stream_in_comp_desc,
+	NULL,
+};
+
+/* function-specific strings: */
+
+static struct usb_string strings_stream[] = {
+	[0].s = "bulk stream",
+	{  }			/* end of list */
+};
+
+static struct usb_gadget_strings stringtab_stream = {
+	.language	= 0x0409,	/* en-us */
+	.strings	= strings_stream,
+};
+
+static struct usb_gadget_strings *stream_strings[] = {
+	&stringtab_stream,
+	NULL,
+};
+
+/*-------------------------------------------------------------------------*/
+
+static void stream_complete(struct usb_ep *ep, struct usb_request *req)
+{
+	struct f_stream		*st = req->context;
+	unsigned long		flags;
+
+	switch (req->status) {
+	case 0:				/* normal completion */
+	case -ECONNABORTED:		/* hardware forced ep reset */
+	case -ECONNRESET:		/* request dequeued */
+	case -ESHUTDOWN:		/* disconnect from host */
+		break;
+	default:
+		ERROR(st->function.config->cdev, "%s complete --> %d, %d/%d\n",
+		      ep->name, req->status, req->actual, req->length);
+		break;
+	}
+
+	/* Requests complete in order, this frees the oldest queued chunk */
+	spin_lock_irqsave(&st->stream->lock, flags);
+	st->inflight--;
+	spin_unlock_irqrestore(&st->stream->lock, flags);
+}
+
+/* Queues the head chunk, called with stream->lock held */
+static int stream_queue(struct f_stream *st)
+{
+	struct usb_request	*req = st->reqs[st->head];
+	void			*chunk = st->buf + st->head * st->buflen;
+	unsigned		rest = st->fill;
+	struct scatterlist	*sg;
+	int			i, ret;
+
+	flush_kernel_vmap_range(chunk, st->fill);
+
+	/* A flushed chunk may end within a page */
+	req->length = st->fill;
+	req->num_sgs = DIV_ROUND_UP(st->fill, PAGE_SIZE);
+	for_each_sg(req->sg, sg, req->num_sgs, i) {
+		sg->length = min_t(unsigned, rest, PAGE_SIZE);
+		rest -= sg->length;
+	}
+	/* ... and then the host shouldn't wait for more */
+	req->zero = st->fill < st->buflen;
+
+	st->fill = 0;
+
+	ret = usb_ep_queue(st->in_ep, req, GFP_ATOMIC);
+	if (ret) {
+		/* The chunk stays at the head and is filled again */
+		VDBG(st->function.config->cdev, "%s queue req --> %d\n",
+		     st->in_ep->name, ret);
+		return ret;
+	}
+
+	st->inflight++;
+	st->head = (st->head + 1) % st->qlen;
+
+	return 0;
+}
+
+static void stream_free_ring(struct f_stream *st)
+{
+	unsigned i;
+
+	for (i = 0; i < st->qlen; i++) {
+		if (st->reqs && st->reqs[i])
+			usb_ep_free_request(st->in_ep, st->reqs[i]);
+		if (st->sgts)
+			sg_free_table(&st->sgts[i]);
+	}
+
+	kfree(st->reqs);
+	st->reqs = NULL;
+	kfree(st->sgts);
+	st->sgts = NULL;
+	vfree(st->buf);
+	st->buf = NULL;
+}
+
+static int stream_alloc_ring(struct f_stream *st)
+{
+	unsigned		pages = st->buflen / PAGE_SIZE;
+	struct usb_request	*req;
+	struct scatterlist	*sg;
+	void			*chunk;
+	unsigned		i, j;
+	int			ret;
+
+	st->buf = vmalloc(array_size(st->qlen, st->buflen));
+	st->sgts = kcalloc(st->qlen, sizeof(*st->sgts), GFP_KERNEL);
+	st->reqs = kcalloc(st->qlen, sizeof(*st->reqs), GFP_KERNEL);
+	if (!st->buf || !st->sgts || !st->reqs) {
+		ret = -ENOMEM;
+		goto fail;
+	}
+
+	for (i = 0; i < st->qlen; i++) {
+		chunk = st->buf + i * st->buflen;
+
+		ret = sg_alloc_table(&st->sgts[i], pages, GFP_KERNEL);
+		if (ret)
+			goto fail;
+		for_each_sg(st->sgts[i].sgl, sg, pages, j)
+			sg_set_page(sg, vmalloc_to_page(chunk + j * PAGE_SIZE),
+				    PAGE_SIZE, 0);
+
+		req = usb_ep_alloc_request(st->in_ep, GFP_KERNEL);
+		if (!req) {
+			ret = -ENOMEM;
+			goto fail;
+		}
+		req->buf = NULL;
+		req->sg = st->sgts[i].sgl;
+		req->complete = stream_complete;
+		req->context = st;
+		st->reqs[i] = req;
+	}
+
+	return 0;
+
+fail:
+	stream_free_ring(st);
+	return ret;
+}
+
+static int stream_bind(struct usb_configuration *c, struct usb_function *f)
+{
+	struct usb_composite_dev *cdev = c->cdev;
+	struct f_stream		*st = func_to_stream(f);
+	struct usb_stream	*stream = st->stream;
+	int			id;
+	int ret;
+
+	if (!cdev->gadget->sg_supported) {
+		ERROR(cdev, "%s: %s can't do scatter-gather\n",
+			f->name, cdev->gadget->name);
+		return -EOPNOTSUPP;
+	}
+
+	/* allocate interface ID(s) */
+	id = usb_interface_id(c, f);
+	if (id < 0)
+		return id;
+	stream_intf.bInterfaceNumber = id;
+
+	id = usb_string_id(cdev);
+	if (id < 0)
+		return id;
+	strings_stream[0].id = id;
+	stream_intf.iInterface = id;
+
+	/* allocate endpoints */
+
+	st->in_ep = usb_ep_autoconfig(cdev->gadget, &fs_stream_in_desc);
+	if (!st->in_ep) {
+		ERROR(cdev, "%s: can't autoconfigure on %s\n",
+			f->name, cdev->gadget->name);
+		return -ENODEV;
+	}
+
+	/* support high speed hardware */
+	hs_stream_in_desc.bEndpointAddress = fs_stream_in_desc.bEndpointAddress;
+
+	/* support super speed hardware */
+	ss_stream_in_desc.bEndpointAddress = fs_stream_in_desc.bEndpointAddress;
+
+	ret = usb_assign_descriptors(f, fs_stream_descs, hs_stream_descs,
+			ss_stream_descs, NULL);
+	if (ret)
+		return ret;
+
+	ret = stream_alloc_ring(st);
+	if (ret)
+		goto fail;
+
+	/* An instance linked into two configurations streams through one */
+	spin_lock_irq(&stream->lock);
+	if (stream->f)
+		ret = -EBUSY;
+	else
+		stream->f = st;
+	spin_unlock_irq(&stream->lock);
+	if (ret) {
+		stream_free_ring(st);
+		goto fail;
+	}
+
+	DBG(cdev, "%s speed %s: IN/%s, %u x %u bytes\n",
+	    (gadget_is_superspeed(c->cdev->gadget) ? "super" :
+	     (gadget_is_dualspeed(c->cdev->gadget) ? "dual" : "full")),
+			f->name, st->in_ep->name, st->qlen, st->buflen);
+	return 0;
+
+fail:
+	usb_free_all_descriptors(f);
+	return ret;
+}
+
+static void stream_unbind(struct usb_configuration *c, struct usb_function *f)
+{
+	struct f_stream		*st = func_to_stream(f);
+	struct usb_stream	*stream = st->stream;
+
+	spin_lock_irq(&stream->lock);
+	stream->f = NULL;
+	spin_unlock_irq(&stream->lock);
+
+	stream_free_ring(st);
+	usb_free_all_descriptors(f);
+}
+
+static void stream_free_func(struct usb_function *f)
+{
+	struct f_stream_opts *opts;
+
+	opts = container_of(f->fi, struct f_stream_opts, func_inst);
+
+	mutex_lock(&opts->lock);
+	opts->refcnt--;
+	mutex_unlock(&opts->lock);
+
+	kfree(func_to_stream(f));
+}
+
+static void disable_stream(struct f_stream *st)
+{
+	unsigned long		flags;
+
+	spin_lock_irqsave(&st->stream->lock, flags);
+	st->enabled = false;
+	spin_unlock_irqrestore(&st->stream->lock, flags);
+
+	/* gives back all queued chunks */
+	usb_ep_disable(st->in_ep);
+	VDBG(st->function.config->cdev, "%s disabled\n", st->function.name);
+}
+
+static int stream_set_alt(struct usb_function *f,
+		unsigned intf, unsigned alt)
+{
+	struct f_stream		*st = func_to_stream(f);
+	struct usb_composite_dev *cdev = f->config->cdev;
+	unsigned long		flags;
+	int			result;
+
+	/* we know alt is zero */
+	disable_stream(st);
+
+	result = config_ep_by_speed(cdev->gadget, f, st->in_ep);
+	if (result)
+		return result;
+
+	result = usb_ep_enable(st->in_ep);
+	if (result < 0)
+		return result;
+	st->in_ep->driver_data = st;
+
+	spin_lock_irqsave(&st->stream->lock, flags);
+	st->head = 0;
+	st->fill = 0;
+	st->inflight = 0;
+	st->enabled = true;
+	spin_unlock_irqrestore(&st->stream->lock, flags);
+
+	DBG(cdev, "%s enabled\n", f->name);
+	return 0;
+}
+
+static void stream_disable(struct usb_function *f)
+{
+	disable_stream(func_to_stream(f));
+}
+
+static struct usb_function *stream_alloc(struct usb_function_instance *fi)
+{
+	struct f_stream		*st;
+	struct f_stream_opts	*opts;
+
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return ERR_PTR(-ENOMEM);
+
+	opts = container_of(fi, struct f_stream_opts, func_inst);
+
+	mutex_lock(&opts->lock);
+	opts->refcnt++;
+	st->buflen = opts->buflen;
+	st->qlen = opts->qlen;
+	mutex_unlock(&opts->lock);
+
+	st->stream = opts->stream;
+
+	st->function.name = "stream";
+	st->function.bind = stream_bind;
+	st->function.unbind = stream_unbind;
+	st->function.set_alt = stream_set_alt;
+	st->function.disable = stream_disable;
+	st->function.strings = stream_strings;
+
+	st->function.free_func = stream_free_func;
+
+	return &st->function;
+}
+
+/*-------------------------------------------------------------------------*/
+
+static struct usb_stream *usb_stream_find(const char *name)
+{
+	struct usb_stream *stream;
+
+	lockdep_assert_held(&usb_stream_list_lock);
+
+	list_for_each_entry(stream, &usb_stream_list, entry)
+		if (!strcmp(stream->name, name))
+			return stream;
+
+	return NULL;
+}
+
+static void usb_stream_release(struct kref *ref)
+	__releases(&usb_stream_list_lock)
+{
+	struct usb_stream *stream = container_of(ref, struct usb_stream, ref);
+
+	list_del(&stream->entry);
+	mutex_unlock(&usb_stream_list_lock);
+
+	kfree(stream->name);
+	kfree(stream);
+}
+
+/**
+ * usb_stream_get() - look up a stream function instance
+ * @name: Name of the instance, as in functions/stream.<name>
+ *
+ * The stream stays valid until usb_stream_put(), even if the instance is
+ * removed in the meantime.
+ */
+struct usb_stream *usb_stream_get(const char *name)
+{
+	struct usb_stream *stream;
+
+	mutex_lock(&usb_stream_list_lock);
+	stream = usb_stream_find(name);
+	if (stream)
+		kref_get(&stream->ref);
+	mutex_unlock(&usb_stream_list_lock);
+
+	return stream ? stream : ERR_PTR(-ENODEV);
+}
+EXPORT_SYMBOL_GPL(usb_stream_get);
+
+/**
+ * usb_stream_put() - release a stream
+ * @stream: As returned by usb_stream_get()
+ */
+void usb_stream_put(struct usb_stream *stream)
+{
+	kref_put_mutex(&stream->ref, usb_stream_release, &usb_stream_list_lock);
+}
+EXPORT_SYMBOL_GPL(usb_stream_put);
+
+/**
+ * usb_stream_write() - send data to the host
+ * @stream: As returned by usb_stream_get()
+ * @buf: Data to send
+ * @len: Length of @buf in bytes
+ *
+ * Copies as much of @buf into the ring as fits, and queues every chunk that
+ * fills up. Safe to call from any context but NMI.
+ *
+ * Return: the number of bytes taken, less than @len if the ring is full.
+ * -ENOTCONN if the host hasn't enabled the stream.
+ */
+ssize_t usb_stream_write(struct usb_stream *stream, const void *buf,
+			 size_t len)
+{
+	struct f_stream *st;
+	unsigned long flags;
+	size_t done = 0;
+	size_t n;
+	ssize_t ret;
+
+	spin_lock_irqsave(&stream->lock, flags);
+	st = stream->f;
+	if (!st || !st->enabled) {
+		ret = -ENOTCONN;
+		goto out;
+	}
+
+	/* The head chunk is free unless the whole ring is queued */
+	while (done < len && st->inflight < st->qlen) {
+		n = min_t(size_t, len - done, st->buflen - st->fill);
+		memcpy(st->buf + st->head * st->buflen + st->fill, buf + done,
+		       n);
+		st->fill += n;
+		done += n;
+
+		if (st->fill == st->buflen)
+			stream_queue(st);
+	}
+	ret = done;
+
+out:
+	spin_unlock_irqrestore(&stream->lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(usb_stream_write);
+
+/**
+ * usb_stream_flush() - send the partially filled chunk
+ * @stream: As returned by usb_stream_get()
+ *
+ * For the end of a burst of data, so that the host doesn't wait for the
+ * chunk to fill up. Safe to call from any context but NMI.
+ */
+int usb_stream_flush(struct usb_stream *stream)
+{
+	struct f_stream *st;
+	unsigned long flags;
+	int ret = 0;
+
+	spin_lock_irqsave(&stream->lock, flags);
+	st = stream->f;
+	if (!st || !st->enabled)
+		ret = -ENOTCONN;
+	else if (st->fill)
+		ret = stream_queue(st);
+	spin_unlock_irqrestore(&stream->lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(usb_stream_flush);
+
+/*-------------------------------------------------------------------------*/
+
+static inline struct f_stream_opts *to_f_stream_opts(struct config_item *item)
+{
+	return container_of(to_config_group(item), struct f_stream_opts,
+			    func_inst.group);
+}
+
+static void stream_attr_release(struct config_item *item)
+{
+	struct f_stream_opts *opts = to_f_stream_opts(item);
+
+	usb_put_function_instance(&opts->func_inst);
+}
+
+static struct configfs_item_operations stream_item_ops = {
+	.release		= stream_attr_release,
+};
+
+static ssize_t f_stream_opts_qlen_show(struct config_item *item, char *page)
+{
+	struct f_stream_opts *opts = to_f_stream_opts(item);
+	int result;
+
+	mutex_lock(&opts->lock);
+	result = sprintf(page, "%u\n", opts->qlen);
+	mutex_unlock(&opts->lock);
+
+	return result;
+}
+
+static ssize_t f_stream_opts_qlen_store(struct config_item *item,
+					const char *page, size_t len)
+{
+	struct f_stream_opts *opts = to_f_stream_opts(item);
+	int ret;
+	u32 num;
+
+	mutex_lock(&opts->lock);
+	if (opts->refcnt) {
+		ret = -EBUSY;
+		goto end;
+	}
+
+	ret = kstrtou32(page, 0, &num);
+	if (ret)
+		goto end;
+
+	/* One chunk to fill while the others are queued */
+	if (num < 2) {
+		ret = -EINVAL;
+		goto end;
+	}
+
+	opts->qlen = num;
+	ret = len;
+end:
+	mutex_unlock(&opts->lock);
+	return ret;
+}
+
+CONFIGFS_ATTR(f_stream_opts_, qlen);
+
+static ssize_t f_stream_opts_buflen_show(struct config_item *item, char *page)
+{
+	struct f_stream_opts *opts = to_f_stream_opts(item);
+	int result;
+
+	mutex_lock(&opts->lock);
+	result = sprintf(page, "%u\n", opts->buflen);
+	mutex_unlock(&opts->lock);
+
+	return result;
+}
+
+static ssize_t f_stream_opts_buflen_store(struct config_item *item,
+					  const char *page, size_t len)
+{
+	struct f_stream_opts *opts = to_f_stream_opts(item);
+	int ret;
+	u32 num;
+
+	mutex_lock(&opts->lock);
+	if (opts->refcnt) {
+		ret = -EBUSY;
+		goto end;
+	}
+
+	ret = kstrtou32(page, 0, &num);
+	if (ret)
+		goto end;
+
+	/* Chunks are made of whole pages */
+	if (!num || !PAGE_ALIGNED(num)) {
+		ret = -EINVAL;
+		goto end;
+	}
+
+	opts->buflen = num;
+	ret = len;
+end:
+	mutex_unlock(&opts->lock);
+	return ret;
+}
+
+CONFIGFS_ATTR(f_stream_opts_, buflen);
+
+static struct configfs_attribute *stream_attrs[] = {
+	&f_stream_opts_attr_qlen,
+	&f_stream_opts_attr_buflen,
+	NULL,
+};
+
+static const struct config_item_type stream_func_type = {
+	.ct_item_ops    = &stream_item_ops,
+	.ct_attrs	= stream_attrs,
+	.ct_owner       = THIS_MODULE,
+};
+
+static int stream_set_inst_name(struct usb_function_instance *fi,
+				const char *name)
+{
+	struct f_stream_opts *opts;
+	char *stream_name;
+	int ret = 0;
+
+	opts = container_of(fi, struct f_stream_opts, func_inst);
+
+	stream_name = kstrdup(name, GFP_KERNEL);
+	if (!stream_name)
+		return -ENOMEM;
+
+	mutex_lock(&usb_stream_list_lock);
+	if (usb_stream_find(name)) {
+		ret = -EBUSY;
+		kfree(stream_name);
+	} else {
+		opts->stream->name = stream_name;
+		list_add_tail(&opts->stream->entry, &usb_stream_list);
+	}
+	mutex_unlock(&usb_stream_list_lock);
+
+	return ret;
+}
+
+static void stream_free_instance(struct usb_function_instance *fi)
+{
+	struct f_stream_opts *opts;
+
+	opts = container_of(fi, struct f_stream_opts, func_inst);
+	usb_stream_put(opts->stream);
+	kfree(opts);
+}
+
+static struct usb_function_instance *stream_alloc_instance(void)
+{
+	struct f_stream_opts *opts;
+	struct usb_stream *stream;
+
+	opts = kzalloc(sizeof(*opts), GFP_KERNEL);
+	if (!opts)
+		return ERR_PTR(-ENOMEM);
+
+	stream = kzalloc(sizeof(*stream), GFP_KERNEL);
+	if (!stream) {
+		kfree(opts);
+		return ERR_PTR(-ENOMEM);
+	}
+	kref_init(&stream->ref);
+	INIT_LIST_HEAD(&stream->entry);
+	spin_lock_init(&stream->lock);
+
+	mutex_init(&opts->lock);
+	opts->stream = stream;
+	opts->func_inst.set_inst_name = stream_set_inst_name;
+	opts->func_inst.free_func_inst = stream_free_instance;
+	opts->buflen = STREAM_BUFLEN;
+	opts->qlen = STREAM_QLEN;
+
+	config_group_init_type_name(&opts->func_inst.group, "",
+				    &stream_func_type);
+
+	return &opts->func_inst;
+}
+DECLARE_USB_FUNCTION_INIT(stream, stream_alloc_instance, stream_alloc);
+MODULE_LICENSE("GPL");
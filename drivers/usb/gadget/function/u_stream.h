@@ -0,0 +1,34 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * u_stream.h
+ *
+ * Utility definitions for the bulk streaming function
+ */
+
+#ifndef U_STREAM_H
+#define U_STREAM_H
+
+#include <linux/usb/composite.h>
+
+#define STREAM_BUFLEN		(16 * 1024)
+#define STREAM_QLEN		32
+
+struct usb_stream;
+
+struct f_stream_opts {
+	struct usb_function_instance	func_inst;
+	struct usb_stream		*stream;
+	unsigned			buflen;
+	unsigned			qlen;
+
+	/*
+	 * Read/write access to configfs attributes is handled by configfs.
+	 *
+	 * This is to protect the data from concurrent access by read/write
+	 * and create symlink/remove symlink.
+	 */
+	struct mutex			lock;
+	int				refcnt;
+};
+
+#endif /* U_STREAM_H */
@@ -21,6 +21,7 @@
 #include <linux/pstore_ram.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
+#include <linux/genalloc.h>
 
 #define RAMOOPS_KERNMSG_HDR "===="
 #define MIN_MEM_SIZE 4096UL
@@ -75,6 +76,8 @@ struct ramoops_context {
 	struct persistent_ram_zone **fprzs;	/* Ftrace zones */
 	struct persistent_ram_zone *mprz;	/* PMSG zone */
 	phys_addr_t phys_addr;
+	void *vaddr;				/* Set if already mapped */
+	struct gen_pool *sram_pool;		/* SRAM the area came from */
 	unsigned long size;
 	unsigned int memtype;
 	size_t record_size;
@@ -502,6 +505,20 @@ static void ramoops_free_przs(struct ramoops_context *cxt)
 	}
 }
 
+static struct persistent_ram_zone *
+ramoops_prz_new(struct ramoops_context *cxt, phys_addr_t paddr, size_t sz,
+		u32 sig, u32 flags, char *label)
+{
+	if (cxt->vaddr)
+		return persistent_ram_new_mapped(cxt->vaddr +
+						 (paddr - cxt->phys_addr),
+						 paddr, sz, sig,
+						 &cxt->ecc_info, flags, label);
+
+	return persistent_ram_new(paddr, sz, sig, &cxt->ecc_info,
+				  cxt->memtype, flags, label);
+}
+
 static int ramoops_init_przs(const char *name,
 			     struct device *dev, struct ramoops_context *cxt,
 			     struct persistent_ram_zone ***przs,
@@ -569,9 +586,8 @@ static int ramoops_init_przs(const char *name,
 		else
 			label = kasprintf(GFP_KERNEL, "ramoops:%s(%d/%d)",
 					  name, i, *cnt - 1);
-		prz_ar[i] = persistent_ram_new(*paddr, zone_sz, sig,
-					       &cxt->ecc_info,
-					       cxt->memtype, flags, label);
+		prz_ar[i] = ramoops_prz_new(cxt, *paddr, zone_sz, sig,
+					    flags, label);
 		if (IS_ERR(prz_ar[i])) {
 			err = PTR_ERR(prz_ar[i]);
 			dev_err(dev, "failed to request %s mem region (0x%zx@0x%llx): %d\n",
@@ -600,7 +616,7 @@ static int ramoops_init_przs(const char *name,
 static int ramoops_init_prz(const char *name,
 			    struct device *dev, struct ramoops_context *cxt,
 			    struct persistent_ram_zone **prz,
-			    phys_addr_t *paddr, size_t sz, u32 sig)
+			    phys_addr_t *paddr, size_t sz, u32 sig, u32 flags)
 {
 	char *label;
 
@@ -615,8 +631,8 @@ static int ramoops_init_prz(const char *name,
 	}
 
 	label = kasprintf(GFP_KERNEL, "ramoops:%s", name);
-	*prz = persistent_ram_new(*paddr, sz, sig, &cxt->ecc_info,
-				  cxt->memtype, PRZ_FLAG_ZAP_OLD, label);
+	*prz = ramoops_prz_new(cxt, *paddr, sz, sig,
+			       PRZ_FLAG_ZAP_OLD | flags, label);
 	if (IS_ERR(*prz)) {
 		int err = PTR_ERR(*prz);
 
@@ -664,15 +680,17 @@ static int ramoops_parse_dt(struct platform_device *pdev,
 
 	dev_dbg(&pdev->dev, "using Device Tree\n");
 
+	/* The area comes from an SRAM pool instead (see ramoops_sram_alloc) */
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-	if (!res) {
+	if (res) {
+		pdata->mem_size = resource_size(res);
+		pdata->mem_address = res->start;
+	} else if (!of_property_read_bool(of_node, "sram")) {
 		dev_err(&pdev->dev,
 			"failed to locate DT /reserved-memory resource\n");
 		return -EINVAL;
 	}
 
-	pdata->mem_size = resource_size(res);
-	pdata->mem_address = res->start;
 	pdata->mem_type = of_property_read_bool(of_node, "unbuffered");
 	pdata->dump_oops = !of_property_read_bool(of_node, "no-dump-oops");
 
@@ -715,6 +733,63 @@ static int ramoops_parse_dt(struct platform_device *pdev,
 	return 0;
 }
 
+/*
+ * Take the area from the SRAM pool in the "sram" phandle, e.g. the on-chip
+ * memory of a Zynq. The pool owns the mapping. "sram-offset" places the area
+ * at the same address on every boot, which it must be for the old records
+ * to be found again.
+ */
+static int ramoops_sram_alloc(struct platform_device *pdev,
+			      struct ramoops_context *cxt,
+			      struct ramoops_platform_data *pdata)
+{
+	struct device_node *of_node = pdev->dev.of_node;
+	struct genpool_data_fixed fixed = { 0 };
+	struct gen_pool *pool;
+	unsigned long vaddr;
+	u32 size, offset = 0;
+
+	if (!of_property_read_bool(of_node, "sram"))
+		return 0;
+
+	pool = of_gen_pool_get(of_node, "sram", 0);
+	if (!pool)
+		return -EPROBE_DEFER;
+
+	if (of_property_read_u32(of_node, "sram-size", &size) || !size) {
+		dev_err(&pdev->dev, "missing sram-size\n");
+		return -EINVAL;
+	}
+	of_property_read_u32(of_node, "sram-offset", &offset);
+	fixed.offset = offset;
+
+	vaddr = gen_pool_alloc_algo(pool, size, gen_pool_fixed_alloc, &fixed);
+	if (!vaddr) {
+		dev_err(&pdev->dev, "no room for 0x%x@0x%x in sram\n",
+			size, offset);
+		return -ENOMEM;
+	}
+
+	cxt->sram_pool = pool;
+	cxt->vaddr = (void *)vaddr;
+	cxt->size = size;
+	pdata->mem_vaddr = (void *)vaddr;
+	pdata->mem_address = gen_pool_virt_to_phys(pool, vaddr);
+	pdata->mem_size = size;
+
+	return 0;
+}
+
+static void ramoops_sram_free(struct ramoops_context *cxt)
+{
+	if (!cxt->sram_pool)
+		return;
+
+	gen_pool_free(cxt->sram_pool, (unsigned long)cxt->vaddr, cxt->size);
+	cxt->sram_pool = NULL;
+	cxt->vaddr = NULL;
+}
+
 static int ramoops_probe(struct platform_device *pdev)
 {
 	struct device *dev = &pdev->dev;
@@ -723,6 +798,7 @@ static int ramoops_probe(struct platform_device *pdev)
 	struct ramoops_context *cxt = &oops_cxt;
 	size_t dump_mem_sz;
 	phys_addr_t paddr;
+	u32 fast;
 	int err = -EINVAL;
 
 	/*
@@ -741,6 +817,11 @@ static int ramoops_probe(struct platform_device *pdev)
 		err = ramoops_parse_dt(pdev, pdata);
 		if (err < 0)
 			goto fail_out;
+
+		err = ramoops_sram_alloc(pdev, cxt, pdata);
+		if (err < 0)
+			goto fail_out;
+		err = -EINVAL;
 	}
 
 	/* Make sure we didn't get bogus platform data pointer. */
@@ -753,7 +834,7 @@ static int ramoops_probe(struct platform_device *pdev)
 			!pdata->ftrace_size && !pdata->pmsg_size)) {
 		pr_err("The memory size and the record/console size must be "
 			"non-zero\n");
-		goto fail_out;
+		goto fail_sram;
 	}
 
 	if (pdata->record_size && !is_power_of_2(pdata->record_size))
@@ -767,6 +848,7 @@ static int ramoops_probe(struct platform_device *pdev)
 
 	cxt->size = pdata->mem_size;
 	cxt->phys_addr = pdata->mem_address;
+	cxt->vaddr = pdata->mem_vaddr;
 	cxt->memtype = pdata->mem_type;
 	cxt->record_size = pdata->record_size;
 	cxt->console_size = pdata->console_size;
@@ -784,10 +866,12 @@ static int ramoops_probe(struct platform_device *pdev)
 				dump_mem_sz, cxt->record_size,
 				&cxt->max_dump_cnt, 0, 0);
 	if (err)
-		goto fail_out;
+		goto fail_sram;
 
+	/* Writers of these two never wait for each other (no ECC though) */
+	fast = (cxt->flags & RAMOOPS_FLAG_LOCKLESS) ? PRZ_FLAG_LOCKLESS : 0;
 	err = ramoops_init_prz("console", dev, cxt, &cxt->cprz, &paddr,
-			       cxt->console_size, 0);
+			       cxt->console_size, 0, fast);
 	if (err)
 		goto fail_init_cprz;
 
@@ -803,7 +887,7 @@ static int ramoops_probe(struct platform_device *pdev)
 		goto fail_init_fprz;
 
 	err = ramoops_init_prz("pmsg", dev, cxt, &cxt->mprz, &paddr,
-				cxt->pmsg_size, 0);
+				cxt->pmsg_size, 0, fast);
 	if (err)
 		goto fail_init_mprz;
 
@@ -857,9 +941,9 @@ static int ramoops_probe(struct platform_device *pdev)
 	ramoops_pmsg_size = pdata->pmsg_size;
 	ramoops_ftrace_size = pdata->ftrace_size;
 
-	pr_info("using 0x%lx@0x%llx, ecc: %d\n",
+	pr_info("using 0x%lx@0x%llx%s, ecc: %d\n",
 		cxt->size, (unsigned long long)cxt->phys_addr,
-		cxt->ecc_info.ecc_size);
+		cxt->sram_pool ? " (sram)" : "", cxt->ecc_info.ecc_size);
 
 	return 0;
 
@@ -873,6 +957,8 @@ static int ramoops_probe(struct platform_device *pdev)
 	persistent_ram_free(cxt->cprz);
 fail_init_cprz:
 	ramoops_free_przs(cxt);
+fail_sram:
+	ramoops_sram_free(cxt);
 fail_out:
 	return err;
 }
@@ -889,6 +975,7 @@ static int ramoops_remove(struct platform_device *pdev)
 	persistent_ram_free(cxt->mprz);
 	persistent_ram_free(cxt->cprz);
 	ramoops_free_przs(cxt);
+	ramoops_sram_free(cxt);
 
 	return 0;
 }
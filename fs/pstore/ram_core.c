@@ -49,6 +49,21 @@ static inline size_t buffer_start(struct persistent_ram_zone *prz)
 	return atomic_read(&prz->buffer->start);
 }
 
+/*
+ * Copy a lock-free counter to the buffer header. Writers race for the store,
+ * so repeat it until the newest value has made it.
+ */
+static void buffer_publish(atomic_t *hdr, atomic_t *val)
+{
+	int v;
+
+	do {
+		v = atomic_read(val);
+		atomic_set(hdr, v);
+		smp_mb();
+	} while (atomic_read(val) != v);
+}
+
 /* increase and wrap the start pointer, returning the old value */
 static size_t buffer_start_add(struct persistent_ram_zone *prz, size_t a)
 {
@@ -56,6 +71,18 @@ static size_t buffer_start_add(struct persistent_ram_zone *prz, size_t a)
 	int new;
 	unsigned long flags = 0;
 
+	if (prz->flags & PRZ_FLAG_LOCKLESS) {
+		do {
+			old = atomic_read(&prz->start);
+			new = old + a;
+			while (unlikely(new >= prz->buffer_size))
+				new -= prz->buffer_size;
+		} while (atomic_cmpxchg(&prz->start, old, new) != old);
+
+		buffer_publish(&prz->buffer->start, &prz->start);
+		return old;
+	}
+
 	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
 		raw_spin_lock_irqsave(&prz->buffer_lock, flags);
 
@@ -78,6 +105,20 @@ static void buffer_size_add(struct persistent_ram_zone *prz, size_t a)
 	size_t new;
 	unsigned long flags = 0;
 
+	if (prz->flags & PRZ_FLAG_LOCKLESS) {
+		do {
+			old = atomic_read(&prz->used);
+			if (old == prz->buffer_size)
+				return;
+			new = old + a;
+			if (new > prz->buffer_size)
+				new = prz->buffer_size;
+		} while (atomic_cmpxchg(&prz->used, old, new) != old);
+
+		buffer_publish(&prz->buffer->size, &prz->used);
+		return;
+	}
+
 	if (!(prz->flags & PRZ_FLAG_NO_LOCK))
 		raw_spin_lock_irqsave(&prz->buffer_lock, flags);
 
@@ -395,6 +436,8 @@ void persistent_ram_zap(struct persistent_ram_zone *prz)
 {
 	atomic_set(&prz->buffer->start, 0);
 	atomic_set(&prz->buffer->size, 0);
+	atomic_set(&prz->start, 0);
+	atomic_set(&prz->used, 0);
 	persistent_ram_update_header_ecc(prz);
 }
 
@@ -525,8 +568,12 @@ static int persistent_ram_post_init(struct persistent_ram_zone *prz, u32 sig,
 	}
 
 	/* Reset missing, invalid, or single-use memory area. */
-	if (zap)
+	if (zap) {
 		persistent_ram_zap(prz);
+	} else {
+		atomic_set(&prz->start, buffer_start(prz));
+		atomic_set(&prz->used, buffer_size(prz));
+	}
 
 	return 0;
 }
@@ -536,7 +583,7 @@ void persistent_ram_free(struct persistent_ram_zone *prz)
 	if (!prz)
 		return;
 
-	if (prz->vaddr) {
+	if (prz->vaddr && !prz->premapped) {
 		if (pfn_valid(prz->paddr >> PAGE_SHIFT)) {
 			/* We must vunmap() at page-granularity. */
 			vunmap(prz->vaddr - offset_in_page(prz->paddr));
@@ -558,8 +605,9 @@ void persistent_ram_free(struct persistent_ram_zone *prz)
 	kfree(prz);
 }
 
-struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
-			u32 sig, struct persistent_ram_ecc_info *ecc_info,
+static struct persistent_ram_zone *__persistent_ram_new(void *vaddr,
+			phys_addr_t start, size_t size, u32 sig,
+			struct persistent_ram_ecc_info *ecc_info,
 			unsigned int memtype, u32 flags, char *label)
 {
 	struct persistent_ram_zone *prz;
@@ -573,12 +621,25 @@ struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
 
 	/* Initialize general buffer state. */
 	raw_spin_lock_init(&prz->buffer_lock);
-	prz->flags = flags;
 	prz->label = label;
 
-	ret = persistent_ram_buffer_map(start, size, prz, memtype);
-	if (ret)
-		goto err;
+	/* The lock-free path does not keep the ECC in step */
+	if ((flags & PRZ_FLAG_LOCKLESS) && ecc_info && ecc_info->ecc_size > 0)
+		flags &= ~PRZ_FLAG_LOCKLESS;
+	prz->flags = flags;
+
+	if (vaddr) {
+		prz->paddr = start;
+		prz->size = size;
+		prz->vaddr = vaddr;
+		prz->premapped = true;
+		prz->buffer = vaddr;
+		prz->buffer_size = size - sizeof(struct persistent_ram_buffer);
+	} else {
+		ret = persistent_ram_buffer_map(start, size, prz, memtype);
+		if (ret)
+			goto err;
+	}
 
 	ret = persistent_ram_post_init(prz, sig, ecc_info);
 	if (ret)
@@ -595,3 +656,25 @@ struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
 	persistent_ram_free(prz);
 	return ERR_PTR(ret);
 }
+
+struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
+			u32 sig, struct persistent_ram_ecc_info *ecc_info,
+			unsigned int memtype, u32 flags, char *label)
+{
+	return __persistent_ram_new(NULL, start, size, sig, ecc_info, memtype,
+				    flags, label);
+}
+
+/*
+ * Like persistent_ram_new(), for memory that the caller has mapped already,
+ * such as a chunk of an SRAM pool. The mapping is left alone on free.
+ */
+struct persistent_ram_zone *persistent_ram_new_mapped(void *vaddr,
+			phys_addr_t start, size_t size, u32 sig,
+			struct persistent_ram_ecc_info *ecc_info,
+			u32 flags, char *label)
+{
+	return __persistent_ram_new(vaddr, start, size, sig, ecc_info, 0,
+				    flags, label);
+}
+
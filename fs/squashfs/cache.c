@@ -11,6 +11,9 @@
 /*
  * Blocks in Squashfs are compressed.  To avoid repeatedly decompressing
  * recently accessed data Squashfs uses two small metadata and fragment caches.
+ * Their sizes can be set with the "metadata_cache" and "fragment_cache" mount
+ * options, and the least recently used entry is evicted first.  Hits and
+ * misses are counted and shown in /sys/fs/squashfs/<dev>/.
  *
  * This file implements a generic cache implementation used for both caches,
  * plus functions layered ontop of the generic cache implementation to
@@ -81,18 +84,19 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			}
 
 			/*
-			 * At least one unused cache entry.  A simple
-			 * round-robin strategy is used to choose the entry to
-			 * be evicted from the cache.
+			 * At least one unused cache entry.  Evict the least
+			 * recently used one.
 			 */
-			i = cache->next_blk;
-			for (n = 0; n < cache->entries; n++) {
-				if (cache->entry[i].refcount == 0)
-					break;
-				i = (i + 1) % cache->entries;
+			for (i = -1, n = 0; n < cache->entries; n++) {
+				if (cache->entry[n].refcount)
+					continue;
+				if (i < 0 || cache->lru_clock -
+						cache->entry[n].last_used >
+						cache->lru_clock -
+						cache->entry[i].last_used)
+					i = n;
 			}
 
-			cache->next_blk = (i + 1) % cache->entries;
 			entry = &cache->entry[i];
 
 			/*
@@ -100,6 +104,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 			 * disk.
 			 */
 			cache->unused--;
+			cache->misses++;
+			entry->last_used = ++cache->lru_clock;
 			entry->block = block;
 			entry->refcount = 1;
 			entry->pending = 1;
@@ -141,6 +147,8 @@ struct squashfs_cache_entry *squashfs_cache_get(struct super_block *sb,
 		if (entry->refcount == 0)
 			cache->unused--;
 		entry->refcount++;
+		cache->hits++;
+		entry->last_used = ++cache->lru_clock;
 
 		/*
 		 * If the entry is currently being filled in by another process
@@ -238,7 +246,6 @@ struct squashfs_cache *squashfs_cache_init(char *name, int entries,
 	}
 
 	cache->curr_blk = 0;
-	cache->next_blk = 0;
 	cache->unused = entries;
 	cache->entries = entries;
 	cache->block_size = block_size;
@@ -494,7 +494,57 @@ static int squashfs_readpage(struct file *file, struct page *page)
 	return 0;
 }
 
+/*
+ * Readahead.  All the pages are added to the page cache first.  Then only
+ * the first page of each datablock is read with squashfs_readpage, which
+ * decompresses the block once and fills the other pages of the block
+ * (unlocked here so that grab_cache_page_nowait can take them), including
+ * those beyond the readahead window.
+ */
+static int squashfs_readpages(struct file *file, struct address_space *mapping,
+	struct list_head *pages, unsigned int nr_pages)
+{
+	struct inode *inode = mapping->host;
+	struct squashfs_sb_info *msblk = inode->i_sb->s_fs_info;
+	int shift = msblk->block_log - PAGE_SHIFT;
+	struct page *page, **target;
+	unsigned int i, n = 0;
+
+	target = kmalloc_array(nr_pages, sizeof(*target), GFP_KERNEL);
+	if (target == NULL)
+		return -ENOMEM;
+
+	/* The list is in reverse order, lowest index at the tail */
+	while (!list_empty(pages)) {
+		page = lru_to_page(pages);
+		list_del(&page->lru);
+		if (add_to_page_cache_lru(page, mapping, page->index,
+					readahead_gfp_mask(mapping))) {
+			put_page(page);
+			continue;
+		}
+
+		if (n && (target[n - 1]->index >> shift) ==
+					(page->index >> shift)) {
+			unlock_page(page);
+			put_page(page);
+			continue;
+		}
+
+		target[n++] = page;
+	}
+
+	for (i = 0; i < n; i++) {
+		squashfs_readpage(file, target[i]);
+		put_page(target[i]);
+	}
+
+	kfree(target);
+	return 0;
+}
+
 
 const struct address_space_operations squashfs_aops = {
-	.readpage = squashfs_readpage
+	.readpage = squashfs_readpage,
+	.readpages = squashfs_readpages
 };
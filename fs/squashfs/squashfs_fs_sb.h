@@ -10,13 +10,18 @@
  * squashfs_fs_sb.h
  */
 
+#include <linux/completion.h>
+#include <linux/kobject.h>
+
 #include "squashfs_fs.h"
 
 struct squashfs_cache {
 	char			*name;
 	int			entries;
 	int			curr_blk;
-	int			next_blk;
+	unsigned int		lru_clock;
+	unsigned long		hits;
+	unsigned long		misses;
 	int			num_waiters;
 	int			unused;
 	int			block_size;
@@ -30,6 +35,7 @@ struct squashfs_cache_entry {
 	u64			block;
 	int			length;
 	int			refcount;
+	unsigned int		last_used;
 	u64			next_index;
 	int			pending;
 	int			error;
@@ -64,5 +70,7 @@ struct squashfs_sb_info {
 	unsigned int				inodes;
 	unsigned int				fragments;
 	int					xattr_ids;
+	struct kobject				kobj;
+	struct completion			kobj_unregister;
 };
 #endif
@@ -18,6 +18,7 @@
 
 #include <linux/fs.h>
 #include <linux/fs_context.h>
+#include <linux/fs_parser.h>
 #include <linux/vfs.h>
 #include <linux/slab.h>
 #include <linux/mutex.h>
@@ -25,6 +26,7 @@
 #include <linux/init.h>
 #include <linux/module.h>
 #include <linux/magic.h>
+#include <linux/seq_file.h>
 #include <linux/xattr.h>
 
 #include "squashfs_fs.h"
@@ -37,6 +39,30 @@
 static struct file_system_type squashfs_fs_type;
 static const struct super_operations squashfs_super_ops;
 
+/* Upper limit of the "metadata_cache" and "fragment_cache" mount options */
+#define SQUASHFS_MAX_CACHED	64
+
+struct squashfs_mount_opts {
+	unsigned int metadata_cache;
+	unsigned int fragment_cache;
+};
+
+enum squashfs_param {
+	Opt_metadata_cache,
+	Opt_fragment_cache,
+};
+
+static const struct fs_parameter_spec squashfs_param_specs[] = {
+	fsparam_u32("metadata_cache", Opt_metadata_cache),
+	fsparam_u32("fragment_cache", Opt_fragment_cache),
+	{}
+};
+
+static const struct fs_parameter_description squashfs_fs_parameters = {
+	.name		= "squashfs",
+	.specs		= squashfs_param_specs,
+};
+
 static const struct squashfs_decompressor *supported_squashfs_filesystem(
 	struct fs_context *fc,
 	short major, short minor, short id)
@@ -67,6 +93,7 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(
 
 static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 {
+	struct squashfs_mount_opts *opts = fc->fs_private;
 	struct squashfs_sb_info *msblk;
 	struct squashfs_super_block *sblk = NULL;
 	struct inode *root;
@@ -194,7 +221,7 @@ static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 	err = -ENOMEM;
 
 	msblk->block_cache = squashfs_cache_init("metadata",
-			SQUASHFS_CACHED_BLKS, SQUASHFS_METADATA_SIZE);
+			opts->metadata_cache, SQUASHFS_METADATA_SIZE);
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
@@ -270,7 +297,7 @@ static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 		goto check_directory_table;
 
 	msblk->fragment_cache = squashfs_cache_init("fragment",
-		SQUASHFS_CACHED_FRAGMENTS, msblk->block_size);
+		opts->fragment_cache, msblk->block_size);
 	if (msblk->fragment_cache == NULL) {
 		err = -ENOMEM;
 		goto failed_mount;
@@ -322,6 +349,8 @@ static int squashfs_fill_super(struct super_block *sb, struct fs_context *fc)
 		goto failed_mount;
 	}
 
+	squashfs_sysfs_register(sb);
+
 	TRACE("Leaving squashfs_fill_super\n");
 	kfree(sblk);
 	return 0;
@@ -355,17 +384,80 @@ static int squashfs_reconfigure(struct fs_context *fc)
 	return 0;
 }
 
+static int squashfs_parse_param(struct fs_context *fc,
+				struct fs_parameter *param)
+{
+	struct squashfs_mount_opts *opts = fc->fs_private;
+	struct fs_parse_result result;
+	int opt;
+
+	opt = fs_parse(fc, &squashfs_fs_parameters, param, &result);
+	if (opt < 0)
+		return opt;
+
+	switch (opt) {
+	case Opt_metadata_cache:
+		/* See fill_meta_index in file.c for the lower limit */
+		if (result.uint_32 < SQUASHFS_CACHED_BLKS ||
+		    result.uint_32 > SQUASHFS_MAX_CACHED)
+			return invalf(fc, "squashfs: metadata_cache must be "
+				      "%d to %d", SQUASHFS_CACHED_BLKS,
+				      SQUASHFS_MAX_CACHED);
+		opts->metadata_cache = result.uint_32;
+		break;
+	case Opt_fragment_cache:
+		if (result.uint_32 < 1 || result.uint_32 > SQUASHFS_MAX_CACHED)
+			return invalf(fc, "squashfs: fragment_cache must be "
+				      "1 to %d", SQUASHFS_MAX_CACHED);
+		opts->fragment_cache = result.uint_32;
+		break;
+	}
+
+	return 0;
+}
+
+static void squashfs_free_fs_context(struct fs_context *fc)
+{
+	kfree(fc->fs_private);
+}
+
 static const struct fs_context_operations squashfs_context_ops = {
+	.parse_param	= squashfs_parse_param,
 	.get_tree	= squashfs_get_tree,
 	.reconfigure	= squashfs_reconfigure,
+	.free		= squashfs_free_fs_context,
 };
 
 static int squashfs_init_fs_context(struct fs_context *fc)
 {
+	struct squashfs_mount_opts *opts;
+
+	opts = kzalloc(sizeof(*opts), GFP_KERNEL);
+	if (opts == NULL)
+		return -ENOMEM;
+
+	opts->metadata_cache = SQUASHFS_CACHED_BLKS;
+	opts->fragment_cache = SQUASHFS_CACHED_FRAGMENTS;
+	fc->fs_private = opts;
 	fc->ops = &squashfs_context_ops;
 	return 0;
 }
 
+static int squashfs_show_options(struct seq_file *s, struct dentry *root)
+{
+	struct squashfs_sb_info *msblk = root->d_sb->s_fs_info;
+
+	if (msblk->block_cache->entries != SQUASHFS_CACHED_BLKS)
+		seq_printf(s, ",metadata_cache=%d",
+			   msblk->block_cache->entries);
+	if (msblk->fragment_cache &&
+	    msblk->fragment_cache->entries != SQUASHFS_CACHED_FRAGMENTS)
+		seq_printf(s, ",fragment_cache=%d",
+			   msblk->fragment_cache->entries);
+
+	return 0;
+}
+
 static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 {
 	struct squashfs_sb_info *msblk = dentry->d_sb->s_fs_info;
@@ -391,6 +483,7 @@ static void squashfs_put_super(struct super_block *sb)
 {
 	if (sb->s_fs_info) {
 		struct squashfs_sb_info *sbi = sb->s_fs_info;
+		squashfs_sysfs_unregister(sb);
 		squashfs_cache_delete(sbi->block_cache);
 		squashfs_cache_delete(sbi->fragment_cache);
 		squashfs_cache_delete(sbi->read_page);
@@ -445,8 +538,15 @@ static int __init init_squashfs_fs(void)
 	if (err)
 		return err;
 
+	err = squashfs_sysfs_init();
+	if (err) {
+		destroy_inodecache();
+		return err;
+	}
+
 	err = register_filesystem(&squashfs_fs_type);
 	if (err) {
+		squashfs_sysfs_exit();
 		destroy_inodecache();
 		return err;
 	}
@@ -460,6 +560,7 @@ static int __init init_squashfs_fs(void)
 static void __exit exit_squashfs_fs(void)
 {
 	unregister_filesystem(&squashfs_fs_type);
+	squashfs_sysfs_exit();
 	destroy_inodecache();
 }
 
@@ -482,6 +583,7 @@ static struct file_system_type squashfs_fs_type = {
 	.owner = THIS_MODULE,
 	.name = "squashfs",
 	.init_fs_context = squashfs_init_fs_context,
+	.parameters = &squashfs_fs_parameters,
 	.kill_sb = kill_block_super,
 	.fs_flags = FS_REQUIRES_DEV
 };
@@ -492,6 +594,7 @@ static const struct super_operations squashfs_super_ops = {
 	.free_inode = squashfs_free_inode,
 	.statfs = squashfs_statfs,
 	.put_super = squashfs_put_super,
+	.show_options = squashfs_show_options,
 };
 
 module_init(init_squashfs_fs);
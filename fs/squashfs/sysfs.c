@@ -0,0 +1,158 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Squashfs - a compressed read only filesystem for Linux
+ *
+ * sysfs.c
+ */
+
+/*
+ * This file implements /sys/fs/squashfs/<dev>/, which shows the size and
+ * the hit and miss counts of the metadata and fragment caches of each
+ * mounted filesystem.
+ */
+
+#include <linux/fs.h>
+#include <linux/kobject.h>
+#include <linux/stddef.h>
+#include <linux/sysfs.h>
+
+#include "squashfs_fs.h"
+#include "squashfs_fs_sb.h"
+#include "squashfs.h"
+
+enum {
+	SQUASHFS_ATTR_ENTRIES,
+	SQUASHFS_ATTR_HITS,
+	SQUASHFS_ATTR_MISSES,
+};
+
+struct squashfs_attr {
+	struct attribute attr;
+	/* Offset of the cache pointer in struct squashfs_sb_info */
+	size_t cache;
+	int field;
+};
+
+#define SQUASHFS_CACHE_ATTR(_name, _cache, _field)			\
+static struct squashfs_attr squashfs_attr_##_name = {			\
+	.attr = { .name = __stringify(_name), .mode = 0444 },		\
+	.cache = offsetof(struct squashfs_sb_info, _cache),		\
+	.field = _field,						\
+}
+
+SQUASHFS_CACHE_ATTR(metadata_cache_entries, block_cache, SQUASHFS_ATTR_ENTRIES);
+SQUASHFS_CACHE_ATTR(metadata_cache_hits, block_cache, SQUASHFS_ATTR_HITS);
+SQUASHFS_CACHE_ATTR(metadata_cache_misses, block_cache, SQUASHFS_ATTR_MISSES);
+SQUASHFS_CACHE_ATTR(fragment_cache_entries, fragment_cache,
+		    SQUASHFS_ATTR_ENTRIES);
+SQUASHFS_CACHE_ATTR(fragment_cache_hits, fragment_cache, SQUASHFS_ATTR_HITS);
+SQUASHFS_CACHE_ATTR(fragment_cache_misses, fragment_cache,
+		    SQUASHFS_ATTR_MISSES);
+
+static struct attribute *squashfs_attrs[] = {
+	&squashfs_attr_metadata_cache_entries.attr,
+	&squashfs_attr_metadata_cache_hits.attr,
+	&squashfs_attr_metadata_cache_misses.attr,
+	&squashfs_attr_fragment_cache_entries.attr,
+	&squashfs_attr_fragment_cache_hits.attr,
+	&squashfs_attr_fragment_cache_misses.attr,
+	NULL,
+};
+
+static ssize_t squashfs_attr_show(struct kobject *kobj,
+	struct attribute *attr, char *buf)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+		struct squashfs_sb_info, kobj);
+	struct squashfs_attr *a = container_of(attr, struct squashfs_attr,
+		attr);
+	struct squashfs_cache *cache = *(struct squashfs_cache **)
+		((char *)msblk + a->cache);
+	unsigned long val = 0;
+
+	/* There is no fragment cache if the filesystem has no fragments */
+	if (cache) {
+		switch (a->field) {
+		case SQUASHFS_ATTR_ENTRIES:
+			val = cache->entries;
+			break;
+		case SQUASHFS_ATTR_HITS:
+			val = READ_ONCE(cache->hits);
+			break;
+		case SQUASHFS_ATTR_MISSES:
+			val = READ_ONCE(cache->misses);
+			break;
+		}
+	}
+
+	return sprintf(buf, "%lu\n", val);
+}
+
+static void squashfs_sb_release(struct kobject *kobj)
+{
+	struct squashfs_sb_info *msblk = container_of(kobj,
+		struct squashfs_sb_info, kobj);
+
+	complete(&msblk->kobj_unregister);
+}
+
+static const struct sysfs_ops squashfs_attr_ops = {
+	.show	= squashfs_attr_show,
+};
+
+static struct kobj_type squashfs_sb_ktype = {
+	.default_attrs	= squashfs_attrs,
+	.sysfs_ops	= &squashfs_attr_ops,
+	.release	= squashfs_sb_release,
+};
+
+static struct kset *squashfs_kset;
+
+
+/*
+ * Add /sys/fs/squashfs/<dev>/.  The statistics are not essential, so a
+ * failure is only reported and the mount goes on without them.
+ */
+void squashfs_sysfs_register(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+	int err;
+
+	init_completion(&msblk->kobj_unregister);
+	msblk->kobj.kset = squashfs_kset;
+	err = kobject_init_and_add(&msblk->kobj, &squashfs_sb_ktype, NULL,
+		"%s", sb->s_id);
+	if (err) {
+		kobject_put(&msblk->kobj);
+		wait_for_completion(&msblk->kobj_unregister);
+		memset(&msblk->kobj, 0, sizeof(msblk->kobj));
+		ERROR("Failed to add %s to sysfs (%d)\n", sb->s_id, err);
+	}
+}
+
+
+void squashfs_sysfs_unregister(struct super_block *sb)
+{
+	struct squashfs_sb_info *msblk = sb->s_fs_info;
+
+	if (!msblk->kobj.state_in_sysfs)
+		return;
+
+	kobject_del(&msblk->kobj);
+	kobject_put(&msblk->kobj);
+	wait_for_completion(&msblk->kobj_unregister);
+}
+
+
+int __init squashfs_sysfs_init(void)
+{
+	squashfs_kset = kset_create_and_add("squashfs", NULL, fs_kobj);
+
+	return squashfs_kset ? 0 : -ENOMEM;
+}
+
+
+void squashfs_sysfs_exit(void)
+{
+	kset_unregister(squashfs_kset);
+}
@@ -77,6 +77,35 @@ static struct ubifs_compressor zstd_compr = {
 };
 #endif
 
+#ifdef CONFIG_UBIFS_FS_LZ4
+static DEFINE_MUTEX(lz4_mutex);
+static DEFINE_MUTEX(lz4hc_mutex);
+
+static struct ubifs_compressor lz4_compr = {
+	.compr_type = UBIFS_COMPR_LZ4,
+	.comp_mutex = &lz4_mutex,
+	.name = "lz4",
+	.capi_name = "lz4",
+};
+
+static struct ubifs_compressor lz4hc_compr = {
+	.compr_type = UBIFS_COMPR_LZ4HC,
+	.comp_mutex = &lz4hc_mutex,
+	.name = "lz4hc",
+	.capi_name = "lz4hc",
+};
+#else
+static struct ubifs_compressor lz4_compr = {
+	.compr_type = UBIFS_COMPR_LZ4,
+	.name = "lz4",
+};
+
+static struct ubifs_compressor lz4hc_compr = {
+	.compr_type = UBIFS_COMPR_LZ4HC,
+	.name = "lz4hc",
+};
+#endif
+
 /* All UBIFS compressors */
 struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
 
@@ -242,9 +271,21 @@ int __init ubifs_compressors_init(void)
 	if (err)
 		goto out_zstd;
 
+	err = compr_init(&lz4_compr);
+	if (err)
+		goto out_zlib;
+
+	err = compr_init(&lz4hc_compr);
+	if (err)
+		goto out_lz4;
+
 	ubifs_compressors[UBIFS_COMPR_NONE] = &none_compr;
 	return 0;
 
+out_lz4:
+	compr_exit(&lz4_compr);
+out_zlib:
+	compr_exit(&zlib_compr);
 out_zstd:
 	compr_exit(&zstd_compr);
 out_lzo:
@@ -260,4 +301,6 @@ void ubifs_compressors_exit(void)
 	compr_exit(&lzo_compr);
 	compr_exit(&zlib_compr);
 	compr_exit(&zstd_compr);
+	compr_exit(&lz4_compr);
+	compr_exit(&lz4hc_compr);
 }
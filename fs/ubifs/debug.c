@@ -331,6 +331,8 @@ void ubifs_dump_node(const struct ubifs_info *c, const void *node)
 		       !!(sup_flags & UBIFS_FLG_BIGLPT));
 		pr_err("\tspace_fixup    %u\n",
 		       !!(sup_flags & UBIFS_FLG_SPACE_FIXUP));
+		pr_err("\tlz4            %u\n",
+		       !!(sup_flags & UBIFS_FLG_LZ4));
 		pr_err("\tmin_io_size    %u\n", le32_to_cpu(sup->min_io_size));
 		pr_err("\tleb_size       %u\n", le32_to_cpu(sup->leb_size));
 		pr_err("\tleb_cnt        %u\n", le32_to_cpu(sup->leb_cnt));
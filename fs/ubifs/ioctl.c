@@ -14,6 +14,7 @@
 
 #include <linux/compat.h>
 #include <linux/mount.h>
+#include <mtd/ubifs-user.h>
 #include "ubifs.h"
 
 /* Need to be kept consistent with checked flags in ioctl2ubifs() */
@@ -133,6 +134,50 @@ static int setflags(struct inode *inode, int flags)
 	return err;
 }
 
+/*
+ * setcompr - change the compressor used for new data nodes of an inode.
+ * @inode: regular file to change
+ * @compr_type: new compressor type (%UBIFS_COMPR_NONE, etc)
+ */
+static int setcompr(struct inode *inode, int compr_type)
+{
+	int err, release;
+	struct ubifs_inode *ui = ubifs_inode(inode);
+	struct ubifs_info *c = inode->i_sb->s_fs_info;
+	struct ubifs_budget_req req = { .dirtied_ino = 1,
+					.dirtied_ino_d = ui->data_len };
+
+	if (!S_ISREG(inode->i_mode))
+		return -EINVAL;
+
+	if (compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT ||
+	    !ubifs_compr_present(c, compr_type))
+		return -EOPNOTSUPP;
+
+	if (compr_type == UBIFS_COMPR_LZ4 || compr_type == UBIFS_COMPR_LZ4HC) {
+		err = ubifs_enable_lz4(c);
+		if (err)
+			return err;
+	}
+
+	err = ubifs_budget_space(c, &req);
+	if (err)
+		return err;
+
+	mutex_lock(&ui->ui_mutex);
+	ui->compr_type = compr_type;
+	inode->i_ctime = current_time(inode);
+	release = ui->dirty;
+	mark_inode_dirty_sync(inode);
+	mutex_unlock(&ui->ui_mutex);
+
+	if (release)
+		ubifs_release_budget(c, &req);
+	if (IS_SYNC(inode))
+		err = write_inode_now(inode, 1);
+	return err;
+}
+
 long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	int flags, err;
@@ -173,6 +218,30 @@ long ubifs_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 		mnt_drop_write_file(file);
 		return err;
 	}
+	case UBIFS_IOCGCOMPR:
+		return put_user((int)ubifs_inode(inode)->compr_type,
+				(__s32 __user *) arg);
+
+	case UBIFS_IOCSCOMPR: {
+		__s32 compr_type;
+
+		if (IS_RDONLY(inode))
+			return -EROFS;
+
+		if (!inode_owner_or_capable(inode))
+			return -EACCES;
+
+		if (get_user(compr_type, (__s32 __user *) arg))
+			return -EFAULT;
+
+		err = mnt_want_write_file(file);
+		if (err)
+			return err;
+		dbg_gen("set compressor: %d", compr_type);
+		err = setcompr(inode, compr_type);
+		mnt_drop_write_file(file);
+		return err;
+	}
 	case FS_IOC_SET_ENCRYPTION_POLICY: {
 		struct ubifs_info *c = inode->i_sb->s_fs_info;
 
@@ -215,6 +284,8 @@ long ubifs_compat_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 	case FS_IOC32_SETFLAGS:
 		cmd = FS_IOC_SETFLAGS;
 		break;
+	case UBIFS_IOCGCOMPR:
+	case UBIFS_IOCSCOMPR:
 	case FS_IOC_SET_ENCRYPTION_POLICY:
 	case FS_IOC_GET_ENCRYPTION_POLICY:
 	case FS_IOC_GET_ENCRYPTION_POLICY_EX:
@@ -733,6 +733,7 @@ int ubifs_read_superblock(struct ubifs_info *c)
 	c->space_fixup = !!(sup_flags & UBIFS_FLG_SPACE_FIXUP);
 	c->double_hash = !!(sup_flags & UBIFS_FLG_DOUBLE_HASH);
 	c->encrypted = !!(sup_flags & UBIFS_FLG_ENCRYPTION);
+	c->lz4 = !!(sup_flags & UBIFS_FLG_LZ4);
 
 	err = authenticate_sb_node(c, sup);
 	if (err)
@@ -765,6 +766,17 @@ int ubifs_read_superblock(struct ubifs_info *c)
 			old_leb_cnt, c->leb_cnt);
 	}
 
+	/*
+	 * Older kernels cannot decompress LZ4 nodes, so flag the file system
+	 * before the first one is written. They refuse the unknown flag.
+	 */
+	if (!c->lz4 && (c->default_compr == UBIFS_COMPR_LZ4 ||
+			c->default_compr == UBIFS_COMPR_LZ4HC)) {
+		sup->flags |= cpu_to_le32(UBIFS_FLG_LZ4);
+		c->lz4 = 1;
+		c->superblock_need_write = 1;
+	}
+
 	c->log_bytes = (long long)c->log_lebs * c->leb_size;
 	c->log_last = UBIFS_LOG_LNUM + c->log_lebs - 1;
 	c->lpt_first = UBIFS_LOG_LNUM + c->log_lebs;
@@ -953,3 +965,32 @@ int ubifs_enable_encryption(struct ubifs_info *c)
 
 	return err;
 }
+
+/**
+ * ubifs_enable_lz4 - flag the file system as containing LZ4 nodes.
+ * @c: UBIFS file-system description object
+ *
+ * This function sets %UBIFS_FLG_LZ4 in the superblock so that kernels without
+ * LZ4 support refuse to mount the file system. It has to be called before an
+ * inode is switched to LZ4 at run-time. Returns zero in case of success and a
+ * negative error code in case of failure.
+ */
+int ubifs_enable_lz4(struct ubifs_info *c)
+{
+	int err;
+	struct ubifs_sb_node *sup = c->sup_node;
+
+	if (c->lz4)
+		return 0;
+
+	if (c->ro_mount || c->ro_media)
+		return -EROFS;
+
+	sup->flags |= cpu_to_le32(UBIFS_FLG_LZ4);
+
+	err = ubifs_write_sb_node(c, sup);
+	if (!err)
+		c->lz4 = 1;
+
+	return err;
+}
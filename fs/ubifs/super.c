@@ -1061,6 +1061,10 @@ static int ubifs_parse_options(struct ubifs_info *c, char *options,
 				c->mount_opts.compr_type = UBIFS_COMPR_ZLIB;
 			else if (!strcmp(name, "zstd"))
 				c->mount_opts.compr_type = UBIFS_COMPR_ZSTD;
+			else if (!strcmp(name, "lz4"))
+				c->mount_opts.compr_type = UBIFS_COMPR_LZ4;
+			else if (!strcmp(name, "lz4hc"))
+				c->mount_opts.compr_type = UBIFS_COMPR_LZ4HC;
 			else {
 				ubifs_err(c, "unknown compressor \"%s\"", name); //FIXME: is c ready?
 				kfree(name);
@@ -2359,12 +2363,12 @@ static int __init ubifs_init(void)
 	BUILD_BUG_ON(UBIFS_REF_NODE_SZ != 64);
 
 	/*
-	 * We use 2 bit wide bit-fields to store compression type, which should
+	 * We use 3 bit wide bit-fields to store compression type, which should
 	 * be amended if more compressors are added. The bit-fields are:
 	 * @compr_type in 'struct ubifs_inode', @default_compr in
 	 * 'struct ubifs_info' and @compr_type in 'struct ubifs_mount_opts'.
 	 */
-	BUILD_BUG_ON(UBIFS_COMPR_TYPES_CNT > 4);
+	BUILD_BUG_ON(UBIFS_COMPR_TYPES_CNT > 8);
 
 	/*
 	 * We require that PAGE_SIZE is greater-than-or-equal-to
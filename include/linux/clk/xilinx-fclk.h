@@ -0,0 +1,30 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Load hints for the Xilinx fclk clock driver.
+ */
+
+#ifndef __LINUX_CLK_XILINX_FCLK_H
+#define __LINUX_CLK_XILINX_FCLK_H
+
+#include <linux/err.h>
+
+struct device;
+struct fclk_request;
+
+#if IS_ENABLED(CONFIG_XILINX_FCLK_DEVFREQ)
+struct fclk_request *devm_fclk_request_get(struct device *dev);
+int fclk_request_update(struct fclk_request *req, unsigned long rate);
+#else
+static inline struct fclk_request *devm_fclk_request_get(struct device *dev)
+{
+	return NULL;
+}
+
+static inline int fclk_request_update(struct fclk_request *req,
+				      unsigned long rate)
+{
+	return 0;
+}
+#endif
+
+#endif /* __LINUX_CLK_XILINX_FCLK_H */
@@ -18,4 +18,6 @@ void zynq_clock_init(void);
 struct clk *clk_register_zynq_pll(const char *name, const char *parent,
 		void __iomem *pll_ctrl, void __iomem *pll_status, u8 lock_index,
 		spinlock_t *lock);
+struct clk *clk_register_zynq_fclk_div(const char *name, const char *parent,
+		void __iomem *clk_ctrl, spinlock_t *lock);
 #endif
@@ -447,6 +447,33 @@ static inline void cpufreq_suspend(void) {}
 static inline void cpufreq_resume(void) {}
 #endif
 
+/*
+ * Frequency floor for latency-critical work, e.g. a real-time thread that
+ * drains a device FIFO. See cpufreq_latency_req_add().
+ */
+struct cpufreq_latency_req {
+	struct list_head entries;
+};
+
+static inline void cpufreq_latency_req_init(struct cpufreq_latency_req *req)
+{
+	INIT_LIST_HEAD(&req->entries);
+}
+
+#ifdef CONFIG_CPU_FREQ
+int cpufreq_latency_req_add(struct cpufreq_latency_req *req,
+			    const struct cpumask *cpus, unsigned int min_freq);
+void cpufreq_latency_req_remove(struct cpufreq_latency_req *req);
+#else
+static inline int cpufreq_latency_req_add(struct cpufreq_latency_req *req,
+					  const struct cpumask *cpus,
+					  unsigned int min_freq)
+{
+	return 0;
+}
+static inline void cpufreq_latency_req_remove(struct cpufreq_latency_req *req) {}
+#endif
+
 /*********************************************************************
  *                     CPUFREQ NOTIFIER INTERFACE                    *
  *********************************************************************/
@@ -41,5 +41,7 @@ struct xilinx_vdma_config {
 
 int xilinx_vdma_channel_set_config(struct dma_chan *dchan,
 					struct xilinx_vdma_config *cfg);
+int xilinx_dma_channel_set_poll(struct dma_chan *dchan, bool enable);
+int xilinx_mcdma_channel_set_weight(struct dma_chan *dchan, u32 weight);
 
 #endif
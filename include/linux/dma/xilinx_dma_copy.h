@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Xilinx DMA memory copy offload
+ */
+
+#ifndef __XILINX_DMA_COPY_H
+#define __XILINX_DMA_COPY_H
+
+#include <linux/string.h>
+#include <linux/types.h>
+
+typedef void (*xilinx_dma_copy_callback)(void *param, int err);
+
+#if IS_ENABLED(CONFIG_XILINX_DMA_COPY)
+int xilinx_dma_copy_async(void *dst, const void *src, size_t len,
+			  xilinx_dma_copy_callback done, void *param);
+int xilinx_dma_copy(void *dst, const void *src, size_t len);
+#else
+static inline int xilinx_dma_copy_async(void *dst, const void *src,
+					size_t len,
+					xilinx_dma_copy_callback done,
+					void *param)
+{
+	memcpy(dst, src, len);
+	done(param, 0);
+	return 0;
+}
+
+static inline int xilinx_dma_copy(void *dst, const void *src, size_t len)
+{
+	memcpy(dst, src, len);
+	return 0;
+}
+#endif
+
+#endif /* __XILINX_DMA_COPY_H */
@@ -14,6 +14,8 @@
 
 #include <linux/dmaengine.h>
 
+struct dma_buf;
+
 /* Modes to enable early callback */
 /* To avoid first frame delay */
 #define EARLY_CALLBACK			BIT(1)
@@ -153,6 +155,26 @@ int xilinx_xdma_get_earlycb(struct dma_chan *chan,
 int xilinx_xdma_set_earlycb(struct dma_chan *chan,
 			    struct dma_async_tx_descriptor *async_tx,
 			    u32 earlycb);
+
+/**
+ * xilinx_xdma_set_dmabuf - Synchronise a frame with a dma-buf
+ * @chan: dma channel instance
+ * @async_tx: dma async tx descriptor for the buffer
+ * @dmabuf: dma-buf backing the frame
+ *
+ * The frame does not start before the implicit fences of @dmabuf have
+ * signalled, without blocking the caller: the last writer for a
+ * framebuffer read, all users for a framebuffer write. The driver adds a
+ * fence to @dmabuf that it signals from the interrupt handler once the
+ * frame is done, so the next device in the pipeline can queue against
+ * it. The client maps the dma-buf itself and passes the addresses in the
+ * interleaved template as usual. Must be called before tx_submit().
+ *
+ * Return: 0 on success, negative error code otherwise
+ */
+int xilinx_xdma_set_dmabuf(struct dma_chan *chan,
+			   struct dma_async_tx_descriptor *async_tx,
+			   struct dma_buf *dmabuf);
 #else
 static inline void xilinx_xdma_set_mode(struct dma_chan *chan,
 					enum operation_mode mode)
@@ -204,6 +226,13 @@ static inline int xilinx_xdma_set_earlycb(struct dma_chan *chan,
 {
 	return -ENODEV;
 }
+
+static inline int xilinx_xdma_set_dmabuf(struct dma_chan *chan,
+					 struct dma_async_tx_descriptor *atx,
+					 struct dma_buf *dmabuf)
+{
+	return -ENODEV;
+}
 #endif
 
 #endif /*__XILINX_FRMBUF_DMA_H*/
@@ -125,6 +125,8 @@ struct fpga_image_info {
 /**
  * struct fpga_manager_ops - ops for low level fpga manager drivers
  * @initial_header_size: Maximum number of bytes that should be passed into write_init
+ * @stream_chunk_size: optional: if set, images loaded by firmware name are
+ *	read and passed to @write this many bytes at a time
  * @state: returns an enum value of the FPGA's state
  * @status: returns status of the FPGA, including reconfiguration error code
  * @write_init: prepare the FPGA to receive confuration data
@@ -141,6 +143,7 @@ struct fpga_image_info {
  */
 struct fpga_manager_ops {
 	size_t initial_header_size;
+	size_t stream_chunk_size;
 	enum fpga_mgr_states (*state)(struct fpga_manager *mgr);
 	u64 (*status)(struct fpga_manager *mgr);
 	int (*write_init)(struct fpga_manager *mgr,
@@ -179,6 +182,39 @@ struct fpga_compat_id {
 	u64 id_l;
 };
 
+/**
+ * enum fpga_mgr_phase - phases of loading an image, for timing
+ * @FPGA_MGR_PHASE_READ: reading the image from storage
+ * @FPGA_MGR_PHASE_DECOMPRESS: decompressing a compressed image
+ * @FPGA_MGR_PHASE_WRITE_INIT: the write_init op
+ * @FPGA_MGR_PHASE_WRITE: the write and write_sg ops
+ * @FPGA_MGR_PHASE_WRITE_COMPLETE: the write_complete op
+ */
+enum fpga_mgr_phase {
+	FPGA_MGR_PHASE_READ,
+	FPGA_MGR_PHASE_DECOMPRESS,
+	FPGA_MGR_PHASE_WRITE_INIT,
+	FPGA_MGR_PHASE_WRITE,
+	FPGA_MGR_PHASE_WRITE_COMPLETE,
+	FPGA_MGR_PHASE_MAX
+};
+
+/**
+ * struct fpga_mgr_timing - time spent in the last image load
+ * @start_ns: when the load started
+ * @total_ns: duration of the whole load
+ * @phase_ns: time spent in each phase
+ * @bytes: image bytes written to the FPGA
+ * @result: return value of the load
+ */
+struct fpga_mgr_timing {
+	u64 start_ns;
+	u64 total_ns;
+	u64 phase_ns[FPGA_MGR_PHASE_MAX];
+	size_t bytes;
+	int result;
+};
+
 /**
  * struct fpga_manager - fpga manager structure
  * @name: name of low level fpga manager
@@ -186,7 +222,11 @@ struct fpga_compat_id {
  * @key: key value useful for Encrypted Bitstream loading to read the userkey
  * @dev: fpga manager device
  * @ref_mutex: only allows one reference to fpga manager
+ * @cache_mutex: protects image_cache and cache_size
+ * @image_cache: preloaded images, most recently used first
+ * @cache_size: bytes held by image_cache
  * @state: state of fpga manager
+ * @timing: timing breakdown of the last load
  * @compat_id: FPGA manager id for compatibility check.
  * @mops: pointer to struct of fpga manager ops
  * @priv: low level driver private date
@@ -200,7 +240,11 @@ struct fpga_manager {
 	struct miscdevice miscdev;
 	struct dma_buf *dmabuf;
 	struct mutex ref_mutex;
+	struct mutex cache_mutex;
+	struct list_head image_cache;
+	size_t cache_size;
 	enum fpga_mgr_states state;
+	struct fpga_mgr_timing timing;
 	struct fpga_compat_id *compat_id;
 	const struct fpga_manager_ops *mops;
 	void *priv;
@@ -217,6 +261,9 @@ void fpga_image_info_free(struct fpga_image_info *info);
 
 int fpga_mgr_load(struct fpga_manager *mgr, struct fpga_image_info *info);
 
+int fpga_mgr_cache_preload(struct fpga_manager *mgr, const char *image_name);
+void fpga_mgr_cache_drop(struct fpga_manager *mgr, const char *image_name);
+
 int fpga_mgr_lock(struct fpga_manager *mgr);
 void fpga_mgr_unlock(struct fpga_manager *mgr);
 
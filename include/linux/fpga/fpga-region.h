@@ -36,6 +36,8 @@ struct fpga_region *fpga_region_class_find(
 	int (*match)(struct device *, const void *));
 
 int fpga_region_program_fpga(struct fpga_region *region);
+int fpga_region_cache_preload(struct fpga_region *region,
+			      const char *image_name);
 
 struct fpga_region
 *fpga_region_create(struct device *dev, struct fpga_manager *mgr,
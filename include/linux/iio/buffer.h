@@ -15,6 +15,27 @@ void iio_buffer_set_attrs(struct iio_buffer *buffer,
 			 const struct attribute **attrs);
 
 int iio_push_to_buffers(struct iio_dev *indio_dev, const void *data);
+int iio_push_to_buffers_n(struct iio_dev *indio_dev, const void *data,
+			  unsigned int n);
+
+/**
+ * iio_scan_set_timestamp() - store the timestamp in a scan
+ * @indio_dev:		iio_dev structure for device.
+ * @data:		sample data of one scan
+ * @timestamp:		timestamp for the sample data
+ *
+ * Stores the timestamp as the last element of the scan if timestamps are
+ * enabled for the device. Useful to prepare the scans for
+ * iio_push_to_buffers_n().
+ */
+static inline void iio_scan_set_timestamp(struct iio_dev *indio_dev,
+	void *data, int64_t timestamp)
+{
+	if (indio_dev->scan_timestamp) {
+		size_t ts_offset = indio_dev->scan_bytes / sizeof(int64_t) - 1;
+		((int64_t *)data)[ts_offset] = timestamp;
+	}
+}
 
 /**
  * iio_push_to_buffers_with_timestamp() - push data and timestamp to buffers
@@ -33,10 +54,7 @@ int iio_push_to_buffers(struct iio_dev *indio_dev, const void *data);
 static inline int iio_push_to_buffers_with_timestamp(struct iio_dev *indio_dev,
 	void *data, int64_t timestamp)
 {
-	if (indio_dev->scan_timestamp) {
-		size_t ts_offset = indio_dev->scan_bytes / sizeof(int64_t) - 1;
-		((int64_t *)data)[ts_offset] = timestamp;
-	}
+	iio_scan_set_timestamp(indio_dev, data, timestamp);
 
 	return iio_push_to_buffers(indio_dev, data);
 }
@@ -3,11 +3,13 @@
 #define _IIO_BUFFER_GENERIC_IMPL_H_
 #include <linux/sysfs.h>
 #include <linux/kref.h>
+#include <uapi/linux/iio/buffer.h>
 
 #ifdef CONFIG_IIO_BUFFER
 
 struct iio_dev;
 struct iio_buffer;
+struct vm_area_struct;
 
 /**
  * INDIO_BUFFER_FLAG_FIXED_WATERMARK - Watermark level of the buffer can not be
@@ -18,6 +20,8 @@ struct iio_buffer;
 /**
  * struct iio_buffer_access_funcs - access functions for buffers.
  * @store_to:		actually store stuff to the buffer
+ * @store_n_to:		store several consecutive scans at once. Returns the
+ *			number of scans stored.
  * @read_first_n:	try to get a specified number of bytes (must exist)
  * @data_available:	indicates how much data is available for reading from
  *			the buffer.
@@ -32,6 +36,13 @@ struct iio_buffer;
  *                      device stops sampling. Calles are balanced with @enable.
  * @release:		called when the last reference to the buffer is dropped,
  *			should free all resources allocated by the buffer.
+ * @alloc_blocks:	allocate blocks for mmap() based access.
+ * @free_blocks:	free the blocks allocated with @alloc_blocks.
+ * @query_block:	fill in the descriptor of a block.
+ * @enqueue_block:	hand a block back to the buffer.
+ * @dequeue_block:	take the next block that contains data. Should return
+ *			-EAGAIN if there is none.
+ * @mmap:		map a block into the address space of the caller.
  * @modes:		Supported operating modes by this buffer type
  * @flags:		A bitmask combination of INDIO_BUFFER_FLAG_*
  *
@@ -45,6 +56,8 @@ struct iio_buffer;
  **/
 struct iio_buffer_access_funcs {
 	int (*store_to)(struct iio_buffer *buffer, const void *data);
+	int (*store_n_to)(struct iio_buffer *buffer, const void *data,
+			  unsigned int n);
 	int (*read_first_n)(struct iio_buffer *buffer,
 			    size_t n,
 			    char __user *buf);
@@ -60,6 +73,17 @@ struct iio_buffer_access_funcs {
 
 	void (*release)(struct iio_buffer *buffer);
 
+	int (*alloc_blocks)(struct iio_buffer *buffer,
+			    struct iio_buffer_block_alloc_req *req);
+	int (*free_blocks)(struct iio_buffer *buffer);
+	int (*query_block)(struct iio_buffer *buffer,
+			   struct iio_buffer_block *block);
+	int (*enqueue_block)(struct iio_buffer *buffer,
+			     struct iio_buffer_block *block);
+	int (*dequeue_block)(struct iio_buffer *buffer,
+			     struct iio_buffer_block *block);
+	int (*mmap)(struct iio_buffer *buffer, struct vm_area_struct *vma);
+
 	unsigned int modes;
 	unsigned int flags;
 };
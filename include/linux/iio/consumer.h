@@ -259,6 +259,36 @@ int iio_read_channel_attribute(struct iio_channel *chan, int *val,
  */
 int iio_write_channel_raw(struct iio_channel *chan, int val);
 
+/**
+ * iio_read_channels_raw() - read from several channels in one go
+ * @chans:		The channels being queried.
+ * @num:		Number of entries in @chans and @vals.
+ * @vals:		Values read back, one per channel.
+ *
+ * Fast path for consumers that read the same channels at a high rate. The
+ * channels may belong to different devices. Unlike iio_read_channel_raw() it
+ * does not take the info_exist_lock of the devices. This is safe, because
+ * iio_device_unregister() waits for pending calls to finish.
+ *
+ * Returns 0 on success. On error the values of the channels before the
+ * failing one are valid.
+ */
+int iio_read_channels_raw(struct iio_channel *chans, unsigned int num,
+			  int *vals);
+
+/**
+ * iio_write_channels_raw() - write to several channels in one go
+ * @chans:		The channels being written.
+ * @num:		Number of entries in @chans and @vals.
+ * @vals:		Values being written, one per channel.
+ *
+ * Counterpart of iio_read_channels_raw() for writes.
+ *
+ * Returns 0 on success or a negative error code.
+ */
+int iio_write_channels_raw(struct iio_channel *chans, unsigned int num,
+			   const int *vals);
+
 /**
  * iio_read_max_channel_raw() - read maximum available raw value from a given
  *				channel, i.e. the maximum possible value.
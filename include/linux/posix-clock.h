@@ -113,4 +113,20 @@ int posix_clock_register(struct posix_clock *clk, dev_t devid);
  */
 void posix_clock_unregister(struct posix_clock *clk);
 
+/**
+ * posix_clock_get() - take a reference to a clock
+ * @clk: Clock instance previously registered via posix_clock_register()
+ *
+ * For in-kernel users. The reference keeps the posix_clock from being
+ * deallocated, but it may still become a zombie. Callers must check
+ * 'zombie' while holding 'rwsem' for reading before using the clock.
+ */
+void posix_clock_get(struct posix_clock *clk);
+
+/**
+ * posix_clock_put() - drop a reference taken with posix_clock_get()
+ * @clk: Clock instance
+ */
+void posix_clock_put(struct posix_clock *clk);
+
 #endif
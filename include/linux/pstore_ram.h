@@ -27,6 +27,13 @@
  * getting wiped after its contents get copied out after boot.
  */
 #define PRZ_FLAG_ZAP_OLD	BIT(1)
+/*
+ * Reserve room in the zone with cmpxchg on copies of "start" and "size" in
+ * normal memory, so that writers never wait for each other. Exclusive
+ * accesses are not reliable on the uncached buffer itself. Not for zones
+ * with ECC.
+ */
+#define PRZ_FLAG_LOCKLESS	BIT(2)
 
 struct persistent_ram_buffer;
 struct rs_control;
@@ -51,6 +58,10 @@ struct persistent_ram_ecc_info {
  *
  * @buffer_lock:
  *	locks access to @buffer "size" bytes and "start" offset
+ * @start:
+ *	copy of @buffer "start" offset for PRZ_FLAG_LOCKLESS
+ * @used:
+ *	copy of @buffer "size" bytes for PRZ_FLAG_LOCKLESS
  * @buffer:
  *	pointer to actual RAM area managed by this PRZ
  * @buffer_size:
@@ -75,6 +86,8 @@ struct persistent_ram_ecc_info {
  * @old_log_size:
  *	bytes contained in @old_log
  *
+ * @premapped:
+ *	@vaddr belongs to the caller of persistent_ram_new_mapped()
  */
 struct persistent_ram_zone {
 	phys_addr_t paddr;
@@ -85,6 +98,8 @@ struct persistent_ram_zone {
 	u32 flags;
 
 	raw_spinlock_t buffer_lock;
+	atomic_t start;
+	atomic_t used;
 	struct persistent_ram_buffer *buffer;
 	size_t buffer_size;
 
@@ -97,11 +112,17 @@ struct persistent_ram_zone {
 
 	char *old_log;
 	size_t old_log_size;
+
+	bool premapped;
 };
 
 struct persistent_ram_zone *persistent_ram_new(phys_addr_t start, size_t size,
 			u32 sig, struct persistent_ram_ecc_info *ecc_info,
 			unsigned int memtype, u32 flags, char *label);
+struct persistent_ram_zone *persistent_ram_new_mapped(void *vaddr,
+			phys_addr_t start, size_t size, u32 sig,
+			struct persistent_ram_ecc_info *ecc_info,
+			u32 flags, char *label);
 void persistent_ram_free(struct persistent_ram_zone *prz);
 void persistent_ram_zap(struct persistent_ram_zone *prz);
 
@@ -121,13 +142,18 @@ ssize_t persistent_ram_ecc_string(struct persistent_ram_zone *prz,
  * Ramoops platform data
  * @mem_size	memory size for ramoops
  * @mem_address	physical memory address to contain ramoops
+ * @mem_vaddr	kernel mapping of @mem_address if the memory is already
+ *		mapped (SRAM), NULL otherwise
  */
 
 #define RAMOOPS_FLAG_FTRACE_PER_CPU	BIT(0)
+/* Lock-free console and pmsg zones (ignored with ECC) */
+#define RAMOOPS_FLAG_LOCKLESS		BIT(1)
 
 struct ramoops_platform_data {
 	unsigned long	mem_size;
 	phys_addr_t	mem_address;
+	void		*mem_vaddr;
 	unsigned int	mem_type;
 	unsigned long	record_size;
 	unsigned long	console_size;
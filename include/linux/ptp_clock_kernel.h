@@ -243,6 +243,36 @@ int ptp_find_pin(struct ptp_clock *ptp,
 
 int ptp_schedule_worker(struct ptp_clock *ptp, unsigned long delay);
 
+/**
+ * ptp_clock_get_by_index() - look up a PTP clock for in-kernel use
+ *
+ * @index:  index of the clock, as in /dev/ptp<index>
+ *
+ * The clock must be released with ptp_clock_put(). It stays valid after the
+ * driver unregisters it, but ptp_clock_read() then fails.
+ */
+
+extern struct ptp_clock *ptp_clock_get_by_index(int index);
+
+/**
+ * ptp_clock_put() - release a clock from ptp_clock_get_by_index()
+ *
+ * @ptp:  The clock obtained from ptp_clock_get_by_index().
+ */
+
+extern void ptp_clock_put(struct ptp_clock *ptp);
+
+/**
+ * ptp_clock_read() - read the time of a PTP clock
+ *
+ * @ptp:  The clock obtained from ptp_clock_get_by_index().
+ * @ts:   Holds the time on return.
+ *
+ * May sleep. Returns -ENODEV once the driver has unregistered the clock.
+ */
+
+extern int ptp_clock_read(struct ptp_clock *ptp, struct timespec64 *ts);
+
 #else
 static inline struct ptp_clock *ptp_clock_register(struct ptp_clock_info *info,
 						   struct device *parent)
@@ -260,6 +290,12 @@ static inline int ptp_find_pin(struct ptp_clock *ptp,
 static inline int ptp_schedule_worker(struct ptp_clock *ptp,
 				      unsigned long delay)
 { return -EOPNOTSUPP; }
+static inline struct ptp_clock *ptp_clock_get_by_index(int index)
+{ return ERR_PTR(-ENODEV); }
+static inline void ptp_clock_put(struct ptp_clock *ptp)
+{ }
+static inline int ptp_clock_read(struct ptp_clock *ptp, struct timespec64 *ts)
+{ return -ENODEV; }
 
 #endif
 
@@ -0,0 +1,59 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * pwm-xlnx driver
+ *
+ * Copyright (C) 2019 Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _LINUX_PWM_XLNX_H
+#define _LINUX_PWM_XLNX_H
+
+#include <linux/pwm.h>
+#include <linux/types.h>
+
+/*
+ * Fast path
+ *
+ * For consumers that update the period at a high rate (e.g., the ramp
+ * engine of a stepper motor). Convert the periods to timer load register
+ * values up front with 'xlnx_pwm_ns_to_tlr'. Then 'xlnx_pwm_write_tlr'
+ * simply writes said values. It doesn't sleep, doesn't divide, and doesn't
+ * go through 'pwm_apply_state'. Don't mix it with 'pwm_apply_state' on the
+ * same PWM device.
+ */
+struct xlnx_pwm_tlr {
+	u32 duty;
+	u32 period;
+};
+
+#if IS_REACHABLE(CONFIG_PWM_XLNX)
+bool xlnx_pwm_is_xlnx(struct pwm_device *pwm);
+void xlnx_pwm_ns_to_tlr(struct pwm_device *pwm, unsigned int duty_ns,
+                        unsigned int period_ns, struct xlnx_pwm_tlr *tlr);
+unsigned int xlnx_pwm_tlr_to_period_ns(struct pwm_device *pwm,
+                                       const struct xlnx_pwm_tlr *tlr);
+void xlnx_pwm_write_tlr(struct pwm_device *pwm, const struct xlnx_pwm_tlr *tlr,
+                        bool enabled);
+#else
+static inline bool xlnx_pwm_is_xlnx(struct pwm_device *pwm)
+{
+	return false;
+}
+static inline void xlnx_pwm_ns_to_tlr(struct pwm_device *pwm,
+                                      unsigned int duty_ns,
+                                      unsigned int period_ns,
+                                      struct xlnx_pwm_tlr *tlr)
+{
+}
+static inline unsigned int xlnx_pwm_tlr_to_period_ns(struct pwm_device *pwm,
+                                                     const struct xlnx_pwm_tlr *tlr)
+{
+	return 0;
+}
+static inline void xlnx_pwm_write_tlr(struct pwm_device *pwm,
+                                      const struct xlnx_pwm_tlr *tlr,
+                                      bool enabled)
+{
+}
+#endif
+
+#endif /* _LINUX_PWM_XLNX_H */
@@ -46,6 +46,12 @@ struct ads7846_platform_data {
 	u16	debounce_tol;		/* tolerance used for filtering */
 	u16	debounce_rep;		/* additional consecutive good readings
 					 * required after the first two */
+	u16	filter_shift;		/* if set, read each sample in one SPI
+					 * message and smooth x/y with weight
+					 * 1/2^filter_shift; replaces the
+					 * debounce filter */
+	u32	poll_period_usecs;	/* time between samples while the pen
+					 * is down, 0 for the default */
 	int	gpio_pendown;		/* the GPIO used to decide the pendown
 					 * state if get_pendown_state == NULL */
 	int	gpio_pendown_debounce;	/* platform specific debounce time for
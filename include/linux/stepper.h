@@ -11,20 +11,61 @@
 #ifndef _STEPPER_H_
 #define _STEPPER_H_
 
+#include <uapi/linux/stepper.h>
+
 struct device;
 struct attribute_group;
 
+/* Velocities in the ramp engine are in 1/STEPPER_VELOCITY_SCALE units */
+#define STEPPER_VELOCITY_SCALE 1000
+#define STEPPER_DEFAULT_UPDATE_RATE_HZ 1000
+#define STEPPER_MAX_UPDATE_RATE_HZ 10000
+/* Positions are in 1/STEPPER_POSITION_SCALE steps */
+#define STEPPER_POSITION_SCALE 1000000
+/* The move-to-position mode approaches the target at this velocity (in
+ * 1/STEPPER_VELOCITY_SCALE units) */
+#define STEPPER_POSITION_CREEP_VELOCITY STEPPER_VELOCITY_SCALE
+
+enum stepper_profile {
+	/* Constant acceleration. I.e., a trapezoidal velocity profile. */
+	STEPPER_PROFILE_TRAPEZOID = 0,
+	/* The acceleration itself ramps up and down (limited by the jerk) */
+	STEPPER_PROFILE_SCURVE,
+	STEPPER_PROFILE_SIZE,
+};
+
 struct stepper_vel_cfg {
+	/* The (maximum) acceleration: 'rate_of_change' velocity units per
+	 * 'shift_delay_ms'. The ramp engine applies it in small increments
+	 * at 'update_rate_hz' (or STEPPER_DEFAULT_UPDATE_RATE_HZ if zero). */
 	int rate_of_change;
 	int shift_delay_ms;
 	int min;
 	int max;
+	unsigned int update_rate_hz;
+	enum stepper_profile profile;
+	/* Velocity units per s^2. Only used by STEPPER_PROFILE_SCURVE. Zero
+	 * for no limit (same as STEPPER_PROFILE_TRAPEZOID). */
+	unsigned int jerk;
 };
 
+/*
+ * The ramp engine calls 'set_velocity' (or 'set_velocity_fine' if given),
+ * 'step_rate_mhz', and 'get_steps' from an hrtimer. I.e., in hard IRQ
+ * context. Said callbacks must not sleep.
+ */
 struct stepper_ops {
 	int (*set_velocity)(struct device *dev, int velocity);
+	/* Optional. In 1/STEPPER_VELOCITY_SCALE velocity units. */
+	int (*set_velocity_fine)(struct device *dev, int velocity_fine);
 	int (*get_abs_torque)(struct device *dev, unsigned* abs_torque);
 	int (*set_abs_torque)(struct device *dev, unsigned abs_torque);
+	/* Optional. The (unsigned) step rate in mHz at the given velocity (in
+	 * 1/STEPPER_VELOCITY_SCALE units). Enables position tracking. */
+	u32 (*step_rate_mhz)(struct device *dev, int velocity_fine);
+	/* Optional. Reads a hardware step counter. Takes precedence over
+	 * 'step_rate_mhz'. */
+	int (*get_steps)(struct device *dev, s64 *steps);
 };
 
 struct device *
@@ -37,6 +78,8 @@ devm_stepper_device_register(struct device *dev,
                              struct stepper_ops *ops,
                              struct stepper_vel_cfg *cfg);
 
+int stepper_of_get_vel_cfg(struct device *dev, struct stepper_vel_cfg *cfg);
+
 void stepper_device_unregister(struct device *dev);
 void devm_stepper_device_unregister(struct device *dev);
 
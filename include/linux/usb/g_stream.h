@@ -0,0 +1,22 @@
+/* SPDX-License-Identifier: GPL-2.0+ */
+/*
+ * g_stream.h -- Producer interface of the USB bulk streaming function
+ *
+ * In-kernel data sources feed a "stream" gadget function (as in
+ * functions/stream.<name> in configfs) through these calls.
+ */
+
+#ifndef __LINUX_USB_G_STREAM_H
+#define __LINUX_USB_G_STREAM_H
+
+#include <linux/types.h>
+
+struct usb_stream;
+
+struct usb_stream *usb_stream_get(const char *name);
+void usb_stream_put(struct usb_stream *stream);
+ssize_t usb_stream_write(struct usb_stream *stream, const void *buf,
+			 size_t len);
+int usb_stream_flush(struct usb_stream *stream);
+
+#endif /* __LINUX_USB_G_STREAM_H */
@@ -0,0 +1,42 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM arm_global_timer
+
+#if !defined(_TRACE_ARM_GLOBAL_TIMER_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_ARM_GLOBAL_TIMER_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One request to program the comparator of the local CPU, with the
+ * running counts of this CPU. 'skipped' if the comparator already held the
+ * same value.
+ */
+TRACE_EVENT(gt_compare_set,
+	TP_PROTO(u64 comp, bool skipped, unsigned long reprograms,
+		 unsigned long skips),
+	TP_ARGS(comp, skipped, reprograms, skips),
+
+	TP_STRUCT__entry(
+		__field(u64,		comp		)
+		__field(bool,		skipped		)
+		__field(unsigned long,	reprograms	)
+		__field(unsigned long,	skips		)
+	),
+
+	TP_fast_assign(
+		__entry->comp		= comp;
+		__entry->skipped	= skipped;
+		__entry->reprograms	= reprograms;
+		__entry->skips		= skips;
+	),
+
+	TP_printk("comp=%llu%s reprograms=%lu skips=%lu", __entry->comp,
+		  __entry->skipped ? " (skipped)" : "", __entry->reprograms,
+		  __entry->skips)
+);
+
+#endif /* _TRACE_ARM_GLOBAL_TIMER_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
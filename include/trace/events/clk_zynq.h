@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+/*
+ * Zynq clock tracepoints
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM clk_zynq
+
+#if !defined(_TRACE_CLK_ZYNQ_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_CLK_ZYNQ_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(zynq_fclk_set_rate,
+
+	TP_PROTO(const char *name, unsigned long parent_rate,
+		 unsigned int div0, unsigned int div1),
+
+	TP_ARGS(name, parent_rate, div0, div1),
+
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(unsigned long, parent_rate)
+		__field(unsigned int, div0)
+		__field(unsigned int, div1)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, name);
+		__entry->parent_rate = parent_rate;
+		__entry->div0 = div0;
+		__entry->div1 = div1;
+	),
+
+	TP_printk("%s rate=%lu parent_rate=%lu div0=%u div1=%u",
+		__get_str(name),
+		DIV_ROUND_UP(__entry->parent_rate,
+			     __entry->div0 * __entry->div1),
+		__entry->parent_rate, __entry->div0, __entry->div1)
+);
+
+#endif /* _TRACE_CLK_ZYNQ_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
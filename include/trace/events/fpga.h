@@ -0,0 +1,86 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fpga
+
+#if !defined(_TRACE_FPGA_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_FPGA_H
+
+#include <linux/fpga/fpga-mgr.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(fpga_mgr_phase,
+
+	TP_PROTO(struct fpga_manager *mgr, const char *phase, u64 duration_ns,
+		 size_t bytes),
+
+	TP_ARGS(mgr, phase, duration_ns, bytes),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&mgr->dev))
+		__string(phase, phase)
+		__field(u64, duration_ns)
+		__field(size_t, bytes)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&mgr->dev));
+		__assign_str(phase, phase);
+		__entry->duration_ns = duration_ns;
+		__entry->bytes = bytes;
+	),
+
+	TP_printk("%s %s %llu ns %zu bytes", __get_str(name),
+		  __get_str(phase), __entry->duration_ns, __entry->bytes)
+);
+
+TRACE_EVENT(fpga_mgr_step,
+
+	TP_PROTO(struct fpga_manager *mgr, const char *step, u64 duration_ns),
+
+	TP_ARGS(mgr, step, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&mgr->dev))
+		__string(step, step)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&mgr->dev));
+		__assign_str(step, step);
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("%s %s %llu ns", __get_str(name), __get_str(step),
+		  __entry->duration_ns)
+);
+
+TRACE_EVENT(fpga_mgr_load,
+
+	TP_PROTO(struct fpga_manager *mgr, size_t bytes, u64 duration_ns,
+		 int result),
+
+	TP_ARGS(mgr, bytes, duration_ns, result),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(&mgr->dev))
+		__field(size_t, bytes)
+		__field(u64, duration_ns)
+		__field(int, result)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(&mgr->dev));
+		__entry->bytes = bytes;
+		__entry->duration_ns = duration_ns;
+		__entry->result = result;
+	),
+
+	TP_printk("%s %zu bytes in %llu ns (%d)", __get_str(name),
+		  __entry->bytes, __entry->duration_ns, __entry->result)
+);
+
+#endif /* if !defined(_TRACE_FPGA_H) || defined(TRACE_HEADER_MULTI_READ) */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
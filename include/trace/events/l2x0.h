@@ -0,0 +1,55 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM l2x0
+
+#if !defined(_TRACE_L2X0_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_L2X0_H
+
+#include <linux/tracepoint.h>
+
+#define show_l2x0_event(config)						\
+	__print_symbolic(config,					\
+		{ 0x1, "co" },						\
+		{ 0x2, "drhit" },					\
+		{ 0x3, "drreq" },					\
+		{ 0x4, "dwhit" },					\
+		{ 0x5, "dwreq" },					\
+		{ 0x6, "dwtreq" },					\
+		{ 0x7, "irhit" },					\
+		{ 0x8, "irreq" },					\
+		{ 0x9, "wa" },						\
+		{ 0xa, "ipfalloc" },					\
+		{ 0xb, "epfhit" },					\
+		{ 0xc, "epfalloc" },					\
+		{ 0xd, "srrcvd" },					\
+		{ 0xe, "srconf" },					\
+		{ 0xf, "epfrcvd" })
+
+/*
+ * The events counted by one L2 counter since the previous poll of the PMU
+ * hrtimer. See the "sample_us" parameter of cache-l2x0-pmu.c.
+ */
+TRACE_EVENT(l2x0_pmu_sample,
+	TP_PROTO(int idx, u32 config, u64 delta),
+	TP_ARGS(idx, config, delta),
+
+	TP_STRUCT__entry(
+		__field(int,	idx	)
+		__field(u32,	config	)
+		__field(u64,	delta	)
+	),
+
+	TP_fast_assign(
+		__entry->idx	= idx;
+		__entry->config	= config;
+		__entry->delta	= delta;
+	),
+
+	TP_printk("counter%d %s %llu", __entry->idx,
+		  show_l2x0_event(__entry->config), __entry->delta)
+);
+
+#endif /* _TRACE_L2X0_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
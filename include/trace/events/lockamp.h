@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM lockamp
+
+#if !defined(_TRACE_LOCKAMP_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_LOCKAMP_H
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+#include <uapi/linux/sbt_lockamp.h>
+
+TRACE_EVENT(lockamp_drain_start,
+
+	TP_PROTO(struct device *dev),
+
+	TP_ARGS(dev),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+	),
+
+	TP_printk("%s", __get_str(name))
+);
+
+TRACE_EVENT(lockamp_drain_end,
+
+	TP_PROTO(struct device *dev, size_t size_n, u64 duration_ns),
+
+	TP_ARGS(dev, size_n, duration_ns),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(size_t, size_n)
+		__field(u64, duration_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->size_n = size_n;
+		__entry->duration_ns = duration_ns;
+	),
+
+	TP_printk("%s samples=%zu duration_ns=%llu", __get_str(name),
+		__entry->size_n, __entry->duration_ns)
+);
+
+TRACE_EVENT(lockamp_drain_wakeup,
+
+	TP_PROTO(struct device *dev, u64 latency_ns),
+
+	TP_ARGS(dev, latency_ns),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(u64, latency_ns)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->latency_ns = latency_ns;
+	),
+
+	TP_printk("%s latency_ns=%llu", __get_str(name), __entry->latency_ns)
+);
+
+TRACE_EVENT(lockamp_drain_sleep,
+
+	TP_PROTO(struct device *dev, unsigned long lower_us,
+		 unsigned long upper_us),
+
+	TP_ARGS(dev, lower_us, upper_us),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(unsigned long, lower_us)
+		__field(unsigned long, upper_us)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->lower_us = lower_us;
+		__entry->upper_us = upper_us;
+	),
+
+	TP_printk("%s lower_us=%lu upper_us=%lu", __get_str(name),
+		__entry->lower_us, __entry->upper_us)
+);
+
+TRACE_EVENT(lockamp_fifo_fill,
+
+	TP_PROTO(struct device *dev, size_t fifo_n, size_t capacity_n),
+
+	TP_ARGS(dev, fifo_n, capacity_n),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(size_t, fifo_n)
+		__field(size_t, capacity_n)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->fifo_n = fifo_n;
+		__entry->capacity_n = capacity_n;
+	),
+
+	TP_printk("%s fifo=%zu/%zu", __get_str(name),
+		__entry->fifo_n, __entry->capacity_n)
+);
+
+TRACE_EVENT(lockamp_sbuf_fill,
+
+	TP_PROTO(struct device *dev, u32 head, size_t size_n),
+
+	TP_ARGS(dev, head, size_n),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(u32, head)
+		__field(size_t, size_n)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->head = head;
+		__entry->size_n = size_n;
+	),
+
+	TP_printk("%s head=%u added=%zu", __get_str(name),
+		__entry->head, __entry->size_n)
+);
+
+TRACE_EVENT(lockamp_desync,
+
+	TP_PROTO(struct device *dev, int desyncs),
+
+	TP_ARGS(dev, desyncs),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(int, desyncs)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->desyncs = desyncs;
+	),
+
+	TP_printk("%s desyncs=%d", __get_str(name), __entry->desyncs)
+);
+
+TRACE_EVENT(lockamp_reader_pop,
+
+	TP_PROTO(struct device *dev, u32 tail, size_t size_n),
+
+	TP_ARGS(dev, tail, size_n),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(u32, tail)
+		__field(size_t, size_n)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->tail = tail;
+		__entry->size_n = size_n;
+	),
+
+	TP_printk("%s tail=%u samples=%zu", __get_str(name),
+		__entry->tail, __entry->size_n)
+);
+
+TRACE_EVENT(lockamp_reader_overrun,
+
+	TP_PROTO(struct device *dev, u32 tail, u32 lost_n),
+
+	TP_ARGS(dev, tail, lost_n),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(u32, tail)
+		__field(u32, lost_n)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->tail = tail;
+		__entry->lost_n = lost_n;
+	),
+
+	TP_printk("%s tail=%u lost=%u", __get_str(name),
+		__entry->tail, __entry->lost_n)
+);
+
+/*
+ * Writable for BPF programs (see 'struct lockamp_filter_block'). The block
+ * must be the first argument.
+ */
+DECLARE_EVENT_CLASS(lockamp_filter_block,
+
+	TP_PROTO(struct lockamp_filter_block *block, struct device *dev),
+
+	TP_ARGS(block, dev),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(u32, count)
+		__field(u32, size_n)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->count = block->count;
+		__entry->size_n = block->size_n;
+	),
+
+	TP_printk("%s count=%u samples=%u", __get_str(name),
+		__entry->count, __entry->size_n)
+);
+
+#ifdef DEFINE_EVENT_WRITABLE
+#undef LOCKAMP_DEFINE_EVENT
+#define LOCKAMP_DEFINE_EVENT(template, call, proto, args, size)	\
+	DEFINE_EVENT_WRITABLE(template, call, PARAMS(proto),		\
+			      PARAMS(args), size)
+#else
+#undef LOCKAMP_DEFINE_EVENT
+#define LOCKAMP_DEFINE_EVENT(template, call, proto, args, size)	\
+	DEFINE_EVENT(template, call, PARAMS(proto), PARAMS(args))
+#endif
+
+LOCKAMP_DEFINE_EVENT(lockamp_filter_block, lockamp_filter_block,
+
+	TP_PROTO(struct lockamp_filter_block *block, struct device *dev),
+
+	TP_ARGS(block, dev),
+
+	sizeof(struct lockamp_filter_block)
+);
+
+#endif /* _TRACE_LOCKAMP_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM ubi
+
+#if !defined(_TRACE_UBI_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _TRACE_UBI_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * One event per attach phase ("fastmap", "scan", "vtbl", "wl", "eba") with
+ * its duration.
+ */
+TRACE_EVENT(ubi_attach_phase,
+	TP_PROTO(int ubi_num, const char *phase, s64 duration_ns),
+	TP_ARGS(ubi_num, phase, duration_ns),
+
+	TP_STRUCT__entry(
+		__field(int,		ubi_num		)
+		__string(phase,		phase		)
+		__field(s64,		duration_ns	)
+	),
+
+	TP_fast_assign(
+		__entry->ubi_num	= ubi_num;
+		__assign_str(phase, phase);
+		__entry->duration_ns	= duration_ns;
+	),
+
+	TP_printk("ubi%d %s %lld ns", __entry->ubi_num, __get_str(phase),
+		  __entry->duration_ns)
+);
+
+/* The result of scanning one PEB during a fastmap or full scan */
+TRACE_EVENT(ubi_scan_peb,
+	TP_PROTO(int ubi_num, int pnum, int err),
+	TP_ARGS(ubi_num, pnum, err),
+
+	TP_STRUCT__entry(
+		__field(int,	ubi_num	)
+		__field(int,	pnum	)
+		__field(int,	err	)
+	),
+
+	TP_fast_assign(
+		__entry->ubi_num	= ubi_num;
+		__entry->pnum		= pnum;
+		__entry->err		= err;
+	),
+
+	TP_printk("ubi%d PEB %d err %d", __entry->ubi_num, __entry->pnum,
+		  __entry->err)
+);
+
+#endif /* _TRACE_UBI_H */
+
+/* This part must be outside protection */
+#include <trace/define_trace.h>
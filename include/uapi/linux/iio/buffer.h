@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/* The industrial I/O - block based buffer access */
+#ifndef _UAPI_IIO_BUFFER_H_
+#define _UAPI_IIO_BUFFER_H_
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/**
+ * struct iio_buffer_block_alloc_req - Descriptor for allocating IIO buffer
+ *   blocks
+ * @type:	Reserved, must be 0
+ * @size:	Size of each block in bytes
+ * @count:	Number of blocks to allocate. Set to the number of blocks that
+ *		were actually allocated on return.
+ * @id:		Reserved, must be 0
+ */
+struct iio_buffer_block_alloc_req {
+	__u32 type;
+	__u32 size;
+	__u32 count;
+	__u32 id;
+};
+
+/**
+ * struct iio_buffer_block - Descriptor for a IIO buffer block
+ * @id:		Identifier of the block
+ * @size:	Total size of the block in bytes
+ * @bytes_used:	Number of bytes that contain valid data
+ * @type:	Reserved, must be 0
+ * @flags:	Reserved, must be 0
+ * @data.offset: Offset to pass to mmap() to map the block
+ * @timestamp:	Reserved, must be 0
+ */
+struct iio_buffer_block {
+	__u32 id;
+	__u32 size;
+	__u32 bytes_used;
+	__u32 type;
+	__u32 flags;
+	union {
+		__u32 offset;
+	} data;
+	__u64 timestamp;
+};
+
+/*
+ * While blocks are allocated with IIO_BUFFER_BLOCK_ALLOC_IOCTL the buffer is
+ * only accessible through mmap() and the ioctls below. read() fails with
+ * -EBUSY until the blocks are freed again.
+ */
+#define IIO_BUFFER_BLOCK_ALLOC_IOCTL	_IOWR('i', 0xa0, struct iio_buffer_block_alloc_req)
+#define IIO_BUFFER_BLOCK_FREE_IOCTL	_IO('i', 0xa1)
+#define IIO_BUFFER_BLOCK_QUERY_IOCTL	_IOWR('i', 0xa2, struct iio_buffer_block)
+#define IIO_BUFFER_BLOCK_ENQUEUE_IOCTL	_IOWR('i', 0xa3, struct iio_buffer_block)
+#define IIO_BUFFER_BLOCK_DEQUEUE_IOCTL	_IOWR('i', 0xa4, struct iio_buffer_block)
+
+#endif /* _UAPI_IIO_BUFFER_H_ */
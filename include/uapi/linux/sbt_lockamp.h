@@ -0,0 +1,329 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later WITH Linux-syscall-note */
+/*
+ * SBT Instruments Lock-in Amplifier
+ *
+ * Copyright (c) 2019, Frederik Peter Aalund <fpa@sbtinstruments.com>
+ */
+#ifndef _UAPI_LINUX_SBT_LOCKAMP_H
+#define _UAPI_LINUX_SBT_LOCKAMP_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Memory map layout of the character device
+ *
+ * The signal buffer can be mapped directly into the reader so that samples
+ * are consumed in place (without the copy done by read()). There are two
+ * separate mappings, selected by the page offset given to mmap():
+ *
+ *   Page offset LOCKAMP_MMAP_CTRL_PGOFF:
+ *     A single page with a 'struct lockamp_mmap_ctrl'. Map it read-write.
+ *   Page offset LOCKAMP_MMAP_DATA_PGOFF:
+ *     The signal buffer itself ('capacity_n' samples). Map it read-only.
+ *
+ * The kernel produces samples at 'head'. The reader consumes samples at
+ * 'tail' and advances 'tail' when it is done with them. 'head', 'tail',
+ * 'start_tail' and 'write_end' are free-running sample counts (they wrap at
+ * 2^32). The buffer index of a count is the count modulo 'capacity_n' (a
+ * power of 2).
+ *
+ * The kernel never waits for the reader. Instead, it overwrites the oldest
+ * samples. Only the samples in [write_end - capacity_n; head) are valid.
+ * Check 'write_end' again after you processed a range of samples to see if
+ * the range was overwritten in the meantime. If the kernel finds that the
+ * reader was overrun, it skips ahead. In that case, 'start_tail' is ahead of
+ * 'tail' and the samples in between are lost.
+ *
+ * Only a single file can map the control page at a time. Once a file has
+ * mapped the control page, read() is no longer allowed on said file.
+ */
+#define LOCKAMP_MMAP_CTRL_PGOFF 0
+#define LOCKAMP_MMAP_DATA_PGOFF 1
+
+struct lockamp_mmap_ctrl {
+	/* Written by the kernel. Load with acquire semantics. */
+	__u32 head;
+	/* Written by the reader. Store with release semantics. */
+	__u32 tail;
+	__u32 capacity_n;
+	__u32 sample_size;
+	/* Odd while the kernel updates the fields below. Retry the read if
+	 * 'seq' is odd or changed during the read. */
+	__u32 seq;
+	__u32 desyncs;
+	__u64 time_step_ns;
+	/* Time (ns since the epoch) of the sample at count 'start_tail' */
+	__u64 last_start_time_ns;
+	__u32 start_tail;
+	/* Written by the kernel. The kernel may write samples up to here. */
+	__u32 write_end;
+	/* Written by the kernel. See LOCKAMP_IOC_SET_CONFIG. Load 'config_seq'
+	 * with acquire semantics before 'config_count'. */
+	__u32 config_seq;
+	__u32 config_count;
+};
+
+/*
+ * ADC snapshots
+ *
+ * The "adc_snapshot" sysfs attribute (of the device) can be mapped
+ * read-only. It starts with a 'struct lockamp_adc_snapshot_ctrl' followed
+ * by two snapshot buffers at LOCKAMP_ADC_SNAPSHOT_DATA_OFFSET. Each buffer
+ * holds the raw ADC samples (s32 each) of a single capture.
+ *
+ * To read the latest snapshot: Load 'seq' (with acquire semantics), load
+ * 'index' and 'time_ns', and copy buffer 'index'. Then load 'seq' again.
+ * If it changed, the kernel may have written to the buffer in the meantime.
+ * Retry in that case.
+ */
+#define LOCKAMP_ADC_SNAPSHOT_DATA_OFFSET 4096
+
+struct lockamp_adc_snapshot_ctrl {
+	/* Incremented after each capture */
+	__u32 seq;
+	/* The buffer (0 or 1) with the latest capture */
+	__u32 index;
+	/* CLOCK_MONOTONIC at the start of the latest capture */
+	__u64 time_ns;
+};
+
+/*
+ * Measurement configuration
+ *
+ * LOCKAMP_IOC_SET_CONFIG applies a complete configuration in one pass and
+ * resets the moving average filter once. The kernel then fills in
+ * 'start_count': The free-running count of the first sample that is
+ * produced with the new configuration. 'seq' is incremented for each
+ * configuration. The same two values are also published in the mmap
+ * control page ('config_seq' and 'config_count').
+ *
+ * read() never returns a chunk that spans 'start_count'. Thus, a chunk is
+ * either entirely from before or entirely from after the change.
+ *
+ * LOCKAMP_IOC_GET_CONFIG returns the current configuration (read back from
+ * the device) along with the 'start_count' and 'seq' of the latest change.
+ */
+struct lockamp_gen_config {
+	__u32 scale;
+	__u32 step_int;
+	__u32 step_frac;
+	__u32 lock_phase;
+};
+
+struct lockamp_config {
+	struct lockamp_gen_config gen[2];
+	__u32 ma_length;
+	__u32 ma_scale;
+	__u32 cic_length;
+	__u32 cic_scale;
+	/* 1, 2, 4, 8, or 16 */
+	__u32 decimation;
+	/* Written by the kernel */
+	__u32 start_count;
+	__u32 seq;
+	__u32 reserved;
+};
+
+/*
+ * Status snapshot
+ *
+ * The "status" sysfs attribute holds a 'struct lockamp_status': The current
+ * configuration (as LOCKAMP_IOC_GET_CONFIG returns it), the derived timing,
+ * and the producer statistics. A single read() gets all of it. The kernel
+ * serves it from the register cache, so the read neither touches nor powers
+ * up the device.
+ *
+ * 'size' is the size of the struct in bytes. Later versions only append
+ * fields (and increment 'version').
+ */
+#define LOCKAMP_STATUS_VERSION 1
+
+struct lockamp_status {
+	__u32 version;
+	__u32 size;
+	struct lockamp_config config;
+	__u32 fir_cycles;
+	__u32 time_step_ns;
+	__u64 time_step_fs;
+	__u32 ma_time_step_ns;
+	__u32 fifo_read_duration_us;
+	__u32 fifo_read_delay_us;
+	/* Event counters. See the "stats" file in debugfs. */
+	__u32 fifo_high;
+	__u32 fifo_overruns;
+	__u32 overruns;
+	__u32 invalid_mmap_tails;
+	__u32 dma_errors;
+	__u32 desyncs;
+	__u32 reserved;
+	__u64 fifo_lost_n;
+	__u64 lost_n;
+	__u64 wakeup_latency_ns;
+	__u64 wakeup_latency_max_ns;
+};
+
+/*
+ * Frequency sweep
+ *
+ * LOCKAMP_IOC_START_SWEEP runs through a table of generator settings. Each
+ * step lasts for 'dwell_n' samples. The kernel advances the sweep as it
+ * moves samples into the signal buffer. Thus, it does so on sample counts
+ * and not on (user space) time.
+ *
+ * Each step transition is a configuration change just like
+ * LOCKAMP_IOC_SET_CONFIG. I.e., it increments 'config_seq' and sets
+ * 'config_count' to the first sample of the step, and read() splits
+ * chunks at the transition. The kernel writes the 'config_seq' of the
+ * first step into 'seq'. Step i then has the sequence number 'seq' + i
+ * (until the sweep loops around).
+ *
+ * Note that the moving average filter is not reset between steps.
+ *
+ * The sweep stops after the last step (unless LOCKAMP_SWEEP_LOOP is given),
+ * on LOCKAMP_IOC_STOP_SWEEP, or when the file that started it is closed.
+ */
+#define LOCKAMP_SWEEP_MAX_STEPS 4096
+
+/* Start over after the last step */
+#define LOCKAMP_SWEEP_LOOP (1 << 0)
+
+struct lockamp_sweep_step {
+	__u32 step_int;
+	__u32 step_frac;
+	__u32 scale;
+	__u32 dwell_n;
+};
+
+struct lockamp_sweep {
+	/* User space pointer to 'step_count' 'struct lockamp_sweep_step's */
+	__u64 steps;
+	__u32 step_count;
+	/* The generator to sweep (0 or 1) */
+	__u32 gen;
+	__u32 flags;
+	/* Written by the kernel */
+	__u32 seq;
+};
+
+/*
+ * Monitor device
+ *
+ * Each lock-in amplifier also has a "<name>_monitor" character device for
+ * low-rate readers (e.g., live displays). Its read() returns whole
+ * 'struct lockamp_monitor_sample's. Each is the mean of 'size_n'
+ * consecutive samples of the signal buffer, starting at the free-running
+ * count 'count'. The "rate_hz" sysfs attribute of the monitor device sets
+ * the target rate (100 by default). A mean never spans a configuration
+ * change (see LOCKAMP_IOC_SET_CONFIG), so it may be over fewer samples.
+ *
+ * 'time_ns' is the time (ns since the epoch) of the sample at 'count'.
+ *
+ * Any number of files can read the monitor device. A reader that falls
+ * more than 1024 means behind loses the oldest ones. The next 'count' is
+ * then past 'count' + 'size_n' of the previous mean.
+ */
+struct lockamp_monitor_sample {
+	__u64 time_ns;
+	__u32 count;
+	__u32 size_n;
+	/* In the order of the entries of a sample */
+	__s32 entries[8];
+};
+
+/*
+ * Capture device
+ *
+ * Each lock-in amplifier also has a "<name>_capture" character device that
+ * only delivers the samples around trigger events. A window holds "pre_n"
+ * samples before the trigger sample and "post_n" samples from it on. Both
+ * are sysfs attributes of the capture device. The "trigger_source"
+ * attribute selects what triggers a window:
+ *
+ *   software: Nothing but writes to the "trigger" attribute
+ *   gpio:     The rising edge of the "trigger" GPIO (if the device tree
+ *             gives one)
+ *   level:    Entry "level_entry" of a sample crosses "level" in the
+ *             direction of "level_edge" (rising, falling, or both)
+ *   config:   The first sample of each configuration (e.g., each step of a
+ *             sweep)
+ *
+ * A write to "trigger" triggers a window regardless of the source.
+ * A trigger during a window is dropped and counted in 'missed' of the next
+ * window. So are the triggers that are too old by the time we see them.
+ *
+ * read() returns whole windows. Each is a 'struct lockamp_capture_header'
+ * followed by 'size_n' samples (like the signal buffer samples). 'size_n'
+ * is below "pre_n" + "post_n" if the signal buffer no longer held all of
+ * the pre-trigger samples. The buffer given to read() must fit a full
+ * window.
+ *
+ * 'time_ns' is the time (ns since the epoch) of the trigger sample at
+ * 'trigger_count'. 'seq' counts the windows. A reader that falls too far
+ * behind loses the oldest windows, which shows as a jump in 'seq'.
+ *
+ * "pre_n" and "post_n" can only change while no capture file is open.
+ */
+enum lockamp_capture_source {
+	LOCKAMP_CAPTURE_SOFTWARE = 0,
+	LOCKAMP_CAPTURE_GPIO = 1,
+	LOCKAMP_CAPTURE_LEVEL = 2,
+	LOCKAMP_CAPTURE_CONFIG = 3,
+};
+
+struct lockamp_capture_header {
+	__u64 time_ns;
+	__u32 seq;
+	__u32 trigger_count;
+	/* Count of the first sample */
+	__u32 count;
+	__u32 size_n;
+	/* trigger_count - count */
+	__u32 pre_n;
+	/* See 'enum lockamp_capture_source' */
+	__u32 source;
+	__u32 missed;
+	__u32 reserved;
+};
+
+/*
+ * Filter programs
+ *
+ * The producer hands the new samples to the "lockamp_filter_block"
+ * tracepoint before it publishes them. The tracepoint is writable, so a
+ * BPF_PROG_TYPE_RAW_TRACEPOINT_WRITABLE program can both look at a block
+ * and set LOCKAMP_FILTER_DROP in its 'flags'. The first argument of the
+ * program is a 'struct lockamp_filter_block'. A block holds at most
+ * LOCKAMP_FILTER_BLOCK_N samples, contiguous in the signal buffer at the
+ * kernel address 'samples' (read them with bpf_probe_read). Events go to
+ * user space through bpf_perf_event_output.
+ *
+ * read() and splice() skip the dropped blocks. The chunk after a skip has
+ * LOCKAMP_CHUNK_FILTERED (bit 2) set in the flags of its sequence header.
+ * The sequence number skips the dropped samples, but 'dropped_n' does not
+ * count them (they are not lost). mmap, the IIO frontend, and the monitor
+ * and capture devices still see all samples.
+ *
+ * Without a program, the tracepoint costs a static branch per drain.
+ */
+#define LOCKAMP_FILTER_BLOCK_N 256
+#define LOCKAMP_FILTER_DROP    (1 << 0)
+
+struct lockamp_filter_block {
+	__u64 samples;
+	/* Count of the first sample */
+	__u32 count;
+	__u32 size_n;
+	/* Minor number of the lock-in amplifier */
+	__u32 id;
+	/* Set by the program. See LOCKAMP_FILTER_DROP. */
+	__u32 flags;
+};
+
+#define LOCKAMP_IOC_MAGIC       0xB4
+#define LOCKAMP_IOC_SET_CONFIG  _IOWR(LOCKAMP_IOC_MAGIC, 0, struct lockamp_config)
+#define LOCKAMP_IOC_GET_CONFIG  _IOR(LOCKAMP_IOC_MAGIC, 1, struct lockamp_config)
+#define LOCKAMP_IOC_START_SWEEP _IOWR(LOCKAMP_IOC_MAGIC, 2, struct lockamp_sweep)
+#define LOCKAMP_IOC_STOP_SWEEP  _IO(LOCKAMP_IOC_MAGIC, 3)
+
+#endif /* _UAPI_LINUX_SBT_LOCKAMP_H */
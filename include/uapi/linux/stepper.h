@@ -0,0 +1,76 @@
+/* SPDX-License-Identifier: GPL-2.0-or-later WITH Linux-syscall-note */
+/*
+    stepper.h - User space interface of the stepper motor drivers
+
+    Copyright (C) 2019 Frederik Peter Aalund <fpa@sbtinstruments.com>
+*/
+#ifndef _UAPI_LINUX_STEPPER_H
+#define _UAPI_LINUX_STEPPER_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+/*
+ * Command queue
+ *
+ * Each stepper device has a character device (/dev/<name>).
+ * STEPPER_IOC_QUEUE hands a batch of timed commands to the kernel. The
+ * kernel executes them on its own (from a kernel thread). I.e., without
+ * further system calls.
+ *
+ * Each command runs at 'start_ns' + 'offset_ns'. The offsets must be in
+ * non-decreasing order. A command may change the velocity (ramped as
+ * with the "velocity_target" attribute or instantly as with
+ * "velocity_target_instant"), the torque (as with "abs_torque"), or both.
+ *
+ * A batch replaces the current batch (if any). The batch stops after the
+ * last command, on STEPPER_IOC_CANCEL, or when the file that queued it is
+ * closed. The velocity stays at whatever the last executed command set.
+ *
+ * STEPPER_IOC_STATUS returns the progress of the current (or latest)
+ * batch.
+ */
+#define STEPPER_QUEUE_MAX_CMDS 4096
+
+/* Set the target velocity (ramped) */
+#define STEPPER_CMD_VELOCITY         (1 << 0)
+/* Set the velocity instantly. Implies STEPPER_CMD_VELOCITY. */
+#define STEPPER_CMD_VELOCITY_INSTANT (1 << 1)
+/* Set the absolute torque */
+#define STEPPER_CMD_TORQUE           (1 << 2)
+
+struct stepper_cmd {
+	/* Relative to the start of the batch */
+	__u64 offset_ns;
+	__s32 velocity;
+	/* 0 to 100 */
+	__u32 abs_torque;
+	__u32 flags;
+	__u32 reserved;
+};
+
+struct stepper_batch {
+	/* User space pointer to 'count' 'struct stepper_cmd's */
+	__u64 cmds;
+	__u32 count;
+	__u32 flags;
+	/* CLOCK_MONOTONIC. Zero for "now". The kernel writes the actual start
+	 * time. */
+	__u64 start_ns;
+};
+
+struct stepper_queue_status {
+	/* Commands of the current batch that are yet to run */
+	__u32 pending;
+	__u32 executed;
+	/* The first error of the batch (a negative errno) or zero */
+	__s32 error;
+	__u32 reserved;
+};
+
+#define STEPPER_IOC_MAGIC  0xB5
+#define STEPPER_IOC_QUEUE  _IOWR(STEPPER_IOC_MAGIC, 0, struct stepper_batch)
+#define STEPPER_IOC_CANCEL _IO(STEPPER_IOC_MAGIC, 1)
+#define STEPPER_IOC_STATUS _IOR(STEPPER_IOC_MAGIC, 2, struct stepper_queue_status)
+
+#endif /* _UAPI_LINUX_STEPPER_H */
@@ -62,4 +62,32 @@ struct uio_dmabuf_args {
  */
 #define	UIO_IOC_UNMAP_DMABUF	_IOWR(UIO_IOC_BASE, 0x2, struct uio_dmabuf_args)
 
+#define UIO_DMABUF_SYNC_FOR_CPU		(1 << 0)
+#define UIO_DMABUF_SYNC_FOR_DEV		(1 << 1)
+#define UIO_DMABUF_SYNC_VALID_FLAGS	(UIO_DMABUF_SYNC_FOR_CPU | \
+					 UIO_DMABUF_SYNC_FOR_DEV)
+
+/**
+ * struct uio_dmabuf_sync_args - arguments from userspace to sync a dmabuf
+ * @dbuf_fd: The fd of a dma buf mapped with UIO_IOC_MAP_DMABUF
+ * @flags: UIO_DMABUF_SYNC_FOR_CPU and / or UIO_DMABUF_SYNC_FOR_DEV
+ */
+struct uio_dmabuf_sync_args {
+	__s32	dbuf_fd;
+	__u32	flags;
+};
+
+/**
+ * DOC: UIO_IOC_SYNC_DMABUF - Sync the caches for a mapped dma buf
+ *
+ * This takes uio_dmabuf_sync_args, and does the cache maintenance to give
+ * the mapped dmabuf @dbuf_fd to the cpu or to the device, without
+ * unmapping it. Mapping a dmabuf syncs it for the device and unmapping it
+ * syncs it for the cpu. The attachment stays cached after the unmap, so a
+ * later map of the same dmabuf is only a sync.
+ * FIXME: This is experimental and may change at any time. Don't consider this
+ * as stable ABI.
+ */
+#define	UIO_IOC_SYNC_DMABUF	_IOWR(UIO_IOC_BASE, 0x3, struct uio_dmabuf_sync_args)
+
 #endif
@@ -288,6 +288,40 @@ struct usb_functionfs_event {
 #define	FUNCTIONFS_ENDPOINT_DESC	_IOR('g', 130, \
 					     struct usb_endpoint_descriptor)
 
+/**
+ * struct usb_ffs_dmabuf_transfer_req - Transfer request for a DMABUF object
+ * @fd:		file descriptor of the DMABUF object
+ * @flags:	one or more FFS_DMABUF_* flags, must be zero for now
+ * @offset:	offset of the data in the DMABUF object, in bytes
+ * @length:	number of bytes to transfer
+ */
+struct usb_ffs_dmabuf_transfer_req {
+	int fd;
+	__u32 flags;
+	__u64 offset;
+	__u64 length;
+} __attribute__((packed));
+
+/*
+ * Attaches the DMABUF object, identified by its file descriptor, to the
+ * endpoint. Only page backed DMABUFs are supported and the gadget controller
+ * has to support scatter-gather.
+ */
+#define FUNCTIONFS_DMABUF_ATTACH	_IOW('g', 131, int)
+
+/* Detaches the given DMABUF object from the endpoint. */
+#define FUNCTIONFS_DMABUF_DETACH	_IOW('g', 132, int)
+
+/*
+ * Enqueues a transfer from or to an attached DMABUF object. The call returns
+ * as soon as the transfer is queued. A fence is added to the reservation
+ * object of the DMABUF and signalled on completion, poll() the DMABUF file
+ * descriptor to wait for it. With O_NONBLOCK, returns -EBUSY instead of
+ * waiting for earlier fences of the DMABUF that conflict with the transfer.
+ */
+#define FUNCTIONFS_DMABUF_TRANSFER	_IOW('g', 133, \
+					     struct usb_ffs_dmabuf_transfer_req)
+
 
 
 #endif /* _UAPI__LINUX_FUNCTIONFS_H__ */
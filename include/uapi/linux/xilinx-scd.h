@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+/*
+ * Xilinx Scene Change Detection
+ *
+ * Results of the scene change detection of a channel, as kept by the driver
+ * for each processed frame. Analysis applications can fetch them in bulk
+ * through the channel subdev instead of waiting for one event per frame.
+ */
+
+#ifndef __UAPI_XILINX_SCD_H__
+#define __UAPI_XILINX_SCD_H__
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+#include <linux/videodev2.h>
+
+/**
+ * struct xscd_result - Scene change detection result of one frame
+ * @timestamp: CLOCK_MONOTONIC time the result was collected, in ns
+ * @sequence: Frame sequence number of the channel
+ * @sad: Sum of absolute differences to the previous frame, normalised to
+ *	 0-100 like the threshold control
+ * @scene_change: 1 if @sad was above the threshold, 0 otherwise
+ * @reserved: Must be ignored
+ */
+struct xscd_result {
+	__u64 timestamp;
+	__u32 sequence;
+	__u32 sad;
+	__u32 scene_change;
+	__u32 reserved;
+};
+
+/**
+ * struct xscd_results - Bulk read of scene change detection results
+ * @sequence: In: sequence number of the first result wanted. Out: sequence
+ *	      number of the first result returned
+ * @count: In: number of entries in @results. Out: number of results returned
+ * @lost: Out: number of wanted results the driver had already dropped
+ * @reserved: Must be zero
+ * @results: Pointer to an array of struct xscd_result
+ *
+ * Results are returned in sequence order, starting with the oldest one still
+ * held by the driver if @sequence is too old. Pass the returned @sequence plus
+ * @count to continue where the previous call stopped.
+ */
+struct xscd_results {
+	__u32 sequence;
+	__u32 count;
+	__u32 lost;
+	__u32 reserved;
+	__u64 results;
+};
+
+#define XSCD_IOCTL_GET_RESULTS \
+	_IOWR('V', BASE_VIDIOC_PRIVATE + 8, struct xscd_results)
+
+#endif /* __UAPI_XILINX_SCD_H__ */
@@ -262,6 +262,44 @@ struct xsdfec_ldpc_param_table_sizes {
 	__u32 qc_size;
 };
 
+/**
+ * struct xsdfec_batch - Batch of blocks submitted with ioctl
+ *			 XSDFEC_SUBMIT_BATCH.
+ * @din_fd: dma-buf holding the input blocks
+ * @dout_fd: dma-buf receiving the output blocks
+ * @din_offset: Offset of the first input block in the din dma-buf
+ * @dout_offset: Offset of the first output block in the dout dma-buf
+ * @din_block_size: Size of each input block in bytes
+ * @dout_block_size: Size of each output block in bytes
+ * @num_blocks: Number of blocks in the batch
+ * @eventfd: eventfd signalled when the batch completes, or -1
+ * @id: Value returned with the completion of the batch
+ */
+struct xsdfec_batch {
+	__s32 din_fd;
+	__s32 dout_fd;
+	__u32 din_offset;
+	__u32 dout_offset;
+	__u32 din_block_size;
+	__u32 dout_block_size;
+	__u32 num_blocks;
+	__s32 eventfd;
+	__u64 id;
+};
+
+/**
+ * struct xsdfec_batch_status - Completion retrieved by ioctl
+ *				XSDFEC_GET_BATCH.
+ * @id: The id of the completed batch
+ * @status: 0 on success, -ECANCELED or -EIO if the batch failed
+ * @reserved: Reserved, set to 0
+ */
+struct xsdfec_batch_status {
+	__u64 id;
+	__s32 status;
+	__u32 reserved;
+};
+
 /*
  * XSDFEC IOCTL List
  */
@@ -444,5 +482,37 @@ struct xsdfec_ldpc_param_table_sizes {
  * This can only be used when the driver is in the XSDFEC_STOPPED state
  */
 #define XSDFEC_SET_DEFAULT_CONFIG _IO(XSDFEC_MAGIC, 13)
+/**
+ * DOC: XSDFEC_SUBMIT_BATCH
+ * @Parameters
+ *
+ * @struct xsdfec_batch *
+ *	Pointer to the &struct xsdfec_batch that describes the blocks
+ *
+ * @Description
+ *
+ * ioctl that queues a batch of blocks on the DIN and DOUT DMA channels
+ *
+ * The blocks of all batches are processed in submission order. A completed
+ * batch makes poll() return POLLIN | POLLRDBAND until it is retrieved with
+ * XSDFEC_GET_BATCH.
+ *
+ * This can only be used when the driver is in the XSDFEC_STARTED state and
+ * the device tree provides the DMA channels
+ */
+#define XSDFEC_SUBMIT_BATCH _IOW(XSDFEC_MAGIC, 14, struct xsdfec_batch)
+/**
+ * DOC: XSDFEC_GET_BATCH
+ * @Parameters
+ *
+ * @struct xsdfec_batch_status *
+ *	Pointer to the &struct xsdfec_batch_status that will contain the
+ *	oldest completed batch
+ *
+ * @Description
+ *
+ * ioctl that retrieves a completed batch, fails with EAGAIN if there is none
+ */
+#define XSDFEC_GET_BATCH _IOR(XSDFEC_MAGIC, 15, struct xsdfec_batch_status)
 
 #endif /* __XILINX_SDFEC_H__ */
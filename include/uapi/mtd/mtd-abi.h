@@ -91,6 +91,25 @@ struct mtd_write_req {
 	__u8 padding[7];
 };
 
+/**
+ * struct mtd_bulk_req - data structure for a bulk read or write
+ *
+ * @start:	start address
+ * @len:	length of data buffer
+ * @usr_data:	user-provided data buffer
+ * @retlen:	number of bytes read or written (returned by the kernel)
+ *
+ * This structure supports ioctl(MEMREADBULK) and ioctl(MEMWRITEBULK). The
+ * kernel pins @usr_data and passes it to the driver in large requests
+ * instead of copying it through a small bounce buffer.
+ */
+struct mtd_bulk_req {
+	__u64 start;
+	__u64 len;
+	__u64 usr_data;
+	__u64 retlen;
+};
+
 #define MTD_ABSENT		0
 #define MTD_RAM			1
 #define MTD_ROM			2
@@ -204,6 +223,10 @@ struct otp_info {
  * without OOB, e.g., NOR flash.
  */
 #define MEMWRITE		_IOWR('M', 24, struct mtd_write_req)
+/* Read in-band data straight into pinned user pages */
+#define MEMREADBULK		_IOWR('M', 27, struct mtd_bulk_req)
+/* Write in-band data straight from pinned user pages (no erase) */
+#define MEMWRITEBULK		_IOWR('M', 28, struct mtd_bulk_req)
 
 /*
  * Obsolete legacy interface. Keep it in order not to break userspace
@@ -0,0 +1,44 @@
+/* SPDX-License-Identifier: GPL-2.0+ WITH Linux-syscall-note */
+/*
+ * This file is part of UBIFS.
+ */
+
+#ifndef __UBIFS_USER_H__
+#define __UBIFS_USER_H__
+
+#include <linux/types.h>
+
+/*
+ * Per-inode compressor
+ * ~~~~~~~~~~~~~~~~~~~~
+ *
+ * The compressor of a regular file is chosen when the file is created (the
+ * "compr=" mount option or the superblock default). The %UBIFS_IOCGCOMPR and
+ * %UBIFS_IOCSCOMPR ioctl commands read and change it. A new compressor only
+ * applies to data written afterwards; existing data nodes keep the
+ * compressor they were written with.
+ *
+ * Example:
+ * __s32 compr = UBIFS_USER_COMPR_LZ4;
+ * ioctl(fd, UBIFS_IOCSCOMPR, &compr);
+ */
+
+/* The same values as the on-flash compressor types */
+enum {
+	UBIFS_USER_COMPR_NONE,
+	UBIFS_USER_COMPR_LZO,
+	UBIFS_USER_COMPR_ZLIB,
+	UBIFS_USER_COMPR_ZSTD,
+	UBIFS_USER_COMPR_LZ4,
+	UBIFS_USER_COMPR_LZ4HC,
+};
+
+/* ioctl commands of UBIFS regular files (the numbers are unused by UBI) */
+#define UBIFS_IOC_MAGIC 'o'
+
+/* Get the compressor of an inode */
+#define UBIFS_IOCGCOMPR _IOR(UBIFS_IOC_MAGIC, 128, __s32)
+/* Set the compressor of an inode */
+#define UBIFS_IOCSCOMPR _IOW(UBIFS_IOC_MAGIC, 129, __s32)
+
+#endif /* __UBIFS_USER_H__ */
@@ -322,6 +322,42 @@ int irq_set_affinity_hint(unsigned int irq, const struct cpumask *m)
 }
 EXPORT_SYMBOL_GPL(irq_set_affinity_hint);
 
+/**
+ *	irq_set_initial_affinity - Set the affinity of an interrupt for request
+ *	@irq:	Interrupt to set affinity
+ *	@mask:	cpumask
+ *
+ *	For interrupts that are not requested yet, e.g. right after the
+ *	mapping was created from the firmware description. The mask is only
+ *	stored and irq_setup_affinity() applies it when the interrupt is
+ *	requested, like an affinity that user space set before. Returns
+ *	-EBUSY and changes nothing if the interrupt is requested already or
+ *	its affinity was set before.
+ */
+int irq_set_initial_affinity(unsigned int irq, const struct cpumask *mask)
+{
+	unsigned long flags;
+	struct irq_desc *desc = irq_get_desc_lock(irq, &flags, IRQ_GET_DESC_CHECK_GLOBAL);
+	int ret = 0;
+
+	if (!desc)
+		return -EINVAL;
+
+	if (!__irq_can_set_affinity(desc)) {
+		ret = -EINVAL;
+	} else if (desc->action ||
+		   irqd_has_set(&desc->irq_data, IRQD_AFFINITY_SET)) {
+		ret = -EBUSY;
+	} else {
+		cpumask_copy(desc->irq_common_data.affinity, mask);
+		irqd_set(&desc->irq_data, IRQD_AFFINITY_SET);
+	}
+
+	irq_put_desc_unlock(desc, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(irq_set_initial_affinity);
+
 static void irq_affinity_notify(struct work_struct *work)
 {
 	struct irq_affinity_notify *notify =
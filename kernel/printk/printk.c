@@ -44,9 +44,11 @@
 #include <linux/poll.h>
 #include <linux/irq_work.h>
 #include <linux/ctype.h>
+#include <linux/kthread.h>
 #include <linux/uio.h>
 #include <linux/sched/clock.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/rt.h>
 #include <linux/sched/task_stack.h>
 
 #include <linux/uaccess.h>
@@ -1951,6 +1953,80 @@ int vprintk_store(int facility, int level,
 			  dict, dictlen, text, text_len);
 }
 
+/*
+ * Asynchronous console output
+ *
+ * With printk.async=1, printk() only stores the message and the "printk"
+ * kthread prints it to the consoles. The caller then never waits for a
+ * slow console (a 115200 baud UART takes ~90 us per character), which
+ * matters for real-time threads and interrupt handlers. The kthread runs
+ * with SCHED_FIFO priority printk.async_prio, or SCHED_NORMAL for 0.
+ *
+ * Until the kthread is up, during an oops and once the system goes down,
+ * printk() prints synchronously as before, so that nothing gets lost.
+ */
+static bool printk_async = IS_ENABLED(CONFIG_PRINTK_ASYNC);
+module_param_named(async, printk_async, bool, 0644);
+MODULE_PARM_DESC(async, "print to the consoles from a kthread");
+
+static int printk_async_prio = CONFIG_PRINTK_ASYNC_PRIO;
+module_param_named(async_prio, printk_async_prio, int, 0444);
+MODULE_PARM_DESC(async_prio, "SCHED_FIFO priority of the printk kthread (0 = SCHED_NORMAL)");
+
+static struct task_struct *printk_kthread __read_mostly;
+static bool printk_kthread_pending;
+
+static bool printk_async_active(void)
+{
+	return READ_ONCE(printk_async) && READ_ONCE(printk_kthread) &&
+	       !oops_in_progress && system_state <= SYSTEM_RUNNING;
+}
+
+static int printk_kthread_func(void *data)
+{
+	while (!kthread_should_stop()) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (!xchg(&printk_kthread_pending, false)) {
+			schedule();
+			continue;
+		}
+		__set_current_state(TASK_RUNNING);
+
+		console_lock();
+		console_unlock();
+	}
+
+	return 0;
+}
+
+/* Called from the irq_work of defer_console_output() */
+static void printk_kthread_wake(void)
+{
+	WRITE_ONCE(printk_kthread_pending, true);
+	wake_up_process(printk_kthread);
+}
+
+static int __init printk_async_init(void)
+{
+	struct sched_param param = {
+		.sched_priority = clamp(printk_async_prio, 0, MAX_RT_PRIO - 1),
+	};
+	struct task_struct *task;
+
+	task = kthread_run(printk_kthread_func, NULL, "printk");
+	if (IS_ERR(task)) {
+		pr_err("printk: cannot start the console kthread: %ld\n",
+		       PTR_ERR(task));
+		return PTR_ERR(task);
+	}
+	if (param.sched_priority)
+		sched_setscheduler_nocheck(task, SCHED_FIFO, &param);
+
+	WRITE_ONCE(printk_kthread, task);
+	return 0;
+}
+late_initcall(printk_async_init);
+
 asmlinkage int vprintk_emit(int facility, int level,
 			    const char *dict, size_t dictlen,
 			    const char *fmt, va_list args)
@@ -1979,6 +2055,12 @@ asmlinkage int vprintk_emit(int facility, int level,
 	pending_output = (curr_log_seq != log_next_seq);
 	logbuf_unlock_irqrestore(flags);
 
+	/* Leave the consoles to the printk kthread */
+	if (!in_sched && pending_output && printk_async_active()) {
+		defer_console_output();
+		in_sched = true;
+	}
+
 	/* If called from the scheduler, we can not call up(). */
 	if (!in_sched && pending_output) {
 		/*
@@ -2950,8 +3032,10 @@ static void wake_up_klogd_work_func(struct irq_work *irq_work)
 	int pending = __this_cpu_xchg(printk_pending, 0);
 
 	if (pending & PRINTK_PENDING_OUTPUT) {
+		if (printk_async_active())
+			printk_kthread_wake();
 		/* If trylock fails, someone else is doing the printing */
-		if (console_trylock())
+		else if (console_trylock())
 			console_unlock();
 	}
 
@@ -9,14 +9,34 @@
  */
 #include "sched.h"
 
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/irqnr.h>
+
 DEFINE_STATIC_KEY_FALSE(housekeeping_overridden);
 EXPORT_SYMBOL_GPL(housekeeping_overridden);
 static cpumask_var_t housekeeping_mask;
 static unsigned int housekeeping_flags;
 
+/*
+ * Runtime isolation (see /sys/kernel/isolation/cpus below). It takes the
+ * CPUs out of the timer and misc housekeeping on top of the boot time
+ * masks. The other flags need the boot parameters.
+ */
+#define HK_RUNTIME_FLAGS	(HK_FLAG_TIMER | HK_FLAG_MISC)
+
+static bool runtime_isolation;
+static struct cpumask runtime_isolated_mask;
+static struct cpumask runtime_housekeeping_mask;
+
+static inline bool housekeeping_runtime(enum hk_flags flags)
+{
+	return (flags & HK_RUNTIME_FLAGS) && READ_ONCE(runtime_isolation);
+}
+
 bool housekeeping_enabled(enum hk_flags flags)
 {
-	return !!(housekeeping_flags & flags);
+	return !!(housekeeping_flags & flags) || housekeeping_runtime(flags);
 }
 EXPORT_SYMBOL_GPL(housekeeping_enabled);
 
@@ -25,6 +45,14 @@ int housekeeping_any_cpu(enum hk_flags flags)
 	int cpu;
 
 	if (static_branch_unlikely(&housekeeping_overridden)) {
+		if (housekeeping_runtime(flags)) {
+			cpu = smp_processor_id();
+			if (cpumask_test_cpu(cpu, &runtime_housekeeping_mask))
+				return cpu;
+
+			return cpumask_any_and(&runtime_housekeeping_mask,
+					       cpu_online_mask);
+		}
 		if (housekeeping_flags & flags) {
 			cpu = sched_numa_find_closest(housekeeping_mask, smp_processor_id());
 			if (cpu < nr_cpu_ids)
@@ -39,9 +67,12 @@ EXPORT_SYMBOL_GPL(housekeeping_any_cpu);
 
 const struct cpumask *housekeeping_cpumask(enum hk_flags flags)
 {
-	if (static_branch_unlikely(&housekeeping_overridden))
+	if (static_branch_unlikely(&housekeeping_overridden)) {
+		if (housekeeping_runtime(flags))
+			return &runtime_housekeeping_mask;
 		if (housekeeping_flags & flags)
 			return housekeeping_mask;
+	}
 	return cpu_possible_mask;
 }
 EXPORT_SYMBOL_GPL(housekeeping_cpumask);
@@ -56,9 +87,12 @@ EXPORT_SYMBOL_GPL(housekeeping_affine);
 
 bool housekeeping_test_cpu(int cpu, enum hk_flags flags)
 {
-	if (static_branch_unlikely(&housekeeping_overridden))
+	if (static_branch_unlikely(&housekeeping_overridden)) {
+		if (housekeeping_runtime(flags))
+			return cpumask_test_cpu(cpu, &runtime_housekeeping_mask);
 		if (housekeeping_flags & flags)
 			return cpumask_test_cpu(cpu, housekeeping_mask);
+	}
 	return true;
 }
 EXPORT_SYMBOL_GPL(housekeeping_test_cpu);
@@ -174,3 +208,284 @@ static int __init housekeeping_isolcpus_setup(char *str)
 	return housekeeping_setup(str, flags);
 }
 __setup("isolcpus=", housekeeping_isolcpus_setup);
+
+/*
+ * Runtime isolation
+ *
+ * Writing a CPU list to /sys/kernel/isolation/cpus moves off those CPUs:
+ *
+ *  - the unbound workqueues,
+ *  - the kthreads that may run elsewhere (kthreadd included, so new
+ *    kthreads follow),
+ *  - the interrupts that may run elsewhere, and the default affinity of
+ *    new interrupts,
+ *  - new unpinned timers (through HK_FLAG_TIMER). Timers that are queued
+ *    on the CPUs already fire there one last time.
+ *
+ * Per-CPU kthreads, pinned timers, kthreads and interrupts that were bound
+ * to the isolated CPUs only, and managed interrupts stay. Writing an empty
+ * list undoes the isolation. Whatever someone else changed in the meantime
+ * is left alone.
+ */
+struct isolation_undo {
+	/* NULL for an interrupt */
+	struct task_struct *task;
+	unsigned int irq;
+	cpumask_var_t mask;
+};
+
+static DEFINE_MUTEX(isolation_mutex);
+static struct isolation_undo *isolation_undo;
+static unsigned int isolation_undo_n;
+static cpumask_var_t isolation_irq_default;
+
+/* The affinity that an isolation gives to something with affinity @from */
+static void isolation_target(struct cpumask *to, const struct cpumask *from)
+{
+	if (!cpumask_and(to, from, &runtime_housekeeping_mask))
+		cpumask_copy(to, &runtime_housekeeping_mask);
+}
+
+static bool isolation_task_movable(struct task_struct *p)
+{
+	return (p->flags & PF_KTHREAD) && !(p->flags & PF_NO_SETAFFINITY) &&
+	       cpumask_intersects(p->cpus_ptr, &runtime_isolated_mask) &&
+	       !cpumask_subset(p->cpus_ptr, &runtime_isolated_mask);
+}
+
+static bool isolation_irq_movable(unsigned int irq)
+{
+	struct irq_data *d = irq_get_irq_data(irq);
+
+	return d && irq_can_set_affinity(irq) && !irqd_affinity_is_managed(d) &&
+	       cpumask_intersects(irq_data_get_affinity_mask(d),
+				  &runtime_isolated_mask) &&
+	       !cpumask_subset(irq_data_get_affinity_mask(d),
+			       &runtime_isolated_mask);
+}
+
+static void isolation_record(struct task_struct *task, unsigned int irq,
+			     const struct cpumask *mask, unsigned int max)
+{
+	struct isolation_undo *u = &isolation_undo[isolation_undo_n];
+
+	if (isolation_undo_n >= max || !alloc_cpumask_var(&u->mask, GFP_ATOMIC))
+		return;
+	if (task)
+		get_task_struct(task);
+	u->task = task;
+	u->irq = irq;
+	cpumask_copy(u->mask, mask);
+	isolation_undo_n++;
+}
+
+static void isolation_apply(void)
+{
+	cpumask_var_t to;
+	unsigned int i;
+	int ret;
+
+	if (!alloc_cpumask_var(&to, GFP_KERNEL))
+		return;
+
+	for (i = 0; i < isolation_undo_n; i++) {
+		struct isolation_undo *u = &isolation_undo[i];
+
+		isolation_target(to, u->mask);
+		if (u->task)
+			ret = set_cpus_allowed_ptr(u->task, to);
+		else
+			ret = irq_set_affinity(u->irq, to);
+		if (ret)
+			pr_debug("Isolation: cannot move %s %d: %d\n",
+				 u->task ? "task" : "irq",
+				 u->task ? task_pid_nr(u->task) : u->irq, ret);
+	}
+
+	free_cpumask_var(to);
+}
+
+static void isolation_restore(void)
+{
+	cpumask_var_t to;
+	unsigned int i;
+
+	if (!alloc_cpumask_var(&to, GFP_KERNEL))
+		return;
+
+	for (i = 0; i < isolation_undo_n; i++) {
+		struct isolation_undo *u = &isolation_undo[i];
+		struct irq_data *d;
+
+		/* Only undo what is still as the isolation left it */
+		isolation_target(to, u->mask);
+		if (u->task) {
+			if (cpumask_equal(u->task->cpus_ptr, to))
+				set_cpus_allowed_ptr(u->task, u->mask);
+			put_task_struct(u->task);
+		} else {
+			d = irq_get_irq_data(u->irq);
+			if (d && cpumask_equal(irq_data_get_affinity_mask(d), to))
+				irq_set_affinity(u->irq, u->mask);
+		}
+		free_cpumask_var(u->mask);
+	}
+
+	kfree(isolation_undo);
+	isolation_undo = NULL;
+	isolation_undo_n = 0;
+	free_cpumask_var(to);
+}
+
+static int isolation_set_wq(const struct cpumask *mask)
+{
+	cpumask_var_t wq;
+	int ret;
+
+	if (!alloc_cpumask_var(&wq, GFP_KERNEL))
+		return -ENOMEM;
+
+	/* The default of the workqueue code */
+	cpumask_and(wq, housekeeping_cpumask(HK_FLAG_DOMAIN | HK_FLAG_WQ), mask);
+	ret = workqueue_set_unbound_cpumask(wq);
+	free_cpumask_var(wq);
+	return ret;
+}
+
+static int isolation_start(const struct cpumask *cpus)
+{
+	struct task_struct *p;
+	unsigned int max = 0, irq;
+	int ret;
+
+	cpumask_andnot(&runtime_housekeeping_mask, cpu_possible_mask, cpus);
+	if (housekeeping_flags & HK_RUNTIME_FLAGS)
+		cpumask_and(&runtime_housekeeping_mask,
+			    &runtime_housekeeping_mask, housekeeping_mask);
+	if (!cpumask_intersects(&runtime_housekeeping_mask, cpu_online_mask))
+		return -EINVAL;
+	cpumask_copy(&runtime_isolated_mask, cpus);
+
+	/* Some room for kthreads that start while we count */
+	rcu_read_lock();
+	for_each_process(p)
+		max += isolation_task_movable(p);
+	rcu_read_unlock();
+	for_each_active_irq(irq)
+		max += isolation_irq_movable(irq);
+	max += 16;
+
+	isolation_undo = kcalloc(max, sizeof(*isolation_undo), GFP_KERNEL);
+	if (!isolation_undo)
+		return -ENOMEM;
+
+	ret = isolation_set_wq(&runtime_housekeeping_mask);
+	if (ret < 0) {
+		kfree(isolation_undo);
+		isolation_undo = NULL;
+		return ret;
+	}
+
+	rcu_read_lock();
+	/* kthreadd first, so that new kthreads get the new affinity */
+	if (isolation_task_movable(kthreadd_task))
+		isolation_record(kthreadd_task, 0, kthreadd_task->cpus_ptr, max);
+	for_each_process(p) {
+		if (p != kthreadd_task && isolation_task_movable(p))
+			isolation_record(p, 0, p->cpus_ptr, max);
+	}
+	rcu_read_unlock();
+
+	for_each_active_irq(irq) {
+		if (isolation_irq_movable(irq))
+			isolation_record(NULL, irq,
+				irq_data_get_affinity_mask(irq_get_irq_data(irq)),
+				max);
+	}
+
+	cpumask_copy(isolation_irq_default, irq_default_affinity);
+	isolation_target(irq_default_affinity, isolation_irq_default);
+
+	if (!static_key_enabled(&housekeeping_overridden))
+		static_branch_enable(&housekeeping_overridden);
+	WRITE_ONCE(runtime_isolation, true);
+
+	isolation_apply();
+	return 0;
+}
+
+static void isolation_stop(void)
+{
+	cpumask_var_t to;
+
+	WRITE_ONCE(runtime_isolation, false);
+
+	if (alloc_cpumask_var(&to, GFP_KERNEL)) {
+		isolation_target(to, isolation_irq_default);
+		if (cpumask_equal(irq_default_affinity, to))
+			cpumask_copy(irq_default_affinity, isolation_irq_default);
+		free_cpumask_var(to);
+	}
+	isolation_restore();
+	isolation_set_wq(cpu_possible_mask);
+
+	cpumask_clear(&runtime_isolated_mask);
+}
+
+static ssize_t cpus_show(struct kobject *kobj, struct kobj_attribute *attr,
+			 char *buf)
+{
+	ssize_t len;
+
+	mutex_lock(&isolation_mutex);
+	len = sprintf(buf, "%*pbl\n", cpumask_pr_args(&runtime_isolated_mask));
+	mutex_unlock(&isolation_mutex);
+	return len;
+}
+
+static ssize_t cpus_store(struct kobject *kobj, struct kobj_attribute *attr,
+			  const char *buf, size_t count)
+{
+	cpumask_var_t cpus;
+	int ret;
+
+	if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
+
+	ret = cpulist_parse(buf, cpus);
+	if (ret < 0 || cpumask_last(cpus) >= nr_cpu_ids) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	mutex_lock(&isolation_mutex);
+	if (runtime_isolation)
+		isolation_stop();
+	if (!cpumask_empty(cpus)) {
+		ret = isolation_start(cpus);
+		if (ret < 0)
+			cpumask_clear(&runtime_isolated_mask);
+	}
+	mutex_unlock(&isolation_mutex);
+
+out:
+	free_cpumask_var(cpus);
+	return ret < 0 ? ret : count;
+}
+
+static struct kobj_attribute isolation_cpus_attr = __ATTR_RW(cpus);
+
+static int __init isolation_sysfs_init(void)
+{
+	struct kobject *kobj;
+
+	if (!zalloc_cpumask_var(&isolation_irq_default, GFP_KERNEL))
+		return -ENOMEM;
+
+	kobj = kobject_create_and_add("isolation", kernel_kobj);
+	if (!kobj)
+		return -ENOMEM;
+
+	return sysfs_create_file(kobj, &isolation_cpus_attr.attr);
+}
+late_initcall(isolation_sysfs_init);
@@ -196,6 +196,18 @@ void posix_clock_unregister(struct posix_clock *clk)
 }
 EXPORT_SYMBOL_GPL(posix_clock_unregister);
 
+void posix_clock_get(struct posix_clock *clk)
+{
+	kref_get(&clk->kref);
+}
+EXPORT_SYMBOL_GPL(posix_clock_get);
+
+void posix_clock_put(struct posix_clock *clk)
+{
+	kref_put(&clk->kref, delete_clock);
+}
+EXPORT_SYMBOL_GPL(posix_clock_put);
+
 struct posix_clock_desc {
 	struct file *fp;
 	struct posix_clock *clk;
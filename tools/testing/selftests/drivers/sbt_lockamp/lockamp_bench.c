@@ -0,0 +1,356 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Read benchmark of the SBT Instruments lock-in amplifier driver
+ *
+ * For each decimation factor, measure:
+ *
+ *   - The read throughput (and check that no samples are lost or corrupt)
+ *   - The drain latency: The age of the newest sample of each chunk when
+ *     read() returns
+ *   - The overrun threshold: The longest pause between reads without loss
+ *
+ * Meant for the simulated hardware (CONFIG_SBT_LOCKAMP_SIM) where each
+ * sample holds its own sample count. See lockamp_sim.sh.
+ */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../../kselftest.h"
+
+#define SYSFS_PATH_FMT     "/sys/class/lockin_amplifier/%s/%s"
+#define ENTRIES_PER_SAMPLE 8
+#define SAMPLE_SIZE        (ENTRIES_PER_SAMPLE * sizeof(int32_t))
+#define VALUE_MASK         0x7fffffff
+#define READ_BUF_SIZE      (1 << 20)
+/* Small enough that the overrun threshold is quick to find */
+#define SIGNAL_BUF_SIZE    (1 << 18)
+#define LOW_WATERMARK_N    1024
+/* Tolerance of the throughput compared to the sample rate */
+#define RATE_TOLERANCE     0.05
+
+/* Chunk header version 2 (see drivers/char/sbt_lockamp/fops.c) */
+struct chunk_header {
+	uint64_t last_start_time_ns;
+	uint64_t time_step_ns;
+	uint64_t seq;
+	uint64_t dropped_n;
+	uint32_t flags;
+	uint32_t version;
+} __attribute__((packed));
+
+struct run {
+	uint64_t elapsed_ns;
+	uint64_t reads;
+	uint64_t samples;
+	uint64_t lost_n;
+	uint64_t corrupt_n;
+	uint64_t latency_sum_ns;
+	uint64_t latency_max_ns;
+};
+
+struct saved_attr {
+	const char *name;
+	unsigned long value;
+};
+
+static const unsigned int decimations[] = { 1, 2, 4, 8, 16 };
+static const char *dev_name = "sbt-lockamp-sim";
+static unsigned int duration_ms = 2000;
+static char *read_buf;
+
+static struct saved_attr saved_attrs[] = {
+	{ "decimation_factor", 0 },
+	{ "signal_buf_capacity", 0 },
+	{ "read_low_watermark", 0 },
+	{ "chunk_header_version", 0 },
+};
+
+static int sysfs_read(const char *attr, unsigned long *value)
+{
+	char path[256];
+	FILE *f;
+	int ret;
+	snprintf(path, sizeof(path), SYSFS_PATH_FMT, dev_name, attr);
+	f = fopen(path, "r");
+	if (!f)
+		return -errno;
+	ret = fscanf(f, "%lu", value);
+	fclose(f);
+	return (1 == ret) ? 0 : -EINVAL;
+}
+
+static int sysfs_write(const char *attr, unsigned long value)
+{
+	char path[256];
+	FILE *f;
+	int ret;
+	snprintf(path, sizeof(path), SYSFS_PATH_FMT, dev_name, attr);
+	f = fopen(path, "w");
+	if (!f)
+		return -errno;
+	ret = fprintf(f, "%lu\n", value);
+	if (EOF == fclose(f) || 0 > ret)
+		return -EIO;
+	return 0;
+}
+
+static uint64_t now_ns(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Count the entries that don't continue the sample count */
+static uint64_t check_chunk(const int32_t *data, size_t count, bool *have_next,
+                            uint32_t *next)
+{
+	uint64_t corrupt_n = 0;
+	uint32_t expected;
+	size_t i, j;
+	if (0 == count)
+		return 0;
+	if (!*have_next)
+		*next = data[0];
+	for (i = 0; count != i; ++i) {
+		expected = (*next + i) & VALUE_MASK;
+		for (j = 0; ENTRIES_PER_SAMPLE != j; ++j) {
+			if ((uint32_t)data[i * ENTRIES_PER_SAMPLE + j] != expected)
+				++corrupt_n;
+		}
+	}
+	*next = (data[(count - 1) * ENTRIES_PER_SAMPLE] + 1) & VALUE_MASK;
+	*have_next = true;
+	return corrupt_n;
+}
+
+/* Read for 'run_ns' and pause for 'pause_us' after each read */
+static int run_reader(uint64_t run_ns, unsigned int pause_us, struct run *run)
+{
+	struct chunk_header header;
+	uint64_t first_dropped_n = 0;
+	uint64_t start_ns, newest_ns, real_ns, latency_ns;
+	bool have_next = false;
+	bool first = true;
+	uint32_t next = 0;
+	size_t count;
+	ssize_t size;
+	char path[256];
+	int ret = 0;
+	int fd;
+
+	memset(run, 0, sizeof(*run));
+	snprintf(path, sizeof(path), "/dev/%s", dev_name);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -errno;
+	start_ns = now_ns(CLOCK_MONOTONIC);
+	while (now_ns(CLOCK_MONOTONIC) - start_ns < run_ns) {
+		size = read(fd, read_buf, READ_BUF_SIZE);
+		real_ns = now_ns(CLOCK_REALTIME);
+		if (size < 0) {
+			if (EINTR == errno)
+				continue;
+			ret = -errno;
+			break;
+		}
+		if ((size_t)size < sizeof(header)) {
+			ret = -EPROTO;
+			break;
+		}
+		memcpy(&header, read_buf, sizeof(header));
+		if (2 != header.version) {
+			ret = -EPROTO;
+			break;
+		}
+		count = (size - sizeof(header)) / SAMPLE_SIZE;
+		/* The FIFO may have overflowed before we opened the device */
+		if (first) {
+			first_dropped_n = header.dropped_n;
+			first = false;
+		} else if (header.flags) {
+			have_next = false;
+		}
+		run->corrupt_n += check_chunk((int32_t *)(read_buf + sizeof(header)),
+		                              count, &have_next, &next);
+		if (0 != count) {
+			newest_ns = header.last_start_time_ns +
+			            (count - 1) * header.time_step_ns;
+			latency_ns = (real_ns > newest_ns) ? real_ns - newest_ns : 0;
+			run->latency_sum_ns += latency_ns;
+			if (latency_ns > run->latency_max_ns)
+				run->latency_max_ns = latency_ns;
+		}
+		run->lost_n = header.dropped_n - first_dropped_n;
+		run->samples += count;
+		++run->reads;
+		if (pause_us)
+			usleep(pause_us);
+	}
+	run->elapsed_ns = now_ns(CLOCK_MONOTONIC) - start_ns;
+	close(fd);
+	return ret;
+}
+
+static void test_throughput(unsigned int decimation, unsigned long time_step_ns)
+{
+	double rate, expected_rate;
+	struct run run;
+	int ret;
+
+	ret = run_reader((uint64_t)duration_ms * 1000000, 0, &run);
+	if (ret < 0) {
+		ksft_test_result_error("decimation %u: throughput: read: %s\n",
+		                       decimation, strerror(-ret));
+		return;
+	}
+	rate = run.samples * 1e9 / run.elapsed_ns;
+	expected_rate = 1e9 / time_step_ns;
+	ksft_print_msg("decimation %u: %.0f samples/s (%.2f MB/s), expected %.0f samples/s\n",
+	               decimation, rate, rate * SAMPLE_SIZE / 1e6, expected_rate);
+	ksft_print_msg("decimation %u: drain latency avg %" PRIu64 " us, max %" PRIu64 " us (%" PRIu64 " reads)\n",
+	               decimation,
+	               run.reads ? run.latency_sum_ns / run.reads / 1000 : 0,
+	               run.latency_max_ns / 1000, run.reads);
+	if (run.lost_n || run.corrupt_n ||
+	    rate < expected_rate * (1 - RATE_TOLERANCE)) {
+		ksft_test_result_fail("decimation %u: throughput (lost %" PRIu64 ", corrupt %" PRIu64 ")\n",
+		                      decimation, run.lost_n, run.corrupt_n);
+		return;
+	}
+	ksft_test_result_pass("decimation %u: throughput\n", decimation);
+}
+
+/*
+ * Double the pause between reads (starting at an eighth of the signal
+ * buffer duration) until we lose samples.
+ */
+static void test_overrun_threshold(unsigned int decimation,
+                                   unsigned long time_step_ns)
+{
+	uint64_t buf_ns = (uint64_t)SIGNAL_BUF_SIZE / SAMPLE_SIZE * time_step_ns;
+	uint64_t pause_ns, run_ns;
+	uint64_t ok_ns = 0;
+	bool lost = false;
+	struct run run;
+	int ret;
+
+	for (pause_ns = buf_ns / 8; pause_ns <= 2 * buf_ns; pause_ns *= 2) {
+		run_ns = 4 * pause_ns;
+		if (run_ns < 250000000)
+			run_ns = 250000000;
+		ret = run_reader(run_ns, pause_ns / 1000, &run);
+		if (ret < 0) {
+			ksft_test_result_error("decimation %u: overrun threshold: read: %s\n",
+			                       decimation, strerror(-ret));
+			return;
+		}
+		if (run.corrupt_n) {
+			ksft_test_result_fail("decimation %u: overrun threshold (corrupt %" PRIu64 ")\n",
+			                      decimation, run.corrupt_n);
+			return;
+		}
+		if (run.lost_n) {
+			lost = true;
+			break;
+		}
+		ok_ns = pause_ns;
+	}
+	if (lost)
+		ksft_print_msg("decimation %u: no loss up to a %" PRIu64 " us pause, loss at %" PRIu64 " us (signal buffer: %" PRIu64 " us)\n",
+		               decimation, ok_ns / 1000, pause_ns / 1000, buf_ns / 1000);
+	else
+		ksft_print_msg("decimation %u: no loss up to a %" PRIu64 " us pause (signal buffer: %" PRIu64 " us)\n",
+		               decimation, ok_ns / 1000, buf_ns / 1000);
+	/* The signal buffer must at least cover half of its own duration */
+	if (ok_ns < buf_ns / 2) {
+		ksft_test_result_fail("decimation %u: overrun threshold\n", decimation);
+		return;
+	}
+	ksft_test_result_pass("decimation %u: overrun threshold\n", decimation);
+}
+
+static void save_attrs(void)
+{
+	size_t i;
+	for (i = 0; i < sizeof(saved_attrs) / sizeof(saved_attrs[0]); ++i) {
+		if (sysfs_read(saved_attrs[i].name, &saved_attrs[i].value) < 0)
+			ksft_exit_skip("%s: can't read '%s'\n", dev_name,
+			               saved_attrs[i].name);
+	}
+}
+
+static void restore_attrs(void)
+{
+	size_t i;
+	for (i = 0; i < sizeof(saved_attrs) / sizeof(saved_attrs[0]); ++i)
+		sysfs_write(saved_attrs[i].name, saved_attrs[i].value);
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-d device] [-t duration_ms]\n", name);
+	exit(KSFT_FAIL);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long time_step_ns;
+	unsigned int decimation;
+	size_t i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:t:")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev_name = optarg;
+			break;
+		case 't':
+			duration_ms = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+
+	ksft_print_header();
+	save_attrs();
+	read_buf = malloc(READ_BUF_SIZE);
+	if (!read_buf)
+		ksft_exit_fail_msg("malloc: %s\n", strerror(errno));
+	if (sysfs_write("signal_buf_capacity", SIGNAL_BUF_SIZE) < 0 ||
+	    sysfs_write("read_low_watermark", LOW_WATERMARK_N) < 0 ||
+	    sysfs_write("chunk_header_version", 2) < 0) {
+		restore_attrs();
+		ksft_exit_fail_msg("%s: failed to configure the device\n", dev_name);
+	}
+
+	ksft_set_plan(2 * sizeof(decimations) / sizeof(decimations[0]));
+	for (i = 0; i < sizeof(decimations) / sizeof(decimations[0]); ++i) {
+		decimation = decimations[i];
+		if (sysfs_write("decimation_factor", decimation) < 0 ||
+		    sysfs_read("time_step_ns", &time_step_ns) < 0 ||
+		    0 == time_step_ns) {
+			ksft_test_result_error("decimation %u: configure\n", decimation);
+			ksft_test_result_skip("decimation %u: overrun threshold\n", decimation);
+			continue;
+		}
+		test_throughput(decimation, time_step_ns);
+		test_overrun_threshold(decimation, time_step_ns);
+	}
+
+	restore_attrs();
+	free(read_buf);
+	ksft_print_cnts();
+	return ksft_get_fail_cnt() || ksft_get_error_cnt() ? KSFT_FAIL : KSFT_PASS;
+}
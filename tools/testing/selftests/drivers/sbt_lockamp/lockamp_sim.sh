@@ -0,0 +1,37 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+# Run the read benchmark against the simulated lock-in amplifier. Loads the
+# driver with "sim=1" unless the simulated device is already there.
+
+# Kselftest framework requirement - SKIP code is 4.
+ksft_skip=4
+
+dev=sbt-lockamp-sim
+loaded=0
+
+if [ "$(id -u)" != 0 ]; then
+	echo "lockamp_sim: [SKIP] must be run as root"
+	exit $ksft_skip
+fi
+
+if [ ! -e /dev/$dev ]; then
+	if ! modprobe sbt_lockamp_m sim=1; then
+		echo "lockamp_sim: [SKIP] can't load sbt_lockamp_m with sim=1"
+		exit $ksft_skip
+	fi
+	loaded=1
+	udevadm settle 2>/dev/null
+fi
+
+if [ ! -e /dev/$dev ]; then
+	echo "lockamp_sim: [SKIP] no /dev/$dev (CONFIG_SBT_LOCKAMP_SIM?)"
+	[ $loaded = 1 ] && modprobe -r sbt_lockamp_m
+	exit $ksft_skip
+fi
+
+./lockamp_bench -d $dev "$@"
+ret=$?
+
+[ $loaded = 1 ] && modprobe -r sbt_lockamp_m
+exit $ret